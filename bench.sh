@@ -0,0 +1,47 @@
+#!/bin/bash
+
+# Run every benchmark scenario headless and append the results to one CSV,
+# labelled with the commit so runs of different builds can be compared.  Run
+# after the build (as the bench build target does), from the repository
+#
+#   ./bench.sh [results.csv] [extra arguments for main, e.g. --frames 600]
+#
+# With --baseline baseline.csv it fails if any scenario has regressed, see
+# bench.c
+
+OUTPUT="$(realpath -m "${1:-bench_results.csv}")"
+shift
+
+# The baseline is opened from dist/
+ARGS=()
+while [ $# -gt 0 ]; do
+	if [ "$1" = "--baseline" ] && [ $# -gt 1 ]; then
+		ARGS+=("$1" "$(realpath -m "$2")")
+		shift 2
+	else
+		ARGS+=("$1")
+		shift
+	fi
+done
+LABEL="$(git rev-parse --short HEAD 2>/dev/null || echo unknown)"
+
+cd dist || { echo "dist not found - build first"; exit 1; }
+
+if [ ! -x ./main ]; then
+	echo "dist/main not found - build first"
+	exit 1
+fi
+
+# Each scenario is its own run, so one doesn't leave caches or memory warmed
+# up for the next
+FAILED=0
+for SCENARIO in $(./main --bench-list); do
+	echo "Running $SCENARIO"
+	./main --bench "$SCENARIO" --headless --output "$OUTPUT" --label "$LABEL" "${ARGS[@]}" > /dev/null || {
+		echo "$SCENARIO failed"
+		FAILED=1
+	}
+done
+
+echo "Results in $OUTPUT"
+exit $FAILED
@@ -18,10 +18,19 @@ for SHADER_FILE in "$SHADER_DIR"/*; do
   OUTPUT_FILE="$SHADER_DIR/${FILENAME}.spv"
 
   # Check if the file is a valid shader file (you can add more extensions as needed)
-  if [[ "$SHADER_FILE" == *.vert || "$SHADER_FILE" == *.frag ]]; then
+  if [[ "$SHADER_FILE" == *.vert || "$SHADER_FILE" == *.frag || "$SHADER_FILE" == *.comp || "$SHADER_FILE" == *.task || "$SHADER_FILE" == *.mesh ]]; then
+	  # Task and mesh shaders need SPIR-V 1.4, and compute shaders' subgroup
+	  # operations 1.3, so a newer target than the default
+	  TARGET_ENV="vulkan1.0"
+	  if [[ "$SHADER_FILE" == *.task || "$SHADER_FILE" == *.mesh ]]; then
+		  TARGET_ENV="vulkan1.3"
+	  elif [[ "$SHADER_FILE" == *.comp ]]; then
+		  TARGET_ENV="vulkan1.1"
+	  fi
+
 	  # Compile the shader
 	  echo "Compiling $SHADER_FILE to $OUTPUT_FILE..."
-	  glslc "$SHADER_FILE" -o "$OUTPUT_FILE"
+	  glslc --target-env="$TARGET_ENV" "$SHADER_FILE" -o "$OUTPUT_FILE"
 
 	# Check if the compilation was successful
 	if [ $? -eq 0 ]; then
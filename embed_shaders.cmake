@@ -0,0 +1,34 @@
+# Writes the .spv files from compile_shaders.sh into a C file as word arrays,
+# for the EMBED_SHADERS option in CMakeLists.txt.  Run with
+#
+#   cmake -DSHADER_DIR=<shaders directory> -DOUTPUT=<C file> -P embed_shaders.cmake
+
+file(GLOB SHADER_SPV_FILES "${SHADER_DIR}/*.spv")
+list(SORT SHADER_SPV_FILES)
+
+set(CONTENTS "// Generated by embed_shaders.cmake from the compiled shaders - don't edit\n\n")
+string(APPEND CONTENTS "#include \"vkx/vkx_pipeline.h\"\n\n")
+
+set(TABLE "")
+set(INDEX 0)
+foreach(SHADER_FILE ${SHADER_SPV_FILES})
+	get_filename_component(FILE_NAME ${SHADER_FILE} NAME)
+	file(READ ${SHADER_FILE} HEX_CODE HEX)
+	file(SIZE ${SHADER_FILE} CODE_SIZE)
+
+	# SPIR-V is a stream of little endian words
+	string(REGEX REPLACE "([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])([0-9a-f][0-9a-f])" "0x\\4\\3\\2\\1," WORDS "${HEX_CODE}")
+
+	string(APPEND CONTENTS "// ${FILE_NAME}\nstatic const uint32_t shader_${INDEX}[] = {${WORDS}};\n\n")
+	string(APPEND TABLE "\t{\"shaders/${FILE_NAME}\", shader_${INDEX}, ${CODE_SIZE}},\n")
+	math(EXPR INDEX "${INDEX} + 1")
+endforeach()
+
+if(INDEX EQUAL 0)
+	message(FATAL_ERROR "No compiled shaders in ${SHADER_DIR} - run compile_shaders.sh first")
+endif()
+
+string(APPEND CONTENTS "const VkxEmbeddedShader vkx_embedded_shaders[] = {\n${TABLE}};\n\n")
+string(APPEND CONTENTS "const uint32_t vkx_embedded_shaders_count = ${INDEX};\n")
+
+file(WRITE ${OUTPUT} "${CONTENTS}")
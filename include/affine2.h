@@ -0,0 +1,36 @@
+#ifndef AFFINE2_H
+#define AFFINE2_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <cglm/cglm.h>
+
+// A 2D affine transform, the top two rows of a 3x3 matrix, in 24 bytes rather
+// than a mat4's 64:
+//
+//   x' = a x + c y + tx
+//   y' = b x + d y + ty
+//
+// So (a, b) is where the x axis goes and (c, d) the y axis, column by column
+// like cglm's matrices
+typedef struct {
+	float a;
+	float b;
+	float c;
+	float d;
+	float tx;
+	float ty;
+} Affine2;
+
+void affine2_identity(Affine2* t);
+void affine2_make(Affine2* t, const float translation[2], float rotation, const float scale[2]);
+void affine2_mul(const Affine2* first, const Affine2* second, Affine2* out);
+bool affine2_inverse(const Affine2* t, Affine2* out);
+void affine2_apply(const Affine2* t, const float point[2], float out[2]);
+void affine2_to_mat4(const Affine2* t, float z, mat4 out);
+
+void affine2_mul_batch(const Affine2* first, const Affine2* second, Affine2* out, uint32_t count);
+void affine2_inverse_batch(const Affine2* t, Affine2* out, uint32_t count);
+void affine2_transform_points(const Affine2* t, const float* x, const float* y, float* out_x, float* out_y, uint32_t count);
+
+#endif // AFFINE2_H
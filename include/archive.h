@@ -0,0 +1,66 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "io.h"
+
+/*
+ * Asset archive layout (all little endian):
+ *
+ *   ArchiveHeader
+ *   ArchiveEntry[entries_count], sorted by name hash
+ *   payloads, each starting on an ARCHIVE_ALIGNMENT boundary
+ *
+ * Entries are found by the FNV-1a hash of their path (e.g.
+ * "shaders/sprite.vert.spv"), which the packer makes sure are unique.
+ */
+#define ARCHIVE_MAGIC 0x4b505856 // "VXPK"
+#define ARCHIVE_VERSION 1
+// Payload alignment, which suits direct (unbuffered) and async reads
+#define ARCHIVE_ALIGNMENT 4096
+
+typedef enum {
+	ARCHIVE_COMPRESSION_NONE = 0,
+	// A raw LZ4 block (lz4_block.h)
+	ARCHIVE_COMPRESSION_LZ4 = 1,
+} ArchiveCompression;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entries_count;
+	uint32_t _padding;
+} ArchiveHeader;
+
+typedef struct {
+	uint64_t name_hash;
+	// From the start of the archive
+	uint64_t offset;
+	// Stored and decompressed sizes, which are the same without compression
+	uint64_t size;
+	uint64_t uncompressed_size;
+	uint32_t compression;
+	uint32_t _padding;
+} ArchiveEntry;
+
+typedef struct {
+	MappedFile file;
+	const ArchiveEntry* entries;
+	uint32_t entries_count;
+} Archive;
+
+uint64_t archive_hash_name(const char* name);
+
+bool archive_open(Archive* archive, const char* filename);
+void archive_close(Archive* archive);
+const ArchiveEntry* archive_find(const Archive* archive, const char* name);
+bool archive_map_entry(const Archive* archive, const char* name, MappedFile* file);
+
+void archive_mount(const Archive* archive);
+bool archive_map_mounted(const char* name, MappedFile* file);
+bool archive_mounted_has(const char* name);
+
+#endif // ARCHIVE_H
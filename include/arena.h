@@ -0,0 +1,36 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bytes in each thread's frame arena
+#define FRAME_ARENA_SIZE (4 * 1024 * 1024)
+// Threads which can have a frame arena (the job system's, plus the texture
+// streaming thread and any others)
+#define FRAME_ARENA_MAX_THREADS 96
+
+// Memory handed out in order from one block, and given back all at once
+typedef struct {
+	uint8_t* data;
+	size_t capacity;
+	size_t used;
+} Arena;
+
+// Allocate count of a type from an arena
+#define ARENA_ALLOC(arena, type, count) ((type*) arena_alloc((arena), sizeof(type) * (count), _Alignof(type)))
+// Allocate count of a type from the calling thread's frame arena
+#define FRAME_ALLOC(type, count) ARENA_ALLOC(frame_arena(), type, count)
+
+void arena_init(Arena* arena, size_t capacity);
+void arena_cleanup(Arena* arena);
+
+void* arena_alloc(Arena* arena, size_t size, size_t alignment);
+size_t arena_get_mark(const Arena* arena);
+void arena_release(Arena* arena, size_t mark);
+void arena_reset(Arena* arena);
+
+Arena* frame_arena(void);
+void frame_arenas_cleanup(void);
+
+#endif // ARENA_H
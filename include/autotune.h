@@ -0,0 +1,27 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+// The render paths picked by measuring them on this device, kept in a file
+// next to the pipeline cache so they're only measured on the first run (or
+// after the driver changes)
+
+#define AUTOTUNE_MAX_CHOICES 16
+#define AUTOTUNE_MAX_NAME 32
+
+typedef struct {
+	char name[AUTOTUNE_MAX_NAME];
+	uint32_t value;
+} AutotuneChoice;
+
+void autotune_load(const char* path);
+void autotune_save(void);
+bool autotune_get(const char* name, uint32_t* value);
+void autotune_set(const char* name, uint32_t value);
+
+double autotune_time_upload(VkDeviceSize size, bool device_local);
+
+#endif // AUTOTUNE_H
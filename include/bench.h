@@ -0,0 +1,82 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BENCH_MAX_PHASES 24
+// Seed for everything random in a benchmark run, so each run of a scenario
+// draws the same map and monsters
+#define BENCH_SEED 12345u
+// Time step of the simulation in a benchmark run, as a replay would have
+#define BENCH_TIME_STEP (1.0 / 60.0)
+// Fraction a phase's p50 can be slower than its baseline before it counts as a
+// regression, and how many ms it has to be slower by anyway, so phases which
+// take next to no time don't fail on noise
+#define BENCH_DEFAULT_TOLERANCE 0.1
+#define BENCH_MIN_REGRESSION_MS 0.05
+// A phase which isn't timed, whose samples are ignored
+#define BENCH_NO_PHASE UINT32_MAX
+
+typedef struct {
+	const char* name;
+	uint32_t sprites_count;
+	// Size of the map in tiles, which is drawn chunked if it's bigger than
+	// the screen.  The camera pans across it at camera_speed tiles a second
+	uint32_t map_width;
+	uint32_t map_height;
+	float camera_speed;
+	bool post_effects;
+} BenchScenario;
+
+typedef struct {
+	// NULL unless benchmarking
+	const BenchScenario* scenario;
+	bool headless;
+	// Frames run before the timings start, then the frames timed
+	uint32_t warmup_frames;
+	uint32_t frames;
+	// Results are appended to this, as CSV or as JSON lines if it ends in
+	// .json.  NULL to only print them
+	const char* output;
+	// Identifies the build in the results, e.g. the commit
+	const char* label;
+	// Results CSV to compare against, from an earlier run on the same device.
+	// NULL for no comparison
+	const char* baseline;
+	double tolerance;
+	// Replay log to write the run's inputs to, or to run them again from.
+	// NULL for neither
+	const char* record;
+	const char* replay;
+	// Level snapshot to load instead of generating the level, and to save the
+	// generated level to.  NULL for neither
+	const char* level;
+	const char* save_level;
+} BenchOptions;
+
+typedef struct {
+	double min;
+	double avg;
+	double p50;
+	double p95;
+	double p99;
+	double max;
+	uint32_t samples_count;
+} BenchStats;
+
+bool bench_parse_args(int argc, char** argv, BenchOptions* options);
+void bench_print_scenarios(void);
+
+void bench_begin(const BenchOptions* options);
+void bench_end(void);
+bool bench_is_running(void);
+
+uint32_t bench_add_phase(const char* name);
+uint32_t bench_add_startup_phase(const char* name);
+void bench_add_sample(uint32_t phase, double ms);
+BenchStats bench_get_stats(uint32_t phase);
+bool bench_write_results(const char* device_name);
+bool bench_check_baseline(const char* device_name);
+
+#endif // BENCH_H
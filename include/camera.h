@@ -0,0 +1,71 @@
+#ifndef CAMERA_H
+#define CAMERA_H
+
+#include <stdbool.h>
+#include <cglm/cglm.h>
+
+#include "affine2.h"
+
+typedef struct {
+	// World units across the view at zoom 1, and the depth range
+	vec2 view_size;
+	float near_z;
+	float far_z;
+
+	// Where the view is centred before shaking, and how far in.  Above 1 shows
+	// less of the world
+	vec2 centre;
+	float zoom;
+	float min_zoom;
+	float max_zoom;
+
+	// The view is kept inside these, or centred on them if it's bigger
+	bool bounded;
+	vec2 bounds_min;
+	vec2 bounds_max;
+
+	// Shake is trauma squared times max_shake world units of offset.  Trauma
+	// goes from 0 to 1 and wears off at shake_decay a second
+	float trauma;
+	float shake_decay;
+	float max_shake;
+	float shake_time;
+
+	// Screen pixels per world unit at zoom 1, the view is snapped to whole
+	// pixels with this so sprites don't shimmer as it moves.  0 doesn't snap
+	float pixels_per_unit;
+
+	// Set by camera_update(): the centre after shaking and snapping, the
+	// matrices, and the rectangle in view as min x, min y, max x, max y.
+	// view_2d is the view without the depth, from the world to view units
+	vec2 eye;
+	Affine2 view_2d;
+	mat4 projection;
+	mat4 view;
+	mat4 view_projection;
+	float visible[4];
+	// And how fast the centre is moving, in world units a second, smoothed
+	// over the last few updates.  From where it was at the last update
+	vec2 velocity;
+	vec2 last_centre;
+} Camera;
+
+void camera_init(Camera* camera, float view_width, float view_height, float near_z, float far_z);
+void camera_set_bounds(Camera* camera, const float min[2], const float max[2]);
+void camera_set_zoom_range(Camera* camera, float min_zoom, float max_zoom);
+
+void camera_set_centre(Camera* camera, const float centre[2]);
+void camera_move(Camera* camera, const float offset[2]);
+void camera_set_zoom(Camera* camera, float zoom);
+void camera_shake(Camera* camera, float trauma);
+
+void camera_update(Camera* camera, float dt);
+
+void camera_view_affine(const Camera* camera, float parallax, Affine2* view);
+void camera_view_projection(const Camera* camera, float parallax, mat4 view_projection);
+void camera_visible_rect(const Camera* camera, float parallax, float rect[4]);
+void camera_lookahead_rect(const Camera* camera, float seconds, float rect[4]);
+bool camera_is_visible(const Camera* camera, const float rect[4]);
+void camera_screen_to_world(const Camera* camera, float u, float v, float world[2]);
+
+#endif // CAMERA_H
@@ -0,0 +1,83 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+#include "vkx/vkx_core.h"
+#include "vkx/vkx_frame_graph.h"
+
+// Readback buffers, enough for every frame in flight to have one while the
+// writer thread is still on a couple of older frames
+#define CAPTURE_BUFFERS (VKX_MAX_FRAMES_IN_FLIGHT + 2)
+
+// Images the frames are exported into, which the consumer has until it
+// releases them
+#define CAPTURE_EXPORT_IMAGES 4
+// Usage of the export images, which an importer of their opaque fds has to
+// create its images with
+#define CAPTURE_EXPORT_USAGE (VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT)
+
+typedef enum {
+	// Binary PPM, for screenshots
+	CAPTURE_FORMAT_PPM,
+	// Tightly packed 8 bit RGBA frames one after another, with no header
+	CAPTURE_FORMAT_RAW,
+	// YUV4MPEG2 with full resolution (4:4:4) chroma, which ffmpeg and most
+	// players read as is
+	CAPTURE_FORMAT_Y4M,
+} CaptureFormat;
+
+typedef struct {
+	uint64_t frames_written;
+	// Frames which would have been captured, but every readback buffer was
+	// in use or the image was the wrong size or format
+	uint64_t frames_dropped;
+} CaptureStats;
+
+// A frame exported for another API or process, e.g. a hardware video encoder
+typedef struct {
+	// Which export image it is in, for capture_release_export()
+	uint32_t index;
+	// File descriptor for the image's memory, which stays the capture's (dup
+	// it to keep it past capture_stop_export())
+	int fd;
+	// The fd is a dma-buf of a linear image.  Otherwise it is an opaque fd of
+	// an optimally tiled image, to import into Vulkan (or CUDA etc.) with the
+	// same format, extent and CAPTURE_EXPORT_USAGE
+	bool dma_buf;
+	VkDeviceSize memory_size;
+	// Where the pixels are in the memory of a dma-buf
+	VkDeviceSize offset;
+	VkDeviceSize row_pitch;
+	VkFormat format;
+	VkExtent2D extent;
+	// Counts up from 1 with each frame exported
+	uint64_t frame_number;
+} CaptureExportFrame;
+
+// Called on the render thread once the frame's copy has finished on the GPU,
+// so it can be encoded straight away.  Should hand the frame over and return
+typedef void (*CaptureExportFunc)(const CaptureExportFrame* frame, void* data);
+
+void capture_init(void);
+void capture_cleanup(void);
+
+void capture_screenshot(const char* filename);
+bool capture_start_recording(const char* filename, CaptureFormat format, uint32_t frame_rate);
+void capture_stop_recording(void);
+bool capture_is_recording(void);
+bool capture_is_wanted(void);
+
+bool capture_can_export(void);
+bool capture_start_export(VkFormat format, VkExtent2D extent, CaptureExportFunc func, void* data);
+void capture_stop_export(void);
+void capture_release_export(uint32_t index);
+
+void capture_record(VkCommandBuffer command_buffer, uint32_t frame, VkImage image, VkFormat format,
+		VkExtent2D extent, VkxFrameGraphState final);
+void capture_retire(uint32_t frame);
+CaptureStats capture_get_stats(void);
+
+#endif // CAPTURE_H
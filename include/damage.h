@@ -0,0 +1,40 @@
+#ifndef DAMAGE_H
+#define DAMAGE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <cglm/cglm.h>
+
+// Most frames a DamageHistory remembers
+#define DAMAGE_MAX_HISTORY 8
+
+// What changed in the world since the last frame, as one rectangle around all
+// of it (min x, min y, max x, max y) if changed is set, or everything.  Zero
+// is nothing
+typedef struct {
+	float rect[4];
+	bool changed;
+	bool full;
+} Damage;
+
+// The pixels each of the last few frames changed, as min x, min y, max x, max
+// y (exclusive).  Empty where the max isn't past the min
+typedef struct {
+	int32_t pixels[DAMAGE_MAX_HISTORY][4];
+	uint32_t next;
+} DamageHistory;
+
+void damage_clear(Damage* damage);
+void damage_add_everything(Damage* damage);
+void damage_add_rect(Damage* damage, const float rect[4]);
+void damage_add_sprite(Damage* damage, const float pos[2], float radius);
+void damage_add_moving_sprite(Damage* damage, const float from[2], const float to[2], float radius);
+void damage_get_pixels(const Damage* damage, mat4 view_projection, uint32_t width, uint32_t height, int32_t pixels[4]);
+
+void damage_history_push(DamageHistory* history, const int32_t pixels[4]);
+void damage_history_get(const DamageHistory* history, uint32_t frames, int32_t pixels[4]);
+
+uint64_t damage_hash(const void* data, size_t size);
+
+#endif // DAMAGE_H
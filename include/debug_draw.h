@@ -0,0 +1,146 @@
+#ifndef DEBUG_DRAW_H
+#define DEBUG_DRAW_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+#include <SDL3/SDL_atomic.h>
+
+#include "vkx/vkx_core.h"
+#include "vkx/vkx_pipeline.h"
+
+// Lines, boxes and circles in world space over the finished frame, for seeing
+// what collision, pathing and culling are doing.  Built with NDEBUG (i.e.
+// release builds) they compile out to nothing
+
+// Most lines in a frame, anything past this is left out
+#define DEBUG_DRAW_MAX_LINES 16384
+// Segments of a circle
+#define DEBUG_DRAW_CIRCLE_SEGMENTS 24
+
+// Packs a colour as the R8G8B8A8_UNORM the shader reads
+#define DEBUG_RGBA(r, g, b, a) ((uint32_t) (r) | (uint32_t) (g) << 8 | (uint32_t) (b) << 16 | (uint32_t) (a) << 24)
+
+// One instance of debug_line.vert, a segment in world space (24 bytes)
+typedef struct {
+	float a[2];
+	float b[2];
+	uint32_t color;
+	// In screen pixels, whatever the zoom
+	float width;
+} DebugLine;
+
+// A frame's lines, added to from any thread between debug_draw_begin() and
+// debug_draw_end()
+typedef struct {
+	DebugLine* lines;
+	uint32_t capacity;
+	SDL_AtomicInt reserved;
+	// Set by debug_draw_end()
+	uint32_t count;
+} DebugDrawList;
+
+typedef struct {
+	float view_projection[16];
+	float output_size[2];
+	uint32_t pre_rotation;
+} DebugDrawPushConstants;
+
+typedef struct {
+	VkxPipeline pipeline;
+	DebugDrawPushConstants push_constants;
+} DebugDraw;
+
+#ifndef NDEBUG
+
+void debug_draw_init(DebugDraw* draw, VkFormat color_format);
+void debug_draw_cleanup(DebugDraw* draw);
+void debug_draw_set_view(DebugDraw* draw, const float view_projection[16], VkExtent2D output_size, uint32_t pre_rotation);
+void debug_draw_record(DebugDraw* draw, VkCommandBuffer command_buffer, VkxRingBuffer* ring, const DebugDrawList* list);
+
+void debug_draw_list_init(DebugDrawList* list, uint32_t capacity);
+void debug_draw_list_cleanup(DebugDrawList* list);
+void debug_draw_list_swap(DebugDrawList* a, DebugDrawList* b);
+
+void debug_draw_begin(DebugDrawList* list);
+void debug_draw_line(const float a[2], const float b[2], uint32_t color, float width);
+void debug_draw_rect(const float rect[4], uint32_t color, float width);
+void debug_draw_circle(const float centre[2], float radius, uint32_t color, float width);
+void debug_draw_arrow(const float from[2], const float to[2], uint32_t color, float width);
+void debug_draw_end(void);
+
+#else
+
+static inline void debug_draw_init(DebugDraw* draw, VkFormat color_format) {
+	(void) draw;
+	(void) color_format;
+}
+
+static inline void debug_draw_cleanup(DebugDraw* draw) {
+	(void) draw;
+}
+
+static inline void debug_draw_set_view(DebugDraw* draw, const float view_projection[16], VkExtent2D output_size, uint32_t pre_rotation) {
+	(void) draw;
+	(void) view_projection;
+	(void) output_size;
+	(void) pre_rotation;
+}
+
+static inline void debug_draw_record(DebugDraw* draw, VkCommandBuffer command_buffer, VkxRingBuffer* ring, const DebugDrawList* list) {
+	(void) draw;
+	(void) command_buffer;
+	(void) ring;
+	(void) list;
+}
+
+static inline void debug_draw_list_init(DebugDrawList* list, uint32_t capacity) {
+	(void) list;
+	(void) capacity;
+}
+
+static inline void debug_draw_list_cleanup(DebugDrawList* list) {
+	(void) list;
+}
+
+static inline void debug_draw_list_swap(DebugDrawList* a, DebugDrawList* b) {
+	(void) a;
+	(void) b;
+}
+
+static inline void debug_draw_begin(DebugDrawList* list) {
+	(void) list;
+}
+
+static inline void debug_draw_line(const float a[2], const float b[2], uint32_t color, float width) {
+	(void) a;
+	(void) b;
+	(void) color;
+	(void) width;
+}
+
+static inline void debug_draw_rect(const float rect[4], uint32_t color, float width) {
+	(void) rect;
+	(void) color;
+	(void) width;
+}
+
+static inline void debug_draw_circle(const float centre[2], float radius, uint32_t color, float width) {
+	(void) centre;
+	(void) radius;
+	(void) color;
+	(void) width;
+}
+
+static inline void debug_draw_arrow(const float from[2], const float to[2], uint32_t color, float width) {
+	(void) from;
+	(void) to;
+	(void) color;
+	(void) width;
+}
+
+static inline void debug_draw_end(void) {}
+
+#endif // NDEBUG
+
+#endif // DEBUG_DRAW_H
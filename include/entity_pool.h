@@ -0,0 +1,54 @@
+#ifndef ENTITY_POOL_H
+#define ENTITY_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A handle is the entity's slot, with the slot's generation above it so a
+// handle to a destroyed entity doesn't pick up whatever took its slot
+#define ENTITY_POOL_INDEX_BITS 24
+#define ENTITY_POOL_INDEX_MASK ((1u << ENTITY_POOL_INDEX_BITS) - 1)
+#define ENTITY_POOL_MAX_ENTITIES (1u << ENTITY_POOL_INDEX_BITS)
+#define ENTITY_POOL_NO_HANDLE UINT32_MAX
+#define ENTITY_POOL_NO_INDEX UINT32_MAX
+
+#define ENTITY_POOL_MAX_COLUMNS 16
+
+typedef uint32_t EntityHandle;
+
+typedef struct {
+	// Where the caller keeps its pointer to the column
+	void** data;
+	size_t element_size;
+} EntityPoolColumn;
+
+typedef struct {
+	uint32_t capacity;
+	// The entities are packed in [0, count) of every column
+	uint32_t count;
+	EntityPoolColumn columns[ENTITY_POOL_MAX_COLUMNS];
+	uint32_t columns_count;
+	// Slot to dense index, and back
+	uint32_t* dense_indices;
+	uint32_t* slots;
+	uint8_t* generations;
+	// Slots which have ever been used, and the destroyed ones, reused last in
+	// first out
+	uint32_t slots_count;
+	uint32_t* free_slots;
+	uint32_t free_count;
+} EntityPool;
+
+void entity_pool_init(EntityPool* pool, uint32_t capacity);
+void entity_pool_add_column(EntityPool* pool, void** data, size_t element_size);
+void entity_pool_cleanup(EntityPool* pool);
+
+EntityHandle entity_pool_create(EntityPool* pool);
+void entity_pool_destroy(EntityPool* pool, EntityHandle handle);
+void entity_pool_destroy_index(EntityPool* pool, uint32_t index);
+bool entity_pool_is_valid(const EntityPool* pool, EntityHandle handle);
+uint32_t entity_pool_get_index(const EntityPool* pool, EntityHandle handle);
+EntityHandle entity_pool_get_handle(const EntityPool* pool, uint32_t index);
+
+#endif // ENTITY_POOL_H
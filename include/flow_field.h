@@ -0,0 +1,52 @@
+#ifndef FLOW_FIELD_H
+#define FLOW_FIELD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <SDL3/SDL_atomic.h>
+
+#include "tile_collision.h"
+
+// Distance of the tiles which can't reach the target
+#define FLOW_FIELD_UNREACHABLE INT32_MAX
+// Direction of the target's tile and those with no way to it
+#define FLOW_FIELD_NO_DIRECTION 8
+
+// Paths from every tile to a target tile through the ones which aren't solid
+typedef struct {
+	// Read whenever the field is recomputed, and not owned
+	const TileSolidity* solidity;
+	uint32_t width;
+	uint32_t height;
+	uint32_t target[2];
+
+	// Steps to the target of each tile, row by row, updated by the wavefront
+	SDL_AtomicInt* distances;
+	// Which of the 8 neighbours to head for from each tile, or
+	// FLOW_FIELD_NO_DIRECTION
+	uint8_t* directions;
+
+	// The wavefront being spread, and the next one
+	uint32_t* frontier;
+	uint32_t frontier_count;
+	uint32_t* next_frontier;
+	SDL_AtomicInt next_frontier_count;
+
+	// Tiles changed since the last flow_field_update()
+	uint32_t* opened;
+	uint32_t opened_count;
+	uint32_t opened_capacity;
+	bool closed;
+} FlowField;
+
+void flow_field_init(FlowField* field, const TileSolidity* solidity);
+void flow_field_cleanup(FlowField* field);
+
+void flow_field_set_target(FlowField* field, uint32_t x, uint32_t y);
+void flow_field_tile_changed(FlowField* field, uint32_t x, uint32_t y, bool solid);
+void flow_field_update(FlowField* field);
+
+bool flow_field_sample(const FlowField* field, float x, float y, float direction[2]);
+int32_t flow_field_get_distance(const FlowField* field, uint32_t x, uint32_t y);
+
+#endif // FLOW_FIELD_H
@@ -0,0 +1,20 @@
+#ifndef FRAME_PIPELINE_H
+#define FRAME_PIPELINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Snapshots of the frame state, one being written while the other is drawn
+#define FRAME_PIPELINE_SNAPSHOTS 2
+
+// Draws the frame from one of the snapshots
+typedef void (*FramePipelineRenderFunc)(uint32_t snapshot, void* data);
+
+void frame_pipeline_init(bool threaded, FramePipelineRenderFunc render, void* data);
+void frame_pipeline_cleanup(void);
+
+uint32_t frame_pipeline_begin_snapshot(void);
+void frame_pipeline_publish(void);
+void frame_pipeline_sync(void);
+
+#endif // FRAME_PIPELINE_H
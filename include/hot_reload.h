@@ -0,0 +1,40 @@
+#ifndef HOT_RELOAD_H
+#define HOT_RELOAD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "vkx/vkx_core.h"
+
+// Shaders and textures which are watched for changes on disk, for editing
+// them while the game runs
+
+#define HOT_RELOAD_MAX_FILES 128
+#define HOT_RELOAD_MAX_PATH 256
+
+typedef enum {
+	// A .spv file, which is compiled again from its GLSL when that changes
+	HOT_RELOAD_SHADER,
+	HOT_RELOAD_TEXTURE,
+} HotReloadKind;
+
+// A file which changed, ready to be swapped in by the render thread
+typedef struct {
+	HotReloadKind kind;
+	char path[HOT_RELOAD_MAX_PATH];
+	// What the texture was watched as, e.g. its index
+	uint32_t id;
+	// The texture, already decoded on the watcher thread.  Whoever takes the
+	// change frees it
+	VkxDecodedTexture texture;
+} HotReloadChange;
+
+void hot_reload_init(uint32_t poll_interval_ms);
+void hot_reload_cleanup(void);
+
+void hot_reload_watch_shader(const char* spv_path);
+void hot_reload_watch_texture(const char* path, uint32_t id);
+
+bool hot_reload_next(HotReloadChange* change);
+
+#endif // HOT_RELOAD_H
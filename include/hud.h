@@ -0,0 +1,71 @@
+#ifndef HUD_H
+#define HUD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+#include "vkx/vkx_core.h"
+#include "vkx/vkx_pipeline.h"
+
+// Most quads in a frame (a quad for each character, bar and background),
+// anything past this is left out
+#define HUD_MAX_QUADS 4096
+// Size of a character's cell in font pixels, which is a 5x7 glyph and a gap
+#define HUD_GLYPH_WIDTH 6
+#define HUD_GLYPH_HEIGHT 8
+// In place of a glyph, for a filled rectangle
+#define HUD_SOLID 0xffffffffu
+// The font has ASCII 32 to 95, laid out this many across in its atlas
+#define HUD_FONT_GLYPHS 64
+#define HUD_FONT_COLUMNS 8
+// Texels per font pixel in the font's distance field atlas, and how far the
+// distances go either side of an edge, in font pixels
+#define HUD_SDF_TEXELS 8
+#define HUD_SDF_SPREAD 1.0f
+
+// Packs a colour as the R8G8B8A8_UNORM the shader reads
+#define HUD_RGBA(r, g, b, a) ((uint32_t) (r) | (uint32_t) (g) << 8 | (uint32_t) (b) << 16 | (uint32_t) (a) << 24)
+
+// One instance of hud.vert, in pixels from the top left of the window
+typedef struct {
+	float rect[4];
+	uint32_t color;
+	uint32_t glyph;
+} HudQuad;
+
+typedef struct {
+	float output_size[2];
+	uint32_t pre_rotation;
+} HudPushConstants;
+
+typedef struct {
+	VkxPipeline pipeline;
+	// The font's distance field atlas, and the set the pipeline reads it with,
+	// which is pushed when drawing
+	VkxImage font_image;
+	VkSampler font_sampler;
+	VkxPushSet font_set;
+	// Built up on the CPU until hud_record() copies them into the frame ring
+	HudQuad* quads;
+	uint32_t quads_count;
+	HudPushConstants push_constants;
+	// Screen pixels per font pixel
+	float scale;
+} Hud;
+
+void hud_init(Hud* hud, VkFormat color_format, float scale);
+void hud_cleanup(Hud* hud);
+
+void hud_begin(Hud* hud, VkExtent2D output_size, uint32_t pre_rotation);
+void hud_rect(Hud* hud, float x, float y, float width, float height, uint32_t color);
+float hud_text_scaled(Hud* hud, float x, float y, float scale, uint32_t color, const char* text);
+float hud_text(Hud* hud, float x, float y, uint32_t color, const char* text);
+float hud_printf(Hud* hud, float x, float y, uint32_t color, const char* format, ...);
+void hud_graph(Hud* hud, float x, float y, float width, float height, const float* values,
+		uint32_t values_count, uint32_t first, float max_value, float warn_value);
+float hud_line_height(const Hud* hud);
+
+void hud_record(Hud* hud, VkCommandBuffer command_buffer, VkxRingBuffer* ring, uint32_t frame);
+
+#endif // HUD_H
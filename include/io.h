@@ -3,7 +3,30 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
+
+// A read-only view of a whole file from map_file(), which stays valid until
+// unmap_file().  The data is page aligned (and NULL for an empty file), or at
+// least ARCHIVE_ALIGNMENT aligned in an archive
+typedef struct {
+	const void *data;
+	size_t size;
+	// Decompressed from an archive into a buffer which unmap_file() frees
+	void *owned_data;
+	// Part of an archive's mapping, which unmap_file() leaves alone
+	bool borrowed;
+#ifdef _WIN32
+	void *file_handle;
+	void *mapping_handle;
+#endif
+} MappedFile;
 
 char *read_entire_binary_file(const char *filename, size_t *size);
+MappedFile map_file(const char *filename);
+MappedFile map_disk_file(const char *filename);
+void unmap_file(MappedFile *file);
+bool write_entire_binary_file(const char *filename, const void *data, size_t size);
+bool file_exists(const char *filename);
+bool asset_exists(const char *filename);
 
 #endif // STEVE_LIB_IO_H
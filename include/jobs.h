@@ -0,0 +1,39 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <SDL3/SDL.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// Upper limit on the number of worker threads in the pool
+#define JOBS_MAX_WORKERS 64
+// Upper limit on the threads which have a deque, the workers and any others
+// which submit jobs (past this they run their jobs straight away)
+#define JOBS_MAX_THREADS (JOBS_MAX_WORKERS + 16)
+// Jobs each thread can have waiting, a power of 2.  A job submitted to a full
+// deque runs straight away
+#define JOBS_DEQUE_SIZE 4096
+
+// Function which runs a job
+typedef void (*JobFunc)(void* data);
+// Function which processes the items in the range [start, end)
+typedef void (*JobRangeFunc)(size_t start, size_t end, void* data);
+
+// Jobs submitted with a counter which haven't finished yet, so a parent can
+// wait for its children.  Zero it before use, e.g. JobCounter counter = {0}
+typedef struct {
+	SDL_AtomicInt pending;
+} JobCounter;
+
+void jobs_init(uint32_t num_workers, bool pin_threads);
+void jobs_cleanup(void);
+uint32_t jobs_get_num_workers(void);
+
+void jobs_submit(JobFunc func, void* data, JobCounter* counter);
+void jobs_wait(JobCounter* counter);
+bool jobs_is_done(JobCounter* counter);
+void jobs_parallel_for(size_t count, size_t batch_size, JobRangeFunc func, void* data);
+
+#endif // JOBS_H
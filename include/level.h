@@ -0,0 +1,87 @@
+#ifndef LEVEL_H
+#define LEVEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "io.h"
+
+/*
+ * Level snapshot layout (all little endian, in the layout of the machine which
+ * wrote it):
+ *
+ *   LevelHeader
+ *   LevelBlob[blobs_count]
+ *   blobs, each starting on a LEVEL_ALIGNMENT boundary
+ *
+ * Each blob is one of the arrays the level is made of (the tiles, a field of
+ * the monsters or the sprite records), exactly as it is in memory, so loading
+ * one is a memcpy() out of the mapping.
+ */
+#define LEVEL_MAGIC 0x4c565856 // "VXVL"
+#define LEVEL_VERSION 1
+// Blob alignment, which is enough for any of the arrays' types and for copying
+// them with wide loads
+#define LEVEL_ALIGNMENT 64
+
+typedef enum {
+	LEVEL_BLOB_TILES,
+	LEVEL_BLOB_MONSTER_X,
+	LEVEL_BLOB_MONSTER_Y,
+	LEVEL_BLOB_MONSTER_Z,
+	LEVEL_BLOB_MONSTER_VX,
+	LEVEL_BLOB_MONSTER_VY,
+	LEVEL_BLOB_MONSTER_ANIM_PHASE,
+	LEVEL_BLOB_MONSTER_COLOR,
+	LEVEL_BLOB_MONSTER_TEXTURE,
+	LEVEL_BLOB_MONSTER_PIPELINE,
+	LEVEL_BLOB_SPRITES,
+	_LEVEL_BLOB_COUNT
+} LevelBlobId;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t blobs_count;
+	// Whatever the writer needs to match when it's loaded again, e.g. the
+	// settings the sprite records were made with
+	uint32_t flags;
+	uint32_t map_width;
+	uint32_t map_height;
+	uint32_t monsters_count;
+	// Size of a sprite record, and how many there are per monster
+	uint32_t sprite_size;
+	uint32_t sprites_per_monster;
+	uint32_t _padding[3];
+} LevelHeader;
+
+typedef struct {
+	uint32_t id;
+	uint32_t _padding;
+	// From the start of the snapshot
+	uint64_t offset;
+	uint64_t size;
+} LevelBlob;
+
+// A blob to write, from level_write()
+typedef struct {
+	LevelBlobId id;
+	const void* data;
+	size_t size;
+} LevelBlobData;
+
+typedef struct {
+	MappedFile file;
+	LevelHeader header;
+	const LevelBlob* blobs;
+} LevelSnapshot;
+
+bool level_write(const char* filename, const LevelHeader* header, const LevelBlobData* blobs, uint32_t blobs_count);
+
+bool level_open(LevelSnapshot* level, const char* filename);
+void level_close(LevelSnapshot* level);
+const void* level_get_blob(const LevelSnapshot* level, LevelBlobId id, size_t size);
+bool level_copy_blob(const LevelSnapshot* level, LevelBlobId id, void* data, size_t size);
+
+#endif // LEVEL_H
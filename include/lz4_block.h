@@ -0,0 +1,14 @@
+#ifndef LZ4_BLOCK_H
+#define LZ4_BLOCK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Worst case size of a compressed block, for sizing the output
+#define LZ4_BLOCK_BOUND(size) ((size) + (size) / 255 + 16)
+
+size_t lz4_block_compress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_capacity);
+bool lz4_block_decompress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_size);
+
+#endif // LZ4_BLOCK_H
@@ -0,0 +1,132 @@
+#ifndef POST_CHAIN_H
+#define POST_CHAIN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+#include "vkx/vkx_core.h"
+#include "vkx/vkx_frame_graph.h"
+#include "vkx/vkx_pipeline.h"
+
+#define POST_CHAIN_MAX_EFFECTS 8
+// Passes before the screen pass, at most a fused pass and 3 for a bloom per effect
+#define POST_CHAIN_MAX_PASSES (POST_CHAIN_MAX_EFFECTS * 4)
+// Every post pass (and the screen pass) samples the previous result and the
+// bloom, so their descriptor sets have this many textures
+#define POST_CHAIN_TEXTURES 2
+// In place of a pass index, for the scene image (or no bloom)
+#define POST_CHAIN_SCENE UINT32_MAX
+#define POST_CHAIN_NONE UINT32_MAX
+
+// Must match the workgroup size in post.comp
+#define POST_CHAIN_WORKGROUP_SIZE 16
+// Targets of the compute passes, which every device can write as a storage
+// image (unlike the sRGB swap chain formats)
+#define POST_CHAIN_COMPUTE_FORMAT VK_FORMAT_R16G16B16A16_SFLOAT
+
+typedef enum {
+	// Per-pixel effects, which are fused with their neighbours into one pass
+	// (as long as they are in the same order as in screen.frag)
+	POST_EFFECT_WAVE,
+	POST_EFFECT_COLOR_GRADE,
+	POST_EFFECT_CRT,
+	// Scale the scene up by a whole number and letterbox the rest.  This is
+	// always done by the screen pass, wherever it is in the chain
+	POST_EFFECT_PIXEL_PERFECT,
+	// Effects which read their neighbourhood so need passes of their own, into
+	// smaller targets (see the divisors in PostChainDesc)
+	POST_EFFECT_BLOOM,
+	POST_EFFECT_BLUR,
+} PostEffect;
+
+// The fused per-pixel effects of a pass, which is the FUSED specialization
+// constant of screen.vert and screen.frag
+#define POST_FUSED_WAVE (1u << 0)
+#define POST_FUSED_BLOOM (1u << 1)
+#define POST_FUSED_COLOR_GRADE (1u << 2)
+#define POST_FUSED_CRT (1u << 3)
+#define POST_FUSED_PIXEL_PERFECT (1u << 4)
+
+typedef enum {
+	// screen.frag with some of the per-pixel effects
+	POST_PASS_FUSED,
+	// blur.frag keeping the bright parts for the bloom
+	POST_PASS_BRIGHT,
+	// blur.frag's separable gaussian
+	POST_PASS_BLUR_X,
+	POST_PASS_BLUR_Y,
+} PostPassType;
+
+typedef struct {
+	PostEffect effects[POST_CHAIN_MAX_EFFECTS];
+	uint32_t effects_count;
+	// Targets of the bloom and blur are 1 / divisor of the size of the scene
+	uint32_t bloom_divisor;
+	uint32_t blur_divisor;
+	// Run the passes as compute dispatches of post.comp rather than draws, and
+	// then on the compute queue if the device has a separate one
+	bool compute;
+	bool async_compute;
+	// Draw the fused passes with screen_half.frag, which does the effects at
+	// half precision, where the device can (vkx_instance.has_shader_float16)
+	bool half_precision;
+} PostChainDesc;
+
+typedef struct {
+	PostPassType type;
+	// POST_FUSED_* for POST_PASS_FUSED
+	uint32_t fused;
+	// How much smaller than the scene the target is
+	uint32_t divisor;
+	// The passes whose targets it samples
+	uint32_t input_pass;
+	uint32_t bloom_pass;
+	// Frame graph images it samples (bloom is POST_CHAIN_NONE without one) and
+	// renders to, from post_chain_add_passes()
+	uint32_t input;
+	uint32_t bloom;
+	uint32_t target;
+	uint32_t graph_pass;
+	// The part of the target written this frame, for the compute dispatches
+	VkExtent2D extent;
+	VkxPipeline pipeline;
+	VkDescriptorSet descriptor_sets[VKX_MAX_FRAMES_IN_FLIGHT];
+} PostChainPass;
+
+typedef struct {
+	PostChainDesc desc;
+	PostChainPass passes[POST_CHAIN_MAX_PASSES];
+	uint32_t passes_count;
+	// What is left for the screen pass, and the passes and images it samples
+	uint32_t screen_fused;
+	uint32_t screen_input_pass;
+	uint32_t screen_bloom_pass;
+	uint32_t screen_input;
+	uint32_t screen_bloom;
+	// The passes are compute dispatches, and are on the compute queue
+	bool compute;
+	bool async_compute;
+	bool half_precision;
+	VkDescriptorPool descriptor_pool;
+} PostChain;
+
+void post_chain_init(PostChain* chain, const PostChainDesc* desc);
+void post_chain_cleanup(PostChain* chain);
+bool post_chain_is_empty(const PostChain* chain);
+bool post_chain_is_per_pixel(const PostChain* chain);
+
+void post_chain_add_passes(PostChain* chain, VkxFrameGraph* graph, uint32_t scene_image,
+		VkExtent2D scene_extent, VkFormat format);
+void post_chain_create(PostChain* chain, const VkxFrameGraph* graph, VkSampler sampler,
+		const VkDescriptorBufferInfo* uniform_buffer);
+VkxPipeline post_chain_create_screen_pipeline(const PostChain* chain, VkFormat format);
+VkxPipeline post_chain_create_local_read_pipeline(const PostChain* chain, const VkxPushSet* push_set);
+void post_chain_screen_image_infos(const PostChain* chain, const VkxFrameGraph* graph, uint32_t frame,
+		VkSampler sampler, VkDescriptorImageInfo* image_infos);
+
+void post_chain_set_render_extent(PostChain* chain, VkxFrameGraph* graph, VkExtent2D extent);
+void post_chain_record(PostChain* chain, VkxFrameGraph* graph, VkCommandBuffer command_buffer,
+		uint32_t frame, const uint32_t* dynamic_offsets);
+
+#endif // POST_CHAIN_H
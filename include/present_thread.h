@@ -0,0 +1,38 @@
+#ifndef PRESENT_THREAD_H
+#define PRESENT_THREAD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+// Acquires and presents vkx_swap_chain's images on a thread of its own (see
+// present_thread.c)
+
+// Frames handed over and not presented yet, and presents not reported yet
+#define PRESENT_THREAD_QUEUE 8
+
+// A submitted frame for the thread to present
+typedef struct {
+	uint32_t image_index;
+	// Only the part of the image in rect changed since the last present
+	bool has_region;
+	VkRectLayerKHR rect;
+} PresentThreadFrame;
+
+// How a present went, from present_thread_take_report()
+typedef struct {
+	VkResult result;
+	// In vkQueuePresentKHR, and in vkAcquireNextImageKHR for the next image
+	// after it
+	double present_ms;
+	double acquire_ms;
+} PresentThreadReport;
+
+bool present_thread_is_running(void);
+void present_thread_stop(void);
+
+VkResult present_thread_take_image(uint32_t frame, uint32_t* image_index);
+void present_thread_present(const PresentThreadFrame* frame);
+bool present_thread_take_report(PresentThreadReport* report);
+
+#endif // PRESENT_THREAD_H
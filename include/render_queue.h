@@ -0,0 +1,80 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Sort key layout, most significant bits first so that a plain integer sort
+ * gives the draw order:
+ *
+ *   63-56  layer
+ *   55     translucent (opaque things are drawn first)
+ *
+ * Opaque (front to back, grouped by state):
+ *   54-47  pipeline
+ *   46-32  texture
+ *   31-0   depth
+ *
+ * Translucent (back to front, then grouped by state where depths are equal):
+ *   54-23  inverted depth
+ *   22-15  pipeline
+ *   14-0   texture
+ */
+#define RENDER_QUEUE_MAX_LAYER 0xff
+#define RENDER_QUEUE_MAX_PIPELINE 0xff
+#define RENDER_QUEUE_MAX_TEXTURE 0x7fff
+
+// Queues with at least this many items are sorted on the job system
+#define RENDER_QUEUE_PARALLEL_THRESHOLD 16384
+// render_queue_sort_coherent() gives up on repairing last sort's order, and
+// radix sorts, once it has moved the items more than count / this places
+#define RENDER_QUEUE_REPAIR_DIVISOR 4
+
+typedef struct {
+	// Index of the first item in the sorted queue
+	uint32_t first;
+	uint32_t count;
+	// Key of the first item, for getting the layer, pipeline etc.
+	uint64_t key;
+} RenderQueueBatch;
+
+typedef struct {
+	uint32_t capacity;
+	uint32_t count;
+	uint64_t* keys;
+	// Caller defined value for each item, e.g. the sprite index
+	uint32_t* values;
+	// Double buffers for the radix sort
+	uint64_t* scratch_keys;
+	uint32_t* scratch_values;
+	// Per chunk bucket counts for the parallel sort
+	uint32_t* chunk_histograms;
+	// The values in the order render_queue_sort_coherent() last sorted them
+	// into, and where each value was pushed this time, by value
+	uint32_t* previous_values;
+	uint32_t previous_count;
+	uint32_t* slots;
+	// Filled in by render_queue_build_batches()
+	RenderQueueBatch* batches;
+	uint32_t batches_count;
+} RenderQueue;
+
+void render_queue_init(RenderQueue* queue, uint32_t capacity);
+void render_queue_cleanup(RenderQueue* queue);
+
+void render_queue_clear(RenderQueue* queue);
+void render_queue_push(RenderQueue* queue, uint64_t key, uint32_t value);
+void render_queue_sort(RenderQueue* queue);
+bool render_queue_sort_coherent(RenderQueue* queue);
+uint32_t render_queue_build_batches(RenderQueue* queue);
+
+uint64_t render_queue_opaque_key(uint32_t layer, uint32_t pipeline, uint32_t texture, float depth);
+uint64_t render_queue_translucent_key(uint32_t layer, uint32_t pipeline, uint32_t texture, float depth);
+
+uint32_t render_queue_key_layer(uint64_t key);
+bool render_queue_key_translucent(uint64_t key);
+uint32_t render_queue_key_pipeline(uint64_t key);
+uint32_t render_queue_key_texture(uint64_t key);
+
+#endif // RENDER_QUEUE_H
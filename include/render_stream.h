@@ -0,0 +1,60 @@
+#ifndef RENDER_STREAM_H
+#define RENDER_STREAM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sprite_batch.h"
+
+// What a frame draws, sent as compact commands over TCP to another copy of
+// the renderer which draws it (see render_stream.c)
+
+// Steps a world unit the positions and sizes are rounded to, and steps a
+// texture coordinate unit and a radian
+#define RENDER_STREAM_POSITION_SCALE 256.0f
+#define RENDER_STREAM_UV_SCALE 65536.0f
+#define RENDER_STREAM_ROTATION_SCALE 10430.378f
+// Anything longer is taken as a broken stream
+#define RENDER_STREAM_MAX_MESSAGE (64 * 1024 * 1024)
+
+typedef enum {
+	RENDER_STREAM_OFF,
+	// Connect to the other copy and send it every frame
+	RENDER_STREAM_SEND,
+	// Listen for the other copy and draw what it sends
+	RENDER_STREAM_RECEIVE,
+} RenderStreamMode;
+
+typedef struct {
+	uint32_t x;
+	uint32_t y;
+	uint32_t value;
+} RenderStreamTile;
+
+// What render_stream_receive() took
+typedef struct {
+	// Of the first view's camera
+	float centre[2];
+	float zoom;
+	// The newest frame's sprite_draw() sprites and shapes, with the positions
+	// rounded
+	SpriteBatchItem* items;
+	uint32_t items_count;
+	uint32_t items_capacity;
+	// The tiles changed in every frame since the last receive, oldest first
+	RenderStreamTile* tiles;
+	uint32_t tiles_count;
+	uint32_t tiles_capacity;
+} RenderStreamFrame;
+
+bool render_stream_start(RenderStreamMode mode, const char* host, uint16_t port);
+void render_stream_stop(void);
+bool render_stream_is_connected(void);
+
+void render_stream_add_tile(uint32_t x, uint32_t y, uint32_t value);
+bool render_stream_send(const SpriteBatch* batch, const float centre[2], float zoom);
+
+void render_stream_frame_cleanup(RenderStreamFrame* frame);
+bool render_stream_receive(RenderStreamFrame* frame);
+
+#endif // RENDER_STREAM_H
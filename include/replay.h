@@ -0,0 +1,34 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// First bytes of a replay log ("RPLY"), and the version of its format
+#define REPLAY_MAGIC 0x594c5052u
+#define REPLAY_VERSION 1
+
+// An input event, with only what the main loop uses of it
+typedef struct {
+	// An SDL_EventType
+	uint32_t type;
+	// The key or the mouse button
+	int32_t code;
+	// Where the mouse was, or how far the wheel scrolled
+	float x;
+	float y;
+} ReplayEvent;
+
+bool replay_start_recording(const char* filename, uint32_t seed);
+bool replay_start_playing(const char* filename);
+void replay_stop(void);
+bool replay_is_recording(void);
+bool replay_is_playing(void);
+uint32_t replay_get_seed(void);
+
+void replay_record_event(const ReplayEvent* event);
+void replay_record_frame(double dt, uint32_t held_keys);
+bool replay_next_event(ReplayEvent* event);
+bool replay_next_frame(double* dt, uint32_t* held_keys);
+
+#endif // REPLAY_H
@@ -0,0 +1,54 @@
+#ifndef SKELETON_H
+#define SKELETON_H
+
+#include <stdint.h>
+
+#include "affine2.h"
+
+#define SKELETON_MAX_BONES 32
+// Keys in each bone's track of a clip
+#define SKELETON_MAX_KEYS 8
+#define SKELETON_NO_PARENT UINT32_MAX
+
+// A bone's offset from its rest pose at a time in a clip
+typedef struct {
+	float time;
+	// Anticlockwise, in radians
+	float rotation;
+	float translation[2];
+} SkeletonKey;
+
+typedef struct {
+	// In time order.  None leaves the bone at rest
+	SkeletonKey keys[SKELETON_MAX_KEYS];
+	uint32_t keys_count;
+} SkeletonTrack;
+
+// An animation of every bone of a skeleton, which loops
+typedef struct {
+	float duration;
+	SkeletonTrack tracks[SKELETON_MAX_BONES];
+} SkeletonClip;
+
+typedef struct {
+	// Every bone comes after its parent, so the roots are first and a pose
+	// can be built in one pass
+	uint32_t bones_count;
+	uint32_t parents[SKELETON_MAX_BONES];
+	// The rest pose, where each bone is in its parent's space
+	float rest_positions[SKELETON_MAX_BONES][2];
+	float rest_rotations[SKELETON_MAX_BONES];
+	// From the model (which the skin's vertices are in) to each bone's space
+	// in the rest pose
+	Affine2 inverse_binds[SKELETON_MAX_BONES];
+} Skeleton;
+
+void skeleton_init(Skeleton* skeleton);
+uint32_t skeleton_add_bone(Skeleton* skeleton, uint32_t parent, const float position[2], float rotation);
+
+void skeleton_clip_init(SkeletonClip* clip, float duration);
+void skeleton_clip_add_key(SkeletonClip* clip, uint32_t bone, float time, float rotation, const float translation[2]);
+
+void skeleton_sample(const Skeleton* skeleton, const SkeletonClip* clip, float time, const Affine2* placement, Affine2* palette);
+
+#endif // SKELETON_H
@@ -0,0 +1,46 @@
+#ifndef SPATIAL_GRID_H
+#define SPATIAL_GRID_H
+
+#include <stdint.h>
+
+// Items are counted into cells by up to this many jobs at once
+#define SPATIAL_GRID_MAX_BLOCKS 64
+#define SPATIAL_GRID_NONE UINT32_MAX
+
+// Called with each pair of items closer than the radius, i < j.  From worker
+// threads, with the pairs of different cells at the same time
+typedef void (*SpatialGridPairFunc)(uint32_t i, uint32_t j, void* data);
+
+typedef struct {
+	// The area covered, anything outside is put in the nearest edge cell
+	float origin[2];
+	float cell_size;
+	float inv_cell_size;
+	uint32_t width;
+	uint32_t height;
+	uint32_t capacity;
+
+	// Set by spatial_grid_build(): the items' positions, and their indices
+	// sorted by cell, with cell c's in entries[cell_starts[c], cell_starts[c + 1])
+	const float* x;
+	const float* y;
+	uint32_t count;
+	uint32_t* cell_starts;
+	uint32_t* entries;
+
+	// Scratch space for the counting sort
+	uint32_t* item_cells;
+	uint32_t* block_counts;
+	uint32_t blocks_count;
+} SpatialGrid;
+
+void spatial_grid_init(SpatialGrid* grid, const float origin[2], const float size[2], float cell_size, uint32_t capacity);
+void spatial_grid_cleanup(SpatialGrid* grid);
+
+void spatial_grid_build(SpatialGrid* grid, const float* x, const float* y, uint32_t count);
+
+uint32_t spatial_grid_query_radius(const SpatialGrid* grid, float x, float y, float radius, uint32_t* results, uint32_t max_results);
+uint32_t spatial_grid_nearest(const SpatialGrid* grid, float x, float y, float max_radius);
+void spatial_grid_find_pairs(const SpatialGrid* grid, float radius, SpatialGridPairFunc func, void* data);
+
+#endif // SPATIAL_GRID_H
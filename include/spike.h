@@ -0,0 +1,33 @@
+#ifndef SPIKE_H
+#define SPIKE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Frames whose times the median is taken from, a few seconds' worth.  No
+// spikes are looked for until there are this many
+#define SPIKE_HISTORY_FRAMES 256
+// Frames before and after a spike which go in its trace
+#define SPIKE_FRAMES_BEFORE 90
+#define SPIKE_FRAMES_AFTER 30
+
+typedef struct {
+	// A frame is a spike if it took longer than this, or 0 for no limit...
+	double threshold_ms;
+	// ...or longer than this many times the median of the frames before it,
+	// or 0 to only use the threshold
+	double median_multiple;
+	// Each trace is written to this with its number, e.g. "spike_%03u.json"
+	const char* filename_format;
+	// Most traces written in a run, so a bad patch doesn't fill the disk
+	uint32_t max_traces;
+} SpikeDesc;
+
+void spike_start(const SpikeDesc* desc);
+void spike_stop(void);
+
+bool spike_end_frame(uint64_t now_ns);
+void spike_skip_frame(void);
+bool spike_write_trace(void);
+
+#endif // SPIKE_H
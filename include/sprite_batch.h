@@ -0,0 +1,106 @@
+#ifndef SPRITE_BATCH_H
+#define SPRITE_BATCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <SDL3/SDL_atomic.h>
+
+// Sprites are handed out to the drawing threads this many at a time
+#define SPRITE_BATCH_CHUNK 256
+// Chunks start on a cache line, so threads filling neighbouring ones don't
+// share a line
+#define SPRITE_BATCH_CACHE_LINE 64
+
+// Packs a colour as the RGBA bytes the sprite shader reads
+#define SPRITE_RGBA(r, g, b, a) ((uint32_t) (r) | (uint32_t) (g) << 8 | (uint32_t) (b) << 16 | (uint32_t) (a) << 24)
+#define SPRITE_WHITE SPRITE_RGBA(255, 255, 255, 255)
+
+// SpriteBatchItem.texture of a shape_draw(), with its ShapeKind in the bits
+// under it
+#define SPRITE_BATCH_SHAPE 0x80000000u
+
+// What shape_draw() draws, whose edges are worked out exactly in the fragment
+// shader rather than from a texture
+typedef enum {
+	// With rounded corners, for a panel or a bar
+	SHAPE_RECT = 0,
+	// Fitting the rectangle, so a circle in a square
+	SHAPE_ELLIPSE,
+	_SHAPE_COUNT
+} ShapeKind;
+
+// How shape_draw() fills a shape, with the sizes in world units.  Each is at
+// most half the shape's shorter side
+typedef struct {
+	uint32_t fill_color;
+	// Inside the edge, over the fill.  0 wide for none
+	uint32_t outline_color;
+	float outline_width;
+	// The rectangle's corners', which the ellipse doesn't have
+	float corner_radius;
+	// How far past the edge it fades out, e.g. for a soft shadow.  0 is an
+	// antialiased edge
+	float softness;
+} ShapeStyle;
+
+// One sprite_draw() or shape_draw()
+typedef struct {
+	// Centre and size in world space
+	float pos[2];
+	float size[2];
+	// Part of the texture, top left then bottom right in its texture
+	// coordinates.  For a shape, its corner radius and outline width, then its
+	// softness
+	float uv[2];
+	float uv2[2];
+	// Around the centre, in radians
+	float rotation;
+	float z;
+	// Or SPRITE_BATCH_SHAPE and the shape
+	uint32_t texture;
+	uint32_t color;
+	// Only for shapes
+	uint32_t outline_color;
+} SpriteBatchItem;
+
+// Sprites in a chunk so far, written by its thread with every sprite, so
+// each has a cache line of its own
+typedef struct {
+	uint32_t count;
+	uint8_t padding[SPRITE_BATCH_CACHE_LINE - sizeof(uint32_t)];
+} SpriteBatchChunkCount;
+
+typedef struct {
+	// capacity items in chunks of SPRITE_BATCH_CHUNK, each filled from the start
+	// by one thread
+	SpriteBatchItem* items;
+	uint32_t capacity;
+	SpriteBatchChunkCount* chunk_counts;
+	// Each item's bounds in world space, written along with it as arrays of
+	// each side so sprite_batch_cull() goes through them many at a time
+	float* min_x;
+	float* min_y;
+	float* max_x;
+	float* max_y;
+	// Chunks handed out, which can go past the end once it's full
+	SDL_AtomicInt chunks_reserved;
+	// Set by sprite_batch_end()
+	uint32_t chunks_count;
+	uint32_t count;
+	// Sprites which didn't fit
+	SDL_AtomicInt dropped;
+} SpriteBatch;
+
+void sprite_batch_init(SpriteBatch* batch, uint32_t capacity);
+void sprite_batch_cleanup(SpriteBatch* batch);
+void sprite_batch_swap(SpriteBatch* a, SpriteBatch* b);
+
+void sprite_batch_begin(SpriteBatch* batch);
+void sprite_draw(uint32_t texture, const float src_rect[4], const float dst[4], float rotation, uint32_t color, float z);
+void shape_draw(ShapeKind kind, const float dst[4], float rotation, const ShapeStyle* style, float z);
+void sprite_batch_draw_item(const SpriteBatchItem* item);
+void sprite_batch_end(void);
+
+void sprite_batch_cull(const SpriteBatch* batch, const float rect[4], uint8_t* visible);
+
+#endif // SPRITE_BATCH_H
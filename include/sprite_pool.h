@@ -0,0 +1,50 @@
+#ifndef SPRITE_POOL_H
+#define SPRITE_POOL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// A handle is the slot's index, with the slot's generation above it so a
+// handle to a removed sprite doesn't pick up whatever took its slot
+#define SPRITE_POOL_INDEX_BITS 24
+#define SPRITE_POOL_INDEX_MASK ((1u << SPRITE_POOL_INDEX_BITS) - 1)
+#define SPRITE_POOL_MAX_SPRITES (1u << SPRITE_POOL_INDEX_BITS)
+#define SPRITE_POOL_NO_HANDLE UINT32_MAX
+
+typedef uint32_t SpriteHandle;
+
+// Changed slots [first, first + count)
+typedef struct {
+	uint32_t first;
+	uint32_t count;
+} SpritePoolRange;
+
+typedef struct {
+	uint32_t capacity;
+	// Slots which have ever been used, the rest are all free
+	uint32_t slots_count;
+	uint32_t live_count;
+	uint8_t* generations;
+	// Bit arrays of the slots in use and the ones changed since the last
+	// sprite_pool_take_dirty_ranges()
+	uint64_t* live;
+	uint64_t* dirty;
+	// Removed slots, reused last in first out
+	uint32_t* free_slots;
+	uint32_t free_count;
+} SpritePool;
+
+void sprite_pool_init(SpritePool* pool, uint32_t capacity);
+void sprite_pool_cleanup(SpritePool* pool);
+
+SpriteHandle sprite_pool_add(SpritePool* pool);
+void sprite_pool_remove(SpritePool* pool, SpriteHandle handle);
+bool sprite_pool_is_valid(const SpritePool* pool, SpriteHandle handle);
+uint32_t sprite_pool_get_index(SpriteHandle handle);
+void sprite_pool_mark_dirty(SpritePool* pool, SpriteHandle handle);
+void sprite_pool_mark_all_dirty(SpritePool* pool);
+bool sprite_pool_is_dirty(const SpritePool* pool);
+
+uint32_t sprite_pool_take_dirty_ranges(SpritePool* pool, SpritePoolRange* ranges, uint32_t max_ranges, uint32_t max_gap);
+
+#endif // SPRITE_POOL_H
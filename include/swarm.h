@@ -0,0 +1,56 @@
+#ifndef SWARM_H
+#define SWARM_H
+
+#include <stdint.h>
+
+#include "spatial_grid.h"
+#include "tile_collision.h"
+
+// Neighbours are summed this many at a time, in independent lanes which the
+// compiler can turn into SIMD
+#define SWARM_LANES 8
+// Most cells either side of an agent's looked at, however big the radius
+#define SWARM_MAX_REACH 4
+
+// How the agents steer (see swarm.c).  The weights scale each behaviour's
+// steering, a change of speed a second
+typedef struct {
+	// Neighbours closer than this are aligned and cohered with, and those
+	// closer than separation_radius kept away from
+	float neighbour_radius;
+	float separation_radius;
+	// Most agents looked at for each one, nearest cells first, so crowds
+	// don't cost more than this
+	uint32_t max_neighbours;
+
+	float separation_weight;
+	float alignment_weight;
+	float cohesion_weight;
+
+	// Solid tiles closer than avoidance_distance are steered away from, more
+	// the closer they are.  NULL for no obstacles
+	const TileSolidity* solidity;
+	float avoidance_distance;
+	float avoidance_weight;
+
+	// The agents' speeds are kept between these
+	float min_speed;
+	float max_speed;
+} SwarmParams;
+
+typedef struct {
+	uint32_t capacity;
+	// The agents' positions and speeds in the grid's order, so the agents of a
+	// cell are next to each other.  Padded by SWARM_LANES
+	float* x;
+	float* y;
+	float* vx;
+	float* vy;
+} Swarm;
+
+void swarm_init(Swarm* swarm, uint32_t capacity);
+void swarm_cleanup(Swarm* swarm);
+
+void swarm_steer(Swarm* swarm, const SpatialGrid* grid, const SwarmParams* params, float* vx, float* vy, float dt);
+
+#endif // SWARM_H
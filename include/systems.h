@@ -0,0 +1,46 @@
+#ifndef SYSTEMS_H
+#define SYSTEMS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "jobs.h"
+
+#define SYSTEMS_MAX 32
+
+// The components of an archetype a system reads or writes, a bit each, e.g. a
+// bit for each column of an EntityPool.  Anything else a system touches which
+// another one does too, like a grid built from the positions, gets a bit of
+// its own
+typedef uint32_t SystemComponents;
+
+// A loop over every entity of an archetype (entities stored together which
+// all have the same components), see systems.c
+typedef struct {
+	// For the trace
+	const char* name;
+	// What it runs over, [0, *count) of the archetype, which can be anything
+	// identifying it such as its EntityPool.  NULL count runs the kernel once
+	// as [0, 1), for what's done for the archetype as a whole
+	const void* archetype;
+	const uint32_t* count;
+	JobRangeFunc kernel;
+	void* data;
+	SystemComponents reads;
+	SystemComponents writes;
+} System;
+
+typedef struct {
+	System systems[SYSTEMS_MAX];
+	uint32_t count;
+	// Each system's phase.  The systems of a phase can run at the same time,
+	// and each phase starts once the ones before it are done
+	uint32_t phases[SYSTEMS_MAX];
+	uint32_t phases_count;
+} SystemSchedule;
+
+void systems_add(SystemSchedule* schedule, const System* system);
+void systems_run(const SystemSchedule* schedule, size_t batch_size);
+
+#endif // SYSTEMS_H
@@ -0,0 +1,60 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// The histograms' buckets go up by a quarter of a power of 2 from
+// TELEMETRY_HISTOGRAM_MIN_MS, so 48 of them cover 0.25 ms to a second, each
+// about 19% wider than the last.  Anything slower goes in the last bucket
+#define TELEMETRY_HISTOGRAM_BUCKETS 48
+#define TELEMETRY_HISTOGRAM_MIN_MS 0.25
+#define TELEMETRY_BUCKETS_PER_DOUBLING 4
+#define TELEMETRY_MAX_GAUGES 32
+#define TELEMETRY_MAX_NAME 48
+
+typedef enum {
+	// Time between the starts of consecutive frames on the render thread
+	TELEMETRY_FRAME_TIME,
+	// The GPU's time for a frame, from the profiler
+	TELEMETRY_GPU_TIME,
+	TELEMETRY_HISTOGRAMS_COUNT,
+} TelemetryHistogram;
+
+typedef enum {
+	TELEMETRY_FRAMES,
+	// Frames which took more than one and a half refresh periods, and the
+	// refreshes they missed
+	TELEMETRY_LATE_FRAMES,
+	TELEMETRY_DROPPED_FRAMES,
+	// Acquires and presents which returned VK_SUBOPTIMAL_KHR, and
+	// VK_ERROR_OUT_OF_DATE_KHR
+	TELEMETRY_SUBOPTIMAL,
+	TELEMETRY_OUT_OF_DATE,
+	TELEMETRY_SWAP_CHAIN_RECREATIONS,
+	TELEMETRY_COUNTERS_COUNT,
+} TelemetryCounter;
+
+typedef struct {
+	// Time between snapshots
+	uint32_t interval_ms;
+	// JSON lines are appended to this, or NULL
+	const char* json_filename;
+	// StatsD server to send UDP packets to, or NULL
+	const char* statsd_host;
+	uint16_t statsd_port;
+	// Start of every metric name, e.g. "kiosk"
+	const char* prefix;
+} TelemetryDesc;
+
+uint32_t telemetry_add_gauge(const char* name);
+bool telemetry_start(const TelemetryDesc* desc);
+void telemetry_stop(void);
+bool telemetry_is_running(void);
+
+void telemetry_add_sample(TelemetryHistogram histogram, double ms);
+void telemetry_add_frame(uint64_t frame_ns, uint64_t refresh_period_ns);
+void telemetry_count(TelemetryCounter counter, int count);
+void telemetry_set_gauge(uint32_t gauge, int value);
+
+#endif // TELEMETRY_H
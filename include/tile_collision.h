@@ -0,0 +1,27 @@
+#ifndef TILE_COLLISION_H
+#define TILE_COLLISION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// What tile_solidity_move() ran into
+#define TILE_HIT_X 1u
+#define TILE_HIT_Y 2u
+
+// Which tiles are solid, one bit each, 64 to a word and each row starting on
+// a new word.  Tile (x, y) covers [x, x + 1) by [y, y + 1)
+typedef struct {
+	uint32_t width;
+	uint32_t height;
+	uint32_t words_per_row;
+	uint64_t* bits;
+} TileSolidity;
+
+void tile_solidity_init(TileSolidity* solidity, const uint8_t* tiles, uint32_t width, uint32_t height, uint8_t empty_tile);
+void tile_solidity_cleanup(TileSolidity* solidity);
+void tile_solidity_set(TileSolidity* solidity, uint32_t x, uint32_t y, bool solid);
+bool tile_solidity_is_solid(const TileSolidity* solidity, int64_t x, int64_t y);
+
+uint32_t tile_solidity_move(const TileSolidity* solidity, float pos[2], const float half_size[2], const float delta[2]);
+
+#endif // TILE_COLLISION_H
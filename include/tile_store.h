@@ -0,0 +1,50 @@
+#ifndef TILE_STORE_H
+#define TILE_STORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Chunks are this many tiles wide and high.  A row of a chunk's 16 bit tiles
+// is then 64 bytes, one cache line
+#define TILE_STORE_CHUNK_SIZE 32
+
+typedef struct {
+	// In chunks, so tile (x, y) is in chunk (x / TILE_STORE_CHUNK_SIZE,
+	// y / TILE_STORE_CHUNK_SIZE) rounded down
+	int32_t x;
+	int32_t y;
+	// The tiles which aren't empty.  The chunk is freed when this gets to 0
+	uint32_t occupied;
+	// Free for whatever fills the store, e.g. the frame a streamed chunk was
+	// last near the view (world_stream.c).  0 when the chunk is created
+	uint32_t last_used;
+	// Row by row
+	uint16_t tiles[TILE_STORE_CHUNK_SIZE * TILE_STORE_CHUNK_SIZE];
+} TileStoreChunk;
+
+// A map of any size, which only has memory for the chunks with something in
+// them.  Everything else is empty_tile
+typedef struct {
+	uint16_t empty_tile;
+	// The chunks there are, in no particular order
+	TileStoreChunk** chunks;
+	uint32_t chunks_count;
+	uint32_t chunks_capacity;
+	// Open addressed hash table of the chunks by their coordinates, holding
+	// their index in chunks + 1 (0 for a free slot).  A power of 2 long
+	uint32_t* slots;
+	uint32_t slots_count;
+} TileStore;
+
+void tile_store_init(TileStore* store, uint16_t empty_tile);
+void tile_store_cleanup(TileStore* store);
+
+uint16_t tile_store_get(const TileStore* store, int32_t x, int32_t y);
+void tile_store_set(TileStore* store, int32_t x, int32_t y, uint16_t value);
+TileStoreChunk* tile_store_put_chunk(TileStore* store, int32_t chunk_x, int32_t chunk_y, const uint16_t* tiles);
+void tile_store_remove_chunk(TileStore* store, int32_t chunk_x, int32_t chunk_y);
+const TileStoreChunk* tile_store_find_chunk(const TileStore* store, int32_t chunk_x, int32_t chunk_y);
+size_t tile_store_get_memory(const TileStore* store);
+
+#endif // TILE_STORE_H
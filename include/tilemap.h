@@ -0,0 +1,129 @@
+#ifndef TILEMAP_H
+#define TILEMAP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+#include <cglm/cglm.h>
+
+#include "tile_store.h"
+#include "vertex_formats.h"
+#include "vkx/vkx_core.h"
+
+// Chunks are this many tiles wide and high.  At 4 vertices per tile this
+// keeps the vertex count of a chunk well inside 16 bit indices.  The same as
+// a tile store's chunks, so each is built from one of them
+#define TILEMAP_CHUNK_SIZE TILE_STORE_CHUNK_SIZE
+
+// Chunks this far outside the view (in chunks) are kept or built ahead of
+// time, anything further away is evicted
+#define TILEMAP_CHUNK_MARGIN 1
+
+// Most quads in an index buffer with 16 bit indices, 4 vertices each
+#define TILEMAP_MAX_QUADS ((UINT16_MAX + 1) / 4)
+
+// A chunk without an impostor, or with nothing in it to make one of
+#define TILEMAP_NO_IMPOSTOR UINT32_MAX
+#define TILEMAP_EMPTY_IMPOSTOR (UINT32_MAX - 1)
+
+// Struct for vertex based geometry (i.e. the quads the tile layers are drawn
+// on), QUAD_VERTEX_FIELDS in vertex_formats.h
+typedef struct {
+	QUAD_VERTEX_FIELDS(VERTEX_STRUCT_FIELD, VERTEX_STRUCT_PAD, Vertex)
+} Vertex;
+
+// A vertex of a tile.  All 4 of a tile's vertices are the same and come one
+// after another, so tiles.vert works out the corner from the vertex index and
+// the texture coordinates from the tile value.  TILE_VERTEX_FIELDS in
+// vertex_formats.h
+typedef struct {
+	TILE_VERTEX_FIELDS(VERTEX_STRUCT_FIELD, VERTEX_STRUCT_PAD, TileVertex)
+} TileVertex;
+
+typedef struct {
+	// Tile values, width * height of them, row by row.  Not copied
+	const uint8_t* tiles;
+	// Or the tile store the map is the width * height tiles from (0, 0) of,
+	// instead of the tiles.  Not owned
+	const TileStore* store;
+	uint32_t width;
+	uint32_t height;
+	// Tile value for nothing
+	uint8_t empty_tile;
+	// Indices of TILEMAP_MAX_QUADS quads, 0 1 2 2 3 0 for each 4 vertices, shared
+	// by all of the chunks.  Not owned
+	VkBuffer quad_index_buffer;
+	// Have the vertex shader read the chunks' vertices through their device
+	// addresses, which tilemap_draw() pushes at this offset in the push
+	// constants, rather than binding them as vertex buffers
+	bool vertex_pulling;
+	uint32_t vertices_address_offset;
+} TilemapDesc;
+
+typedef struct {
+	bool resident;
+	// A tile has changed, so the chunk is rebuilt on the next update
+	bool dirty;
+	VkxBuffer vertex_buffer;
+	// With vertex pulling
+	VkDeviceAddress vertices_address;
+	// Of the shared quad index buffer
+	uint32_t index_count;
+} TilemapChunk;
+
+// A chunk drawn from its image in a slot of the impostor atlas, rather than
+// tile by tile (see tilemap_update_impostors())
+typedef struct {
+	uint32_t chunk;
+	uint32_t slot;
+} TilemapImpostor;
+
+typedef struct {
+	TilemapDesc desc;
+
+	uint32_t chunks_x;
+	uint32_t chunks_y;
+	TilemapChunk* chunks;
+
+	// Indices of the resident chunks which intersect the view, from the last update
+	uint32_t* visible;
+	uint32_t visible_count;
+
+	// Indices of the resident chunks, so eviction doesn't have to look at every
+	// chunk in the map
+	uint32_t* resident;
+	uint32_t resident_count;
+
+	// With tilemap_init_impostors(), the slot each chunk's impostor is in (or
+	// TILEMAP_NO_IMPOSTOR or TILEMAP_EMPTY_IMPOSTOR), and whether a tile in it
+	// has changed since it was rendered
+	uint32_t* chunk_impostors;
+	bool* impostors_stale;
+	// The chunk in each slot (or TILEMAP_NO_IMPOSTOR), and the last update it
+	// was drawn in, so the one unused for longest is taken for a new chunk
+	uint32_t impostor_slots_count;
+	uint32_t* slot_chunks;
+	uint64_t* slots_used;
+	uint64_t impostor_updates;
+	// From the last tilemap_update_impostors(): the impostors in view, and the
+	// ones of them to render before they're drawn
+	TilemapImpostor* visible_impostors;
+	uint32_t visible_impostors_count;
+	TilemapImpostor* impostor_renders;
+	uint32_t impostor_renders_count;
+} Tilemap;
+
+void tilemap_init(Tilemap* map, const TilemapDesc* desc);
+void tilemap_cleanup(Tilemap* map);
+
+bool tilemap_update(Tilemap* map, float view_min_x, float view_min_y, float view_max_x, float view_max_y);
+void tilemap_tile_changed(Tilemap* map, uint32_t x, uint32_t y);
+void tilemap_draw(const Tilemap* map, VkCommandBuffer command_buffer, VkPipelineLayout pipeline_layout);
+
+uint32_t tilemap_write_chunk_vertices(const Tilemap* map, uint32_t chunk_index, TileVertex* vertices);
+void tilemap_init_impostors(Tilemap* map, uint32_t slots_count);
+void tilemap_update_impostors(Tilemap* map, float view_min_x, float view_min_y, float view_max_x, float view_max_y,
+		uint32_t max_renders);
+
+#endif // TILEMAP_H
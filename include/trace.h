@@ -0,0 +1,29 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Threads which can record zones (the main thread, the render thread and the
+// job workers)
+#define TRACE_MAX_THREADS 72
+// Zones kept for each thread, older ones are overwritten
+#define TRACE_EVENTS_PER_THREAD 16384
+// Zones nested deeper than this are not recorded
+#define TRACE_MAX_DEPTH 32
+// Counter values kept for each thread which adds them
+#define TRACE_COUNTERS_PER_THREAD 8192
+
+void trace_init(void);
+void trace_cleanup(void);
+
+void trace_set_thread_name(const char* name);
+void trace_begin(const char* name);
+void trace_end(void);
+void trace_add_gpu_zone(const char* name, uint64_t start_ns, uint64_t end_ns);
+void trace_add_counter(const char* name, double value);
+
+bool trace_write(const char* filename);
+bool trace_write_window(const char* filename, uint64_t start_ns, uint64_t end_ns);
+
+#endif // TRACE_H
@@ -0,0 +1,72 @@
+#ifndef TRANSFORM_TREE_H
+#define TRANSFORM_TREE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "affine2.h"
+
+// A handle is the node's slot, with the slot's generation above it so a
+// handle to a removed node doesn't pick up whatever took its slot
+#define TRANSFORM_TREE_INDEX_BITS 24
+#define TRANSFORM_TREE_INDEX_MASK ((1u << TRANSFORM_TREE_INDEX_BITS) - 1)
+#define TRANSFORM_TREE_MAX_NODES (1u << TRANSFORM_TREE_INDEX_BITS)
+#define TRANSFORM_TREE_NO_HANDLE UINT32_MAX
+#define TRANSFORM_TREE_NO_INDEX UINT32_MAX
+// Roots are depth 0, and nothing can be deeper than this minus 1
+#define TRANSFORM_TREE_MAX_DEPTH 32
+
+typedef uint32_t TransformHandle;
+
+typedef struct {
+	uint32_t capacity;
+	// The nodes are packed in [0, count) of these, every parent before its
+	// children.  After transform_tree_update() they're sorted by depth, with
+	// depth d's in [level_starts[d], level_starts[d + 1]).  Nodes added since
+	// are on the end
+	uint32_t count;
+	// The parent's index, or TRANSFORM_TREE_NO_INDEX for a root
+	uint32_t* parents;
+	uint8_t* depths;
+	// Whether the local transform changed since the last update
+	uint8_t* dirty;
+	Affine2* locals;
+	// Set by transform_tree_update(): the local transforms of everything
+	// above the node and then its own, so from the node to the world
+	Affine2* worlds;
+	uint32_t level_starts[TRANSFORM_TREE_MAX_DEPTH + 1];
+	uint32_t levels_count;
+
+	// Slot to index, and back
+	uint32_t* indices;
+	uint32_t* slots;
+	uint8_t* generations;
+	// Slots which have ever been used, and the removed ones, reused last in
+	// first out
+	uint32_t slots_count;
+	uint32_t* free_slots;
+	uint32_t free_count;
+
+	// Set when nodes are added or removed, so the next update sorts them
+	bool unsorted;
+	// Set when anything is dirty, so an update with nothing to do is free
+	bool changed;
+	// Room for a column while the nodes are sorted, and where each one goes
+	void* scratch;
+	uint32_t* remap;
+} TransformTree;
+
+void transform_tree_init(TransformTree* tree, uint32_t capacity);
+void transform_tree_cleanup(TransformTree* tree);
+
+TransformHandle transform_tree_add(TransformTree* tree, TransformHandle parent, const Affine2* local);
+void transform_tree_remove(TransformTree* tree, TransformHandle handle);
+bool transform_tree_is_valid(const TransformTree* tree, TransformHandle handle);
+uint32_t transform_tree_get_index(const TransformTree* tree, TransformHandle handle);
+
+void transform_tree_set_local(TransformTree* tree, TransformHandle handle, const Affine2* local);
+const Affine2* transform_tree_get_world(const TransformTree* tree, TransformHandle handle);
+
+void transform_tree_update(TransformTree* tree);
+
+#endif // TRANSFORM_TREE_H
@@ -0,0 +1,55 @@
+#ifndef TWEEN_H
+#define TWEEN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Floats eased to a value over a time, kept in arrays by easing and updated
+// all at once (see tween.c)
+
+// Tweens eased together, in a scratch array on the stack
+#define TWEEN_BATCH 256
+
+typedef enum {
+	TWEEN_LINEAR,
+	TWEEN_QUAD_IN,
+	TWEEN_QUAD_OUT,
+	TWEEN_QUAD_IN_OUT,
+	TWEEN_CUBIC_IN,
+	TWEEN_CUBIC_OUT,
+	TWEEN_CUBIC_IN_OUT,
+	TWEEN_SINE_IN_OUT,
+	// Goes a little past the end first
+	TWEEN_BACK_OUT,
+	_TWEEN_EASING_COUNT,
+} TweenEasing;
+
+// The tweens with one easing, packed in [0, count) of every array
+typedef struct {
+	uint32_t count;
+	// The floats they write, e.g. a field of an entity pool column or a
+	// transform tree node's local transform
+	float** targets;
+	float* from;
+	float* to;
+	float* elapsed;
+	float* inv_duration;
+} TweenGroup;
+
+typedef struct {
+	// Of each group
+	uint32_t capacity;
+	TweenGroup groups[_TWEEN_EASING_COUNT];
+} Tweens;
+
+void tweens_init(Tweens* tweens, uint32_t capacity);
+void tweens_cleanup(Tweens* tweens);
+
+bool tween_start(Tweens* tweens, float* target, float to, float duration, TweenEasing easing);
+uint32_t tween_cancel(Tweens* tweens, const float* target);
+uint32_t tween_move_target(Tweens* tweens, const float* target, float* moved);
+uint32_t tweens_count(const Tweens* tweens);
+
+uint32_t tweens_update(Tweens* tweens, float dt, float** finished, uint32_t max_finished);
+
+#endif // TWEEN_H
@@ -0,0 +1,57 @@
+#ifndef UPDATE_TIERS_H
+#define UPDATE_TIERS_H
+
+#include <stdint.h>
+
+#define UPDATE_TIERS_MAX 4
+// Fewest of the entities out of view updated in a step however small the
+// budget, so they never stop altogether
+#define UPDATE_TIERS_MIN_UPDATES 64
+// The estimate of an update's time follows each step's by this much of the
+// way
+#define UPDATE_TIERS_COST_SMOOTHING 0.1
+
+typedef struct {
+	// Entities in view are tier 0 and updated every step.  Those out of view
+	// are tier 1 up to tier_distance from it, tier 2 up to twice that, and so
+	// on up to the last tier
+	float tier_distance;
+	uint32_t tiers_count;
+	// Seconds each tier is left for between updates, 0 for tier 0
+	float intervals[UPDATE_TIERS_MAX];
+	// Most seconds an entity is stepped by at once, however long it was left
+	float max_dt;
+} UpdateTiersDesc;
+
+// Which entities to update each step and for how long, see update_tiers.c
+typedef struct {
+	UpdateTiersDesc desc;
+	uint32_t capacity;
+	// Each entity's tier, and the time until now it hasn't been updated for
+	uint8_t* tiers;
+	float* pending_dt;
+
+	// Set by update_tiers_schedule(): the entities to update this step, the
+	// ones in view first, and each one's time step
+	uint32_t* indices;
+	float* dt;
+	uint32_t count;
+	// And how many entities there are in each tier
+	uint32_t tier_counts[UPDATE_TIERS_MAX];
+
+	// Where the round robin of the entities out of view carries on from
+	uint32_t cursor;
+	// Estimated nanoseconds a step takes for each entity it updates, or 0
+	// before the first step
+	double update_ns;
+} UpdateTiers;
+
+void update_tiers_init(UpdateTiers* tiers, const UpdateTiersDesc* desc, uint32_t capacity);
+void update_tiers_cleanup(UpdateTiers* tiers);
+
+uint32_t update_tiers_get_budget(const UpdateTiers* tiers, double budget_ms);
+void update_tiers_schedule(UpdateTiers* tiers, const float* x, const float* y, uint32_t count,
+	const float visible_rect[4], float dt, uint32_t max_updates);
+void update_tiers_end_step(UpdateTiers* tiers, uint64_t elapsed_ns);
+
+#endif // UPDATE_TIERS_H
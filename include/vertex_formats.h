@@ -0,0 +1,229 @@
+#ifndef VERTEX_FORMATS_H
+#define VERTEX_FORMATS_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// The vertex formats, each written down once as a list of its fields, from
+// which come the C structs, the VkVertexInputAttributeDescriptions and the
+// GLSL.  The GLSL is shaders/vertex_formats.glsl, which tools/vertex_glsl.c
+// writes (the vertex_formats target) and the shaders include, so it has to
+// be written again whenever a format or a packing changes.
+//
+// A field is FIELD(T, name, kind, count, location): count components of a
+// kind, read by the vertex input at location.  PAD(T, name, kind, count) is
+// the same without an attribute.  T is the struct, for offsetof()
+//
+// The kinds, which are tokens rather than values so they can be pasted:
+//   VERTEX_FLOAT    float                  float/vecN in GLSL
+//   VERTEX_HALF     uint16_t half floats   float/vecN
+//   VERTEX_UNORM8   uint8_t of 0 to 1      float/vecN
+//   VERTEX_UNORM16  uint16_t of 0 to 1     float/vecN
+//   VERTEX_UINT8, VERTEX_UINT16, VERTEX_UINT32    uint/uvecN
+
+// How the sprites' texture coordinates are packed, VERTEX_UNORM16 or
+// VERTEX_HALF (finer near 0 and able to go past 1, but coarser than
+// VERTEX_UNORM16 over a half).  Each pair has to stay one word, as the GPU
+// particles write them as words
+#ifndef SPRITE_UV_PACKING
+#define SPRITE_UV_PACKING VERTEX_UNORM16
+#endif
+// And the skinned meshes', which can be any of the float kinds as only the
+// vertex input reads them
+#ifndef SKINNED_UV_PACKING
+#define SKINNED_UV_PACKING VERTEX_UNORM16
+#endif
+
+#define VERTEX_PASTE(a, b) VERTEX_PASTE_(a, b)
+#define VERTEX_PASTE_(a, b) a##b
+
+// The C type of a component of a kind
+#define VERTEX_C_TYPE(kind) VERTEX_PASTE(VERTEX_C_TYPE_, kind)
+#define VERTEX_C_TYPE_VERTEX_FLOAT float
+#define VERTEX_C_TYPE_VERTEX_HALF uint16_t
+#define VERTEX_C_TYPE_VERTEX_UNORM8 uint8_t
+#define VERTEX_C_TYPE_VERTEX_UNORM16 uint16_t
+#define VERTEX_C_TYPE_VERTEX_UINT8 uint8_t
+#define VERTEX_C_TYPE_VERTEX_UINT16 uint16_t
+#define VERTEX_C_TYPE_VERTEX_UINT32 uint32_t
+
+// The VkFormat of count components of a kind
+#define VERTEX_VK_FORMAT(kind, count) VERTEX_PASTE(VERTEX_VK_FORMAT_, kind)(count)
+#define VERTEX_VK_FORMAT_VERTEX_FLOAT(count) VERTEX_PASTE(VERTEX_VK_FLOAT_, count)
+#define VERTEX_VK_FORMAT_VERTEX_HALF(count) VERTEX_PASTE(VERTEX_VK_HALF_, count)
+#define VERTEX_VK_FORMAT_VERTEX_UNORM8(count) VERTEX_PASTE(VERTEX_VK_UNORM8_, count)
+#define VERTEX_VK_FORMAT_VERTEX_UNORM16(count) VERTEX_PASTE(VERTEX_VK_UNORM16_, count)
+#define VERTEX_VK_FORMAT_VERTEX_UINT8(count) VERTEX_PASTE(VERTEX_VK_UINT8_, count)
+#define VERTEX_VK_FORMAT_VERTEX_UINT16(count) VERTEX_PASTE(VERTEX_VK_UINT16_, count)
+#define VERTEX_VK_FORMAT_VERTEX_UINT32(count) VERTEX_PASTE(VERTEX_VK_UINT32_, count)
+#define VERTEX_VK_FLOAT_1 VK_FORMAT_R32_SFLOAT
+#define VERTEX_VK_FLOAT_2 VK_FORMAT_R32G32_SFLOAT
+#define VERTEX_VK_FLOAT_3 VK_FORMAT_R32G32B32_SFLOAT
+#define VERTEX_VK_FLOAT_4 VK_FORMAT_R32G32B32A32_SFLOAT
+#define VERTEX_VK_HALF_1 VK_FORMAT_R16_SFLOAT
+#define VERTEX_VK_HALF_2 VK_FORMAT_R16G16_SFLOAT
+#define VERTEX_VK_HALF_3 VK_FORMAT_R16G16B16_SFLOAT
+#define VERTEX_VK_HALF_4 VK_FORMAT_R16G16B16A16_SFLOAT
+#define VERTEX_VK_UNORM8_1 VK_FORMAT_R8_UNORM
+#define VERTEX_VK_UNORM8_2 VK_FORMAT_R8G8_UNORM
+#define VERTEX_VK_UNORM8_3 VK_FORMAT_R8G8B8_UNORM
+#define VERTEX_VK_UNORM8_4 VK_FORMAT_R8G8B8A8_UNORM
+#define VERTEX_VK_UNORM16_1 VK_FORMAT_R16_UNORM
+#define VERTEX_VK_UNORM16_2 VK_FORMAT_R16G16_UNORM
+#define VERTEX_VK_UNORM16_3 VK_FORMAT_R16G16B16_UNORM
+#define VERTEX_VK_UNORM16_4 VK_FORMAT_R16G16B16A16_UNORM
+#define VERTEX_VK_UINT8_1 VK_FORMAT_R8_UINT
+#define VERTEX_VK_UINT8_2 VK_FORMAT_R8G8_UINT
+#define VERTEX_VK_UINT8_3 VK_FORMAT_R8G8B8_UINT
+#define VERTEX_VK_UINT8_4 VK_FORMAT_R8G8B8A8_UINT
+#define VERTEX_VK_UINT16_1 VK_FORMAT_R16_UINT
+#define VERTEX_VK_UINT16_2 VK_FORMAT_R16G16_UINT
+#define VERTEX_VK_UINT16_3 VK_FORMAT_R16G16B16_UINT
+#define VERTEX_VK_UINT16_4 VK_FORMAT_R16G16B16A16_UINT
+#define VERTEX_VK_UINT32_1 VK_FORMAT_R32_UINT
+#define VERTEX_VK_UINT32_2 VK_FORMAT_R32G32_UINT
+#define VERTEX_VK_UINT32_3 VK_FORMAT_R32G32B32_UINT
+#define VERTEX_VK_UINT32_4 VK_FORMAT_R32G32B32A32_UINT
+
+// A member of count components, an array unless there's one
+#define VERTEX_DECLARATOR(name, count) VERTEX_PASTE(VERTEX_DECLARATOR_, count)(name)
+#define VERTEX_DECLARATOR_1(name) name
+#define VERTEX_DECLARATOR_2(name) name[2]
+#define VERTEX_DECLARATOR_3(name) name[3]
+#define VERTEX_DECLARATOR_4(name) name[4]
+
+// For FIELD and PAD, the struct's members
+#define VERTEX_STRUCT_FIELD(T, name, kind, count, location) VERTEX_C_TYPE(kind) VERTEX_DECLARATOR(name, count);
+#define VERTEX_STRUCT_PAD(T, name, kind, count) VERTEX_C_TYPE(kind) VERTEX_DECLARATOR(name, count);
+// And the VkVertexInputAttributeDescriptions of binding 0
+#define VERTEX_ATTRIBUTE(T, name, kind, count, location) {location, 0, VERTEX_VK_FORMAT(kind, count), offsetof(T, name)},
+#define VERTEX_NO_ATTRIBUTE(T, name, kind, count)
+
+// A sprite, or a shape drawn with the sprites' fields (see make_shape_record()
+// in main.c), in a vertex array or the frame ring (24 bytes)
+#define SPRITE_VERTEX_FIELDS(FIELD, PAD, T) \
+	/* RGBA colour for rendering */ \
+	FIELD(T, color, VERTEX_UNORM8, 4, 0) \
+	/* Texture coordinates of the corners */ \
+	FIELD(T, uv, SPRITE_UV_PACKING, 2, 1) \
+	FIELD(T, uv2, SPRITE_UV_PACKING, 2, 2) \
+	/* Index into the sprite transform storage buffer */ \
+	FIELD(T, sprite_index, VERTEX_UINT32, 1, 4) \
+	/* Texture enum value, replaced by the atlas layer once the texture */ \
+	/* coordinates have been mapped into the atlas, and SPRITE_FLAG_* */ \
+	FIELD(T, texture_index, VERTEX_UINT16, 1, 3) \
+	/* The transparent edges of the frame left out of the quad, see */ \
+	/* trim_sprite_frame().  0 to draw the whole rectangle */ \
+	FIELD(T, trim, VERTEX_UINT16, 1, 6) \
+	/* Frames the vertex shader plays from the time, see */ \
+	/* pack_sprite_flipbook().  0 to always draw uv to uv2 */ \
+	FIELD(T, flipbook, VERTEX_UINT32, 1, 5)
+
+// A sprite whose texture coordinates, texture and trim are a frame of the
+// shared frame table, with sprite_frame_table (see create_sprite_frames() in
+// main.c), so changing its frame is writing 2 bytes (16 bytes)
+#define FRAMED_SPRITE_VERTEX_FIELDS(FIELD, PAD, T) \
+	FIELD(T, color, VERTEX_UNORM8, 4, 0) \
+	/* Index into the sprite transform storage buffer */ \
+	FIELD(T, sprite_index, VERTEX_UINT32, 1, 3) \
+	/* Index into the frame table */ \
+	FIELD(T, frame, VERTEX_UINT16, 1, 1) \
+	/* The bits of VertexBufferSprite.texture_index above the texture */ \
+	FIELD(T, flags, VERTEX_UINT16, 1, 2) \
+	/* As VertexBufferSprite's, from the frame */ \
+	FIELD(T, flipbook, VERTEX_UINT32, 1, 4)
+
+// A vertex of a skinned mesh, in the model's rest pose (20 bytes with
+// VERTEX_UNORM16 texture coordinates)
+#define SKINNED_VERTEX_FIELDS(FIELD, PAD, T) \
+	FIELD(T, pos, VERTEX_FLOAT, 2, 0) \
+	/* In the texture atlas */ \
+	FIELD(T, uv, SKINNED_UV_PACKING, 2, 1) \
+	/* Bones of the skeleton it moves with, and how much it goes with the */ \
+	/* first (the second has the rest) */ \
+	FIELD(T, bones, VERTEX_UINT8, 2, 2) \
+	FIELD(T, weight, VERTEX_UNORM8, 1, 3) \
+	PAD(T, padding, VERTEX_UINT8, 1) \
+	/* Atlas layer */ \
+	FIELD(T, texture_index, VERTEX_UINT16, 1, 4) \
+	PAD(T, padding2, VERTEX_UINT16, 1)
+
+// A vertex of a tile (8 bytes), see TileVertex in tilemap.h
+#define TILE_VERTEX_FIELDS(FIELD, PAD, T) \
+	/* Bottom left of the tile, in tiles */ \
+	FIELD(T, pos, VERTEX_UINT16, 2, 0) \
+	FIELD(T, tile, VERTEX_UINT16, 1, 1) \
+	PAD(T, _padding, VERTEX_UINT16, 1)
+
+// A vertex of the quads the tile layers are drawn on (20 bytes)
+#define QUAD_VERTEX_FIELDS(FIELD, PAD, T) \
+	FIELD(T, pos, VERTEX_FLOAT, 3, 0) \
+	FIELD(T, tex_coord, VERTEX_FLOAT, 2, 1)
+
+// Packing and unpacking a float component of a kind
+#define VERTEX_PACK(kind, value) VERTEX_PASTE(VERTEX_PACK_, kind)(value)
+#define VERTEX_UNPACK(kind, value) VERTEX_PASTE(VERTEX_UNPACK_, kind)(value)
+#define VERTEX_PACK_VERTEX_FLOAT(value) (value)
+#define VERTEX_UNPACK_VERTEX_FLOAT(value) (value)
+#define VERTEX_PACK_VERTEX_HALF(value) vertex_pack_half(value)
+#define VERTEX_UNPACK_VERTEX_HALF(value) vertex_unpack_half(value)
+#define VERTEX_PACK_VERTEX_UNORM8(value) vertex_pack_unorm8(value)
+#define VERTEX_UNPACK_VERTEX_UNORM8(value) ((value) / 255.0f)
+#define VERTEX_PACK_VERTEX_UNORM16(value) vertex_pack_unorm16(value)
+#define VERTEX_UNPACK_VERTEX_UNORM16(value) ((value) / 65535.0f)
+
+static inline uint8_t vertex_pack_unorm8(float value) {
+	return (uint8_t) lroundf(fminf(fmaxf(value, 0.0f), 1.0f) * 255.0f);
+}
+
+static inline uint16_t vertex_pack_unorm16(float value) {
+	return (uint16_t) lroundf(fminf(fmaxf(value, 0.0f), 1.0f) * 65535.0f);
+}
+
+static inline uint16_t vertex_pack_half(float value) {
+	/*
+	 * The nearest half float, rounding ties to even as the GPU does
+	 */
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	uint32_t sign = (bits >> 16) & 0x8000;
+	uint32_t magnitude = bits & 0x7fffffff;
+
+	// Too big (or infinite), or not a number
+	if (magnitude >= 0x47800000) {
+		return (uint16_t) (sign | (magnitude > 0x7f800000 ? 0x7e00 : 0x7c00));
+	}
+	// Below the smallest normal half, in steps of 2^-24
+	if (magnitude < 0x38800000) {
+		return (uint16_t) (sign | (uint32_t) lrintf(fabsf(value) * 16777216.0f));
+	}
+
+	uint32_t half = (magnitude - 0x38000000) >> 13;
+	uint32_t rest = magnitude & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1) != 0)) {
+		half++;
+	}
+	return (uint16_t) (sign | half);
+}
+
+static inline float vertex_unpack_half(uint16_t half) {
+	uint32_t sign = (uint32_t) (half & 0x8000) << 16;
+	uint32_t exponent = (half >> 10) & 0x1f;
+	uint32_t mantissa = half & 0x3ff;
+
+	if (exponent == 0) {
+		float value = ldexpf((float) mantissa, -24);
+		return sign != 0 ? -value : value;
+	}
+
+	uint32_t bits = exponent == 0x1f
+		? sign | 0x7f800000 | mantissa << 13
+		: sign | (exponent + 112) << 23 | mantissa << 13;
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+#endif // VERTEX_FORMATS_H
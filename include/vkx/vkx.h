@@ -2,8 +2,25 @@
 #define VXK_H
 
 #include "vkx/vkx_core.h"
+#include "vkx/vkx_host_memory.h"
+#include "vkx/vkx_memory.h"
+#include "vkx/vkx_upload.h"
+#include "vkx/vkx_ktx2.h"
+#include "vkx/vkx_texture_cache.h"
+#include "vkx/vkx_texture_quality.h"
+#include "vkx/vkx_palette.h"
+#include "vkx/vkx_atlas.h"
+#include "vkx/vkx_sparse_atlas.h"
+#include "vkx/vkx_texture_table.h"
+#include "vkx/vkx_residency.h"
 #include "vkx/vkx_init.h"
 #include "vkx/vkx_swap_chain.h"
+#include "vkx/vkx_descriptor_ring.h"
 #include "vkx/vkx_pipeline.h"
+#include "vkx/vkx_pipeline_manager.h"
+#include "vkx/vkx_frame_graph.h"
+#include "vkx/vkx_profiler.h"
+#include "vkx/vkx_secondary.h"
+#include "vkx/vkx_debug.h"
 
 #endif // VXK_H
@@ -0,0 +1,48 @@
+#ifndef VKX_ATLAS_H
+#define VKX_ATLAS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+#include "vkx/vkx_core.h"
+#include "vkx/vkx_palette.h"
+
+// Gap left around every image in the atlas.  The edge pixels are repeated into
+// the gap so that filtering (and the first couple of mip levels) doesn't pick
+// up the neighbouring images
+#define VKX_ATLAS_PADDING 4
+
+typedef struct {
+	// Page (array layer) the image was packed into
+	uint32_t layer;
+	// Position and size of the image on the page in pixels
+	uint32_t x;
+	uint32_t y;
+	uint32_t width;
+	uint32_t height;
+	// Atlas texture coordinates of the top left of the image...
+	float uv_offset[2];
+	// ...and the size of the image in atlas texture coordinates
+	float uv_scale[2];
+} VkxAtlasRegion;
+
+typedef struct {
+	// 2D array image with one layer per page
+	VkxImage image;
+	uint32_t page_width;
+	uint32_t page_height;
+	uint32_t pages_count;
+	// One region per source image, in the order they were given
+	VkxAtlasRegion* regions;
+	uint32_t regions_count;
+} VkxAtlas;
+
+VkxAtlas vkx_pack_texture_atlas(const char* const* filenames, uint32_t count, uint32_t max_page_size, uint8_t** page_pixels);
+VkxAtlas vkx_create_texture_atlas(const char* const* filenames, uint32_t count, uint32_t max_page_size, bool generate_mipmaps);
+VkxAtlas vkx_create_palette_atlas(const char* const* filenames, uint32_t count, uint32_t max_page_size, uint8_t palette[VKX_PALETTE_COLOURS * 4]);
+VkxAtlas vkx_create_atlas_like(const VkxAtlas* layout, const char* const* filenames, const uint8_t fill[4], bool generate_mipmaps);
+void vkx_cleanup_atlas(VkxAtlas* atlas);
+
+void vkx_atlas_map_uv(const VkxAtlas* atlas, uint32_t region_index, const float uv[2], float out_uv[2]);
+
+#endif // VKX_ATLAS_H
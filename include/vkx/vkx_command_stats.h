@@ -0,0 +1,69 @@
+#ifndef VKX_COMMAND_STATS_H
+#define VKX_COMMAND_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+// Counts of the commands recorded and the calls made in each frame, so a
+// change which breaks up the batching shows straight away (see
+// vkx_command_stats.c).  Only built with VKX_COMMAND_STATS (the COMMAND_STATS
+// CMake option), otherwise nothing is counted and the counts are all 0
+
+typedef enum {
+	// Draws of any kind, including indirect and mesh task ones, and dispatches
+	VKX_STAT_DRAWS,
+	VKX_STAT_DISPATCHES,
+	// Pipelines and shader objects bound
+	VKX_STAT_PIPELINE_BINDS,
+	// Descriptor sets bound, pushed or pointed at in descriptor buffers
+	VKX_STAT_DESCRIPTOR_BINDS,
+	// vkCmdPipelineBarrier2 calls, however many barriers each has
+	VKX_STAT_BARRIERS,
+	VKX_STAT_PUSH_CONSTANTS,
+	// Written for the GPU by the CPU: the frame ring, staging buffers, host
+	// image copies and vkCmdUpdateBuffer
+	VKX_STAT_UPLOAD_BYTES,
+	VKX_STAT_SUBMITS,
+	_VKX_STAT_COUNT,
+} VkxCommandStat;
+
+typedef struct {
+	uint32_t counts[_VKX_STAT_COUNT];
+} VkxCommandStats;
+
+bool vkx_command_stats_enabled(void);
+const char* vkx_command_stat_name(VkxCommandStat stat);
+void vkx_command_stats_add(VkxCommandStat stat, uint32_t count);
+void vkx_command_stats_end_frame(VkxCommandStats* stats);
+
+#ifdef VKX_COMMAND_STATS
+
+#define VKX_COUNT_COMMANDS(stat, count) vkx_command_stats_add((stat), (uint32_t) (count))
+
+// The calls made directly are counted by these, which don't expand again
+// inside themselves.  The extension commands called through pointers are
+// counted where they're called
+#define vkCmdDraw(...) (VKX_COUNT_COMMANDS(VKX_STAT_DRAWS, 1), vkCmdDraw(__VA_ARGS__))
+#define vkCmdDrawIndexed(...) (VKX_COUNT_COMMANDS(VKX_STAT_DRAWS, 1), vkCmdDrawIndexed(__VA_ARGS__))
+#define vkCmdDrawIndirect(...) (VKX_COUNT_COMMANDS(VKX_STAT_DRAWS, 1), vkCmdDrawIndirect(__VA_ARGS__))
+#define vkCmdDrawIndexedIndirect(...) (VKX_COUNT_COMMANDS(VKX_STAT_DRAWS, 1), vkCmdDrawIndexedIndirect(__VA_ARGS__))
+#define vkCmdDispatch(...) (VKX_COUNT_COMMANDS(VKX_STAT_DISPATCHES, 1), vkCmdDispatch(__VA_ARGS__))
+#define vkCmdBindPipeline(...) (VKX_COUNT_COMMANDS(VKX_STAT_PIPELINE_BINDS, 1), vkCmdBindPipeline(__VA_ARGS__))
+#define vkCmdBindDescriptorSets(command_buffer, bind_point, layout, first_set, sets_count, ...) \
+	(VKX_COUNT_COMMANDS(VKX_STAT_DESCRIPTOR_BINDS, sets_count), \
+	vkCmdBindDescriptorSets(command_buffer, bind_point, layout, first_set, sets_count, __VA_ARGS__))
+#define vkCmdPipelineBarrier2(...) (VKX_COUNT_COMMANDS(VKX_STAT_BARRIERS, 1), vkCmdPipelineBarrier2(__VA_ARGS__))
+#define vkCmdPushConstants(...) (VKX_COUNT_COMMANDS(VKX_STAT_PUSH_CONSTANTS, 1), vkCmdPushConstants(__VA_ARGS__))
+#define vkCmdUpdateBuffer(command_buffer, buffer, offset, size, data) \
+	(VKX_COUNT_COMMANDS(VKX_STAT_UPLOAD_BYTES, size), vkCmdUpdateBuffer(command_buffer, buffer, offset, size, data))
+#define vkQueueSubmit(...) (VKX_COUNT_COMMANDS(VKX_STAT_SUBMITS, 1), vkQueueSubmit(__VA_ARGS__))
+#define vkQueueSubmit2(...) (VKX_COUNT_COMMANDS(VKX_STAT_SUBMITS, 1), vkQueueSubmit2(__VA_ARGS__))
+
+#else
+
+#define VKX_COUNT_COMMANDS(stat, count) ((void) 0)
+
+#endif // VKX_COMMAND_STATS
+
+#endif // VKX_COMMAND_STATS_H
@@ -6,49 +6,213 @@
 #include <vulkan/vulkan.h>
 #include <SDL3/SDL.h>
 
-#define VKX_FRAMES_IN_FLIGHT 2
+#include "vkx/vkx_host_memory.h"
+#include "vkx/vkx_ktx2.h"
+#include "vkx/vkx_pixels.h"
+#include "vkx/vkx_command_stats.h"
 
+// Upper limit on the frames in flight, for sizing the per-frame arrays.  The
+// number used is vkx_instance.frames_in_flight, which is given to vkx_init()
+#define VKX_MAX_FRAMES_IN_FLIGHT 3
+
+// Host memory is only imported if the device's alignment for it is no more
+// than this, the smallest page size, so rounding a pointer out to it stays in
+// the pages the data is in
+#define VKX_HOST_IMPORT_MAX_ALIGNMENT 4096
+
+// What device memory is used for, to count it by in vkx_memory.c.  Allocations
+// get the calling thread's tag, see vkx_memory_set_tag()
+typedef enum {
+	VKX_MEMORY_TAG_OTHER,
+	VKX_MEMORY_TAG_TEXTURES,
+	VKX_MEMORY_TAG_OFFSCREEN,
+	VKX_MEMORY_TAG_TILES,
+	VKX_MEMORY_TAG_SPRITES,
+	VKX_MEMORY_TAG_STAGING,
+	VKX_MEMORY_TAGS_COUNT
+} VkxMemoryTag;
+
+// Part of a device memory block handed out by the allocator in vkx_memory.c
 typedef struct {
-	VkBuffer buffer;
 	VkDeviceMemory memory;
+	VkDeviceSize offset;
+	VkDeviceSize size;
+	// Start of the allocation if the memory is host visible, otherwise NULL
+	void* mapped;
+	// Index of the block that this was allocated from
+	uint32_t block_index;
+	VkxMemoryTag tag;
+} VkxAllocation;
+
+typedef struct {
+	VkBuffer buffer;
+	VkxAllocation allocation;
 } VkxBuffer;
 
 typedef struct {
 	VkImage image;
-	VkDeviceMemory memory;
+	VkxAllocation allocation;
 	VkImageView view;
+	uint32_t mip_levels;
+	uint32_t array_layers;
+	// What it was created with, so it can be created again (see
+	// vkx_record_image_move())
+	VkFormat format;
+	VkExtent2D extent;
+	VkImageUsageFlags usage;
 } VkxImage;
 
+// A texture loaded by vkx_decode_texture(), ready to be uploaded
+typedef struct {
+	// A KTX2 encoding of the image (see vkx_load_ktx2_texture()) or its entry in
+	// the texture cache, otherwise the image decoded to RGBA pixels
+	bool compressed;
+	MappedFile ktx2_file;
+	VkxKtx2Texture ktx2;
+	uint8_t* pixels;
+	int width;
+	int height;
+	// Done to the decoded pixels on their way to the staging buffer, or NULL.
+	// Set by the caller before vkx_create_decoded_textures()
+	const VkxPixelConversion* conversion;
+} VkxDecodedTexture;
+
 typedef struct {
 	// Vulkan instance
 	VkInstance instance;
 	// Vulkan debug messenger
 	VkDebugUtilsMessengerEXT debug_messenger;
+	// VK_EXT_debug_utils is enabled, for the validation layers' messages and
+	// the names and labels in vkx_debug.h
+	bool has_debug_utils;
 	// SDL window that we are rendering to
 	SDL_Window* window;
 	// Surface from the SDL window
 	VkSurfaceKHR surface;
+	// No window or surface, so nothing is presented (see
+	// vkx_create_headless_swap_chain())
+	bool headless;
 	// Physical device that we are using
 	VkPhysicalDevice physical_device;
 	// Logical device that we are using
 	VkDevice device;
 	// Graphics queue
 	VkQueue graphics_queue;
-	// Presentation queue
+	// Presentation queue.  A second queue of the graphics family when that's
+	// the present family and has one (see has_separate_present_queue)
 	VkQueue present_queue;
-	// Single command pool for the program
+	// Queue for uploads - from a dedicated transfer family if there is one,
+	// otherwise this is the graphics queue
+	VkQueue transfer_queue;
+	// Queue for async compute - from a compute family without graphics if there
+	// is one (see has_async_compute), otherwise this is the graphics queue
+	VkQueue compute_queue;
+	// Queue family indices for the above
+	uint32_t graphics_queue_family;
+	uint32_t transfer_queue_family;
+	uint32_t compute_queue_family;
+	bool has_async_compute;
+	// The present queue isn't the graphics queue, so it can be presented on
+	// from another thread than the one submitting (see present_thread.c)
+	bool has_separate_present_queue;
+	// Command pool for the one-time command buffers, the frames in flight have
+	// their own
 	VkCommandPool command_pool;
-	// Command buffers for each frame in flight
-	VkCommandBuffer command_buffers[VKX_FRAMES_IN_FLIGHT];
-	// Number of command buffers
-	uint32_t command_buffers_count;
+	// Frames which can be recorded while the GPU works on earlier ones, from 1
+	// to VKX_MAX_FRAMES_IN_FLIGHT (vkx_frames has this many)
+	uint32_t frames_in_flight;
+	// Optional device extensions which were enabled
+	bool has_memory_budget;
+	// VK_KHR_present_id and VK_KHR_present_wait are enabled
+	bool has_present_wait;
+	// VK_KHR_incremental_present
+	bool has_incremental_present;
+	// VK_EXT_swapchain_maintenance1, with the surface maintenance instance
+	// extensions it needs
+	bool has_surface_maintenance1;
+	bool has_swapchain_maintenance1;
+	// VK_EXT_extended_dynamic_state3 with the blend enable and equation
+	bool has_extended_dynamic_state3;
+	// VK_EXT_host_image_copy, which can write images in shader read only optimal
+	bool has_host_image_copy;
+	// VK_KHR_external_memory_fd, and VK_EXT_external_memory_dma_buf with it
+	bool has_external_memory_fd;
+	bool has_external_memory_dma_buf;
+	// VK_EXT_external_memory_host, and what the host memory imported has to
+	// start and end on (see vkx_import_host_buffer())
+	bool has_external_memory_host;
+	VkDeviceSize host_pointer_alignment;
+	// VK_KHR_push_descriptor
+	bool has_push_descriptor;
+	// bufferDeviceAddress from Vulkan 1.2, which allocations in linear blocks
+	// are made with
+	bool has_buffer_device_address;
+	// VK_EXT_descriptor_buffer with buffer device address, and its sizes and
+	// alignments
+	bool has_descriptor_buffer;
+	VkPhysicalDeviceDescriptorBufferPropertiesEXT descriptor_buffer_properties;
+	// VK_EXT_shader_object
+	bool has_shader_object;
+	// VK_EXT_graphics_pipeline_library (with VK_KHR_pipeline_library), where
+	// the libraries can be linked quickly
+	bool has_graphics_pipeline_library;
+	// VK_EXT_mesh_shader with task shaders, and whether they can render with
+	// multiview
+	bool has_mesh_shader;
+	bool has_multiview_mesh_shader;
+	// VK_KHR_fragment_shading_rate with the rate set per draw, and whether it
+	// can also come from an attachment, with the sizes of the attachment's
+	// texels it can have
+	bool has_fragment_shading_rate;
+	bool has_shading_rate_attachment;
+	VkExtent2D shading_rate_texel_min;
+	VkExtent2D shading_rate_texel_max;
+	// VK_KHR_dynamic_rendering_local_read, for reading the pixel being drawn
+	// to from the colour attachment as an input attachment
+	bool has_local_read;
+	// pipelineStatisticsQuery, for the profiler's statistics scopes
+	bool has_pipeline_statistics;
+	// VK_EXT_calibrated_timestamps, for putting the profiler's timestamps on
+	// the CPU's clock
+	bool has_calibrated_timestamps;
+	// multiDrawIndirect, for indirect draws of more than one command, and the
+	// most commands one can have
+	bool has_multi_draw_indirect;
+	uint32_t max_draw_indirect_count;
+	// Subgroup ballots in compute shaders, for the sprite simulation's events
+	bool has_subgroup_ballot;
+	// shaderFloat16 from Vulkan 1.2 (VK_KHR_shader_float16_int8), for the
+	// shaders which do their colour maths at half precision
+	bool has_shader_float16;
+	// Sparse residency for 2D images with the standard block shapes, sparse
+	// binding on the graphics queue, and the shader features to sample them
+	// (see vkx_sparse_atlas.c)
+	bool has_sparse_residency;
+	// Integrated GPU (or every device local memory type is host visible), so
+	// device local buffers can be written by the CPU without a staging copy
+	bool unified_memory;
+	// Timeline semaphore which each frame's submission signals on the graphics
+	// queue, and the value the next one will signal
+	VkSemaphore frame_timeline;
+	uint64_t frame_timeline_value;
 } VkxInstance;
 
 typedef struct {
     uint32_t graphics_family;
     uint32_t present_family;
+	// Transfer only family (no graphics), if the device has one
+	uint32_t transfer_family;
+	// Compute family without graphics, if the device has one.  If it is also the
+	// transfer family the compute queue is the second queue of it
+	uint32_t compute_family;
+	uint32_t compute_queue_index;
+	// The second queue of the graphics family if it is also the present family
+	// and has two, otherwise 0
+	uint32_t present_queue_index;
 	bool has_graphics_family;
 	bool has_present_family;
+	bool has_transfer_family;
+	bool has_compute_family;
 } VkxQueueFamilyIndices;
 
 typedef struct {
@@ -59,6 +223,9 @@ typedef struct {
 	VkPresentModeKHR* present_modes;
 } VkxSwapChainSupportDetails;
 
+// Most present modes a swap chain can switch between
+#define VKX_MAX_PRESENT_MODES 8
+
 typedef struct {
 	// Vulkan swap chain
 	VkSwapchainKHR swap_chain;
@@ -70,48 +237,190 @@ typedef struct {
 	VkImageView* image_views;
 	// Array of swap chain images
 	VkFormat image_format;
-	// Size of the swap chain images
+	// Colour attachment, and transfer destination if the surface allows it
+	VkImageUsageFlags image_usage;
+	// Size of the swap chain images, in the display's native orientation
 	VkExtent2D extent;
+	// Transform the presentation engine expects the images to already have,
+	// and the same as clockwise quarter turns for the screen shader
+	VkSurfaceTransformFlagBitsKHR pre_transform;
+	uint32_t pre_rotation;
 	// Semaphore for each swapchain image
 	VkSemaphore* render_finished_semaphores;
 	// Depth buffer
 	VkxImage depth_image;
 	// Is the depth image created?
 	bool has_depth_image;
+	// The mode it was created with (which might not be the one asked for), or
+	// switched to since
+	VkPresentModeKHR present_mode;
+	// With VK_EXT_swapchain_maintenance1, the modes it can switch between
+	// without being recreated (see vkx_switch_present_mode()), and a fence for
+	// each image's last present, which is signalled once the present has
+	// finished with the image and its semaphore.  Otherwise none
+	VkPresentModeKHR present_modes[VKX_MAX_PRESENT_MODES];
+	uint32_t present_modes_count;
+	VkFence* present_fences;
+	// ID of the last present, when there is present wait (0 before the first)
+	uint64_t present_id;
+	// In headless mode the images are ordinary ones, and there is no swap
+	// chain or render finished semaphores
+	VkxImage* headless_images;
 } VkxSwapChain;
 
+// Most windows besides vkx_instance's which are presented along with it
+#define VKX_MAX_WINDOWS 8
+
+// Another window on vkx_instance's device, with a surface, swap chain and
+// acquire semaphores of its own and everything else shared (see
+// vkx_create_window())
+typedef struct {
+	SDL_Window* window;
+	VkSurfaceKHR surface;
+	VkxSwapChain swap_chain;
+	// One for each frame in flight, like VkxFrame's
+	VkSemaphore image_available_semaphores[VKX_MAX_FRAMES_IN_FLIGHT];
+	// Acquired for this frame, or UINT32_MAX if it hasn't one (e.g. it's
+	// minimised)
+	uint32_t image_index;
+	// The swap chain is recreated before it's next acquired from
+	bool out_of_date;
+} VkxWindow;
+
+// Upper limit on the vertex attributes of a pipeline made of shader objects
+#define VKX_MAX_VERTEX_ATTRIBUTES 8
+
 typedef struct {
 	VkDescriptorSetLayout descriptor_set_layout;
 	VkPipelineLayout layout;
 	VkPipeline pipeline;
+	// A vertex buffer pipeline created after vkx_set_shader_objects(true) has
+	// linked shaders instead of the pipeline, and keeps the state which would
+	// have been baked into it for vkx_cmd_bind_pipeline() to set
+	VkShaderEXT shaders[2];
+	VkVertexInputBindingDescription2EXT vertex_binding;
+	VkVertexInputAttributeDescription2EXT vertex_attributes[VKX_MAX_VERTEX_ATTRIBUTES];
+	uint32_t vertex_attributes_count;
+	VkSampleCountFlagBits samples;
+	bool alpha_blend;
+	bool additive_blend;
+	bool alpha_to_coverage;
+	// The fragment shading rate is dynamic (see vkx_set_shading_rate()), and
+	// vkx_cmd_bind_pipeline() sets it back to every pixel
+	bool shading_rate;
 } VkxPipeline;
 
+// Persistently mapped buffer split into one region per frame in flight.  Each
+// frame hands out aligned slices of its region with a simple bump allocator,
+// which are bound with dynamic offsets
+typedef struct {
+	VkxBuffer buffer;
+	// Start of the mapped memory (covers all frames)
+	uint8_t* mapped;
+	// Size of each frame's region
+	VkDeviceSize frame_size;
+	// Alignment of every allocation
+	VkDeviceSize alignment;
+	// Start of the current frame's region
+	VkDeviceSize frame_start;
+	// Next free byte in the current frame's region (relative to frame_start)
+	VkDeviceSize head;
+} VkxRingBuffer;
+
 typedef struct {
+	// Mapped pointer to write the data to
+	void* data;
+	// Offset into the ring buffer (use as the dynamic offset)
+	VkDeviceSize offset;
+} VkxRingAllocation;
+
+// Most barriers a batch can hold of each kind before it has to be flushed
+#define VKX_BARRIER_BATCH_MAX 16
+
+// Barriers collected up to be recorded with a single vkCmdPipelineBarrier2
+typedef struct {
+	VkCommandBuffer command_buffer;
+	VkImageMemoryBarrier2 image_barriers[VKX_BARRIER_BATCH_MAX];
+	uint32_t image_barriers_count;
+	VkBufferMemoryBarrier2 buffer_barriers[VKX_BARRIER_BATCH_MAX];
+	uint32_t buffer_barriers_count;
+} VkxBarrierBatch;
+
+// Everything which belongs to one frame in flight
+typedef struct {
+	// The frame's command buffers come from its own pool, which is reset all
+	// at once before the frame is recorded again
+	VkCommandPool command_pool;
+	VkCommandBuffer command_buffer;
 	VkSemaphore image_available_semaphore;
+	// Signalled when the GPU has finished with the frame
 	VkFence in_flight_fence;
-} VkxFrameSyncObjects;
+	// Frame timeline value of the frame's last submission, 0 before the first
+	uint64_t timeline_value;
+	// With async compute the frame is submitted in three parts: the graphics
+	// work up to the compute passes, the compute passes on the compute queue,
+	// then command_buffer_after_compute.  Each part waits for the one before
+	VkCommandBuffer command_buffer_after_compute;
+	VkCommandPool compute_command_pool;
+	VkCommandBuffer compute_command_buffer;
+	VkSemaphore compute_wait_semaphore;
+	VkSemaphore compute_finished_semaphore;
+} VkxFrame;
 
 
 extern VkxInstance vkx_instance;
 extern VkxSwapChain vkx_swap_chain;
-extern VkxFrameSyncObjects vkx_frame_sync_objects[VKX_FRAMES_IN_FLIGHT];
+extern VkxFrame vkx_frames[VKX_MAX_FRAMES_IN_FLIGHT];
 
 VkxSwapChainSupportDetails vkx_query_swap_chain_support(VkPhysicalDevice device, VkSurfaceKHR surface);
 
-void vkx_free_swap_chain_support(VkxSwapChainSupportDetails* details);
-
 VkxQueueFamilyIndices vkx_find_queue_families(VkPhysicalDevice device, VkSurfaceKHR surface);
 
-VkxImage vkx_create_image(uint32_t width, uint32_t height, VkFormat format,
+uint32_t vkx_find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties);
+
+uint32_t vkx_mip_levels_for_extent(uint32_t width, uint32_t height);
+void vkx_downsample_srgb(const uint8_t* src, uint32_t width, uint32_t height, uint8_t* dst);
+
+VkxImage vkx_create_image(uint32_t width, uint32_t height, uint32_t mip_levels, VkFormat format,
 		VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties);
+VkxImage vkx_create_image_array(uint32_t width, uint32_t height, uint32_t mip_levels, uint32_t array_layers,
+		VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties);
 void vkx_cleanup_image(VkxImage* image);
+VkxImage vkx_record_image_move(VkCommandBuffer command_buffer, const VkxImage* image);
 
 VkImageView vkx_create_image_view(VkImage image, VkFormat format,
-		VkImageAspectFlags aspect_flags);
+		VkImageAspectFlags aspect_flags, uint32_t mip_levels);
+VkImageView vkx_create_image_array_view(VkImage image, VkFormat format,
+		VkImageAspectFlags aspect_flags, uint32_t mip_levels, uint32_t array_layers);
 
 VkxBuffer vkx_create_buffer(VkDeviceSize size, VkBufferUsageFlags usage,
 		VkMemoryPropertyFlags properties);
 void vkx_cleanup_buffer(VkxBuffer* buffer);
+VkDeviceAddress vkx_get_buffer_address(VkBuffer buffer);
+VkxBuffer vkx_import_host_buffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage, VkDeviceSize* data_offset);
+
+VkxRingBuffer vkx_create_ring_buffer(VkDeviceSize frame_size, VkBufferUsageFlags usage, bool prefer_device_local);
+void vkx_ring_buffer_begin_frame(VkxRingBuffer* ring, uint32_t frame);
+VkxRingAllocation vkx_ring_buffer_alloc(VkxRingBuffer* ring, VkDeviceSize size);
+void vkx_cleanup_ring_buffer(VkxRingBuffer* ring);
+
+uint64_t vkx_frame_timeline_pending(void);
+uint64_t vkx_frame_timeline_signal(void);
+uint64_t vkx_frame_timeline_completed(void);
+void vkx_frame_timeline_wait(uint64_t value);
+
+// Destroys something once no frame can be using it, and frees data if it
+// was allocated
+typedef void (*VkxDeferredDestroyFunc)(void* data);
+
+void vkx_defer_destroy(VkxDeferredDestroyFunc func, void* data);
+void vkx_defer_cleanup_buffer(VkxBuffer* buffer);
+void vkx_defer_cleanup_image(VkxImage* image);
+void vkx_defer_destroy_image_view(VkImageView view);
+void vkx_defer_cleanup_pipeline(VkxPipeline pipeline);
+void vkx_defer_memory_free(VkxAllocation* allocation);
+void vkx_collect_deferred_destroys(void);
+void vkx_flush_deferred_destroys(void);
 
 VkCommandBuffer vkx_begin_single_time_commands();
 
@@ -122,15 +431,33 @@ VkFormat vkx_find_supported_format(VkFormat* candidates, size_t candidates_count
 VkFormat vkx_find_depth_format();
 
 bool vkx_has_stencil_component(VkFormat format);
+VkSampleCountFlagBits vkx_get_max_sample_count(VkSampleCountFlagBits wanted);
 
 void vkx_transition_image_layout_tmp_buffer(VkImage image, VkFormat format, VkImageLayout old_layout, VkImageLayout new_layout);
 
 void vkx_transition_image_layout(VkCommandBuffer command_buffer, VkImage image, VkFormat format, VkImageLayout old_layout, VkImageLayout new_layout);
 
+void vkx_barrier_batch_begin(VkxBarrierBatch* batch, VkCommandBuffer command_buffer);
+void vkx_barrier_batch_add_image(VkxBarrierBatch* batch, VkImage image, VkFormat format, VkImageLayout old_layout, VkImageLayout new_layout);
+void vkx_barrier_batch_add_buffer(VkxBarrierBatch* batch, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size,
+		VkPipelineStageFlags2 src_stages, VkAccessFlags2 src_access, VkPipelineStageFlags2 dst_stages, VkAccessFlags2 dst_access);
+void vkx_barrier_batch_flush(VkxBarrierBatch* batch);
+
+VkImageMemoryBarrier2 vkx_image_ownership_release(VkImageMemoryBarrier2 barrier, uint32_t src_family, uint32_t dst_family);
+VkImageMemoryBarrier2 vkx_image_ownership_acquire(VkImageMemoryBarrier2 barrier, uint32_t src_family, uint32_t dst_family);
+VkBufferMemoryBarrier2 vkx_buffer_ownership_release(VkBufferMemoryBarrier2 barrier, uint32_t src_family, uint32_t dst_family);
+VkBufferMemoryBarrier2 vkx_buffer_ownership_acquire(VkBufferMemoryBarrier2 barrier, uint32_t src_family, uint32_t dst_family);
+
 void vkx_copy_buffer(VkBuffer src_buffer, VkBuffer dst_buffer, VkDeviceSize size);
 
 void vkx_copy_buffer_to_image(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
 
-VkxImage vkx_create_texture_image(const char* filename);
+uint32_t vkx_texture_mip_levels(uint32_t width, uint32_t height, bool generate_mipmaps);
+uint8_t* vkx_load_image_pixels(const char* filename, int* width, int* height);
+bool vkx_decode_texture(const char* filename, VkxDecodedTexture* texture);
+void vkx_free_decoded_texture(VkxDecodedTexture* texture);
+void vkx_create_decoded_textures(uint32_t count, const VkxDecodedTexture* textures, VkxImage* images, bool generate_mipmaps);
+VkxImage vkx_create_texture_image(const char* filename, bool generate_mipmaps);
+void vkx_create_texture_images(const char* const* filenames, uint32_t count, VkxImage* images, bool generate_mipmaps);
 
 #endif // VKX_CORE_H
@@ -0,0 +1,60 @@
+#ifndef VKX_DEBUG_H
+#define VKX_DEBUG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+#include "vkx/vkx_core.h"
+
+// Object names and command buffer labels for capture tools (RenderDoc, Nsight,
+// RGP...) with VK_EXT_debug_utils, where the instance has it.  Built with
+// NDEBUG (i.e. release builds) they compile out to nothing
+#ifndef NDEBUG
+
+void vkx_debug_init(void);
+
+void vkx_set_object_name(VkObjectType type, uint64_t handle, const char* name);
+void vkx_set_buffer_name(const VkxBuffer* buffer, const char* name);
+void vkx_set_image_name(const VkxImage* image, const char* name);
+void vkx_set_pipeline_name(const VkxPipeline* pipeline, const char* name);
+
+void vkx_cmd_begin_label(VkCommandBuffer command_buffer, const char* name);
+void vkx_cmd_end_label(VkCommandBuffer command_buffer);
+
+#else
+
+static inline void vkx_debug_init(void) {}
+
+static inline void vkx_set_object_name(VkObjectType type, uint64_t handle, const char* name) {
+	(void) type;
+	(void) handle;
+	(void) name;
+}
+
+static inline void vkx_set_buffer_name(const VkxBuffer* buffer, const char* name) {
+	(void) buffer;
+	(void) name;
+}
+
+static inline void vkx_set_image_name(const VkxImage* image, const char* name) {
+	(void) image;
+	(void) name;
+}
+
+static inline void vkx_set_pipeline_name(const VkxPipeline* pipeline, const char* name) {
+	(void) pipeline;
+	(void) name;
+}
+
+static inline void vkx_cmd_begin_label(VkCommandBuffer command_buffer, const char* name) {
+	(void) command_buffer;
+	(void) name;
+}
+
+static inline void vkx_cmd_end_label(VkCommandBuffer command_buffer) {
+	(void) command_buffer;
+}
+
+#endif // NDEBUG
+
+#endif // VKX_DEBUG_H
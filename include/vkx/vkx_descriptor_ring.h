@@ -0,0 +1,21 @@
+#ifndef VKX_DESCRIPTOR_RING_H
+#define VKX_DESCRIPTOR_RING_H
+
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+#include "vkx/vkx_core.h"
+
+// Sets in the first pool of each frame, with every pool chained on after it
+// twice the size of the one before, and at most this many pools a frame
+#define VKX_DESCRIPTOR_RING_POOL_SETS 64
+#define VKX_DESCRIPTOR_RING_MAX_POOLS 16
+// Descriptors of each type the pools have for each of their sets
+#define VKX_DESCRIPTOR_RING_DESCRIPTORS_PER_SET 4
+
+void vkx_descriptor_ring_init(void);
+void vkx_descriptor_ring_cleanup(void);
+
+void vkx_descriptor_ring_begin_frame(uint32_t frame);
+VkDescriptorSet vkx_descriptor_ring_allocate(VkDescriptorSetLayout layout);
+
+#endif // VKX_DESCRIPTOR_RING_H
@@ -0,0 +1,223 @@
+#ifndef VKX_FRAME_GRAPH_H
+#define VKX_FRAME_GRAPH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+#include "vkx/vkx_core.h"
+
+#define VKX_FRAME_GRAPH_MAX_PASSES 16
+#define VKX_FRAME_GRAPH_MAX_IMAGES 16
+// Attachments and sampled images in a single pass
+#define VKX_FRAME_GRAPH_MAX_PASS_IMAGES 8
+#define VKX_FRAME_GRAPH_MAX_BARRIERS (VKX_FRAME_GRAPH_MAX_PASSES * VKX_FRAME_GRAPH_MAX_PASS_IMAGES + VKX_FRAME_GRAPH_MAX_IMAGES)
+
+// With VKX_FRAME_GRAPH_AUTO the transients are only duplicated for each frame
+// in flight if all of the copies fit in this fraction of the available memory
+#define VKX_FRAME_GRAPH_BUDGET_DIVISOR 4
+
+typedef enum {
+	// Pick between the other two depending on the memory budget
+	VKX_FRAME_GRAPH_AUTO,
+	// One set of transient images for each frame in flight
+	VKX_FRAME_GRAPH_PER_FRAME,
+	// A single set used by all of the frames in flight
+	VKX_FRAME_GRAPH_SHARED,
+} VkxFrameGraphTransientMode;
+
+typedef enum {
+	VKX_FRAME_GRAPH_COLOR_ATTACHMENT,
+	VKX_FRAME_GRAPH_DEPTH_ATTACHMENT,
+	// Where a multisampled colour attachment of the same pass is resolved to
+	VKX_FRAME_GRAPH_RESOLVE_ATTACHMENT,
+	// Sampled in the fragment shader
+	VKX_FRAME_GRAPH_SAMPLED,
+	// Copied or blitted from and to, outside of rendering
+	VKX_FRAME_GRAPH_TRANSFER_SOURCE,
+	VKX_FRAME_GRAPH_TRANSFER_DESTINATION,
+	// Written as a storage image and sampled in compute shaders, outside of
+	// rendering
+	VKX_FRAME_GRAPH_STORAGE,
+	VKX_FRAME_GRAPH_COMPUTE_SAMPLED,
+	// Where the pass's fragment shading rate comes from, one texel for each
+	// block of its pixels (VK_KHR_fragment_shading_rate)
+	VKX_FRAME_GRAPH_SHADING_RATE_ATTACHMENT,
+	// A colour attachment whose pixels are also read back in the same pass, as
+	// an input attachment (VK_KHR_dynamic_rendering_local_read)
+	VKX_FRAME_GRAPH_LOCAL_READ_ATTACHMENT,
+} VkxFrameGraphUsage;
+
+// How an image was last used, which is what the next barrier waits on
+typedef struct {
+	VkImageLayout layout;
+	VkPipelineStageFlags2 stages;
+	VkAccessFlags2 access;
+} VkxFrameGraphState;
+
+typedef struct {
+	uint32_t image;
+	VkxFrameGraphUsage usage;
+	// As the pass was given it, until vkx_frame_graph_compile() finds the
+	// contents before the pass don't matter
+	VkAttachmentLoadOp load_op;
+	// Worked out by vkx_frame_graph_compile()
+	VkAttachmentStoreOp store_op;
+	// Every pixel of the render area is drawn over, see
+	// vkx_frame_graph_set_covered()
+	bool covered;
+	VkClearValue clear_value;
+	// For colour attachments, the image they're resolved to or UINT32_MAX
+	uint32_t resolve_image;
+} VkxFrameGraphAccess;
+
+typedef struct {
+	VkxFrameGraphAccess accesses[VKX_FRAME_GRAPH_MAX_PASS_IMAGES];
+	uint32_t accesses_count;
+	// Part of the attachments to render to, from the top left.  Zero for all of
+	// the attachment (this can change between frames)
+	VkExtent2D render_extent;
+	// Part of that which is drawn, with the viewport left where it is.  Zero
+	// for all of it (this can change between frames too)
+	VkRect2D render_area;
+	// Views rendered at once with multiview, one to each layer of the
+	// attachments.  0 for none
+	uint32_t view_mask;
+	// The pixels each texel of its shading rate attachment covers, if it has
+	// one
+	VkExtent2D shading_rate_texel_size;
+	// Recorded in a command buffer for the compute queue
+	bool async_compute;
+	// Barriers recorded before the pass
+	uint32_t barriers_first;
+	uint32_t barriers_count;
+} VkxFrameGraphPass;
+
+typedef struct {
+	VkFormat format;
+	VkImageAspectFlags aspect;
+	VkExtent2D extent;
+	// Transient images can have layers, e.g. for multiview, and more than one
+	// sample a pixel
+	uint32_t array_layers;
+	VkSampleCountFlagBits samples;
+	// Transient images are created by the graph, one per frame in flight (or
+	// shared between them), and their contents don't last past the frame
+	bool transient;
+	VkImageUsageFlags usage;
+	// Imported images are left in final.layout and final.stages is what waits
+	// for them (e.g. nothing for presenting, as that waits on a semaphore)
+	VkxFrameGraphState initial;
+	VkxFrameGraphState final;
+	// First and last passes using the image
+	uint32_t first_pass;
+	uint32_t last_pass;
+	// Transient images whose passes don't overlap share memory
+	uint32_t memory_slot;
+	// Transient attachments which only live inside one pass are never written
+	// out to memory, so on tiled GPUs they can use lazily allocated memory
+	bool lazy;
+	// Used on both the graphics and the compute queue, so it is shared between
+	// their families rather than having its ownership transferred
+	bool concurrent;
+	// Transient images which keep their contents from one frame to the next
+	// (on the same copy), and which copies have been through a frame
+	bool persistent;
+	bool initialized[VKX_MAX_FRAMES_IN_FLIGHT];
+	// Imported images only use the first of these
+	VkImage images[VKX_MAX_FRAMES_IN_FLIGHT];
+	VkImageView views[VKX_MAX_FRAMES_IN_FLIGHT];
+} VkxFrameGraphImage;
+
+// The attachments of a pass, for recording secondary command buffers inside it
+typedef struct {
+	VkFormat color_formats[VKX_FRAME_GRAPH_MAX_PASS_IMAGES];
+	uint32_t color_formats_count;
+	// VK_FORMAT_UNDEFINED without a depth attachment
+	VkFormat depth_format;
+	VkSampleCountFlagBits samples;
+	// The area rendered this frame
+	VkExtent2D extent;
+	// The part of it which is drawn, which the scissor is set to
+	VkRect2D render_area;
+	uint32_t view_mask;
+} VkxFrameGraphPassInfo;
+
+typedef struct {
+	VkxFrameGraphImage images[VKX_FRAME_GRAPH_MAX_IMAGES];
+	uint32_t images_count;
+	VkxFrameGraphPass passes[VKX_FRAME_GRAPH_MAX_PASSES];
+	uint32_t passes_count;
+
+	// Compiled barriers for all of the passes, the image handles are filled in
+	// when they are recorded
+	VkImageMemoryBarrier2 barriers[VKX_FRAME_GRAPH_MAX_BARRIERS];
+	uint32_t barrier_images[VKX_FRAME_GRAPH_MAX_BARRIERS];
+	uint32_t barriers_count;
+	// Barriers to the final layouts, after the last pass
+	uint32_t final_barriers_first;
+	uint32_t final_barriers_count;
+
+	// Memory for the transient images, per frame in flight
+	VkxAllocation memory[VKX_MAX_FRAMES_IN_FLIGHT][VKX_FRAME_GRAPH_MAX_IMAGES];
+	VkMemoryPropertyFlags memory_slot_properties[VKX_FRAME_GRAPH_MAX_IMAGES];
+	uint32_t memory_slots_count;
+	VkxFrameGraphTransientMode transient_mode;
+	// Copies of each transient image, 1 if they are shared
+	uint32_t transient_copies;
+	// Some passes are on the compute queue
+	bool async_compute;
+	bool compiled;
+
+	// The frame being recorded
+	VkCommandBuffer command_buffer;
+	uint32_t frame;
+	uint32_t next_pass;
+	bool in_pass;
+} VkxFrameGraph;
+
+void vkx_frame_graph_init(VkxFrameGraph* graph);
+void vkx_frame_graph_cleanup(VkxFrameGraph* graph);
+
+uint32_t vkx_frame_graph_import_image(VkxFrameGraph* graph, VkFormat format,
+		VkxFrameGraphState initial, VkxFrameGraphState final);
+uint32_t vkx_frame_graph_create_image(VkxFrameGraph* graph, uint32_t width, uint32_t height, VkFormat format);
+uint32_t vkx_frame_graph_create_image_array(VkxFrameGraph* graph, uint32_t width, uint32_t height, VkFormat format, uint32_t array_layers);
+void vkx_frame_graph_set_samples(VkxFrameGraph* graph, uint32_t image, VkSampleCountFlagBits samples);
+void vkx_frame_graph_set_persistent(VkxFrameGraph* graph, uint32_t image);
+void vkx_frame_graph_set_image(VkxFrameGraph* graph, uint32_t image, VkImage handle, VkImageView view, VkExtent2D extent);
+
+uint32_t vkx_frame_graph_add_pass(VkxFrameGraph* graph);
+void vkx_frame_graph_add_color_attachment(VkxFrameGraph* graph, uint32_t pass, uint32_t image,
+		VkAttachmentLoadOp load_op, VkClearValue clear_value);
+void vkx_frame_graph_add_depth_attachment(VkxFrameGraph* graph, uint32_t pass, uint32_t image,
+		VkAttachmentLoadOp load_op, VkClearValue clear_value);
+void vkx_frame_graph_add_resolve_attachment(VkxFrameGraph* graph, uint32_t pass, uint32_t image, uint32_t resolve_image);
+void vkx_frame_graph_add_sampled_image(VkxFrameGraph* graph, uint32_t pass, uint32_t image);
+void vkx_frame_graph_add_transfer_source(VkxFrameGraph* graph, uint32_t pass, uint32_t image);
+void vkx_frame_graph_add_transfer_destination(VkxFrameGraph* graph, uint32_t pass, uint32_t image);
+void vkx_frame_graph_add_storage_image(VkxFrameGraph* graph, uint32_t pass, uint32_t image);
+void vkx_frame_graph_add_compute_sampled_image(VkxFrameGraph* graph, uint32_t pass, uint32_t image);
+void vkx_frame_graph_add_shading_rate_attachment(VkxFrameGraph* graph, uint32_t pass, uint32_t image, VkExtent2D texel_size);
+void vkx_frame_graph_add_local_read_attachment(VkxFrameGraph* graph, uint32_t pass, uint32_t image,
+		VkAttachmentLoadOp load_op, VkClearValue clear_value);
+void vkx_frame_graph_set_covered(VkxFrameGraph* graph, uint32_t pass, uint32_t image);
+void vkx_frame_graph_set_render_extent(VkxFrameGraph* graph, uint32_t pass, VkExtent2D extent);
+void vkx_frame_graph_set_render_area(VkxFrameGraph* graph, uint32_t pass, VkRect2D area);
+void vkx_frame_graph_set_view_mask(VkxFrameGraph* graph, uint32_t pass, uint32_t view_mask);
+void vkx_frame_graph_set_async_compute(VkxFrameGraph* graph, uint32_t pass);
+
+void vkx_frame_graph_set_transient_mode(VkxFrameGraph* graph, VkxFrameGraphTransientMode mode);
+void vkx_frame_graph_compile(VkxFrameGraph* graph);
+VkImageView vkx_frame_graph_get_view(const VkxFrameGraph* graph, uint32_t image, uint32_t frame);
+VkImage vkx_frame_graph_get_image(const VkxFrameGraph* graph, uint32_t image);
+
+void vkx_frame_graph_begin(VkxFrameGraph* graph, VkCommandBuffer command_buffer, uint32_t frame);
+void vkx_frame_graph_set_command_buffer(VkxFrameGraph* graph, VkCommandBuffer command_buffer);
+void vkx_frame_graph_begin_pass(VkxFrameGraph* graph, uint32_t pass);
+void vkx_frame_graph_begin_secondary_pass(VkxFrameGraph* graph, uint32_t pass);
+VkxFrameGraphPassInfo vkx_frame_graph_get_pass_info(const VkxFrameGraph* graph, uint32_t pass);
+void vkx_frame_graph_cmd_local_read_barrier(VkxFrameGraph* graph);
+void vkx_frame_graph_end_pass(VkxFrameGraph* graph);
+void vkx_frame_graph_end(VkxFrameGraph* graph);
+
+#endif // VKX_FRAME_GRAPH_H
@@ -0,0 +1,41 @@
+#ifndef VKX_HOST_MEMORY_H
+#define VKX_HOST_MEMORY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+extern const bool track_host_allocations;
+extern const bool pool_host_allocations;
+
+// Largest allocation the pools serve, the rest go to the heap
+#define VKX_HOST_POOL_MAX_SIZE 4096
+// Bytes each pool takes from the heap at a time
+#define VKX_HOST_POOL_CHUNK_SIZE (256 * 1024)
+
+typedef struct {
+	// Allocations made, and those made since vkx_host_memory_begin_frames()
+	uint64_t allocations_count;
+	uint64_t frame_allocations_count;
+	// Reallocations and frees, counted the same way
+	uint64_t reallocations_count;
+	uint64_t frame_reallocations_count;
+	uint64_t frees_count;
+	// Bytes currently allocated, and the most there has been
+	uint64_t live_bytes;
+	uint64_t peak_bytes;
+	// Allocations the driver made itself and told us about
+	uint64_t internal_allocations_count;
+	uint64_t internal_live_bytes;
+} VkxHostMemoryStats;
+
+void vkx_host_memory_init(void);
+void vkx_host_memory_cleanup(void);
+
+const VkAllocationCallbacks* vkx_get_allocator(VkObjectType object_type);
+
+void vkx_host_memory_begin_frames(void);
+VkxHostMemoryStats vkx_host_memory_get_stats(void);
+void vkx_host_memory_print_stats(void);
+
+#endif // VKX_HOST_MEMORY_H
@@ -2,13 +2,15 @@
 #define VKX_INIT_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <vulkan/vulkan.h>
 #include <SDL3/SDL.h>
 #include "vkx/vkx_core.h"
 
 extern const bool enable_validation_layers;
+extern const char* const preferred_physical_device;
 
-void vkx_init(SDL_Window* window);
+void vkx_init(SDL_Window* window, uint32_t frames_in_flight);
 void vkx_cleanup_instance();
 
 #endif // VKX_INIT_H
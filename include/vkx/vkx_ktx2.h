@@ -0,0 +1,31 @@
+#ifndef VKX_KTX2_H
+#define VKX_KTX2_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+#include "io.h"
+
+// More than enough for a 32768x32768 texture
+#define VKX_KTX2_MAX_LEVELS 16
+
+typedef struct {
+	VkFormat format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t mip_levels;
+	uint32_t array_layers;
+	// Where each level is in the file, level 0 being the largest.  Each level
+	// has all of the layers tightly packed
+	VkDeviceSize level_offsets[VKX_KTX2_MAX_LEVELS];
+	VkDeviceSize level_sizes[VKX_KTX2_MAX_LEVELS];
+} VkxKtx2Texture;
+
+bool vkx_ktx2_parse(const char* filename, const void* data, size_t size, VkxKtx2Texture* texture);
+bool vkx_ktx2_format_supported(VkFormat format);
+bool vkx_load_ktx2_texture(const char* filename, MappedFile* file, VkxKtx2Texture* texture);
+bool vkx_ktx2_write_rgba8(const char* filename, uint32_t width, uint32_t height, uint32_t mip_levels, const uint8_t* const* levels);
+
+#endif // VKX_KTX2_H
@@ -0,0 +1,71 @@
+#ifndef VKX_MEMORY_H
+#define VKX_MEMORY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+#include "vkx/vkx_core.h"
+
+// Default size of each device memory block.  Anything bigger than half of this
+// gets a dedicated block of its own
+#define VKX_MEMORY_BLOCK_SIZE (64 * 1024 * 1024)
+
+// Blocks are emptied when a heap's free space is more fragmented than this...
+#define VKX_MEMORY_DEFRAG_FRAGMENTATION 0.5f
+// ...starting with the emptiest one which is less full than this
+#define VKX_MEMORY_DEFRAG_MAX_USAGE 0.5f
+// A block which hasn't had anything moved out of it in this many frames is
+// given up on
+#define VKX_MEMORY_DEFRAG_STALL_FRAMES 300
+
+typedef struct {
+	// Total size of the heap as reported by the device
+	VkDeviceSize heap_size;
+	bool device_local;
+	// Number of device memory blocks allocated from this heap
+	uint32_t blocks_count;
+	// Number of resources placed in those blocks
+	uint32_t allocations_count;
+	// Bytes allocated from the device (sum of block sizes)
+	VkDeviceSize allocated_bytes;
+	// Bytes handed out to resources (not including alignment padding)
+	VkDeviceSize used_bytes;
+	// The same by tag
+	uint32_t tag_allocations_count[VKX_MEMORY_TAGS_COUNT];
+	VkDeviceSize tag_used_bytes[VKX_MEMORY_TAGS_COUNT];
+	// Free space in the shared blocks and the biggest single range of it.
+	// Fragmentation is how much of the free space isn't in the biggest range,
+	// from 0 (all in one place) to nearly 1
+	VkDeviceSize free_bytes;
+	VkDeviceSize largest_free_bytes;
+	float fragmentation;
+	// What the driver says we can use and are using (everything in the process,
+	// not just the blocks).  Without VK_EXT_memory_budget the budget is the
+	// heap size and the usage is the allocated bytes
+	VkDeviceSize budget_bytes;
+	VkDeviceSize usage_bytes;
+} VkxMemoryHeapStats;
+
+void vkx_memory_init(void);
+void vkx_memory_cleanup(void);
+
+VkxMemoryTag vkx_memory_set_tag(VkxMemoryTag tag);
+VkxMemoryTag vkx_memory_get_tag(void);
+const char* vkx_memory_get_tag_name(VkxMemoryTag tag);
+
+VkxAllocation vkx_memory_alloc(VkMemoryRequirements requirements, VkMemoryPropertyFlags properties, bool linear);
+bool vkx_memory_import_host(void* pointer, VkDeviceSize size, uint32_t type_filter, VkxAllocation* allocation);
+void vkx_memory_free(VkxAllocation* allocation);
+void vkx_memory_update_defragmentation(void);
+bool vkx_memory_is_moving(const VkxAllocation* allocation);
+bool vkx_memory_has_type(uint32_t type_filter, VkMemoryPropertyFlags properties);
+bool vkx_memory_has_mapped_device_local(VkDeviceSize size);
+uint32_t vkx_memory_get_type_heap(uint32_t type_filter, VkMemoryPropertyFlags properties);
+VkDeviceSize vkx_memory_get_available(uint32_t heap_index);
+
+uint32_t vkx_memory_get_heaps_count(void);
+VkxMemoryHeapStats vkx_memory_get_heap_stats(uint32_t heap_index);
+void vkx_memory_print_stats(void);
+bool vkx_memory_write_stats(const char* filename);
+
+#endif // VKX_MEMORY_H
@@ -0,0 +1,16 @@
+#ifndef VKX_PALETTE_H
+#define VKX_PALETTE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+#include "vkx/vkx_core.h"
+
+// Colours in each palette, so an index fits in a byte.  Index 0 is always the
+// fully transparent pixels
+#define VKX_PALETTE_COLOURS 256
+
+void vkx_quantise_pixels(const uint8_t* pixels, size_t count, uint8_t* indices, uint8_t palette[VKX_PALETTE_COLOURS * 4]);
+VkxImage vkx_create_palette_image(const uint8_t* colours, uint32_t rows);
+
+#endif // VKX_PALETTE_H
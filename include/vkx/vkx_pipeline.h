@@ -1,10 +1,150 @@
 #ifndef VKX_PIPELINE_H
 #define VKX_PIPELINE_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <vulkan/vulkan.h>
 #include "vkx/vkx_core.h"
 
+// The state which vertex buffer pipelines leave to the command buffer after
+// vkx_set_dynamic_render_state(true), for vkx_cmd_set_render_state()
+typedef struct {
+	VkCullModeFlags cull_mode;
+	bool depth_test;
+	bool depth_write;
+	VkCompareOp depth_compare_op;
+	// Blend with the source alpha.  Only dynamic if vkx_has_dynamic_blend(),
+	// otherwise it is whatever the pipeline was created with
+	bool alpha_blend;
+	// And with it, add the colour to what's there instead of blending it by
+	// its alpha, see vkx_set_additive_blend()
+	bool additive_blend;
+} VkxRenderState;
+
+// Distinct shader paths which can be loaded
+#define VKX_MAX_SHADER_MODULES 64
+
+// Distinct parts of vertex buffer pipelines, see vkx_set_pipeline_libraries()
+#define VKX_MAX_PIPELINE_LIBRARIES 128
+
+// Distinct samplers, descriptor set layouts and pipeline layouts, see
+// vkx_get_sampler()
+#define VKX_MAX_CACHED_OBJECTS 256
+
+// Bindings after the first three which the vertex buffer pipelines' fragment
+// shaders can have, see vkx_set_fragment_bindings()
+#define VKX_MAX_FRAGMENT_BINDINGS 4
+
+// The standard bindings of vkx_create_descriptor_set_layout(), by how often
+// they change.  Each keeps its binding number whichever of the others are left
+// out, so a pipeline's layout only has what its shaders read
+typedef enum {
+	// Binding 0, the frame's uniform buffer (dynamic, offset once a frame)
+	VKX_SET_UNIFORMS = 1,
+	// Binding 1, the textures, which only change with the material
+	VKX_SET_TEXTURES = 2,
+	// Binding 2, the per-draw storage buffer, e.g. the sprite transforms
+	// (dynamic, offset for each draw's data)
+	VKX_SET_DRAW_DATA = 4,
+	VKX_SET_ALL = VKX_SET_UNIFORMS | VKX_SET_TEXTURES | VKX_SET_DRAW_DATA,
+} VkxSetBindings;
+
+// Bindings a VkxPushSet can have
+#define VKX_MAX_PUSH_SET_BINDINGS 8
+
+// A set whose bindings are given while recording instead of being allocated
+// and written up front, e.g. a material's textures.  With VK_KHR_push_descriptor
+// they're pushed into the command buffer, otherwise they're written into a
+// set from the descriptor ring (see vkx_descriptor_ring.c), both through the
+// same update template.  Only one thread records with each
+typedef struct {
+	VkDescriptorSetLayout layout;
+	VkDescriptorUpdateTemplate update_template;
+	VkPipelineBindPoint bind_point;
+	VkPipelineLayout pipeline_layout;
+	uint32_t set;
+	VkDescriptorType types[VKX_MAX_PUSH_SET_BINDINGS];
+	uint32_t bindings_count;
+	uint32_t frame;
+	// After vkx_set_descriptor_buffers(true), it may instead be written into
+	// a buffer holding max_pushes copies of the set for each frame in flight,
+	// set_size apart, with its bindings at binding_offsets in each
+	bool uses_descriptor_buffer;
+	VkxBuffer descriptor_buffer;
+	VkDeviceAddress descriptor_buffer_address;
+	VkBufferUsageFlags descriptor_buffer_usage;
+	VkDeviceSize set_size;
+	VkDeviceSize binding_offsets[VKX_MAX_PUSH_SET_BINDINGS];
+	uint32_t max_pushes;
+	uint32_t pushes;
+} VkxPushSet;
+
+// What a binding of a VkxPushSet is set to, one for each in binding order
+typedef union {
+	VkDescriptorImageInfo image;
+	VkDescriptorBufferInfo buffer;
+} VkxPushSetData;
+
+// SPIR-V compiled into the binary, see the EMBED_SHADERS option in
+// CMakeLists.txt.  The code is in words so that it is aligned for
+// vkCreateShaderModule()
+typedef struct {
+	const char* path;
+	const uint32_t* code;
+	size_t size;
+} VkxEmbeddedShader;
+
+#ifdef VKX_EMBEDDED_SHADERS
+extern const VkxEmbeddedShader vkx_embedded_shaders[];
+extern const uint32_t vkx_embedded_shaders_count;
+#endif
+
+void vkx_init_pipeline_cache(const char* path);
+void vkx_cleanup_pipeline_cache(void);
+
+void vkx_set_dynamic_render_state(bool enabled);
+void vkx_set_descriptor_buffers(bool enabled);
+void vkx_set_shader_objects(bool enabled);
+void vkx_set_pipeline_libraries(bool enabled);
+void vkx_set_view_mask(uint32_t mask);
+uint32_t vkx_get_view_mask(void);
+void vkx_set_depth_buffer(bool enabled);
+VkFormat vkx_get_depth_format(void);
+void vkx_set_color_format(VkFormat format);
+VkFormat vkx_get_color_format(void);
+void vkx_set_fragment_bindings(const VkDescriptorType* types, uint32_t count);
+void vkx_set_multisampling(VkSampleCountFlagBits samples, bool alpha_to_coverage);
+void vkx_set_additive_blend(bool enabled);
+VkSampleCountFlagBits vkx_get_sample_count(void);
+void vkx_set_shading_rate(bool enabled, bool attachment);
+bool vkx_has_shading_rate(void);
+bool vkx_has_shading_rate_attachment(void);
+bool vkx_has_dynamic_render_state(void);
+bool vkx_has_dynamic_blend(void);
+void vkx_cmd_set_render_state(VkCommandBuffer command_buffer, const VkxRenderState* state);
+void vkx_cmd_set_shading_rate(VkCommandBuffer command_buffer, VkExtent2D fragment_size, bool use_attachment);
+void vkx_cmd_bind_pipeline(VkCommandBuffer command_buffer, const VkxPipeline* pipeline);
+
+VkDescriptorSetLayout vkx_create_descriptor_set_layout(VkxSetBindings bindings, uint32_t num_textures,
+		const VkDescriptorType* fragment_types, uint32_t fragment_count);
+
+void vkx_push_set_init(VkxPushSet* push_set, const VkDescriptorType* types, VkShaderStageFlags stages,
+		uint32_t count, uint32_t max_pushes_per_frame);
+void vkx_push_set_create_template(VkxPushSet* push_set, VkPipelineLayout pipeline_layout,
+		VkPipelineBindPoint bind_point, uint32_t set);
+void vkx_push_set_begin_frame(VkxPushSet* push_set, uint32_t frame);
+void vkx_cmd_push_set(VkxPushSet* push_set, VkCommandBuffer command_buffer, const VkxPushSetData* data);
+void vkx_push_set_cleanup(VkxPushSet* push_set);
+
+VkSampler vkx_get_sampler(const VkSamplerCreateInfo* create_info);
+VkDescriptorSetLayout vkx_get_descriptor_set_layout(const VkDescriptorSetLayoutCreateInfo* create_info);
+VkPipelineLayout vkx_get_pipeline_layout(const VkPipelineLayoutCreateInfo* create_info);
+
 VkShaderModule vkx_load_shader_module(const char* path);
+void vkx_reload_shader_module(const char* path);
+void vkx_destroy_retired_shader_modules(void);
+const char* vkx_get_embedded_shader(const char* path, size_t* code_size);
 
 VkxPipeline vkx_create_vertex_buffer_pipeline(
 		const char* vert_shader_path,
@@ -13,12 +153,56 @@ VkxPipeline vkx_create_vertex_buffer_pipeline(
 		VkVertexInputAttributeDescription* attribute_descriptions,
 		size_t attribute_descriptions_count,
 		VkPushConstantRange push_constant_range,
-		uint32_t num_textures
+		uint32_t num_textures,
+		bool use_texture_table,
+		bool alpha_blend,
+		VkDescriptorSetLayout extra_set_layout,
+		const VkSpecializationInfo* specialization
+);
+
+VkxPipeline vkx_create_mesh_pipeline(
+		const char* task_shader_path,
+		const char* mesh_shader_path,
+		const char* frag_shader_path,
+		VkPushConstantRange push_constant_range,
+		uint32_t num_textures,
+		bool use_texture_table,
+		const VkSpecializationInfo* specialization
 );
+void vkx_cmd_draw_mesh_tasks(VkCommandBuffer command_buffer, uint32_t group_count_x, uint32_t group_count_y, uint32_t group_count_z);
 
 VkxPipeline vkx_create_screen_pipeline(
 		const char* vert_shader_path,
-		const char* frag_shader_path
+		const char* frag_shader_path,
+		uint32_t num_textures,
+		VkFormat color_format,
+		const VkSpecializationInfo* specialization
+);
+
+VkxPipeline vkx_create_local_read_pipeline(
+		const char* vert_shader_path,
+		const char* frag_shader_path,
+		const VkxPushSet* push_set,
+		const VkSpecializationInfo* specialization
+);
+
+VkxPipeline vkx_create_overlay_pipeline(
+		const char* vert_shader_path,
+		const char* frag_shader_path,
+		VkVertexInputBindingDescription binding_description,
+		VkVertexInputAttributeDescription* attribute_descriptions,
+		size_t attribute_descriptions_count,
+		VkPushConstantRange push_constant_range,
+		const VkxPushSet* push_set,
+		VkFormat color_format
+);
+
+VkxPipeline vkx_create_compute_pipeline(
+		const char* comp_shader_path,
+		const VkDescriptorType* binding_types,
+		uint32_t bindings_count,
+		VkPushConstantRange push_constant_range,
+		const VkSpecializationInfo* specialization
 );
 
 void vkx_cleanup_pipeline(VkxPipeline pipeline);
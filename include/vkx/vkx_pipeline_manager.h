@@ -0,0 +1,50 @@
+#ifndef VKX_PIPELINE_MANAGER_H
+#define VKX_PIPELINE_MANAGER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+#include "vkx/vkx_core.h"
+
+#define VKX_PIPELINE_MANAGER_MAX_PIPELINES 64
+#define VKX_PIPELINE_MANAGER_MAX_THREADS 8
+#define VKX_PIPELINE_MANAGER_MAX_ATTRIBUTES 8
+#define VKX_PIPELINE_MANAGER_MAX_SPECIALIZATION_ENTRIES 8
+#define VKX_PIPELINE_MANAGER_MAX_SPECIALIZATION_SIZE 64
+
+// The arguments of vkx_create_vertex_buffer_pipeline(), copied so that they can
+// be used after the request returns (apart from the shader paths, which have to
+// stay around until the pipeline is ready)
+typedef struct {
+	const char* vert_shader_path;
+	const char* frag_shader_path;
+	VkVertexInputBindingDescription binding_description;
+	VkVertexInputAttributeDescription attribute_descriptions[VKX_PIPELINE_MANAGER_MAX_ATTRIBUTES];
+	uint32_t attribute_descriptions_count;
+	VkPushConstantRange push_constant_range;
+	uint32_t num_textures;
+	bool use_texture_table;
+	bool alpha_blend;
+	VkDescriptorSetLayout extra_set_layout;
+	// Constants for both of the shaders, none if the count is 0
+	VkSpecializationMapEntry specialization_entries[VKX_PIPELINE_MANAGER_MAX_SPECIALIZATION_ENTRIES];
+	uint32_t specialization_entries_count;
+	uint8_t specialization_data[VKX_PIPELINE_MANAGER_MAX_SPECIALIZATION_SIZE];
+	size_t specialization_data_size;
+} VkxPipelineDesc;
+
+void vkx_pipeline_manager_init(uint32_t num_threads);
+void vkx_pipeline_manager_cleanup(void);
+
+void vkx_pipeline_desc_set_specialization(VkxPipelineDesc* desc, const VkSpecializationInfo* specialization);
+
+uint32_t vkx_pipeline_manager_request(const VkxPipelineDesc* desc, const VkxPipeline* fallback);
+bool vkx_pipeline_manager_is_ready(uint32_t handle);
+const VkxPipeline* vkx_pipeline_manager_get(uint32_t handle);
+void vkx_pipeline_manager_wait_all(void);
+
+uint32_t vkx_pipeline_manager_reload(const char* shader_path);
+uint32_t vkx_pipeline_manager_swap_reloaded(void);
+
+#endif // VKX_PIPELINE_MANAGER_H
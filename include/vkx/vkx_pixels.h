@@ -0,0 +1,47 @@
+#ifndef VKX_PIXELS_H
+#define VKX_PIXELS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Conversions of RGBA8 pixels done in one pass as they're copied (see
+// vkx_pixels.c), in this order
+//
+// Reorder the channels, see VkxPixelConversion.swizzle
+#define VKX_PIXELS_SWIZZLE 1u
+// Give the fully transparent pixels the colour of their visible neighbours,
+// so filtering at the edges of what's visible (and of atlas regions) doesn't
+// bring in whatever colour the transparent pixels were.  Pointless along with
+// VKX_PIXELS_PREMULTIPLY, which makes them black
+#define VKX_PIXELS_BLEED 2u
+// Multiply the colour by the alpha
+#define VKX_PIXELS_PREMULTIPLY 4u
+// Find the visible pixels of each region, see VkxPixelConversion.bounds
+#define VKX_PIXELS_BOUNDS 8u
+
+// The pixels of a region whose alpha isn't 0, from its top left corner
+// inclusive.  max_x is below min_x if there are none
+typedef struct {
+	int32_t min_x;
+	int32_t min_y;
+	int32_t max_x;
+	int32_t max_y;
+} VkxPixelBounds;
+
+typedef struct {
+	// VKX_PIXELS_* flags
+	uint32_t flags;
+	// The channel of the source each channel of the result comes from, e.g.
+	// {2, 1, 0, 3} for BGRA
+	uint8_t swizzle[4];
+	// A grid of regions_x by regions_y regions the image is cut into, e.g. the
+	// frames of a sprite sheet, and their bounds, row by row.  The pixels to
+	// the right and below the last whole region aren't in any
+	uint32_t regions_x;
+	uint32_t regions_y;
+	VkxPixelBounds* bounds;
+} VkxPixelConversion;
+
+void vkx_convert_pixels(const VkxPixelConversion* conversion, const uint8_t* src, uint8_t* dst, uint32_t width, uint32_t height);
+
+#endif // VKX_PIXELS_H
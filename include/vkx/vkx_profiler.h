@@ -0,0 +1,100 @@
+#ifndef VKX_PROFILER_H
+#define VKX_PROFILER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+#include "vkx/vkx_core.h"
+
+#define VKX_PROFILER_MAX_SCOPES 16
+// Samples kept for each scope's statistics, a few seconds' worth
+#define VKX_PROFILER_HISTORY 512
+// How often the GPU's clock is matched up with the CPU's again, as they drift
+// apart, and the tries each time (the quickest is used)
+#define VKX_PROFILER_CALIBRATION_INTERVAL_NS 1000000000ull
+#define VKX_PROFILER_CALIBRATION_TRIES 4
+
+// What a statistics scope's draws did, in the order of their
+// VkQueryPipelineStatisticFlagBits
+typedef struct {
+	uint64_t vertex_invocations;
+	// Primitives which went into clipping, i.e. weren't culled before it
+	uint64_t clipping_invocations;
+	uint64_t fragment_invocations;
+} VkxProfilerStatistics;
+
+typedef struct {
+	const char* name;
+	// GPU times in milliseconds, a ring of the most recent samples
+	float samples[VKX_PROFILER_HISTORY];
+	uint32_t samples_count;
+	uint32_t next_sample;
+	// The newest sample
+	float last;
+	// When it started and ended on the SDL_GetTicksNS() clock, if the
+	// profiler is calibrated, and whether the last vkx_profiler_collect()
+	// read it
+	uint64_t last_start_ns;
+	uint64_t last_end_ns;
+	bool collected;
+	// Timestamps were written in the command buffer for each frame in flight
+	bool written[VKX_MAX_FRAMES_IN_FLIGHT];
+	// Whether the scope also counts its pipeline statistics, see
+	// vkx_profiler_add_statistics_scope(), and the newest counts
+	bool statistics;
+	VkxProfilerStatistics last_statistics;
+} VkxProfilerScope;
+
+typedef struct {
+	float min;
+	float avg;
+	float max;
+	float p99;
+} VkxProfilerStats;
+
+typedef struct {
+	// NULL if the graphics queue doesn't have timestamps, in which case
+	// everything else does nothing
+	VkQueryPool query_pool;
+	// And the pipeline statistics queries, NULL if the device can't count
+	// them (or there are no timestamps)
+	VkQueryPool statistics_pool;
+	// Nanoseconds per tick, and the bits of the timestamps which are valid
+	double timestamp_period;
+	uint64_t timestamp_mask;
+	// With VK_EXT_calibrated_timestamps, a GPU timestamp and the
+	// SDL_GetTicksNS() time it was read at, which the others are put on the
+	// CPU's clock from (see vkx_profiler.c)
+	bool calibrated;
+	uint64_t calibration_timestamp;
+	uint64_t calibration_ns;
+	PFN_vkGetCalibratedTimestampsEXT get_calibrated_timestamps;
+
+	VkxProfilerScope scopes[VKX_PROFILER_MAX_SCOPES];
+	uint32_t scopes_count;
+
+	// The frame being recorded
+	VkCommandBuffer command_buffer;
+	uint32_t frame;
+	// A statistics scope's query is active, which only one can be at a time
+	bool statistics_active;
+} VkxProfiler;
+
+void vkx_profiler_init(VkxProfiler* profiler);
+void vkx_profiler_cleanup(VkxProfiler* profiler);
+bool vkx_profiler_is_enabled(const VkxProfiler* profiler);
+
+uint32_t vkx_profiler_add_scope(VkxProfiler* profiler, const char* name);
+uint32_t vkx_profiler_add_statistics_scope(VkxProfiler* profiler, const char* name);
+
+bool vkx_profiler_collect(VkxProfiler* profiler, uint32_t frame);
+void vkx_profiler_begin_frame(VkxProfiler* profiler, VkCommandBuffer command_buffer, uint32_t frame);
+void vkx_profiler_set_command_buffer(VkxProfiler* profiler, VkCommandBuffer command_buffer);
+void vkx_profiler_begin_scope(VkxProfiler* profiler, uint32_t scope);
+void vkx_profiler_end_scope(VkxProfiler* profiler, uint32_t scope);
+
+VkxProfilerStats vkx_profiler_get_stats(const VkxProfiler* profiler, uint32_t scope);
+VkxProfilerStatistics vkx_profiler_get_statistics(const VkxProfiler* profiler, uint32_t scope);
+void vkx_profiler_print(const VkxProfiler* profiler);
+
+#endif // VKX_PROFILER_H
@@ -0,0 +1,38 @@
+#ifndef VKX_RESIDENCY_H
+#define VKX_RESIDENCY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+#include "vkx/vkx_core.h"
+
+#define VKX_RESIDENCY_MAX_TEXTURES 1024
+// Placeholders are the texture shrunk to this size or less
+#define VKX_RESIDENCY_PLACEHOLDER_SIZE 32
+// Textures used in this many frames are never evicted, so what's on screen
+// doesn't get swapped in and out
+#define VKX_RESIDENCY_KEEP_FRAMES 120
+// Fraction of the device local heap's budget left for everything else
+#define VKX_RESIDENCY_HEAP_RESERVE 0.1
+
+typedef struct {
+	uint32_t textures_count;
+	uint32_t resident_count;
+	// Being decoded or uploaded
+	uint32_t streaming_count;
+	// Bytes of the full textures which are resident or on their way
+	VkDeviceSize resident_bytes;
+} VkxResidencyStats;
+
+void vkx_residency_init(VkSampler sampler, VkDeviceSize budget, bool generate_mipmaps);
+void vkx_residency_cleanup(void);
+
+void vkx_residency_add_textures(const char* const* filenames, uint32_t count, uint32_t* handles);
+uint32_t vkx_residency_get_table_index(uint32_t handle);
+bool vkx_residency_is_resident(uint32_t handle);
+void vkx_residency_use(uint32_t handle);
+void vkx_residency_update(void);
+void vkx_residency_move_textures(VkCommandBuffer command_buffer, VkDeviceSize max_bytes);
+VkxResidencyStats vkx_residency_get_stats(void);
+
+#endif // VKX_RESIDENCY_H
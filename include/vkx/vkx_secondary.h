@@ -0,0 +1,31 @@
+#ifndef VKX_SECONDARY_H
+#define VKX_SECONDARY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+#include "vkx/vkx_core.h"
+#include "vkx/vkx_frame_graph.h"
+
+// Secondary command buffers which can be recorded at the same time
+#define VKX_MAX_SECONDARY_COMMAND_BUFFERS 16
+
+typedef struct {
+	// Each command buffer has its own pool, so they can be recorded on
+	// different threads
+	VkCommandPool pools[VKX_MAX_FRAMES_IN_FLIGHT][VKX_MAX_SECONDARY_COMMAND_BUFFERS];
+	VkCommandBuffer command_buffers[VKX_MAX_FRAMES_IN_FLIGHT][VKX_MAX_SECONDARY_COMMAND_BUFFERS];
+	uint32_t count;
+	// The command buffers can be executed again in later frames, until they
+	// are begun again.  Otherwise they are recorded for one submit
+	bool reusable;
+} VkxSecondaryCommands;
+
+void vkx_secondary_commands_init(VkxSecondaryCommands* commands, uint32_t count, bool reusable);
+void vkx_secondary_commands_cleanup(VkxSecondaryCommands* commands);
+
+VkCommandBuffer vkx_secondary_commands_begin(VkxSecondaryCommands* commands, uint32_t frame, uint32_t index,
+		const VkxFrameGraphPassInfo* pass_info);
+void vkx_secondary_commands_end(VkCommandBuffer command_buffer);
+
+#endif // VKX_SECONDARY_H
@@ -0,0 +1,43 @@
+#ifndef VKX_SPARSE_ATLAS_H
+#define VKX_SPARSE_ATLAS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+#include "vkx/vkx_atlas.h"
+
+// Pages sampled in this many frames are never evicted, so what's on screen
+// doesn't get swapped in and out
+#define VKX_SPARSE_KEEP_FRAMES 60
+// Most mip levels the feedback has room for (SparseFeedback in the sparse
+// shaders)
+#define VKX_SPARSE_MAX_LEVELS 16
+
+typedef struct {
+	// Pages outside the mip tail, and how many of them are resident
+	uint32_t pages_count;
+	uint32_t resident_count;
+	// Pages the memory pool has room for
+	uint32_t slots_count;
+	// Pages sampled in the last frame read back which weren't resident
+	uint32_t requested_count;
+	// Device memory of the pool and the mip tail
+	VkDeviceSize pool_bytes;
+	VkDeviceSize tail_bytes;
+} VkxSparseAtlasStats;
+
+bool vkx_sparse_atlas_is_supported(void);
+VkxAtlas vkx_create_sparse_texture_atlas(const char* const* filenames, uint32_t count, uint32_t max_page_size,
+		VkDeviceSize budget, uint32_t max_pages_per_frame);
+void vkx_sparse_atlas_cleanup(void);
+
+VkDescriptorBufferInfo vkx_sparse_atlas_get_feedback(uint32_t frame);
+void vkx_sparse_atlas_update(uint32_t frame);
+bool vkx_sparse_atlas_get_bind_wait(VkSemaphoreSubmitInfo* wait_info);
+void vkx_sparse_atlas_record_uploads(VkCommandBuffer command_buffer, uint32_t frame);
+void vkx_sparse_atlas_record_feedback_barrier(VkCommandBuffer command_buffer);
+
+VkxSparseAtlasStats vkx_sparse_atlas_get_stats(void);
+void vkx_sparse_atlas_print_stats(void);
+
+#endif // VKX_SPARSE_ATLAS_H
@@ -4,8 +4,43 @@
 #include <vulkan/vulkan.h>
 #include "vkx/vkx_core.h"
 
+// A present of other windows' images along with vkx_swap_chain's, see
+// vkx_add_present_windows().  Has to last until the present
+typedef struct {
+	VkSwapchainKHR swap_chains[VKX_MAX_WINDOWS + 1];
+	uint32_t image_indices[VKX_MAX_WINDOWS + 1];
+	VkSemaphore wait_semaphores[VKX_MAX_WINDOWS + 1];
+	VkResult results[VKX_MAX_WINDOWS + 1];
+	uint64_t present_ids[VKX_MAX_WINDOWS + 1];
+	VkFence present_fences[VKX_MAX_WINDOWS + 1];
+	VkPresentModeKHR present_modes[VKX_MAX_WINDOWS + 1];
+	VkPresentRegionKHR present_regions[VKX_MAX_WINDOWS + 1];
+	// The windows after vkx_swap_chain, in order
+	VkxWindow* windows[VKX_MAX_WINDOWS];
+	uint32_t windows_count;
+} VkxPresentBatch;
+
 void vkx_create_swap_chain(bool create_depth_image);
+void vkx_create_headless_swap_chain(VkExtent2D extent, uint32_t images_count, bool create_depth_image);
 void vkx_cleanup_swap_chain();
 void vkx_recreate_swap_chain();
 
+void vkx_set_present_mode(VkPresentModeKHR present_mode, uint32_t image_count);
+bool vkx_switch_present_mode(VkPresentModeKHR present_mode);
+void vkx_set_pre_rotation(bool pre_rotate);
+void vkx_set_swap_chain_input_attachment(bool input_attachment);
+const char* vkx_present_mode_name(VkPresentModeKHR present_mode);
+void vkx_add_present_id(VkPresentInfoKHR* present_info, VkPresentIdKHR* present_id);
+void vkx_add_present_fence(VkPresentInfoKHR* present_info, VkSwapchainPresentFenceInfoEXT* fence_info,
+		VkSwapchainPresentModeInfoEXT* mode_info, uint32_t image_index);
+void vkx_add_present_region(VkPresentInfoKHR* present_info, VkPresentRegionsKHR* regions, VkPresentRegionKHR* region,
+		const VkRectLayerKHR* rect);
+bool vkx_wait_for_present(uint64_t present_id, uint64_t timeout_ns);
+
+bool vkx_create_window(VkxWindow* window, SDL_Window* sdl_window);
+void vkx_cleanup_window(VkxWindow* window);
+bool vkx_acquire_window_image(VkxWindow* window, uint32_t frame);
+void vkx_add_present_windows(VkPresentInfoKHR* present_info, VkxPresentBatch* batch, VkxWindow* windows, uint32_t windows_count);
+VkResult vkx_finish_present_windows(const VkxPresentBatch* batch, VkResult result);
+
 #endif // VXK_SWAP_CHAIN_H
@@ -0,0 +1,18 @@
+#ifndef VKX_TEXTURE_CACHE_H
+#define VKX_TEXTURE_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "io.h"
+#include "vkx/vkx_ktx2.h"
+
+void vkx_texture_cache_init(const char* directory, bool mip_chains);
+bool vkx_texture_cache_is_enabled(void);
+
+uint64_t vkx_texture_cache_key(const void* data, size_t size);
+bool vkx_texture_cache_load(uint64_t key, MappedFile* file, VkxKtx2Texture* texture);
+void vkx_texture_cache_store(uint64_t key, const uint8_t* pixels, uint32_t width, uint32_t height);
+
+#endif // VKX_TEXTURE_CACHE_H
@@ -0,0 +1,35 @@
+#ifndef VKX_TEXTURE_QUALITY_H
+#define VKX_TEXTURE_QUALITY_H
+
+#include <stdint.h>
+#include "vkx/vkx_core.h"
+
+// How much device local memory the device has for us, from its biggest heap's
+// budget (see vkx_get_memory_tier())
+typedef enum {
+	// Under VKX_MEMORY_TIER_LOW_BYTES, e.g. a 512 MB device or a small carve
+	// out of an integrated GPU's
+	VKX_MEMORY_TIER_LOW,
+	// Under VKX_MEMORY_TIER_MEDIUM_BYTES, e.g. a 1 GB device once the desktop
+	// and the driver have had theirs
+	VKX_MEMORY_TIER_MEDIUM,
+	VKX_MEMORY_TIER_HIGH,
+} VkxMemoryTier;
+
+#define VKX_MEMORY_TIER_LOW_BYTES (768ull * 1024 * 1024)
+#define VKX_MEMORY_TIER_MEDIUM_BYTES (1536ull * 1024 * 1024)
+
+// The longer side a texture isn't shrunk below, unless it has a minimum of its
+// own (see vkx_set_texture_min_size())
+#define VKX_TEXTURE_QUALITY_MIN_SIZE 256
+// Textures which can have their own minimum
+#define VKX_TEXTURE_QUALITY_MAX_RULES 64
+
+VkxMemoryTier vkx_get_memory_tier(void);
+void vkx_set_texture_quality(int32_t dropped_levels);
+void vkx_set_texture_min_size(const char* filename, uint32_t min_size);
+uint32_t vkx_get_texture_dropped_levels(const char* filename, uint32_t width, uint32_t height);
+uint8_t* vkx_reduce_image_quality(const char* filename, uint8_t* pixels, int* width, int* height);
+void vkx_reduce_texture_quality(const char* filename, VkxDecodedTexture* texture);
+
+#endif // VKX_TEXTURE_QUALITY_H
@@ -0,0 +1,29 @@
+#ifndef VKX_TEXTURE_TABLE_H
+#define VKX_TEXTURE_TABLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+#include "vkx/vkx_core.h"
+
+// Descriptor set number that pipelines using the table put it in
+#define VKX_TEXTURE_TABLE_SET 1
+
+// Returned by vkx_texture_table_add() if the table is full
+#define VKX_TEXTURE_TABLE_INVALID_INDEX UINT32_MAX
+
+void vkx_texture_table_init(uint32_t max_textures);
+void vkx_texture_table_cleanup(void);
+bool vkx_texture_table_is_initialised(void);
+
+uint32_t vkx_texture_table_add(VkImageView view, VkSampler sampler);
+void vkx_texture_table_remove(uint32_t index);
+void vkx_texture_table_replace(uint32_t index, VkImageView view, VkSampler sampler);
+void vkx_texture_table_begin_frame(uint32_t frame);
+
+uint32_t vkx_texture_table_get_capacity(void);
+uint32_t vkx_texture_table_get_count(void);
+VkDescriptorSetLayout vkx_texture_table_get_layout(void);
+VkDescriptorSet vkx_texture_table_get_set(void);
+
+#endif // VKX_TEXTURE_TABLE_H
@@ -0,0 +1,53 @@
+#ifndef VKX_UPLOAD_H
+#define VKX_UPLOAD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+#include "vkx/vkx_core.h"
+
+// Size of the persistently mapped staging buffer which uploads are carved out
+// of.  Anything bigger gets a staging buffer of its own
+#define VKX_UPLOAD_STAGING_ARENA_SIZE (32 * 1024 * 1024)
+// Smallest upload which vkx_upload_buffer_in_place() imports rather than
+// copying, as importing pins the pages and costs more than a small copy
+#define VKX_UPLOAD_IMPORT_MIN_SIZE (256 * 1024)
+
+typedef struct {
+	// The image (must have TRANSFER_DST usage)
+	VkImage image;
+	// Size of the base level
+	VkExtent2D extent;
+	// If this is more than 1 the lower levels are generated from the base level,
+	// which needs TRANSFER_SRC usage and linear blit support for the format
+	uint32_t mip_levels;
+	uint32_t array_layers;
+	// Tightly packed pixels for the base level, one layer after another
+	const void* pixels;
+	// Size of the pixel data in bytes
+	VkDeviceSize size;
+	// Offsets into pixels of all mip_levels levels when they are already there
+	// (like in a KTX2 file), in which case nothing is generated and the format
+	// can be block compressed.  NULL for just the base level
+	const VkDeviceSize* level_offsets;
+	// Done to the pixels as they're copied to the staging buffer, or NULL.  Only
+	// for a single layer of RGBA8 without level_offsets, and not on the host
+	const VkxPixelConversion* conversion;
+} VkxImageUpload;
+
+void vkx_upload_init(void);
+void vkx_upload_cleanup(void);
+
+void vkx_upload_buffer(VkBuffer dst_buffer, VkDeviceSize dst_offset, const void* data, VkDeviceSize size);
+void vkx_upload_buffer_in_place(VkBuffer dst_buffer, VkDeviceSize dst_offset, const void* data, VkDeviceSize size);
+void vkx_upload_image(VkImage image, uint32_t width, uint32_t height, uint32_t mip_levels, const void* pixels, VkDeviceSize size);
+void vkx_upload_images(uint32_t count, const VkxImageUpload* uploads);
+bool vkx_upload_can_copy_on_host(VkFormat format, VkImageUsageFlags usage);
+void vkx_upload_images_on_host(uint32_t count, const VkxImageUpload* uploads);
+
+uint64_t vkx_upload_flush(void);
+bool vkx_upload_is_complete(uint64_t value);
+void vkx_upload_wait(uint64_t value);
+VkSemaphore vkx_upload_get_semaphore(void);
+
+#endif // VKX_UPLOAD_H
@@ -0,0 +1,135 @@
+#ifndef WORLD_STREAM_H
+#define WORLD_STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "io.h"
+#include "jobs.h"
+#include "tile_store.h"
+
+/*
+ * World region file layout (all little endian):
+ *
+ *   WorldRegionHeader
+ *   WorldRegionEntry[WORLD_REGION_CHUNKS * WORLD_REGION_CHUNKS], row by row
+ *   each chunk's tiles (TileStoreChunk.tiles) as a raw LZ4 block (lz4_block.h)
+ *
+ * A region is WORLD_REGION_CHUNKS x WORLD_REGION_CHUNKS tile store chunks, in
+ * the file world_get_region_filename() names.  Empty chunks have no block, and
+ * a region with nothing in it has no file.
+ */
+#define WORLD_REGION_MAGIC 0x47525856 // "VXRG"
+#define WORLD_REGION_VERSION 1
+#define WORLD_REGION_CHUNKS 32
+
+// Chunks this far outside the view (in chunks) are streamed in ahead of the
+// camera, and aren't evicted
+#define WORLD_STREAM_MARGIN 4
+// And so are the chunks the view will sweep over in this many seconds at the
+// camera's velocity, but no more than this many chunks ahead, so a fast camera
+// doesn't ask for half the world
+#define WORLD_STREAM_LOOKAHEAD 1.0f
+#define WORLD_STREAM_MAX_LOOKAHEAD 8
+// Slowest the camera counts as heading towards a chunk, in tiles a second, so
+// the chunks it isn't heading for still get a time until they're visible
+#define WORLD_STREAM_MIN_SPEED 1.0f
+// Most chunk reads in flight at once
+#define WORLD_STREAM_MAX_REQUESTS 64
+// Most region files kept mapped at once
+#define WORLD_STREAM_MAX_REGIONS 16
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	// In regions
+	int32_t region_x;
+	int32_t region_y;
+	// TILE_STORE_CHUNK_SIZE of the writer
+	uint32_t chunk_size;
+	uint32_t _padding[3];
+} WorldRegionHeader;
+
+typedef struct {
+	// From the start of the file
+	uint64_t offset;
+	// Of the LZ4 block, 0 for an empty chunk
+	uint32_t size;
+	uint32_t _padding;
+} WorldRegionEntry;
+
+// Called when a chunk of the store is streamed in, or evicted
+typedef void (*WorldChunkFunc)(int32_t chunk_x, int32_t chunk_y, void* data);
+
+typedef struct {
+	bool used;
+	int32_t x;
+	int32_t y;
+	// The region's file and its index.  The entries are NULL if the region
+	// has no file (so nothing in it)
+	MappedFile file;
+	const WorldRegionEntry* entries;
+	// The stream's frame when it was last needed, for closing the least
+	// recently used
+	uint32_t last_used;
+	// Chunk reads in flight from it, which keep it open
+	uint32_t pending;
+} WorldRegion;
+
+typedef struct {
+	bool active;
+	int32_t chunk_x;
+	int32_t chunk_y;
+	uint32_t region;
+	const uint8_t* compressed;
+	uint32_t compressed_size;
+	// Set by the job
+	bool valid;
+	JobCounter counter;
+	// Set once the chunk leaves the window before it's read, so the job skips
+	// it and the result is dropped
+	SDL_AtomicInt cancelled;
+	uint16_t tiles[TILE_STORE_CHUNK_SIZE * TILE_STORE_CHUNK_SIZE];
+} WorldStreamRequest;
+
+typedef struct {
+	// Estimated seconds until the chunk is in view, 0 if it's near it already
+	float time;
+	int32_t x;
+	int32_t y;
+} WorldStreamCandidate;
+
+typedef struct {
+	const char* prefix;
+	// Not owned
+	TileStore* store;
+	// Most bytes of chunks kept in the store before the least recently used
+	// ones outside the margin are evicted
+	size_t memory_budget;
+	WorldChunkFunc chunk_changed;
+	void* chunk_changed_data;
+
+	uint32_t frame;
+	WorldRegion regions[WORLD_STREAM_MAX_REGIONS];
+	WorldStreamRequest requests[WORLD_STREAM_MAX_REQUESTS];
+	// The chunks in the window the store doesn't have, sorted by how soon
+	// they'll be visible.  Kept to save allocating them every update
+	WorldStreamCandidate* candidates;
+	uint32_t candidates_capacity;
+
+	// Since the start, for the stats
+	uint32_t loaded_count;
+	uint32_t evicted_count;
+	uint32_t cancelled_count;
+} WorldStream;
+
+void world_get_region_filename(const char* prefix, int32_t region_x, int32_t region_y, char* filename, size_t size);
+bool world_write_regions(const char* prefix, const TileStore* store);
+
+void world_stream_init(WorldStream* stream, const char* prefix, TileStore* store, size_t memory_budget,
+		WorldChunkFunc chunk_changed, void* chunk_changed_data);
+void world_stream_cleanup(WorldStream* stream);
+void world_stream_update(WorldStream* stream, const float view[4], const float velocity[2]);
+
+#endif // WORLD_STREAM_H
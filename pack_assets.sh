@@ -0,0 +1,16 @@
+#!/bin/bash
+
+# Pack the compiled shaders and the textures into dist/assets.pak, which the
+# renderer then loads instead of the loose files.  Run after compile_shaders.sh
+# and the build (which copies them into dist/ and builds pack_assets there)
+
+cd dist || { echo "dist not found - build first"; exit 1; }
+
+if [ ! -x ./pack_assets ]; then
+	echo "dist/pack_assets not found - build first"
+	exit 1
+fi
+
+# The KTX2 encodings of the textures are optional
+shopt -s nullglob
+./pack_assets -z assets.pak shaders/*.spv textures/*.png textures/*.ktx2 || { echo "Packing failed"; exit 1; }
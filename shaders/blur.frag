@@ -0,0 +1,66 @@
+#version 450
+
+// POST_PASS_* in post_chain.h: 1 keeps the bright parts for the bloom, 2 and 3
+// are the horizontal and vertical halves of a separable gaussian
+layout(constant_id = 1) const uint PASS_TYPE = 2;
+
+const uint PASS_BRIGHT = 1;
+const uint PASS_BLUR_X = 2;
+
+layout(binding = 0) uniform UniformBufferObject {
+    float t;
+    // The part of each target which is rendered to
+    vec2 render_uv_scale;
+    vec2 render_size;
+    uint bilinear_upscale;
+    uint pre_rotation;
+    vec2 output_size;
+    vec4 color_grade;
+    // Threshold and intensity
+    vec4 bloom;
+} ubo;
+
+layout(binding = 1) uniform sampler2D textures[2];
+
+layout(location = 0) in vec2 frag_tex_coord;
+
+layout(location = 0) out vec4 out_color;
+
+vec3 sample_input(vec2 uv, vec2 size) {
+	// Keep the filter from reaching past the rendered part
+	vec2 half_texel = 0.5 / size;
+	return texture(textures[0], clamp(uv, half_texel, ubo.render_uv_scale - half_texel)).rgb;
+}
+
+void main() {
+	vec2 input_size = vec2(textureSize(textures[0], 0));
+	vec2 texel = 1.0 / input_size;
+	vec2 uv = frag_tex_coord * ubo.render_uv_scale;
+
+	if (PASS_TYPE == PASS_BRIGHT) {
+		// The target is smaller, so average a few texels of the input for each
+		vec3 color = 0.25 * (
+			sample_input(uv + vec2(-0.5, -0.5) * texel, input_size) +
+			sample_input(uv + vec2( 0.5, -0.5) * texel, input_size) +
+			sample_input(uv + vec2(-0.5,  0.5) * texel, input_size) +
+			sample_input(uv + vec2( 0.5,  0.5) * texel, input_size));
+
+		float brightness = max(color.r, max(color.g, color.b));
+		float kept = max(brightness - ubo.bloom.x, 0.0) / max(brightness, 0.0001);
+		out_color = vec4(color * kept, 1.0);
+		return;
+	}
+
+	// 9 tap gaussian in 5 bilinear fetches
+	vec2 direction = PASS_TYPE == PASS_BLUR_X ? vec2(texel.x, 0.0) : vec2(0.0, texel.y);
+	const float offsets[3] = float[] (0.0, 1.3846153846, 3.2307692308);
+	const float weights[3] = float[] (0.2270270270, 0.3162162162, 0.0702702703);
+
+	vec3 color = sample_input(uv, input_size) * weights[0];
+	for (int i = 1; i < 3; i++) {
+		color += sample_input(uv + direction * offsets[i], input_size) * weights[i];
+		color += sample_input(uv - direction * offsets[i], input_size) * weights[i];
+	}
+
+	out_color = vec4(color, 1.0);
+}
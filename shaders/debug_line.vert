@@ -0,0 +1,56 @@
+#version 450
+
+// DebugDrawPushConstants in debug_draw.h
+layout(push_constant) uniform PushConstantObject {
+	// The camera's, from the world to the screen before the pre-rotation
+	mat4 view_projection;
+	// Size of the window before the pre-rotation, which the widths are in
+	vec2 output_size;
+	// Clockwise quarter turns to match the swap chain's pre-transform
+	uint pre_rotation;
+} push_constants;
+
+// DebugLine in debug_draw.h, one instance per segment: both ends in world
+// space, its colour and its width in pixels
+layout(location = 0) in vec4 ends_in;
+layout(location = 1) in vec4 color_in;
+layout(location = 2) in float width_in;
+
+layout(location = 0) out vec4 frag_color;
+
+// Two triangles, along the segment from a (x = 0) to b (x = 1), and across it
+vec2 corners[6] = vec2[] (
+	vec2(0.0, -0.5),
+	vec2(1.0, -0.5),
+	vec2(1.0, 0.5),
+	vec2(0.0, -0.5),
+	vec2(1.0, 0.5),
+	vec2(0.0, 0.5)
+);
+
+void main() {
+	vec2 corner = corners[gl_VertexIndex];
+
+	// Both ends in pixels, so the width is the same whatever the zoom
+	vec4 a = push_constants.view_projection * vec4(ends_in.xy, 0.0, 1.0);
+	vec4 b = push_constants.view_projection * vec4(ends_in.zw, 0.0, 1.0);
+	vec2 pixels_a = (a.xy / a.w * 0.5 + 0.5) * push_constants.output_size;
+	vec2 pixels_b = (b.xy / b.w * 0.5 + 0.5) * push_constants.output_size;
+
+	// Half the width past each end too, so the corners of a box are filled.  A
+	// segment with no length is a square dot
+	vec2 along = pixels_b - pixels_a;
+	vec2 direction = dot(along, along) > 0.0 ? normalize(along) : vec2(1.0, 0.0);
+	vec2 normal = vec2(-direction.y, direction.x);
+	vec2 extended = direction * width_in * 0.5 * (corner.x * 2.0 - 1.0);
+	vec2 pixels = mix(pixels_a, pixels_b, corner.x) + extended + normal * corner.y * width_in;
+	vec2 position = pixels / push_constants.output_size * 2.0 - 1.0;
+
+	// The same rotation as the screen pass (see screen.vert)
+	for (uint i = 0; i < push_constants.pre_rotation; i++) {
+		position = vec2(-position.y, position.x);
+	}
+
+	gl_Position = vec4(position, 0.0, 1.0);
+	frag_color = color_in;
+}
@@ -0,0 +1,40 @@
+#version 450
+
+// HUD_SOLID in hud.h
+const uint SOLID = 0xffffffffu;
+// HUD_FONT_GLYPHS and HUD_FONT_COLUMNS in hud.h
+const uint GLYPHS = 64;
+const uint COLUMNS = 8;
+
+// The font's signed distance fields, one glyph cell after another (see
+// hud_build_font_sdf()).  0.5 is on the edge of a glyph and higher is inside
+layout(binding = 0) uniform sampler2D font_atlas;
+
+layout(location = 0) in vec2 frag_cell;
+layout(location = 1) in vec4 frag_color;
+layout(location = 2) flat in uint frag_glyph;
+
+layout(location = 0) out vec4 out_color;
+
+void main() {
+	if (frag_glyph == SOLID) {
+		out_color = frag_color;
+		return;
+	}
+	if (frag_glyph >= GLYPHS) {
+		discard;
+	}
+
+	vec2 cell = vec2(frag_glyph % COLUMNS, frag_glyph / COLUMNS);
+	vec2 uv = (cell + frag_cell) / vec2(COLUMNS, GLYPHS / COLUMNS);
+	float distance = texture(font_atlas, uv).r;
+
+	// Fade across about a screen pixel, however big the text is
+	float width = max(fwidth(distance), 1e-4) * 0.5;
+	float coverage = smoothstep(0.5 - width, 0.5 + width, distance);
+	if (coverage <= 0.0) {
+		discard;
+	}
+
+	out_color = vec4(frag_color.rgb, frag_color.a * coverage);
+}
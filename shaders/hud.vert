@@ -0,0 +1,44 @@
+#version 450
+
+// HudPushConstants in hud.h
+layout(push_constant) uniform PushConstantObject {
+	// Size of the window before the pre-rotation, which the quads are laid out in
+	vec2 output_size;
+	// Clockwise quarter turns to match the swap chain's pre-transform
+	uint pre_rotation;
+} push_constants;
+
+// HudQuad in hud.h, one instance per quad: the rectangle in pixels from the
+// top left of the window, its colour and the glyph (or HUD_SOLID)
+layout(location = 0) in vec4 rect_in;
+layout(location = 1) in vec4 color_in;
+layout(location = 2) in uint glyph_in;
+
+layout(location = 0) out vec2 frag_cell;
+layout(location = 1) out vec4 frag_color;
+layout(location = 2) flat out uint frag_glyph;
+
+// Two triangles, from the top left
+vec2 corners[6] = vec2[] (
+	vec2(0.0, 0.0),
+	vec2(1.0, 0.0),
+	vec2(1.0, 1.0),
+	vec2(0.0, 0.0),
+	vec2(1.0, 1.0),
+	vec2(0.0, 1.0)
+);
+
+void main() {
+	vec2 corner = corners[gl_VertexIndex];
+	vec2 position = (rect_in.xy + corner * rect_in.zw) / push_constants.output_size * 2.0 - 1.0;
+
+	// The same rotation as the screen pass (see screen.vert)
+	for (uint i = 0; i < push_constants.pre_rotation; i++) {
+		position = vec2(-position.y, position.x);
+	}
+
+	gl_Position = vec4(position, 0.0, 1.0);
+	frag_cell = corner;
+	frag_color = color_in;
+	frag_glyph = glyph_in;
+}
@@ -1,20 +1,86 @@
 #version 450
-#define NUM_MONSTERS 1000
+
+// Per-pixel effects fused into the pass (POST_FUSED_* in post_chain.h), and
+// whether this is the screen pass rather than a post-processing pass
+layout(constant_id = 0) const uint FUSED = 0;
+layout(constant_id = 2) const bool SCREEN = true;
+
+const uint FUSED_WAVE = 1;
+const uint FUSED_BLOOM = 2;
+const uint FUSED_COLOR_GRADE = 4;
+const uint FUSED_CRT = 8;
 
 layout(binding = 0) uniform UniformBufferObject {
     float t;
-    mat4 mvps[NUM_MONSTERS];
+    // The part of the image which the scene was rendered to
+    vec2 render_uv_scale;
+    vec2 render_size;
+    uint bilinear_upscale;
+    uint pre_rotation;
+    vec2 output_size;
+    // Exposure, contrast and saturation
+    vec4 color_grade;
+    // Threshold and intensity
+    vec4 bloom;
+    // Scanline and vignette strength
+    vec4 crt;
 } ubo;
 
-layout(binding = 1) uniform sampler2D tex_sampler;
+// The previous result, and the blurred bright parts with FUSED_BLOOM
+layout(binding = 1) uniform sampler2D textures[2];
 
 layout(location = 0) in vec2 frag_tex_coord;
 
 layout(location = 0) out vec4 out_color;
 
+vec2 clamp_uv(vec2 uv, vec2 size) {
+	// Keep the filter from reaching past the rendered part
+	vec2 half_texel = 0.5 / size;
+	return clamp(uv, half_texel, ubo.render_uv_scale - half_texel);
+}
+
 void main() {
-	// Wavy effect
-	float wave = sin(ubo.t * 2.0 + frag_tex_coord.x * 2.0 + frag_tex_coord.y) * 0.01;
-	vec2 tex_coord = frag_tex_coord + vec2(wave, wave);
-	out_color = texture(tex_sampler, tex_coord);
+	// The effects are applied in the order of their bits, see post_chain.c
+	vec2 tex_coord = frag_tex_coord;
+	if ((FUSED & FUSED_WAVE) != 0) {
+		// Wavy effect
+		float wave = sin(ubo.t * 2.0 + frag_tex_coord.x * 2.0 + frag_tex_coord.y) * 0.01;
+		tex_coord += vec2(wave, wave);
+	}
+
+	// Post-processing passes are the same size as their input, so the
+	// filtering only matters for scaling up to the screen
+	vec2 input_size = vec2(textureSize(textures[0], 0));
+	vec4 color;
+	if (!SCREEN || ubo.bilinear_upscale != 0) {
+		color = texture(textures[0], clamp_uv(tex_coord * ubo.render_uv_scale, input_size));
+	}
+	else {
+		ivec2 rendered = ivec2(ubo.render_uv_scale * input_size + 0.5);
+		ivec2 texel = clamp(ivec2(tex_coord * vec2(rendered)), ivec2(0), rendered - 1);
+		color = texelFetch(textures[0], texel, 0);
+	}
+
+	if ((FUSED & FUSED_BLOOM) != 0) {
+		vec2 bloom_size = vec2(textureSize(textures[1], 0));
+		color.rgb += texture(textures[1], clamp_uv(tex_coord * ubo.render_uv_scale, bloom_size)).rgb * ubo.bloom.y;
+	}
+
+	if ((FUSED & FUSED_COLOR_GRADE) != 0) {
+		vec3 graded = color.rgb * ubo.color_grade.x;
+		graded = (graded - 0.5) * ubo.color_grade.y + 0.5;
+		float luma = dot(graded, vec3(0.2126, 0.7152, 0.0722));
+		color.rgb = clamp(mix(vec3(luma), graded, ubo.color_grade.z), 0.0, 1.0);
+	}
+
+	if ((FUSED & FUSED_CRT) != 0) {
+		// Darken between the rows of scene pixels, and towards the corners
+		float row = tex_coord.y * ubo.render_size.y;
+		float scanline = 1.0 - ubo.crt.x * (0.5 - 0.5 * cos(row * 6.28318531));
+		vec2 centre = frag_tex_coord - 0.5;
+		float vignette = 1.0 - ubo.crt.y * dot(centre, centre) * 2.0;
+		color.rgb *= scanline * clamp(vignette, 0.0, 1.0);
+	}
+
+	out_color = color;
 }
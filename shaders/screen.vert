@@ -1,5 +1,23 @@
 #version 450
 
+// Per-pixel effects fused into the pass (POST_FUSED_* in post_chain.h), and
+// whether this is the screen pass rather than a post-processing pass
+layout(constant_id = 0) const uint FUSED = 0;
+layout(constant_id = 2) const bool SCREEN = true;
+
+const uint FUSED_PIXEL_PERFECT = 16;
+
+layout(binding = 0) uniform UniformBufferObject {
+    float t;
+    vec2 render_uv_scale;
+    vec2 render_size;
+    uint bilinear_upscale;
+    // Clockwise quarter turns to match the swap chain's pre-transform
+    uint pre_rotation;
+    // Size of the window before that rotation
+    vec2 output_size;
+} ubo;
+
 layout(location = 0) out vec2 frag_texcoord;
 
 vec2 positions[4] = vec2[] (
@@ -23,7 +41,24 @@ uint indices[6] = uint[] (
 
 void main() {
 	uint idx = indices[gl_VertexIndex];
+	vec2 position = positions[idx];
+
+	if (SCREEN && (FUSED & FUSED_PIXEL_PERFECT) != 0) {
+		// The largest whole number scale which fits, in the middle of the window
+		// (the rest is left cleared)
+		vec2 fit = ubo.output_size / ubo.render_size;
+		float scale = max(floor(min(fit.x, fit.y)), 1.0);
+		position *= scale * ubo.render_size / ubo.output_size;
+	}
+
+	if (SCREEN) {
+		// The swap chain images are in the display's native orientation, so the
+		// quad is rotated into it here instead of by the compositor
+		for (uint i = 0; i < ubo.pre_rotation; i++) {
+			position = vec2(-position.y, position.x);
+		}
+	}
 
-	gl_Position = vec4(positions[idx], 0.0, 1.0);
+	gl_Position = vec4(position, 0.0, 1.0);
 	frag_texcoord = texcoords[idx];
 }
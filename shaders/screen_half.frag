@@ -0,0 +1,98 @@
+#version 450
+#extension GL_EXT_shader_explicit_arithmetic_types_float16 : require
+
+// screen.frag with the effects at half precision, for PostChainDesc.half_precision
+// (see half_precision_shading in main.c).  The texture coordinates and the
+// time stay full precision, so the phases of the wave and the scanlines are
+// wrapped first and only the sin/cos and the colour maths are float16
+
+// Per-pixel effects fused into the pass (POST_FUSED_* in post_chain.h), and
+// whether this is the screen pass rather than a post-processing pass
+layout(constant_id = 0) const uint FUSED = 0;
+layout(constant_id = 2) const bool SCREEN = true;
+
+const uint FUSED_WAVE = 1;
+const uint FUSED_BLOOM = 2;
+const uint FUSED_COLOR_GRADE = 4;
+const uint FUSED_CRT = 8;
+
+const float TAU = 6.28318531;
+
+layout(binding = 0) uniform UniformBufferObject {
+    float t;
+    // The part of the image which the scene was rendered to
+    vec2 render_uv_scale;
+    vec2 render_size;
+    uint bilinear_upscale;
+    uint pre_rotation;
+    vec2 output_size;
+    // Exposure, contrast and saturation
+    vec4 color_grade;
+    // Threshold and intensity
+    vec4 bloom;
+    // Scanline and vignette strength
+    vec4 crt;
+} ubo;
+
+// The previous result, and the blurred bright parts with FUSED_BLOOM
+layout(binding = 1) uniform mediump sampler2D textures[2];
+
+layout(location = 0) in vec2 frag_tex_coord;
+
+layout(location = 0) out mediump vec4 out_color;
+
+vec2 clamp_uv(vec2 uv, vec2 size) {
+	// Keep the filter from reaching past the rendered part
+	vec2 half_texel = 0.5 / size;
+	return clamp(uv, half_texel, ubo.render_uv_scale - half_texel);
+}
+
+void main() {
+	// The effects are applied in the order of their bits, see post_chain.c
+	vec2 tex_coord = frag_tex_coord;
+	if ((FUSED & FUSED_WAVE) != 0) {
+		// Wavy effect
+		float phase = mod(ubo.t * 2.0, TAU) + frag_tex_coord.x * 2.0 + frag_tex_coord.y;
+		float16_t wave = sin(float16_t(phase)) * float16_t(0.01);
+		tex_coord += vec2(wave, wave);
+	}
+
+	// Post-processing passes are the same size as their input, so the
+	// filtering only matters for scaling up to the screen
+	vec2 input_size = vec2(textureSize(textures[0], 0));
+	f16vec4 color;
+	if (!SCREEN || ubo.bilinear_upscale != 0) {
+		color = f16vec4(texture(textures[0], clamp_uv(tex_coord * ubo.render_uv_scale, input_size)));
+	}
+	else {
+		ivec2 rendered = ivec2(ubo.render_uv_scale * input_size + 0.5);
+		ivec2 texel = clamp(ivec2(tex_coord * vec2(rendered)), ivec2(0), rendered - 1);
+		color = f16vec4(texelFetch(textures[0], texel, 0));
+	}
+
+	if ((FUSED & FUSED_BLOOM) != 0) {
+		vec2 bloom_size = vec2(textureSize(textures[1], 0));
+		f16vec3 bloom = f16vec3(texture(textures[1], clamp_uv(tex_coord * ubo.render_uv_scale, bloom_size)).rgb);
+		color.rgb += bloom * float16_t(ubo.bloom.y);
+	}
+
+	if ((FUSED & FUSED_COLOR_GRADE) != 0) {
+		f16vec3 grade = f16vec3(ubo.color_grade.xyz);
+		f16vec3 graded = color.rgb * grade.x;
+		graded = (graded - float16_t(0.5)) * grade.y + float16_t(0.5);
+		float16_t luma = dot(graded, f16vec3(0.2126, 0.7152, 0.0722));
+		color.rgb = clamp(mix(f16vec3(luma), graded, grade.z), float16_t(0.0), float16_t(1.0));
+	}
+
+	if ((FUSED & FUSED_CRT) != 0) {
+		// Darken between the rows of scene pixels, and towards the corners
+		float16_t row = float16_t(fract(tex_coord.y * ubo.render_size.y));
+		f16vec2 crt = f16vec2(ubo.crt.xy);
+		float16_t scanline = float16_t(1.0) - crt.x * (float16_t(0.5) - float16_t(0.5) * cos(row * float16_t(TAU)));
+		f16vec2 centre = f16vec2(frag_tex_coord - 0.5);
+		float16_t vignette = float16_t(1.0) - crt.y * dot(centre, centre) * float16_t(2.0);
+		color.rgb *= scanline * clamp(vignette, float16_t(0.0), float16_t(1.0));
+	}
+
+	out_color = vec4(color);
+}
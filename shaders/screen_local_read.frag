@@ -0,0 +1,53 @@
+#version 450
+
+// The per-pixel effects left for the screen pass (POST_FUSED_* in
+// post_chain.h), applied in place at the end of the scene pass.  Only the ones
+// which read nothing but their own pixel, see post_chain_is_per_pixel()
+layout(constant_id = 0) const uint FUSED = 0;
+
+const uint FUSED_COLOR_GRADE = 4;
+const uint FUSED_CRT = 8;
+
+layout(set = 0, binding = 0) uniform UniformBufferObject {
+    float t;
+    vec2 render_uv_scale;
+    vec2 render_size;
+    uint bilinear_upscale;
+    uint pre_rotation;
+    vec2 output_size;
+    // Exposure, contrast and saturation
+    vec4 color_grade;
+    // Threshold and intensity
+    vec4 bloom;
+    // Scanline and vignette strength
+    vec4 crt;
+} ubo;
+
+// What the scene pass has drawn to this pixel of the swap chain image
+layout(input_attachment_index = 0, set = 1, binding = 0) uniform subpassInput scene;
+
+layout(location = 0) in vec2 frag_tex_coord;
+
+layout(location = 0) out vec4 out_color;
+
+void main() {
+	// The same as screen.frag, which has the effects in the same order
+	vec4 color = subpassLoad(scene);
+
+	if ((FUSED & FUSED_COLOR_GRADE) != 0) {
+		vec3 graded = color.rgb * ubo.color_grade.x;
+		graded = (graded - 0.5) * ubo.color_grade.y + 0.5;
+		float luma = dot(graded, vec3(0.2126, 0.7152, 0.0722));
+		color.rgb = clamp(mix(vec3(luma), graded, ubo.color_grade.z), 0.0, 1.0);
+	}
+
+	if ((FUSED & FUSED_CRT) != 0) {
+		float row = frag_tex_coord.y * ubo.render_size.y;
+		float scanline = 1.0 - ubo.crt.x * (0.5 - 0.5 * cos(row * 6.28318531));
+		vec2 centre = frag_tex_coord - 0.5;
+		float vignette = 1.0 - ubo.crt.y * dot(centre, centre) * 2.0;
+		color.rgb *= scanline * clamp(vignette, 0.0, 1.0);
+	}
+
+	out_color = color;
+}
@@ -0,0 +1,56 @@
+#version 450
+
+// ShapeKind in sprite_batch.h
+const uint SHAPE_RECT = 0;
+const uint SHAPE_ELLIPSE = 1;
+
+layout(location = 0) in vec4 frag_fill;
+layout(location = 1) in vec2 frag_local;
+layout(location = 2) flat in vec2 frag_half_size;
+layout(location = 3) flat in vec3 frag_params;
+layout(location = 4) flat in vec4 frag_outline_color;
+layout(location = 5) flat in uint frag_kind;
+
+layout(location = 0) out vec4 out_color;
+
+float rounded_rect_distance(vec2 p, vec2 half_size, float radius) {
+	vec2 q = abs(p) - half_size + radius;
+	return length(max(q, 0.0)) + min(max(q.x, q.y), 0.0) - radius;
+}
+
+float ellipse_distance(vec2 p, vec2 half_size) {
+	// The distance in the circle it's stretched from, divided by the gradient
+	// there, which is near enough close to the edge where it's used
+	vec2 scaled = p / half_size;
+	float k = length(scaled);
+	float gradient = length(scaled / half_size);
+	return k * (k - 1.0) / max(gradient, 1e-6);
+}
+
+void main() {
+	float radius = frag_params.x;
+	float outline = frag_params.y;
+	float softness = frag_params.z;
+
+	float distance = frag_kind == SHAPE_ELLIPSE
+		? ellipse_distance(frag_local, frag_half_size)
+		: rounded_rect_distance(frag_local, frag_half_size, radius);
+
+	// A pixel in world units, which the edges are smoothed over, or further
+	// out over the softness
+	float pixel = max(fwidth(distance), 1e-6);
+	float coverage = 1.0 - smoothstep(-0.5 * pixel, 0.5 * pixel + softness, distance);
+
+	vec4 color = frag_fill;
+	if (outline > 0.0) {
+		float in_outline = smoothstep(-outline - 0.5 * pixel, -outline + 0.5 * pixel, distance);
+		color = mix(frag_fill, frag_outline_color, in_outline);
+	}
+	color.a *= coverage;
+
+	// Blended, but fully transparent pixels can't change anything
+	if (color.a <= 0.0) {
+		discard;
+	}
+	out_color = color;
+}
@@ -0,0 +1,108 @@
+#version 450
+#extension GL_EXT_multiview : require
+#extension GL_EXT_buffer_reference : require
+#extension GL_GOOGLE_include_directive : require
+
+// shape.vert for vertex_pulling in main.c, which reads the records itself as
+// sprite_pulled.vert does
+
+// VertexBufferSprite in main.c as words
+#define SPRITE_VERTEX_RECORD
+#include "vertex_formats.glsl"
+
+layout(buffer_reference, std430, buffer_reference_align = 4) readonly buffer SpriteRecords {
+	SpriteRecord records[];
+};
+
+layout(push_constant) uniform PushConstantObject {
+	// Shared view-projection matrix for all of the sprites
+	mat4 mvp;
+	vec4 color;
+	uint texture_idx;
+	// Where the records being drawn start (PushConstants.records_address)
+	layout(offset = 88) SpriteRecords records;
+} push_constants;
+
+// SpriteTransform in main.c, the shape's centre, size, rotation and depth
+struct SpriteTransform {
+	vec2 pos;
+	vec2 scale;
+	float rotation;
+	float z;
+	float anim_phase;
+	uint anim_params;
+};
+
+// Split screen views and the late latched camera, as in sprite.vert
+const uint MAX_VIEWS = 4;
+const uint VIEW_SLOTS = 3;
+
+layout(binding = 0) uniform UniformBufferObject {
+	float t;
+	layout(offset = 96) mat4 view_corrections[VIEW_SLOTS * (MAX_VIEWS - 1)];
+	layout(offset = 768) mat4 late_latch[VIEW_SLOTS];
+} ubo;
+
+vec4 view_position(vec4 position, uint slot) {
+	if (gl_ViewIndex == 0) {
+		return ubo.late_latch[slot] * position;
+	}
+	return ubo.view_corrections[slot * (MAX_VIEWS - 1) + gl_ViewIndex - 1] * position;
+}
+
+layout(std430, binding = 2) readonly buffer SpriteTransformBuffer {
+	SpriteTransform transforms[];
+} sprite_buffer;
+
+layout(location = 0) out vec4 frag_fill;
+// From the centre, in the shape's own unrotated world units
+layout(location = 1) out vec2 frag_local;
+layout(location = 2) flat out vec2 frag_half_size;
+// Corner radius, outline width and softness, in world units
+layout(location = 3) flat out vec3 frag_params;
+layout(location = 4) flat out vec4 frag_outline_color;
+layout(location = 5) flat out uint frag_kind;
+
+vec2 positions[4] = vec2[] (
+	vec2(0.0, 0.0),
+	vec2(1.0, 0.0),
+	vec2(1.0, 1.0),
+	vec2(0.0, 1.0)
+);
+
+uint indices[6] = uint[] (
+	0, 1, 2,
+	0, 2, 3
+);
+
+void main() {
+	uint idx = indices[gl_VertexIndex % 6];
+
+	// Unpacked as the vertex input formats would, see shape.vert
+	SpriteRecord record = push_constants.records.records[gl_InstanceIndex + gl_VertexIndex / 6 * 6];
+	vec4 fill_in = sprite_record_color(record);
+	vec2 radius_outline_in = sprite_record_uv(record);
+	vec2 softness_in = sprite_record_uv2(record);
+	uint kind_in = sprite_record_texture_index(record);
+	uint outline_color_in = sprite_record_flipbook(record);
+	SpriteTransform transform = sprite_buffer.transforms[sprite_record_sprite_index(record)];
+
+	vec2 half_size = abs(transform.scale) * 0.5;
+	float unit = min(half_size.x, half_size.y);
+	vec3 params = vec3(radius_outline_in, softness_in.x) * unit;
+
+	// The quad is grown by the softness, and a pixel for the antialiasing is
+	// left to the fragment shader's smoothing inside it
+	vec2 local = (positions[idx] - vec2(0.5)) * 2.0 * (half_size + params.z);
+	float s = sin(transform.rotation);
+	float c = cos(transform.rotation);
+	vec2 world = vec2(c * local.x - s * local.y, s * local.x + c * local.y) + transform.pos;
+
+	gl_Position = view_position(push_constants.mvp * vec4(world, transform.z, 1.0), 0);
+	frag_fill = fill_in;
+	frag_local = local;
+	frag_half_size = half_size;
+	frag_params = params;
+	frag_outline_color = unpackUnorm4x8(outline_color_in);
+	frag_kind = kind_in;
+}
@@ -0,0 +1,75 @@
+#version 450
+#extension GL_EXT_multiview : require
+#extension GL_GOOGLE_include_directive : require
+
+// The skinned characters' meshes (DEMO_SKINNED_CHARACTERS in main.c), drawn
+// instanced with a palette of bones for each character.  Goes with
+// sprite.frag
+
+layout(push_constant) uniform PushConstantObject {
+	// The view-projection, moved to the characters' depth
+	mat4 mvp;
+	vec4 color;
+} push_constants;
+
+// The split screen views, as in sprite.vert
+const uint MAX_VIEWS = 4;
+const uint VIEW_SLOTS = 3;
+
+layout(binding = 0) uniform UniformBufferObject {
+	float t;
+	layout(offset = 96) mat4 view_corrections[VIEW_SLOTS * (MAX_VIEWS - 1)];
+	layout(offset = 768) mat4 late_latch[VIEW_SLOTS];
+} ubo;
+
+vec4 view_position(vec4 position, uint slot) {
+	// The first view's is what the push constants already give, moved to the
+	// camera latched at submit
+	if (gl_ViewIndex == 0) {
+		return ubo.late_latch[slot] * position;
+	}
+	return ubo.view_corrections[slot * (MAX_VIEWS - 1) + gl_ViewIndex - 1] * position;
+}
+
+// Affine2 in affine2.h: x' = a x + c y + tx, y' = b x + d y + ty (24 bytes)
+struct Bone {
+	float a;
+	float b;
+	float c;
+	float d;
+	float tx;
+	float ty;
+};
+
+// Where the sprite transforms usually are, the palettes in the frame ring,
+// each character's bones one after the other
+layout(std430, binding = 2) readonly buffer BonePalettes {
+	Bone bones[];
+} palettes;
+
+// SkinnedSpecialization in main.c, after the fragment shader's
+layout(constant_id = 3) const uint BONES_COUNT = 1;
+
+// SkinnedVertex in main.c, in the rest pose.  weight_in is of the first bone,
+// the second gets the rest
+#define SKINNED_VERTEX_INPUTS
+#include "vertex_formats.glsl"
+
+layout(location = 0) out vec4 frag_color;
+layout(location = 1) out vec2 frag_texcoord;
+layout(location = 2) out uint frag_texture_idx;
+
+vec2 apply_bone(uint bone, vec2 position) {
+	Bone b = palettes.bones[gl_InstanceIndex * BONES_COUNT + bone];
+	return vec2(b.a * position.x + b.c * position.y + b.tx, b.b * position.x + b.d * position.y + b.ty);
+}
+
+void main() {
+	vec2 world = apply_bone(bones_in.x, pos_in) * weight_in
+		+ apply_bone(bones_in.y, pos_in) * (1.0 - weight_in);
+
+	gl_Position = view_position(push_constants.mvp * vec4(world, 0.0, 1.0), 0);
+	frag_color = push_constants.color;
+	frag_texcoord = uv_in;
+	frag_texture_idx = texture_index_in;
+}
@@ -1,8 +1,19 @@
 #version 450
-#extension GL_EXT_nonuniform_qualifier : require
-#define NUM_TEXTURES 5
 
-layout(binding = 1) uniform sampler2D texSampler[NUM_TEXTURES];
+// All of the textures are packed into the layers of a single atlas
+layout(binding = 1) uniform sampler2DArray texAtlas;
+
+// SpritePipeline and FragmentSpecialization in main.c.  Opaque sprites never
+// discard so the depth test can happen before shading, cutouts discard below
+// the cutoff, and blended sprites only skip fully transparent pixels
+layout(constant_id = 0) const uint ALPHA_MODE = 1;
+layout(constant_id = 1) const float ALPHA_CUTOFF = 0.5;
+// With multisampling, cutouts write their alpha as coverage instead of
+// discarding, see alpha_to_coverage in main.c
+layout(constant_id = 2) const bool ALPHA_TO_COVERAGE = false;
+
+const uint ALPHA_OPAQUE = 0;
+const uint ALPHA_CUTOUT = 1;
 
 layout(location = 0) in vec4 frag_color;
 layout(location = 1) in vec2 frag_tex_coord;
@@ -11,9 +22,25 @@ layout(location = 2) flat in uint frag_texture_index;
 layout(location = 0) out vec4 out_color;
 
 void main() {
-	vec4 tex_color = texture(texSampler[nonuniformEXT(frag_texture_index)], frag_tex_coord);
-	if (tex_color.a < 0.5) {
-		discard;
+	vec4 tex_color = texture(texAtlas, vec3(frag_tex_coord, float(frag_texture_index)));
+	if (ALPHA_MODE == ALPHA_CUTOUT && ALPHA_TO_COVERAGE) {
+		// Sharpen the alpha into a ramp about a pixel wide around the cutoff,
+		// so the edge covers some of the samples of the pixels it crosses
+		tex_color.a = clamp((tex_color.a - ALPHA_CUTOFF) / max(fwidth(tex_color.a), 0.0001) + 0.5, 0.0, 1.0);
+		if (tex_color.a <= 0.0) {
+			discard;
+		}
+	}
+	else if (ALPHA_MODE == ALPHA_CUTOUT) {
+		if (tex_color.a < ALPHA_CUTOFF) {
+			discard;
+		}
+	}
+	else if (ALPHA_MODE != ALPHA_OPAQUE) {
+		// Blending keeps soft edges, but fully transparent pixels can't change anything
+		if (tex_color.a <= 0.0) {
+			discard;
+		}
 	}
 	out_color = tex_color * frag_color;
 }
@@ -0,0 +1,44 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Bindless texture table (see vkx_texture_table.c)
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+
+// SpritePipeline and FragmentSpecialization in main.c.  Opaque sprites never
+// discard so the depth test can happen before shading, cutouts discard below
+// the cutoff, and blended sprites only skip fully transparent pixels
+layout(constant_id = 0) const uint ALPHA_MODE = 1;
+layout(constant_id = 1) const float ALPHA_CUTOFF = 0.5;
+layout(constant_id = 2) const bool ALPHA_TO_COVERAGE = false;
+
+const uint ALPHA_OPAQUE = 0;
+const uint ALPHA_CUTOUT = 1;
+
+layout(location = 0) in vec4 frag_color;
+layout(location = 1) in vec2 frag_tex_coord;
+layout(location = 2) flat in uint frag_texture_index;
+
+layout(location = 0) out vec4 out_color;
+
+void main() {
+	vec4 tex_color = texture(textures[nonuniformEXT(frag_texture_index)], frag_tex_coord);
+	if (ALPHA_MODE == ALPHA_CUTOUT && ALPHA_TO_COVERAGE) {
+		// As in sprite.frag
+		tex_color.a = clamp((tex_color.a - ALPHA_CUTOFF) / max(fwidth(tex_color.a), 0.0001) + 0.5, 0.0, 1.0);
+		if (tex_color.a <= 0.0) {
+			discard;
+		}
+	}
+	else if (ALPHA_MODE == ALPHA_CUTOUT) {
+		if (tex_color.a < ALPHA_CUTOFF) {
+			discard;
+		}
+	}
+	else if (ALPHA_MODE != ALPHA_OPAQUE) {
+		// Blending keeps soft edges, but fully transparent pixels can't change anything
+		if (tex_color.a <= 0.0) {
+			discard;
+		}
+	}
+	out_color = tex_color * frag_color;
+}
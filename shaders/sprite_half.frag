@@ -0,0 +1,47 @@
+#version 450
+#extension GL_EXT_shader_explicit_arithmetic_types_float16 : require
+
+// sprite.frag with the colour maths at half precision, for half_precision_shading
+// in main.c.  The texture coordinates stay full precision, as half can't
+// address the texels of a big atlas, but the texel, the tint and the alpha
+// tests are float16 (and the mediump ones are RelaxedPrecision)
+
+layout(binding = 1) uniform mediump sampler2DArray texAtlas;
+
+// SpritePipeline and FragmentSpecialization in main.c, as in sprite.frag
+layout(constant_id = 0) const uint ALPHA_MODE = 1;
+layout(constant_id = 1) const float ALPHA_CUTOFF = 0.5;
+layout(constant_id = 2) const bool ALPHA_TO_COVERAGE = false;
+
+const uint ALPHA_OPAQUE = 0;
+const uint ALPHA_CUTOUT = 1;
+
+layout(location = 0) in mediump vec4 frag_color;
+layout(location = 1) in vec2 frag_tex_coord;
+layout(location = 2) flat in uint frag_texture_index;
+
+layout(location = 0) out mediump vec4 out_color;
+
+void main() {
+	f16vec4 tex_color = f16vec4(texture(texAtlas, vec3(frag_tex_coord, float(frag_texture_index))));
+	float16_t cutoff = float16_t(ALPHA_CUTOFF);
+	if (ALPHA_MODE == ALPHA_CUTOUT && ALPHA_TO_COVERAGE) {
+		// Sharpen the alpha into a ramp about a pixel wide around the cutoff
+		tex_color.a = clamp((tex_color.a - cutoff) / max(fwidth(tex_color.a), float16_t(0.001)) + float16_t(0.5),
+			float16_t(0.0), float16_t(1.0));
+		if (tex_color.a <= float16_t(0.0)) {
+			discard;
+		}
+	}
+	else if (ALPHA_MODE == ALPHA_CUTOUT) {
+		if (tex_color.a < cutoff) {
+			discard;
+		}
+	}
+	else if (ALPHA_MODE != ALPHA_OPAQUE) {
+		if (tex_color.a <= float16_t(0.0)) {
+			discard;
+		}
+	}
+	out_color = vec4(tex_color * f16vec4(frag_color));
+}
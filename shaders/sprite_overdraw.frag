@@ -0,0 +1,36 @@
+#version 450
+
+// All of the textures are packed into the layers of a single atlas
+layout(binding = 1) uniform sampler2DArray texAtlas;
+
+// The same as sprite.frag, so the sprites discard (and fill the depth buffer)
+// where they would have been drawn
+layout(constant_id = 0) const uint ALPHA_MODE = 1;
+layout(constant_id = 1) const float ALPHA_CUTOFF = 0.5;
+layout(constant_id = 2) const bool ALPHA_TO_COVERAGE = false;
+
+const uint ALPHA_OPAQUE = 0;
+const uint ALPHA_CUTOUT = 1;
+
+// Added for every fragment shaded, see overdraw_heatmap in main.c.  Red fills
+// up after 8 fragments, green after 16 and blue after 32, so the pixels go from
+// black through red and yellow to white
+const vec4 HEAT = vec4(1.0 / 8.0, 1.0 / 16.0, 1.0 / 32.0, 1.0);
+
+layout(location = 0) in vec4 frag_color;
+layout(location = 1) in vec2 frag_tex_coord;
+layout(location = 2) flat in uint frag_texture_index;
+
+layout(location = 0) out vec4 out_color;
+
+void main() {
+	// Discarded pixels were still shaded (the profiler's fragment counts have
+	// them), but they don't add heat, and stay out of the depth buffer as usual
+	if (ALPHA_MODE != ALPHA_OPAQUE) {
+		float alpha = texture(texAtlas, vec3(frag_tex_coord, float(frag_texture_index))).a;
+		if (ALPHA_MODE == ALPHA_CUTOUT ? alpha < ALPHA_CUTOFF : alpha <= 0.0) {
+			discard;
+		}
+	}
+	out_color = HEAT;
+}
@@ -0,0 +1,51 @@
+#version 450
+
+// sprite.frag for palette_textures in main.c.  The atlas has a palette index
+// in each texel, see vkx_palette.c, which is looked up in the sprite's row of
+// the palettes.  Indices can't be filtered, so the nearest texel of the base
+// level is always the one used
+layout(binding = 1) uniform sampler2DArray texAtlas;
+layout(binding = 3) uniform sampler2D palettes;
+
+// SpritePipeline and FragmentSpecialization in main.c, as in sprite.frag
+layout(constant_id = 0) const uint ALPHA_MODE = 1;
+layout(constant_id = 1) const float ALPHA_CUTOFF = 0.5;
+layout(constant_id = 2) const bool ALPHA_TO_COVERAGE = false;
+
+const uint ALPHA_OPAQUE = 0;
+const uint ALPHA_CUTOUT = 1;
+
+// SPRITE_TEXTURE_BITS and SPRITE_PALETTE() in main.c
+const uint TEXTURE_MASK = 0xfff;
+const uint PALETTE_SHIFT = 14;
+
+layout(location = 0) in vec4 frag_color;
+layout(location = 1) in vec2 frag_tex_coord;
+layout(location = 2) flat in uint frag_texture_index;
+
+layout(location = 0) out vec4 out_color;
+
+void main() {
+	ivec2 size = textureSize(texAtlas, 0).xy;
+	ivec2 texel = clamp(ivec2(frag_tex_coord * vec2(size)), ivec2(0), size - 1);
+	float index = texelFetch(texAtlas, ivec3(texel, frag_texture_index & TEXTURE_MASK), 0).r;
+	vec4 tex_color = texelFetch(palettes, ivec2(round(index * 255.0), frag_texture_index >> PALETTE_SHIFT), 0);
+
+	if (ALPHA_MODE == ALPHA_CUTOUT && ALPHA_TO_COVERAGE) {
+		tex_color.a = clamp((tex_color.a - ALPHA_CUTOFF) / max(fwidth(tex_color.a), 0.0001) + 0.5, 0.0, 1.0);
+		if (tex_color.a <= 0.0) {
+			discard;
+		}
+	}
+	else if (ALPHA_MODE == ALPHA_CUTOUT) {
+		if (tex_color.a < ALPHA_CUTOFF) {
+			discard;
+		}
+	}
+	else if (ALPHA_MODE != ALPHA_OPAQUE) {
+		if (tex_color.a <= 0.0) {
+			discard;
+		}
+	}
+	out_color = tex_color * frag_color;
+}
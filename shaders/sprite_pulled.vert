@@ -0,0 +1,167 @@
+#version 450
+#extension GL_EXT_multiview : require
+#extension GL_EXT_buffer_reference : require
+#extension GL_GOOGLE_include_directive : require
+
+// sprite.vert for vertex_pulling in main.c, which reads the sprite records
+// itself rather than through the vertex input
+
+// VertexBufferSprite in main.c as words
+#define SPRITE_VERTEX_RECORD
+#include "vertex_formats.glsl"
+
+layout(buffer_reference, std430, buffer_reference_align = 4) readonly buffer SpriteRecords {
+	SpriteRecord records[];
+};
+
+layout(push_constant) uniform PushConstantObject {
+	// Shared view-projection matrix for all of the sprites
+	mat4 mvp;
+	vec4 color;
+	uint texture_idx;
+	// Where the records being drawn start (PushConstants.records_address)
+	layout(offset = 88) SpriteRecords records;
+} push_constants;
+
+// Compact transform for a single sprite (matches SpriteTransform in main.c)
+struct SpriteTransform {
+	vec2 pos;
+	vec2 scale;
+	float rotation;
+	float z;
+	float anim_phase;
+	uint anim_params;
+};
+
+// Split screen draws every view at once with multiview.  Each view after the
+// first has a matrix taking it from the first's view-projection to its own,
+// for the world and each tile layer (which have their own parallax), see
+// write_view_corrections() in main.c
+const uint MAX_VIEWS = 4;
+const uint VIEW_SLOTS = 3;
+
+layout(binding = 0) uniform UniformBufferObject {
+	float t;
+	layout(offset = 96) mat4 view_corrections[VIEW_SLOTS * (MAX_VIEWS - 1)];
+	layout(offset = 768) mat4 late_latch[VIEW_SLOTS];
+} ubo;
+
+vec4 view_position(vec4 position, uint slot) {
+	// The first view's is what the push constants already give, moved to the
+	// camera latched at submit
+	if (gl_ViewIndex == 0) {
+		return ubo.late_latch[slot] * position;
+	}
+	return ubo.view_corrections[slot * (MAX_VIEWS - 1) + gl_ViewIndex - 1] * position;
+}
+
+layout(std430, binding = 2) readonly buffer SpriteTransformBuffer {
+	SpriteTransform transforms[];
+} sprite_buffer;
+
+// SPRITE_ANIM_MAX_AMPLITUDE and SPRITE_ANIM_MAX_FREQUENCY in main.c
+const vec2 ANIM_MAX = vec2(1.0, 16.0);
+
+// The texture index is in the low bits, with flags above it (SPRITE_TEXTURE_BITS
+// and SPRITE_FLAG_* in main.c)
+const uint TEXTURE_MASK = 0xfff;
+const uint FLAG_FLIP_X = 1 << 12;
+const uint FLAG_FLIP_Y = 1 << 13;
+// Passed on with the texture for sprite_palette.frag, and only set with
+// palette_textures in main.c
+const uint PALETTE_MASK = 0xc000;
+
+layout(location = 0) out vec4 frag_color;
+layout(location = 1) out vec2 frag_texcoord;
+layout(location = 2) out uint frag_texture_idx;
+// For sprite_lit.frag, which turns the normal map's normals the way the sprite
+// is turned: the cos and sin of the rotation, then -1 for each flipped axis
+layout(location = 3) flat out vec4 frag_normal_basis;
+
+vec2 positions[4] = vec2[] (
+	vec2(0.0, 0.0),
+	vec2(1.0, 0.0),
+	vec2(1.0, 1.0),
+	vec2(0.0, 1.0)
+);
+
+uint indices[6] = uint[] (
+	0, 1, 2,
+	0, 2, 3
+);
+
+void main() {
+	uint idx = indices[gl_VertexIndex % 6];
+
+	// Instanced sprites have a record per instance (and the vertex index is 0
+	// to 5), otherwise the record is repeated for each of the quad's 6 vertices
+	// and any of them will do
+	SpriteRecord record = push_constants.records.records[gl_InstanceIndex + gl_VertexIndex / 6 * 6];
+
+	// Unpacked as the vertex input formats in get_sprite_attribute_descriptions()
+	// would.  Frame 0 of the flipbook is uv_in to uv2_in, see
+	// pack_sprite_flipbook() in main.c
+	vec4 color_in = sprite_record_color(record);
+	vec2 uv_in = sprite_record_uv(record);
+	vec2 uv2_in = sprite_record_uv2(record);
+	uint texture_index_in = sprite_record_texture_index(record);
+	uint trim_in = sprite_record_trim(record);
+	uint sprite_index_in = sprite_record_sprite_index(record);
+	uint flipbook_in = sprite_record_flipbook(record);
+
+	// Build the quad from the compact transform in the storage buffer
+	SpriteTransform transform = sprite_buffer.transforms[sprite_index_in];
+
+	// Bob up and down and squash, see pack_sprite_animation() in main.c
+	vec2 anim = unpackUnorm2x16(transform.anim_params) * ANIM_MAX;
+	float squash = sin(ubo.t * anim.y + transform.anim_phase) * anim.x * 0.75;
+	transform.pos.y += sin(ubo.t * anim.y * 2.0 + transform.anim_phase) * anim.x;
+	transform.scale *= vec2(1.0 + squash, 1.0 - squash);
+
+	// Flipping swaps which corner gets which texture coordinate
+	bool flip_x = (texture_index_in & FLAG_FLIP_X) != 0;
+	bool flip_y = (texture_index_in & FLAG_FLIP_Y) != 0;
+	bool right = positions[idx].x > 0.5;
+	bool top = positions[idx].y < 0.5;
+	if (flip_x) {
+		right = !right;
+	}
+	if (flip_y) {
+		top = !top;
+	}
+
+	// Where the corner is in the frame once the transparent edges are trimmed
+	// off, and where that puts it on the full quad
+	vec4 trim = vec4(trim_in & 0xf, (trim_in >> 4) & 0xf, (trim_in >> 8) & 0xf, trim_in >> 12) / 16.0;
+	vec2 frame_pos = vec2(right ? 1.0 - trim.z : trim.x, top ? 1.0 - trim.w : trim.y);
+	vec2 corner = vec2(flip_x ? 1.0 - frame_pos.x : frame_pos.x, flip_y ? frame_pos.y : 1.0 - frame_pos.y);
+
+	// Centre the quad around the sprite position, then scale and rotate it
+	vec2 local = (corner - vec2(0.5)) * transform.scale;
+	float s = sin(transform.rotation);
+	float c = cos(transform.rotation);
+	vec2 world = vec2(c * local.x - s * local.y, s * local.x + c * local.y) + transform.pos;
+
+	gl_Position = view_position(push_constants.mvp * vec4(world, transform.z, 1.0), 0);
+
+	// Move the rectangle along to the flipbook's current frame
+	vec2 uv = uv_in;
+	vec2 uv2 = uv2_in;
+	uint frames = flipbook_in & 0xff;
+	if (frames > 0) {
+		uint columns = max((flipbook_in >> 8) & 0xff, 1);
+		float fps = float((flipbook_in >> 16) & 0xff);
+		uint frame = (flipbook_in >> 24) + uint(ubo.t * fps);
+		frame %= frames;
+		vec2 offset = vec2(frame % columns, frame / columns) * (uv2_in - uv_in);
+		uv += offset;
+		uv2 += offset;
+	}
+
+	frag_texcoord = mix(uv, uv2, frame_pos);
+	frag_color = color_in;
+	frag_texture_idx = texture_index_in & (TEXTURE_MASK | PALETTE_MASK);
+	frag_normal_basis = vec4(c, s,
+		flip_x ? -1.0 : 1.0,
+		flip_y ? -1.0 : 1.0);
+}
@@ -0,0 +1,26 @@
+#version 450
+
+// A tile layer which was rendered ahead of time
+layout(binding = 1) uniform sampler2D texLayer;
+
+// FragmentSpecialization in main.c
+layout(constant_id = 1) const float ALPHA_CUTOFF = 0.5;
+
+layout(push_constant) uniform PushConstantObject {
+	mat4 mvp;
+	vec4 color;
+	uint texture_idx;
+} push_constants;
+
+layout(location = 0) in vec2 frag_tex_coord;
+
+layout(location = 0) out vec4 out_color;
+
+void main() {
+	vec4 tex_color = texture(texLayer, frag_tex_coord);
+	// The gaps between the tiles were cleared to transparent
+	if (tex_color.a < ALPHA_CUTOFF) {
+		discard;
+	}
+	out_color = tex_color * push_constants.color;
+}
@@ -0,0 +1,42 @@
+#version 450
+#extension GL_EXT_multiview : require
+#extension GL_GOOGLE_include_directive : require
+
+layout(push_constant) uniform PushConstantObject {
+	mat4 mvp;
+	vec4 tileset_rect;
+	uint texture_idx;
+	uint tileset_x_tiles;
+	uint tileset_y_tiles;
+	uint empty_tile;
+} push_constants;
+
+// The split screen views, as in sprite.vert
+const uint MAX_VIEWS = 4;
+const uint VIEW_SLOTS = 3;
+
+layout(binding = 0) uniform UniformBufferObject {
+	float t;
+	layout(offset = 96) mat4 view_corrections[VIEW_SLOTS * (MAX_VIEWS - 1)];
+	layout(offset = 768) mat4 late_latch[VIEW_SLOTS];
+} ubo;
+
+vec4 view_position(vec4 position, uint slot) {
+	// The first view's is what the push constants already give, moved to the
+	// camera latched at submit
+	if (gl_ViewIndex == 0) {
+		return ubo.late_latch[slot] * position;
+	}
+	return ubo.view_corrections[slot * (MAX_VIEWS - 1) + gl_ViewIndex - 1] * position;
+}
+
+// Vertex in tilemap.h, with tex_coord_in the position in the map in tiles
+#define QUAD_VERTEX_INPUTS
+#include "vertex_formats.glsl"
+
+layout(location = 0) out vec2 frag_map_pos;
+
+void main() {
+	gl_Position = view_position(push_constants.mvp * vec4(pos_in, 1.0), 0);
+	frag_map_pos = tex_coord_in;
+}
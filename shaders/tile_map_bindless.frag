@@ -0,0 +1,72 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Bindless texture table (see vkx_texture_table.c)
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+
+// One texel per tile holding the tileset index
+layout(set = 2, binding = 0) uniform utexture2D tile_indices;
+
+// The uniforms up to the tile animations, as in tiles.vert
+const uint TILE_ANIMATION_SLOTS = 16;
+
+layout(binding = 0) uniform UniformBufferObject {
+	float t;
+	layout(offset = 960) uvec4 tile_animations[TILE_ANIMATION_SLOTS];
+} ubo;
+
+// FragmentSpecialization in main.c
+layout(constant_id = 1) const float ALPHA_CUTOFF = 0.5;
+
+layout(push_constant) uniform PushConstantObject {
+	mat4 mvp;
+	// Unused, the tileset is a texture of its own
+	vec4 tileset_rect;
+	uint texture_idx;
+	uint tileset_x_tiles;
+	uint tileset_y_tiles;
+	uint empty_tile;
+} push_constants;
+
+layout(location = 0) in vec2 frag_map_pos;
+
+layout(location = 0) out vec4 out_color;
+
+uint animate_tile(uint tile) {
+	// The frame of an animated tile (TILE_ANIMATIONS in main.c) showing now,
+	// which is further along the tileset
+	if (tile >= TILE_ANIMATION_SLOTS || ubo.tile_animations[tile].x <= 1) {
+		return tile;
+	}
+	uvec4 animation = ubo.tile_animations[tile];
+	uint frame = uint(ubo.t * uintBitsToFloat(animation.z)) % animation.x;
+	return tile + frame * animation.y;
+}
+
+void main() {
+	ivec2 tile = clamp(ivec2(floor(frag_map_pos)), ivec2(0), textureSize(tile_indices, 0) - 1);
+	uint tile_value = texelFetch(tile_indices, tile, 0).r;
+	if (tile_value == push_constants.empty_tile) {
+		discard;
+	}
+
+	// The tileset rows go down the image but the map goes up the screen
+	vec2 tileset_tiles = vec2(push_constants.tileset_x_tiles, push_constants.tileset_y_tiles);
+	uint animated_tile = animate_tile(tile_value);
+	vec2 tileset_pos = vec2(animated_tile % push_constants.tileset_x_tiles, animated_tile / push_constants.tileset_x_tiles);
+	vec2 tile_pos = fract(frag_map_pos);
+	vec2 uv = (tileset_pos + vec2(tile_pos.x, 1.0 - tile_pos.y)) / tileset_tiles;
+
+	// The texture coordinates jump at the tile edges, so the gradients for picking
+	// the mip level come from the map position instead
+	vec2 uv_scale = vec2(1.0, -1.0) / tileset_tiles;
+	vec2 uv_dx = dFdx(frag_map_pos) * uv_scale;
+	vec2 uv_dy = dFdy(frag_map_pos) * uv_scale;
+
+	// The index is the same for the whole draw
+	vec4 tex_color = textureGrad(textures[push_constants.texture_idx], uv, uv_dx, uv_dy);
+	if (tex_color.a < ALPHA_CUTOFF) {
+		discard;
+	}
+	out_color = tex_color;
+}
@@ -1,7 +1,10 @@
 #version 450
-#define NUM_TEXTURES 5
 
-layout(binding = 1) uniform sampler2D texSampler[NUM_TEXTURES];
+// All of the textures are packed into the layers of a single atlas
+layout(binding = 1) uniform sampler2DArray texAtlas;
+
+// FragmentSpecialization in main.c
+layout(constant_id = 1) const float ALPHA_CUTOFF = 0.5;
 
 layout(push_constant) uniform PushConstantObject {
 	mat4 mvp;
@@ -14,8 +17,8 @@ layout(location = 0) in vec2 frag_tex_coord;
 layout(location = 0) out vec4 out_color;
 
 void main() {
-	vec4 tex_color = texture(texSampler[push_constants.texture_idx], frag_tex_coord);
-	if (tex_color.a < 0.5) {
+	vec4 tex_color = texture(texAtlas, vec3(frag_tex_coord, float(push_constants.texture_idx)));
+	if (tex_color.a < ALPHA_CUTOFF) {
 		discard;
 	}
     out_color = tex_color * push_constants.color;
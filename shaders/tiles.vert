@@ -1,17 +1,85 @@
 #version 450
+#extension GL_EXT_multiview : require
+#extension GL_GOOGLE_include_directive : require
 
 layout(push_constant) uniform PushConstantObject {
 	mat4 mvp;
 	vec4 color;
 	uint texture_idx;
+	// Where the tileset is in the atlas (offset then scale) and its layout
+	vec4 tileset_rect;
+	uint tileset_x_tiles;
+	uint tileset_y_tiles;
+	uint empty_tile;
+	// Which view corrections it's drawn with, the world's or a tile layer's
+	uint view_slot;
 } push_constants;
 
-layout(location = 0) in vec3 position_in;
-layout(location = 1) in vec2 texcoord_in;
+// The split screen views, as in sprite.vert
+const uint MAX_VIEWS = 4;
+const uint VIEW_SLOTS = 3;
+// TILE_ANIMATION_SLOTS in main.c
+const uint TILE_ANIMATION_SLOTS = 16;
+
+layout(binding = 0) uniform UniformBufferObject {
+	float t;
+	layout(offset = 96) mat4 view_corrections[VIEW_SLOTS * (MAX_VIEWS - 1)];
+	layout(offset = 768) mat4 late_latch[VIEW_SLOTS];
+	// Each tile's frames, stride and frames a second (as bits)
+	layout(offset = 960) uvec4 tile_animations[TILE_ANIMATION_SLOTS];
+} ubo;
+
+vec4 view_position(vec4 position, uint slot) {
+	// The first view's is what the push constants already give, moved to the
+	// camera latched at submit
+	if (gl_ViewIndex == 0) {
+		return ubo.late_latch[slot] * position;
+	}
+	return ubo.view_corrections[slot * (MAX_VIEWS - 1) + gl_ViewIndex - 1] * position;
+}
+
+// TileVertex in tilemap.h, which is the same for all 4 vertices of the tile
+#define TILE_VERTEX_INPUTS
+#include "vertex_formats.glsl"
 
 layout(location = 0) out vec2 frag_texcoord;
 
+// Bottom left, bottom right, top right, top left, the order of the vertices of
+// each quad in the shared quad index buffer
+vec2 corners[4] = vec2[] (
+	vec2(0.0, 0.0),
+	vec2(1.0, 0.0),
+	vec2(1.0, 1.0),
+	vec2(0.0, 1.0)
+);
+
+uint animate_tile(uint tile) {
+	// The frame of an animated tile (TILE_ANIMATIONS in main.c) showing now,
+	// which is further along the tileset
+	if (tile >= TILE_ANIMATION_SLOTS || ubo.tile_animations[tile].x <= 1) {
+		return tile;
+	}
+	uvec4 animation = ubo.tile_animations[tile];
+	uint frame = uint(ubo.t * uintBitsToFloat(animation.z)) % animation.x;
+	return tile + frame * animation.y;
+}
+
 void main() {
-	gl_Position = push_constants.mvp * vec4(position_in, 1.0);
-	frag_texcoord = texcoord_in;
+	// Every tile has 4 vertices in a row
+	vec2 corner = corners[gl_VertexIndex % 4];
+
+	// Empty tiles have slots in the tile mesh, so put all of their corners in the
+	// same place and the triangles get thrown away before rasterising
+	if (tile_in == push_constants.empty_tile) {
+		corner = vec2(0.0);
+	}
+
+	gl_Position = view_position(push_constants.mvp * vec4(vec2(pos_in) + corner, 0.0, 1.0), push_constants.view_slot);
+
+	// The tileset's rows go down the image, and the map's go up
+	uint tile = animate_tile(tile_in);
+	uvec2 tileset_pos = uvec2(tile % push_constants.tileset_x_tiles, tile / push_constants.tileset_x_tiles);
+	vec2 tileset_uv = (vec2(tileset_pos) + vec2(corner.x, 1.0 - corner.y))
+		/ vec2(push_constants.tileset_x_tiles, push_constants.tileset_y_tiles);
+	frag_texcoord = push_constants.tileset_rect.xy + tileset_uv * push_constants.tileset_rect.zw;
 }
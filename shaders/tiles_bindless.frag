@@ -0,0 +1,27 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Bindless texture table (see vkx_texture_table.c)
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+
+// FragmentSpecialization in main.c
+layout(constant_id = 1) const float ALPHA_CUTOFF = 0.5;
+
+layout(push_constant) uniform PushConstantObject {
+	mat4 mvp;
+	vec4 color;
+	uint texture_idx;
+} push_constants;
+
+layout(location = 0) in vec2 frag_tex_coord;
+
+layout(location = 0) out vec4 out_color;
+
+void main() {
+	// The index is the same for the whole draw
+	vec4 tex_color = texture(textures[push_constants.texture_idx], frag_tex_coord);
+	if (tex_color.a < ALPHA_CUTOFF) {
+		discard;
+	}
+	out_color = tex_color * push_constants.color;
+}
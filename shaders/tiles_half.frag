@@ -0,0 +1,27 @@
+#version 450
+#extension GL_EXT_shader_explicit_arithmetic_types_float16 : require
+
+// tiles.frag with the colour maths at half precision, see sprite_half.frag
+
+layout(binding = 1) uniform mediump sampler2DArray texAtlas;
+
+// FragmentSpecialization in main.c
+layout(constant_id = 1) const float ALPHA_CUTOFF = 0.5;
+
+layout(push_constant) uniform PushConstantObject {
+	mat4 mvp;
+	vec4 color;
+	uint texture_idx;
+} push_constants;
+
+layout(location = 0) in vec2 frag_tex_coord;
+
+layout(location = 0) out mediump vec4 out_color;
+
+void main() {
+	f16vec4 tex_color = f16vec4(texture(texAtlas, vec3(frag_tex_coord, float(push_constants.texture_idx))));
+	if (tex_color.a < float16_t(ALPHA_CUTOFF)) {
+		discard;
+	}
+	out_color = vec4(tex_color * f16vec4(push_constants.color));
+}
@@ -0,0 +1,100 @@
+#version 450
+#extension GL_EXT_multiview : require
+
+// tiles.frag with the lights added up, as in sprite_lit.frag
+layout(binding = 1) uniform sampler2DArray texAtlas;
+layout(binding = 5) uniform sampler2DArray normalAtlas;
+
+// FragmentSpecialization in main.c
+layout(constant_id = 1) const float ALPHA_CUTOFF = 0.5;
+
+layout(push_constant) uniform PushConstantObject {
+	mat4 mvp;
+	vec4 color;
+	uint texture_idx;
+} push_constants;
+
+// MAX_VIEWS and LIGHT_TILE_SIZE in main.c, and MAX_LIGHTS_PER_TILE + 1
+const uint MAX_VIEWS = 4;
+const uint LIGHT_TILE_SIZE = 16;
+const uint LIGHT_TILE_WORDS = 64;
+
+layout(binding = 0) uniform UniformBufferObject {
+	layout(offset = 672) vec4 ambient_light;
+	vec4 light_views[MAX_VIEWS];
+	uvec2 light_tiles;
+	uint shadow_resolution;
+	float shadow_bias;
+} ubo;
+
+// Light in main.c
+struct Light {
+	vec2 pos;
+	float radius;
+	float height;
+	vec3 color;
+	float intensity;
+};
+
+layout(std430, binding = 3) readonly buffer LightBuffer {
+	Light lights[];
+} light_buffer;
+
+layout(std430, binding = 4) readonly buffer LightTileBuffer {
+	uint words[];
+} light_tiles;
+
+layout(std430, binding = 6) readonly buffer ShadowBuffer {
+	float distances[];
+} shadows;
+
+layout(location = 0) in vec2 frag_tex_coord;
+
+layout(location = 0) out vec4 out_color;
+
+const float TAU = 6.28318530718;
+
+float get_shadow(uint index, vec2 offset) {
+	float distance = length(offset);
+	float direction = fract(atan(-offset.y, -offset.x) / TAU) * float(ubo.shadow_resolution) - 0.5;
+	float blend = fract(direction);
+	uint first = (uint(floor(direction) + float(ubo.shadow_resolution))) % ubo.shadow_resolution;
+	uint second = (first + 1) % ubo.shadow_resolution;
+	uint row = index * ubo.shadow_resolution;
+	float lit_first = step(distance, shadows.distances[row + first] + ubo.shadow_bias);
+	float lit_second = step(distance, shadows.distances[row + second] + ubo.shadow_bias);
+	return mix(lit_first, lit_second, blend);
+}
+
+vec3 get_light(vec3 normal) {
+	vec4 view = ubo.light_views[gl_ViewIndex];
+	vec2 world = view.xy + gl_FragCoord.xy * view.zw;
+
+	uvec2 tile = min(uvec2(gl_FragCoord.xy) / LIGHT_TILE_SIZE, ubo.light_tiles - 1);
+	uint start = ((gl_ViewIndex * ubo.light_tiles.y + tile.y) * ubo.light_tiles.x + tile.x) * LIGHT_TILE_WORDS;
+	uint count = light_tiles.words[start];
+
+	vec3 light = ubo.ambient_light.rgb;
+	for (uint i = 0; i < count; i++) {
+		uint index = light_tiles.words[start + 1 + i];
+		Light l = light_buffer.lights[index];
+		vec2 offset = l.pos - world;
+		float falloff = clamp(1.0 - length(offset) / l.radius, 0.0, 1.0);
+		float facing = max(dot(normal, normalize(vec3(offset, l.height))), 0.0);
+		float shadow = ubo.shadow_resolution > 0 ? get_shadow(index, offset) : 1.0;
+		light += l.color * l.intensity * falloff * falloff * facing * shadow;
+	}
+	return light;
+}
+
+void main() {
+	vec3 coord = vec3(frag_tex_coord, float(push_constants.texture_idx));
+	vec4 tex_color = texture(texAtlas, coord);
+	if (tex_color.a < ALPHA_CUTOFF) {
+		discard;
+	}
+
+	// The tiles are never turned or flipped
+	vec3 normal = normalize(texture(normalAtlas, coord).xyz * 2.0 - 1.0);
+	out_color = tex_color * push_constants.color * vec4(get_light(normal), 1.0);
+}
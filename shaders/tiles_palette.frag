@@ -0,0 +1,30 @@
+#version 450
+
+// tiles.frag for palette_textures in main.c, see sprite_palette.frag.  The
+// tiles always use the first palette
+layout(binding = 1) uniform sampler2DArray texAtlas;
+layout(binding = 3) uniform sampler2D palettes;
+
+// FragmentSpecialization in main.c
+layout(constant_id = 1) const float ALPHA_CUTOFF = 0.5;
+
+layout(push_constant) uniform PushConstantObject {
+	mat4 mvp;
+	vec4 color;
+	uint texture_idx;
+} push_constants;
+
+layout(location = 0) in vec2 frag_tex_coord;
+
+layout(location = 0) out vec4 out_color;
+
+void main() {
+	ivec2 size = textureSize(texAtlas, 0).xy;
+	ivec2 texel = clamp(ivec2(frag_tex_coord * vec2(size)), ivec2(0), size - 1);
+	float index = texelFetch(texAtlas, ivec3(texel, push_constants.texture_idx), 0).r;
+	vec4 tex_color = texelFetch(palettes, ivec2(round(index * 255.0), 0), 0);
+	if (tex_color.a < ALPHA_CUTOFF) {
+		discard;
+	}
+	out_color = tex_color * push_constants.color;
+}
@@ -0,0 +1,102 @@
+#version 450
+#extension GL_EXT_multiview : require
+#extension GL_EXT_buffer_reference : require
+
+// tiles.vert for vertex_pulling in main.c, which reads the tile vertices itself
+// rather than through the vertex input
+
+// TileVertex in tilemap.h, the position's x and y in a uint and the tile in
+// the low 16 bits of the next
+struct TileVertex {
+	uint pos;
+	uint tile;
+};
+
+layout(buffer_reference, std430, buffer_reference_align = 4) readonly buffer TileVertices {
+	TileVertex vertices[];
+};
+
+layout(push_constant) uniform PushConstantObject {
+	mat4 mvp;
+	vec4 color;
+	uint texture_idx;
+	// The chunk's (or the whole map's) vertices
+	layout(offset = 88) TileVertices vertices;
+	// Where the tileset is in the atlas (offset then scale) and its layout
+	vec4 tileset_rect;
+	uint tileset_x_tiles;
+	uint tileset_y_tiles;
+	uint empty_tile;
+	// Which view corrections it's drawn with, the world's or a tile layer's
+	uint view_slot;
+} push_constants;
+
+// The split screen views, as in sprite.vert
+const uint MAX_VIEWS = 4;
+const uint VIEW_SLOTS = 3;
+// TILE_ANIMATION_SLOTS in main.c
+const uint TILE_ANIMATION_SLOTS = 16;
+
+layout(binding = 0) uniform UniformBufferObject {
+	float t;
+	layout(offset = 96) mat4 view_corrections[VIEW_SLOTS * (MAX_VIEWS - 1)];
+	layout(offset = 768) mat4 late_latch[VIEW_SLOTS];
+	// Each tile's frames, stride and frames a second (as bits)
+	layout(offset = 960) uvec4 tile_animations[TILE_ANIMATION_SLOTS];
+} ubo;
+
+vec4 view_position(vec4 position, uint slot) {
+	// The first view's is what the push constants already give, moved to the
+	// camera latched at submit
+	if (gl_ViewIndex == 0) {
+		return ubo.late_latch[slot] * position;
+	}
+	return ubo.view_corrections[slot * (MAX_VIEWS - 1) + gl_ViewIndex - 1] * position;
+}
+
+layout(location = 0) out vec2 frag_texcoord;
+
+// Bottom left, bottom right, top right, top left, the order of the vertices of
+// each quad in the shared quad index buffer
+vec2 corners[4] = vec2[] (
+	vec2(0.0, 0.0),
+	vec2(1.0, 0.0),
+	vec2(1.0, 1.0),
+	vec2(0.0, 1.0)
+);
+
+uint animate_tile(uint tile) {
+	// The frame of an animated tile (TILE_ANIMATIONS in main.c) showing now,
+	// which is further along the tileset
+	if (tile >= TILE_ANIMATION_SLOTS || ubo.tile_animations[tile].x <= 1) {
+		return tile;
+	}
+	uvec4 animation = ubo.tile_animations[tile];
+	uint frame = uint(ubo.t * uintBitsToFloat(animation.z)) % animation.x;
+	return tile + frame * animation.y;
+}
+
+void main() {
+	// Which is the same for all 4 vertices of the tile
+	TileVertex tile_vertex = push_constants.vertices.vertices[gl_VertexIndex];
+	uvec2 tile_pos_in = uvec2(tile_vertex.pos & 0xffff, tile_vertex.pos >> 16);
+	uint tile_in = tile_vertex.tile & 0xffff;
+
+	// Every tile has 4 vertices in a row
+	vec2 corner = corners[gl_VertexIndex % 4];
+
+	// Empty tiles have slots in the tile mesh, so put all of their corners in the
+	// same place and the triangles get thrown away before rasterising
+	if (tile_in == push_constants.empty_tile) {
+		corner = vec2(0.0);
+	}
+
+	gl_Position = view_position(push_constants.mvp * vec4(vec2(tile_pos_in) + corner, 0.0, 1.0), push_constants.view_slot);
+
+	// The tileset's rows go down the image, and the map's go up
+	uint tile = animate_tile(tile_in);
+	uvec2 tileset_pos = uvec2(tile % push_constants.tileset_x_tiles, tile / push_constants.tileset_x_tiles);
+	vec2 tileset_uv = (vec2(tileset_pos) + vec2(corner.x, 1.0 - corner.y))
+		/ vec2(push_constants.tileset_x_tiles, push_constants.tileset_y_tiles);
+	frag_texcoord = push_constants.tileset_rect.xy + tileset_uv * push_constants.tileset_rect.zw;
+}
@@ -0,0 +1,71 @@
+#version 450
+#extension GL_ARB_sparse_texture2 : require
+
+// tiles.frag for the sparse atlas, see vkx_sparse_atlas.c.  Pages which
+// aren't resident are drawn from a coarser level until they are streamed in
+layout(binding = 1) uniform sampler2DArray texAtlas;
+
+// VkxSparseFeedback in vkx_sparse_atlas.c.  A few pixels mark the page they
+// wanted, which the atlas reads back once the frame is done
+layout(std430, binding = 3) buffer SparseFeedback {
+	uint sample_offset;
+	uint tail_lod;
+	uvec2 page_size;
+	uint pages_per_layer;
+	uint level_offsets[16];
+	uint page_bits[];
+} feedback;
+
+// FragmentSpecialization in main.c
+layout(constant_id = 1) const float ALPHA_CUTOFF = 0.5;
+
+layout(push_constant) uniform PushConstantObject {
+	mat4 mvp;
+	vec4 color;
+	uint texture_idx;
+} push_constants;
+
+layout(location = 0) in vec2 frag_tex_coord;
+
+layout(location = 0) out vec4 out_color;
+
+void request_page(vec2 uv, uint layer, float lod) {
+	// One pixel in each 4x4, a different one each frame
+	uvec2 pixel = uvec2(gl_FragCoord.xy) & 3u;
+	uint level = uint(lod);
+	if (pixel.x + pixel.y * 4u != feedback.sample_offset || level >= feedback.tail_lod) {
+		return;
+	}
+
+	uvec2 level_size = uvec2(textureSize(texAtlas, int(level)).xy);
+	uvec2 pages = (level_size + feedback.page_size - 1u) / feedback.page_size;
+	uvec2 page = min(uvec2(clamp(uv, 0.0, 1.0) * vec2(level_size)) / feedback.page_size, pages - 1u);
+	uint index = layer * feedback.pages_per_layer + feedback.level_offsets[level] + page.y * pages.x + page.x;
+	atomicOr(feedback.page_bits[index / 32u], 1u << (index % 32u));
+}
+
+vec4 sample_atlas(vec2 uv, uint layer) {
+	// The level the sampler would pick, then coarser ones until all of the
+	// texels are resident.  The mip tail always is
+	float lod = textureQueryLod(texAtlas, uv).y;
+	float level = clamp(lod, 0.0, float(feedback.tail_lod));
+	request_page(uv, layer, level);
+
+	vec3 coord = vec3(uv, float(layer));
+	vec4 color;
+	while (level < float(feedback.tail_lod)) {
+		if (sparseTexelsResidentARB(sparseTextureLodARB(texAtlas, coord, level, color))) {
+			return color;
+		}
+		level = floor(level) + 1.0;
+	}
+	return textureLod(texAtlas, coord, level);
+}
+
+void main() {
+	vec4 tex_color = sample_atlas(frag_tex_coord, push_constants.texture_idx);
+	if (tex_color.a < ALPHA_CUTOFF) {
+		discard;
+	}
+    out_color = tex_color * push_constants.color;
+}
@@ -0,0 +1,90 @@
+// Generated by tools/vertex_glsl.c from include/vertex_formats.h - don't edit
+//
+// Define a format's name before including this for its vertex inputs, e.g.
+// SPRITE_VERTEX_INPUTS, or its struct of words, e.g. SPRITE_VERTEX_RECORD
+
+#ifdef SPRITE_VERTEX_INPUTS
+// VertexBufferSprite, 24 bytes
+layout(location = 0) in vec4 color_in;
+layout(location = 1) in vec2 uv_in;
+layout(location = 2) in vec2 uv2_in;
+layout(location = 3) in uint texture_index_in;
+layout(location = 4) in uint sprite_index_in;
+layout(location = 5) in uint flipbook_in;
+layout(location = 6) in uint trim_in;
+#endif
+
+#ifdef SPRITE_VERTEX_RECORD
+// VertexBufferSprite as words
+const uint SPRITE_RECORD_WORDS = 6;
+const uint SPRITE_RECORD_COLOR_WORD = 0;
+const uint SPRITE_RECORD_UV_WORD = 1;
+const uint SPRITE_RECORD_UV2_WORD = 2;
+const uint SPRITE_RECORD_SPRITE_INDEX_WORD = 3;
+const uint SPRITE_RECORD_TEXTURE_INDEX_WORD = 4;
+const uint SPRITE_RECORD_TRIM_WORD = 4;
+const uint SPRITE_RECORD_FLIPBOOK_WORD = 5;
+
+struct SpriteRecord {
+	uint words[SPRITE_RECORD_WORDS];
+};
+
+vec4 sprite_record_color(SpriteRecord record) {
+	return unpackUnorm4x8(record.words[0]);
+}
+
+vec2 sprite_record_uv(SpriteRecord record) {
+	return unpackUnorm2x16(record.words[1]);
+}
+
+vec2 sprite_record_uv2(SpriteRecord record) {
+	return unpackUnorm2x16(record.words[2]);
+}
+
+uint sprite_record_sprite_index(SpriteRecord record) {
+	return record.words[3];
+}
+
+uint sprite_record_texture_index(SpriteRecord record) {
+	return (record.words[4] & 0xffffu);
+}
+
+uint sprite_record_trim(SpriteRecord record) {
+	return (record.words[4] >> 16);
+}
+
+uint sprite_record_flipbook(SpriteRecord record) {
+	return record.words[5];
+}
+
+#endif
+
+#ifdef FRAMED_SPRITE_VERTEX_INPUTS
+// VertexBufferFramedSprite, 16 bytes
+layout(location = 0) in vec4 color_in;
+layout(location = 1) in uint frame_in;
+layout(location = 2) in uint flags_in;
+layout(location = 3) in uint sprite_index_in;
+layout(location = 4) in uint flipbook_in;
+#endif
+
+#ifdef SKINNED_VERTEX_INPUTS
+// SkinnedVertex, 20 bytes
+layout(location = 0) in vec2 pos_in;
+layout(location = 1) in vec2 uv_in;
+layout(location = 2) in uvec2 bones_in;
+layout(location = 3) in float weight_in;
+layout(location = 4) in uint texture_index_in;
+#endif
+
+#ifdef TILE_VERTEX_INPUTS
+// TileVertex, 8 bytes
+layout(location = 0) in uvec2 pos_in;
+layout(location = 1) in uint tile_in;
+#endif
+
+#ifdef QUAD_VERTEX_INPUTS
+// Vertex, 20 bytes
+layout(location = 0) in vec3 pos_in;
+layout(location = 1) in vec2 tex_coord_in;
+#endif
@@ -0,0 +1,152 @@
+/*
+ * 2D affine transforms, for the 2D parts of the view and model matrices
+ * without carrying a whole mat4 through them (see affine2.h).
+ *
+ * Composing two is 12 multiplies rather than the 64 of glm_mat4_mul(), and
+ * the camera's view, the layers' models and the culling only ever need the
+ * 2D part, so they're built as these and made into a mat4 once, where the
+ * shaders need one (affine2_to_mat4()).
+ *
+ * The batch versions are loops with no branches or calls over whole arrays,
+ * so the compiler can use SSE/AVX/NEON on them, the same as the batched
+ * sprite transforms in main.c.
+ */
+
+#include "affine2.h"
+
+#include <math.h>
+
+void affine2_identity(Affine2* t) {
+	*t = (Affine2) {.a = 1.0f, .d = 1.0f};
+}
+
+void affine2_make(Affine2* t, const float translation[2], float rotation, const float scale[2]) {
+	/*
+	 * Make a transform which scales, then rotates and then translates
+	 *
+	 * @param rotation Anticlockwise, in radians
+	 */
+	float cos_r = cosf(rotation);
+	float sin_r = sinf(rotation);
+	t->a = cos_r * scale[0];
+	t->b = sin_r * scale[0];
+	t->c = -sin_r * scale[1];
+	t->d = cos_r * scale[1];
+	t->tx = translation[0];
+	t->ty = translation[1];
+}
+
+void affine2_mul(const Affine2* first, const Affine2* second, Affine2* out) {
+	/*
+	 * Compose two transforms, into one which does first and then second, e.g.
+	 * a model and then the view.  out can be either of them
+	 */
+	Affine2 result = {
+		.a = second->a * first->a + second->c * first->b,
+		.b = second->b * first->a + second->d * first->b,
+		.c = second->a * first->c + second->c * first->d,
+		.d = second->b * first->c + second->d * first->d,
+		.tx = second->a * first->tx + second->c * first->ty + second->tx,
+		.ty = second->b * first->tx + second->d * first->ty + second->ty,
+	};
+	*out = result;
+}
+
+bool affine2_inverse(const Affine2* t, Affine2* out) {
+	/*
+	 * Get the transform which undoes t.  out can be t
+	 *
+	 * @return false, leaving out alone, if t squashes everything onto a line
+	 *         or a point so there isn't one
+	 */
+	float det = t->a * t->d - t->b * t->c;
+	if (det == 0.0f) {
+		return false;
+	}
+	affine2_inverse_batch(t, out, 1);
+	return true;
+}
+
+void affine2_apply(const Affine2* t, const float point[2], float out[2]) {
+	/*
+	 * Transform a point.  out can be point
+	 */
+	float x = point[0];
+	float y = point[1];
+	out[0] = t->a * x + t->c * y + t->tx;
+	out[1] = t->b * x + t->d * y + t->ty;
+}
+
+void affine2_to_mat4(const Affine2* t, float z, mat4 out) {
+	/*
+	 * Make the transform into a matrix for the shaders, which also moves
+	 * everything to depth z (e.g. a layer's)
+	 */
+	glm_mat4_identity(out);
+	out[0][0] = t->a;
+	out[0][1] = t->b;
+	out[1][0] = t->c;
+	out[1][1] = t->d;
+	out[3][0] = t->tx;
+	out[3][1] = t->ty;
+	out[3][2] = z;
+}
+
+void affine2_mul_batch(const Affine2* first, const Affine2* second, Affine2* out, uint32_t count) {
+	/*
+	 * affine2_mul() of count pairs, out[i] being first[i] and then second[i].
+	 * out can't be either of them
+	 */
+	for (uint32_t i = 0; i < count; i++) {
+		const Affine2* f = &first[i];
+		const Affine2* s = &second[i];
+		out[i].a = s->a * f->a + s->c * f->b;
+		out[i].b = s->b * f->a + s->d * f->b;
+		out[i].c = s->a * f->c + s->c * f->d;
+		out[i].d = s->b * f->c + s->d * f->d;
+		out[i].tx = s->a * f->tx + s->c * f->ty + s->tx;
+		out[i].ty = s->b * f->tx + s->d * f->ty + s->ty;
+	}
+}
+
+void affine2_inverse_batch(const Affine2* t, Affine2* out, uint32_t count) {
+	/*
+	 * affine2_inverse() of count transforms.  The ones with no inverse come
+	 * out as all zeroes (so everything goes to the origin) rather than
+	 * branching.  out can be t
+	 */
+	for (uint32_t i = 0; i < count; i++) {
+		Affine2 in = t[i];
+		float det = in.a * in.d - in.b * in.c;
+		float inv_det = det != 0.0f ? 1.0f / det : 0.0f;
+		float a = in.d * inv_det;
+		float b = -in.b * inv_det;
+		float c = -in.c * inv_det;
+		float d = in.a * inv_det;
+		out[i].a = a;
+		out[i].b = b;
+		out[i].c = c;
+		out[i].d = d;
+		out[i].tx = -(a * in.tx + c * in.ty);
+		out[i].ty = -(b * in.tx + d * in.ty);
+	}
+}
+
+void affine2_transform_points(const Affine2* t, const float* x, const float* y, float* out_x, float* out_y, uint32_t count) {
+	/*
+	 * Transform count points, kept as separate arrays of x and y like the
+	 * monsters'.  The outputs can be the inputs
+	 */
+	float a = t->a;
+	float b = t->b;
+	float c = t->c;
+	float d = t->d;
+	float tx = t->tx;
+	float ty = t->ty;
+	for (uint32_t i = 0; i < count; i++) {
+		float px = x[i];
+		float py = y[i];
+		out_x[i] = a * px + c * py + tx;
+		out_y[i] = b * px + d * py + ty;
+	}
+}
@@ -0,0 +1,188 @@
+/*
+ * Reader for the packed asset archives written by tools/pack_assets.c (see
+ * archive.h for the layout).
+ *
+ * The whole archive is mapped with map_disk_file(), so opening it is one file
+ * and uncompressed entries are views straight into the mapping.  LZ4 entries
+ * are decompressed into a buffer owned by their MappedFile.
+ *
+ * An archive can be mounted, after which map_file() looks paths up in it before
+ * going to the disk, so the rest of the code loads assets the same way either
+ * way.  Nothing is written after mounting, so lookups are safe on any thread.
+ */
+
+#include "archive.h"
+#include "lz4_block.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const Archive* mounted_archive = NULL;
+
+uint64_t archive_hash_name(const char* name) {
+	// 64 bit FNV-1a
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (const char* c = name; *c != '\0'; c++) {
+		hash ^= (uint8_t) *c;
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+bool archive_open(Archive* archive, const char* filename) {
+	/*
+	 * Map an archive and check its index
+	 *
+	 * @param filename The archive, which has to exist
+	 *
+	 * @return false (with the archive left closed) if it isn't a valid archive
+	 */
+	memset(archive, 0, sizeof(Archive));
+	archive->file = map_disk_file(filename);
+
+	const uint8_t* data = archive->file.data;
+	size_t size = archive->file.size;
+
+	ArchiveHeader header;
+	if (size < sizeof(header)) {
+		fprintf(stderr, "Archive %s is too small\n", filename);
+		archive_close(archive);
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+
+	if (header.magic != ARCHIVE_MAGIC || header.version != ARCHIVE_VERSION) {
+		fprintf(stderr, "Archive %s isn't a version %d archive\n", filename, ARCHIVE_VERSION);
+		archive_close(archive);
+		return false;
+	}
+
+	if (header.entries_count > (size - sizeof(header)) / sizeof(ArchiveEntry)) {
+		fprintf(stderr, "Archive %s has a truncated index\n", filename);
+		archive_close(archive);
+		return false;
+	}
+
+	// The mapping is page aligned and the header is 16 bytes, so the entries
+	// can be used in place
+	archive->entries = (const ArchiveEntry*) (data + sizeof(header));
+	archive->entries_count = header.entries_count;
+
+	for (uint32_t i = 0; i < archive->entries_count; i++) {
+		const ArchiveEntry* entry = &archive->entries[i];
+		bool sorted = i == 0 || archive->entries[i - 1].name_hash < entry->name_hash;
+		bool in_file = entry->offset <= size && entry->size <= size - entry->offset;
+		bool valid_size = entry->compression == ARCHIVE_COMPRESSION_LZ4 || entry->size == entry->uncompressed_size;
+
+		if (!sorted || !in_file || !valid_size || entry->compression > ARCHIVE_COMPRESSION_LZ4) {
+			fprintf(stderr, "Archive %s has a bad entry %d\n", filename, i);
+			archive_close(archive);
+			return false;
+		}
+	}
+
+	printf("Opened archive %s with %d entries\n", filename, archive->entries_count);
+
+	return true;
+}
+
+void archive_close(Archive* archive) {
+	if (mounted_archive == archive) {
+		mounted_archive = NULL;
+	}
+
+	unmap_file(&archive->file);
+	memset(archive, 0, sizeof(Archive));
+}
+
+const ArchiveEntry* archive_find(const Archive* archive, const char* name) {
+	/*
+	 * Binary search the index for a path
+	 *
+	 * @return The entry, or NULL if the archive doesn't have it
+	 */
+	uint64_t hash = archive_hash_name(name);
+
+	uint32_t low = 0;
+	uint32_t high = archive->entries_count;
+	while (low < high) {
+		uint32_t middle = low + (high - low) / 2;
+		uint64_t middle_hash = archive->entries[middle].name_hash;
+
+		if (middle_hash == hash) {
+			return &archive->entries[middle];
+		}
+		else if (middle_hash < hash) {
+			low = middle + 1;
+		}
+		else {
+			high = middle;
+		}
+	}
+
+	return NULL;
+}
+
+bool archive_map_entry(const Archive* archive, const char* name, MappedFile* file) {
+	/*
+	 * Get the contents of an entry, to release with unmap_file()
+	 *
+	 * @param name The entry's path
+	 * @param file Set to a view of the entry
+	 *
+	 * @return false if the archive doesn't have the entry.  Exits if the entry
+	 *         can't be decompressed
+	 */
+	const ArchiveEntry* entry = archive_find(archive, name);
+	if (entry == NULL) {
+		return false;
+	}
+
+	memset(file, 0, sizeof(MappedFile));
+	const uint8_t* payload = (const uint8_t*) archive->file.data + entry->offset;
+
+	if (entry->compression == ARCHIVE_COMPRESSION_NONE) {
+		file->data = payload;
+		file->size = (size_t) entry->size;
+		file->borrowed = true;
+		return true;
+	}
+
+	// Zero sized entries still get a buffer, so data isn't NULL
+	uint8_t* data = malloc(entry->uncompressed_size > 0 ? (size_t) entry->uncompressed_size : 1);
+	if (data == NULL) {
+		fprintf(stderr, "Failed to allocate %llu bytes for %s\n", (unsigned long long) entry->uncompressed_size, name);
+		exit(1);
+	}
+
+	if (!lz4_block_decompress(payload, (size_t) entry->size, data, (size_t) entry->uncompressed_size)) {
+		fprintf(stderr, "Failed to decompress %s from the archive\n", name);
+		exit(1);
+	}
+
+	file->data = data;
+	file->size = (size_t) entry->uncompressed_size;
+	file->owned_data = data;
+	return true;
+}
+
+void archive_mount(const Archive* archive) {
+	/*
+	 * Make map_file() look in the archive first, until it is closed (or
+	 * another one is mounted).  NULL unmounts it
+	 */
+	mounted_archive = archive;
+}
+
+bool archive_map_mounted(const char* name, MappedFile* file) {
+	if (mounted_archive == NULL) {
+		return false;
+	}
+
+	return archive_map_entry(mounted_archive, name, file);
+}
+
+bool archive_mounted_has(const char* name) {
+	return mounted_archive != NULL && archive_find(mounted_archive, name) != NULL;
+}
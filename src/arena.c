@@ -0,0 +1,109 @@
+/*
+ * Linear allocators for memory which only lives a short while.
+ *
+ * An arena hands out memory from one block by moving a pointer along, so an
+ * allocation costs a few instructions and nothing is freed by itself:
+ * arena_reset() gives everything back at once, and arena_release() everything
+ * since arena_get_mark(), so a function can borrow some and give it back when
+ * it returns.  Running out is fatal, as anything which could need more should
+ * be using the heap.
+ *
+ * Every thread gets a frame arena of its own the first time it calls
+ * frame_arena(), so nothing is shared and allocating takes no lock.  The main
+ * loop resets the main thread's at the start of each frame, so what it
+ * allocates there lasts until the next one.  Anywhere else (jobs, drawing,
+ * code which might run on any thread) takes a mark and releases it when it's
+ * done, which the job system does around every job.  After the first few
+ * frames have claimed the arenas the frame loop doesn't need the heap.
+ */
+
+#include "arena.h"
+
+#include <SDL3/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static Arena frame_arenas[FRAME_ARENA_MAX_THREADS] = {0};
+static SDL_AtomicInt frame_arenas_count = {0};
+
+static _Thread_local Arena* current_frame_arena = NULL;
+
+void arena_init(Arena* arena, size_t capacity) {
+	arena->data = malloc(capacity);
+	if (arena->data == NULL) {
+		fprintf(stderr, "Failed to allocate an arena of %zu bytes\n", capacity);
+		exit(1);
+	}
+	arena->capacity = capacity;
+	arena->used = 0;
+}
+
+void arena_cleanup(Arena* arena) {
+	free(arena->data);
+	*arena = (Arena) {0};
+}
+
+void* arena_alloc(Arena* arena, size_t size, size_t alignment) {
+	/*
+	 * Take some memory, which isn't cleared
+	 *
+	 * @param alignment A power of 2
+	 *
+	 * @return Never NULL, even for 0 bytes
+	 */
+	size_t start = (arena->used + alignment - 1) & ~(alignment - 1);
+	if (start > arena->capacity || size > arena->capacity - start) {
+		fprintf(stderr, "Out of arena memory (%zu of %zu bytes used, %zu more wanted)\n", arena->used, arena->capacity, size);
+		exit(1);
+	}
+
+	arena->used = start + size;
+	return arena->data + start;
+}
+
+size_t arena_get_mark(const Arena* arena) {
+	return arena->used;
+}
+
+void arena_release(Arena* arena, size_t mark) {
+	/*
+	 * Give back everything allocated since a mark
+	 */
+	arena->used = mark;
+}
+
+void arena_reset(Arena* arena) {
+	arena->used = 0;
+}
+
+Arena* frame_arena(void) {
+	/*
+	 * The calling thread's frame arena, claiming one on first use
+	 */
+	if (current_frame_arena != NULL) {
+		return current_frame_arena;
+	}
+
+	int index = SDL_AddAtomicInt(&frame_arenas_count, 1);
+	if (index >= FRAME_ARENA_MAX_THREADS) {
+		fprintf(stderr, "Too many threads for the frame arenas (max %d)\n", FRAME_ARENA_MAX_THREADS);
+		exit(1);
+	}
+
+	arena_init(&frame_arenas[index], FRAME_ARENA_SIZE);
+	current_frame_arena = &frame_arenas[index];
+	return current_frame_arena;
+}
+
+void frame_arenas_cleanup(void) {
+	/*
+	 * Free every thread's frame arena.  No other thread can be using them
+	 */
+	int count = SDL_GetAtomicInt(&frame_arenas_count);
+	for (int i = 0; i < count && i < FRAME_ARENA_MAX_THREADS; i++) {
+		arena_cleanup(&frame_arenas[i]);
+	}
+	SDL_SetAtomicInt(&frame_arenas_count, 0);
+	current_frame_arena = NULL;
+}
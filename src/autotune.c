@@ -0,0 +1,217 @@
+/*
+ * Choosing between render paths by timing them on the device.
+ *
+ * Some of the alternatives are only faster on some GPUs (e.g. whether the CPU
+ * writing over PCIe into resizable BAR beats the GPU reading host memory), so
+ * rather than picking them by hand the caller measures each candidate once
+ * and records the winner here under a name.  The choices are written to a
+ * file with the device's UUID and driver version, and autotune_load() only
+ * takes them back for the same device and driver, so a new GPU or driver is
+ * measured again and every other run starts straight away.
+ *
+ * autotune_time_upload() is the probe for where streamed data goes: the time
+ * for the CPU to write a block into memory and the GPU to read it.
+ */
+
+#include "autotune.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL3/SDL_timer.h>
+
+#include "io.h"
+#include "vkx/vkx_core.h"
+
+#define AUTOTUNE_MAGIC 0x4e545856 // "VXTN"
+// Goes up when the choices' names or meanings change
+#define AUTOTUNE_VERSION 1
+// Each probe is the best of this many, after one to warm up
+#define AUTOTUNE_UPLOAD_REPEATS 4
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t driver_version;
+	uint32_t choices_count;
+	uint8_t device_uuid[VK_UUID_SIZE];
+} AutotuneFileHeader;
+
+static const char* autotune_path = NULL;
+static AutotuneChoice choices[AUTOTUNE_MAX_CHOICES];
+static uint32_t choices_count = 0;
+// Something was measured, so the file needs writing
+static bool choices_changed = false;
+
+static void autotune_get_device(uint8_t uuid[VK_UUID_SIZE], uint32_t* driver_version) {
+	VkPhysicalDeviceIDProperties id_properties = {0};
+	id_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+	VkPhysicalDeviceProperties2 properties = {0};
+	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties.pNext = &id_properties;
+	vkGetPhysicalDeviceProperties2(vkx_instance.physical_device, &properties);
+
+	memcpy(uuid, id_properties.deviceUUID, VK_UUID_SIZE);
+	*driver_version = properties.properties.driverVersion;
+}
+
+void autotune_load(const char* path) {
+	/*
+	 * Take back the choices made on an earlier run, if it was on this device
+	 * and driver.  After vkx_init()
+	 *
+	 * @param path The file to load them from (and save them to)
+	 */
+	autotune_path = path;
+	choices_count = 0;
+	choices_changed = false;
+	if (!file_exists(path)) {
+		return;
+	}
+
+	uint8_t uuid[VK_UUID_SIZE];
+	uint32_t driver_version;
+	autotune_get_device(uuid, &driver_version);
+
+	MappedFile file = map_disk_file(path);
+	AutotuneFileHeader header = {0};
+	if (file.size >= sizeof(header)) {
+		memcpy(&header, file.data, sizeof(header));
+	}
+	if (header.magic != AUTOTUNE_MAGIC
+			|| header.version != AUTOTUNE_VERSION
+			|| header.driver_version != driver_version
+			|| memcmp(header.device_uuid, uuid, VK_UUID_SIZE) != 0
+			|| header.choices_count > AUTOTUNE_MAX_CHOICES
+			|| file.size != sizeof(header) + sizeof(AutotuneChoice) * header.choices_count) {
+		printf(" Autotuned render paths in %s are for another device or driver - measuring them again\n", path);
+		unmap_file(&file);
+		return;
+	}
+
+	memcpy(choices, (const char*) file.data + sizeof(header), sizeof(AutotuneChoice) * header.choices_count);
+	choices_count = header.choices_count;
+	for (uint32_t i = 0; i < choices_count; i++) {
+		choices[i].name[AUTOTUNE_MAX_NAME - 1] = '\0';
+	}
+	printf(" Loaded %u autotuned render paths\n", choices_count);
+	unmap_file(&file);
+}
+
+void autotune_save(void) {
+	/*
+	 * Write the choices out if any were measured this run.  Failing to isn't
+	 * fatal, they'll just be measured again
+	 */
+	if (!choices_changed || autotune_path == NULL) {
+		return;
+	}
+
+	size_t size = sizeof(AutotuneFileHeader) + sizeof(AutotuneChoice) * choices_count;
+	char* data = malloc(size);
+	if (data == NULL) {
+		return;
+	}
+
+	AutotuneFileHeader header = {0};
+	header.magic = AUTOTUNE_MAGIC;
+	header.version = AUTOTUNE_VERSION;
+	header.choices_count = choices_count;
+	autotune_get_device(header.device_uuid, &header.driver_version);
+	memcpy(data, &header, sizeof(header));
+	memcpy(data + sizeof(header), choices, sizeof(AutotuneChoice) * choices_count);
+
+	write_entire_binary_file(autotune_path, data, size);
+	free(data);
+	choices_changed = false;
+}
+
+bool autotune_get(const char* name, uint32_t* value) {
+	/*
+	 * Get what was picked for a path, or false if it hasn't been measured on
+	 * this device yet
+	 */
+	for (uint32_t i = 0; i < choices_count; i++) {
+		if (strcmp(choices[i].name, name) == 0) {
+			*value = choices[i].value;
+			return true;
+		}
+	}
+	return false;
+}
+
+void autotune_set(const char* name, uint32_t value) {
+	/*
+	 * Record what was picked for a path, for autotune_save()
+	 *
+	 * @param name Shorter than AUTOTUNE_MAX_NAME
+	 */
+	if (strlen(name) >= AUTOTUNE_MAX_NAME) {
+		fprintf(stderr, "Autotune names must be shorter than %d characters: %s\n", AUTOTUNE_MAX_NAME, name);
+		exit(1);
+	}
+
+	uint32_t i = 0;
+	while (i < choices_count && strcmp(choices[i].name, name) != 0) {
+		i++;
+	}
+	if (i == AUTOTUNE_MAX_CHOICES) {
+		fprintf(stderr, "Only %d render paths can be autotuned\n", AUTOTUNE_MAX_CHOICES);
+		exit(1);
+	}
+	if (i == choices_count) {
+		memset(&choices[i], 0, sizeof(choices[i]));
+		strcpy(choices[i].name, name);
+		choices_count++;
+	}
+	choices[i].value = value;
+	choices_changed = true;
+}
+
+double autotune_time_upload(VkDeviceSize size, bool device_local) {
+	/*
+	 * Time the CPU writing a block into host visible memory and the GPU copying
+	 * it out to device local memory, as a frame's streamed data is written
+	 * each frame and read by the shaders
+	 *
+	 * @param device_local In host visible device local memory (resizable BAR
+	 *                     or unified memory), rather than host memory
+	 *
+	 * @return The fastest of a few tries, in milliseconds
+	 */
+	VkMemoryPropertyFlags memory_properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	if (device_local) {
+		memory_properties |= VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+	}
+	VkxBuffer source = vkx_create_buffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, memory_properties);
+	VkxBuffer destination = vkx_create_buffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	void* data = malloc((size_t) size);
+	if (data == NULL) {
+		fprintf(stderr, "Failed to allocate %llu bytes for the upload probe\n", (unsigned long long) size);
+		exit(1);
+	}
+	memset(data, 0x5a, (size_t) size);
+
+	// The submission's own overhead is in both candidates' times alike
+	double best_ms = 0.0;
+	for (uint32_t i = 0; i <= AUTOTUNE_UPLOAD_REPEATS; i++) {
+		uint64_t start = SDL_GetTicksNS();
+		memcpy(source.allocation.mapped, data, (size_t) size);
+
+		VkCommandBuffer command_buffer = vkx_begin_single_time_commands();
+		VkBufferCopy region = {0, 0, size};
+		vkCmdCopyBuffer(command_buffer, source.buffer, destination.buffer, 1, &region);
+		vkx_end_single_time_commands(command_buffer);
+
+		double ms = (double) (SDL_GetTicksNS() - start) / 1e6;
+		if (i == 1 || (i > 1 && ms < best_ms)) {
+			best_ms = ms;
+		}
+	}
+
+	free(data);
+	vkx_cleanup_buffer(&source);
+	vkx_cleanup_buffer(&destination);
+	return best_ms;
+}
@@ -0,0 +1,544 @@
+/*
+ * Benchmark scenarios and their timings.
+ *
+ *   main --bench <scenario> [--headless] [--frames N] [--warmup N]
+ *        [--output results.csv] [--label name]
+ *        [--baseline baseline.csv] [--tolerance percent]
+ *        [--record inputs.rply | --replay inputs.rply]
+ *   main [--level level.vxl | --save-level level.vxl]
+ *   main --bench-list
+ *
+ * A scenario fixes the number of sprites, the size of the map and whether the
+ * post effects are on.  The run is deterministic (BENCH_SEED and a fixed time
+ * step), so the same scenario does the same work on every commit and GPU.
+ * The renderer adds a phase for each CPU and GPU stage it times and a sample
+ * to each phase every frame.  The first warmup_frames samples of each phase
+ * are left out, and once the run is over the statistics of the rest are
+ * printed and appended to the output file.  bench.sh runs every scenario into
+ * one file (the bench build target runs it).
+ *
+ * With a baseline (the results file of an earlier run, on the reference
+ * machine) each phase's p50 is compared with the baseline's for the same
+ * scenario and device, and the run fails if any is more than the tolerance
+ * slower.  The bench_check build target does that for every scenario.
+ *
+ * --record writes the seed, the input and the frame times of a run to a log
+ * (see replay.c), and --replay runs it again from one, frame for frame, with
+ * or without --bench.  A log is replayed with the scenario it was recorded
+ * with.
+ *
+ * --save-level writes the level (the tiles and the monsters) to a snapshot
+ * once it's generated, and --level loads one instead of generating it (see
+ * level.c).  A scenario generates its own level, so they aren't for
+ * benchmarks.
+ */
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_DEFAULT_WARMUP_FRAMES 120
+#define BENCH_DEFAULT_FRAMES 1200
+
+static const BenchScenario BENCH_SCENARIOS[] = {
+	// Sprite count sweep, on a single screen map
+	{"sprites-1k", 1000, 32, 24, 0.0f, true},
+	{"sprites-10k", 10000, 32, 24, 0.0f, true},
+	{"sprites-100k", 100000, 32, 24, 0.0f, true},
+	{"sprites-1m", 1000000, 32, 24, 0.0f, true},
+	// Map size sweep, panning so chunks keep being built
+	{"map-256", 1000, 256, 256, 8.0f, true},
+	{"map-1024", 1000, 1024, 1024, 8.0f, true},
+	{"map-4096", 1000, 4096, 4096, 8.0f, true},
+	// The post effects' cost
+	{"post-off", 10000, 32, 24, 0.0f, false},
+	{"post-on", 10000, 32, 24, 0.0f, true},
+};
+
+#define BENCH_SCENARIOS_COUNT (sizeof(BENCH_SCENARIOS) / sizeof(BENCH_SCENARIOS[0]))
+
+typedef struct {
+	const char* name;
+	float* samples;
+	uint32_t samples_count;
+	// Samples seen, including the warmup ones
+	uint32_t seen_count;
+	// Timed once at startup, so there's no warmup to leave out
+	bool startup;
+} BenchPhase;
+
+static BenchOptions bench_options = {0};
+static BenchPhase phases[BENCH_MAX_PHASES] = {0};
+static uint32_t phases_count = 0;
+
+static bool bench_parse_uint(const char* value, uint32_t* result) {
+	char* end = NULL;
+	unsigned long parsed = strtoul(value, &end, 10);
+	if (end == value || *end != '\0' || parsed > UINT32_MAX) {
+		return false;
+	}
+	*result = (uint32_t) parsed;
+	return true;
+}
+
+static const BenchScenario* bench_find_scenario(const char* name) {
+	for (size_t i = 0; i < BENCH_SCENARIOS_COUNT; i++) {
+		if (strcmp(BENCH_SCENARIOS[i].name, name) == 0) {
+			return &BENCH_SCENARIOS[i];
+		}
+	}
+	return NULL;
+}
+
+void bench_print_scenarios(void) {
+	/*
+	 * Print the scenario names one per line, for bench.sh
+	 */
+	for (size_t i = 0; i < BENCH_SCENARIOS_COUNT; i++) {
+		printf("%s\n", BENCH_SCENARIOS[i].name);
+	}
+}
+
+bool bench_parse_args(int argc, char** argv, BenchOptions* options) {
+	/*
+	 * Read the benchmark options from the command line
+	 *
+	 * @param options Set to the options, with scenario left NULL if there's
+	 *        no --bench
+	 *
+	 * @return false if the arguments are wrong, which has been printed
+	 */
+	memset(options, 0, sizeof(BenchOptions));
+	options->warmup_frames = BENCH_DEFAULT_WARMUP_FRAMES;
+	options->frames = BENCH_DEFAULT_FRAMES;
+	options->label = "";
+	options->tolerance = BENCH_DEFAULT_TOLERANCE;
+
+	for (int i = 1; i < argc; i++) {
+		const char* arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+
+		if (strcmp(arg, "--headless") == 0) {
+			options->headless = true;
+		}
+		else if (value == NULL) {
+			fprintf(stderr, "Unknown argument %s, or it needs a value\n", arg);
+			return false;
+		}
+		else if (strcmp(arg, "--bench") == 0) {
+			options->scenario = bench_find_scenario(value);
+			if (options->scenario == NULL) {
+				fprintf(stderr, "Unknown benchmark scenario %s, these are the scenarios:\n", value);
+				bench_print_scenarios();
+				return false;
+			}
+			i++;
+		}
+		else if (strcmp(arg, "--frames") == 0 || strcmp(arg, "--warmup") == 0) {
+			uint32_t* result = strcmp(arg, "--frames") == 0 ? &options->frames : &options->warmup_frames;
+			if (!bench_parse_uint(value, result)) {
+				fprintf(stderr, "%s needs a number of frames, not %s\n", arg, value);
+				return false;
+			}
+			i++;
+		}
+		else if (strcmp(arg, "--output") == 0) {
+			options->output = value;
+			i++;
+		}
+		else if (strcmp(arg, "--label") == 0) {
+			options->label = value;
+			i++;
+		}
+		else if (strcmp(arg, "--baseline") == 0) {
+			options->baseline = value;
+			i++;
+		}
+		else if (strcmp(arg, "--record") == 0) {
+			options->record = value;
+			i++;
+		}
+		else if (strcmp(arg, "--replay") == 0) {
+			options->replay = value;
+			i++;
+		}
+		else if (strcmp(arg, "--level") == 0) {
+			options->level = value;
+			i++;
+		}
+		else if (strcmp(arg, "--save-level") == 0) {
+			options->save_level = value;
+			i++;
+		}
+		else if (strcmp(arg, "--tolerance") == 0) {
+			char* end = NULL;
+			double percent = strtod(value, &end);
+			if (end == value || *end != '\0' || percent < 0.0) {
+				fprintf(stderr, "--tolerance needs a percentage, not %s\n", value);
+				return false;
+			}
+			options->tolerance = percent / 100.0;
+			i++;
+		}
+		else {
+			fprintf(stderr, "Unknown argument %s\n", arg);
+			return false;
+		}
+	}
+
+	if (options->scenario == NULL && (options->output != NULL || options->headless || options->baseline != NULL)) {
+		fprintf(stderr, "--headless, --output and --baseline are for benchmarks, which need --bench <scenario>\n");
+		return false;
+	}
+	if (options->record != NULL && options->replay != NULL) {
+		fprintf(stderr, "--record and --replay can't both be used\n");
+		return false;
+	}
+	if (options->level != NULL && options->save_level != NULL) {
+		fprintf(stderr, "--level and --save-level can't both be used\n");
+		return false;
+	}
+	if (options->scenario != NULL && (options->level != NULL || options->save_level != NULL)) {
+		fprintf(stderr, "--level and --save-level can't be used with --bench, which generates its own level\n");
+		return false;
+	}
+	if (options->frames == 0) {
+		options->frames = 1;
+	}
+
+	return true;
+}
+
+void bench_begin(const BenchOptions* options) {
+	/*
+	 * Start a benchmark run, before the phases are added
+	 */
+	bench_options = *options;
+	memset(phases, 0, sizeof(phases));
+	phases_count = 0;
+
+	const BenchScenario* scenario = options->scenario;
+	printf("Benchmark %s: %u sprites, %ux%u map, post effects %s, %u frames after %u warmup frames%s\n",
+			scenario->name, scenario->sprites_count, scenario->map_width, scenario->map_height,
+			scenario->post_effects ? "on" : "off", options->frames, options->warmup_frames,
+			options->headless ? ", headless" : "");
+}
+
+void bench_end(void) {
+	for (uint32_t i = 0; i < phases_count; i++) {
+		free(phases[i].samples);
+	}
+	memset(phases, 0, sizeof(phases));
+	phases_count = 0;
+	bench_options.scenario = NULL;
+}
+
+bool bench_is_running(void) {
+	return bench_options.scenario != NULL;
+}
+
+uint32_t bench_add_phase(const char* name) {
+	/*
+	 * Add a CPU or GPU phase to time, whose samples come from a single thread
+	 *
+	 * @param name Kept, so it should be a literal
+	 */
+	if (phases_count >= BENCH_MAX_PHASES) {
+		fprintf(stderr, "Too many benchmark phases (the most is %d)\n", BENCH_MAX_PHASES);
+		exit(1);
+	}
+
+	BenchPhase* phase = &phases[phases_count];
+	phase->name = name;
+	phase->samples = malloc(sizeof(float) * bench_options.frames);
+	if (phase->samples == NULL) {
+		fprintf(stderr, "Failed to allocate the samples for benchmark phase %s\n", name);
+		exit(1);
+	}
+
+	return phases_count++;
+}
+
+uint32_t bench_add_startup_phase(const char* name) {
+	/*
+	 * Add a phase timed once when starting up (e.g. building the tile mesh),
+	 * which gets a single sample
+	 */
+	uint32_t phase = bench_add_phase(name);
+	phases[phase].startup = true;
+	return phase;
+}
+
+void bench_add_sample(uint32_t phase, double ms) {
+	/*
+	 * Add a frame's time for a phase, does nothing when not benchmarking
+	 */
+	if (bench_options.scenario == NULL || phase >= phases_count) {
+		return;
+	}
+
+	BenchPhase* bench_phase = &phases[phase];
+	if (!bench_phase->startup && bench_phase->seen_count++ < bench_options.warmup_frames) {
+		return;
+	}
+	if (bench_phase->samples_count < bench_options.frames) {
+		bench_phase->samples[bench_phase->samples_count++] = (float) ms;
+	}
+}
+
+static int bench_compare_floats(const void* a, const void* b) {
+	float value_a = *(const float*) a;
+	float value_b = *(const float*) b;
+	return (value_a > value_b) - (value_a < value_b);
+}
+
+BenchStats bench_get_stats(uint32_t phase) {
+	/*
+	 * The statistics of a phase's samples so far, which puts them in order
+	 */
+	BenchStats stats = {0};
+	BenchPhase* bench_phase = &phases[phase];
+	uint32_t count = bench_phase->samples_count;
+	stats.samples_count = count;
+	if (count == 0) {
+		return stats;
+	}
+
+	qsort(bench_phase->samples, count, sizeof(float), bench_compare_floats);
+
+	double total = 0.0;
+	for (uint32_t i = 0; i < count; i++) {
+		total += bench_phase->samples[i];
+	}
+
+	stats.min = bench_phase->samples[0];
+	stats.max = bench_phase->samples[count - 1];
+	stats.avg = total / count;
+	stats.p50 = bench_phase->samples[(count - 1) * 50 / 100];
+	stats.p95 = bench_phase->samples[(count - 1) * 95 / 100];
+	stats.p99 = bench_phase->samples[(count - 1) * 99 / 100];
+	return stats;
+}
+
+static void bench_write_json_string(FILE* file, const char* string) {
+	fputc('"', file);
+	for (const char* c = string; *c != '\0'; c++) {
+		if (*c == '"' || *c == '\\') {
+			fputc('\\', file);
+			fputc(*c, file);
+		}
+		else if ((unsigned char) *c < 0x20) {
+			fprintf(file, "\\u%04x", (unsigned char) *c);
+		}
+		else {
+			fputc(*c, file);
+		}
+	}
+	fputc('"', file);
+}
+
+static void bench_write_csv_string(FILE* file, const char* string) {
+	fputc('"', file);
+	for (const char* c = string; *c != '\0'; c++) {
+		if (*c == '"') {
+			fputc('"', file);
+		}
+		fputc(*c, file);
+	}
+	fputc('"', file);
+}
+
+bool bench_write_results(const char* device_name) {
+	/*
+	 * Print the statistics of every phase, and append them to the output file.
+	 * CSV has a row for each phase (and a header if the file is new), JSON a
+	 * line with an object for the whole run
+	 *
+	 * @param device_name Of the GPU, to tell the results apart
+	 *
+	 * @return false if the file couldn't be written
+	 */
+	const BenchScenario* scenario = bench_options.scenario;
+	BenchStats stats[BENCH_MAX_PHASES];
+
+	printf("Benchmark %s results (ms):\n", scenario->name);
+	printf("  %-20s %9s %9s %9s %9s %9s %9s\n", "phase", "min", "avg", "p50", "p95", "p99", "max");
+	for (uint32_t i = 0; i < phases_count; i++) {
+		stats[i] = bench_get_stats(i);
+		printf("  %-20s %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f\n", phases[i].name,
+				stats[i].min, stats[i].avg, stats[i].p50, stats[i].p95, stats[i].p99, stats[i].max);
+	}
+
+	if (bench_options.output == NULL) {
+		return true;
+	}
+
+	FILE* file = fopen(bench_options.output, "ab");
+	if (file == NULL) {
+		fprintf(stderr, "Failed to open %s for the benchmark results\n", bench_options.output);
+		return false;
+	}
+
+	size_t length = strlen(bench_options.output);
+	bool json = length >= 5 && strcmp(bench_options.output + length - 5, ".json") == 0;
+
+	if (json) {
+		fprintf(file, "{\"label\":");
+		bench_write_json_string(file, bench_options.label);
+		fprintf(file, ",\"device\":");
+		bench_write_json_string(file, device_name);
+		fprintf(file, ",\"scenario\":");
+		bench_write_json_string(file, scenario->name);
+		fprintf(file, ",\"headless\":%s,\"sprites\":%u,\"map_width\":%u,\"map_height\":%u,\"post_effects\":%s,\"phases\":{",
+				bench_options.headless ? "true" : "false", scenario->sprites_count, scenario->map_width,
+				scenario->map_height, scenario->post_effects ? "true" : "false");
+		for (uint32_t i = 0; i < phases_count; i++) {
+			fprintf(file, "%s", i > 0 ? "," : "");
+			bench_write_json_string(file, phases[i].name);
+			fprintf(file, ":{\"samples\":%u,\"min\":%.4f,\"avg\":%.4f,\"p50\":%.4f,\"p95\":%.4f,\"p99\":%.4f,\"max\":%.4f}",
+					stats[i].samples_count, stats[i].min, stats[i].avg, stats[i].p50, stats[i].p95, stats[i].p99, stats[i].max);
+		}
+		fprintf(file, "}}\n");
+	}
+	else {
+		// Appending, so a new file is one with nothing in it yet
+		fseek(file, 0, SEEK_END);
+		if (ftell(file) == 0) {
+			fprintf(file, "label,device,scenario,headless,sprites,map_width,map_height,post_effects,phase,samples,min_ms,avg_ms,p50_ms,p95_ms,p99_ms,max_ms\n");
+		}
+
+		for (uint32_t i = 0; i < phases_count; i++) {
+			bench_write_csv_string(file, bench_options.label);
+			fputc(',', file);
+			bench_write_csv_string(file, device_name);
+			fprintf(file, ",%s,%d,%u,%u,%u,%d,%s,%u,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n", scenario->name,
+					bench_options.headless, scenario->sprites_count, scenario->map_width, scenario->map_height,
+					scenario->post_effects, phases[i].name, stats[i].samples_count,
+					stats[i].min, stats[i].avg, stats[i].p50, stats[i].p95, stats[i].p99, stats[i].max);
+		}
+	}
+
+	if (ferror(file) || fclose(file) != 0) {
+		fprintf(stderr, "Failed to write the benchmark results to %s\n", bench_options.output);
+		return false;
+	}
+
+	printf("Appended the results to %s\n", bench_options.output);
+	return true;
+}
+
+static uint32_t bench_split_csv_line(char* line, char** fields, uint32_t max_fields) {
+	/*
+	 * Split a line of a results file into its fields in place, unquoting the
+	 * quoted ones (as bench_write_csv_string() writes them)
+	 *
+	 * @return The number of fields
+	 */
+	uint32_t count = 0;
+	char* read = line;
+	while (count < max_fields) {
+		char* write = read;
+		fields[count++] = write;
+
+		if (*read == '"') {
+			read++;
+			while (*read != '\0') {
+				if (*read == '"' && read[1] == '"') {
+					*write++ = '"';
+					read += 2;
+				}
+				else if (*read == '"') {
+					read++;
+					break;
+				}
+				else {
+					*write++ = *read++;
+				}
+			}
+		}
+		while (*read != '\0' && *read != ',' && *read != '\n' && *read != '\r') {
+			*write++ = *read++;
+		}
+
+		bool last = *read != ',';
+		*write = '\0';
+		if (last) {
+			break;
+		}
+		read++;
+	}
+	return count;
+}
+
+bool bench_check_baseline(const char* device_name) {
+	/*
+	 * Compare the p50 of each phase with the last run of the same scenario in
+	 * the baseline, on the same device.  Call after bench_write_results(),
+	 * which puts the samples in order
+	 *
+	 * @return false if a phase has regressed, or there is no baseline to
+	 *         compare with
+	 */
+	if (bench_options.baseline == NULL) {
+		return true;
+	}
+
+	FILE* file = fopen(bench_options.baseline, "rb");
+	if (file == NULL) {
+		fprintf(stderr, "Failed to open the benchmark baseline %s\n", bench_options.baseline);
+		return false;
+	}
+
+	const BenchScenario* scenario = bench_options.scenario;
+	double baseline_p50[BENCH_MAX_PHASES];
+	bool found[BENCH_MAX_PHASES] = {0};
+	uint32_t found_count = 0;
+
+	char line[1024];
+	while (fgets(line, sizeof(line), file) != NULL) {
+		// label, device, scenario, headless, ..., phase, samples, min, avg, p50
+		char* fields[16];
+		if (bench_split_csv_line(line, fields, 16) != 16) {
+			continue;
+		}
+		if (strcmp(fields[1], device_name) != 0 || strcmp(fields[2], scenario->name) != 0 ||
+				atoi(fields[3]) != (int) bench_options.headless) {
+			continue;
+		}
+
+		// Later rows are later runs, which replace the earlier ones
+		for (uint32_t i = 0; i < phases_count; i++) {
+			if (strcmp(fields[8], phases[i].name) == 0) {
+				found_count += found[i] ? 0 : 1;
+				found[i] = true;
+				baseline_p50[i] = strtod(fields[12], NULL);
+			}
+		}
+	}
+	fclose(file);
+
+	if (found_count == 0) {
+		fprintf(stderr, "The baseline %s has no results for %s on %s\n", bench_options.baseline, scenario->name, device_name);
+		return false;
+	}
+
+	bool passed = true;
+	printf("Benchmark %s against %s (p50, %.0f%% tolerance):\n", scenario->name, bench_options.baseline,
+			bench_options.tolerance * 100.0);
+	for (uint32_t i = 0; i < phases_count; i++) {
+		if (!found[i]) {
+			printf("  %-20s no baseline\n", phases[i].name);
+			continue;
+		}
+
+		BenchStats stats = bench_get_stats(i);
+		double limit = baseline_p50[i] * (1.0 + bench_options.tolerance);
+		bool regressed = stats.p50 > limit && stats.p50 - baseline_p50[i] > BENCH_MIN_REGRESSION_MS;
+		printf("  %-20s %9.3f vs %9.3f %s\n", phases[i].name, stats.p50, baseline_p50[i], regressed ? "REGRESSED" : "ok");
+		passed &= !regressed;
+	}
+
+	return passed;
+}
@@ -0,0 +1,233 @@
+/*
+ * A 2D camera: pans, zooms and shakes over the world, and makes the matrices
+ * and the rectangle in view for the frame.
+ *
+ * The game moves the centre and zoom whenever it likes, then camera_update()
+ * once an update keeps the view inside the bounds, adds the shake, snaps it
+ * to whole screen pixels and builds everything from that.  The renderer only
+ * reads the results, from a copy, so the same view-projection is used by the
+ * culling, the tiles and the sprites.
+ *
+ * The view is view_size / zoom across with its smallest x and y at the bottom
+ * left of the screen (y goes up it).  Layers with parallax move their bottom
+ * left corner by parallax times the camera's at zoom 1, so a layer with 0
+ * stays where the camera at the origin sees it, and they zoom about the same
+ * centre as everything else.
+ */
+
+#include "camera.h"
+
+#include <math.h>
+#include <string.h>
+
+// How quickly the velocity follows the camera's movement, per second.  Higher
+// reacts sooner, lower is steadier
+#define CAMERA_VELOCITY_RESPONSE 8.0f
+
+void camera_init(Camera* camera, float view_width, float view_height, float near_z, float far_z) {
+	/*
+	 * Set a camera up unbounded at zoom 1, centred on the middle of the view
+	 * with its corner at the origin
+	 *
+	 * @param view_width World units across the screen at zoom 1
+	 * @param view_height And up it
+	 * @param near_z Depth which is nearest, as the sprites' z (larger is further
+	 *               away, so this is the larger one)
+	 * @param far_z Depth which is furthest
+	 */
+	memset(camera, 0, sizeof(*camera));
+	camera->view_size[0] = view_width;
+	camera->view_size[1] = view_height;
+	camera->near_z = near_z;
+	camera->far_z = far_z;
+	camera->centre[0] = view_width * 0.5f;
+	camera->centre[1] = view_height * 0.5f;
+	camera->zoom = 1.0f;
+	camera->min_zoom = 1.0f;
+	camera->max_zoom = 1.0f;
+	camera->shake_decay = 1.0f;
+	camera_update(camera, 0.0f);
+}
+
+void camera_set_bounds(Camera* camera, const float min[2], const float max[2]) {
+	/*
+	 * Keep the view inside a rectangle of the world, e.g. the map
+	 */
+	camera->bounded = true;
+	glm_vec2_copy((float*) min, camera->bounds_min);
+	glm_vec2_copy((float*) max, camera->bounds_max);
+}
+
+void camera_set_zoom_range(Camera* camera, float min_zoom, float max_zoom) {
+	camera->min_zoom = min_zoom;
+	camera->max_zoom = max_zoom;
+	camera->zoom = glm_clamp(camera->zoom, min_zoom, max_zoom);
+}
+
+void camera_set_centre(Camera* camera, const float centre[2]) {
+	glm_vec2_copy((float*) centre, camera->centre);
+}
+
+void camera_move(Camera* camera, const float offset[2]) {
+	camera->centre[0] += offset[0];
+	camera->centre[1] += offset[1];
+}
+
+void camera_set_zoom(Camera* camera, float zoom) {
+	/*
+	 * Zoom about the centre, within the zoom range
+	 */
+	camera->zoom = glm_clamp(zoom, camera->min_zoom, camera->max_zoom);
+}
+
+void camera_shake(Camera* camera, float trauma) {
+	/*
+	 * Add some trauma, e.g. for a hit.  It adds up to 1 and wears off by itself
+	 */
+	camera->trauma = glm_clamp(camera->trauma + trauma, 0.0f, 1.0f);
+}
+
+static void camera_get_corner(const Camera* camera, float parallax, float corner[2]) {
+	/*
+	 * Get the smallest x and y in view, for a layer moving parallax times as
+	 * far as the camera
+	 */
+	for (int i = 0; i < 2; i++) {
+		float half = camera->view_size[i] * 0.5f;
+		float centre = camera->eye[i] * parallax + half * (1.0f - parallax);
+		corner[i] = centre - half / camera->zoom;
+	}
+}
+
+void camera_view_affine(const Camera* camera, float parallax, Affine2* view) {
+	/*
+	 * Get the view of a layer moving parallax times as far as the camera,
+	 * from the world to view units (0 to view_size), e.g. to compose with a
+	 * model or to cull in view space
+	 */
+	float corner[2];
+	camera_get_corner(camera, parallax, corner);
+
+	// Zoomed about the corner, which ends up at the origin
+	*view = (Affine2) {
+		.a = camera->zoom,
+		.d = camera->zoom,
+		.tx = -corner[0] * camera->zoom,
+		.ty = -corner[1] * camera->zoom,
+	};
+}
+
+void camera_update(Camera* camera, float dt) {
+	/*
+	 * Work out where the camera is this update and rebuild its matrices and
+	 * visible rectangle
+	 *
+	 * @param dt Seconds since the last update, which the shake moves on by
+	 */
+	camera->zoom = glm_clamp(camera->zoom, camera->min_zoom, camera->max_zoom);
+
+	if (camera->bounded) {
+		for (int i = 0; i < 2; i++) {
+			float half = camera->view_size[i] * 0.5f / camera->zoom;
+			float min = camera->bounds_min[i] + half;
+			float max = camera->bounds_max[i] - half;
+			camera->centre[i] = min < max
+				? glm_clamp(camera->centre[i], min, max)
+				: (camera->bounds_min[i] + camera->bounds_max[i]) * 0.5f;
+		}
+	}
+
+	// After the bounds, so a camera stopped against one isn't moving.  Without
+	// the shake, which goes nowhere
+	if (dt > 0.0f) {
+		float blend = glm_min(dt * CAMERA_VELOCITY_RESPONSE, 1.0f);
+		for (int i = 0; i < 2; i++) {
+			float moved = (camera->centre[i] - camera->last_centre[i]) / dt;
+			camera->velocity[i] += (moved - camera->velocity[i]) * blend;
+		}
+	}
+	glm_vec2_copy(camera->centre, camera->last_centre);
+
+	// Smooth noise from sines which don't line up, so the shake wanders rather
+	// than jitters.  The shake can take the view a little past the bounds
+	camera->trauma = glm_max(camera->trauma - camera->shake_decay * dt, 0.0f);
+	camera->shake_time += dt;
+	float shake = camera->max_shake * camera->trauma * camera->trauma;
+	float time = camera->shake_time;
+	camera->eye[0] = camera->centre[0] + shake * (sinf(time * 37.0f) * 0.6f + sinf(time * 71.0f + 1.3f) * 0.4f);
+	camera->eye[1] = camera->centre[1] + shake * (sinf(time * 43.0f + 2.1f) * 0.6f + sinf(time * 67.0f + 0.7f) * 0.4f);
+
+	// Snap the corner (rather than the centre) as it's what lands on pixel 0
+	if (camera->pixels_per_unit > 0.0f) {
+		float pixels = camera->pixels_per_unit * camera->zoom;
+		float corner[2];
+		camera_get_corner(camera, 1.0f, corner);
+		for (int i = 0; i < 2; i++) {
+			camera->eye[i] += roundf(corner[i] * pixels) / pixels - corner[i];
+		}
+	}
+
+	glm_ortho(0.0f, camera->view_size[0], camera->view_size[1], 0.0f, camera->near_z, camera->far_z, camera->projection);
+	camera_view_affine(camera, 1.0f, &camera->view_2d);
+	affine2_to_mat4(&camera->view_2d, 0.0f, camera->view);
+	glm_mat4_mul(camera->projection, camera->view, camera->view_projection);
+	camera_visible_rect(camera, 1.0f, camera->visible);
+}
+
+void camera_view_projection(const Camera* camera, float parallax, mat4 view_projection) {
+	/*
+	 * Get the view-projection for a layer moving parallax times as far as the
+	 * camera (1 is the same as the camera's)
+	 */
+	Affine2 view_2d;
+	camera_view_affine(camera, parallax, &view_2d);
+	mat4 view;
+	affine2_to_mat4(&view_2d, 0.0f, view);
+	glm_mat4_mul((vec4*) camera->projection, view, view_projection);
+}
+
+void camera_visible_rect(const Camera* camera, float parallax, float rect[4]) {
+	/*
+	 * Get the rectangle of a layer moving parallax times as far as the camera
+	 * which is in view, as min x, min y, max x, max y
+	 */
+	camera_get_corner(camera, parallax, rect);
+	rect[2] = rect[0] + camera->view_size[0] / camera->zoom;
+	rect[3] = rect[1] + camera->view_size[1] / camera->zoom;
+}
+
+void camera_lookahead_rect(const Camera* camera, float seconds, float rect[4]) {
+	/*
+	 * Get the rectangle the view sweeps over in the next few seconds if it
+	 * keeps going at its velocity, including what's in view now, e.g. for
+	 * loading what's about to appear
+	 */
+	memcpy(rect, camera->visible, sizeof(camera->visible));
+	for (int i = 0; i < 2; i++) {
+		float ahead = camera->velocity[i] * seconds;
+		rect[i] += glm_min(ahead, 0.0f);
+		rect[i + 2] += glm_max(ahead, 0.0f);
+	}
+}
+
+bool camera_is_visible(const Camera* camera, const float rect[4]) {
+	/*
+	 * Check whether any of a rectangle (min x, min y, max x, max y) is in view
+	 */
+	return rect[2] >= camera->visible[0] && rect[0] <= camera->visible[2]
+		&& rect[3] >= camera->visible[1] && rect[1] <= camera->visible[3];
+}
+
+void camera_screen_to_world(const Camera* camera, float u, float v, float world[2]) {
+	/*
+	 * Get the point in the world under a point on the screen
+	 *
+	 * @param u How far across the screen from the left, 0 to 1
+	 * @param v How far down it from the top, 0 to 1
+	 */
+	// The view goes up the screen from the bottom left
+	const float point[2] = {u * camera->view_size[0], (1.0f - v) * camera->view_size[1]};
+	Affine2 inverse;
+	affine2_inverse(&camera->view_2d, &inverse);
+	affine2_apply(&inverse, point, world);
+}
@@ -0,0 +1,926 @@
+/*
+ * Screenshots, recordings and exports of the frames, without waiting on the GPU.
+ *
+ * capture_record() goes at the end of a frame's command buffer, and copies the
+ * image it rendered into one of CAPTURE_BUFFERS host visible readback buffers.
+ * The copy is only looked at once that frame in flight has been waited on
+ * again, when capture_retire() hands the buffer to the writer thread.  The
+ * writer converts and writes out the pixels, then frees the buffer for another
+ * frame.  Nothing on the render thread waits for the GPU or the disk: if every
+ * buffer is still in use the frame is dropped from the capture (and counted)
+ * rather than stalling the frame.
+ *
+ * The image has to be left as a transfer source by the frame graph (the final
+ * state {TRANSFER_SRC_OPTIMAL, COPY, TRANSFER_READ}), and capture_record()
+ * moves it on to where it is really wanted, e.g. for presenting.  Only 8 bit
+ * RGBA and BGRA images can be captured, which covers the swap chain formats.
+ *
+ * The readback buffers are created the first time they are needed, and again
+ * if the images get bigger, so there's no cost until something is captured.
+ *
+ * Frames can also be exported with capture_start_export(), copied on the GPU
+ * into images whose memory is exported as file descriptors (dma-bufs where the
+ * driver has them), for a hardware encoder to import.  The consumer is handed
+ * each frame as it retires and gives the image back when it's done with it.
+ */
+
+#include "capture.h"
+#include "trace.h"
+#include "vkx/vkx_memory.h"
+
+#include <SDL3/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#define CAPTURE_MAX_FILENAME 256
+
+typedef enum {
+	CAPTURE_SLOT_FREE,
+	// Copied into in a frame which may still be on the GPU
+	CAPTURE_SLOT_RECORDED,
+	// Waiting for or being written by the writer thread
+	CAPTURE_SLOT_QUEUED,
+} CaptureSlotState;
+
+typedef struct {
+	CaptureSlotState state;
+	VkxBuffer buffer;
+	VkDeviceSize capacity;
+	VkExtent2D extent;
+	bool bgra;
+	// The frame in flight it was copied in, and the order it was queued in
+	uint32_t frame;
+	uint64_t sequence;
+	// What it is for, which can be both
+	bool screenshot;
+	bool recorded;
+	char filename[CAPTURE_MAX_FILENAME];
+} CaptureSlot;
+
+static CaptureSlot slots[CAPTURE_BUFFERS] = {0};
+static SDL_Thread* writer_thread = NULL;
+
+// Protects everything below, and the slots' state
+static SDL_Mutex* capture_mutex = NULL;
+// Signalled when a slot is queued (or we are quitting)
+static SDL_Condition* queued_condition = NULL;
+// Signalled when the writer finishes with a slot
+static SDL_Condition* written_condition = NULL;
+static uint64_t next_sequence = 0;
+static bool writer_busy = false;
+static bool quitting = false;
+
+static bool screenshot_pending = false;
+static char screenshot_filename[CAPTURE_MAX_FILENAME] = {0};
+
+// Only the writer touches the file and header flag while recording, and
+// capture_stop_recording() once the writer has caught up
+static bool recording = false;
+static FILE* recording_file = NULL;
+static CaptureFormat recording_format = CAPTURE_FORMAT_RAW;
+static uint32_t recording_frame_rate = 60;
+// Fixed by the first frame, frames of any other size are dropped
+static VkExtent2D recording_extent = {0};
+static bool recording_header_written = false;
+static uint64_t recording_frames = 0;
+
+// Frames being exported, and the images they go through.  RECORDED is copied
+// into in a frame which may still be on the GPU and QUEUED is the consumer's
+typedef struct {
+	CaptureSlotState state;
+	VkImage image;
+	VkDeviceMemory memory;
+	uint32_t frame_index;
+	// What the consumer is given, with the fd exported when it was created
+	CaptureExportFrame frame;
+} CaptureExportImage;
+
+static CaptureExportImage export_images[CAPTURE_EXPORT_IMAGES] = {0};
+static bool exporting = false;
+static CaptureExportFunc export_func = NULL;
+static void* export_data = NULL;
+static VkFormat export_format = VK_FORMAT_UNDEFINED;
+static VkExtent2D export_extent = {0};
+static uint64_t export_frames_count = 0;
+
+static CaptureStats stats = {0};
+
+static void capture_to_rgb(const CaptureSlot* slot, uint8_t* rgb, uint32_t channels) {
+	/*
+	 * Convert a slot's pixels to tightly packed RGB (3 channels) or RGBA (4)
+	 */
+	const uint8_t* pixels = slot->buffer.allocation.mapped;
+	size_t pixels_count = (size_t) slot->extent.width * slot->extent.height;
+	uint32_t red = slot->bgra ? 2 : 0;
+	uint32_t blue = slot->bgra ? 0 : 2;
+
+	for (size_t i = 0; i < pixels_count; i++) {
+		rgb[i * channels + 0] = pixels[i * 4 + red];
+		rgb[i * channels + 1] = pixels[i * 4 + 1];
+		rgb[i * channels + 2] = pixels[i * 4 + blue];
+		if (channels == 4) {
+			rgb[i * channels + 3] = pixels[i * 4 + 3];
+		}
+	}
+}
+
+static void capture_to_yuv(const CaptureSlot* slot, uint8_t* yuv) {
+	/*
+	 * Convert a slot's pixels to the Y, U and V planes of a 4:4:4 frame, with
+	 * limited range BT.601 as YUV4MPEG2 expects.  The pixels are already sRGB
+	 * encoded, which is what the video formats want
+	 */
+	const uint8_t* pixels = slot->buffer.allocation.mapped;
+	size_t pixels_count = (size_t) slot->extent.width * slot->extent.height;
+	uint8_t* y_plane = yuv;
+	uint8_t* u_plane = yuv + pixels_count;
+	uint8_t* v_plane = yuv + pixels_count * 2;
+	uint32_t red = slot->bgra ? 2 : 0;
+	uint32_t blue = slot->bgra ? 0 : 2;
+
+	for (size_t i = 0; i < pixels_count; i++) {
+		int r = pixels[i * 4 + red];
+		int g = pixels[i * 4 + 1];
+		int b = pixels[i * 4 + blue];
+		y_plane[i] = (uint8_t) (16 + ((66 * r + 129 * g + 25 * b + 128) >> 8));
+		u_plane[i] = (uint8_t) (128 + ((-38 * r - 74 * g + 112 * b + 128) >> 8));
+		v_plane[i] = (uint8_t) (128 + ((112 * r - 94 * g - 18 * b + 128) >> 8));
+	}
+}
+
+static void capture_write_slot(const CaptureSlot* slot, uint8_t** scratch, size_t* scratch_size) {
+	/*
+	 * Write out a slot on the writer thread, as a screenshot and/or the next
+	 * frame of the recording
+	 *
+	 * @param scratch The writer's buffer for converting the pixels, which is
+	 *        grown to fit
+	 */
+	size_t pixels_count = (size_t) slot->extent.width * slot->extent.height;
+	if (*scratch_size < pixels_count * 4) {
+		free(*scratch);
+		*scratch_size = pixels_count * 4;
+		*scratch = malloc(*scratch_size);
+		if (*scratch == NULL) {
+			fprintf(stderr, "Failed to allocate %zu bytes for converting a capture\n", *scratch_size);
+			exit(1);
+		}
+	}
+
+	if (slot->screenshot) {
+		FILE* file = fopen(slot->filename, "wb");
+		if (file == NULL) {
+			fprintf(stderr, "Failed to open %s for writing\n", slot->filename);
+		}
+		else {
+			capture_to_rgb(slot, *scratch, 3);
+			fprintf(file, "P6\n%u %u\n255\n", slot->extent.width, slot->extent.height);
+			fwrite(*scratch, 1, pixels_count * 3, file);
+			if (ferror(file) || fclose(file) != 0) {
+				fprintf(stderr, "Failed to write %s\n", slot->filename);
+			}
+			else {
+				printf("Wrote a screenshot to %s\n", slot->filename);
+			}
+		}
+	}
+
+	if (slot->recorded) {
+		if (recording_format == CAPTURE_FORMAT_Y4M) {
+			if (!recording_header_written) {
+				fprintf(recording_file, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C444\n",
+						slot->extent.width, slot->extent.height, recording_frame_rate);
+				recording_header_written = true;
+			}
+			capture_to_yuv(slot, *scratch);
+			fprintf(recording_file, "FRAME\n");
+			fwrite(*scratch, 1, pixels_count * 3, recording_file);
+		}
+		else if (recording_format == CAPTURE_FORMAT_RAW) {
+			capture_to_rgb(slot, *scratch, 4);
+			fwrite(*scratch, 1, pixels_count * 4, recording_file);
+		}
+		else {
+			capture_to_rgb(slot, *scratch, 3);
+			fprintf(recording_file, "P6\n%u %u\n255\n", slot->extent.width, slot->extent.height);
+			fwrite(*scratch, 1, pixels_count * 3, recording_file);
+		}
+		recording_frames++;
+	}
+}
+
+static int capture_writer_main(void* data) {
+	(void) data;
+
+	trace_set_thread_name("capture");
+
+	uint8_t* scratch = NULL;
+	size_t scratch_size = 0;
+
+	SDL_LockMutex(capture_mutex);
+	for (;;) {
+		// The oldest queued slot, so the recording's frames stay in order
+		CaptureSlot* slot = NULL;
+		while (slot == NULL) {
+			for (uint32_t i = 0; i < CAPTURE_BUFFERS; i++) {
+				if (slots[i].state == CAPTURE_SLOT_QUEUED && (slot == NULL || slots[i].sequence < slot->sequence)) {
+					slot = &slots[i];
+				}
+			}
+
+			if (slot == NULL) {
+				if (quitting) {
+					break;
+				}
+				SDL_WaitCondition(queued_condition, capture_mutex);
+			}
+		}
+
+		// Everything queued is written before quitting
+		if (slot == NULL) {
+			break;
+		}
+
+		writer_busy = true;
+		SDL_UnlockMutex(capture_mutex);
+
+		trace_begin("write capture");
+		capture_write_slot(slot, &scratch, &scratch_size);
+		trace_end();
+
+		SDL_LockMutex(capture_mutex);
+		slot->state = CAPTURE_SLOT_FREE;
+		writer_busy = false;
+		stats.frames_written++;
+		SDL_BroadcastCondition(written_condition);
+	}
+	SDL_UnlockMutex(capture_mutex);
+
+	free(scratch);
+	return 0;
+}
+
+void capture_init(void) {
+	/*
+	 * Start the writer thread
+	 */
+	memset(slots, 0, sizeof(slots));
+	memset(&stats, 0, sizeof(stats));
+	next_sequence = 0;
+	writer_busy = false;
+	quitting = false;
+	screenshot_pending = false;
+	recording = false;
+
+	capture_mutex = SDL_CreateMutex();
+	queued_condition = SDL_CreateCondition();
+	written_condition = SDL_CreateCondition();
+	if (capture_mutex == NULL || queued_condition == NULL || written_condition == NULL) {
+		fprintf(stderr, "Failed to create the capture synchronisation primitives: %s\n", SDL_GetError());
+		exit(1);
+	}
+
+	writer_thread = SDL_CreateThread(capture_writer_main, "capture", NULL);
+	if (writer_thread == NULL) {
+		fprintf(stderr, "Failed to create the capture thread: %s\n", SDL_GetError());
+		exit(1);
+	}
+}
+
+void capture_cleanup(void) {
+	/*
+	 * Finish writing whatever has been retired, then stop the writer and
+	 * destroy the readback buffers.  The device must be idle
+	 */
+	capture_stop_recording();
+	capture_stop_export();
+
+	SDL_LockMutex(capture_mutex);
+	quitting = true;
+	SDL_BroadcastCondition(queued_condition);
+	SDL_UnlockMutex(capture_mutex);
+
+	SDL_WaitThread(writer_thread, NULL);
+	writer_thread = NULL;
+
+	for (uint32_t i = 0; i < CAPTURE_BUFFERS; i++) {
+		if (slots[i].capacity > 0) {
+			vkx_cleanup_buffer(&slots[i].buffer);
+		}
+	}
+	memset(slots, 0, sizeof(slots));
+
+	SDL_DestroyCondition(written_condition);
+	SDL_DestroyCondition(queued_condition);
+	SDL_DestroyMutex(capture_mutex);
+	written_condition = NULL;
+	queued_condition = NULL;
+	capture_mutex = NULL;
+}
+
+void capture_screenshot(const char* filename) {
+	/*
+	 * Write the next frame recorded to a PPM file
+	 */
+	SDL_LockMutex(capture_mutex);
+	snprintf(screenshot_filename, sizeof(screenshot_filename), "%s", filename);
+	screenshot_pending = true;
+	SDL_UnlockMutex(capture_mutex);
+}
+
+bool capture_start_recording(const char* filename, CaptureFormat format, uint32_t frame_rate) {
+	/*
+	 * Write every frame recorded from now on to a file, stopping any recording
+	 * there already is
+	 *
+	 * @param frame_rate Written in the Y4M header, the frames are whatever
+	 *        rate they were rendered at
+	 *
+	 * @return false if the file can't be opened
+	 */
+	capture_stop_recording();
+
+	FILE* file = fopen(filename, "wb");
+	if (file == NULL) {
+		fprintf(stderr, "Failed to open %s for recording\n", filename);
+		return false;
+	}
+
+	SDL_LockMutex(capture_mutex);
+	recording_file = file;
+	recording_format = format;
+	recording_frame_rate = frame_rate > 0 ? frame_rate : 60;
+	recording_extent.width = 0;
+	recording_extent.height = 0;
+	recording_header_written = false;
+	recording_frames = 0;
+	recording = true;
+	SDL_UnlockMutex(capture_mutex);
+
+	printf("Recording to %s\n", filename);
+	return true;
+}
+
+void capture_stop_recording(void) {
+	/*
+	 * Stop recording and close the file once the writer has caught up.  The
+	 * frames still on the GPU are left out, as waiting for them would stall
+	 */
+	SDL_LockMutex(capture_mutex);
+	if (recording_file == NULL) {
+		SDL_UnlockMutex(capture_mutex);
+		return;
+	}
+	recording = false;
+
+	for (;;) {
+		bool queued = writer_busy;
+		for (uint32_t i = 0; i < CAPTURE_BUFFERS; i++) {
+			queued = queued || (slots[i].state == CAPTURE_SLOT_QUEUED && slots[i].recorded);
+		}
+		if (!queued) {
+			break;
+		}
+		SDL_WaitCondition(written_condition, capture_mutex);
+	}
+
+	if (ferror(recording_file) || fclose(recording_file) != 0) {
+		fprintf(stderr, "Failed to write the recording\n");
+	}
+	recording_file = NULL;
+
+	printf("Recorded %llu frames (%llu dropped so far)\n", (unsigned long long) recording_frames,
+			(unsigned long long) stats.frames_dropped);
+	SDL_UnlockMutex(capture_mutex);
+}
+
+bool capture_is_recording(void) {
+	SDL_LockMutex(capture_mutex);
+	bool result = recording;
+	SDL_UnlockMutex(capture_mutex);
+	return result;
+}
+
+bool capture_is_wanted(void) {
+	/*
+	 * Whether the next frame recorded will be copied, for a screenshot, the
+	 * recording or exporting
+	 */
+	SDL_LockMutex(capture_mutex);
+	bool result = screenshot_pending || recording || exporting;
+	SDL_UnlockMutex(capture_mutex);
+	return result;
+}
+
+static bool capture_export_format_supported(VkFormat format, VkImageTiling tiling, VkExternalMemoryHandleTypeFlagBits handle_type) {
+	/*
+	 * Check images of a format can be created with memory to export
+	 */
+	VkPhysicalDeviceExternalImageFormatInfo external_info = {0};
+	external_info.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_IMAGE_FORMAT_INFO;
+	external_info.handleType = handle_type;
+
+	VkPhysicalDeviceImageFormatInfo2 format_info = {0};
+	format_info.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_FORMAT_INFO_2;
+	format_info.pNext = &external_info;
+	format_info.format = format;
+	format_info.type = VK_IMAGE_TYPE_2D;
+	format_info.tiling = tiling;
+	format_info.usage = CAPTURE_EXPORT_USAGE;
+
+	VkExternalImageFormatProperties external_properties = {0};
+	external_properties.sType = VK_STRUCTURE_TYPE_EXTERNAL_IMAGE_FORMAT_PROPERTIES;
+
+	VkImageFormatProperties2 format_properties = {0};
+	format_properties.sType = VK_STRUCTURE_TYPE_IMAGE_FORMAT_PROPERTIES_2;
+	format_properties.pNext = &external_properties;
+
+	if (vkGetPhysicalDeviceImageFormatProperties2(vkx_instance.physical_device, &format_info, &format_properties) != VK_SUCCESS) {
+		return false;
+	}
+
+	VkExternalMemoryFeatureFlags features = external_properties.externalMemoryProperties.externalMemoryFeatures;
+	return (features & VK_EXTERNAL_MEMORY_FEATURE_EXPORTABLE_BIT) != 0;
+}
+
+bool capture_can_export(void) {
+	/*
+	 * Whether frames can be exported at all, which needs VK_KHR_external_memory_fd
+	 */
+	return vkx_instance.has_external_memory_fd;
+}
+
+static void capture_destroy_export_images(void) {
+	for (uint32_t i = 0; i < CAPTURE_EXPORT_IMAGES; i++) {
+		CaptureExportImage* export_image = &export_images[i];
+		if (export_image->image == VK_NULL_HANDLE) {
+			continue;
+		}
+
+#ifndef _WIN32
+		close(export_image->frame.fd);
+#endif
+		vkDestroyImage(vkx_instance.device, export_image->image, vkx_get_allocator(VK_OBJECT_TYPE_IMAGE));
+		vkFreeMemory(vkx_instance.device, export_image->memory, vkx_get_allocator(VK_OBJECT_TYPE_DEVICE_MEMORY));
+	}
+	memset(export_images, 0, sizeof(export_images));
+}
+
+bool capture_start_export(VkFormat format, VkExtent2D extent, CaptureExportFunc func, void* data) {
+	/*
+	 * Export every frame recorded from now on, by copying it into one of
+	 * CAPTURE_EXPORT_IMAGES images whose memory can be imported elsewhere.
+	 * The images are dma-bufs if the device can export them, so they can go
+	 * to e.g. VA-API, or opaque fds for Vulkan (or CUDA for NVENC) otherwise.
+	 * Nothing goes through the CPU.  Frames of any other size or format are
+	 * dropped, as are frames when the consumer has every image
+	 *
+	 * @param func Given each frame, which then belongs to the consumer until it
+	 *        calls capture_release_export()
+	 *
+	 * @return false if the images can't be exported
+	 */
+	capture_stop_export();
+
+	if (!vkx_instance.has_external_memory_fd) {
+		fprintf(stderr, "Frames can't be exported without VK_KHR_external_memory_fd\n");
+		return false;
+	}
+
+	// dma-bufs of linear images can be read by anything, the layout of
+	// optimal ones is only known to the same driver
+	bool dma_buf = vkx_instance.has_external_memory_dma_buf
+		&& capture_export_format_supported(format, VK_IMAGE_TILING_LINEAR, VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT);
+	if (!dma_buf && !capture_export_format_supported(format, VK_IMAGE_TILING_OPTIMAL, VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT)) {
+		fprintf(stderr, "Images in format %d can't be exported\n", format);
+		return false;
+	}
+	VkExternalMemoryHandleTypeFlagBits handle_type = dma_buf ? VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT : VK_EXTERNAL_MEMORY_HANDLE_TYPE_OPAQUE_FD_BIT;
+
+	PFN_vkGetMemoryFdKHR get_memory_fd = (PFN_vkGetMemoryFdKHR) vkGetDeviceProcAddr(vkx_instance.device, "vkGetMemoryFdKHR");
+	if (get_memory_fd == NULL) {
+		fprintf(stderr, "failed to load vkGetMemoryFdKHR!\n");
+		exit(1);
+	}
+
+	for (uint32_t i = 0; i < CAPTURE_EXPORT_IMAGES; i++) {
+		CaptureExportImage* export_image = &export_images[i];
+
+		VkExternalMemoryImageCreateInfo external_info = {0};
+		external_info.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO;
+		external_info.handleTypes = handle_type;
+
+		VkImageCreateInfo image_info = {0};
+		image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		image_info.pNext = &external_info;
+		image_info.imageType = VK_IMAGE_TYPE_2D;
+		image_info.format = format;
+		image_info.extent.width = extent.width;
+		image_info.extent.height = extent.height;
+		image_info.extent.depth = 1;
+		image_info.mipLevels = 1;
+		image_info.arrayLayers = 1;
+		image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+		image_info.tiling = dma_buf ? VK_IMAGE_TILING_LINEAR : VK_IMAGE_TILING_OPTIMAL;
+		image_info.usage = CAPTURE_EXPORT_USAGE;
+		image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+		if (vkCreateImage(vkx_instance.device, &image_info, vkx_get_allocator(VK_OBJECT_TYPE_IMAGE), &export_image->image) != VK_SUCCESS) {
+			fprintf(stderr, "failed to create an export image!\n");
+			exit(1);
+		}
+
+		// Exported memory is allocated on its own rather than from the
+		// allocator's blocks, as the fd is for the whole allocation.  It is
+		// always dedicated, which some importers want even if the device
+		// doesn't need it
+		VkMemoryRequirements requirements;
+		vkGetImageMemoryRequirements(vkx_instance.device, export_image->image, &requirements);
+
+		VkMemoryDedicatedAllocateInfo dedicated_info = {0};
+		dedicated_info.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+		dedicated_info.image = export_image->image;
+
+		VkExportMemoryAllocateInfo export_info = {0};
+		export_info.sType = VK_STRUCTURE_TYPE_EXPORT_MEMORY_ALLOCATE_INFO;
+		export_info.pNext = &dedicated_info;
+		export_info.handleTypes = handle_type;
+
+		VkMemoryPropertyFlags properties = vkx_memory_has_type(requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+			? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT : 0;
+
+		VkMemoryAllocateInfo allocate_info = {0};
+		allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocate_info.pNext = &export_info;
+		allocate_info.allocationSize = requirements.size;
+		allocate_info.memoryTypeIndex = vkx_find_memory_type(requirements.memoryTypeBits, properties);
+
+		if (vkAllocateMemory(vkx_instance.device, &allocate_info, vkx_get_allocator(VK_OBJECT_TYPE_DEVICE_MEMORY), &export_image->memory) != VK_SUCCESS) {
+			fprintf(stderr, "failed to allocate export image memory!\n");
+			exit(1);
+		}
+		vkBindImageMemory(vkx_instance.device, export_image->image, export_image->memory, 0);
+
+		VkMemoryGetFdInfoKHR fd_info = {0};
+		fd_info.sType = VK_STRUCTURE_TYPE_MEMORY_GET_FD_INFO_KHR;
+		fd_info.memory = export_image->memory;
+		fd_info.handleType = handle_type;
+
+		int fd = -1;
+		if (get_memory_fd(vkx_instance.device, &fd_info, &fd) != VK_SUCCESS) {
+			fprintf(stderr, "failed to export the memory of an export image!\n");
+			exit(1);
+		}
+
+		CaptureExportFrame* frame = &export_image->frame;
+		memset(frame, 0, sizeof(CaptureExportFrame));
+		frame->index = i;
+		frame->fd = fd;
+		frame->dma_buf = dma_buf;
+		frame->memory_size = requirements.size;
+		frame->format = format;
+		frame->extent = extent;
+
+		if (dma_buf) {
+			VkImageSubresource subresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0};
+			VkSubresourceLayout layout;
+			vkGetImageSubresourceLayout(vkx_instance.device, export_image->image, &subresource, &layout);
+			frame->offset = layout.offset;
+			frame->row_pitch = layout.rowPitch;
+		}
+
+		export_image->state = CAPTURE_SLOT_FREE;
+	}
+
+	SDL_LockMutex(capture_mutex);
+	export_func = func;
+	export_data = data;
+	export_format = format;
+	export_extent = extent;
+	export_frames_count = 0;
+	exporting = true;
+	SDL_UnlockMutex(capture_mutex);
+
+	printf("Exporting %ux%u frames as %s\n", extent.width, extent.height, dma_buf ? "dma-bufs" : "opaque fds");
+	return true;
+}
+
+void capture_stop_export(void) {
+	/*
+	 * Stop exporting frames and destroy the export images.  The GPU must be
+	 * done with the frames recorded (e.g. after vkDeviceWaitIdle()), and the
+	 * consumer with the images
+	 */
+	SDL_LockMutex(capture_mutex);
+	bool was_exporting = exporting;
+	exporting = false;
+	export_func = NULL;
+	export_data = NULL;
+	SDL_UnlockMutex(capture_mutex);
+
+	if (was_exporting) {
+		capture_destroy_export_images();
+		printf("Exported %llu frames\n", (unsigned long long) export_frames_count);
+	}
+}
+
+void capture_release_export(uint32_t index) {
+	/*
+	 * Give an exported frame's image back, once the consumer has finished
+	 * reading it.  Can be called from any thread
+	 */
+	SDL_LockMutex(capture_mutex);
+	if (index < CAPTURE_EXPORT_IMAGES && export_images[index].state == CAPTURE_SLOT_QUEUED) {
+		export_images[index].state = CAPTURE_SLOT_FREE;
+	}
+	SDL_UnlockMutex(capture_mutex);
+}
+
+static void capture_barriers(VkCommandBuffer command_buffer, VkImage image, VkxFrameGraphState final,
+		VkBuffer buffer, VkImage export_image) {
+	/*
+	 * Move the image from being a transfer source to its final state, make the
+	 * copy into the buffer (if there is one) visible to the host, and hand the
+	 * export image (if there is one) over to whatever imports it
+	 */
+	VkImageMemoryBarrier2 image_barriers[2] = {0};
+	uint32_t image_barriers_count = 0;
+
+	if (final.layout != VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL) {
+		VkImageMemoryBarrier2* barrier = &image_barriers[image_barriers_count++];
+		barrier->sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+		// Blitted from for other windows too
+		barrier->srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_BLIT_BIT;
+		barrier->srcAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT;
+		barrier->dstStageMask = final.stages;
+		barrier->dstAccessMask = final.access;
+		barrier->oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier->newLayout = final.layout;
+		barrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier->image = image;
+		barrier->subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier->subresourceRange.levelCount = 1;
+		barrier->subresourceRange.layerCount = 1;
+	}
+
+	// Released to the external queue family in the general layout, the
+	// importer acquires it
+	if (export_image != VK_NULL_HANDLE) {
+		VkImageMemoryBarrier2 barrier = {0};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+		barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+		barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.image = export_image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.layerCount = 1;
+		image_barriers[image_barriers_count++] = vkx_image_ownership_release(barrier,
+				vkx_instance.graphics_queue_family, VK_QUEUE_FAMILY_EXTERNAL);
+	}
+
+	VkBufferMemoryBarrier2 buffer_barrier = {0};
+	buffer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+	buffer_barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	buffer_barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	buffer_barrier.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT;
+	buffer_barrier.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT;
+	buffer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	buffer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	buffer_barrier.buffer = buffer;
+	buffer_barrier.size = VK_WHOLE_SIZE;
+
+	VkDependencyInfo dependency_info = {0};
+	dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dependency_info.imageMemoryBarrierCount = image_barriers_count;
+	dependency_info.pImageMemoryBarriers = image_barriers;
+	if (buffer != VK_NULL_HANDLE) {
+		dependency_info.bufferMemoryBarrierCount = 1;
+		dependency_info.pBufferMemoryBarriers = &buffer_barrier;
+	}
+
+	if (dependency_info.imageMemoryBarrierCount > 0 || dependency_info.bufferMemoryBarrierCount > 0) {
+		vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+	}
+}
+
+static CaptureSlot* capture_take_slot(VkFormat format, VkExtent2D extent) {
+	/*
+	 * Take a readback buffer for the screenshot and/or the recording, if
+	 * either wants this frame.  The lock must be held
+	 */
+	bool bgra = format == VK_FORMAT_B8G8R8A8_UNORM || format == VK_FORMAT_B8G8R8A8_SRGB;
+	bool rgba = format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_R8G8B8A8_SRGB;
+	if (!screenshot_pending && !recording) {
+		return NULL;
+	}
+
+	bool record = recording && (bgra || rgba);
+	if (record && recording_extent.width == 0) {
+		recording_extent = extent;
+	}
+	record = record && recording_extent.width == extent.width && recording_extent.height == extent.height;
+
+	CaptureSlot* slot = NULL;
+	for (uint32_t i = 0; i < CAPTURE_BUFFERS && slot == NULL; i++) {
+		if (slots[i].state == CAPTURE_SLOT_FREE) {
+			slot = &slots[i];
+		}
+	}
+
+	// Screenshots are tried again next frame
+	bool screenshot = screenshot_pending && (bgra || rgba) && slot != NULL;
+	if (recording && (!record || slot == NULL)) {
+		stats.frames_dropped++;
+	}
+	if (screenshot_pending && !bgra && !rgba) {
+		fprintf(stderr, "Can't capture images in format %d\n", format);
+		screenshot_pending = false;
+	}
+	if (slot == NULL || (!screenshot && !record)) {
+		return NULL;
+	}
+
+	slot->state = CAPTURE_SLOT_RECORDED;
+	slot->extent = extent;
+	slot->bgra = bgra;
+	slot->screenshot = screenshot;
+	slot->recorded = record;
+	if (screenshot) {
+		memcpy(slot->filename, screenshot_filename, sizeof(slot->filename));
+		screenshot_pending = false;
+	}
+	return slot;
+}
+
+static CaptureExportImage* capture_take_export_image(VkFormat format, VkExtent2D extent) {
+	/*
+	 * Take a free export image, if exporting.  The lock must be held
+	 */
+	if (!exporting) {
+		return NULL;
+	}
+
+	if (format == export_format && extent.width == export_extent.width && extent.height == export_extent.height) {
+		for (uint32_t i = 0; i < CAPTURE_EXPORT_IMAGES; i++) {
+			if (export_images[i].state == CAPTURE_SLOT_FREE) {
+				export_images[i].state = CAPTURE_SLOT_RECORDED;
+				return &export_images[i];
+			}
+		}
+	}
+
+	stats.frames_dropped++;
+	return NULL;
+}
+
+void capture_record(VkCommandBuffer command_buffer, uint32_t frame, VkImage image, VkFormat format,
+		VkExtent2D extent, VkxFrameGraphState final) {
+	/*
+	 * Copy a frame's image into a readback buffer and/or an export image if it
+	 * is wanted, and leave the image in its final state either way.  Goes
+	 * after everything else touching the image in the command buffer
+	 *
+	 * @param frame The frame in flight, which capture_retire() is called with
+	 *        once it has been waited on
+	 * @param image In VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, after a barrier
+	 *        to the copy stage
+	 * @param final Layout to leave the image in, and the stages and accesses
+	 *        which use it next
+	 */
+	SDL_LockMutex(capture_mutex);
+	CaptureSlot* slot = capture_take_slot(format, extent);
+	CaptureExportImage* export_image = capture_take_export_image(format, extent);
+	if (slot != NULL) {
+		slot->frame = frame;
+	}
+	if (export_image != NULL) {
+		export_image->frame_index = frame;
+	}
+	SDL_UnlockMutex(capture_mutex);
+
+	VkImageSubresourceLayers subresource = {0};
+	subresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	subresource.layerCount = 1;
+
+	if (slot != NULL) {
+		// Only this thread touches free and recorded slots, so the buffer can
+		// be made without holding the lock
+		VkDeviceSize size = (VkDeviceSize) extent.width * extent.height * 4;
+		if (slot->capacity < size) {
+			if (slot->capacity > 0) {
+				vkx_cleanup_buffer(&slot->buffer);
+			}
+
+			// Cached memory if there is any, as the writer reads every pixel
+			VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+			if (vkx_memory_has_type(UINT32_MAX, properties | VK_MEMORY_PROPERTY_HOST_CACHED_BIT)) {
+				properties |= VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+			}
+			VkxMemoryTag previous_tag = vkx_memory_set_tag(VKX_MEMORY_TAG_STAGING);
+			slot->buffer = vkx_create_buffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, properties);
+			vkx_memory_set_tag(previous_tag);
+			slot->capacity = size;
+		}
+
+		VkBufferImageCopy region = {0};
+		region.imageSubresource = subresource;
+		region.imageExtent.width = extent.width;
+		region.imageExtent.height = extent.height;
+		region.imageExtent.depth = 1;
+
+		vkCmdCopyImageToBuffer(command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot->buffer.buffer, 1, &region);
+	}
+
+	if (export_image != NULL) {
+		// The old contents don't matter, so it can come from undefined
+		// without acquiring it back from the importer
+		VkxBarrierBatch barriers;
+		vkx_barrier_batch_begin(&barriers, command_buffer);
+		vkx_barrier_batch_add_image(&barriers, export_image->image, format, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+		vkx_barrier_batch_flush(&barriers);
+
+		VkImageCopy region = {0};
+		region.srcSubresource = subresource;
+		region.dstSubresource = subresource;
+		region.extent.width = extent.width;
+		region.extent.height = extent.height;
+		region.extent.depth = 1;
+
+		vkCmdCopyImage(command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				export_image->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+	}
+
+	capture_barriers(command_buffer, image, final, slot != NULL ? slot->buffer.buffer : VK_NULL_HANDLE,
+			export_image != NULL ? export_image->image : VK_NULL_HANDLE);
+}
+
+void capture_retire(uint32_t frame) {
+	/*
+	 * Hand the copies made in a frame in flight to the writer, and the exported
+	 * frames to the consumer, once the frame has been waited on
+	 */
+	CaptureExportFrame exported[CAPTURE_EXPORT_IMAGES];
+	uint32_t exported_count = 0;
+	CaptureExportFunc func = NULL;
+	void* data = NULL;
+
+	SDL_LockMutex(capture_mutex);
+	bool queued = false;
+	for (uint32_t i = 0; i < CAPTURE_BUFFERS; i++) {
+		CaptureSlot* slot = &slots[i];
+		if (slot->state != CAPTURE_SLOT_RECORDED || slot->frame != frame) {
+			continue;
+		}
+
+		// The recording stopped while the frame was on the GPU
+		slot->recorded = slot->recorded && recording;
+		if (!slot->screenshot && !slot->recorded) {
+			slot->state = CAPTURE_SLOT_FREE;
+			continue;
+		}
+
+		slot->state = CAPTURE_SLOT_QUEUED;
+		slot->sequence = next_sequence++;
+		queued = true;
+	}
+
+	if (queued) {
+		SDL_SignalCondition(queued_condition);
+	}
+
+	for (uint32_t i = 0; i < CAPTURE_EXPORT_IMAGES && exporting; i++) {
+		CaptureExportImage* export_image = &export_images[i];
+		if (export_image->state != CAPTURE_SLOT_RECORDED || export_image->frame_index != frame) {
+			continue;
+		}
+
+		export_image->state = CAPTURE_SLOT_QUEUED;
+		export_image->frame.frame_number = ++export_frames_count;
+		exported[exported_count++] = export_image->frame;
+	}
+	func = export_func;
+	data = export_data;
+	SDL_UnlockMutex(capture_mutex);
+
+	// Outside the lock, as the consumer may release frames straight away
+	for (uint32_t i = 0; i < exported_count; i++) {
+		func(&exported[i], data);
+	}
+}
+
+CaptureStats capture_get_stats(void) {
+	SDL_LockMutex(capture_mutex);
+	CaptureStats result = stats;
+	SDL_UnlockMutex(capture_mutex);
+	return result;
+}
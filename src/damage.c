@@ -0,0 +1,176 @@
+/*
+ * Damage tracking, for only drawing the part of the picture which changed.
+ *
+ * Whatever moves or changes adds the world rectangles it was and is drawn in
+ * to the frame's Damage, which is kept as the one rectangle around all of
+ * them.  That's turned into pixels with the camera it's drawn with, and the
+ * pixels go into a DamageHistory.  An image which was last drawn n frames ago
+ * (e.g. one of the copies of an offscreen image, one per frame in flight)
+ * needs everything which changed in the n frames since, plus this one, drawn
+ * again, which is what damage_history_get() gives.
+ *
+ * One rectangle covers more than a list of them would, but the whole of it
+ * can go in a single scissor and render area.
+ */
+
+#include "damage.h"
+
+#include <math.h>
+#include <string.h>
+
+void damage_clear(Damage* damage) {
+	memset(damage, 0, sizeof(Damage));
+}
+
+void damage_add_everything(Damage* damage) {
+	/*
+	 * Draw all of the picture again, e.g. when the camera moves
+	 */
+	damage->full = true;
+}
+
+void damage_add_rect(Damage* damage, const float rect[4]) {
+	/*
+	 * Add a world rectangle which changed, as min x, min y, max x, max y
+	 */
+	if (!damage->changed) {
+		memcpy(damage->rect, rect, sizeof(damage->rect));
+		damage->changed = true;
+		return;
+	}
+
+	damage->rect[0] = fminf(damage->rect[0], rect[0]);
+	damage->rect[1] = fminf(damage->rect[1], rect[1]);
+	damage->rect[2] = fmaxf(damage->rect[2], rect[2]);
+	damage->rect[3] = fmaxf(damage->rect[3], rect[3]);
+}
+
+void damage_add_sprite(Damage* damage, const float pos[2], float radius) {
+	/*
+	 * Add a sprite which changed where it is
+	 *
+	 * @param pos The sprite's centre
+	 * @param radius How far from the centre it can draw, with room for its
+	 *               rotation and animation
+	 */
+	const float rect[4] = {pos[0] - radius, pos[1] - radius, pos[0] + radius, pos[1] + radius};
+	damage_add_rect(damage, rect);
+}
+
+void damage_add_moving_sprite(Damage* damage, const float from[2], const float to[2], float radius) {
+	/*
+	 * Add a sprite which is somewhere between two places, e.g. interpolated
+	 * between two steps of the simulation
+	 */
+	const float rect[4] = {
+		fminf(from[0], to[0]) - radius,
+		fminf(from[1], to[1]) - radius,
+		fmaxf(from[0], to[0]) + radius,
+		fmaxf(from[1], to[1]) + radius
+	};
+	damage_add_rect(damage, rect);
+}
+
+void damage_get_pixels(const Damage* damage, mat4 view_projection, uint32_t width, uint32_t height, int32_t pixels[4]) {
+	/*
+	 * Get the pixels the damage covers when drawn with a camera, rounded out
+	 * and with a pixel more for the filtering along the edges
+	 *
+	 * @param view_projection The camera's, whose clip space covers the pixels
+	 * @param width, height The size of the picture in pixels
+	 * @param pixels Set to min x, min y, max x, max y (exclusive), empty if
+	 *               nothing changed
+	 */
+	if (damage->full) {
+		pixels[0] = 0;
+		pixels[1] = 0;
+		pixels[2] = (int32_t) width;
+		pixels[3] = (int32_t) height;
+		return;
+	}
+
+	memset(pixels, 0, sizeof(int32_t) * 4);
+	if (!damage->changed) {
+		return;
+	}
+
+	// The corners could swap over if the projection flips an axis
+	vec4 corners[2] = {
+		{damage->rect[0], damage->rect[1], 0.0f, 1.0f},
+		{damage->rect[2], damage->rect[3], 0.0f, 1.0f}
+	};
+	float x[2];
+	float y[2];
+	for (int i = 0; i < 2; i++) {
+		vec4 clip;
+		glm_mat4_mulv(view_projection, corners[i], clip);
+		x[i] = (clip[0] / clip[3] * 0.5f + 0.5f) * (float) width;
+		y[i] = (clip[1] / clip[3] * 0.5f + 0.5f) * (float) height;
+	}
+
+	float min_x = floorf(fminf(x[0], x[1])) - 1.0f;
+	float min_y = floorf(fminf(y[0], y[1])) - 1.0f;
+	float max_x = ceilf(fmaxf(x[0], x[1])) + 1.0f;
+	float max_y = ceilf(fmaxf(y[0], y[1])) + 1.0f;
+
+	pixels[0] = (int32_t) glm_clamp(min_x, 0.0f, (float) width);
+	pixels[1] = (int32_t) glm_clamp(min_y, 0.0f, (float) height);
+	pixels[2] = (int32_t) glm_clamp(max_x, 0.0f, (float) width);
+	pixels[3] = (int32_t) glm_clamp(max_y, 0.0f, (float) height);
+}
+
+void damage_history_push(DamageHistory* history, const int32_t pixels[4]) {
+	/*
+	 * Remember the pixels a frame changed
+	 */
+	memcpy(history->pixels[history->next], pixels, sizeof(history->pixels[0]));
+	history->next = (history->next + 1) % DAMAGE_MAX_HISTORY;
+}
+
+void damage_history_get(const DamageHistory* history, uint32_t frames, int32_t pixels[4]) {
+	/*
+	 * Get the pixels which changed in the last few frames, as one rectangle
+	 *
+	 * @param frames How many, up to DAMAGE_MAX_HISTORY
+	 * @param pixels Set to min x, min y, max x, max y (exclusive), empty if
+	 *               nothing changed
+	 */
+	memset(pixels, 0, sizeof(int32_t) * 4);
+	bool any = false;
+
+	for (uint32_t i = 0; i < frames && i < DAMAGE_MAX_HISTORY; i++) {
+		const int32_t* frame = history->pixels[(history->next + DAMAGE_MAX_HISTORY - 1 - i) % DAMAGE_MAX_HISTORY];
+		if (frame[2] <= frame[0] || frame[3] <= frame[1]) {
+			continue;
+		}
+
+		if (!any) {
+			memcpy(pixels, frame, sizeof(int32_t) * 4);
+			any = true;
+			continue;
+		}
+		pixels[0] = frame[0] < pixels[0] ? frame[0] : pixels[0];
+		pixels[1] = frame[1] < pixels[1] ? frame[1] : pixels[1];
+		pixels[2] = frame[2] > pixels[2] ? frame[2] : pixels[2];
+		pixels[3] = frame[3] > pixels[3] ? frame[3] : pixels[3];
+	}
+}
+
+uint64_t damage_hash(const void* data, size_t size) {
+	/*
+	 * Hash something which is drawn, to tell whether it changed.  The hashes
+	 * of a set of things can be added up to get the same for the set in any
+	 * order
+	 */
+	const uint8_t* bytes = data;
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+	}
+
+	// Mixed so that the sums don't cancel out
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdull;
+	hash ^= hash >> 33;
+	return hash;
+}
@@ -0,0 +1,259 @@
+/*
+ * Debug shapes in world space, for seeing what collision, pathing and culling
+ * are doing, drawn over the finished frame.
+ *
+ * Everything is made of line segments.  Between debug_draw_begin() and
+ * debug_draw_end() any thread can add shapes to the list, each claiming its
+ * segments with one atomic add (what doesn't fit is dropped), so drawing from
+ * the worker pool is fine.  debug_draw_record() copies the list into the
+ * frame ring and draws all of it with one instanced draw of debug_line.vert,
+ * which projects each segment's ends and widens it into a quad in screen
+ * space, the way sprite.vert makes a sprite's quad, so lines are the same
+ * number of pixels wide at any zoom.
+ *
+ * Built with NDEBUG none of this is compiled, and debug_draw.h makes every
+ * call nothing, so release builds can leave the calls in.
+ */
+
+#include "debug_draw.h"
+
+#ifndef NDEBUG
+
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vkx/vkx_core.h"
+#include "vkx/vkx_pipeline.h"
+
+static DebugDrawList* current_list = NULL;
+
+void debug_draw_init(DebugDraw* draw, VkFormat color_format) {
+	/*
+	 * Create the pipeline
+	 *
+	 * @param color_format Of the image it draws on, i.e. the swap chain's
+	 */
+	memset(draw, 0, sizeof(*draw));
+
+	VkVertexInputBindingDescription binding_description = {0};
+	binding_description.binding = 0;
+	binding_description.stride = sizeof(DebugLine);
+	binding_description.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+	VkVertexInputAttributeDescription attribute_descriptions[3] = {0};
+	attribute_descriptions[0].binding = 0;
+	attribute_descriptions[0].location = 0;
+	attribute_descriptions[0].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+	attribute_descriptions[0].offset = offsetof(DebugLine, a);
+
+	attribute_descriptions[1].binding = 0;
+	attribute_descriptions[1].location = 1;
+	attribute_descriptions[1].format = VK_FORMAT_R8G8B8A8_UNORM;
+	attribute_descriptions[1].offset = offsetof(DebugLine, color);
+
+	attribute_descriptions[2].binding = 0;
+	attribute_descriptions[2].location = 2;
+	attribute_descriptions[2].format = VK_FORMAT_R32_SFLOAT;
+	attribute_descriptions[2].offset = offsetof(DebugLine, width);
+
+	VkPushConstantRange push_constant_range = {0};
+	push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	push_constant_range.offset = 0;
+	push_constant_range.size = sizeof(DebugDrawPushConstants);
+
+	draw->pipeline = vkx_create_overlay_pipeline(
+		"shaders/debug_line.vert.spv",
+		"shaders/debug_line.frag.spv",
+		binding_description,
+		attribute_descriptions,
+		3,
+		push_constant_range,
+		NULL,
+		color_format
+	);
+}
+
+void debug_draw_cleanup(DebugDraw* draw) {
+	vkx_cleanup_pipeline(draw->pipeline);
+	memset(draw, 0, sizeof(*draw));
+}
+
+void debug_draw_set_view(DebugDraw* draw, const float view_projection[16], VkExtent2D output_size, uint32_t pre_rotation) {
+	/*
+	 * Set where the world is on the screen for this frame
+	 *
+	 * @param view_projection The camera's, which the shapes are drawn with
+	 * @param output_size Size of the window, before the pre-rotation
+	 * @param pre_rotation Clockwise quarter turns of the swap chain
+	 */
+	memcpy(draw->push_constants.view_projection, view_projection, sizeof(draw->push_constants.view_projection));
+	draw->push_constants.output_size[0] = (float) output_size.width;
+	draw->push_constants.output_size[1] = (float) output_size.height;
+	draw->push_constants.pre_rotation = pre_rotation;
+}
+
+void debug_draw_record(DebugDraw* draw, VkCommandBuffer command_buffer, VkxRingBuffer* ring, const DebugDrawList* list) {
+	/*
+	 * Draw a finished list
+	 *
+	 * @param command_buffer The command buffer to record into (inside rendering
+	 *                       to the image the pipeline was created for)
+	 * @param ring The frame ring, which has to have room for the list's capacity
+	 */
+	if (list->count == 0) {
+		return;
+	}
+
+	VkDeviceSize size = sizeof(DebugLine) * list->count;
+	VkxRingAllocation allocation = vkx_ring_buffer_alloc(ring, size);
+	memcpy(allocation.data, list->lines, size);
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, draw->pipeline.pipeline);
+	vkCmdPushConstants(command_buffer, draw->pipeline.layout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+			sizeof(DebugDrawPushConstants), &draw->push_constants);
+	vkCmdBindVertexBuffers(command_buffer, 0, 1, &ring->buffer.buffer, &allocation.offset);
+	vkCmdDraw(command_buffer, 6, list->count, 0, 0);
+}
+
+void debug_draw_list_init(DebugDrawList* list, uint32_t capacity) {
+	memset(list, 0, sizeof(*list));
+	list->lines = malloc(sizeof(DebugLine) * capacity);
+	if (list->lines == NULL) {
+		fprintf(stderr, "Failed to allocate %u debug lines\n", capacity);
+		exit(1);
+	}
+	list->capacity = capacity;
+}
+
+void debug_draw_list_cleanup(DebugDrawList* list) {
+	free(list->lines);
+	memset(list, 0, sizeof(*list));
+}
+
+void debug_draw_list_swap(DebugDrawList* a, DebugDrawList* b) {
+	/*
+	 * Swap two lists' lines, e.g. to hand a finished one to the renderer
+	 * without copying it.  Neither can be being drawn to
+	 */
+	DebugDrawList swapped = *a;
+	*a = *b;
+	*b = swapped;
+}
+
+void debug_draw_begin(DebugDrawList* list) {
+	/*
+	 * Empty a list, and draw into it until debug_draw_end()
+	 */
+	SDL_SetAtomicInt(&list->reserved, 0);
+	list->count = 0;
+	current_list = list;
+}
+
+void debug_draw_end(void) {
+	/*
+	 * Finish the list, once every thread drawing into it is done
+	 */
+	if (current_list == NULL) {
+		return;
+	}
+
+	uint32_t reserved = (uint32_t) SDL_GetAtomicInt(&current_list->reserved);
+	current_list->count = reserved < current_list->capacity ? reserved : current_list->capacity;
+	current_list = NULL;
+}
+
+static DebugLine* debug_draw_reserve(uint32_t count) {
+	/*
+	 * Claim room for a shape's lines, or NULL if there isn't any (or nothing is
+	 * being drawn)
+	 */
+	if (current_list == NULL) {
+		return NULL;
+	}
+
+	uint32_t first = (uint32_t) SDL_AddAtomicInt(&current_list->reserved, (int) count);
+	if (first + count > current_list->capacity) {
+		return NULL;
+	}
+	return &current_list->lines[first];
+}
+
+static void debug_draw_set_line(DebugLine* line, float ax, float ay, float bx, float by, uint32_t color, float width) {
+	line->a[0] = ax;
+	line->a[1] = ay;
+	line->b[0] = bx;
+	line->b[1] = by;
+	line->color = color;
+	line->width = width;
+}
+
+void debug_draw_line(const float a[2], const float b[2], uint32_t color, float width) {
+	/*
+	 * @param width In screen pixels
+	 */
+	DebugLine* line = debug_draw_reserve(1);
+	if (line != NULL) {
+		debug_draw_set_line(line, a[0], a[1], b[0], b[1], color, width);
+	}
+}
+
+void debug_draw_rect(const float rect[4], uint32_t color, float width) {
+	/*
+	 * The outline of a rectangle
+	 *
+	 * @param rect Left, top, right and bottom, like Camera.visible
+	 */
+	DebugLine* lines = debug_draw_reserve(4);
+	if (lines == NULL) {
+		return;
+	}
+
+	debug_draw_set_line(&lines[0], rect[0], rect[1], rect[2], rect[1], color, width);
+	debug_draw_set_line(&lines[1], rect[2], rect[1], rect[2], rect[3], color, width);
+	debug_draw_set_line(&lines[2], rect[2], rect[3], rect[0], rect[3], color, width);
+	debug_draw_set_line(&lines[3], rect[0], rect[3], rect[0], rect[1], color, width);
+}
+
+void debug_draw_circle(const float centre[2], float radius, uint32_t color, float width) {
+	/*
+	 * The outline of a circle, in DEBUG_DRAW_CIRCLE_SEGMENTS segments
+	 */
+	DebugLine* lines = debug_draw_reserve(DEBUG_DRAW_CIRCLE_SEGMENTS);
+	if (lines == NULL) {
+		return;
+	}
+
+	const float step = 2.0f * 3.14159265f / DEBUG_DRAW_CIRCLE_SEGMENTS;
+	float x = centre[0] + radius;
+	float y = centre[1];
+	for (uint32_t i = 0; i < DEBUG_DRAW_CIRCLE_SEGMENTS; i++) {
+		float angle = step * (float) (i + 1);
+		float next_x = centre[0] + cosf(angle) * radius;
+		float next_y = centre[1] + sinf(angle) * radius;
+		debug_draw_set_line(&lines[i], x, y, next_x, next_y, color, width);
+		x = next_x;
+		y = next_y;
+	}
+}
+
+void debug_draw_arrow(const float from[2], const float to[2], uint32_t color, float width) {
+	/*
+	 * A line with a head at the to end, a quarter of its length
+	 */
+	DebugLine* lines = debug_draw_reserve(3);
+	if (lines == NULL) {
+		return;
+	}
+
+	float dx = (to[0] - from[0]) * 0.25f;
+	float dy = (to[1] - from[1]) * 0.25f;
+	debug_draw_set_line(&lines[0], from[0], from[1], to[0], to[1], color, width);
+	// Back along the line and out to either side
+	debug_draw_set_line(&lines[1], to[0], to[1], to[0] - dx - dy, to[1] - dy + dx, color, width);
+	debug_draw_set_line(&lines[2], to[0], to[1], to[0] - dx + dy, to[1] - dy - dx, color, width);
+}
+
+#endif // NDEBUG
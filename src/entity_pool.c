@@ -0,0 +1,162 @@
+/*
+ * Entities with stable handles, packed so they can be iterated without gaps.
+ *
+ * The entities' data is a structure of arrays, the pool's columns, each
+ * indexed by the entity's dense index in [0, count).  Creating one appends it
+ * and destroying one moves the last entity into its place, in every column,
+ * so both are O(1) and the columns never have holes.  As dense indices move
+ * about, anything kept between frames holds a handle instead: a slot that
+ * maps to the current dense index, and the slot's generation, which goes up
+ * when the entity is destroyed so that old handles stop being valid.
+ *
+ * Everything is allocated up front for capacity entities, so spawning and
+ * killing them never allocates.  To destroy entities while iterating over
+ * them, go from the end: the one moved into a destroyed one's place has
+ * already been visited.
+ */
+
+#include "entity_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void entity_pool_init(EntityPool* pool, uint32_t capacity) {
+	/*
+	 * Set up a pool for up to capacity entities, with no columns yet
+	 */
+	if (capacity > ENTITY_POOL_MAX_ENTITIES) {
+		fprintf(stderr, "Entity pools can't have more than %u entities\n", ENTITY_POOL_MAX_ENTITIES);
+		exit(1);
+	}
+
+	memset(pool, 0, sizeof(*pool));
+	pool->capacity = capacity;
+	pool->dense_indices = malloc(sizeof(uint32_t) * capacity);
+	pool->slots = malloc(sizeof(uint32_t) * capacity);
+	pool->generations = calloc(capacity, sizeof(uint8_t));
+	pool->free_slots = malloc(sizeof(uint32_t) * capacity);
+	if (pool->dense_indices == NULL || pool->slots == NULL || pool->generations == NULL || pool->free_slots == NULL) {
+		fprintf(stderr, "Failed to allocate an entity pool of %u entities\n", capacity);
+		exit(1);
+	}
+}
+
+void entity_pool_add_column(EntityPool* pool, void** data, size_t element_size) {
+	/*
+	 * Allocate a column of capacity elements, which the pool keeps packed
+	 *
+	 * @param data Set to the column, and freed by entity_pool_cleanup()
+	 * @param element_size Of each entity's element
+	 */
+	if (pool->columns_count == ENTITY_POOL_MAX_COLUMNS) {
+		fprintf(stderr, "Entity pools can't have more than %d columns\n", ENTITY_POOL_MAX_COLUMNS);
+		exit(1);
+	}
+
+	*data = malloc(element_size * pool->capacity);
+	if (*data == NULL) {
+		fprintf(stderr, "Failed to allocate an entity pool column of %u entities\n", pool->capacity);
+		exit(1);
+	}
+
+	EntityPoolColumn* column = &pool->columns[pool->columns_count++];
+	column->data = data;
+	column->element_size = element_size;
+}
+
+void entity_pool_cleanup(EntityPool* pool) {
+	for (uint32_t i = 0; i < pool->columns_count; i++) {
+		free(*pool->columns[i].data);
+		*pool->columns[i].data = NULL;
+	}
+	free(pool->dense_indices);
+	free(pool->slots);
+	free(pool->generations);
+	free(pool->free_slots);
+	memset(pool, 0, sizeof(*pool));
+}
+
+EntityHandle entity_pool_create(EntityPool* pool) {
+	/*
+	 * Add an entity at the end of the columns, at entity_pool_get_index() (or
+	 * count - 1).  Its elements are left for the caller to fill in
+	 *
+	 * @return Its handle, or ENTITY_POOL_NO_HANDLE if the pool is full
+	 */
+	if (pool->count == pool->capacity) {
+		return ENTITY_POOL_NO_HANDLE;
+	}
+
+	uint32_t slot = pool->free_count > 0 ? pool->free_slots[--pool->free_count] : pool->slots_count++;
+	uint32_t index = pool->count++;
+	pool->dense_indices[slot] = index;
+	pool->slots[index] = slot;
+	return (EntityHandle) pool->generations[slot] << ENTITY_POOL_INDEX_BITS | slot;
+}
+
+void entity_pool_destroy_index(EntityPool* pool, uint32_t index) {
+	/*
+	 * Destroy the entity at a dense index, moving the last one into its place
+	 */
+	if (index >= pool->count) {
+		return;
+	}
+
+	uint32_t slot = pool->slots[index];
+	uint32_t last = --pool->count;
+	if (index != last) {
+		for (uint32_t i = 0; i < pool->columns_count; i++) {
+			const EntityPoolColumn* column = &pool->columns[i];
+			char* data = *column->data;
+			memcpy(data + column->element_size * index, data + column->element_size * last, column->element_size);
+		}
+		uint32_t moved_slot = pool->slots[last];
+		pool->slots[index] = moved_slot;
+		pool->dense_indices[moved_slot] = index;
+	}
+
+	pool->dense_indices[slot] = ENTITY_POOL_NO_INDEX;
+	pool->generations[slot]++;
+	pool->free_slots[pool->free_count++] = slot;
+}
+
+void entity_pool_destroy(EntityPool* pool, EntityHandle handle) {
+	/*
+	 * Destroy an entity, if the handle is still valid
+	 */
+	uint32_t index = entity_pool_get_index(pool, handle);
+	if (index != ENTITY_POOL_NO_INDEX) {
+		entity_pool_destroy_index(pool, index);
+	}
+}
+
+bool entity_pool_is_valid(const EntityPool* pool, EntityHandle handle) {
+	uint32_t slot = handle & ENTITY_POOL_INDEX_MASK;
+	return handle != ENTITY_POOL_NO_HANDLE
+		&& slot < pool->slots_count
+		&& pool->dense_indices[slot] != ENTITY_POOL_NO_INDEX
+		&& pool->generations[slot] == handle >> ENTITY_POOL_INDEX_BITS;
+}
+
+uint32_t entity_pool_get_index(const EntityPool* pool, EntityHandle handle) {
+	/*
+	 * @return The entity's current dense index, or ENTITY_POOL_NO_INDEX if it's
+	 *         been destroyed.  It changes when other entities are destroyed
+	 */
+	if (!entity_pool_is_valid(pool, handle)) {
+		return ENTITY_POOL_NO_INDEX;
+	}
+	return pool->dense_indices[handle & ENTITY_POOL_INDEX_MASK];
+}
+
+EntityHandle entity_pool_get_handle(const EntityPool* pool, uint32_t index) {
+	/*
+	 * @return The handle of the entity at a dense index, to keep hold of it
+	 */
+	if (index >= pool->count) {
+		return ENTITY_POOL_NO_HANDLE;
+	}
+	uint32_t slot = pool->slots[index];
+	return (EntityHandle) pool->generations[slot] << ENTITY_POOL_INDEX_BITS | slot;
+}
@@ -0,0 +1,352 @@
+/*
+ * Flow fields over the tilemap, so any number of monsters can head for the
+ * same target for the cost of one search.
+ *
+ * The integration field is the number of steps (up, down, left or right)
+ * from each tile to the target, found with a breadth first wavefront.  Each
+ * step of the wavefront is split over the worker pool: the jobs lower their
+ * tiles' neighbours with a compare and swap, and whoever lowers a tile adds it
+ * to the next wavefront, so a tile is only in it once.  The directions are
+ * then worked out from the distances, each tile heading for its neighbour
+ * (diagonals too, when they don't cut a corner) closest to the target.
+ * Sampling the field is a look up of the tile's direction.
+ *
+ * Tiles which open up can only make paths shorter, so the wavefront is spread
+ * from just them and only the directions around what changed are redone.
+ * Tiles which close can make paths longer anywhere, so the whole field is
+ * searched again.  Either way the changes are collected and applied by the
+ * next flow_field_update().
+ */
+
+#include "flow_field.h"
+#include "jobs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Tiles for each job of the passes over the map
+#define FLOW_FIELD_JOB_SIZE 4096
+// Wavefront tiles for each job
+#define FLOW_FIELD_FRONTIER_JOB_SIZE 1024
+
+static const int32_t neighbour_offsets[4][2] = {{1, 0}, {0, 1}, {-1, 0}, {0, -1}};
+
+// For each direction, going anticlockwise from +x
+static const int32_t direction_offsets[8][2] = {
+	{1, 0}, {1, 1}, {0, 1}, {-1, 1}, {-1, 0}, {-1, -1}, {0, -1}, {1, -1},
+};
+#define FLOW_FIELD_DIAGONAL 0.70710678f
+static const float direction_vectors[8][2] = {
+	{1.0f, 0.0f}, {FLOW_FIELD_DIAGONAL, FLOW_FIELD_DIAGONAL}, {0.0f, 1.0f}, {-FLOW_FIELD_DIAGONAL, FLOW_FIELD_DIAGONAL},
+	{-1.0f, 0.0f}, {-FLOW_FIELD_DIAGONAL, -FLOW_FIELD_DIAGONAL}, {0.0f, -1.0f}, {FLOW_FIELD_DIAGONAL, -FLOW_FIELD_DIAGONAL},
+};
+
+// Rows [first_row, last_row] whose directions need working out
+typedef struct {
+	FlowField* field;
+	uint32_t first_row;
+	uint32_t last_row;
+} FlowFieldRows;
+
+void flow_field_init(FlowField* field, const TileSolidity* solidity) {
+	/*
+	 * Set up a field over a map, with nowhere to go until a target is set
+	 *
+	 * @param solidity The map, which has to outlive the field
+	 */
+	memset(field, 0, sizeof(*field));
+	field->solidity = solidity;
+	field->width = solidity->width;
+	field->height = solidity->height;
+
+	size_t tiles = (size_t) field->width * field->height;
+	field->distances = malloc(sizeof(SDL_AtomicInt) * tiles);
+	field->directions = malloc(sizeof(uint8_t) * tiles);
+	field->frontier = malloc(sizeof(uint32_t) * tiles);
+	field->next_frontier = malloc(sizeof(uint32_t) * tiles);
+	if (field->distances == NULL || field->directions == NULL || field->frontier == NULL || field->next_frontier == NULL) {
+		fprintf(stderr, "Failed to allocate a %ux%u flow field\n", field->width, field->height);
+		exit(1);
+	}
+
+	for (size_t i = 0; i < tiles; i++) {
+		SDL_SetAtomicInt(&field->distances[i], FLOW_FIELD_UNREACHABLE);
+	}
+	memset(field->directions, FLOW_FIELD_NO_DIRECTION, tiles);
+}
+
+void flow_field_cleanup(FlowField* field) {
+	free(field->distances);
+	free(field->directions);
+	free(field->frontier);
+	free(field->next_frontier);
+	free(field->opened);
+	memset(field, 0, sizeof(*field));
+}
+
+static bool flow_field_is_open(const FlowField* field, int64_t x, int64_t y) {
+	return !tile_solidity_is_solid(field->solidity, x, y);
+}
+
+static void flow_field_spread_job(size_t start, size_t end, void* data) {
+	/*
+	 * Lower the neighbours of the wavefront's tiles [start, end), and add the
+	 * ones lowered to the next wavefront
+	 */
+	FlowField* field = data;
+	for (size_t i = start; i < end; i++) {
+		uint32_t tile = field->frontier[i];
+		int64_t x = tile % field->width;
+		int64_t y = tile / field->width;
+		int distance = SDL_GetAtomicInt(&field->distances[tile]) + 1;
+
+		for (int n = 0; n < 4; n++) {
+			int64_t nx = x + neighbour_offsets[n][0];
+			int64_t ny = y + neighbour_offsets[n][1];
+			if (!flow_field_is_open(field, nx, ny)) {
+				continue;
+			}
+
+			uint32_t neighbour = (uint32_t) (nx + ny * field->width);
+			SDL_AtomicInt* neighbour_distance = &field->distances[neighbour];
+			for (int current = SDL_GetAtomicInt(neighbour_distance); current > distance; current = SDL_GetAtomicInt(neighbour_distance)) {
+				if (SDL_CompareAndSwapAtomicInt(neighbour_distance, current, distance)) {
+					field->next_frontier[SDL_AddAtomicInt(&field->next_frontier_count, 1)] = neighbour;
+					break;
+				}
+			}
+		}
+	}
+}
+
+static void flow_field_spread(FlowField* field, uint32_t* first_row, uint32_t* last_row) {
+	/*
+	 * Spread the wavefront until nothing is lowered any more
+	 *
+	 * @param first_row Lowered to the lowest row of the tiles changed
+	 * @param last_row Raised to the highest
+	 */
+	while (field->frontier_count > 0) {
+		for (uint32_t i = 0; i < field->frontier_count; i++) {
+			uint32_t y = field->frontier[i] / field->width;
+			*first_row = y < *first_row ? y : *first_row;
+			*last_row = y > *last_row ? y : *last_row;
+		}
+
+		SDL_SetAtomicInt(&field->next_frontier_count, 0);
+		jobs_parallel_for(field->frontier_count, FLOW_FIELD_FRONTIER_JOB_SIZE, flow_field_spread_job, field);
+
+		uint32_t* spread = field->frontier;
+		field->frontier = field->next_frontier;
+		field->next_frontier = spread;
+		field->frontier_count = (uint32_t) SDL_GetAtomicInt(&field->next_frontier_count);
+	}
+}
+
+static void flow_field_directions_job(size_t start, size_t end, void* data) {
+	/*
+	 * Work out the directions of the tiles [start, end) on from the first row
+	 */
+	const FlowFieldRows* rows = data;
+	FlowField* field = rows->field;
+	size_t offset = (size_t) rows->first_row * field->width;
+
+	for (size_t tile = offset + start; tile < offset + end; tile++) {
+		int64_t x = tile % field->width;
+		int64_t y = tile / field->width;
+		int best = SDL_GetAtomicInt(&field->distances[tile]);
+		uint8_t direction = FLOW_FIELD_NO_DIRECTION;
+
+		if (best != FLOW_FIELD_UNREACHABLE && flow_field_is_open(field, x, y)) {
+			for (uint8_t d = 0; d < 8; d++) {
+				int64_t nx = x + direction_offsets[d][0];
+				int64_t ny = y + direction_offsets[d][1];
+				// Diagonals only if both of the tiles beside them are open too
+				if (!flow_field_is_open(field, nx, ny) || !flow_field_is_open(field, nx, y) || !flow_field_is_open(field, x, ny)) {
+					continue;
+				}
+				int distance = SDL_GetAtomicInt(&field->distances[nx + ny * field->width]);
+				if (distance < best) {
+					best = distance;
+					direction = d;
+				}
+			}
+		}
+		field->directions[tile] = direction;
+	}
+}
+
+static void flow_field_update_directions(FlowField* field, uint32_t first_row, uint32_t last_row) {
+	/*
+	 * Work out the directions of rows [first_row, last_row] and the rows
+	 * either side of them, whose closest neighbours could have changed
+	 */
+	if (first_row > last_row) {
+		return;
+	}
+
+	FlowFieldRows rows = {
+		.field = field,
+		.first_row = first_row > 0 ? first_row - 1 : 0,
+		.last_row = last_row + 1 < field->height ? last_row + 1 : field->height - 1,
+	};
+	size_t tiles = (size_t) (rows.last_row - rows.first_row + 1) * field->width;
+	jobs_parallel_for(tiles, FLOW_FIELD_JOB_SIZE, flow_field_directions_job, &rows);
+}
+
+static void flow_field_reset_job(size_t start, size_t end, void* data) {
+	FlowField* field = data;
+	for (size_t i = start; i < end; i++) {
+		SDL_SetAtomicInt(&field->distances[i], FLOW_FIELD_UNREACHABLE);
+	}
+}
+
+static void flow_field_recompute(FlowField* field) {
+	/*
+	 * Search the whole field again from the target
+	 */
+	size_t tiles = (size_t) field->width * field->height;
+	jobs_parallel_for(tiles, FLOW_FIELD_JOB_SIZE, flow_field_reset_job, field);
+
+	uint32_t target = field->target[0] + field->target[1] * field->width;
+	SDL_SetAtomicInt(&field->distances[target], 0);
+	field->frontier[0] = target;
+	field->frontier_count = 1;
+
+	uint32_t first_row = UINT32_MAX;
+	uint32_t last_row = 0;
+	flow_field_spread(field, &first_row, &last_row);
+	// Everything else could have been cut off
+	flow_field_update_directions(field, 0, field->height - 1);
+}
+
+void flow_field_set_target(FlowField* field, uint32_t x, uint32_t y) {
+	/*
+	 * Point the field at a tile, and search it all again straight away
+	 */
+	if (x >= field->width || y >= field->height) {
+		return;
+	}
+
+	field->target[0] = x;
+	field->target[1] = y;
+	field->opened_count = 0;
+	field->closed = false;
+	flow_field_recompute(field);
+}
+
+void flow_field_tile_changed(FlowField* field, uint32_t x, uint32_t y, bool solid) {
+	/*
+	 * Note that a tile of the map has changed, to be taken into account by the
+	 * next flow_field_update()
+	 */
+	if (x >= field->width || y >= field->height) {
+		return;
+	}
+
+	if (solid) {
+		field->closed = true;
+		return;
+	}
+
+	if (field->opened_count == field->opened_capacity) {
+		field->opened_capacity = field->opened_capacity == 0 ? 64 : field->opened_capacity * 2;
+		field->opened = realloc(field->opened, sizeof(uint32_t) * field->opened_capacity);
+		if (field->opened == NULL) {
+			fprintf(stderr, "Failed to allocate the flow field's changed tiles\n");
+			exit(1);
+		}
+	}
+	field->opened[field->opened_count++] = x + y * field->width;
+}
+
+void flow_field_update(FlowField* field) {
+	/*
+	 * Bring the field up to date with the tiles changed since the last update
+	 */
+	if (field->closed) {
+		field->opened_count = 0;
+		field->closed = false;
+		flow_field_recompute(field);
+		return;
+	}
+	if (field->opened_count == 0) {
+		return;
+	}
+
+	// Each open tile starts one step further than its closest neighbour, and
+	// the wavefront carries on from the ones which are closer than they were
+	field->frontier_count = 0;
+	uint32_t first_row = UINT32_MAX;
+	uint32_t last_row = 0;
+	for (uint32_t i = 0; i < field->opened_count; i++) {
+		uint32_t tile = field->opened[i];
+		int64_t x = tile % field->width;
+		int64_t y = tile / field->width;
+		if (!flow_field_is_open(field, x, y)) {
+			continue;
+		}
+
+		int distance = FLOW_FIELD_UNREACHABLE;
+		for (int n = 0; n < 4; n++) {
+			int64_t nx = x + neighbour_offsets[n][0];
+			int64_t ny = y + neighbour_offsets[n][1];
+			if (flow_field_is_open(field, nx, ny)) {
+				int neighbour_distance = SDL_GetAtomicInt(&field->distances[nx + ny * field->width]);
+				if (neighbour_distance != FLOW_FIELD_UNREACHABLE && neighbour_distance + 1 < distance) {
+					distance = neighbour_distance + 1;
+				}
+			}
+		}
+		if (x == field->target[0] && y == field->target[1]) {
+			distance = 0;
+		}
+
+		// Seen before from another of the open tiles, or no path yet.  Either
+		// way it's still in the directions to redo
+		uint32_t row = (uint32_t) y;
+		first_row = row < first_row ? row : first_row;
+		last_row = row > last_row ? row : last_row;
+		if (distance < SDL_GetAtomicInt(&field->distances[tile])) {
+			SDL_SetAtomicInt(&field->distances[tile], distance);
+			field->frontier[field->frontier_count++] = tile;
+		}
+	}
+	field->opened_count = 0;
+
+	flow_field_spread(field, &first_row, &last_row);
+	flow_field_update_directions(field, first_row, last_row);
+}
+
+bool flow_field_sample(const FlowField* field, float x, float y, float direction[2]) {
+	/*
+	 * Get the way to go from a point towards the target
+	 *
+	 * @param direction Set to a unit vector
+	 *
+	 * @return Whether there's a way to go, which there isn't at the target, off
+	 *         the map or where it can't be reached
+	 */
+	if (!(x >= 0.0f && y >= 0.0f && x < (float) field->width && y < (float) field->height)) {
+		return false;
+	}
+
+	uint8_t d = field->directions[(size_t) x + (size_t) y * field->width];
+	if (d == FLOW_FIELD_NO_DIRECTION) {
+		return false;
+	}
+	direction[0] = direction_vectors[d][0];
+	direction[1] = direction_vectors[d][1];
+	return true;
+}
+
+int32_t flow_field_get_distance(const FlowField* field, uint32_t x, uint32_t y) {
+	/*
+	 * @return The steps from a tile to the target, or FLOW_FIELD_UNREACHABLE
+	 */
+	if (x >= field->width || y >= field->height) {
+		return FLOW_FIELD_UNREACHABLE;
+	}
+	return SDL_GetAtomicInt(&field->distances[x + y * field->width]);
+}
@@ -0,0 +1,191 @@
+/*
+ * Hands frames from the simulation to a render thread.
+ *
+ * The caller keeps FRAME_PIPELINE_SNAPSHOTS copies of whatever the renderer
+ * needs from the simulation.  Each frame it writes one with the index from
+ * frame_pipeline_begin_snapshot() and hands it over with frame_pipeline_publish().
+ * The render thread draws the snapshots in the order they were published, so
+ * while it records, submits and waits on the GPU for frame N the simulation can
+ * already be writing frame N+1 into the other one.  The simulation is never more
+ * than one frame ahead: beginning a snapshot blocks until the frame which last
+ * used it has been drawn.
+ *
+ * Anything else shared with the renderer can only be touched after
+ * frame_pipeline_sync(), which waits for the render thread to go idle.
+ *
+ * Without the thread, publishing draws the frame straight away on the calling
+ * thread, so both ways run the same code.
+ */
+
+#include "frame_pipeline.h"
+#include "trace.h"
+
+#include <SDL3/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static bool pipeline_threaded = false;
+static FramePipelineRenderFunc pipeline_render = NULL;
+static void* pipeline_data = NULL;
+static SDL_Thread* render_thread = NULL;
+
+// Protects everything below
+static SDL_Mutex* pipeline_mutex = NULL;
+// Signalled when a snapshot is published (or we are quitting)
+static SDL_Condition* publish_condition = NULL;
+// Signalled when the render thread finishes a frame
+static SDL_Condition* rendered_condition = NULL;
+
+// Frames handed over, and frames the render thread has finished drawing.  Frame
+// n uses snapshot n % FRAME_PIPELINE_SNAPSHOTS
+static uint64_t published_count = 0;
+static uint64_t rendered_count = 0;
+static bool quitting = false;
+
+static int frame_pipeline_render_main(void* data) {
+	(void) data;
+
+	trace_set_thread_name("render");
+
+	SDL_LockMutex(pipeline_mutex);
+	for (;;) {
+		while (!quitting && rendered_count == published_count) {
+			SDL_WaitCondition(publish_condition, pipeline_mutex);
+		}
+
+		// Everything published is drawn before quitting
+		if (rendered_count == published_count) {
+			break;
+		}
+
+		uint32_t snapshot = (uint32_t) (rendered_count % FRAME_PIPELINE_SNAPSHOTS);
+		SDL_UnlockMutex(pipeline_mutex);
+
+		pipeline_render(snapshot, pipeline_data);
+
+		SDL_LockMutex(pipeline_mutex);
+		rendered_count++;
+		SDL_BroadcastCondition(rendered_condition);
+	}
+	SDL_UnlockMutex(pipeline_mutex);
+
+	return 0;
+}
+
+void frame_pipeline_init(bool threaded, FramePipelineRenderFunc render, void* data) {
+	/*
+	 * Start the render thread
+	 *
+	 * @param threaded Draw the frames on a render thread, otherwise
+	 *                 frame_pipeline_publish() draws them on the calling thread
+	 * @param render Called with each published snapshot
+	 * @param data User data passed through to render
+	 */
+	pipeline_threaded = threaded;
+	pipeline_render = render;
+	pipeline_data = data;
+	published_count = 0;
+	rendered_count = 0;
+	quitting = false;
+
+	if (!threaded) {
+		return;
+	}
+
+	pipeline_mutex = SDL_CreateMutex();
+	publish_condition = SDL_CreateCondition();
+	rendered_condition = SDL_CreateCondition();
+
+	if (pipeline_mutex == NULL || publish_condition == NULL || rendered_condition == NULL) {
+		fprintf(stderr, "Failed to create frame pipeline sync objects: %s\n", SDL_GetError());
+		exit(1);
+	}
+
+	render_thread = SDL_CreateThread(frame_pipeline_render_main, "render", NULL);
+	if (render_thread == NULL) {
+		fprintf(stderr, "Failed to create the render thread: %s\n", SDL_GetError());
+		exit(1);
+	}
+}
+
+void frame_pipeline_cleanup(void) {
+	/*
+	 * Draw anything still published, then stop and join the render thread
+	 */
+	if (!pipeline_threaded) {
+		return;
+	}
+
+	SDL_LockMutex(pipeline_mutex);
+	quitting = true;
+	SDL_BroadcastCondition(publish_condition);
+	SDL_UnlockMutex(pipeline_mutex);
+
+	SDL_WaitThread(render_thread, NULL);
+	render_thread = NULL;
+
+	SDL_DestroyCondition(rendered_condition);
+	SDL_DestroyCondition(publish_condition);
+	SDL_DestroyMutex(pipeline_mutex);
+	rendered_condition = NULL;
+	publish_condition = NULL;
+	pipeline_mutex = NULL;
+	pipeline_threaded = false;
+}
+
+uint32_t frame_pipeline_begin_snapshot(void) {
+	/*
+	 * Wait until the next snapshot is free to write, i.e. the render thread has
+	 * finished the frame before the one it's drawing now
+	 *
+	 * @return Index of the snapshot to write the next frame into
+	 */
+	if (pipeline_threaded) {
+		trace_begin("wait for render thread");
+		SDL_LockMutex(pipeline_mutex);
+		while (published_count > rendered_count + FRAME_PIPELINE_SNAPSHOTS - 1) {
+			SDL_WaitCondition(rendered_condition, pipeline_mutex);
+		}
+		SDL_UnlockMutex(pipeline_mutex);
+		trace_end();
+	}
+
+	return (uint32_t) (published_count % FRAME_PIPELINE_SNAPSHOTS);
+}
+
+void frame_pipeline_publish(void) {
+	/*
+	 * Hand the snapshot from frame_pipeline_begin_snapshot() to the renderer.
+	 * It mustn't be written again until frame_pipeline_begin_snapshot() returns it
+	 */
+	if (!pipeline_threaded) {
+		pipeline_render((uint32_t) (published_count % FRAME_PIPELINE_SNAPSHOTS), pipeline_data);
+		published_count++;
+		rendered_count++;
+		return;
+	}
+
+	SDL_LockMutex(pipeline_mutex);
+	published_count++;
+	SDL_SignalCondition(publish_condition);
+	SDL_UnlockMutex(pipeline_mutex);
+}
+
+void frame_pipeline_sync(void) {
+	/*
+	 * Wait for every published frame to be drawn.  Until the next publish the
+	 * render thread does nothing, so the state it uses can be changed
+	 */
+	if (!pipeline_threaded) {
+		return;
+	}
+
+	trace_begin("sync render thread");
+	SDL_LockMutex(pipeline_mutex);
+	while (rendered_count < published_count) {
+		SDL_WaitCondition(rendered_condition, pipeline_mutex);
+	}
+	SDL_UnlockMutex(pipeline_mutex);
+	trace_end();
+}
@@ -0,0 +1,316 @@
+/*
+ * Reloads shaders and textures when they change on disk, without stalling
+ * the frame.
+ *
+ * A watcher thread looks at the files' modification times every poll
+ * interval.  A file only counts as changed once its time has stayed the same
+ * for a whole poll, so nothing is read while an editor (or glslc) is still
+ * writing it.  When a shader's GLSL changes the watcher compiles it with
+ * glslc, the way compile_shaders.sh does, and the new .spv is then picked up
+ * like any other change.  Textures are decoded on the watcher thread too.
+ *
+ * The changes are queued for the render thread, which takes them between
+ * frames with hot_reload_next(), and only has to start the pipelines
+ * compiling again (see vkx_pipeline_manager_reload()) or upload the decoded
+ * texture.  If a shader fails to compile the error is printed and the old
+ * one is kept.
+ */
+
+#include "hot_reload.h"
+
+#include <SDL3/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+
+#define HOT_RELOAD_GLSLC "glslc"
+
+typedef struct {
+	HotReloadKind kind;
+	char path[HOT_RELOAD_MAX_PATH];
+	// The GLSL of a shader, which is the .spv without the extension
+	char source_path[HOT_RELOAD_MAX_PATH];
+	uint32_t id;
+	// The times last acted on, and the ones seen last poll which have to
+	// stay the same for another.  Only the watcher touches these
+	SDL_Time modify_time;
+	SDL_Time settling_time;
+	SDL_Time source_modify_time;
+	SDL_Time source_settling_time;
+} HotReloadFile;
+
+static HotReloadFile files[HOT_RELOAD_MAX_FILES];
+static SDL_Thread* watcher_thread = NULL;
+static uint32_t poll_interval = 0;
+
+// Protects everything below
+static SDL_Mutex* hot_reload_mutex = NULL;
+// Signalled when we are quitting, so the watcher doesn't sleep out its poll
+static SDL_Condition* quit_condition = NULL;
+// Only added to, so the watcher can go through the first files_count
+// without the lock
+static uint32_t files_count = 0;
+static HotReloadChange* changes = NULL;
+static uint32_t changes_count = 0;
+static bool quitting = false;
+
+static SDL_Time hot_reload_get_modify_time(const char* path) {
+	/*
+	 * When a file was last written, or 0 if it isn't there
+	 */
+	SDL_PathInfo info;
+	if (!SDL_GetPathInfo(path, &info)) {
+		return 0;
+	}
+	return info.modify_time;
+}
+
+static bool hot_reload_settled(SDL_Time time, SDL_Time* seen, SDL_Time* settling) {
+	/*
+	 * Whether a file has a new modification time which it also had last poll
+	 */
+	if (time == 0 || time == *seen) {
+		return false;
+	}
+	if (time != *settling) {
+		*settling = time;
+		return false;
+	}
+	*seen = time;
+	return true;
+}
+
+static void hot_reload_push(const HotReloadChange* change) {
+	SDL_LockMutex(hot_reload_mutex);
+	HotReloadChange* grown = realloc(changes, sizeof(HotReloadChange) * (changes_count + 1));
+	if (grown == NULL) {
+		fprintf(stderr, "Failed to allocate a hot reload change\n");
+		exit(1);
+	}
+	changes = grown;
+	changes[changes_count++] = *change;
+	SDL_UnlockMutex(hot_reload_mutex);
+}
+
+static void hot_reload_compile(const HotReloadFile* file) {
+	/*
+	 * Compile a shader's GLSL to its .spv.  glslc doesn't write the output if it
+	 * fails, so the old SPIR-V stays
+	 */
+	size_t length = strlen(file->source_path);
+	bool mesh_stage = length > 5 && (strcmp(file->source_path + length - 5, ".task") == 0 || strcmp(file->source_path + length - 5, ".mesh") == 0);
+	bool compute_stage = length > 5 && strcmp(file->source_path + length - 5, ".comp") == 0;
+
+	// Task and mesh shaders need SPIR-V 1.4, and compute shaders' subgroup
+	// operations 1.3, as in compile_shaders.sh
+	char command[HOT_RELOAD_MAX_PATH * 2 + 64];
+	snprintf(command, sizeof(command), HOT_RELOAD_GLSLC " --target-env=%s \"%s\" -o \"%s\"",
+		mesh_stage ? "vulkan1.3" : compute_stage ? "vulkan1.1" : "vulkan1.0", file->source_path, file->path);
+
+	printf("Compiling %s\n", file->source_path);
+	trace_begin("compile shader");
+	int status = system(command);
+	trace_end();
+	if (status != 0) {
+		fprintf(stderr, "Failed to compile %s, keeping the old shader\n", file->source_path);
+	}
+}
+
+static void hot_reload_poll(HotReloadFile* file) {
+	if (file->kind == HOT_RELOAD_SHADER && hot_reload_settled(hot_reload_get_modify_time(file->source_path),
+			&file->source_modify_time, &file->source_settling_time)) {
+		hot_reload_compile(file);
+	}
+
+	if (!hot_reload_settled(hot_reload_get_modify_time(file->path), &file->modify_time, &file->settling_time)) {
+		return;
+	}
+
+	HotReloadChange change = {0};
+	change.kind = file->kind;
+	memcpy(change.path, file->path, sizeof(change.path));
+	change.id = file->id;
+
+	if (file->kind == HOT_RELOAD_TEXTURE) {
+		trace_begin("decode texture");
+		bool decoded = vkx_decode_texture(file->path, &change.texture);
+		trace_end();
+		if (!decoded) {
+			fprintf(stderr, "Failed to load %s, keeping the old texture\n", file->path);
+			return;
+		}
+	}
+
+	printf("Reloading %s\n", file->path);
+	hot_reload_push(&change);
+}
+
+static int hot_reload_watcher_main(void* data) {
+	(void) data;
+
+	trace_set_thread_name("hot reload");
+
+	SDL_LockMutex(hot_reload_mutex);
+	for (;;) {
+		SDL_WaitConditionTimeout(quit_condition, hot_reload_mutex, (Sint32) poll_interval);
+		if (quitting) {
+			break;
+		}
+
+		uint32_t count = files_count;
+		SDL_UnlockMutex(hot_reload_mutex);
+
+		for (uint32_t i = 0; i < count; i++) {
+			hot_reload_poll(&files[i]);
+		}
+
+		SDL_LockMutex(hot_reload_mutex);
+	}
+	SDL_UnlockMutex(hot_reload_mutex);
+
+	return 0;
+}
+
+void hot_reload_init(uint32_t poll_interval_ms) {
+	/*
+	 * Start the watcher thread, which has nothing to watch until files are
+	 * added
+	 *
+	 * @param poll_interval_ms How often the files are looked at.  A change is
+	 *                         seen between one and two intervals after it
+	 */
+	memset(files, 0, sizeof(files));
+	poll_interval = poll_interval_ms;
+	files_count = 0;
+	changes = NULL;
+	changes_count = 0;
+	quitting = false;
+
+	hot_reload_mutex = SDL_CreateMutex();
+	quit_condition = SDL_CreateCondition();
+	if (hot_reload_mutex == NULL || quit_condition == NULL) {
+		fprintf(stderr, "Failed to create the hot reload synchronisation primitives: %s\n", SDL_GetError());
+		exit(1);
+	}
+
+	watcher_thread = SDL_CreateThread(hot_reload_watcher_main, "hot_reload", NULL);
+	if (watcher_thread == NULL) {
+		fprintf(stderr, "Failed to create the hot reload thread: %s\n", SDL_GetError());
+		exit(1);
+	}
+}
+
+void hot_reload_cleanup(void) {
+	/*
+	 * Stop the watcher (once it has finished with the file it's on), and drop
+	 * the changes nobody took
+	 */
+	SDL_LockMutex(hot_reload_mutex);
+	quitting = true;
+	SDL_BroadcastCondition(quit_condition);
+	SDL_UnlockMutex(hot_reload_mutex);
+
+	SDL_WaitThread(watcher_thread, NULL);
+	watcher_thread = NULL;
+
+	for (uint32_t i = 0; i < changes_count; i++) {
+		if (changes[i].kind == HOT_RELOAD_TEXTURE) {
+			vkx_free_decoded_texture(&changes[i].texture);
+		}
+	}
+	free(changes);
+	changes = NULL;
+	changes_count = 0;
+	files_count = 0;
+
+	SDL_DestroyCondition(quit_condition);
+	SDL_DestroyMutex(hot_reload_mutex);
+	quit_condition = NULL;
+	hot_reload_mutex = NULL;
+}
+
+static void hot_reload_add(HotReloadKind kind, const char* path, uint32_t id) {
+	/*
+	 * Start watching a file, from how it is now
+	 */
+	if (strlen(path) >= HOT_RELOAD_MAX_PATH) {
+		fprintf(stderr, "Path too long to hot reload: %s\n", path);
+		exit(1);
+	}
+
+	SDL_LockMutex(hot_reload_mutex);
+	if (files_count >= HOT_RELOAD_MAX_FILES) {
+		fprintf(stderr, "Too many files to hot reload (max %d)\n", HOT_RELOAD_MAX_FILES);
+		exit(1);
+	}
+
+	HotReloadFile* file = &files[files_count];
+	memset(file, 0, sizeof(*file));
+	file->kind = kind;
+	strcpy(file->path, path);
+	file->id = id;
+	file->modify_time = hot_reload_get_modify_time(path);
+	file->settling_time = file->modify_time;
+
+	if (kind == HOT_RELOAD_SHADER) {
+		// "shaders/sprite.frag.spv" is compiled from "shaders/sprite.frag"
+		strcpy(file->source_path, path);
+		char* extension = strrchr(file->source_path, '.');
+		if (extension != NULL && strcmp(extension, ".spv") == 0) {
+			*extension = '\0';
+		}
+		file->source_modify_time = hot_reload_get_modify_time(file->source_path);
+		file->source_settling_time = file->source_modify_time;
+	}
+
+	// Written before the watcher can see it
+	files_count++;
+	SDL_UnlockMutex(hot_reload_mutex);
+}
+
+void hot_reload_watch_shader(const char* spv_path) {
+	/*
+	 * Watch a shader, and its GLSL if it's next to it (otherwise only the
+	 * SPIR-V is watched)
+	 *
+	 * @param spv_path The .spv file the pipelines are made from
+	 */
+	SDL_LockMutex(hot_reload_mutex);
+	for (uint32_t i = 0; i < files_count; i++) {
+		if (files[i].kind == HOT_RELOAD_SHADER && strcmp(files[i].path, spv_path) == 0) {
+			SDL_UnlockMutex(hot_reload_mutex);
+			return;
+		}
+	}
+	SDL_UnlockMutex(hot_reload_mutex);
+
+	hot_reload_add(HOT_RELOAD_SHADER, spv_path, 0);
+}
+
+void hot_reload_watch_texture(const char* path, uint32_t id) {
+	/*
+	 * @param id Given back with its changes
+	 */
+	hot_reload_add(HOT_RELOAD_TEXTURE, path, id);
+}
+
+bool hot_reload_next(HotReloadChange* change) {
+	/*
+	 * Take the oldest change which is ready, without waiting for the watcher
+	 *
+	 * @return false if there aren't any
+	 */
+	SDL_LockMutex(hot_reload_mutex);
+	bool found = changes_count > 0;
+	if (found) {
+		*change = changes[0];
+		changes_count--;
+		memmove(changes, changes + 1, sizeof(HotReloadChange) * changes_count);
+	}
+	SDL_UnlockMutex(hot_reload_mutex);
+
+	return found;
+}
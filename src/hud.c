@@ -0,0 +1,358 @@
+/*
+ * Performance overlay, drawn over the finished frame.
+ *
+ * Everything on it is a quad: a character of text, a bar of a graph or a
+ * background.  They are collected on the CPU each frame between hud_begin()
+ * and hud_record(), which copies them into the frame ring and draws them all
+ * with one instanced draw of hud.vert, so a screen full of text is still one
+ * draw and nothing is allocated per frame.
+ *
+ * The font is a table of 5x7 glyphs, rasterised once by hud_init() into an
+ * atlas of signed distance fields, HUD_SDF_TEXELS texels per font pixel.
+ * hud.frag finds the glyph's edge where the bilinear distance crosses the
+ * middle and smooths it over a screen pixel, so text stays sharp and
+ * antialiased at any scale, not only whole multiples of the font's pixels.
+ *
+ * The quads are laid out in pixels from the top left of the window, before
+ * a pre-rotated swap chain's rotation, which the vertex shader applies like
+ * the screen pass does.
+ */
+
+#include "hud.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vkx/vkx_core.h"
+#include "vkx/vkx_memory.h"
+#include "vkx/vkx_pipeline.h"
+#include "vkx/vkx_upload.h"
+
+// 5x7 pixel glyphs for ASCII 32 to 95 (hud_text() draws lower case as upper
+// case).  Each glyph is two words of one byte per row, top row first, with the
+// leftmost pixel in the lowest bit
+static const uint32_t HUD_FONT[HUD_FONT_GLYPHS * 2] = {
+	0x00000000, 0x00000000, 0x04040404, 0x00040004, 0x00000a0a, 0x00000000, 0x0a1f0a0a, 0x000a0a1f,
+	0x0e051e04, 0x00040f14, 0x04081303, 0x00181902, 0x02050906, 0x00160915, 0x00000404, 0x00000000,
+	0x02020408, 0x00080402, 0x08080402, 0x00020408, 0x0e150400, 0x00000415, 0x1f040400, 0x00000404,
+	0x00000000, 0x00020406, 0x1f000000, 0x00000000, 0x00000000, 0x00060600, 0x04081000, 0x00000102,
+	0x1519110e, 0x000e1113, 0x04040604, 0x000e0404, 0x0810110e, 0x001f0204, 0x0804081f, 0x000e1110,
+	0x090a0c08, 0x0008081f, 0x100f011f, 0x000e1110, 0x0f01020c, 0x000e1111, 0x0408101f, 0x00020202,
+	0x0e11110e, 0x000e1111, 0x1e11110e, 0x00060810, 0x00060600, 0x00000606, 0x00060600, 0x00020406,
+	0x01020408, 0x00080402, 0x001f0000, 0x0000001f, 0x10080402, 0x00020408, 0x0810110e, 0x00040004,
+	0x1610110e, 0x000e1515, 0x1f11110e, 0x00111111, 0x0f11110f, 0x000f1111, 0x0101110e, 0x000e1101,
+	0x11110907, 0x00070911, 0x0f01011f, 0x001f0101, 0x0f01011f, 0x00010101, 0x1d01110e, 0x001e1111,
+	0x1f111111, 0x00111111, 0x0404040e, 0x000e0404, 0x0808081c, 0x00060908, 0x03050911, 0x00110905,
+	0x01010101, 0x001f0101, 0x15151b11, 0x00111111, 0x15131111, 0x00111119, 0x1111110e, 0x000e1111,
+	0x0f11110f, 0x00010101, 0x1111110e, 0x00160915, 0x0f11110f, 0x00110905, 0x0e01011e, 0x000f1010,
+	0x0404041f, 0x00040404, 0x11111111, 0x000e1111, 0x11111111, 0x00040a11, 0x15111111, 0x000a1515,
+	0x040a1111, 0x0011110a, 0x040a1111, 0x00040404, 0x0408101f, 0x001f0102, 0x0202020e, 0x000e0202,
+	0x04020100, 0x00001008, 0x0808080e, 0x000e0808, 0x00110a04, 0x00000000, 0x00000000, 0x001f0000
+};
+
+static bool hud_font_pixel(uint32_t glyph, int x, int y) {
+	if (x < 0 || y < 0 || x >= 5 || y >= 7) {
+		return false;
+	}
+	uint32_t row = (HUD_FONT[glyph * 2 + (uint32_t) y / 4] >> (((uint32_t) y % 4) * 8)) & 0xffu;
+	return (row & (1u << x)) != 0;
+}
+
+static uint8_t* hud_build_font_sdf(uint32_t* width, uint32_t* height) {
+	/*
+	 * Rasterise the font into a distance field atlas of HUD_FONT_COLUMNS glyph
+	 * cells across, in the order of the glyphs.  0.5 is on an edge, higher is
+	 * inside and 0 or 1 is HUD_SDF_SPREAD font pixels or more away
+	 */
+	const uint32_t cell_width = HUD_GLYPH_WIDTH * HUD_SDF_TEXELS;
+	const uint32_t cell_height = HUD_GLYPH_HEIGHT * HUD_SDF_TEXELS;
+	*width = cell_width * HUD_FONT_COLUMNS;
+	*height = cell_height * (HUD_FONT_GLYPHS / HUD_FONT_COLUMNS);
+
+	uint8_t* pixels = malloc((size_t) *width * *height);
+	if (pixels == NULL) {
+		fprintf(stderr, "Failed to allocate the HUD font atlas\n");
+		exit(1);
+	}
+
+	const int reach = (int) ceilf(HUD_SDF_SPREAD);
+	for (uint32_t glyph = 0; glyph < HUD_FONT_GLYPHS; glyph++) {
+		uint32_t cell_x = glyph % HUD_FONT_COLUMNS * cell_width;
+		uint32_t cell_y = glyph / HUD_FONT_COLUMNS * cell_height;
+
+		for (uint32_t ty = 0; ty < cell_height; ty++) {
+			for (uint32_t tx = 0; tx < cell_width; tx++) {
+				// The texel's centre in font pixels
+				float px = ((float) tx + 0.5f) / HUD_SDF_TEXELS;
+				float py = ((float) ty + 0.5f) / HUD_SDF_TEXELS;
+				int pixel_x = (int) px;
+				int pixel_y = (int) py;
+				bool inside = hud_font_pixel(glyph, pixel_x, pixel_y);
+
+				// The edge is as near as the nearest pixel of the other kind, and
+				// only the ones within the spread matter
+				float nearest = HUD_SDF_SPREAD;
+				for (int y = pixel_y - reach; y <= pixel_y + reach; y++) {
+					for (int x = pixel_x - reach; x <= pixel_x + reach; x++) {
+						if (hud_font_pixel(glyph, x, y) == inside) {
+							continue;
+						}
+						float dx = fmaxf(fmaxf((float) x - px, px - (float) (x + 1)), 0.0f);
+						float dy = fmaxf(fmaxf((float) y - py, py - (float) (y + 1)), 0.0f);
+						nearest = fminf(nearest, sqrtf(dx * dx + dy * dy));
+					}
+				}
+
+				float distance = inside ? nearest : -nearest;
+				float value = 0.5f + distance / (2.0f * HUD_SDF_SPREAD);
+				pixels[(size_t) (cell_y + ty) * *width + cell_x + tx] = (uint8_t) (fminf(fmaxf(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+			}
+		}
+	}
+
+	return pixels;
+}
+
+static void hud_create_font(Hud* hud) {
+	/*
+	 * Upload the font atlas and the sampler for drawing with it
+	 */
+	uint32_t width;
+	uint32_t height;
+	uint8_t* pixels = hud_build_font_sdf(&width, &height);
+
+	VkxMemoryTag previous_tag = vkx_memory_set_tag(VKX_MEMORY_TAG_TEXTURES);
+	hud->font_image = vkx_create_image(width, height, 1, VK_FORMAT_R8_UNORM, VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	vkx_memory_set_tag(previous_tag);
+	hud->font_image.view = vkx_create_image_view(hud->font_image.image, VK_FORMAT_R8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+	vkx_upload_image(hud->font_image.image, width, height, 1, pixels, (VkDeviceSize) width * height);
+	free(pixels);
+
+	// Bilinear, which is what makes the distance field smooth
+	VkSamplerCreateInfo sampler_info = {0};
+	sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	sampler_info.magFilter = VK_FILTER_LINEAR;
+	sampler_info.minFilter = VK_FILTER_LINEAR;
+	sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+	sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	sampler_info.minLod = 0.0f;
+	sampler_info.maxLod = 0.0f;
+
+	hud->font_sampler = vkx_get_sampler(&sampler_info);
+}
+
+void hud_init(Hud* hud, VkFormat color_format, float scale) {
+	/*
+	 * Create the overlay's pipeline, its font and its buffer of quads.  The font
+	 * is uploaded with the upload manager, which has to be flushed before the
+	 * first hud_record()
+	 *
+	 * @param color_format Of the image it draws on, i.e. the swap chain's
+	 * @param scale Screen pixels per font pixel
+	 */
+	VkVertexInputBindingDescription binding_description = {0};
+	binding_description.binding = 0;
+	binding_description.stride = sizeof(HudQuad);
+	binding_description.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+	VkVertexInputAttributeDescription attribute_descriptions[3] = {0};
+	attribute_descriptions[0].binding = 0;
+	attribute_descriptions[0].location = 0;
+	attribute_descriptions[0].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+	attribute_descriptions[0].offset = offsetof(HudQuad, rect);
+
+	attribute_descriptions[1].binding = 0;
+	attribute_descriptions[1].location = 1;
+	attribute_descriptions[1].format = VK_FORMAT_R8G8B8A8_UNORM;
+	attribute_descriptions[1].offset = offsetof(HudQuad, color);
+
+	attribute_descriptions[2].binding = 0;
+	attribute_descriptions[2].location = 2;
+	attribute_descriptions[2].format = VK_FORMAT_R32_UINT;
+	attribute_descriptions[2].offset = offsetof(HudQuad, glyph);
+
+	VkPushConstantRange push_constant_range = {0};
+	push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	push_constant_range.offset = 0;
+	push_constant_range.size = sizeof(HudPushConstants);
+
+	// The font, pushed once a frame
+	VkDescriptorType font_type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	vkx_push_set_init(&hud->font_set, &font_type, VK_SHADER_STAGE_FRAGMENT_BIT, 1, 1);
+
+	hud->pipeline = vkx_create_overlay_pipeline(
+		"shaders/hud.vert.spv",
+		"shaders/hud.frag.spv",
+		binding_description,
+		attribute_descriptions,
+		3,
+		push_constant_range,
+		&hud->font_set,
+		color_format
+	);
+	vkx_push_set_create_template(&hud->font_set, hud->pipeline.layout, VK_PIPELINE_BIND_POINT_GRAPHICS, 0);
+	hud_create_font(hud);
+
+	hud->quads = malloc(sizeof(HudQuad) * HUD_MAX_QUADS);
+	if (hud->quads == NULL) {
+		fprintf(stderr, "Failed to allocate the HUD quads\n");
+		exit(1);
+	}
+	hud->quads_count = 0;
+	hud->scale = scale;
+}
+
+void hud_cleanup(Hud* hud) {
+	vkx_push_set_cleanup(&hud->font_set);
+	vkx_cleanup_image(&hud->font_image);
+	vkx_cleanup_pipeline(hud->pipeline);
+	free(hud->quads);
+	hud->quads = NULL;
+	hud->quads_count = 0;
+}
+
+void hud_begin(Hud* hud, VkExtent2D output_size, uint32_t pre_rotation) {
+	/*
+	 * Start a new frame of the overlay
+	 *
+	 * @param output_size Size of the window, before the pre-rotation
+	 * @param pre_rotation Clockwise quarter turns of the swap chain
+	 */
+	hud->quads_count = 0;
+	hud->push_constants.output_size[0] = (float) output_size.width;
+	hud->push_constants.output_size[1] = (float) output_size.height;
+	hud->push_constants.pre_rotation = pre_rotation;
+}
+
+static void hud_add_quad(Hud* hud, float x, float y, float width, float height, uint32_t color, uint32_t glyph) {
+	if (hud->quads_count >= HUD_MAX_QUADS) {
+		return;
+	}
+
+	HudQuad* quad = &hud->quads[hud->quads_count++];
+	quad->rect[0] = x;
+	quad->rect[1] = y;
+	quad->rect[2] = width;
+	quad->rect[3] = height;
+	quad->color = color;
+	quad->glyph = glyph;
+}
+
+void hud_rect(Hud* hud, float x, float y, float width, float height, uint32_t color) {
+	hud_add_quad(hud, x, y, width, height, color, HUD_SOLID);
+}
+
+float hud_line_height(const Hud* hud) {
+	return HUD_GLYPH_HEIGHT * hud->scale;
+}
+
+float hud_text_scaled(Hud* hud, float x, float y, float scale, uint32_t color, const char* text) {
+	/*
+	 * Draw a line of text with its top left at x, y.  Lower case is drawn as
+	 * upper case, and anything the font doesn't have as a space
+	 *
+	 * @param scale Screen pixels per font pixel, which needn't be a whole number
+	 *
+	 * @return The x after the last character
+	 */
+	float width = HUD_GLYPH_WIDTH * scale;
+	float height = HUD_GLYPH_HEIGHT * scale;
+
+	for (const char* c = text; *c != '\0'; c++) {
+		int code = toupper((unsigned char) *c);
+		// Spaces aren't worth a quad
+		if (code > ' ' && code < ' ' + 64) {
+			hud_add_quad(hud, x, y, width, height, color, (uint32_t) (code - ' '));
+		}
+		x += width;
+	}
+
+	return x;
+}
+
+float hud_text(Hud* hud, float x, float y, uint32_t color, const char* text) {
+	/*
+	 * Draw text at the overlay's scale, see hud_text_scaled()
+	 */
+	return hud_text_scaled(hud, x, y, hud->scale, color, text);
+}
+
+float hud_printf(Hud* hud, float x, float y, uint32_t color, const char* format, ...) {
+	/*
+	 * Draw formatted text, see hud_text()
+	 */
+	char text[256];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(text, sizeof(text), format, args);
+	va_end(args);
+
+	return hud_text(hud, x, y, color, text);
+}
+
+void hud_graph(Hud* hud, float x, float y, float width, float height, const float* values,
+		uint32_t values_count, uint32_t first, float max_value, float warn_value) {
+	/*
+	 * Draw a bar for each value, oldest on the left, over a dark background
+	 * with a line at warn_value.  Bars over it are red
+	 *
+	 * @param values A ring of values_count values, the oldest at first
+	 * @param max_value The value at the top of the graph, higher ones are cut off
+	 */
+	hud_rect(hud, x, y, width, height, HUD_RGBA(0, 0, 0, 160));
+	if (values_count == 0 || max_value <= 0.0f) {
+		return;
+	}
+
+	float bar_width = width / (float) values_count;
+	for (uint32_t i = 0; i < values_count; i++) {
+		float value = values[(first + i) % values_count];
+		float bar_height = (value < max_value ? value : max_value) / max_value * height;
+		uint32_t color = value > warn_value ? HUD_RGBA(255, 64, 64, 255) : HUD_RGBA(64, 255, 96, 255);
+		hud_rect(hud, x + bar_width * (float) i, y + height - bar_height, bar_width, bar_height, color);
+	}
+
+	if (warn_value < max_value) {
+		float line_y = y + height - warn_value / max_value * height;
+		hud_rect(hud, x, line_y, width, hud->scale * 0.5f, HUD_RGBA(255, 255, 255, 128));
+	}
+}
+
+void hud_record(Hud* hud, VkCommandBuffer command_buffer, VkxRingBuffer* ring, uint32_t frame) {
+	/*
+	 * Draw the quads
+	 *
+	 * @param command_buffer The command buffer to record into (inside rendering
+	 *                       to the image the pipeline was created for)
+	 * @param ring The frame ring, which has to have room for HUD_MAX_QUADS
+	 * @param frame The frame in flight
+	 */
+	if (hud->quads_count == 0) {
+		return;
+	}
+
+	VkDeviceSize size = sizeof(HudQuad) * hud->quads_count;
+	VkxRingAllocation allocation = vkx_ring_buffer_alloc(ring, size);
+	memcpy(allocation.data, hud->quads, size);
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, hud->pipeline.pipeline);
+	VkxPushSetData font = {0};
+	font.image.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	font.image.imageView = hud->font_image.view;
+	font.image.sampler = hud->font_sampler;
+	vkx_push_set_begin_frame(&hud->font_set, frame);
+	vkx_cmd_push_set(&hud->font_set, command_buffer, &font);
+	vkCmdPushConstants(command_buffer, hud->pipeline.layout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+			sizeof(HudPushConstants), &hud->push_constants);
+	vkCmdBindVertexBuffers(command_buffer, 0, 1, &ring->buffer.buffer, &allocation.offset);
+	vkCmdDraw(command_buffer, 6, hud->quads_count, 0, 0);
+}
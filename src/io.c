@@ -1,8 +1,20 @@
 #include "io.h"
+#include "archive.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 char *read_entire_binary_file(const char *filename, size_t *size) {
 	printf(" Reading file %s\n", filename);
@@ -47,3 +59,161 @@ char *read_entire_binary_file(const char *filename, size_t *size) {
 	*size = bytes_read;
 	return buffer;
 }
+
+MappedFile map_file(const char *filename) {
+	/*
+	 * Map a whole file into memory rather than reading it, so nothing is copied
+	 * until the pages are touched (and they can be shared with the page cache).
+	 * The mounted archive (archive_mount()) is looked in first.  Like
+	 * read_entire_binary_file() this exits if the file can't be opened
+	 */
+	MappedFile file = {0};
+	if (archive_map_mounted(filename, &file)) {
+		return file;
+	}
+
+	return map_disk_file(filename);
+}
+
+MappedFile map_disk_file(const char *filename) {
+	/*
+	 * Map a file from the disk, ignoring any mounted archive
+	 */
+	printf(" Mapping file %s\n", filename);
+
+	MappedFile file = {0};
+
+#ifdef _WIN32
+	HANDLE file_handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file_handle == INVALID_HANDLE_VALUE) {
+		fprintf(stderr, "Failed to open file %s\n", filename);
+		exit(1);
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file_handle, &size)) {
+		fprintf(stderr, "Failed to get the size of file %s\n", filename);
+		exit(1);
+	}
+	file.size = (size_t) size.QuadPart;
+
+	// Empty files can't be mapped
+	if (file.size == 0) {
+		CloseHandle(file_handle);
+		return file;
+	}
+
+	HANDLE mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping_handle == NULL) {
+		fprintf(stderr, "Failed to map file %s\n", filename);
+		exit(1);
+	}
+
+	file.data = MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+	if (file.data == NULL) {
+		fprintf(stderr, "Failed to map file %s\n", filename);
+		exit(1);
+	}
+
+	file.file_handle = file_handle;
+	file.mapping_handle = mapping_handle;
+#else
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open file %s\n", filename);
+		exit(1);
+	}
+
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) != 0) {
+		fprintf(stderr, "Failed to get the size of file %s\n", filename);
+		exit(1);
+	}
+	file.size = (size_t) file_stat.st_size;
+
+	// Empty files can't be mapped
+	if (file.size > 0) {
+		void *data = mmap(NULL, file.size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			fprintf(stderr, "Failed to map file %s\n", filename);
+			exit(1);
+		}
+		file.data = data;
+	}
+
+	// The mapping keeps the file open
+	close(fd);
+#endif
+
+	return file;
+}
+
+void unmap_file(MappedFile *file) {
+	if (file->owned_data != NULL) {
+		free(file->owned_data);
+	}
+	else if (file->borrowed) {
+		// The archive owns it
+	}
+#ifdef _WIN32
+	else if (file->data != NULL) {
+		UnmapViewOfFile(file->data);
+		CloseHandle(file->mapping_handle);
+		CloseHandle(file->file_handle);
+	}
+#else
+	else if (file->data != NULL) {
+		munmap((void *) file->data, file->size);
+	}
+#endif
+
+	file->data = NULL;
+	file->size = 0;
+	file->owned_data = NULL;
+	file->borrowed = false;
+}
+
+bool write_entire_binary_file(const char *filename, const void *data, size_t size) {
+	/*
+	 * Write the data to a file, replacing anything that was there.  Unlike reading
+	 * this doesn't exit on failure as it's normally used for caches - it just
+	 * returns false
+	 */
+	printf(" Writing file %s\n", filename);
+
+	FILE *file = fopen(filename, "wb");
+
+	if (!file) {
+		fprintf(stderr, "Failed to open file %s for writing\n", filename);
+		return false;
+	}
+
+	size_t written = fwrite(data, 1, size, file);
+	fclose(file);
+
+	if (written != size) {
+		fprintf(stderr, "Failed to write file %s\n", filename);
+		return false;
+	}
+
+	return true;
+}
+
+bool file_exists(const char *filename) {
+	FILE *file = fopen(filename, "rb");
+
+	if (!file) {
+		return false;
+	}
+
+	fclose(file);
+	return true;
+}
+
+bool asset_exists(const char *filename) {
+	/*
+	 * Check whether map_file() would find a file, in the mounted archive or on
+	 * the disk
+	 */
+	return archive_mounted_has(filename) || file_exists(filename);
+}
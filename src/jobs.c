@@ -0,0 +1,556 @@
+/*
+ * Work stealing job system, shared by everything which splits work across the
+ * cores.
+ *
+ * Every thread which submits jobs has a deque of its own: the workers get one
+ * when they start, and any other thread (the main thread, the render thread)
+ * the first time it submits.  A thread pushes and pops jobs at the bottom of
+ * its own deque without any locks, and when it runs out it steals from the
+ * top of someone else's, so the work spreads out from wherever it was
+ * submitted and a thread mostly runs the jobs it made itself, which are still
+ * in its cache.  The deques are the fixed size Chase-Lev kind, and a job which
+ * doesn't fit runs straight away.
+ *
+ * A job can be given a JobCounter, which goes up when it's submitted and down
+ * when it finishes.  jobs_wait() runs other jobs until the counter gets to
+ * zero rather than blocking, so a job can submit children and wait for them.
+ * jobs_parallel_for() is batches on a counter, so it can be called from inside
+ * a job, or from several threads at once.
+ *
+ * Idle threads spin for a little in case more work turns up, then sleep until
+ * something is pushed (or, for jobs_wait(), a counter finishes).
+ */
+
+#if defined(__linux__)
+// For pthread_setaffinity_np()
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+#include "jobs.h"
+#include "arena.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Times an idle thread looks for work before it goes to sleep
+#define JOBS_IDLE_SPINS 64
+
+typedef struct {
+	// One of these is set
+	JobFunc func;
+	JobRangeFunc range_func;
+	void* data;
+	size_t start;
+	size_t end;
+	JobCounter* counter;
+} Job;
+
+typedef struct {
+	// The owner pushes and pops at the bottom and the thieves take from the
+	// top.  Both only go up (wrapping round), and index the slots modulo the
+	// size, so the jobs waiting are [top, bottom)
+	SDL_AtomicInt top;
+	SDL_AtomicInt bottom;
+	Job slots[JOBS_DEQUE_SIZE];
+} JobDeque;
+
+static SDL_Thread* workers[JOBS_MAX_WORKERS] = {0};
+static uint32_t workers_count = 0;
+
+// Threads' deques, of which the first deques_count are in use (the workers'
+// first).  A deque is only filled in before the count which includes it
+static JobDeque* deques[JOBS_MAX_THREADS] = {0};
+static SDL_AtomicInt deques_count = {0};
+// Goes up with every jobs_init(), so a thread doesn't use a deque from before
+// a restart
+static int jobs_generation = 0;
+
+static _Thread_local int thread_deque = -1;
+static _Thread_local int thread_generation = 0;
+static _Thread_local uint32_t thread_random = 0;
+
+// Jobs pushed which haven't been taken yet.  It goes up before a job can be
+// seen and down after it's taken, so it's never less than what's there, and
+// nobody sleeps while there's work
+static SDL_AtomicInt jobs_queued = {0};
+// Threads waiting on wake_condition, so pushing only takes the mutex when
+// there's someone to wake
+static SDL_AtomicInt sleeping_threads = {0};
+static SDL_AtomicInt quitting = {0};
+
+// Only for sleeping and waking
+static SDL_Mutex* jobs_mutex = NULL;
+// Signalled when jobs are pushed or a counter finishes (or we are quitting)
+static SDL_Condition* wake_condition = NULL;
+
+static bool jobs_deque_push(JobDeque* deque, const Job* job) {
+	/*
+	 * Push a job onto the bottom of this thread's own deque
+	 *
+	 * @return False if it's full
+	 */
+	uint32_t bottom = (uint32_t) SDL_GetAtomicInt(&deque->bottom);
+	uint32_t top = (uint32_t) SDL_GetAtomicInt(&deque->top);
+	if (bottom - top >= JOBS_DEQUE_SIZE) {
+		return false;
+	}
+
+	deque->slots[bottom % JOBS_DEQUE_SIZE] = *job;
+	// The SDL atomics are sequentially consistent, so the job is written before
+	// any thief can see the new bottom
+	SDL_SetAtomicInt(&deque->bottom, (int) (bottom + 1));
+	return true;
+}
+
+static bool jobs_deque_pop(JobDeque* deque, Job* job) {
+	/*
+	 * Take the most recently pushed job from this thread's own deque
+	 */
+	uint32_t bottom = (uint32_t) SDL_GetAtomicInt(&deque->bottom) - 1;
+	// Claim the bottom job before looking at the top, so a thief can't take it
+	// at the same time without one of us seeing the other
+	SDL_SetAtomicInt(&deque->bottom, (int) bottom);
+	uint32_t top = (uint32_t) SDL_GetAtomicInt(&deque->top);
+
+	int32_t remaining = (int32_t) (bottom - top);
+	if (remaining < 0) {
+		SDL_SetAtomicInt(&deque->bottom, (int) top);
+		return false;
+	}
+
+	*job = deque->slots[bottom % JOBS_DEQUE_SIZE];
+	if (remaining > 0) {
+		return true;
+	}
+
+	// The last job, which a thief might be taking from the top too
+	bool taken = SDL_CompareAndSwapAtomicInt(&deque->top, (int) top, (int) (top + 1));
+	SDL_SetAtomicInt(&deque->bottom, (int) (top + 1));
+	return taken;
+}
+
+static bool jobs_deque_steal(JobDeque* deque, Job* job) {
+	/*
+	 * Take the oldest job from another thread's deque
+	 *
+	 * @return False if it's empty or another thread got there first
+	 */
+	uint32_t top = (uint32_t) SDL_GetAtomicInt(&deque->top);
+	uint32_t bottom = (uint32_t) SDL_GetAtomicInt(&deque->bottom);
+	if ((int32_t) (bottom - top) <= 0) {
+		return false;
+	}
+
+	// Copied before it's claimed.  If the owner has wrapped round and written
+	// over the slot since, the top has moved on and the claim fails
+	Job stolen = deque->slots[top % JOBS_DEQUE_SIZE];
+	if (!SDL_CompareAndSwapAtomicInt(&deque->top, (int) top, (int) (top + 1))) {
+		return false;
+	}
+
+	*job = stolen;
+	return true;
+}
+
+static JobDeque* jobs_get_thread_deque(void) {
+	/*
+	 * Get this thread's deque, giving it one if it hasn't got one yet
+	 *
+	 * @return NULL if every deque is taken
+	 */
+	if (thread_generation == jobs_generation && thread_deque >= 0) {
+		return deques[thread_deque];
+	}
+
+	SDL_LockMutex(jobs_mutex);
+	int index = SDL_GetAtomicInt(&deques_count);
+	if (index < JOBS_MAX_THREADS) {
+		deques[index] = calloc(1, sizeof(JobDeque));
+		if (deques[index] == NULL) {
+			fprintf(stderr, "Failed to allocate a job deque\n");
+			exit(1);
+		}
+		SDL_SetAtomicInt(&deques_count, index + 1);
+	}
+	else {
+		index = -1;
+	}
+	SDL_UnlockMutex(jobs_mutex);
+
+	thread_deque = index;
+	thread_generation = jobs_generation;
+	thread_random = (uint32_t) index * 2654435761u + 1;
+	return index >= 0 ? deques[index] : NULL;
+}
+
+static void jobs_wake(bool everyone) {
+	/*
+	 * Wake a sleeping thread for a pushed job, or all of them when a counter
+	 * finishes (as it's one of the waiters which wants to know)
+	 */
+	if (SDL_GetAtomicInt(&sleeping_threads) == 0) {
+		return;
+	}
+
+	SDL_LockMutex(jobs_mutex);
+	if (everyone) {
+		SDL_BroadcastCondition(wake_condition);
+	}
+	else {
+		SDL_SignalCondition(wake_condition);
+	}
+	SDL_UnlockMutex(jobs_mutex);
+}
+
+static void jobs_run(const Job* job) {
+	// Whatever the job takes from the frame arena is given back when it
+	// returns, so a job run by a waiting thread leaves the waiter's alone
+	Arena* arena = frame_arena();
+	size_t mark = arena_get_mark(arena);
+
+	if (job->range_func != NULL) {
+		trace_begin("job batch");
+		job->range_func(job->start, job->end, job->data);
+	}
+	else {
+		trace_begin("job");
+		job->func(job->data);
+	}
+	trace_end();
+
+	arena_release(arena, mark);
+
+	// The counter can go as soon as it's zero (it's usually on the waiter's
+	// stack), so it isn't touched after
+	if (job->counter != NULL && SDL_AddAtomicInt(&job->counter->pending, -1) == 1) {
+		jobs_wake(true);
+	}
+}
+
+static bool jobs_push(const Job* job) {
+	/*
+	 * Push a job onto this thread's deque without waking anyone
+	 *
+	 * @return False if it couldn't be, in which case it's already been run
+	 */
+	if (job->counter != NULL) {
+		SDL_AddAtomicInt(&job->counter->pending, 1);
+	}
+
+	JobDeque* deque = workers_count > 0 ? jobs_get_thread_deque() : NULL;
+	if (deque != NULL) {
+		SDL_AddAtomicInt(&jobs_queued, 1);
+		if (jobs_deque_push(deque, job)) {
+			return true;
+		}
+		SDL_AddAtomicInt(&jobs_queued, -1);
+	}
+
+	// Nobody else to run it, or nowhere to put it
+	jobs_run(job);
+	return false;
+}
+
+static bool jobs_find(Job* job) {
+	/*
+	 * Take a job from this thread's deque, or failing that steal one
+	 */
+	JobDeque* own = NULL;
+	if (thread_generation == jobs_generation && thread_deque >= 0) {
+		own = deques[thread_deque];
+	}
+
+	bool found = own != NULL && jobs_deque_pop(own, job);
+	if (!found) {
+		// Start from a random deque, so the thieves don't all go for the same one
+		int count = SDL_GetAtomicInt(&deques_count);
+		thread_random ^= thread_random << 13;
+		thread_random ^= thread_random >> 17;
+		thread_random ^= thread_random << 5;
+		int first = count > 0 ? (int) (thread_random % (uint32_t) count) : 0;
+
+		for (int i = 0; i < count && !found; i++) {
+			JobDeque* victim = deques[(first + i) % count];
+			found = victim != own && jobs_deque_steal(victim, job);
+		}
+	}
+
+	if (found) {
+		SDL_AddAtomicInt(&jobs_queued, -1);
+	}
+	return found;
+}
+
+static void jobs_pin_thread(uint32_t core) {
+	/*
+	 * Keep this thread on one logical core
+	 */
+#if defined(__linux__)
+	cpu_set_t cores;
+	CPU_ZERO(&cores);
+	CPU_SET(core, &cores);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(cores), &cores) != 0) {
+		printf("Failed to pin a job worker to core %u\n", core);
+	}
+#elif defined(_WIN32)
+	if (core >= 64 || SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR) 1 << core) == 0) {
+		printf("Failed to pin a job worker to core %u\n", core);
+	}
+#else
+	// e.g. macOS only has affinity hints, so leave it to the scheduler
+	(void) core;
+#endif
+}
+
+typedef struct {
+	uint32_t index;
+	bool pin;
+} JobsWorkerStart;
+
+static JobsWorkerStart worker_starts[JOBS_MAX_WORKERS];
+
+static int jobs_worker_main(void* data) {
+	JobsWorkerStart* start = data;
+
+	trace_set_thread_name("job worker");
+
+	// Core 0 is left for the main thread
+	if (start->pin) {
+		jobs_pin_thread(start->index + 1);
+	}
+
+	// The workers' deques are the first ones
+	thread_deque = (int) start->index;
+	thread_generation = jobs_generation;
+	thread_random = start->index * 2654435761u + 1;
+
+	int spins = 0;
+	while (SDL_GetAtomicInt(&quitting) == 0) {
+		Job job;
+		if (jobs_find(&job)) {
+			jobs_run(&job);
+			spins = 0;
+			continue;
+		}
+
+		if (++spins < JOBS_IDLE_SPINS) {
+			SDL_CPUPauseInstruction();
+			continue;
+		}
+
+		// Counted as sleeping before looking at the queue, so whoever pushes
+		// next either sees us and wakes us, or we see their job
+		SDL_LockMutex(jobs_mutex);
+		SDL_AddAtomicInt(&sleeping_threads, 1);
+		while (SDL_GetAtomicInt(&quitting) == 0 && SDL_GetAtomicInt(&jobs_queued) <= 0) {
+			SDL_WaitCondition(wake_condition, jobs_mutex);
+		}
+		SDL_AddAtomicInt(&sleeping_threads, -1);
+		SDL_UnlockMutex(jobs_mutex);
+		spins = 0;
+	}
+
+	return 0;
+}
+
+void jobs_init(uint32_t num_workers, bool pin_threads) {
+	/*
+	 * Start the worker threads
+	 *
+	 * @param num_workers The number of worker threads to create.  If this is 0 we
+	 *                    create one per logical core, minus one for the main thread
+	 *                    which also does work in jobs_wait()
+	 * @param pin_threads Keep each worker on a core of its own, from core 1 up.
+	 *                    Only where the OS lets threads be pinned
+	 */
+	int num_cores = SDL_GetNumLogicalCPUCores();
+	if (num_workers == 0) {
+		num_workers = num_cores > 1 ? (uint32_t) num_cores - 1 : 0;
+	}
+
+	if (num_workers > JOBS_MAX_WORKERS) {
+		num_workers = JOBS_MAX_WORKERS;
+	}
+
+	jobs_mutex = SDL_CreateMutex();
+	wake_condition = SDL_CreateCondition();
+
+	if (jobs_mutex == NULL || wake_condition == NULL) {
+		fprintf(stderr, "Failed to create job system sync objects: %s\n", SDL_GetError());
+		exit(1);
+	}
+
+	jobs_generation++;
+	SDL_SetAtomicInt(&quitting, 0);
+	SDL_SetAtomicInt(&jobs_queued, 0);
+	SDL_SetAtomicInt(&sleeping_threads, 0);
+
+	// Every worker's deque is there before any of them can steal
+	for (uint32_t i = 0; i < num_workers; i++) {
+		deques[i] = calloc(1, sizeof(JobDeque));
+		if (deques[i] == NULL) {
+			fprintf(stderr, "Failed to allocate a job deque\n");
+			exit(1);
+		}
+	}
+	SDL_SetAtomicInt(&deques_count, (int) num_workers);
+
+	// With nothing to pin to, pinning would just pile the workers up
+	bool pin = pin_threads && num_workers < (uint32_t) num_cores;
+
+	for (workers_count = 0; workers_count < num_workers; workers_count++) {
+		worker_starts[workers_count].index = workers_count;
+		worker_starts[workers_count].pin = pin;
+		workers[workers_count] = SDL_CreateThread(jobs_worker_main, "job_worker", &worker_starts[workers_count]);
+		if (workers[workers_count] == NULL) {
+			fprintf(stderr, "Failed to create job worker thread: %s\n", SDL_GetError());
+			exit(1);
+		}
+	}
+
+	printf("Job system started with %d worker threads%s\n", workers_count, pin ? ", pinned to cores" : "");
+}
+
+void jobs_cleanup(void) {
+	/*
+	 * Stop and join all of the worker threads.  Nothing can be waiting on a job
+	 */
+	SDL_LockMutex(jobs_mutex);
+	SDL_SetAtomicInt(&quitting, 1);
+	SDL_BroadcastCondition(wake_condition);
+	SDL_UnlockMutex(jobs_mutex);
+
+	for (uint32_t i = 0; i < workers_count; i++) {
+		SDL_WaitThread(workers[i], NULL);
+		workers[i] = NULL;
+	}
+	workers_count = 0;
+
+	int count = SDL_GetAtomicInt(&deques_count);
+	for (int i = 0; i < count; i++) {
+		free(deques[i]);
+		deques[i] = NULL;
+	}
+	SDL_SetAtomicInt(&deques_count, 0);
+
+	SDL_DestroyCondition(wake_condition);
+	SDL_DestroyMutex(jobs_mutex);
+	wake_condition = NULL;
+	jobs_mutex = NULL;
+}
+
+uint32_t jobs_get_num_workers(void) {
+	return workers_count;
+}
+
+void jobs_submit(JobFunc func, void* data, JobCounter* counter) {
+	/*
+	 * Run func on whichever thread gets to it first.  With no workers (or no
+	 * room for it) it runs before this returns
+	 *
+	 * @param data User data passed through to func
+	 * @param counter Counts the job until it's finished, for jobs_wait(), or NULL
+	 */
+	Job job = {
+		.func = func,
+		.data = data,
+		.counter = counter,
+	};
+
+	if (jobs_push(&job)) {
+		jobs_wake(false);
+	}
+}
+
+bool jobs_is_done(JobCounter* counter) {
+	return SDL_GetAtomicInt(&counter->pending) == 0;
+}
+
+void jobs_wait(JobCounter* counter) {
+	/*
+	 * Block until every job submitted with counter has finished, running other
+	 * jobs on this thread meanwhile (this thread's own first)
+	 */
+	int spins = 0;
+	while (SDL_GetAtomicInt(&counter->pending) > 0) {
+		Job job;
+		if (jobs_find(&job)) {
+			jobs_run(&job);
+			spins = 0;
+			continue;
+		}
+
+		if (++spins < JOBS_IDLE_SPINS) {
+			SDL_CPUPauseInstruction();
+			continue;
+		}
+
+		// The rest are running elsewhere, so sleep until one of them finishes
+		// (or there's something to help with).  Like the workers, counted as
+		// sleeping before looking, so the last job's wake up isn't missed
+		SDL_LockMutex(jobs_mutex);
+		SDL_AddAtomicInt(&sleeping_threads, 1);
+		while (SDL_GetAtomicInt(&counter->pending) > 0 && SDL_GetAtomicInt(&jobs_queued) <= 0) {
+			SDL_WaitCondition(wake_condition, jobs_mutex);
+		}
+		SDL_AddAtomicInt(&sleeping_threads, -1);
+		SDL_UnlockMutex(jobs_mutex);
+		spins = 0;
+	}
+}
+
+void jobs_parallel_for(size_t count, size_t batch_size, JobRangeFunc func, void* data) {
+	/*
+	 * Call func for every batch in [0, count) spread across the worker threads.  The
+	 * calling thread also processes batches, and this blocks until everything is done.
+	 * It can be called from inside a job
+	 *
+	 * @param count The total number of items
+	 * @param batch_size The maximum number of items passed to each call of func
+	 * @param func The function to process a range of items
+	 * @param data User data passed through to func
+	 */
+	if (count == 0) {
+		return;
+	}
+
+	if (batch_size == 0) {
+		batch_size = 1;
+	}
+
+	size_t num_batches = (count + batch_size - 1) / batch_size;
+
+	// Not worth waking anyone up for this
+	if (workers_count == 0 || num_batches == 1) {
+		func(0, count, data);
+		return;
+	}
+
+	JobCounter counter = {0};
+
+	// Pushed last to first, so this thread pops from the start of the range
+	// while the thieves take from the end
+	bool pushed = false;
+	for (size_t batch = num_batches; batch-- > 0;) {
+		size_t start = batch * batch_size;
+		size_t end = start + batch_size;
+		Job job = {
+			.range_func = func,
+			.data = data,
+			.start = start,
+			.end = end < count ? end : count,
+			.counter = &counter,
+		};
+		pushed |= jobs_push(&job);
+	}
+
+	if (pushed) {
+		jobs_wake(true);
+	}
+	jobs_wait(&counter);
+}
@@ -0,0 +1,163 @@
+/*
+ * Level snapshots, for loading a level without generating it again (see
+ * level.h for the layout).
+ *
+ * The writer knows nothing about what the blobs are, main.c hands it the
+ * arrays.  Reading maps the whole snapshot with map_disk_file() and checks the
+ * header and the index, after which each blob is a pointer into the mapping
+ * that can be copied straight into the array (or staging buffer) it came out
+ * of.  Nothing is parsed per tile or per monster.
+ */
+
+#include "level.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static size_t level_align(size_t offset) {
+	return (offset + LEVEL_ALIGNMENT - 1) & ~(size_t) (LEVEL_ALIGNMENT - 1);
+}
+
+bool level_write(const char* filename, const LevelHeader* header, const LevelBlobData* blobs, uint32_t blobs_count) {
+	/*
+	 * Write a snapshot
+	 *
+	 * @param header The level's description.  The magic, version and count are
+	 *               filled in
+	 * @param blobs The arrays to save, at most one of each id
+	 *
+	 * @return false if the file couldn't be written
+	 */
+	size_t index_end = sizeof(LevelHeader) + sizeof(LevelBlob) * blobs_count;
+	size_t size = level_align(index_end);
+	for (uint32_t i = 0; i < blobs_count; i++) {
+		size = level_align(size + blobs[i].size);
+	}
+
+	uint8_t* data = calloc(1, size);
+	if (data == NULL) {
+		fprintf(stderr, "Failed to allocate %zu bytes for level %s\n", size, filename);
+		return false;
+	}
+
+	LevelHeader out_header = *header;
+	out_header.magic = LEVEL_MAGIC;
+	out_header.version = LEVEL_VERSION;
+	out_header.blobs_count = blobs_count;
+	memcpy(data, &out_header, sizeof(out_header));
+
+	size_t offset = level_align(index_end);
+	for (uint32_t i = 0; i < blobs_count; i++) {
+		LevelBlob blob = {
+			.id = blobs[i].id,
+			.offset = offset,
+			.size = blobs[i].size,
+		};
+		memcpy(data + sizeof(LevelHeader) + sizeof(LevelBlob) * i, &blob, sizeof(blob));
+		if (blobs[i].size > 0) {
+			memcpy(data + offset, blobs[i].data, blobs[i].size);
+		}
+		offset = level_align(offset + blobs[i].size);
+	}
+
+	bool written = write_entire_binary_file(filename, data, size);
+	free(data);
+	return written;
+}
+
+bool level_open(LevelSnapshot* level, const char* filename) {
+	/*
+	 * Map a snapshot and check its index
+	 *
+	 * @param filename The snapshot, which has to exist
+	 *
+	 * @return false (with the snapshot left closed) if it isn't a valid
+	 *         snapshot
+	 */
+	memset(level, 0, sizeof(LevelSnapshot));
+	level->file = map_disk_file(filename);
+
+	const uint8_t* data = level->file.data;
+	size_t size = level->file.size;
+
+	if (size < sizeof(LevelHeader)) {
+		fprintf(stderr, "Level %s is too small\n", filename);
+		level_close(level);
+		return false;
+	}
+	memcpy(&level->header, data, sizeof(LevelHeader));
+
+	if (level->header.magic != LEVEL_MAGIC || level->header.version != LEVEL_VERSION) {
+		fprintf(stderr, "Level %s isn't a version %d level\n", filename, LEVEL_VERSION);
+		level_close(level);
+		return false;
+	}
+
+	if (level->header.blobs_count > (size - sizeof(LevelHeader)) / sizeof(LevelBlob)) {
+		fprintf(stderr, "Level %s has a truncated index\n", filename);
+		level_close(level);
+		return false;
+	}
+
+	// The mapping is page aligned and the header is a multiple of 16 bytes, so
+	// the index can be used in place
+	level->blobs = (const LevelBlob*) (data + sizeof(LevelHeader));
+
+	for (uint32_t i = 0; i < level->header.blobs_count; i++) {
+		const LevelBlob* blob = &level->blobs[i];
+		bool in_file = blob->offset <= size && blob->size <= size - blob->offset;
+		bool aligned = blob->offset % LEVEL_ALIGNMENT == 0;
+
+		if (!in_file || !aligned || blob->id >= _LEVEL_BLOB_COUNT) {
+			fprintf(stderr, "Level %s has a bad blob %d\n", filename, i);
+			level_close(level);
+			return false;
+		}
+	}
+
+	printf("Opened level %s, %ux%u tiles and %u monsters\n", filename,
+		level->header.map_width, level->header.map_height, level->header.monsters_count);
+
+	return true;
+}
+
+void level_close(LevelSnapshot* level) {
+	unmap_file(&level->file);
+	memset(level, 0, sizeof(LevelSnapshot));
+}
+
+const void* level_get_blob(const LevelSnapshot* level, LevelBlobId id, size_t size) {
+	/*
+	 * Get a blob in place, valid until level_close()
+	 *
+	 * @param size The size the array it goes in has, which the blob has to be
+	 *
+	 * @return NULL if the snapshot doesn't have the blob, or it's a different
+	 *         size
+	 */
+	for (uint32_t i = 0; i < level->header.blobs_count; i++) {
+		const LevelBlob* blob = &level->blobs[i];
+		if (blob->id == (uint32_t) id) {
+			return blob->size == size ? (const uint8_t*) level->file.data + blob->offset : NULL;
+		}
+	}
+	return NULL;
+}
+
+bool level_copy_blob(const LevelSnapshot* level, LevelBlobId id, void* data, size_t size) {
+	/*
+	 * Copy a blob into the array it was saved from
+	 *
+	 * @return false, leaving the array alone, if the snapshot doesn't have the
+	 *         blob or it's a different size
+	 */
+	const void* blob = level_get_blob(level, id, size);
+	if (blob == NULL) {
+		return false;
+	}
+	if (size > 0) {
+		memcpy(data, blob, size);
+	}
+	return true;
+}
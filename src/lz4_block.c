@@ -0,0 +1,217 @@
+/*
+ * Compression and decompression of raw LZ4 blocks (no frame header), for the
+ * asset archive entries.
+ *
+ * The compressor is a simple greedy one with a hash table of 4 byte sequences,
+ * which is fast and compresses well enough for an offline packer.  Its output
+ * follows the block format's end rules (the last 5 bytes are literals and no
+ * match starts in the last 12), so any LZ4 decoder can read it.  The
+ * decompressor checks every length and offset against the buffers, as the
+ * archive could be corrupt.
+ */
+
+#include "lz4_block.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_MATCH 4
+#define LAST_LITERALS 5
+#define MATCH_FIND_LIMIT 12
+#define MAX_OFFSET 65535
+#define HASH_BITS 14
+
+static uint32_t lz4_read32(const uint8_t* p) {
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static uint32_t lz4_hash(uint32_t sequence) {
+	return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static bool lz4_write_length(uint8_t* dst, size_t dst_capacity, size_t* op, size_t length) {
+	// The part of a length which doesn't fit in the token's 4 bits
+	while (length >= 255) {
+		if (*op >= dst_capacity) {
+			return false;
+		}
+		dst[(*op)++] = 255;
+		length -= 255;
+	}
+
+	if (*op >= dst_capacity) {
+		return false;
+	}
+	dst[(*op)++] = (uint8_t) length;
+	return true;
+}
+
+static bool lz4_write_sequence(uint8_t* dst, size_t dst_capacity, size_t* op,
+		const uint8_t* literals, size_t literals_count, size_t offset, size_t match_length) {
+	/*
+	 * Write a token, its literals and (unless match_length is 0, for the last
+	 * sequence) the match
+	 */
+	if (*op >= dst_capacity) {
+		return false;
+	}
+
+	size_t token_op = (*op)++;
+	uint8_t token = (uint8_t) ((literals_count >= 15 ? 15 : literals_count) << 4);
+	if (literals_count >= 15 && !lz4_write_length(dst, dst_capacity, op, literals_count - 15)) {
+		return false;
+	}
+
+	if (*op + literals_count > dst_capacity) {
+		return false;
+	}
+	memcpy(dst + *op, literals, literals_count);
+	*op += literals_count;
+
+	if (match_length > 0) {
+		if (*op + 2 > dst_capacity) {
+			return false;
+		}
+		dst[(*op)++] = (uint8_t) (offset & 0xff);
+		dst[(*op)++] = (uint8_t) (offset >> 8);
+
+		size_t length = match_length - MIN_MATCH;
+		token |= (uint8_t) (length >= 15 ? 15 : length);
+		if (length >= 15 && !lz4_write_length(dst, dst_capacity, op, length - 15)) {
+			return false;
+		}
+	}
+
+	dst[token_op] = token;
+	return true;
+}
+
+size_t lz4_block_compress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_capacity) {
+	/*
+	 * Compress a block
+	 *
+	 * @param dst The output, which LZ4_BLOCK_BOUND(src_size) is always enough for
+	 *
+	 * @return The compressed size, or 0 if it didn't fit in dst_capacity
+	 */
+	// Positions + 1 of the last time each hash was seen, 0 for never
+	size_t* table = calloc(1 << HASH_BITS, sizeof(size_t));
+	if (table == NULL) {
+		return 0;
+	}
+
+	size_t op = 0;
+	size_t anchor = 0;
+	size_t ip = 0;
+
+	if (src_size > MATCH_FIND_LIMIT) {
+		size_t match_limit = src_size - LAST_LITERALS;
+
+		while (ip + MATCH_FIND_LIMIT < src_size) {
+			uint32_t sequence = lz4_read32(src + ip);
+			uint32_t hash = lz4_hash(sequence);
+			size_t candidate = table[hash];
+			table[hash] = ip + 1;
+
+			if (candidate == 0 || ip - (candidate - 1) > MAX_OFFSET || lz4_read32(src + candidate - 1) != sequence) {
+				ip++;
+				continue;
+			}
+
+			size_t match = candidate - 1;
+			size_t length = MIN_MATCH;
+			while (ip + length < match_limit && src[match + length] == src[ip + length]) {
+				length++;
+			}
+
+			if (!lz4_write_sequence(dst, dst_capacity, &op, src + anchor, ip - anchor, ip - match, length)) {
+				free(table);
+				return 0;
+			}
+
+			ip += length;
+			anchor = ip;
+		}
+	}
+
+	free(table);
+
+	if (!lz4_write_sequence(dst, dst_capacity, &op, src + anchor, src_size - anchor, 0, 0)) {
+		return 0;
+	}
+
+	return op;
+}
+
+static bool lz4_read_length(const uint8_t* src, size_t src_size, size_t* ip, size_t* length) {
+	uint8_t byte;
+	do {
+		if (*ip >= src_size) {
+			return false;
+		}
+		byte = src[(*ip)++];
+		*length += byte;
+	} while (byte == 255);
+	return true;
+}
+
+bool lz4_block_decompress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_size) {
+	/*
+	 * Decompress a block
+	 *
+	 * @param dst_size The exact size of the decompressed data
+	 *
+	 * @return false if the block is corrupt or doesn't decompress to dst_size
+	 */
+	size_t ip = 0;
+	size_t op = 0;
+
+	while (ip < src_size) {
+		uint8_t token = src[ip++];
+
+		size_t literals_count = token >> 4;
+		if (literals_count == 15 && !lz4_read_length(src, src_size, &ip, &literals_count)) {
+			return false;
+		}
+		if (literals_count > src_size - ip || literals_count > dst_size - op) {
+			return false;
+		}
+		memcpy(dst + op, src + ip, literals_count);
+		ip += literals_count;
+		op += literals_count;
+
+		// The last sequence has no match
+		if (ip == src_size) {
+			break;
+		}
+
+		if (src_size - ip < 2) {
+			return false;
+		}
+		size_t offset = (size_t) src[ip] | ((size_t) src[ip + 1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > op) {
+			return false;
+		}
+
+		size_t length = token & 15;
+		if (length == 15 && !lz4_read_length(src, src_size, &ip, &length)) {
+			return false;
+		}
+		length += MIN_MATCH;
+		if (length > dst_size - op) {
+			return false;
+		}
+
+		// The match can overlap what it writes, so byte by byte
+		const uint8_t* match = dst + op - offset;
+		for (size_t i = 0; i < length; i++) {
+			dst[op + i] = match[i];
+		}
+		op += length;
+	}
+
+	return op == dst_size;
+}
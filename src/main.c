@@ -6,13 +6,17 @@
  *
  * 1. Render the tilemap from vertex data to an offscreen image
  *
- *    This is straight forward - the vertices are stored in the obvious way
+ *    Each tile is a quad whose 4 vertices are just its position and tile value
+ *    (TileVertex), and the vertex shader works out the corners and texture
+ *    coordinates.  All of the quads share one index buffer
  *
  * 2. Render the sprites from a vertex buffer which contains the sprite data
  *
  *    This time the vertices are generated in the vertex shader, the transform
- *    data is stored in a uniform buffer and the "vertex" data actually stores
- *    offsets into the array of transforms in the uniform buffer.
+ *    data is stored in a storage buffer (one compact SpriteTransform per sprite)
+ *    and the "vertex" data actually stores offsets into the array of transforms
+ *    in the storage buffer.  The shared view-projection matrix is passed in
+ *    with the push constants.
  *
  *    Again this is rendered to an offscreen image.
  *
@@ -20,10 +24,25 @@
  *
  *    This serves 2 purposes - it allows us to keep the same resolution even if
  *    the window is resized (useful for pixel art) and also allows us to implement
- *    post processing effects.
+ *    post processing effects.  The scene can be rendered to just part of the
+ *    offscreen image (render_scale), which the screen pass scales up, and
+ *    with dynamic_resolution that scale follows the GPU frame time.  The
+ *    post-processing effects run in between (post_chain.c), and without any
+ *    this is a copy or blit rather than a draw.
  * 
  * In both of the first steps we use a depth buffer so that we can order the sprites
- * by their z-coordinate.
+ * by their z-coordinate, or without depth_buffer the sprites are sorted back to
+ * front and drawn either side of the tiles instead.
+ *
+ * The two passes are declared in a frame graph (vkx_frame_graph.c), which works
+ * out the layout transitions and barriers between them and owns the offscreen
+ * and depth images.
+ *
+ * With threaded_rendering the frames are recorded and submitted on a render
+ * thread (frame_pipeline.c).  The main thread handles the input and runs the
+ * simulation one frame ahead, handing each frame over as a FrameState snapshot.
+ * With parallel_recording the scene pass is recorded by the worker threads into
+ * secondary command buffers (vkx_secondary.c).
  *
  * Copyright (c) 2025 Stephen Brown
  *
@@ -45,58 +64,533 @@
 
 #include <cglm/cglm.h>
 
+#include "arena.h"
+#include "archive.h"
+#include "autotune.h"
+#include "bench.h"
+#include "camera.h"
+#include "capture.h"
+#include "damage.h"
+#include "debug_draw.h"
+#include "entity_pool.h"
+#include "flow_field.h"
+#include "frame_pipeline.h"
+#include "hot_reload.h"
+#include "hud.h"
 #include "io.h"
+#include "jobs.h"
+#include "level.h"
+#include "post_chain.h"
+#include "present_thread.h"
+#include "render_queue.h"
+#include "render_stream.h"
+#include "replay.h"
+#include "skeleton.h"
+#include "spike.h"
+#include "sprite_batch.h"
+#include "spatial_grid.h"
+#include "sprite_pool.h"
+#include "swarm.h"
+#include "systems.h"
+#include "telemetry.h"
+#include "tile_collision.h"
+#include "tile_store.h"
+#include "tilemap.h"
+#include "trace.h"
+#include "transform_tree.h"
+#include "tween.h"
+#include "update_tiers.h"
+#include "vertex_formats.h"
+#include "world_stream.h"
 
 #include "vkx/vkx.h"
+#include "vendor/stb_image.h"
 
-// Struct for vertex based geometry (i.e. the tiles)
-typedef struct {
-	vec3 pos;
-	vec2 tex_coord;
-} Vertex;
 
+// Split screen views at most, and the views' view-projections which are
+// corrected for each of them: the world's and each tile layer's (as they have
+// their own parallax), see write_view_corrections()
+#define MAX_VIEWS 4
+#define VIEW_SLOTS 3
+// Tiles of the tileset which can have an animation (see TILE_ANIMATIONS), at
+// least TILESET_TOTAL_TILES
+#define TILE_ANIMATION_SLOTS 16
 
 // Struct for the uniform buffer object for all shaders
 typedef struct {
 	// Time to use in shaders
 	float t;
-	// Matrices for sprites
-	// This is basically the limit to fit the ubo in 64k
-	mat4 mvps[1000];
+	float _padding;
+	// The part of the offscreen image the scene was rendered to, in texture
+	// coordinates and in pixels (for the screen shader)
+	float render_uv_scale[2];
+	float render_size[2];
+	// Non-zero to scale that up to the window with bilinear filtering,
+	// otherwise nearest
+	uint32_t bilinear_upscale;
+	// Clockwise quarter turns the screen shader rotates by to match the swap
+	// chain's pre-transform
+	uint32_t pre_rotation;
+	// Size of the window before the pre-rotation, for the pixel perfect scale
+	float output_size[2];
+	float _post_padding[2];
+	// Post-processing parameters, see the POST_ constants
+	float color_grade[4];
+	float bloom[4];
+	float crt[4];
+	// For each slot, the matrices taking the first view's view-projection to
+	// each of the other views'.  Column major like mat4, which can't be used
+	// here as the ring doesn't keep cglm's alignment
+	float view_corrections[VIEW_SLOTS][MAX_VIEWS - 1][16];
+	// For the lighting, the light with no lights on it, and each view's top
+	// left pixel in the world then the world units across and down a pixel
+	// (negative, as y goes up the world).  Tiles across and down each view,
+	// then the angles in each light's shadow map (0 without shadows) and
+	// SHADOW_BIAS
+	float ambient_light[4];
+	float light_views[MAX_VIEWS][4];
+	uint32_t light_tiles[2];
+	uint32_t shadow_resolution;
+	float shadow_bias;
+	// For each slot, the matrix moving the first view from the view-projection
+	// it was recorded with to the latched one, see write_late_latch()
+	float late_latch[VIEW_SLOTS][16];
+	// For each tile of the tileset, its frames (0 or 1 if it doesn't animate),
+	// the tiles from one frame to the next, and the float bits of its frames a
+	// second, see build_tile_animations()
+	uint32_t tile_animations[TILE_ANIMATION_SLOTS][4];
 } UniformBufferObject;
 
-// This struct stores a sprite in a vertex array
+// The screen and post-processing shaders only read the uniforms before the
+// views', so their sets only cover that much of the frame's
+#define SCREEN_UNIFORMS_SIZE offsetof(UniformBufferObject, view_corrections)
+
+// Compact per-sprite transform, stored in a storage buffer and expanded into
+// a quad in the sprite vertex shader.  Must match the std430 layout of the
+// SpriteTransform struct in sprite.vert (32 bytes)
 typedef struct {
-	// RGBA colour for rendering
-	vec4 color;
-	// Texture coordinates
-	vec2 uv;
-	vec2 uv2;
-	// Texture index
+	// Centre of the sprite in world space
+	vec2 pos;
+	// Width and height of the sprite
+	vec2 scale;
+	// Rotation around the centre in radians
+	float rotation;
+	// Depth (used for the depth test)
+	float z;
+	// Bob and squash, which the sprite shader animates from the time, see
+	// pack_sprite_animation().  0 for none
+	float anim_phase;
+	uint32_t anim_params;
+} SpriteTransform;
+
+// The largest animation amplitude (in world units) and angular frequency (in
+// radians a second) pack_sprite_animation() can hold
+#define SPRITE_ANIM_MAX_AMPLITUDE 1.0f
+#define SPRITE_ANIM_MAX_FREQUENCY 16.0f
+
+// Per-sprite simulation state, kept on the GPU when the sprites are simulated
+// in the compute shader.  Must match the std430 layout of SpriteState in
+// sprite_sim.comp (32 bytes)
+typedef struct {
+	vec2 pos;
+	vec2 velocity;
+	float z;
+	float _padding[3];
+} SpriteState;
+
+// Push constants for the sprite simulation compute shader
+typedef struct {
+	float dt;
+	// SpriteTransform.anim_params of every sprite
+	uint32_t anim_params;
+	// Sprites bounce off 0 and these
+	vec2 bounds;
+	float sprite_size;
+	uint32_t count;
+	// Room in the event buffer, 0 to write no events
+	uint32_t max_events;
+} SimPushConstants;
+
+// Which edges a sprite hit, in SpriteEvent.edges
+#define SPRITE_EDGE_RIGHT 0x1u
+#define SPRITE_EDGE_TOP 0x2u
+#define SPRITE_EDGE_LEFT 0x4u
+#define SPRITE_EDGE_BOTTOM 0x8u
+
+// A sprite bouncing off an edge, appended by sprite_sim.comp.  Must match the
+// std430 layout of SpriteEvent there (16 bytes)
+typedef struct {
+	uint32_t sprite;
+	uint32_t edges;
+	vec2 pos;
+} SpriteEvent;
+
+// The start of the event buffer, before the events
+typedef struct {
+	// How many were appended, which can be more than fit
+	uint32_t count;
+	uint32_t _padding[3];
+} SpriteEventHeader;
+
+// Push constants for the sprite culling compute shader
+typedef struct {
+	// Shared view-projection matrix, the same as the sprite shader uses
+	mat4 view_projection;
+	uint32_t count;
+	// 1 for instanced sprites, 6 otherwise
+	uint32_t vertices_per_sprite;
+	// The occlusion mask's first tile and its size (0 wide without one), and
+	// the z the sprites further than are behind the map
+	int32_t occlusion_origin[2];
+	uint32_t occlusion_size[2];
+	uint32_t occlusion_words_per_row;
+	float occluder_z;
+} CullPushConstants;
+
+// Push constants for sprite.task and sprite.mesh
+typedef struct {
+	mat4 mvp;
+	// What any of the views can see, as min x, min y, max x, max y
+	vec4 visible_rect;
+	// The sprite records, the same ones the culling shader would read
+	VkDeviceAddress records_address;
+	uint32_t count;
+	uint32_t vertices_per_sprite;
+} MeshSpritePushConstants;
+
+// A particle, only ever on the GPU.  Must match the std430 layout of Particle
+// in particle_emit.comp and particle_update.comp (64 bytes)
+typedef struct {
+	vec2 pos;
+	vec2 velocity;
+	float age;
+	// Dead once age reaches it, and dead particles have 0
+	float lifetime;
+	float size;
+	float gravity;
+	float z;
+	// The words of its VertexBufferSprite, from the emitter
+	uint32_t color;
+	uint32_t uv;
+	uint32_t uv2;
 	uint32_t texture_index;
-	// Index into arrays in ubo
-	uint32_t sprite_index;
+	float _padding[3];
+} Particle;
+
+// The most particle emitters there can be, see add_particle_emitter()
+#define MAX_PARTICLE_EMITTERS 64
+
+// The most lights there can be, see add_light()
+#define MAX_LIGHTS 1024
+// The most rows of the shadows' occluder map updated in a frame, the rest
+// wait for the next ones
+#define MAX_OCCLUDER_ROWS_PER_FRAME 64
+
+// What the particles spawned this frame start as, written into the frame ring.
+// Must match the std430 layout of ParticleEmitter in particle_emit.comp (64
+// bytes)
+typedef struct {
+	vec2 pos;
+	vec2 velocity;
+	// Largest speed added in a random direction
+	float spread;
+	// Longest a particle lives, some only live half of it
+	float lifetime;
+	float size;
+	// Added to the y velocity every second
+	float gravity;
+	float z;
+	// The words of the particles' VertexBufferSprite, see make_sprite_record()
+	uint32_t color;
+	uint32_t uv;
+	uint32_t uv2;
+	uint32_t texture_index;
+	// Its particles are [first_spawn, first_spawn + spawn_count) of the frame's
+	uint32_t first_spawn;
+	uint32_t spawn_count;
+	uint32_t _padding;
+} ParticleEmitter;
+
+// Push constants for both of the particle compute shaders
+typedef struct {
+	float dt;
+	// Changes every frame, for the random numbers
+	uint32_t seed;
+	uint32_t capacity;
+	uint32_t emitters_count;
+	// Particles spawned this frame, from all of the emitters
+	uint32_t spawn_count;
+	// 1 for instanced sprites, 6 otherwise
+	uint32_t vertices_per_sprite;
+} ParticlePushConstants;
+
+// A point light, see add_light().  Must match the std430 layout of Light in
+// light_cull.comp and the lit fragment shaders (32 bytes)
+typedef struct {
+	vec2 pos;
+	// Lights nothing further away than this
+	float radius;
+	// How far above the world it is, the lower the more it lights surfaces
+	// facing it rather than the viewer
+	float height;
+	float color[3];
+	float intensity;
+} Light;
+
+// Push constants for the light culling compute shader
+typedef struct {
+	uint32_t count;
+} LightCullPushConstants;
+
+// Push constants for the shadow map compute shader
+typedef struct {
+	uint32_t count;
+	uint32_t resolution;
+	// The occluder map's size in tiles, and the 64 bit words in each row
+	uint32_t map_width;
+	uint32_t map_height;
+	uint32_t words_per_row;
+} ShadowMapPushConstants;
+
+// Specialization constants of the tile and sprite fragment shaders
+typedef struct {
+	// The SpritePipeline the sprite shaders are for: opaque doesn't discard,
+	// cutouts discard below alpha_cutoff and translucent sprites only discard
+	// fully transparent pixels (the tiles are always alpha tested)
+	uint32_t alpha_mode;
+	float alpha_cutoff;
+	// Cutouts turn their alpha into coverage instead, see alpha_to_coverage
+	VkBool32 alpha_to_coverage;
+} FragmentSpecialization;
+
+// Specialization constants of the skinned characters' pipeline: sprite.frag's,
+// then the bones in each of skinned.vert's palettes
+typedef struct {
+	FragmentSpecialization fragment;
+	uint32_t bones_count;
+} SkinnedSpecialization;
+
+// The low bits of VertexBufferSprite.texture_index are the texture, and the
+// rest are flags
+#define SPRITE_TEXTURE_BITS 12
+#define SPRITE_TEXTURE_MASK ((1u << SPRITE_TEXTURE_BITS) - 1)
+// Mirror the texture coordinates across the sprite
+#define SPRITE_FLAG_FLIP_X (1u << 12)
+#define SPRITE_FLAG_FLIP_Y (1u << 13)
+// The sprite's row of the palettes with palette_textures, and 0 otherwise as
+// only sprite_palette.frag ignores these bits
+#define SPRITE_PALETTE_SHIFT 14
+#define SPRITE_PALETTE(palette) ((uint32_t) (palette) << SPRITE_PALETTE_SHIFT)
+
+// This struct stores a sprite in a vertex array, packed as the vertex input
+// formats in get_sprite_attribute_descriptions() unpack it.  The fields are
+// SPRITE_VERTEX_FIELDS in vertex_formats.h
+typedef struct {
+	SPRITE_VERTEX_FIELDS(VERTEX_STRUCT_FIELD, VERTEX_STRUCT_PAD, VertexBufferSprite)
 } VertexBufferSprite;
 
+// A sprite with the rest of its VertexBufferSprite in the frame table, with
+// sprite_frame_table.  The fields are FRAMED_SPRITE_VERTEX_FIELDS in
+// vertex_formats.h
+typedef struct {
+	FRAMED_SPRITE_VERTEX_FIELDS(VERTEX_STRUCT_FIELD, VERTEX_STRUCT_PAD, VertexBufferFramedSprite)
+} VertexBufferFramedSprite;
+
+// A frame of the frame table, std430 for sprite_framed.vert
+typedef struct {
+	// uv then uv2, unpacked
+	float rect[4];
+	// The texture bits of VertexBufferSprite.texture_index, and its trim
+	uint32_t texture_index;
+	uint32_t trim;
+	uint32_t padding[2];
+} SpriteFrame;
+
+// A vertex of a skinned mesh, SKINNED_VERTEX_FIELDS in vertex_formats.h
+typedef struct {
+	SKINNED_VERTEX_FIELDS(VERTEX_STRUCT_FIELD, VERTEX_STRUCT_PAD, SkinnedVertex)
+} SkinnedVertex;
+
 // Push constants - are used by the tilemap (default) shader
 typedef struct {
 	// Single combined model view projection matrix
     mat4 mvp;
 	// RGBA colour for rendering
 	vec4 color;
-	// Texture index
+	// Texture atlas layer
 	uint32_t texture_index;
+	// With vertex_pulling, where the sprite records or tile vertices being
+	// drawn are.  Pushed by itself, see bind_vertex_records()
+	VkDeviceAddress records_address;
+	// Only used by tiles.vert, which works out the texture coordinates of the
+	// tiles.  Where the tileset is in the atlas, offset then scale
+	vec4 tileset_rect;
+	uint32_t tileset_x_tiles;
+	uint32_t tileset_y_tiles;
+	uint32_t empty_tile;
+	// Which of the VIEW_SLOTS the split screen views are corrected with
+	uint32_t view_slot;
 } PushConstants;
 
-// Monster struct for game logic
+// Push constants for the tile texture shaders
 typedef struct {
-	vec3 pos;
-	vec2 spd;
-	vec4 color;
-	uint32_t texture;
-} Monster;
+	mat4 mvp;
+	// Where the tileset is in the atlas, offset then scale
+	vec4 tileset_rect;
+	// Atlas layer or texture table index of the tileset
+	uint32_t texture_index;
+	uint32_t tileset_x_tiles;
+	uint32_t tileset_y_tiles;
+	uint32_t empty_tile;
+} TileMapPushConstants;
+
+// A tile which needs copying into the tile texture
+typedef struct {
+	uint32_t x;
+	uint32_t y;
+} TileEdit;
+
+typedef struct {
+	// How far the layer moves with the camera (1 moves with the map)
+	float parallax;
+	// Depth of the layer, larger is further away
+	float z;
+	// Static layers are rendered once into an image if it's small enough
+	bool is_static;
+} TileLayerDesc;
+
+// A tile of the tileset which animates by itself, stepping through the tiles
+// after it in the tileset
+typedef struct {
+	uint32_t tile;
+	// Including the tile itself
+	uint32_t frames;
+	// Tiles in the tileset from one frame to the next
+	uint32_t stride;
+	float fps;
+} TileAnimation;
 
-// Texture indices
+typedef struct {
+	TileLayerDesc desc;
+	// Big enough to cover the view wherever the camera is
+	uint32_t width;
+	uint32_t height;
+	uint8_t* tiles;
+	// The layer's chunks, unless it's cached
+	Tilemap tilemap;
+	// The cached image of the whole layer and the descriptor set for drawing it
+	bool cached;
+	VkxImage cache_image;
+	VkDescriptorSet cache_descriptor_set;
+} TileLayer;
+
+// Unless a benchmark scenario says otherwise (see monsters_count)
+#define DEFAULT_MONSTERS 1000
+
+// Monster data for game logic, stored as a structure of arrays so that the
+// simulation and transform loops only stream through the fields they use.
+// Each array has monsters_count elements
+typedef struct {
+	// Position, and where it was before the last step
+	float* x;
+	float* y;
+	float* z;
+	float* prev_x;
+	float* prev_y;
+	// Speed
+	float* vx;
+	float* vy;
+	// SpriteTransform.anim_phase, so that they don't all bob together
+	float* anim_phase;
+	// Only used when creating the sprites
+	vec4* color;
+	uint32_t* texture;
+	// SpritePipeline, from how transparent the sprite's frame is
+	uint32_t* pipeline;
+} Monsters;
+
+// Projectile data, in the columns of projectile_pool so that it stays packed
+// as projectiles come and go.  Each array has projectile_pool.count elements
+typedef struct {
+	float* x;
+	float* y;
+	float* prev_x;
+	float* prev_y;
+	float* vx;
+	float* vy;
+	// Seconds left until it's gone
+	float* life;
+	uint32_t* texture;
+} Projectiles;
+
+// The components of the monsters which the update systems read and write (see
+// create_update_systems()), and what's built from them
+#define MONSTER_COMPONENT_X (1u << 0)
+#define MONSTER_COMPONENT_Y (1u << 1)
+#define MONSTER_COMPONENT_VX (1u << 2)
+#define MONSTER_COMPONENT_VY (1u << 3)
+#define MONSTER_COMPONENT_PREVIOUS (1u << 4)
+#define MONSTER_COMPONENT_GRID (1u << 5)
+#define MONSTER_COMPONENT_FLOW_FIELD (1u << 6)
+// And of the projectiles
+#define PROJECTILE_COMPONENT_POSITION (1u << 0)
+#define PROJECTILE_COMPONENT_VELOCITY (1u << 1)
+#define PROJECTILE_COMPONENT_PREVIOUS (1u << 2)
+
+// One axis of the monsters for bounce_axis()
+typedef struct {
+	float** pos;
+	float** spd;
+	// The far edge of the play area
+	float max;
+} BounceAxis;
+
+// What the renderer reads from the simulation for a frame.  With the render
+// thread the simulation writes the next frame's while this one is drawn
+typedef struct {
+	double t;
+	// Time step for the GPU sprite simulation
+	float sprite_sim_dt;
+	// Where the views' cameras were, with their matrices and visible
+	// rectangles
+	Camera cameras[MAX_VIEWS];
+	// Monster positions, the rest of the monster data doesn't change.  They're
+	// drawn the fraction interpolation of the way from the previous step's
+	float* x;
+	float* y;
+	float* prev_x;
+	float* prev_y;
+	float interpolation;
+	// How long the update took, for the HUD
+	double update_ms;
+	// What the update drew with sprite_draw()
+	SpriteBatch sprites;
+	// And with debug_draw_line() and the rest, see draw_debug_shapes()
+	DebugDrawList debug_lines;
+	// The retained sprites which changed: their ranges of slots, and their
+	// data one range after another
+	SpritePoolRange* retained_ranges;
+	uint32_t retained_ranges_count;
+	SpriteTransform* retained_transforms;
+	VertexBufferSprite* retained_records;
+	uint32_t retained_changed_count;
+	// Retained slots to draw
+	uint32_t retained_slots_count;
+	// The particle emitters, with how many particles they spawn this frame
+	ParticleEmitter particle_emitters[MAX_PARTICLE_EMITTERS];
+	uint32_t particle_emitters_count;
+	uint32_t particles_spawned;
+	// The lights, for the light culling shader
+	Light lights[MAX_LIGHTS];
+	uint32_t lights_count;
+	// With shadows, the rows of the occluder map which changed and their
+	// words of tile_solidity
+	uint32_t occluder_rows[MAX_OCCLUDER_ROWS_PER_FRAME];
+	uint32_t occluder_rows_count;
+	uint64_t* occluder_words;
+} FrameState;
+
+// Texture indices (regions in the texture atlas)
 enum Texture {
 	TEX_TILES,
 	TEX_MONSTERS,
@@ -107,38 +601,953 @@ enum Texture {
 	_TEX_COUNT
 };
 
+// In the same order as the Texture enum
+const char* const TEXTURE_FILENAMES[_TEX_COUNT] = {
+	"textures/tiles.png",
+	"textures/monsters1.png",
+	"textures/monsters2.png",
+	"textures/monsters3.png",
+	"textures/monsters4.png",
+};
+
+// Their normal maps for the lighting, the same size as the textures.  The
+// textures without one are flat
+const char* const NORMAL_MAP_FILENAMES[_TEX_COUNT] = {
+	"textures/tiles_normal.png",
+	"textures/monsters1_normal.png",
+	"textures/monsters2_normal.png",
+	"textures/monsters3_normal.png",
+	"textures/monsters4_normal.png",
+};
+
+// The longer side each texture (and its normal map) is kept at least, however
+// little memory the device has (see texture_quality_levels).  0 for
+// VKX_TEXTURE_QUALITY_MIN_SIZE, UINT32_MAX to always load it whole
+const uint32_t TEXTURE_MIN_SIZES[_TEX_COUNT] = {
+	// Pixel art, which halving blurs
+	UINT32_MAX,
+	0,
+	0,
+	0,
+	0,
+};
+
+// The monster sheets are a grid of this many frames each way
+#define MONSTER_FRAMES_X 4
+#define MONSTER_FRAMES_Y 4
+
 #define TILESET_X_TILES 3
 #define TILESET_Y_TILES 3
 
 #define TILESET_TOTAL_TILES (TILESET_X_TILES * TILESET_Y_TILES)
 #define EMPTY TILESET_TOTAL_TILES
 
+// Animate tiles of the tileset, e.g. water or torches, in the tile shaders.
+// They pick each tile's frame from ubo.t, so the tiles themselves never change
+// and there's nothing to rewrite or upload.  Cached static layers keep the
+// first frames
+const bool animated_tiles = false;
+const TileAnimation TILE_ANIMATIONS[] = {
+	{6, 3, 1, 4.0f},
+};
+
 #define X_TILES 32
 #define Y_TILES 24
 
 #define TOTAL_TILES (X_TILES * Y_TILES)
 
-#define NUM_MONSTERS 1000
+// Use a big map split into chunks which are built and drawn as the camera gets
+// near them.  When false the map is the size of the screen and is drawn from
+// one static vertex buffer.  A benchmark scenario with a big map turns it on
+bool chunked_tilemap = false;
+// Or draw a big map as a single quad, with the shader looking each tile up in
+// an image of the tile indices.  Changing a tile is then a one texel copy
+const bool tile_texture_tilemap = false;
+// Keep a chunked map's tiles in a sparse tile store (tile_store.h), which only
+// has memory for the chunks with something in them, rather than in an array
+// of the whole map
+const bool sparse_tiles = false;
+// Stream a sparse map's chunks in from region files (world_stream.h) as the
+// camera nears them, and evict them again once they're far away, rather than
+// keeping all of it in memory.  The first run writes the generated map to
+// them, and later ones load it from there
+const bool streamed_world = false;
+// The region files are named this then their coordinates, e.g. world_0_0.vxr
+const char* WORLD_REGION_PREFIX = "world";
+// Bytes of streamed chunks kept before the least recently used are evicted
+#define WORLD_MEMORY_BUDGET (16 * 1024 * 1024)
+// Depth of the map, larger is further away.  The monsters are either side
+#define TILE_MAP_Z 10.0f
+// Size of the map for either of the above
+#define LARGE_MAP_X_TILES 1024
+#define LARGE_MAP_Y_TILES 1024
+// Most tiles copied into the tile texture in a frame, any more wait for the next
+#define MAX_TILE_EDITS_PER_FRAME 256
+// Zoomed out past CHUNK_IMPOSTOR_ZOOM in every view, draw the chunked map as
+// impostors: an image of each chunk, rendered once into a slot of an atlas and
+// drawn as one quad, and only rendered again when one of its tiles changes.
+// The camera can then zoom out to CHUNK_IMPOSTOR_MIN_ZOOM.  The impostors keep
+// the animated tiles at their first frames
+const bool chunk_impostors = false;
+const float CHUNK_IMPOSTOR_ZOOM = 0.125f;
+const float CHUNK_IMPOSTOR_MIN_ZOOM = 1.0f / 16.0f;
+// Pixels per tile in the impostors, as many as on screen at CHUNK_IMPOSTOR_ZOOM
+#define CHUNK_IMPOSTOR_TILE_PIXELS 4
+// Width and height of the atlas, which has a slot for every chunk in view at
+// the furthest zoom
+#define CHUNK_IMPOSTOR_ATLAS_SIZE 2048
+// Most impostors rendered in a frame, the chunks past that which don't have one
+// yet wait for the next frames
+#define CHUNK_IMPOSTOR_RENDERS_PER_FRAME 16
+#define CHUNK_IMPOSTOR_SLOT_PIXELS (TILEMAP_CHUNK_SIZE * CHUNK_IMPOSTOR_TILE_PIXELS)
+#define CHUNK_IMPOSTOR_SLOTS_X (CHUNK_IMPOSTOR_ATLAS_SIZE / CHUNK_IMPOSTOR_SLOT_PIXELS)
+#define CHUNK_IMPOSTOR_SLOTS (CHUNK_IMPOSTOR_SLOTS_X * CHUNK_IMPOSTOR_SLOTS_X)
+
+// Draw extra tile layers behind the map, each with their own tiles, z and
+// parallax.  They are drawn from chunks like the chunked tilemap
+const bool tile_layers = false;
+#define TILE_LAYERS_COUNT 2
+const TileLayerDesc TILE_LAYER_DESCS[TILE_LAYERS_COUNT] = {
+	{0.25f, 21.0f, true},
+	{0.5f, 20.0f, false},
+};
+#if VIEW_SLOTS != 1 + TILE_LAYERS_COUNT
+#error "The views need a correction for each tile layer"
+#endif
+// Pixels per tile in the cached images of the static layers (the same as on screen)
+#define TILE_LAYER_CACHE_TILE_PIXELS 32
+
+// Arrow keys scroll the camera at this many tiles per second
+const float CAMERA_SPEED = 16.0f;
+// Each notch of the mouse wheel zooms by this much, within the range
+const float CAMERA_ZOOM_STEP = 1.25f;
+const float CAMERA_MIN_ZOOM = 0.5f;
+const float CAMERA_MAX_ZOOM = 4.0f;
+// Tiles the camera shakes by at full trauma (K adds some), and how much of
+// the trauma wears off a second
+const float CAMERA_MAX_SHAKE = 0.5f;
+const float CAMERA_SHAKE_DECAY = 1.5f;
+const float CAMERA_SHAKE_TRAUMA = 0.5f;
+// Snap the view to whole pixels of the window's size
+const bool camera_pixel_snap = true;
+
+// Split screen for local multiplayer: this many views (1 to MAX_VIEWS), each
+// with a camera of its own.  They are all rendered in one pass with multiview,
+// into the layers of an image which is then copied into place on the screen.
+// Two are side by side, three or four in the quarters of the screen.  Tab
+// picks which one the arrow keys, mouse wheel and K move
+const uint32_t split_screen_views = 1;
+
+// Compiled pipelines are saved here so they don't have to be rebuilt every launch
+const char* PIPELINE_CACHE_FILENAME = "pipeline_cache.bin";
+// And decoded textures here, so the images are only decoded once (NULL to
+// decode them every time)
+const char* TEXTURE_CACHE_DIRECTORY = "texture_cache";
+// On the first run on a device (or after the driver changes) time the paths
+// which are only faster on some GPUs, and take the fastest, saved here for
+// later runs (see autotune.c): the frame ring in device local memory or not,
+// and the size of the transforms' jobs.  Not while benchmarking, so every
+// run of a scenario takes the same paths
+const bool autotune_render_paths = true;
+const char* AUTOTUNE_FILENAME = "autotune.bin";
+// The job sizes it tries, and how many times it runs each over the monsters
+const uint32_t AUTOTUNE_JOB_SIZES[] = {1024, 2048, 4096, 8192, 16384};
+#define AUTOTUNE_JOB_ITERATIONS 32
+
+// If this archive (from the pack_assets tool) exists the shaders and textures
+// are loaded from it, otherwise they are loose files
+const char* ASSET_ARCHIVE_FILENAME = "assets.pak";
+Archive asset_archive = {0};
+
+// The snapshot --level loads the tiles and monsters from, open until they're
+// created (see open_level())
+LevelSnapshot level_snapshot = {0};
+bool level_loaded = false;
 
 const bool limit_fps = false;
 const double min_frame_time = 1.0 / 120.0;
 
-uint8_t tiles[X_TILES * Y_TILES] = {0};
+// Don't draw while the window is minimised, hidden or covered, or while the
+// next frame would look like the last one (nothing moved, see
+// frame_is_unchanged()).  The main loop then sleeps until an event comes in,
+// or IDLE_WAKE_MS passes for the simulation to catch up.  Headless frames,
+// benchmarks and recordings are always drawn
+const bool skip_idle_frames = true;
+#define IDLE_WAKE_MS 100
+
+// Frames the CPU can record while the GPU works on the earlier ones, from 1
+// (lowest latency) to VKX_MAX_FRAMES_IN_FLIGHT (most overlap when CPU bound)
+const uint32_t FRAMES_IN_FLIGHT = 2;
+// Wait for the frames in flight on the frame timeline semaphore rather than
+// on their fences.  Either way everything which is freed once the GPU is done
+// with it (tilemap chunks, texture table indices) goes by the timeline
+const bool timeline_frame_sync = false;
+
+// Record and submit the frames on a render thread, while the main thread reads
+// the input and simulates the next frame.  This adds a frame of latency, but
+// the simulation and the wait for the GPU overlap instead of adding up
+const bool threaded_rendering = true;
+
+// Record the scene pass on the worker threads into secondary command buffers,
+// which the frame's command buffer then executes in order.  The tiles and the
+// sprites aren't timed separately on the GPU with this
+const bool parallel_recording = false;
+// Secondary command buffers the sprites are split between (the tiles get one
+// more of their own)
+#define SPRITE_RECORDING_JOBS 4
+
+// Keep the tiles and the screen blit in secondary command buffers which are
+// replayed every frame, and only recorded again when something they use
+// changes (the camera, the ring offsets, the render area, the tiles or the
+// swap chain).  Like parallel_recording, the tiles and the sprites aren't
+// timed separately on the GPU with this
+const bool static_command_buffers = false;
+
+// Present mode for the swap chain (FIFO if the surface doesn't have it), and
+// the number of images, 0 for one more than the minimum.  F5 cycles through
+// the present modes
+VkPresentModeKHR present_mode = VK_PRESENT_MODE_MAILBOX_KHR;
+const uint32_t SWAP_CHAIN_IMAGE_COUNT = 0;
+
+// Create the swap chain in the display's native orientation and rotate in the
+// screen pass, which saves the compositor a full screen rotation on rotated
+// displays (e.g. phones and kiosks).  Does nothing on most desktops
+const bool pre_rotated_swap_chain = true;
+
+// Acquire and present the swap chain images on a thread of their own (see
+// present_thread.c), so the frames are never held up in the driver or by the
+// compositor there, only if the image they need isn't ready yet.  Needs a
+// present queue apart from the graphics queue (a second one of its family on
+// most desktop GPUs), and isn't with EXTRA_WINDOWS.  Low latency pacing sleeps
+// to the refresh rate rather than waiting for the presents with it
+const bool threaded_present = false;
+
+// Windows to open on the other displays (up to VKX_MAX_WINDOWS), which show
+// the main window's finished frame scaled to fit.  They share the device,
+// pipelines and textures, only their swap chains are their own, and every
+// window is presented in the one vkQueuePresentKHR.  The main swap chain isn't
+// pre-rotated with them
+#define EXTRA_WINDOWS 0
+
+// Start each frame as late as possible so the input it reads is fresh when it
+// reaches the screen (F6 toggles it).  With VK_KHR_present_wait this waits for
+// the earlier presents to be displayed, otherwise frames are paced to the
+// display's refresh rate
+bool low_latency = false;
+// Presents which can be queued while the next frame is made.  0 gives the
+// lowest latency, but then the CPU and GPU don't overlap
+const uint64_t LOW_LATENCY_QUEUED_PRESENTS = 1;
+
+// Move the scene to the main thread's newest camera just before the frame is
+// submitted, rather than drawing it from the camera it was recorded with.  The
+// vertex shaders apply the difference from the uniforms (late_latch in
+// UniformBufferObject).  With threaded_rendering the main thread is a frame
+// ahead, so the view follows the input a frame sooner.  The culling, the
+// streaming and the lighting still go by the recorded camera
+const bool late_latched_camera = false;
+// In case the present never happens, e.g. the window is hidden
+const uint64_t PRESENT_WAIT_TIMEOUT_NS = SDL_NS_PER_SECOND / 10;
+// Sleeps can overshoot by about this much, so the end of a wait is spun
+const uint64_t FRAME_SPIN_NS = 2 * SDL_NS_PER_MS;
+// When the next frame should start, for the sleep based pacing
+uint64_t next_frame_ns = 0;
+
+// When the GPU is the bottleneck, hold each frame back so it's submitted just
+// as the GPU finishes the last one, rather than reading the input and then
+// waiting on the fences and the swap chain with it.  The GPU time of a frame
+// comes from the profiler and the CPU time from the start of the frame to its
+// submit (less what it waited for) is measured, see start_frame_just_in_time().
+// This runs before the input is read, so it's without threaded_rendering
+const bool just_in_time_frames = false;
+// Time the frame is started early by anyway, for the predictions being out
+const double JUST_IN_TIME_MARGIN_MS = 1.0;
+// How much of each new time goes into the predictions.  A slower frame goes
+// in whole, so they only come down slowly
+const double JUST_IN_TIME_SMOOTHING = 0.1;
+// The predicted GPU and CPU times of a frame in ms, when the frame started and
+// when the last one was submitted
+double just_in_time_gpu_ms = 0.0;
+double just_in_time_cpu_ms = 0.0;
+uint64_t just_in_time_start_ns = 0;
+uint64_t just_in_time_submit_ns = 0;
+
+// When true each sprite is a single per-instance record in the sprite vertex
+// buffer and is drawn as an instance of a 6 vertex quad.  When false the
+// record is duplicated for all 6 vertices of the quad.
+const bool instanced_sprites = true;
+
+// Draw the monsters from VertexBufferFramedSprite records, which point at a
+// frame of a table shared by all of them (see create_sprite_frames()) in place
+// of their own texture coordinates, texture and trim.  That's two thirds of
+// the size, and changing a sprite's frame is writing 2 bytes.  Only for the
+// static sprite vertex buffer drawn as it is, so not with sprite_render_queue,
+// gpu_sprite_culling or vertex_pulling.  Without bufferDeviceAddress, which
+// the table is read through, they're drawn as usual
+const bool sprite_frame_table = false;
+// The frame table's ids are 16 bit
+#define SPRITE_FRAMES_MAX 65536
+
+// Write a VkDrawIndirectCommand for each batch of sorted sprites into the
+// frame ring, so the batches after each other with the same pipeline and
+// shading rate (e.g. in different layers) are one vkCmdDrawIndirect.  That's
+// one command each without multiDrawIndirect
+const bool indirect_sprite_batches = true;
+
+// Have the sprite and tile vertex shaders (sprite_pulled.vert and
+// tiles_pulled.vert) read the records themselves through a buffer device
+// address in the push constants, with no vertex input at all.  Without
+// bufferDeviceAddress the records are bound as vertex buffers as usual
+const bool vertex_pulling = false;
+
+// Generate a full mip chain for each texture on the GPU so minified sprites
+// don't shimmer.  When false the textures only have the base level
+const bool generate_mipmaps = true;
+// Mip levels dropped off the top of each texture as it's loaded, so devices
+// with little memory aren't paged out of it, or -1 for what the device's
+// memory tier drops (see vkx_texture_quality.c)
+const int32_t texture_quality_levels = -1;
+
+// All of the textures are packed into atlas pages of up to this size
+#define ATLAS_MAX_PAGE_SIZE 2048
+// Make the atlas sparse, so only the pages the shaders have sampled lately are
+// in device memory, streamed in from a copy in host memory (see
+// vkx_sparse_atlas.c).  The whole atlas is loaded if the device can't.  Needs
+// mipmaps, and can't be used with the lighting, the cached tile layers, the
+// chunk impostors or the tile texture tilemap, which sample the atlas with
+// shaders of their own
+const bool sparse_atlas = false;
+// Device memory for the pages outside the mip tail, and the most pages to
+// stream in each frame
+#define SPARSE_ATLAS_MEMORY_BUDGET (64 * 1024 * 1024)
+#define SPARSE_ATLAS_PAGES_PER_FRAME 16
+// Quantise the atlas to VKX_PALETTE_COLOURS colours and keep a byte per pixel,
+// a quarter of the memory and texture bandwidth (less still without the mip
+// levels), with the shaders looking the colours up in a palette (see
+// vkx_palette.c).  Each monster gets one of PALETTE_ROWS palettes, hue shifted
+// copies of the first, so they're recoloured without any more textures.
+// Lossy for art which wasn't drawn with a palette, and unfiltered.  Can't be
+// used with the sparse atlas, bindless textures, lighting, the tile texture
+// tilemap or the overdraw heatmap, which sample the atlas with shaders of
+// their own
+const bool palette_textures = false;
+// At most 4, see SPRITE_PALETTE()
+#define PALETTE_ROWS 4
+
+// Instead of the atlas, put each texture in the bindless texture table and have
+// the sprites index it directly.  Textures can then be streamed in and out
+// without touching the descriptor sets or pipelines
+const bool bindless_textures = false;
+#define MAX_BINDLESS_TEXTURES 4096
+// With bindless textures, let the residency manager evict textures which haven't
+// been drawn for a while when they go over the memory budget (showing a small
+// placeholder until they have streamed back in)
+const bool texture_streaming = true;
+// Bytes the full textures can use, or 0 for what the GPU's memory budget allows
+#define TEXTURE_MEMORY_BUDGET 0
+// Seconds ahead of the camera the monsters' textures are kept in, so the ones
+// it's heading for have streamed in by the time they're visible
+#define TEXTURE_LOOKAHEAD 0.5f
+// As textures stream in and out, move them to empty the device memory blocks
+// they leave full of holes, copying at most this much a frame
+const bool defragment_memory = true;
+#define DEFRAGMENT_BYTES_PER_FRAME (4 * 1024 * 1024)
+
+// Sort the sprites by a material / depth key every frame and draw them in
+// batches from a copy of the sprite records in the frame ring.  When false the
+// static sprite vertex buffer is drawn as it is, in creation order
+const bool sprite_render_queue = true;
+// Start each frame's sort from the order the sprites were in last frame and
+// only move the ones whose depth has changed past others, which is most of the
+// sort skipped when few move.  It radix sorts as usual when lots have
+const bool coherent_sprite_sort = true;
+// Alpha blend all of the sprites, rather than only the ones whose frames have
+// soft edges, so they look right.  Blended sprites are drawn back to front,
+// which needs sprite_render_queue
+const bool translucent_sprites = false;
+// Order the scene with the depth test.  Without it there is no depth attachment
+// to clear, test and write: the tile layers, the sprites behind the map, the map
+// and then the sprites in front of it are drawn in that order, with the sprites
+// blended back to front in the render queue's layers (SCENE_LAYER_*).  Needs
+// sprite_render_queue, and not gpu_sprite_culling, parallel_recording or
+// static_command_buffers
+const bool depth_buffer = true;
+// Render queue layers of the sprites without the depth buffer.  The
+// background is only used with variable_rate_shading (with or without it) or
+// half_res_background
+#define SCENE_LAYER_BACKGROUND 0
+#define SCENE_LAYER_BEHIND_MAP 1
+#define SCENE_LAYER_FRONT 2
+// Alpha tested pixels more transparent than this are discarded
+const float ALPHA_CUTOFF = 0.5f;
+// Frames with more than this fraction of their visible pixels partly
+// transparent are blended.  The rest are alpha tested, or with no transparency
+// at all drawn without discarding so the depth test can happen early
+const float TRANSLUCENT_FRAME_THRESHOLD = 0.05f;
+// Shrink the monsters' quads to the part of their frames which isn't fully
+// transparent, so the empty corners aren't rasterised and shaded
+const bool trimmed_sprites = true;
+// The trims are in steps of this fraction of the frame, a nibble a side
+#define SPRITE_TRIM_STEPS 16
+// Leave the cull mode and depth settings of the tile and sprite pipelines to the
+// command buffer, and the blending as well where the device has
+// VK_EXT_extended_dynamic_state3.  The translucent sprites then share the
+// opaque sprite pipeline rather than having one of their own
+const bool dynamic_render_state = true;
+// Write the push sets' descriptors (e.g. the HUD's font) straight into buffers
+// with VK_EXT_descriptor_buffer, where the device has it
+const bool descriptor_buffers = false;
+// Make the tile and sprite pipelines out of VK_EXT_shader_object shaders, where
+// the device has it, so there are no pipelines to compile for their states
+const bool shader_objects = false;
+// Otherwise link them from VK_EXT_graphics_pipeline_library parts where the
+// device has it, which the pipelines sharing a shader or state compile once
+const bool pipeline_libraries = true;
+// Compile the opaque and translucent sprite pipelines on background threads
+// rather than stalling the start up for them.  Until they are ready their
+// sprites are drawn with the cutout pipeline, which can draw anything
+const bool async_pipeline_compilation = true;
+#define PIPELINE_COMPILER_THREADS 1
+// Watch the shaders of those pipelines and the textures for changes, and swap
+// in the new ones between frames (compiling the GLSL with glslc if it's next
+// to the SPIR-V).  Only loose files reload, not embedded shaders or ones in
+// the asset archive, and only the textures of the bindless textures without
+// streaming, since the atlas packs them
+const bool hot_reload = true;
+#define HOT_RELOAD_POLL_MS 250
+
+// Move the sprites and build their transforms in a compute shader instead of
+// on the CPU.  The sprite state then lives in a device local buffer, and
+// nothing about the sprites is computed or uploaded per frame
+const bool gpu_sprite_simulation = false;
+// The local_size_x of sprite_sim.comp, as a specialization constant
+#define SPRITE_SIM_WORKGROUP_SIZE 64
+// With it, have sprite_sim.comp write down the sprites which bounce off the
+// edges, for handle_sprite_event() to react to without the sprite state
+// coming back to the CPU.  They are appended to a buffer on the GPU, copied
+// into host cached memory after the simulation, and read when the frame in
+// flight comes round again, so nothing waits for the GPU.  The shader needs
+// subgroup ballots.  Any past this many in a frame are dropped
+const bool gpu_sprite_events = true;
+#define MAX_SPRITE_EVENTS 4096
+
+// Run the simulation in fixed steps of this long, however often frames are
+// drawn, and draw the monsters and projectiles interpolated between the last
+// two steps.  Otherwise every frame is one step of however long it took
+const bool fixed_timestep = true;
+const double SIMULATION_STEP = 1.0 / 60.0;
+
+// Bounce the monsters off each other as well as the edges (on the CPU only),
+// found through monster_grid.  They collide closer than this, which is also
+// the grid's cell size
+const bool monster_collisions = false;
+const float MONSTER_COLLISION_DISTANCE = 1.0f;
+// Most of a monster's neighbours looked at in a frame
+#define MAX_MONSTER_NEIGHBOURS 32
+// Stop the monsters at solid tiles, as boxes this size around their
+// centres (on the CPU only), see tile_solidity
+const bool monster_tile_collisions = false;
+const float MONSTER_TILE_HALF_SIZE = 0.4f;
+// Steer the monsters along a flow field to a tile (middle click to move it),
+// on the CPU only.  Best with monster_tile_collisions, so that they go round
+// the solid tiles rather than through them.  They turn by this much of the
+// way to the field's direction a second
+const bool monster_pathfinding = false;
+const float MONSTER_PATH_SPEED = 4.0f;
+const float MONSTER_PATH_STEERING = 4.0f;
+// Steer the monsters as a flock (on the CPU only), keeping apart from the
+// ones closer than the separation radius, lining up with and heading for the
+// middle of the rest within the neighbour radius, and turning away from the
+// solid tiles, see swarm.h.  The neighbours are found through monster_grid
+const bool monster_swarming = false;
+const SwarmParams MONSTER_SWARM = {
+	.neighbour_radius = 2.0f,
+	.separation_radius = 0.75f,
+	.max_neighbours = 64,
+	.separation_weight = 2.0f,
+	.alignment_weight = 1.0f,
+	.cohesion_weight = 0.5f,
+	.avoidance_distance = 1.0f,
+	.avoidance_weight = 8.0f,
+	.min_speed = 1.0f,
+	.max_speed = 5.0f,
+};
+// Step the monsters out of view less often the further they are from it (on
+// the CPU only), see update_tiers.h.  The ones in view are moved every step,
+// and the rest share what's left of MONSTER_UPDATE_BUDGET_MS a step, each
+// tier no more often than its interval.  The views' rectangle is grown by
+// MONSTER_UPDATE_MARGIN, so a monster catching up on what it missed does it
+// just out of sight
+const bool throttle_monster_updates = false;
+const UpdateTiersDesc MONSTER_UPDATE_TIERS = {
+	.tier_distance = 16.0f,
+	.tiers_count = 4,
+	.intervals = {0.0f, 0.05f, 0.1f, 0.25f},
+	.max_dt = 0.25f,
+};
+#define MONSTER_UPDATE_BUDGET_MS 2.0
+const float MONSTER_UPDATE_MARGIN = 4.0f;
+
+// Test the sprites against the view in a compute shader, compact the visible
+// ones into a vertex buffer and draw them with a single indirect draw.  The
+// visible sprites come out in any order, so this can't be used with
+// translucent_sprites
+const bool gpu_sprite_culling = false;
+// Skip the monsters behind the map which are wholly under its opaque tiles,
+// which would only have been drawn to fail the depth test or be drawn over.
+// Each frame marks the opaque tiles in view in a mask, a bit each, which the
+// monsters are tested against along with the view: on the CPU, or in the
+// culling shader with gpu_sprite_culling.  Views bigger than this many tiles a
+// side aren't worth it, the monsters are too small by then
+const bool occlusion_culling = false;
+#define OCCLUSION_MASK_MAX_TILES 256
+// The local_size_x of sprite_cull.comp, as a specialization constant
+#define SPRITE_CULL_WORKGROUP_SIZE 64
+// Instead of the compute shader, where the device has VK_EXT_mesh_shader and
+// buffer device addresses, have sprite.task cull groups of the sprites and
+// sprite.mesh make the quads of the visible ones in the same draw.  There's
+// no compacted copy of the records or indirect draw in between
+const bool mesh_shader_sprites = true;
+// Sprites each task and mesh shader workgroup has (GROUP_SIZE in them)
+#define SPRITE_MESH_GROUP_SIZE 32
+
+// Particles which live entirely on the GPU: compute shaders spawn them from the
+// emitters (see add_particle_emitter()), move them and put the dead ones back
+// on a free list, and write the live ones out for an indirect draw with the
+// sprite shaders.  All the CPU sends is the emitters each frame
+const bool gpu_particles = false;
+#define PARTICLES_CAPACITY 65536
+// The local_size_x of particle_emit.comp and particle_update.comp
+#define PARTICLE_WORKGROUP_SIZE 64
+// A fountain in the middle of the map, as a demo.  Particles a second
+const float DEMO_PARTICLES_PER_SECOND = 0.0f;
+
+// Point lights (see add_light()) on normal mapped tiles and sprites.  Every
+// frame a compute shader bins the lights into LIGHT_TILE_SIZE pixel tiles of
+// each view, so a pixel only adds up the lights which reach its tile rather
+// than all of them.  Needs the texture atlas.  The cached tile layers and the
+// tile texture tilemap are drawn unlit
+const bool lighting = false;
+// What's lit by no lights at all
+const float AMBIENT_LIGHT[3] = {0.2f, 0.2f, 0.3f};
+// The lit shaders and light_cull.comp have these too.  A tile holds this many
+// lights, and any more which reach it are left out
+#define LIGHT_TILE_SIZE 16
+#define MAX_LIGHTS_PER_TILE 63
+#define LIGHT_TILE_WORDS (MAX_LIGHTS_PER_TILE + 1)
+// The local_size_x of light_cull.comp
+#define LIGHT_CULL_WORKGROUP_SIZE 64
+// Lights wandering around the map, as a demo
+const uint32_t DEMO_LIGHTS = 0;
+// Lights are stopped by the solid tiles.  Each frame a compute shader walks
+// out from every light through a copy of tile_solidity on the GPU, and keeps
+// how far it gets in each of SHADOW_MAP_RESOLUTION directions (the light's 1D
+// shadow map).  Needs lighting
+const bool light_shadows = false;
+#define SHADOW_MAP_RESOLUTION 256
+// How far into the tile which stops it a light still reaches, so walls are
+// lit on the side facing it
+const float SHADOW_BIAS = 0.5f;
+// The local_size_x of shadow_map.comp
+#define SHADOW_MAP_WORKGROUP_SIZE 64
+
+// Compute the sprite transforms on the worker pool using the vectorisable batch
+// path.  When false we use the original scalar loop on the main thread
+const bool threaded_transforms = true;
+// Keep each job worker on a logical core of its own (the main thread gets the
+// first).  Helps when nothing else is running, hurts when something is
+const bool pin_job_workers = false;
+// Time the scalar and batched transform paths at startup and print the speedup
+const bool benchmark_transforms = false;
+const uint32_t TRANSFORM_BENCHMARK_ITERATIONS = 1000;
+
+// Sprites the game can draw each frame with sprite_draw() (from any thread,
+// between the update's sprite_batch_begin() and sprite_batch_end()), as well
+// as the monsters.  They're sorted into as few draws as the pipelines allow
+// and copied into the frame ring, which has room for this many
+#define BATCHED_SPRITES_CAPACITY 65536
+// Leave out the sprite_draw() sprites which are outside all of the views
+// before they're sorted and copied, checking them on the worker pool
+const bool cull_batched_sprites = true;
+// Sprites update() draws that way each frame, a swarm circling the view
+const uint32_t DEMO_BATCHED_SPRITES = 0;
+
+// Sprites which stay put until they're changed, e.g. scenery, see
+// add_retained_sprite().  They live in device local buffers, and only the ones
+// which changed are copied there each frame
+#define RETAINED_SPRITES_CAPACITY 65536
+// Changed sprites with this many unchanged ones or fewer between them are
+// copied together, and at most this many copies are made a frame
+#define RETAINED_SPRITES_MAX_GAP 16
+#define MAX_RETAINED_SPRITE_RANGES 256
+// Retained sprites scattered over the map as a demo, of which a few spin and
+// the rest never change (they bob, but that's done in the vertex shader)
+const uint32_t DEMO_RETAINED_SPRITES = 0;
+#define DEMO_SPINNING_SPRITES 16
+
+// Sprites attached to one another in a transform tree as a demo, see
+// create_demo_tree().  Arms of DEMO_ARM_LINKS links each, each link swinging
+// from the one before, around a hub in the middle of the map
+const uint32_t DEMO_PARENTED_SPRITES = 0;
+#define DEMO_ARM_LINKS 8
+
+// Sprites which tween from place to place over the map as a demo, each x and y
+// with an easing of its own and a new tween as soon as one finishes, see
+// update_demo_tweens()
+const uint32_t DEMO_TWEENED_SPRITES = 0;
+// Seconds each tween takes, at most
+#define DEMO_TWEEN_MAX_DURATION 3.0
+
+// Characters cut from a monster's frame into parts on a skeleton as a demo,
+// walking across the map, see create_demo_skeleton().  Their poses are sampled
+// on the worker pool and their meshes skinned by skinned.vert, all of them in
+// one instanced draw.  Needs the texture atlas, without lighting
+const uint32_t DEMO_SKINNED_CHARACTERS = 0;
+// How fast they walk, in tiles a second.  They're as big as the monsters
+#define SKINNED_CHARACTER_SPEED 1.5f
+#define SKINNED_CHARACTER_Z 0.5f
+// Characters whose poses are sampled by each job
+#define SKINNED_JOB_SIZE 64
+
+// A panel of shape_draw() shapes in the corner of the first view as a demo,
+// with a soft shadow, an outline, round buttons and a bar, all in one draw
+const bool demo_shape_panel = false;
+#define SHAPE_PANEL_Z 0.05f
+
+// Projectiles, short lived entities which are spawned and destroyed at any
+// time (see spawn_projectile()), drawn with sprite_draw()
+#define PROJECTILES_CAPACITY 65536
+#define PROJECTILE_LIFETIME 1.5
+#define PROJECTILE_SPEED 12.0
+// Projectiles fired from random monsters each second as a demo
+const uint32_t DEMO_PROJECTILES_PER_SECOND = 0;
+
+// Sprites are split into jobs of this size for the worker pool (unless
+// autotune_render_paths finds another faster)...
+#define TRANSFORM_JOB_SIZE 4096
+// ...and each job is processed in structure-of-arrays batches of this size
+#define TRANSFORM_BATCH_SIZE 64
+
+// Monsters are 2 tiles wide (in the rendered image)
+const float MONSTER_SIZE = 2.0f;
+// How much the monsters bob and squash, see pack_sprite_animation()
+const float MONSTER_ANIM_AMPLITUDE = 0.2f;
+const float MONSTER_ANIM_FREQUENCY = 2.0f;
+// Play all of the frames on the monsters' sheets at this rate, in the vertex
+// shader.  The sheets' frames are then only opaque if all of them are
+const bool animated_monsters = false;
+#define MONSTER_ANIM_FPS 8
+
+// Size of the map in tiles
+uint32_t map_x_tiles = X_TILES;
+uint32_t map_y_tiles = Y_TILES;
+uint8_t* tiles = NULL;
+// Or the map's tiles with use_sparse_tiles(), when tiles is NULL
+TileStore tile_store = {0};
+// Fills tile_store when use_streamed_world()
+WorldStream world_stream = {0};
+// Which of them aren't EMPTY, for monster_tile_collisions
+TileSolidity tile_solidity = {0};
+// Where the monsters are heading, for monster_pathfinding
+FlowField monster_flow_field = {0};
+
+// The chunks of the map when using chunked_tilemap
+Tilemap tilemap = {0};
+
+// With chunk_impostors, the atlas the chunks' impostors are rendered into and
+// the set for drawing them from it with the tile layer pipeline
+VkxImage chunk_impostor_atlas = {0};
+VkDescriptorSet chunk_impostor_descriptor_set = VK_NULL_HANDLE;
+// A chunk this frame renders the impostor of
+typedef struct {
+	// Where its vertices are in the frame ring, and how many
+	VkDeviceSize vertices_offset;
+	uint32_t vertices_count;
+	uint32_t chunk;
+	uint32_t slot;
+} ChunkImpostorRender;
+ChunkImpostorRender chunk_impostor_renders[CHUNK_IMPOSTOR_RENDERS_PER_FRAME] = {0};
+uint32_t chunk_impostor_renders_count = 0;
+// Whether this frame draws the map's impostors rather than its chunks, the
+// uniforms they're rendered with, and where the quads they're drawn with are
+// in the frame ring
+bool drawing_chunk_impostors = false;
+uint32_t chunk_impostor_ubo_offset = 0;
+VkDeviceSize chunk_impostor_quads_offset = 0;
+uint32_t chunk_impostor_quads_count = 0;
+
+// With tile_texture_tilemap, the tile indices as an image (one texel per tile)
+VkxImage tile_index_image = {0};
+VkDescriptorSetLayout tile_index_set_layout = VK_NULL_HANDLE;
+VkDescriptorSet tile_index_descriptor_set = VK_NULL_HANDLE;
+// The extra tile layers when using tile_layers
+TileLayer layers[TILE_LAYERS_COUNT] = {0};
+// Unit quad for drawing the cached layers
+VkxBuffer tile_layer_quad_vertex_buffer = {0};
+// With tile_texture_tilemap, the quad over the whole map
+VkxBuffer tile_map_quad_vertex_buffer = {0};
+
+// Tiles changed since they were last copied to the GPU (the chunked tilemap
+// rebuilds its chunks instead)
+TileEdit* tile_edits = NULL;
+uint32_t tile_edits_count = 0;
+uint32_t tile_edits_capacity = 0;
+// This frame's copies, with the new data staged in the frame ring.  Either
+// into the tile index image or into each tile's slot in the tile mesh
+uint32_t tile_edits_staged = 0;
+VkBufferImageCopy tile_image_copies[MAX_TILE_EDITS_PER_FRAME] = {0};
+VkBufferCopy tile_vertex_copies[MAX_TILE_EDITS_PER_FRAME] = {0};
+
+// The simulation's cameras for each view, which write_frame_state() copies for
+// the renderer
+Camera cameras[MAX_VIEWS] = {0};
+// The newest of the first view's, which the renderer latches just before it
+// submits with late_latched_camera
+SDL_Mutex* latched_camera_mutex = NULL;
+Camera latched_camera = {0};
+// The one the input moves
+uint32_t active_view = 0;
+// Tiles a second the camera pans by itself in a benchmark, turning round at
+// the edges of the map
+vec2 camera_pan = {0.0f, 0.0f};
 
 const uint32_t SCREEN_WIDTH = X_TILES * 32;
 const uint32_t SCREEN_HEIGHT = Y_TILES * 32;
 
+// The scene is rendered at this fraction of SCREEN_WIDTH x SCREEN_HEIGHT and
+// scaled up to the window in the screen pass.  The offscreen image is created
+// at the maximum scale and only the top left of it is rendered to, so this can
+// change every frame (the - and = keys step it)
+float render_scale = 1.0f;
+const float MIN_RENDER_SCALE = 0.5f;
+const float MAX_RENDER_SCALE = 1.0f;
+const float RENDER_SCALE_STEP = 0.05f;
+// Multisample the scene, which smooths the edges of scaled and rotated sprites
+// for much less than rendering it bigger.  The samples are resolved into the
+// offscreen image at the end of the scene pass, so on tiled GPUs they never
+// leave tile memory.  Fewer if the device can't do this many
+const VkSampleCountFlagBits MSAA_SAMPLES = VK_SAMPLE_COUNT_1_BIT;
+// With multisampling, the cutout sprites' alpha becomes how many of the samples
+// they cover, rather than hard edges at ALPHA_CUTOFF
+const bool alpha_to_coverage = true;
+// Shade the background fewer times than there are pixels, where the device has
+// VK_KHR_fragment_shading_rate.  The sprites from BACKGROUND_SPRITE_Z back
+// (the ones faded as far away) and the tile layers which move slower than the
+// camera are drawn at 2x2 a fragment, and the map takes its rate from a mask
+// with the flat tiles of the tileset at 2x2 and the rest at every pixel, where
+// the device can do that too (not with split screen or secondary command
+// buffers).  Saves fragment shading at high render scales
+const bool variable_rate_shading = false;
+#define BACKGROUND_SPRITE_Z 15.0f
+// Pixels of the scene each texel of the mask covers a side, kept within what
+// the device can do
+#define SHADING_RATE_TEXEL_SIZE 16
+// Tiles which are opaque and whose brightness varies less than this from
+// their average are flat enough for 2x2
+const float LOW_DETAIL_TILE_DEVIATION = 0.03f;
+// A texel of the mask at 2x2, log2 of the width and height
+#define SHADING_RATE_COARSE ((1 << 2) | 1)
+// Draw the background (the same sprites and tile layers as with
+// variable_rate_shading) into an image BACKGROUND_RESOLUTION_DIVISOR times
+// smaller a side, and scale it up under the rest of the scene.  Any device can
+// do it, but not with variable_rate_shading, the depth_buffer, split screen or
+// partial_redraw
+const bool half_res_background = false;
+#define BACKGROUND_RESOLUTION_DIVISOR 2
+// Filtering for scaling the background up, nearest when false
+const bool background_bilinear = true;
+// Do the colour maths of the plain sprite, tile and screen shaders at half
+// precision (the _half.frag variants), where the device has shaderFloat16.
+// Mobile GPUs do it twice as fast in half the registers, desktop ones the
+// same as full precision.  Texture coordinates stay full precision, as half
+// can't address the texels of a big atlas
+const bool half_precision_shading = true;
+// Filtering for scaling the scene up, nearest when false (the B key toggles it)
+bool bilinear_upscale = false;
+// Formats for the offscreen images the scene and the post-processing render
+// to, best first.  The first the device can render to, blend into and filter
+// is used, so the scene's bandwidth doesn't depend on the display: e.g.
+// VK_FORMAT_B10G11R11_UFLOAT_PACK32 for HDR effects in 32 bits a pixel, or
+// VK_FORMAT_R8G8B8A8_UNORM.  OFFSCREEN_FORMAT_SWAP_CHAIN is the swap chain's
+// format, which the screen pass can copy without any effects rather than blit
+#define OFFSCREEN_FORMAT_SWAP_CHAIN VK_FORMAT_UNDEFINED
+const VkFormat OFFSCREEN_FORMATS[] = {OFFSCREEN_FORMAT_SWAP_CHAIN};
+// The cached tile layers need alpha for their gaps, so with an offscreen
+// format without any they're this instead
+#define TILE_LAYER_CACHE_FALLBACK_FORMAT VK_FORMAT_R8G8B8A8_SRGB
+
+// Post-processing effects between the scene and the screen, in order (see
+// post_chain.h).  Neighbouring per-pixel effects are fused into one pass, and
+// the last of them into the screen pass.  With none, the offscreen image is
+// copied to the swap chain image when the scene fills it at the same size, or
+// blitted to scale it up, instead of a full screen draw.  A pre-rotated swap
+// chain needs the shader, so it's only pre-rotated with effects.  The passes
+// before the screen pass can be compute dispatches, and those can run on the
+// compute queue while the graphics queue gets on with other work
+const PostChainDesc POST_CHAIN_DESC = {
+	{POST_EFFECT_WAVE},
+	1,
+	// Bloom and blur divisors
+	2,
+	2,
+	// Compute, and async compute where there is a separate compute queue
+	false,
+	true,
+	// Half precision, see half_precision_shading
+	true,
+};
+// Colour grading
+const float POST_EXPOSURE = 1.0f;
+const float POST_CONTRAST = 1.1f;
+const float POST_SATURATION = 1.2f;
+// Only the parts brighter than the threshold glow
+const float BLOOM_THRESHOLD = 0.7f;
+const float BLOOM_INTENSITY = 0.6f;
+// How much darker the gaps between the scanlines and the corners are
+const float CRT_SCANLINES = 0.3f;
+const float CRT_VIGNETTE = 0.4f;
+// Draw the scene straight into the swap chain image, with no offscreen image
+// or screen pass, and apply the effects at the end of the scene pass by
+// reading each pixel back from the attachment it was drawn to
+// (VK_KHR_dynamic_rendering_local_read).  On tiled GPUs the picture then never
+// leaves tile memory between the scene and its effects.  Only for chains of
+// colour grading and CRT scanlines (see post_chain_is_per_pixel()), and the
+// scene is always the window's size, so there's no dynamic resolution.  Not
+// with multisampling, split screen, partial_redraw, half_res_background or
+// secondary command buffers.  Falls back to the screen pass where the device
+// or the swap chain can't do it
+const bool local_read_screen = false;
+
+// Adjust render_scale between frames to keep the GPU time for a frame inside
+// the budget, e.g. 1/60 or 1/120 of a second.  Off when benchmarking, so each
+// run draws the same number of pixels
+bool dynamic_resolution = true;
+const double GPU_FRAME_TIME_BUDGET = 1.0 / 60.0;
+// Aim for this fraction of the budget, and only scale up again when the GPU
+// time drops below LOWER_THRESHOLD of that, so it doesn't flicker between sizes
+const double DYNAMIC_RESOLUTION_TARGET = 0.9;
+const double DYNAMIC_RESOLUTION_LOWER_THRESHOLD = 0.75;
+// Weight of the newest frame in the smoothed GPU time
+const double GPU_FRAME_TIME_SMOOTHING = 0.1;
+// Frames to leave between changes, so the smoothed time catches up
+const uint32_t DYNAMIC_RESOLUTION_INTERVAL = 8;
+
 const uint32_t DEFAULT_WIDTH = X_TILES * 32;
 const uint32_t DEFAULT_HEIGHT = Y_TILES * 32;
 
+// Render without a window or display (e.g. thumbnails and replays on GPU
+// servers).  The frames go into DEFAULT_WIDTH x DEFAULT_HEIGHT images instead
+// of a swap chain, and the ones wanted are read back with the frame capture
+// (see capture.c), so nothing waits on the GPU.  It runs as fast as the
+// GPU allows for HEADLESS_FRAMES frames, with a fixed time step so a replay
+// comes out the same every time.  --headless turns it on for a benchmark
+bool headless = false;
+const uint32_t HEADLESS_FRAMES = 600;
+const double HEADLESS_TIME_STEP = 1.0 / 60.0;
+// Every this many frames one is written out as a binary PPM, 0 for none
+const uint32_t HEADLESS_CAPTURE_INTERVAL = 60;
+const char* HEADLESS_CAPTURE_FILENAME = "frame_%05llu.ppm";
+
+// F12 writes a screenshot and F8 starts and stops a recording.  The frames are
+// copied into readback buffers at the end of their command buffers and written
+// out by a thread of its own once they have finished on the GPU, so capturing
+// doesn't cost frames (if the writer falls behind, frames are dropped from the
+// recording instead).  The swap chain images go through the transfer source
+// layout on their way to being presented, which this turns off
+const bool frame_capture = true;
+const char* SCREENSHOT_FILENAME = "screenshot_%03u.ppm";
+const char* RECORDING_FILENAME = "recording.y4m";
+const CaptureFormat RECORDING_FORMAT = CAPTURE_FORMAT_Y4M;
+const uint32_t RECORDING_FRAME_RATE = 60;
+// Hand every frame to a hardware encoder without it going through the CPU:
+// they are copied into images whose memory is exported as dma-bufs (or opaque
+// fds), see export_frame() for where the encoder goes.  Only frames the size
+// the swap chain started at are exported
+const bool export_frames = false;
+
+// Debug view of the overdraw: the sprites add a little heat for every pixel
+// they draw instead of their colour (see sprite_overdraw.frag), over the tiles.
+// They still test and write depth, so it's what was shaded rather than every
+// pixel they cover.  The profiler's statistics give the fragment counts
+const bool overdraw_heatmap = false;
+
+// Performance overlay, which F3 shows and hides: the frame rate, the last
+// frame's CPU phases and GPU passes, a graph of the recent frame times, the
+// sprite and draw counts and the memory used from each heap.  It's drawn at
+// the end of the screen pass, so while it's hidden it costs nothing.  A screen
+// pass which copies or blits (or with static_command_buffers, is recorded once)
+// can't draw it, so then it gets a pass of its own after the screen pass
+const bool performance_hud = true;
+bool hud_visible = false;
+// Window pixels per font pixel
+const float HUD_SCALE = 2.0f;
+
+// Debug shapes over the frame, which F4 shows and hides: the views' visible
+// rectangles, the monsters' bounds (and collision circles), the projectiles
+// and the flow field's arrows, see draw_debug_shapes().  Drawn with the
+// performance overlay in one draw, and compiled out of release builds
+const bool debug_shapes = true;
+bool debug_shapes_visible = false;
+// In window pixels
+const float DEBUG_LINE_WIDTH = 1.5f;
+// The flow field is only drawn with fewer tiles in view than this
+#define DEBUG_MAX_FLOW_TILES 2048
+// Frames in the frame time graph, and the time at the top of it
+#define HUD_GRAPH_FRAMES 120
+const float HUD_GRAPH_MAX_MS = 33.3f;
+
+// Frame metrics for machines nobody watches, e.g. kiosks: percentiles of the
+// frame and GPU times, late and dropped frames, swap chain trouble and memory
+// use.  A thread of their own exports them every TELEMETRY_INTERVAL_MS as a
+// JSON line and/or StatsD, and recording them takes only atomic adds
+const bool telemetry = false;
+#define TELEMETRY_INTERVAL_MS 10000
+// Appended to, or NULL
+#define TELEMETRY_FILENAME "telemetry.jsonl"
+// StatsD server, or NULL
+#define TELEMETRY_STATSD_HOST NULL
+#define TELEMETRY_STATSD_PORT 8125
+#define TELEMETRY_PREFIX "renderer"
+// Frames between updates of the memory gauges
+#define TELEMETRY_MEMORY_FRAMES 60
+
+// Send what every frame draws to another copy of the renderer (e.g. a thin
+// client) as compact commands rather than pixels, see render_stream.c: the
+// sprite_draw() sprites with their positions rounded and delta coded and
+// their textures as indices, the first view's camera and the tile edits.
+// RENDER_STREAM_SEND connects to RENDER_STREAM_HOST, and the copy with
+// RENDER_STREAM_RECEIVE listens on RENDER_STREAM_PORT and draws the newest
+// frame to have come in instead of its own sprite_draw() sprites.  Both need
+// the same map and textures
+const RenderStreamMode render_stream_mode = RENDER_STREAM_OFF;
+#define RENDER_STREAM_HOST "127.0.0.1"
+#define RENDER_STREAM_PORT 7420
+// What the receiver last took from the stream
+RenderStreamFrame render_stream_frame = {0};
+
+// Whether each frame in flight gets its own offscreen and depth images.  AUTO
+// shares one set between the frames when the copies would use a lot of the
+// memory budget
+const VkxFrameGraphTransientMode offscreen_target_mode = VKX_FRAME_GRAPH_AUTO;
+
+// Keep the offscreen image from frame to frame and only draw the part of the
+// scene which changed since its copy was last drawn, for screens which are
+// mostly still.  The moving sprites, the sprite_draw() ones, the retained
+// sprites and the tile edits say where they changed (see update_damage()), and
+// anything else changing (the camera, the render extent, textures streaming
+// in, lights, particles or sprites moved on the GPU) draws it all.  The screen
+// pass still draws the whole window, but the presentation engine is told
+// which part of it changed with VK_KHR_incremental_present where it can be.
+// Not with split screen
+const bool partial_redraw = false;
+
 SDL_Window* window = NULL;
 
 // Single descriptor pool for the whole app
 VkDescriptorPool descriptor_pool = {0};
 // Descriptor sets for the main pipelines
-VkDescriptorSet descriptor_sets[VKX_FRAMES_IN_FLIGHT] = {0};
+VkDescriptorSet descriptor_sets[VKX_MAX_FRAMES_IN_FLIGHT] = {0};
 // Descriptor sets for the screen pipeline
-VkDescriptorSet screen_descriptor_sets[VKX_FRAMES_IN_FLIGHT] = {0};
+VkDescriptorSet screen_descriptor_sets[VKX_MAX_FRAMES_IN_FLIGHT] = {0};
 
 // Which frame in the frames in flight are we rendering?
 uint32_t current_frame = 0;
@@ -146,21 +1555,183 @@ uint32_t current_frame = 0;
 // Used to recreate swap chain on resize
 bool framebuffer_resized = false;
 
-// To store our textures
-VkxImage* textures;
+// With skip_idle_frames, what the last frame handed to the renderer showed,
+// to tell whether the next one is any different
+Camera drawn_cameras[MAX_VIEWS] = {0};
+Light drawn_lights[MAX_LIGHTS] = {0};
+uint32_t drawn_lights_count = 0;
+uint64_t drawn_batch_hash = 0;
+// Set on the render thread when a frame left work for the ones after it
+// (tile edits over the frame's limit, tilemap chunks still streaming in), so
+// they're drawn even if nothing else changes
+SDL_AtomicInt render_work_left = {0};
+
+// Frames can be captured (the swap chain images can be copied from), and
+// where the swap chain image goes after capture_record()
+bool capture_enabled = false;
+
+Hud hud = {0};
+// The overlay's own pass, when the screen pass can't draw it (or the debug
+// shapes')
+uint32_t hud_pass = UINT32_MAX;
+DebugDraw debug_drawer = {0};
+// What the update is drawing the debug shapes into, handed to the renderer in
+// the frame state
+DebugDrawList debug_lines = {0};
+// A ring of the times between the last HUD_GRAPH_FRAMES frames, in ms
+float hud_frame_times[HUD_GRAPH_FRAMES] = {0};
+uint32_t hud_frame_times_next = 0;
+uint64_t hud_last_frame_ns = 0;
+// Of the display, read on the main thread before the telemetry starts (0 when
+// headless, so no frame is late)
+uint64_t telemetry_refresh_period_ns = 0;
+uint64_t telemetry_last_frame_ns = 0;
+uint32_t telemetry_frames_count = 0;
+// A gauge of the MB used from each memory heap
+uint32_t telemetry_heap_gauges[VK_MAX_MEMORY_HEAPS] = {0};
+// Draws recorded this frame (from any thread) and what the last frame recorded
+SDL_AtomicInt draws_recorded = {0};
+int last_draws_count = 0;
+// Everything the last frame recorded and submitted, when built with
+// COMMAND_STATS, and a telemetry gauge of each count
+VkxCommandStats last_command_stats = {0};
+uint32_t telemetry_command_gauges[_VKX_STAT_COUNT] = {0};
+// The last frame's CPU phases on the render thread, in ms
+double cpu_wait_ms = 0.0;
+// How long the last frame waited to acquire a swap chain image
+double cpu_acquire_ms = 0.0;
+double cpu_record_ms = 0.0;
+double cpu_submit_ms = 0.0;
+double cpu_transforms_ms = 0.0;
+double cpu_sort_ms = 0.0;
+VkxFrameGraphState swap_chain_present_state = {0};
+VkxWindow extra_windows[VKX_MAX_WINDOWS] = {0};
+uint32_t extra_windows_count = 0;
+uint32_t screenshots_count = 0;
+uint64_t headless_frames_count = 0;
+
+// All of the textures packed into a single 2D array image
+VkxAtlas texture_atlas = {0};
+// With lighting, the textures' normal maps packed the same way
+VkxAtlas normal_atlas = {0};
+// With palette_textures, PALETTE_ROWS rows of VKX_PALETTE_COLOURS
+VkxImage palette_image = {0};
+// Or when using bindless textures, the individual textures and their indices
+// into the texture table
+VkxImage textures[_TEX_COUNT] = {0};
+uint32_t texture_table_indices[_TEX_COUNT] = {0};
+// Or with texture streaming, the residency manager's handles for them
+uint32_t texture_residency_handles[_TEX_COUNT] = {0};
 VkSampler texture_sampler;
+// Bilinear sampler for scaling the offscreen image up to the window
+VkSampler screen_sampler;
 
-// Offscreen image for rendering to
-VkxImage offscreen_images[VKX_FRAMES_IN_FLIGHT] = {0};
-VkxImage depth_images[VKX_FRAMES_IN_FLIGHT] = {0};
+// Secondary command buffers for the scene pass, with parallel_recording or
+// static_command_buffers
+VkxSecondaryCommands scene_commands = {0};
 
-// Vertices for the tilemap
-size_t vertices_count = 0;
-Vertex* vertices = NULL;
+// The reusable command buffers with static_command_buffers
+enum {
+	STATIC_COMMANDS_TILES,
+	STATIC_COMMANDS_SCREEN,
+
+	_STATIC_COMMANDS_COUNT
+};
+VkxSecondaryCommands static_commands = {0};
 
-// Indices for the tilemap
-size_t vertex_indices_count = 0;
-uint16_t* vertex_indices = NULL;
+// What a static command buffer was last recorded with
+typedef struct {
+	bool recorded;
+	uint64_t generation;
+	float views[MAX_VIEWS][4];
+	uint32_t dynamic_offsets[2];
+	VkExtent2D extent;
+	VkRect2D render_area;
+} StaticCommandsKey;
+StaticCommandsKey static_commands_keys[VKX_MAX_FRAMES_IN_FLIGHT][_STATIC_COMMANDS_COUNT] = {0};
+// Bumped whenever the static command buffers all have to be recorded again
+uint64_t static_commands_generation = 0;
+
+// The passes of a frame and the images they use.  The offscreen and depth
+// images are transients owned by the graph
+VkxFrameGraph frame_graph = {0};
+uint32_t scene_pass = 0;
+uint32_t screen_pass = UINT32_MAX;
+// The screen pass copies or blits rather than drawing, see POST_CHAIN_DESC
+bool screen_transfer = false;
+// With local_read_screen, whether the scene pass is drawing to the swap chain
+// image (so there's no screen pass, and graph_offscreen_image is the swap
+// chain's), as large as it can get, and the set the effects read it back with
+bool scene_to_swap_chain = false;
+VkExtent2D largest_swap_chain_extent = {0};
+VkxPushSet scene_input_set = {0};
+// Picked from OFFSCREEN_FORMATS when the swap chain is first created, and kept
+// when it's recreated
+VkFormat offscreen_format = VK_FORMAT_UNDEFINED;
+PostChain post_chain = {0};
+uint32_t graph_offscreen_image = 0;
+// With partial_redraw, what changed since update_damage() last ran, and the
+// pixels the frames before changed.  It's all drawn again if the camera or
+// the render extent isn't what it was
+Damage frame_damage = {0};
+DamageHistory damage_history = {0};
+mat4 damage_view_projection = {0};
+VkExtent2D damage_extent = {0};
+// The part of the scene drawn this frame, min x, min y, max x, max y
+int32_t damage_pixels[4] = {0};
+// The sprite_draw() sprites last frame, added together from each one's hash,
+// and the rectangle around them
+uint64_t damage_batch_hash = 0;
+Damage damage_batch_rect = {0};
+uint32_t graph_depth_image = 0;
+// With split screen the scene pass renders a layer of these for each view,
+// which the split screen pass copies into place in the offscreen image
+uint32_t split_screen_pass = UINT32_MAX;
+uint32_t graph_views_image = 0;
+uint32_t graph_views_depth_image = 0;
+uint32_t graph_swap_chain_image = 0;
+// With multisampling, what the scene pass renders to and resolves from
+uint32_t graph_msaa_image = 0;
+// MSAA_SAMPLES or as many as the device can do
+VkSampleCountFlagBits msaa_samples = VK_SAMPLE_COUNT_1_BIT;
+// With variable_rate_shading's mask, the image the scene pass takes it from,
+// the pass which copies it there from where stage_shading_rate_mask() wrote
+// it in the frame ring, and the pixels each of its texels covers
+uint32_t shading_rate_pass = UINT32_MAX;
+uint32_t graph_shading_rate_image = 0;
+VkDeviceSize shading_rate_mask_offset = 0;
+VkExtent2D shading_rate_texel_size = {SHADING_RATE_TEXEL_SIZE, SHADING_RATE_TEXEL_SIZE};
+// Which tiles of the tileset are flat enough for 2x2, and EMPTY as there's
+// nothing to shade
+bool low_detail_tiles[TILESET_TOTAL_TILES + 1] = {0};
+
+// TILE_ANIMATIONS as the tile shaders read them, copied into each frame's
+// uniforms
+uint32_t tile_animations[TILE_ANIMATION_SLOTS][4] = {{0}};
+// With half_res_background, the pass which draws the background, the image it
+// resolves to or renders straight into, its samples with multisampling, and
+// the sets the scene pass samples it with, one for each frame's copy
+uint32_t background_pass = UINT32_MAX;
+uint32_t graph_background_image = 0;
+uint32_t graph_background_msaa_image = 0;
+VkDescriptorSet background_descriptor_sets[VKX_MAX_FRAMES_IN_FLIGHT] = {0};
+
+// GPU timestamps around the passes.  The whole frame's time also drives the
+// dynamic resolution
+VkxProfiler profiler = {0};
+uint32_t profile_frame = 0;
+uint32_t profile_tiles = 0;
+uint32_t profile_sprites = 0;
+uint32_t profile_post = 0;
+uint32_t profile_screen = 0;
+// Smoothed GPU time for a frame in seconds, 0 until the first one is read
+double gpu_frame_time = 0.0;
+uint32_t frames_since_render_scale_change = 0;
+
+// Vertices for the tilemap, 4 for every tile.  They are drawn with the
+// shared quad indices
+size_t vertices_count = 0;
+TileVertex* vertices = NULL;
 
 // "Vertices" for the sprites
 size_t vertex_sprites_count = 0;
@@ -168,39 +1739,431 @@ VertexBufferSprite* vertex_sprites = NULL;
 
 // Buffers to feed the pipelines
 VkxBuffer vertex_buffer = {0};
-VkxBuffer index_buffer = {0};
 VkxBuffer sprite_vertex_buffer = {0};
-
-// Uniform buffer used in all pipelines
-VkxBuffer uniform_buffers[VKX_FRAMES_IN_FLIGHT] = {0};
-void* uniform_buffers_mapped[VKX_FRAMES_IN_FLIGHT] = {0};
-
-// Matrices for rendering
-mat4 projection_matrix;
-mat4 view_matrix;
+// With sprite_frame_table, the frames which sprite_vertex_buffer's
+// VertexBufferFramedSprites point at
+SpriteFrame* sprite_frames = NULL;
+uint32_t sprite_frames_count = 0;
+VkxBuffer sprite_frame_buffer = {0};
+// The indices of TILEMAP_MAX_QUADS quads, shared by the tiles and every other
+// quad with 4 vertices
+VkxBuffer quad_index_buffer = {0};
+
+// Ring buffer for all of the per-frame dynamic data.  The uniform buffer and
+// the sprite transforms are allocated from this every frame and bound with
+// dynamic offsets.  The sorted sprite records are bound from it as a vertex buffer
+VkxRingBuffer frame_ring = {0};
+// With gpu_sprite_simulation the sprite state and transforms are only ever on
+// the GPU instead
+VkxBuffer sprite_state_buffer = {0};
+// With gpu_sprite_events, the events the simulation appends, and a copy of
+// them for each frame in flight to read once the frame has finished
+VkxBuffer sprite_event_buffer = {0};
+VkxBuffer sprite_event_readback_buffers[VKX_MAX_FRAMES_IN_FLIGHT] = {0};
+bool sprite_events_copied[VKX_MAX_FRAMES_IN_FLIGHT] = {0};
+// Counted by handle_sprite_event(), and the events which didn't fit
+uint64_t sprite_edge_hits = 0;
+uint64_t sprite_events_dropped = 0;
+VkxBuffer sprite_transform_buffer = {0};
+// With gpu_sprite_culling, the visible sprite records and the indirect draw
+// written by the culling shader
+VkxBuffer visible_sprite_buffer = {0};
+VkxBuffer sprite_indirect_buffer = {0};
+// With gpu_particles, the particles and the free list of their slots (a count
+// then the slots), and what the update shader writes for drawing them
+VkxBuffer particle_buffer = {0};
+VkxBuffer particle_dead_list_buffer = {0};
+VkxBuffer particle_transform_buffer = {0};
+VkxBuffer particle_record_buffer = {0};
+VkxBuffer particle_indirect_buffer = {0};
+// Bound in place of descriptor_sets for drawing them, with an offset of 0 into
+// their transforms.  Where this frame's emitters are in the frame ring
+VkDescriptorSet particle_descriptor_sets[VKX_MAX_FRAMES_IN_FLIGHT] = {0};
+uint32_t particle_dynamic_offsets[2] = {0};
+uint32_t particle_emitters_offset = 0;
+// With lighting, the frame's lights copied out of the frame ring, and each
+// view's tiles of them from the culling shader
+VkxBuffer light_buffer = {0};
+VkxBuffer light_tile_buffer = {0};
+VkDeviceSize lights_offset = 0;
+// With shadows, tile_solidity's bits for the shadow map shader and the
+// lights' shadow maps (without, a placeholder for the lit shaders' binding).
+// Where this frame's changed rows of it are in the frame ring
+VkxBuffer occluder_buffer = {0};
+VkxBuffer shadow_buffer = {0};
+VkDeviceSize occluder_rows_offset = 0;
+// Room left in each frame's region for other streamed data
+const VkDeviceSize FRAME_RING_EXTRA_SPACE = 65536;
+// Put the ring in device local memory when the CPU can write to it directly
+// (resizable BAR / Smart Access Memory, or an integrated GPU), so the shaders
+// don't read the transforms and sprite records over PCIe.  Everything written
+// to the ring is write only, which is what that memory is fast at
+const bool device_local_frame_ring = true;
+// On integrated GPUs (unified memory) write the static buffers directly rather
+// than through a staging buffer and a copy
+const bool unified_memory_buffers = true;
+// Otherwise, with VK_EXT_external_memory_host, copy the tile mesh and the
+// sprites to the GPU straight out of their arrays rather than through staging
+// copies of them
+const bool import_host_uploads = true;
+
+// Dynamic offsets for the current frame, in binding order (uniform buffer,
+// then sprite transforms)
+uint32_t frame_dynamic_offsets[2] = {0};
+
+// What autotune_render_paths picked: the jobs' size, and whether the frame
+// ring goes in device local memory (with device_local_frame_ring)
+uint32_t transform_job_size = TRANSFORM_JOB_SIZE;
+bool frame_ring_device_local = true;
+
+// The hot_reload watcher was started, which use_hot_reload() decided then
+bool hot_reloading = false;
 
 // Last frame time (elapsed since start of app in seconds)
 double t_last = 0.0;
 // Current time
 double t = 0.0;
 
-// Length of texture array
-const uint32_t num_textures = (uint32_t) _TEX_COUNT;
-
-// Monster data
-Monster monsters[NUM_MONSTERS] = {0};
+// Everything random is drawn from this, which a benchmark fixes and a replay
+// takes from its log
+uint32_t random_seed = 0;
+
+// The keys update_camera() polls, as bits, which are what a replay log keeps
+// of the keyboard every frame
+#define CAMERA_KEY_LEFT (1u << 0)
+#define CAMERA_KEY_RIGHT (1u << 1)
+#define CAMERA_KEY_DOWN (1u << 2)
+#define CAMERA_KEY_UP (1u << 3)
+// Which of them are held this frame
+uint32_t held_keys = 0;
+
+// Everything is sampled from the atlas through a single descriptor
+const uint32_t num_textures = 1;
+
+// Monster data, for this many monsters
+Monsters monsters = {0};
+uint32_t monsters_count = DEFAULT_MONSTERS;
+
+// The monsters by where they are, rebuilt by update() when it's needed
+SpatialGrid monster_grid = {0};
+// The monsters' copies for monster_swarming
+Swarm monster_swarm = {0};
+
+Projectiles projectiles = {0};
+EntityPool projectile_pool = {0};
+
+// What update() does to the monsters and projectiles each step, and the time
+// step it's doing it for
+SystemSchedule update_systems = {0};
+float update_step = 0.0f;
+// With throttle_monster_updates, which monsters the systems step and for how
+// long each (the rest of them are left where they are)
+UpdateTiers monster_update_tiers = {0};
+BounceAxis monster_bounce_axes[2] = {0};
+// The demo's fraction of a projectile left over from the last update
+double demo_projectiles_due = 0.0;
+
+// The particle emitters, written on the main thread, with how many particles
+// each spawns a second and the fraction of one it has left over
+ParticleEmitter particle_emitters[MAX_PARTICLE_EMITTERS] = {0};
+float particle_emitter_rates[MAX_PARTICLE_EMITTERS] = {0};
+float particle_emitters_due[MAX_PARTICLE_EMITTERS] = {0};
+uint32_t particle_emitters_count = 0;
+// Particles spawned this frame, from all of them
+uint32_t particles_spawned = 0;
+#define PARTICLE_NO_EMITTER UINT32_MAX
+uint32_t demo_particle_emitter = PARTICLE_NO_EMITTER;
+
+// The lights, written on the main thread
+Light lights[MAX_LIGHTS] = {0};
+uint32_t lights_count = 0;
+#define NO_LIGHT UINT32_MAX
+// With shadows, the rows of tile_solidity which changed since the last
+// snapshot, for the occluder map
+bool* occluder_rows_dirty = NULL;
+uint32_t occluder_rows_dirty_count = 0;
+
+// Where the demo lights circle around: the centre, how far out and how fast
+float demo_light_orbits[MAX_LIGHTS][4] = {0};
+
+// The benchmark scenario from the command line (see bench.c), and the phases
+// timed every frame.  The GPU phases are the profiler's scopes
+BenchOptions bench_options = {0};
+uint32_t bench_phase_update = BENCH_NO_PHASE;
+uint32_t bench_phase_snapshot = BENCH_NO_PHASE;
+uint32_t bench_phase_wait = BENCH_NO_PHASE;
+uint32_t bench_phase_record = BENCH_NO_PHASE;
+uint32_t bench_phase_submit = BENCH_NO_PHASE;
+uint32_t bench_phase_present = BENCH_NO_PHASE;
+uint32_t bench_phase_transforms = BENCH_NO_PHASE;
+uint32_t bench_phase_sort = BENCH_NO_PHASE;
+uint32_t bench_phase_tiles = BENCH_NO_PHASE;
+
+// The parts of starting up, each timed once and printed with the time to the
+// first frame (and benchmarked as startup phases).  The world is made on a
+// worker while the device, pipelines and textures are, and the wait is how
+// long the buffers had to wait for it after that
+typedef enum {
+	STARTUP_DEVICE,
+	STARTUP_WORLD,
+	STARTUP_PIPELINES,
+	STARTUP_TEXTURES,
+	STARTUP_WORLD_WAIT,
+	STARTUP_BUFFERS,
+	_STARTUP_PHASE_COUNT,
+} StartupPhase;
+
+const char* STARTUP_PHASE_NAMES[_STARTUP_PHASE_COUNT] = {
+	[STARTUP_DEVICE] = "device",
+	[STARTUP_WORLD] = "world",
+	[STARTUP_PIPELINES] = "pipelines",
+	[STARTUP_TEXTURES] = "textures",
+	[STARTUP_WORLD_WAIT] = "world wait",
+	[STARTUP_BUFFERS] = "buffers",
+};
+double startup_phase_ms[_STARTUP_PHASE_COUNT] = {0};
+uint32_t bench_phases_startup[_STARTUP_PHASE_COUNT] = {0};
+uint64_t startup_start_ns = 0;
+bool startup_reported = false;
+// The tiles, monsters and the rest of the world's CPU side, see create_world()
+JobCounter world_counter = {0};
+uint32_t bench_phases_gpu[VKX_PROFILER_MAX_SCOPES] = {0};
+char bench_gpu_phase_names[VKX_PROFILER_MAX_SCOPES][64] = {0};
+
+// Handed from the simulation to the renderer, and the one being drawn.  The
+// render code reads the frame's time, camera and monster positions from here
+FrameState frame_states[FRAME_PIPELINE_SNAPSHOTS] = {0};
+FrameState* frame_state = &frame_states[0];
+// Whether each monster could be in any of the views this frame, from
+// cull_monsters()
+bool* monsters_in_view = NULL;
+// With occlusion_culling, which of the tiles in view are opaque, from
+// build_occlusion_mask().  Bit (0, 0) is tile occlusion_origin of the map.
+// Anything outside it isn't in view, so it counts as covered
+TileSolidity occlusion_mask = {0};
+uint64_t occlusion_mask_bits[OCCLUSION_MASK_MAX_TILES / 64 * OCCLUSION_MASK_MAX_TILES] = {0};
+int32_t occlusion_origin[2] = {0, 0};
+// Where this frame's copy of the bits is in the frame ring, for the culling
+// shader
+VkDeviceSize occlusion_mask_offset = 0;
+// Which tiles of the tileset are wholly opaque, all through their animations,
+// and so hide what's behind them
+bool opaque_tiles[TILESET_TOTAL_TILES + 1] = {0};
+// The sprite_draw() calls of the update, swapped into its snapshot
+SpriteBatch sprite_batch = {0};
+// Which of the snapshot's batched sprites are in view this frame, with
+// cull_batched_sprites
+uint8_t* batched_sprites_visible = NULL;
 
 // Tile pipeline draws the tiles from the vertex data
 VkxPipeline tile_pipeline = {0};
+// Or the tile map pipeline draws them from the tile index image
+VkxPipeline tile_map_pipeline = {0};
+// Draws the cached images of the static tile layers
+VkxPipeline tile_layer_pipeline = {0};
+// With split screen the scene pipelines use multiview, so the tiles are drawn
+// into the caches with a copy of the tile pipeline which doesn't (and isn't
+// lit, as the lights move)
+VkxPipeline tile_cache_pipeline = {0};
+// Another copy renders the chunk impostors, without a depth buffer as the
+// atlas doesn't have one
+VkxPipeline chunk_impostor_pipeline = {0};
 // Screen pipeline for blitting offscreen image to the swapchain
 VkxPipeline screen_pipeline = {0};
-// Sprite pipeline generates its own vertices in the shader
-VkxPipeline sprite_pipeline = {0};
+// Sprite pipelines generate their own vertices in the shader.  One for each
+// SpritePipeline
+VkxPipeline sprite_opaque_pipeline = {0};
+VkxPipeline sprite_cutout_pipeline = {0};
+VkxPipeline sprite_translucent_pipeline = {0};
+// Draws the monsters with sprite_frame_table, where they're all alpha tested
+// as they aren't sorted
+VkxPipeline framed_sprite_pipeline = {0};
+// Compute pipeline which moves the sprites and writes their transforms
+VkxPipeline sprite_sim_pipeline = {0};
+VkDescriptorSet sprite_sim_descriptor_set = VK_NULL_HANDLE;
+// Time step for the compute shader, from update()
+float sprite_sim_dt = 0.0f;
+// Time not yet simulated, less than a step, and how far through the next
+// step that is
+double simulation_lag = 0.0;
+float simulation_interpolation = 1.0f;
+// Compute pipeline which culls the sprites against the view
+VkxPipeline sprite_cull_pipeline = {0};
+VkDescriptorSet sprite_cull_descriptor_set = VK_NULL_HANDLE;
+// Or with mesh_shader_sprites, which shares the scene's sets
+VkxPipeline sprite_mesh_pipeline = {0};
+// Compute pipelines which spawn the particles, and move them and write out the
+// live ones
+VkxPipeline particle_emit_pipeline = {0};
+VkxPipeline particle_update_pipeline = {0};
+VkDescriptorSet particle_emit_descriptor_set = VK_NULL_HANDLE;
+VkDescriptorSet particle_update_descriptor_set = VK_NULL_HANDLE;
+// Compute pipeline which bins the lights into the tiles of the screen
+VkxPipeline light_cull_pipeline = {0};
+VkDescriptorSet light_cull_descriptor_set = VK_NULL_HANDLE;
+// Compute pipeline which makes the lights' shadow maps
+VkxPipeline shadow_map_pipeline = {0};
+VkDescriptorSet shadow_map_descriptor_set = VK_NULL_HANDLE;
+
+// Pipeline ids used in the sprite sort keys, which are also the ALPHA_MODE
+// specialization constant of the sprite shaders.  Opaque sprites come first in
+// the queue, then cutouts, both front to back, then translucent back to front
+typedef enum {
+	SPRITE_PIPELINE_OPAQUE = 0,
+	SPRITE_PIPELINE_CUTOUT,
+	SPRITE_PIPELINE_TRANSLUCENT,
+	_SPRITE_PIPELINE_COUNT
+} SpritePipeline;
+
+// Indexed by SpritePipeline
+VkxPipeline* sprite_pipelines[_SPRITE_PIPELINE_COUNT] = {
+	&sprite_opaque_pipeline,
+	&sprite_cutout_pipeline,
+	&sprite_translucent_pipeline,
+};
+
+// Also indexed by SpritePipeline, the pipeline manager's handles for the ones
+// which are compiled in the background
+#define SPRITE_PIPELINE_NO_REQUEST UINT32_MAX
+uint32_t sprite_pipeline_requests[_SPRITE_PIPELINE_COUNT] = {
+	SPRITE_PIPELINE_NO_REQUEST,
+	SPRITE_PIPELINE_NO_REQUEST,
+	SPRITE_PIPELINE_NO_REQUEST,
+};
+
+// Also indexed by SpritePipeline, set after binding the pipelines if their
+// render state is dynamic.  The tiles are alpha tested like the cutouts
+const VkxRenderState SPRITE_RENDER_STATES[_SPRITE_PIPELINE_COUNT] = {
+	{VK_CULL_MODE_BACK_BIT, true, true, VK_COMPARE_OP_LESS, false, false},
+	{VK_CULL_MODE_BACK_BIT, true, true, VK_COMPARE_OP_LESS, false, false},
+	{VK_CULL_MODE_BACK_BIT, true, false, VK_COMPARE_OP_LESS, true, false},
+};
+
+// The same for overdraw_heatmap, where they all add up
+const VkxRenderState OVERDRAW_RENDER_STATES[_SPRITE_PIPELINE_COUNT] = {
+	{VK_CULL_MODE_BACK_BIT, true, true, VK_COMPARE_OP_LESS, true, true},
+	{VK_CULL_MODE_BACK_BIT, true, true, VK_COMPARE_OP_LESS, true, true},
+	{VK_CULL_MODE_BACK_BIT, true, false, VK_COMPARE_OP_LESS, true, true},
+};
+
+// The pipeline id of shape_draw()'s shapes in the sort keys, after the
+// SpritePipeline ones.  They're blended like the translucent sprites
+#define SHAPE_PIPELINE_ID _SPRITE_PIPELINE_COUNT
+VkxPipeline shape_pipeline = {0};
+
+// Sprites queued for this frame, sorted and batched
+RenderQueue sprite_queue = {0};
+// Where this frame's sorted sprite records are in the frame ring, and their
+// batches' draws with indirect_sprite_batches
+VkDeviceSize sprite_records_offset = 0;
+VkDeviceSize sprite_draws_offset = 0;
+
+// The sprites drawn with sprite_draw() for this frame, sorted and batched the
+// same way, and where their records are in the frame ring
+RenderQueue batched_sprite_queue = {0};
+VkDeviceSize batched_sprite_records_offset = 0;
+VkDeviceSize batched_sprite_draws_offset = 0;
+// Bound in place of descriptor_sets for them, with their own transforms from
+// the frame ring (the uniform buffer, then the transforms)
+VkDescriptorSet batched_sprite_descriptor_sets[VKX_MAX_FRAMES_IN_FLIGHT] = {0};
+uint32_t batched_sprite_dynamic_offsets[2] = {0};
+
+// The retained sprites' slots, and their data indexed by slot, written on the
+// main thread
+SpritePool retained_sprites = {0};
+SpriteTransform* retained_transforms = NULL;
+VertexBufferSprite* retained_records = NULL;
+// Their copy on the GPU, and the sets to draw them with (bound with the frame's
+// uniform buffer and an offset of 0 into the transforms)
+VkxBuffer retained_transform_buffer = {0};
+VkxBuffer retained_record_buffer = {0};
+VkDescriptorSet retained_sprite_descriptor_sets[VKX_MAX_FRAMES_IN_FLIGHT] = {0};
+uint32_t retained_sprite_dynamic_offsets[2] = {0};
+// This frame's copies of the changed ones from the frame ring
+VkBufferCopy retained_transform_copies[MAX_RETAINED_SPRITE_RANGES] = {0};
+VkBufferCopy retained_record_copies[MAX_RETAINED_SPRITE_RANGES] = {0};
+uint32_t retained_copies_count = 0;
+// Set on the render thread when a frame's changes were never copied, so the
+// main thread sends all of them again
+SDL_AtomicInt retained_sprites_lost = {0};
+// With partial_redraw, their transforms as they are on the GPU, on the render
+// thread, for where the changed ones were
+SpriteTransform* retained_drawn_transforms = NULL;
+// The demo's sprites
+SpriteHandle* demo_retained_handles = NULL;
+
+// The demo's parented sprites, and the links of their arms (the hub is the
+// tree's only root)
+TransformTree demo_tree = {0};
+TransformHandle* demo_tree_links = NULL;
+
+// The demo's tweens, and the positions they write
+Tweens demo_tweens = {0};
+float* demo_tweened_x = NULL;
+float* demo_tweened_y = NULL;
+float** demo_tweens_finished = NULL;
+
+// The demo skeleton's bones, in the order create_demo_skeleton() adds them
+enum {
+	DEMO_BONE_HIPS,
+	DEMO_BONE_TORSO,
+	DEMO_BONE_HEAD,
+	DEMO_BONE_ARM_L,
+	DEMO_BONE_ARM_R,
+	DEMO_BONE_LEG_L,
+	DEMO_BONE_LEG_R,
+};
+
+// The demo's skinned characters: where each starts and how far into the walk
+typedef struct {
+	float x;
+	float y;
+	float phase;
+} SkinnedCharacter;
+Skeleton demo_skeleton = {0};
+SkeletonClip demo_walk_clip = {0};
+SkinnedCharacter* skinned_characters = NULL;
+// Their mesh, which every character draws as an instance
+VkxBuffer skinned_vertex_buffer = {0};
+VkxBuffer skinned_index_buffer = {0};
+uint32_t skinned_indices_count = 0;
+VkxPipeline skinned_pipeline = {0};
+// This frame's characters in view, whose palettes are in the frame ring in
+// the same order, bound in place of the batched sprites' transforms
+uint32_t* skinned_visible = NULL;
+uint32_t skinned_instances_count = 0;
+uint32_t skinned_dynamic_offsets[2] = {0};
 
 bool fullscreen = false;
 
 // FPS counter
 uint32_t frame_count = 0;
+// Print the GPU time of each pass along with the FPS
+const bool print_gpu_times = true;
+
+// Record CPU zones for the phases of each frame, which F9 writes out as a
+// Chrome trace (chrome://tracing or ui.perfetto.dev).  With
+// VK_EXT_calibrated_timestamps the profiler's GPU scopes are in it too, on
+// the same clock
+const bool cpu_trace = true;
+const char* TRACE_FILENAME = "trace.json";
+// Write the trace of the frames around any frame which takes longer than
+// SPIKE_THRESHOLD_MS, or SPIKE_MEDIAN_MULTIPLE times the median of the last
+// few seconds', to catch the hitches which are gone by the time F9 is pressed.
+// The GPU scopes and the command counts of each frame go in as counters
+const bool spike_traces = false;
+#define SPIKE_THRESHOLD_MS 50.0
+#define SPIKE_MEDIAN_MULTIPLE 3.0
+#define SPIKE_MAX_TRACES 16
+const char* SPIKE_TRACE_FILENAME_FORMAT = "spike_%03u.json";
+
+// The device memory by heap and tag, which F10 and the end of a run write out
+// as JSON to compare between builds
+const char* MEMORY_STATS_FILENAME = "memory.json";
+// Device local memory allocated past this gets a warning (and fails a
+// benchmark), so growth shows up long before it runs out on a 2 GB card.  0
+// for no limit
+#define DEVICE_MEMORY_WARNING_MB 1536
 double last_fps_time = 0.0;
 
 // If the swap chain is suboptimal, we record how many cycles it was suboptimal for
@@ -210,6 +2173,59 @@ double last_fps_time = 0.0;
 uint32_t suboptimal_swapchain_count = 0;
 const uint32_t SUBOPTIMAL_SWAPCHAIN_THRESHOLD = 10;
 
+const VkSpecializationMapEntry FRAGMENT_SPECIALIZATION_ENTRIES[3] = {
+	{0, offsetof(FragmentSpecialization, alpha_mode), sizeof(uint32_t)},
+	{1, offsetof(FragmentSpecialization, alpha_cutoff), sizeof(float)},
+	{2, offsetof(FragmentSpecialization, alpha_to_coverage), sizeof(VkBool32)},
+};
+
+VkSpecializationInfo get_fragment_specialization_info(const FragmentSpecialization* specialization) {
+	/*
+	 * The specialization info for a pipeline drawing tiles or sprites, which
+	 * points at the constants so they have to outlive it
+	 */
+	VkSpecializationInfo specialization_info = {0};
+	specialization_info.mapEntryCount = 3;
+	specialization_info.pMapEntries = FRAGMENT_SPECIALIZATION_ENTRIES;
+	specialization_info.dataSize = sizeof(FragmentSpecialization);
+	specialization_info.pData = specialization;
+	return specialization_info;
+}
+
+VkSpecializationInfo get_skinned_specialization_info(const SkinnedSpecialization* specialization) {
+	/*
+	 * The specialization info for the skinned characters' pipeline, which
+	 * points at the constants so they have to outlive it
+	 */
+	static const VkSpecializationMapEntry entries[4] = {
+		{0, offsetof(SkinnedSpecialization, fragment.alpha_mode), sizeof(uint32_t)},
+		{1, offsetof(SkinnedSpecialization, fragment.alpha_cutoff), sizeof(float)},
+		{2, offsetof(SkinnedSpecialization, fragment.alpha_to_coverage), sizeof(VkBool32)},
+		{3, offsetof(SkinnedSpecialization, bones_count), sizeof(uint32_t)},
+	};
+
+	VkSpecializationInfo specialization_info = {0};
+	specialization_info.mapEntryCount = 4;
+	specialization_info.pMapEntries = entries;
+	specialization_info.dataSize = sizeof(SkinnedSpecialization);
+	specialization_info.pData = specialization;
+	return specialization_info;
+}
+
+VkSpecializationInfo get_workgroup_specialization_info(const uint32_t* workgroup_size) {
+	/*
+	 * The specialization info for a compute shader with local_size_x_id = 0
+	 */
+	static const VkSpecializationMapEntry entry = {0, 0, sizeof(uint32_t)};
+
+	VkSpecializationInfo specialization_info = {0};
+	specialization_info.mapEntryCount = 1;
+	specialization_info.pMapEntries = &entry;
+	specialization_info.dataSize = sizeof(uint32_t);
+	specialization_info.pData = workgroup_size;
+	return specialization_info;
+}
+
 VkVertexInputBindingDescription get_binding_description() {
 	VkVertexInputBindingDescription binding_description = {0};
 	binding_description.binding = 0;
@@ -219,71 +2235,285 @@ VkVertexInputBindingDescription get_binding_description() {
 	return binding_description;
 }
 
-VkVertexInputAttributeDescription* get_attribute_descriptions(size_t* count) {
-	*count = 2;
+VkVertexInputAttributeDescription* copy_attribute_descriptions(const VkVertexInputAttributeDescription* descriptions, size_t descriptions_count, size_t* count) {
+	/*
+	 * A format's attribute descriptions from vertex_formats.h, in the frame
+	 * allocator as the pipelines take them
+	 */
+	*count = descriptions_count;
 
-	VkVertexInputAttributeDescription* attribute_descriptions = malloc(sizeof(VkVertexInputAttributeDescription) * *count);
-	
-	attribute_descriptions[0] = (VkVertexInputAttributeDescription) {0};
-	attribute_descriptions[0].binding = 0;
-	attribute_descriptions[0].location = 0;
-	attribute_descriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-	attribute_descriptions[0].offset = offsetof(Vertex, pos);
-
-	attribute_descriptions[1] = (VkVertexInputAttributeDescription) {0};
-	attribute_descriptions[1].binding = 0;
-	attribute_descriptions[1].location = 1;
-	attribute_descriptions[1].format = VK_FORMAT_R32G32_SFLOAT;
-	attribute_descriptions[1].offset = offsetof(Vertex, tex_coord);
+	VkVertexInputAttributeDescription* attribute_descriptions = FRAME_ALLOC(VkVertexInputAttributeDescription, *count);
+	memcpy(attribute_descriptions, descriptions, sizeof(VkVertexInputAttributeDescription) * descriptions_count);
 
 	return attribute_descriptions;
 }
 
+VkVertexInputAttributeDescription* get_attribute_descriptions(size_t* count) {
+	static const VkVertexInputAttributeDescription descriptions[] = {
+		QUAD_VERTEX_FIELDS(VERTEX_ATTRIBUTE, VERTEX_NO_ATTRIBUTE, Vertex)
+	};
+	return copy_attribute_descriptions(descriptions, sizeof(descriptions) / sizeof(descriptions[0]), count);
+}
+
+VkVertexInputBindingDescription get_tile_binding_description() {
+	VkVertexInputBindingDescription binding_description = {0};
+	binding_description.binding = 0;
+	binding_description.stride = sizeof(TileVertex);
+	binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+	return binding_description;
+}
+
+VkVertexInputAttributeDescription* get_tile_attribute_descriptions(size_t* count) {
+	static const VkVertexInputAttributeDescription descriptions[] = {
+		TILE_VERTEX_FIELDS(VERTEX_ATTRIBUTE, VERTEX_NO_ATTRIBUTE, TileVertex)
+	};
+	return copy_attribute_descriptions(descriptions, sizeof(descriptions) / sizeof(descriptions[0]), count);
+}
+
 VkVertexInputBindingDescription get_sprite_binding_description() {
 	VkVertexInputBindingDescription binding_description = {0};
 	binding_description.binding = 0;
 	binding_description.stride = sizeof(VertexBufferSprite);
+	// In instanced mode the attributes advance once per sprite rather than once per vertex
+	binding_description.inputRate = instanced_sprites ? VK_VERTEX_INPUT_RATE_INSTANCE : VK_VERTEX_INPUT_RATE_VERTEX;
+
+	return binding_description;
+}
+
+VkVertexInputBindingDescription get_skinned_binding_description(void) {
+	VkVertexInputBindingDescription binding_description = {0};
+	binding_description.binding = 0;
+	binding_description.stride = sizeof(SkinnedVertex);
 	binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
 	return binding_description;
 }
 
+VkVertexInputAttributeDescription* get_skinned_attribute_descriptions(size_t* count) {
+	static const VkVertexInputAttributeDescription descriptions[] = {
+		SKINNED_VERTEX_FIELDS(VERTEX_ATTRIBUTE, VERTEX_NO_ATTRIBUTE, SkinnedVertex)
+	};
+	return copy_attribute_descriptions(descriptions, sizeof(descriptions) / sizeof(descriptions[0]), count);
+}
+
 VkVertexInputAttributeDescription* get_sprite_attribute_descriptions(size_t* count) {
-	*count = 5;
+	static const VkVertexInputAttributeDescription descriptions[] = {
+		SPRITE_VERTEX_FIELDS(VERTEX_ATTRIBUTE, VERTEX_NO_ATTRIBUTE, VertexBufferSprite)
+	};
+	return copy_attribute_descriptions(descriptions, sizeof(descriptions) / sizeof(descriptions[0]), count);
+}
 
-	VkVertexInputAttributeDescription* attribute_descriptions = malloc(sizeof(VkVertexInputAttributeDescription) * *count);
-	
-	attribute_descriptions[0] = (VkVertexInputAttributeDescription) {0};
-	attribute_descriptions[0].binding = 0;
-	attribute_descriptions[0].location = 0;
-	attribute_descriptions[0].format = VK_FORMAT_R32G32B32A32_SFLOAT;
-	attribute_descriptions[0].offset = offsetof(VertexBufferSprite, color);
-	
-	attribute_descriptions[1] = (VkVertexInputAttributeDescription) {0};
-	attribute_descriptions[1].binding = 0;
-	attribute_descriptions[1].location = 1;
-	attribute_descriptions[1].format = VK_FORMAT_R32G32_SFLOAT;
-	attribute_descriptions[1].offset = offsetof(VertexBufferSprite, uv);
-
-	attribute_descriptions[2] = (VkVertexInputAttributeDescription) {0};
-	attribute_descriptions[2].binding = 0;
-	attribute_descriptions[2].location = 2;
-	attribute_descriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
-	attribute_descriptions[2].offset = offsetof(VertexBufferSprite, uv2);
-
-	attribute_descriptions[3] = (VkVertexInputAttributeDescription) {0};
-	attribute_descriptions[3].binding = 0;
-	attribute_descriptions[3].location = 3;
-	attribute_descriptions[3].format = VK_FORMAT_R32_UINT;
-	attribute_descriptions[3].offset = offsetof(VertexBufferSprite, texture_index);
-
-	attribute_descriptions[4] = (VkVertexInputAttributeDescription) {0};
-	attribute_descriptions[4].binding = 0;
-	attribute_descriptions[4].location = 4;
-	attribute_descriptions[4].format = VK_FORMAT_R32_UINT;
-	attribute_descriptions[4].offset = offsetof(VertexBufferSprite, sprite_index);
+VkVertexInputBindingDescription get_framed_sprite_binding_description(void) {
+	VkVertexInputBindingDescription binding_description = get_sprite_binding_description();
+	binding_description.stride = sizeof(VertexBufferFramedSprite);
 
-	return attribute_descriptions;
+	return binding_description;
+}
+
+VkVertexInputAttributeDescription* get_framed_sprite_attribute_descriptions(size_t* count) {
+	static const VkVertexInputAttributeDescription descriptions[] = {
+		FRAMED_SPRITE_VERTEX_FIELDS(VERTEX_ATTRIBUTE, VERTEX_NO_ATTRIBUTE, VertexBufferFramedSprite)
+	};
+	return copy_attribute_descriptions(descriptions, sizeof(descriptions) / sizeof(descriptions[0]), count);
+}
+
+bool use_debug_shapes(void) {
+#ifndef NDEBUG
+	return debug_shapes;
+#else
+	return false;
+#endif
+}
+
+bool use_vertex_pulling(void) {
+	return vertex_pulling && vkx_instance.has_buffer_device_address;
+}
+
+bool use_sprite_frame_table(void) {
+	return sprite_frame_table && vkx_instance.has_buffer_device_address;
+}
+
+bool use_half_precision_shading(void) {
+	return half_precision_shading && vkx_instance.has_shader_float16;
+}
+
+bool use_threaded_present(void) {
+	return threaded_present && !headless && vkx_instance.has_separate_present_queue && extra_windows_count == 0;
+}
+
+bool use_autotune(void) {
+	return autotune_render_paths && !bench_is_running();
+}
+
+bool use_hot_reload(void) {
+	// The watcher would be timed along with the frames
+	return hot_reload && async_pipeline_compilation && !bench_is_running();
+}
+
+bool is_loose_file(const char* path) {
+	/*
+	 * Whether a shader or texture is read from its file, rather than being
+	 * embedded in the binary or packed in the asset archive, so changing the
+	 * file does something
+	 */
+	size_t embedded_size;
+	return vkx_get_embedded_shader(path, &embedded_size) == NULL && !archive_mounted_has(path);
+}
+
+bool use_sparse_tiles(void) {
+	// Only the chunked tilemap draws from a tile store
+	return sparse_tiles && chunked_tilemap;
+}
+
+bool use_chunk_impostors(void) {
+	// Only the chunked tilemap has chunks to make impostors of
+	return chunk_impostors && chunked_tilemap;
+}
+
+bool use_streamed_world(void) {
+	return streamed_world && use_sparse_tiles();
+}
+
+bool use_sprite_events(void) {
+	return gpu_sprite_simulation && gpu_sprite_events;
+}
+
+VkDeviceSize get_sprite_events_size(void) {
+	/*
+	 * The size of the event buffer and its copies, which is only the header
+	 * without gpu_sprite_events
+	 */
+	return sizeof(SpriteEventHeader) + (use_sprite_events() ? sizeof(SpriteEvent) * MAX_SPRITE_EVENTS : 0);
+}
+
+bool use_mesh_shader_sprites(void) {
+	/*
+	 * Whether gpu_sprite_culling is done by the mesh shader sprites, which the
+	 * device might not be able to do (or not with split screen's multiview)
+	 */
+	return gpu_sprite_culling && mesh_shader_sprites
+		&& vkx_instance.has_mesh_shader && vkx_instance.has_buffer_device_address
+		&& (split_screen_views == 1 || vkx_instance.has_multiview_mesh_shader);
+}
+
+bool use_sparse_atlas(void) {
+	// Whether the atlas is sparse, which the device might not be able to do
+	return sparse_atlas && !bindless_textures && vkx_sparse_atlas_is_supported();
+}
+
+bool use_variable_rate_shading(void) {
+	// Whether the background is shaded at 2x2, which the device might not be
+	// able to do
+	return variable_rate_shading && vkx_has_shading_rate();
+}
+
+bool use_shading_rate_image(void) {
+	// Whether the map's rate comes from the mask as well (see
+	// vkx_set_shading_rate() in init_vulkan())
+	return use_variable_rate_shading() && vkx_has_shading_rate_attachment();
+}
+
+bool use_background_layer(void) {
+	// Whether the sprites from BACKGROUND_SPRITE_Z back are drawn apart from
+	// the rest, at 2x2 or at a lower resolution
+	return use_variable_rate_shading() || half_res_background;
+}
+
+bool tile_layer_in_background(const TileLayer* layer) {
+	// Whether a tile layer is drawn in the background pass, as it moves slower
+	// than the camera
+	return half_res_background && layer->desc.parallax < 1.0f;
+}
+
+const char* get_tile_frag_shader_path(void) {
+	if (bindless_textures) {
+		return "shaders/tiles_bindless.frag.spv";
+	}
+	if (lighting) {
+		return "shaders/tiles_lit.frag.spv";
+	}
+	if (use_sparse_atlas()) {
+		return "shaders/tiles_sparse.frag.spv";
+	}
+	if (palette_textures) {
+		return "shaders/tiles_palette.frag.spv";
+	}
+	return use_half_precision_shading() ? "shaders/tiles_half.frag.spv" : "shaders/tiles.frag.spv";
+}
+
+const char* get_tile_cache_frag_shader_path(void) {
+	// The tiles drawn into the cached tile layers and the chunk impostors,
+	// which are unlit and never from the sparse atlas
+	if (bindless_textures) {
+		return "shaders/tiles_bindless.frag.spv";
+	}
+	if (palette_textures) {
+		return "shaders/tiles_palette.frag.spv";
+	}
+	return use_half_precision_shading() ? "shaders/tiles_half.frag.spv" : "shaders/tiles.frag.spv";
+}
+
+const char* get_sprite_frag_shader_path(void) {
+	if (overdraw_heatmap) {
+		return "shaders/sprite_overdraw.frag.spv";
+	}
+	if (bindless_textures) {
+		return "shaders/sprite_bindless.frag.spv";
+	}
+	if (lighting) {
+		return "shaders/sprite_lit.frag.spv";
+	}
+	if (use_sparse_atlas()) {
+		return "shaders/sprite_sparse.frag.spv";
+	}
+	if (palette_textures) {
+		return "shaders/sprite_palette.frag.spv";
+	}
+	return use_half_precision_shading() ? "shaders/sprite_half.frag.spv" : "shaders/sprite.frag.spv";
+}
+
+VkPipelineStageFlags2 get_sprite_geometry_stages(void) {
+	/*
+	 * Get the shader stages which read the sprite transforms while drawing
+	 */
+	if (use_mesh_shader_sprites()) {
+		return VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT | VK_PIPELINE_STAGE_2_MESH_SHADER_BIT_EXT;
+	}
+	return VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT;
+}
+
+VkBufferUsageFlags get_vertex_records_usage(void) {
+	/*
+	 * Get the usage which the buffers of sprite records and tile vertices need
+	 * to be drawn from
+	 */
+	VkBufferUsageFlags usage = use_vertex_pulling() ? VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT : VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+	// The mesh shader sprites find the records by their address too
+	if (use_mesh_shader_sprites()) {
+		usage |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+	}
+	return usage;
+}
+
+void bind_vertex_records(VkCommandBuffer command_buffer, VkPipelineLayout layout, VkBuffer records, VkDeviceSize offset) {
+	/*
+	 * Bind the sprite records or tile vertices the next draws read, as the
+	 * vertex buffer or by pushing their address.  The address has to be pushed
+	 * again after the whole of the push constants are
+	 *
+	 * @param layout Layout of the bound pipeline, with PushConstants
+	 * @param records A buffer made with get_vertex_records_usage()
+	 * @param offset Where the records start in it
+	 */
+	if (use_vertex_pulling()) {
+		VkDeviceAddress address = vkx_get_buffer_address(records) + offset;
+		vkCmdPushConstants(command_buffer, layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+				offsetof(PushConstants, records_address), sizeof(VkDeviceAddress), &address);
+		return;
+	}
+
+	vkCmdBindVertexBuffers(command_buffer, 0, 1, &records, &offset);
 }
 
 void create_texture_sampler() {
@@ -309,1002 +2539,10089 @@ void create_texture_sampler() {
 	sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
 	sampler_info.mipLodBias = 0.0f;
 	sampler_info.minLod = 0.0f;
-	sampler_info.maxLod = 0.0f;
+	sampler_info.maxLod = generate_mipmaps ? VK_LOD_CLAMP_NONE : 0.0f;
 	
-	if (vkCreateSampler(vkx_instance.device, &sampler_info, NULL, &texture_sampler) != VK_SUCCESS) {
-		fprintf(stderr, "failed to create texture sampler!\n");
-		exit(1);
+	texture_sampler = vkx_get_sampler(&sampler_info);
+}
+
+void create_screen_sampler() {
+	// The offscreen image has no mip levels, and nearest upscaling uses
+	// texelFetch() so it ignores the filter
+	VkSamplerCreateInfo sampler_info = {0};
+	sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	sampler_info.magFilter = VK_FILTER_LINEAR;
+	sampler_info.minFilter = VK_FILTER_LINEAR;
+	sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	sampler_info.anisotropyEnable = VK_FALSE;
+	sampler_info.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+	sampler_info.unnormalizedCoordinates = VK_FALSE;
+	sampler_info.compareEnable = VK_FALSE;
+	sampler_info.compareOp = VK_COMPARE_OP_ALWAYS;
+	sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	sampler_info.minLod = 0.0f;
+	sampler_info.maxLod = 0.0f;
+
+	screen_sampler = vkx_get_sampler(&sampler_info);
+}
+
+void create_profiler() {
+	vkx_profiler_init(&profiler);
+	// The passes also count their shader invocations, except where the
+	// counts would be split between the views, or the secondary command
+	// buffers would have to carry on the query
+	profile_frame = vkx_profiler_add_scope(&profiler, "frame");
+	if (split_screen_views > 1) {
+		profile_tiles = vkx_profiler_add_scope(&profiler, "tiles");
+		profile_sprites = vkx_profiler_add_scope(&profiler, "sprites");
+	}
+	else {
+		profile_tiles = vkx_profiler_add_statistics_scope(&profiler, "tiles");
+		profile_sprites = vkx_profiler_add_statistics_scope(&profiler, "sprites");
 	}
+	profile_post = vkx_profiler_add_statistics_scope(&profiler, "post");
+	profile_screen = static_command_buffers ? vkx_profiler_add_scope(&profiler, "screen") : vkx_profiler_add_statistics_scope(&profiler, "screen");
 }
 
-VkxBuffer vkx_create_and_populate_buffer(
-		void* vertices,
-		VkDeviceSize buffer_size,
-		VkBufferUsageFlags usage_flags
-) {
+VkExtent2D get_largest_swap_chain_extent(void) {
 	/*
-	 * Create a vertex buffer from the given vertices
-	 *
-	 * @param vertices The array of vertex data to create the buffer from
-	 * @param buffer_size The size of the vertex data (i.e. sizeof(vertices[0]) * vertices_count)
-	 * @param usage_flags The usage flags for the buffer (TRANSFER_DST_BIT is automatically added)
+	 * The largest the swap chain can get, for the images the scene is drawn
+	 * with when it's drawn straight to the swap chain: the display's longer
+	 * side both ways, so it's big enough however the window is resized or
+	 * rotated, or just the swap chain's extent headless
 	 */
-	// We should probably add a flag to decide if the buffer should be host coherent
-	// (and not use a staging buffer)
-	VkxBuffer staging_buffer = vkx_create_buffer(
-		buffer_size,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-	);
+	VkExtent2D extent = vkx_swap_chain.extent;
+	const SDL_DisplayMode* mode = headless ? NULL : SDL_GetDesktopDisplayMode(SDL_GetDisplayForWindow(window));
+	if (mode != NULL) {
+		int side = mode->w > mode->h ? mode->w : mode->h;
+		uint32_t pixels = (uint32_t) ((float) side * mode->pixel_density + 0.5f);
+		extent.width = pixels > extent.width ? pixels : extent.width;
+		extent.height = pixels > extent.height ? pixels : extent.height;
+	}
+	return extent;
+}
 
-	void *data;
-	vkMapMemory(vkx_instance.device, staging_buffer.memory, 0, buffer_size, 0, &data);
-	memcpy(data, vertices, (size_t) buffer_size);
-	vkUnmapMemory(vkx_instance.device, staging_buffer.memory);
+VkExtent2D get_max_render_extent(void) {
+	// The largest the scene can be, which the images it's drawn to are made big
+	// enough for
+	if (scene_to_swap_chain) {
+		return largest_swap_chain_extent;
+	}
 
-	VkxBuffer buffer = vkx_create_buffer(
-		buffer_size,
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage_flags,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
-	);
+	VkExtent2D extent = {
+		(uint32_t) ((float) SCREEN_WIDTH * MAX_RENDER_SCALE + 0.5f),
+		(uint32_t) ((float) SCREEN_HEIGHT * MAX_RENDER_SCALE + 0.5f),
+	};
+	return extent;
+}
 
-	// Copy the staging buffer into the vertex buffer
-	vkx_copy_buffer(staging_buffer.buffer, buffer.buffer, buffer_size);
-	
-	vkx_cleanup_buffer(&staging_buffer);
+VkExtent2D get_render_extent() {
+	// Size of the scene in the offscreen image at the current render scale
+	if (scene_to_swap_chain) {
+		// Or all of the swap chain image it's drawn straight to, as far as the
+		// depth image reaches
+		VkExtent2D extent = vkx_swap_chain.extent;
+		extent.width = extent.width < largest_swap_chain_extent.width ? extent.width : largest_swap_chain_extent.width;
+		extent.height = extent.height < largest_swap_chain_extent.height ? extent.height : largest_swap_chain_extent.height;
+		return extent;
+	}
 
-	return buffer;
+	VkExtent2D extent = {0};
+	extent.width = (uint32_t) ((float) SCREEN_WIDTH * render_scale + 0.5f);
+	extent.height = (uint32_t) ((float) SCREEN_HEIGHT * render_scale + 0.5f);
+	extent.width = extent.width < 1 ? 1 : extent.width;
+	extent.height = extent.height < 1 ? 1 : extent.height;
+	return extent;
 }
 
-void init_vulkan(void) {
-	// ----- Initialise the vulkan instance and devices -----
-	vkx_init(window);
-
-	// ----- Create the swap chain -----
-	vkx_create_swap_chain(false);
-	
-	// ----- Create the graphics pipeline -----
-	// Vertex input bindng and attributes
-	VkVertexInputBindingDescription binding_description = get_binding_description();
-	size_t attribute_descriptions_count = 0;
-	VkVertexInputAttributeDescription* attribute_descriptions = get_attribute_descriptions(&attribute_descriptions_count);
+VkExtent2D get_background_extent(VkExtent2D extent) {
+	// Size of the background for the scene at a size, rounded up
+	extent.width = (extent.width + BACKGROUND_RESOLUTION_DIVISOR - 1) / BACKGROUND_RESOLUTION_DIVISOR;
+	extent.height = (extent.height + BACKGROUND_RESOLUTION_DIVISOR - 1) / BACKGROUND_RESOLUTION_DIVISOR;
+	return extent;
+}
 
-	// Push constants for pushing matrices etc.
-	VkPushConstantRange push_constant_range = {0};
-	push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-	push_constant_range.offset = 0;
-	push_constant_range.size = sizeof(PushConstants);
+VkExtent2D get_shading_rate_mask_extent(void) {
+	// The texels of the mask, enough for the offscreen image at the largest
+	// render scale
+	VkExtent2D extent = get_max_render_extent();
+	extent.width = (extent.width + shading_rate_texel_size.width - 1) / shading_rate_texel_size.width;
+	extent.height = (extent.height + shading_rate_texel_size.height - 1) / shading_rate_texel_size.height;
+	return extent;
+}
 
-	tile_pipeline = vkx_create_vertex_buffer_pipeline(
-		"shaders/tiles.vert.spv",
-		"shaders/tiles.frag.spv",
-		binding_description,
-		attribute_descriptions,
-		attribute_descriptions_count,
-		push_constant_range,
-		num_textures
-	);
-	
-	// Create the sprite pipeline
-	// Vertex input binding and attributes
-	VkVertexInputBindingDescription sprite_binding_description = get_sprite_binding_description();
-	size_t sprite_attribute_descriptions_count = 0;
-	VkVertexInputAttributeDescription* sprite_attribute_descriptions = get_sprite_attribute_descriptions(&sprite_attribute_descriptions_count);
+bool shading_rate_mask_supported(void) {
+	/*
+	 * Whether the scene pass can take its shading rate from the mask: the
+	 * device has to have shading rate attachments in R8_UINT, which can be
+	 * copied to, and the scene pass has to be recorded in the primary command
+	 * buffer with one view, into an image of a size known up front (not the
+	 * swap chain with local_read_screen)
+	 */
+	if (!vkx_instance.has_shading_rate_attachment || split_screen_views > 1 || parallel_recording || static_command_buffers
+			|| local_read_screen) {
+		return false;
+	}
 
-	// Push constants are the same (actually not used by the sprite shaders)
-	sprite_pipeline = vkx_create_vertex_buffer_pipeline(
-		"shaders/sprite.vert.spv",
-		"shaders/sprite.frag.spv",
-		sprite_binding_description,
-		sprite_attribute_descriptions,
-		sprite_attribute_descriptions_count,
-		push_constant_range,
-		num_textures
-	);
+	VkFormatFeatureFlags features = VK_FORMAT_FEATURE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+	VkFormatProperties properties;
+	vkGetPhysicalDeviceFormatProperties(vkx_instance.physical_device, VK_FORMAT_R8_UINT, &properties);
+	return (properties.optimalTilingFeatures & features) == features;
+}
 
-	// Screen pipeline is simple and has no vertex input
-	screen_pipeline = vkx_create_screen_pipeline(
-		"shaders/screen.vert.spv",
-		"shaders/screen.frag.spv"
-	);
+bool screen_transfer_supported() {
+	/*
+	 * Whether the screen pass can copy or blit the offscreen image to the swap
+	 * chain image, which has to be unrotated, a transfer destination, and in a
+	 * format that can be blitted (the offscreen image has the same format)
+	 */
+	if (vkx_swap_chain.pre_rotation != 0 || (vkx_swap_chain.image_usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT) == 0) {
+		return false;
+	}
 
-	free(sprite_attribute_descriptions);
-	free(attribute_descriptions);
+	VkFormatProperties source_properties;
+	vkGetPhysicalDeviceFormatProperties(vkx_instance.physical_device, offscreen_format, &source_properties);
+	VkFormatProperties destination_properties;
+	vkGetPhysicalDeviceFormatProperties(vkx_instance.physical_device, vkx_swap_chain.image_format, &destination_properties);
+	VkFormatFeatureFlags source_features = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
 
-	
-	// ----- Create the buffers -----
-	// Vertex buffer
-	vertex_buffer = vkx_create_and_populate_buffer(
-			vertices, sizeof(vertices[0]) * vertices_count,
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
-	);
-	// Index buffer
-	index_buffer = vkx_create_and_populate_buffer(
-			vertex_indices, sizeof(vertex_indices[0]) * vertex_indices_count,
-			VK_BUFFER_USAGE_INDEX_BUFFER_BIT
-	);
-	// Sprite vertex buffer
-	sprite_vertex_buffer = vkx_create_and_populate_buffer(
-			vertex_sprites, sizeof(vertex_sprites[0]) * vertex_sprites_count,
-			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
-	);
+	return (source_properties.optimalTilingFeatures & source_features) == source_features
+		&& (destination_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT) != 0;
+}
 
-	// ----- Load the texture images -----
-	textures = malloc(sizeof(VkxImage) * num_textures);
-	textures[0] = vkx_create_texture_image("textures/tiles.png");
-	textures[1] = vkx_create_texture_image("textures/monsters1.png");
-	textures[2] = vkx_create_texture_image("textures/monsters2.png");
-	textures[3] = vkx_create_texture_image("textures/monsters3.png");
-	textures[4] = vkx_create_texture_image("textures/monsters4.png");
-	
-	// Create the texture sampler
-	create_texture_sampler();
+VkFormat choose_offscreen_format(void) {
+	/*
+	 * The first of OFFSCREEN_FORMATS the scene can be drawn into and the
+	 * screen pass can sample, or the swap chain's if none of them can
+	 */
+	const VkFormatFeatureFlags features = VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BLEND_BIT
+		| VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
 
-	// ----- Create the uniform buffer -----
-	VkDeviceSize uniform_buffer_size = sizeof(UniformBufferObject);
+	for (size_t i = 0; i < sizeof(OFFSCREEN_FORMATS) / sizeof(OFFSCREEN_FORMATS[0]); i++) {
+		if (OFFSCREEN_FORMATS[i] == OFFSCREEN_FORMAT_SWAP_CHAIN) {
+			return vkx_swap_chain.image_format;
+		}
 
-	if (uniform_buffer_size > 65536) {
-		fprintf(stderr, "Tried to allocate a buffer with %zu bytes, which is greater than the maximum (65536)", uniform_buffer_size);
-		exit(1);
+		VkFormatProperties properties;
+		vkGetPhysicalDeviceFormatProperties(vkx_instance.physical_device, OFFSCREEN_FORMATS[i], &properties);
+		if ((properties.optimalTilingFeatures & features) == features) {
+			return OFFSCREEN_FORMATS[i];
+		}
 	}
 
-	for (size_t i = 0; i < VKX_FRAMES_IN_FLIGHT; i++) {
-		uniform_buffers[i] = vkx_create_buffer(
-			uniform_buffer_size,
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-		);
+	printf("None of the offscreen formats can be rendered to, so the swap chain's is used\n");
+	return vkx_swap_chain.image_format;
+}
 
-		// Map the buffer memory and copy the vertex data into it
-		vkMapMemory(vkx_instance.device, uniform_buffers[i].memory, 0, uniform_buffer_size, 0, &uniform_buffers_mapped[i]);
+VkFormat get_tile_layer_cache_format(void) {
+	/*
+	 * The format of the cached tile layers, the offscreen format unless it has
+	 * no alpha
+	 */
+	switch (offscreen_format) {
+		case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+		case VK_FORMAT_R5G6B5_UNORM_PACK16:
+		case VK_FORMAT_B5G6R5_UNORM_PACK16:
+			return TILE_LAYER_CACHE_FALLBACK_FORMAT;
+		default:
+			return offscreen_format;
 	}
+}
 
-	// ----- Create the offscreen images -----
-	VkFormat depth_format = vkx_find_depth_format();
+void set_render_scale(float scale) {
+	render_scale = glm_clamp(scale, MIN_RENDER_SCALE, MAX_RENDER_SCALE);
+	frames_since_render_scale_change = 0;
+}
 
-	for (size_t i=0; i<VKX_FRAMES_IN_FLIGHT; i++) {
-		offscreen_images[i] = vkx_create_image(
-			SCREEN_WIDTH,
-			SCREEN_HEIGHT,
-			vkx_swap_chain.image_format,
-			VK_IMAGE_TILING_OPTIMAL,
-			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+VkxBuffer vkx_create_and_populate_buffer(
+		void* vertices,
+		VkDeviceSize buffer_size,
+		VkBufferUsageFlags usage_flags
+) {
+	/*
+	 * Create a vertex buffer from the given vertices
+	 *
+	 * @param vertices The array of vertex data to create the buffer from
+	 * @param buffer_size The size of the vertex data (i.e. sizeof(vertices[0]) * vertices_count)
+	 * @param usage_flags The usage flags for the buffer (TRANSFER_DST_BIT is automatically added)
+	 *
+	 * The copy is queued with the upload manager, so vkx_upload_flush() must be
+	 * called before the buffer is used.  With unified memory the data is written
+	 * straight into the buffer instead, which is ready to use straight away
+	 */
+	if (unified_memory_buffers && vkx_instance.unified_memory) {
+		VkxBuffer buffer = vkx_create_buffer(
+			buffer_size,
+			usage_flags,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
 		);
 
-		offscreen_images[i].view = vkx_create_image_view(
-			offscreen_images[i].image,
-			vkx_swap_chain.image_format,
-			VK_IMAGE_ASPECT_COLOR_BIT
-		);
+		// Host writes are visible to the GPU from the next queue submission
+		memcpy(buffer.allocation.mapped, vertices, (size_t) buffer_size);
 
-		// transition the image layout to color attachment optimal
-		vkx_transition_image_layout_tmp_buffer(
-			offscreen_images[i].image,
-			vkx_swap_chain.image_format,
-			VK_IMAGE_LAYOUT_UNDEFINED,
-			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-		);
+		return buffer;
+	}
 
-		// And depth images too
-		depth_images[i] = vkx_create_image(
-			SCREEN_WIDTH,
-			SCREEN_HEIGHT,
-			depth_format,
-			VK_IMAGE_TILING_OPTIMAL,
-			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
-		);
+	VkxBuffer buffer = vkx_create_buffer(
+		buffer_size,
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage_flags,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+	);
 
-		depth_images[i].view = vkx_create_image_view(depth_images[i].image, depth_format, VK_IMAGE_ASPECT_DEPTH_BIT);
+	// Copy the data in on the transfer queue
+	vkx_upload_buffer(buffer.buffer, 0, vertices, buffer_size);
 
-		// Transition the image layout to depth stencil attachment
-		vkx_transition_image_layout_tmp_buffer(
-			depth_images[i].image, depth_format,
-			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
-		);
+	return buffer;
+}
+
+VkxBuffer create_and_populate_buffer_in_place(const void* data, VkDeviceSize size, VkBufferUsageFlags usage_flags) {
+	/*
+	 * vkx_create_and_populate_buffer() for data which is kept, and isn't
+	 * changed until the upload is done, so with import_host_uploads it's
+	 * copied to the GPU straight out of the data (see
+	 * vkx_upload_buffer_in_place()).  With unified memory it's written
+	 * straight into the buffer either way
+	 */
+	if (!import_host_uploads || (unified_memory_buffers && vkx_instance.unified_memory)) {
+		return vkx_create_and_populate_buffer((void*) data, size, usage_flags);
 	}
 
-	// ----- Create the descriptor pool -----
-	VkDescriptorPoolSize desc_pool_sizes[2] = {0};
-	desc_pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	desc_pool_sizes[0].descriptorCount = VKX_FRAMES_IN_FLIGHT * 2;
-	desc_pool_sizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	desc_pool_sizes[1].descriptorCount = VKX_FRAMES_IN_FLIGHT * num_textures + VKX_FRAMES_IN_FLIGHT;
+	VkxBuffer buffer = vkx_create_buffer(
+		size,
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage_flags,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+	);
+	vkx_upload_buffer_in_place(buffer.buffer, 0, data, size);
 
-	VkDescriptorPoolCreateInfo desc_pool_info = {0};
-	desc_pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	desc_pool_info.poolSizeCount = 2;
-	desc_pool_info.pPoolSizes = desc_pool_sizes;
-	desc_pool_info.maxSets = VKX_FRAMES_IN_FLIGHT * 2;
+	return buffer;
+}
 
-	if (vkCreateDescriptorPool(vkx_instance.device, &desc_pool_info, NULL, &descriptor_pool) != VK_SUCCESS) {
-		fprintf(stderr, "failed to create descriptor pool!\n");
+uint8_t pack_unorm8(float value) {
+	// Round a 0 to 1 value to the nearest of 256 steps, for R8_UNORM formats
+	return (uint8_t) lroundf(glm_clamp(value, 0.0f, 1.0f) * 255.0f);
+}
+
+uint16_t pack_unorm16(float value) {
+	return (uint16_t) lroundf(glm_clamp(value, 0.0f, 1.0f) * 65535.0f);
+}
+
+uint32_t pack_sprite_flipbook(uint32_t first_frame, uint32_t frames, uint32_t columns, uint32_t fps) {
+	/*
+	 * Pack a sprite's flipbook, which sprite.vert plays from the time.  The
+	 * sprite's uv to uv2 is frame 0, and frame n is that moved along by n %
+	 * columns of its width and down by n / columns of its height, so the frames
+	 * have to be a grid of the same sized rectangles in the one texture.  Each
+	 * is up to 255
+	 *
+	 * @param first_frame The frame it's on at time 0, to keep sprites from
+	 *                    playing in step
+	 * @param frames How many frames there are, 0 for none
+	 * @param columns Frames across the grid
+	 * @param fps Frames a second
+	 */
+	return (first_frame & 0xff) << 24 | (fps & 0xff) << 16 | (columns & 0xff) << 8 | (frames & 0xff);
+}
+
+uint32_t pack_sprite_animation(float amplitude, float frequency) {
+	/*
+	 * Pack the parameters of a sprite's procedural animation, which sprite.vert
+	 * evaluates: it bobs up and down by amplitude at twice frequency, and
+	 * squashes by three quarters of amplitude (as a fraction of its size) at
+	 * frequency, both from SpriteTransform.anim_phase
+	 *
+	 * @param amplitude Up to SPRITE_ANIM_MAX_AMPLITUDE
+	 * @param frequency In radians a second, up to SPRITE_ANIM_MAX_FREQUENCY
+	 */
+	return (uint32_t) pack_unorm16(amplitude / SPRITE_ANIM_MAX_AMPLITUDE)
+		| (uint32_t) pack_unorm16(frequency / SPRITE_ANIM_MAX_FREQUENCY) << 16;
+}
+
+uint16_t set_sprite_texture(uint32_t texture, uint32_t flags) {
+	/*
+	 * Pack a texture into a VertexBufferSprite.texture_index
+	 *
+	 * @param texture The texture enum value, atlas layer or texture table index
+	 * @param flags SPRITE_FLAG_*
+	 */
+	if (texture > SPRITE_TEXTURE_MASK) {
+		fprintf(stderr, "Sprite texture %u doesn't fit in %d bits\n", texture, SPRITE_TEXTURE_BITS);
 		exit(1);
 	}
-	
-	{
-		// ----- Create the descriptor sets -----
-		VkDescriptorSetLayout ds_layouts[VKX_FRAMES_IN_FLIGHT] = {0};
-		for (size_t i = 0; i < VKX_FRAMES_IN_FLIGHT; i++) {
-			ds_layouts[i] = tile_pipeline.descriptor_set_layout;
-		}
+	return (uint16_t) (texture | flags);
+}
 
-		VkDescriptorSetAllocateInfo ds_alloc_info = {0};
-		ds_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-		ds_alloc_info.descriptorPool = descriptor_pool;
-		ds_alloc_info.descriptorSetCount = VKX_FRAMES_IN_FLIGHT;
-		ds_alloc_info.pSetLayouts = ds_layouts;
-		
-		// Create the base descriptor sets
-		if (vkAllocateDescriptorSets(vkx_instance.device, &ds_alloc_info, descriptor_sets) != VK_SUCCESS) {
-			fprintf(stderr, "failed to allocate descriptor sets!\n");
-			exit(1);
+void shift_palette_hue(const uint8_t* palette, float turns, uint8_t* out) {
+	/*
+	 * Make a recoloured copy of a palette by turning its colours' hues around
+	 * the grey axis, keeping their brightness and alpha
+	 *
+	 * @param palette VKX_PALETTE_COLOURS RGBA8 colours
+	 * @param turns How far round to turn them, 1 being all the way
+	 * @param out Set to the turned colours
+	 */
+	float c = cosf(turns * 2.0f * GLM_PIf);
+	float s = sinf(turns * 2.0f * GLM_PIf) * sqrtf(1.0f / 3.0f);
+	float d = (1.0f - c) / 3.0f;
+	const float rotation[3][3] = {
+		{c + d, d - s, d + s},
+		{d + s, c + d, d - s},
+		{d - s, d + s, c + d},
+	};
+
+	for (uint32_t i = 0; i < VKX_PALETTE_COLOURS; i++) {
+		const uint8_t* colour = &palette[i * 4];
+		for (uint32_t k = 0; k < 3; k++) {
+			float value = rotation[k][0] * colour[0] + rotation[k][1] * colour[1] + rotation[k][2] * colour[2];
+			out[i * 4 + k] = (uint8_t) fminf(fmaxf(value + 0.5f, 0.0f), 255.0f);
 		}
+		out[i * 4 + 3] = colour[3];
+	}
+}
 
-		for (size_t i = 0; i < VKX_FRAMES_IN_FLIGHT; i++) {
-			VkDescriptorBufferInfo buffer_info = {0};
-			buffer_info.buffer = uniform_buffers[i].buffer;
-			buffer_info.offset = 0;
-			buffer_info.range = sizeof(UniformBufferObject);
+void apply_texture_atlas(void) {
+	/*
+	 * Rewrite the texture coordinates in the sprite vertex data so they point
+	 * into the texture atlas, and the sprite texture indices to atlas pages.  The
+	 * tile shaders do the mapping for the tiles
+	 */
+	for (size_t i = 0; i < vertex_sprites_count; i++) {
+		VertexBufferSprite* sprite = &vertex_sprites[i];
+		uint32_t texture = sprite->texture_index & SPRITE_TEXTURE_MASK;
+		uint32_t flags = sprite->texture_index & ~SPRITE_TEXTURE_MASK;
+
+		vec2 uv = {VERTEX_UNPACK(SPRITE_UV_PACKING, sprite->uv[0]), VERTEX_UNPACK(SPRITE_UV_PACKING, sprite->uv[1])};
+		vec2 uv2 = {VERTEX_UNPACK(SPRITE_UV_PACKING, sprite->uv2[0]), VERTEX_UNPACK(SPRITE_UV_PACKING, sprite->uv2[1])};
+		vkx_atlas_map_uv(&texture_atlas, texture, uv, uv);
+		vkx_atlas_map_uv(&texture_atlas, texture, uv2, uv2);
+		for (size_t k = 0; k < 2; k++) {
+			sprite->uv[k] = VERTEX_PACK(SPRITE_UV_PACKING, uv[k]);
+			sprite->uv2[k] = VERTEX_PACK(SPRITE_UV_PACKING, uv2[k]);
+		}
 
-			VkDescriptorImageInfo* image_infos = malloc(sizeof(VkDescriptorImageInfo) * num_textures);
+		sprite->texture_index = set_sprite_texture(texture_atlas.regions[texture].layer, flags);
+	}
+}
 
-			for (size_t j = 0; j < num_textures; j++) {
-				image_infos[j].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-				image_infos[j].imageView = textures[j].view;
-				image_infos[j].sampler = texture_sampler;
-			}
+void apply_texture_table(void) {
+	/*
+	 * Rewrite the sprite texture indices to their indices in the bindless texture
+	 * table.  The texture coordinates don't need to change
+	 */
+	for (size_t i = 0; i < vertex_sprites_count; i++) {
+		uint32_t texture = vertex_sprites[i].texture_index & SPRITE_TEXTURE_MASK;
+		uint32_t flags = vertex_sprites[i].texture_index & ~SPRITE_TEXTURE_MASK;
+		vertex_sprites[i].texture_index = set_sprite_texture(texture_table_indices[texture], flags);
+	}
+}
 
-			VkWriteDescriptorSet descriptor_writes[2] = {0};
-			descriptor_writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptor_writes[0].dstSet = descriptor_sets[i];
-			descriptor_writes[0].dstBinding = 0;
-			descriptor_writes[0].dstArrayElement = 0;
-			descriptor_writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-			descriptor_writes[0].descriptorCount = 1;
-			descriptor_writes[0].pBufferInfo = &buffer_info;
-			descriptor_writes[0].pImageInfo = NULL;
-			descriptor_writes[0].pTexelBufferView = NULL;
+VertexBufferSprite make_sprite_record(uint32_t texture, const float uv[2], const float uv2[2], uint32_t color, uint32_t sprite_index) {
+	/*
+	 * Pack a sprite drawn at run time, mapping its texture like
+	 * apply_texture_atlas() or apply_texture_table() do the monsters'
+	 *
+	 * @param texture The texture enum value
+	 * @param uv, uv2 The corners of the part to draw, in its texture coordinates
+	 * @param color SPRITE_RGBA()
+	 */
+	VertexBufferSprite record = {0};
+	for (size_t k = 0; k < 4; k++) {
+		record.color[k] = (uint8_t) (color >> (k * 8));
+	}
 
-			descriptor_writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptor_writes[1].dstSet = descriptor_sets[i];
-			descriptor_writes[1].dstBinding = 1;
-			descriptor_writes[1].dstArrayElement = 0;
-			descriptor_writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			descriptor_writes[1].descriptorCount = num_textures;
-			descriptor_writes[1].pBufferInfo = NULL;
-			descriptor_writes[1].pImageInfo = image_infos;
-			descriptor_writes[1].pTexelBufferView = NULL;
+	vec2 mapped_uv = {uv[0], uv[1]};
+	vec2 mapped_uv2 = {uv2[0], uv2[1]};
+	if (bindless_textures) {
+		record.texture_index = set_sprite_texture(texture_table_indices[texture], 0);
+	}
+	else {
+		vkx_atlas_map_uv(&texture_atlas, texture, mapped_uv, mapped_uv);
+		vkx_atlas_map_uv(&texture_atlas, texture, mapped_uv2, mapped_uv2);
+		record.texture_index = set_sprite_texture(texture_atlas.regions[texture].layer, 0);
+	}
+	for (size_t k = 0; k < 2; k++) {
+		record.uv[k] = VERTEX_PACK(SPRITE_UV_PACKING, mapped_uv[k]);
+		record.uv2[k] = VERTEX_PACK(SPRITE_UV_PACKING, mapped_uv2[k]);
+	}
+	record.sprite_index = sprite_index;
 
-			vkUpdateDescriptorSets(vkx_instance.device, 2, descriptor_writes, 0, NULL);
+	return record;
+}
 
-			free(image_infos);
+uint16_t add_sprite_frame(const VertexBufferSprite* sprite) {
+	/*
+	 * Find the frame of the table with a sprite's texture coordinates, texture
+	 * and trim, adding it if there isn't one yet
+	 *
+	 * @return Its id
+	 */
+	SpriteFrame frame = {0};
+	frame.rect[0] = VERTEX_UNPACK(SPRITE_UV_PACKING, sprite->uv[0]);
+	frame.rect[1] = VERTEX_UNPACK(SPRITE_UV_PACKING, sprite->uv[1]);
+	frame.rect[2] = VERTEX_UNPACK(SPRITE_UV_PACKING, sprite->uv2[0]);
+	frame.rect[3] = VERTEX_UNPACK(SPRITE_UV_PACKING, sprite->uv2[1]);
+	frame.texture_index = sprite->texture_index & SPRITE_TEXTURE_MASK;
+	frame.trim = sprite->trim;
+
+	for (uint32_t i = 0; i < sprite_frames_count; i++) {
+		if (memcmp(&sprite_frames[i], &frame, sizeof(frame)) == 0) {
+			return (uint16_t) i;
 		}
 	}
-	{
-		// ----- Create the screen descriptor sets -----
-		VkDescriptorSetLayout ds_layouts[VKX_FRAMES_IN_FLIGHT] = {0};
-		for (size_t i = 0; i < VKX_FRAMES_IN_FLIGHT; i++) {
-			ds_layouts[i] = screen_pipeline.descriptor_set_layout;
-		}
+	if (sprite_frames_count == SPRITE_FRAMES_MAX) {
+		fprintf(stderr, "The sprites have more than %d frames\n", SPRITE_FRAMES_MAX);
+		exit(1);
+	}
+	sprite_frames[sprite_frames_count] = frame;
+	return (uint16_t) sprite_frames_count++;
+}
 
-		VkDescriptorSetAllocateInfo ds_alloc_info = {0};
-		ds_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-		ds_alloc_info.descriptorPool = descriptor_pool;
-		ds_alloc_info.descriptorSetCount = VKX_FRAMES_IN_FLIGHT;
-		ds_alloc_info.pSetLayouts = ds_layouts;
-		
-		// Create the base descriptor sets
-		if (vkAllocateDescriptorSets(vkx_instance.device, &ds_alloc_info, screen_descriptor_sets) != VK_SUCCESS) {
-			fprintf(stderr, "failed to allocate screen descriptor sets!\n");
-			exit(1);
+VertexBufferFramedSprite* create_sprite_frames(void) {
+	/*
+	 * Make the frame table for sprite_frame_table from the monsters'
+	 * vertex_sprites, once they're mapped to the atlas or the texture table,
+	 * and their VertexBufferFramedSprites.  The monsters showing the same part
+	 * of the same texture share a frame, so there are only as many as the
+	 * sheets have
+	 *
+	 * @return vertex_sprites_count records, to be freed once they're uploaded
+	 */
+	sprite_frames = malloc(sizeof(SpriteFrame) * SPRITE_FRAMES_MAX);
+	VertexBufferFramedSprite* records = malloc(sizeof(VertexBufferFramedSprite) * vertex_sprites_count);
+	if (sprite_frames == NULL || records == NULL) {
+		fprintf(stderr, "Failed to allocate the sprite frames\n");
+		exit(1);
+	}
+	sprite_frames_count = 0;
+
+	uint16_t frame = 0;
+	for (size_t i = 0; i < vertex_sprites_count; i++) {
+		const VertexBufferSprite* sprite = &vertex_sprites[i];
+		// Without instanced_sprites each sprite's record is there for each of
+		// its vertices
+		if (i == 0 || memcmp(sprite, &vertex_sprites[i - 1], sizeof(*sprite)) != 0) {
+			frame = add_sprite_frame(sprite);
 		}
 
-		for (size_t i = 0; i < VKX_FRAMES_IN_FLIGHT; i++) {
-			VkDescriptorBufferInfo buffer_info = {0};
-			buffer_info.buffer = uniform_buffers[i].buffer;
-			buffer_info.offset = 0;
-			buffer_info.range = sizeof(UniformBufferObject);
+		VertexBufferFramedSprite* record = &records[i];
+		memcpy(record->color, sprite->color, sizeof(record->color));
+		record->sprite_index = sprite->sprite_index;
+		record->frame = frame;
+		record->flags = (uint16_t) (sprite->texture_index & ~SPRITE_TEXTURE_MASK);
+		record->flipbook = sprite->flipbook;
+	}
 
-			VkDescriptorImageInfo image_info = {0};
+	printf("Sprite frames: %u, %zu bytes a sprite rather than %zu\n",
+		sprite_frames_count, sizeof(VertexBufferFramedSprite), sizeof(VertexBufferSprite));
+	return records;
+}
 
-			image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			image_info.imageView = offscreen_images[i].view;
-			image_info.sampler = texture_sampler;
+void set_retained_sprite_transform(uint32_t index, const float dst[4], float rotation) {
+	SpriteTransform* transform = &retained_transforms[index];
+	if (dst != NULL) {
+		transform->pos[0] = dst[0] + dst[2] * 0.5f;
+		transform->pos[1] = dst[1] + dst[3] * 0.5f;
+		transform->scale[0] = dst[2];
+		transform->scale[1] = dst[3];
+	}
+	transform->rotation = rotation;
+}
 
-			VkWriteDescriptorSet descriptor_writes[2] = {0};
-			descriptor_writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptor_writes[0].dstSet = screen_descriptor_sets[i];
-			descriptor_writes[0].dstBinding = 0;
-			descriptor_writes[0].dstArrayElement = 0;
-			descriptor_writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-			descriptor_writes[0].descriptorCount = 1;
-			descriptor_writes[0].pBufferInfo = &buffer_info;
-			descriptor_writes[0].pImageInfo = NULL;
-			descriptor_writes[0].pTexelBufferView = NULL;
+SpriteHandle add_retained_sprite(uint32_t texture, const float src_rect[4], const float dst[4], float rotation, uint32_t color, float z) {
+	/*
+	 * Add a sprite which is drawn every frame until it's removed, and only
+	 * uploaded again when it changes.  The arguments are the same as
+	 * sprite_draw()'s, but retained sprites are always alpha tested as they
+	 * aren't sorted.  On the main thread, after init_vulkan()
+	 *
+	 * @return Its handle, or SPRITE_POOL_NO_HANDLE if there's no room
+	 */
+	if (texture >= _TEX_COUNT) {
+		return SPRITE_POOL_NO_HANDLE;
+	}
 
-			descriptor_writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptor_writes[1].dstSet = screen_descriptor_sets[i];
-			descriptor_writes[1].dstBinding = 1;
-			descriptor_writes[1].dstArrayElement = 0;
-			descriptor_writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			descriptor_writes[1].descriptorCount = 1;
-			descriptor_writes[1].pBufferInfo = NULL;
-			descriptor_writes[1].pImageInfo = &image_info;
-			descriptor_writes[1].pTexelBufferView = NULL;
+	SpriteHandle handle = sprite_pool_add(&retained_sprites);
+	if (handle == SPRITE_POOL_NO_HANDLE) {
+		return handle;
+	}
+	uint32_t index = sprite_pool_get_index(handle);
+
+	retained_transforms[index] = (SpriteTransform) {0};
+	retained_transforms[index].z = z;
+	set_retained_sprite_transform(index, dst, rotation);
 
-			vkUpdateDescriptorSets(vkx_instance.device, 2, descriptor_writes, 0, NULL);
+	const float full_rect[4] = {0.0f, 0.0f, 1.0f, 1.0f};
+	const float* rect = src_rect != NULL ? src_rect : full_rect;
+	const float uv[2] = {rect[0], rect[1]};
+	const float uv2[2] = {rect[0] + rect[2], rect[1] + rect[3]};
+	VertexBufferSprite record = make_sprite_record(texture, uv, uv2, color, index);
+
+	const size_t vertices_per_sprite = instanced_sprites ? 1 : 6;
+	for (size_t j = 0; j < vertices_per_sprite; j++) {
+		retained_records[index * vertices_per_sprite + j] = record;
+	}
+
+	return handle;
+}
+
+void move_retained_sprite(SpriteHandle handle, const float dst[4], float rotation) {
+	/*
+	 * Move a retained sprite, or with dst NULL only turn it
+	 */
+	if (!sprite_pool_is_valid(&retained_sprites, handle)) {
+		return;
+	}
+	set_retained_sprite_transform(sprite_pool_get_index(handle), dst, rotation);
+	sprite_pool_mark_dirty(&retained_sprites, handle);
+}
+
+void animate_retained_sprite(SpriteHandle handle, float amplitude, float frequency, float phase) {
+	/*
+	 * Make a retained sprite bob and squash, which the vertex shader does with
+	 * nothing more uploaded, see pack_sprite_animation().  0 amplitude stops it
+	 *
+	 * @param phase In radians, to keep sprites from moving together
+	 */
+	if (!sprite_pool_is_valid(&retained_sprites, handle)) {
+		return;
+	}
+	SpriteTransform* transform = &retained_transforms[sprite_pool_get_index(handle)];
+	transform->anim_phase = phase;
+	transform->anim_params = pack_sprite_animation(amplitude, frequency);
+	sprite_pool_mark_dirty(&retained_sprites, handle);
+}
+
+void remove_retained_sprite(SpriteHandle handle) {
+	/*
+	 * Stop drawing a retained sprite.  Its slot is left with no size until it's
+	 * reused, so it draws nothing
+	 */
+	if (!sprite_pool_is_valid(&retained_sprites, handle)) {
+		return;
+	}
+	uint32_t index = sprite_pool_get_index(handle);
+	retained_transforms[index].scale[0] = 0.0f;
+	retained_transforms[index].scale[1] = 0.0f;
+	sprite_pool_remove(&retained_sprites, handle);
+}
+
+uint32_t add_particle_emitter(uint32_t texture, const float src_rect[4], uint32_t color, float size, float lifetime, float gravity, float z) {
+	/*
+	 * Add an emitter of GPU particles, which spawns nothing until it's given a
+	 * rate with move_particle_emitter().  The particles are alpha tested like
+	 * retained sprites, and shrink away over their lifetime.  On the main
+	 * thread, after init_vulkan()
+	 *
+	 * @param texture, src_rect, color As for sprite_draw()
+	 * @param size Width and height of a new particle
+	 * @param lifetime Longest a particle lives, in seconds
+	 * @param gravity Added to the particles' y velocity every second
+	 *
+	 * @return The emitter, or PARTICLE_NO_EMITTER if there are too many
+	 */
+	if (!gpu_particles || texture >= _TEX_COUNT || particle_emitters_count == MAX_PARTICLE_EMITTERS) {
+		return PARTICLE_NO_EMITTER;
+	}
+
+	const float full_rect[4] = {0.0f, 0.0f, 1.0f, 1.0f};
+	const float* rect = src_rect != NULL ? src_rect : full_rect;
+	const float uv[2] = {rect[0], rect[1]};
+	const float uv2[2] = {rect[0] + rect[2], rect[1] + rect[3]};
+	VertexBufferSprite record = make_sprite_record(texture, uv, uv2, color, 0);
+
+	uint32_t index = particle_emitters_count++;
+	ParticleEmitter* emitter = &particle_emitters[index];
+	*emitter = (ParticleEmitter) {0};
+	emitter->size = size;
+	emitter->lifetime = lifetime;
+	emitter->gravity = gravity;
+	emitter->z = z;
+	// The record's words, which the shaders copy as they are
+	_Static_assert(sizeof(record.uv) == sizeof(uint32_t), "SPRITE_UV_PACKING has to keep a pair of texture coordinates in a word");
+	memcpy(&emitter->color, record.color, sizeof(uint32_t));
+	memcpy(&emitter->uv, record.uv, sizeof(uint32_t));
+	memcpy(&emitter->uv2, record.uv2, sizeof(uint32_t));
+	emitter->texture_index = record.texture_index;
+	particle_emitter_rates[index] = 0.0f;
+	particle_emitters_due[index] = 0.0f;
+
+	return index;
+}
+
+void move_particle_emitter(uint32_t emitter, const float pos[2], const float velocity[2], float spread, float rate) {
+	/*
+	 * Set where an emitter's particles start and how fast
+	 *
+	 * @param velocity Of every new particle, or NULL for none
+	 * @param spread The largest speed added to that in a random direction
+	 * @param rate Particles a second, 0 to stop
+	 */
+	if (emitter >= particle_emitters_count) {
+		return;
+	}
+	ParticleEmitter* e = &particle_emitters[emitter];
+	glm_vec2_copy((float*) pos, e->pos);
+	if (velocity != NULL) {
+		glm_vec2_copy((float*) velocity, e->velocity);
+	}
+	else {
+		glm_vec2_zero(e->velocity);
+	}
+	e->spread = spread;
+	particle_emitter_rates[emitter] = rate;
+}
+
+void emit_particles(float dt) {
+	/*
+	 * Work out how many particles each emitter spawns this frame, which the
+	 * emit shader turns into particles
+	 */
+	particles_spawned = 0;
+	for (uint32_t i = 0; i < particle_emitters_count; i++) {
+		float due = particle_emitters_due[i] + particle_emitter_rates[i] * dt;
+		uint32_t count = (uint32_t) due;
+		particle_emitters_due[i] = due - (float) count;
+
+		// Past the capacity there's nowhere for them to go, so don't bother
+		if (count > PARTICLES_CAPACITY - particles_spawned) {
+			count = PARTICLES_CAPACITY - particles_spawned;
+		}
+		particle_emitters[i].first_spawn = particles_spawned;
+		particle_emitters[i].spawn_count = count;
+		particles_spawned += count;
+	}
+}
+
+uint32_t add_light(const float pos[2], float radius, const float color[3], float intensity, float height) {
+	/*
+	 * Add a point light, which lights the tiles and sprites within its radius
+	 * and fades out towards it.  On the main thread
+	 *
+	 * @param color Linear RGB, multiplied by intensity
+	 * @param height Above the world, in world units
+	 *
+	 * @return The light, or NO_LIGHT if there are too many
+	 */
+	if (!lighting || lights_count == MAX_LIGHTS) {
+		return NO_LIGHT;
+	}
+
+	uint32_t index = lights_count++;
+	Light* light = &lights[index];
+	glm_vec2_copy((float*) pos, light->pos);
+	light->radius = radius;
+	light->height = height;
+	memcpy(light->color, color, sizeof(light->color));
+	light->intensity = intensity;
+	return index;
+}
+
+void move_light(uint32_t light, const float pos[2]) {
+	if (light >= lights_count) {
+		return;
+	}
+	glm_vec2_copy((float*) pos, lights[light].pos);
+}
+
+void set_light_intensity(uint32_t light, float intensity) {
+	/*
+	 * Brighten or dim a light, 0 turns it off
+	 */
+	if (light >= lights_count) {
+		return;
+	}
+	lights[light].intensity = intensity;
+}
+
+size_t get_tile_index(size_t x, size_t y) {
+	/*
+	 * Return the index of the tile at (x, y)
+	 */
+	return x + y * map_x_tiles;
+}
+
+uint16_t get_map_tile(uint32_t x, uint32_t y) {
+	/*
+	 * Return the tile at (x, y), wherever the map keeps it
+	 */
+	if (use_sparse_tiles()) {
+		return tile_store_get(&tile_store, (int32_t) x, (int32_t) y);
+	}
+	return tiles[get_tile_index(x, y)];
+}
+
+void write_tile_vertices(size_t x, size_t y, TileVertex* out) {
+	/*
+	 * Write the 4 vertices for the tile at (x, y).  The tile mesh has a slot for
+	 * every tile so these always go at the same place, and tiles.vert collapses
+	 * the empty ones so they aren't drawn
+	 *
+	 * @param x The x coordinate of the tile
+	 * @param y The y coordinate of the tile
+	 * @param out Where to write the vertices
+	 */
+	for (size_t i = 0; i < 4; i++) {
+		out[i].pos[0] = (uint16_t) x;
+		out[i].pos[1] = (uint16_t) y;
+		out[i].tile = tiles[get_tile_index(x, y)];
+		out[i]._padding = 0;
+	}
+}
+
+uint32_t get_view_mask(void) {
+	/*
+	 * The views the scene pass renders with multiview, or 0 without split screen
+	 */
+	return split_screen_views > 1 ? (1u << split_screen_views) - 1 : 0;
+}
+
+void get_view_grid(uint32_t* columns, uint32_t* rows) {
+	/*
+	 * How the split screen views are laid out on the screen, in order along
+	 * the rows from the top left
+	 */
+	*columns = split_screen_views > 1 ? 2 : 1;
+	*rows = split_screen_views > 2 ? 2 : 1;
+}
+
+VkExtent2D get_view_extent(VkExtent2D extent) {
+	/*
+	 * The size of each view's part of an area of the screen
+	 */
+	uint32_t columns;
+	uint32_t rows;
+	get_view_grid(&columns, &rows);
+	extent.width /= columns;
+	extent.height /= rows;
+	return extent;
+}
+
+bool has_tile_cache_pipeline(void) {
+	/*
+	 * Whether the tile layer caches are rendered with a pipeline of their own,
+	 * as they're single views with one sample and unlit, and the scene's tile
+	 * pipeline isn't (or in a format of their own)
+	 */
+	return tile_layers && (split_screen_views > 1 || lighting || msaa_samples > VK_SAMPLE_COUNT_1_BIT
+		|| get_tile_layer_cache_format() != offscreen_format);
+}
+
+void get_views_visible_rect(const Camera* views, float parallax, float rect[4]) {
+	/*
+	 * Get the smallest rectangle holding all of what the views see of a layer
+	 * moving parallax times as far as their cameras
+	 */
+	camera_visible_rect(&views[0], parallax, rect);
+	for (uint32_t i = 1; i < split_screen_views; i++) {
+		float view[4];
+		camera_visible_rect(&views[i], parallax, view);
+		rect[0] = glm_min(rect[0], view[0]);
+		rect[1] = glm_min(rect[1], view[1]);
+		rect[2] = glm_max(rect[2], view[2]);
+		rect[3] = glm_max(rect[3], view[3]);
+	}
+}
+
+void set_tile_push_constants(PushConstants* push_constants) {
+	/*
+	 * Fill in everything but the mvp for drawing tiles with the tile pipeline
+	 */
+	if (bindless_textures) {
+		push_constants->tileset_rect[0] = 0.0f;
+		push_constants->tileset_rect[1] = 0.0f;
+		push_constants->tileset_rect[2] = 1.0f;
+		push_constants->tileset_rect[3] = 1.0f;
+		push_constants->texture_index = texture_table_indices[TEX_TILES];
+	}
+	else {
+		const VkxAtlasRegion* region = &texture_atlas.regions[TEX_TILES];
+		push_constants->tileset_rect[0] = region->uv_offset[0];
+		push_constants->tileset_rect[1] = region->uv_offset[1];
+		push_constants->tileset_rect[2] = region->uv_scale[0];
+		push_constants->tileset_rect[3] = region->uv_scale[1];
+		push_constants->texture_index = region->layer;
+	}
+	push_constants->tileset_x_tiles = TILESET_X_TILES;
+	push_constants->tileset_y_tiles = TILESET_Y_TILES;
+	push_constants->empty_tile = EMPTY;
+
+	// Tiles always full white
+	for (size_t i = 0; i < 4; i++) {
+		push_constants->color[i] = 1.0f;
+	}
+}
+
+void build_tile_animations(void) {
+	/*
+	 * Lay out TILE_ANIMATIONS for the tile shaders, with every other tile
+	 * left still
+	 */
+	memset(tile_animations, 0, sizeof(tile_animations));
+	if (!animated_tiles) {
+		return;
+	}
+
+	for (size_t i = 0; i < sizeof(TILE_ANIMATIONS) / sizeof(TILE_ANIMATIONS[0]); i++) {
+		const TileAnimation* animation = &TILE_ANIMATIONS[i];
+		if (animation->frames == 0 || animation->tile + (animation->frames - 1) * animation->stride >= TILESET_TOTAL_TILES) {
+			fprintf(stderr, "Tile %u's animation goes past the end of the tileset\n", animation->tile);
+			exit(1);
+		}
+
+		uint32_t* slot = tile_animations[animation->tile];
+		slot[0] = animation->frames;
+		slot[1] = animation->stride;
+		memcpy(&slot[2], &animation->fps, sizeof(float));
+	}
+}
+
+VkDescriptorSet create_cache_descriptor_set(VkImageView view, VkSampler sampler) {
+	/*
+	 * Create a set for drawing an image with the tile layer pipeline, the same
+	 * as the main sets but with the image as the texture
+	 *
+	 * @param view The image's view, which is in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+	 *             when it's drawn
+	 * @param sampler What it's sampled with
+	 */
+	VkDescriptorSetAllocateInfo ds_alloc_info = {0};
+	ds_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	ds_alloc_info.descriptorPool = descriptor_pool;
+	ds_alloc_info.descriptorSetCount = 1;
+	ds_alloc_info.pSetLayouts = &tile_layer_pipeline.descriptor_set_layout;
+
+	VkDescriptorSet set = VK_NULL_HANDLE;
+	if (vkAllocateDescriptorSets(vkx_instance.device, &ds_alloc_info, &set) != VK_SUCCESS) {
+		fprintf(stderr, "failed to allocate cache descriptor set!\n");
+		exit(1);
+	}
+
+	VkDescriptorBufferInfo buffer_info = {0};
+	buffer_info.buffer = frame_ring.buffer.buffer;
+	buffer_info.offset = 0;
+	buffer_info.range = sizeof(UniformBufferObject);
+
+	VkDescriptorImageInfo image_info = {0};
+	image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	image_info.imageView = view;
+	image_info.sampler = sampler;
+
+	// Unused, but every dynamic binding gets an offset when bound
+	VkDescriptorBufferInfo sprite_buffer_info = {0};
+	sprite_buffer_info.buffer = gpu_sprite_simulation ? sprite_transform_buffer.buffer : frame_ring.buffer.buffer;
+	sprite_buffer_info.offset = 0;
+	sprite_buffer_info.range = sizeof(SpriteTransform) * monsters_count;
+
+	VkWriteDescriptorSet descriptor_writes[3] = {0};
+	for (uint32_t i = 0; i < 3; i++) {
+		descriptor_writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptor_writes[i].dstSet = set;
+		descriptor_writes[i].dstBinding = i;
+		descriptor_writes[i].dstArrayElement = 0;
+		descriptor_writes[i].descriptorCount = 1;
+	}
+	descriptor_writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	descriptor_writes[0].pBufferInfo = &buffer_info;
+	descriptor_writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	descriptor_writes[1].pImageInfo = &image_info;
+	descriptor_writes[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	descriptor_writes[2].pBufferInfo = &sprite_buffer_info;
+
+	vkUpdateDescriptorSets(vkx_instance.device, 3, descriptor_writes, 0, NULL);
+	return set;
+}
+
+void render_tile_layer_cache(TileLayer* layer) {
+	/*
+	 * Render the whole of a static tile layer into its cache image, which is then
+	 * drawn as a single quad instead of the layer's chunks.  This only happens
+	 * once (at start up) so it waits for the GPU
+	 *
+	 * @param layer The layer to render, its chunks are destroyed afterwards
+	 */
+	uint32_t width = layer->width * TILE_LAYER_CACHE_TILE_PIXELS;
+	uint32_t height = layer->height * TILE_LAYER_CACHE_TILE_PIXELS;
+
+	// Same formats as the offscreen images so the tile pipeline can draw into
+	// it, unless it has a pipeline of its own
+	VkFormat cache_format = get_tile_layer_cache_format();
+	VkxMemoryTag previous_tag = vkx_memory_set_tag(VKX_MEMORY_TAG_TILES);
+	layer->cache_image = vkx_create_image(
+		width,
+		height,
+		1,
+		cache_format,
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+	);
+	layer->cache_image.view = vkx_create_image_view(layer->cache_image.image, cache_format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+
+	// The pipeline's depth attachment, if it has one
+	VkFormat depth_format = vkx_get_depth_format();
+	VkxImage depth_image = {0};
+	if (depth_buffer) {
+		depth_image = vkx_create_image(
+			width,
+			height,
+			1,
+			depth_format,
+			VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+		);
+		depth_image.view = vkx_create_image_view(depth_image.image, depth_format, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
+	}
+	vkx_memory_set_tag(previous_tag);
+
+	// Build every chunk in the layer.  The uploads are submitted before the
+	// commands below, so they are done in time
+	tilemap_update(&layer->tilemap, 0.0f, 0.0f, (float) layer->width, (float) layer->height);
+	vkx_upload_flush();
+
+	VkCommandBuffer command_buffer = vkx_begin_single_time_commands();
+
+	// Both attachments are transitioned together
+	VkxBarrierBatch barriers;
+	vkx_barrier_batch_begin(&barriers, command_buffer);
+	vkx_barrier_batch_add_image(
+		&barriers, layer->cache_image.image, cache_format,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+	);
+	if (depth_buffer) {
+		vkx_barrier_batch_add_image(
+			&barriers, depth_image.image, depth_format,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+		);
+	}
+	vkx_barrier_batch_flush(&barriers);
+
+	// Clear to transparent so the gaps show the layers behind
+	VkRenderingAttachmentInfo color_attachment_info = {0};
+	color_attachment_info.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+	color_attachment_info.imageView = layer->cache_image.view;
+	color_attachment_info.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	color_attachment_info.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	color_attachment_info.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	color_attachment_info.clearValue = (VkClearValue) {{{0.0f, 0.0f, 0.0f, 0.0f}}};
+
+	VkRenderingAttachmentInfo depth_info = {0};
+	depth_info.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+	depth_info.imageView = depth_image.view;
+	depth_info.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depth_info.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depth_info.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depth_info.clearValue.depthStencil.depth = 1.0f;
+	depth_info.clearValue.depthStencil.stencil = 0;
+
+	VkRenderingInfo rendering_info = {0};
+	rendering_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+	rendering_info.renderArea.extent.width = width;
+	rendering_info.renderArea.extent.height = height;
+	rendering_info.layerCount = 1;
+	rendering_info.colorAttachmentCount = 1;
+	rendering_info.pColorAttachments = &color_attachment_info;
+	rendering_info.pDepthAttachment = depth_buffer ? &depth_info : NULL;
+
+	vkCmdBeginRendering(command_buffer, &rendering_info);
+
+	VkViewport viewport = {0};
+	viewport.width = (float) width;
+	viewport.height = (float) height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewportWithCount(command_buffer, 1, &viewport);
+
+	VkRect2D scissor = {0};
+	scissor.extent.width = width;
+	scissor.extent.height = height;
+	vkCmdSetScissorWithCount(command_buffer, 1, &scissor);
+
+	// Uniforms of its own, which leave the view where the push constants put
+	// it and the animated tiles at their first frames, as it's drawn once.
+	// This is before the first frame, which starts the ring again
+	VkxRingAllocation ubo_allocation = vkx_ring_buffer_alloc(&frame_ring, sizeof(UniformBufferObject));
+	UniformBufferObject* ubo = ubo_allocation.data;
+	memset(ubo, 0, sizeof(*ubo));
+	for (uint32_t slot = 0; slot < VIEW_SLOTS; slot++) {
+		mat4 identity = GLM_MAT4_IDENTITY_INIT;
+		memcpy(ubo->late_latch[slot], identity, sizeof(identity));
+	}
+	uint32_t dynamic_offsets[2] = {(uint32_t) ubo_allocation.offset, frame_dynamic_offsets[1]};
+
+	// This pass doesn't use multiview or multisampling, even when the scene does
+	const VkxPipeline* pipeline = has_tile_cache_pipeline() ? &tile_cache_pipeline : &tile_pipeline;
+	vkx_cmd_bind_pipeline(command_buffer, pipeline);
+	vkx_cmd_set_render_state(command_buffer, &SPRITE_RENDER_STATES[SPRITE_PIPELINE_CUTOUT]);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->layout, 0, 1, &descriptor_sets[0], 2, dynamic_offsets);
+	if (bindless_textures) {
+		VkDescriptorSet texture_table_set = vkx_texture_table_get_set();
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->layout, VKX_TEXTURE_TABLE_SET, 1, &texture_table_set, 0, NULL);
+	}
+
+	// The whole layer fills the image, in the same orientation as the screen
+	PushConstants push_constants = {0};
+	glm_ortho(0.0f, (float) layer->width, (float) layer->height, 0.0f, 22.0f, -22.0f, push_constants.mvp);
+	set_tile_push_constants(&push_constants);
+	vkCmdPushConstants(command_buffer, pipeline->layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants), &push_constants);
+
+	tilemap_draw(&layer->tilemap, command_buffer, pipeline->layout);
+
+	vkCmdEndRendering(command_buffer);
+
+	vkx_transition_image_layout(
+		command_buffer, layer->cache_image.image, cache_format,
+		VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+	);
+
+	vkx_end_single_time_commands(command_buffer);
+
+	// The GPU is finished with these now
+	if (depth_buffer) {
+		vkx_cleanup_image(&depth_image);
+	}
+	tilemap_cleanup(&layer->tilemap);
+
+	layer->cache_descriptor_set = create_cache_descriptor_set(layer->cache_image.view, texture_sampler);
+
+	printf("Cached a %ux%u tile layer in a %ux%u image\n", layer->width, layer->height, width, height);
+}
+
+void create_chunk_impostor_atlas(void) {
+	/*
+	 * Create the atlas the chunk impostors are rendered into, a slot for each,
+	 * and the set for drawing them from it.  A slot is only drawn once its
+	 * impostor has been rendered, so it starts out as it is
+	 */
+	VkFormat format = get_tile_layer_cache_format();
+	VkxMemoryTag previous_tag = vkx_memory_set_tag(VKX_MEMORY_TAG_TILES);
+	chunk_impostor_atlas = vkx_create_image(
+		CHUNK_IMPOSTOR_ATLAS_SIZE,
+		CHUNK_IMPOSTOR_ATLAS_SIZE,
+		1,
+		format,
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+	);
+	chunk_impostor_atlas.view = vkx_create_image_view(chunk_impostor_atlas.image, format, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+	vkx_memory_set_tag(previous_tag);
+
+	// Each frame's renders take it from and back to being sampled
+	VkCommandBuffer command_buffer = vkx_begin_single_time_commands();
+	vkx_transition_image_layout(
+		command_buffer, chunk_impostor_atlas.image, format,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+	);
+	vkx_end_single_time_commands(command_buffer);
+
+	// Filtered, as the impostors are drawn smaller than they were rendered
+	// when zoomed out further.  Half a texel inside each slot keeps its
+	// neighbours out
+	chunk_impostor_descriptor_set = create_cache_descriptor_set(chunk_impostor_atlas.view, screen_sampler);
+
+	printf("Chunk impostors: %u slots of %ux%u in a %ux%u atlas\n", CHUNK_IMPOSTOR_SLOTS, CHUNK_IMPOSTOR_SLOT_PIXELS,
+			CHUNK_IMPOSTOR_SLOT_PIXELS, CHUNK_IMPOSTOR_ATLAS_SIZE, CHUNK_IMPOSTOR_ATLAS_SIZE);
+}
+
+void export_frame(const CaptureExportFrame* frame, void* data) {
+	/*
+	 * Where an encoder would be handed the frames from capture_start_export(),
+	 * e.g. importing the dma-buf into VA-API or the opaque fd into CUDA for
+	 * NVENC, then releasing the frame once the encoder has read it.  This just
+	 * releases them straight away
+	 */
+	(void) data;
+
+	if (frame->frame_number == 1) {
+		printf("First exported frame: fd %d, %s, %llu bytes, row pitch %llu\n", frame->fd,
+				frame->dma_buf ? "dma-buf" : "opaque", (unsigned long long) frame->memory_size,
+				(unsigned long long) frame->row_pitch);
+	}
+
+	capture_release_export(frame->index);
+}
+
+void create_particle_buffers(void) {
+	/*
+	 * Create the GPU particles' buffers.  The particles start out zeroed, which
+	 * is dead, and every slot is on the free list
+	 */
+	const VkDeviceSize vertices_per_sprite = instanced_sprites ? 1 : 6;
+
+	particle_buffer = vkx_create_buffer(
+		sizeof(Particle) * PARTICLES_CAPACITY,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+	);
+	particle_dead_list_buffer = vkx_create_buffer(
+		sizeof(uint32_t) * (PARTICLES_CAPACITY + 1),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+	);
+	particle_transform_buffer = vkx_create_buffer(
+		sizeof(SpriteTransform) * PARTICLES_CAPACITY,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+	);
+	particle_record_buffer = vkx_create_buffer(
+		sizeof(VertexBufferSprite) * vertices_per_sprite * PARTICLES_CAPACITY,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | get_vertex_records_usage(),
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+	);
+	particle_indirect_buffer = vkx_create_buffer(
+		sizeof(VkDrawIndirectCommand),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+	);
+
+	// The upload copies the data, so one scratch allocation does for both
+	uint32_t* scratch = calloc(PARTICLES_CAPACITY * sizeof(Particle) / sizeof(uint32_t), sizeof(uint32_t));
+	if (scratch == NULL) {
+		fprintf(stderr, "Failed to allocate the particles' initial data\n");
+		exit(1);
+	}
+	vkx_upload_buffer(particle_buffer.buffer, 0, scratch, sizeof(Particle) * PARTICLES_CAPACITY);
+
+	scratch[0] = PARTICLES_CAPACITY;
+	for (uint32_t i = 0; i < PARTICLES_CAPACITY; i++) {
+		scratch[i + 1] = i;
+	}
+	vkx_upload_buffer(particle_dead_list_buffer.buffer, 0, scratch, sizeof(uint32_t) * (PARTICLES_CAPACITY + 1));
+	free(scratch);
+}
+
+void get_light_tiles(VkExtent2D extent, uint32_t tiles[2]) {
+	/*
+	 * The number of light tiles across and down a view of the scene which is
+	 * extent in size
+	 */
+	tiles[0] = (extent.width + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+	tiles[1] = (extent.height + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+}
+
+void create_light_buffers(void) {
+	/*
+	 * Create the lighting's buffers, with enough tiles for the views at the
+	 * largest render scale.  The culling shader writes every tile in view each
+	 * frame before anything reads them
+	 */
+	VkExtent2D extent = get_max_render_extent();
+	uint32_t tiles[2];
+	get_light_tiles(get_view_extent(extent), tiles);
+
+	light_buffer = vkx_create_buffer(
+		sizeof(Light) * MAX_LIGHTS,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+	);
+	light_tile_buffer = vkx_create_buffer(
+		sizeof(uint32_t) * LIGHT_TILE_WORDS * tiles[0] * tiles[1] * split_screen_views,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+	);
+
+	// The occluders start out as the map, and only the rows which change are
+	// copied after that
+	if (light_shadows) {
+		VkDeviceSize occluders_size = sizeof(uint64_t) * tile_solidity.words_per_row * tile_solidity.height;
+		occluder_buffer = vkx_create_buffer(
+			occluders_size,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+		);
+		vkx_upload_buffer(occluder_buffer.buffer, 0, tile_solidity.bits, occluders_size);
+	}
+	shadow_buffer = vkx_create_buffer(
+		light_shadows ? sizeof(float) * SHADOW_MAP_RESOLUTION * MAX_LIGHTS : sizeof(float),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+	);
+}
+
+void name_vulkan_objects(void) {
+	/*
+	 * Name what init_vulkan() created, for capture tools and the validation
+	 * layers (nothing in release builds).  Whatever a config didn't create is
+	 * a null handle, which is skipped
+	 */
+	const struct {
+		const VkxPipeline* pipeline;
+		const char* name;
+	} pipelines[] = {
+		{&tile_pipeline, "tiles"},
+		{&tile_map_pipeline, "tile map"},
+		{&tile_layer_pipeline, "tile layer"},
+		{&tile_cache_pipeline, "tile cache"},
+		{&chunk_impostor_pipeline, "chunk impostors"},
+		{&screen_pipeline, "screen"},
+		{&sprite_opaque_pipeline, "sprites opaque"},
+		{&sprite_cutout_pipeline, "sprites cutout"},
+		{&sprite_translucent_pipeline, "sprites translucent"},
+		{&sprite_sim_pipeline, "sprite simulation"},
+		{&sprite_cull_pipeline, "sprite culling"},
+		{&sprite_mesh_pipeline, "sprites mesh"},
+		{&skinned_pipeline, "skinned characters"},
+		{&shape_pipeline, "shapes"},
+		{&particle_emit_pipeline, "particle emit"},
+		{&particle_update_pipeline, "particle update"},
+		{&light_cull_pipeline, "light culling"},
+		{&shadow_map_pipeline, "shadow maps"},
+	};
+	for (size_t i = 0; i < sizeof(pipelines) / sizeof(pipelines[0]); i++) {
+		vkx_set_pipeline_name(pipelines[i].pipeline, pipelines[i].name);
+	}
+
+	const struct {
+		const VkxBuffer* buffer;
+		const char* name;
+	} buffers[] = {
+		{&vertex_buffer, "tile vertices"},
+		{&sprite_vertex_buffer, "sprite vertices"},
+		{&sprite_frame_buffer, "sprite frames"},
+		{&quad_index_buffer, "quad indices"},
+		{&frame_ring.buffer, "frame ring"},
+		{&tile_layer_quad_vertex_buffer, "tile layer quad"},
+		{&tile_map_quad_vertex_buffer, "tile map quad"},
+		{&sprite_state_buffer, "sprite states"},
+		{&sprite_event_buffer, "sprite events"},
+		{&sprite_transform_buffer, "sprite transforms"},
+		{&visible_sprite_buffer, "visible sprites"},
+		{&sprite_indirect_buffer, "sprite indirect"},
+		{&particle_buffer, "particles"},
+		{&particle_dead_list_buffer, "particle dead list"},
+		{&particle_transform_buffer, "particle transforms"},
+		{&particle_record_buffer, "particle records"},
+		{&particle_indirect_buffer, "particle indirect"},
+		{&light_buffer, "lights"},
+		{&light_tile_buffer, "light tiles"},
+		{&occluder_buffer, "occluders"},
+		{&shadow_buffer, "shadows"},
+		{&retained_transform_buffer, "retained transforms"},
+		{&retained_record_buffer, "retained records"},
+		{&skinned_vertex_buffer, "skinned vertices"},
+		{&skinned_index_buffer, "skinned indices"},
+	};
+	for (size_t i = 0; i < sizeof(buffers) / sizeof(buffers[0]); i++) {
+		vkx_set_buffer_name(buffers[i].buffer, buffers[i].name);
+	}
+
+	vkx_set_image_name(&texture_atlas.image, "texture atlas");
+	vkx_set_image_name(&normal_atlas.image, "normal atlas");
+	vkx_set_image_name(&palette_image, "palettes");
+	vkx_set_image_name(&tile_index_image, "tile indices");
+	vkx_set_image_name(&chunk_impostor_atlas, "chunk impostors");
+	vkx_set_object_name(VK_OBJECT_TYPE_DESCRIPTOR_SET, (uint64_t) chunk_impostor_descriptor_set, "chunk impostors");
+	for (uint32_t i = 0; i < _TEX_COUNT; i++) {
+		vkx_set_image_name(&textures[i], TEXTURE_FILENAMES[i]);
+	}
+	for (uint32_t i = 0; i < TILE_LAYERS_COUNT; i++) {
+		char name[32];
+		snprintf(name, sizeof(name), "tile layer %u", i);
+		vkx_set_image_name(&layers[i].cache_image, name);
+		vkx_set_object_name(VK_OBJECT_TYPE_DESCRIPTOR_SET, (uint64_t) layers[i].cache_descriptor_set, name);
+	}
+
+	vkx_set_object_name(VK_OBJECT_TYPE_SAMPLER, (uint64_t) texture_sampler, "textures");
+	vkx_set_object_name(VK_OBJECT_TYPE_SAMPLER, (uint64_t) screen_sampler, "screen");
+	vkx_set_object_name(VK_OBJECT_TYPE_DESCRIPTOR_POOL, (uint64_t) descriptor_pool, "descriptors");
+	vkx_set_object_name(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, (uint64_t) tile_index_set_layout, "tile indices");
+	vkx_set_object_name(VK_OBJECT_TYPE_DESCRIPTOR_SET, (uint64_t) tile_index_descriptor_set, "tile indices");
+	vkx_set_object_name(VK_OBJECT_TYPE_DESCRIPTOR_SET, (uint64_t) sprite_sim_descriptor_set, "sprite simulation");
+	vkx_set_object_name(VK_OBJECT_TYPE_DESCRIPTOR_SET, (uint64_t) sprite_cull_descriptor_set, "sprite culling");
+	vkx_set_object_name(VK_OBJECT_TYPE_DESCRIPTOR_SET, (uint64_t) particle_emit_descriptor_set, "particle emit");
+	vkx_set_object_name(VK_OBJECT_TYPE_DESCRIPTOR_SET, (uint64_t) particle_update_descriptor_set, "particle update");
+	vkx_set_object_name(VK_OBJECT_TYPE_DESCRIPTOR_SET, (uint64_t) light_cull_descriptor_set, "light culling");
+	vkx_set_object_name(VK_OBJECT_TYPE_DESCRIPTOR_SET, (uint64_t) shadow_map_descriptor_set, "shadow maps");
+
+	// The sets each frame in flight has its own of
+	const struct {
+		const VkDescriptorSet* sets;
+		const char* name;
+	} frame_sets[] = {
+		{descriptor_sets, "scene"},
+		{screen_descriptor_sets, "screen"},
+		{background_descriptor_sets, "background"},
+		{particle_descriptor_sets, "particles"},
+		{batched_sprite_descriptor_sets, "batched sprites"},
+		{retained_sprite_descriptor_sets, "retained sprites"},
+	};
+	for (size_t i = 0; i < sizeof(frame_sets) / sizeof(frame_sets[0]); i++) {
+		for (uint32_t j = 0; j < vkx_instance.frames_in_flight; j++) {
+			char name[64];
+			snprintf(name, sizeof(name), "%s %u", frame_sets[i].name, j);
+			vkx_set_object_name(VK_OBJECT_TYPE_DESCRIPTOR_SET, (uint64_t) frame_sets[i].sets[j], name);
+		}
+	}
+}
+
+void create_skinned_mesh(void) {
+	/*
+	 * Cut the first frame of the first monsters' sheet into parts, a quad on
+	 * each of the demo skeleton's bones.  The edges at the joints go half with
+	 * the bone above, so the parts bend rather than pull apart.  The model is
+	 * the frame as a unit square with the feet at the origin
+	 */
+	static const struct {
+		uint32_t bone;
+		// The bone the joint's edge also goes with, and whether that edge is
+		// the top (rather than the bottom)
+		uint32_t joint_bone;
+		bool joint_at_top;
+		// Left, top, right, bottom
+		float rect[4];
+	} parts[] = {
+		{DEMO_BONE_TORSO, DEMO_BONE_HIPS, false, {-0.2f, -0.7f, 0.2f, -0.4f}},
+		{DEMO_BONE_LEG_L, DEMO_BONE_HIPS, true, {-0.25f, -0.45f, 0.0f, 0.0f}},
+		{DEMO_BONE_LEG_R, DEMO_BONE_HIPS, true, {0.0f, -0.45f, 0.25f, 0.0f}},
+		{DEMO_BONE_HEAD, DEMO_BONE_TORSO, false, {-0.3f, -1.0f, 0.3f, -0.65f}},
+		{DEMO_BONE_ARM_L, DEMO_BONE_TORSO, true, {-0.5f, -0.7f, -0.2f, -0.35f}},
+		{DEMO_BONE_ARM_R, DEMO_BONE_TORSO, true, {0.2f, -0.7f, 0.5f, -0.35f}},
+	};
+	const uint32_t parts_count = sizeof(parts) / sizeof(parts[0]);
+	SkinnedVertex vertices[sizeof(parts) / sizeof(parts[0]) * 4] = {0};
+	uint16_t indices[sizeof(parts) / sizeof(parts[0]) * 6] = {0};
+
+	for (uint32_t i = 0; i < parts_count; i++) {
+		// Bottom left, bottom right, top right, top left
+		const float* rect = parts[i].rect;
+		const float corners[4][2] = {{rect[0], rect[3]}, {rect[2], rect[3]}, {rect[2], rect[1]}, {rect[0], rect[1]}};
+		for (uint32_t j = 0; j < 4; j++) {
+			SkinnedVertex* vertex = &vertices[i * 4 + j];
+			vertex->pos[0] = corners[j][0];
+			vertex->pos[1] = corners[j][1];
+
+			vec2 uv = {(corners[j][0] + 0.5f) / MONSTER_FRAMES_X, (corners[j][1] + 1.0f) / MONSTER_FRAMES_Y};
+			vkx_atlas_map_uv(&texture_atlas, TEX_MONSTERS, uv, uv);
+			vertex->uv[0] = VERTEX_PACK(SKINNED_UV_PACKING, uv[0]);
+			vertex->uv[1] = VERTEX_PACK(SKINNED_UV_PACKING, uv[1]);
+			vertex->texture_index = (uint16_t) texture_atlas.regions[TEX_MONSTERS].layer;
+
+			bool joint = (j >= 2) == parts[i].joint_at_top;
+			vertex->bones[0] = (uint8_t) parts[i].bone;
+			vertex->bones[1] = (uint8_t) parts[i].joint_bone;
+			vertex->weight = joint ? 128 : 255;
+		}
+
+		const uint16_t quad[6] = {0, 1, 2, 2, 3, 0};
+		for (uint32_t j = 0; j < 6; j++) {
+			indices[i * 6 + j] = (uint16_t) (i * 4 + quad[j]);
+		}
+	}
+
+	skinned_vertex_buffer = vkx_create_and_populate_buffer(vertices, sizeof(vertices), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+	skinned_index_buffer = vkx_create_and_populate_buffer(indices, sizeof(indices), VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+	skinned_indices_count = parts_count * 6;
+}
+
+void tune_frame_ring_placement(VkDeviceSize frame_size) {
+	/*
+	 * Pick whether the frame ring goes in device local memory, by timing the
+	 * CPU writing a frame's worth and the GPU reading it from each, unless
+	 * it's already known for this device.  Only where there's a choice: with
+	 * unified memory it's all the same memory
+	 */
+	VkDeviceSize ring_size = frame_size * vkx_instance.frames_in_flight;
+	if (!use_autotune() || vkx_instance.unified_memory || !vkx_memory_has_mapped_device_local(ring_size)) {
+		return;
+	}
+
+	uint32_t value;
+	if (autotune_get("frame_ring_device_local", &value)) {
+		frame_ring_device_local = value != 0;
+		return;
+	}
+
+	double host_ms = autotune_time_upload(frame_size, false);
+	double device_local_ms = autotune_time_upload(frame_size, true);
+	frame_ring_device_local = device_local_ms <= host_ms;
+	autotune_set("frame_ring_device_local", frame_ring_device_local);
+	printf(" Autotuned the frame ring into %s memory (%.3f ms for a frame, %.3f ms in %s)\n",
+			frame_ring_device_local ? "device local" : "host",
+			frame_ring_device_local ? device_local_ms : host_ms,
+			frame_ring_device_local ? host_ms : device_local_ms,
+			frame_ring_device_local ? "host" : "device local");
+}
+
+void end_startup_phase(StartupPhase phase, uint64_t start_ns) {
+	/*
+	 * Record how long a startup phase took, on whichever thread it ran
+	 */
+	double ms = (double) (SDL_GetTicksNS() - start_ns) / 1e6;
+	startup_phase_ms[phase] = ms;
+	bench_add_sample(bench_phases_startup[phase], ms);
+}
+
+void report_startup(void) {
+	/*
+	 * Print the startup phases and the time to the first frame, once it's
+	 * been submitted
+	 */
+	startup_reported = true;
+	printf("Startup took %.1f ms to the first frame:", (double) (SDL_GetTicksNS() - startup_start_ns) / 1e6);
+	for (uint32_t i = 0; i < _STARTUP_PHASE_COUNT; i++) {
+		printf(" %s %.1f ms%s", STARTUP_PHASE_NAMES[i], startup_phase_ms[i], i + 1 < _STARTUP_PHASE_COUNT ? "," : "\n");
+	}
+}
+
+void create_extra_windows(void) {
+	/*
+	 * Open the EXTRA_WINDOWS windows, on the displays after the main window's
+	 * (wrapping round, so they can share one).  The main swap chain images are
+	 * blitted to them, so any which can't be blitted to leave none
+	 */
+	VkFormatProperties properties;
+	vkGetPhysicalDeviceFormatProperties(vkx_instance.physical_device, vkx_swap_chain.image_format, &properties);
+	if ((vkx_swap_chain.image_usage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) == 0
+			|| (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT) == 0) {
+		printf("The swap chain images can't be blitted from, so there are no other windows\n");
+		return;
+	}
+
+	int displays_count = 0;
+	SDL_DisplayID* displays = SDL_GetDisplays(&displays_count);
+	SDL_DisplayID main_display = SDL_GetDisplayForWindow(vkx_instance.window);
+	int main_index = 0;
+	for (int i = 0; i < displays_count; i++) {
+		if (displays[i] == main_display) {
+			main_index = i;
+		}
+	}
+
+	uint32_t count = EXTRA_WINDOWS < VKX_MAX_WINDOWS ? EXTRA_WINDOWS : VKX_MAX_WINDOWS;
+	for (uint32_t i = 0; i < count; i++) {
+		SDL_DisplayID display = displays_count > 0 ? displays[(main_index + 1 + (int) i) % displays_count] : 0;
+		SDL_PropertiesID window_properties = SDL_CreateProperties();
+		SDL_SetStringProperty(window_properties, SDL_PROP_WINDOW_CREATE_TITLE_STRING, "Vulkan");
+		SDL_SetNumberProperty(window_properties, SDL_PROP_WINDOW_CREATE_X_NUMBER, SDL_WINDOWPOS_CENTERED_DISPLAY(display));
+		SDL_SetNumberProperty(window_properties, SDL_PROP_WINDOW_CREATE_Y_NUMBER, SDL_WINDOWPOS_CENTERED_DISPLAY(display));
+		SDL_SetNumberProperty(window_properties, SDL_PROP_WINDOW_CREATE_WIDTH_NUMBER, DEFAULT_WIDTH);
+		SDL_SetNumberProperty(window_properties, SDL_PROP_WINDOW_CREATE_HEIGHT_NUMBER, DEFAULT_HEIGHT);
+		SDL_SetBooleanProperty(window_properties, SDL_PROP_WINDOW_CREATE_VULKAN_BOOLEAN, true);
+		SDL_SetBooleanProperty(window_properties, SDL_PROP_WINDOW_CREATE_RESIZABLE_BOOLEAN, true);
+		SDL_Window* window = SDL_CreateWindowWithProperties(window_properties);
+		SDL_DestroyProperties(window_properties);
+		if (window == NULL) {
+			fprintf(stderr, "Failed to create another window: %s\n", SDL_GetError());
+			break;
+		}
+
+		if (!vkx_create_window(&extra_windows[extra_windows_count], window)) {
+			SDL_DestroyWindow(window);
+			break;
+		}
+		extra_windows_count++;
+	}
+	SDL_free(displays);
+
+	if (extra_windows_count > 0) {
+		printf("%u other windows\n", extra_windows_count);
+	}
+}
+
+void cleanup_extra_windows(void) {
+	for (uint32_t i = 0; i < extra_windows_count; i++) {
+		SDL_Window* window = extra_windows[i].window;
+		vkx_cleanup_window(&extra_windows[i]);
+		SDL_DestroyWindow(window);
+	}
+	extra_windows_count = 0;
+}
+
+void init_vulkan(void) {
+	// ----- Initialise the vulkan instance and devices -----
+	uint64_t device_start_ns = SDL_GetTicksNS();
+	vkx_init(window, FRAMES_IN_FLIGHT);
+	vkx_set_dynamic_render_state(dynamic_render_state);
+	vkx_set_descriptor_buffers(descriptor_buffers);
+	vkx_set_shader_objects(shader_objects);
+	vkx_set_pipeline_libraries(pipeline_libraries);
+	// The scene pipelines render all of the views at once
+	if (split_screen_views < 1 || split_screen_views > MAX_VIEWS) {
+		fprintf(stderr, "Split screen can have 1 to %d views\n", MAX_VIEWS);
+		exit(1);
+	}
+	vkx_set_view_mask(get_view_mask());
+	vkx_set_depth_buffer(depth_buffer);
+	// And with multisampling
+	msaa_samples = vkx_get_max_sample_count(MSAA_SAMPLES);
+	if (msaa_samples != MSAA_SAMPLES) {
+		printf("The device can only do %u samples for MSAA\n", (uint32_t) msaa_samples);
+	}
+	vkx_set_multisampling(msaa_samples, alpha_to_coverage);
+	// And with the background's shading rate left to the draws
+	vkx_set_shading_rate(variable_rate_shading, shading_rate_mask_supported());
+	if (variable_rate_shading && !vkx_has_shading_rate()) {
+		printf("The device can't vary the shading rate, so the background is shaded at every pixel\n");
+	}
+	if (use_shading_rate_image()) {
+		const VkExtent2D* min = &vkx_instance.shading_rate_texel_min;
+		const VkExtent2D* max = &vkx_instance.shading_rate_texel_max;
+		shading_rate_texel_size.width = (uint32_t) glm_clamp(SHADING_RATE_TEXEL_SIZE, min->width, max->width);
+		shading_rate_texel_size.height = (uint32_t) glm_clamp(SHADING_RATE_TEXEL_SIZE, min->height, max->height);
+	}
+
+	if (bindless_textures) {
+		vkx_texture_table_init(MAX_BINDLESS_TEXTURES);
+	}
+
+	end_startup_phase(STARTUP_DEVICE, device_start_ns);
+
+	// ----- Load the pipeline and texture caches -----
+	uint64_t pipelines_start_ns = SDL_GetTicksNS();
+	vkx_init_pipeline_cache(PIPELINE_CACHE_FILENAME);
+	if (use_autotune()) {
+		autotune_load(AUTOTUNE_FILENAME);
+	}
+	vkx_texture_cache_init(TEXTURE_CACHE_DIRECTORY, generate_mipmaps);
+	for (uint32_t i = 0; i < _TEX_COUNT; i++) {
+		if (TEXTURE_MIN_SIZES[i] != 0) {
+			vkx_set_texture_min_size(TEXTURE_FILENAMES[i], TEXTURE_MIN_SIZES[i]);
+			vkx_set_texture_min_size(NORMAL_MAP_FILENAMES[i], TEXTURE_MIN_SIZES[i]);
+		}
+	}
+	vkx_set_texture_quality(texture_quality_levels);
+	vkx_pipeline_manager_init(async_pipeline_compilation ? PIPELINE_COMPILER_THREADS : 0);
+	hot_reloading = use_hot_reload();
+	if (hot_reloading) {
+		hot_reload_init(HOT_RELOAD_POLL_MS);
+	}
+
+	// ----- Create the swap chain -----
+	PostChainDesc post_chain_desc = POST_CHAIN_DESC;
+	if (bench_is_running() && !bench_options.scenario->post_effects) {
+		post_chain_desc.effects_count = 0;
+	}
+	post_chain_init(&post_chain, &post_chain_desc);
+	// The effects can only be applied in the scene pass if they read nothing
+	// but the pixel they write, and the swap chain images can be read back
+	bool local_read = local_read_screen && vkx_instance.has_local_read && post_chain_is_per_pixel(&post_chain);
+	if (local_read_screen && !local_read) {
+		printf("The device can't read back the swap chain in the scene pass, or the effects need their neighbours, so there's a screen pass\n");
+	}
+	vkx_set_swap_chain_input_attachment(local_read && post_chain.screen_fused != 0);
+	if (headless) {
+		// One image for each frame in flight, so each frame reuses its own
+		VkExtent2D extent = {DEFAULT_WIDTH, DEFAULT_HEIGHT};
+		vkx_create_headless_swap_chain(extent, vkx_instance.frames_in_flight, false);
+	}
+	else {
+		vkx_set_present_mode(present_mode, SWAP_CHAIN_IMAGE_COUNT);
+		// The other windows are blitted to from the main swap chain as it is
+		vkx_set_pre_rotation(pre_rotated_swap_chain && !post_chain_is_empty(&post_chain) && !local_read && EXTRA_WINDOWS == 0);
+		vkx_create_swap_chain(false);
+		if (EXTRA_WINDOWS > 0) {
+			create_extra_windows();
+		}
+	}
+	scene_to_swap_chain = local_read && vkx_swap_chain.pre_rotation == 0
+		&& (post_chain.screen_fused == 0 || (vkx_swap_chain.image_usage & VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT) != 0);
+	if (local_read && !scene_to_swap_chain) {
+		printf("The swap chain images can't be input attachments or are rotated, so there's a screen pass\n");
+	}
+	if (scene_to_swap_chain) {
+		// The scene is whatever size the window is
+		largest_swap_chain_extent = get_largest_swap_chain_extent();
+		dynamic_resolution = false;
+	}
+	offscreen_format = scene_to_swap_chain ? vkx_swap_chain.image_format : choose_offscreen_format();
+	vkx_set_color_format(offscreen_format);
+
+	// ----- Start the frame capture -----
+	// Headless the frames are always captured, as that's the only way to see
+	// them
+	capture_enabled = headless || ((frame_capture || export_frames) && (vkx_swap_chain.image_usage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) != 0);
+	if (capture_enabled) {
+		capture_init();
+
+		if (export_frames && capture_can_export()) {
+			capture_start_export(vkx_swap_chain.image_format, vkx_swap_chain.extent, export_frame, NULL);
+		}
+	}
+	else if (frame_capture || export_frames) {
+		printf("The swap chain images can't be copied from, so frames can't be captured\n");
+	}
+	
+	// ----- Create the graphics pipeline -----
+	// Vertex input bindng and attributes, for the tiles and then for the quads.
+	// The attributes are in the frame arena until the pipelines are created
+	size_t attributes_arena_mark = arena_get_mark(frame_arena());
+	VkVertexInputBindingDescription tile_binding_description = get_tile_binding_description();
+	size_t tile_attribute_descriptions_count = 0;
+	VkVertexInputAttributeDescription* tile_attribute_descriptions = get_tile_attribute_descriptions(&tile_attribute_descriptions_count);
+	// The pulled shaders read the vertices themselves and have no attributes
+	const char* tile_vert_shader_path = "shaders/tiles.vert.spv";
+	if (use_vertex_pulling()) {
+		tile_attribute_descriptions_count = 0;
+		tile_vert_shader_path = "shaders/tiles_pulled.vert.spv";
+	}
+
+	VkVertexInputBindingDescription binding_description = get_binding_description();
+	size_t attribute_descriptions_count = 0;
+	VkVertexInputAttributeDescription* attribute_descriptions = get_attribute_descriptions(&attribute_descriptions_count);
+
+	// Push constants for pushing matrices etc.
+	VkPushConstantRange push_constant_range = {0};
+	push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+	push_constant_range.offset = 0;
+	push_constant_range.size = sizeof(PushConstants);
+
+	// The tiles and cached layers are always alpha tested
+	FragmentSpecialization tile_specialization = {SPRITE_PIPELINE_CUTOUT, ALPHA_CUTOFF, VK_FALSE};
+	VkSpecializationInfo tile_specialization_info = get_fragment_specialization_info(&tile_specialization);
+
+	// The lit shaders read the lights, their tiles, the normal maps and the
+	// shadow maps after the other bindings.  Every set has them, as they all
+	// share the layout
+	if (lighting) {
+		if (bindless_textures) {
+			fprintf(stderr, "Lighting needs the normal maps to be in an atlas with the textures\n");
+			exit(1);
+		}
+
+		const VkDescriptorType light_binding_types[] = {
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		};
+		vkx_set_fragment_bindings(light_binding_types, 4);
+	}
+	else if (light_shadows) {
+		fprintf(stderr, "Shadows need lighting\n");
+		exit(1);
+	}
+
+	// The sparse shaders write which pages they wanted to a buffer after the
+	// other bindings
+	if (sparse_atlas && !bindless_textures) {
+		if (lighting || tile_layers || use_chunk_impostors() || tile_texture_tilemap) {
+			fprintf(stderr, "The sparse atlas can't be used with lighting, the cached tile layers, the chunk impostors or the tile texture tilemap\n");
+			exit(1);
+		}
+		if (!generate_mipmaps) {
+			fprintf(stderr, "The sparse atlas needs mipmaps to fall back to\n");
+			exit(1);
+		}
+	}
+	if (use_sparse_atlas()) {
+		const VkDescriptorType sparse_binding_types[] = {
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		};
+		vkx_set_fragment_bindings(sparse_binding_types, 1);
+	}
+	else if (sparse_atlas && !bindless_textures) {
+		printf("The device can't do sparse textures, so the whole atlas is loaded\n");
+	}
+
+	// And the palette shaders look the colours up in an image after them
+	if (palette_textures) {
+		if (bindless_textures || sparse_atlas || lighting || tile_texture_tilemap || overdraw_heatmap) {
+			fprintf(stderr, "Palette textures can't be used with bindless textures, the sparse atlas, lighting, the tile texture tilemap or the overdraw heatmap\n");
+			exit(1);
+		}
+
+		const VkDescriptorType palette_binding_types[] = {
+			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		};
+		vkx_set_fragment_bindings(palette_binding_types, 1);
+	}
+
+	tile_pipeline = vkx_create_vertex_buffer_pipeline(
+		tile_vert_shader_path,
+		get_tile_frag_shader_path(),
+		tile_binding_description,
+		tile_attribute_descriptions,
+		tile_attribute_descriptions_count,
+		push_constant_range,
+		num_textures,
+		bindless_textures,
+		false,
+		VK_NULL_HANDLE,
+		&tile_specialization_info
+	);
+
+	if (has_tile_cache_pipeline()) {
+		vkx_set_view_mask(0);
+		vkx_set_multisampling(VK_SAMPLE_COUNT_1_BIT, false);
+		vkx_set_color_format(get_tile_layer_cache_format());
+		tile_cache_pipeline = vkx_create_vertex_buffer_pipeline(
+			tile_vert_shader_path,
+			get_tile_cache_frag_shader_path(),
+			tile_binding_description,
+			tile_attribute_descriptions,
+			tile_attribute_descriptions_count,
+			push_constant_range,
+			num_textures,
+			bindless_textures,
+			false,
+			VK_NULL_HANDLE,
+			&tile_specialization_info
+		);
+		vkx_set_view_mask(get_view_mask());
+		vkx_set_multisampling(msaa_samples, alpha_to_coverage);
+		vkx_set_color_format(offscreen_format);
+	}
+	if (use_chunk_impostors()) {
+		vkx_set_view_mask(0);
+		vkx_set_multisampling(VK_SAMPLE_COUNT_1_BIT, false);
+		vkx_set_color_format(get_tile_layer_cache_format());
+		vkx_set_depth_buffer(false);
+		chunk_impostor_pipeline = vkx_create_vertex_buffer_pipeline(
+			tile_vert_shader_path,
+			get_tile_cache_frag_shader_path(),
+			tile_binding_description,
+			tile_attribute_descriptions,
+			tile_attribute_descriptions_count,
+			push_constant_range,
+			num_textures,
+			bindless_textures,
+			false,
+			VK_NULL_HANDLE,
+			&tile_specialization_info
+		);
+		vkx_set_view_mask(get_view_mask());
+		vkx_set_multisampling(msaa_samples, alpha_to_coverage);
+		vkx_set_color_format(offscreen_format);
+		vkx_set_depth_buffer(depth_buffer);
+	}
+
+	if (tile_texture_tilemap) {
+		if (chunked_tilemap) {
+			fprintf(stderr, "The chunked tilemap and the tile texture tilemap can't both be used\n");
+			exit(1);
+		}
+
+		// The tile index image has a set of its own, as no other pipeline uses it.
+		// It is read with texelFetch, so it doesn't need a sampler
+		VkDescriptorSetLayoutBinding tile_index_binding = {0};
+		tile_index_binding.binding = 0;
+		tile_index_binding.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+		tile_index_binding.descriptorCount = 1;
+		tile_index_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		VkDescriptorSetLayoutCreateInfo tile_index_layout_info = {0};
+		tile_index_layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		tile_index_layout_info.bindingCount = 1;
+		tile_index_layout_info.pBindings = &tile_index_binding;
+
+		tile_index_set_layout = vkx_get_descriptor_set_layout(&tile_index_layout_info);
+
+		VkPushConstantRange tile_map_push_constant_range = {0};
+		tile_map_push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+		tile_map_push_constant_range.offset = 0;
+		tile_map_push_constant_range.size = sizeof(TileMapPushConstants);
+
+		// The quad's texture coordinates are positions in the map
+		tile_map_pipeline = vkx_create_vertex_buffer_pipeline(
+			"shaders/tile_map.vert.spv",
+			bindless_textures ? "shaders/tile_map_bindless.frag.spv" : "shaders/tile_map.frag.spv",
+			binding_description,
+			attribute_descriptions,
+			attribute_descriptions_count,
+			tile_map_push_constant_range,
+			num_textures,
+			bindless_textures,
+			false,
+			tile_index_set_layout,
+			&tile_specialization_info
+		);
+	}
+
+	if (tile_layers || half_res_background || use_chunk_impostors()) {
+		// Draws the cached tile layers as a quad, with the same push constants as
+		// the tiles but the texture is the cache image rather than the tileset.
+		// The background is scaled up with it the same way, and the chunk
+		// impostors are quads of their atlas
+		tile_layer_pipeline = vkx_create_vertex_buffer_pipeline(
+			"shaders/quad.vert.spv",
+			"shaders/tile_layer.frag.spv",
+			binding_description,
+			attribute_descriptions,
+			attribute_descriptions_count,
+			push_constant_range,
+			1,
+			false,
+			false,
+			VK_NULL_HANDLE,
+			&tile_specialization_info
+		);
+	}
+	
+	// Create the sprite pipeline
+	// Vertex input binding and attributes
+	VkVertexInputBindingDescription sprite_binding_description = get_sprite_binding_description();
+	size_t sprite_attribute_descriptions_count = 0;
+	VkVertexInputAttributeDescription* sprite_attribute_descriptions = get_sprite_attribute_descriptions(&sprite_attribute_descriptions_count);
+	const char* sprite_vert_shader_path = "shaders/sprite.vert.spv";
+	if (use_vertex_pulling()) {
+		sprite_attribute_descriptions_count = 0;
+		sprite_vert_shader_path = "shaders/sprite_pulled.vert.spv";
+	}
+
+	// The heatmap's shader only has the atlas, and the mesh pipeline can't add
+	if (overdraw_heatmap && (bindless_textures || use_sparse_atlas() || use_mesh_shader_sprites())) {
+		fprintf(stderr, "The overdraw heatmap needs the sprites drawn from the texture atlas by the vertex buffer pipelines\n");
+		exit(1);
+	}
+	vkx_set_additive_blend(overdraw_heatmap);
+
+	// Push constants are the same (the sprite shaders only use the mvp as the
+	// shared view-projection matrix).  The specialization constants pick
+	// whether the pipeline discards, and the translucent one blends (or they
+	// all add up, for the heatmap)
+	for (uint32_t i = 0; i < _SPRITE_PIPELINE_COUNT; i++) {
+		// Blending is set per batch, and the opaque shader (which never
+		// discards) is fine for blending as the depth writes are off too
+		if (i == SPRITE_PIPELINE_TRANSLUCENT && vkx_has_dynamic_blend()) {
+			sprite_pipelines[i] = &sprite_opaque_pipeline;
+			sprite_pipeline_requests[i] = sprite_pipeline_requests[SPRITE_PIPELINE_OPAQUE];
+			continue;
+		}
+
+		FragmentSpecialization sprite_specialization = {i, ALPHA_CUTOFF, alpha_to_coverage && msaa_samples > VK_SAMPLE_COUNT_1_BIT};
+		VkSpecializationInfo sprite_specialization_info = get_fragment_specialization_info(&sprite_specialization);
+
+		// The cutout pipeline is what the others fall back to, so it is always
+		// ready.  The heatmap's blending is only set while these are created
+		if (async_pipeline_compilation && !overdraw_heatmap && i != SPRITE_PIPELINE_CUTOUT) {
+			VkxPipelineDesc sprite_desc = {0};
+			sprite_desc.vert_shader_path = sprite_vert_shader_path;
+			sprite_desc.frag_shader_path = get_sprite_frag_shader_path();
+			sprite_desc.binding_description = sprite_binding_description;
+			memcpy(sprite_desc.attribute_descriptions, sprite_attribute_descriptions,
+					sizeof(VkVertexInputAttributeDescription) * sprite_attribute_descriptions_count);
+			sprite_desc.attribute_descriptions_count = (uint32_t) sprite_attribute_descriptions_count;
+			sprite_desc.push_constant_range = push_constant_range;
+			sprite_desc.num_textures = num_textures;
+			sprite_desc.use_texture_table = bindless_textures;
+			sprite_desc.alpha_blend = i == SPRITE_PIPELINE_TRANSLUCENT;
+			sprite_desc.extra_set_layout = VK_NULL_HANDLE;
+			vkx_pipeline_desc_set_specialization(&sprite_desc, &sprite_specialization_info);
+
+			sprite_pipeline_requests[i] = vkx_pipeline_manager_request(&sprite_desc, &sprite_cutout_pipeline);
+			if (hot_reloading && is_loose_file(sprite_desc.vert_shader_path)) {
+				hot_reload_watch_shader(sprite_desc.vert_shader_path);
+			}
+			if (hot_reloading && is_loose_file(sprite_desc.frag_shader_path)) {
+				hot_reload_watch_shader(sprite_desc.frag_shader_path);
+			}
+			continue;
+		}
+
+		*sprite_pipelines[i] = vkx_create_vertex_buffer_pipeline(
+			sprite_vert_shader_path,
+			get_sprite_frag_shader_path(),
+			sprite_binding_description,
+			sprite_attribute_descriptions,
+			sprite_attribute_descriptions_count,
+			push_constant_range,
+			num_textures,
+			bindless_textures,
+			i == SPRITE_PIPELINE_TRANSLUCENT || overdraw_heatmap,
+			VK_NULL_HANDLE,
+			&sprite_specialization_info
+		);
+	}
+	vkx_set_additive_blend(false);
+
+	if (use_sprite_frame_table()) {
+		if (sprite_render_queue || gpu_sprite_culling || use_vertex_pulling()) {
+			fprintf(stderr, "The sprite frame table can't be used with the render queue, GPU culling or vertex pulling\n");
+			exit(1);
+		}
+
+		VkVertexInputBindingDescription framed_binding_description = get_framed_sprite_binding_description();
+		size_t framed_attribute_descriptions_count = 0;
+		VkVertexInputAttributeDescription* framed_attribute_descriptions = get_framed_sprite_attribute_descriptions(&framed_attribute_descriptions_count);
+
+		FragmentSpecialization framed_specialization = {SPRITE_PIPELINE_CUTOUT, ALPHA_CUTOFF, alpha_to_coverage && msaa_samples > VK_SAMPLE_COUNT_1_BIT};
+		VkSpecializationInfo framed_specialization_info = get_fragment_specialization_info(&framed_specialization);
+		vkx_set_additive_blend(overdraw_heatmap);
+		framed_sprite_pipeline = vkx_create_vertex_buffer_pipeline(
+			"shaders/sprite_framed.vert.spv",
+			get_sprite_frag_shader_path(),
+			framed_binding_description,
+			framed_attribute_descriptions,
+			framed_attribute_descriptions_count,
+			push_constant_range,
+			num_textures,
+			bindless_textures,
+			overdraw_heatmap,
+			VK_NULL_HANDLE,
+			&framed_specialization_info
+		);
+		vkx_set_additive_blend(false);
+	}
+
+	// The shapes have the sprites' records and transforms, and work out their
+	// own coverage, so there's nothing to specialize
+	shape_pipeline = vkx_create_vertex_buffer_pipeline(
+		use_vertex_pulling() ? "shaders/shape_pulled.vert.spv" : "shaders/shape.vert.spv",
+		"shaders/shape.frag.spv",
+		sprite_binding_description,
+		sprite_attribute_descriptions,
+		sprite_attribute_descriptions_count,
+		push_constant_range,
+		num_textures,
+		bindless_textures,
+		true,
+		VK_NULL_HANDLE,
+		NULL
+	);
+
+	if (DEMO_SKINNED_CHARACTERS > 0) {
+		// Alpha tested, with the rest of the scene's set like the sprites
+		VkVertexInputBindingDescription skinned_binding_description = get_skinned_binding_description();
+		size_t skinned_attribute_descriptions_count;
+		VkVertexInputAttributeDescription* skinned_attribute_descriptions = get_skinned_attribute_descriptions(&skinned_attribute_descriptions_count);
+
+		SkinnedSpecialization skinned_specialization = {
+			{SPRITE_PIPELINE_CUTOUT, ALPHA_CUTOFF, alpha_to_coverage && msaa_samples > VK_SAMPLE_COUNT_1_BIT},
+			demo_skeleton.bones_count
+		};
+		VkSpecializationInfo skinned_specialization_info = get_skinned_specialization_info(&skinned_specialization);
+		skinned_pipeline = vkx_create_vertex_buffer_pipeline(
+			"shaders/skinned.vert.spv",
+			get_sprite_frag_shader_path(),
+			skinned_binding_description,
+			skinned_attribute_descriptions,
+			skinned_attribute_descriptions_count,
+			push_constant_range,
+			num_textures,
+			false,
+			false,
+			VK_NULL_HANDLE,
+			&skinned_specialization_info
+		);
+	}
+
+	// Screen pipeline is simple and has no vertex input, and does whatever
+	// post-processing is left at the end of the chain
+	if (scene_to_swap_chain) {
+		// Or the same, drawn over the scene at the end of its pass, reading the
+		// pixels back from the swap chain image
+		VkDescriptorType input_type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+		vkx_push_set_init(&scene_input_set, &input_type, VK_SHADER_STAGE_FRAGMENT_BIT, 1, 1);
+		screen_pipeline = post_chain_create_local_read_pipeline(&post_chain, &scene_input_set);
+		vkx_push_set_create_template(&scene_input_set, screen_pipeline.layout, VK_PIPELINE_BIND_POINT_GRAPHICS, 1);
+	}
+	else {
+		screen_pipeline = post_chain_create_screen_pipeline(&post_chain, vkx_swap_chain.image_format);
+	}
+
+	if (performance_hud) {
+		hud_init(&hud, vkx_swap_chain.image_format, HUD_SCALE);
+	}
+	if (use_debug_shapes()) {
+		debug_draw_init(&debug_drawer, vkx_swap_chain.image_format);
+	}
+
+	arena_release(frame_arena(), attributes_arena_mark);
+
+	if (gpu_sprite_simulation) {
+		if (!vkx_instance.has_subgroup_ballot) {
+			fprintf(stderr, "The sprite simulation needs subgroup ballots in compute shaders\n");
+			exit(1);
+		}
+
+		VkPushConstantRange sim_push_constant_range = {0};
+		sim_push_constant_range.offset = 0;
+		sim_push_constant_range.size = sizeof(SimPushConstants);
+		sim_push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		// Binding 0 is the sprite state, binding 1 the transforms and binding 2
+		// the events
+		VkDescriptorType sim_binding_types[] = {
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		};
+		const uint32_t sim_workgroup_size = SPRITE_SIM_WORKGROUP_SIZE;
+		VkSpecializationInfo sim_specialization_info = get_workgroup_specialization_info(&sim_workgroup_size);
+		sprite_sim_pipeline = vkx_create_compute_pipeline("shaders/sprite_sim.comp.spv", sim_binding_types, 3, sim_push_constant_range, &sim_specialization_info);
+	}
+
+	if (gpu_sprite_culling) {
+		if (translucent_sprites) {
+			fprintf(stderr, "GPU sprite culling doesn't keep the draw order needed by translucent sprites\n");
+			exit(1);
+		}
+	}
+
+	if (use_mesh_shader_sprites()) {
+		// Alpha tested, like the sprites from the culling shader.  The transforms
+		// and the rest of the scene's set are shared with the sprite pipelines
+		VkPushConstantRange mesh_push_constant_range = {0};
+		mesh_push_constant_range.offset = 0;
+		mesh_push_constant_range.size = sizeof(MeshSpritePushConstants);
+		mesh_push_constant_range.stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+
+		FragmentSpecialization mesh_specialization = {SPRITE_PIPELINE_CUTOUT, ALPHA_CUTOFF, alpha_to_coverage && msaa_samples > VK_SAMPLE_COUNT_1_BIT};
+		VkSpecializationInfo mesh_specialization_info = get_fragment_specialization_info(&mesh_specialization);
+		sprite_mesh_pipeline = vkx_create_mesh_pipeline(
+			"shaders/sprite.task.spv",
+			"shaders/sprite.mesh.spv",
+			get_sprite_frag_shader_path(),
+			mesh_push_constant_range,
+			num_textures,
+			bindless_textures,
+			&mesh_specialization_info
+		);
+	}
+	else if (gpu_sprite_culling) {
+		VkPushConstantRange cull_push_constant_range = {0};
+		cull_push_constant_range.offset = 0;
+		cull_push_constant_range.size = sizeof(CullPushConstants);
+		cull_push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		// The transforms, the input sprite records and the occlusion mask can be
+		// in the frame ring
+		VkDescriptorType cull_binding_types[] = {
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+		};
+		const uint32_t cull_workgroup_size = SPRITE_CULL_WORKGROUP_SIZE;
+		VkSpecializationInfo cull_specialization_info = get_workgroup_specialization_info(&cull_workgroup_size);
+		sprite_cull_pipeline = vkx_create_compute_pipeline("shaders/sprite_cull.comp.spv", cull_binding_types, 5, cull_push_constant_range, &cull_specialization_info);
+	}
+
+	if (gpu_particles) {
+		VkPushConstantRange particle_push_constant_range = {0};
+		particle_push_constant_range.offset = 0;
+		particle_push_constant_range.size = sizeof(ParticlePushConstants);
+		particle_push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		const uint32_t particle_workgroup_size = PARTICLE_WORKGROUP_SIZE;
+		VkSpecializationInfo particle_specialization_info = get_workgroup_specialization_info(&particle_workgroup_size);
+
+		// The emitters are in the frame ring, then the particles and the free list
+		VkDescriptorType emit_binding_types[] = {
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		};
+		particle_emit_pipeline = vkx_create_compute_pipeline("shaders/particle_emit.comp.spv", emit_binding_types, 3, particle_push_constant_range, &particle_specialization_info);
+
+		// The particles and the free list, then the transforms, records and draw
+		VkDescriptorType update_binding_types[] = {
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		};
+		particle_update_pipeline = vkx_create_compute_pipeline("shaders/particle_update.comp.spv", update_binding_types, 5, particle_push_constant_range, &particle_specialization_info);
+	}
+
+	if (lighting) {
+		VkPushConstantRange light_push_constant_range = {0};
+		light_push_constant_range.offset = 0;
+		light_push_constant_range.size = sizeof(LightCullPushConstants);
+		light_push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		// The uniform buffer for the views, then the lights and their tiles
+		VkDescriptorType light_binding_types[] = {
+			VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		};
+		const uint32_t light_workgroup_size = LIGHT_CULL_WORKGROUP_SIZE;
+		VkSpecializationInfo light_specialization_info = get_workgroup_specialization_info(&light_workgroup_size);
+		light_cull_pipeline = vkx_create_compute_pipeline("shaders/light_cull.comp.spv", light_binding_types, 3, light_push_constant_range, &light_specialization_info);
+	}
+
+	if (light_shadows) {
+		VkPushConstantRange shadow_push_constant_range = {0};
+		shadow_push_constant_range.offset = 0;
+		shadow_push_constant_range.size = sizeof(ShadowMapPushConstants);
+		shadow_push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		// The lights, the occluders and the shadow maps
+		VkDescriptorType shadow_binding_types[] = {
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		};
+		const uint32_t shadow_workgroup_size = SHADOW_MAP_WORKGROUP_SIZE;
+		VkSpecializationInfo shadow_specialization_info = get_workgroup_specialization_info(&shadow_workgroup_size);
+		shadow_map_pipeline = vkx_create_compute_pipeline("shaders/shadow_map.comp.spv", shadow_binding_types, 3, shadow_push_constant_range, &shadow_specialization_info);
+	}
+
+	end_startup_phase(STARTUP_PIPELINES, pipelines_start_ns);
+
+	// ----- Load the texture images -----
+	uint64_t textures_start_ns = SDL_GetTicksNS();
+	// The texture table needs the sampler when the textures are added
+	create_texture_sampler();
+	create_screen_sampler();
+
+	// Decoded in parallel on the job system, then either packed into the atlas or
+	// added to the texture table.  This has to happen before the vertex data is
+	// uploaded so it can be remapped
+	if (bindless_textures && texture_streaming) {
+		vkx_residency_init(texture_sampler, TEXTURE_MEMORY_BUDGET, generate_mipmaps);
+		vkx_residency_add_textures(TEXTURE_FILENAMES, _TEX_COUNT, texture_residency_handles);
+
+		for (size_t i = 0; i < _TEX_COUNT; i++) {
+			texture_table_indices[i] = vkx_residency_get_table_index(texture_residency_handles[i]);
+		}
+
+		apply_texture_table();
+	}
+	else if (bindless_textures) {
+		vkx_create_texture_images(TEXTURE_FILENAMES, _TEX_COUNT, textures, generate_mipmaps);
+
+		for (size_t i = 0; i < _TEX_COUNT; i++) {
+			texture_table_indices[i] = vkx_texture_table_add(textures[i].view, texture_sampler);
+			if (hot_reloading && is_loose_file(TEXTURE_FILENAMES[i])) {
+				hot_reload_watch_texture(TEXTURE_FILENAMES[i], (uint32_t) i);
+			}
+		}
+
+		apply_texture_table();
+	}
+	else if (palette_textures) {
+		uint8_t palettes[PALETTE_ROWS][VKX_PALETTE_COLOURS * 4] = {0};
+		texture_atlas = vkx_create_palette_atlas(TEXTURE_FILENAMES, _TEX_COUNT, ATLAS_MAX_PAGE_SIZE, palettes[0]);
+		for (uint32_t i = 1; i < PALETTE_ROWS; i++) {
+			shift_palette_hue(palettes[0], (float) i / PALETTE_ROWS, palettes[i]);
+		}
+		palette_image = vkx_create_palette_image(palettes[0], PALETTE_ROWS);
+		apply_texture_atlas();
+	}
+	else if (use_sparse_atlas()) {
+		texture_atlas = vkx_create_sparse_texture_atlas(TEXTURE_FILENAMES, _TEX_COUNT, ATLAS_MAX_PAGE_SIZE,
+			SPARSE_ATLAS_MEMORY_BUDGET, SPARSE_ATLAS_PAGES_PER_FRAME);
+		apply_texture_atlas();
+	}
+	else {
+		texture_atlas = vkx_create_texture_atlas(TEXTURE_FILENAMES, _TEX_COUNT, ATLAS_MAX_PAGE_SIZE, generate_mipmaps);
+		apply_texture_atlas();
+
+		if (lighting) {
+			// Straight out of the screen
+			const uint8_t flat_normal[4] = {128, 128, 255, 255};
+			normal_atlas = vkx_create_atlas_like(&texture_atlas, NORMAL_MAP_FILENAMES, flat_normal, generate_mipmaps);
+		}
+	}
+
+	end_startup_phase(STARTUP_TEXTURES, textures_start_ns);
+
+	// ----- Wait for the world -----
+	// Everything from here on is made from the tiles and the monsters
+	uint64_t world_wait_start_ns = SDL_GetTicksNS();
+	jobs_wait(&world_counter);
+	end_startup_phase(STARTUP_WORLD_WAIT, world_wait_start_ns);
+
+	// ----- Create the buffers -----
+	uint64_t buffers_start_ns = SDL_GetTicksNS();
+	// Tagged by what they're for, for the memory statistics
+	VkxMemoryTag previous_tag = vkx_memory_set_tag(VKX_MEMORY_TAG_TILES);
+
+	// Every quad is the same two triangles, so they all use the same indices
+	uint16_t* quad_indices = malloc(sizeof(uint16_t) * 6 * TILEMAP_MAX_QUADS);
+	if (quad_indices == NULL) {
+		fprintf(stderr, "Failed to allocate the quad indices\n");
+		exit(1);
+	}
+	for (uint32_t i = 0; i < TILEMAP_MAX_QUADS; i++) {
+		// Bottom left, bottom right, top right, top right, top left, bottom left
+		const uint16_t quad[6] = {0, 1, 2, 2, 3, 0};
+		for (uint32_t j = 0; j < 6; j++) {
+			quad_indices[i * 6 + j] = (uint16_t) (i * 4 + quad[j]);
+		}
+	}
+	quad_index_buffer = vkx_create_and_populate_buffer(
+			quad_indices, sizeof(uint16_t) * 6 * TILEMAP_MAX_QUADS,
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT
+	);
+	free(quad_indices);
+
+	if (chunked_tilemap) {
+		// The chunks are built and uploaded as they come into view
+		TilemapDesc tilemap_desc = {0};
+		tilemap_desc.tiles = tiles;
+		tilemap_desc.store = use_sparse_tiles() ? &tile_store : NULL;
+		tilemap_desc.width = map_x_tiles;
+		tilemap_desc.height = map_y_tiles;
+		tilemap_desc.empty_tile = EMPTY;
+		tilemap_desc.quad_index_buffer = quad_index_buffer.buffer;
+		tilemap_desc.vertex_pulling = use_vertex_pulling();
+		tilemap_desc.vertices_address_offset = offsetof(PushConstants, records_address);
+		tilemap_init(&tilemap, &tilemap_desc);
+		if (use_chunk_impostors()) {
+			tilemap_init_impostors(&tilemap, CHUNK_IMPOSTOR_SLOTS);
+		}
+	}
+	else if (tile_texture_tilemap) {
+		// A single quad over the whole map, with the position in the map as the
+		// texture coordinates
+		const float x_tiles = (float) map_x_tiles;
+		const float y_tiles = (float) map_y_tiles;
+		Vertex quad_vertices[] = {
+			{{0.0f, 0.0f, 0.0f}, {0.0f, 0.0f}},
+			{{x_tiles, 0.0f, 0.0f}, {x_tiles, 0.0f}},
+			{{x_tiles, y_tiles, 0.0f}, {x_tiles, y_tiles}},
+			{{0.0f, y_tiles, 0.0f}, {0.0f, y_tiles}},
+		};
+
+		tile_map_quad_vertex_buffer = vkx_create_and_populate_buffer(
+				quad_vertices, sizeof(quad_vertices),
+				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
+		);
+	}
+	else {
+		// Vertex buffer
+		vertex_buffer = create_and_populate_buffer_in_place(
+				vertices, sizeof(vertices[0]) * vertices_count,
+				get_vertex_records_usage()
+		);
+	}
+	// The extra tile layers are chunked like the main tilemap
+	if (tile_layers) {
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(vkx_instance.physical_device, &properties);
+		uint32_t max_cache_tiles = properties.limits.maxImageDimension2D / TILE_LAYER_CACHE_TILE_PIXELS;
+
+		for (size_t i = 0; i < TILE_LAYERS_COUNT; i++) {
+			TileLayer* layer = &layers[i];
+
+			TilemapDesc tilemap_desc = {0};
+			tilemap_desc.tiles = layer->tiles;
+			tilemap_desc.width = layer->width;
+			tilemap_desc.height = layer->height;
+			tilemap_desc.empty_tile = EMPTY;
+			tilemap_desc.quad_index_buffer = quad_index_buffer.buffer;
+			tilemap_desc.vertex_pulling = use_vertex_pulling();
+			tilemap_desc.vertices_address_offset = offsetof(PushConstants, records_address);
+			tilemap_init(&layer->tilemap, &tilemap_desc);
+
+			// Static layers are rendered into an image once at the end of the
+			// initialisation, if it doesn't get too big
+			layer->cached = layer->desc.is_static && layer->width <= max_cache_tiles && layer->height <= max_cache_tiles;
+			if (layer->desc.is_static && !layer->cached) {
+				printf("Tile layer %zu (%ux%u) is too big to cache, drawing it from chunks\n", i, layer->width, layer->height);
+			}
+		}
+	}
+	if (tile_layers || half_res_background) {
+		// A unit quad for drawing the cached layers, scaled up to the layer's
+		// size, and the background over the scene
+		Vertex quad_vertices[] = {
+			{{0.0f, 0.0f, 0.0f}, {0.0f, 1.0f}},
+			{{1.0f, 0.0f, 0.0f}, {1.0f, 1.0f}},
+			{{1.0f, 1.0f, 0.0f}, {1.0f, 0.0f}},
+			{{0.0f, 1.0f, 0.0f}, {0.0f, 0.0f}},
+		};
+
+		tile_layer_quad_vertex_buffer = vkx_create_and_populate_buffer(
+				quad_vertices, sizeof(quad_vertices),
+				VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
+		);
+	}
+	// The tile index image, read by the tile texture shaders
+	if (tile_texture_tilemap) {
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(vkx_instance.physical_device, &properties);
+
+		if (map_x_tiles > properties.limits.maxImageDimension2D || map_y_tiles > properties.limits.maxImageDimension2D) {
+			fprintf(stderr, "The map (%ux%u) is too big for the tile index image (max %u)\n",
+				map_x_tiles, map_y_tiles, properties.limits.maxImageDimension2D);
+			exit(1);
+		}
+
+		// The tiles are 8 bit so they go in as they are
+		tile_index_image = vkx_create_image(
+			map_x_tiles,
+			map_y_tiles,
+			1,
+			VK_FORMAT_R8_UINT,
+			VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+		);
+		tile_index_image.view = vkx_create_image_view(tile_index_image.image, VK_FORMAT_R8_UINT, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+
+		vkx_upload_image(tile_index_image.image, map_x_tiles, map_y_tiles, 1, tiles, sizeof(tiles[0]) * map_x_tiles * map_y_tiles);
+	}
+
+	// Sprite vertex buffer (also read by the culling shader)
+	vkx_memory_set_tag(VKX_MEMORY_TAG_SPRITES);
+	if (use_sprite_frame_table()) {
+		VertexBufferFramedSprite* framed_sprites = create_sprite_frames();
+		sprite_vertex_buffer = vkx_create_and_populate_buffer(
+				framed_sprites, sizeof(framed_sprites[0]) * vertex_sprites_count,
+				get_vertex_records_usage()
+		);
+		free(framed_sprites);
+		sprite_frame_buffer = vkx_create_and_populate_buffer(
+				sprite_frames, sizeof(SpriteFrame) * sprite_frames_count,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+		);
+	}
+	else {
+		sprite_vertex_buffer = create_and_populate_buffer_in_place(
+				vertex_sprites, sizeof(vertex_sprites[0]) * vertex_sprites_count,
+				get_vertex_records_usage() | (gpu_sprite_culling ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT : 0)
+		);
+	}
+
+	if (DEMO_SKINNED_CHARACTERS > 0) {
+		create_skinned_mesh();
+	}
+
+	// Sprite simulation state and the transforms written from it
+	if (gpu_sprite_simulation) {
+		SpriteState* sprite_states = malloc(sizeof(SpriteState) * monsters_count);
+		if (sprite_states == NULL) {
+			fprintf(stderr, "Failed to allocate sprite states\n");
+			exit(1);
+		}
+
+		for (size_t i = 0; i < monsters_count; i++) {
+			sprite_states[i] = (SpriteState) {0};
+			sprite_states[i].pos[0] = monsters.x[i];
+			sprite_states[i].pos[1] = monsters.y[i];
+			sprite_states[i].velocity[0] = monsters.vx[i];
+			sprite_states[i].velocity[1] = monsters.vy[i];
+			sprite_states[i].z = monsters.z[i];
+		}
+
+		sprite_state_buffer = vkx_create_and_populate_buffer(
+				sprite_states, sizeof(SpriteState) * monsters_count,
+				VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+		);
+
+		// The upload manager has its own copy
+		free(sprite_states);
+
+		// The GPU's event buffer, and copies the CPU reads (cached memory if
+		// there is any, as it reads every event)
+		sprite_event_buffer = vkx_create_buffer(
+			get_sprite_events_size(),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+		);
+		if (use_sprite_events()) {
+			VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+			if (vkx_memory_has_type(UINT32_MAX, properties | VK_MEMORY_PROPERTY_HOST_CACHED_BIT)) {
+				properties |= VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+			}
+			VkxMemoryTag previous_tag = vkx_memory_set_tag(VKX_MEMORY_TAG_STAGING);
+			for (uint32_t i = 0; i < VKX_MAX_FRAMES_IN_FLIGHT; i++) {
+				sprite_event_readback_buffers[i] = vkx_create_buffer(get_sprite_events_size(), VK_BUFFER_USAGE_TRANSFER_DST_BIT, properties);
+				sprite_events_copied[i] = false;
+			}
+			vkx_memory_set_tag(previous_tag);
+		}
+
+		sprite_transform_buffer = vkx_create_buffer(
+			sizeof(SpriteTransform) * monsters_count,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+		);
+	}
+
+	// The retained sprites, which are only ever copied into
+	retained_transform_buffer = vkx_create_buffer(
+		sizeof(SpriteTransform) * retained_sprites.capacity,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+	);
+	retained_record_buffer = vkx_create_buffer(
+		sizeof(VertexBufferSprite) * (instanced_sprites ? 1 : 6) * retained_sprites.capacity,
+		get_vertex_records_usage() | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+	);
+
+	// Output of the culling shader
+	if (gpu_sprite_culling && !use_mesh_shader_sprites()) {
+		visible_sprite_buffer = vkx_create_buffer(
+			sizeof(VertexBufferSprite) * vertex_sprites_count,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | get_vertex_records_usage(),
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+		);
+
+		sprite_indirect_buffer = vkx_create_buffer(
+			sizeof(VkDrawIndirectCommand),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+		);
+	}
+	vkx_memory_set_tag(previous_tag);
+
+	// The particles, which all start dead with every slot on the free list
+	if (gpu_particles) {
+		create_particle_buffers();
+	}
+
+	if (lighting) {
+		create_light_buffers();
+	}
+
+	// Submit all of the buffer and texture uploads in one go.  Nothing needs to
+	// wait on this as the graphics queue is ordered after the uploads
+	vkx_upload_flush();
+
+	// ----- Create the per-frame ring buffer -----
+	VkDeviceSize uniform_buffer_size = sizeof(UniformBufferObject);
+
+	if (uniform_buffer_size > 65536) {
+		fprintf(stderr, "Tried to allocate a buffer with %zu bytes, which is greater than the maximum (65536)", uniform_buffer_size);
+		exit(1);
+	}
+
+	// The sprite transforms live in the same buffer but are bound as a storage
+	// buffer, so the number of sprites is only limited by memory
+	VkDeviceSize sprite_transform_buffer_size = sizeof(SpriteTransform) * monsters_count;
+	VkDeviceSize sprite_transform_ring_size = gpu_sprite_simulation ? 0 : sprite_transform_buffer_size;
+
+	// The sorted copy of the sprite records
+	VkDeviceSize sprite_records_size = sprite_render_queue ? sizeof(VertexBufferSprite) * vertex_sprites_count : 0;
+	// And a draw for each batch, which at most is one a sprite
+	VkDeviceSize sprite_draws_size = indirect_sprite_batches
+		? sizeof(VkDrawIndirectCommand) * ((sprite_render_queue ? monsters_count : 0) + sprite_batch.capacity) + 512 : 0;
+
+	// New data for the changed tiles, either their values for the tile index
+	// image or their vertices
+	VkDeviceSize tile_edit_size = tile_texture_tilemap ? sizeof(tiles[0]) : sizeof(TileVertex) * 4;
+	VkDeviceSize tile_edits_size = chunked_tilemap ? 0 : tile_edit_size * MAX_TILE_EDITS_PER_FRAME;
+	// The vertices of the chunk impostors rendered in a frame and their
+	// uniforms, and the quads of all the ones drawn
+	// The culling shader's copy of the occlusion mask
+	VkDeviceSize occlusion_mask_size = occlusion_culling && gpu_sprite_culling && !use_mesh_shader_sprites()
+		? sizeof(occlusion_mask_bits) + 256 : 0;
+	VkDeviceSize chunk_impostors_size = use_chunk_impostors()
+		? (sizeof(TileVertex) * 4 * TILEMAP_CHUNK_SIZE * TILEMAP_CHUNK_SIZE + 256) * CHUNK_IMPOSTOR_RENDERS_PER_FRAME
+			+ sizeof(UniformBufferObject) + sizeof(Vertex) * 4 * CHUNK_IMPOSTOR_SLOTS + 512 : 0;
+
+	// The overlay's quads
+	VkDeviceSize hud_size = performance_hud ? sizeof(HudQuad) * HUD_MAX_QUADS : 0;
+	VkDeviceSize debug_lines_size = use_debug_shapes() ? sizeof(DebugLine) * DEBUG_DRAW_MAX_LINES : 0;
+
+	// The transforms and records of the sprites from sprite_draw() (the batches
+	// are made before this), with room for the alignment between them
+	VkDeviceSize batched_sprites_size = (sizeof(SpriteTransform) + sizeof(VertexBufferSprite) * (instanced_sprites ? 1 : 6))
+		* sprite_batch.capacity + 256;
+	// The retained sprites which changed, which at most is all of them
+	VkDeviceSize retained_sprites_size = (sizeof(SpriteTransform) + sizeof(VertexBufferSprite) * (instanced_sprites ? 1 : 6))
+		* retained_sprites.capacity + 256;
+
+	// The particle emitters
+	VkDeviceSize particle_emitters_size = gpu_particles ? sizeof(ParticleEmitter) * MAX_PARTICLE_EMITTERS : 0;
+
+	// The skinned characters' palettes, if they're all in view
+	VkDeviceSize skinned_palettes_size = DEMO_SKINNED_CHARACTERS > 0
+		? sizeof(Affine2) * demo_skeleton.bones_count * DEMO_SKINNED_CHARACTERS + 256 : 0;
+
+	// The shading rate mask, a byte a texel
+	VkExtent2D shading_rate_mask_extent = get_shading_rate_mask_extent();
+	VkDeviceSize shading_rate_mask_size = use_shading_rate_image() ? shading_rate_mask_extent.width * shading_rate_mask_extent.height : 0;
+
+	// The lights, which are copied out of the ring to their buffer, and the
+	// changed rows of the occluders
+	VkDeviceSize lights_size = lighting ? sizeof(Light) * MAX_LIGHTS : 0;
+	VkDeviceSize occluder_rows_size = light_shadows ? sizeof(uint64_t) * tile_solidity.words_per_row * MAX_OCCLUDER_ROWS_PER_FRAME : 0;
+
+	VkDeviceSize frame_ring_size = uniform_buffer_size + sprite_transform_ring_size + sprite_records_size + tile_edits_size + chunk_impostors_size + occlusion_mask_size + hud_size
+		+ debug_lines_size + batched_sprites_size + retained_sprites_size + particle_emitters_size + skinned_palettes_size + lights_size
+		+ occluder_rows_size + shading_rate_mask_size + sprite_draws_size + FRAME_RING_EXTRA_SPACE;
+	if (device_local_frame_ring) {
+		tune_frame_ring_placement(frame_ring_size);
+	}
+	frame_ring = vkx_create_ring_buffer(
+		frame_ring_size,
+		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
+			| VK_BUFFER_USAGE_TRANSFER_SRC_BIT | get_vertex_records_usage()
+			| (indirect_sprite_batches ? VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT : 0),
+		device_local_frame_ring && frame_ring_device_local
+	);
+
+	if (translucent_sprites && !sprite_render_queue) {
+		fprintf(stderr, "Translucent sprites need the sprite render queue for sorting\n");
+		exit(1);
+	}
+	if (!depth_buffer && (!sprite_render_queue || gpu_sprite_culling)) {
+		fprintf(stderr, "Drawing without a depth buffer needs the sprite render queue to sort the sprites\n");
+		exit(1);
+	}
+	if (!depth_buffer && (parallel_recording || static_command_buffers)) {
+		fprintf(stderr, "Drawing without a depth buffer needs the sprites drawn in between the tiles, which secondary command buffers can't do\n");
+		exit(1);
+	}
+	if (partial_redraw && split_screen_views > 1) {
+		fprintf(stderr, "Partial redraws only track the damage with one view\n");
+		exit(1);
+	}
+	if (DEMO_SKINNED_CHARACTERS > 0 && (bindless_textures || use_sparse_atlas() || lighting || overdraw_heatmap)) {
+		fprintf(stderr, "The skinned characters are drawn from the texture atlas, without lighting or the overdraw heatmap\n");
+		exit(1);
+	}
+	if (sizeof(Affine2) * demo_skeleton.bones_count * DEMO_SKINNED_CHARACTERS > sizeof(SpriteTransform) * sprite_batch.capacity) {
+		fprintf(stderr, "The skinned characters' palettes are bound in place of the batched sprites' transforms, which don't have room for them\n");
+		exit(1);
+	}
+	if (sparse_tiles && tile_texture_tilemap) {
+		fprintf(stderr, "The tile texture is an image of the whole map, which sparse tiles don't have\n");
+		exit(1);
+	}
+	if (TILESET_TOTAL_TILES > TILE_ANIMATION_SLOTS) {
+		fprintf(stderr, "The tileset has more tiles than there are TILE_ANIMATION_SLOTS\n");
+		exit(1);
+	}
+	if (streamed_world && threaded_rendering) {
+		fprintf(stderr, "Streamed chunks go in the tile store on the main thread, which the render thread reads\n");
+		exit(1);
+	}
+	if (just_in_time_frames && threaded_rendering) {
+		fprintf(stderr, "Just in time frames delay reading the input, which the main thread does a frame ahead with threaded rendering\n");
+		exit(1);
+	}
+	if (late_latched_camera && (split_screen_views > 1 || partial_redraw)) {
+		fprintf(stderr, "The late latched camera moves the one view, which is drawn all of it every frame\n");
+		exit(1);
+	}
+	if (half_res_background && (depth_buffer || variable_rate_shading)) {
+		fprintf(stderr, "The half resolution background is drawn first without the depth buffer, and not with variable rate shading\n");
+		exit(1);
+	}
+	if (half_res_background && (split_screen_views > 1 || partial_redraw)) {
+		fprintf(stderr, "The half resolution background is drawn for one view, all of it every frame\n");
+		exit(1);
+	}
+	if (local_read_screen && (MSAA_SAMPLES > VK_SAMPLE_COUNT_1_BIT || split_screen_views > 1 || partial_redraw || half_res_background)) {
+		fprintf(stderr, "The scene is only drawn straight to the swap chain with one sample, one view, all of it every frame and no separate background\n");
+		exit(1);
+	}
+	if (local_read_screen && (parallel_recording || static_command_buffers)) {
+		fprintf(stderr, "The scene pass applies the effects to the swap chain in the primary command buffer\n");
+		exit(1);
+	}
+
+	if (sprite_render_queue) {
+		render_queue_init(&sprite_queue, monsters_count);
+	}
+	render_queue_init(&batched_sprite_queue, sprite_batch.capacity);
+
+	// ----- Create the frame graph -----
+	vkx_frame_graph_init(&frame_graph);
+
+	// The swap chain image's contents are cleared, and the acquire semaphore is
+	// waited on at the colour attachment stage
+	VkxFrameGraphState swap_chain_initial = {
+		VK_IMAGE_LAYOUT_UNDEFINED,
+		VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+		VK_ACCESS_2_NONE
+	};
+	VkxFrameGraphState swap_chain_final = {
+		VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+		VK_PIPELINE_STAGE_2_NONE,
+		VK_ACCESS_2_NONE
+	};
+	// To capture it or blit it to the other windows the graph leaves it to be
+	// copied from, and capture_record() or record_extra_windows() moves it on
+	// to be presented (or headless, leaves it there)
+	swap_chain_present_state = swap_chain_final;
+	if (capture_enabled || extra_windows_count > 0) {
+		swap_chain_final.layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		swap_chain_final.stages = VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_BLIT_BIT;
+		swap_chain_final.access = VK_ACCESS_2_TRANSFER_READ_BIT;
+	}
+	if (headless) {
+		swap_chain_present_state = swap_chain_final;
+	}
+	graph_swap_chain_image = vkx_frame_graph_import_image(&frame_graph, vkx_swap_chain.image_format, swap_chain_initial, swap_chain_final);
+
+	// Big enough for the largest render scale
+	VkExtent2D max_render_extent = get_max_render_extent();
+	uint32_t offscreen_width = max_render_extent.width;
+	uint32_t offscreen_height = max_render_extent.height;
+	if (scene_to_swap_chain) {
+		graph_offscreen_image = graph_swap_chain_image;
+	}
+	else {
+		graph_offscreen_image = vkx_frame_graph_create_image(&frame_graph, offscreen_width, offscreen_height, offscreen_format);
+	}
+	// Only what changed is drawn over what's already there
+	if (partial_redraw) {
+		vkx_frame_graph_set_persistent(&frame_graph, graph_offscreen_image);
+	}
+	if (split_screen_views > 1) {
+		VkExtent2D view_extent = get_view_extent((VkExtent2D) {offscreen_width, offscreen_height});
+		graph_views_image = vkx_frame_graph_create_image_array(&frame_graph, view_extent.width, view_extent.height,
+				offscreen_format, split_screen_views);
+		if (depth_buffer) {
+			graph_views_depth_image = vkx_frame_graph_create_image_array(&frame_graph, view_extent.width, view_extent.height,
+					vkx_get_depth_format(), split_screen_views);
+		}
+	}
+	else if (depth_buffer) {
+		graph_depth_image = vkx_frame_graph_create_image(&frame_graph, offscreen_width, offscreen_height, vkx_get_depth_format());
+	}
+	// The scene's multisampled colour is resolved into the views or the
+	// offscreen image, and its depth isn't needed after the pass
+	uint32_t scene_image = split_screen_views > 1 ? graph_views_image : graph_offscreen_image;
+	uint32_t scene_depth_image = split_screen_views > 1 ? graph_views_depth_image : graph_depth_image;
+	if (msaa_samples > VK_SAMPLE_COUNT_1_BIT) {
+		const VkxFrameGraphImage* resolved = &frame_graph.images[scene_image];
+		graph_msaa_image = vkx_frame_graph_create_image_array(&frame_graph, resolved->extent.width, resolved->extent.height,
+				resolved->format, resolved->array_layers);
+		vkx_frame_graph_set_samples(&frame_graph, graph_msaa_image, msaa_samples);
+		if (depth_buffer) {
+			vkx_frame_graph_set_samples(&frame_graph, scene_depth_image, msaa_samples);
+		}
+	}
+
+	// Tiles and sprites
+	VkClearValue clear_color = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
+	VkClearValue depth_clear_value = {0};
+	depth_clear_value.depthStencil.depth = 1.0f;
+	depth_clear_value.depthStencil.stencil = 0;
+
+	// The shading rate mask is copied in before the scene pass reads it
+	if (use_shading_rate_image()) {
+		graph_shading_rate_image = vkx_frame_graph_create_image(&frame_graph, shading_rate_mask_extent.width,
+				shading_rate_mask_extent.height, VK_FORMAT_R8_UINT);
+		shading_rate_pass = vkx_frame_graph_add_pass(&frame_graph);
+		vkx_frame_graph_add_transfer_destination(&frame_graph, shading_rate_pass, graph_shading_rate_image);
+	}
+
+	// The background is drawn at a lower resolution first, with the same
+	// format and samples so the scene's pipelines can draw it
+	if (half_res_background) {
+		VkExtent2D background_extent = get_background_extent((VkExtent2D) {offscreen_width, offscreen_height});
+		graph_background_image = vkx_frame_graph_create_image(&frame_graph, background_extent.width,
+				background_extent.height, offscreen_format);
+
+		// Cleared to transparent, so the composite's alpha test leaves the
+		// scene's clear colour where there's no background
+		VkClearValue background_clear_color = {{{0.0f, 0.0f, 0.0f, 0.0f}}};
+		background_pass = vkx_frame_graph_add_pass(&frame_graph);
+		if (msaa_samples > VK_SAMPLE_COUNT_1_BIT) {
+			graph_background_msaa_image = vkx_frame_graph_create_image(&frame_graph, background_extent.width,
+					background_extent.height, offscreen_format);
+			vkx_frame_graph_set_samples(&frame_graph, graph_background_msaa_image, msaa_samples);
+			vkx_frame_graph_add_color_attachment(&frame_graph, background_pass, graph_background_msaa_image,
+					VK_ATTACHMENT_LOAD_OP_CLEAR, background_clear_color);
+			vkx_frame_graph_add_resolve_attachment(&frame_graph, background_pass, graph_background_msaa_image,
+					graph_background_image);
+		}
+		else {
+			vkx_frame_graph_add_color_attachment(&frame_graph, background_pass, graph_background_image,
+					VK_ATTACHMENT_LOAD_OP_CLEAR, background_clear_color);
+		}
+	}
+
+	scene_pass = vkx_frame_graph_add_pass(&frame_graph);
+	if (background_pass != UINT32_MAX) {
+		vkx_frame_graph_add_sampled_image(&frame_graph, scene_pass, graph_background_image);
+	}
+	if (msaa_samples > VK_SAMPLE_COUNT_1_BIT) {
+		vkx_frame_graph_add_color_attachment(&frame_graph, scene_pass, graph_msaa_image, VK_ATTACHMENT_LOAD_OP_CLEAR, clear_color);
+		vkx_frame_graph_add_resolve_attachment(&frame_graph, scene_pass, graph_msaa_image, scene_image);
+	}
+	else if (scene_to_swap_chain && post_chain.screen_fused != 0) {
+		// The effects read back what the scene drew in the same pass
+		vkx_frame_graph_add_local_read_attachment(&frame_graph, scene_pass, scene_image, VK_ATTACHMENT_LOAD_OP_CLEAR, clear_color);
+	}
+	else {
+		vkx_frame_graph_add_color_attachment(&frame_graph, scene_pass, scene_image, VK_ATTACHMENT_LOAD_OP_CLEAR, clear_color);
+	}
+	if (depth_buffer) {
+		vkx_frame_graph_add_depth_attachment(&frame_graph, scene_pass, scene_depth_image, VK_ATTACHMENT_LOAD_OP_CLEAR, depth_clear_value);
+	}
+	if (shading_rate_pass != UINT32_MAX) {
+		vkx_frame_graph_add_shading_rate_attachment(&frame_graph, scene_pass, graph_shading_rate_image, shading_rate_texel_size);
+	}
+
+	if (split_screen_views > 1) {
+		vkx_frame_graph_set_view_mask(&frame_graph, scene_pass, get_view_mask());
+
+		split_screen_pass = vkx_frame_graph_add_pass(&frame_graph);
+		vkx_frame_graph_add_transfer_source(&frame_graph, split_screen_pass, graph_views_image);
+		vkx_frame_graph_add_transfer_destination(&frame_graph, split_screen_pass, graph_offscreen_image);
+	}
+
+	// Post-processing, in between
+	VkExtent2D offscreen_extent = {offscreen_width, offscreen_height};
+	post_chain_add_passes(&post_chain, &frame_graph, graph_offscreen_image, offscreen_extent, offscreen_format);
+
+	// The end of the chain (or just the offscreen image) to the swap chain,
+	// unless the scene is already there
+	if (!scene_to_swap_chain) {
+		screen_pass = vkx_frame_graph_add_pass(&frame_graph);
+		screen_transfer = post_chain_is_empty(&post_chain) && screen_transfer_supported();
+		if (screen_transfer) {
+			vkx_frame_graph_add_transfer_source(&frame_graph, screen_pass, graph_offscreen_image);
+			vkx_frame_graph_add_transfer_destination(&frame_graph, screen_pass, graph_swap_chain_image);
+		}
+		else {
+			vkx_frame_graph_add_sampled_image(&frame_graph, screen_pass, post_chain.screen_input);
+			if (post_chain.screen_bloom != POST_CHAIN_NONE) {
+				vkx_frame_graph_add_sampled_image(&frame_graph, screen_pass, post_chain.screen_bloom);
+			}
+			vkx_frame_graph_add_color_attachment(&frame_graph, screen_pass, graph_swap_chain_image, VK_ATTACHMENT_LOAD_OP_CLEAR, clear_color);
+			// The quad covers the window, unless it's scaled by a whole number
+			// with the clear colour around it
+			if ((post_chain.screen_fused & POST_FUSED_PIXEL_PERFECT) == 0) {
+				vkx_frame_graph_set_covered(&frame_graph, screen_pass, graph_swap_chain_image);
+			}
+		}
+	}
+	printf("Screen pass: %s\n", scene_to_swap_chain ? "none, the scene is drawn to the swap chain" : screen_transfer ? "copy or blit" : "shader");
+
+	// Draws the overlays on top when the screen pass can't, or when there's none
+	if ((performance_hud || use_debug_shapes()) && (screen_transfer || static_command_buffers || scene_to_swap_chain)) {
+		hud_pass = vkx_frame_graph_add_pass(&frame_graph);
+		vkx_frame_graph_add_color_attachment(&frame_graph, hud_pass, graph_swap_chain_image, VK_ATTACHMENT_LOAD_OP_LOAD, clear_color);
+	}
+
+	vkx_frame_graph_set_transient_mode(&frame_graph, offscreen_target_mode);
+	vkx_frame_graph_compile(&frame_graph);
+
+	// ----- Create the descriptor pool -----
+	// With lighting the sets with the shared layout (all but the compute and
+	// post-processing ones) have the lights, their tiles, the normal maps and
+	// the shadow maps too, and there's the light culling set (and with shadows
+	// the shadow map one).  The background's sets for scaling it up and the
+	// chunk impostors' set have the same layout
+	uint32_t background_sets = half_res_background ? vkx_instance.frames_in_flight : 0;
+	uint32_t impostor_sets = use_chunk_impostors() ? 1 : 0;
+	uint32_t lit_sets = lighting ? vkx_instance.frames_in_flight * 4 + TILE_LAYERS_COUNT + background_sets + impostor_sets : 0;
+	uint32_t light_cull_sets = lighting ? 1 : 0;
+	uint32_t shadow_map_sets = light_shadows ? 1 : 0;
+	// And with the sparse atlas those sets have its feedback buffer
+	uint32_t sparse_sets = use_sparse_atlas() ? vkx_instance.frames_in_flight * 4 : 0;
+	// Or the palettes, in all of them
+	uint32_t palette_sets = palette_textures ? vkx_instance.frames_in_flight * 4 + TILE_LAYERS_COUNT + background_sets + impostor_sets : 0;
+
+	VkDescriptorPoolSize desc_pool_sizes[5] = {0};
+	desc_pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	// Plus one set for each cached tile layer, at most, and the batched,
+	// retained sprites' and particles' sets
+	desc_pool_sizes[0].descriptorCount = vkx_instance.frames_in_flight * 5 + TILE_LAYERS_COUNT + light_cull_sets + background_sets
+		+ impostor_sets;
+	desc_pool_sizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	desc_pool_sizes[1].descriptorCount = vkx_instance.frames_in_flight * num_textures * 4 + vkx_instance.frames_in_flight * POST_CHAIN_TEXTURES + TILE_LAYERS_COUNT
+		+ lit_sets + background_sets + impostor_sets + palette_sets;
+	// Every set with the shared layout has the storage buffer binding even if
+	// the pipeline doesn't use it (the screen sets don't have one)
+	desc_pool_sizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	// Plus the three in the sprite culling set and the particle emitters
+	desc_pool_sizes[2].descriptorCount = vkx_instance.frames_in_flight * 4 + 4 + TILE_LAYERS_COUNT + background_sets + impostor_sets;
+	// Sprite simulation, culling and particle sets
+	desc_pool_sizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	desc_pool_sizes[3].descriptorCount = 11 + lit_sets * 3 + light_cull_sets * 2 + shadow_map_sets * 3 + sparse_sets;
+	// Tile index image
+	desc_pool_sizes[4].type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	desc_pool_sizes[4].descriptorCount = 1;
+
+	VkDescriptorPoolCreateInfo desc_pool_info = {0};
+	desc_pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	desc_pool_info.poolSizeCount = 5;
+	desc_pool_info.pPoolSizes = desc_pool_sizes;
+	desc_pool_info.maxSets = vkx_instance.frames_in_flight * 5 + 5 + TILE_LAYERS_COUNT + light_cull_sets + shadow_map_sets + background_sets
+		+ impostor_sets;
+
+	if (vkCreateDescriptorPool(vkx_instance.device, &desc_pool_info, vkx_get_allocator(VK_OBJECT_TYPE_DESCRIPTOR_POOL), &descriptor_pool) != VK_SUCCESS) {
+		fprintf(stderr, "failed to create descriptor pool!\n");
+		exit(1);
+	}
+	
+	{
+		// ----- Create the descriptor sets -----
+		VkDescriptorSetLayout ds_layouts[VKX_MAX_FRAMES_IN_FLIGHT] = {0};
+		for (size_t i = 0; i < vkx_instance.frames_in_flight; i++) {
+			ds_layouts[i] = tile_pipeline.descriptor_set_layout;
+		}
+
+		VkDescriptorSetAllocateInfo ds_alloc_info = {0};
+		ds_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		ds_alloc_info.descriptorPool = descriptor_pool;
+		ds_alloc_info.descriptorSetCount = vkx_instance.frames_in_flight;
+		ds_alloc_info.pSetLayouts = ds_layouts;
+		
+		// Create the base descriptor sets
+		if (vkAllocateDescriptorSets(vkx_instance.device, &ds_alloc_info, descriptor_sets) != VK_SUCCESS) {
+			fprintf(stderr, "failed to allocate descriptor sets!\n");
+			exit(1);
+		}
+		if (vkAllocateDescriptorSets(vkx_instance.device, &ds_alloc_info, batched_sprite_descriptor_sets) != VK_SUCCESS) {
+			fprintf(stderr, "failed to allocate the batched sprite descriptor sets!\n");
+			exit(1);
+		}
+		if (vkAllocateDescriptorSets(vkx_instance.device, &ds_alloc_info, retained_sprite_descriptor_sets) != VK_SUCCESS) {
+			fprintf(stderr, "failed to allocate the retained sprite descriptor sets!\n");
+			exit(1);
+		}
+		if (gpu_particles && vkAllocateDescriptorSets(vkx_instance.device, &ds_alloc_info, particle_descriptor_sets) != VK_SUCCESS) {
+			fprintf(stderr, "failed to allocate the particle descriptor sets!\n");
+			exit(1);
+		}
+
+		for (size_t i = 0; i < vkx_instance.frames_in_flight; i++) {
+			// The actual offsets into the ring buffer are given when binding
+			VkDescriptorBufferInfo buffer_info = {0};
+			buffer_info.buffer = frame_ring.buffer.buffer;
+			buffer_info.offset = 0;
+			buffer_info.range = sizeof(UniformBufferObject);
+
+			// The sparse atlas stays in GENERAL, as pages are copied in while
+			// it's being sampled
+			VkDescriptorImageInfo image_info = {0};
+			image_info.imageLayout = use_sparse_atlas() ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			image_info.imageView = texture_atlas.image.view;
+			image_info.sampler = texture_sampler;
+
+			// The GPU simulation writes the transforms to their own buffer, which
+			// is bound with a dynamic offset of 0
+			VkDescriptorBufferInfo sprite_buffer_info = {0};
+			sprite_buffer_info.buffer = gpu_sprite_simulation ? sprite_transform_buffer.buffer : frame_ring.buffer.buffer;
+			sprite_buffer_info.offset = 0;
+			sprite_buffer_info.range = sprite_transform_buffer_size;
+
+			VkWriteDescriptorSet descriptor_writes[7] = {0};
+			descriptor_writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptor_writes[0].dstSet = descriptor_sets[i];
+			descriptor_writes[0].dstBinding = 0;
+			descriptor_writes[0].dstArrayElement = 0;
+			descriptor_writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+			descriptor_writes[0].descriptorCount = 1;
+			descriptor_writes[0].pBufferInfo = &buffer_info;
+			descriptor_writes[0].pImageInfo = NULL;
+			descriptor_writes[0].pTexelBufferView = NULL;
+
+			descriptor_writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptor_writes[1].dstSet = descriptor_sets[i];
+			descriptor_writes[1].dstBinding = 1;
+			descriptor_writes[1].dstArrayElement = 0;
+			descriptor_writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			descriptor_writes[1].descriptorCount = num_textures;
+			descriptor_writes[1].pBufferInfo = NULL;
+			descriptor_writes[1].pImageInfo = &image_info;
+			descriptor_writes[1].pTexelBufferView = NULL;
+
+			descriptor_writes[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptor_writes[2].dstSet = descriptor_sets[i];
+			descriptor_writes[2].dstBinding = 2;
+			descriptor_writes[2].dstArrayElement = 0;
+			descriptor_writes[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+			descriptor_writes[2].descriptorCount = 1;
+			descriptor_writes[2].pBufferInfo = &sprite_buffer_info;
+			descriptor_writes[2].pImageInfo = NULL;
+			descriptor_writes[2].pTexelBufferView = NULL;
+
+			// The bindless shaders don't use the atlas binding, so leave it empty
+			uint32_t descriptor_writes_count = 3;
+			if (bindless_textures) {
+				descriptor_writes[1] = descriptor_writes[2];
+				descriptor_writes_count = 2;
+			}
+
+			// The lit shaders' lights, tiles, normal maps and shadow maps, which
+			// are the same for every frame
+			VkDescriptorBufferInfo light_buffer_infos[4] = {0};
+			light_buffer_infos[0].buffer = light_buffer.buffer;
+			light_buffer_infos[0].range = VK_WHOLE_SIZE;
+			light_buffer_infos[1].buffer = light_tile_buffer.buffer;
+			light_buffer_infos[1].range = VK_WHOLE_SIZE;
+			light_buffer_infos[3].buffer = shadow_buffer.buffer;
+			light_buffer_infos[3].range = VK_WHOLE_SIZE;
+
+			VkDescriptorImageInfo normal_image_info = image_info;
+			normal_image_info.imageView = normal_atlas.image.view;
+
+			if (lighting) {
+				for (uint32_t k = 0; k < 4; k++) {
+					VkWriteDescriptorSet* write = &descriptor_writes[descriptor_writes_count++];
+					write->sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+					write->dstSet = descriptor_sets[i];
+					write->dstBinding = 3 + k;
+					write->dstArrayElement = 0;
+					write->descriptorCount = 1;
+					if (k != 2) {
+						write->descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+						write->pBufferInfo = &light_buffer_infos[k];
+					}
+					else {
+						write->descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+						write->pImageInfo = &normal_image_info;
+					}
+				}
+			}
+
+			// The sparse atlas's feedback for this frame
+			VkDescriptorBufferInfo feedback_buffer_info = {0};
+			if (use_sparse_atlas()) {
+				feedback_buffer_info = vkx_sparse_atlas_get_feedback((uint32_t) i);
+
+				VkWriteDescriptorSet* write = &descriptor_writes[descriptor_writes_count++];
+				write->sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				write->dstSet = descriptor_sets[i];
+				write->dstBinding = 3;
+				write->dstArrayElement = 0;
+				write->descriptorCount = 1;
+				write->descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				write->pBufferInfo = &feedback_buffer_info;
+			}
+
+			// The palettes
+			VkDescriptorImageInfo palette_image_info = image_info;
+			palette_image_info.imageView = palette_image.view;
+			if (palette_textures) {
+				VkWriteDescriptorSet* write = &descriptor_writes[descriptor_writes_count++];
+				write->sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				write->dstSet = descriptor_sets[i];
+				write->dstBinding = 3;
+				write->dstArrayElement = 0;
+				write->descriptorCount = 1;
+				write->descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+				write->pImageInfo = &palette_image_info;
+			}
+
+			vkUpdateDescriptorSets(vkx_instance.device, descriptor_writes_count, descriptor_writes, 0, NULL);
+
+			// The batched sprites' set is the same, except their transforms are
+			// always in the frame ring
+			VkDescriptorBufferInfo batched_sprite_buffer_info = sprite_buffer_info;
+			batched_sprite_buffer_info.buffer = frame_ring.buffer.buffer;
+			batched_sprite_buffer_info.range = sizeof(SpriteTransform) * sprite_batch.capacity;
+			for (uint32_t k = 0; k < descriptor_writes_count; k++) {
+				descriptor_writes[k].dstSet = batched_sprite_descriptor_sets[i];
+				if (descriptor_writes[k].pBufferInfo == &sprite_buffer_info) {
+					descriptor_writes[k].pBufferInfo = &batched_sprite_buffer_info;
+				}
+			}
+
+			vkUpdateDescriptorSets(vkx_instance.device, descriptor_writes_count, descriptor_writes, 0, NULL);
+
+			// And the retained sprites' has their own transforms
+			VkDescriptorBufferInfo retained_sprite_buffer_info = sprite_buffer_info;
+			retained_sprite_buffer_info.buffer = retained_transform_buffer.buffer;
+			retained_sprite_buffer_info.range = sizeof(SpriteTransform) * retained_sprites.capacity;
+			for (uint32_t k = 0; k < descriptor_writes_count; k++) {
+				descriptor_writes[k].dstSet = retained_sprite_descriptor_sets[i];
+				if (descriptor_writes[k].pBufferInfo == &batched_sprite_buffer_info) {
+					descriptor_writes[k].pBufferInfo = &retained_sprite_buffer_info;
+				}
+			}
+
+			vkUpdateDescriptorSets(vkx_instance.device, descriptor_writes_count, descriptor_writes, 0, NULL);
+
+			// And the particles' has the update shader's transforms
+			if (gpu_particles) {
+				VkDescriptorBufferInfo particle_buffer_info = sprite_buffer_info;
+				particle_buffer_info.buffer = particle_transform_buffer.buffer;
+				particle_buffer_info.range = sizeof(SpriteTransform) * PARTICLES_CAPACITY;
+				for (uint32_t k = 0; k < descriptor_writes_count; k++) {
+					descriptor_writes[k].dstSet = particle_descriptor_sets[i];
+					if (descriptor_writes[k].pBufferInfo == &retained_sprite_buffer_info) {
+						descriptor_writes[k].pBufferInfo = &particle_buffer_info;
+					}
+				}
+
+				vkUpdateDescriptorSets(vkx_instance.device, descriptor_writes_count, descriptor_writes, 0, NULL);
+			}
+		}
+	}
+	if (gpu_sprite_simulation) {
+		// ----- Create the sprite simulation descriptor set -----
+		// None of this changes per frame, so one set is enough
+		VkDescriptorSetAllocateInfo ds_alloc_info = {0};
+		ds_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		ds_alloc_info.descriptorPool = descriptor_pool;
+		ds_alloc_info.descriptorSetCount = 1;
+		ds_alloc_info.pSetLayouts = &sprite_sim_pipeline.descriptor_set_layout;
+
+		if (vkAllocateDescriptorSets(vkx_instance.device, &ds_alloc_info, &sprite_sim_descriptor_set) != VK_SUCCESS) {
+			fprintf(stderr, "failed to allocate sprite simulation descriptor set!\n");
+			exit(1);
+		}
+
+		VkDescriptorBufferInfo buffer_infos[3] = {0};
+		buffer_infos[0].buffer = sprite_state_buffer.buffer;
+		buffer_infos[0].offset = 0;
+		buffer_infos[0].range = VK_WHOLE_SIZE;
+		buffer_infos[1].buffer = sprite_transform_buffer.buffer;
+		buffer_infos[1].offset = 0;
+		buffer_infos[1].range = VK_WHOLE_SIZE;
+		buffer_infos[2].buffer = sprite_event_buffer.buffer;
+		buffer_infos[2].offset = 0;
+		buffer_infos[2].range = VK_WHOLE_SIZE;
+
+		VkWriteDescriptorSet descriptor_writes[3] = {0};
+		for (uint32_t i = 0; i < 3; i++) {
+			descriptor_writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptor_writes[i].dstSet = sprite_sim_descriptor_set;
+			descriptor_writes[i].dstBinding = i;
+			descriptor_writes[i].dstArrayElement = 0;
+			descriptor_writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			descriptor_writes[i].descriptorCount = 1;
+			descriptor_writes[i].pBufferInfo = &buffer_infos[i];
+		}
+
+		vkUpdateDescriptorSets(vkx_instance.device, 3, descriptor_writes, 0, NULL);
+	}
+	if (gpu_sprite_culling && !use_mesh_shader_sprites()) {
+		// ----- Create the sprite culling descriptor set -----
+		// The per-frame inputs are picked with dynamic offsets, so one set is enough
+		VkDescriptorSetAllocateInfo ds_alloc_info = {0};
+		ds_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		ds_alloc_info.descriptorPool = descriptor_pool;
+		ds_alloc_info.descriptorSetCount = 1;
+		ds_alloc_info.pSetLayouts = &sprite_cull_pipeline.descriptor_set_layout;
+
+		if (vkAllocateDescriptorSets(vkx_instance.device, &ds_alloc_info, &sprite_cull_descriptor_set) != VK_SUCCESS) {
+			fprintf(stderr, "failed to allocate sprite culling descriptor set!\n");
+			exit(1);
+		}
+
+		VkDeviceSize sprite_records_buffer_size = sizeof(VertexBufferSprite) * vertex_sprites_count;
+
+		VkDescriptorBufferInfo buffer_infos[5] = {0};
+		// Transforms, from the ring or the GPU simulation
+		buffer_infos[0].buffer = gpu_sprite_simulation ? sprite_transform_buffer.buffer : frame_ring.buffer.buffer;
+		buffer_infos[0].offset = 0;
+		buffer_infos[0].range = sprite_transform_buffer_size;
+		// Sprite records, sorted in the ring or straight from the vertex buffer
+		buffer_infos[1].buffer = sprite_render_queue ? frame_ring.buffer.buffer : sprite_vertex_buffer.buffer;
+		buffer_infos[1].offset = 0;
+		buffer_infos[1].range = sprite_records_buffer_size;
+		buffer_infos[2].buffer = visible_sprite_buffer.buffer;
+		buffer_infos[2].offset = 0;
+		buffer_infos[2].range = VK_WHOLE_SIZE;
+		buffer_infos[3].buffer = sprite_indirect_buffer.buffer;
+		buffer_infos[3].offset = 0;
+		buffer_infos[3].range = VK_WHOLE_SIZE;
+		// The occlusion mask, in the ring.  Bound without occlusion_culling too,
+		// the shader just doesn't read it
+		buffer_infos[4].buffer = frame_ring.buffer.buffer;
+		buffer_infos[4].offset = 0;
+		buffer_infos[4].range = sizeof(occlusion_mask_bits);
+
+		VkWriteDescriptorSet descriptor_writes[5] = {0};
+		for (uint32_t i = 0; i < 5; i++) {
+			descriptor_writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptor_writes[i].dstSet = sprite_cull_descriptor_set;
+			descriptor_writes[i].dstBinding = i;
+			descriptor_writes[i].dstArrayElement = 0;
+			descriptor_writes[i].descriptorType = i < 2 || i == 4 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			descriptor_writes[i].descriptorCount = 1;
+			descriptor_writes[i].pBufferInfo = &buffer_infos[i];
+		}
+
+		vkUpdateDescriptorSets(vkx_instance.device, 5, descriptor_writes, 0, NULL);
+	}
+	if (gpu_particles) {
+		// ----- Create the particle descriptor sets -----
+		// Only the emitters change per frame, and they have a dynamic offset
+		VkDescriptorSetAllocateInfo ds_alloc_info = {0};
+		ds_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		ds_alloc_info.descriptorPool = descriptor_pool;
+		ds_alloc_info.descriptorSetCount = 1;
+		ds_alloc_info.pSetLayouts = &particle_emit_pipeline.descriptor_set_layout;
+
+		if (vkAllocateDescriptorSets(vkx_instance.device, &ds_alloc_info, &particle_emit_descriptor_set) != VK_SUCCESS) {
+			fprintf(stderr, "failed to allocate particle emit descriptor set!\n");
+			exit(1);
+		}
+
+		ds_alloc_info.pSetLayouts = &particle_update_pipeline.descriptor_set_layout;
+		if (vkAllocateDescriptorSets(vkx_instance.device, &ds_alloc_info, &particle_update_descriptor_set) != VK_SUCCESS) {
+			fprintf(stderr, "failed to allocate particle update descriptor set!\n");
+			exit(1);
+		}
+
+		// The emit set has the emitters then the first two of these, and the
+		// update set all of the rest
+		VkDescriptorBufferInfo buffer_infos[6] = {0};
+		buffer_infos[0].buffer = frame_ring.buffer.buffer;
+		buffer_infos[0].offset = 0;
+		buffer_infos[0].range = sizeof(ParticleEmitter) * MAX_PARTICLE_EMITTERS;
+		buffer_infos[1].buffer = particle_buffer.buffer;
+		buffer_infos[2].buffer = particle_dead_list_buffer.buffer;
+		buffer_infos[3].buffer = particle_transform_buffer.buffer;
+		buffer_infos[4].buffer = particle_record_buffer.buffer;
+		buffer_infos[5].buffer = particle_indirect_buffer.buffer;
+		for (uint32_t i = 1; i < 6; i++) {
+			buffer_infos[i].offset = 0;
+			buffer_infos[i].range = VK_WHOLE_SIZE;
+		}
+
+		VkWriteDescriptorSet descriptor_writes[8] = {0};
+		for (uint32_t i = 0; i < 8; i++) {
+			bool emit = i < 3;
+			descriptor_writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptor_writes[i].dstSet = emit ? particle_emit_descriptor_set : particle_update_descriptor_set;
+			descriptor_writes[i].dstBinding = emit ? i : i - 3;
+			descriptor_writes[i].dstArrayElement = 0;
+			descriptor_writes[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			descriptor_writes[i].descriptorCount = 1;
+			descriptor_writes[i].pBufferInfo = &buffer_infos[emit ? i : i - 2];
+		}
+
+		vkUpdateDescriptorSets(vkx_instance.device, 8, descriptor_writes, 0, NULL);
+	}
+	if (lighting) {
+		// ----- Create the light culling descriptor set -----
+		// Only the uniform buffer changes per frame, and it has a dynamic offset
+		VkDescriptorSetAllocateInfo ds_alloc_info = {0};
+		ds_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		ds_alloc_info.descriptorPool = descriptor_pool;
+		ds_alloc_info.descriptorSetCount = 1;
+		ds_alloc_info.pSetLayouts = &light_cull_pipeline.descriptor_set_layout;
+
+		if (vkAllocateDescriptorSets(vkx_instance.device, &ds_alloc_info, &light_cull_descriptor_set) != VK_SUCCESS) {
+			fprintf(stderr, "failed to allocate light culling descriptor set!\n");
+			exit(1);
+		}
+
+		VkDescriptorBufferInfo buffer_infos[3] = {0};
+		buffer_infos[0].buffer = frame_ring.buffer.buffer;
+		buffer_infos[0].offset = 0;
+		buffer_infos[0].range = sizeof(UniformBufferObject);
+		buffer_infos[1].buffer = light_buffer.buffer;
+		buffer_infos[1].range = VK_WHOLE_SIZE;
+		buffer_infos[2].buffer = light_tile_buffer.buffer;
+		buffer_infos[2].range = VK_WHOLE_SIZE;
+
+		VkWriteDescriptorSet descriptor_writes[3] = {0};
+		for (uint32_t i = 0; i < 3; i++) {
+			descriptor_writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptor_writes[i].dstSet = light_cull_descriptor_set;
+			descriptor_writes[i].dstBinding = i;
+			descriptor_writes[i].dstArrayElement = 0;
+			descriptor_writes[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			descriptor_writes[i].descriptorCount = 1;
+			descriptor_writes[i].pBufferInfo = &buffer_infos[i];
+		}
+
+		vkUpdateDescriptorSets(vkx_instance.device, 3, descriptor_writes, 0, NULL);
+	}
+	if (light_shadows) {
+		// ----- Create the shadow map descriptor set -----
+		VkDescriptorSetAllocateInfo ds_alloc_info = {0};
+		ds_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		ds_alloc_info.descriptorPool = descriptor_pool;
+		ds_alloc_info.descriptorSetCount = 1;
+		ds_alloc_info.pSetLayouts = &shadow_map_pipeline.descriptor_set_layout;
+
+		if (vkAllocateDescriptorSets(vkx_instance.device, &ds_alloc_info, &shadow_map_descriptor_set) != VK_SUCCESS) {
+			fprintf(stderr, "failed to allocate shadow map descriptor set!\n");
+			exit(1);
+		}
+
+		VkDescriptorBufferInfo buffer_infos[3] = {0};
+		buffer_infos[0].buffer = light_buffer.buffer;
+		buffer_infos[0].range = VK_WHOLE_SIZE;
+		buffer_infos[1].buffer = occluder_buffer.buffer;
+		buffer_infos[1].range = VK_WHOLE_SIZE;
+		buffer_infos[2].buffer = shadow_buffer.buffer;
+		buffer_infos[2].range = VK_WHOLE_SIZE;
+
+		VkWriteDescriptorSet descriptor_writes[3] = {0};
+		for (uint32_t i = 0; i < 3; i++) {
+			descriptor_writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptor_writes[i].dstSet = shadow_map_descriptor_set;
+			descriptor_writes[i].dstBinding = i;
+			descriptor_writes[i].dstArrayElement = 0;
+			descriptor_writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			descriptor_writes[i].descriptorCount = 1;
+			descriptor_writes[i].pBufferInfo = &buffer_infos[i];
+		}
+
+		vkUpdateDescriptorSets(vkx_instance.device, 3, descriptor_writes, 0, NULL);
+	}
+	if (tile_texture_tilemap) {
+		// ----- Create the tile index descriptor set -----
+		// Edits are copied into the same image, so one set is enough
+		VkDescriptorSetAllocateInfo ds_alloc_info = {0};
+		ds_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		ds_alloc_info.descriptorPool = descriptor_pool;
+		ds_alloc_info.descriptorSetCount = 1;
+		ds_alloc_info.pSetLayouts = &tile_index_set_layout;
+
+		if (vkAllocateDescriptorSets(vkx_instance.device, &ds_alloc_info, &tile_index_descriptor_set) != VK_SUCCESS) {
+			fprintf(stderr, "failed to allocate tile index descriptor set!\n");
+			exit(1);
+		}
+
+		VkDescriptorImageInfo image_info = {0};
+		image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		image_info.imageView = tile_index_image.view;
+		image_info.sampler = VK_NULL_HANDLE;
+
+		VkWriteDescriptorSet descriptor_write = {0};
+		descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptor_write.dstSet = tile_index_descriptor_set;
+		descriptor_write.dstBinding = 0;
+		descriptor_write.dstArrayElement = 0;
+		descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+		descriptor_write.descriptorCount = 1;
+		descriptor_write.pImageInfo = &image_info;
+
+		vkUpdateDescriptorSets(vkx_instance.device, 1, &descriptor_write, 0, NULL);
+	}
+	{
+		// ----- Create the screen descriptor sets -----
+		VkDescriptorSetLayout ds_layouts[VKX_MAX_FRAMES_IN_FLIGHT] = {0};
+		for (size_t i = 0; i < vkx_instance.frames_in_flight; i++) {
+			ds_layouts[i] = screen_pipeline.descriptor_set_layout;
+		}
+
+		VkDescriptorSetAllocateInfo ds_alloc_info = {0};
+		ds_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		ds_alloc_info.descriptorPool = descriptor_pool;
+		ds_alloc_info.descriptorSetCount = vkx_instance.frames_in_flight;
+		ds_alloc_info.pSetLayouts = ds_layouts;
+		
+		// Create the base descriptor sets
+		if (vkAllocateDescriptorSets(vkx_instance.device, &ds_alloc_info, screen_descriptor_sets) != VK_SUCCESS) {
+			fprintf(stderr, "failed to allocate screen descriptor sets!\n");
+			exit(1);
+		}
+
+		// The actual offset into the ring buffer is given when binding
+		VkDescriptorBufferInfo buffer_info = {0};
+		buffer_info.buffer = frame_ring.buffer.buffer;
+		buffer_info.offset = 0;
+		buffer_info.range = SCREEN_UNIFORMS_SIZE;
+
+		for (size_t i = 0; i < vkx_instance.frames_in_flight; i++) {
+			// The end of the post-processing chain, and its bloom
+			VkDescriptorImageInfo image_infos[POST_CHAIN_TEXTURES] = {0};
+			if (!scene_to_swap_chain) {
+				post_chain_screen_image_infos(&post_chain, &frame_graph, (uint32_t) i, screen_sampler, image_infos);
+			}
+
+			// Without a screen pass there's only the uniform buffer
+			VkWriteDescriptorSet descriptor_writes[2] = {0};
+			descriptor_writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptor_writes[0].dstSet = screen_descriptor_sets[i];
+			descriptor_writes[0].dstBinding = 0;
+			descriptor_writes[0].dstArrayElement = 0;
+			descriptor_writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+			descriptor_writes[0].descriptorCount = 1;
+			descriptor_writes[0].pBufferInfo = &buffer_info;
+			descriptor_writes[0].pImageInfo = NULL;
+			descriptor_writes[0].pTexelBufferView = NULL;
+
+			descriptor_writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptor_writes[1].dstSet = screen_descriptor_sets[i];
+			descriptor_writes[1].dstBinding = 1;
+			descriptor_writes[1].dstArrayElement = 0;
+			descriptor_writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			descriptor_writes[1].descriptorCount = POST_CHAIN_TEXTURES;
+			descriptor_writes[1].pBufferInfo = NULL;
+			descriptor_writes[1].pImageInfo = image_infos;
+			descriptor_writes[1].pTexelBufferView = NULL;
+
+			vkUpdateDescriptorSets(vkx_instance.device, scene_to_swap_chain ? 1 : 2, descriptor_writes, 0, NULL);
+		}
+
+		// The post-processing passes have sets of the same layout
+		post_chain_create(&post_chain, &frame_graph, screen_sampler, &buffer_info);
+	}
+	if (half_res_background) {
+		// ----- Create the background descriptor sets -----
+		// The same as the tile layers' cache sets, with each frame's copy of
+		// the background as the texture
+		VkDescriptorSetLayout ds_layouts[VKX_MAX_FRAMES_IN_FLIGHT] = {0};
+		for (size_t i = 0; i < vkx_instance.frames_in_flight; i++) {
+			ds_layouts[i] = tile_layer_pipeline.descriptor_set_layout;
+		}
+
+		VkDescriptorSetAllocateInfo ds_alloc_info = {0};
+		ds_alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		ds_alloc_info.descriptorPool = descriptor_pool;
+		ds_alloc_info.descriptorSetCount = vkx_instance.frames_in_flight;
+		ds_alloc_info.pSetLayouts = ds_layouts;
+
+		if (vkAllocateDescriptorSets(vkx_instance.device, &ds_alloc_info, background_descriptor_sets) != VK_SUCCESS) {
+			fprintf(stderr, "failed to allocate background descriptor sets!\n");
+			exit(1);
+		}
+
+		VkDescriptorBufferInfo buffer_info = {0};
+		buffer_info.buffer = frame_ring.buffer.buffer;
+		buffer_info.offset = 0;
+		buffer_info.range = sizeof(UniformBufferObject);
+
+		// Unused, but every dynamic binding gets an offset when bound
+		VkDescriptorBufferInfo sprite_buffer_info = {0};
+		sprite_buffer_info.buffer = gpu_sprite_simulation ? sprite_transform_buffer.buffer : frame_ring.buffer.buffer;
+		sprite_buffer_info.offset = 0;
+		sprite_buffer_info.range = sizeof(SpriteTransform) * monsters_count;
+
+		for (size_t i = 0; i < vkx_instance.frames_in_flight; i++) {
+			VkDescriptorImageInfo image_info = {0};
+			image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			image_info.imageView = vkx_frame_graph_get_view(&frame_graph, graph_background_image, (uint32_t) i);
+			image_info.sampler = background_bilinear ? screen_sampler : texture_sampler;
+
+			VkWriteDescriptorSet descriptor_writes[3] = {0};
+			for (uint32_t j = 0; j < 3; j++) {
+				descriptor_writes[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				descriptor_writes[j].dstSet = background_descriptor_sets[i];
+				descriptor_writes[j].dstBinding = j;
+				descriptor_writes[j].dstArrayElement = 0;
+				descriptor_writes[j].descriptorCount = 1;
+			}
+			descriptor_writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+			descriptor_writes[0].pBufferInfo = &buffer_info;
+			descriptor_writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			descriptor_writes[1].pImageInfo = &image_info;
+			descriptor_writes[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+			descriptor_writes[2].pBufferInfo = &sprite_buffer_info;
+
+			vkUpdateDescriptorSets(vkx_instance.device, 3, descriptor_writes, 0, NULL);
+		}
+	}
+
+	create_profiler();
+
+	if (parallel_recording || static_command_buffers) {
+		vkx_secondary_commands_init(&scene_commands, 1 + SPRITE_RECORDING_JOBS, false);
+	}
+	if (static_command_buffers) {
+		vkx_secondary_commands_init(&static_commands, _STATIC_COMMANDS_COUNT, true);
+	}
+
+	// ----- Cache the static tile layers -----
+	// Needs the tile pipeline and descriptor sets, so it comes last
+	if (tile_layers) {
+		for (size_t i = 0; i < TILE_LAYERS_COUNT; i++) {
+			if (layers[i].cached) {
+				render_tile_layer_cache(&layers[i]);
+			}
+		}
+	}
+	if (use_chunk_impostors()) {
+		create_chunk_impostor_atlas();
+	}
+
+	name_vulkan_objects();
+	end_startup_phase(STARTUP_BUFFERS, buffers_start_ns);
+
+	printf("Initiialisation complete\n");
+}
+
+void count_draws(int count) {
+	/*
+	 * Add to the draws recorded this frame, for the HUD.  Static command
+	 * buffers are only counted when they are recorded
+	 */
+	if (hud_visible) {
+		SDL_AddAtomicInt(&draws_recorded, count);
+	}
+}
+
+const VkxPipeline* get_sprite_pipeline(uint32_t pipeline_id) {
+	/*
+	 * The pipeline for a SpritePipeline id, which is the cutout pipeline until
+	 * one compiling in the background is ready
+	 */
+	if (pipeline_id == SHAPE_PIPELINE_ID) {
+		return &shape_pipeline;
+	}
+	if (sprite_pipeline_requests[pipeline_id] != SPRITE_PIPELINE_NO_REQUEST) {
+		return vkx_pipeline_manager_get(sprite_pipeline_requests[pipeline_id]);
+	}
+	return sprite_pipelines[pipeline_id];
+}
+
+const VkxRenderState* get_sprite_render_state(uint32_t pipeline_id) {
+	// The render state to draw a SpritePipeline id's sprites with.  The shapes
+	// aren't counted by the heatmap, so they're always just blended
+	if (pipeline_id == SHAPE_PIPELINE_ID) {
+		return &SPRITE_RENDER_STATES[SPRITE_PIPELINE_TRANSLUCENT];
+	}
+	return overdraw_heatmap ? &OVERDRAW_RENDER_STATES[pipeline_id] : &SPRITE_RENDER_STATES[pipeline_id];
+}
+
+void record_sprite_batches(VkCommandBuffer command_buffer, const PushConstants* push_constants,
+		const RenderQueue* queue, VkDeviceSize records_offset, VkDeviceSize draws_offset, uint32_t first_batch, uint32_t end_batch) {
+	/*
+	 * Draw the sorted sprites from the frame ring, one draw per batch, or with
+	 * indirect_sprite_batches one draw per run of batches with the same state.
+	 * The pipeline is only rebound when it changes between batches, and with
+	 * dynamic render state the pipeline ids can share a pipeline and only change
+	 * the state.  The background layer's batches are shaded at 2x2 with
+	 * variable_rate_shading
+	 *
+	 * @param command_buffer The command buffer to record into (inside the rendering pass)
+	 * @param push_constants Push constants with the view-projection matrix
+	 * @param queue The sorted sprites, sprite_queue or batched_sprite_queue
+	 * @param records_offset Where their records are in the frame ring
+	 * @param draws_offset Where write_batch_draws() put their draws
+	 * @param first_batch, end_batch The range of batches to draw
+	 */
+	uint32_t bound_pipeline_id = UINT32_MAX;
+	const VkxPipeline* bound_pipeline = NULL;
+	// Binding a pipeline sets the rate back to every pixel
+	const VkExtent2D coarse_rate = {2, 2};
+	const VkExtent2D full_rate = {1, 1};
+	bool coarse = false;
+
+	for (uint32_t i = first_batch; i < end_batch; i++) {
+		const RenderQueueBatch* batch = &queue->batches[i];
+		uint32_t pipeline_id = render_queue_key_pipeline(batch->key);
+
+		if (pipeline_id != bound_pipeline_id) {
+			const VkxPipeline* pipeline = get_sprite_pipeline(pipeline_id);
+			if (pipeline != bound_pipeline) {
+				vkx_cmd_bind_pipeline(command_buffer, pipeline);
+				coarse = false;
+				vkCmdPushConstants(command_buffer, pipeline->layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants), push_constants);
+				if (bound_pipeline == NULL || use_vertex_pulling()) {
+					bind_vertex_records(command_buffer, pipeline->layout, frame_ring.buffer.buffer, records_offset);
+				}
+				bound_pipeline = pipeline;
+			}
+			vkx_cmd_set_render_state(command_buffer, get_sprite_render_state(pipeline_id));
+			bound_pipeline_id = pipeline_id;
+		}
+
+		bool background = use_variable_rate_shading() && render_queue_key_layer(batch->key) == SCENE_LAYER_BACKGROUND;
+		if (background != coarse) {
+			vkx_cmd_set_shading_rate(command_buffer, background ? coarse_rate : full_rate, false);
+			coarse = background;
+		}
+
+		if (indirect_sprite_batches) {
+			// Along with the batches after it which need nothing changed
+			uint32_t end = i + 1;
+			while (end < end_batch && end - i < vkx_instance.max_draw_indirect_count) {
+				uint64_t key = queue->batches[end].key;
+				bool end_background = use_variable_rate_shading() && render_queue_key_layer(key) == SCENE_LAYER_BACKGROUND;
+				if (render_queue_key_pipeline(key) != pipeline_id || end_background != background) {
+					break;
+				}
+				end++;
+			}
+			vkCmdDrawIndirect(command_buffer, frame_ring.buffer.buffer, draws_offset + sizeof(VkDrawIndirectCommand) * i,
+					end - i, sizeof(VkDrawIndirectCommand));
+			i = end - 1;
+		}
+		else if (instanced_sprites) {
+			vkCmdDraw(command_buffer, 6, batch->count, 0, batch->first);
+		}
+		else {
+			vkCmdDraw(command_buffer, batch->count * 6, 1, batch->first * 6, 0);
+		}
+		count_draws(1);
+	}
+}
+
+void record_sprite_simulation(VkCommandBuffer command_buffer) {
+	/*
+	 * Move the sprites and write their transforms on the GPU.  There is only one
+	 * copy of the state and the transforms, so this has to wait for the previous
+	 * frame to finish with them, and the vertex shader has to wait for this.
+	 * With gpu_sprite_events the events are then copied for this frame in
+	 * flight, for collect_sprite_events()
+	 *
+	 * @param command_buffer The command buffer to record into (outside of rendering)
+	 */
+	VkMemoryBarrier2 barrier = {0};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | get_sprite_geometry_stages();
+	barrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+
+	VkDependencyInfo dependency_info = {0};
+	dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dependency_info.memoryBarrierCount = 1;
+	dependency_info.pMemoryBarriers = &barrier;
+
+	if (use_sprite_events()) {
+		// The count goes back to 0 once the previous frame has copied the events
+		barrier.srcStageMask |= VK_PIPELINE_STAGE_2_COPY_BIT;
+		barrier.dstStageMask |= VK_PIPELINE_STAGE_2_CLEAR_BIT;
+		barrier.dstAccessMask |= VK_ACCESS_2_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+		vkCmdFillBuffer(command_buffer, sprite_event_buffer.buffer, 0, sizeof(uint32_t), 0);
+
+		barrier.srcStageMask = VK_PIPELINE_STAGE_2_CLEAR_BIT;
+		barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+		barrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+		barrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+	}
+	vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, sprite_sim_pipeline.pipeline);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, sprite_sim_pipeline.layout, 0, 1, &sprite_sim_descriptor_set, 0, NULL);
+
+	SimPushConstants push_constants = {0};
+	push_constants.dt = frame_state->sprite_sim_dt;
+	push_constants.anim_params = pack_sprite_animation(MONSTER_ANIM_AMPLITUDE, MONSTER_ANIM_FREQUENCY);
+	push_constants.bounds[0] = (float) X_TILES;
+	push_constants.bounds[1] = (float) Y_TILES;
+	push_constants.sprite_size = MONSTER_SIZE;
+	push_constants.count = monsters_count;
+	push_constants.max_events = use_sprite_events() ? MAX_SPRITE_EVENTS : 0;
+	vkCmdPushConstants(command_buffer, sprite_sim_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SimPushConstants), &push_constants);
+
+	vkCmdDispatch(command_buffer, (monsters_count + SPRITE_SIM_WORKGROUP_SIZE - 1) / SPRITE_SIM_WORKGROUP_SIZE, 1, 1);
+
+	// The transforms are read by the sprite vertex shader (and the culling shader)
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+	barrier.dstStageMask = get_sprite_geometry_stages() | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+	if (use_sprite_events()) {
+		barrier.dstStageMask |= VK_PIPELINE_STAGE_2_COPY_BIT;
+		barrier.dstAccessMask |= VK_ACCESS_2_TRANSFER_READ_BIT;
+	}
+	vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+
+	if (use_sprite_events()) {
+		VkBufferCopy region = {0};
+		region.size = get_sprite_events_size();
+		vkCmdCopyBuffer(command_buffer, sprite_event_buffer.buffer, sprite_event_readback_buffers[current_frame].buffer, 1, &region);
+
+		barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+		barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+		barrier.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT;
+		barrier.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT;
+		vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+		sprite_events_copied[current_frame] = true;
+	}
+}
+
+void handle_sprite_event(const SpriteEvent* event) {
+	/*
+	 * React to a sprite bouncing off an edge, a couple of frames after it did.
+	 * The GPU has the sprite's state, so this can't change it
+	 */
+	(void) event;
+	sprite_edge_hits++;
+}
+
+void collect_sprite_events(uint32_t frame) {
+	/*
+	 * Hand the events the simulation copied the last time round for a frame in
+	 * flight to handle_sprite_event(), in no particular order.  The frame has
+	 * to have finished on the GPU
+	 */
+	if (!sprite_events_copied[frame]) {
+		return;
+	}
+	sprite_events_copied[frame] = false;
+
+	const SpriteEventHeader* header = sprite_event_readback_buffers[frame].allocation.mapped;
+	const SpriteEvent* events = (const SpriteEvent*) (header + 1);
+	uint32_t count = header->count < MAX_SPRITE_EVENTS ? header->count : MAX_SPRITE_EVENTS;
+	sprite_events_dropped += header->count - count;
+	for (uint32_t i = 0; i < count; i++) {
+		handle_sprite_event(&events[i]);
+	}
+}
+
+void record_sprite_culling(VkCommandBuffer command_buffer) {
+	/*
+	 * Cull the sprites against the view on the GPU.  The visible sprite records are
+	 * compacted into visible_sprite_buffer and the draw for them is written to
+	 * sprite_indirect_buffer
+	 *
+	 * @param command_buffer The command buffer to record into (outside of rendering)
+	 */
+	const uint32_t vertices_per_sprite = instanced_sprites ? 1 : 6;
+
+	// The previous frame has to have finished drawing from the outputs
+	VkMemoryBarrier2 barrier = {0};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT | VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_NONE;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_NONE;
+
+	VkDependencyInfo dependency_info = {0};
+	dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dependency_info.memoryBarrierCount = 1;
+	dependency_info.pMemoryBarriers = &barrier;
+	vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+
+	// Reset the draw, the shader counts up the instances (or vertices)
+	VkDrawIndirectCommand draw_command = {0};
+	draw_command.vertexCount = instanced_sprites ? 6 : 0;
+	draw_command.instanceCount = instanced_sprites ? 0 : 1;
+	draw_command.firstVertex = 0;
+	draw_command.firstInstance = 0;
+	vkCmdUpdateBuffer(command_buffer, sprite_indirect_buffer.buffer, 0, sizeof(draw_command), &draw_command);
+
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+	vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+
+	// Same offsets as the sprite pipeline uses for the transforms, and wherever
+	// the sprite records and the occlusion mask are this frame
+	uint32_t dynamic_offsets[3] = {
+		frame_dynamic_offsets[1],
+		sprite_render_queue ? (uint32_t) sprite_records_offset : 0,
+		(uint32_t) occlusion_mask_offset,
+	};
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, sprite_cull_pipeline.pipeline);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, sprite_cull_pipeline.layout, 0, 1, &sprite_cull_descriptor_set, 3, dynamic_offsets);
+
+	CullPushConstants push_constants = {0};
+	// With split screen, against everything any of the views can see
+	if (split_screen_views > 1) {
+		const Camera* first = &frame_state->cameras[0];
+		float rect[4];
+		get_views_visible_rect(frame_state->cameras, 1.0f, rect);
+		glm_ortho(rect[0], rect[2], rect[3], rect[1], first->near_z, first->far_z, push_constants.view_projection);
+	}
+	else {
+		glm_mat4_copy(frame_state->cameras[0].view_projection, push_constants.view_projection);
+	}
+	push_constants.count = monsters_count;
+	push_constants.vertices_per_sprite = vertices_per_sprite;
+	push_constants.occlusion_origin[0] = occlusion_origin[0];
+	push_constants.occlusion_origin[1] = occlusion_origin[1];
+	push_constants.occlusion_size[0] = occlusion_mask.width;
+	push_constants.occlusion_size[1] = occlusion_mask.height;
+	push_constants.occlusion_words_per_row = occlusion_mask.words_per_row;
+	push_constants.occluder_z = TILE_MAP_Z;
+	vkCmdPushConstants(command_buffer, sprite_cull_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants), &push_constants);
+
+	vkCmdDispatch(command_buffer, (monsters_count + SPRITE_CULL_WORKGROUP_SIZE - 1) / SPRITE_CULL_WORKGROUP_SIZE, 1, 1);
+
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT | VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT;
+	vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+}
+
+void record_particle_simulation(VkCommandBuffer command_buffer) {
+	/*
+	 * Spawn this frame's particles, then move them all, free the dead ones and
+	 * write the live ones out for record_particles().  There is only one copy of
+	 * everything, so this waits for the previous frame to have drawn them
+	 *
+	 * @param command_buffer The command buffer to record into (outside of rendering)
+	 */
+	VkMemoryBarrier2 barrier = {0};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT
+		| VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT | VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+
+	VkDependencyInfo dependency_info = {0};
+	dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dependency_info.memoryBarrierCount = 1;
+	dependency_info.pMemoryBarriers = &barrier;
+	vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+
+	// Reset the draw, the update shader counts up the instances (or vertices)
+	VkDrawIndirectCommand draw_command = {0};
+	draw_command.vertexCount = instanced_sprites ? 6 : 0;
+	draw_command.instanceCount = instanced_sprites ? 0 : 1;
+	vkCmdUpdateBuffer(command_buffer, particle_indirect_buffer.buffer, 0, sizeof(draw_command), &draw_command);
+
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+	vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+
+	static uint32_t seed = 0;
+	ParticlePushConstants push_constants = {0};
+	push_constants.dt = frame_state->sprite_sim_dt;
+	push_constants.seed = seed++;
+	push_constants.capacity = PARTICLES_CAPACITY;
+	push_constants.emitters_count = frame_state->particle_emitters_count;
+	push_constants.spawn_count = frame_state->particles_spawned;
+	push_constants.vertices_per_sprite = instanced_sprites ? 1 : 6;
+
+	// Take the new particles' slots off the free list, before any go back on
+	if (push_constants.spawn_count > 0) {
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, particle_emit_pipeline.pipeline);
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, particle_emit_pipeline.layout, 0, 1,
+				&particle_emit_descriptor_set, 1, &particle_emitters_offset);
+		vkCmdPushConstants(command_buffer, particle_emit_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ParticlePushConstants), &push_constants);
+		vkCmdDispatch(command_buffer, (push_constants.spawn_count + PARTICLE_WORKGROUP_SIZE - 1) / PARTICLE_WORKGROUP_SIZE, 1, 1);
+
+		barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+		barrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+		vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+	}
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, particle_update_pipeline.pipeline);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, particle_update_pipeline.layout, 0, 1,
+			&particle_update_descriptor_set, 0, NULL);
+	vkCmdPushConstants(command_buffer, particle_update_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ParticlePushConstants), &push_constants);
+	vkCmdDispatch(command_buffer, (PARTICLES_CAPACITY + PARTICLE_WORKGROUP_SIZE - 1) / PARTICLE_WORKGROUP_SIZE, 1, 1);
+
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT
+		| VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT
+		| VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT;
+	vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+}
+
+void record_shadow_maps(VkCommandBuffer command_buffer, uint32_t count) {
+	/*
+	 * Walk out from each light through the occluders to make its shadow map.
+	 * The lights and occluders have been copied and the barrier after that
+	 * recorded
+	 *
+	 * @param count The number of lights
+	 */
+	ShadowMapPushConstants push_constants = {0};
+	push_constants.count = count;
+	push_constants.resolution = SHADOW_MAP_RESOLUTION;
+	push_constants.map_width = tile_solidity.width;
+	push_constants.map_height = tile_solidity.height;
+	push_constants.words_per_row = tile_solidity.words_per_row;
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, shadow_map_pipeline.pipeline);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, shadow_map_pipeline.layout, 0, 1,
+			&shadow_map_descriptor_set, 0, NULL);
+	vkCmdPushConstants(command_buffer, shadow_map_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ShadowMapPushConstants), &push_constants);
+	vkCmdDispatch(command_buffer, (SHADOW_MAP_RESOLUTION + SHADOW_MAP_WORKGROUP_SIZE - 1) / SHADOW_MAP_WORKGROUP_SIZE, count, 1);
+}
+
+void record_light_culling(VkCommandBuffer command_buffer) {
+	/*
+	 * Copy this frame's lights (and with shadows the changed rows of the
+	 * occluders) out of the frame ring, make the shadow maps and bin the
+	 * lights into each view's tiles for the lit fragment shaders.  As with the
+	 * particles there's one copy of each, so this waits for the previous frame
+	 * to have drawn
+	 *
+	 * @param command_buffer The command buffer to record into (outside of rendering)
+	 */
+	VkMemoryBarrier2 barrier = {0};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_NONE;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_NONE;
+
+	VkDependencyInfo dependency_info = {0};
+	dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dependency_info.memoryBarrierCount = 1;
+	dependency_info.pMemoryBarriers = &barrier;
+	vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+
+	uint32_t count = frame_state->lights_count;
+	if (count > 0) {
+		VkBufferCopy region = {0};
+		region.srcOffset = lights_offset;
+		region.dstOffset = 0;
+		region.size = sizeof(Light) * count;
+		vkCmdCopyBuffer(command_buffer, frame_ring.buffer.buffer, light_buffer.buffer, 1, &region);
+	}
+
+	// Each changed row is its own copy, next to each other in the ring
+	uint32_t rows_count = light_shadows ? frame_state->occluder_rows_count : 0;
+	if (rows_count > 0) {
+		VkDeviceSize row_size = sizeof(uint64_t) * tile_solidity.words_per_row;
+		VkBufferCopy regions[MAX_OCCLUDER_ROWS_PER_FRAME];
+		for (uint32_t i = 0; i < rows_count; i++) {
+			regions[i].srcOffset = occluder_rows_offset + row_size * i;
+			regions[i].dstOffset = row_size * frame_state->occluder_rows[i];
+			regions[i].size = row_size;
+		}
+		vkCmdCopyBuffer(command_buffer, frame_ring.buffer.buffer, occluder_buffer.buffer, rows_count, regions);
+	}
+
+	if (count > 0 || rows_count > 0) {
+		barrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+		barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+		barrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+		barrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+		vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+	}
+
+	// The culling doesn't read the shadow maps, so it needs no barrier after
+	// them
+	if (light_shadows && count > 0) {
+		record_shadow_maps(command_buffer, count);
+	}
+
+	uint32_t tiles[2];
+	get_light_tiles(split_screen_views > 1 ? get_view_extent(get_render_extent()) : get_render_extent(), tiles);
+
+	LightCullPushConstants push_constants = {0};
+	push_constants.count = count;
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, light_cull_pipeline.pipeline);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, light_cull_pipeline.layout, 0, 1,
+			&light_cull_descriptor_set, 1, &frame_dynamic_offsets[0]);
+	vkCmdPushConstants(command_buffer, light_cull_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(LightCullPushConstants), &push_constants);
+	vkCmdDispatch(command_buffer, tiles[0], tiles[1], split_screen_views);
+
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+	vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+}
+
+void record_tile_edits(VkCommandBuffer command_buffer) {
+	/*
+	 * Copy this frame's changed tiles from the frame ring into the tile index image,
+	 * or into the tile vertex buffer
+	 *
+	 * @param command_buffer The command buffer to record into (outside of rendering)
+	 */
+	VkxBarrierBatch barriers;
+	vkx_barrier_batch_begin(&barriers, command_buffer);
+
+	if (!tile_texture_tilemap) {
+		// Earlier frames have to have finished reading the tile mesh
+		vkx_barrier_batch_add_buffer(
+			&barriers, vertex_buffer.buffer, 0, VK_WHOLE_SIZE,
+			VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT, VK_ACCESS_2_NONE,
+			VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT
+		);
+		vkx_barrier_batch_flush(&barriers);
+
+		vkCmdCopyBuffer(command_buffer, frame_ring.buffer.buffer, vertex_buffer.buffer, tile_edits_staged, tile_vertex_copies);
+
+		vkx_barrier_batch_add_buffer(
+			&barriers, vertex_buffer.buffer, 0, VK_WHOLE_SIZE,
+			VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+			VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT, VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT
+		);
+		vkx_barrier_batch_flush(&barriers);
+		return;
+	}
+
+	// Earlier frames have to have finished reading the image
+	vkx_barrier_batch_add_image(
+		&barriers, tile_index_image.image, VK_FORMAT_R8_UINT,
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+	);
+	vkx_barrier_batch_flush(&barriers);
+
+	vkCmdCopyBufferToImage(
+		command_buffer,
+		frame_ring.buffer.buffer,
+		tile_index_image.image,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		tile_edits_staged,
+		tile_image_copies
+	);
+
+	vkx_barrier_batch_add_image(
+		&barriers, tile_index_image.image, VK_FORMAT_R8_UINT,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+	);
+	vkx_barrier_batch_flush(&barriers);
+}
+
+void record_chunk_impostor_renders(VkCommandBuffer command_buffer) {
+	/*
+	 * Render the chunk impostors stage_chunk_impostors() wrote the vertices of
+	 * into their slots of the atlas, keeping the rest of it
+	 *
+	 * @param command_buffer The command buffer to record into (outside of rendering)
+	 */
+	VkFormat format = get_tile_layer_cache_format();
+	vkx_transition_image_layout(
+		command_buffer, chunk_impostor_atlas.image, format,
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+	);
+
+	VkRenderingAttachmentInfo color_attachment_info = {0};
+	color_attachment_info.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+	color_attachment_info.imageView = chunk_impostor_atlas.view;
+	color_attachment_info.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	color_attachment_info.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	color_attachment_info.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+
+	VkRenderingInfo rendering_info = {0};
+	rendering_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+	rendering_info.renderArea.extent.width = CHUNK_IMPOSTOR_ATLAS_SIZE;
+	rendering_info.renderArea.extent.height = CHUNK_IMPOSTOR_ATLAS_SIZE;
+	rendering_info.layerCount = 1;
+	rendering_info.colorAttachmentCount = 1;
+	rendering_info.pColorAttachments = &color_attachment_info;
+
+	vkCmdBeginRendering(command_buffer, &rendering_info);
+
+	uint32_t dynamic_offsets[2] = {chunk_impostor_ubo_offset, frame_dynamic_offsets[1]};
+	vkx_cmd_bind_pipeline(command_buffer, &chunk_impostor_pipeline);
+	vkx_cmd_set_render_state(command_buffer, &SPRITE_RENDER_STATES[SPRITE_PIPELINE_CUTOUT]);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, chunk_impostor_pipeline.layout, 0, 1, &descriptor_sets[current_frame], 2, dynamic_offsets);
+	if (bindless_textures) {
+		VkDescriptorSet texture_table_set = vkx_texture_table_get_set();
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, chunk_impostor_pipeline.layout, VKX_TEXTURE_TABLE_SET, 1, &texture_table_set, 0, NULL);
+	}
+	vkCmdBindIndexBuffer(command_buffer, quad_index_buffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+
+	PushConstants push_constants = {0};
+	set_tile_push_constants(&push_constants);
+
+	for (uint32_t i = 0; i < chunk_impostor_renders_count; i++) {
+		const ChunkImpostorRender* render = &chunk_impostor_renders[i];
+
+		// Transparent first, as the slot has some other chunk in it or this
+		// one before its tiles changed
+		VkRect2D slot_rect = {0};
+		slot_rect.offset.x = (int32_t) (render->slot % CHUNK_IMPOSTOR_SLOTS_X * CHUNK_IMPOSTOR_SLOT_PIXELS);
+		slot_rect.offset.y = (int32_t) (render->slot / CHUNK_IMPOSTOR_SLOTS_X * CHUNK_IMPOSTOR_SLOT_PIXELS);
+		slot_rect.extent.width = CHUNK_IMPOSTOR_SLOT_PIXELS;
+		slot_rect.extent.height = CHUNK_IMPOSTOR_SLOT_PIXELS;
+
+		VkClearAttachment clear = {0};
+		clear.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		clear.colorAttachment = 0;
+		clear.clearValue = (VkClearValue) {{{0.0f, 0.0f, 0.0f, 0.0f}}};
+		VkClearRect clear_rect = {0};
+		clear_rect.rect = slot_rect;
+		clear_rect.layerCount = 1;
+		vkCmdClearAttachments(command_buffer, 1, &clear, 1, &clear_rect);
+
+		if (render->vertices_count == 0) {
+			continue;
+		}
+
+		VkViewport viewport = {0};
+		viewport.x = (float) slot_rect.offset.x;
+		viewport.y = (float) slot_rect.offset.y;
+		viewport.width = (float) CHUNK_IMPOSTOR_SLOT_PIXELS;
+		viewport.height = (float) CHUNK_IMPOSTOR_SLOT_PIXELS;
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+		vkCmdSetViewportWithCount(command_buffer, 1, &viewport);
+		vkCmdSetScissorWithCount(command_buffer, 1, &slot_rect);
+
+		// The chunk fills the slot, the same way up as the tile layer caches
+		float x0 = (float) (render->chunk % tilemap.chunks_x * TILEMAP_CHUNK_SIZE);
+		float y0 = (float) (render->chunk / tilemap.chunks_x * TILEMAP_CHUNK_SIZE);
+		glm_ortho(x0, x0 + (float) TILEMAP_CHUNK_SIZE, y0 + (float) TILEMAP_CHUNK_SIZE, y0, 22.0f, -22.0f, push_constants.mvp);
+		vkCmdPushConstants(command_buffer, chunk_impostor_pipeline.layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants), &push_constants);
+		bind_vertex_records(command_buffer, chunk_impostor_pipeline.layout, frame_ring.buffer.buffer, render->vertices_offset);
+
+		vkCmdDrawIndexed(command_buffer, render->vertices_count / 4 * 6, 1, 0, 0, 0);
+		count_draws(1);
+	}
+
+	vkCmdEndRendering(command_buffer);
+
+	vkx_transition_image_layout(
+		command_buffer, chunk_impostor_atlas.image, format,
+		VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+	);
+}
+
+void record_shading_rate_mask(VkCommandBuffer command_buffer) {
+	/*
+	 * Copy this frame's shading rate mask from the frame ring into the image
+	 * the scene pass takes it from
+	 *
+	 * @param command_buffer The command buffer to record into (in the shading
+	 *                       rate pass, outside of rendering)
+	 */
+	VkExtent2D mask_extent = get_shading_rate_mask_extent();
+
+	VkBufferImageCopy copy = {0};
+	copy.bufferOffset = shading_rate_mask_offset;
+	copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	copy.imageSubresource.layerCount = 1;
+	copy.imageExtent.width = mask_extent.width;
+	copy.imageExtent.height = mask_extent.height;
+	copy.imageExtent.depth = 1;
+	vkCmdCopyBufferToImage(command_buffer, frame_ring.buffer.buffer, vkx_frame_graph_get_image(&frame_graph, graph_shading_rate_image),
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+}
+
+void record_retained_sprite_copies(VkCommandBuffer command_buffer) {
+	/*
+	 * Copy this frame's changed retained sprites from the frame ring into their
+	 * buffers
+	 *
+	 * @param command_buffer The command buffer to record into (outside of rendering)
+	 */
+	VkxBarrierBatch barriers;
+	vkx_barrier_batch_begin(&barriers, command_buffer);
+
+	// Earlier frames have to have finished drawing them
+	vkx_barrier_batch_add_buffer(
+		&barriers, retained_transform_buffer.buffer, 0, VK_WHOLE_SIZE,
+		VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT, VK_ACCESS_2_NONE,
+		VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT
+	);
+	vkx_barrier_batch_add_buffer(
+		&barriers, retained_record_buffer.buffer, 0, VK_WHOLE_SIZE,
+		VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT, VK_ACCESS_2_NONE,
+		VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT
+	);
+	vkx_barrier_batch_flush(&barriers);
+
+	vkCmdCopyBuffer(command_buffer, frame_ring.buffer.buffer, retained_transform_buffer.buffer, retained_copies_count, retained_transform_copies);
+	vkCmdCopyBuffer(command_buffer, frame_ring.buffer.buffer, retained_record_buffer.buffer, retained_copies_count, retained_record_copies);
+
+	vkx_barrier_batch_add_buffer(
+		&barriers, retained_transform_buffer.buffer, 0, VK_WHOLE_SIZE,
+		VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+		VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT
+	);
+	vkx_barrier_batch_add_buffer(
+		&barriers, retained_record_buffer.buffer, 0, VK_WHOLE_SIZE,
+		VK_PIPELINE_STAGE_2_COPY_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+		VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT, VK_ACCESS_2_VERTEX_ATTRIBUTE_READ_BIT
+	);
+	vkx_barrier_batch_flush(&barriers);
+}
+
+void record_tile_layers(VkCommandBuffer command_buffer, bool background) {
+	/*
+	 * Draw the extra tile layers, either from their chunks with the tile pipeline
+	 * or their cached images.  The main descriptor sets must be bound, and they
+	 * are again afterwards
+	 *
+	 * @param command_buffer The command buffer to record into (inside rendering)
+	 * @param background Draw the layers in the background pass rather than the
+	 *                   rest (see tile_layer_in_background())
+	 */
+	PushConstants push_constants = {0};
+	set_tile_push_constants(&push_constants);
+
+	// The cache sets are bound in place of the main set
+	bool main_set_bound = true;
+
+	// With variable_rate_shading, the layers which move slower than the camera
+	// are the background, and are shaded at 2x2
+	const VkExtent2D coarse_rate = {2, 2};
+
+	for (size_t i = 0; i < TILE_LAYERS_COUNT; i++) {
+		TileLayer* layer = &layers[i];
+		if (tile_layer_in_background(layer) != background) {
+			continue;
+		}
+
+		// Each layer has its own view depending on how far it moves with the
+		// camera.  The cached ones stretch the unit quad over the layer
+		const Camera* camera = &frame_state->cameras[0];
+		Affine2 layer_model;
+		affine2_identity(&layer_model);
+		if (layer->cached) {
+			layer_model.a = (float) layer->width;
+			layer_model.d = (float) layer->height;
+		}
+		Affine2 layer_view;
+		camera_view_affine(camera, layer->desc.parallax, &layer_view);
+		affine2_mul(&layer_model, &layer_view, &layer_view);
+
+		mat4 layer_model_view;
+		affine2_to_mat4(&layer_view, layer->desc.z, layer_model_view);
+		glm_mat4_mul((vec4*) camera->projection, layer_model_view, push_constants.mvp);
+		push_constants.view_slot = 1 + (uint32_t) i;
+
+		if (layer->cached) {
+			vkx_cmd_bind_pipeline(command_buffer, &tile_layer_pipeline);
+			vkx_cmd_set_render_state(command_buffer, &SPRITE_RENDER_STATES[SPRITE_PIPELINE_CUTOUT]);
+			if (use_variable_rate_shading() && layer->desc.parallax < 1.0f) {
+				vkx_cmd_set_shading_rate(command_buffer, coarse_rate, false);
+			}
+			vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, tile_layer_pipeline.layout, 0, 1, &layer->cache_descriptor_set, 2, frame_dynamic_offsets);
+			main_set_bound = false;
+
+			vkCmdPushConstants(command_buffer, tile_layer_pipeline.layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants), &push_constants);
+
+			VkBuffer vertex_buffers[] = {tile_layer_quad_vertex_buffer.buffer};
+			VkDeviceSize offsets[] = {0};
+			vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, offsets);
+			vkCmdBindIndexBuffer(command_buffer, quad_index_buffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+
+			vkCmdDrawIndexed(command_buffer, 6, 1, 0, 0, 0);
+			count_draws(1);
+			continue;
+		}
+
+		vkx_cmd_bind_pipeline(command_buffer, &tile_pipeline);
+		vkx_cmd_set_render_state(command_buffer, &SPRITE_RENDER_STATES[SPRITE_PIPELINE_CUTOUT]);
+		if (use_variable_rate_shading() && layer->desc.parallax < 1.0f) {
+			vkx_cmd_set_shading_rate(command_buffer, coarse_rate, false);
+		}
+		if (!main_set_bound) {
+			vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, tile_pipeline.layout, 0, 1, &descriptor_sets[current_frame], 2, frame_dynamic_offsets);
+			main_set_bound = true;
+		}
+
+		vkCmdPushConstants(command_buffer, tile_pipeline.layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants), &push_constants);
+
+		tilemap_draw(&layer->tilemap, command_buffer, tile_pipeline.layout);
+		count_draws((int) layer->tilemap.visible_count);
+	}
+
+	// The layouts match for set 0, so this leaves the texture table bound
+	if (!main_set_bound) {
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, tile_pipeline.layout, 0, 1, &descriptor_sets[current_frame], 2, frame_dynamic_offsets);
+	}
+}
+
+void record_tile_map(VkCommandBuffer command_buffer, mat4 mvp) {
+	/*
+	 * Draw the whole map as one quad, with the tiles looked up from the tile index
+	 * image in the fragment shader
+	 *
+	 * @param command_buffer The command buffer to record into (inside rendering)
+	 * @param mvp The model view projection matrix for the tiles
+	 */
+	vkx_cmd_bind_pipeline(command_buffer, &tile_map_pipeline);
+	vkx_cmd_set_render_state(command_buffer, &SPRITE_RENDER_STATES[SPRITE_PIPELINE_CUTOUT]);
+	// At the rate of the mask, see stage_shading_rate_mask()
+	if (use_shading_rate_image()) {
+		const VkExtent2D full_rate = {1, 1};
+		vkx_cmd_set_shading_rate(command_buffer, full_rate, true);
+	}
+
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, tile_map_pipeline.layout, 0, 1, &descriptor_sets[current_frame], 2, frame_dynamic_offsets);
+
+	uint32_t tile_index_set = 1;
+	if (bindless_textures) {
+		VkDescriptorSet texture_table_set = vkx_texture_table_get_set();
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, tile_map_pipeline.layout, VKX_TEXTURE_TABLE_SET, 1, &texture_table_set, 0, NULL);
+		tile_index_set = VKX_TEXTURE_TABLE_SET + 1;
+	}
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, tile_map_pipeline.layout, tile_index_set, 1, &tile_index_descriptor_set, 0, NULL);
+
+	TileMapPushConstants push_constants = {0};
+	glm_mat4_copy(mvp, push_constants.mvp);
+	if (bindless_textures) {
+		push_constants.tileset_rect[0] = 0.0f;
+		push_constants.tileset_rect[1] = 0.0f;
+		push_constants.tileset_rect[2] = 1.0f;
+		push_constants.tileset_rect[3] = 1.0f;
+		push_constants.texture_index = texture_table_indices[TEX_TILES];
+	}
+	else {
+		const VkxAtlasRegion* region = &texture_atlas.regions[TEX_TILES];
+		push_constants.tileset_rect[0] = region->uv_offset[0];
+		push_constants.tileset_rect[1] = region->uv_offset[1];
+		push_constants.tileset_rect[2] = region->uv_scale[0];
+		push_constants.tileset_rect[3] = region->uv_scale[1];
+		push_constants.texture_index = region->layer;
+	}
+	push_constants.tileset_x_tiles = TILESET_X_TILES;
+	push_constants.tileset_y_tiles = TILESET_Y_TILES;
+	push_constants.empty_tile = EMPTY;
+
+	vkCmdPushConstants(command_buffer, tile_map_pipeline.layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(TileMapPushConstants), &push_constants);
+
+	VkBuffer vertex_buffers[] = {tile_map_quad_vertex_buffer.buffer};
+	VkDeviceSize offsets[] = {0};
+	vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, offsets);
+
+	vkCmdBindIndexBuffer(command_buffer, quad_index_buffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+
+	vkCmdDrawIndexed(command_buffer, 6, 1, 0, 0, 0);
+	count_draws(1);
+}
+
+void bind_scene_sets(VkCommandBuffer command_buffer) {
+	/*
+	 * Bind the descriptor sets shared by the tiles and the sprites
+	 *
+	 * @param command_buffer The command buffer to record into
+	 */
+	// Bind the descriptor set to update the uniform buffer
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, tile_pipeline.layout, 0, 1, &descriptor_sets[current_frame], 2, frame_dynamic_offsets);
+
+	// The texture table set stays bound for the sprites too
+	if (bindless_textures) {
+		VkDescriptorSet texture_table_set = vkx_texture_table_get_set();
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, tile_pipeline.layout, VKX_TEXTURE_TABLE_SET, 1, &texture_table_set, 0, NULL);
+	}
+}
+
+void record_map_tiles(VkCommandBuffer command_buffer) {
+	/*
+	 * Draw the tile map, leaving the shared descriptor sets bound
+	 *
+	 * @param command_buffer The command buffer to record into (inside the scene
+	 *                       pass, with the shared descriptor sets bound)
+	 */
+	// Update push constants with the mvp matrix: the first view's, which the
+	// shaders correct for the others, moved back to TILE_MAP_Z so that the
+	// tilemap is not infront of everything else
+	PushConstants push_constants = {0};
+	const Camera* camera = &frame_state->cameras[0];
+	mat4 tile_model_view;
+	affine2_to_mat4(&camera->view_2d, TILE_MAP_Z, tile_model_view);
+	glm_mat4_mul((vec4*) camera->projection, tile_model_view, push_constants.mvp);
+
+	// This has a different pipeline layout, so the sets which are shared with
+	// the sprites are bound again after it
+	if (tile_texture_tilemap) {
+		record_tile_map(command_buffer, push_constants.mvp);
+		bind_scene_sets(command_buffer);
+		return;
+	}
+
+	// The shader maps the tile texture coordinates into the atlas
+	set_tile_push_constants(&push_constants);
+
+	// Or a quad for each chunk's impostor, with the tile layer pipeline
+	if (drawing_chunk_impostors) {
+		vkx_cmd_bind_pipeline(command_buffer, &tile_layer_pipeline);
+		vkx_cmd_set_render_state(command_buffer, &SPRITE_RENDER_STATES[SPRITE_PIPELINE_CUTOUT]);
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, tile_layer_pipeline.layout, 0, 1, &chunk_impostor_descriptor_set, 2, frame_dynamic_offsets);
+		vkCmdPushConstants(command_buffer, tile_layer_pipeline.layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants), &push_constants);
+
+		VkBuffer vertex_buffers[] = {frame_ring.buffer.buffer};
+		VkDeviceSize offsets[] = {chunk_impostor_quads_offset};
+		vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, offsets);
+		vkCmdBindIndexBuffer(command_buffer, quad_index_buffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+
+		vkCmdDrawIndexed(command_buffer, chunk_impostor_quads_count * 6, 1, 0, 0, 0);
+		count_draws(1);
+		bind_scene_sets(command_buffer);
+		return;
+	}
+
+	vkx_cmd_bind_pipeline(command_buffer, &tile_pipeline);
+	vkx_cmd_set_render_state(command_buffer, &SPRITE_RENDER_STATES[SPRITE_PIPELINE_CUTOUT]);
+	// At the rate of the mask, see stage_shading_rate_mask()
+	if (use_shading_rate_image()) {
+		const VkExtent2D full_rate = {1, 1};
+		vkx_cmd_set_shading_rate(command_buffer, full_rate, true);
+	}
+
+	vkCmdPushConstants(command_buffer, tile_pipeline.layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants), &push_constants);
+
+	// Draw the triangles for the tiles
+	if (chunked_tilemap) {
+		tilemap_draw(&tilemap, command_buffer, tile_pipeline.layout);
+		count_draws((int) tilemap.visible_count);
+	}
+	else {
+		bind_vertex_records(command_buffer, tile_pipeline.layout, vertex_buffer.buffer, 0);
+		vkCmdBindIndexBuffer(command_buffer, quad_index_buffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+
+		vkCmdDrawIndexed(command_buffer, vertices_count / 4 * 6, 1, 0, 0, 0);
+		count_draws(1);
+	}
+}
+
+void record_tiles(VkCommandBuffer command_buffer) {
+	/*
+	 * Draw the layers behind the tile map and then the map, back to front,
+	 * leaving the shared descriptor sets bound
+	 *
+	 * @param command_buffer The command buffer to record into (inside the scene pass)
+	 */
+	bind_scene_sets(command_buffer);
+
+	if (tile_layers) {
+		record_tile_layers(command_buffer, false);
+	}
+
+	record_map_tiles(command_buffer);
+}
+
+void record_culled_sprites(VkCommandBuffer command_buffer, const PushConstants* push_constants) {
+	/*
+	 * Draw the sprites the culling shader found visible, with its indirect draw
+	 */
+	// Everything is alpha tested, as the sprites can't be sorted
+	vkx_cmd_bind_pipeline(command_buffer, &sprite_cutout_pipeline);
+	vkx_cmd_set_render_state(command_buffer, get_sprite_render_state(SPRITE_PIPELINE_CUTOUT));
+
+	vkCmdPushConstants(command_buffer, sprite_cutout_pipeline.layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants), push_constants);
+	bind_vertex_records(command_buffer, sprite_cutout_pipeline.layout, visible_sprite_buffer.buffer, 0);
+
+	vkCmdDrawIndirect(command_buffer, sprite_indirect_buffer.buffer, 0, 1, sizeof(VkDrawIndirectCommand));
+	count_draws(1);
+}
+
+void record_mesh_sprites(VkCommandBuffer command_buffer) {
+	/*
+	 * Cull and draw the sprites with the task and mesh shaders.  Their pipeline
+	 * pushes different constants, so the shared descriptor sets are bound again
+	 * for it and then again for whatever is drawn after
+	 */
+	vkx_cmd_bind_pipeline(command_buffer, &sprite_mesh_pipeline);
+	vkx_cmd_set_render_state(command_buffer, &SPRITE_RENDER_STATES[SPRITE_PIPELINE_CUTOUT]);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, sprite_mesh_pipeline.layout, 0, 1, &descriptor_sets[current_frame], 2, frame_dynamic_offsets);
+	if (bindless_textures) {
+		VkDescriptorSet texture_table_set = vkx_texture_table_get_set();
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, sprite_mesh_pipeline.layout, VKX_TEXTURE_TABLE_SET, 1, &texture_table_set, 0, NULL);
+	}
+
+	MeshSpritePushConstants push_constants = {0};
+	glm_mat4_copy(frame_state->cameras[0].view_projection, push_constants.mvp);
+	if (split_screen_views > 1) {
+		get_views_visible_rect(frame_state->cameras, 1.0f, push_constants.visible_rect);
+	}
+	else {
+		memcpy(push_constants.visible_rect, frame_state->cameras[0].visible, sizeof(push_constants.visible_rect));
+	}
+	// Sorted in the ring or straight from the vertex buffer
+	push_constants.records_address = sprite_render_queue
+		? vkx_get_buffer_address(frame_ring.buffer.buffer) + sprite_records_offset
+		: vkx_get_buffer_address(sprite_vertex_buffer.buffer);
+	push_constants.count = monsters_count;
+	push_constants.vertices_per_sprite = instanced_sprites ? 1 : 6;
+	vkCmdPushConstants(command_buffer, sprite_mesh_pipeline.layout, VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT, 0, sizeof(MeshSpritePushConstants), &push_constants);
+
+	vkx_cmd_draw_mesh_tasks(command_buffer, (monsters_count + SPRITE_MESH_GROUP_SIZE - 1) / SPRITE_MESH_GROUP_SIZE, 1, 1);
+	count_draws(1);
+
+	bind_scene_sets(command_buffer);
+}
+
+void record_particles(VkCommandBuffer command_buffer, const PushConstants* push_constants) {
+	/*
+	 * Draw the live particles with the update shader's indirect draw, with
+	 * particle_descriptor_sets bound
+	 */
+	// They aren't sorted, so they're alpha tested like the culled sprites
+	vkx_cmd_bind_pipeline(command_buffer, &sprite_cutout_pipeline);
+	vkx_cmd_set_render_state(command_buffer, get_sprite_render_state(SPRITE_PIPELINE_CUTOUT));
+
+	vkCmdPushConstants(command_buffer, sprite_cutout_pipeline.layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants), push_constants);
+	bind_vertex_records(command_buffer, sprite_cutout_pipeline.layout, particle_record_buffer.buffer, 0);
+
+	vkCmdDrawIndirect(command_buffer, particle_indirect_buffer.buffer, 0, 1, sizeof(VkDrawIndirectCommand));
+	count_draws(1);
+}
+
+void record_unsorted_sprites(VkCommandBuffer command_buffer, const PushConstants* push_constants, VkBuffer records,
+		uint32_t first, uint32_t end) {
+	/*
+	 * Draw the sprites [first, end) of a buffer of sprite records in order, e.g.
+	 * the monsters from the static sprite vertex buffer
+	 */
+	// Unsorted, so everything is alpha tested
+	vkx_cmd_bind_pipeline(command_buffer, &sprite_cutout_pipeline);
+	vkx_cmd_set_render_state(command_buffer, get_sprite_render_state(SPRITE_PIPELINE_CUTOUT));
+
+	vkCmdPushConstants(command_buffer, sprite_cutout_pipeline.layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants), push_constants);
+	bind_vertex_records(command_buffer, sprite_cutout_pipeline.layout, records, 0);
+
+	if (instanced_sprites) {
+		// One instance per sprite, the shader generates the 6 quad vertices
+		vkCmdDraw(command_buffer, 6, end - first, 0, first);
+	}
+	else {
+		vkCmdDraw(command_buffer, (end - first) * 6, 1, first * 6, 0);
+	}
+	count_draws(1);
+}
+
+void record_framed_sprites(VkCommandBuffer command_buffer, const PushConstants* push_constants, uint32_t first, uint32_t end) {
+	/*
+	 * Draw the monsters [first, end) with sprite_frame_table, like
+	 * record_unsorted_sprites() with the frame table's address pushed
+	 */
+	vkx_cmd_bind_pipeline(command_buffer, &framed_sprite_pipeline);
+	vkx_cmd_set_render_state(command_buffer, get_sprite_render_state(SPRITE_PIPELINE_CUTOUT));
+
+	PushConstants framed_push_constants = *push_constants;
+	framed_push_constants.records_address = vkx_get_buffer_address(sprite_frame_buffer.buffer);
+	vkCmdPushConstants(command_buffer, framed_sprite_pipeline.layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants), &framed_push_constants);
+	VkDeviceSize offset = 0;
+	vkCmdBindVertexBuffers(command_buffer, 0, 1, &sprite_vertex_buffer.buffer, &offset);
+
+	if (instanced_sprites) {
+		vkCmdDraw(command_buffer, 6, end - first, 0, first);
+	}
+	else {
+		vkCmdDraw(command_buffer, (end - first) * 6, 1, first * 6, 0);
+	}
+	count_draws(1);
+}
+
+void record_skinned_characters(VkCommandBuffer command_buffer, const PushConstants* push_constants) {
+	/*
+	 * Draw the skinned characters in view, an instance each, with the palettes
+	 * stage_skinned_characters() wrote bound in place of the batched sprites'
+	 * transforms
+	 */
+	vkx_cmd_bind_pipeline(command_buffer, &skinned_pipeline);
+	vkx_cmd_set_render_state(command_buffer, &SPRITE_RENDER_STATES[SPRITE_PIPELINE_CUTOUT]);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, skinned_pipeline.layout, 0, 1,
+			&batched_sprite_descriptor_sets[current_frame], 2, skinned_dynamic_offsets);
+
+	// The shader moves the vertices to the world, so this is only the
+	// view-projection at the characters' depth
+	PushConstants skinned_push_constants = *push_constants;
+	glm_translate(skinned_push_constants.mvp, (vec3) {0.0f, 0.0f, SKINNED_CHARACTER_Z});
+	glm_vec4_one(skinned_push_constants.color);
+	vkCmdPushConstants(command_buffer, skinned_pipeline.layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants), &skinned_push_constants);
+
+	VkDeviceSize offset = 0;
+	vkCmdBindVertexBuffers(command_buffer, 0, 1, &skinned_vertex_buffer.buffer, &offset);
+	vkCmdBindIndexBuffer(command_buffer, skinned_index_buffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+	vkCmdDrawIndexed(command_buffer, skinned_indices_count, skinned_instances_count, 0, 0, 0);
+	count_draws(1);
+}
+
+void record_unqueued_sprites(VkCommandBuffer command_buffer, const PushConstants* push_constants) {
+	/*
+	 * Draw the retained sprites, the particles and the skinned characters,
+	 * which aren't in a render queue.  This leaves their own sets bound
+	 */
+	if (frame_state->retained_slots_count > 0) {
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, tile_pipeline.layout, 0, 1,
+				&retained_sprite_descriptor_sets[current_frame], 2, retained_sprite_dynamic_offsets);
+		record_unsorted_sprites(command_buffer, push_constants, retained_record_buffer.buffer, 0, frame_state->retained_slots_count);
+	}
+	if (gpu_particles) {
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, tile_pipeline.layout, 0, 1,
+				&particle_descriptor_sets[current_frame], 2, particle_dynamic_offsets);
+		record_particles(command_buffer, push_constants);
+	}
+	if (skinned_instances_count > 0) {
+		record_skinned_characters(command_buffer, push_constants);
+	}
+}
+
+void get_layer_batches(const RenderQueue* queue, uint32_t layer, uint32_t* first_batch, uint32_t* end_batch) {
+	/*
+	 * Find the batches of a sorted queue in one layer, which are next to each
+	 * other as the layer is at the top of the keys
+	 */
+	uint32_t first = 0;
+	while (first < queue->batches_count && render_queue_key_layer(queue->batches[first].key) < layer) {
+		first++;
+	}
+	uint32_t end = first;
+	while (end < queue->batches_count && render_queue_key_layer(queue->batches[end].key) == layer) {
+		end++;
+	}
+	*first_batch = first;
+	*end_batch = end;
+}
+
+void record_sprite_layer(VkCommandBuffer command_buffer, uint32_t layer) {
+	/*
+	 * Draw the monsters and the sprite_draw() sprites in one of the scene
+	 * layers without the depth buffer, leaving the shared descriptor sets bound
+	 *
+	 * @param command_buffer The command buffer to record into (inside the scene
+	 *                       pass, with the shared descriptor sets bound)
+	 * @param layer SCENE_LAYER_*
+	 */
+	PushConstants push_constants = {0};
+	glm_mat4_copy(frame_state->cameras[0].view_projection, push_constants.mvp);
+
+	uint32_t first_batch, end_batch;
+	get_layer_batches(&sprite_queue, layer, &first_batch, &end_batch);
+	record_sprite_batches(command_buffer, &push_constants, &sprite_queue, sprite_records_offset, sprite_draws_offset, first_batch, end_batch);
+
+	get_layer_batches(&batched_sprite_queue, layer, &first_batch, &end_batch);
+	if (first_batch < end_batch) {
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, tile_pipeline.layout, 0, 1,
+				&batched_sprite_descriptor_sets[current_frame], 2, batched_sprite_dynamic_offsets);
+		record_sprite_batches(command_buffer, &push_constants, &batched_sprite_queue, batched_sprite_records_offset, batched_sprite_draws_offset,
+				first_batch, end_batch);
+		bind_scene_sets(command_buffer);
+	}
+}
+
+void record_background(VkCommandBuffer command_buffer) {
+	/*
+	 * Draw the tile layers and sprites of the background at its lower
+	 * resolution.  The camera's projection covers the smaller image the same
+	 * as it does the scene
+	 *
+	 * @param command_buffer The command buffer to record into (inside the
+	 *                       background pass)
+	 */
+	bind_scene_sets(command_buffer);
+
+	if (tile_layers) {
+		record_tile_layers(command_buffer, true);
+	}
+	record_sprite_layer(command_buffer, SCENE_LAYER_BACKGROUND);
+}
+
+void record_background_composite(VkCommandBuffer command_buffer) {
+	/*
+	 * Scale the background up over the whole scene, before anything in front
+	 * of it, leaving the shared descriptor sets bound
+	 *
+	 * @param command_buffer The command buffer to record into (inside the scene
+	 *                       pass, with the shared descriptor sets bound)
+	 */
+	// The background only fills part of its image at lower render scales, so
+	// the unit quad is stretched for that part to cover the scene
+	VkExtent2D background_extent = get_background_extent(get_render_extent());
+	const VkxFrameGraphImage* image = &frame_graph.images[graph_background_image];
+	float used_width = (float) background_extent.width / (float) image->extent.width;
+	float used_height = (float) background_extent.height / (float) image->extent.height;
+
+	PushConstants push_constants = {0};
+	set_tile_push_constants(&push_constants);
+	glm_ortho(0.0f, used_width, 1.0f, 1.0f - used_height, 22.0f, -22.0f, push_constants.mvp);
+
+	vkx_cmd_bind_pipeline(command_buffer, &tile_layer_pipeline);
+	vkx_cmd_set_render_state(command_buffer, &SPRITE_RENDER_STATES[SPRITE_PIPELINE_CUTOUT]);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, tile_layer_pipeline.layout, 0, 1,
+			&background_descriptor_sets[current_frame], 2, frame_dynamic_offsets);
+	vkCmdPushConstants(command_buffer, tile_layer_pipeline.layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants), &push_constants);
+
+	VkBuffer vertex_buffers[] = {tile_layer_quad_vertex_buffer.buffer};
+	VkDeviceSize offsets[] = {0};
+	vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, offsets);
+	vkCmdBindIndexBuffer(command_buffer, quad_index_buffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+
+	vkCmdDrawIndexed(command_buffer, 6, 1, 0, 0, 0);
+	count_draws(1);
+
+	bind_scene_sets(command_buffer);
+}
+
+void record_scene_back_to_front(VkCommandBuffer command_buffer) {
+	/*
+	 * Draw the scene without the depth buffer, with everything in the order it
+	 * goes on top of each other.  The retained sprites and the particles aren't
+	 * sorted, so they go over the rest
+	 *
+	 * @param command_buffer The command buffer to record into (inside the scene pass)
+	 */
+	bind_scene_sets(command_buffer);
+
+	if (half_res_background) {
+		record_background_composite(command_buffer);
+	}
+	if (tile_layers) {
+		record_tile_layers(command_buffer, false);
+	}
+	if (!half_res_background) {
+		record_sprite_layer(command_buffer, SCENE_LAYER_BACKGROUND);
+	}
+	record_sprite_layer(command_buffer, SCENE_LAYER_BEHIND_MAP);
+	record_map_tiles(command_buffer);
+	record_sprite_layer(command_buffer, SCENE_LAYER_FRONT);
+
+	PushConstants push_constants = {0};
+	glm_mat4_copy(frame_state->cameras[0].view_projection, push_constants.mvp);
+	record_unqueued_sprites(command_buffer, &push_constants);
+}
+
+void record_sprites(VkCommandBuffer command_buffer, uint32_t part, uint32_t parts_count) {
+	/*
+	 * Draw some of the sprites.  Splitting them into parts and drawing the parts
+	 * in order gives the same image as drawing them all at once
+	 *
+	 * @param command_buffer The command buffer to record into (inside the scene
+	 *                       pass, with the shared descriptor sets bound)
+	 * @param part Which of the parts to draw
+	 * @param parts_count How many parts the sprites are split into
+	 */
+	// The sprite shader builds the model transform itself, so it only needs
+	// the shared view-projection matrix
+	PushConstants push_constants = {0};
+	glm_mat4_copy(frame_state->cameras[0].view_projection, push_constants.mvp);
+
+	if (use_mesh_shader_sprites()) {
+		// All of them go in the one draw
+		if (part == 0) {
+			record_mesh_sprites(command_buffer);
+		}
+	}
+	else if (gpu_sprite_culling) {
+		// The culling shader has already worked out how many to draw, so that
+		// can't be split
+		if (part == 0) {
+			record_culled_sprites(command_buffer, &push_constants);
+		}
+	}
+	else if (sprite_render_queue) {
+		uint32_t first_batch = (uint32_t) ((uint64_t) sprite_queue.batches_count * part / parts_count);
+		uint32_t end_batch = (uint32_t) ((uint64_t) sprite_queue.batches_count * (part + 1) / parts_count);
+		record_sprite_batches(command_buffer, &push_constants, &sprite_queue, sprite_records_offset, sprite_draws_offset, first_batch, end_batch);
+	}
+	else {
+		uint32_t first = (uint32_t) ((uint64_t) monsters_count * part / parts_count);
+		uint32_t end = (uint32_t) ((uint64_t) monsters_count * (part + 1) / parts_count);
+		if (first < end && use_sprite_frame_table()) {
+			record_framed_sprites(command_buffer, &push_constants, first, end);
+		}
+		else if (first < end) {
+			record_unsorted_sprites(command_buffer, &push_constants, sprite_vertex_buffer.buffer, first, end);
+		}
+	}
+
+	// The retained sprites, the particles and then the ones from sprite_draw()
+	// go after the monsters, in the last part
+	if (part == parts_count - 1) {
+		record_unqueued_sprites(command_buffer, &push_constants);
+	}
+	if (part == parts_count - 1 && batched_sprite_queue.batches_count > 0) {
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, tile_pipeline.layout, 0, 1,
+				&batched_sprite_descriptor_sets[current_frame], 2, batched_sprite_dynamic_offsets);
+		record_sprite_batches(command_buffer, &push_constants, &batched_sprite_queue, batched_sprite_records_offset, batched_sprite_draws_offset,
+				0, batched_sprite_queue.batches_count);
+	}
+}
+
+void mark_static_commands_dirty(void) {
+	// Every frame in flight records its static command buffers again
+	static_commands_generation++;
+}
+
+bool static_commands_changed(uint32_t commands, const Camera* views, const VkxFrameGraphPassInfo* pass_info) {
+	/*
+	 * Check whether one of the current frame's static command buffers has to be
+	 * recorded again, and remember what it's recorded with if so
+	 *
+	 * @param commands STATIC_COMMANDS_TILES or STATIC_COMMANDS_SCREEN
+	 * @param views The views' cameras if it depends on them, or NULL
+	 * @param pass_info The pass it's recorded for, whose extent and render area
+	 *                  the viewport and scissor are set to
+	 *
+	 * @return true if it has to be recorded
+	 */
+	StaticCommandsKey key = {0};
+	key.recorded = true;
+	key.generation = static_commands_generation;
+	// Which chunks are drawn depends on all of the views
+	for (uint32_t i = 0; views != NULL && i < split_screen_views; i++) {
+		memcpy(key.views[i], views[i].visible, sizeof(key.views[i]));
+	}
+	// The ring allocations come in the same order every frame, so these only
+	// change if the sizes do
+	key.dynamic_offsets[0] = frame_dynamic_offsets[0];
+	key.dynamic_offsets[1] = frame_dynamic_offsets[1];
+	key.extent = pass_info->extent;
+	key.render_area = pass_info->render_area;
+
+	StaticCommandsKey* recorded = &static_commands_keys[current_frame][commands];
+	bool changed = !recorded->recorded
+		|| recorded->generation != key.generation
+		|| memcmp(recorded->views, key.views, sizeof(key.views)) != 0
+		|| recorded->dynamic_offsets[0] != key.dynamic_offsets[0]
+		|| recorded->dynamic_offsets[1] != key.dynamic_offsets[1]
+		|| recorded->extent.width != key.extent.width
+		|| recorded->extent.height != key.extent.height
+		|| memcmp(&recorded->render_area, &key.render_area, sizeof(key.render_area)) != 0;
+
+	*recorded = key;
+	return changed;
+}
+
+// Each job records one of the scene pass's secondary command buffers.  The
+// first has the tiles and the rest split the sprites between them
+typedef struct {
+	VkxFrameGraphPassInfo pass_info;
+	VkCommandBuffer command_buffers[1 + SPRITE_RECORDING_JOBS];
+	uint32_t sprite_parts;
+	// The tiles are replayed from static_commands as they are
+	bool reuse_tiles;
+} SceneRecordingJob;
+
+void record_scene_part(size_t start, size_t end, void* data) {
+	SceneRecordingJob* job = data;
+
+	for (size_t i = start; i < end; i++) {
+		VkCommandBuffer command_buffer;
+		if (i == 0 && static_command_buffers) {
+			if (job->reuse_tiles) {
+				job->command_buffers[i] = static_commands.command_buffers[current_frame][STATIC_COMMANDS_TILES];
+				continue;
+			}
+			command_buffer = vkx_secondary_commands_begin(&static_commands, current_frame, STATIC_COMMANDS_TILES, &job->pass_info);
+		}
+		else {
+			command_buffer = vkx_secondary_commands_begin(&scene_commands, current_frame, (uint32_t) i, &job->pass_info);
+		}
+
+		if (i == 0) {
+			record_tiles(command_buffer);
+		}
+		else {
+			bind_scene_sets(command_buffer);
+			record_sprites(command_buffer, (uint32_t) i - 1, job->sprite_parts);
+		}
+
+		vkx_secondary_commands_end(command_buffer);
+		job->command_buffers[i] = command_buffer;
+	}
+}
+
+void record_scene_secondary(VkCommandBuffer command_buffer) {
+	/*
+	 * Record the scene pass into secondary command buffers, across the worker
+	 * threads with parallel_recording, and execute them in order.  The tiles
+	 * are replayed if they haven't changed with static_command_buffers.
+	 * Timestamps can't be written between them, so the tiles and sprites
+	 * aren't timed separately
+	 *
+	 * @param command_buffer The frame's command buffer
+	 */
+	SceneRecordingJob job = {0};
+	job.pass_info = vkx_frame_graph_get_pass_info(&frame_graph, scene_pass);
+	job.sprite_parts = parallel_recording ? SPRITE_RECORDING_JOBS : 1;
+	if (static_command_buffers) {
+		job.reuse_tiles = !static_commands_changed(STATIC_COMMANDS_TILES, frame_state->cameras, &job.pass_info);
+	}
+	uint32_t count = 1 + job.sprite_parts;
+
+	trace_begin("record scene");
+	if (parallel_recording) {
+		jobs_parallel_for(count, 1, record_scene_part, &job);
+	}
+	else {
+		record_scene_part(0, count, &job);
+	}
+	trace_end();
+
+	vkx_frame_graph_begin_secondary_pass(&frame_graph, scene_pass);
+	vkCmdExecuteCommands(command_buffer, count, job.command_buffers);
+	vkx_frame_graph_end_pass(&frame_graph);
+}
+
+void record_screen(VkCommandBuffer command_buffer) {
+	/*
+	 * Draw the offscreen image to the swap chain image
+	 *
+	 * @param command_buffer The command buffer to record into (inside the screen pass)
+	 */
+	// NOTE: an improvement we could make here would be to add a projection
+	// matrix and feed it into the screen pipeline to ensure a consistent
+	// aspect ratio (i.e. but black stripes down the sides of the screen).
+	// This would probably involve adding the push constants to the screen
+	// pipeline, or adding that projection matrix to the ubo.
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, screen_pipeline.pipeline);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, screen_pipeline.layout, 0, 1, &screen_descriptor_sets[current_frame], 1, frame_dynamic_offsets);
+	vkCmdDraw(command_buffer, 6, 1, 0, 0);
+	count_draws(1);
+}
+
+void record_screen_local_read(VkCommandBuffer command_buffer, uint32_t image_index) {
+	/*
+	 * Apply the effects to the swap chain image the scene was drawn to, at the
+	 * end of the scene pass, reading each pixel back from the attachment
+	 *
+	 * @param command_buffer The command buffer to record into (inside the scene pass)
+	 * @param image_index The swap chain image being drawn to
+	 */
+	if (post_chain.screen_fused == 0) {
+		return;
+	}
+
+	vkx_frame_graph_cmd_local_read_barrier(&frame_graph);
+
+	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, screen_pipeline.pipeline);
+	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, screen_pipeline.layout, 0, 1, &screen_descriptor_sets[current_frame], 1, frame_dynamic_offsets);
+
+	VkxPushSetData input = {0};
+	input.image.imageView = vkx_swap_chain.image_views[image_index];
+	input.image.imageLayout = VK_IMAGE_LAYOUT_RENDERING_LOCAL_READ_KHR;
+	vkx_push_set_begin_frame(&scene_input_set, current_frame);
+	vkx_cmd_push_set(&scene_input_set, command_buffer, &input);
+
+	vkCmdDraw(command_buffer, 6, 1, 0, 0);
+	count_draws(1);
+}
+
+void record_screen_transfer(VkCommandBuffer command_buffer) {
+	/*
+	 * Copy the scene to the swap chain image if it's the same size, otherwise
+	 * blit it to scale it up, without any effects
+	 *
+	 * @param command_buffer The command buffer to record into (in the screen
+	 *                       pass, outside of rendering)
+	 */
+	VkExtent2D render_extent = get_render_extent();
+	VkImage offscreen = vkx_frame_graph_get_image(&frame_graph, graph_offscreen_image);
+	VkImage swap_chain_image = vkx_frame_graph_get_image(&frame_graph, graph_swap_chain_image);
+
+	VkImageSubresourceLayers subresource = {0};
+	subresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	subresource.mipLevel = 0;
+	subresource.baseArrayLayer = 0;
+	subresource.layerCount = 1;
+
+	bool same_size = render_extent.width == vkx_swap_chain.extent.width && render_extent.height == vkx_swap_chain.extent.height;
+	if (same_size && offscreen_format == vkx_swap_chain.image_format) {
+		VkImageCopy2 region = {0};
+		region.sType = VK_STRUCTURE_TYPE_IMAGE_COPY_2;
+		region.srcSubresource = subresource;
+		region.dstSubresource = subresource;
+		region.extent.width = render_extent.width;
+		region.extent.height = render_extent.height;
+		region.extent.depth = 1;
+
+		VkCopyImageInfo2 copy_info = {0};
+		copy_info.sType = VK_STRUCTURE_TYPE_COPY_IMAGE_INFO_2;
+		copy_info.srcImage = offscreen;
+		copy_info.srcImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		copy_info.dstImage = swap_chain_image;
+		copy_info.dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		copy_info.regionCount = 1;
+		copy_info.pRegions = &region;
+		vkCmdCopyImage2(command_buffer, &copy_info);
+		return;
+	}
+
+	VkImageBlit2 region = {0};
+	region.sType = VK_STRUCTURE_TYPE_IMAGE_BLIT_2;
+	region.srcSubresource = subresource;
+	region.srcOffsets[1].x = (int32_t) render_extent.width;
+	region.srcOffsets[1].y = (int32_t) render_extent.height;
+	region.srcOffsets[1].z = 1;
+	region.dstSubresource = subresource;
+	region.dstOffsets[1].x = (int32_t) vkx_swap_chain.extent.width;
+	region.dstOffsets[1].y = (int32_t) vkx_swap_chain.extent.height;
+	region.dstOffsets[1].z = 1;
+
+	VkBlitImageInfo2 blit_info = {0};
+	blit_info.sType = VK_STRUCTURE_TYPE_BLIT_IMAGE_INFO_2;
+	blit_info.srcImage = offscreen;
+	blit_info.srcImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	blit_info.dstImage = swap_chain_image;
+	blit_info.dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	blit_info.regionCount = 1;
+	blit_info.pRegions = &region;
+	blit_info.filter = bilinear_upscale ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+	vkCmdBlitImage2(command_buffer, &blit_info);
+}
+
+void record_split_screen(VkCommandBuffer command_buffer) {
+	/*
+	 * Copy each view from its layer into its part of the offscreen image, so
+	 * the post-processing and screen passes see one picture
+	 *
+	 * @param command_buffer The command buffer to record into (in the split
+	 *                       screen pass, outside of rendering)
+	 */
+	VkImage views = vkx_frame_graph_get_image(&frame_graph, graph_views_image);
+	VkImage offscreen = vkx_frame_graph_get_image(&frame_graph, graph_offscreen_image);
+	VkExtent2D render_extent = get_render_extent();
+	VkExtent2D view_extent = get_view_extent(render_extent);
+	uint32_t columns;
+	uint32_t rows;
+	get_view_grid(&columns, &rows);
+
+	// Three views leave a quarter with nothing copied to it, and odd sizes a
+	// row or column of pixels
+	bool gaps = split_screen_views < columns * rows
+		|| view_extent.width * columns != render_extent.width
+		|| view_extent.height * rows != render_extent.height;
+	if (gaps) {
+		VkClearColorValue clear_color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+		VkImageSubresourceRange range = {0};
+		range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		range.levelCount = 1;
+		range.layerCount = 1;
+		vkCmdClearColorImage(command_buffer, offscreen, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clear_color, 1, &range);
+
+		VkMemoryBarrier2 barrier = {0};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+		barrier.srcStageMask = VK_PIPELINE_STAGE_2_CLEAR_BIT;
+		barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+		barrier.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+		barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+
+		VkDependencyInfo dependency_info = {0};
+		dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+		dependency_info.memoryBarrierCount = 1;
+		dependency_info.pMemoryBarriers = &barrier;
+		vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+	}
+
+	VkImageCopy2 regions[MAX_VIEWS] = {0};
+	for (uint32_t i = 0; i < split_screen_views; i++) {
+		VkImageCopy2* region = &regions[i];
+		region->sType = VK_STRUCTURE_TYPE_IMAGE_COPY_2;
+		region->srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region->srcSubresource.baseArrayLayer = i;
+		region->srcSubresource.layerCount = 1;
+		region->dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region->dstSubresource.layerCount = 1;
+		region->dstOffset.x = (int32_t) ((i % columns) * view_extent.width);
+		region->dstOffset.y = (int32_t) ((i / columns) * view_extent.height);
+		region->extent.width = view_extent.width;
+		region->extent.height = view_extent.height;
+		region->extent.depth = 1;
+	}
+
+	VkCopyImageInfo2 copy_info = {0};
+	copy_info.sType = VK_STRUCTURE_TYPE_COPY_IMAGE_INFO_2;
+	copy_info.srcImage = views;
+	copy_info.srcImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	copy_info.dstImage = offscreen;
+	copy_info.dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	copy_info.regionCount = split_screen_views;
+	copy_info.pRegions = regions;
+	vkCmdCopyImage2(command_buffer, &copy_info);
+}
+
+void begin_command_buffer(VkCommandBuffer command_buffer) {
+	VkCommandBufferBeginInfo begin_info = {0};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+	if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+		fprintf(stderr, "failed to begin recording command buffer!\n");
+		exit(1);
+	}
+}
+
+void end_command_buffer(VkCommandBuffer command_buffer) {
+	if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+		fprintf(stderr, "failed to record command buffer!\n");
+		exit(1);
+	}
+}
+
+VkCommandBuffer record_async_compute(VkCommandBuffer command_buffer) {
+	/*
+	 * Finish the graphics work before the post-processing, and record the
+	 * post-processing in the frame's compute command buffer.  The three are
+	 * submitted one after another by draw_frame()
+	 *
+	 * @param command_buffer The frame's command buffer so far
+	 *
+	 * @return The command buffer for the rest of the frame
+	 */
+	end_command_buffer(command_buffer);
+
+	VkCommandBuffer compute_command_buffer = vkx_frames[current_frame].compute_command_buffer;
+	begin_command_buffer(compute_command_buffer);
+	vkx_frame_graph_set_command_buffer(&frame_graph, compute_command_buffer);
+	post_chain_record(&post_chain, &frame_graph, compute_command_buffer, current_frame, frame_dynamic_offsets);
+	end_command_buffer(compute_command_buffer);
+
+	VkCommandBuffer after_compute = vkx_frames[current_frame].command_buffer_after_compute;
+	begin_command_buffer(after_compute);
+	vkx_frame_graph_set_command_buffer(&frame_graph, after_compute);
+	vkx_profiler_set_command_buffer(&profiler, after_compute);
+
+	return after_compute;
+}
+
+void record_overlays(VkCommandBuffer command_buffer) {
+	/*
+	 * Draw the debug shapes and then the performance overlay over the finished
+	 * frame, whichever are showing
+	 *
+	 * @param command_buffer The command buffer to record into (inside rendering
+	 *                       to the swap chain image)
+	 */
+	if (debug_shapes_visible) {
+		debug_draw_record(&debug_drawer, command_buffer, &frame_ring, &frame_state->debug_lines);
+	}
+	if (hud_visible) {
+		hud_record(&hud, command_buffer, &frame_ring, current_frame);
+	}
+}
+
+void record_extra_windows(VkCommandBuffer command_buffer, uint32_t image_index) {
+	/*
+	 * Blit the finished swap chain image to each other window which acquired
+	 * one, as big as it fits with the aspect kept and black around it, and
+	 * leave those ready to present.  The swap chain image is left to be
+	 * captured, or with no capture, ready to present too
+	 *
+	 * @param image_index The main swap chain's, in VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+	 */
+	VkImageMemoryBarrier2 barriers[VKX_MAX_WINDOWS + 1] = {0};
+	uint32_t barriers_count = 0;
+	for (uint32_t i = 0; i < extra_windows_count; i++) {
+		const VkxWindow* window = &extra_windows[i];
+		if (window->image_index == UINT32_MAX) {
+			continue;
+		}
+		// The acquire semaphore is waited on at the transfer stages
+		VkImageMemoryBarrier2* barrier = &barriers[barriers_count++];
+		barrier->sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+		barrier->srcStageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+		barrier->dstStageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+		barrier->dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+		barrier->oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier->newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier->image = window->swap_chain.images[window->image_index];
+		barrier->subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier->subresourceRange.levelCount = 1;
+		barrier->subresourceRange.layerCount = 1;
+	}
+	if (barriers_count == 0 && capture_enabled) {
+		return;
+	}
+
+	VkDependencyInfo dependency_info = {0};
+	dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dependency_info.imageMemoryBarrierCount = barriers_count;
+	dependency_info.pImageMemoryBarriers = barriers;
+	if (barriers_count > 0) {
+		vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+	}
+
+	VkImageSubresourceRange range = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+	VkClearColorValue black = {{0.0f, 0.0f, 0.0f, 1.0f}};
+	VkExtent2D source_extent = vkx_swap_chain.extent;
+	for (uint32_t i = 0; i < extra_windows_count; i++) {
+		const VkxWindow* window = &extra_windows[i];
+		if (window->image_index == UINT32_MAX) {
+			continue;
+		}
+		VkImage image = window->swap_chain.images[window->image_index];
+		VkExtent2D extent = window->swap_chain.extent;
+		vkCmdClearColorImage(command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &black, 1, &range);
+
+		float scale = fminf((float) extent.width / (float) source_extent.width, (float) extent.height / (float) source_extent.height);
+		int32_t width = (int32_t) ((float) source_extent.width * scale);
+		int32_t height = (int32_t) ((float) source_extent.height * scale);
+		int32_t x = ((int32_t) extent.width - width) / 2;
+		int32_t y = ((int32_t) extent.height - height) / 2;
+
+		VkImageBlit region = {0};
+		region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region.srcSubresource.layerCount = 1;
+		region.srcOffsets[1].x = (int32_t) source_extent.width;
+		region.srcOffsets[1].y = (int32_t) source_extent.height;
+		region.srcOffsets[1].z = 1;
+		region.dstSubresource = region.srcSubresource;
+		region.dstOffsets[0].x = x;
+		region.dstOffsets[0].y = y;
+		region.dstOffsets[1].x = x + width;
+		region.dstOffsets[1].y = y + height;
+		region.dstOffsets[1].z = 1;
+		if (width > 0 && height > 0) {
+			vkCmdBlitImage(command_buffer, vkx_swap_chain.images[image_index], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+					image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region, VK_FILTER_LINEAR);
+		}
+	}
+
+	for (uint32_t i = 0; i < barriers_count; i++) {
+		barriers[i].srcStageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+		barriers[i].srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+		barriers[i].dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+		barriers[i].dstAccessMask = VK_ACCESS_2_NONE;
+		barriers[i].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barriers[i].newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	}
+	// capture_record() moves it on otherwise
+	if (!capture_enabled) {
+		VkImageMemoryBarrier2* barrier = &barriers[barriers_count++];
+		barrier->sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+		barrier->srcStageMask = VK_PIPELINE_STAGE_2_BLIT_BIT;
+		barrier->srcAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT;
+		barrier->dstStageMask = swap_chain_present_state.stages;
+		barrier->dstAccessMask = swap_chain_present_state.access;
+		barrier->oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier->newLayout = swap_chain_present_state.layout;
+		barrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier->image = vkx_swap_chain.images[image_index];
+		barrier->subresourceRange = range;
+	}
+	dependency_info.imageMemoryBarrierCount = barriers_count;
+	vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+}
+
+void record_command_buffer(VkCommandBuffer command_buffer, uint32_t image_index) {
+	begin_command_buffer(command_buffer);
+
+	vkx_profiler_begin_frame(&profiler, command_buffer, current_frame);
+	vkx_profiler_begin_scope(&profiler, profile_frame);
+
+	if (gpu_sprite_simulation) {
+		record_sprite_simulation(command_buffer);
+	}
+
+	if (gpu_sprite_culling && !use_mesh_shader_sprites()) {
+		record_sprite_culling(command_buffer);
+	}
+
+	if (gpu_particles) {
+		record_particle_simulation(command_buffer);
+	}
+
+	if (lighting) {
+		record_light_culling(command_buffer);
+	}
+
+	if (tile_edits_staged > 0) {
+		record_tile_edits(command_buffer);
+	}
+
+	if (chunk_impostor_renders_count > 0) {
+		record_chunk_impostor_renders(command_buffer);
+	}
+
+	if (retained_copies_count > 0) {
+		record_retained_sprite_copies(command_buffer);
+	}
+
+	if (bindless_textures && texture_streaming && defragment_memory) {
+		vkx_residency_move_textures(command_buffer, DEFRAGMENT_BYTES_PER_FRAME);
+	}
+
+	if (use_sparse_atlas()) {
+		vkx_sparse_atlas_record_uploads(command_buffer, current_frame);
+	}
+
+	// The scene is rendered to part of the offscreen image, so the resolution
+	// can change without recreating it (or to part of each view's layer)
+	vkx_frame_graph_set_render_extent(&frame_graph, scene_pass,
+			split_screen_views > 1 ? get_view_extent(get_render_extent()) : get_render_extent());
+	if (background_pass != UINT32_MAX) {
+		vkx_frame_graph_set_render_extent(&frame_graph, background_pass, get_background_extent(get_render_extent()));
+	}
+	post_chain_set_render_extent(&post_chain, &frame_graph, get_render_extent());
+	if (partial_redraw) {
+		VkRect2D area = {0};
+		area.offset.x = damage_pixels[0];
+		area.offset.y = damage_pixels[1];
+		area.extent.width = (uint32_t) (damage_pixels[2] - damage_pixels[0]);
+		area.extent.height = (uint32_t) (damage_pixels[3] - damage_pixels[1]);
+		// Nothing changed, but the pass can't draw nothing, so that's a pixel
+		// drawn the same again
+		if (area.extent.width == 0 || area.extent.height == 0) {
+			area.extent.width = 1;
+			area.extent.height = 1;
+		}
+		vkx_frame_graph_set_render_area(&frame_graph, scene_pass, area);
+	}
+	
+	// The swap chain image changes from frame to frame
+	vkx_frame_graph_set_image(
+		&frame_graph,
+		graph_swap_chain_image,
+		vkx_swap_chain.images[image_index],
+		vkx_swap_chain.image_views[image_index],
+		vkx_swap_chain.extent
+	);
+
+	// --- Begin dynamic rendering --------------------------------------------
+	vkx_frame_graph_begin(&frame_graph, command_buffer, current_frame);
+
+	if (shading_rate_pass != UINT32_MAX) {
+		// No attachments, so this isn't inside rendering
+		vkx_frame_graph_begin_pass(&frame_graph, shading_rate_pass);
+		record_shading_rate_mask(command_buffer);
+		vkx_frame_graph_end_pass(&frame_graph);
+	}
+
+	if (tile_edits_staged > 0) {
+		mark_static_commands_dirty();
+	}
+
+	// Labelled for capture tools, along with the passes after it
+	vkx_cmd_begin_label(command_buffer, "scene");
+	if (parallel_recording || static_command_buffers) {
+		record_scene_secondary(command_buffer);
+	}
+	else if (!depth_buffer) {
+		if (background_pass != UINT32_MAX) {
+			vkx_frame_graph_begin_pass(&frame_graph, background_pass);
+			record_background(command_buffer);
+			vkx_frame_graph_end_pass(&frame_graph);
+		}
+
+		// The tiles and sprites are drawn in between each other, so they
+		// aren't timed separately
+		vkx_frame_graph_begin_pass(&frame_graph, scene_pass);
+		record_scene_back_to_front(command_buffer);
+		if (scene_to_swap_chain) {
+			record_screen_local_read(command_buffer, image_index);
+		}
+		vkx_frame_graph_end_pass(&frame_graph);
+	}
+	else {
+		vkx_frame_graph_begin_pass(&frame_graph, scene_pass);
+
+		vkx_cmd_begin_label(command_buffer, "tiles");
+		vkx_profiler_begin_scope(&profiler, profile_tiles);
+		record_tiles(command_buffer);
+		vkx_profiler_end_scope(&profiler, profile_tiles);
+		vkx_cmd_end_label(command_buffer);
+
+		// The descriptor sets are still bound from the tiles
+		vkx_cmd_begin_label(command_buffer, "sprites");
+		vkx_profiler_begin_scope(&profiler, profile_sprites);
+		record_sprites(command_buffer, 0, 1);
+		vkx_profiler_end_scope(&profiler, profile_sprites);
+		vkx_cmd_end_label(command_buffer);
+
+		if (scene_to_swap_chain) {
+			record_screen_local_read(command_buffer, image_index);
+		}
+		vkx_frame_graph_end_pass(&frame_graph);
+	}
+
+	if (split_screen_pass != UINT32_MAX) {
+		// No attachments, so this isn't inside rendering
+		vkx_frame_graph_begin_pass(&frame_graph, split_screen_pass);
+		record_split_screen(command_buffer);
+		vkx_frame_graph_end_pass(&frame_graph);
+	}
+	vkx_cmd_end_label(command_buffer);
+
+	// -- Post-processing -----------------------------------------------------
+	if (post_chain.async_compute) {
+		// The compute queue's timestamps aren't reset with the rest, so these
+		// passes aren't timed
+		command_buffer = record_async_compute(command_buffer);
+	}
+	else if (post_chain.passes_count > 0) {
+		vkx_cmd_begin_label(command_buffer, "post");
+		vkx_profiler_begin_scope(&profiler, profile_post);
+		post_chain_record(&post_chain, &frame_graph, command_buffer, current_frame, frame_dynamic_offsets);
+		vkx_profiler_end_scope(&profiler, profile_post);
+		vkx_cmd_end_label(command_buffer);
+		count_draws(post_chain.compute ? 0 : (int) post_chain.passes_count);
+	}
+
+	// -- Render the screen ---------------------------------------------------
+	// (already done by the scene pass when it draws to the swap chain)
+	if (screen_pass != UINT32_MAX) {
+		vkx_cmd_begin_label(command_buffer, "screen");
+		vkx_profiler_begin_scope(&profiler, profile_screen);
+		if (screen_transfer) {
+			// No attachments, so this isn't inside rendering
+			vkx_frame_graph_begin_pass(&frame_graph, screen_pass);
+			record_screen_transfer(command_buffer);
+		}
+		else if (static_command_buffers) {
+			VkxFrameGraphPassInfo pass_info = vkx_frame_graph_get_pass_info(&frame_graph, screen_pass);
+			VkCommandBuffer screen_commands = static_commands.command_buffers[current_frame][STATIC_COMMANDS_SCREEN];
+			if (static_commands_changed(STATIC_COMMANDS_SCREEN, NULL, &pass_info)) {
+				screen_commands = vkx_secondary_commands_begin(&static_commands, current_frame, STATIC_COMMANDS_SCREEN, &pass_info);
+				record_screen(screen_commands);
+				vkx_secondary_commands_end(screen_commands);
+			}
+
+			vkx_frame_graph_begin_secondary_pass(&frame_graph, screen_pass);
+			vkCmdExecuteCommands(command_buffer, 1, &screen_commands);
+		}
+		else {
+			vkx_frame_graph_begin_pass(&frame_graph, screen_pass);
+			record_screen(command_buffer);
+			record_overlays(command_buffer);
+		}
+
+		// --- End dynamic rendering ----------------------------------------------
+		vkx_frame_graph_end_pass(&frame_graph);
+		vkx_profiler_end_scope(&profiler, profile_screen);
+		vkx_cmd_end_label(command_buffer);
+	}
+
+	if (hud_pass != UINT32_MAX) {
+		vkx_frame_graph_begin_pass(&frame_graph, hud_pass);
+		record_overlays(command_buffer);
+		vkx_frame_graph_end_pass(&frame_graph);
+	}
+
+	// Leaves the swap chain image ready to present, or to be captured first
+	vkx_frame_graph_end(&frame_graph);
+
+	vkx_profiler_end_scope(&profiler, profile_frame);
+
+	if (extra_windows_count > 0) {
+		record_extra_windows(command_buffer, image_index);
+	}
+
+	if (capture_enabled) {
+		capture_record(command_buffer, current_frame, vkx_swap_chain.images[image_index], vkx_swap_chain.image_format,
+				vkx_swap_chain.extent, swap_chain_present_state);
+	}
+
+	if (use_sparse_atlas()) {
+		vkx_sparse_atlas_record_feedback_barrier(command_buffer);
+	}
+
+	end_command_buffer(command_buffer);
+}
+
+// Data shared by all of the sprite transform jobs
+typedef struct {
+	SpriteTransform* out;
+	uint32_t anim_params;
+} SpriteTransformJob;
+
+void compute_sprite_transforms_scalar(size_t start, size_t end, void* data) {
+	/*
+	 * Reference implementation - processes one sprite at a time
+	 */
+	SpriteTransformJob* job = data;
+	SpriteTransform* sprite_transforms = job->out;
+	float a = frame_state->interpolation;
+
+	for (size_t i=start; i<end; i++) {
+		sprite_transforms[i].pos[0] = frame_state->prev_x[i] + (frame_state->x[i] - frame_state->prev_x[i]) * a;
+		sprite_transforms[i].pos[1] = frame_state->prev_y[i] + (frame_state->y[i] - frame_state->prev_y[i]) * a;
+		sprite_transforms[i].scale[0] = MONSTER_SIZE;
+		sprite_transforms[i].scale[1] = MONSTER_SIZE;
+		sprite_transforms[i].rotation = 0.0f;
+		sprite_transforms[i].z = monsters.z[i];
+
+		// The bob and pulse are done by the vertex shader
+		sprite_transforms[i].anim_phase = monsters.anim_phase[i];
+		sprite_transforms[i].anim_params = job->anim_params;
+	}
+}
+
+void compute_sprite_transforms_batched(size_t start, size_t end, void* data) {
+	/*
+	 * Batched version of compute_sprite_transforms_scalar().  Each batch
+	 * interpolates the positions in a loop with no branches or calls (so the
+	 * compiler can use SSE/AVX/NEON), then writes the finished transforms
+	 * sequentially into the mapped buffer, reading the positions straight from
+	 * the frame state
+	 */
+	SpriteTransformJob* job = data;
+	SpriteTransform* sprite_transforms = job->out;
+	float a = frame_state->interpolation;
+
+	float pos_x[TRANSFORM_BATCH_SIZE];
+	float pos_y[TRANSFORM_BATCH_SIZE];
+
+	for (size_t batch_start=start; batch_start<end; batch_start+=TRANSFORM_BATCH_SIZE) {
+		size_t n = end - batch_start;
+		if (n > TRANSFORM_BATCH_SIZE) {
+			n = TRANSFORM_BATCH_SIZE;
+		}
+
+		// Compute
+		const float* x = &frame_state->x[batch_start];
+		const float* y = &frame_state->y[batch_start];
+		const float* prev_x = &frame_state->prev_x[batch_start];
+		const float* prev_y = &frame_state->prev_y[batch_start];
+		for (size_t i=0; i<n; i++) {
+			pos_x[i] = prev_x[i] + (x[i] - prev_x[i]) * a;
+			pos_y[i] = prev_y[i] + (y[i] - prev_y[i]) * a;
+		}
+
+		// Scatter.  The bob and pulse are done by the vertex shader
+		const float* z = &monsters.z[batch_start];
+		const float* phase = &monsters.anim_phase[batch_start];
+		for (size_t i=0; i<n; i++) {
+			SpriteTransform* transform = &sprite_transforms[batch_start + i];
+			transform->pos[0] = pos_x[i];
+			transform->pos[1] = pos_y[i];
+			transform->scale[0] = MONSTER_SIZE;
+			transform->scale[1] = MONSTER_SIZE;
+			transform->rotation = 0.0f;
+			transform->z = z[i];
+			transform->anim_phase = phase[i];
+			transform->anim_params = job->anim_params;
+		}
+	}
+}
+
+void update_sprite_transforms(SpriteTransform* out) {
+	/*
+	 * Fill in the transforms for all of the monsters
+	 *
+	 * @param out The array to fill (normally the mapped storage buffer)
+	 */
+	SpriteTransformJob job = {0};
+	job.out = out;
+	job.anim_params = pack_sprite_animation(MONSTER_ANIM_AMPLITUDE, MONSTER_ANIM_FREQUENCY);
+
+	if (threaded_transforms) {
+		jobs_parallel_for(monsters_count, transform_job_size, compute_sprite_transforms_batched, &job);
+	}
+	else {
+		compute_sprite_transforms_scalar(0, monsters_count, &job);
+	}
+}
+
+void run_transform_benchmark(void) {
+	/*
+	 * Compare the original scalar transform loop against the batched path, both
+	 * on a single thread and spread across the worker pool
+	 */
+	SpriteTransform* out = malloc(sizeof(SpriteTransform) * monsters_count);
+	if (out == NULL) {
+		fprintf(stderr, "Failed to allocate transform benchmark buffer\n");
+		exit(1);
+	}
+
+	SpriteTransformJob job = {0};
+	job.out = out;
+	job.anim_params = pack_sprite_animation(MONSTER_ANIM_AMPLITUDE, MONSTER_ANIM_FREQUENCY);
+
+	// Warm up the caches so that the first path isn't penalised
+	compute_sprite_transforms_scalar(0, monsters_count, &job);
+
+	uint64_t start = SDL_GetTicksNS();
+	for (uint32_t i = 0; i < TRANSFORM_BENCHMARK_ITERATIONS; i++) {
+		compute_sprite_transforms_scalar(0, monsters_count, &job);
+	}
+	uint64_t scalar_ns = SDL_GetTicksNS() - start;
+
+	start = SDL_GetTicksNS();
+	for (uint32_t i = 0; i < TRANSFORM_BENCHMARK_ITERATIONS; i++) {
+		compute_sprite_transforms_batched(0, monsters_count, &job);
+	}
+	uint64_t batched_ns = SDL_GetTicksNS() - start;
+
+	start = SDL_GetTicksNS();
+	for (uint32_t i = 0; i < TRANSFORM_BENCHMARK_ITERATIONS; i++) {
+		jobs_parallel_for(monsters_count, transform_job_size, compute_sprite_transforms_batched, &job);
+	}
+	uint64_t threaded_ns = SDL_GetTicksNS() - start;
+
+	// Avoid dividing by zero if the clock is too coarse
+	if (batched_ns == 0) {
+		batched_ns = 1;
+	}
+	if (threaded_ns == 0) {
+		threaded_ns = 1;
+	}
+
+	double per_iteration = 1000000.0 * TRANSFORM_BENCHMARK_ITERATIONS;
+	printf("Transform benchmark (%u sprites, %d iterations):\n", monsters_count, TRANSFORM_BENCHMARK_ITERATIONS);
+	printf("  Scalar:           %f ms\n", scalar_ns / per_iteration);
+	printf("  Batched:          %f ms (%.2fx)\n", batched_ns / per_iteration, (double) scalar_ns / batched_ns);
+	printf("  Batched + %2d jobs: %f ms (%.2fx)\n", jobs_get_num_workers() + 1, threaded_ns / per_iteration, (double) scalar_ns / threaded_ns);
+
+	free(out);
+}
+
+void tune_transform_job_size(void) {
+	/*
+	 * Pick transform_job_size by timing the monsters' transforms on the worker
+	 * pool with each of AUTOTUNE_JOB_SIZES, unless it's already known for this
+	 * device
+	 */
+	uint32_t value;
+	if (autotune_get("transform_job_size", &value)) {
+		transform_job_size = value;
+		return;
+	}
+	if (monsters_count == 0 || !threaded_transforms) {
+		return;
+	}
+
+	SpriteTransform* out = malloc(sizeof(SpriteTransform) * monsters_count);
+	if (out == NULL) {
+		fprintf(stderr, "Failed to allocate the autotune's transforms\n");
+		exit(1);
+	}
+
+	SpriteTransformJob job = {0};
+	job.out = out;
+	job.anim_params = pack_sprite_animation(MONSTER_ANIM_AMPLITUDE, MONSTER_ANIM_FREQUENCY);
+	// Warm up the caches and the workers so that the first size isn't penalised
+	jobs_parallel_for(monsters_count, TRANSFORM_JOB_SIZE, compute_sprite_transforms_batched, &job);
+
+	uint64_t best_ns = UINT64_MAX;
+	for (size_t i = 0; i < sizeof(AUTOTUNE_JOB_SIZES) / sizeof(AUTOTUNE_JOB_SIZES[0]); i++) {
+		uint64_t start = SDL_GetTicksNS();
+		for (uint32_t j = 0; j < AUTOTUNE_JOB_ITERATIONS; j++) {
+			jobs_parallel_for(monsters_count, AUTOTUNE_JOB_SIZES[i], compute_sprite_transforms_batched, &job);
+		}
+		uint64_t ns = SDL_GetTicksNS() - start;
+		if (ns < best_ns) {
+			best_ns = ns;
+			transform_job_size = AUTOTUNE_JOB_SIZES[i];
+		}
+	}
+	free(out);
+
+	autotune_set("transform_job_size", transform_job_size);
+	printf(" Autotuned the transforms' jobs to %u sprites (%f ms for %u)\n", transform_job_size,
+			(double) best_ns / (1e6 * AUTOTUNE_JOB_ITERATIONS), monsters_count);
+}
+
+bool monster_occluded(uint32_t monster) {
+	/*
+	 * Whether a monster is behind the map and every tile in view its sprite
+	 * could cover is opaque.  That's the culling shader's square, which holds
+	 * it at any rotation and however far it bobs and squashes, from where it
+	 * was in the snapshot to where it is
+	 */
+	if (occlusion_mask.width == 0 || monsters.z[monster] <= TILE_MAP_Z) {
+		return false;
+	}
+
+	const float radius = MONSTER_SIZE * 0.70710678f * (1.0f + SPRITE_ANIM_MAX_AMPLITUDE * 0.75f) + SPRITE_ANIM_MAX_AMPLITUDE;
+	float x = frame_state->x[monster];
+	float y = frame_state->y[monster];
+	float prev_x = frame_state->prev_x[monster];
+	float prev_y = frame_state->prev_y[monster];
+	int64_t x0 = (int64_t) floorf(fminf(x, prev_x) - radius) - occlusion_origin[0];
+	int64_t y0 = (int64_t) floorf(fminf(y, prev_y) - radius) - occlusion_origin[1];
+	int64_t x1 = (int64_t) floorf(fmaxf(x, prev_x) + radius) - occlusion_origin[0];
+	int64_t y1 = (int64_t) floorf(fmaxf(y, prev_y) + radius) - occlusion_origin[1];
+
+	for (int64_t tile_y = y0; tile_y <= y1; tile_y++) {
+		for (int64_t tile_x = x0; tile_x <= x1; tile_x++) {
+			if (!tile_solidity_is_solid(&occlusion_mask, tile_x, tile_y)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+void build_occlusion_mask(void) {
+	/*
+	 * Mark which of the map's tiles in view are opaque in occlusion_mask, for
+	 * cull_monsters() and the culling shader.  With the sparse store each
+	 * chunk is looked up once, and the ones it doesn't have are all empty
+	 */
+	float rect[4];
+	get_views_visible_rect(frame_state->cameras, 1.0f, rect);
+	occlusion_origin[0] = (int32_t) floorf(rect[0]);
+	occlusion_origin[1] = (int32_t) floorf(rect[1]);
+	int32_t width = (int32_t) ceilf(rect[2]) - occlusion_origin[0];
+	int32_t height = (int32_t) ceilf(rect[3]) - occlusion_origin[1];
+
+	// Too big, so nothing is culled
+	occlusion_mask.bits = occlusion_mask_bits;
+	if (width <= 0 || height <= 0 || width > OCCLUSION_MASK_MAX_TILES || height > OCCLUSION_MASK_MAX_TILES) {
+		occlusion_mask.width = 0;
+		occlusion_mask.height = 0;
+		occlusion_mask.words_per_row = 0;
+		return;
+	}
+	occlusion_mask.width = (uint32_t) width;
+	occlusion_mask.height = (uint32_t) height;
+	occlusion_mask.words_per_row = (occlusion_mask.width + 63) / 64;
+	memset(occlusion_mask_bits, 0, sizeof(uint64_t) * occlusion_mask.words_per_row * occlusion_mask.height);
+
+	// The part of it on the map, everything off it is empty
+	int32_t x0 = occlusion_origin[0] > 0 ? occlusion_origin[0] : 0;
+	int32_t y0 = occlusion_origin[1] > 0 ? occlusion_origin[1] : 0;
+	int32_t x1 = occlusion_origin[0] + width < (int32_t) map_x_tiles ? occlusion_origin[0] + width : (int32_t) map_x_tiles;
+	int32_t y1 = occlusion_origin[1] + height < (int32_t) map_y_tiles ? occlusion_origin[1] + height : (int32_t) map_y_tiles;
+
+	if (!use_sparse_tiles()) {
+		for (int32_t y = y0; y < y1; y++) {
+			for (int32_t x = x0; x < x1; x++) {
+				if (opaque_tiles[tiles[get_tile_index((size_t) x, (size_t) y)]]) {
+					tile_solidity_set(&occlusion_mask, (uint32_t) (x - occlusion_origin[0]), (uint32_t) (y - occlusion_origin[1]), true);
+				}
+			}
+		}
+		return;
+	}
+
+	const int32_t size = TILE_STORE_CHUNK_SIZE;
+	for (int32_t chunk_y = y0 / size; chunk_y * size < y1; chunk_y++) {
+		for (int32_t chunk_x = x0 / size; chunk_x * size < x1; chunk_x++) {
+			const TileStoreChunk* chunk = tile_store_find_chunk(&tile_store, chunk_x, chunk_y);
+			if (chunk == NULL) {
+				continue;
+			}
+
+			int32_t chunk_x0 = x0 > chunk_x * size ? x0 : chunk_x * size;
+			int32_t chunk_y0 = y0 > chunk_y * size ? y0 : chunk_y * size;
+			int32_t chunk_x1 = x1 < (chunk_x + 1) * size ? x1 : (chunk_x + 1) * size;
+			int32_t chunk_y1 = y1 < (chunk_y + 1) * size ? y1 : (chunk_y + 1) * size;
+			for (int32_t y = chunk_y0; y < chunk_y1; y++) {
+				const uint16_t* row = &chunk->tiles[(y - chunk_y * size) * size];
+				for (int32_t x = chunk_x0; x < chunk_x1; x++) {
+					uint16_t tile = row[x - chunk_x * size];
+					if (tile <= TILESET_TOTAL_TILES && opaque_tiles[tile]) {
+						tile_solidity_set(&occlusion_mask, (uint32_t) (x - occlusion_origin[0]), (uint32_t) (y - occlusion_origin[1]), true);
+					}
+				}
+			}
+		}
+	}
+}
+
+void cull_monsters(void) {
+	/*
+	 * Work out which monsters could be in any of the views this frame, from
+	 * where they are in the snapshot, for monster_in_view().  Each batch of
+	 * positions goes through the view's affine into view units in one loop,
+	 * then is compared with the view in another, so both vectorise.  Leaves a
+	 * monster's size of room for the bob, squash and rotation the vertex
+	 * shader adds.  With occlusion_culling, the ones in view which are hidden
+	 * by the map are then left out too
+	 */
+	float view_x[TRANSFORM_BATCH_SIZE];
+	float view_y[TRANSFORM_BATCH_SIZE];
+
+	memset(monsters_in_view, 0, sizeof(bool) * monsters_count);
+	for (uint32_t view = 0; view < split_screen_views; view++) {
+		const Camera* camera = &frame_state->cameras[view];
+		float margin = MONSTER_SIZE * camera->zoom;
+		float max_x = camera->view_size[0] + margin;
+		float max_y = camera->view_size[1] + margin;
+
+		for (uint32_t start = 0; start < monsters_count; start += TRANSFORM_BATCH_SIZE) {
+			uint32_t n = monsters_count - start;
+			if (n > TRANSFORM_BATCH_SIZE) {
+				n = TRANSFORM_BATCH_SIZE;
+			}
+			affine2_transform_points(&camera->view_2d, &frame_state->x[start], &frame_state->y[start], view_x, view_y, n);
+			bool* in_view = &monsters_in_view[start];
+			for (uint32_t i = 0; i < n; i++) {
+				in_view[i] |= view_x[i] >= -margin && view_x[i] <= max_x
+					&& view_y[i] >= -margin && view_y[i] <= max_y;
+			}
+		}
+	}
+
+	// The ones behind the map's opaque tiles can't be seen either
+	for (uint32_t i = 0; occlusion_mask.width > 0 && i < monsters_count; i++) {
+		if (monsters_in_view[i] && monster_occluded(i)) {
+			monsters_in_view[i] = false;
+		}
+	}
+}
+
+bool monster_in_view(uint32_t monster) {
+	/*
+	 * Check whether a monster could be in any of the views this frame.  Off
+	 * screen ones are all drawn when they move on the GPU, so they aren't
+	 * culled
+	 */
+	return gpu_sprite_simulation || monsters_in_view[monster];
+}
+
+void mark_used_textures(void) {
+	/*
+	 * Tell the residency manager which textures this frame draws with: the
+	 * monsters' in view (or about to be) and the ones sprite_draw() drew with.
+	 * When the monsters move on the GPU they could be anywhere, so that's all
+	 * of theirs
+	 */
+	float ahead[4];
+	camera_lookahead_rect(&frame_state->cameras[0], TEXTURE_LOOKAHEAD, ahead);
+
+	vkx_residency_use(texture_residency_handles[TEX_TILES]);
+	for (uint32_t i = 0; i < monsters_count; i++) {
+		float x = frame_state->x[i];
+		float y = frame_state->y[i];
+		bool coming = x + MONSTER_SIZE >= ahead[0] && x - MONSTER_SIZE <= ahead[2]
+			&& y + MONSTER_SIZE >= ahead[1] && y - MONSTER_SIZE <= ahead[3];
+		if (gpu_sprite_simulation || coming || monster_in_view(i)) {
+			vkx_residency_use(texture_residency_handles[monsters.texture[i]]);
+		}
+	}
+
+	const SpriteBatch* batch = &frame_state->sprites;
+	for (uint32_t chunk = 0; chunk < batch->chunks_count; chunk++) {
+		for (uint32_t i = 0; i < batch->chunk_counts[chunk].count; i++) {
+			uint32_t texture = batch->items[chunk * SPRITE_BATCH_CHUNK + i].texture;
+			if (texture < _TEX_COUNT) {
+				vkx_residency_use(texture_residency_handles[texture]);
+			}
+		}
+	}
+}
+
+uint32_t get_scene_layer(float z) {
+	/*
+	 * The render queue layer of a sprite at z.  With the depth buffer they're
+	 * all in the one layer, which the depth test sorts out, apart from the
+	 * background ones with variable_rate_shading, which are drawn at 2x2 (or
+	 * with half_res_background, in their own pass)
+	 */
+	if (use_background_layer() && z >= BACKGROUND_SPRITE_Z) {
+		return SCENE_LAYER_BACKGROUND;
+	}
+	if (depth_buffer || z > TILE_MAP_Z) {
+		return SCENE_LAYER_BEHIND_MAP;
+	}
+	return SCENE_LAYER_FRONT;
+}
+
+VkDeviceSize write_batch_draws(const RenderQueue* queue) {
+	/*
+	 * Write a queue's batches' draws into the frame ring for
+	 * record_sprite_batches(), with the quads of each from its first sorted
+	 * sprite
+	 *
+	 * @return Where they are, or 0 without indirect_sprite_batches
+	 */
+	if (!indirect_sprite_batches || queue->batches_count == 0) {
+		return 0;
+	}
+
+	VkxRingAllocation allocation = vkx_ring_buffer_alloc(&frame_ring, sizeof(VkDrawIndirectCommand) * queue->batches_count);
+	VkDrawIndirectCommand* draws = allocation.data;
+	for (uint32_t i = 0; i < queue->batches_count; i++) {
+		const RenderQueueBatch* batch = &queue->batches[i];
+		VkDrawIndirectCommand draw = {0};
+		if (instanced_sprites) {
+			draw.vertexCount = 6;
+			draw.instanceCount = batch->count;
+			draw.firstInstance = batch->first;
+		}
+		else {
+			draw.vertexCount = batch->count * 6;
+			draw.instanceCount = 1;
+			draw.firstVertex = batch->first * 6;
+		}
+		draws[i] = draw;
+	}
+	return allocation.offset;
+}
+
+void queue_sprites(void) {
+	/*
+	 * Sort the sprites for this frame and write their records into the frame
+	 * ring in draw order.  The records carry their sprite index, so the shader
+	 * still finds the right transform after they have been shuffled
+	 */
+	const size_t vertices_per_sprite = instanced_sprites ? 1 : 6;
+
+	render_queue_clear(&sprite_queue);
+
+	for (uint32_t i = 0; i < monsters_count; i++) {
+		// The ones off screen aren't queued, unless they move on the GPU
+		if (!gpu_sprite_simulation && !monster_in_view(i)) {
+			continue;
+		}
+
+		// Opaque and alpha tested sprites are drawn front to back so the depth test rejects
+		// as much as possible, blended ones have to go back to front
+		uint32_t texture = vertex_sprites[i * vertices_per_sprite].texture_index & SPRITE_TEXTURE_MASK;
+		uint32_t layer = get_scene_layer(monsters.z[i]);
+		uint64_t key;
+		if (monsters.pipeline[i] == SPRITE_PIPELINE_TRANSLUCENT) {
+			key = render_queue_translucent_key(layer, SPRITE_PIPELINE_TRANSLUCENT, texture, monsters.z[i]);
+		}
+		else {
+			key = render_queue_opaque_key(layer, monsters.pipeline[i], texture, monsters.z[i]);
+		}
+		render_queue_push(&sprite_queue, key, i);
+	}
+
+	if (coherent_sprite_sort) {
+		render_queue_sort_coherent(&sprite_queue);
+	}
+	else {
+		render_queue_sort(&sprite_queue);
+	}
+	render_queue_build_batches(&sprite_queue);
+
+	VkDeviceSize records_size = sizeof(VertexBufferSprite) * vertex_sprites_count;
+	VkxRingAllocation records_allocation = vkx_ring_buffer_alloc(&frame_ring, records_size);
+	VertexBufferSprite* records = records_allocation.data;
+
+	for (uint32_t i = 0; i < sprite_queue.count; i++) {
+		uint32_t sprite = sprite_queue.values[i];
+		memcpy(
+			&records[i * vertices_per_sprite],
+			&vertex_sprites[sprite * vertices_per_sprite],
+			sizeof(VertexBufferSprite) * vertices_per_sprite
+		);
+	}
+
+	sprite_records_offset = records_allocation.offset;
+	sprite_draws_offset = write_batch_draws(&sprite_queue);
+}
+
+VertexBufferSprite make_shape_record(const SpriteBatchItem* item, uint32_t sprite_index) {
+	/*
+	 * Pack a shape_draw() shape for shape.vert, which reads its style from
+	 * where a sprite's texture coordinates and flipbook are.  The sizes go as
+	 * fractions of half the shorter side, which is as big as they can be
+	 */
+	VertexBufferSprite record = {0};
+	for (size_t k = 0; k < 4; k++) {
+		record.color[k] = (uint8_t) (item->color >> (k * 8));
+	}
+
+	float unit = fminf(fabsf(item->size[0]), fabsf(item->size[1])) * 0.5f;
+	float scale = unit > 0.0f ? 1.0f / unit : 0.0f;
+	record.uv[0] = VERTEX_PACK(SPRITE_UV_PACKING, glm_clamp(item->uv[0] * scale, 0.0f, 1.0f));
+	record.uv[1] = VERTEX_PACK(SPRITE_UV_PACKING, glm_clamp(item->uv[1] * scale, 0.0f, 1.0f));
+	record.uv2[0] = VERTEX_PACK(SPRITE_UV_PACKING, glm_clamp(item->uv2[0] * scale, 0.0f, 1.0f));
+	record.texture_index = (uint16_t) (item->texture & ~SPRITE_BATCH_SHAPE);
+	record.flipbook = item->outline_color;
+	record.sprite_index = sprite_index;
+
+	return record;
+}
+
+// Data shared by the jobs writing out the batched sprites
+typedef struct {
+	const SpriteBatch* batch;
+	SpriteTransform* transforms;
+	VertexBufferSprite* records;
+} BatchedSpritesJob;
+
+void write_batched_sprites(size_t start, size_t end, void* data) {
+	/*
+	 * Write the transforms and records of the sorted batched sprites [start,
+	 * end)
+	 */
+	BatchedSpritesJob* job = data;
+	const size_t vertices_per_sprite = instanced_sprites ? 1 : 6;
+
+	for (size_t i = start; i < end; i++) {
+		const SpriteBatchItem* item = &job->batch->items[batched_sprite_queue.values[i]];
+
+		SpriteTransform* transform = &job->transforms[i];
+		glm_vec2_copy((float*) item->pos, transform->pos);
+		glm_vec2_copy((float*) item->size, transform->scale);
+		transform->rotation = item->rotation;
+		transform->z = item->z;
+		transform->anim_phase = 0.0f;
+		transform->anim_params = 0;
+
+		VertexBufferSprite record = (item->texture & SPRITE_BATCH_SHAPE) != 0
+			? make_shape_record(item, (uint32_t) i)
+			: make_sprite_record(item->texture, item->uv, item->uv2, item->color, (uint32_t) i);
+		for (size_t j = 0; j < vertices_per_sprite; j++) {
+			job->records[i * vertices_per_sprite + j] = record;
+		}
+	}
+}
+
+void queue_batched_sprites(void) {
+	/*
+	 * Sort the frame's sprites from sprite_draw() into batches like the
+	 * monsters, and write their transforms and records into the frame ring in
+	 * draw order, on the worker pool
+	 */
+	const SpriteBatch* batch = &frame_state->sprites;
+	const size_t vertices_per_sprite = instanced_sprites ? 1 : 6;
+
+	render_queue_clear(&batched_sprite_queue);
+	batched_sprite_queue.batches_count = 0;
+	if (batch->count == 0) {
+		return;
+	}
+
+	if (cull_batched_sprites) {
+		float rect[4];
+		get_views_visible_rect(frame_state->cameras, 1.0f, rect);
+		sprite_batch_cull(batch, rect, batched_sprites_visible);
+	}
+
+	for (uint32_t chunk = 0; chunk < batch->chunks_count; chunk++) {
+		for (uint32_t i = 0; i < batch->chunk_counts[chunk].count; i++) {
+			uint32_t index = chunk * SPRITE_BATCH_CHUNK + i;
+			if (cull_batched_sprites && !batched_sprites_visible[index]) {
+				continue;
+			}
+			const SpriteBatchItem* item = &batch->items[index];
+			uint32_t layer = get_scene_layer(item->z);
+			// Shapes all go in one batch at a depth, drawn in the order they
+			// were drawn in as the sort keeps it
+			if ((item->texture & SPRITE_BATCH_SHAPE) != 0) {
+				uint64_t key = render_queue_translucent_key(layer, SHAPE_PIPELINE_ID, 0, item->z);
+				render_queue_push(&batched_sprite_queue, key, index);
+				continue;
+			}
+			if (item->texture >= _TEX_COUNT) {
+				continue;
+			}
+
+			// Anything see through is blended, the rest alpha tested like the
+			// sprites which aren't classified.  Without the depth buffer it's
+			// all blended back to front
+			uint64_t key;
+			if ((item->color >> 24) < 255 || !depth_buffer) {
+				key = render_queue_translucent_key(layer, SPRITE_PIPELINE_TRANSLUCENT, item->texture, item->z);
+			}
+			else {
+				key = render_queue_opaque_key(layer, SPRITE_PIPELINE_CUTOUT, item->texture, item->z);
+			}
+			render_queue_push(&batched_sprite_queue, key, index);
+		}
+	}
+
+	render_queue_sort(&batched_sprite_queue);
+	render_queue_build_batches(&batched_sprite_queue);
+
+	uint32_t count = batched_sprite_queue.count;
+	VkxRingAllocation transforms_allocation = vkx_ring_buffer_alloc(&frame_ring, sizeof(SpriteTransform) * count);
+	VkxRingAllocation records_allocation = vkx_ring_buffer_alloc(&frame_ring, sizeof(VertexBufferSprite) * count * vertices_per_sprite);
+
+	BatchedSpritesJob job = {0};
+	job.batch = batch;
+	job.transforms = transforms_allocation.data;
+	job.records = records_allocation.data;
+	jobs_parallel_for(count, transform_job_size, write_batched_sprites, &job);
+
+	batched_sprite_dynamic_offsets[0] = frame_dynamic_offsets[0];
+	batched_sprite_dynamic_offsets[1] = (uint32_t) transforms_allocation.offset;
+	batched_sprite_records_offset = records_allocation.offset;
+	batched_sprite_draws_offset = write_batch_draws(&batched_sprite_queue);
+}
+
+void stage_particle_emitters(void) {
+	/*
+	 * Write the particle emitters into the frame ring for the emit shader
+	 */
+	particle_dynamic_offsets[0] = frame_dynamic_offsets[0];
+	particle_dynamic_offsets[1] = 0;
+
+	VkxRingAllocation allocation = vkx_ring_buffer_alloc(&frame_ring, sizeof(ParticleEmitter) * MAX_PARTICLE_EMITTERS);
+	memcpy(allocation.data, frame_state->particle_emitters, sizeof(ParticleEmitter) * frame_state->particle_emitters_count);
+	particle_emitters_offset = (uint32_t) allocation.offset;
+}
+
+void stage_lights(void) {
+	/*
+	 * Write the lights (and the changed rows of the occluders) into the frame
+	 * ring, for record_light_culling() to copy to their buffers
+	 */
+	VkxRingAllocation allocation = vkx_ring_buffer_alloc(&frame_ring, sizeof(Light) * MAX_LIGHTS);
+	memcpy(allocation.data, frame_state->lights, sizeof(Light) * frame_state->lights_count);
+	lights_offset = allocation.offset;
+
+	if (light_shadows && frame_state->occluder_rows_count > 0) {
+		size_t rows_size = sizeof(uint64_t) * tile_solidity.words_per_row * frame_state->occluder_rows_count;
+		VkxRingAllocation rows_allocation = vkx_ring_buffer_alloc(&frame_ring, rows_size);
+		memcpy(rows_allocation.data, frame_state->occluder_words, rows_size);
+		occluder_rows_offset = rows_allocation.offset;
+	}
+}
+
+typedef struct {
+	Affine2* palettes;
+	double t;
+} SkinnedCharactersJob;
+
+void get_skinned_character_placement(uint32_t i, double time, Affine2* placement) {
+	/*
+	 * Where one of the demo's skinned characters is at a time, from its feet,
+	 * walking right and back round the map
+	 */
+	const SkinnedCharacter* character = &skinned_characters[i];
+	const float translation[2] = {
+		fmodf(character->x + SKINNED_CHARACTER_SPEED * (float) time, (float) map_x_tiles),
+		character->y
+	};
+	const float scale[2] = {MONSTER_SIZE, MONSTER_SIZE};
+	affine2_make(placement, translation, 0.0f, scale);
+}
+
+void pose_skinned_characters(size_t start, size_t end, void* data) {
+	/*
+	 * Sample the walk for some of the characters in view, from the worker pool
+	 */
+	SkinnedCharactersJob* job = data;
+	for (size_t i = start; i < end; i++) {
+		uint32_t character = skinned_visible[i];
+		Affine2 placement;
+		get_skinned_character_placement(character, job->t, &placement);
+		skeleton_sample(&demo_skeleton, &demo_walk_clip, (float) job->t + skinned_characters[character].phase, &placement,
+				&job->palettes[i * demo_skeleton.bones_count]);
+	}
+}
+
+void stage_skinned_characters(void) {
+	/*
+	 * Pose the skinned characters in any view into the frame ring, a palette
+	 * each in the order they're instanced in
+	 */
+	skinned_instances_count = 0;
+	for (uint32_t i = 0; i < DEMO_SKINNED_CHARACTERS; i++) {
+		Affine2 placement;
+		get_skinned_character_placement(i, frame_state->t, &placement);
+		// The model is a unit square above its feet, with the arms' swing
+		const float rect[4] = {
+			placement.tx - MONSTER_SIZE, placement.ty - MONSTER_SIZE * 1.5f,
+			placement.tx + MONSTER_SIZE, placement.ty + MONSTER_SIZE * 0.5f
+		};
+		for (uint32_t view = 0; view < split_screen_views; view++) {
+			if (camera_is_visible(&frame_state->cameras[view], rect)) {
+				skinned_visible[skinned_instances_count++] = i;
+				break;
+			}
+		}
+	}
+	if (skinned_instances_count == 0) {
+		return;
+	}
+
+	VkxRingAllocation allocation = vkx_ring_buffer_alloc(&frame_ring, sizeof(Affine2) * demo_skeleton.bones_count * skinned_instances_count);
+	SkinnedCharactersJob job = {allocation.data, frame_state->t};
+	jobs_parallel_for(skinned_instances_count, SKINNED_JOB_SIZE, pose_skinned_characters, &job);
+
+	skinned_dynamic_offsets[0] = frame_dynamic_offsets[0];
+	skinned_dynamic_offsets[1] = (uint32_t) allocation.offset;
+}
+
+void stage_retained_sprites(void) {
+	/*
+	 * Write the retained sprites which changed into the frame ring and set up
+	 * their copies for record_retained_sprite_copies()
+	 */
+	retained_sprite_dynamic_offsets[0] = frame_dynamic_offsets[0];
+	retained_sprite_dynamic_offsets[1] = 0;
+
+	retained_copies_count = 0;
+	uint32_t changed = frame_state->retained_changed_count;
+	if (changed == 0) {
+		return;
+	}
+
+	const size_t vertices_per_sprite = instanced_sprites ? 1 : 6;
+	const VkDeviceSize record_size = sizeof(VertexBufferSprite) * vertices_per_sprite;
+	VkxRingAllocation transforms_allocation = vkx_ring_buffer_alloc(&frame_ring, sizeof(SpriteTransform) * changed);
+	VkxRingAllocation records_allocation = vkx_ring_buffer_alloc(&frame_ring, record_size * changed);
+	memcpy(transforms_allocation.data, frame_state->retained_transforms, sizeof(SpriteTransform) * changed);
+	memcpy(records_allocation.data, frame_state->retained_records, record_size * changed);
+
+	uint32_t staged = 0;
+	for (uint32_t i = 0; i < frame_state->retained_ranges_count; i++) {
+		const SpritePoolRange* range = &frame_state->retained_ranges[i];
+
+		retained_transform_copies[i].srcOffset = transforms_allocation.offset + sizeof(SpriteTransform) * staged;
+		retained_transform_copies[i].dstOffset = sizeof(SpriteTransform) * range->first;
+		retained_transform_copies[i].size = sizeof(SpriteTransform) * range->count;
+
+		retained_record_copies[i].srcOffset = records_allocation.offset + record_size * staged;
+		retained_record_copies[i].dstOffset = record_size * range->first;
+		retained_record_copies[i].size = record_size * range->count;
+
+		staged += range->count;
+	}
+	retained_copies_count = frame_state->retained_ranges_count;
+}
+
+void stage_shading_rate_mask(void) {
+	/*
+	 * Write this frame's shading rate mask into the frame ring for
+	 * record_shading_rate_mask().  It's all 2x2 apart from under the tiles in
+	 * view which aren't low detail, which are shaded at every pixel.  Only the
+	 * map is drawn at the mask's rate, the rest set their own
+	 */
+	VkExtent2D mask_extent = get_shading_rate_mask_extent();
+	size_t mask_size = (size_t) mask_extent.width * mask_extent.height;
+	VkxRingAllocation allocation = vkx_ring_buffer_alloc(&frame_ring, mask_size);
+	uint8_t* mask = allocation.data;
+	memset(mask, SHADING_RATE_COARSE, mask_size);
+	shading_rate_mask_offset = allocation.offset;
+
+	// The camera is orthographic and lined up with the map, so a world
+	// position's pixel is a scale and an offset, which two corners give
+	Camera* camera = &frame_state->cameras[0];
+	VkExtent2D extent = get_render_extent();
+	vec4 corners[2] = {{0.0f, 0.0f, 0.0f, 1.0f}, {1.0f, 1.0f, 0.0f, 1.0f}};
+	vec2 pixels[2];
+	for (int i = 0; i < 2; i++) {
+		vec4 clip;
+		glm_mat4_mulv(camera->view_projection, corners[i], clip);
+		pixels[i][0] = (clip[0] / clip[3] * 0.5f + 0.5f) * (float) extent.width;
+		pixels[i][1] = (clip[1] / clip[3] * 0.5f + 0.5f) * (float) extent.height;
+	}
+	// Per tile, in texels of the mask
+	float scale_x = (pixels[1][0] - pixels[0][0]) / (float) shading_rate_texel_size.width;
+	float scale_y = (pixels[1][1] - pixels[0][1]) / (float) shading_rate_texel_size.height;
+	float offset_x = pixels[0][0] / (float) shading_rate_texel_size.width;
+	float offset_y = pixels[0][1] / (float) shading_rate_texel_size.height;
+
+	uint32_t min_x = (uint32_t) glm_clamp(floorf(camera->visible[0]), 0.0f, (float) map_x_tiles);
+	uint32_t min_y = (uint32_t) glm_clamp(floorf(camera->visible[1]), 0.0f, (float) map_y_tiles);
+	uint32_t max_x = (uint32_t) glm_clamp(ceilf(camera->visible[2]), 0.0f, (float) map_x_tiles);
+	uint32_t max_y = (uint32_t) glm_clamp(ceilf(camera->visible[3]), 0.0f, (float) map_y_tiles);
+
+	for (uint32_t y = min_y; y < max_y; y++) {
+		for (uint32_t x = min_x; x < max_x; x++) {
+			if (low_detail_tiles[tiles[get_tile_index(x, y)]]) {
+				continue;
+			}
+
+			// Every texel the tile touches, either way round
+			float x0 = offset_x + scale_x * (float) x;
+			float x1 = x0 + scale_x;
+			float y0 = offset_y + scale_y * (float) y;
+			float y1 = y0 + scale_y;
+			uint32_t texel_x0 = (uint32_t) glm_clamp(floorf(fminf(x0, x1)), 0.0f, (float) mask_extent.width);
+			uint32_t texel_x1 = (uint32_t) glm_clamp(ceilf(fmaxf(x0, x1)), 0.0f, (float) mask_extent.width);
+			uint32_t texel_y0 = (uint32_t) glm_clamp(floorf(fminf(y0, y1)), 0.0f, (float) mask_extent.height);
+			uint32_t texel_y1 = (uint32_t) glm_clamp(ceilf(fmaxf(y0, y1)), 0.0f, (float) mask_extent.height);
+			for (uint32_t texel_y = texel_y0; texel_y < texel_y1 && texel_x1 > texel_x0; texel_y++) {
+				memset(&mask[(size_t) texel_y * mask_extent.width + texel_x0], 0, texel_x1 - texel_x0);
+			}
+		}
+	}
+}
+
+void stage_chunk_impostors(void) {
+	/*
+	 * Write the vertices of the chunks tilemap_update_impostors() picked to
+	 * render the impostors of into the frame ring, with uniforms of their own,
+	 * and the quads of all the impostors to draw.  Each is allocated at its
+	 * most, so the allocations after them don't move
+	 */
+	// Like the tile layer caches', these leave the view where the push
+	// constants put it and the animated tiles at their first frames
+	VkxRingAllocation ubo_allocation = vkx_ring_buffer_alloc(&frame_ring, sizeof(UniformBufferObject));
+	UniformBufferObject* ubo = ubo_allocation.data;
+	memset(ubo, 0, sizeof(*ubo));
+	for (uint32_t slot = 0; slot < VIEW_SLOTS; slot++) {
+		mat4 identity = GLM_MAT4_IDENTITY_INIT;
+		memcpy(ubo->late_latch[slot], identity, sizeof(identity));
+	}
+	chunk_impostor_ubo_offset = (uint32_t) ubo_allocation.offset;
+
+	chunk_impostor_renders_count = tilemap.impostor_renders_count;
+	for (uint32_t i = 0; i < chunk_impostor_renders_count; i++) {
+		const TilemapImpostor* impostor = &tilemap.impostor_renders[i];
+		VkxRingAllocation allocation = vkx_ring_buffer_alloc(&frame_ring, sizeof(TileVertex) * 4 * TILEMAP_CHUNK_SIZE * TILEMAP_CHUNK_SIZE);
+
+		ChunkImpostorRender* render = &chunk_impostor_renders[i];
+		render->vertices_offset = allocation.offset;
+		render->vertices_count = tilemap_write_chunk_vertices(&tilemap, impostor->chunk, allocation.data);
+		render->chunk = impostor->chunk;
+		render->slot = impostor->slot;
+	}
+
+	VkxRingAllocation quads_allocation = vkx_ring_buffer_alloc(&frame_ring, sizeof(Vertex) * 4 * CHUNK_IMPOSTOR_SLOTS);
+	Vertex* quads = quads_allocation.data;
+	chunk_impostor_quads_offset = quads_allocation.offset;
+	chunk_impostor_quads_count = tilemap.visible_impostors_count;
+
+	const float slot_uv = (float) CHUNK_IMPOSTOR_SLOT_PIXELS / (float) CHUNK_IMPOSTOR_ATLAS_SIZE;
+	const float half_texel = 0.5f / (float) CHUNK_IMPOSTOR_ATLAS_SIZE;
+	for (uint32_t i = 0; i < chunk_impostor_quads_count; i++) {
+		const TilemapImpostor* impostor = &tilemap.visible_impostors[i];
+		float x0 = (float) (impostor->chunk % tilemap.chunks_x * TILEMAP_CHUNK_SIZE);
+		float y0 = (float) (impostor->chunk / tilemap.chunks_x * TILEMAP_CHUNK_SIZE);
+		float x1 = x0 + (float) TILEMAP_CHUNK_SIZE;
+		float y1 = y0 + (float) TILEMAP_CHUNK_SIZE;
+		float u0 = (float) (impostor->slot % CHUNK_IMPOSTOR_SLOTS_X) * slot_uv + half_texel;
+		float v0 = (float) (impostor->slot / CHUNK_IMPOSTOR_SLOTS_X) * slot_uv + half_texel;
+		float u1 = u0 + slot_uv - 2.0f * half_texel;
+		float v1 = v0 + slot_uv - 2.0f * half_texel;
+
+		// The same way up as the tile layers' unit quad
+		Vertex* quad = &quads[i * 4];
+		quad[0] = (Vertex) {{x0, y0, 0.0f}, {u0, v1}};
+		quad[1] = (Vertex) {{x1, y0, 0.0f}, {u1, v1}};
+		quad[2] = (Vertex) {{x1, y1, 0.0f}, {u1, v0}};
+		quad[3] = (Vertex) {{x0, y1, 0.0f}, {u0, v0}};
+	}
+}
+
+void stage_tile_edits(void) {
+	/*
+	 * Write the new data for the changed tiles into the frame ring and set up the
+	 * copies for record_tile_edits().  That's the new tile values for the tile
+	 * index image, or otherwise the tiles' slots in the vertex buffer
+	 */
+	tile_edits_staged = tile_edits_count < MAX_TILE_EDITS_PER_FRAME ? tile_edits_count : MAX_TILE_EDITS_PER_FRAME;
+	if (tile_edits_staged == 0) {
+		return;
+	}
+
+	// Each tile covers a unit square of the world from its coordinates
+	for (uint32_t i = 0; partial_redraw && i < tile_edits_staged; i++) {
+		const float rect[4] = {
+			(float) tile_edits[i].x,
+			(float) tile_edits[i].y,
+			(float) tile_edits[i].x + 1.0f,
+			(float) tile_edits[i].y + 1.0f
+		};
+		damage_add_rect(&frame_damage, rect);
+	}
+
+	if (tile_texture_tilemap) {
+		VkxRingAllocation allocation = vkx_ring_buffer_alloc(&frame_ring, sizeof(tiles[0]) * tile_edits_staged);
+		uint8_t* values = allocation.data;
+
+		for (uint32_t i = 0; i < tile_edits_staged; i++) {
+			const TileEdit* tile_edit = &tile_edits[i];
+			values[i] = tiles[get_tile_index(tile_edit->x, tile_edit->y)];
+
+			VkBufferImageCopy* region = &tile_image_copies[i];
+			*region = (VkBufferImageCopy) {0};
+			region->bufferOffset = allocation.offset + i;
+			region->imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region->imageSubresource.mipLevel = 0;
+			region->imageSubresource.baseArrayLayer = 0;
+			region->imageSubresource.layerCount = 1;
+			region->imageOffset.x = (int32_t) tile_edit->x;
+			region->imageOffset.y = (int32_t) tile_edit->y;
+			region->imageExtent.width = 1;
+			region->imageExtent.height = 1;
+			region->imageExtent.depth = 1;
+		}
+	}
+	else {
+		const VkDeviceSize tile_vertices_size = sizeof(TileVertex) * 4;
+		VkxRingAllocation allocation = vkx_ring_buffer_alloc(&frame_ring, tile_vertices_size * tile_edits_staged);
+		TileVertex* tile_vertices = allocation.data;
+
+		for (uint32_t i = 0; i < tile_edits_staged; i++) {
+			const TileEdit* tile_edit = &tile_edits[i];
+			size_t idx = get_tile_index(tile_edit->x, tile_edit->y);
+
+			write_tile_vertices(tile_edit->x, tile_edit->y, &tile_vertices[4 * i]);
+
+			tile_vertex_copies[i].srcOffset = allocation.offset + tile_vertices_size * i;
+			tile_vertex_copies[i].dstOffset = tile_vertices_size * idx;
+			tile_vertex_copies[i].size = tile_vertices_size;
+		}
+	}
+
+	// Anything left over goes next frame
+	tile_edits_count -= tile_edits_staged;
+	memmove(tile_edits, tile_edits + tile_edits_staged, sizeof(TileEdit) * tile_edits_count);
+}
+
+void add_batched_sprite_damage(void) {
+	/*
+	 * Add the sprite_draw() sprites to the frame's damage if any of them
+	 * changed, as where they all were and are.  They're drawn again every frame
+	 * by however many threads, so they're compared as a set
+	 */
+	const SpriteBatch* batch = &frame_state->sprites;
+	uint64_t hash = 0;
+	Damage rect = {0};
+	for (uint32_t chunk = 0; chunk < batch->chunks_count; chunk++) {
+		for (uint32_t i = 0; i < batch->chunk_counts[chunk].count; i++) {
+			const SpriteBatchItem* item = &batch->items[chunk * SPRITE_BATCH_CHUNK + i];
+			hash += damage_hash(item, sizeof(SpriteBatchItem));
+			// A shape's softness goes outside it
+			float extent = fmaxf(fabsf(item->size[0]), fabsf(item->size[1]));
+			if ((item->texture & SPRITE_BATCH_SHAPE) != 0) {
+				extent += item->uv2[0] * 2.0f;
+			}
+			damage_add_sprite(&rect, item->pos, extent);
+		}
+	}
+
+	if (hash == damage_batch_hash) {
+		return;
+	}
+
+	if (damage_batch_rect.changed) {
+		damage_add_rect(&frame_damage, damage_batch_rect.rect);
+	}
+	if (rect.changed) {
+		damage_add_rect(&frame_damage, rect.rect);
+	}
+	damage_batch_hash = hash;
+	damage_batch_rect = rect;
+}
+
+void add_retained_sprite_damage(void) {
+	/*
+	 * Add where the changed retained sprites were and are to the frame's
+	 * damage, and the animated ones wherever they are
+	 */
+	uint32_t staged = 0;
+	for (uint32_t i = 0; i < frame_state->retained_ranges_count; i++) {
+		const SpritePoolRange* range = &frame_state->retained_ranges[i];
+		for (uint32_t j = 0; j < range->count; j++) {
+			SpriteTransform* drawn = &retained_drawn_transforms[range->first + j];
+			const SpriteTransform* changed = &frame_state->retained_transforms[staged + j];
+			damage_add_sprite(&frame_damage, drawn->pos, fmaxf(fabsf(drawn->scale[0]), fabsf(drawn->scale[1])));
+			damage_add_sprite(&frame_damage, changed->pos, fmaxf(fabsf(changed->scale[0]), fabsf(changed->scale[1])));
+			*drawn = *changed;
+		}
+		staged += range->count;
+	}
+
+	for (uint32_t i = 0; i < frame_state->retained_slots_count; i++) {
+		const SpriteTransform* drawn = &retained_drawn_transforms[i];
+		if (drawn->anim_params != 0) {
+			damage_add_sprite(&frame_damage, drawn->pos, fmaxf(fabsf(drawn->scale[0]), fabsf(drawn->scale[1])));
+		}
+	}
+}
+
+void update_damage(void) {
+	/*
+	 * Work out which part of the scene has to be drawn this frame with
+	 * partial_redraw: everything which changed since the offscreen image's copy
+	 * was last drawn into, which is transient_copies frames ago
+	 */
+	VkExtent2D extent = get_render_extent();
+	const Camera* camera = &frame_state->cameras[0];
+
+	bool moved = memcmp(camera->view_projection, damage_view_projection, sizeof(mat4)) != 0
+		|| extent.width != damage_extent.width || extent.height != damage_extent.height;
+	// What these draw changes without anything on the CPU knowing where
+	bool untracked = gpu_sprite_simulation || gpu_particles || lighting || use_sparse_atlas()
+		|| (bindless_textures && texture_streaming) || DEMO_SKINNED_CHARACTERS > 0 || animated_tiles;
+	if (moved || untracked) {
+		damage_add_everything(&frame_damage);
+	}
+	glm_mat4_copy((vec4*) camera->view_projection, damage_view_projection);
+	damage_extent = extent;
+
+	// The monsters bob all of the time, so every one which is in view is
+	// drawn again, from where it was at the last step to where it is now.
+	// The last frame's damage covers where it was drawn then
+	bool monsters_animated = MONSTER_ANIM_AMPLITUDE > 0.0f;
+	for (uint32_t i = 0; !frame_damage.full && i < monsters_count; i++) {
+		const float from[2] = {frame_state->prev_x[i], frame_state->prev_y[i]};
+		const float to[2] = {frame_state->x[i], frame_state->y[i]};
+		bool monster_moved = from[0] != to[0] || from[1] != to[1];
+		if ((monsters_animated || monster_moved) && monster_in_view(i)) {
+			damage_add_moving_sprite(&frame_damage, from, to, MONSTER_SIZE);
+		}
+	}
+
+	add_batched_sprite_damage();
+	add_retained_sprite_damage();
+
+	int32_t pixels[4];
+	damage_get_pixels(&frame_damage, (vec4*) camera->view_projection, extent.width, extent.height, pixels);
+	damage_history_push(&damage_history, pixels);
+	damage_clear(&frame_damage);
+
+	// Anything which changed since this copy was drawn, and where what changed
+	// then was drawn the frame before
+	damage_history_get(&damage_history, frame_graph.transient_copies + 1, damage_pixels);
+}
+
+void update_render_scale() {
+	/*
+	 * Move the render scale towards the frame time budget using the GPU time
+	 * of the frame which has just been collected by the profiler.  The cost of the passes mostly scales with the number of pixels,
+	 * so the scale changes with the square root of the time ratio.  The time
+	 * includes anything the GPU waits on inside the command buffer, so
+	 * it's on the cautious side
+	 */
+	double frame_time = profiler.scopes[profile_frame].last * 1e-3;
+	if (gpu_frame_time == 0.0) {
+		gpu_frame_time = frame_time;
+	}
+	else {
+		gpu_frame_time += (frame_time - gpu_frame_time) * GPU_FRAME_TIME_SMOOTHING;
+	}
+
+	frames_since_render_scale_change++;
+	if (frames_since_render_scale_change < DYNAMIC_RESOLUTION_INTERVAL || gpu_frame_time <= 0.0) {
+		return;
+	}
+
+	double target = GPU_FRAME_TIME_BUDGET * DYNAMIC_RESOLUTION_TARGET;
+	if (gpu_frame_time <= target && gpu_frame_time >= target * DYNAMIC_RESOLUTION_LOWER_THRESHOLD) {
+		return;
+	}
+
+	float scale = render_scale * (float) sqrt(target / gpu_frame_time);
+	scale = glm_clamp(scale, render_scale - RENDER_SCALE_STEP, render_scale + RENDER_SCALE_STEP);
+	if (fabsf(scale - render_scale) > 0.001f) {
+		set_render_scale(scale);
+	}
+}
+
+void recreate_swap_chain(void) {
+	telemetry_count(TELEMETRY_SWAP_CHAIN_RECREATIONS, 1);
+	// Which starts again with the next frame
+	present_thread_stop();
+	// The screen blit is recorded for the old swap chain
+	vkx_recreate_swap_chain();
+	mark_static_commands_dirty();
+}
+
+void submit_before_async_compute(const VkSemaphoreSubmitInfo* sparse_wait) {
+	/*
+	 * Submit the first two parts of a frame with async compute: the graphics
+	 * work up to the post-processing, then the post-processing on the compute
+	 * queue once that is done.  The rest waits on compute_finished_semaphore
+	 *
+	 * @param sparse_wait The sparse atlas's binds for the first part to wait
+	 *        on, or NULL
+	 */
+	VkxFrame* frame = &vkx_frames[current_frame];
+
+	VkCommandBufferSubmitInfo command_buffer_info = {0};
+	command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+	command_buffer_info.commandBuffer = frame->command_buffer;
+
+	VkSemaphoreSubmitInfo semaphore_info = {0};
+	semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+	semaphore_info.semaphore = frame->compute_wait_semaphore;
+	semaphore_info.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+	VkSubmitInfo2 submit_info = {0};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+	submit_info.waitSemaphoreInfoCount = sparse_wait != NULL ? 1 : 0;
+	submit_info.pWaitSemaphoreInfos = sparse_wait;
+	submit_info.commandBufferInfoCount = 1;
+	submit_info.pCommandBufferInfos = &command_buffer_info;
+	submit_info.signalSemaphoreInfoCount = 1;
+	submit_info.pSignalSemaphoreInfos = &semaphore_info;
+
+	if (vkQueueSubmit2(vkx_instance.graphics_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+		fprintf(stderr, "failed to submit draw command buffer!");
+		exit(1);
+	}
+
+	VkSemaphoreSubmitInfo signal_info = semaphore_info;
+	signal_info.semaphore = frame->compute_finished_semaphore;
+	command_buffer_info.commandBuffer = frame->compute_command_buffer;
+
+	submit_info.waitSemaphoreInfoCount = 1;
+	submit_info.pWaitSemaphoreInfos = &semaphore_info;
+	submit_info.pSignalSemaphoreInfos = &signal_info;
+
+	if (vkQueueSubmit2(vkx_instance.compute_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+		fprintf(stderr, "failed to submit compute command buffer!");
+		exit(1);
+	}
+}
+
+double get_elapsed_ms(uint64_t start_ns) {
+	return (double) (SDL_GetTicksNS() - start_ns) / SDL_NS_PER_MS;
+}
+
+void build_hud(VkExtent2D output_size, uint32_t pre_rotation) {
+	/*
+	 * Lay out the overlay for this frame.  The times are the last frame's
+	 * (the GPU's from a few frames ago), as this one is still being made
+	 *
+	 * @param output_size Size of the window before the pre-rotation
+	 */
+	const uint32_t white = HUD_RGBA(255, 255, 255, 255);
+	const uint32_t grey = HUD_RGBA(160, 160, 160, 255);
+	const float line = hud_line_height(&hud);
+	// Wide enough for the longest line
+	const float width = 36.0f * HUD_GLYPH_WIDTH * HUD_SCALE;
+	const float x = line;
+	float y = line;
+
+	hud_begin(&hud, output_size, pre_rotation);
+
+	// The background goes first so it's drawn underneath, and its height is
+	// filled in at the end
+	uint32_t background = hud.quads_count;
+	hud_rect(&hud, x - line * 0.5f, y - line * 0.5f, width + line, 0.0f, HUD_RGBA(0, 0, 0, 140));
+
+	uint32_t frames_count = 0;
+	float total_ms = 0.0f;
+	float max_ms = 0.0f;
+	for (uint32_t i = 0; i < HUD_GRAPH_FRAMES; i++) {
+		if (hud_frame_times[i] > 0.0f) {
+			frames_count++;
+			total_ms += hud_frame_times[i];
+			max_ms = fmaxf(max_ms, hud_frame_times[i]);
+		}
+	}
+	float avg_ms = frames_count > 0 ? total_ms / (float) frames_count : 0.0f;
+	hud_printf(&hud, x, y, white, "FPS %.0f  FRAME %.2f MS  MAX %.2f", avg_ms > 0.0f ? 1000.0f / avg_ms : 0.0f, avg_ms, max_ms);
+	y += line * 1.5f;
+
+	hud_graph(&hud, x, y, width, line * 4.0f, hud_frame_times, HUD_GRAPH_FRAMES, hud_frame_times_next,
+			HUD_GRAPH_MAX_MS, (float) (GPU_FRAME_TIME_BUDGET * 1000.0));
+	y += line * 5.0f;
+
+	hud_printf(&hud, x, y, white, "CPU UPDATE %.2f  WAIT %.2f", frame_state->update_ms, cpu_wait_ms);
+	y += line;
+	hud_printf(&hud, x, y, white, "    RECORD %.2f  SUBMIT %.2f", cpu_record_ms, cpu_submit_ms);
+	y += line;
+	hud_printf(&hud, x, y, grey, "    TRANSFORMS %.2f  SORT %.2f", cpu_transforms_ms, cpu_sort_ms);
+	y += line * 1.5f;
+
+	if (vkx_profiler_is_enabled(&profiler)) {
+		for (uint32_t i = 0; i < profiler.scopes_count; i++) {
+			hud_printf(&hud, x, y, i == profile_frame ? white : grey, "GPU %-8s %6.2f MS", profiler.scopes[i].name, profiler.scopes[i].last);
+			y += line;
+		}
+	}
+	else {
+		hud_text(&hud, x, y, grey, "GPU NO TIMESTAMPS");
+		y += line;
+	}
+	y += line * 0.5f;
+
+	hud_printf(&hud, x, y, white, "SPRITES %u  DRAWS %d", monsters_count, last_draws_count);
+	y += line;
+	if (vkx_command_stats_enabled()) {
+		const uint32_t* counts = last_command_stats.counts;
+		hud_printf(&hud, x, y, grey, "CMD DRAWS %u  DISPATCHES %u  SUBMITS %u",
+				counts[VKX_STAT_DRAWS], counts[VKX_STAT_DISPATCHES], counts[VKX_STAT_SUBMITS]);
+		y += line;
+		hud_printf(&hud, x, y, grey, "BINDS %u  SETS %u  PUSHES %u  BARRIERS %u", counts[VKX_STAT_PIPELINE_BINDS],
+				counts[VKX_STAT_DESCRIPTOR_BINDS], counts[VKX_STAT_PUSH_CONSTANTS], counts[VKX_STAT_BARRIERS]);
+		y += line;
+		hud_printf(&hud, x, y, grey, "UPLOADED %.1f KB", (double) counts[VKX_STAT_UPLOAD_BYTES] / 1024.0);
+		y += line;
+	}
+	hud_printf(&hud, x, y, white, "RENDER SCALE %.2f", render_scale);
+	y += line;
+	if (use_sprite_events()) {
+		hud_printf(&hud, x, y, grey, "EDGE HITS %llu  DROPPED %llu",
+				(unsigned long long) sprite_edge_hits, (unsigned long long) sprite_events_dropped);
+		y += line;
+	}
+	y += line * 0.5f;
+
+	for (uint32_t i = 0; i < vkx_memory_get_heaps_count(); i++) {
+		VkxMemoryHeapStats stats = vkx_memory_get_heap_stats(i);
+		if (stats.blocks_count == 0) {
+			continue;
+		}
+		hud_printf(&hud, x, y, white, "HEAP %u %7.1f / %7.1f MB", i,
+				(double) stats.used_bytes / (1024.0 * 1024.0), (double) stats.heap_size / (1024.0 * 1024.0));
+		y += line;
+	}
+
+	hud.quads[background].rect[3] = y - hud.quads[background].rect[1];
+}
+
+void update_telemetry(uint64_t frame_start_ns) {
+	/*
+	 * Add the time since the last frame started, and every so often the
+	 * memory used
+	 */
+	if (telemetry_last_frame_ns != 0) {
+		telemetry_add_frame(frame_start_ns - telemetry_last_frame_ns, telemetry_refresh_period_ns);
+	}
+	telemetry_last_frame_ns = frame_start_ns;
+
+	if (vkx_command_stats_enabled()) {
+		for (uint32_t i = 0; i < _VKX_STAT_COUNT; i++) {
+			telemetry_set_gauge(telemetry_command_gauges[i], (int) last_command_stats.counts[i]);
+		}
+	}
+
+	if (telemetry_frames_count++ % TELEMETRY_MEMORY_FRAMES == 0) {
+		for (uint32_t i = 0; i < vkx_memory_get_heaps_count(); i++) {
+			VkxMemoryHeapStats stats = vkx_memory_get_heap_stats(i);
+			telemetry_set_gauge(telemetry_heap_gauges[i], (int) (stats.used_bytes >> 20));
+		}
+	}
+}
+
+void write_light_views(UniformBufferObject* ubo) {
+	/*
+	 * Write where each view's pixels are in the world and how many light tiles
+	 * there are, for the light culling and the lit shaders
+	 */
+	VkExtent2D extent = split_screen_views > 1 ? get_view_extent(get_render_extent()) : get_render_extent();
+	get_light_tiles(extent, ubo->light_tiles);
+	ubo->shadow_resolution = light_shadows ? SHADOW_MAP_RESOLUTION : 0;
+	ubo->shadow_bias = SHADOW_BIAS;
+	memcpy(ubo->ambient_light, AMBIENT_LIGHT, sizeof(AMBIENT_LIGHT));
+	ubo->ambient_light[3] = 1.0f;
+
+	// From the top left, as the pixels are
+	for (uint32_t i = 0; i < split_screen_views; i++) {
+		const float* visible = frame_state->cameras[i].visible;
+		ubo->light_views[i][0] = visible[0];
+		ubo->light_views[i][1] = visible[3];
+		ubo->light_views[i][2] = (visible[2] - visible[0]) / (float) extent.width;
+		ubo->light_views[i][3] = (visible[1] - visible[3]) / (float) extent.height;
+	}
+}
+
+void write_view_corrections(UniformBufferObject* ubo) {
+	/*
+	 * Work out the matrices taking the first view's view-projection to each of
+	 * the other views', for the world and each tile layer.  The draws only
+	 * push the first's, so they are recorded once for all of the views
+	 */
+	const Camera* first = &frame_state->cameras[0];
+
+	for (uint32_t slot = 0; slot < VIEW_SLOTS; slot++) {
+		float parallax = slot == 0 ? 1.0f : TILE_LAYER_DESCS[slot - 1].parallax;
+		mat4 first_view_projection;
+		mat4 inverse;
+		camera_view_projection(first, parallax, first_view_projection);
+		glm_mat4_inv(first_view_projection, inverse);
+
+		for (uint32_t i = 1; i < split_screen_views; i++) {
+			mat4 view_projection;
+			mat4 correction;
+			camera_view_projection(&frame_state->cameras[i], parallax, view_projection);
+			glm_mat4_mul(view_projection, inverse, correction);
+			memcpy(ubo->view_corrections[slot][i - 1], correction, sizeof(correction));
+		}
+	}
+}
+
+void write_late_latch(UniformBufferObject* ubo) {
+	/*
+	 * Write the matrices taking the first view's view-projection, for the
+	 * world and each tile layer, from the camera the frame was recorded with
+	 * to the newest one.  Called just before the frame is submitted, and
+	 * they're left as the identity without late_latched_camera
+	 */
+	if (!late_latched_camera) {
+		for (uint32_t slot = 0; slot < VIEW_SLOTS; slot++) {
+			mat4 identity = GLM_MAT4_IDENTITY_INIT;
+			memcpy(ubo->late_latch[slot], identity, sizeof(identity));
+		}
+		return;
+	}
+
+	SDL_LockMutex(latched_camera_mutex);
+	Camera latched = latched_camera;
+	SDL_UnlockMutex(latched_camera_mutex);
+
+	for (uint32_t slot = 0; slot < VIEW_SLOTS; slot++) {
+		float parallax = slot == 0 ? 1.0f : TILE_LAYER_DESCS[slot - 1].parallax;
+		mat4 recorded;
+		mat4 inverse;
+		mat4 latest;
+		mat4 latch;
+		camera_view_projection(&frame_state->cameras[0], parallax, recorded);
+		glm_mat4_inv(recorded, inverse);
+		camera_view_projection(&latched, parallax, latest);
+		glm_mat4_mul(latest, inverse, latch);
+		memcpy(ubo->late_latch[slot], latch, sizeof(latch));
+	}
+}
+
+void reload_texture(uint32_t texture, const VkxDecodedTexture* decoded) {
+	/*
+	 * Upload a texture which changed on disk into a new image, and point its
+	 * texture table index at it.  The frames in flight keep the old one until
+	 * they're done
+	 */
+	VkxImage image;
+	vkx_create_decoded_textures(1, decoded, &image, generate_mipmaps);
+	vkx_upload_flush();
+
+	vkx_texture_table_replace(texture_table_indices[texture], image.view, texture_sampler);
+	vkx_defer_cleanup_image(&textures[texture]);
+	textures[texture] = image;
+}
+
+void apply_hot_reloads(void) {
+	/*
+	 * Between frames, start the pipelines using changed shaders compiling and
+	 * upload changed textures, then swap in the pipelines which have finished.
+	 * Nothing here waits for a compile
+	 */
+	HotReloadChange change;
+	bool changed = false;
+	while (hot_reload_next(&change)) {
+		if (change.kind == HOT_RELOAD_SHADER) {
+			vkx_reload_shader_module(change.path);
+			vkx_pipeline_manager_reload(change.path);
+		}
+		else {
+			reload_texture(change.id, &change.texture);
+			vkx_free_decoded_texture(&change.texture);
+			changed = true;
+		}
+	}
+
+	if (vkx_pipeline_manager_swap_reloaded() > 0) {
+		changed = true;
+	}
+	// Everything drawn with them has to be drawn again
+	if (changed) {
+		mark_static_commands_dirty();
+		damage_add_everything(&frame_damage);
+	}
+}
+
+double predict_frame_time(double predicted_ms, double ms) {
+	/*
+	 * Add a frame's time to a prediction of the next one's for
+	 * just_in_time_frames, erring on the slow side
+	 */
+	if (ms > predicted_ms) {
+		return ms;
+	}
+	return predicted_ms + (ms - predicted_ms) * JUST_IN_TIME_SMOOTHING;
+}
+
+void get_present_rect(VkRectLayerKHR* rect) {
+	/*
+	 * The part of the swap chain image the scene changed this frame, which the
+	 * screen pass stretches the render extent over
+	 */
+	VkExtent2D render_extent = get_render_extent();
+	float scale_x = (float) vkx_swap_chain.extent.width / (float) render_extent.width;
+	float scale_y = (float) vkx_swap_chain.extent.height / (float) render_extent.height;
+
+	// Rounded out, with a pixel more for the filtering when it's scaled up
+	int32_t x0 = (int32_t) floorf((float) damage_pixels[0] * scale_x) - 1;
+	int32_t y0 = (int32_t) floorf((float) damage_pixels[1] * scale_y) - 1;
+	int32_t x1 = (int32_t) ceilf((float) damage_pixels[2] * scale_x) + 1;
+	int32_t y1 = (int32_t) ceilf((float) damage_pixels[3] * scale_y) + 1;
+	x0 = x0 > 0 ? x0 : 0;
+	y0 = y0 > 0 ? y0 : 0;
+	x1 = x1 < (int32_t) vkx_swap_chain.extent.width ? x1 : (int32_t) vkx_swap_chain.extent.width;
+	y1 = y1 < (int32_t) vkx_swap_chain.extent.height ? y1 : (int32_t) vkx_swap_chain.extent.height;
+
+	// No rectangles would mean all of it, so nothing changing is a pixel
+	rect->offset.x = x0;
+	rect->offset.y = y0;
+	rect->extent.width = x1 > x0 ? (uint32_t) (x1 - x0) : 1;
+	rect->extent.height = y1 > y0 ? (uint32_t) (y1 - y0) : 1;
+	rect->layer = 0;
+}
+
+VkResult present_inline(uint32_t image_index, bool present_region) {
+	/*
+	 * Present the frame's image, and the other windows' with it, on this thread
+	 *
+	 * @param image_index The image the frame signals the render finished
+	 *                    semaphore of
+	 * @param present_region Only the part of the window from get_present_rect()
+	 *                       changed
+	 *
+	 * @return What vkQueuePresentKHR returned, for all the windows together
+	 */
+	VkPresentInfoKHR present_info = {0};
+	present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+
+	present_info.waitSemaphoreCount = 1;
+	present_info.pWaitSemaphores = &vkx_swap_chain.render_finished_semaphores[image_index];
+
+	VkSwapchainKHR swap_chains[] = {vkx_swap_chain.swap_chain};
+	present_info.swapchainCount = 1;
+	present_info.pSwapchains = swap_chains;
+
+	present_info.pImageIndices = &image_index;
+
+	// Lets the low latency pacing wait for it to be displayed
+	VkPresentIdKHR present_id = {0};
+	vkx_add_present_id(&present_info, &present_id);
+
+	// Tells exactly when the present is done with the image, and switches
+	// the present mode without recreating the swap chain
+	VkSwapchainPresentFenceInfoEXT present_fence = {0};
+	VkSwapchainPresentModeInfoEXT present_mode_info = {0};
+	vkx_add_present_fence(&present_info, &present_fence, &present_mode_info, image_index);
+
+	VkPresentRegionsKHR present_regions = {0};
+	VkPresentRegionKHR region = {0};
+	VkRectLayerKHR present_rect = {0};
+	if (present_region) {
+		get_present_rect(&present_rect);
+		vkx_add_present_region(&present_info, &present_regions, &region, &present_rect);
+	}
+
+	// And the other windows with it
+	VkxPresentBatch present_batch;
+	vkx_add_present_windows(&present_info, &present_batch, extra_windows, extra_windows_count);
+
+	trace_begin("present");
+	VkResult result = vkQueuePresentKHR(vkx_instance.present_queue, &present_info);
+	trace_end();
+	return vkx_finish_present_windows(&present_batch, result);
+}
+
+void draw_frame() {
+	uint64_t wait_start_ns = SDL_GetTicksNS();
+	if (hud_visible) {
+		if (hud_last_frame_ns != 0) {
+			hud_frame_times[hud_frame_times_next] = (float) (wait_start_ns - hud_last_frame_ns) / SDL_NS_PER_MS;
+			hud_frame_times_next = (hud_frame_times_next + 1) % HUD_GRAPH_FRAMES;
+		}
+		hud_last_frame_ns = wait_start_ns;
+	}
+	if (telemetry_is_running()) {
+		update_telemetry(wait_start_ns);
+	}
+
+	trace_begin("wait for frame");
+	if (timeline_frame_sync) {
+		vkx_frame_timeline_wait(vkx_frames[current_frame].timeline_value);
+	} else {
+		vkWaitForFences(vkx_instance.device, 1, &vkx_frames[current_frame].in_flight_fence, VK_TRUE, UINT64_MAX);
+	}
+	trace_end();
+	cpu_wait_ms = get_elapsed_ms(wait_start_ns);
+	bench_add_sample(bench_phase_wait, cpu_wait_ms);
+
+	// Destroy whatever the finished frames were the last to use, e.g. old swap chains
+	vkx_collect_deferred_destroys();
+
+	if (hot_reloading) {
+		apply_hot_reloads();
+	}
+
+	// This frame's timestamps from last time round are ready now
+	bool profiled = vkx_profiler_collect(&profiler, current_frame);
+	if (dynamic_resolution && profiled) {
+		update_render_scale();
+	}
+	if (bench_is_running() && profiled) {
+		for (uint32_t i = 0; i < profiler.scopes_count; i++) {
+			bench_add_sample(bench_phases_gpu[i], profiler.scopes[i].last);
+		}
+	}
+	if (profiled) {
+		telemetry_add_sample(TELEMETRY_GPU_TIME, profiler.scopes[profile_frame].last);
+	}
+	// On the trace's GPU track, where the profiler can put them on its clock
+	if (cpu_trace && profiled && profiler.calibrated) {
+		for (uint32_t i = 0; i < profiler.scopes_count; i++) {
+			if (profiler.scopes[i].collected) {
+				trace_add_gpu_zone(profiler.scopes[i].name, profiler.scopes[i].last_start_ns, profiler.scopes[i].last_end_ns);
+			}
+		}
+	}
+	if (spike_traces && profiled) {
+		for (uint32_t i = 0; i < profiler.scopes_count; i++) {
+			trace_add_counter(profiler.scopes[i].name, profiler.scopes[i].last);
+		}
+	}
+	if (just_in_time_frames && profiled) {
+		just_in_time_gpu_ms = predict_frame_time(just_in_time_gpu_ms, profiler.scopes[profile_frame].last);
+	}
+
+	// What this frame captured last time round can be written out
+	if (capture_enabled) {
+		capture_retire(current_frame);
+	}
+
+	// And its sprite events handled
+	if (use_sprite_events()) {
+		collect_sprite_events(current_frame);
+	}
+
+	// Each frame in flight has its own headless image, which is finished with
+	// now
+	uint32_t image_index = current_frame;
+	VkResult result = VK_SUCCESS;
+	if (headless) {
+		uint64_t frame_number = headless_frames_count + 1;
+		// Not in a benchmark, which would time the writing
+		if (HEADLESS_CAPTURE_INTERVAL > 0 && frame_number % HEADLESS_CAPTURE_INTERVAL == 0 && !bench_is_running()) {
+			char filename[256];
+			snprintf(filename, sizeof(filename), HEADLESS_CAPTURE_FILENAME, (unsigned long long) frame_number);
+			capture_screenshot(filename);
+		}
+	}
+	else {
+		// Set between frames, e.g. when the window comes back after frames
+		// were skipped while it was hidden
+		if (framebuffer_resized) {
+			framebuffer_resized = false;
+			recreate_swap_chain();
+		}
+
+		uint64_t acquire_start_ns = SDL_GetTicksNS();
+		trace_begin("acquire image");
+		if (use_threaded_present()) {
+			result = present_thread_take_image(current_frame, &image_index);
+		}
+		else {
+			result = vkAcquireNextImageKHR(vkx_instance.device, vkx_swap_chain.swap_chain, UINT64_MAX, vkx_frames[current_frame].image_available_semaphore, VK_NULL_HANDLE, &image_index);
+		}
+		trace_end();
+		cpu_acquire_ms = get_elapsed_ms(acquire_start_ns);
+
+		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+			printf("Couldn't acquire swap chain image - recreating swap chain\n");
+			telemetry_count(TELEMETRY_OUT_OF_DATE, 1);
+			// This frame's retained sprite changes are lost with it
+			if (frame_state->retained_changed_count > 0) {
+				SDL_SetAtomicInt(&retained_sprites_lost, 1);
+			}
+			recreate_swap_chain();
+			return;
+		} else if (result == VK_SUBOPTIMAL_KHR) {
+			telemetry_count(TELEMETRY_SUBOPTIMAL, 1);
+		} else if (result != VK_SUCCESS) {
+			fprintf(stderr, "Failed to acquire swap chain image (result: %d)\n", result);
+			exit(1);
+		}
+
+		// The other windows which haven't got an image this frame just aren't
+		// drawn to
+		for (uint32_t i = 0; i < extra_windows_count; i++) {
+			vkx_acquire_window_image(&extra_windows[i], current_frame);
+		}
+	}
+	
+	// Everything from here on culls the monsters by what's in view
+	if (occlusion_culling) {
+		build_occlusion_mask();
+	}
+	if (!gpu_sprite_simulation) {
+		cull_monsters();
+	}
+
+	// This frame has been waited on, so its part of the ring is free again
+	vkx_ring_buffer_begin_frame(&frame_ring, current_frame);
+	// And so are its transient descriptor sets
+	vkx_descriptor_ring_begin_frame(current_frame);
+	// The culling shader's copy of the occlusion mask
+	if (occlusion_culling && gpu_sprite_culling && !use_mesh_shader_sprites()) {
+		VkxRingAllocation allocation = vkx_ring_buffer_alloc(&frame_ring, sizeof(occlusion_mask_bits));
+		memcpy(allocation.data, occlusion_mask_bits, sizeof(uint64_t) * occlusion_mask.words_per_row * occlusion_mask.height);
+		occlusion_mask_offset = allocation.offset;
+	}
+	// And any texture table indices it could have been using
+	if (bindless_textures) {
+		vkx_texture_table_begin_frame(current_frame);
+	}
+	// Which can swap in textures that have finished streaming, or evict some
+	if (bindless_textures && texture_streaming) {
+		vkx_residency_update();
+		mark_used_textures();
+
+		if (defragment_memory) {
+			vkx_memory_update_defragmentation();
+		}
+	}
+	// Bind whatever pages of the sparse atlas this frame sampled last time round
+	if (use_sparse_atlas()) {
+		vkx_sparse_atlas_update(current_frame);
+	}
+
+	// Stream in the tilemap chunks around the view.  The uploads are submitted
+	// before this frame, so the graphics queue sees them in time
+	bool streamed = false;
+	chunk_impostor_renders_count = 0;
+	if (chunked_tilemap) {
+		float view[4];
+		get_views_visible_rect(frame_state->cameras, 1.0f, view);
+
+		// Zoomed out far enough the impostors are drawn instead, and the chunks
+		// are left as they are until zooming back in
+		bool impostors = use_chunk_impostors();
+		for (uint32_t i = 0; i < split_screen_views && impostors; i++) {
+			impostors = frame_state->cameras[i].zoom < CHUNK_IMPOSTOR_ZOOM;
+		}
+		bool switched = impostors != drawing_chunk_impostors;
+		drawing_chunk_impostors = impostors;
+
+		if (impostors) {
+			uint32_t drawn = tilemap.visible_impostors_count;
+			tilemap_update_impostors(&tilemap, view[0], view[1], view[2], view[3], CHUNK_IMPOSTOR_RENDERS_PER_FRAME);
+			stage_chunk_impostors();
+			if (switched || tilemap.impostor_renders_count > 0 || tilemap.visible_impostors_count != drawn) {
+				mark_static_commands_dirty();
+				damage_add_everything(&frame_damage);
+			}
+		}
+		else if (tilemap_update(&tilemap, view[0], view[1], view[2], view[3]) || switched) {
+			vkx_upload_flush();
+			mark_static_commands_dirty();
+			// Including chunks rebuilt for edited tiles
+			damage_add_everything(&frame_damage);
+			streamed = true;
+		}
+	}
+	// The moving tile layers scroll slower (or faster) than the camera
+	if (tile_layers) {
+		bool uploaded = false;
+		for (size_t i = 0; i < TILE_LAYERS_COUNT; i++) {
+			TileLayer* layer = &layers[i];
+			if (layer->cached) {
+				continue;
+			}
+
+			float view[4];
+			get_views_visible_rect(frame_state->cameras, layer->desc.parallax, view);
+			uploaded |= tilemap_update(&layer->tilemap, view[0], view[1], view[2], view[3]);
+		}
+		if (uploaded) {
+			vkx_upload_flush();
+			mark_static_commands_dirty();
+			damage_add_everything(&frame_damage);
+			streamed = true;
+		}
+	}
+
+	// Update the uniform buffer - only the fields which change get written
+	VkxRingAllocation ubo_allocation = vkx_ring_buffer_alloc(&frame_ring, sizeof(UniformBufferObject));
+	UniformBufferObject* ubo = ubo_allocation.data;
+	ubo->t = (float) frame_state->t;
+	memcpy(ubo->tile_animations, tile_animations, sizeof(tile_animations));
+
+	VkExtent2D render_extent = get_render_extent();
+	// The swap chain image's extent is only set in the graph when it's recorded
+	VkExtent2D offscreen_extent = scene_to_swap_chain ? vkx_swap_chain.extent : frame_graph.images[graph_offscreen_image].extent;
+	ubo->render_uv_scale[0] = (float) render_extent.width / (float) offscreen_extent.width;
+	ubo->render_uv_scale[1] = (float) render_extent.height / (float) offscreen_extent.height;
+	ubo->render_size[0] = (float) render_extent.width;
+	ubo->render_size[1] = (float) render_extent.height;
+	ubo->bilinear_upscale = bilinear_upscale ? 1 : 0;
+	ubo->pre_rotation = vkx_swap_chain.pre_rotation;
+	// The size of the window, before it is rotated by the screen pass
+	bool rotated = vkx_swap_chain.pre_rotation % 2 == 1;
+	ubo->output_size[0] = (float) (rotated ? vkx_swap_chain.extent.height : vkx_swap_chain.extent.width);
+	ubo->output_size[1] = (float) (rotated ? vkx_swap_chain.extent.width : vkx_swap_chain.extent.height);
+	ubo->color_grade[0] = POST_EXPOSURE;
+	ubo->color_grade[1] = POST_CONTRAST;
+	ubo->color_grade[2] = POST_SATURATION;
+	ubo->bloom[0] = BLOOM_THRESHOLD;
+	ubo->bloom[1] = BLOOM_INTENSITY;
+	ubo->crt[0] = CRT_SCANLINES;
+	ubo->crt[1] = CRT_VIGNETTE;
+	if (split_screen_views > 1) {
+		write_view_corrections(ubo);
+	}
+	if (lighting) {
+		write_light_views(ubo);
+	}
+
+	frame_dynamic_offsets[0] = (uint32_t) ubo_allocation.offset;
+
+	if (gpu_sprite_simulation) {
+		// The compute shader writes them to their own buffer
+		frame_dynamic_offsets[1] = 0;
+	}
+	else {
+		// Write the monster transforms straight into the mapped storage buffer
+		VkxRingAllocation transforms_allocation = vkx_ring_buffer_alloc(&frame_ring, sizeof(SpriteTransform) * monsters_count);
+		uint64_t transforms_start_ns = SDL_GetTicksNS();
+		trace_begin("sprite transforms");
+		update_sprite_transforms(transforms_allocation.data);
+		trace_end();
+		cpu_transforms_ms = get_elapsed_ms(transforms_start_ns);
+		bench_add_sample(bench_phase_transforms, cpu_transforms_ms);
+		frame_dynamic_offsets[1] = (uint32_t) transforms_allocation.offset;
+	}
+
+	if (sprite_render_queue) {
+		uint64_t sort_start_ns = SDL_GetTicksNS();
+		queue_sprites();
+		cpu_sort_ms = get_elapsed_ms(sort_start_ns);
+		bench_add_sample(bench_phase_sort, cpu_sort_ms);
+	}
+
+	queue_batched_sprites();
+	stage_retained_sprites();
+	if (DEMO_SKINNED_CHARACTERS > 0) {
+		stage_skinned_characters();
+	}
+	if (gpu_particles) {
+		stage_particle_emitters();
+	}
+	if (lighting) {
+		stage_lights();
+	}
+
+	if (!chunked_tilemap) {
+		stage_tile_edits();
+	}
+	if (shading_rate_pass != UINT32_MAX) {
+		stage_shading_rate_mask();
+	}
+	// The uploads are limited each frame, so there could be more to come
+	SDL_SetAtomicInt(&render_work_left, streamed || tile_edits_count > 0);
+	if (partial_redraw) {
+		update_damage();
+	}
+	
+	if (!timeline_frame_sync) {
+		vkResetFences(vkx_instance.device, 1, &vkx_frames[current_frame].in_flight_fence);
+	}
+	
+	// Resets the frame's command buffer along with anything else from its pool
+	vkResetCommandPool(vkx_instance.device, vkx_frames[current_frame].command_pool, 0);
+	if (post_chain.async_compute) {
+		vkResetCommandPool(vkx_instance.device, vkx_frames[current_frame].compute_command_pool, 0);
+	}
+	
+	// Everything counted since this point last frame, i.e. all of the last
+	// frame's commands and submits, along with its present on the present thread
+	if (vkx_command_stats_enabled()) {
+		vkx_command_stats_end_frame(&last_command_stats);
+		if (spike_traces) {
+			for (uint32_t i = 0; i < _VKX_STAT_COUNT; i++) {
+				trace_add_counter(vkx_command_stat_name((VkxCommandStat) i), (double) last_command_stats.counts[i]);
+			}
+		}
+	}
+
+	// The overlay is laid out before anything else is recorded, with what the
+	// last frame drew
+	if (hud_visible) {
+		last_draws_count = SDL_SetAtomicInt(&draws_recorded, 0);
+		VkExtent2D output_size = {(uint32_t) ubo->output_size[0], (uint32_t) ubo->output_size[1]};
+		build_hud(output_size, ubo->pre_rotation);
+	}
+	if (debug_shapes_visible) {
+		VkExtent2D output_size = {(uint32_t) ubo->output_size[0], (uint32_t) ubo->output_size[1]};
+		debug_draw_set_view(&debug_drawer, (const float*) frame_state->cameras[0].view_projection, output_size, ubo->pre_rotation);
+	}
+
+	// Write our draw commands into the command buffer
+	uint64_t record_start_ns = SDL_GetTicksNS();
+	trace_begin("record");
+	record_command_buffer(vkx_frames[current_frame].command_buffer, image_index);
+	trace_end();
+	cpu_record_ms = get_elapsed_ms(record_start_ns);
+	bench_add_sample(bench_phase_record, cpu_record_ms);
+
+	// Nothing is acquired headless, so there's nothing to wait for
+	VkSemaphoreSubmitInfo wait_infos[3 + VKX_MAX_WINDOWS] = {0};
+	uint32_t wait_infos_count = 0;
+	if (!headless) {
+		wait_infos[wait_infos_count].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+		wait_infos[wait_infos_count].semaphore = vkx_frames[current_frame].image_available_semaphore;
+		wait_infos[wait_infos_count].stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+		wait_infos_count++;
+	}
+	// The other windows' images are only blitted to
+	for (uint32_t i = 0; i < extra_windows_count; i++) {
+		if (extra_windows[i].image_index != UINT32_MAX) {
+			wait_infos[wait_infos_count].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+			wait_infos[wait_infos_count].semaphore = extra_windows[i].image_available_semaphores[current_frame];
+			wait_infos[wait_infos_count].stageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+			wait_infos_count++;
+		}
+	}
+
+	VkCommandBufferSubmitInfo command_buffer_info = {0};
+	command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+	command_buffer_info.commandBuffer = vkx_frames[current_frame].command_buffer;
+
+	// As late as it can be, once everything else is recorded
+	write_late_latch(ubo);
+
+	// The swap chain image is only used after the post-processing, so the last
+	// part is what waits for it
+	uint64_t submit_start_ns = SDL_GetTicksNS();
+	trace_begin("submit");
+	// The pages the sparse atlas bound for this frame have to be there before
+	// they're copied to
+	VkSemaphoreSubmitInfo sparse_wait = {0};
+	bool has_sparse_wait = use_sparse_atlas() && vkx_sparse_atlas_get_bind_wait(&sparse_wait);
+
+	if (post_chain.async_compute) {
+		submit_before_async_compute(has_sparse_wait ? &sparse_wait : NULL);
+
+		command_buffer_info.commandBuffer = vkx_frames[current_frame].command_buffer_after_compute;
+		wait_infos[wait_infos_count].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+		wait_infos[wait_infos_count].semaphore = vkx_frames[current_frame].compute_finished_semaphore;
+		wait_infos[wait_infos_count].stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+		wait_infos_count++;
+	}
+	else if (has_sparse_wait) {
+		wait_infos[wait_infos_count++] = sparse_wait;
+	}
+
+	// The swap chain image's semaphore for presenting (not headless), and the
+	// frame timeline whichever way the frames are waited on
+	VkSemaphoreSubmitInfo signal_infos[2 + VKX_MAX_WINDOWS] = {0};
+	signal_infos[0].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+	signal_infos[0].semaphore = headless ? VK_NULL_HANDLE : vkx_swap_chain.render_finished_semaphores[image_index];
+	signal_infos[0].stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+	signal_infos[1].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+	signal_infos[1].semaphore = vkx_instance.frame_timeline;
+	signal_infos[1].value = vkx_frame_timeline_signal();
+	signal_infos[1].stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+	vkx_frames[current_frame].timeline_value = signal_infos[1].value;
+	uint32_t signal_infos_count = 2;
+	for (uint32_t i = 0; i < extra_windows_count; i++) {
+		const VkxWindow* window = &extra_windows[i];
+		if (window->image_index != UINT32_MAX) {
+			signal_infos[signal_infos_count].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+			signal_infos[signal_infos_count].semaphore = window->swap_chain.render_finished_semaphores[window->image_index];
+			signal_infos[signal_infos_count].stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+			signal_infos_count++;
+		}
+	}
+
+	VkSubmitInfo2 submit_info = {0};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+	submit_info.waitSemaphoreInfoCount = wait_infos_count;
+	submit_info.pWaitSemaphoreInfos = wait_infos;
+	submit_info.commandBufferInfoCount = 1;
+	submit_info.pCommandBufferInfos = &command_buffer_info;
+	submit_info.signalSemaphoreInfoCount = headless ? 1 : signal_infos_count;
+	submit_info.pSignalSemaphoreInfos = headless ? &signal_infos[1] : signal_infos;
+
+	VkFence fence = timeline_frame_sync ? VK_NULL_HANDLE : vkx_frames[current_frame].in_flight_fence;
+
+	if (vkQueueSubmit2(vkx_instance.graphics_queue, 1, &submit_info, fence) != VK_SUCCESS) {
+		fprintf(stderr, "failed to submit draw command buffer!");
+		exit(1);
+	}
+	trace_end();
+	cpu_submit_ms = get_elapsed_ms(submit_start_ns);
+	bench_add_sample(bench_phase_submit, cpu_submit_ms);
+	if (!startup_reported) {
+		report_startup();
+	}
+
+	if (just_in_time_frames) {
+		just_in_time_submit_ns = SDL_GetTicksNS();
+		double cpu_ms = get_elapsed_ms(just_in_time_start_ns) - cpu_wait_ms - cpu_acquire_ms;
+		just_in_time_cpu_ms = predict_frame_time(just_in_time_cpu_ms, cpu_ms);
+	}
+
+	if (headless) {
+		headless_frames_count++;
+		current_frame = (current_frame + 1) % vkx_instance.frames_in_flight;
+		return;
+	}
+
+	// Only the part of the window the scene changed in, unless the post
+	// effects or the overlay could have changed the rest
+	bool present_region = partial_redraw && post_chain_is_empty(&post_chain) && !hud_visible;
+
+	bool presented = true;
+	if (use_threaded_present()) {
+		PresentThreadFrame present_frame = {0};
+		present_frame.image_index = image_index;
+		present_frame.has_region = present_region;
+		if (present_region) {
+			get_present_rect(&present_frame.rect);
+		}
+		present_thread_present(&present_frame);
+
+		// And how the earlier presents went, which is what the inline present
+		// would have returned.  Usually that's the last frame's
+		result = VK_SUCCESS;
+		presented = false;
+		PresentThreadReport report;
+		while (present_thread_take_report(&report)) {
+			presented = true;
+			bench_add_sample(bench_phase_present, report.present_ms + report.acquire_ms);
+			if (report.result < 0 || (report.result == VK_SUBOPTIMAL_KHR && result == VK_SUCCESS)) {
+				result = report.result;
+			}
+		}
+	}
+	else {
+		result = present_inline(image_index, present_region);
+	}
+
+	if (result == VK_SUBOPTIMAL_KHR) {
+		if (suboptimal_swapchain_count == 0) {
+			printf("Swapchain was suboptimal\n");
+		}
+		suboptimal_swapchain_count++;
+		telemetry_count(TELEMETRY_SUBOPTIMAL, 1);
+	}
+	else if (presented) {
+		// Reset to 0 if it doesn't come back like that every frame
+		suboptimal_swapchain_count = 0;
+	}
+	
+	if (framebuffer_resized) {
+		printf("Framebuffer resized - recreating swap chain\n");
+		framebuffer_resized = false;
+		recreate_swap_chain();
+	}
+	else if (suboptimal_swapchain_count >= SUBOPTIMAL_SWAPCHAIN_THRESHOLD) {
+		suboptimal_swapchain_count = 0;
+		printf("Swapchain is still suboptimal - recreating\n");
+		recreate_swap_chain();
+	}
+	else if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+		printf("Couldn't present swap chain image - recreating swap chain (result: %d)\n", result);
+		telemetry_count(TELEMETRY_OUT_OF_DATE, 1);
+		recreate_swap_chain();
+	}
+	else if (result != VK_SUBOPTIMAL_KHR && result != VK_SUCCESS) {
+		fprintf(stderr, "failed to present swap chain image! (result: %d)\n", result);
+		exit(1);
+	}
+
+	current_frame = (current_frame + 1) % vkx_instance.frames_in_flight;
+}
+
+void cleanup_vulkan(void) {
+	printf("Cleaning up Vulkan\n");
+
+	vkx_cleanup_swap_chain();
+	cleanup_extra_windows();
+	if (capture_enabled) {
+		capture_cleanup();
+	}
+	
+	vkx_profiler_cleanup(&profiler);
+	vkx_secondary_commands_cleanup(&scene_commands);
+	vkx_secondary_commands_cleanup(&static_commands);
+	if (bindless_textures && texture_streaming) {
+		vkx_residency_cleanup();
+	}
+	else if (bindless_textures) {
+		for (size_t i = 0; i < _TEX_COUNT; i++) {
+			vkx_texture_table_remove(texture_table_indices[i]);
+			vkx_cleanup_image(&textures[i]);
+		}
+	}
+	else {
+		if (use_sparse_atlas()) {
+			vkx_sparse_atlas_cleanup();
+		}
+		vkx_cleanup_atlas(&texture_atlas);
+		if (lighting) {
+			vkx_cleanup_atlas(&normal_atlas);
+		}
+		if (palette_textures) {
+			vkx_cleanup_image(&palette_image);
+		}
+	}
+
+	vkx_cleanup_ring_buffer(&frame_ring);
+
+	if (sprite_render_queue) {
+		render_queue_cleanup(&sprite_queue);
+	}
+	render_queue_cleanup(&batched_sprite_queue);
+	
+	vkDestroyDescriptorPool(vkx_instance.device, descriptor_pool, vkx_get_allocator(VK_OBJECT_TYPE_DESCRIPTOR_POOL));
+	
+	vkx_cleanup_pipeline(tile_pipeline);
+	if (has_tile_cache_pipeline()) {
+		vkx_cleanup_pipeline(tile_cache_pipeline);
+	}
+	if (tile_texture_tilemap) {
+		vkx_cleanup_pipeline(tile_map_pipeline);
+		vkx_cleanup_image(&tile_index_image);
+	}
+	free(tile_edits);
+	if (tile_layers || half_res_background || use_chunk_impostors()) {
+		vkx_cleanup_pipeline(tile_layer_pipeline);
+	}
+	if (use_chunk_impostors()) {
+		vkx_cleanup_pipeline(chunk_impostor_pipeline);
+		vkx_cleanup_image(&chunk_impostor_atlas);
+	}
+	vkx_cleanup_pipeline(screen_pipeline);
+	if (scene_to_swap_chain) {
+		vkx_push_set_cleanup(&scene_input_set);
+	}
+	if (performance_hud) {
+		hud_cleanup(&hud);
+	}
+	if (use_debug_shapes()) {
+		debug_draw_cleanup(&debug_drawer);
+	}
+	post_chain_cleanup(&post_chain);
+	for (uint32_t i = 0; i < _SPRITE_PIPELINE_COUNT; i++) {
+		// Some ids can share a pipeline, and the pipeline manager destroys its own
+		if (i == SPRITE_PIPELINE_TRANSLUCENT && sprite_pipelines[i] == &sprite_opaque_pipeline) {
+			continue;
+		}
+		if (sprite_pipeline_requests[i] == SPRITE_PIPELINE_NO_REQUEST) {
+			vkx_cleanup_pipeline(*sprite_pipelines[i]);
+		}
+	}
+	if (gpu_sprite_simulation) {
+		vkx_cleanup_pipeline(sprite_sim_pipeline);
+	}
+	if (use_mesh_shader_sprites()) {
+		vkx_cleanup_pipeline(sprite_mesh_pipeline);
+	}
+	else if (gpu_sprite_culling) {
+		vkx_cleanup_pipeline(sprite_cull_pipeline);
+	}
+	if (use_sprite_frame_table()) {
+		vkx_cleanup_pipeline(framed_sprite_pipeline);
+	}
+	vkx_cleanup_pipeline(shape_pipeline);
+	if (DEMO_SKINNED_CHARACTERS > 0) {
+		vkx_cleanup_pipeline(skinned_pipeline);
+	}
+	if (gpu_particles) {
+		vkx_cleanup_pipeline(particle_emit_pipeline);
+		vkx_cleanup_pipeline(particle_update_pipeline);
+	}
+	if (lighting) {
+		vkx_cleanup_pipeline(light_cull_pipeline);
+	}
+	if (light_shadows) {
+		vkx_cleanup_pipeline(shadow_map_pipeline);
+	}
+
+	if (hot_reloading) {
+		hot_reload_cleanup();
+	}
+
+	// Save the compiled pipelines for next time, after the background ones
+	vkx_pipeline_manager_cleanup();
+	vkx_cleanup_pipeline_cache();
+
+	if (bindless_textures) {
+		vkx_texture_table_cleanup();
+	}
+
+	if (chunked_tilemap) {
+		tilemap_cleanup(&tilemap);
+	}
+	else if (tile_texture_tilemap) {
+		vkx_cleanup_buffer(&tile_map_quad_vertex_buffer);
+	}
+	else {
+		vkx_cleanup_buffer(&vertex_buffer);
+	}
+	vkx_cleanup_buffer(&quad_index_buffer);
+	if (tile_layers) {
+		for (size_t i = 0; i < TILE_LAYERS_COUNT; i++) {
+			// The chunks of the cached layers went after caching
+			if (layers[i].cached) {
+				vkx_cleanup_image(&layers[i].cache_image);
+			}
+			else {
+				tilemap_cleanup(&layers[i].tilemap);
+			}
+			free(layers[i].tiles);
+		}
+	}
+	if (tile_layers || half_res_background) {
+		vkx_cleanup_buffer(&tile_layer_quad_vertex_buffer);
+	}
+	vkx_cleanup_buffer(&sprite_vertex_buffer);
+	if (use_sprite_frame_table()) {
+		vkx_cleanup_buffer(&sprite_frame_buffer);
+		free(sprite_frames);
+	}
+	if (DEMO_SKINNED_CHARACTERS > 0) {
+		vkx_cleanup_buffer(&skinned_vertex_buffer);
+		vkx_cleanup_buffer(&skinned_index_buffer);
+	}
+	vkx_cleanup_buffer(&retained_transform_buffer);
+	vkx_cleanup_buffer(&retained_record_buffer);
+	if (gpu_sprite_simulation) {
+		vkx_cleanup_buffer(&sprite_state_buffer);
+		vkx_cleanup_buffer(&sprite_transform_buffer);
+		vkx_cleanup_buffer(&sprite_event_buffer);
+	}
+	if (use_sprite_events()) {
+		for (uint32_t i = 0; i < VKX_MAX_FRAMES_IN_FLIGHT; i++) {
+			vkx_cleanup_buffer(&sprite_event_readback_buffers[i]);
+		}
+	}
+	if (gpu_sprite_culling && !use_mesh_shader_sprites()) {
+		vkx_cleanup_buffer(&visible_sprite_buffer);
+		vkx_cleanup_buffer(&sprite_indirect_buffer);
+	}
+	if (gpu_particles) {
+		vkx_cleanup_buffer(&particle_buffer);
+		vkx_cleanup_buffer(&particle_dead_list_buffer);
+		vkx_cleanup_buffer(&particle_transform_buffer);
+		vkx_cleanup_buffer(&particle_record_buffer);
+		vkx_cleanup_buffer(&particle_indirect_buffer);
+	}
+	if (lighting) {
+		vkx_cleanup_buffer(&light_buffer);
+		vkx_cleanup_buffer(&light_tile_buffer);
+		vkx_cleanup_buffer(&shadow_buffer);
+	}
+	if (light_shadows) {
+		vkx_cleanup_buffer(&occluder_buffer);
+	}
+	
+	vkx_frame_graph_cleanup(&frame_graph);
+
+	vkx_cleanup_instance();
+}
+
+double rand_double(double exclusive_max) {
+	for (;;) {
+		double result = ((double)rand() / (double)RAND_MAX) * exclusive_max;
+		if (result < exclusive_max) {
+			return result;
+		}
+	}
+}
+
+int rand_range(int min, int exclusive_max) {
+	/*
+	 * Return a random number between min and exclusive max
+	 */
+	return min + (int)rand_double((double)(exclusive_max - min));
+}
+
+void set_map_tile(uint32_t x, uint32_t y, uint16_t value) {
+	/*
+	 * Change a tile in the map.  Only that tile's texel in the tile index image, or
+	 * its vertices and indices in the tile mesh, are updated on the next frame.
+	 * The chunked tilemap rebuilds the chunk the tile is in
+	 *
+	 * @param x The x coordinate of the tile
+	 * @param y The y coordinate of the tile
+	 * @param value The tileset index, or EMPTY
+	 */
+	if (x >= map_x_tiles || y >= map_y_tiles) {
+		return;
+	}
+
+	if (get_map_tile(x, y) == value) {
+		return;
+	}
+	render_stream_add_tile(x, y, value);
+	if (use_sparse_tiles()) {
+		tile_store_set(&tile_store, (int32_t) x, (int32_t) y, value);
+	}
+	else {
+		tiles[get_tile_index(x, y)] = (uint8_t) value;
+	}
+	tile_solidity_set(&tile_solidity, x, y, value != EMPTY);
+	flow_field_tile_changed(&monster_flow_field, x, y, value != EMPTY);
+	if (light_shadows && !occluder_rows_dirty[y]) {
+		occluder_rows_dirty[y] = true;
+		occluder_rows_dirty_count++;
+	}
+
+	if (chunked_tilemap) {
+		tilemap_tile_changed(&tilemap, x, y);
+		return;
+	}
+
+	// The value is read when the copy is staged, so a tile only needs to
+	// be in the list once
+	for (uint32_t i = 0; i < tile_edits_count; i++) {
+		if (tile_edits[i].x == x && tile_edits[i].y == y) {
+			return;
+		}
+	}
+
+	if (tile_edits_count == tile_edits_capacity) {
+		tile_edits_capacity = tile_edits_capacity == 0 ? MAX_TILE_EDITS_PER_FRAME : tile_edits_capacity * 2;
+		tile_edits = realloc(tile_edits, sizeof(TileEdit) * tile_edits_capacity);
+		if (tile_edits == NULL) {
+			fprintf(stderr, "Failed to allocate the tile edits\n");
+			exit(1);
+		}
+	}
+
+	tile_edits[tile_edits_count].x = x;
+	tile_edits[tile_edits_count].y = y;
+	tile_edits_count++;
+}
+
+void world_chunk_changed(int32_t chunk_x, int32_t chunk_y, void* data) {
+	/*
+	 * A chunk of the streamed world came in or was evicted, so the collisions
+	 * and the tilemap need to catch up
+	 */
+	(void) data;
+	for (uint32_t i = 0; i < TILE_STORE_CHUNK_SIZE * TILE_STORE_CHUNK_SIZE; i++) {
+		uint32_t x = (uint32_t) chunk_x * TILE_STORE_CHUNK_SIZE + i % TILE_STORE_CHUNK_SIZE;
+		uint32_t y = (uint32_t) chunk_y * TILE_STORE_CHUNK_SIZE + i / TILE_STORE_CHUNK_SIZE;
+		if (chunk_x < 0 || chunk_y < 0 || x >= map_x_tiles || y >= map_y_tiles) {
+			continue;
+		}
+
+		bool solid = get_map_tile(x, y) != EMPTY;
+		if (solid == tile_solidity_is_solid(&tile_solidity, x, y)) {
+			continue;
+		}
+		tile_solidity_set(&tile_solidity, x, y, solid);
+		flow_field_tile_changed(&monster_flow_field, x, y, solid);
+		if (light_shadows && !occluder_rows_dirty[y]) {
+			occluder_rows_dirty[y] = true;
+			occluder_rows_dirty_count++;
+		}
+	}
+	tilemap_tile_changed(&tilemap, (uint32_t) chunk_x * TILE_STORE_CHUNK_SIZE, (uint32_t) chunk_y * TILE_STORE_CHUNK_SIZE);
+}
+
+void create_tiles(void) {
+	if (level_loaded) {
+		map_x_tiles = level_snapshot.header.map_width;
+		map_y_tiles = level_snapshot.header.map_height;
+	}
+	else if (bench_is_running()) {
+		map_x_tiles = bench_options.scenario->map_width;
+		map_y_tiles = bench_options.scenario->map_height;
+	}
+	else if (chunked_tilemap || tile_texture_tilemap) {
+		map_x_tiles = LARGE_MAP_X_TILES;
+		map_y_tiles = LARGE_MAP_Y_TILES;
+	}
+
+	if (use_sparse_tiles()) {
+		tile_store_init(&tile_store, EMPTY);
+	}
+	else {
+		tiles = malloc(sizeof(uint8_t) * map_x_tiles * map_y_tiles);
+		if (tiles == NULL) {
+			fprintf(stderr, "Failed to allocate the tiles\n");
+			exit(1);
+		}
+	}
+
+	// The number of occupied tiles
+	size_t num_tiles = 0;
+
+	// Only print small maps
+	const bool print_tiles = !chunked_tilemap && !tile_texture_tilemap;
+
+	// A streamed world is generated once, and read from its regions after that
+	char world_filename[256];
+	world_get_region_filename(WORLD_REGION_PREFIX, 0, 0, world_filename, sizeof(world_filename));
+	const bool world_exists = use_streamed_world() && file_exists(world_filename);
+
+	// Generate a random set of tiles (unless the level was loaded), the same
+	// set every benchmark run and replay.  The monsters are created after this,
+	// so they come out the same too
+	srand(random_seed);
+	if (level_loaded) {
+		// They're in the same order in the snapshot
+		size_t size = sizeof(uint8_t) * map_x_tiles * map_y_tiles;
+		if (!level_copy_blob(&level_snapshot, LEVEL_BLOB_TILES, tiles, size)) {
+			fprintf(stderr, "The level's tiles are missing\n");
+			exit(1);
+		}
+		for (size_t i = 0; i < (size_t) map_x_tiles * map_y_tiles; i++) {
+			if (tiles[i] > EMPTY) {
+				fprintf(stderr, "The level has a tile %d, which isn't in the tileset\n", tiles[i]);
+				exit(1);
+			}
+			num_tiles += tiles[i] != EMPTY;
+		}
+	}
+	else if (!world_exists) {
+		for (int y = map_y_tiles - 1; y >= 0; y--) {
+			for (size_t x = 0; x < map_x_tiles; x++) {
+				uint8_t value;
+
+				// Edge tiles are always occupied
+				if(x == 0 || x == map_x_tiles - 1 || y == 0 || y == (int) map_y_tiles - 1) {
+					value = 0;
+				}
+				// 2/3 of the rest are empty
+				else if(rand() % 3 >= 2) {
+					value = (uint8_t) rand_range(0, TILESET_TOTAL_TILES);
+				} else {
+					value = EMPTY;
+				}
+
+				if (use_sparse_tiles()) {
+					tile_store_set(&tile_store, (int32_t) x, y, value);
+				}
+				else {
+					tiles[get_tile_index(x, y)] = value;
+				}
+
+				if (value != EMPTY) {
+					num_tiles++;
+				}
+
+				// Debug test stuff
+				if (!print_tiles) {
+					continue;
+				}
+				if (value == EMPTY) {
+					printf("-- ");
+				}
+				else {
+					if (value < 10) {
+						printf("0");
+					}
+					printf("%d ", value);
+				}
+			}
+			if (print_tiles) {
+				printf("\n");
+			}
+		}
+	}
+
+	if (use_sparse_tiles()) {
+		printf("Sparse tiles have %u chunks in %zu KB, for %zu KB of tiles\n", tile_store.chunks_count,
+			tile_store_get_memory(&tile_store) / 1024, (size_t) map_x_tiles * map_y_tiles / 1024);
+	}
+
+	// Everything is streamed back in from the regions as it's needed
+	if (use_streamed_world()) {
+		if (!world_exists && !world_write_regions(WORLD_REGION_PREFIX, &tile_store)) {
+			exit(1);
+		}
+		tile_store_cleanup(&tile_store);
+		tile_store_init(&tile_store, EMPTY);
+		world_stream_init(&world_stream, WORLD_REGION_PREFIX, &tile_store, WORLD_MEMORY_BUDGET, world_chunk_changed, NULL);
+	}
+
+	// The chunked tilemap builds its own meshes
+	if (chunked_tilemap) {
+		return;
+	}
+
+	// The tile texture is drawn on a single quad over the whole map instead
+	if (tile_texture_tilemap) {
+		return;
+	}
+
+	// Generate the mesh for the tilemap.  Every tile gets 4 vertices, even empty
+	// ones, so a tile can be changed by patching its slot
+	if (map_x_tiles * map_y_tiles > TILEMAP_MAX_QUADS) {
+		fprintf(stderr, "The map is too big for 16 bit tile indices\n");
+		exit(1);
+	}
+
+	vertices_count = map_x_tiles * map_y_tiles * 4;
+	vertices = malloc(sizeof(TileVertex) * vertices_count);
+	if (vertices == NULL) {
+		fprintf(stderr, "Failed to allocate the tile mesh\n");
+		exit(1);
+	}
+
+	for (size_t y = 0; y < map_y_tiles; y++) {
+		for (size_t x = 0; x < map_x_tiles; x++) {
+			write_tile_vertices(x, y, &vertices[get_tile_index(x, y) * 4]);
+		}
+	}
+
+	printf("Tile mesh has %zu occupied tiles of %zu\n", num_tiles, (size_t) map_x_tiles * map_y_tiles);
+}
+
+void init_tile_solidity(void) {
+	/*
+	 * Work out which tiles are solid, going through only the chunks there are
+	 * with sparse tiles
+	 */
+	tile_solidity_init(&tile_solidity, tiles, map_x_tiles, map_y_tiles, EMPTY);
+	for (uint32_t i = 0; i < tile_store.chunks_count; i++) {
+		const TileStoreChunk* chunk = tile_store.chunks[i];
+		for (uint32_t j = 0; j < TILE_STORE_CHUNK_SIZE * TILE_STORE_CHUNK_SIZE; j++) {
+			if (chunk->tiles[j] != EMPTY) {
+				uint32_t x = (uint32_t) chunk->x * TILE_STORE_CHUNK_SIZE + j % TILE_STORE_CHUNK_SIZE;
+				uint32_t y = (uint32_t) chunk->y * TILE_STORE_CHUNK_SIZE + j / TILE_STORE_CHUNK_SIZE;
+				tile_solidity_set(&tile_solidity, x, y, true);
+			}
+		}
+	}
+}
+
+void create_tile_layers(void) {
+	/*
+	 * Generate the tiles for the extra tile layers.  Each layer is sized so that
+	 * the view stays inside it wherever the camera is on the map
+	 */
+	for (size_t i = 0; i < TILE_LAYERS_COUNT; i++) {
+		TileLayer* layer = &layers[i];
+		layer->desc = TILE_LAYER_DESCS[i];
+		layer->width = X_TILES + (uint32_t) ceilf((float) (map_x_tiles - X_TILES) * layer->desc.parallax);
+		layer->height = Y_TILES + (uint32_t) ceilf((float) (map_y_tiles - Y_TILES) * layer->desc.parallax);
+
+		layer->tiles = malloc(sizeof(uint8_t) * layer->width * layer->height);
+		if (layer->tiles == NULL) {
+			fprintf(stderr, "Failed to allocate the tile layer\n");
+			exit(1);
+		}
+
+		// Sparser than the map so the layers behind show through
+		for (size_t j = 0; j < (size_t) layer->width * layer->height; j++) {
+			layer->tiles[j] = rand() % 4 == 0 ? (uint8_t) rand_range(0, TILESET_TOTAL_TILES) : EMPTY;
+		}
+	}
+}
+
+SpritePipeline classify_sprite_frame(const uint8_t* pixels, int width, int x0, int y0, int frame_width, int frame_height) {
+	/*
+	 * Pick the pipeline for a frame of a sprite sheet from its alpha
+	 *
+	 * @param pixels The RGBA sheet
+	 * @param width The width of the sheet in pixels
+	 * @param x0, y0 The top left of the frame in pixels
+	 * @param frame_width, frame_height The size of the frame in pixels
+	 */
+	size_t visible = 0;
+	size_t soft = 0;
+	size_t transparent = 0;
+
+	for (int y = y0; y < y0 + frame_height; y++) {
+		for (int x = x0; x < x0 + frame_width; x++) {
+			uint8_t alpha = pixels[((size_t) y * width + x) * 4 + 3];
+			if (alpha == 0) {
+				transparent++;
+			}
+			else {
+				visible++;
+				soft += alpha < 255;
+			}
+		}
+	}
+
+	if (transparent == 0 && soft == 0) {
+		return SPRITE_PIPELINE_OPAQUE;
+	}
+	if ((float) soft <= (float) visible * TRANSLUCENT_FRAME_THRESHOLD) {
+		return SPRITE_PIPELINE_CUTOUT;
+	}
+	return SPRITE_PIPELINE_TRANSLUCENT;
+}
+
+uint16_t trim_sprite_frame(const VkxPixelBounds* bounds, int frame_width, int frame_height) {
+	/*
+	 * Work out how much of each side of a frame of a sprite sheet can be left out
+	 * of its quad.  The bounds of the pixels which aren't fully transparent are
+	 * grown by a texel for the filtering, then rounded out to SPRITE_TRIM_STEPS
+	 *
+	 * @param bounds The frame's visible pixels, from vkx_convert_pixels()
+	 * @param frame_width, frame_height The size of the frame in pixels
+	 *
+	 * @return VertexBufferSprite.trim: the steps off the left, top, right and
+	 *         bottom of the frame, a nibble each from the low bits up.  0 for a
+	 *         frame with nothing visible, which isn't worth special casing
+	 */
+	int min_x = bounds->min_x;
+	int min_y = bounds->min_y;
+	int max_x = bounds->max_x;
+	int max_y = bounds->max_y;
+	if (max_x < min_x) {
+		return 0;
+	}
+
+	min_x = min_x > 0 ? min_x - 1 : 0;
+	min_y = min_y > 0 ? min_y - 1 : 0;
+	max_x = max_x < frame_width - 1 ? max_x + 1 : frame_width - 1;
+	max_y = max_y < frame_height - 1 ? max_y + 1 : frame_height - 1;
+
+	// Rounding down keeps at least the visible texels on both axes
+	uint16_t left = (uint16_t) (min_x * SPRITE_TRIM_STEPS / frame_width);
+	uint16_t top = (uint16_t) (min_y * SPRITE_TRIM_STEPS / frame_height);
+	uint16_t right = (uint16_t) ((frame_width - 1 - max_x) * SPRITE_TRIM_STEPS / frame_width);
+	uint16_t bottom = (uint16_t) ((frame_height - 1 - max_y) * SPRITE_TRIM_STEPS / frame_height);
+	return (uint16_t) (left | top << 4 | right << 8 | bottom << 12);
+}
+
+uint16_t union_sprite_trims(uint16_t a, uint16_t b) {
+	/*
+	 * The trim which fits the visible parts of both frames, for a flipbook
+	 */
+	uint16_t trim = 0;
+	for (uint32_t shift = 0; shift < 16; shift += 4) {
+		uint16_t side_a = (a >> shift) & 0xf;
+		uint16_t side_b = (b >> shift) & 0xf;
+		trim |= (uint16_t) ((side_a < side_b ? side_a : side_b) << shift);
+	}
+	return trim;
+}
+
+float get_sprite_trim_area(uint16_t trim) {
+	/*
+	 * The fraction of the quad a trim leaves
+	 */
+	float width = (float) (SPRITE_TRIM_STEPS - (trim & 0xf) - ((trim >> 8) & 0xf)) / SPRITE_TRIM_STEPS;
+	float height = (float) (SPRITE_TRIM_STEPS - ((trim >> 4) & 0xf) - (trim >> 12)) / SPRITE_TRIM_STEPS;
+	return width * height;
+}
+
+void classify_monster_frames(SpritePipeline frame_pipelines[_TEX_COUNT][MONSTER_FRAMES_X * MONSTER_FRAMES_Y],
+		uint16_t frame_trims[_TEX_COUNT][MONSTER_FRAMES_X * MONSTER_FRAMES_Y]) {
+	/*
+	 * Work out the pipeline and trim for every frame of the monster sheets, which
+	 * means decoding them here as well as when they are uploaded
+	 *
+	 * @param frame_pipelines Filled in for the monster textures, row by row
+	 * @param frame_trims The same for trim_sprite_frame()
+	 */
+	for (uint32_t texture = TEX_MONSTERS; texture < _TEX_COUNT; texture++) {
+		int width, height;
+		stbi_uc* pixels = vkx_load_image_pixels(TEXTURE_FILENAMES[texture], &width, &height);
+		if (pixels == NULL) {
+			fprintf(stderr, "Failed to load texture image %s\n", TEXTURE_FILENAMES[texture]);
+			exit(1);
+		}
+
+		// The frames' visible pixels in one pass over the sheet
+		VkxPixelBounds bounds[MONSTER_FRAMES_X * MONSTER_FRAMES_Y];
+		VkxPixelConversion conversion = {0};
+		conversion.flags = VKX_PIXELS_BOUNDS;
+		conversion.regions_x = MONSTER_FRAMES_X;
+		conversion.regions_y = MONSTER_FRAMES_Y;
+		conversion.bounds = bounds;
+		vkx_convert_pixels(&conversion, pixels, NULL, (uint32_t) width, (uint32_t) height);
+
+		int frame_width = width / MONSTER_FRAMES_X;
+		int frame_height = height / MONSTER_FRAMES_Y;
+		for (int y = 0; y < MONSTER_FRAMES_Y; y++) {
+			for (int x = 0; x < MONSTER_FRAMES_X; x++) {
+				frame_pipelines[texture][x + y * MONSTER_FRAMES_X] = classify_sprite_frame(
+					pixels, width, x * frame_width, y * frame_height, frame_width, frame_height
+				);
+				frame_trims[texture][x + y * MONSTER_FRAMES_X] = trim_sprite_frame(
+					&bounds[x + y * MONSTER_FRAMES_X], frame_width, frame_height
+				);
+			}
+		}
+
+		stbi_image_free(pixels);
+	}
+}
+
+bool tile_is_low_detail(const uint8_t* pixels, int width, int x0, int y0, int tile_width, int tile_height) {
+	/*
+	 * Whether a tile of the tileset can be shaded at 2x2 without it showing:
+	 * it's opaque (a 2x2 fragment discards all four pixels or none) and its
+	 * brightness is near its average all over
+	 *
+	 * @param pixels The RGBA tileset
+	 * @param width The width of the tileset in pixels
+	 * @param x0, y0 The top left of the tile in pixels
+	 * @param tile_width, tile_height The size of the tile in pixels
+	 */
+	double sum = 0.0;
+	double sum_squares = 0.0;
+	for (int y = y0; y < y0 + tile_height; y++) {
+		for (int x = x0; x < x0 + tile_width; x++) {
+			const uint8_t* pixel = &pixels[((size_t) y * width + x) * 4];
+			if (pixel[3] < 255) {
+				return false;
+			}
+			double luminance = (0.2126 * pixel[0] + 0.7152 * pixel[1] + 0.0722 * pixel[2]) / 255.0;
+			sum += luminance;
+			sum_squares += luminance * luminance;
+		}
+	}
+
+	double count = (double) tile_width * tile_height;
+	double mean = sum / count;
+	double variance = sum_squares / count - mean * mean;
+	return variance <= (double) LOW_DETAIL_TILE_DEVIATION * LOW_DETAIL_TILE_DEVIATION;
+}
+
+bool tile_is_opaque(const uint8_t* pixels, int width, int x0, int y0, int tile_width, int tile_height) {
+	/*
+	 * Whether a tile of the tileset has no transparent pixels, so nothing
+	 * behind it shows through
+	 *
+	 * @param pixels The RGBA tileset
+	 * @param width The width of the tileset in pixels
+	 * @param x0, y0 The top left of the tile in pixels
+	 * @param tile_width, tile_height The size of the tile in pixels
+	 */
+	for (int y = y0; y < y0 + tile_height; y++) {
+		for (int x = x0; x < x0 + tile_width; x++) {
+			if (pixels[((size_t) y * width + x) * 4 + 3] < 255) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+void classify_tileset_tiles(void) {
+	/*
+	 * Work out which tiles of the tileset are low detail for the shading rate
+	 * mask and which are opaque for the occlusion mask, which means decoding
+	 * it here as well as when it's uploaded
+	 */
+	int width, height;
+	stbi_uc* pixels = vkx_load_image_pixels(TEXTURE_FILENAMES[TEX_TILES], &width, &height);
+	if (pixels == NULL) {
+		fprintf(stderr, "Failed to load texture image %s\n", TEXTURE_FILENAMES[TEX_TILES]);
+		exit(1);
+	}
+
+	int tile_width = width / TILESET_X_TILES;
+	int tile_height = height / TILESET_Y_TILES;
+	uint32_t low_detail_count = 0;
+	for (uint32_t i = 0; i < TILESET_TOTAL_TILES; i++) {
+		int x = (int) (i % TILESET_X_TILES);
+		int y = (int) (i / TILESET_X_TILES);
+		low_detail_tiles[i] = tile_is_low_detail(pixels, width, x * tile_width, y * tile_height, tile_width, tile_height);
+		low_detail_count += low_detail_tiles[i];
+		opaque_tiles[i] = tile_is_opaque(pixels, width, x * tile_width, y * tile_height, tile_width, tile_height);
+	}
+	low_detail_tiles[EMPTY] = true;
+	opaque_tiles[EMPTY] = false;
+	stbi_image_free(pixels);
+
+	// An animated tile is only opaque if every frame of it is
+	for (size_t i = 0; animated_tiles && i < sizeof(TILE_ANIMATIONS) / sizeof(TILE_ANIMATIONS[0]); i++) {
+		const TileAnimation* animation = &TILE_ANIMATIONS[i];
+		for (uint32_t frame = 1; frame < animation->frames; frame++) {
+			opaque_tiles[animation->tile] &= opaque_tiles[animation->tile + frame * animation->stride];
+		}
+	}
+
+	if (use_shading_rate_image()) {
+		printf("%u of %u tiles are shaded at 2x2\n", low_detail_count, TILESET_TOTAL_TILES);
+	}
+}
+
+size_t get_sprites_per_monster(void) {
+	// Instanced sprites only need a single record, otherwise we need 1 per vertex
+	return instanced_sprites ? 1 : 6;
+}
+
+uint32_t get_level_flags(void) {
+	/*
+	 * The settings a level's sprites were made with, which it has to be loaded
+	 * with too
+	 */
+	const bool blend_all = translucent_sprites || !depth_buffer;
+	return (uint32_t) blend_all | (uint32_t) trimmed_sprites << 1 | (uint32_t) animated_monsters << 2;
+}
+
+bool open_level(const char* filename) {
+	/*
+	 * Open the level snapshot to create the tiles and monsters from, before
+	 * anything is sized by monsters_count
+	 *
+	 * @return false if it isn't a level, or was saved with different settings
+	 */
+	if (!level_open(&level_snapshot, filename)) {
+		return false;
+	}
+
+	const LevelHeader* header = &level_snapshot.header;
+	if (header->flags != get_level_flags() || header->sprite_size != sizeof(VertexBufferSprite)
+			|| header->sprites_per_monster != get_sprites_per_monster()) {
+		fprintf(stderr, "Level %s was saved with different sprite settings\n", filename);
+		level_close(&level_snapshot);
+		return false;
+	}
+	if (header->map_width == 0 || header->map_height == 0) {
+		fprintf(stderr, "Level %s has no tiles\n", filename);
+		level_close(&level_snapshot);
+		return false;
+	}
+
+	monsters_count = header->monsters_count;
+	level_loaded = true;
+	return true;
+}
+
+void load_level_monsters(void) {
+	/*
+	 * Copy the monsters out of the level snapshot, and their sprites, which
+	 * are ready to upload
+	 */
+	const struct {
+		LevelBlobId id;
+		void* data;
+		size_t size;
+	} arrays[] = {
+		{LEVEL_BLOB_MONSTER_X, monsters.x, sizeof(float)},
+		{LEVEL_BLOB_MONSTER_Y, monsters.y, sizeof(float)},
+		{LEVEL_BLOB_MONSTER_Z, monsters.z, sizeof(float)},
+		{LEVEL_BLOB_MONSTER_VX, monsters.vx, sizeof(float)},
+		{LEVEL_BLOB_MONSTER_VY, monsters.vy, sizeof(float)},
+		{LEVEL_BLOB_MONSTER_ANIM_PHASE, monsters.anim_phase, sizeof(float)},
+		{LEVEL_BLOB_MONSTER_COLOR, monsters.color, sizeof(vec4)},
+		{LEVEL_BLOB_MONSTER_TEXTURE, monsters.texture, sizeof(uint32_t)},
+		{LEVEL_BLOB_MONSTER_PIPELINE, monsters.pipeline, sizeof(uint32_t)},
+		{LEVEL_BLOB_SPRITES, vertex_sprites, sizeof(VertexBufferSprite) * get_sprites_per_monster()},
+	};
+	for (size_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]); i++) {
+		if (!level_copy_blob(&level_snapshot, arrays[i].id, arrays[i].data, arrays[i].size * monsters_count)) {
+			fprintf(stderr, "The level's monsters are missing\n");
+			exit(1);
+		}
+	}
+
+	for (size_t i = 0; i < monsters_count; i++) {
+		if (monsters.texture[i] < TEX_MONSTERS || monsters.texture[i] >= _TEX_COUNT
+				|| monsters.pipeline[i] >= _SPRITE_PIPELINE_COUNT) {
+			fprintf(stderr, "The level has a bad monster %zu\n", i);
+			exit(1);
+		}
+	}
+}
+
+void* allocate_monster_array(size_t element_size) {
+	void* array = malloc(element_size * monsters_count);
+	if (array == NULL) {
+		fprintf(stderr, "Failed to allocate the data for %u monsters\n", monsters_count);
+		exit(1);
+	}
+	return array;
+}
+
+void create_monsters(void) {
+	monsters.x = allocate_monster_array(sizeof(float));
+	monsters.y = allocate_monster_array(sizeof(float));
+	monsters.z = allocate_monster_array(sizeof(float));
+	monsters.prev_x = allocate_monster_array(sizeof(float));
+	monsters.prev_y = allocate_monster_array(sizeof(float));
+	monsters.vx = allocate_monster_array(sizeof(float));
+	monsters.vy = allocate_monster_array(sizeof(float));
+	monsters.anim_phase = allocate_monster_array(sizeof(float));
+	monsters.color = allocate_monster_array(sizeof(vec4));
+	monsters.texture = allocate_monster_array(sizeof(uint32_t));
+	monsters.pipeline = allocate_monster_array(sizeof(uint32_t));
+	for (size_t i = 0; i < FRAME_PIPELINE_SNAPSHOTS; i++) {
+		frame_states[i].x = allocate_monster_array(sizeof(float));
+		frame_states[i].y = allocate_monster_array(sizeof(float));
+		frame_states[i].prev_x = allocate_monster_array(sizeof(float));
+		frame_states[i].prev_y = allocate_monster_array(sizeof(float));
+	}
+	monsters_in_view = allocate_monster_array(sizeof(bool));
+
+	// Which pipeline each frame of the sheets needs, unless everything is blended,
+	// and how much of it can be trimmed off
+	// Without the depth buffer they're all blended, as nothing can be drawn out
+	// of order
+	const bool blend_all = translucent_sprites || !depth_buffer;
+	// A loaded level already has them in its sprites
+	SpritePipeline frame_pipelines[_TEX_COUNT][MONSTER_FRAMES_X * MONSTER_FRAMES_Y] = {0};
+	uint16_t frame_trims[_TEX_COUNT][MONSTER_FRAMES_X * MONSTER_FRAMES_Y] = {0};
+	if (!level_loaded && (!blend_all || trimmed_sprites)) {
+		classify_monster_frames(frame_pipelines, frame_trims);
+	}
+
+	// Create the array to hold sprite data
+	const size_t vertices_per_sprite = get_sprites_per_monster();
+	vertex_sprites_count = monsters_count * vertices_per_sprite;
+	vertex_sprites = malloc(sizeof(VertexBufferSprite) * vertex_sprites_count);
+
+	if (level_loaded) {
+		load_level_monsters();
+	}
+
+	// Create the monsters and their and their "sprites"
+	for (size_t i=0; i<monsters_count && !level_loaded; i++) {
+		monsters.x[i] = rand_double(X_TILES);
+		monsters.y[i] = rand_double(Y_TILES);
+		// Half of the monsters will be in front of the tiles and half
+		// will be behind
+		monsters.z[i] = rand_double(18) + 1;
+
+		monsters.vx[i] = rand_double(10) - 5;
+		monsters.vy[i] = rand_double(10) - 5;
+		monsters.anim_phase[i] = (float) fmod((double) i * 5.0, 2.0 * GLM_PI);
+		
+		// Fade to blue as the monsters z coord puts them in the background
+		float blue_fade = monsters.z[i] / 20.0f;
+		monsters.color[i][0] = 1.0f - blue_fade;
+		monsters.color[i][1] = 1.0f - blue_fade;
+		monsters.color[i][2] = 1.0f - blue_fade * 0.6f;
+		monsters.color[i][3] = 1.0f;
+
+		monsters.texture[i] = TEX_MONSTERS + (i / 16) % 4;
+
+		assert(monsters.texture[i] < _TEX_COUNT);
+		assert(monsters.texture[i] >= TEX_MONSTERS);
+
+		// The frame in the 4x4 grid of sprites on the sheet.  Animated ones
+		// start from the first frame, and need a pipeline for all of them
+		const uint32_t frames = MONSTER_FRAMES_X * MONSTER_FRAMES_Y;
+		size_t frame = i % frames;
+		monsters.pipeline[i] = blend_all ? SPRITE_PIPELINE_TRANSLUCENT : frame_pipelines[monsters.texture[i]][frame];
+		uint16_t trim = trimmed_sprites ? frame_trims[monsters.texture[i]][frame] : 0;
+		uint32_t flipbook = 0;
+		if (animated_monsters) {
+			flipbook = pack_sprite_flipbook((uint32_t) frame, frames, MONSTER_FRAMES_X, MONSTER_ANIM_FPS);
+			for (uint32_t f = 0; f < frames && !blend_all; f++) {
+				SpritePipeline pipeline = frame_pipelines[monsters.texture[i]][f];
+				monsters.pipeline[i] = pipeline > monsters.pipeline[i] ? pipeline : monsters.pipeline[i];
+			}
+			// The quad stays the same size as it plays, so it fits every frame
+			for (uint32_t f = 0; f < frames && trimmed_sprites; f++) {
+				trim = union_sprite_trims(trim, frame_trims[monsters.texture[i]][f]);
+			}
+			frame = 0;
+		}
+
+		// Create the sprite vertices
+		for (size_t j=0; j<vertices_per_sprite; j++ ) {
+			size_t idx = i * vertices_per_sprite + j;
+			assert(idx < vertex_sprites_count);
+
+			for (size_t k=0; k<4; k++) {
+				vertex_sprites[idx].color[k] = pack_unorm8(monsters.color[i][k]);
+			}
+			// Calculate uv index based on the grid of sprites
+			size_t sprite_x = frame % MONSTER_FRAMES_X;
+			size_t sprite_y = frame / MONSTER_FRAMES_X;
+			float u_scale = 1.0f / MONSTER_FRAMES_X;
+			float v_scale = 1.0f / MONSTER_FRAMES_Y;
+
+			float u = u_scale * sprite_x;
+			float v = v_scale * sprite_y;
+			assert(u >= 0.0f && u + u_scale <= 1.0f);
+			assert(v >= 0.0f && v + v_scale <= 1.0f);
+
+			vertex_sprites[idx].uv[0] = VERTEX_PACK(SPRITE_UV_PACKING, u);
+			vertex_sprites[idx].uv[1] = VERTEX_PACK(SPRITE_UV_PACKING, v);
+			vertex_sprites[idx].uv2[0] = VERTEX_PACK(SPRITE_UV_PACKING, u + u_scale);
+			vertex_sprites[idx].uv2[1] = VERTEX_PACK(SPRITE_UV_PACKING, v + v_scale);
+			vertex_sprites[idx].texture_index = set_sprite_texture(monsters.texture[i], palette_textures ? SPRITE_PALETTE(i % PALETTE_ROWS) : 0);
+			vertex_sprites[idx].sprite_index = i;
+			vertex_sprites[idx].trim = trim;
+			vertex_sprites[idx].flipbook = flipbook;
+		}
+	}
+
+	memcpy(monsters.prev_x, monsters.x, sizeof(float) * monsters_count);
+	memcpy(monsters.prev_y, monsters.y, sizeof(float) * monsters_count);
+
+	uint32_t pipeline_counts[_SPRITE_PIPELINE_COUNT] = {0};
+	float trimmed_area = 0.0f;
+	for (size_t i = 0; i < monsters_count; i++) {
+		pipeline_counts[monsters.pipeline[i]]++;
+		trimmed_area += get_sprite_trim_area(vertex_sprites[i * vertices_per_sprite].trim);
+	}
+
+	printf("Sprites: %u opaque, %u alpha tested, %u blended\n",
+		pipeline_counts[SPRITE_PIPELINE_OPAQUE], pipeline_counts[SPRITE_PIPELINE_CUTOUT], pipeline_counts[SPRITE_PIPELINE_TRANSLUCENT]);
+	if (pipeline_counts[SPRITE_PIPELINE_TRANSLUCENT] > 0 && (!sprite_render_queue || gpu_sprite_culling)) {
+		printf("The sprites aren't sorted, so the blended ones are alpha tested instead\n");
+	}
+	if (trimmed_sprites && monsters_count > 0) {
+		printf("Trimmed sprite quads cover %.0f%% of their frames\n", 100.0f * trimmed_area / monsters_count);
+	}
+}
+
+bool save_level(const char* filename) {
+	/*
+	 * Write the tiles and monsters to a level snapshot, straight after they're
+	 * created (before the sprites are pointed into the texture atlas)
+	 */
+	const LevelHeader header = {
+		.flags = get_level_flags(),
+		.map_width = map_x_tiles,
+		.map_height = map_y_tiles,
+		.monsters_count = monsters_count,
+		.sprite_size = sizeof(VertexBufferSprite),
+		.sprites_per_monster = (uint32_t) get_sprites_per_monster(),
+	};
+	const LevelBlobData blobs[] = {
+		{LEVEL_BLOB_TILES, tiles, sizeof(uint8_t) * map_x_tiles * map_y_tiles},
+		{LEVEL_BLOB_MONSTER_X, monsters.x, sizeof(float) * monsters_count},
+		{LEVEL_BLOB_MONSTER_Y, monsters.y, sizeof(float) * monsters_count},
+		{LEVEL_BLOB_MONSTER_Z, monsters.z, sizeof(float) * monsters_count},
+		{LEVEL_BLOB_MONSTER_VX, monsters.vx, sizeof(float) * monsters_count},
+		{LEVEL_BLOB_MONSTER_VY, monsters.vy, sizeof(float) * monsters_count},
+		{LEVEL_BLOB_MONSTER_ANIM_PHASE, monsters.anim_phase, sizeof(float) * monsters_count},
+		{LEVEL_BLOB_MONSTER_COLOR, monsters.color, sizeof(vec4) * monsters_count},
+		{LEVEL_BLOB_MONSTER_TEXTURE, monsters.texture, sizeof(uint32_t) * monsters_count},
+		{LEVEL_BLOB_MONSTER_PIPELINE, monsters.pipeline, sizeof(uint32_t) * monsters_count},
+		{LEVEL_BLOB_SPRITES, vertex_sprites, sizeof(VertexBufferSprite) * vertex_sprites_count},
+	};
+	return level_write(filename, &header, blobs, sizeof(blobs) / sizeof(blobs[0]));
+}
+
+void bounce_axis(size_t start, size_t end, void* data) {
+	/*
+	 * Integrate one axis of the positions of the monsters in [start, end) (of
+	 * the ones being stepped), bouncing off 0 and max.  This is written without branches so that the
+	 * loop vectorises.  The rules match the original: a monster moving out past
+	 * an edge has its speed flipped instead of moving that frame
+	 *
+	 * @param data The BounceAxis
+	 */
+	const BounceAxis* axis = data;
+	float* pos = *axis->pos;
+	float* spd = *axis->spd;
+	float max = axis->max;
+	if (throttle_monster_updates) {
+		// [start, end) of the ones being stepped, each for its own time
+		const uint32_t* indices = monster_update_tiers.indices;
+		const float* steps = monster_update_tiers.dt;
+		for (size_t k = start; k < end; k++) {
+			uint32_t i = indices[k];
+			float p = pos[i];
+			float v = spd[i];
+			float hit = (float) (((v > 0.0f) & (p >= max)) | ((v < 0.0f) & (p <= 0.0f)));
+			pos[i] = p + steps[k] * v * (1.0f - hit);
+			spd[i] = v * (1.0f - 2.0f * hit);
+		}
+		return;
+	}
+
+	float dt = update_step;
+	for (size_t i = start; i < end; i++) {
+		float p = pos[i];
+		float v = spd[i];
+
+		// 1.0 if we've hit an edge while moving towards it, otherwise 0.0
+		float hit = (float) (((v > 0.0f) & (p >= max)) | ((v < 0.0f) & (p <= 0.0f)));
+
+		pos[i] = p + dt * v * (1.0f - hit);
+		spd[i] = v * (1.0f - 2.0f * hit);
+	}
+}
+
+void collide_monsters(size_t start, size_t end, void* data) {
+	/*
+	 * Turn the monsters in [start, end) (of the ones being stepped) away from
+	 * the ones they're touching, from monster_grid.  Each only changes its own
+	 * speed, so the jobs don't need to coordinate
+	 */
+	(void) data;
+	uint32_t neighbours[MAX_MONSTER_NEIGHBOURS];
+	for (size_t k = start; k < end; k++) {
+		size_t i = throttle_monster_updates ? monster_update_tiers.indices[k] : k;
+		uint32_t neighbours_count = spatial_grid_query_radius(&monster_grid, monsters.x[i], monsters.y[i],
+				MONSTER_COLLISION_DISTANCE, neighbours, MAX_MONSTER_NEIGHBOURS);
+
+		for (uint32_t n = 0; n < neighbours_count; n++) {
+			uint32_t j = neighbours[n];
+			float nx = monsters.x[i] - monsters.x[j];
+			float ny = monsters.y[i] - monsters.y[j];
+			float length2 = nx * nx + ny * ny;
+			float along = monsters.vx[i] * nx + monsters.vy[i] * ny;
+			// Only reflect the speed if it's heading towards the other one
+			if (j == i || length2 == 0.0f || along >= 0.0f) {
+				continue;
+			}
+			float scale = 2.0f * along / length2;
+			monsters.vx[i] -= scale * nx;
+			monsters.vy[i] -= scale * ny;
+		}
+	}
+}
+
+void move_monsters_through_tiles(size_t start, size_t end, void* data) {
+	/*
+	 * Move the monsters in [start, end) (of the ones being stepped), bouncing
+	 * off the solid tiles and the edges of the play area
+	 *
+	 * @param data Pointer to the time step
+	 */
+	const float half_size[2] = {MONSTER_TILE_HALF_SIZE, MONSTER_TILE_HALF_SIZE};
+	for (size_t k = start; k < end; k++) {
+		size_t i = throttle_monster_updates ? monster_update_tiers.indices[k] : k;
+		float dt = throttle_monster_updates ? monster_update_tiers.dt[k] : *(const float*) data;
+		float pos[2] = {monsters.x[i], monsters.y[i]};
+		float delta[2] = {monsters.vx[i] * dt, monsters.vy[i] * dt};
+		uint32_t hits = tile_solidity_move(&tile_solidity, pos, half_size, delta);
+		monsters.x[i] = pos[0];
+		monsters.y[i] = pos[1];
+
+		// The same rule as bounce_axis() for the edges
+		bool hit_x = (hits & TILE_HIT_X) || (monsters.vx[i] > 0.0f && pos[0] >= X_TILES) || (monsters.vx[i] < 0.0f && pos[0] <= 0.0f);
+		bool hit_y = (hits & TILE_HIT_Y) || (monsters.vy[i] > 0.0f && pos[1] >= Y_TILES) || (monsters.vy[i] < 0.0f && pos[1] <= 0.0f);
+		monsters.vx[i] = hit_x ? -monsters.vx[i] : monsters.vx[i];
+		monsters.vy[i] = hit_y ? -monsters.vy[i] : monsters.vy[i];
+	}
+}
+
+void steer_monsters(size_t start, size_t end, void* data) {
+	/*
+	 * Turn the monsters in [start, end) (of the ones being stepped) towards
+	 * monster_flow_field's target
+	 *
+	 * @param data Pointer to the time step
+	 */
+	for (size_t k = start; k < end; k++) {
+		size_t i = throttle_monster_updates ? monster_update_tiers.indices[k] : k;
+		float dt = throttle_monster_updates ? monster_update_tiers.dt[k] : *(const float*) data;
+		float turn = MONSTER_PATH_STEERING * dt < 1.0f ? MONSTER_PATH_STEERING * dt : 1.0f;
+		float direction[2];
+		if (!flow_field_sample(&monster_flow_field, monsters.x[i], monsters.y[i], direction)) {
+			continue;
+		}
+		monsters.vx[i] += (direction[0] * MONSTER_PATH_SPEED - monsters.vx[i]) * turn;
+		monsters.vy[i] += (direction[1] * MONSTER_PATH_SPEED - monsters.vy[i]) * turn;
+	}
+}
+
+void remember_monster_positions(size_t start, size_t end, void* data) {
+	/*
+	 * Keep where the monsters in [start, end) were before the step, to draw
+	 * them between the two
+	 */
+	(void) data;
+	memcpy(&monsters.prev_x[start], &monsters.x[start], sizeof(float) * (end - start));
+	memcpy(&monsters.prev_y[start], &monsters.y[start], sizeof(float) * (end - start));
+}
+
+void update_monster_flow_field(size_t start, size_t end, void* data) {
+	(void) start;
+	(void) end;
+	(void) data;
+	flow_field_update(&monster_flow_field);
+}
+
+void build_monster_grid(size_t start, size_t end, void* data) {
+	(void) start;
+	(void) end;
+	(void) data;
+	spatial_grid_build(&monster_grid, monsters.x, monsters.y, monsters_count);
+}
+
+void swarm_monsters(size_t start, size_t end, void* data) {
+	(void) start;
+	(void) end;
+	(void) data;
+	SwarmParams params = MONSTER_SWARM;
+	params.solidity = &tile_solidity;
+	swarm_steer(&monster_swarm, &monster_grid, &params, monsters.vx, monsters.vy, update_step);
+}
+
+uint32_t pick_monster(float x, float y) {
+	/*
+	 * Find the monster under a point, from their CPU positions
+	 *
+	 * @return Its index, or SPATIAL_GRID_NONE if there isn't one
+	 */
+	if (!monster_collisions) {
+		spatial_grid_build(&monster_grid, monsters.x, monsters.y, monsters_count);
+	}
+	return spatial_grid_nearest(&monster_grid, x, y, MONSTER_SIZE * 0.5f);
+}
+
+bool window_to_world(float x, float y, float world[2]) {
+	/*
+	 * Find the point on the map under a point in the window, through whichever
+	 * view it's in
+	 *
+	 * @return false if it isn't in any of them
+	 */
+	int window_width = 0;
+	int window_height = 0;
+	SDL_GetWindowSize(window, &window_width, &window_height);
+	if (window_width <= 0 || window_height <= 0) {
+		return false;
+	}
+
+	uint32_t columns;
+	uint32_t rows;
+	get_view_grid(&columns, &rows);
+	float u = x / (float) window_width * (float) columns;
+	float v = y / (float) window_height * (float) rows;
+	if (u < 0.0f || v < 0.0f || u >= (float) columns || v >= (float) rows) {
+		return false;
+	}
+
+	uint32_t view = (uint32_t) v * columns + (uint32_t) u;
+	if (view >= split_screen_views) {
+		return false;
+	}
+
+	camera_screen_to_world(&cameras[view], u - floorf(u), v - floorf(v), world);
+	return true;
+}
+
+uint32_t get_held_keys(void) {
+	/*
+	 * Get which of the arrow keys are held, as CAMERA_KEY_* bits
+	 */
+	if (headless) {
+		return 0;
+	}
+
+	const bool* keys = SDL_GetKeyboardState(NULL);
+	uint32_t held = 0;
+	held |= keys[SDL_SCANCODE_LEFT] ? CAMERA_KEY_LEFT : 0;
+	held |= keys[SDL_SCANCODE_RIGHT] ? CAMERA_KEY_RIGHT : 0;
+	held |= keys[SDL_SCANCODE_DOWN] ? CAMERA_KEY_DOWN : 0;
+	held |= keys[SDL_SCANCODE_UP] ? CAMERA_KEY_UP : 0;
+	return held;
+}
+
+void update_camera(float dt) {
+	/*
+	 * Scroll the active view's camera with the arrow keys in held_keys and let
+	 * the cameras keep their views inside the map, shake and rebuild their
+	 * matrices
+	 */
+	vec2 direction = {0.0f, 0.0f};
+	if (held_keys & CAMERA_KEY_LEFT) {
+		direction[0] -= 1.0f;
+	}
+	if (held_keys & CAMERA_KEY_RIGHT) {
+		direction[0] += 1.0f;
+	}
+	if (held_keys & CAMERA_KEY_DOWN) {
+		direction[1] -= 1.0f;
+	}
+	if (held_keys & CAMERA_KEY_UP) {
+		direction[1] += 1.0f;
+	}
+
+	// Scrolls the same number of screens a second at any zoom
+	Camera* active = &cameras[active_view];
+	float speed = CAMERA_SPEED / active->zoom;
+	const float offset[2] = {direction[0] * speed * dt, direction[1] * speed * dt};
+	camera_move(active, offset);
+
+	// A benchmark pans the first view on its own as well
+	const float pan[2] = {camera_pan[0] * dt, camera_pan[1] * dt};
+	camera_move(&cameras[0], pan);
+
+	for (uint32_t i = 0; i < split_screen_views; i++) {
+		camera_update(&cameras[i], dt);
+	}
+
+	// Turning round once it's stopped by an edge of the map
+	const float map_max[2] = {(float) map_x_tiles, (float) map_y_tiles};
+	const float* visible = cameras[0].visible;
+	for (int i = 0; i < 2; i++) {
+		if ((visible[i] <= 1e-3f && camera_pan[i] < 0.0f) || (visible[i + 2] >= map_max[i] - 1e-3f && camera_pan[i] > 0.0f)) {
+			camera_pan[i] = -camera_pan[i];
+		}
+	}
+}
+
+void create_retained_sprites(void) {
+	/*
+	 * Allocate the retained sprites, and a copy of as many for each snapshot
+	 */
+	const size_t vertices_per_sprite = instanced_sprites ? 1 : 6;
+	sprite_pool_init(&retained_sprites, RETAINED_SPRITES_CAPACITY);
+	retained_transforms = calloc(RETAINED_SPRITES_CAPACITY, sizeof(SpriteTransform));
+	retained_records = calloc(RETAINED_SPRITES_CAPACITY * vertices_per_sprite, sizeof(VertexBufferSprite));
+	bool allocated = retained_transforms != NULL && retained_records != NULL;
+	if (partial_redraw) {
+		retained_drawn_transforms = calloc(RETAINED_SPRITES_CAPACITY, sizeof(SpriteTransform));
+		allocated &= retained_drawn_transforms != NULL;
+	}
+
+	for (size_t i = 0; i < FRAME_PIPELINE_SNAPSHOTS; i++) {
+		FrameState* state = &frame_states[i];
+		state->retained_ranges = malloc(sizeof(SpritePoolRange) * MAX_RETAINED_SPRITE_RANGES);
+		state->retained_transforms = malloc(sizeof(SpriteTransform) * RETAINED_SPRITES_CAPACITY);
+		state->retained_records = malloc(sizeof(VertexBufferSprite) * vertices_per_sprite * RETAINED_SPRITES_CAPACITY);
+		allocated &= state->retained_ranges != NULL && state->retained_transforms != NULL && state->retained_records != NULL;
+	}
+
+	if (!allocated) {
+		fprintf(stderr, "Failed to allocate %d retained sprites\n", RETAINED_SPRITES_CAPACITY);
+		exit(1);
+	}
+}
+
+void cleanup_retained_sprites(void) {
+	sprite_pool_cleanup(&retained_sprites);
+	free(retained_transforms);
+	free(retained_records);
+	free(retained_drawn_transforms);
+	for (size_t i = 0; i < FRAME_PIPELINE_SNAPSHOTS; i++) {
+		free(frame_states[i].retained_ranges);
+		free(frame_states[i].retained_transforms);
+		free(frame_states[i].retained_records);
+	}
+	free(demo_retained_handles);
+}
+
+void create_demo_retained_sprites(void) {
+	/*
+	 * Scatter the demo's retained sprites over the map, behind the monsters
+	 */
+	demo_retained_handles = malloc(sizeof(SpriteHandle) * DEMO_RETAINED_SPRITES);
+	if (demo_retained_handles == NULL) {
+		fprintf(stderr, "Failed to allocate the demo's retained sprites\n");
+		exit(1);
+	}
+
+	// The first frame of the third sheet
+	const float src_rect[4] = {0.0f, 0.0f, 1.0f / MONSTER_FRAMES_X, 1.0f / MONSTER_FRAMES_Y};
+	for (uint32_t i = 0; i < DEMO_RETAINED_SPRITES; i++) {
+		float dst[4] = {(float) rand_double(map_x_tiles), (float) rand_double(map_y_tiles), MONSTER_SIZE, MONSTER_SIZE};
+		demo_retained_handles[i] = add_retained_sprite(TEX_MONSTERS3, src_rect, dst, 0.0f, SPRITE_RGBA(160, 160, 160, 255), 19.5f);
+		animate_retained_sprite(demo_retained_handles[i], MONSTER_ANIM_AMPLITUDE * 0.5f, MONSTER_ANIM_FREQUENCY, (float) rand_double(2.0 * GLM_PI));
+	}
+}
+
+void get_demo_link_local(uint32_t i, double time, Affine2* local) {
+	/*
+	 * Where a link of the demo's arms is from the one before it (or the hub,
+	 * which the first link turns the whole arm about), at a time
+	 */
+	uint32_t arms_count = (DEMO_PARENTED_SPRITES + DEMO_ARM_LINKS - 1) / DEMO_ARM_LINKS;
+	uint32_t arm = i / DEMO_ARM_LINKS;
+	uint32_t link = i % DEMO_ARM_LINKS;
+
+	// Each link is a sprite further out than the last
+	const float translation[2] = {link == 0 ? 1.0f : MONSTER_SIZE * 0.5f, 0.0f};
+	const float scale[2] = {1.0f, 1.0f};
+	float rotation = link == 0
+		? (float) arm * 2.0f * GLM_PIf / (float) arms_count + (float) time * 0.2f
+		: sinf((float) time * 1.5f + (float) arm) * 0.3f;
+	affine2_make(local, translation, rotation, scale);
+}
+
+void create_demo_tree(void) {
+	/*
+	 * Build the demo's arms, which update() swings with transform_tree_set_local()
+	 */
+	transform_tree_init(&demo_tree, DEMO_PARENTED_SPRITES + 1);
+	demo_tree_links = malloc(sizeof(TransformHandle) * DEMO_PARENTED_SPRITES);
+	if (demo_tree_links == NULL) {
+		fprintf(stderr, "Failed to allocate the demo's parented sprites\n");
+		exit(1);
+	}
+
+	Affine2 hub;
+	affine2_identity(&hub);
+	hub.tx = (float) map_x_tiles * 0.5f;
+	hub.ty = (float) map_y_tiles * 0.5f;
+	TransformHandle hub_handle = transform_tree_add(&demo_tree, TRANSFORM_TREE_NO_HANDLE, &hub);
+
+	for (uint32_t i = 0; i < DEMO_PARENTED_SPRITES; i++) {
+		Affine2 local;
+		get_demo_link_local(i, t, &local);
+		TransformHandle parent = i % DEMO_ARM_LINKS == 0 ? hub_handle : demo_tree_links[i - 1];
+		demo_tree_links[i] = transform_tree_add(&demo_tree, parent, &local);
+	}
+	transform_tree_update(&demo_tree);
+}
+
+void cleanup_demo_tree(void) {
+	transform_tree_cleanup(&demo_tree);
+	free(demo_tree_links);
+}
+
+void update_demo_tree(void) {
+	/*
+	 * Swing each link of the arms from the one before it.  Turning the first
+	 * link of an arm moves everything on it, which is recomputed too
+	 */
+	for (uint32_t i = 0; i < DEMO_PARENTED_SPRITES; i++) {
+		Affine2 local;
+		get_demo_link_local(i, t, &local);
+		transform_tree_set_local(&demo_tree, demo_tree_links[i], &local);
+	}
+	transform_tree_update(&demo_tree);
+}
+
+void draw_demo_tree(size_t start, size_t end, void* data) {
+	/*
+	 * Draw every node of the demo's tree where the last update put it, from
+	 * the worker pool
+	 */
+	(void) data;
+	const float src_rect[4] = {0.0f, 0.0f, 1.0f / MONSTER_FRAMES_X, 1.0f / MONSTER_FRAMES_Y};
+	const float size = MONSTER_SIZE * 0.5f;
+
+	for (size_t i = start; i < end; i++) {
+		const Affine2* world = &demo_tree.worlds[i];
+		float dst[4] = {world->tx - size * 0.5f, world->ty - size * 0.5f, size, size};
+		float rotation = atan2f(world->b, world->a);
+		sprite_draw(TEX_MONSTERS2, src_rect, dst, rotation, SPRITE_WHITE, 0.5f);
+	}
+}
+
+void start_demo_tween(float* target, float range) {
+	/*
+	 * Send one of the demo's coordinates somewhere else in [0, range), with a
+	 * random easing and time
+	 */
+	float to = (float) rand_double(range);
+	float duration = (float) (0.5 + rand_double(DEMO_TWEEN_MAX_DURATION - 0.5));
+	TweenEasing easing = (TweenEasing) rand_range(0, _TWEEN_EASING_COUNT);
+	tween_start(&demo_tweens, target, to, duration, easing);
+}
+
+void create_demo_tweens(void) {
+	/*
+	 * Scatter the demo's tweened sprites over the map, each coordinate on its
+	 * way somewhere
+	 */
+	uint32_t count = DEMO_TWEENED_SPRITES;
+	// Both coordinates could be the same easing
+	tweens_init(&demo_tweens, 2 * count);
+	demo_tweened_x = malloc(sizeof(float) * count);
+	demo_tweened_y = malloc(sizeof(float) * count);
+	demo_tweens_finished = malloc(sizeof(float*) * 2 * count);
+	if (demo_tweened_x == NULL || demo_tweened_y == NULL || demo_tweens_finished == NULL) {
+		fprintf(stderr, "Failed to allocate the demo's tweened sprites\n");
+		exit(1);
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		demo_tweened_x[i] = (float) rand_double((double) map_x_tiles);
+		demo_tweened_y[i] = (float) rand_double((double) map_y_tiles);
+		start_demo_tween(&demo_tweened_x[i], (float) map_x_tiles);
+		start_demo_tween(&demo_tweened_y[i], (float) map_y_tiles);
+	}
+}
+
+void cleanup_demo_tweens(void) {
+	tweens_cleanup(&demo_tweens);
+	free(demo_tweened_x);
+	free(demo_tweened_y);
+	free(demo_tweens_finished);
+}
+
+void update_demo_tweens(float dt) {
+	/*
+	 * Move every tween on, and start the next one of each coordinate which got
+	 * where it was going
+	 */
+	uint32_t finished_count = tweens_update(&demo_tweens, dt, demo_tweens_finished, 2 * DEMO_TWEENED_SPRITES);
+	for (uint32_t i = 0; i < finished_count; i++) {
+		float* target = demo_tweens_finished[i];
+		bool is_x = target >= demo_tweened_x && target < demo_tweened_x + DEMO_TWEENED_SPRITES;
+		start_demo_tween(target, (float) (is_x ? map_x_tiles : map_y_tiles));
+	}
+}
+
+void draw_demo_tweens(size_t start, size_t end, void* data) {
+	/*
+	 * Draw the tweened sprites where the last update put them, from the worker
+	 * pool
+	 */
+	(void) data;
+	const float src_rect[4] = {0.0f, 0.0f, 1.0f / MONSTER_FRAMES_X, 1.0f / MONSTER_FRAMES_Y};
+	const float size = MONSTER_SIZE * 0.5f;
+
+	for (size_t i = start; i < end; i++) {
+		float dst[4] = {demo_tweened_x[i] - size * 0.5f, demo_tweened_y[i] - size * 0.5f, size, size};
+		sprite_draw(TEX_MONSTERS2, src_rect, dst, 0.0f, SPRITE_WHITE, 0.5f);
+	}
+}
+
+void create_demo_skeleton(void) {
+	/*
+	 * Build the skinned characters' skeleton and their walk, and scatter them
+	 * over the map.  create_skinned_mesh() cuts their parts to match
+	 */
+	skeleton_init(&demo_skeleton);
+	const float hips[2] = {0.0f, -0.45f};
+	const float torso[2] = {0.0f, 0.0f};
+	const float head[2] = {0.0f, -0.25f};
+	const float arm_l[2] = {-0.2f, -0.2f};
+	const float arm_r[2] = {0.2f, -0.2f};
+	const float leg_l[2] = {-0.1f, 0.0f};
+	const float leg_r[2] = {0.1f, 0.0f};
+	skeleton_add_bone(&demo_skeleton, SKELETON_NO_PARENT, hips, 0.0f);
+	skeleton_add_bone(&demo_skeleton, DEMO_BONE_HIPS, torso, 0.0f);
+	skeleton_add_bone(&demo_skeleton, DEMO_BONE_TORSO, head, 0.0f);
+	skeleton_add_bone(&demo_skeleton, DEMO_BONE_TORSO, arm_l, 0.0f);
+	skeleton_add_bone(&demo_skeleton, DEMO_BONE_TORSO, arm_r, 0.0f);
+	skeleton_add_bone(&demo_skeleton, DEMO_BONE_HIPS, leg_l, 0.0f);
+	skeleton_add_bone(&demo_skeleton, DEMO_BONE_HIPS, leg_r, 0.0f);
+
+	// The legs swing against each other and the arms against the legs, with
+	// the hips up as each leg passes under them
+	const float still[2] = {0.0f, 0.0f};
+	const float up[2] = {0.0f, -0.03f};
+	skeleton_clip_init(&demo_walk_clip, 0.8f);
+	skeleton_clip_add_key(&demo_walk_clip, DEMO_BONE_LEG_L, 0.0f, 0.5f, still);
+	skeleton_clip_add_key(&demo_walk_clip, DEMO_BONE_LEG_L, 0.4f, -0.5f, still);
+	skeleton_clip_add_key(&demo_walk_clip, DEMO_BONE_LEG_R, 0.0f, -0.5f, still);
+	skeleton_clip_add_key(&demo_walk_clip, DEMO_BONE_LEG_R, 0.4f, 0.5f, still);
+	skeleton_clip_add_key(&demo_walk_clip, DEMO_BONE_ARM_L, 0.0f, -0.4f, still);
+	skeleton_clip_add_key(&demo_walk_clip, DEMO_BONE_ARM_L, 0.4f, 0.4f, still);
+	skeleton_clip_add_key(&demo_walk_clip, DEMO_BONE_ARM_R, 0.0f, 0.4f, still);
+	skeleton_clip_add_key(&demo_walk_clip, DEMO_BONE_ARM_R, 0.4f, -0.4f, still);
+	skeleton_clip_add_key(&demo_walk_clip, DEMO_BONE_HIPS, 0.0f, 0.0f, still);
+	skeleton_clip_add_key(&demo_walk_clip, DEMO_BONE_HIPS, 0.2f, 0.0f, up);
+	skeleton_clip_add_key(&demo_walk_clip, DEMO_BONE_HIPS, 0.4f, 0.0f, still);
+	skeleton_clip_add_key(&demo_walk_clip, DEMO_BONE_HIPS, 0.6f, 0.0f, up);
+	skeleton_clip_add_key(&demo_walk_clip, DEMO_BONE_HEAD, 0.0f, 0.1f, still);
+	skeleton_clip_add_key(&demo_walk_clip, DEMO_BONE_HEAD, 0.4f, -0.1f, still);
+
+	skinned_characters = malloc(sizeof(SkinnedCharacter) * DEMO_SKINNED_CHARACTERS);
+	skinned_visible = malloc(sizeof(uint32_t) * DEMO_SKINNED_CHARACTERS);
+	if (skinned_characters == NULL || skinned_visible == NULL) {
+		fprintf(stderr, "Failed to allocate the demo's skinned characters\n");
+		exit(1);
+	}
+	for (uint32_t i = 0; i < DEMO_SKINNED_CHARACTERS; i++) {
+		skinned_characters[i].x = (float) rand_double(map_x_tiles);
+		skinned_characters[i].y = (float) rand_double(map_y_tiles);
+		skinned_characters[i].phase = (float) rand_double(demo_walk_clip.duration);
+	}
+}
+
+void create_demo_particle_emitter(void) {
+	/*
+	 * A fountain of small monsters in the middle of the map, which update()
+	 * sweeps from side to side
+	 */
+	const float src_rect[4] = {0.0f, 0.0f, 1.0f / MONSTER_FRAMES_X, 1.0f / MONSTER_FRAMES_Y};
+	demo_particle_emitter = add_particle_emitter(TEX_MONSTERS4, src_rect, SPRITE_WHITE, MONSTER_SIZE * 0.25f, 2.0f, -8.0f, 19.0f);
+}
+
+void create_demo_lights(void) {
+	/*
+	 * Coloured lights around the map, which update() moves in circles
+	 */
+	for (uint32_t i = 0; i < DEMO_LIGHTS; i++) {
+		float* orbit = demo_light_orbits[i];
+		orbit[0] = (float) rand_double(X_TILES);
+		orbit[1] = (float) rand_double(Y_TILES);
+		orbit[2] = 1.0f + (float) rand_double(4.0);
+		orbit[3] = (float) rand_double(2.0) - 1.0f;
+
+		float color[3] = {
+			0.4f + (float) rand_double(0.6),
+			0.4f + (float) rand_double(0.6),
+			0.4f + (float) rand_double(0.6),
+		};
+		if (add_light(orbit, 3.0f + (float) rand_double(5.0), color, 1.5f, 1.0f) == NO_LIGHT) {
+			break;
+		}
+	}
+}
+
+void create_occluder_rows(void) {
+	/*
+	 * Allocate the changed rows of the shadows' occluders, and room for as many
+	 * as a frame copies in each snapshot
+	 */
+	occluder_rows_dirty = calloc(tile_solidity.height, sizeof(bool));
+	bool allocated = occluder_rows_dirty != NULL;
+	for (size_t i = 0; i < FRAME_PIPELINE_SNAPSHOTS; i++) {
+		frame_states[i].occluder_words = malloc(sizeof(uint64_t) * tile_solidity.words_per_row * MAX_OCCLUDER_ROWS_PER_FRAME);
+		allocated &= frame_states[i].occluder_words != NULL;
+	}
+
+	if (!allocated) {
+		fprintf(stderr, "Failed to allocate the occluder rows\n");
+		exit(1);
+	}
+}
+
+void cleanup_occluder_rows(void) {
+	free(occluder_rows_dirty);
+	for (size_t i = 0; i < FRAME_PIPELINE_SNAPSHOTS; i++) {
+		free(frame_states[i].occluder_words);
+	}
+}
+
+void create_projectiles(void) {
+	entity_pool_init(&projectile_pool, PROJECTILES_CAPACITY);
+	entity_pool_add_column(&projectile_pool, (void**) &projectiles.x, sizeof(float));
+	entity_pool_add_column(&projectile_pool, (void**) &projectiles.y, sizeof(float));
+	entity_pool_add_column(&projectile_pool, (void**) &projectiles.prev_x, sizeof(float));
+	entity_pool_add_column(&projectile_pool, (void**) &projectiles.prev_y, sizeof(float));
+	entity_pool_add_column(&projectile_pool, (void**) &projectiles.vx, sizeof(float));
+	entity_pool_add_column(&projectile_pool, (void**) &projectiles.vy, sizeof(float));
+	entity_pool_add_column(&projectile_pool, (void**) &projectiles.life, sizeof(float));
+	entity_pool_add_column(&projectile_pool, (void**) &projectiles.texture, sizeof(uint32_t));
+}
+
+EntityHandle spawn_projectile(float x, float y, float vx, float vy, uint32_t texture) {
+	/*
+	 * Fire a projectile, which lasts PROJECTILE_LIFETIME seconds
+	 *
+	 * @return Its handle, or ENTITY_POOL_NO_HANDLE if there are too many
+	 */
+	EntityHandle handle = entity_pool_create(&projectile_pool);
+	if (handle == ENTITY_POOL_NO_HANDLE) {
+		return handle;
+	}
+
+	uint32_t i = entity_pool_get_index(&projectile_pool, handle);
+	projectiles.x[i] = x;
+	projectiles.y[i] = y;
+	projectiles.prev_x[i] = x;
+	projectiles.prev_y[i] = y;
+	projectiles.vx[i] = vx;
+	projectiles.vy[i] = vy;
+	projectiles.life[i] = (float) PROJECTILE_LIFETIME;
+	projectiles.texture[i] = texture;
+	return handle;
+}
+
+void spawn_demo_projectiles(double dt) {
+	demo_projectiles_due += DEMO_PROJECTILES_PER_SECOND * dt;
+	for (; demo_projectiles_due >= 1.0; demo_projectiles_due -= 1.0) {
+		uint32_t monster = (uint32_t) rand_double(monsters_count);
+		float angle = (float) rand_double(2.0 * GLM_PI);
+		spawn_projectile(monsters.x[monster], monsters.y[monster], cosf(angle) * (float) PROJECTILE_SPEED,
+				sinf(angle) * (float) PROJECTILE_SPEED, monsters.texture[monster]);
+	}
+}
+
+void age_projectiles(float dt) {
+	/*
+	 * Destroy the projectiles which have run out.  This moves them around the
+	 * pool, so it's done before any of the update systems run over it
+	 */
+	// From the end, as destroying one moves the last one into its place
+	for (uint32_t i = projectile_pool.count; i-- > 0;) {
+		projectiles.life[i] -= dt;
+		if (projectiles.life[i] <= 0.0f) {
+			entity_pool_destroy_index(&projectile_pool, i);
 		}
 	}
+}
 
-	// ----- Create the semaphores and fences -----
-
-	VkSemaphoreCreateInfo semaphore_info = {0};
-	semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+void move_projectiles(size_t start, size_t end, void* data) {
+	/*
+	 * Move the projectiles in [start, end), keeping where they were
+	 */
+	(void) data;
+	float dt = update_step;
+	for (size_t i = start; i < end; i++) {
+		projectiles.prev_x[i] = projectiles.x[i];
+		projectiles.prev_y[i] = projectiles.y[i];
+		projectiles.x[i] += projectiles.vx[i] * dt;
+		projectiles.y[i] += projectiles.vy[i] * dt;
+	}
+}
 
-	VkFenceCreateInfo fence_info = {0};
-	fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+void create_update_systems(void) {
+	/*
+	 * Schedule what update() does to the monsters and projectiles each step.
+	 * Only the systems for the options which are on are added, so stepping
+	 * doesn't check any of them, and systems_add() puts the ones which don't
+	 * touch the same components in the same phase to run at the same time.
+	 * The compute shader does the moving for gpu_sprite_simulation, every
+	 * frame, and monsters.x / y are left as the starting positions.  With
+	 * throttle_monster_updates the systems for each monster only go over the
+	 * ones update() picks, but where they were is still kept for all of them,
+	 * so the rest stay still, and the grid and the swarm have all of them
+	 */
+	if (!gpu_sprite_simulation) {
+		const uint32_t* stepped_count = &monsters_count;
+		if (throttle_monster_updates) {
+			update_tiers_init(&monster_update_tiers, &MONSTER_UPDATE_TIERS, monsters_count);
+			stepped_count = &monster_update_tiers.count;
+		}
 
-	for (size_t i = 0; i < VKX_FRAMES_IN_FLIGHT; i++) {
-		if (vkCreateSemaphore(vkx_instance.device, &semaphore_info, NULL, &vkx_frame_sync_objects[i].image_available_semaphore) != VK_SUCCESS) {
-			fprintf(stderr, "failed to create semaphores for a frame!\n");
-			exit(1);
+		systems_add(&update_systems, &(System) {
+			.name = "remember monster positions", .archetype = &monsters, .count = &monsters_count,
+			.kernel = remember_monster_positions,
+			.reads = MONSTER_COMPONENT_X | MONSTER_COMPONENT_Y, .writes = MONSTER_COMPONENT_PREVIOUS,
+		});
+
+		if (monster_pathfinding) {
+			systems_add(&update_systems, &(System) {
+				.name = "update monster flow field", .archetype = &monsters, .kernel = update_monster_flow_field,
+				.writes = MONSTER_COMPONENT_FLOW_FIELD,
+			});
+			systems_add(&update_systems, &(System) {
+				.name = "steer monsters", .archetype = &monsters, .count = stepped_count,
+				.kernel = steer_monsters, .data = &update_step,
+				.reads = MONSTER_COMPONENT_X | MONSTER_COMPONENT_Y | MONSTER_COMPONENT_FLOW_FIELD,
+				.writes = MONSTER_COMPONENT_VX | MONSTER_COMPONENT_VY,
+			});
+		}
+		if (monster_collisions || monster_swarming) {
+			systems_add(&update_systems, &(System) {
+				.name = "build monster grid", .archetype = &monsters, .kernel = build_monster_grid,
+				.reads = MONSTER_COMPONENT_X | MONSTER_COMPONENT_Y, .writes = MONSTER_COMPONENT_GRID,
+			});
+		}
+		if (monster_swarming) {
+			systems_add(&update_systems, &(System) {
+				.name = "swarm monsters", .archetype = &monsters, .kernel = swarm_monsters,
+				.reads = MONSTER_COMPONENT_GRID | MONSTER_COMPONENT_X | MONSTER_COMPONENT_Y,
+				.writes = MONSTER_COMPONENT_VX | MONSTER_COMPONENT_VY,
+			});
+		}
+		if (monster_collisions) {
+			systems_add(&update_systems, &(System) {
+				.name = "collide monsters", .archetype = &monsters, .count = stepped_count,
+				.kernel = collide_monsters,
+				.reads = MONSTER_COMPONENT_GRID | MONSTER_COMPONENT_X | MONSTER_COMPONENT_Y,
+				.writes = MONSTER_COMPONENT_VX | MONSTER_COMPONENT_VY,
+			});
 		}
 
-		if (vkCreateFence(vkx_instance.device, &fence_info, NULL, &vkx_frame_sync_objects[i].in_flight_fence) != VK_SUCCESS) {
-			fprintf(stderr, "failed to create synchronization objects for a frame!\n");
-			exit(1);
+		if (monster_tile_collisions) {
+			systems_add(&update_systems, &(System) {
+				.name = "move monsters through tiles", .archetype = &monsters, .count = stepped_count,
+				.kernel = move_monsters_through_tiles, .data = &update_step,
+				.writes = MONSTER_COMPONENT_X | MONSTER_COMPONENT_Y | MONSTER_COMPONENT_VX | MONSTER_COMPONENT_VY,
+			});
+		}
+		else {
+			// The axes don't touch each other, so they're moved at the same time
+			monster_bounce_axes[0] = (BounceAxis) {&monsters.x, &monsters.vx, (float) X_TILES};
+			monster_bounce_axes[1] = (BounceAxis) {&monsters.y, &monsters.vy, (float) Y_TILES};
+			systems_add(&update_systems, &(System) {
+				.name = "bounce monsters x", .archetype = &monsters, .count = stepped_count,
+				.kernel = bounce_axis, .data = &monster_bounce_axes[0],
+				.writes = MONSTER_COMPONENT_X | MONSTER_COMPONENT_VX,
+			});
+			systems_add(&update_systems, &(System) {
+				.name = "bounce monsters y", .archetype = &monsters, .count = stepped_count,
+				.kernel = bounce_axis, .data = &monster_bounce_axes[1],
+				.writes = MONSTER_COMPONENT_Y | MONSTER_COMPONENT_VY,
+			});
 		}
 	}
 
-	printf("Initiialisation complete\n");
+	systems_add(&update_systems, &(System) {
+		.name = "move projectiles", .archetype = &projectile_pool, .count = &projectile_pool.count,
+		.kernel = move_projectiles,
+		.reads = PROJECTILE_COMPONENT_VELOCITY, .writes = PROJECTILE_COMPONENT_POSITION | PROJECTILE_COMPONENT_PREVIOUS,
+	});
 }
 
-void record_command_buffer(VkCommandBuffer command_buffer, uint32_t image_index) {
-	VkCommandBufferBeginInfo begin_info = {0};
-	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-
-	if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
-		fprintf(stderr, "failed to begin recording command buffer!\n");
-		exit(1);
+void draw_projectiles(float interpolation) {
+	/*
+	 * Draw the projectiles, the fraction interpolation of the way through the
+	 * last step
+	 */
+	const float src_rect[4] = {0.0f, 0.0f, 1.0f / MONSTER_FRAMES_X, 1.0f / MONSTER_FRAMES_Y};
+	const float size = MONSTER_SIZE * 0.25f;
+	for (uint32_t i = 0; i < projectile_pool.count; i++) {
+		float x = projectiles.prev_x[i] + (projectiles.x[i] - projectiles.prev_x[i]) * interpolation;
+		float y = projectiles.prev_y[i] + (projectiles.y[i] - projectiles.prev_y[i]) * interpolation;
+		float dst[4] = {x - size * 0.5f, y - size * 0.5f, size, size};
+		sprite_draw(projectiles.texture[i], src_rect, dst, 0.0f, SPRITE_WHITE, 0.5f);
 	}
-	
-	// Memory barrier to transition from present source to color attachment
-	vkx_transition_image_layout(
-		command_buffer,
-		vkx_swap_chain.images[image_index],
-		vkx_swap_chain.image_format,
-		VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-		VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
-	);
-
-	// Memory barrier to transition the offscreen image from color attachment to shader read
-	vkx_transition_image_layout(
-		command_buffer,
-		offscreen_images[current_frame].image,
-		vkx_swap_chain.image_format,
-		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-		VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
-	);
-
-	VkClearValue clear_color = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
-
-	VkRenderingAttachmentInfo color_attachment_info = {0};
-	color_attachment_info.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-	color_attachment_info.imageView = offscreen_images[current_frame].view;
-	color_attachment_info.imageLayout = VK_IMAGE_LAYOUT_ATTACHMENT_OPTIMAL;
-	color_attachment_info.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	color_attachment_info.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-	color_attachment_info.clearValue = clear_color;
-	
-	VkClearValue depth_clear_value = {0};
-	depth_clear_value.depthStencil.depth = 1.0f;
-	depth_clear_value.depthStencil.stencil = 0;
-
-	VkRenderingAttachmentInfo depth_info = {0};
-	depth_info.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-	depth_info.imageView = depth_images[current_frame].view;
-	depth_info.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-	depth_info.resolveMode = VK_RESOLVE_MODE_NONE;
-	depth_info.resolveImageView = VK_NULL_HANDLE;
-	depth_info.resolveImageLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	depth_info.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	depth_info.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	depth_info.clearValue = depth_clear_value;
-
-	VkRenderingInfo rendering_info = {0};
-	rendering_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
-	rendering_info.renderArea.offset.x = 0;
-	rendering_info.renderArea.offset.y = 0;
-	rendering_info.renderArea.extent.width = SCREEN_WIDTH;
-	rendering_info.renderArea.extent.height = SCREEN_HEIGHT;
-	rendering_info.layerCount = 1;
-	rendering_info.colorAttachmentCount = 1;
-	rendering_info.pColorAttachments = &color_attachment_info;
-	rendering_info.pDepthAttachment = &depth_info;
-	
-	// --- Begin dynamic rendering --------------------------------------------
-	vkCmdBeginRendering(command_buffer, &rendering_info);
-
-	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, tile_pipeline.pipeline);
+}
 
-	VkBuffer vertex_buffers[] = {vertex_buffer.buffer};
-	VkDeviceSize offsets[] = {0};
-	vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, offsets);
+void draw_demo_sprites(size_t start, size_t end, void* data) {
+	/*
+	 * A swarm circling the middle of the view, drawn with sprite_draw() from
+	 * the worker pool
+	 */
+	(void) data;
+	const float src_rect[4] = {0.0f, 0.0f, 1.0f / MONSTER_FRAMES_X, 1.0f / MONSTER_FRAMES_Y};
+	const float size = MONSTER_SIZE * 0.5f;
+
+	for (size_t i = start; i < end; i++) {
+		// Spread around the circle by the golden angle, in rings
+		float angle = (float) (t * 0.5 + (double) i * 2.39996);
+		float radius = 2.0f + (float) (i % 64) * 0.15f;
+		float dst[4] = {
+			cameras[0].centre[0] + cosf(angle) * radius - size * 0.5f,
+			cameras[0].centre[1] + sinf(angle) * radius - size * 0.5f,
+			size,
+			size,
+		};
+		sprite_draw(TEX_MONSTERS + (uint32_t) (i % 4), src_rect, dst, angle, SPRITE_WHITE, 0.5f);
+	}
+}
 
-	vkCmdBindIndexBuffer(command_buffer, index_buffer.buffer, 0, VK_INDEX_TYPE_UINT16);
-	
-	VkViewport viewport = {0};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float) SCREEN_WIDTH;
-	viewport.height = (float) SCREEN_HEIGHT;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-	vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+void schedule_monster_updates(void) {
+	/*
+	 * Pick which monsters update() steps this step.  A replay has to step the
+	 * same ones as when it was recorded, so it goes by the tiers' intervals
+	 * without the budget, which depends on how long they take
+	 */
+	float rect[4];
+	get_views_visible_rect(cameras, 1.0f, rect);
+	rect[0] -= MONSTER_UPDATE_MARGIN;
+	rect[1] -= MONSTER_UPDATE_MARGIN;
+	rect[2] += MONSTER_UPDATE_MARGIN;
+	rect[3] += MONSTER_UPDATE_MARGIN;
+
+	uint32_t max_updates = UINT32_MAX;
+	if (!replay_is_recording() && !replay_is_playing()) {
+		max_updates = update_tiers_get_budget(&monster_update_tiers, MONSTER_UPDATE_BUDGET_MS);
+	}
+	update_tiers_schedule(&monster_update_tiers, monsters.x, monsters.y, monsters_count, rect, update_step, max_updates);
+}
 
-	VkRect2D scissor = {0};
-	scissor.offset.x = 0;
-	scissor.offset.y = 0;
-	scissor.extent.width = SCREEN_WIDTH;
-	scissor.extent.height = SCREEN_HEIGHT;
-	vkCmdSetScissor(command_buffer, 0, 1, &scissor);
-	
-	// -- Render the tiles ----------------------------------------------------
-	// Bind the descriptor set to update the uniform buffer
-	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, tile_pipeline.layout, 0, 1, &descriptor_sets[current_frame], 0, NULL);
-	
-	// Update push constants with the mvp matrix
-	PushConstants push_constants = {0};
-	// Copy projection and view matrix to the constants
-	glm_mat4_mul(projection_matrix, view_matrix, push_constants.mvp);
-
-	// Create a model matrix for the sprite
-	mat4 tile_model_matrix = GLM_MAT4_IDENTITY_INIT;
-
-	// Update the z-coordinate of the model matrix so that the tilemap is not
-	// infront of everything else
-	vec3 tile_translation = {
-		0.0f,
-		0.0f,
-		10.0f,
-	};
-	glm_translate(tile_model_matrix, tile_translation);
+void update(double dt) {
+	/*
+	 * Step the simulation
+	 *
+	 * @param dt The time step, SIMULATION_STEP with fixed_timestep
+	 */
+	// The rest of the retained sprites aren't touched, so they aren't uploaded
+	if (demo_retained_handles != NULL) {
+		for (uint32_t i = 0; i < DEMO_RETAINED_SPRITES && i < DEMO_SPINNING_SPRITES; i++) {
+			move_retained_sprite(demo_retained_handles[i], NULL, (float) t * 2.0f);
+		}
+	}
 
-	// Apply model matrix to the push constants
-	glm_mat4_mul(push_constants.mvp, tile_model_matrix, push_constants.mvp);
+	for (uint32_t i = 0; i < DEMO_LIGHTS && i < lights_count; i++) {
+		const float* orbit = demo_light_orbits[i];
+		float angle = (float) t * orbit[3] + (float) i;
+		float pos[2] = {orbit[0] + cosf(angle) * orbit[2], orbit[1] + sinf(angle) * orbit[2]};
+		move_light(i, pos);
+	}
 
-	// Set the texture index to 0
-	push_constants.texture_index = TEX_TILES;
-	// Tiles always full white
-	for (size_t i=0; i<4; i++) {
-		push_constants.color[i] = 1.0f;
+	if (demo_particle_emitter != PARTICLE_NO_EMITTER) {
+		float pos[2] = {X_TILES * 0.5f, Y_TILES * 0.5f};
+		float velocity[2] = {sinf((float) t) * 4.0f, 10.0f};
+		move_particle_emitter(demo_particle_emitter, pos, velocity, 2.0f, DEMO_PARTICLES_PER_SECOND);
 	}
 
-	vkCmdPushConstants(command_buffer, tile_pipeline.layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants), &push_constants);
+	if (DEMO_PROJECTILES_PER_SECOND > 0) {
+		spawn_demo_projectiles(dt);
+	}
+	age_projectiles((float) dt);
 
-	// Draw the triangles for the tiles
-	vkCmdDrawIndexed(command_buffer, vertex_indices_count, 1, 0, 0, 0);
-	
-	// -- Render the sprites --------------------------------------------------
-	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, sprite_pipeline.pipeline);
+	// The monsters and projectiles, see create_update_systems()
+	update_step = (float) dt;
+	if (throttle_monster_updates && !gpu_sprite_simulation) {
+		schedule_monster_updates();
+	}
+	uint64_t systems_start_ns = SDL_GetTicksNS();
+	systems_run(&update_systems, transform_job_size);
+	if (throttle_monster_updates && !gpu_sprite_simulation) {
+		update_tiers_end_step(&monster_update_tiers, SDL_GetTicksNS() - systems_start_ns);
+	}
 
-	VkBuffer sprite_vertex_buffers[] = {sprite_vertex_buffer.buffer};
-	VkDeviceSize sprite_offsets[] = {0};
-	vkCmdBindVertexBuffers(command_buffer, 0, 1, sprite_vertex_buffers, sprite_offsets);
+	if (DEMO_PARENTED_SPRITES > 0) {
+		update_demo_tree();
+	}
+	if (DEMO_TWEENED_SPRITES > 0) {
+		update_demo_tweens((float) dt);
+	}
+}
 
-	vkCmdDraw(command_buffer, NUM_MONSTERS * 6, 1, 0, 0);
+void draw_debug_monsters(size_t start, size_t end, void* data) {
+	/*
+	 * The bounds of the monsters in [start, end) which are in a view (and what
+	 * they collide with), from the worker pool
+	 */
+	(void) data;
+	const uint32_t bounds_color = DEBUG_RGBA(64, 255, 96, 200);
+	const uint32_t collision_color = DEBUG_RGBA(255, 160, 64, 200);
+	const float half = MONSTER_SIZE * 0.5f;
+
+	for (size_t i = start; i < end; i++) {
+		const float rect[4] = {monsters.x[i] - half, monsters.y[i] - half, monsters.x[i] + half, monsters.y[i] + half};
+		bool visible = false;
+		for (uint32_t view = 0; view < split_screen_views && !visible; view++) {
+			visible = camera_is_visible(&cameras[view], rect);
+		}
+		if (!visible) {
+			continue;
+		}
 
-	vkCmdEndRendering(command_buffer);
+		debug_draw_rect(rect, bounds_color, DEBUG_LINE_WIDTH);
+		if (monster_collisions) {
+			const float centre[2] = {monsters.x[i], monsters.y[i]};
+			debug_draw_circle(centre, MONSTER_COLLISION_DISTANCE * 0.5f, collision_color, DEBUG_LINE_WIDTH);
+		}
+	}
+}
 
-	// Memory barrier to transition the offscreen image from shader read to color attachment
-	vkx_transition_image_layout(
-		command_buffer,
-		offscreen_images[current_frame].image,
-		vkx_swap_chain.image_format,
-		VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-	);
+void draw_debug_shapes(void) {
+	/*
+	 * Draw what the culling, collision and pathing are working with, for F4
+	 */
+	for (uint32_t view = 0; view < split_screen_views; view++) {
+		debug_draw_rect(cameras[view].visible, DEBUG_RGBA(255, 255, 0, 255), DEBUG_LINE_WIDTH * 2.0f);
+	}
 
-	// -- Render the screen ---------------------------------------------------
-	// Update some parameters on the original structs
-	viewport.width = (float) vkx_swap_chain.extent.width;
-	viewport.height = (float) vkx_swap_chain.extent.height;
-	vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+	jobs_parallel_for(monsters_count, transform_job_size, draw_debug_monsters, NULL);
 
-	scissor.extent = vkx_swap_chain.extent;
-	vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+	const float projectile_radius = MONSTER_SIZE * 0.125f;
+	for (uint32_t i = 0; i < projectile_pool.count; i++) {
+		const float centre[2] = {projectiles.x[i], projectiles.y[i]};
+		debug_draw_circle(centre, projectile_radius, DEBUG_RGBA(255, 64, 64, 255), DEBUG_LINE_WIDTH);
+	}
 
-	rendering_info.pDepthAttachment = NULL;
-	color_attachment_info.imageView = vkx_swap_chain.image_views[image_index];
-	rendering_info.renderArea.extent = vkx_swap_chain.extent;
-	
-	// NOTE: an improvement we could make here would be to add a projection
-	// matrix and feed it into the screen pipeline to ensure a consistent
-	// aspect ratio (i.e. but black stripes down the sides of the screen).
-	// This would probably involve adding the push constants to the screen
-	// pipeline, or adding that projection matrix to the ubo.
+	// An arrow on each tile in the first view, the way it heads for the target
+	if (monster_pathfinding) {
+		const float* visible = cameras[0].visible;
+		int32_t x0 = (int32_t) fmaxf(floorf(visible[0]), 0.0f);
+		int32_t y0 = (int32_t) fmaxf(floorf(visible[1]), 0.0f);
+		int32_t x1 = (int32_t) fminf(ceilf(visible[2]), (float) monster_flow_field.width);
+		int32_t y1 = (int32_t) fminf(ceilf(visible[3]), (float) monster_flow_field.height);
+		if (x1 > x0 && y1 > y0 && (x1 - x0) * (y1 - y0) <= DEBUG_MAX_FLOW_TILES) {
+			for (int32_t y = y0; y < y1; y++) {
+				for (int32_t x = x0; x < x1; x++) {
+					const float from[2] = {(float) x + 0.5f, (float) y + 0.5f};
+					float direction[2];
+					if (!flow_field_sample(&monster_flow_field, from[0], from[1], direction)) {
+						continue;
+					}
+					const float to[2] = {from[0] + direction[0] * 0.4f, from[1] + direction[1] * 0.4f};
+					debug_draw_arrow(from, to, DEBUG_RGBA(96, 160, 255, 200), DEBUG_LINE_WIDTH);
+				}
+			}
+		}
+	}
+}
 
-	// Begin rendering again
-	vkCmdBeginRendering(command_buffer, &rendering_info);
-	vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, screen_pipeline.pipeline);
-	vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, screen_pipeline.layout, 0, 1, &screen_descriptor_sets[current_frame], 0, NULL);
-	vkCmdDraw(command_buffer, 6, 1, 0, 0);
+void draw_demo_shape_panel(void) {
+	/*
+	 * Draw the demo's panel in the top left of the first view, sized to it so
+	 * it stays the same on the screen whatever the zoom
+	 */
+	const float* visible = cameras[0].visible;
+	float unit = (visible[2] - visible[0]) / 64.0f;
+	float x = visible[0] + unit * 2.0f;
+	float y = visible[1] + unit * 2.0f;
+	float width = unit * 16.0f;
+	float height = unit * 9.0f;
+
+	ShapeStyle shadow = {SPRITE_RGBA(0, 0, 0, 128), 0, 0.0f, unit, unit};
+	const float shadow_rect[4] = {x + unit * 0.5f, y + unit * 0.5f, width, height};
+	shape_draw(SHAPE_RECT, shadow_rect, 0.0f, &shadow, SHAPE_PANEL_Z);
+
+	ShapeStyle panel = {SPRITE_RGBA(32, 36, 48, 224), SPRITE_RGBA(160, 176, 208, 255), unit * 0.15f, unit, 0.0f};
+	const float panel_rect[4] = {x, y, width, height};
+	shape_draw(SHAPE_RECT, panel_rect, 0.0f, &panel, SHAPE_PANEL_Z);
+
+	ShapeStyle button = {SPRITE_RGBA(64, 128, 224, 255), SPRITE_RGBA(224, 232, 255, 255), unit * 0.12f, 0.0f, 0.0f};
+	for (uint32_t i = 0; i < 4; i++) {
+		const float button_rect[4] = {x + unit * (1.0f + 2.5f * (float) i), y + unit, unit * 2.0f, unit * 2.0f};
+		shape_draw(SHAPE_ELLIPSE, button_rect, 0.0f, &button, SHAPE_PANEL_Z);
+	}
 
-	// --- End dynamic rendering ----------------------------------------------
-	vkCmdEndRendering(command_buffer);
-	
-	// Memory barrier to transition the swap chain image from color attachment to present
-	vkx_transition_image_layout(
-		command_buffer,
-		vkx_swap_chain.images[image_index],
-		vkx_swap_chain.image_format,
-		VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-		VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
-	);
+	// A bar filling up and emptying, over its background
+	float fill = 0.5f + 0.5f * sinf((float) t);
+	ShapeStyle bar_back = {SPRITE_RGBA(16, 16, 24, 255), 0, 0.0f, unit * 0.5f, 0.0f};
+	const float bar_back_rect[4] = {x + unit, y + unit * 6.5f, width - unit * 2.0f, unit};
+	shape_draw(SHAPE_RECT, bar_back_rect, 0.0f, &bar_back, SHAPE_PANEL_Z);
+	ShapeStyle bar = {SPRITE_RGBA(96, 208, 112, 255), 0, 0.0f, unit * 0.5f, 0.0f};
+	const float bar_rect[4] = {x + unit, y + unit * 6.5f, fmaxf((width - unit * 2.0f) * fill, unit), unit};
+	shape_draw(SHAPE_RECT, bar_rect, 0.0f, &bar, SHAPE_PANEL_Z);
+}
 
-	if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
-		fprintf(stderr, "failed to record command buffer!\n");
-		exit(1);
+void draw_render_stream_sprites(size_t start, size_t end, void* data) {
+	/*
+	 * Draw the sprites of the render stream's newest frame, from the worker
+	 * pool
+	 */
+	(void) data;
+	for (size_t i = start; i < end; i++) {
+		sprite_batch_draw_item(&render_stream_frame.items[i]);
 	}
 }
 
-void draw_frame() {
-	vkWaitForFences(vkx_instance.device, 1, &vkx_frame_sync_objects[current_frame].in_flight_fence, VK_TRUE, UINT64_MAX);
-
-	uint32_t image_index;
-	VkResult result = vkAcquireNextImageKHR(vkx_instance.device, vkx_swap_chain.swap_chain, UINT64_MAX, vkx_frame_sync_objects[current_frame].image_available_semaphore, VK_NULL_HANDLE, &image_index);
-
-	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-		printf("Couldn't acquire swap chain image - recreating swap chain\n");
-		vkx_recreate_swap_chain();
+void draw_game(void) {
+	/*
+	 * Draw the frame's sprite_draw() sprites, between the last two steps of the
+	 * simulation
+	 */
+	if (render_stream_mode == RENDER_STREAM_RECEIVE) {
+		jobs_parallel_for(render_stream_frame.items_count, transform_job_size, draw_render_stream_sprites, NULL);
 		return;
-	} else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
-		fprintf(stderr, "Failed to acquire swap chain image (result: %d)\n", result);
-		exit(1);
 	}
-	
-	// Update all uniform buffers with transform data
-	UniformBufferObject ubo = {0};
-	ubo.t = (float) t;
-	// Update monster transforms
-	for (size_t i=0; i<NUM_MONSTERS; i++) {
-		// Copy projection and view matrix to the uniform buffer
-		glm_mat4_mul(projection_matrix, view_matrix, ubo.mvps[i]);
-		// Create a model matrix for the sprite
-		mat4 model_matrix = GLM_MAT4_IDENTITY_INIT;
-		// Monsters are 2 tiles wide (in the rendered image)
-		const float monster_size = 2.0f;
-		// Centre the sprite around it's position
-		vec3 offset = {-monster_size / 2, -monster_size / 2, 0.0f};
-		glm_translate(model_matrix, offset);
-
-		// Move it up and down
-		vec3 translation = {
-			monsters[i].pos[0],
-			monsters[i].pos[1] + (float) sin(t * 4.0f + i * 5) * 0.2f,
-			monsters[i].pos[2]
-		};
-		glm_translate(model_matrix, translation);
-
-		vec3 scale = {monster_size, monster_size, 1.0f};
-		// Pulsating effect
-		float sin_val = (float) sin(t * 2.0f + i * 5) * 0.15f;
-		scale[0] *= (1 + sin_val);
-		scale[1] *= (1 - sin_val);
-		glm_scale(model_matrix, scale);
-		
-		// Apply model matrix to the push constants
-		glm_mat4_mul(ubo.mvps[i], model_matrix, ubo.mvps[i]);
+	if (DEMO_BATCHED_SPRITES > 0) {
+		jobs_parallel_for(DEMO_BATCHED_SPRITES, transform_job_size, draw_demo_sprites, NULL);
 	}
-	
-	memcpy(uniform_buffers_mapped[current_frame], &ubo, sizeof(ubo));
-
-	vkResetFences(vkx_instance.device, 1, &vkx_frame_sync_objects[current_frame].in_flight_fence);
-	
-	vkResetCommandBuffer(vkx_instance.command_buffers[current_frame], /*VkCommandBufferResetFlagBits*/ 0);
-	
-	// Write our draw commands into the command buffer
-	record_command_buffer(vkx_instance.command_buffers[current_frame], image_index);
-
-	VkSubmitInfo submit_info = {0};
-	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	
-	VkSemaphore* image_available_semaphore = &vkx_frame_sync_objects[current_frame].image_available_semaphore;
-	VkPipelineStageFlags wait_stages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-	submit_info.waitSemaphoreCount = 1;
-	submit_info.pWaitSemaphores = image_available_semaphore;
-	submit_info.pWaitDstStageMask = wait_stages;
+	if (DEMO_PARENTED_SPRITES > 0) {
+		jobs_parallel_for(demo_tree.count, transform_job_size, draw_demo_tree, NULL);
+	}
+	if (DEMO_TWEENED_SPRITES > 0) {
+		jobs_parallel_for(DEMO_TWEENED_SPRITES, transform_job_size, draw_demo_tweens, NULL);
+	}
+	draw_projectiles(simulation_interpolation);
+	if (demo_shape_panel) {
+		draw_demo_shape_panel();
+	}
+}
 
-	submit_info.commandBufferCount = 1;
-	submit_info.pCommandBuffers = &vkx_instance.command_buffers[current_frame];
+void publish_latched_camera(void) {
+	/*
+	 * Hand the first view's camera to the renderer as soon as it has moved,
+	 * for it to latch before submitting (late_latched_camera)
+	 */
+	SDL_LockMutex(latched_camera_mutex);
+	latched_camera = cameras[0];
+	SDL_UnlockMutex(latched_camera_mutex);
+}
 
-	VkSemaphore* render_finished_semaphore = &vkx_swap_chain.render_finished_semaphores[image_index];
-	submit_info.signalSemaphoreCount = 1;
-	submit_info.pSignalSemaphores = render_finished_semaphore;
+void write_frame_state(FrameState* state) {
+	/*
+	 * Copy what the renderer needs from the simulation into a snapshot
+	 */
+	state->t = t;
+	state->sprite_sim_dt = sprite_sim_dt;
+	memcpy(state->cameras, cameras, sizeof(cameras));
+	memcpy(state->x, monsters.x, sizeof(float) * monsters_count);
+	memcpy(state->y, monsters.y, sizeof(float) * monsters_count);
+	memcpy(state->prev_x, monsters.prev_x, sizeof(float) * monsters_count);
+	memcpy(state->prev_y, monsters.prev_y, sizeof(float) * monsters_count);
+	state->interpolation = simulation_interpolation;
+	// The snapshot's old sprites are what the next update draws over
+	sprite_batch_swap(&state->sprites, &sprite_batch);
+	if (debug_shapes_visible) {
+		debug_draw_list_swap(&state->debug_lines, &debug_lines);
+	}
 
-	if (vkQueueSubmit(vkx_instance.graphics_queue, 1, &submit_info, vkx_frame_sync_objects[current_frame].in_flight_fence) != VK_SUCCESS) {
-		fprintf(stderr, "failed to submit draw command buffer!");
-		exit(1);
+	// Only the retained sprites which changed, or all of them if the renderer
+	// lost some
+	if (SDL_SetAtomicInt(&retained_sprites_lost, 0) != 0) {
+		sprite_pool_mark_all_dirty(&retained_sprites);
+	}
+	state->retained_ranges_count = sprite_pool_take_dirty_ranges(&retained_sprites, state->retained_ranges,
+			MAX_RETAINED_SPRITE_RANGES, RETAINED_SPRITES_MAX_GAP);
+
+	const size_t vertices_per_sprite = instanced_sprites ? 1 : 6;
+	uint32_t changed = 0;
+	for (uint32_t i = 0; i < state->retained_ranges_count; i++) {
+		const SpritePoolRange* range = &state->retained_ranges[i];
+		memcpy(&state->retained_transforms[changed], &retained_transforms[range->first], sizeof(SpriteTransform) * range->count);
+		memcpy(&state->retained_records[changed * vertices_per_sprite], &retained_records[range->first * vertices_per_sprite],
+				sizeof(VertexBufferSprite) * vertices_per_sprite * range->count);
+		changed += range->count;
 	}
+	state->retained_changed_count = changed;
+	state->retained_slots_count = retained_sprites.slots_count;
 
-	VkPresentInfoKHR present_info = {0};
-	present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+	memcpy(state->particle_emitters, particle_emitters, sizeof(ParticleEmitter) * particle_emitters_count);
+	state->particle_emitters_count = particle_emitters_count;
+	state->particles_spawned = particles_spawned;
 
-	present_info.waitSemaphoreCount = 1;
-	present_info.pWaitSemaphores = render_finished_semaphore;
+	memcpy(state->lights, lights, sizeof(Light) * lights_count);
+	state->lights_count = lights_count;
 
-	VkSwapchainKHR swap_chains[] = {vkx_swap_chain.swap_chain};
-	present_info.swapchainCount = 1;
-	present_info.pSwapchains = swap_chains;
+	// The occluder rows which changed, up to as many as a frame copies
+	state->occluder_rows_count = 0;
+	for (uint32_t y = 0; occluder_rows_dirty_count > 0 && state->occluder_rows_count < MAX_OCCLUDER_ROWS_PER_FRAME; y++) {
+		if (!occluder_rows_dirty[y]) {
+			continue;
+		}
+		occluder_rows_dirty[y] = false;
+		occluder_rows_dirty_count--;
 
-	present_info.pImageIndices = &image_index;
+		uint32_t words = tile_solidity.words_per_row;
+		memcpy(&state->occluder_words[words * state->occluder_rows_count], &tile_solidity.bits[(size_t) y * words],
+				sizeof(uint64_t) * words);
+		state->occluder_rows[state->occluder_rows_count++] = y;
+	}
+}
 
-	result = vkQueuePresentKHR(vkx_instance.present_queue, &present_info);
+bool window_is_hidden(void) {
+	/*
+	 * Whether nothing drawn would be seen, with the window minimised, hidden or
+	 * covered by others
+	 */
+	SDL_WindowFlags flags = SDL_GetWindowFlags(window);
+	return (flags & (SDL_WINDOW_HIDDEN | SDL_WINDOW_MINIMIZED | SDL_WINDOW_OCCLUDED)) != 0;
+}
 
-	if (result == VK_SUBOPTIMAL_KHR) {
-		if (suboptimal_swapchain_count == 0) {
-			printf("Swapchain was suboptimal\n");
-		}
-		suboptimal_swapchain_count++;
-	}
-	else {
-		// Reset to 0 if it doesn't come back like that every frame
-		suboptimal_swapchain_count = 0;
-	}
-	
-	if (framebuffer_resized) {
-		printf("Framebuffer resized - recreating swap chain\n");
-		framebuffer_resized = false;
-		vkx_recreate_swap_chain();
+bool frame_is_unchanged(void) {
+	/*
+	 * Check whether the frame the update just made would look the same as the
+	 * last one handed to the renderer, for skip_idle_frames, and remember what
+	 * it shows for next time.  Whatever moves every frame or on the GPU (the
+	 * monsters, animated sprites, particles, textures streaming in, the post
+	 * effects and the HUD) counts as a change
+	 */
+	bool unchanged = monsters_count == 0 && !hud_visible && post_chain_is_empty(&post_chain)
+		&& !gpu_sprite_simulation && !gpu_particles && !use_sparse_atlas() && !(bindless_textures && texture_streaming)
+		&& !(capture_enabled && capture_is_wanted())
+		&& occluder_rows_dirty_count == 0 && SDL_GetAtomicInt(&render_work_left) == 0
+		&& !sprite_pool_is_dirty(&retained_sprites) && SDL_GetAtomicInt(&retained_sprites_lost) == 0;
+
+	if (memcmp(cameras, drawn_cameras, sizeof(cameras)) != 0) {
+		memcpy(drawn_cameras, cameras, sizeof(cameras));
+		unchanged = false;
 	}
-	else if (suboptimal_swapchain_count >= SUBOPTIMAL_SWAPCHAIN_THRESHOLD) {
-		suboptimal_swapchain_count = 0;
-		printf("Swapchain is still suboptimal - recreating\n");
-		vkx_recreate_swap_chain();
+	if (lights_count != drawn_lights_count || memcmp(lights, drawn_lights, sizeof(Light) * lights_count) != 0) {
+		memcpy(drawn_lights, lights, sizeof(Light) * lights_count);
+		drawn_lights_count = lights_count;
+		unchanged = false;
 	}
-	else if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-		printf("Couldn't present swap chain image - recreating swap chain (result: %d)\n", result);
-		vkx_recreate_swap_chain();
+
+	// The sprite_draw() sprites are compared as a set, like for the damage
+	uint64_t hash = 0;
+	for (uint32_t chunk = 0; chunk < sprite_batch.chunks_count; chunk++) {
+		for (uint32_t i = 0; i < sprite_batch.chunk_counts[chunk].count; i++) {
+			hash += damage_hash(&sprite_batch.items[chunk * SPRITE_BATCH_CHUNK + i], sizeof(SpriteBatchItem));
+		}
 	}
-	else if (result != VK_SUBOPTIMAL_KHR && result != VK_SUCCESS) {
-		fprintf(stderr, "failed to present swap chain image! (result: %d)\n", result);
-		exit(1);
+	if (hash != drawn_batch_hash) {
+		drawn_batch_hash = hash;
+		unchanged = false;
 	}
 
-	current_frame = (current_frame + 1) % VKX_FRAMES_IN_FLIGHT;
+	// The animated retained sprites move in the vertex shader
+	for (uint32_t i = 0; unchanged && i < retained_sprites.slots_count; i++) {
+		if (retained_transforms[i].anim_params != 0) {
+			unchanged = false;
+		}
+	}
+	return unchanged;
 }
 
-void cleanup_vulkan(void) {
-	printf("Cleaning up Vulkan\n");
+void count_frame(void) {
+	/*
+	 * Count the frames drawn, and print the frame rate (and the GPU times)
+	 * every second
+	 */
+	double now = frame_state->t;
+	frame_count++;
 
-	vkx_cleanup_swap_chain();
-	
-	vkDestroySampler(vkx_instance.device, texture_sampler, NULL);
-	for (size_t i = 0; i < num_textures; i++) {
-		vkx_cleanup_image(&textures[i]);
+	if (now - last_fps_time >= 1.0) {
+		double total_time = now - last_fps_time;
+		uint32_t fps = (uint32_t) (frame_count / total_time);
+		printf("FPS: %d\n", fps);
+		printf("Frame time: %f ms\n", (total_time / frame_count) * 1000.0);
+		if (print_gpu_times) {
+			vkx_profiler_print(&profiler);
+
+			// How many times the sprites shaded each pixel of the picture, on average
+			VkxProfilerStatistics sprite_statistics = vkx_profiler_get_statistics(&profiler, profile_sprites);
+			if (sprite_statistics.fragment_invocations > 0) {
+				VkExtent2D extent = get_render_extent();
+				printf("Sprite overdraw: %.2f fragments per pixel\n",
+						(double) sprite_statistics.fragment_invocations / ((double) extent.width * (double) extent.height));
+			}
+		}
+		if (dynamic_resolution && vkx_profiler_is_enabled(&profiler)) {
+			printf("Render scale: %.2f\n", render_scale);
+		}
+		frame_count = 0;
+		last_fps_time = now;
 	}
+}
 
-	for (size_t i = 0; i < VKX_FRAMES_IN_FLIGHT; i++) {
-		vkx_cleanup_buffer(&uniform_buffers[i]);
+void wait_until(uint64_t target_ns) {
+	/*
+	 * Sleep until shortly before the target time and spin the rest, as the
+	 * sleep alone can be late by a millisecond or more
+	 *
+	 * @param target_ns Time from SDL_GetTicksNS()
+	 */
+	uint64_t now = SDL_GetTicksNS();
+	if (target_ns > now + FRAME_SPIN_NS) {
+		SDL_DelayNS(target_ns - now - FRAME_SPIN_NS);
 	}
-	
-	vkDestroyDescriptorPool(vkx_instance.device, descriptor_pool, NULL);
-	
-	vkx_cleanup_pipeline(tile_pipeline);
-	vkx_cleanup_pipeline(screen_pipeline);
-	vkx_cleanup_pipeline(sprite_pipeline);
 
-	vkx_cleanup_buffer(&vertex_buffer);
-	vkx_cleanup_buffer(&index_buffer);
-	vkx_cleanup_buffer(&sprite_vertex_buffer);
-	
-	for (size_t i = 0; i < VKX_FRAMES_IN_FLIGHT; i++) {
-		vkDestroySemaphore(vkx_instance.device, vkx_frame_sync_objects[i].image_available_semaphore, NULL);
-		vkDestroyFence(vkx_instance.device, vkx_frame_sync_objects[i].in_flight_fence, NULL);
+	while (SDL_GetTicksNS() < target_ns) {
+		SDL_CPUPauseInstruction();
 	}
+}
 
-	for (size_t i = 0; i < VKX_FRAMES_IN_FLIGHT; i++) {
-		vkx_cleanup_image(&offscreen_images[i]);
-		vkx_cleanup_image(&depth_images[i]);
+uint64_t get_refresh_period_ns() {
+	// Falls back on min_frame_time if the display doesn't say
+	const SDL_DisplayMode* mode = SDL_GetCurrentDisplayMode(SDL_GetDisplayForWindow(window));
+	if (mode == NULL || mode->refresh_rate <= 0.0f) {
+		return (uint64_t) (min_frame_time * SDL_NS_PER_SECOND);
 	}
 
-	vkx_cleanup_instance();
+	return (uint64_t) ((double) SDL_NS_PER_SECOND / mode->refresh_rate);
 }
 
-double rand_double(double exclusive_max) {
-	for (;;) {
-		double result = ((double)rand() / (double)RAND_MAX) * exclusive_max;
-		if (result < exclusive_max) {
-			return result;
-		}
+void start_frame_just_in_time() {
+	/*
+	 * Wait until the frame would be submitted just as the GPU runs out of
+	 * work.  The frame before last has to be finished before this one can use
+	 * its resources anyway, and then the GPU has (at most) the last frame left,
+	 * which started from then or from its submit, whichever is later
+	 */
+	if (headless || bench_is_running() || vkx_instance.frames_in_flight < 2) {
+		just_in_time_start_ns = SDL_GetTicksNS();
+		return;
+	}
+
+	trace_begin("wait for frame before last");
+	uint32_t before_last = (current_frame + vkx_instance.frames_in_flight - 2) % vkx_instance.frames_in_flight;
+	if (timeline_frame_sync) {
+		vkx_frame_timeline_wait(vkx_frames[before_last].timeline_value);
+	} else {
+		vkWaitForFences(vkx_instance.device, 1, &vkx_frames[before_last].in_flight_fence, VK_TRUE, UINT64_MAX);
 	}
+	trace_end();
+
+	uint64_t now = SDL_GetTicksNS();
+	uint64_t gpu_start_ns = just_in_time_submit_ns > now ? just_in_time_submit_ns : now;
+	uint64_t gpu_free_ns = gpu_start_ns + (uint64_t) (just_in_time_gpu_ms * SDL_NS_PER_MS);
+	uint64_t cpu_ns = (uint64_t) ((just_in_time_cpu_ms + JUST_IN_TIME_MARGIN_MS) * SDL_NS_PER_MS);
+	if (gpu_free_ns > now + cpu_ns) {
+		trace_begin("just in time");
+		wait_until(gpu_free_ns - cpu_ns);
+		trace_end();
+	}
+	just_in_time_start_ns = SDL_GetTicksNS();
 }
 
-int rand_range(int min, int exclusive_max) {
+void pace_frame() {
 	/*
-	 * Return a random number between min and exclusive max
+	 * Wait until it's time to start the next frame, before the input is read.
+	 * Low latency waits for the presents before the queued ones to be on
+	 * screen, or paces to the refresh rate without present wait (or with the
+	 * present thread).  Otherwise
+	 * limit_fps paces to min_frame_time.  Headless frames and benchmarks go as
+	 * fast as they can
 	 */
-	return min + (int)rand_double((double)(exclusive_max - min));
-}
+	if (headless || bench_is_running()) {
+		return;
+	}
 
-size_t get_tile_index(size_t x, size_t y) {
-	/*
-	 * Return the index of the tile at (x, y)
-	 */
-	return x + y * X_TILES;
-}
+	uint64_t frame_ns = 0;
+	if (low_latency) {
+		// The present thread has the swap chain
+		if (vkx_instance.has_present_wait && !use_threaded_present()) {
+			if (vkx_swap_chain.present_id > LOW_LATENCY_QUEUED_PRESENTS) {
+				trace_begin("wait for present");
+				vkx_wait_for_present(vkx_swap_chain.present_id - LOW_LATENCY_QUEUED_PRESENTS, PRESENT_WAIT_TIMEOUT_NS);
+				trace_end();
+			}
+			return;
+		}
+		frame_ns = get_refresh_period_ns();
+	}
+	else if (limit_fps) {
+		frame_ns = (uint64_t) (min_frame_time * SDL_NS_PER_SECOND);
+	}
 
-void create_tiles(void) {
-	// The number of occupied tiles
-	size_t num_tiles = 0;
+	if (frame_ns == 0) {
+		return;
+	}
 
-	// Generate a random set of tiles
-	srand(time(NULL));
-	for (int y = Y_TILES - 1; y >= 0; y--) {
-		for (size_t x = 0; x < X_TILES; x++) {
-			size_t idx = get_tile_index(x, y);
+	// Start again from now if it's fallen a whole frame behind, rather than
+	// rushing the next few frames to catch up
+	uint64_t now = SDL_GetTicksNS();
+	if (next_frame_ns + frame_ns < now) {
+		next_frame_ns = now;
+	}
 
-			// Edge tiles are always occupied
-			if(x == 0 || x == X_TILES - 1 || y == 0 || y == Y_TILES - 1) {
-				tiles[idx] = 0;
-			}
-			// 2/3 of the rest are empty
-			else if(rand() % 3 >= 2) {
-				tiles[idx] = (uint8_t) rand_range(0, TILESET_TOTAL_TILES);
-			} else {
-				tiles[idx] = EMPTY;
-			}
+	trace_begin("pace frame");
+	wait_until(next_frame_ns);
+	trace_end();
 
-			if (tiles[idx] != EMPTY) {
-				num_tiles++;
-			}
+	next_frame_ns += frame_ns;
+}
 
-			// Debug test stuff
-			if (tiles[idx] == EMPTY) {
-				printf("-- ");
-			}
-			else {
-				if (tiles[idx] < 10) {
-					printf("0");
-				}
-				printf("%d ", tiles[idx]);
-			}
-		}
-		printf("\n");
+void render_frame(uint32_t snapshot, void* data) {
+	/*
+	 * Draw a frame from a snapshot, on the render thread if there is one.  That
+	 * does the frame pacing too, as the present wait needs the swap chain
+	 */
+	(void) data;
+
+	if (threaded_rendering) {
+		pace_frame();
 	}
 
-	// Generate the mesh for the tilemap
-	
-	// First let's allocate some memory for the vertices and indices
-	// We need 4 vertices per tile, and 6 indices per tile
-	vertices_count = num_tiles * 4;
-	vertices = malloc(sizeof(Vertex) * vertices_count);
-	vertex_indices_count = num_tiles * 6;
-	vertex_indices = malloc(sizeof(uint16_t) * vertex_indices_count);
-
-	// Loop through and add the geometry for each tile
-	size_t vertex_idx = 0;
-	size_t index_idx = 0;
-
-	for (size_t x = 0; x < X_TILES; x++) {
-		for (size_t y = 0; y < Y_TILES; y++) {
-			size_t idx = get_tile_index(x, y);
-			if (tiles[idx] == EMPTY) {
-				continue;
-			}
+	frame_state = &frame_states[snapshot];
 
-			// We need to calculate the grid coords of the texture tile
-			size_t tileset_idx = tiles[idx];
-			size_t tileset_x = tileset_idx % TILESET_X_TILES;
-			size_t tileset_y = tileset_idx / TILESET_X_TILES;
+	// Without the render thread this is the main thread, whose frame arena
+	// still has the update's allocations in it
+	Arena* arena = frame_arena();
+	size_t arena_mark = arena_get_mark(arena);
 
-			// Tiles are 1x1, so we can just use the x and y coordinates as the vertex positions
-			// We can leave all z coordinates as 0.0f. We'll update colours later
-			
-			// Bottom left
-			vertices[vertex_idx].pos[0] = (float) x;
-			vertices[vertex_idx].pos[1] = (float) y;
-			vertices[vertex_idx].tex_coord[0] = (float) tileset_x / TILESET_X_TILES;
-			vertices[vertex_idx].tex_coord[1] = (float) tileset_y / TILESET_Y_TILES + 1.0f / TILESET_Y_TILES;
-			vertex_idx++;
+	trace_begin("draw frame");
+	draw_frame();
+	trace_end();
 
-			// Bottom right
-			vertices[vertex_idx].pos[0] = (float) x + 1.0f;
-			vertices[vertex_idx].pos[1] = (float) y;
-			vertices[vertex_idx].tex_coord[0] = (float) tileset_x / TILESET_X_TILES + 1.0f / TILESET_X_TILES;
-			vertices[vertex_idx].tex_coord[1] = (float) tileset_y / TILESET_Y_TILES + 1.0f / TILESET_Y_TILES;
-			vertex_idx++;
+	arena_release(arena, arena_mark);
 
-			// Top right
-			vertices[vertex_idx].pos[0] = (float) x + 1.0f;
-			vertices[vertex_idx].pos[1] = (float) y + 1.0f;
-			vertices[vertex_idx].tex_coord[0] = (float) tileset_x / TILESET_X_TILES + 1.0f / TILESET_X_TILES;
-			vertices[vertex_idx].tex_coord[1] = (float) tileset_y / TILESET_Y_TILES;
-			vertex_idx++;
+	count_frame();
+}
 
-			// Top left
-			vertices[vertex_idx].pos[0] = (float) x;
-			vertices[vertex_idx].pos[1] = (float) y + 1.0f;
-			vertices[vertex_idx].tex_coord[0] = (float) tileset_x / TILESET_X_TILES;
-			vertices[vertex_idx].tex_coord[1] = (float) tileset_y / TILESET_Y_TILES;
-			vertex_idx++;
+void apply_bench_scenario(void) {
+	/*
+	 * Set the renderer up for the benchmark scenario in bench_options: its
+	 * sprites, map and post effects, and nothing which changes from run to run
+	 */
+	const BenchScenario* scenario = bench_options.scenario;
+	monsters_count = scenario->sprites_count;
+	chunked_tilemap = scenario->map_width > X_TILES || scenario->map_height > Y_TILES;
+	camera_pan[0] = scenario->camera_speed;
+	camera_pan[1] = scenario->camera_speed * 0.5f;
+	headless = bench_options.headless;
+	dynamic_resolution = false;
+	low_latency = false;
+	// Don't wait for vertical blanks, FIFO if the surface doesn't have it
+	present_mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+}
 
-			// Now we need to add the indices for this tile
-			vertex_indices[index_idx++] = vertex_idx - 4; // Bottom left
-			vertex_indices[index_idx++] = vertex_idx - 3; // Bottom right
-			vertex_indices[index_idx++] = vertex_idx - 2; // Top right
-			vertex_indices[index_idx++] = vertex_idx - 2; // Top right
-			vertex_indices[index_idx++] = vertex_idx - 1; // Top left
-			vertex_indices[index_idx++] = vertex_idx - 4; // Bottom left
-		}
+void add_bench_phases(void) {
+	/*
+	 * The CPU phases, and a GPU phase for each of the profiler's scopes
+	 */
+	bench_phase_update = bench_add_phase("cpu update");
+	bench_phase_snapshot = bench_add_phase("cpu snapshot");
+	bench_phase_wait = bench_add_phase("cpu wait");
+	bench_phase_record = bench_add_phase("cpu record");
+	bench_phase_submit = bench_add_phase("cpu submit");
+	// On the present thread, so not part of the frame's CPU time
+	if (threaded_present) {
+		bench_phase_present = bench_add_phase("cpu present");
+	}
+	// Parts of the above, so a regression in one of them shows up
+	if (!gpu_sprite_simulation) {
+		bench_phase_transforms = bench_add_phase("cpu transforms");
+	}
+	if (sprite_render_queue) {
+		bench_phase_sort = bench_add_phase("cpu sort");
 	}
 
-	// Loop through all vertices now and set z coord
-	for (size_t i = 0; i < vertices_count; i++) {
-		vertices[i].pos[2] = 0.0f;
+	for (uint32_t i = 0; i < profiler.scopes_count; i++) {
+		snprintf(bench_gpu_phase_names[i], sizeof(bench_gpu_phase_names[i]), "gpu %s", profiler.scopes[i].name);
+		bench_phases_gpu[i] = bench_add_phase(bench_gpu_phase_names[i]);
 	}
 }
 
-void create_monsters(void) {
-	// Create the array to hold sprite data
-	vertex_sprites_count = NUM_MONSTERS * 6;
-	vertex_sprites = malloc(sizeof(VertexBufferSprite) * vertex_sprites_count);
-
-	// Create the monsters and their and their "sprites"
-	for (size_t i=0; i<NUM_MONSTERS; i++) {
-		monsters[i].pos[0] = rand_double(X_TILES);
-		monsters[i].pos[1] = rand_double(Y_TILES);
-		// Half of the monsters will be in front of the tiles and half
-		// will be behind
-		monsters[i].pos[2] = rand_double(18) + 1;
+void start_telemetry(void) {
+	/*
+	 * Add the gauges and start the exporter
+	 */
+	for (uint32_t i = 0; i < vkx_memory_get_heaps_count(); i++) {
+		char name[TELEMETRY_MAX_NAME];
+		snprintf(name, sizeof(name), "memory.heap%u.used_mb", i);
+		telemetry_heap_gauges[i] = telemetry_add_gauge(name);
+	}
+	if (vkx_command_stats_enabled()) {
+		for (uint32_t i = 0; i < _VKX_STAT_COUNT; i++) {
+			char name[TELEMETRY_MAX_NAME];
+			snprintf(name, sizeof(name), "commands.%s", vkx_command_stat_name((VkxCommandStat) i));
+			telemetry_command_gauges[i] = telemetry_add_gauge(name);
+		}
+	}
 
-		monsters[i].spd[0] = rand_double(10) - 5;
-		monsters[i].spd[1] = rand_double(10) - 5;
-		
-		// Fade to blue as the monsters z coord puts them in the background
-		float blue_fade = monsters[i].pos[2] / 20.0f;
-		monsters[i].color[0] = 1.0f - blue_fade;
-		monsters[i].color[1] = 1.0f - blue_fade;
-		monsters[i].color[2] = 1.0f - blue_fade * 0.6f;
-		monsters[i].color[3] = 1.0f;
+	if (!headless) {
+		telemetry_refresh_period_ns = get_refresh_period_ns();
+	}
 
-		monsters[i].texture = TEX_MONSTERS + (i / 16) % 4;
+	TelemetryDesc desc = {0};
+	desc.interval_ms = TELEMETRY_INTERVAL_MS;
+	desc.json_filename = TELEMETRY_FILENAME;
+	desc.statsd_host = TELEMETRY_STATSD_HOST;
+	desc.statsd_port = TELEMETRY_STATSD_PORT;
+	desc.prefix = TELEMETRY_PREFIX;
+	if (!telemetry_start(&desc)) {
+		fprintf(stderr, "Telemetry has nowhere to go, so it's off\n");
+	}
+}
 
-		assert(monsters[i].texture < _TEX_COUNT);
-		assert(monsters[i].texture >= TEX_MONSTERS);
+void receive_render_stream(void) {
+	/*
+	 * Take what the render stream's sender has sent: make its tile changes and
+	 * move the first view's camera to where the sender's is.  The sprites are
+	 * drawn by draw_game()
+	 */
+	if (!render_stream_receive(&render_stream_frame)) {
+		return;
+	}
 
-		// Create the sprite vertices
-		for (size_t j=0; j<6; j++ ) {
-			size_t idx = i * 6 + j;
-			assert(idx < vertex_sprites_count);
+	for (uint32_t i = 0; i < render_stream_frame.tiles_count; i++) {
+		const RenderStreamTile* tile = &render_stream_frame.tiles[i];
+		if (tile->value <= EMPTY) {
+			set_map_tile(tile->x, tile->y, (uint16_t) tile->value);
+		}
+	}
+	render_stream_frame.tiles_count = 0;
 
-			for (size_t k=0; k<4; k++) {
-				vertex_sprites[idx].color[k] = monsters[i].color[k];
-			}
-			// Calculate uv index based on 4x4 grid of sprites
-			size_t sprite_x = i % 4;
-			size_t sprite_y = (i % 16) / 4;
-			float uv_scale = 1.0f / 4.0f;
-
-			vertex_sprites[idx].uv[0] = uv_scale * sprite_x;
-			vertex_sprites[idx].uv[1] = uv_scale * sprite_y;
-			vertex_sprites[idx].uv2[0] = vertex_sprites[idx].uv[0] + uv_scale;
-			vertex_sprites[idx].uv2[1] = vertex_sprites[idx].uv[1] + uv_scale;
-			vertex_sprites[idx].texture_index = monsters[i].texture;
-			vertex_sprites[idx].sprite_index = i;
+	camera_set_zoom(&cameras[0], render_stream_frame.zoom);
+	camera_set_centre(&cameras[0], render_stream_frame.centre);
+}
 
-			assert(vertex_sprites[idx].uv[0] >= 0.0f);
-			assert(vertex_sprites[idx].uv[0] <= 1.0f);
-			assert(vertex_sprites[idx].uv[1] >= 0.0f);
-			assert(vertex_sprites[idx].uv[1] <= 1.0f);
-			assert(vertex_sprites[idx].uv2[0] >= 0.0f);
-			assert(vertex_sprites[idx].uv2[0] <= 1.0f);
-			assert(vertex_sprites[idx].uv2[1] >= 0.0f);
-			assert(vertex_sprites[idx].uv2[1] <= 1.0f);
+bool check_device_memory(void) {
+	/*
+	 * Check the device local memory allocated is under DEVICE_MEMORY_WARNING_MB
+	 */
+	VkDeviceSize allocated = 0;
+	for (uint32_t i = 0; i < vkx_memory_get_heaps_count(); i++) {
+		VkxMemoryHeapStats stats = vkx_memory_get_heap_stats(i);
+		if (stats.device_local) {
+			allocated += stats.allocated_bytes;
 		}
 	}
+
+	double allocated_mb = allocated / (1024.0 * 1024.0);
+	if (DEVICE_MEMORY_WARNING_MB > 0 && allocated_mb > DEVICE_MEMORY_WARNING_MB) {
+		fprintf(stderr, "Warning: %.1f MB of device local memory allocated, over the %d MB limit\n", allocated_mb, DEVICE_MEMORY_WARNING_MB);
+		return false;
+	}
+	return true;
 }
 
-void update(double dt) {
-	for (size_t i=0; i<NUM_MONSTERS; i++) {
-		if (monsters[i].spd[0] > 0 && monsters[i].pos[0] >= X_TILES) {
-			monsters[i].spd[0] *= -1;
+bool is_input_event(const SDL_Event* event) {
+	// The events the main loop handles which a replay log keeps
+	return event->type == SDL_EVENT_QUIT || event->type == SDL_EVENT_KEY_DOWN
+		|| event->type == SDL_EVENT_MOUSE_WHEEL || event->type == SDL_EVENT_MOUSE_BUTTON_DOWN;
+}
+
+bool poll_event(SDL_Event* event) {
+	/*
+	 * Get the next event for the main loop, like SDL_PollEvent().  A replay
+	 * hands out the frame's events from its log first and drops the real
+	 * input (except quitting), and a recording writes the input down
+	 *
+	 * @return false once there are no more events this frame
+	 */
+	ReplayEvent replayed;
+	if (replay_next_event(&replayed)) {
+		memset(event, 0, sizeof(SDL_Event));
+		event->type = replayed.type;
+		if (replayed.type == SDL_EVENT_KEY_DOWN) {
+			event->key.key = (SDL_Keycode) replayed.code;
 		}
-		else if (monsters[i].spd[0] < 0 && monsters[i].pos[0] <= 0) {
-			monsters[i].spd[0] *= -1;
+		else if (replayed.type == SDL_EVENT_MOUSE_WHEEL) {
+			event->wheel.x = replayed.x;
+			event->wheel.y = replayed.y;
 		}
-		else {
-			monsters[i].pos[0] += dt * monsters[i].spd[0];
+		else if (replayed.type == SDL_EVENT_MOUSE_BUTTON_DOWN) {
+			event->button.button = (Uint8) replayed.code;
+			event->button.x = replayed.x;
+			event->button.y = replayed.y;
 		}
+		return true;
+	}
 
-		if (monsters[i].spd[1] > 0 && monsters[i].pos[1] >= Y_TILES) {
-			monsters[i].spd[1] *= -1;
+	while (!headless && SDL_PollEvent(event)) {
+		if (!is_input_event(event)) {
+			return true;
 		}
-		else if (monsters[i].spd[1] < 0 && monsters[i].pos[1] <= 0) {
-			monsters[i].spd[1] *= -1;
+		if (replay_is_playing() && event->type != SDL_EVENT_QUIT) {
+			continue;
 		}
-		else {
-			monsters[i].pos[1] += dt * monsters[i].spd[1];
+
+		if (replay_is_recording()) {
+			ReplayEvent recorded = {event->type, 0, 0.0f, 0.0f};
+			if (event->type == SDL_EVENT_KEY_DOWN) {
+				recorded.code = (int32_t) event->key.key;
+			}
+			else if (event->type == SDL_EVENT_MOUSE_WHEEL) {
+				recorded.x = event->wheel.x;
+				recorded.y = event->wheel.y;
+			}
+			else if (event->type == SDL_EVENT_MOUSE_BUTTON_DOWN) {
+				recorded.code = event->button.button;
+				recorded.x = event->button.x;
+				recorded.y = event->button.y;
+			}
+			replay_record_event(&recorded);
 		}
+		return true;
 	}
+	return false;
+}
 
-	// FPS count
-	frame_count++;
+void create_world(void* data) {
+	/*
+	 * Make the tiles, the monsters and everything else the simulation starts
+	 * with, as a job which runs while init_vulkan() creates the device,
+	 * pipelines and textures (it waits for this before the buffers).  Nothing
+	 * else draws random numbers meanwhile, so the world is the same as made
+	 * in order
+	 */
+	(void) data;
+	uint64_t world_start_ns = SDL_GetTicksNS();
 
-	if (t - last_fps_time >= 1.0) {
-		double total_time = t - last_fps_time;
-		uint32_t fps = (uint32_t) (frame_count / total_time);
-		printf("FPS: %d\n", fps);
-		printf("Frame time: %f ms\n", (total_time / frame_count) * 1000.0);
-		frame_count = 0;
-		last_fps_time = t;
+	// Create the tiles
+	uint64_t tiles_start_ns = SDL_GetTicksNS();
+	create_tiles();
+	init_tile_solidity();
+	if (light_shadows) {
+		create_occluder_rows();
+	}
+	if (monster_pathfinding) {
+		flow_field_init(&monster_flow_field, &tile_solidity);
+		flow_field_set_target(&monster_flow_field, X_TILES / 2, Y_TILES / 2);
+	}
+	bench_add_sample(bench_phase_tiles, get_elapsed_ms(tiles_start_ns));
+	if (tile_layers) {
+		create_tile_layers();
+	}
+
+	// Create the monsters, and give the benchmark and the first frame their positions
+	create_monsters();
+	if (level_loaded) {
+		level_close(&level_snapshot);
+	}
+	float monster_area[2] = {X_TILES, Y_TILES};
+	spatial_grid_init(&monster_grid, (float[2]) {0.0f, 0.0f}, monster_area, MONSTER_COLLISION_DISTANCE, monsters_count);
+	if (monster_swarming) {
+		swarm_init(&monster_swarm, monsters_count);
+	}
+	create_projectiles();
+	create_update_systems();
+	sprite_batch_init(&sprite_batch, BATCHED_SPRITES_CAPACITY);
+	for (size_t i = 0; i < FRAME_PIPELINE_SNAPSHOTS; i++) {
+		sprite_batch_init(&frame_states[i].sprites, BATCHED_SPRITES_CAPACITY);
+	}
+	if (cull_batched_sprites) {
+		batched_sprites_visible = malloc(sprite_batch.capacity);
+		if (batched_sprites_visible == NULL) {
+			fprintf(stderr, "Failed to allocate the batched sprites' visibility\n");
+			exit(1);
+		}
+	}
+	if (use_debug_shapes()) {
+		debug_draw_list_init(&debug_lines, DEBUG_DRAW_MAX_LINES);
+		for (size_t i = 0; i < FRAME_PIPELINE_SNAPSHOTS; i++) {
+			debug_draw_list_init(&frame_states[i].debug_lines, DEBUG_DRAW_MAX_LINES);
+		}
 	}
+	create_retained_sprites();
+	write_frame_state(&frame_states[0]);
+	publish_latched_camera();
+
+	end_startup_phase(STARTUP_WORLD, world_start_ns);
 }
 
-int main(void) {
+int main(int argc, char** argv) {
+	startup_start_ns = SDL_GetTicksNS();
+
+	// For bench.sh
+	if (argc == 2 && strcmp(argv[1], "--bench-list") == 0) {
+		bench_print_scenarios();
+		return 0;
+	}
+	if (!bench_parse_args(argc, argv, &bench_options)) {
+		return 1;
+	}
+	if (bench_options.scenario != NULL) {
+		bench_begin(&bench_options);
+		apply_bench_scenario();
+	}
+
+	// A replay draws everything random the way its recording did
+	random_seed = bench_is_running() ? BENCH_SEED : (uint32_t) time(NULL);
+	if (bench_options.replay != NULL) {
+		if (!replay_start_playing(bench_options.replay)) {
+			return 1;
+		}
+		random_seed = replay_get_seed();
+	}
+	if (bench_options.record != NULL && !replay_start_recording(bench_options.record, random_seed)) {
+		return 1;
+	}
+	if (use_sparse_tiles() && (bench_options.level != NULL || bench_options.save_level != NULL)) {
+		fprintf(stderr, "Level snapshots store an array of the whole map, which sparse tiles don't have\n");
+		return 1;
+	}
+	if (bench_options.level != NULL && !open_level(bench_options.level)) {
+		return 1;
+	}
+
 	printf("Hello, Vulkan!\n");
 
-	// Initialise SDL
-    if (!SDL_Init(SDL_INIT_VIDEO)) {
+	// Initialise SDL, without video headless as there may not be a display
+    if (!SDL_Init(headless ? 0 : SDL_INIT_VIDEO)) {
 		printf("SDL initialization failed: %s\n", SDL_GetError());
         return 1;
     }
 
 	// Create the window
-	SDL_WindowFlags window_flags = SDL_WINDOW_VULKAN | SDL_WINDOW_HIDDEN | SDL_WINDOW_RESIZABLE;
-	window = SDL_CreateWindow("Vulkan", DEFAULT_WIDTH, DEFAULT_HEIGHT, window_flags);
-    if (!window) {
-		printf("Window creation failed: %s\n", SDL_GetError());
-        SDL_Quit();
-        return 1;
-    }
+	if (!headless) {
+		SDL_WindowFlags window_flags = SDL_WINDOW_VULKAN | SDL_WINDOW_HIDDEN | SDL_WINDOW_RESIZABLE;
+		window = SDL_CreateWindow("Vulkan", DEFAULT_WIDTH, DEFAULT_HEIGHT, window_flags);
+		if (!window) {
+			printf("Window creation failed: %s\n", SDL_GetError());
+			SDL_Quit();
+			return 1;
+		}
 
-    SDL_SetWindowPosition(window, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED);
-	printf("SDL window created\n");
+		SDL_SetWindowPosition(window, SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED);
+		printf("SDL window created\n");
 
-	// Don't let the window shrink
-	SDL_SetWindowMinimumSize(window, SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2);
+		// Don't let the window shrink
+		SDL_SetWindowMinimumSize(window, SCREEN_WIDTH / 2, SCREEN_HEIGHT / 2);
+	}
 
-	// Create the tiles
-	create_tiles();
+	// Everything after this loads its assets through map_file()
+	if (file_exists(ASSET_ARCHIVE_FILENAME) && archive_open(&asset_archive, ASSET_ARCHIVE_FILENAME)) {
+		archive_mount(&asset_archive);
+	}
 
-	// Create the monsters
-	create_monsters();
+	if (bench_is_running()) {
+		bench_phase_tiles = bench_add_startup_phase("startup tiles");
+		for (uint32_t i = 0; i < _STARTUP_PHASE_COUNT; i++) {
+			char name[64];
+			snprintf(name, sizeof(name), "startup %s", STARTUP_PHASE_NAMES[i]);
+			bench_phases_startup[i] = bench_add_startup_phase(name);
+		}
+	}
+
+	// Before the workers start, so they can name their threads
+	if (cpu_trace) {
+		trace_init();
+	}
+	if (spike_traces) {
+		if (!cpu_trace) {
+			fprintf(stderr, "The spike traces need the CPU trace\n");
+			exit(1);
+		}
+		SpikeDesc spike_desc = {
+			.threshold_ms = SPIKE_THRESHOLD_MS,
+			.median_multiple = SPIKE_MEDIAN_MULTIPLE,
+			.filename_format = SPIKE_TRACE_FILENAME_FORMAT,
+			.max_traces = SPIKE_MAX_TRACES,
+		};
+		spike_start(&spike_desc);
+	}
+
+	// Start the worker threads, which make the world while Vulkan starts up
+	jobs_init(0, pin_job_workers);
+	latched_camera_mutex = SDL_CreateMutex();
+	jobs_submit(create_world, NULL, &world_counter);
+
+	// Saved before anything can change it
+	if (bench_options.save_level != NULL) {
+		jobs_wait(&world_counter);
+		if (!save_level(bench_options.save_level)) {
+			return 1;
+		}
+	}
+	if (benchmark_transforms) {
+		jobs_wait(&world_counter);
+		run_transform_benchmark();
+	}
 
 	// Initialise Vulkan
+	if (DEMO_SKINNED_CHARACTERS > 0) {
+		// The pipeline is specialized for its bones, so it's first.  It's
+		// spread over the map, and its random numbers come after the world's
+		jobs_wait(&world_counter);
+		create_demo_skeleton();
+	}
+	// Copied into every frame's uniforms for the tile shaders
+	build_tile_animations();
 	init_vulkan();
+	if (use_autotune()) {
+		tune_transform_job_size();
+		autotune_save();
+	}
+	if (use_shading_rate_image() || occlusion_culling) {
+		classify_tileset_tiles();
+	}
+
+	vkx_memory_print_stats();
+	check_device_memory();
+
+	if (bench_is_running()) {
+		add_bench_phases();
+	}
+	if (telemetry) {
+		start_telemetry();
+	}
+	render_stream_start(render_stream_mode, RENDER_STREAM_HOST, RENDER_STREAM_PORT);
+	if (DEMO_RETAINED_SPRITES > 0) {
+		create_demo_retained_sprites();
+	}
+	if (DEMO_PARTICLES_PER_SECOND > 0.0f) {
+		create_demo_particle_emitter();
+	}
+	if (DEMO_LIGHTS > 0) {
+		create_demo_lights();
+	}
+	if (DEMO_PARENTED_SPRITES > 0) {
+		create_demo_tree();
+	}
+	if (DEMO_TWEENED_SPRITES > 0) {
+		create_demo_tweens();
+	}
 	
 	// Make the window visible
-	SDL_ShowWindow(window);
-
-	// Initialise matrices
-	// At the moment there is no camera - just use the identity matrix for view
-	glm_mat4_identity(view_matrix);
+	if (!headless) {
+		SDL_ShowWindow(window);
+	}
 
-	// Projection matrix
-	// Orthographic projection with 0,0 in the bottom left hand corner, and each tile being 1x1
-	// NOTE: z is inverted in OpenGL so we put -1.0f as the far plane
+	// The cameras show X_TILES by Y_TILES tiles at zoom 1 (split between the
+	// views), with 0,0 in the bottom left hand corner and each tile being 1x1
+	// NOTE: z is inverted in OpenGL so we put -22 as the far plane
 	// This seems to give values where 0 is closest and 20 is furthest away
-	glm_ortho(0.0f, (float) X_TILES, (float) Y_TILES, 0.0f, 22.0f, -22.0f, projection_matrix);
+	uint32_t view_columns;
+	uint32_t view_rows;
+	get_view_grid(&view_columns, &view_rows);
+	const float map_min[2] = {0.0f, 0.0f};
+	const float map_max[2] = {(float) map_x_tiles, (float) map_y_tiles};
+	for (uint32_t i = 0; i < split_screen_views; i++) {
+		Camera* camera = &cameras[i];
+		camera_init(camera, (float) X_TILES / (float) view_columns, (float) Y_TILES / (float) view_rows, 22.0f, -22.0f);
+		camera_set_bounds(camera, map_min, map_max);
+		camera_set_zoom_range(camera, use_chunk_impostors() ? CHUNK_IMPOSTOR_MIN_ZOOM : CAMERA_MIN_ZOOM, CAMERA_MAX_ZOOM);
+		camera->max_shake = CAMERA_MAX_SHAKE;
+		camera->shake_decay = CAMERA_SHAKE_DECAY;
+		if (camera_pixel_snap) {
+			camera->pixels_per_unit = (float) SCREEN_WIDTH / (float) X_TILES;
+		}
+
+		// With split screen each view starts over its own part of the map,
+		// otherwise in the bottom left corner
+		if (split_screen_views > 1) {
+			const float centre[2] = {
+				map_max[0] * ((float) (i % view_columns) + 0.5f) / (float) view_columns,
+				map_max[1] * (1.0f - ((float) (i / view_columns) + 0.5f) / (float) view_rows),
+			};
+			camera_set_centre(camera, centre);
+		}
+		camera_update(camera, 0.0f);
+	}
+
+	// Everything the render thread uses is set up, so it can start
+	frame_pipeline_init(threaded_rendering, render_frame, NULL);
 	
 	// ----- Main loop -----
 
     bool running = true;
     SDL_Event event;
+	uint32_t frames_published = 0;
+	// Anything the driver allocates from here on is counted against the frames
+	vkx_host_memory_begin_frames();
+	// A benchmark runs a few frames more than it times, so the GPU timings of
+	// the last ones have come back
+	uint32_t bench_frames = bench_options.warmup_frames + bench_options.frames + VKX_MAX_FRAMES_IN_FLIGHT;
+	// With skip_idle_frames, whether the last frame wasn't drawn, and whether
+	// that was because the window was hidden
+	bool idle = false;
+	bool skipped_hidden = false;
     while (running) {
+		// Everything the last frame took from the main thread's arena is done with
+		arena_reset(frame_arena());
+
+		// The render thread paces itself, this then waits for it
+		if (!threaded_rendering) {
+			pace_frame();
+		}
+		if (just_in_time_frames) {
+			start_frame_just_in_time();
+		}
+
+		// Headless there are no events, and it finishes after a set number of
+		// frames
+		if (headless && !bench_is_running() && frames_published >= HEADLESS_FRAMES) {
+			running = false;
+			break;
+		}
+		if (bench_is_running() && frames_published >= bench_frames) {
+			running = false;
+			break;
+		}
+
+		// Nothing was drawn last time round, so sleep until something happens
+		// rather than spinning
+		if (idle) {
+			SDL_WaitEventTimeout(NULL, IDLE_WAKE_MS);
+		}
+
         // Poll for events
-        while (SDL_PollEvent(&event)) {
+		bool events = false;
+        while (poll_event(&event)) {
+			// Any of them could change what's on screen
+			events = true;
+
             if (event.type == SDL_EVENT_QUIT) {
                 running = false;
             }
 			else if (event.type == SDL_EVENT_KEY_DOWN) {
+				// The keys change what the renderer uses, so it has to be idle
+				frame_pipeline_sync();
+
 				if (event.key.key == SDLK_ESCAPE || event.key.key == SDLK_Q) {
 					printf("Quitting...\n");
 					running = false;
 				}
+				else if (event.key.key == SDLK_MINUS) {
+					set_render_scale(render_scale - RENDER_SCALE_STEP);
+					printf("Render scale: %.2f\n", render_scale);
+				}
+				else if (event.key.key == SDLK_EQUALS) {
+					set_render_scale(render_scale + RENDER_SCALE_STEP);
+					printf("Render scale: %.2f\n", render_scale);
+				}
+				else if (event.key.key == SDLK_K) {
+					camera_shake(&cameras[active_view], CAMERA_SHAKE_TRAUMA);
+				}
+				else if (event.key.key == SDLK_TAB && split_screen_views > 1) {
+					active_view = (active_view + 1) % split_screen_views;
+					printf("Moving view %u\n", active_view + 1);
+				}
+				else if (event.key.key == SDLK_B) {
+					bilinear_upscale = !bilinear_upscale;
+					printf("Upscaling: %s\n", bilinear_upscale ? "bilinear" : "nearest");
+				}
+				else if (event.key.key == SDLK_F9) {
+					// No jobs are running between frames, and the render
+					// thread is idle
+					if (trace_write(TRACE_FILENAME)) {
+						printf("Wrote the %s trace to %s\n", profiler.calibrated ? "CPU and GPU" : "CPU", TRACE_FILENAME);
+					}
+				}
+				else if (event.key.key == SDLK_F10) {
+					vkx_memory_print_stats();
+					if (use_sparse_atlas()) {
+						vkx_sparse_atlas_print_stats();
+					}
+					if (vkx_memory_write_stats(MEMORY_STATS_FILENAME)) {
+						printf("Wrote the memory statistics to %s\n", MEMORY_STATS_FILENAME);
+					}
+				}
+				else if (event.key.key == SDLK_F5) {
+					// Takes effect from the next present if the swap chain
+					// can switch to it, otherwise when it's recreated
+					const VkPresentModeKHR modes[] = {
+						VK_PRESENT_MODE_FIFO_KHR,
+						VK_PRESENT_MODE_FIFO_RELAXED_KHR,
+						VK_PRESENT_MODE_MAILBOX_KHR,
+						VK_PRESENT_MODE_IMMEDIATE_KHR,
+					};
+					size_t next = 0;
+					for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+						if (modes[i] == present_mode) {
+							next = (i + 1) % (sizeof(modes) / sizeof(modes[0]));
+						}
+					}
+					present_mode = modes[next];
+					vkx_set_present_mode(present_mode, SWAP_CHAIN_IMAGE_COUNT);
+					printf("Present mode: %s\n", vkx_present_mode_name(present_mode));
+					if (!vkx_switch_present_mode(present_mode)) {
+						framebuffer_resized = true;
+					}
+				}
+				else if (event.key.key == SDLK_F6) {
+					low_latency = !low_latency;
+					printf("Low latency pacing: %s (%s)\n", low_latency ? "on" : "off",
+							vkx_instance.has_present_wait ? "present wait" : "sleep");
+				}
+				else if (event.key.key == SDLK_F12 && capture_enabled) {
+					char filename[256];
+					snprintf(filename, sizeof(filename), SCREENSHOT_FILENAME, screenshots_count++);
+					capture_screenshot(filename);
+				}
+				else if (event.key.key == SDLK_F8 && capture_enabled) {
+					if (capture_is_recording()) {
+						capture_stop_recording();
+					}
+					else {
+						capture_start_recording(RECORDING_FILENAME, RECORDING_FORMAT, RECORDING_FRAME_RATE);
+					}
+				}
+				else if (event.key.key == SDLK_F4 && use_debug_shapes()) {
+					debug_shapes_visible = !debug_shapes_visible;
+				}
+				else if (event.key.key == SDLK_F3 && performance_hud) {
+					hud_visible = !hud_visible;
+					hud_last_frame_ns = 0;
+					memset(hud_frame_times, 0, sizeof(hud_frame_times));
+				}
 				else if (event.key.key == SDLK_F11) {
 					// Toggle fullscreen
 					if (fullscreen) {
@@ -1318,42 +12635,275 @@ int main(void) {
 					framebuffer_resized = true;
 				}
 			}
+			else if (event.type == SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED) {
+				// Rather than waiting for the swap chain to go out of date
+				bool main_window = true;
+				for (uint32_t i = 0; i < extra_windows_count; i++) {
+					if (SDL_GetWindowID(extra_windows[i].window) == event.window.windowID) {
+						extra_windows[i].out_of_date = true;
+						main_window = false;
+					}
+				}
+				if (main_window) {
+					frame_pipeline_sync();
+					framebuffer_resized = true;
+				}
+			}
+			else if (event.type == SDL_EVENT_MOUSE_WHEEL) {
+				// Zoom in and out about the middle of the view
+				Camera* camera = &cameras[active_view];
+				camera_set_zoom(camera, camera->zoom * powf(CAMERA_ZOOM_STEP, event.wheel.y));
+			}
+			else if (event.type == SDL_EVENT_MOUSE_BUTTON_DOWN && event.button.button == SDL_BUTTON_RIGHT && !gpu_sprite_simulation) {
+				// Right click to say which monster is under the cursor
+				float map_pos[2];
+				if (window_to_world(event.button.x, event.button.y, map_pos)) {
+					float map_x = map_pos[0];
+					float map_y = map_pos[1];
+					uint32_t monster = pick_monster(map_x, map_y);
+					if (monster != SPATIAL_GRID_NONE) {
+						printf("Monster %u at (%.2f, %.2f)\n", monster, monsters.x[monster], monsters.y[monster]);
+					}
+				}
+			}
+			else if (event.type == SDL_EVENT_MOUSE_BUTTON_DOWN && event.button.button == SDL_BUTTON_MIDDLE && monster_pathfinding) {
+				// Middle click to send the monsters to the tile under the cursor
+				float map_pos[2];
+				if (window_to_world(event.button.x, event.button.y, map_pos)) {
+					float map_x = map_pos[0];
+					float map_y = map_pos[1];
+					if (map_x >= 0.0f && map_y >= 0.0f) {
+						flow_field_set_target(&monster_flow_field, (uint32_t) map_x, (uint32_t) map_y);
+					}
+				}
+			}
+			else if (event.type == SDL_EVENT_MOUSE_BUTTON_DOWN && event.button.button == SDL_BUTTON_LEFT) {
+				// The tile edits are read by the renderer
+				frame_pipeline_sync();
+
+				// Click to cycle the tile under the cursor through the tileset
+				float map_pos[2];
+				if (window_to_world(event.button.x, event.button.y, map_pos)) {
+					float map_x = map_pos[0];
+					float map_y = map_pos[1];
+
+					if (map_x >= 0.0f && map_y >= 0.0f) {
+						uint32_t tile_x = (uint32_t) map_x;
+						uint32_t tile_y = (uint32_t) map_y;
+						if (tile_x < map_x_tiles && tile_y < map_y_tiles) {
+							uint16_t value = get_map_tile(tile_x, tile_y);
+							set_map_tile(tile_x, tile_y, (uint16_t) ((value + 1) % (TILESET_TOTAL_TILES + 1)));
+						}
+					}
+				}
+			}
         }
 
 		uint64_t ticks = SDL_GetTicksNS();
-		t = SDL_NS_TO_SECONDS((double) ticks);
-		double dt = t - t_last;
-
-		if (limit_fps && dt < min_frame_time) {
-			int dt_ms = (int) (1000.0 * dt);
-			int sleep_time = (int) (1000.0 * min_frame_time) - dt_ms;
-			if (sleep_time <= 0) {
-				sleep_time = 1;
+		if (replay_is_playing()) {
+			// The frame as it was recorded, until the log runs out
+			double replayed_dt = 0.0;
+			if (!replay_next_frame(&replayed_dt, &held_keys)) {
+				running = false;
+				break;
 			}
-			SDL_Delay(sleep_time);
-			ticks = SDL_GetTicksNS();
-			t = SDL_NS_TO_SECONDS((double) ticks);
-			dt = t - t_last;
+			t = t_last + replayed_dt;
+		}
+		else if (bench_is_running()) {
+			t = t_last + BENCH_TIME_STEP;
+			held_keys = get_held_keys();
+		}
+		else {
+			t = headless ? t_last + HEADLESS_TIME_STEP : SDL_NS_TO_SECONDS((double) ticks);
+			held_keys = get_held_keys();
 		}
-		else if (dt > 0.1) {
+		double dt = t - t_last;
+		replay_record_frame(dt, held_keys);
+
+		if (dt > 0.1) {
 			// Clamp the delta time to 0.1 seconds
 			dt = 0.1;
 		}
 
-		update(dt);
+		trace_begin("frame");
+
+		trace_begin("update");
+		if (render_stream_mode == RENDER_STREAM_RECEIVE) {
+			receive_render_stream();
+		}
+		update_camera((float) dt);
+		if (late_latched_camera) {
+			publish_latched_camera();
+		}
+		if (use_streamed_world()) {
+			float view[4];
+			get_views_visible_rect(cameras, 1.0f, view);
+			world_stream_update(&world_stream, view, cameras[0].velocity);
+		}
+		sprite_sim_dt = (float) dt;
+		if (fixed_timestep) {
+			// However many steps it takes to catch up, and the rest of the way
+			// to the next one is how far to interpolate
+			simulation_lag += dt;
+			while (simulation_lag >= SIMULATION_STEP) {
+				update(SIMULATION_STEP);
+				simulation_lag -= SIMULATION_STEP;
+			}
+			simulation_interpolation = (float) (simulation_lag / SIMULATION_STEP);
+		}
+		else {
+			update(dt);
+			simulation_interpolation = 1.0f;
+		}
+
+		sprite_batch_begin(&sprite_batch);
+		draw_game();
+		sprite_batch_end();
+		if (render_stream_mode == RENDER_STREAM_SEND) {
+			render_stream_send(&sprite_batch, cameras[0].centre, cameras[0].zoom);
+		}
+		if (debug_shapes_visible) {
+			debug_draw_begin(&debug_lines);
+			draw_debug_shapes();
+			debug_draw_end();
+		}
+		emit_particles((float) dt);
+		trace_end();
+		double update_ms = get_elapsed_ms(ticks);
+		bench_add_sample(bench_phase_update, update_ms);
+
+		// Skip the frame if it wouldn't be seen, or would look like the last
+		// one.  What the renderer takes from the queues (the retained sprites,
+		// the tile and occluder edits) waits there until a frame is drawn
+		if (skip_idle_frames && !headless && !bench_is_running() && !replay_is_playing()) {
+			bool hidden = window_is_hidden();
+			bool unchanged = frame_is_unchanged();
+			idle = !events && (hidden || unchanged);
+			skipped_hidden |= idle && hidden;
+		}
+		if (idle) {
+			trace_end();
+			if (spike_traces) {
+				spike_skip_frame();
+			}
+			t_last = t;
+			continue;
+		}
+
+		// The window could have changed size or surface while it was away, so
+		// the swap chain is replaced before the next frame acquires from it
+		if (skipped_hidden) {
+			frame_pipeline_sync();
+			framebuffer_resized = true;
+			skipped_hidden = false;
+		}
 
-		draw_frame();
+		// Hand the frame to the renderer (which draws it here without the
+		// render thread)
+		FrameState* state = &frame_states[frame_pipeline_begin_snapshot()];
+		uint64_t snapshot_start_ns = SDL_GetTicksNS();
+		write_frame_state(state);
+		state->update_ms = update_ms;
+		bench_add_sample(bench_phase_snapshot, get_elapsed_ms(snapshot_start_ns));
+		frame_pipeline_publish();
+		frames_published++;
+
+		trace_end();
+
+		// The window is written once the render thread has finished with its
+		// zones, like F9
+		if (spike_traces && spike_end_frame(SDL_GetTicksNS())) {
+			frame_pipeline_sync();
+			spike_write_trace();
+		}
 
 		t_last = t;
     }
 
+	replay_stop();
+	frame_pipeline_cleanup();
+	present_thread_stop();
+	SDL_DestroyMutex(latched_camera_mutex);
+	telemetry_stop();
+	if (spike_traces) {
+		spike_stop();
+	}
+	render_stream_stop();
+	render_stream_frame_cleanup(&render_stream_frame);
+
 	vkDeviceWaitIdle(vkx_instance.device);
+	vkx_host_memory_print_stats();
+
+	// The last frames in flight, oldest first, are written before cleaning up
+	if (capture_enabled) {
+		for (uint32_t i = 0; i < vkx_instance.frames_in_flight; i++) {
+			capture_retire((current_frame + i) % vkx_instance.frames_in_flight);
+		}
+	}
+
+	// At the end is when the most is allocated, with everything streamed in
+	bool memory_passed = check_device_memory();
+	vkx_memory_write_stats(MEMORY_STATS_FILENAME);
+
+	if (bench_is_running()) {
+		VkPhysicalDeviceProperties properties = {0};
+		vkGetPhysicalDeviceProperties(vkx_instance.physical_device, &properties);
+		bool written = bench_write_results(properties.deviceName);
+		bool passed = bench_check_baseline(properties.deviceName);
+		bench_end();
+		if (!written || !passed || !memory_passed) {
+			exit(1);
+		}
+	}
 	
 	cleanup_vulkan();
+	archive_close(&asset_archive);
+
+	free(batched_sprites_visible);
+	sprite_batch_cleanup(&sprite_batch);
+	for (size_t i = 0; i < FRAME_PIPELINE_SNAPSHOTS; i++) {
+		sprite_batch_cleanup(&frame_states[i].sprites);
+	}
+	if (use_debug_shapes()) {
+		debug_draw_list_cleanup(&debug_lines);
+		for (size_t i = 0; i < FRAME_PIPELINE_SNAPSHOTS; i++) {
+			debug_draw_list_cleanup(&frame_states[i].debug_lines);
+		}
+	}
+	cleanup_retained_sprites();
+	entity_pool_cleanup(&projectile_pool);
+	if (DEMO_PARENTED_SPRITES > 0) {
+		cleanup_demo_tree();
+	}
+	if (DEMO_TWEENED_SPRITES > 0) {
+		cleanup_demo_tweens();
+	}
+	if (DEMO_SKINNED_CHARACTERS > 0) {
+		free(skinned_characters);
+		free(skinned_visible);
+	}
+	spatial_grid_cleanup(&monster_grid);
+	swarm_cleanup(&monster_swarm);
+	if (throttle_monster_updates && !gpu_sprite_simulation) {
+		update_tiers_cleanup(&monster_update_tiers);
+	}
+	flow_field_cleanup(&monster_flow_field);
+	if (light_shadows) {
+		cleanup_occluder_rows();
+	}
+	tile_solidity_cleanup(&tile_solidity);
+	world_stream_cleanup(&world_stream);
+	tile_store_cleanup(&tile_store);
+
+	jobs_cleanup();
+	trace_cleanup();
+	frame_arenas_cleanup();
 
 	// Cleanup SDL
 	printf("Cleaning up SDL\n");
-    SDL_DestroyWindow(window);
+	if (window != NULL) {
+		SDL_DestroyWindow(window);
+	}
     SDL_Quit();
 	
 	printf("Goodbye Vulkan!\n");
@@ -0,0 +1,503 @@
+/*
+ * Post-processing chain between the scene and the screen pass.
+ *
+ * The effects are listed in order in a PostChainDesc and post_chain_init()
+ * works out the passes for them.  Per-pixel effects (colour grading, CRT
+ * scanlines, the wave) don't need their neighbours, so a run of them becomes a
+ * single pass of screen.frag with the FUSED specialization constant picking
+ * the effects, in the order screen.frag applies them.  The last run is fused
+ * into the screen pass itself, so a chain of only per-pixel effects costs no
+ * more bandwidth than the plain screen pass.
+ *
+ * Effects which read their neighbourhood (bloom and blur) get passes of their
+ * own in blur.frag, rendering into smaller targets: a bright pass and a
+ * separable gaussian for the bloom, which the next fused pass adds on, or
+ * just the gaussian for the blur.
+ *
+ * The targets are transient images of the frame graph, so the ones which
+ * aren't in use at the same time share memory.  A long chain only ever needs
+ * a couple of targets' worth (i.e. they are ping-ponged).
+ *
+ * Every pass renders to the same part of its target as the scene takes up of
+ * the offscreen image (scaled by the divisor), so they all sample with the
+ * uniform buffer's render_uv_scale and the render scale can still change every
+ * frame.
+ *
+ * With PostChainDesc.compute the same passes are compute dispatches of
+ * post.comp instead, writing storage images.  Its blurs load their workgroup's
+ * rows (or columns) and the texels either side into shared memory, so every
+ * texel is only sampled once or twice rather than for each of the 9 taps.  The
+ * swap chain formats usually can't be storage images, so the targets are
+ * POST_CHAIN_COMPUTE_FORMAT.  If the device has a separate compute queue the
+ * passes can go on that too (PostChainDesc.async_compute), overlapping with the
+ * graphics work around them, see vkx_frame_graph_set_async_compute().
+ *
+ * With PostChainDesc.half_precision the fused passes (screen pass included)
+ * are screen_half.frag, which applies the same effects in float16 where the
+ * device supports it.
+ */
+
+#include "post_chain.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vkx/vkx_pipeline.h"
+
+// Specialization constants of screen.vert, screen.frag and blur.frag
+typedef struct {
+	uint32_t fused;
+	uint32_t pass_type;
+	// The screen pass, which applies the pre-rotation and the upscale filter
+	VkBool32 screen;
+} PostSpecialization;
+
+static const VkSpecializationMapEntry post_specialization_entries[3] = {
+	{0, offsetof(PostSpecialization, fused), sizeof(uint32_t)},
+	{1, offsetof(PostSpecialization, pass_type), sizeof(uint32_t)},
+	{2, offsetof(PostSpecialization, screen), sizeof(VkBool32)},
+};
+
+static VkSpecializationInfo post_specialization_info(const PostSpecialization* specialization) {
+	VkSpecializationInfo specialization_info = {0};
+	specialization_info.mapEntryCount = 3;
+	specialization_info.pMapEntries = post_specialization_entries;
+	specialization_info.dataSize = sizeof(PostSpecialization);
+	specialization_info.pData = specialization;
+	return specialization_info;
+}
+
+static uint32_t post_chain_add_pass(PostChain* chain, PostPassType type, uint32_t input_pass, uint32_t divisor) {
+	if (chain->passes_count >= POST_CHAIN_MAX_PASSES) {
+		fprintf(stderr, "Too many post-processing passes (max %d)\n", POST_CHAIN_MAX_PASSES);
+		exit(1);
+	}
+
+	PostChainPass* pass = &chain->passes[chain->passes_count];
+	memset(pass, 0, sizeof(PostChainPass));
+	pass->type = type;
+	pass->divisor = divisor;
+	pass->input_pass = input_pass;
+	pass->bloom_pass = POST_CHAIN_NONE;
+
+	return chain->passes_count++;
+}
+
+static uint32_t post_fused_bit(PostEffect effect) {
+	switch (effect) {
+		case POST_EFFECT_WAVE:
+			return POST_FUSED_WAVE;
+		case POST_EFFECT_COLOR_GRADE:
+			return POST_FUSED_COLOR_GRADE;
+		case POST_EFFECT_CRT:
+			return POST_FUSED_CRT;
+		default:
+			return 0;
+	}
+}
+
+void post_chain_init(PostChain* chain, const PostChainDesc* desc) {
+	/*
+	 * Work out the passes for the effects.  Nothing is created until
+	 * post_chain_add_passes() and post_chain_create()
+	 *
+	 * @param desc Copied
+	 */
+	memset(chain, 0, sizeof(PostChain));
+	chain->desc = *desc;
+	if (desc->effects_count > POST_CHAIN_MAX_EFFECTS) {
+		fprintf(stderr, "Too many post-processing effects (max %d)\n", POST_CHAIN_MAX_EFFECTS);
+		exit(1);
+	}
+
+	uint32_t bloom_divisor = desc->bloom_divisor > 0 ? desc->bloom_divisor : 1;
+	uint32_t blur_divisor = desc->blur_divisor > 0 ? desc->blur_divisor : 1;
+
+	// The result so far, and the per-pixel effects still to be applied to it
+	uint32_t current = POST_CHAIN_SCENE;
+	uint32_t current_divisor = 1;
+	uint32_t pending = 0;
+	uint32_t pending_bloom = POST_CHAIN_NONE;
+	bool pixel_perfect = false;
+
+	for (uint32_t i = 0; i < desc->effects_count; i++) {
+		PostEffect effect = desc->effects[i];
+		uint32_t bit = post_fused_bit(effect);
+
+		if (effect == POST_EFFECT_PIXEL_PERFECT) {
+			pixel_perfect = true;
+			continue;
+		}
+
+		// Effects can only be fused in screen.frag's order, and the ones which
+		// read their neighbours need everything before them applied first
+		bool flush = bit != 0 ? (pending & ~(bit - 1)) != 0 : pending != 0;
+		if (flush) {
+			uint32_t fused = post_chain_add_pass(chain, POST_PASS_FUSED, current, current_divisor);
+			chain->passes[fused].fused = pending;
+			chain->passes[fused].bloom_pass = pending_bloom;
+			current = fused;
+			pending = 0;
+			pending_bloom = POST_CHAIN_NONE;
+		}
+
+		if (bit != 0) {
+			pending |= bit;
+			continue;
+		}
+
+		if (effect == POST_EFFECT_BLOOM) {
+			uint32_t divisor = current_divisor * bloom_divisor;
+			uint32_t bright = post_chain_add_pass(chain, POST_PASS_BRIGHT, current, divisor);
+			uint32_t blur_x = post_chain_add_pass(chain, POST_PASS_BLUR_X, bright, divisor);
+			pending_bloom = post_chain_add_pass(chain, POST_PASS_BLUR_Y, blur_x, divisor);
+			pending |= POST_FUSED_BLOOM;
+		}
+		else if (effect == POST_EFFECT_BLUR) {
+			current_divisor *= blur_divisor;
+			uint32_t blur_x = post_chain_add_pass(chain, POST_PASS_BLUR_X, current, current_divisor);
+			current = post_chain_add_pass(chain, POST_PASS_BLUR_Y, blur_x, current_divisor);
+		}
+	}
+
+	chain->screen_fused = pending | (pixel_perfect ? POST_FUSED_PIXEL_PERFECT : 0);
+	chain->screen_input_pass = current;
+	chain->screen_bloom_pass = pending_bloom;
+	chain->screen_input = POST_CHAIN_NONE;
+	chain->screen_bloom = POST_CHAIN_NONE;
+
+	// Whatever is fused into the screen pass is drawn either way
+	chain->compute = desc->compute && chain->passes_count > 0;
+	chain->async_compute = chain->compute && desc->async_compute && vkx_instance.has_async_compute;
+	chain->half_precision = desc->half_precision && vkx_instance.has_shader_float16;
+}
+
+void post_chain_cleanup(PostChain* chain) {
+	/*
+	 * Destroy the pipelines and descriptor sets.  The targets belong to the
+	 * frame graph
+	 */
+	for (uint32_t i = 0; i < chain->passes_count; i++) {
+		if (chain->passes[i].pipeline.pipeline != VK_NULL_HANDLE) {
+			vkx_cleanup_pipeline(chain->passes[i].pipeline);
+		}
+	}
+
+	if (chain->descriptor_pool != VK_NULL_HANDLE) {
+		vkDestroyDescriptorPool(vkx_instance.device, chain->descriptor_pool, vkx_get_allocator(VK_OBJECT_TYPE_DESCRIPTOR_POOL));
+	}
+
+	memset(chain, 0, sizeof(PostChain));
+}
+
+bool post_chain_is_empty(const PostChain* chain) {
+	/*
+	 * Whether the screen pass has nothing to do but scale up the scene, so it
+	 * could be a copy or blit
+	 */
+	return chain->passes_count == 0 && chain->screen_fused == 0;
+}
+
+bool post_chain_is_per_pixel(const PostChain* chain) {
+	/*
+	 * Whether every effect only reads the pixel it writes, so the chain can be
+	 * applied in place at the end of the scene pass, see
+	 * post_chain_create_local_read_pipeline().  The wave moves the pixels
+	 * around, and pixel perfect scaling needs a scene smaller than the screen
+	 */
+	return chain->passes_count == 0 && (chain->screen_fused & ~(POST_FUSED_COLOR_GRADE | POST_FUSED_CRT)) == 0;
+}
+
+static uint32_t post_chain_image(const PostChain* chain, uint32_t pass, uint32_t scene_image) {
+	return pass == POST_CHAIN_SCENE ? scene_image : chain->passes[pass].target;
+}
+
+static VkExtent2D post_chain_divide_extent(VkExtent2D extent, uint32_t divisor) {
+	VkExtent2D divided = {0};
+	divided.width = (extent.width + divisor - 1) / divisor;
+	divided.height = (extent.height + divisor - 1) / divisor;
+	return divided;
+}
+
+void post_chain_add_passes(PostChain* chain, VkxFrameGraph* graph, uint32_t scene_image,
+		VkExtent2D scene_extent, VkFormat format) {
+	/*
+	 * Add the targets and passes to the frame graph, after the scene pass and
+	 * before the screen pass (which samples screen_input and screen_bloom)
+	 *
+	 * @param scene_image The frame graph's offscreen image
+	 * @param scene_extent Size of the offscreen image
+	 * @param format Format of the targets, unless they are compute passes
+	 */
+	VkClearValue unused = {0};
+
+	for (uint32_t i = 0; i < chain->passes_count; i++) {
+		PostChainPass* pass = &chain->passes[i];
+		VkExtent2D extent = post_chain_divide_extent(scene_extent, pass->divisor);
+
+		pass->input = post_chain_image(chain, pass->input_pass, scene_image);
+		pass->bloom = pass->bloom_pass == POST_CHAIN_NONE ? POST_CHAIN_NONE : chain->passes[pass->bloom_pass].target;
+		pass->target = vkx_frame_graph_create_image(graph, extent.width, extent.height,
+			chain->compute ? POST_CHAIN_COMPUTE_FORMAT : format);
+		pass->graph_pass = vkx_frame_graph_add_pass(graph);
+
+		if (chain->compute) {
+			vkx_frame_graph_add_compute_sampled_image(graph, pass->graph_pass, pass->input);
+			if (pass->bloom != POST_CHAIN_NONE) {
+				vkx_frame_graph_add_compute_sampled_image(graph, pass->graph_pass, pass->bloom);
+			}
+			vkx_frame_graph_add_storage_image(graph, pass->graph_pass, pass->target);
+			if (chain->async_compute) {
+				vkx_frame_graph_set_async_compute(graph, pass->graph_pass);
+			}
+			continue;
+		}
+
+		vkx_frame_graph_add_sampled_image(graph, pass->graph_pass, pass->input);
+		if (pass->bloom != POST_CHAIN_NONE) {
+			vkx_frame_graph_add_sampled_image(graph, pass->graph_pass, pass->bloom);
+		}
+		// Every pixel of the render area is written
+		vkx_frame_graph_add_color_attachment(graph, pass->graph_pass, pass->target, VK_ATTACHMENT_LOAD_OP_DONT_CARE, unused);
+	}
+
+	chain->screen_input = post_chain_image(chain, chain->screen_input_pass, scene_image);
+	chain->screen_bloom = chain->screen_bloom_pass == POST_CHAIN_NONE ? POST_CHAIN_NONE : chain->passes[chain->screen_bloom_pass].target;
+}
+
+static VkxPipeline post_chain_create_pipeline(const char* frag_shader_path, PostSpecialization specialization, VkFormat format) {
+	VkSpecializationInfo specialization_info = post_specialization_info(&specialization);
+	return vkx_create_screen_pipeline("shaders/screen.vert.spv", frag_shader_path, POST_CHAIN_TEXTURES, format, &specialization_info);
+}
+
+static const char* post_chain_fused_shader_path(const PostChain* chain) {
+	return chain->half_precision ? "shaders/screen_half.frag.spv" : "shaders/screen.frag.spv";
+}
+
+// The uniform buffer, the input and the bloom, then the target
+static const VkDescriptorType post_compute_binding_types[4] = {
+	VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+	VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+	VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+	VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+};
+
+static VkxPipeline post_chain_create_compute_pipeline(PostSpecialization specialization) {
+	VkSpecializationInfo specialization_info = post_specialization_info(&specialization);
+	VkPushConstantRange no_push_constants = {0};
+	return vkx_create_compute_pipeline("shaders/post.comp.spv", post_compute_binding_types, 4, no_push_constants, &specialization_info);
+}
+
+VkxPipeline post_chain_create_screen_pipeline(const PostChain* chain, VkFormat format) {
+	/*
+	 * Create the screen pass's pipeline, with the effects which are left for it
+	 *
+	 * @param format Format of the swap chain
+	 */
+	PostSpecialization specialization = {chain->screen_fused, POST_PASS_FUSED, VK_TRUE};
+	return post_chain_create_pipeline(post_chain_fused_shader_path(chain), specialization, format);
+}
+
+VkxPipeline post_chain_create_local_read_pipeline(const PostChain* chain, const VkxPushSet* push_set) {
+	/*
+	 * Create a pipeline applying the screen pass's effects to the pixels the
+	 * scene pass has drawn, in the scene pass itself, for a chain which
+	 * post_chain_is_per_pixel().  It draws over the scene's colour attachment,
+	 * reading it as push_set's input attachment
+	 */
+	PostSpecialization specialization = {chain->screen_fused, POST_PASS_FUSED, VK_TRUE};
+	VkSpecializationInfo specialization_info = post_specialization_info(&specialization);
+	return vkx_create_local_read_pipeline("shaders/screen.vert.spv", "shaders/screen_local_read.frag.spv", push_set, &specialization_info);
+}
+
+static void post_chain_image_infos(const VkxFrameGraph* graph, uint32_t input, uint32_t bloom, uint32_t frame,
+		VkSampler sampler, VkDescriptorImageInfo* image_infos) {
+	// Without a bloom the slot still needs something valid in it
+	uint32_t images[POST_CHAIN_TEXTURES] = {input, bloom != POST_CHAIN_NONE ? bloom : input};
+
+	for (uint32_t i = 0; i < POST_CHAIN_TEXTURES; i++) {
+		image_infos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		image_infos[i].imageView = vkx_frame_graph_get_view(graph, images[i], frame);
+		image_infos[i].sampler = sampler;
+	}
+}
+
+void post_chain_screen_image_infos(const PostChain* chain, const VkxFrameGraph* graph, uint32_t frame,
+		VkSampler sampler, VkDescriptorImageInfo* image_infos) {
+	/*
+	 * The textures of the screen pass's descriptor set for a frame in flight
+	 *
+	 * @param image_infos POST_CHAIN_TEXTURES of them
+	 */
+	post_chain_image_infos(graph, chain->screen_input, chain->screen_bloom, frame, sampler, image_infos);
+}
+
+static void post_chain_write_compute_set(VkDescriptorSet descriptor_set, const VkDescriptorBufferInfo* uniform_buffer,
+		const VkDescriptorImageInfo* image_infos, VkImageView target_view) {
+	VkDescriptorImageInfo target_info = {0};
+	target_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+	target_info.imageView = target_view;
+
+	VkWriteDescriptorSet writes[4] = {0};
+	for (uint32_t w = 0; w < 4; w++) {
+		writes[w].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[w].dstSet = descriptor_set;
+		writes[w].dstBinding = w;
+		writes[w].dstArrayElement = 0;
+		writes[w].descriptorCount = 1;
+		writes[w].descriptorType = post_compute_binding_types[w];
+	}
+	writes[0].pBufferInfo = uniform_buffer;
+	writes[1].pImageInfo = &image_infos[0];
+	writes[2].pImageInfo = &image_infos[1];
+	writes[3].pImageInfo = &target_info;
+
+	vkUpdateDescriptorSets(vkx_instance.device, 4, writes, 0, NULL);
+}
+
+void post_chain_create(PostChain* chain, const VkxFrameGraph* graph, VkSampler sampler,
+		const VkDescriptorBufferInfo* uniform_buffer) {
+	/*
+	 * Create the pipelines and descriptor sets of the passes, once the graph
+	 * is compiled
+	 *
+	 * @param sampler Linear filtering, clamped to the edge
+	 * @param uniform_buffer The part of the frame's uniform buffer the passes
+	 *                       read, offset when bound
+	 */
+	if (chain->passes_count == 0) {
+		return;
+	}
+
+	uint32_t sets_count = chain->passes_count * vkx_instance.frames_in_flight;
+
+	VkDescriptorPoolSize pool_sizes[3] = {0};
+	uint32_t pool_sizes_count = chain->compute ? 3 : 2;
+	pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	pool_sizes[0].descriptorCount = sets_count;
+	pool_sizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	pool_sizes[1].descriptorCount = sets_count * POST_CHAIN_TEXTURES;
+	// The compute passes write to a storage image
+	pool_sizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	pool_sizes[2].descriptorCount = sets_count;
+
+	VkDescriptorPoolCreateInfo pool_info = {0};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.poolSizeCount = pool_sizes_count;
+	pool_info.pPoolSizes = pool_sizes;
+	pool_info.maxSets = sets_count;
+
+	if (vkCreateDescriptorPool(vkx_instance.device, &pool_info, vkx_get_allocator(VK_OBJECT_TYPE_DESCRIPTOR_POOL), &chain->descriptor_pool) != VK_SUCCESS) {
+		fprintf(stderr, "failed to create post-processing descriptor pool!\n");
+		exit(1);
+	}
+
+	for (uint32_t i = 0; i < chain->passes_count; i++) {
+		PostChainPass* pass = &chain->passes[i];
+		VkFormat format = graph->images[pass->target].format;
+
+		PostSpecialization specialization = {pass->fused, pass->type, VK_FALSE};
+		if (chain->compute) {
+			pass->pipeline = post_chain_create_compute_pipeline(specialization);
+		}
+		else {
+			const char* frag_shader_path = pass->type == POST_PASS_FUSED ? post_chain_fused_shader_path(chain) : "shaders/blur.frag.spv";
+			pass->pipeline = post_chain_create_pipeline(frag_shader_path, specialization, format);
+		}
+
+		VkDescriptorSetLayout layouts[VKX_MAX_FRAMES_IN_FLIGHT];
+		for (uint32_t f = 0; f < vkx_instance.frames_in_flight; f++) {
+			layouts[f] = pass->pipeline.descriptor_set_layout;
+		}
+
+		VkDescriptorSetAllocateInfo alloc_info = {0};
+		alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		alloc_info.descriptorPool = chain->descriptor_pool;
+		alloc_info.descriptorSetCount = vkx_instance.frames_in_flight;
+		alloc_info.pSetLayouts = layouts;
+
+		if (vkAllocateDescriptorSets(vkx_instance.device, &alloc_info, pass->descriptor_sets) != VK_SUCCESS) {
+			fprintf(stderr, "failed to allocate post-processing descriptor sets!\n");
+			exit(1);
+		}
+
+		for (uint32_t f = 0; f < vkx_instance.frames_in_flight; f++) {
+			VkDescriptorImageInfo image_infos[POST_CHAIN_TEXTURES];
+			post_chain_image_infos(graph, pass->input, pass->bloom, f, sampler, image_infos);
+
+			if (chain->compute) {
+				VkImageView target_view = vkx_frame_graph_get_view(graph, pass->target, f);
+				post_chain_write_compute_set(pass->descriptor_sets[f], uniform_buffer, image_infos, target_view);
+				continue;
+			}
+
+			VkWriteDescriptorSet writes[2] = {0};
+			for (uint32_t w = 0; w < 2; w++) {
+				writes[w].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writes[w].dstSet = pass->descriptor_sets[f];
+				writes[w].dstBinding = w;
+				writes[w].dstArrayElement = 0;
+				writes[w].descriptorCount = 1;
+			}
+			writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+			writes[0].pBufferInfo = uniform_buffer;
+			writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			writes[1].descriptorCount = POST_CHAIN_TEXTURES;
+			writes[1].pImageInfo = image_infos;
+
+			vkUpdateDescriptorSets(vkx_instance.device, 2, writes, 0, NULL);
+		}
+	}
+
+	printf("Post-processing: %u %s passes before the screen pass\n", chain->passes_count,
+		chain->async_compute ? "async compute" : chain->compute ? "compute" : "draw");
+}
+
+void post_chain_set_render_extent(PostChain* chain, VkxFrameGraph* graph, VkExtent2D extent) {
+	/*
+	 * Render each pass to its share of the scene's extent this frame
+	 *
+	 * @param extent The scene's render extent
+	 */
+	for (uint32_t i = 0; i < chain->passes_count; i++) {
+		PostChainPass* pass = &chain->passes[i];
+		pass->extent = post_chain_divide_extent(extent, pass->divisor);
+		vkx_frame_graph_set_render_extent(graph, pass->graph_pass, pass->extent);
+	}
+}
+
+void post_chain_record(PostChain* chain, VkxFrameGraph* graph, VkCommandBuffer command_buffer,
+		uint32_t frame, const uint32_t* dynamic_offsets) {
+	/*
+	 * Record the passes, which come straight after the scene pass in the graph.
+	 * With async compute the graph has to be recording into the compute
+	 * queue's command buffer
+	 *
+	 * @param frame The frame in flight
+	 * @param dynamic_offsets The frame's uniform buffer offset first
+	 */
+	for (uint32_t i = 0; i < chain->passes_count; i++) {
+		PostChainPass* pass = &chain->passes[i];
+
+		vkx_frame_graph_begin_pass(graph, pass->graph_pass);
+		// Only the uniform buffer is dynamic
+		if (chain->compute) {
+			vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pass->pipeline.pipeline);
+			vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pass->pipeline.layout,
+					0, 1, &pass->descriptor_sets[frame], 1, dynamic_offsets);
+			vkCmdDispatch(command_buffer,
+				(pass->extent.width + POST_CHAIN_WORKGROUP_SIZE - 1) / POST_CHAIN_WORKGROUP_SIZE,
+				(pass->extent.height + POST_CHAIN_WORKGROUP_SIZE - 1) / POST_CHAIN_WORKGROUP_SIZE, 1);
+			vkx_frame_graph_end_pass(graph);
+			continue;
+		}
+
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pass->pipeline.pipeline);
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pass->pipeline.layout,
+				0, 1, &pass->descriptor_sets[frame], 1, dynamic_offsets);
+		vkCmdDraw(command_buffer, 6, 1, 0, 0);
+		vkx_frame_graph_end_pass(graph);
+	}
+}
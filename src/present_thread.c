@@ -0,0 +1,301 @@
+/*
+ * Acquires and presents vkx_swap_chain's images on a thread of its own, so the
+ * thread recording the frames never waits in vkAcquireNextImageKHR or
+ * vkQueuePresentKHR, however long the driver or the compositor takes.
+ *
+ * The thread acquires the image for a frame in flight once that frame's last
+ * submit is done, and presents each frame handed to it with
+ * present_thread_present().  After each present it acquires the image for the
+ * next frame, so that is usually ready by the time the frame is recorded, and
+ * puts how the present and acquire went in a report for
+ * present_thread_take_report().  The frames and the reports go through rings
+ * with one writer and one reader each, so neither side takes a lock, and the
+ * semaphores are only for sleeping when there's nothing to do.
+ *
+ * The first present_thread_take_image() starts the thread.  Anything which
+ * changes the swap chain (i.e. recreating it) has to present_thread_stop()
+ * first, and the next frame starts it again.  It presents on
+ * vkx_instance.present_queue, which has to be a queue of its own
+ * (has_separate_present_queue), as the graphics queue is submitted to from the
+ * render thread at the same time.  Only vkx_swap_chain is presented, not any
+ * other windows.
+ */
+
+#include "present_thread.h"
+#include "trace.h"
+#include "vkx/vkx_core.h"
+#include "vkx/vkx_swap_chain.h"
+
+#include <SDL3/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// The image acquired for a frame in flight
+typedef struct {
+	uint32_t image_index;
+	VkResult result;
+} PresentThreadImage;
+
+static SDL_Thread* present_thread = NULL;
+// Signalled for each frame handed over, and once to stop
+static SDL_Semaphore* frames_semaphore = NULL;
+// Signalled for each image acquired
+static SDL_Semaphore* images_semaphore = NULL;
+static SDL_AtomicInt quitting = {0};
+
+// The frame in flight the thread acquired its first image for
+static uint32_t first_frame = 0;
+static PresentThreadImage images[VKX_MAX_FRAMES_IN_FLIGHT];
+static SDL_AtomicInt images_acquired = {0};
+// Only read and written by the thread taking the images
+static uint32_t images_taken = 0;
+
+// Rings written by one side and read by the other, by count (ring index is the
+// count % PRESENT_THREAD_QUEUE)
+static PresentThreadFrame frames[PRESENT_THREAD_QUEUE];
+static SDL_AtomicInt frames_written = {0};
+static SDL_AtomicInt frames_read = {0};
+static PresentThreadReport reports[PRESENT_THREAD_QUEUE];
+static SDL_AtomicInt reports_written = {0};
+static SDL_AtomicInt reports_read = {0};
+
+static double present_thread_elapsed_ms(uint64_t start_ns) {
+	return (double) (SDL_GetTicksNS() - start_ns) / SDL_NS_PER_MS;
+}
+
+static VkResult present_thread_acquire(uint32_t frame) {
+	/*
+	 * Acquire the image for a frame in flight, signalling its image available
+	 * semaphore.  That was last waited on by the frame's previous submit, which
+	 * has to have finished first
+	 */
+	uint64_t timeline_value = vkx_frames[frame].timeline_value;
+	if (timeline_value > 0) {
+		VkSemaphoreWaitInfo wait_info = {0};
+		wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		wait_info.semaphoreCount = 1;
+		wait_info.pSemaphores = &vkx_instance.frame_timeline;
+		wait_info.pValues = &timeline_value;
+		vkWaitSemaphores(vkx_instance.device, &wait_info, UINT64_MAX);
+	}
+
+	PresentThreadImage* image = &images[frame];
+	trace_begin("acquire image");
+	image->result = vkAcquireNextImageKHR(vkx_instance.device, vkx_swap_chain.swap_chain, UINT64_MAX,
+			vkx_frames[frame].image_available_semaphore, VK_NULL_HANDLE, &image->image_index);
+	trace_end();
+
+	SDL_AddAtomicInt(&images_acquired, 1);
+	SDL_SignalSemaphore(images_semaphore);
+	return image->result;
+}
+
+static VkResult present_thread_present_frame(const PresentThreadFrame* frame) {
+	VkPresentInfoKHR present_info = {0};
+	present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+	present_info.waitSemaphoreCount = 1;
+	present_info.pWaitSemaphores = &vkx_swap_chain.render_finished_semaphores[frame->image_index];
+	present_info.swapchainCount = 1;
+	present_info.pSwapchains = &vkx_swap_chain.swap_chain;
+	present_info.pImageIndices = &frame->image_index;
+
+	// The same extras as the presents on the render thread
+	VkPresentIdKHR present_id = {0};
+	vkx_add_present_id(&present_info, &present_id);
+
+	VkSwapchainPresentFenceInfoEXT present_fence = {0};
+	VkSwapchainPresentModeInfoEXT present_mode_info = {0};
+	vkx_add_present_fence(&present_info, &present_fence, &present_mode_info, frame->image_index);
+
+	VkPresentRegionsKHR present_regions = {0};
+	VkPresentRegionKHR present_region = {0};
+	if (frame->has_region) {
+		vkx_add_present_region(&present_info, &present_regions, &present_region, &frame->rect);
+	}
+
+	trace_begin("present");
+	VkResult result = vkQueuePresentKHR(vkx_instance.present_queue, &present_info);
+	trace_end();
+	return result;
+}
+
+static int present_thread_main(void* data) {
+	(void) data;
+
+	trace_set_thread_name("present");
+
+	uint32_t frame = first_frame;
+	// Stops acquiring once the swap chain is out of date, until it's recreated
+	bool acquiring = present_thread_acquire(frame) >= 0;
+	frame = (frame + 1) % vkx_instance.frames_in_flight;
+
+	for (;;) {
+		SDL_WaitSemaphore(frames_semaphore);
+
+		// Woken without a frame to stop
+		int read = SDL_GetAtomicInt(&frames_read);
+		if (read == SDL_GetAtomicInt(&frames_written)) {
+			break;
+		}
+
+		PresentThreadReport report = {0};
+		uint64_t present_start_ns = SDL_GetTicksNS();
+		report.result = present_thread_present_frame(&frames[read % PRESENT_THREAD_QUEUE]);
+		report.present_ms = present_thread_elapsed_ms(present_start_ns);
+		SDL_SetAtomicInt(&frames_read, read + 1);
+
+		if (acquiring && SDL_GetAtomicInt(&quitting) == 0) {
+			uint64_t acquire_start_ns = SDL_GetTicksNS();
+			acquiring = present_thread_acquire(frame) >= 0;
+			report.acquire_ms = present_thread_elapsed_ms(acquire_start_ns);
+			frame = (frame + 1) % vkx_instance.frames_in_flight;
+		}
+
+		// Dropped if the reports aren't being taken
+		int written = SDL_GetAtomicInt(&reports_written);
+		if (written - SDL_GetAtomicInt(&reports_read) < PRESENT_THREAD_QUEUE) {
+			reports[written % PRESENT_THREAD_QUEUE] = report;
+			SDL_SetAtomicInt(&reports_written, written + 1);
+		}
+	}
+
+	return 0;
+}
+
+static void present_thread_start(uint32_t frame) {
+	/*
+	 * Start the thread, acquiring the image for a frame in flight first
+	 */
+	frames_semaphore = SDL_CreateSemaphore(0);
+	images_semaphore = SDL_CreateSemaphore(0);
+	if (frames_semaphore == NULL || images_semaphore == NULL) {
+		fprintf(stderr, "Failed to create present thread semaphores: %s\n", SDL_GetError());
+		exit(1);
+	}
+
+	SDL_SetAtomicInt(&quitting, 0);
+	first_frame = frame;
+	SDL_SetAtomicInt(&images_acquired, 0);
+	images_taken = 0;
+	SDL_SetAtomicInt(&frames_written, 0);
+	SDL_SetAtomicInt(&frames_read, 0);
+
+	present_thread = SDL_CreateThread(present_thread_main, "present", NULL);
+	if (present_thread == NULL) {
+		fprintf(stderr, "Failed to create the present thread: %s\n", SDL_GetError());
+		exit(1);
+	}
+}
+
+bool present_thread_is_running(void) {
+	return present_thread != NULL;
+}
+
+void present_thread_stop(void) {
+	/*
+	 * Present everything handed over, then stop and join the thread, so the swap
+	 * chain can be changed.  Does nothing if it isn't running
+	 */
+	if (present_thread == NULL) {
+		return;
+	}
+
+	SDL_SetAtomicInt(&quitting, 1);
+	SDL_SignalSemaphore(frames_semaphore);
+	SDL_WaitThread(present_thread, NULL);
+	present_thread = NULL;
+
+	// An image acquired for a frame which never took it leaves that frame's
+	// semaphore signalled, which it can't be for the next acquire.  A submit
+	// which just waits on it unsignals it again
+	uint32_t acquired = (uint32_t) SDL_GetAtomicInt(&images_acquired);
+	if (acquired > images_taken) {
+		uint32_t frame = (first_frame + acquired - 1) % vkx_instance.frames_in_flight;
+		if (images[frame].result >= 0) {
+			VkSemaphoreSubmitInfo wait_info = {0};
+			wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+			wait_info.semaphore = vkx_frames[frame].image_available_semaphore;
+			wait_info.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+			VkSubmitInfo2 submit_info = {0};
+			submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+			submit_info.waitSemaphoreInfoCount = 1;
+			submit_info.pWaitSemaphoreInfos = &wait_info;
+
+			if (vkQueueSubmit2(vkx_instance.present_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+				fprintf(stderr, "failed to submit the unused swap chain image's wait!\n");
+				exit(1);
+			}
+			vkQueueWaitIdle(vkx_instance.present_queue);
+		}
+	}
+
+	SDL_DestroySemaphore(frames_semaphore);
+	SDL_DestroySemaphore(images_semaphore);
+	frames_semaphore = NULL;
+	images_semaphore = NULL;
+}
+
+VkResult present_thread_take_image(uint32_t frame, uint32_t* image_index) {
+	/*
+	 * Wait for the thread to acquire the image for a frame, starting it if it
+	 * isn't running.  The frame waits on its image available semaphore as usual
+	 *
+	 * @param frame The frame in flight, which has to be the one after the frame
+	 *              the image was last taken for
+	 * @param image_index Set to the image, if it was acquired
+	 *
+	 * @return What vkAcquireNextImageKHR returned.  Stop the thread and
+	 *         recreate the swap chain if it is out of date, as it won't acquire
+	 *         any more
+	 */
+	if (present_thread == NULL) {
+		present_thread_start(frame);
+	}
+
+	if (frame != (first_frame + images_taken) % vkx_instance.frames_in_flight) {
+		fprintf(stderr, "Frame %u took its image out of turn\n", frame);
+		exit(1);
+	}
+
+	SDL_WaitSemaphore(images_semaphore);
+	images_taken++;
+
+	*image_index = images[frame].image_index;
+	return images[frame].result;
+}
+
+void present_thread_present(const PresentThreadFrame* frame) {
+	/*
+	 * Hand the thread a submitted frame to present, without waiting
+	 *
+	 * @param frame The image from present_thread_take_image(), which the frame
+	 *              signals the render finished semaphore of
+	 */
+	int written = SDL_GetAtomicInt(&frames_written);
+	if (written - SDL_GetAtomicInt(&frames_read) >= PRESENT_THREAD_QUEUE) {
+		fprintf(stderr, "Too many frames handed to the present thread\n");
+		exit(1);
+	}
+
+	frames[written % PRESENT_THREAD_QUEUE] = *frame;
+	SDL_SetAtomicInt(&frames_written, written + 1);
+	SDL_SignalSemaphore(frames_semaphore);
+}
+
+bool present_thread_take_report(PresentThreadReport* report) {
+	/*
+	 * Take the oldest present the thread hasn't reported yet
+	 *
+	 * @return false if there are none
+	 */
+	int read = SDL_GetAtomicInt(&reports_read);
+	if (read == SDL_GetAtomicInt(&reports_written)) {
+		return false;
+	}
+
+	*report = reports[read % PRESENT_THREAD_QUEUE];
+	SDL_SetAtomicInt(&reports_read, read + 1);
+	return true;
+}
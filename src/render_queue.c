@@ -0,0 +1,595 @@
+/*
+ * Render queue for anything drawn as lots of small items (sprites).
+ *
+ * Each item is pushed with a 64 bit sort key and a value (usually an index into
+ * the caller's own array).  Once everything is in, the queue is radix sorted on
+ * the keys and consecutive items which can share a draw call are grouped into
+ * batches.  See render_queue.h for the key layout.
+ *
+ * Big queues are sorted in parallel on the job system.  Each radix pass splits
+ * the queue into one chunk per thread: the chunks are counted in parallel, a
+ * prefix sum over (bucket, chunk) gives every chunk its own output range in
+ * each bucket, and then the chunks are scattered in parallel.  Chunks keep
+ * their order within a bucket, so the sort is stable just like the serial one.
+ *
+ * Things mostly move a little between frames, so most keys end up in the same
+ * order as the frame before.  render_queue_sort_coherent() puts the items back
+ * in that order and fixes up what has changed with an insertion sort, giving up
+ * for the radix sort if that takes too long.
+ */
+
+#include "render_queue.h"
+#include "jobs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_PASSES (64 / RADIX_BITS)
+
+// One chunk per worker plus the calling thread
+#define MAX_CHUNKS (JOBS_MAX_WORKERS + 1)
+
+#define LAYER_SHIFT 56
+#define TRANSLUCENT_BIT (1ull << 55)
+
+#define OPAQUE_PIPELINE_SHIFT 47
+#define OPAQUE_TEXTURE_SHIFT 32
+
+#define TRANSLUCENT_DEPTH_SHIFT 23
+#define TRANSLUCENT_PIPELINE_SHIFT 15
+
+// In RenderQueue.slots, for a value which isn't in this frame's items, and for
+// one already put back in last frame's order
+#define NO_SLOT UINT32_MAX
+#define TAKEN_SLOT (UINT32_MAX - 1)
+
+void render_queue_init(RenderQueue* queue, uint32_t capacity) {
+	/*
+	 * Allocate a render queue
+	 *
+	 * @param queue The queue to initialise
+	 * @param capacity The maximum number of items pushed between clears
+	 */
+	memset(queue, 0, sizeof(RenderQueue));
+
+	queue->capacity = capacity;
+	queue->keys = malloc(sizeof(uint64_t) * capacity);
+	queue->values = malloc(sizeof(uint32_t) * capacity);
+	queue->scratch_keys = malloc(sizeof(uint64_t) * capacity);
+	queue->scratch_values = malloc(sizeof(uint32_t) * capacity);
+	queue->batches = malloc(sizeof(RenderQueueBatch) * capacity);
+	queue->chunk_histograms = malloc(sizeof(uint32_t) * RADIX_BUCKETS * MAX_CHUNKS);
+	queue->previous_values = malloc(sizeof(uint32_t) * capacity);
+	queue->slots = malloc(sizeof(uint32_t) * capacity);
+
+	if (queue->keys == NULL || queue->values == NULL || queue->scratch_keys == NULL
+			|| queue->scratch_values == NULL || queue->batches == NULL || queue->chunk_histograms == NULL
+			|| queue->previous_values == NULL || queue->slots == NULL) {
+		fprintf(stderr, "Failed to allocate render queue\n");
+		exit(1);
+	}
+}
+
+void render_queue_cleanup(RenderQueue* queue) {
+	free(queue->slots);
+	free(queue->previous_values);
+	free(queue->chunk_histograms);
+	free(queue->batches);
+	free(queue->scratch_values);
+	free(queue->scratch_keys);
+	free(queue->values);
+	free(queue->keys);
+
+	memset(queue, 0, sizeof(RenderQueue));
+}
+
+void render_queue_clear(RenderQueue* queue) {
+	queue->count = 0;
+	queue->batches_count = 0;
+}
+
+void render_queue_push(RenderQueue* queue, uint64_t key, uint32_t value) {
+	if (queue->count >= queue->capacity) {
+		fprintf(stderr, "Render queue overflow (capacity %d)\n", queue->capacity);
+		exit(1);
+	}
+
+	queue->keys[queue->count] = key;
+	queue->values[queue->count] = value;
+	queue->count++;
+}
+
+static void swap_buffers(RenderQueue* queue, uint64_t* keys_in, uint32_t* values_in) {
+	/*
+	 * Make sure the sorted result (in keys_in / values_in) ends up in keys / values
+	 */
+	if (keys_in != queue->keys) {
+		queue->scratch_keys = queue->keys;
+		queue->scratch_values = queue->values;
+		queue->keys = keys_in;
+		queue->values = values_in;
+	}
+}
+
+static void render_queue_sort_serial(RenderQueue* queue) {
+	uint32_t histograms[RADIX_PASSES][RADIX_BUCKETS];
+	memset(histograms, 0, sizeof(histograms));
+
+	// Build all the histograms in one go
+	for (uint32_t i = 0; i < queue->count; i++) {
+		uint64_t key = queue->keys[i];
+		for (uint32_t pass = 0; pass < RADIX_PASSES; pass++) {
+			histograms[pass][(key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+		}
+	}
+
+	uint64_t* keys_in = queue->keys;
+	uint32_t* values_in = queue->values;
+	uint64_t* keys_out = queue->scratch_keys;
+	uint32_t* values_out = queue->scratch_values;
+
+	for (uint32_t pass = 0; pass < RADIX_PASSES; pass++) {
+		uint32_t* histogram = histograms[pass];
+		uint32_t shift = pass * RADIX_BITS;
+
+		// Nothing to do if everything is in the same bucket
+		uint32_t first_bucket = (keys_in[0] >> shift) & (RADIX_BUCKETS - 1);
+		if (histogram[first_bucket] == queue->count) {
+			continue;
+		}
+
+		// Turn the counts into offsets
+		uint32_t offset = 0;
+		for (uint32_t bucket = 0; bucket < RADIX_BUCKETS; bucket++) {
+			uint32_t bucket_count = histogram[bucket];
+			histogram[bucket] = offset;
+			offset += bucket_count;
+		}
+
+		for (uint32_t i = 0; i < queue->count; i++) {
+			uint32_t bucket = (keys_in[i] >> shift) & (RADIX_BUCKETS - 1);
+			uint32_t dst = histogram[bucket]++;
+			keys_out[dst] = keys_in[i];
+			values_out[dst] = values_in[i];
+		}
+
+		uint64_t* keys_tmp = keys_in;
+		keys_in = keys_out;
+		keys_out = keys_tmp;
+		uint32_t* values_tmp = values_in;
+		values_in = values_out;
+		values_out = values_tmp;
+	}
+
+	swap_buffers(queue, keys_in, values_in);
+}
+
+// ----- Parallel sort -----
+
+typedef struct {
+	RenderQueue* queue;
+	size_t chunk_size;
+	uint32_t shift;
+	uint64_t* keys_in;
+	uint32_t* values_in;
+	uint64_t* keys_out;
+	uint32_t* values_out;
+	// Bits which differ from the first key, per chunk
+	uint64_t diff_masks[MAX_CHUNKS];
+} RadixSortJob;
+
+static void radix_diff_range(size_t start, size_t end, void* data) {
+	/*
+	 * Find which bits vary across the keys so that constant bytes can be skipped.
+	 * The range can cover more than one chunk if the job system ran it inline
+	 */
+	RadixSortJob* job = data;
+	const uint64_t first = job->keys_in[0];
+
+	for (size_t chunk = start / job->chunk_size; chunk * job->chunk_size < end; chunk++) {
+		size_t chunk_end = (chunk + 1) * job->chunk_size;
+		if (chunk_end > end) {
+			chunk_end = end;
+		}
+
+		uint64_t mask = 0;
+		for (size_t i = chunk * job->chunk_size; i < chunk_end; i++) {
+			mask |= job->keys_in[i] ^ first;
+		}
+		job->diff_masks[chunk] = mask;
+	}
+}
+
+static void radix_histogram_range(size_t start, size_t end, void* data) {
+	RadixSortJob* job = data;
+
+	for (size_t chunk = start / job->chunk_size; chunk * job->chunk_size < end; chunk++) {
+		size_t chunk_end = (chunk + 1) * job->chunk_size;
+		if (chunk_end > end) {
+			chunk_end = end;
+		}
+
+		uint32_t* histogram = &job->queue->chunk_histograms[chunk * RADIX_BUCKETS];
+		memset(histogram, 0, sizeof(uint32_t) * RADIX_BUCKETS);
+
+		for (size_t i = chunk * job->chunk_size; i < chunk_end; i++) {
+			histogram[(job->keys_in[i] >> job->shift) & (RADIX_BUCKETS - 1)]++;
+		}
+	}
+}
+
+static void radix_scatter_range(size_t start, size_t end, void* data) {
+	RadixSortJob* job = data;
+
+	for (size_t chunk = start / job->chunk_size; chunk * job->chunk_size < end; chunk++) {
+		size_t chunk_end = (chunk + 1) * job->chunk_size;
+		if (chunk_end > end) {
+			chunk_end = end;
+		}
+
+		// Holds this chunk's output offset for each bucket
+		uint32_t* offsets = &job->queue->chunk_histograms[chunk * RADIX_BUCKETS];
+
+		for (size_t i = chunk * job->chunk_size; i < chunk_end; i++) {
+			uint32_t bucket = (job->keys_in[i] >> job->shift) & (RADIX_BUCKETS - 1);
+			uint32_t dst = offsets[bucket]++;
+			job->keys_out[dst] = job->keys_in[i];
+			job->values_out[dst] = job->values_in[i];
+		}
+	}
+}
+
+static void render_queue_sort_parallel(RenderQueue* queue, uint32_t num_chunks) {
+	RadixSortJob job = {0};
+	job.queue = queue;
+	job.chunk_size = (queue->count + num_chunks - 1) / num_chunks;
+	// Rounding up can leave the last chunk empty
+	num_chunks = (uint32_t) ((queue->count + job.chunk_size - 1) / job.chunk_size);
+
+	job.keys_in = queue->keys;
+	job.values_in = queue->values;
+	job.keys_out = queue->scratch_keys;
+	job.values_out = queue->scratch_values;
+
+	jobs_parallel_for(queue->count, job.chunk_size, radix_diff_range, &job);
+
+	uint64_t diff_mask = 0;
+	for (uint32_t chunk = 0; chunk < num_chunks; chunk++) {
+		diff_mask |= job.diff_masks[chunk];
+	}
+
+	for (uint32_t pass = 0; pass < RADIX_PASSES; pass++) {
+		job.shift = pass * RADIX_BITS;
+
+		// Nothing to do if every key has the same byte here
+		if (((diff_mask >> job.shift) & (RADIX_BUCKETS - 1)) == 0) {
+			continue;
+		}
+
+		jobs_parallel_for(queue->count, job.chunk_size, radix_histogram_range, &job);
+
+		// Turn the counts into offsets.  All of bucket 0 comes first, with each
+		// chunk's part in chunk order, then bucket 1 and so on
+		uint32_t offset = 0;
+		for (uint32_t bucket = 0; bucket < RADIX_BUCKETS; bucket++) {
+			for (uint32_t chunk = 0; chunk < num_chunks; chunk++) {
+				uint32_t* count = &queue->chunk_histograms[chunk * RADIX_BUCKETS + bucket];
+				uint32_t bucket_count = *count;
+				*count = offset;
+				offset += bucket_count;
+			}
+		}
+
+		jobs_parallel_for(queue->count, job.chunk_size, radix_scatter_range, &job);
+
+		uint64_t* keys_tmp = job.keys_in;
+		job.keys_in = job.keys_out;
+		job.keys_out = keys_tmp;
+		uint32_t* values_tmp = job.values_in;
+		job.values_in = job.values_out;
+		job.values_out = values_tmp;
+	}
+
+	swap_buffers(queue, job.keys_in, job.values_in);
+}
+
+void render_queue_sort(RenderQueue* queue) {
+	/*
+	 * Sort the queue by key, smallest first.  This is a stable LSD radix sort, one
+	 * byte per pass.  Passes where every key has the same byte are skipped, which
+	 * is most of them when the keys only differ in depth.  Big queues are sorted
+	 * on the job system if there are any workers
+	 */
+	if (queue->count < 2) {
+		return;
+	}
+
+	uint32_t num_chunks = jobs_get_num_workers() + 1;
+	if (num_chunks > MAX_CHUNKS) {
+		num_chunks = MAX_CHUNKS;
+	}
+
+	if (queue->count >= RENDER_QUEUE_PARALLEL_THRESHOLD && num_chunks > 1) {
+		render_queue_sort_parallel(queue, num_chunks);
+	}
+	else {
+		render_queue_sort_serial(queue);
+	}
+}
+
+// ----- Coherent sort -----
+
+static bool gather_previous_order(RenderQueue* queue, uint32_t* reused) {
+	/*
+	 * Copy the items into the scratch buffers in the order their values were
+	 * last sorted into, followed by the ones which weren't there last time in
+	 * the order they were pushed
+	 *
+	 * @param reused Set to how many were there last time
+	 *
+	 * Returns false if the values can't be used like this, as some are at
+	 * least the capacity or the same as others
+	 */
+	uint32_t* slots = queue->slots;
+	for (uint32_t i = 0; i < queue->previous_count; i++) {
+		if (queue->previous_values[i] < queue->capacity) {
+			slots[queue->previous_values[i]] = NO_SLOT;
+		}
+	}
+	for (uint32_t i = 0; i < queue->count; i++) {
+		if (queue->values[i] >= queue->capacity) {
+			return false;
+		}
+		slots[queue->values[i]] = i;
+	}
+
+	uint32_t out = 0;
+	for (uint32_t i = 0; i < queue->previous_count; i++) {
+		uint32_t value = queue->previous_values[i];
+		uint32_t slot = value < queue->capacity ? slots[value] : NO_SLOT;
+		if (slot == NO_SLOT) {
+			continue;
+		}
+		queue->scratch_keys[out] = queue->keys[slot];
+		queue->scratch_values[out] = value;
+		slots[value] = TAKEN_SLOT;
+		out++;
+	}
+	*reused = out;
+
+	for (uint32_t i = 0; i < queue->count; i++) {
+		if (slots[queue->values[i]] == i) {
+			queue->scratch_keys[out] = queue->keys[i];
+			queue->scratch_values[out] = queue->values[i];
+			out++;
+		}
+	}
+
+	// Anything pushed twice only went in once
+	return out == queue->count;
+}
+
+static bool repair_order(uint64_t* keys, uint32_t* values, uint32_t count, uint32_t* moves_left) {
+	/*
+	 * Insertion sort items which are nearly in order, stably
+	 *
+	 * @param moves_left How many places the items can be moved in all, less
+	 *                   what they were
+	 *
+	 * Returns false, leaving them part sorted, if that's not enough
+	 */
+	for (uint32_t i = 1; i < count; i++) {
+		uint64_t key = keys[i];
+		if (key >= keys[i - 1]) {
+			continue;
+		}
+
+		uint32_t value = values[i];
+		uint32_t j = i;
+		while (j > 0 && keys[j - 1] > key && *moves_left > 0) {
+			keys[j] = keys[j - 1];
+			values[j] = values[j - 1];
+			j--;
+			(*moves_left)--;
+		}
+		keys[j] = key;
+		values[j] = value;
+
+		if (j > 0 && keys[j - 1] > key) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void merge_orders(RenderQueue* queue, uint32_t split) {
+	/*
+	 * Merge the sorted scratch items [0, split) and [split, count) into keys /
+	 * values, the first ones first where the keys are equal
+	 */
+	const uint64_t* keys = queue->scratch_keys;
+	const uint32_t* values = queue->scratch_values;
+	uint32_t a = 0;
+	uint32_t b = split;
+
+	for (uint32_t out = 0; out < queue->count; out++) {
+		if (b == queue->count || (a < split && keys[a] <= keys[b])) {
+			queue->keys[out] = keys[a];
+			queue->values[out] = values[a];
+			a++;
+		}
+		else {
+			queue->keys[out] = keys[b];
+			queue->values[out] = values[b];
+			b++;
+		}
+	}
+}
+
+bool render_queue_sort_coherent(RenderQueue* queue) {
+	/*
+	 * Sort the queue like render_queue_sort(), starting from the order the
+	 * last call sorted the same values into, so that when only a few keys have
+	 * changed the cost is a pass over the items plus however far those have to
+	 * move.  Items which weren't there last time are sorted on their own and
+	 * merged in.  If the keys have changed too much it's radix sorted as usual.
+	 *
+	 * The values have to be different from each other and below the capacity,
+	 * e.g. sprite indices, which mean the same thing from one call to the next.
+	 * Otherwise this is just render_queue_sort().  Where the keys are equal the
+	 * items stay in last time's order rather than the order they're pushed in
+	 *
+	 * Returns whether last time's order was repaired rather than sorted again
+	 */
+	bool repaired = false;
+	uint32_t reused = 0;
+	uint32_t moves_left = queue->count / RENDER_QUEUE_REPAIR_DIVISOR;
+
+	if (queue->count >= 2 && queue->previous_count > 0 && gather_previous_order(queue, &reused)
+			&& queue->count - reused <= moves_left) {
+		uint32_t added = queue->count - reused;
+		repaired = repair_order(queue->scratch_keys, queue->scratch_values, reused, &moves_left)
+			&& repair_order(&queue->scratch_keys[reused], &queue->scratch_values[reused], added, &moves_left);
+	}
+
+	if (repaired) {
+		if (reused > 0 && reused < queue->count) {
+			merge_orders(queue, reused);
+		}
+		else {
+			swap_buffers(queue, queue->scratch_keys, queue->scratch_values);
+		}
+	}
+	else {
+		// keys / values are still as they were pushed
+		render_queue_sort(queue);
+	}
+
+	memcpy(queue->previous_values, queue->values, sizeof(uint32_t) * queue->count);
+	queue->previous_count = queue->count;
+	return repaired;
+}
+
+uint32_t render_queue_build_batches(RenderQueue* queue) {
+	/*
+	 * Group the sorted queue into runs which can be drawn with a single draw call.
+	 * A new batch is started whenever the layer, the translucency or the pipeline
+	 * changes.  The texture doesn't break a batch as it is picked per instance
+	 * (atlas layer or texture table index), it is in the key so that items using
+	 * the same texture end up next to each other
+	 *
+	 * Returns the number of batches
+	 */
+	const uint64_t opaque_state_mask = 0xffull << LAYER_SHIFT | TRANSLUCENT_BIT
+		| (uint64_t)RENDER_QUEUE_MAX_PIPELINE << OPAQUE_PIPELINE_SHIFT;
+	const uint64_t translucent_state_mask = 0xffull << LAYER_SHIFT | TRANSLUCENT_BIT
+		| (uint64_t)RENDER_QUEUE_MAX_PIPELINE << TRANSLUCENT_PIPELINE_SHIFT;
+
+	queue->batches_count = 0;
+
+	for (uint32_t i = 0; i < queue->count; i++) {
+		uint64_t key = queue->keys[i];
+
+		if (queue->batches_count > 0) {
+			RenderQueueBatch* batch = &queue->batches[queue->batches_count - 1];
+			uint64_t mask = (batch->key & TRANSLUCENT_BIT) ? translucent_state_mask : opaque_state_mask;
+			if ((key & mask) == (batch->key & mask)) {
+				batch->count++;
+				continue;
+			}
+		}
+
+		RenderQueueBatch* batch = &queue->batches[queue->batches_count++];
+		batch->first = i;
+		batch->count = 1;
+		batch->key = key;
+	}
+
+	return queue->batches_count;
+}
+
+static uint32_t depth_to_bits(float depth) {
+	/*
+	 * Map a float to an unsigned int with the same ordering, so that it can be
+	 * radix sorted.  Negative numbers have all the bits flipped, positive numbers
+	 * just have the sign bit set
+	 */
+	uint32_t bits;
+	memcpy(&bits, &depth, sizeof(bits));
+
+	if (bits & 0x80000000u) {
+		return ~bits;
+	}
+	return bits | 0x80000000u;
+}
+
+static void check_key_fields(uint32_t layer, uint32_t pipeline, uint32_t texture) {
+	if (layer > RENDER_QUEUE_MAX_LAYER || pipeline > RENDER_QUEUE_MAX_PIPELINE
+			|| texture > RENDER_QUEUE_MAX_TEXTURE) {
+		fprintf(stderr, "Render queue key out of range (layer %d, pipeline %d, texture %d)\n",
+				layer, pipeline, texture);
+		exit(1);
+	}
+}
+
+uint64_t render_queue_opaque_key(uint32_t layer, uint32_t pipeline, uint32_t texture, float depth) {
+	/*
+	 * Key for an opaque item.  Items are grouped by pipeline then texture, and
+	 * drawn front to back within that so the depth test can reject hidden pixels
+	 *
+	 * @param layer Drawn in increasing layer order
+	 * @param pipeline Caller defined pipeline id
+	 * @param texture Texture index (atlas layer or texture table index)
+	 * @param depth Smaller is closer to the camera
+	 */
+	check_key_fields(layer, pipeline, texture);
+
+	return (uint64_t)layer << LAYER_SHIFT
+		| (uint64_t)pipeline << OPAQUE_PIPELINE_SHIFT
+		| (uint64_t)texture << OPAQUE_TEXTURE_SHIFT
+		| (uint64_t)depth_to_bits(depth);
+}
+
+uint64_t render_queue_translucent_key(uint32_t layer, uint32_t pipeline, uint32_t texture, float depth) {
+	/*
+	 * Key for a translucent item.  These come after the opaque items in the same
+	 * layer and are drawn back to front so that they blend correctly
+	 *
+	 * @param layer Drawn in increasing layer order
+	 * @param pipeline Caller defined pipeline id
+	 * @param texture Texture index (atlas layer or texture table index)
+	 * @param depth Smaller is closer to the camera
+	 */
+	check_key_fields(layer, pipeline, texture);
+
+	return (uint64_t)layer << LAYER_SHIFT
+		| TRANSLUCENT_BIT
+		| (uint64_t)(~depth_to_bits(depth)) << TRANSLUCENT_DEPTH_SHIFT
+		| (uint64_t)pipeline << TRANSLUCENT_PIPELINE_SHIFT
+		| (uint64_t)texture;
+}
+
+uint32_t render_queue_key_layer(uint64_t key) {
+	return (uint32_t)(key >> LAYER_SHIFT);
+}
+
+bool render_queue_key_translucent(uint64_t key) {
+	return (key & TRANSLUCENT_BIT) != 0;
+}
+
+uint32_t render_queue_key_pipeline(uint64_t key) {
+	if (key & TRANSLUCENT_BIT) {
+		return (uint32_t)(key >> TRANSLUCENT_PIPELINE_SHIFT) & RENDER_QUEUE_MAX_PIPELINE;
+	}
+	return (uint32_t)(key >> OPAQUE_PIPELINE_SHIFT) & RENDER_QUEUE_MAX_PIPELINE;
+}
+
+uint32_t render_queue_key_texture(uint64_t key) {
+	if (key & TRANSLUCENT_BIT) {
+		return (uint32_t)key & RENDER_QUEUE_MAX_TEXTURE;
+	}
+	return (uint32_t)(key >> OPAQUE_TEXTURE_SHIFT) & RENDER_QUEUE_MAX_TEXTURE;
+}
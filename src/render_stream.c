@@ -0,0 +1,789 @@
+/*
+ * A frame's drawing sent to another copy of the renderer as commands rather
+ * than pixels, e.g. so a thin client with its own GPU shows what a server
+ * simulates.
+ *
+ * Each frame the sender writes one message: the first view's camera, the
+ * tiles changed since the last message, and every sprite_draw() sprite and
+ * shape_draw() shape in the finished batch.  The receiver has the same map
+ * and textures, so a sprite is its texture's index and a tile its tileset
+ * index, and the receiver draws the sprites again through the sprite batch.
+ *
+ * Sprites are small on the wire.  Positions and sizes are rounded to
+ * 1/RENDER_STREAM_POSITION_SCALE of a world unit, texture coordinates and
+ * rotations likewise, and each is sent as the difference from the sprite
+ * before it as a zigzag varint, so a run of sprites near each other takes a
+ * byte or two each.  The rest (depth, texture, colours) is only sent when it
+ * isn't the same as the last sprite's, with a byte of flags saying which.
+ * The differences are within a message, so every message stands on its own.
+ *
+ * It goes over TCP, so the tile edits arrive and in order, with Nagle off.
+ * Neither end ever waits on the socket: the sender only starts a message
+ * once the last one has gone, and skips the frame otherwise (the tiles wait
+ * for the next one), and the receiver decodes every whole message which has
+ * arrived but only keeps the newest frame's sprites.  So at most one frame
+ * is ever buffered at either end.
+ */
+
+#include "render_stream.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET RenderStreamSocket;
+#define RENDER_STREAM_NO_SOCKET INVALID_SOCKET
+#define render_stream_close_socket closesocket
+#else
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int RenderStreamSocket;
+#define RENDER_STREAM_NO_SOCKET -1
+#define render_stream_close_socket close
+#endif
+
+// A closed connection is an error from send() rather than SIGPIPE
+#ifdef MSG_NOSIGNAL
+#define RENDER_STREAM_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define RENDER_STREAM_SEND_FLAGS 0
+#endif
+
+// Sent first, so the receiver knows it's this stream and this version of it
+static const uint8_t RENDER_STREAM_MAGIC[4] = {'R', 'S', 'T', '1'};
+
+// The most an item or a tile can take: the flags, 10 varints of up to 10
+// bytes and 3 raw 32 bit values for an item
+#define RENDER_STREAM_MAX_ITEM_BYTES 128
+#define RENDER_STREAM_MAX_TILE_BYTES 16
+#define RENDER_STREAM_READ_SIZE 65536
+
+// Which of an item's fields follow its position
+#define RENDER_STREAM_SIZE 0x01
+#define RENDER_STREAM_UV 0x02
+#define RENDER_STREAM_ROTATION 0x04
+#define RENDER_STREAM_Z 0x08
+#define RENDER_STREAM_TEXTURE 0x10
+#define RENDER_STREAM_COLOR 0x20
+#define RENDER_STREAM_OUTLINE_COLOR 0x40
+
+typedef struct {
+	uint8_t* data;
+	size_t size;
+	size_t capacity;
+} RenderStreamBuffer;
+
+typedef struct {
+	const uint8_t* data;
+	size_t size;
+	size_t offset;
+	bool failed;
+} RenderStreamReader;
+
+// The last item sent or received, which the next is the difference from,
+// rounded as on the wire
+typedef struct {
+	int64_t pos[2];
+	int64_t size[2];
+	int64_t uv[4];
+	int64_t rotation;
+	float z;
+	uint32_t texture;
+	uint32_t color;
+	uint32_t outline_color;
+} RenderStreamItemState;
+
+static RenderStreamMode stream_mode = RENDER_STREAM_OFF;
+static RenderStreamSocket listen_socket = RENDER_STREAM_NO_SOCKET;
+static RenderStreamSocket stream_socket = RENDER_STREAM_NO_SOCKET;
+
+// The message being sent, and how much of it has gone
+static RenderStreamBuffer send_buffer = {0};
+static size_t send_offset = 0;
+static RenderStreamTile* pending_tiles = NULL;
+static uint32_t pending_tiles_count = 0;
+static uint32_t pending_tiles_capacity = 0;
+
+// What has arrived but isn't a whole message yet, and whether it started
+// with RENDER_STREAM_MAGIC
+static RenderStreamBuffer receive_buffer = {0};
+static bool receive_started = false;
+
+static void render_stream_reserve(RenderStreamBuffer* buffer, size_t size) {
+	/*
+	 * Make room for size more bytes
+	 */
+	if (buffer->size + size <= buffer->capacity) {
+		return;
+	}
+
+	size_t capacity = buffer->capacity == 0 ? RENDER_STREAM_READ_SIZE : buffer->capacity;
+	while (capacity < buffer->size + size) {
+		capacity *= 2;
+	}
+	uint8_t* grown = realloc(buffer->data, capacity);
+	if (grown == NULL) {
+		fprintf(stderr, "Failed to allocate %zu bytes for the render stream\n", capacity);
+		exit(1);
+	}
+	buffer->data = grown;
+	buffer->capacity = capacity;
+}
+
+// These write without checking, so the room has to be reserved first
+
+static void render_stream_put_byte(RenderStreamBuffer* buffer, uint8_t value) {
+	buffer->data[buffer->size++] = value;
+}
+
+static void render_stream_put_u32(RenderStreamBuffer* buffer, uint32_t value) {
+	// Little endian whatever the machine
+	for (uint32_t i = 0; i < 4; i++) {
+		buffer->data[buffer->size++] = (uint8_t) (value >> (i * 8));
+	}
+}
+
+static void render_stream_put_float(RenderStreamBuffer* buffer, float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	render_stream_put_u32(buffer, bits);
+}
+
+static void render_stream_put_varint(RenderStreamBuffer* buffer, uint64_t value) {
+	/*
+	 * 7 bits a byte, lowest first, with the top bit set on all but the last
+	 */
+	while (value >= 0x80) {
+		buffer->data[buffer->size++] = (uint8_t) (value | 0x80);
+		value >>= 7;
+	}
+	buffer->data[buffer->size++] = (uint8_t) value;
+}
+
+static void render_stream_put_signed(RenderStreamBuffer* buffer, int64_t value) {
+	// Zigzag, so small differences either way are small varints
+	render_stream_put_varint(buffer, ((uint64_t) value << 1) ^ (uint64_t) (value >> 63));
+}
+
+static uint8_t render_stream_get_byte(RenderStreamReader* reader) {
+	if (reader->offset >= reader->size) {
+		reader->failed = true;
+		return 0;
+	}
+	return reader->data[reader->offset++];
+}
+
+static uint32_t render_stream_get_u32(RenderStreamReader* reader) {
+	uint32_t value = 0;
+	for (uint32_t i = 0; i < 4; i++) {
+		value |= (uint32_t) render_stream_get_byte(reader) << (i * 8);
+	}
+	return value;
+}
+
+static float render_stream_get_float(RenderStreamReader* reader) {
+	uint32_t bits = render_stream_get_u32(reader);
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+static uint64_t render_stream_get_varint(RenderStreamReader* reader) {
+	uint64_t value = 0;
+	for (uint32_t shift = 0; shift < 64; shift += 7) {
+		uint8_t byte = render_stream_get_byte(reader);
+		value |= (uint64_t) (byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0) {
+			return value;
+		}
+	}
+	reader->failed = true;
+	return 0;
+}
+
+static int64_t render_stream_get_signed(RenderStreamReader* reader) {
+	uint64_t value = render_stream_get_varint(reader);
+	return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+static int64_t render_stream_quantise(float value, float scale) {
+	// Kept well inside an int64_t, so the differences can't overflow
+	return (int64_t) llroundf(fmaxf(fminf(value * scale, 1e15f), -1e15f));
+}
+
+static void render_stream_add_difference(int64_t* value, RenderStreamReader* reader) {
+	// Wrapping, since a broken stream could send anything
+	*value = (int64_t) ((uint64_t) *value + (uint64_t) render_stream_get_signed(reader));
+}
+
+static void render_stream_put_item(RenderStreamBuffer* buffer, const SpriteBatchItem* item, RenderStreamItemState* last) {
+	/*
+	 * Write a sprite as the difference from the last one, and make it the last
+	 */
+	RenderStreamItemState next;
+	next.pos[0] = render_stream_quantise(item->pos[0], RENDER_STREAM_POSITION_SCALE);
+	next.pos[1] = render_stream_quantise(item->pos[1], RENDER_STREAM_POSITION_SCALE);
+	next.size[0] = render_stream_quantise(item->size[0], RENDER_STREAM_POSITION_SCALE);
+	next.size[1] = render_stream_quantise(item->size[1], RENDER_STREAM_POSITION_SCALE);
+	next.uv[0] = render_stream_quantise(item->uv[0], RENDER_STREAM_UV_SCALE);
+	next.uv[1] = render_stream_quantise(item->uv[1], RENDER_STREAM_UV_SCALE);
+	next.uv[2] = render_stream_quantise(item->uv2[0], RENDER_STREAM_UV_SCALE);
+	next.uv[3] = render_stream_quantise(item->uv2[1], RENDER_STREAM_UV_SCALE);
+	next.rotation = render_stream_quantise(item->rotation, RENDER_STREAM_ROTATION_SCALE);
+	next.z = item->z;
+	next.texture = item->texture;
+	next.color = item->color;
+	next.outline_color = item->outline_color;
+
+	uint8_t flags = 0;
+	if (next.size[0] != last->size[0] || next.size[1] != last->size[1]) {
+		flags |= RENDER_STREAM_SIZE;
+	}
+	if (memcmp(next.uv, last->uv, sizeof(next.uv)) != 0) {
+		flags |= RENDER_STREAM_UV;
+	}
+	if (next.rotation != last->rotation) {
+		flags |= RENDER_STREAM_ROTATION;
+	}
+	// Compared as bits, so it's sent exactly
+	if (memcmp(&next.z, &last->z, sizeof(next.z)) != 0) {
+		flags |= RENDER_STREAM_Z;
+	}
+	if (next.texture != last->texture) {
+		flags |= RENDER_STREAM_TEXTURE;
+	}
+	if (next.color != last->color) {
+		flags |= RENDER_STREAM_COLOR;
+	}
+	if (next.outline_color != last->outline_color) {
+		flags |= RENDER_STREAM_OUTLINE_COLOR;
+	}
+
+	render_stream_reserve(buffer, RENDER_STREAM_MAX_ITEM_BYTES);
+	render_stream_put_byte(buffer, flags);
+	render_stream_put_signed(buffer, next.pos[0] - last->pos[0]);
+	render_stream_put_signed(buffer, next.pos[1] - last->pos[1]);
+	if (flags & RENDER_STREAM_SIZE) {
+		render_stream_put_signed(buffer, next.size[0] - last->size[0]);
+		render_stream_put_signed(buffer, next.size[1] - last->size[1]);
+	}
+	if (flags & RENDER_STREAM_UV) {
+		for (uint32_t i = 0; i < 4; i++) {
+			render_stream_put_signed(buffer, next.uv[i] - last->uv[i]);
+		}
+	}
+	if (flags & RENDER_STREAM_ROTATION) {
+		render_stream_put_signed(buffer, next.rotation - last->rotation);
+	}
+	if (flags & RENDER_STREAM_Z) {
+		render_stream_put_float(buffer, next.z);
+	}
+	if (flags & RENDER_STREAM_TEXTURE) {
+		render_stream_put_varint(buffer, next.texture);
+	}
+	if (flags & RENDER_STREAM_COLOR) {
+		render_stream_put_u32(buffer, next.color);
+	}
+	if (flags & RENDER_STREAM_OUTLINE_COLOR) {
+		render_stream_put_u32(buffer, next.outline_color);
+	}
+
+	*last = next;
+}
+
+static void render_stream_get_item(RenderStreamReader* reader, SpriteBatchItem* item, RenderStreamItemState* last) {
+	/*
+	 * Read what render_stream_put_item() wrote
+	 */
+	uint8_t flags = render_stream_get_byte(reader);
+	render_stream_add_difference(&last->pos[0], reader);
+	render_stream_add_difference(&last->pos[1], reader);
+	if (flags & RENDER_STREAM_SIZE) {
+		render_stream_add_difference(&last->size[0], reader);
+		render_stream_add_difference(&last->size[1], reader);
+	}
+	if (flags & RENDER_STREAM_UV) {
+		for (uint32_t i = 0; i < 4; i++) {
+			render_stream_add_difference(&last->uv[i], reader);
+		}
+	}
+	if (flags & RENDER_STREAM_ROTATION) {
+		render_stream_add_difference(&last->rotation, reader);
+	}
+	if (flags & RENDER_STREAM_Z) {
+		last->z = render_stream_get_float(reader);
+	}
+	if (flags & RENDER_STREAM_TEXTURE) {
+		last->texture = (uint32_t) render_stream_get_varint(reader);
+	}
+	if (flags & RENDER_STREAM_COLOR) {
+		last->color = render_stream_get_u32(reader);
+	}
+	if (flags & RENDER_STREAM_OUTLINE_COLOR) {
+		last->outline_color = render_stream_get_u32(reader);
+	}
+
+	item->pos[0] = (float) last->pos[0] / RENDER_STREAM_POSITION_SCALE;
+	item->pos[1] = (float) last->pos[1] / RENDER_STREAM_POSITION_SCALE;
+	item->size[0] = (float) last->size[0] / RENDER_STREAM_POSITION_SCALE;
+	item->size[1] = (float) last->size[1] / RENDER_STREAM_POSITION_SCALE;
+	item->uv[0] = (float) last->uv[0] / RENDER_STREAM_UV_SCALE;
+	item->uv[1] = (float) last->uv[1] / RENDER_STREAM_UV_SCALE;
+	item->uv2[0] = (float) last->uv[2] / RENDER_STREAM_UV_SCALE;
+	item->uv2[1] = (float) last->uv[3] / RENDER_STREAM_UV_SCALE;
+	item->rotation = (float) last->rotation / RENDER_STREAM_ROTATION_SCALE;
+	item->z = last->z;
+	item->texture = last->texture;
+	item->color = last->color;
+	item->outline_color = last->outline_color;
+
+	// A shape the receiver doesn't have is given a texture past the end,
+	// which the renderer skips
+	if ((item->texture & SPRITE_BATCH_SHAPE) != 0 && (item->texture & ~SPRITE_BATCH_SHAPE) >= _SHAPE_COUNT) {
+		item->texture = ~SPRITE_BATCH_SHAPE;
+	}
+}
+
+static bool render_stream_would_block(void) {
+#ifdef _WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+static void render_stream_set_nonblocking(RenderStreamSocket socket) {
+	/*
+	 * So sending and receiving never wait, and turn Nagle off so each frame
+	 * goes as soon as it's written
+	 */
+#ifdef _WIN32
+	u_long nonblocking = 1;
+	ioctlsocket(socket, FIONBIO, &nonblocking);
+#else
+	fcntl(socket, F_SETFL, fcntl(socket, F_GETFL, 0) | O_NONBLOCK);
+#endif
+	int no_delay = 1;
+	setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, (const char*) &no_delay, sizeof(no_delay));
+}
+
+static void render_stream_disconnect(const char* reason) {
+	/*
+	 * Drop the connection and anything half sent or received.  The receiver
+	 * goes back to waiting for another sender
+	 */
+	if (stream_socket != RENDER_STREAM_NO_SOCKET) {
+		render_stream_close_socket(stream_socket);
+		stream_socket = RENDER_STREAM_NO_SOCKET;
+		if (reason != NULL) {
+			fprintf(stderr, "%s\n", reason);
+		}
+	}
+	send_buffer.size = 0;
+	send_offset = 0;
+	receive_buffer.size = 0;
+	receive_started = false;
+}
+
+static bool render_stream_connect(const char* host, const char* port) {
+	/*
+	 * Connect to the receiver, waiting for it to answer
+	 */
+	struct addrinfo hints = {0};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	struct addrinfo* addresses = NULL;
+	if (getaddrinfo(host, port, &hints, &addresses) != 0) {
+		fprintf(stderr, "Couldn't resolve the render stream receiver %s\n", host);
+		return false;
+	}
+
+	for (struct addrinfo* address = addresses; address != NULL; address = address->ai_next) {
+		stream_socket = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+		if (stream_socket == RENDER_STREAM_NO_SOCKET) {
+			continue;
+		}
+		if (connect(stream_socket, address->ai_addr, (int) address->ai_addrlen) == 0) {
+			break;
+		}
+		render_stream_close_socket(stream_socket);
+		stream_socket = RENDER_STREAM_NO_SOCKET;
+	}
+	freeaddrinfo(addresses);
+
+	if (stream_socket == RENDER_STREAM_NO_SOCKET) {
+		fprintf(stderr, "Couldn't connect to the render stream receiver %s:%s\n", host, port);
+		return false;
+	}
+
+	render_stream_set_nonblocking(stream_socket);
+	// Goes out ahead of the first frame
+	render_stream_reserve(&send_buffer, sizeof(RENDER_STREAM_MAGIC));
+	memcpy(send_buffer.data, RENDER_STREAM_MAGIC, sizeof(RENDER_STREAM_MAGIC));
+	send_buffer.size = sizeof(RENDER_STREAM_MAGIC);
+	return true;
+}
+
+static bool render_stream_listen(const char* port) {
+	/*
+	 * Start listening for the sender, which is accepted by the receives
+	 */
+	struct addrinfo hints = {0};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+
+	struct addrinfo* addresses = NULL;
+	if (getaddrinfo(NULL, port, &hints, &addresses) != 0) {
+		fprintf(stderr, "Couldn't find an address to listen for the render stream on\n");
+		return false;
+	}
+
+	for (struct addrinfo* address = addresses; address != NULL; address = address->ai_next) {
+		listen_socket = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+		if (listen_socket == RENDER_STREAM_NO_SOCKET) {
+			continue;
+		}
+		int reuse = 1;
+		setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, (const char*) &reuse, sizeof(reuse));
+		if (bind(listen_socket, address->ai_addr, (int) address->ai_addrlen) == 0 && listen(listen_socket, 1) == 0) {
+			break;
+		}
+		render_stream_close_socket(listen_socket);
+		listen_socket = RENDER_STREAM_NO_SOCKET;
+	}
+	freeaddrinfo(addresses);
+
+	if (listen_socket == RENDER_STREAM_NO_SOCKET) {
+		fprintf(stderr, "Couldn't listen for the render stream on port %s\n", port);
+		return false;
+	}
+
+	render_stream_set_nonblocking(listen_socket);
+	printf("Listening for the render stream on port %s\n", port);
+	return true;
+}
+
+bool render_stream_start(RenderStreamMode mode, const char* host, uint16_t port) {
+	/*
+	 * Connect to the receiver, or start listening for the sender
+	 *
+	 * @param host The receiver to send to, unused for receiving
+	 *
+	 * @return false if it couldn't, in which case it's off
+	 */
+	if (mode == RENDER_STREAM_OFF) {
+		return false;
+	}
+
+	char port_string[8];
+	snprintf(port_string, sizeof(port_string), "%u", port);
+
+#ifdef _WIN32
+	WSADATA wsa_data;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
+		return false;
+	}
+#endif
+
+	bool started = mode == RENDER_STREAM_SEND ? render_stream_connect(host, port_string) : render_stream_listen(port_string);
+	if (!started) {
+#ifdef _WIN32
+		WSACleanup();
+#endif
+		return false;
+	}
+
+	stream_mode = mode;
+	return true;
+}
+
+void render_stream_stop(void) {
+	if (stream_mode == RENDER_STREAM_OFF) {
+		return;
+	}
+
+	render_stream_disconnect(NULL);
+	if (listen_socket != RENDER_STREAM_NO_SOCKET) {
+		render_stream_close_socket(listen_socket);
+		listen_socket = RENDER_STREAM_NO_SOCKET;
+	}
+#ifdef _WIN32
+	WSACleanup();
+#endif
+
+	free(send_buffer.data);
+	free(receive_buffer.data);
+	free(pending_tiles);
+	memset(&send_buffer, 0, sizeof(send_buffer));
+	memset(&receive_buffer, 0, sizeof(receive_buffer));
+	pending_tiles = NULL;
+	pending_tiles_count = 0;
+	pending_tiles_capacity = 0;
+	stream_mode = RENDER_STREAM_OFF;
+}
+
+bool render_stream_is_connected(void) {
+	return stream_socket != RENDER_STREAM_NO_SOCKET;
+}
+
+void render_stream_add_tile(uint32_t x, uint32_t y, uint32_t value) {
+	/*
+	 * Send a tile change with the next frame
+	 */
+	if (stream_mode != RENDER_STREAM_SEND || stream_socket == RENDER_STREAM_NO_SOCKET) {
+		return;
+	}
+
+	if (pending_tiles_count == pending_tiles_capacity) {
+		pending_tiles_capacity = pending_tiles_capacity == 0 ? 256 : pending_tiles_capacity * 2;
+		pending_tiles = realloc(pending_tiles, sizeof(RenderStreamTile) * pending_tiles_capacity);
+		if (pending_tiles == NULL) {
+			fprintf(stderr, "Failed to allocate the render stream's tiles\n");
+			exit(1);
+		}
+	}
+
+	RenderStreamTile* tile = &pending_tiles[pending_tiles_count++];
+	tile->x = x;
+	tile->y = y;
+	tile->value = value;
+}
+
+static bool render_stream_flush(void) {
+	/*
+	 * Send as much of the message as the socket takes without waiting
+	 *
+	 * @return Whether all of it has gone
+	 */
+	while (send_offset < send_buffer.size) {
+		int sent = (int) send(stream_socket, (const char*) send_buffer.data + send_offset,
+				(int) (send_buffer.size - send_offset), RENDER_STREAM_SEND_FLAGS);
+		if (sent < 0) {
+			if (!render_stream_would_block()) {
+				render_stream_disconnect("Lost the render stream connection");
+			}
+			return false;
+		}
+		send_offset += (size_t) sent;
+	}
+	return true;
+}
+
+bool render_stream_send(const SpriteBatch* batch, const float centre[2], float zoom) {
+	/*
+	 * Send a frame: the first view's camera, the tiles added since the last
+	 * one and a finished batch's sprites
+	 *
+	 * @return false if the last frame is still going (the receiver or the
+	 *         network is behind), in which case this one is skipped and the
+	 *         tiles go with the next
+	 */
+	if (stream_mode != RENDER_STREAM_SEND || stream_socket == RENDER_STREAM_NO_SOCKET || !render_stream_flush()) {
+		return false;
+	}
+
+	send_buffer.size = 0;
+	send_offset = 0;
+	// The length, which is filled in at the end
+	render_stream_reserve(&send_buffer, 4 + 3 * sizeof(float) + 10);
+	send_buffer.size = 4;
+	render_stream_put_float(&send_buffer, centre[0]);
+	render_stream_put_float(&send_buffer, centre[1]);
+	render_stream_put_float(&send_buffer, zoom);
+
+	render_stream_put_varint(&send_buffer, pending_tiles_count);
+	for (uint32_t i = 0; i < pending_tiles_count; i++) {
+		render_stream_reserve(&send_buffer, RENDER_STREAM_MAX_TILE_BYTES);
+		render_stream_put_varint(&send_buffer, pending_tiles[i].x);
+		render_stream_put_varint(&send_buffer, pending_tiles[i].y);
+		render_stream_put_varint(&send_buffer, pending_tiles[i].value);
+	}
+	pending_tiles_count = 0;
+
+	render_stream_reserve(&send_buffer, 10);
+	render_stream_put_varint(&send_buffer, batch->count);
+	RenderStreamItemState last = {0};
+	for (uint32_t chunk = 0; chunk < batch->chunks_count; chunk++) {
+		for (uint32_t i = 0; i < batch->chunk_counts[chunk].count; i++) {
+			render_stream_put_item(&send_buffer, &batch->items[chunk * SPRITE_BATCH_CHUNK + i], &last);
+		}
+	}
+
+	size_t length = send_buffer.size - 4;
+	send_buffer.size = 0;
+	render_stream_put_u32(&send_buffer, (uint32_t) length);
+	send_buffer.size = length + 4;
+
+	render_stream_flush();
+	return true;
+}
+
+void render_stream_frame_cleanup(RenderStreamFrame* frame) {
+	free(frame->items);
+	free(frame->tiles);
+	memset(frame, 0, sizeof(*frame));
+}
+
+static bool render_stream_decode(const uint8_t* data, size_t size, RenderStreamFrame* frame) {
+	/*
+	 * Read a message into the frame, replacing its sprites and adding its
+	 * tiles to the ones already there
+	 *
+	 * @return false if it's broken
+	 */
+	RenderStreamReader reader = {data, size, 0, false};
+	uint32_t first_tile = frame->tiles_count;
+	frame->centre[0] = render_stream_get_float(&reader);
+	frame->centre[1] = render_stream_get_float(&reader);
+	frame->zoom = render_stream_get_float(&reader);
+
+	// Every tile and item takes at least 3 bytes, so a count which couldn't
+	// be there isn't allocated for
+	uint64_t tiles_count = render_stream_get_varint(&reader);
+	if (reader.failed || tiles_count > (size - reader.offset) / 3) {
+		frame->items_count = 0;
+		return false;
+	}
+	if (frame->tiles_count + tiles_count > frame->tiles_capacity) {
+		frame->tiles_capacity = frame->tiles_count + (uint32_t) tiles_count;
+		frame->tiles = realloc(frame->tiles, sizeof(RenderStreamTile) * frame->tiles_capacity);
+		if (frame->tiles == NULL) {
+			fprintf(stderr, "Failed to allocate the render stream's tiles\n");
+			exit(1);
+		}
+	}
+	for (uint64_t i = 0; i < tiles_count; i++) {
+		RenderStreamTile* tile = &frame->tiles[frame->tiles_count++];
+		tile->x = (uint32_t) render_stream_get_varint(&reader);
+		tile->y = (uint32_t) render_stream_get_varint(&reader);
+		tile->value = (uint32_t) render_stream_get_varint(&reader);
+	}
+
+	uint64_t items_count = render_stream_get_varint(&reader);
+	if (reader.failed || items_count > (size - reader.offset) / 3) {
+		frame->tiles_count = first_tile;
+		frame->items_count = 0;
+		return false;
+	}
+	if (items_count > frame->items_capacity) {
+		frame->items_capacity = (uint32_t) items_count;
+		free(frame->items);
+		frame->items = malloc(sizeof(SpriteBatchItem) * frame->items_capacity);
+		if (frame->items == NULL) {
+			fprintf(stderr, "Failed to allocate %u render stream sprites\n", frame->items_capacity);
+			exit(1);
+		}
+	}
+	RenderStreamItemState last = {0};
+	for (uint64_t i = 0; i < items_count; i++) {
+		render_stream_get_item(&reader, &frame->items[i], &last);
+	}
+	frame->items_count = (uint32_t) items_count;
+
+	if (reader.failed || reader.offset != size) {
+		frame->tiles_count = first_tile;
+		frame->items_count = 0;
+		return false;
+	}
+	return true;
+}
+
+static void render_stream_accept(void) {
+	RenderStreamSocket accepted = accept(listen_socket, NULL, NULL);
+	if (accepted == RENDER_STREAM_NO_SOCKET) {
+		return;
+	}
+	render_stream_set_nonblocking(accepted);
+	stream_socket = accepted;
+	receive_buffer.size = 0;
+	receive_started = false;
+	printf("The render stream sender connected\n");
+}
+
+bool render_stream_receive(RenderStreamFrame* frame) {
+	/*
+	 * Take whatever has arrived without waiting.  With more than one frame in,
+	 * only the newest one's sprites are kept, but the tiles of all of them are
+	 *
+	 * @param frame Keeps its sprites until a newer frame comes, and the tiles
+	 *              are added to, so the caller empties those once it has made
+	 *              the changes
+	 *
+	 * @return Whether any frames came
+	 */
+	if (stream_mode != RENDER_STREAM_RECEIVE) {
+		return false;
+	}
+	if (stream_socket == RENDER_STREAM_NO_SOCKET) {
+		render_stream_accept();
+		if (stream_socket == RENDER_STREAM_NO_SOCKET) {
+			return false;
+		}
+	}
+
+	for (;;) {
+		render_stream_reserve(&receive_buffer, RENDER_STREAM_READ_SIZE);
+		int received = (int) recv(stream_socket, (char*) receive_buffer.data + receive_buffer.size, RENDER_STREAM_READ_SIZE, 0);
+		if (received > 0) {
+			receive_buffer.size += (size_t) received;
+			continue;
+		}
+		if (received == 0) {
+			render_stream_disconnect("The render stream sender went away");
+			return false;
+		}
+		if (!render_stream_would_block()) {
+			render_stream_disconnect("Lost the render stream connection");
+			return false;
+		}
+		break;
+	}
+
+	size_t offset = 0;
+	if (!receive_started) {
+		if (receive_buffer.size < sizeof(RENDER_STREAM_MAGIC)) {
+			return false;
+		}
+		if (memcmp(receive_buffer.data, RENDER_STREAM_MAGIC, sizeof(RENDER_STREAM_MAGIC)) != 0) {
+			render_stream_disconnect("The render stream sender isn't sending this version of the stream");
+			return false;
+		}
+		offset = sizeof(RENDER_STREAM_MAGIC);
+		receive_started = true;
+	}
+
+	bool received_frame = false;
+	while (receive_buffer.size - offset >= 4) {
+		RenderStreamReader reader = {receive_buffer.data + offset, 4, 0, false};
+		uint32_t length = render_stream_get_u32(&reader);
+		if (length > RENDER_STREAM_MAX_MESSAGE) {
+			render_stream_disconnect("The render stream is broken");
+			return received_frame;
+		}
+		if (receive_buffer.size - offset - 4 < length) {
+			break;
+		}
+		if (!render_stream_decode(receive_buffer.data + offset + 4, length, frame)) {
+			render_stream_disconnect("The render stream is broken");
+			return received_frame;
+		}
+		offset += 4 + (size_t) length;
+		received_frame = true;
+	}
+
+	// Keep the start of the next message
+	memmove(receive_buffer.data, receive_buffer.data + offset, receive_buffer.size - offset);
+	receive_buffer.size -= offset;
+	return received_frame;
+}
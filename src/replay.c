@@ -0,0 +1,234 @@
+/*
+ * Recording and replaying a run's inputs, so a session can be run again doing
+ * exactly the same work (e.g. by a benchmark on another build).
+ *
+ * The log starts with the seed everything random was drawn from, then has a
+ * record for each frame: the input events the main loop handled in it, and
+ * then the frame's time step and which of the polled keys were held.  Replaying
+ * hands them back in the same order, so the map, the monsters and everything
+ * the simulation does come out the same, whatever the real frame times are.
+ *
+ *   header: magic, version, seed (uint32 each)
+ *   event:  REPLAY_RECORD_EVENT, type, code (32 bits each), x, y (float)
+ *   frame:  REPLAY_RECORD_FRAME, dt (double), held keys (uint32)
+ *
+ * Records are a tag byte and then their fields, in the machine's byte order.
+ */
+
+#include "replay.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Tags of the records after the header
+#define REPLAY_RECORD_EVENT 1
+#define REPLAY_RECORD_FRAME 2
+
+typedef struct {
+	FILE* file;
+	bool recording;
+	bool playing;
+	uint32_t seed;
+	uint32_t frames_count;
+	// Read while looking for the next event, and handed out by
+	// replay_next_frame()
+	bool has_frame;
+	double frame_dt;
+	uint32_t frame_held_keys;
+	// Nothing more to read
+	bool ended;
+} Replay;
+
+static Replay replay = {0};
+
+static bool replay_write(const void* data, size_t size) {
+	return fwrite(data, size, 1, replay.file) == 1;
+}
+
+static bool replay_read(void* data, size_t size) {
+	return fread(data, size, 1, replay.file) == 1;
+}
+
+bool replay_start_recording(const char* filename, uint32_t seed) {
+	/*
+	 * Start writing a log of the run
+	 *
+	 * @param seed What everything random is drawn from
+	 *
+	 * @return false if the file couldn't be written, which has been printed
+	 */
+	replay_stop();
+
+	replay.file = fopen(filename, "wb");
+	if (replay.file == NULL) {
+		fprintf(stderr, "Failed to open %s for recording\n", filename);
+		return false;
+	}
+
+	const uint32_t header[3] = {REPLAY_MAGIC, REPLAY_VERSION, seed};
+	if (!replay_write(header, sizeof(header))) {
+		fprintf(stderr, "Failed to write to %s\n", filename);
+		fclose(replay.file);
+		replay.file = NULL;
+		return false;
+	}
+
+	replay.recording = true;
+	replay.seed = seed;
+	printf("Recording the inputs to %s\n", filename);
+	return true;
+}
+
+bool replay_start_playing(const char* filename) {
+	/*
+	 * Start replaying a log, whose seed is then replay_get_seed()
+	 *
+	 * @return false if it couldn't be read, which has been printed
+	 */
+	replay_stop();
+
+	replay.file = fopen(filename, "rb");
+	if (replay.file == NULL) {
+		fprintf(stderr, "Failed to open %s for replaying\n", filename);
+		return false;
+	}
+
+	uint32_t header[3] = {0};
+	if (!replay_read(header, sizeof(header)) || header[0] != REPLAY_MAGIC || header[1] != REPLAY_VERSION) {
+		fprintf(stderr, "%s isn't a replay log of version %u\n", filename, REPLAY_VERSION);
+		fclose(replay.file);
+		replay.file = NULL;
+		return false;
+	}
+
+	replay.playing = true;
+	replay.seed = header[2];
+	printf("Replaying the inputs from %s\n", filename);
+	return true;
+}
+
+void replay_stop(void) {
+	/*
+	 * Finish the recording or the replay, if there is one
+	 */
+	if (replay.file == NULL) {
+		return;
+	}
+
+	printf("%s %u frames\n", replay.recording ? "Recorded" : "Replayed", replay.frames_count);
+	if (fclose(replay.file) != 0 && replay.recording) {
+		fprintf(stderr, "Failed to finish writing the replay log\n");
+	}
+	memset(&replay, 0, sizeof(replay));
+}
+
+bool replay_is_recording(void) {
+	return replay.recording;
+}
+
+bool replay_is_playing(void) {
+	return replay.playing;
+}
+
+uint32_t replay_get_seed(void) {
+	return replay.seed;
+}
+
+void replay_record_event(const ReplayEvent* event) {
+	/*
+	 * Write down an input event of the frame, before its replay_record_frame()
+	 */
+	const uint8_t tag = REPLAY_RECORD_EVENT;
+	if (!replay.recording) {
+		return;
+	}
+
+	replay_write(&tag, sizeof(tag));
+	replay_write(&event->type, sizeof(event->type));
+	replay_write(&event->code, sizeof(event->code));
+	replay_write(&event->x, sizeof(event->x));
+	replay_write(&event->y, sizeof(event->y));
+}
+
+void replay_record_frame(double dt, uint32_t held_keys) {
+	/*
+	 * Finish the frame's record, once its events are written
+	 *
+	 * @param dt The time since the last frame, in seconds
+	 * @param held_keys Whatever keys the caller polls rather than getting
+	 *                  events for, as bits
+	 */
+	const uint8_t tag = REPLAY_RECORD_FRAME;
+	if (!replay.recording) {
+		return;
+	}
+
+	replay_write(&tag, sizeof(tag));
+	replay_write(&dt, sizeof(dt));
+	replay_write(&held_keys, sizeof(held_keys));
+	replay.frames_count++;
+}
+
+static void replay_read_record(void) {
+	// Read the next frame record, giving up on the log if it's cut short
+	uint8_t tag = 0;
+	if (!replay_read(&tag, sizeof(tag)) || tag != REPLAY_RECORD_FRAME
+			|| !replay_read(&replay.frame_dt, sizeof(replay.frame_dt))
+			|| !replay_read(&replay.frame_held_keys, sizeof(replay.frame_held_keys))) {
+		replay.ended = true;
+		return;
+	}
+	replay.has_frame = true;
+}
+
+bool replay_next_event(ReplayEvent* event) {
+	/*
+	 * Read the frame's next event, until there are none left in it and it's
+	 * time for replay_next_frame()
+	 *
+	 * @return false once the frame's events are all read
+	 */
+	if (!replay.playing || replay.has_frame || replay.ended) {
+		return false;
+	}
+
+	uint8_t tag = 0;
+	if (!replay_read(&tag, sizeof(tag))) {
+		replay.ended = true;
+		return false;
+	}
+	if (tag != REPLAY_RECORD_EVENT) {
+		// The frame's own record, which replay_next_frame() hands out
+		fseek(replay.file, -(long) sizeof(tag), SEEK_CUR);
+		replay_read_record();
+		return false;
+	}
+
+	if (!replay_read(&event->type, sizeof(event->type)) || !replay_read(&event->code, sizeof(event->code))
+			|| !replay_read(&event->x, sizeof(event->x)) || !replay_read(&event->y, sizeof(event->y))) {
+		replay.ended = true;
+		return false;
+	}
+	return true;
+}
+
+bool replay_next_frame(double* dt, uint32_t* held_keys) {
+	/*
+	 * Read the frame's time step and held keys, skipping any of its events
+	 * which weren't read
+	 *
+	 * @return false at the end of the log, when the replay is over
+	 */
+	ReplayEvent skipped;
+	while (replay_next_event(&skipped)) {
+	}
+	if (!replay.has_frame) {
+		return false;
+	}
+
+	*dt = replay.frame_dt;
+	*held_keys = replay.frame_held_keys;
+	replay.has_frame = false;
+	replay.frames_count++;
+	return true;
+}
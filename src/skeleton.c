@@ -0,0 +1,168 @@
+/*
+ * 2D skeletons and the looping clips which animate them, for characters
+ * made of parts (cutouts) or skinned meshes.
+ *
+ * A pose is sampled into a palette of transforms, one a bone, each taking a
+ * vertex of the skin in the rest pose to where the bone has moved it in the
+ * world.  The renderer only has to blend a vertex's bones' palette entries,
+ * so the whole skeleton is done once a character on the CPU rather than once
+ * a vertex on the GPU.
+ *
+ * Everything is fixed size and there's nothing shared between calls, so the
+ * characters can be sampled on any number of threads at once.
+ */
+
+#include "skeleton.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void skeleton_init(Skeleton* skeleton) {
+	memset(skeleton, 0, sizeof(*skeleton));
+}
+
+static void skeleton_get_local(const float position[2], float rotation, Affine2* local) {
+	const float scale[2] = {1.0f, 1.0f};
+	affine2_make(local, position, rotation, scale);
+}
+
+uint32_t skeleton_add_bone(Skeleton* skeleton, uint32_t parent, const float position[2], float rotation) {
+	/*
+	 * Add a bone at its rest pose
+	 *
+	 * @param parent A bone added before it, or SKELETON_NO_PARENT for a root
+	 * @param position, rotation Where it is in its parent's space (or the
+	 *                           model's for a root)
+	 *
+	 * @return Its index
+	 */
+	if (skeleton->bones_count == SKELETON_MAX_BONES) {
+		fprintf(stderr, "Skeletons can't have more than %d bones\n", SKELETON_MAX_BONES);
+		exit(1);
+	}
+	if (parent != SKELETON_NO_PARENT && parent >= skeleton->bones_count) {
+		fprintf(stderr, "A bone's parent has to be added before it\n");
+		exit(1);
+	}
+
+	uint32_t bone = skeleton->bones_count++;
+	skeleton->parents[bone] = parent;
+	skeleton->rest_positions[bone][0] = position[0];
+	skeleton->rest_positions[bone][1] = position[1];
+	skeleton->rest_rotations[bone] = rotation;
+
+	// The inverse of the parent's is already there, undo it to get the
+	// parent's rest pose in the model and add this bone's to it
+	Affine2 bind;
+	skeleton_get_local(position, rotation, &bind);
+	if (parent != SKELETON_NO_PARENT) {
+		Affine2 parent_bind;
+		affine2_inverse(&skeleton->inverse_binds[parent], &parent_bind);
+		affine2_mul(&bind, &parent_bind, &bind);
+	}
+	affine2_inverse(&bind, &skeleton->inverse_binds[bone]);
+	return bone;
+}
+
+void skeleton_clip_init(SkeletonClip* clip, float duration) {
+	/*
+	 * Start a clip with every bone at rest
+	 *
+	 * @param duration Seconds before it loops
+	 */
+	memset(clip, 0, sizeof(*clip));
+	clip->duration = duration;
+}
+
+void skeleton_clip_add_key(SkeletonClip* clip, uint32_t bone, float time, float rotation, const float translation[2]) {
+	/*
+	 * Add a key to a bone's track, after the ones it already has.  The last
+	 * key blends back into the first as the clip loops
+	 *
+	 * @param time Seconds into the clip
+	 * @param rotation, translation From the bone's rest pose
+	 */
+	SkeletonTrack* track = &clip->tracks[bone];
+	if (track->keys_count == SKELETON_MAX_KEYS) {
+		fprintf(stderr, "Skeleton clips can't have more than %d keys a bone\n", SKELETON_MAX_KEYS);
+		exit(1);
+	}
+
+	SkeletonKey* key = &track->keys[track->keys_count++];
+	key->time = time;
+	key->rotation = rotation;
+	key->translation[0] = translation[0];
+	key->translation[1] = translation[1];
+}
+
+static void skeleton_sample_track(const SkeletonTrack* track, float duration, float time, SkeletonKey* out) {
+	/*
+	 * Blend the keys either side of a time, which is in [0, duration)
+	 */
+	memset(out, 0, sizeof(*out));
+	if (track->keys_count == 0) {
+		return;
+	}
+
+	// The last key at or before the time, or the last of all if the time is
+	// before the first, which it blends from across the loop
+	uint32_t last = track->keys_count - 1;
+	uint32_t prev = last;
+	for (uint32_t i = 0; i < track->keys_count && track->keys[i].time <= time; i++) {
+		prev = i;
+	}
+	uint32_t next = prev == last ? 0 : prev + 1;
+
+	float start = track->keys[prev].time;
+	float end = track->keys[next].time;
+	if (prev == last) {
+		end += duration;
+		if (time < start) {
+			time += duration;
+		}
+	}
+	float blend = end > start ? (time - start) / (end - start) : 0.0f;
+
+	const SkeletonKey* a = &track->keys[prev];
+	const SkeletonKey* b = &track->keys[next];
+	out->rotation = a->rotation + (b->rotation - a->rotation) * blend;
+	out->translation[0] = a->translation[0] + (b->translation[0] - a->translation[0]) * blend;
+	out->translation[1] = a->translation[1] + (b->translation[1] - a->translation[1]) * blend;
+}
+
+void skeleton_sample(const Skeleton* skeleton, const SkeletonClip* clip, float time, const Affine2* placement, Affine2* palette) {
+	/*
+	 * Pose a skeleton at a time in a clip, for a skin
+	 *
+	 * @param time Seconds, anywhere in the loop
+	 * @param placement From the model to the world
+	 * @param palette Set to bones_count transforms, from the model in the rest
+	 *                pose to the world in this one
+	 */
+	float loop_time = clip->duration > 0.0f ? fmodf(time, clip->duration) : 0.0f;
+	if (loop_time < 0.0f) {
+		loop_time += clip->duration;
+	}
+
+	// Down the hierarchy from the roots, which are placed in the world
+	Affine2 worlds[SKELETON_MAX_BONES];
+	for (uint32_t bone = 0; bone < skeleton->bones_count; bone++) {
+		SkeletonKey key;
+		skeleton_sample_track(&clip->tracks[bone], clip->duration, loop_time, &key);
+
+		const float position[2] = {
+			skeleton->rest_positions[bone][0] + key.translation[0],
+			skeleton->rest_positions[bone][1] + key.translation[1],
+		};
+		Affine2 local;
+		skeleton_get_local(position, skeleton->rest_rotations[bone] + key.rotation, &local);
+
+		uint32_t parent = skeleton->parents[bone];
+		affine2_mul(&local, parent != SKELETON_NO_PARENT ? &worlds[parent] : placement, &worlds[bone]);
+	}
+
+	// Back to the rest pose, then out to the world
+	affine2_mul_batch(skeleton->inverse_binds, worlds, palette, skeleton->bones_count);
+}
@@ -0,0 +1,325 @@
+/*
+ * Uniform grid of points, rebuilt every frame, for collisions and queries
+ * which would otherwise compare everything with everything.
+ *
+ * spatial_grid_build() is a counting sort of the items by cell, split over
+ * the worker pool.  The items are cut into blocks and each block counts its
+ * items into a histogram of its own, the histograms are turned into where
+ * each block's items for each cell start, and then each block scatters its
+ * items there.  Nothing is shared between the jobs in a pass, so there are no
+ * atomics, and the items of a cell stay in index order, so the results are
+ * the same every run whatever the threads do.
+ *
+ * The queries only look at the cells the radius overlaps, so they're fastest
+ * with the cells about the size of the radius they're used with.
+ */
+
+#include "spatial_grid.h"
+#include "jobs.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Smallest number of items in a block, below which splitting costs more
+#define SPATIAL_GRID_MIN_BLOCK_ITEMS 4096
+// Cells for each job of the passes over the cells
+#define SPATIAL_GRID_CELL_JOB_SIZE 256
+
+void spatial_grid_init(SpatialGrid* grid, const float origin[2], const float size[2], float cell_size, uint32_t capacity) {
+	/*
+	 * Set up an empty grid
+	 *
+	 * @param origin The corner of the area covered with the lowest coordinates
+	 * @param size Of the area covered
+	 * @param cell_size Width and height of each cell
+	 * @param capacity Most items spatial_grid_build() will be given
+	 */
+	memset(grid, 0, sizeof(*grid));
+	grid->origin[0] = origin[0];
+	grid->origin[1] = origin[1];
+	grid->cell_size = cell_size;
+	grid->inv_cell_size = 1.0f / cell_size;
+	grid->width = (uint32_t) ceilf(size[0] / cell_size);
+	grid->height = (uint32_t) ceilf(size[1] / cell_size);
+	grid->width = grid->width > 0 ? grid->width : 1;
+	grid->height = grid->height > 0 ? grid->height : 1;
+	grid->capacity = capacity;
+
+	size_t cells = (size_t) grid->width * grid->height;
+	grid->cell_starts = calloc(cells + 1, sizeof(uint32_t));
+	grid->entries = malloc(sizeof(uint32_t) * (capacity > 0 ? capacity : 1));
+	grid->item_cells = malloc(sizeof(uint32_t) * (capacity > 0 ? capacity : 1));
+	grid->block_counts = malloc(sizeof(uint32_t) * cells * SPATIAL_GRID_MAX_BLOCKS);
+	if (grid->cell_starts == NULL || grid->entries == NULL || grid->item_cells == NULL || grid->block_counts == NULL) {
+		fprintf(stderr, "Failed to allocate a %ux%u spatial grid for %u items\n", grid->width, grid->height, capacity);
+		exit(1);
+	}
+}
+
+void spatial_grid_cleanup(SpatialGrid* grid) {
+	free(grid->cell_starts);
+	free(grid->entries);
+	free(grid->item_cells);
+	free(grid->block_counts);
+	memset(grid, 0, sizeof(*grid));
+}
+
+static uint32_t spatial_grid_clamp_cell(float cell, uint32_t cells) {
+	if (!(cell > 0.0f)) {
+		return 0;
+	}
+	return cell >= (float) cells ? cells - 1 : (uint32_t) cell;
+}
+
+static void spatial_grid_get_cell(const SpatialGrid* grid, float x, float y, uint32_t* cell_x, uint32_t* cell_y) {
+	*cell_x = spatial_grid_clamp_cell((x - grid->origin[0]) * grid->inv_cell_size, grid->width);
+	*cell_y = spatial_grid_clamp_cell((y - grid->origin[1]) * grid->inv_cell_size, grid->height);
+}
+
+static size_t spatial_grid_block_size(const SpatialGrid* grid) {
+	return ((size_t) grid->count + grid->blocks_count - 1) / grid->blocks_count;
+}
+
+static void spatial_grid_count_job(size_t start, size_t end, void* data) {
+	/*
+	 * Work out the cells of the items in blocks [start, end), and count them
+	 * into their blocks' histograms
+	 */
+	SpatialGrid* grid = data;
+	size_t cells = (size_t) grid->width * grid->height;
+	size_t block_size = spatial_grid_block_size(grid);
+
+	for (size_t block = start; block < end; block++) {
+		uint32_t* counts = &grid->block_counts[block * cells];
+		memset(counts, 0, sizeof(uint32_t) * cells);
+
+		size_t last = (block + 1) * block_size < grid->count ? (block + 1) * block_size : grid->count;
+		for (size_t i = block * block_size; i < last; i++) {
+			uint32_t cell_x;
+			uint32_t cell_y;
+			spatial_grid_get_cell(grid, grid->x[i], grid->y[i], &cell_x, &cell_y);
+			uint32_t cell = cell_x + cell_y * grid->width;
+			grid->item_cells[i] = cell;
+			counts[cell]++;
+		}
+	}
+}
+
+static void spatial_grid_offsets_job(size_t start, size_t end, void* data) {
+	/*
+	 * Turn the blocks' counts for cells [start, end) into where in the cell
+	 * each block's items start, and total the cells in cell_starts
+	 */
+	SpatialGrid* grid = data;
+	size_t cells = (size_t) grid->width * grid->height;
+
+	for (size_t cell = start; cell < end; cell++) {
+		uint32_t total = 0;
+		for (uint32_t block = 0; block < grid->blocks_count; block++) {
+			uint32_t* count = &grid->block_counts[block * cells + cell];
+			uint32_t block_total = *count;
+			*count = total;
+			total += block_total;
+		}
+		grid->cell_starts[cell] = total;
+	}
+}
+
+static void spatial_grid_scatter_job(size_t start, size_t end, void* data) {
+	/*
+	 * Put the items in blocks [start, end) in their places in entries
+	 */
+	SpatialGrid* grid = data;
+	size_t cells = (size_t) grid->width * grid->height;
+	size_t block_size = spatial_grid_block_size(grid);
+
+	for (size_t block = start; block < end; block++) {
+		uint32_t* offsets = &grid->block_counts[block * cells];
+
+		size_t last = (block + 1) * block_size < grid->count ? (block + 1) * block_size : grid->count;
+		for (size_t i = block * block_size; i < last; i++) {
+			uint32_t cell = grid->item_cells[i];
+			grid->entries[grid->cell_starts[cell] + offsets[cell]++] = (uint32_t) i;
+		}
+	}
+}
+
+void spatial_grid_build(SpatialGrid* grid, const float* x, const float* y, uint32_t count) {
+	/*
+	 * Sort a set of points into the grid, replacing the last ones.  The arrays
+	 * are read by the queries, so they have to stay put until the next build
+	 *
+	 * @param x Array of count x coordinates
+	 * @param y Array of count y coordinates
+	 * @param count At most the grid's capacity
+	 */
+	if (count > grid->capacity) {
+		fprintf(stderr, "Too many items for the spatial grid (%u, it has room for %u)\n", count, grid->capacity);
+		exit(1);
+	}
+
+	size_t cells = (size_t) grid->width * grid->height;
+	grid->x = x;
+	grid->y = y;
+	grid->count = count;
+
+	uint32_t blocks = (count + SPATIAL_GRID_MIN_BLOCK_ITEMS - 1) / SPATIAL_GRID_MIN_BLOCK_ITEMS;
+	uint32_t max_blocks = jobs_get_num_workers() + 1;
+	max_blocks = max_blocks < SPATIAL_GRID_MAX_BLOCKS ? max_blocks : SPATIAL_GRID_MAX_BLOCKS;
+	blocks = blocks < max_blocks ? blocks : max_blocks;
+	grid->blocks_count = blocks > 0 ? blocks : 1;
+
+	jobs_parallel_for(grid->blocks_count, 1, spatial_grid_count_job, grid);
+	jobs_parallel_for(cells, SPATIAL_GRID_CELL_JOB_SIZE, spatial_grid_offsets_job, grid);
+
+	// The cells' totals into where they start
+	uint32_t start = 0;
+	for (size_t cell = 0; cell < cells; cell++) {
+		uint32_t total = grid->cell_starts[cell];
+		grid->cell_starts[cell] = start;
+		start += total;
+	}
+	grid->cell_starts[cells] = start;
+
+	jobs_parallel_for(grid->blocks_count, 1, spatial_grid_scatter_job, grid);
+}
+
+uint32_t spatial_grid_query_radius(const SpatialGrid* grid, float x, float y, float radius, uint32_t* results, uint32_t max_results) {
+	/*
+	 * Find the items within a radius of a point, in cell order
+	 *
+	 * @param results Filled in with the items' indices
+	 * @param max_results Past this many the rest are left out
+	 *
+	 * @return The number of them in results
+	 */
+	uint32_t min_x, min_y, max_x, max_y;
+	spatial_grid_get_cell(grid, x - radius, y - radius, &min_x, &min_y);
+	spatial_grid_get_cell(grid, x + radius, y + radius, &max_x, &max_y);
+
+	float radius2 = radius * radius;
+	uint32_t results_count = 0;
+	for (uint32_t cell_y = min_y; cell_y <= max_y; cell_y++) {
+		for (uint32_t cell_x = min_x; cell_x <= max_x; cell_x++) {
+			uint32_t cell = cell_x + cell_y * grid->width;
+			for (uint32_t e = grid->cell_starts[cell]; e < grid->cell_starts[cell + 1]; e++) {
+				uint32_t i = grid->entries[e];
+				float dx = grid->x[i] - x;
+				float dy = grid->y[i] - y;
+				if (dx * dx + dy * dy > radius2) {
+					continue;
+				}
+				if (results_count == max_results) {
+					return results_count;
+				}
+				results[results_count++] = i;
+			}
+		}
+	}
+	return results_count;
+}
+
+uint32_t spatial_grid_nearest(const SpatialGrid* grid, float x, float y, float max_radius) {
+	/*
+	 * Find the item closest to a point, e.g. to pick one with the mouse
+	 *
+	 * @return Its index, or SPATIAL_GRID_NONE if there are none within max_radius
+	 */
+	uint32_t min_x, min_y, max_x, max_y;
+	spatial_grid_get_cell(grid, x - max_radius, y - max_radius, &min_x, &min_y);
+	spatial_grid_get_cell(grid, x + max_radius, y + max_radius, &max_x, &max_y);
+
+	float nearest2 = max_radius * max_radius;
+	uint32_t nearest = SPATIAL_GRID_NONE;
+	for (uint32_t cell_y = min_y; cell_y <= max_y; cell_y++) {
+		for (uint32_t cell_x = min_x; cell_x <= max_x; cell_x++) {
+			uint32_t cell = cell_x + cell_y * grid->width;
+			for (uint32_t e = grid->cell_starts[cell]; e < grid->cell_starts[cell + 1]; e++) {
+				uint32_t i = grid->entries[e];
+				float dx = grid->x[i] - x;
+				float dy = grid->y[i] - y;
+				float distance2 = dx * dx + dy * dy;
+				if (distance2 <= nearest2) {
+					nearest2 = distance2;
+					nearest = i;
+				}
+			}
+		}
+	}
+	return nearest;
+}
+
+typedef struct {
+	const SpatialGrid* grid;
+	float radius2;
+	// Cells either side to look at, enough to cover the radius
+	uint32_t reach;
+	SpatialGridPairFunc func;
+	void* data;
+} SpatialGridPairsJob;
+
+static void spatial_grid_pair_cells(const SpatialGridPairsJob* job, uint32_t cell, uint32_t other) {
+	/*
+	 * Report the close pairs between two cells, or within one if they're the
+	 * same
+	 */
+	const SpatialGrid* grid = job->grid;
+	uint32_t end = grid->cell_starts[cell + 1];
+	uint32_t other_end = grid->cell_starts[other + 1];
+
+	for (uint32_t e = grid->cell_starts[cell]; e < end; e++) {
+		uint32_t i = grid->entries[e];
+		uint32_t f = cell == other ? e + 1 : grid->cell_starts[other];
+		for (; f < other_end; f++) {
+			uint32_t j = grid->entries[f];
+			float dx = grid->x[i] - grid->x[j];
+			float dy = grid->y[i] - grid->y[j];
+			if (dx * dx + dy * dy <= job->radius2) {
+				job->func(i < j ? i : j, i < j ? j : i, job->data);
+			}
+		}
+	}
+}
+
+static void spatial_grid_pairs_job(size_t start, size_t end, void* data) {
+	const SpatialGridPairsJob* job = data;
+	const SpatialGrid* grid = job->grid;
+	int reach = (int) job->reach;
+
+	for (size_t cell = start; cell < end; cell++) {
+		int cell_x = (int) (cell % grid->width);
+		int cell_y = (int) (cell / grid->width);
+
+		// Only the cells after this one, so each pair of cells is done once
+		for (int dy = 0; dy <= reach; dy++) {
+			for (int dx = dy == 0 ? 0 : -reach; dx <= reach; dx++) {
+				int other_x = cell_x + dx;
+				int other_y = cell_y + dy;
+				if (other_x < 0 || other_x >= (int) grid->width || other_y >= (int) grid->height) {
+					continue;
+				}
+				spatial_grid_pair_cells(job, (uint32_t) cell, (uint32_t) (other_x + other_y * (int) grid->width));
+			}
+		}
+	}
+}
+
+void spatial_grid_find_pairs(const SpatialGrid* grid, float radius, SpatialGridPairFunc func, void* data) {
+	/*
+	 * Find every pair of items within a radius of each other, for broadphase
+	 * collision.  Split over the worker pool by cell
+	 *
+	 * @param func Called with each pair, see SpatialGridPairFunc
+	 */
+	SpatialGridPairsJob job = {
+		.grid = grid,
+		.radius2 = radius * radius,
+		.reach = (uint32_t) ceilf(radius * grid->inv_cell_size),
+		.func = func,
+		.data = data,
+	};
+	jobs_parallel_for((size_t) grid->width * grid->height, SPATIAL_GRID_CELL_JOB_SIZE, spatial_grid_pairs_job, &job);
+}
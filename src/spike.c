@@ -0,0 +1,162 @@
+/*
+ * Frame time spike detection, which writes a trace of the frames around each
+ * spike.
+ *
+ * The rare hitches (a swap chain being recreated, a big upload, a pipeline
+ * compiled on the spot) don't show up in an average over a second, and by the
+ * time anyone presses F9 the zones of the frame have long been overwritten.
+ * So the main thread hands over the end of every frame, and the last
+ * SPIKE_HISTORY_FRAMES frame times are kept in a ring.  A frame which takes
+ * longer than the threshold, or than a multiple of the median of the ring, is
+ * a spike.  SPIKE_FRAMES_AFTER frames later the trace's zones and counters
+ * from SPIKE_FRAMES_BEFORE frames before it up to then are written out with
+ * trace_write_window(), which leaves everything in place for F9.
+ *
+ * The trace's rings are what's written, so they have to be big enough for
+ * the window (TRACE_EVENTS_PER_THREAD zones is a few hundred frames of the
+ * main thread's).  Writing has to happen when nothing else is recording,
+ * which is up to the caller, see spike_write_trace().
+ */
+
+#include "spike.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+_Static_assert(SPIKE_FRAMES_BEFORE < SPIKE_HISTORY_FRAMES, "The frames before a spike have to be in the history");
+
+static SpikeDesc spike_desc = {0};
+static bool spike_running = false;
+
+// Ring of the frames' times and when they started, frames_count is the total
+static double frame_times_ms[SPIKE_HISTORY_FRAMES] = {0};
+static uint64_t frame_starts_ns[SPIKE_HISTORY_FRAMES] = {0};
+static uint64_t frames_count = 0;
+// When the last frame ended, or 0 if the time until the next one isn't a
+// frame's
+static uint64_t last_frame_ns = 0;
+
+// A spike waiting for the frames after it
+static bool spike_pending = false;
+static uint32_t frames_left = 0;
+static double spike_ms = 0.0;
+static double spike_median_ms = 0.0;
+static uint64_t window_start_ns = 0;
+static uint64_t window_end_ns = 0;
+static uint32_t traces_written = 0;
+
+void spike_start(const SpikeDesc* desc) {
+	/*
+	 * Start looking for spikes in the frames from now on.  The trace has to
+	 * have been initialised
+	 */
+	spike_desc = *desc;
+	spike_running = true;
+	frames_count = 0;
+	last_frame_ns = 0;
+	spike_pending = false;
+	traces_written = 0;
+}
+
+void spike_stop(void) {
+	spike_running = false;
+}
+
+static int spike_compare_ms(const void* a, const void* b) {
+	double x = *(const double*) a;
+	double y = *(const double*) b;
+	return (x > y) - (x < y);
+}
+
+static double spike_get_median_ms(void) {
+	// Sorting a copy of a few hundred is quick next to a frame
+	double sorted[SPIKE_HISTORY_FRAMES];
+	memcpy(sorted, frame_times_ms, sizeof(sorted));
+	qsort(sorted, SPIKE_HISTORY_FRAMES, sizeof(double), spike_compare_ms);
+	return sorted[SPIKE_HISTORY_FRAMES / 2];
+}
+
+bool spike_end_frame(uint64_t now_ns) {
+	/*
+	 * Add the frame which ended now, from the main thread
+	 *
+	 * @param now_ns From SDL_GetTicksNS()
+	 *
+	 * @return Whether a spike's frames are all in, to write with
+	 *         spike_write_trace()
+	 */
+	if (!spike_running) {
+		return false;
+	}
+	if (last_frame_ns == 0) {
+		last_frame_ns = now_ns;
+		return false;
+	}
+
+	uint64_t start_ns = last_frame_ns;
+	double ms = (double) (now_ns - start_ns) / 1000000.0;
+	last_frame_ns = now_ns;
+
+	if (spike_pending) {
+		frames_left--;
+	}
+	else if (frames_count >= SPIKE_HISTORY_FRAMES && traces_written < spike_desc.max_traces) {
+		double median_ms = spike_get_median_ms();
+		bool over_threshold = spike_desc.threshold_ms > 0.0 && ms > spike_desc.threshold_ms;
+		bool over_median = spike_desc.median_multiple > 0.0 && ms > median_ms * spike_desc.median_multiple;
+
+		if (over_threshold || over_median) {
+			spike_pending = true;
+			frames_left = SPIKE_FRAMES_AFTER;
+			spike_ms = ms;
+			spike_median_ms = median_ms;
+			window_start_ns = frame_starts_ns[(frames_count - SPIKE_FRAMES_BEFORE) % SPIKE_HISTORY_FRAMES];
+		}
+	}
+
+	frame_times_ms[frames_count % SPIKE_HISTORY_FRAMES] = ms;
+	frame_starts_ns[frames_count % SPIKE_HISTORY_FRAMES] = start_ns;
+	frames_count++;
+
+	if (spike_pending && frames_left == 0) {
+		window_end_ns = now_ns;
+		return true;
+	}
+	return false;
+}
+
+void spike_skip_frame(void) {
+	/*
+	 * Leave the time until the next frame ends out, e.g. when the main loop
+	 * slept instead of making a frame
+	 */
+	last_frame_ns = 0;
+}
+
+bool spike_write_trace(void) {
+	/*
+	 * Write the trace of the last spike, once spike_end_frame() says its
+	 * frames are in.  Like trace_write(), no other thread can be recording
+	 *
+	 * @return false if there's no spike or it couldn't be written
+	 */
+	if (!spike_pending) {
+		return false;
+	}
+	spike_pending = false;
+	traces_written++;
+
+	char filename[256];
+	snprintf(filename, sizeof(filename), spike_desc.filename_format, traces_written);
+	bool written = trace_write_window(filename, window_start_ns, window_end_ns);
+	if (written) {
+		printf("A frame took %.2f ms (the median is %.2f ms), wrote the %d frames around it to %s\n",
+			spike_ms, spike_median_ms, SPIKE_FRAMES_BEFORE + 1 + SPIKE_FRAMES_AFTER, filename);
+	}
+
+	// Writing it took long enough to look like a spike itself
+	last_frame_ns = 0;
+	return written;
+}
@@ -0,0 +1,340 @@
+/*
+ * Immediate mode sprites, which game code draws every frame without any
+ * Vulkan.
+ *
+ * Between sprite_batch_begin() and sprite_batch_end(), sprite_draw() from any
+ * thread adds a sprite to the batch, and shape_draw() a shape, which goes in
+ * the same batch so the two sort and draw together.  Each thread fills chunks of
+ * SPRITE_BATCH_CHUNK sprites of its own, claimed with an atomic add, so
+ * drawing takes one atomic a chunk and never a lock (the batch is a fixed
+ * size, and what doesn't fit is dropped and counted).  A thread's current
+ * chunk is thread local, and is left behind when the next batch begins.
+ *
+ * Nothing a drawing thread writes shares a cache line with another's: the
+ * chunks and their counts are each aligned to a line, and the thread keeps
+ * pointers to its own in the cursor, so sprite_draw() only touches the batch
+ * itself when it claims a chunk.  The only shared write is the claim, so it
+ * scales with the threads however many there are.
+ *
+ * The renderer reads the finished batch: the chunks up to chunks_count, each
+ * with chunk_counts of its sprites.  It sorts them into as few draws as the
+ * pipelines allow and copies them into the frame ring, see
+ * queue_batched_sprites() in main.c.  Begin and end are on the thread which
+ * hands out the drawing to the others (e.g. with jobs_parallel_for()), so
+ * everything they drew is visible once it's back.
+ *
+ * Each item's bounds go in arrays of their own as it's drawn, so that
+ * sprite_batch_cull() can check a chunk of them against the view in one
+ * branchless loop, which the compiler vectorises.  The renderer then leaves
+ * out what's off screen before anything is sorted or copied.
+ */
+
+#include "sprite_batch.h"
+#include "jobs.h"
+
+#include <SDL3/SDL.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+	// The batch begun when the chunk was claimed
+	uint32_t generation;
+	SpriteBatchItem* items;
+	uint32_t* count;
+	uint32_t used;
+	// The chunk's bounds
+	float* min_x;
+	float* min_y;
+	float* max_x;
+	float* max_y;
+} SpriteBatchCursor;
+
+typedef struct {
+	const SpriteBatch* batch;
+	const float* rect;
+	uint8_t* visible;
+} SpriteBatchCullJob;
+
+static SpriteBatch* current_batch = NULL;
+// Goes up with every sprite_batch_begin(), so the threads' chunks from the last
+// batch aren't used again
+static uint32_t current_generation = 0;
+
+static _Thread_local SpriteBatchCursor cursor = {0};
+// Only say the first time a batch overflows, rather than every frame
+static bool warned_full = false;
+
+void sprite_batch_init(SpriteBatch* batch, uint32_t capacity) {
+	/*
+	 * Allocate a batch for up to capacity sprites (rounded up to whole chunks)
+	 */
+	uint32_t chunks = (capacity + SPRITE_BATCH_CHUNK - 1) / SPRITE_BATCH_CHUNK;
+	memset(batch, 0, sizeof(*batch));
+	batch->capacity = chunks * SPRITE_BATCH_CHUNK;
+	batch->items = SDL_aligned_alloc(SPRITE_BATCH_CACHE_LINE, sizeof(SpriteBatchItem) * batch->capacity);
+	batch->chunk_counts = SDL_aligned_alloc(SPRITE_BATCH_CACHE_LINE, sizeof(SpriteBatchChunkCount) * chunks);
+	// A chunk of each is a whole number of cache lines too
+	batch->min_x = SDL_aligned_alloc(SPRITE_BATCH_CACHE_LINE, sizeof(float) * batch->capacity);
+	batch->min_y = SDL_aligned_alloc(SPRITE_BATCH_CACHE_LINE, sizeof(float) * batch->capacity);
+	batch->max_x = SDL_aligned_alloc(SPRITE_BATCH_CACHE_LINE, sizeof(float) * batch->capacity);
+	batch->max_y = SDL_aligned_alloc(SPRITE_BATCH_CACHE_LINE, sizeof(float) * batch->capacity);
+	if (batch->items == NULL || batch->chunk_counts == NULL || batch->min_x == NULL || batch->min_y == NULL
+			|| batch->max_x == NULL || batch->max_y == NULL) {
+		fprintf(stderr, "Failed to allocate a sprite batch of %u sprites\n", batch->capacity);
+		exit(1);
+	}
+	memset(batch->chunk_counts, 0, sizeof(SpriteBatchChunkCount) * chunks);
+}
+
+void sprite_batch_cleanup(SpriteBatch* batch) {
+	SDL_aligned_free(batch->items);
+	SDL_aligned_free(batch->chunk_counts);
+	SDL_aligned_free(batch->min_x);
+	SDL_aligned_free(batch->min_y);
+	SDL_aligned_free(batch->max_x);
+	SDL_aligned_free(batch->max_y);
+	memset(batch, 0, sizeof(*batch));
+}
+
+void sprite_batch_swap(SpriteBatch* a, SpriteBatch* b) {
+	/*
+	 * Swap two batches' sprites, e.g. to hand a finished one to the renderer
+	 * without copying it.  Neither can be being drawn to
+	 */
+	SpriteBatch swapped = *a;
+	*a = *b;
+	*b = swapped;
+}
+
+void sprite_batch_begin(SpriteBatch* batch) {
+	/*
+	 * Empty the batch and send the sprite_draw() calls to it
+	 */
+	SDL_SetAtomicInt(&batch->chunks_reserved, 0);
+	SDL_SetAtomicInt(&batch->dropped, 0);
+	batch->chunks_count = 0;
+	batch->count = 0;
+
+	current_generation++;
+	current_batch = batch;
+}
+
+static SpriteBatchItem* sprite_batch_claim(void) {
+	/*
+	 * Get the next item of this thread's chunk, claiming another when it's
+	 * full.  NULL outside a batch or when the batch is full
+	 */
+	SpriteBatch* batch = current_batch;
+	if (batch == NULL) {
+		return NULL;
+	}
+
+	if (cursor.generation != current_generation || cursor.used == SPRITE_BATCH_CHUNK) {
+		uint32_t chunk = (uint32_t) SDL_AddAtomicInt(&batch->chunks_reserved, 1);
+		cursor.generation = current_generation;
+		if (chunk >= batch->capacity / SPRITE_BATCH_CHUNK) {
+			// Full, so this thread tries again for the next sprite
+			cursor.used = SPRITE_BATCH_CHUNK;
+			SDL_AddAtomicInt(&batch->dropped, 1);
+			return NULL;
+		}
+		cursor.items = &batch->items[chunk * SPRITE_BATCH_CHUNK];
+		cursor.count = &batch->chunk_counts[chunk].count;
+		cursor.min_x = &batch->min_x[chunk * SPRITE_BATCH_CHUNK];
+		cursor.min_y = &batch->min_y[chunk * SPRITE_BATCH_CHUNK];
+		cursor.max_x = &batch->max_x[chunk * SPRITE_BATCH_CHUNK];
+		cursor.max_y = &batch->max_y[chunk * SPRITE_BATCH_CHUNK];
+		cursor.used = 0;
+	}
+
+	return &cursor.items[cursor.used++];
+}
+
+static void sprite_batch_finish_item(const SpriteBatchItem* item) {
+	/*
+	 * Write the bounds of the item just claimed and filled in, and count it
+	 */
+	float half_width = fabsf(item->size[0]) * 0.5f;
+	float half_height = fabsf(item->size[1]) * 0.5f;
+	// However it's turned it's inside the circle through its corners
+	if (item->rotation != 0.0f) {
+		half_width = sqrtf(half_width * half_width + half_height * half_height);
+		half_height = half_width;
+	}
+	// A shape's softness goes outside it
+	if ((item->texture & SPRITE_BATCH_SHAPE) != 0) {
+		half_width += item->uv2[0];
+		half_height += item->uv2[0];
+	}
+
+	uint32_t i = cursor.used - 1;
+	cursor.min_x[i] = item->pos[0] - half_width;
+	cursor.min_y[i] = item->pos[1] - half_height;
+	cursor.max_x[i] = item->pos[0] + half_width;
+	cursor.max_y[i] = item->pos[1] + half_height;
+
+	// Only this thread writes its chunks' counts
+	*cursor.count = cursor.used;
+}
+
+void sprite_draw(uint32_t texture, const float src_rect[4], const float dst[4], float rotation, uint32_t color, float z) {
+	/*
+	 * Draw a sprite this frame.  Does nothing outside a batch
+	 *
+	 * @param texture The texture to draw from
+	 * @param src_rect The part of it to draw, x, y, width and height in its
+	 *                 texture coordinates, or NULL for all of it
+	 * @param dst Where to draw it in world space, x and y of the corner with
+	 *            the lowest coordinates then width and height
+	 * @param rotation Around the centre of dst, in radians
+	 * @param color Multiplies the texture, SPRITE_RGBA().  Sprites which
+	 *              aren't fully opaque are blended, the rest are alpha tested
+	 * @param z Depth, larger is further away
+	 */
+	SpriteBatchItem* item = sprite_batch_claim();
+	if (item == NULL) {
+		return;
+	}
+
+	item->pos[0] = dst[0] + dst[2] * 0.5f;
+	item->pos[1] = dst[1] + dst[3] * 0.5f;
+	item->size[0] = dst[2];
+	item->size[1] = dst[3];
+	if (src_rect != NULL) {
+		item->uv[0] = src_rect[0];
+		item->uv[1] = src_rect[1];
+		item->uv2[0] = src_rect[0] + src_rect[2];
+		item->uv2[1] = src_rect[1] + src_rect[3];
+	}
+	else {
+		item->uv[0] = 0.0f;
+		item->uv[1] = 0.0f;
+		item->uv2[0] = 1.0f;
+		item->uv2[1] = 1.0f;
+	}
+	item->rotation = rotation;
+	item->z = z;
+	item->texture = texture;
+	item->color = color;
+	item->outline_color = 0;
+
+	sprite_batch_finish_item(item);
+}
+
+void shape_draw(ShapeKind kind, const float dst[4], float rotation, const ShapeStyle* style, float z) {
+	/*
+	 * Draw a shape this frame, which is blended like a translucent sprite.
+	 * Does nothing outside a batch
+	 *
+	 * @param dst Where to draw it in world space, as sprite_draw()'s.  The
+	 *            softness goes outside it
+	 * @param rotation Around the centre of dst, in radians
+	 * @param z Depth, larger is further away.  Shapes at the same depth are
+	 *          drawn together, in one draw
+	 */
+	SpriteBatchItem* item = sprite_batch_claim();
+	if (item == NULL) {
+		return;
+	}
+
+	item->pos[0] = dst[0] + dst[2] * 0.5f;
+	item->pos[1] = dst[1] + dst[3] * 0.5f;
+	item->size[0] = dst[2];
+	item->size[1] = dst[3];
+	item->uv[0] = style->corner_radius;
+	item->uv[1] = style->outline_width;
+	item->uv2[0] = style->softness;
+	item->uv2[1] = 0.0f;
+	item->rotation = rotation;
+	item->z = z;
+	item->texture = SPRITE_BATCH_SHAPE | (uint32_t) kind;
+	item->color = style->fill_color;
+	item->outline_color = style->outline_color;
+
+	sprite_batch_finish_item(item);
+}
+
+void sprite_batch_draw_item(const SpriteBatchItem* item) {
+	/*
+	 * Draw a sprite or shape as another batch has it, e.g. one which came from
+	 * another renderer.  Does nothing outside a batch
+	 */
+	SpriteBatchItem* claimed = sprite_batch_claim();
+	if (claimed == NULL) {
+		return;
+	}
+
+	*claimed = *item;
+	sprite_batch_finish_item(claimed);
+}
+
+void sprite_batch_end(void) {
+	/*
+	 * Finish the batch, after which sprite_draw() does nothing until the next
+	 * one begins.  The threads drawing to it have to have finished
+	 */
+	SpriteBatch* batch = current_batch;
+	if (batch == NULL) {
+		return;
+	}
+	current_batch = NULL;
+
+	uint32_t chunks = (uint32_t) SDL_GetAtomicInt(&batch->chunks_reserved);
+	uint32_t max_chunks = batch->capacity / SPRITE_BATCH_CHUNK;
+	batch->chunks_count = chunks < max_chunks ? chunks : max_chunks;
+
+	batch->count = 0;
+	for (uint32_t i = 0; i < batch->chunks_count; i++) {
+		batch->count += batch->chunk_counts[i].count;
+	}
+
+	int dropped = SDL_GetAtomicInt(&batch->dropped);
+	if (dropped > 0 && !warned_full) {
+		warned_full = true;
+		printf("The sprite batch is full (%u sprites), %d were dropped\n", batch->capacity, dropped);
+	}
+}
+
+static void sprite_batch_cull_chunks(size_t start, size_t end, void* data) {
+	SpriteBatchCullJob* job = data;
+	const SpriteBatch* batch = job->batch;
+	float rect_min_x = job->rect[0];
+	float rect_min_y = job->rect[1];
+	float rect_max_x = job->rect[2];
+	float rect_max_y = job->rect[3];
+
+	for (size_t chunk = start; chunk < end; chunk++) {
+		size_t first = chunk * SPRITE_BATCH_CHUNK;
+		size_t count = batch->chunk_counts[chunk].count;
+		const float* min_x = &batch->min_x[first];
+		const float* min_y = &batch->min_y[first];
+		const float* max_x = &batch->max_x[first];
+		const float* max_y = &batch->max_y[first];
+		uint8_t* visible = &job->visible[first];
+
+		// & rather than &&, which would branch
+		for (size_t i = 0; i < count; i++) {
+			visible[i] = (uint8_t) ((max_x[i] >= rect_min_x) & (min_x[i] <= rect_max_x)
+				& (max_y[i] >= rect_min_y) & (min_y[i] <= rect_max_y));
+		}
+	}
+}
+
+void sprite_batch_cull(const SpriteBatch* batch, const float rect[4], uint8_t* visible) {
+	/*
+	 * Find which of a finished batch's items overlap a rectangle, e.g. what
+	 * the cameras can see, on the worker pool
+	 *
+	 * @param rect Min x, min y, max x and max y in world space
+	 * @param visible Set to 1 for the items which do and 0 for the rest, with
+	 *                the same indices as the items
+	 */
+	SpriteBatchCullJob job = {0};
+	job.batch = batch;
+	job.rect = rect;
+	job.visible = visible;
+	jobs_parallel_for(batch->chunks_count, 4, sprite_batch_cull_chunks, &job);
+}
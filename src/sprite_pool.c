@@ -0,0 +1,180 @@
+/*
+ * Retained sprites: slots with stable handles, which only need uploading when
+ * they change.
+ *
+ * The pool only keeps track of the slots.  Whoever uses it keeps the sprites'
+ * data in arrays indexed by sprite_pool_get_index() (and the same layout on
+ * the GPU), and marks a slot dirty whenever its data changes.  Removed slots
+ * go on a free list and are reused first, so the slots in use stay packed at
+ * the start and the draw covers slots_count of them (removed ones should be
+ * left as something which draws nothing).
+ *
+ * Each frame sprite_pool_take_dirty_ranges() turns the dirty bits into ranges
+ * of slots to copy, merging ones with small gaps between them, as a copy
+ * costs more than a few extra sprites in it.  Clean words of the bit array are
+ * skipped 64 slots at a time, so a static scene costs next to nothing.
+ */
+
+#include "sprite_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void sprite_pool_init(SpritePool* pool, uint32_t capacity) {
+	if (capacity > SPRITE_POOL_MAX_SPRITES) {
+		fprintf(stderr, "Sprite pools can't have more than %u sprites\n", SPRITE_POOL_MAX_SPRITES);
+		exit(1);
+	}
+
+	uint32_t words = (capacity + 63) / 64;
+	memset(pool, 0, sizeof(*pool));
+	pool->capacity = capacity;
+	pool->generations = calloc(capacity, sizeof(uint8_t));
+	pool->live = calloc(words, sizeof(uint64_t));
+	pool->dirty = calloc(words, sizeof(uint64_t));
+	pool->free_slots = malloc(sizeof(uint32_t) * capacity);
+	if (pool->generations == NULL || pool->live == NULL || pool->dirty == NULL || pool->free_slots == NULL) {
+		fprintf(stderr, "Failed to allocate a sprite pool of %u sprites\n", capacity);
+		exit(1);
+	}
+}
+
+void sprite_pool_cleanup(SpritePool* pool) {
+	free(pool->generations);
+	free(pool->live);
+	free(pool->dirty);
+	free(pool->free_slots);
+	memset(pool, 0, sizeof(*pool));
+}
+
+static void sprite_pool_set_dirty(SpritePool* pool, uint32_t index) {
+	pool->dirty[index / 64] |= 1ull << (index % 64);
+}
+
+SpriteHandle sprite_pool_add(SpritePool* pool) {
+	/*
+	 * Take a slot, which starts out dirty
+	 *
+	 * @return Its handle, or SPRITE_POOL_NO_HANDLE if the pool is full
+	 */
+	uint32_t index;
+	if (pool->free_count > 0) {
+		index = pool->free_slots[--pool->free_count];
+	}
+	else if (pool->slots_count < pool->capacity) {
+		index = pool->slots_count++;
+	}
+	else {
+		return SPRITE_POOL_NO_HANDLE;
+	}
+
+	pool->live[index / 64] |= 1ull << (index % 64);
+	pool->live_count++;
+	sprite_pool_set_dirty(pool, index);
+	return (SpriteHandle) pool->generations[index] << SPRITE_POOL_INDEX_BITS | index;
+}
+
+void sprite_pool_remove(SpritePool* pool, SpriteHandle handle) {
+	/*
+	 * Free a slot, which is dirty so that whatever it's left as is uploaded.
+	 * Its handle is no longer valid
+	 */
+	if (!sprite_pool_is_valid(pool, handle)) {
+		return;
+	}
+
+	uint32_t index = sprite_pool_get_index(handle);
+	pool->live[index / 64] &= ~(1ull << (index % 64));
+	pool->live_count--;
+	pool->generations[index]++;
+	pool->free_slots[pool->free_count++] = index;
+	sprite_pool_set_dirty(pool, index);
+}
+
+bool sprite_pool_is_valid(const SpritePool* pool, SpriteHandle handle) {
+	uint32_t index = sprite_pool_get_index(handle);
+	return handle != SPRITE_POOL_NO_HANDLE
+		&& index < pool->slots_count
+		&& (pool->live[index / 64] & (1ull << (index % 64))) != 0
+		&& pool->generations[index] == handle >> SPRITE_POOL_INDEX_BITS;
+}
+
+uint32_t sprite_pool_get_index(SpriteHandle handle) {
+	return handle & SPRITE_POOL_INDEX_MASK;
+}
+
+void sprite_pool_mark_dirty(SpritePool* pool, SpriteHandle handle) {
+	if (sprite_pool_is_valid(pool, handle)) {
+		sprite_pool_set_dirty(pool, sprite_pool_get_index(handle));
+	}
+}
+
+void sprite_pool_mark_all_dirty(SpritePool* pool) {
+	/*
+	 * Mark every slot ever used as dirty, e.g. when an upload was lost
+	 */
+	for (uint32_t i = 0; i < pool->slots_count; i += 64) {
+		uint32_t remaining = pool->slots_count - i;
+		pool->dirty[i / 64] = remaining >= 64 ? ~0ull : (1ull << remaining) - 1;
+	}
+}
+
+bool sprite_pool_is_dirty(const SpritePool* pool) {
+	/*
+	 * Check whether any slot has changed since the last
+	 * sprite_pool_take_dirty_ranges()
+	 */
+	for (uint32_t i = 0; i < pool->slots_count; i += 64) {
+		if (pool->dirty[i / 64] != 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+uint32_t sprite_pool_take_dirty_ranges(SpritePool* pool, SpritePoolRange* ranges, uint32_t max_ranges, uint32_t max_gap) {
+	/*
+	 * Get the slots which have changed as ranges in order, and clear them
+	 *
+	 * @param ranges Filled in with the ranges
+	 * @param max_ranges At least 1.  Past this many the last range is grown to
+	 *                   cover the rest, so nothing is left out
+	 * @param max_gap Ranges with this many clean slots or fewer between them
+	 *                are merged
+	 *
+	 * @return The number of ranges
+	 */
+	uint32_t ranges_count = 0;
+	uint32_t words = (pool->slots_count + 63) / 64;
+
+	for (uint32_t word = 0; word < words; word++) {
+		uint64_t bits = pool->dirty[word];
+		if (bits == 0) {
+			continue;
+		}
+		pool->dirty[word] = 0;
+
+		for (uint32_t bit = 0; bit < 64 && bits != 0; bit++, bits >>= 1) {
+			if ((bits & 1) == 0) {
+				continue;
+			}
+
+			uint32_t index = word * 64 + bit;
+			if (ranges_count > 0) {
+				SpritePoolRange* last = &ranges[ranges_count - 1];
+				uint32_t end = last->first + last->count;
+				if (index <= end + max_gap || ranges_count == max_ranges) {
+					last->count = index + 1 - last->first;
+					continue;
+				}
+			}
+
+			ranges[ranges_count].first = index;
+			ranges[ranges_count].count = 1;
+			ranges_count++;
+		}
+	}
+
+	return ranges_count;
+}
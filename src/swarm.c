@@ -0,0 +1,329 @@
+/*
+ * Boids: agents which steer away from the neighbours they're too close to,
+ * along with the rest, towards the middle of them, and away from solid
+ * tiles, so a swarm moves as a flock rather than each agent on its own.
+ *
+ * The neighbours come from a SpatialGrid of the agents' positions, so each
+ * agent only looks at the cells around it rather than at every other one.
+ * swarm_steer() first copies the positions and speeds into the grid's order,
+ * so the agents of a cell are next to each other, and then each job steers a
+ * run of agents in that order, so the cells they look at are mostly the same
+ * ones as the agent before.  A row of cells is one run of the copies, which
+ * is summed SWARM_LANES agents at a time into separate sums, without branches,
+ * which the compiler can do with SIMD without reordering any float maths.  The
+ * speeds are only read from the copies, so each job can write them back
+ * straight away.
+ *
+ * Each agent looks at no more than max_neighbours others, the rows nearest it
+ * first, so however crowded the swarm gets each step is at most that many
+ * times the number of agents.
+ */
+
+#include "swarm.h"
+#include "jobs.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Agents for each job
+#define SWARM_JOB_SIZE 1024
+#define SWARM_MAX_ROWS (2 * SWARM_MAX_REACH + 1)
+
+typedef struct {
+	Swarm* swarm;
+	const SpatialGrid* grid;
+	const SwarmParams* params;
+	float* vx;
+	float* vy;
+	float dt;
+
+	float neighbour_radius2;
+	float separation_radius2;
+	// Cells either side of an agent's to look at, and the rows of them, the
+	// nearest first
+	int32_t reach;
+	int32_t row_offsets[SWARM_MAX_ROWS];
+	uint32_t row_offsets_count;
+} SwarmJob;
+
+// Separate sums for each lane
+typedef struct {
+	float count[SWARM_LANES];
+	// Of the neighbours' offsets and speeds
+	float x[SWARM_LANES];
+	float y[SWARM_LANES];
+	float vx[SWARM_LANES];
+	float vy[SWARM_LANES];
+	float separation_x[SWARM_LANES];
+	float separation_y[SWARM_LANES];
+} SwarmSums;
+
+void swarm_init(Swarm* swarm, uint32_t capacity) {
+	/*
+	 * Make room for steering this many agents at once
+	 */
+	memset(swarm, 0, sizeof(*swarm));
+	swarm->capacity = capacity;
+
+	// The padding is read by the last lanes of the last cell, which are left
+	// out of the sums, so it only has to be finite
+	size_t padded = (size_t) capacity + SWARM_LANES;
+	swarm->x = calloc(padded, sizeof(float));
+	swarm->y = calloc(padded, sizeof(float));
+	swarm->vx = calloc(padded, sizeof(float));
+	swarm->vy = calloc(padded, sizeof(float));
+	if (swarm->x == NULL || swarm->y == NULL || swarm->vx == NULL || swarm->vy == NULL) {
+		fprintf(stderr, "Failed to allocate a swarm of %u\n", capacity);
+		exit(1);
+	}
+}
+
+void swarm_cleanup(Swarm* swarm) {
+	free(swarm->x);
+	free(swarm->y);
+	free(swarm->vx);
+	free(swarm->vy);
+	memset(swarm, 0, sizeof(*swarm));
+}
+
+static void swarm_gather_job(size_t start, size_t end, void* data) {
+	/*
+	 * Copy the agents at [start, end) of the grid's entries
+	 */
+	const SwarmJob* job = data;
+	Swarm* swarm = job->swarm;
+	const SpatialGrid* grid = job->grid;
+
+	for (size_t e = start; e < end; e++) {
+		uint32_t i = grid->entries[e];
+		swarm->x[e] = grid->x[i];
+		swarm->y[e] = grid->y[i];
+		swarm->vx[e] = job->vx[i];
+		swarm->vy[e] = job->vy[i];
+	}
+}
+
+static void swarm_sum_agents(const SwarmJob* job, const uint32_t* run_starts, const uint32_t* run_ends, uint32_t runs_count, float x, float y, SwarmSums* sums) {
+	/*
+	 * Sum the agents in runs of the copies which are near a point.  The agent
+	 * at the point itself is left out by being no distance away
+	 *
+	 * @param run_starts Where each run starts in the copies
+	 * @param run_ends And ends
+	 */
+	const Swarm* swarm = job->swarm;
+	// Summed in a local, which can't be the copies of the agents, so the sums
+	// stay in registers
+	SwarmSums lanes = {0};
+	for (uint32_t r = 0; r < runs_count; r++) {
+		uint32_t end = run_ends[r];
+		for (uint32_t e = run_starts[r]; e < end; e += SWARM_LANES) {
+			for (uint32_t lane = 0; lane < SWARM_LANES; lane++) {
+				uint32_t f = e + lane;
+				float dx = swarm->x[f] - x;
+				float dy = swarm->y[f] - y;
+				float distance2 = dx * dx + dy * dy;
+
+				// Selects rather than branches, so the lanes can be done at once
+				float near = f < end ? 1.0f : 0.0f;
+				near = distance2 < job->neighbour_radius2 ? near : 0.0f;
+				near = distance2 > 0.0f ? near : 0.0f;
+				float close = distance2 < job->separation_radius2 ? near : 0.0f;
+				// 1 / distance2 of those which are close, and 0 for the rest
+				float push = close / (distance2 + 1.0f - close);
+
+				lanes.count[lane] += near;
+				lanes.x[lane] += near * dx;
+				lanes.y[lane] += near * dy;
+				lanes.vx[lane] += near * swarm->vx[f];
+				lanes.vy[lane] += near * swarm->vy[f];
+				lanes.separation_x[lane] -= push * dx;
+				lanes.separation_y[lane] -= push * dy;
+			}
+		}
+	}
+	*sums = lanes;
+}
+
+static void swarm_avoid_tiles(const SwarmParams* params, float x, float y, float avoid[2]) {
+	/*
+	 * Which way to go to get away from the solid tiles near a point, more the
+	 * closer they are
+	 */
+	avoid[0] = 0.0f;
+	avoid[1] = 0.0f;
+
+	float distance = params->avoidance_distance;
+	int64_t min_x = (int64_t) floorf(x - distance);
+	int64_t min_y = (int64_t) floorf(y - distance);
+	int64_t max_x = (int64_t) floorf(x + distance);
+	int64_t max_y = (int64_t) floorf(y + distance);
+	for (int64_t tile_y = min_y; tile_y <= max_y; tile_y++) {
+		for (int64_t tile_x = min_x; tile_x <= max_x; tile_x++) {
+			if (!tile_solidity_is_solid(params->solidity, tile_x, tile_y)) {
+				continue;
+			}
+
+			// Away from the closest point of the tile, or from its middle when
+			// the point is already in it
+			float closest_x = fminf(fmaxf(x, (float) tile_x), (float) tile_x + 1.0f);
+			float closest_y = fminf(fmaxf(y, (float) tile_y), (float) tile_y + 1.0f);
+			float dx = x - closest_x;
+			float dy = y - closest_y;
+			float length = sqrtf(dx * dx + dy * dy);
+			if (length == 0.0f) {
+				dx = x - ((float) tile_x + 0.5f);
+				dy = y - ((float) tile_y + 0.5f);
+				length = sqrtf(dx * dx + dy * dy);
+				if (length == 0.0f) {
+					continue;
+				}
+				avoid[0] += dx / length;
+				avoid[1] += dy / length;
+				continue;
+			}
+			if (length >= distance) {
+				continue;
+			}
+			float strength = 1.0f - length / distance;
+			avoid[0] += dx / length * strength;
+			avoid[1] += dy / length * strength;
+		}
+	}
+}
+
+static void swarm_steer_job(size_t start, size_t end, void* data) {
+	/*
+	 * Steer the agents at [start, end) of the grid's entries
+	 */
+	const SwarmJob* job = data;
+	const Swarm* swarm = job->swarm;
+	const SpatialGrid* grid = job->grid;
+	const SwarmParams* params = job->params;
+
+	for (size_t e = start; e < end; e++) {
+		float x = swarm->x[e];
+		float y = swarm->y[e];
+		float vx = swarm->vx[e];
+		float vy = swarm->vy[e];
+
+		int32_t cell_x = (int32_t) ((x - grid->origin[0]) * grid->inv_cell_size);
+		int32_t cell_y = (int32_t) ((y - grid->origin[1]) * grid->inv_cell_size);
+		cell_x = cell_x < 0 ? 0 : cell_x >= (int32_t) grid->width ? (int32_t) grid->width - 1 : cell_x;
+		cell_y = cell_y < 0 ? 0 : cell_y >= (int32_t) grid->height ? (int32_t) grid->height - 1 : cell_y;
+
+		// The cells of a row are next to each other in the grid, and so are
+		// their agents
+		uint32_t min_x = (uint32_t) (cell_x > job->reach ? cell_x - job->reach : 0);
+		uint32_t max_x = (uint32_t) (cell_x + job->reach < (int32_t) grid->width ? cell_x + job->reach : (int32_t) grid->width - 1);
+
+		uint32_t run_starts[SWARM_MAX_ROWS];
+		uint32_t run_ends[SWARM_MAX_ROWS];
+		uint32_t runs_count = 0;
+		uint32_t budget = params->max_neighbours;
+		for (uint32_t r = 0; r < job->row_offsets_count && budget > 0; r++) {
+			int32_t row = cell_y + job->row_offsets[r];
+			if (row < 0 || row >= (int32_t) grid->height) {
+				continue;
+			}
+			uint32_t row_start = grid->cell_starts[min_x + (uint32_t) row * grid->width];
+			uint32_t row_end = grid->cell_starts[max_x + 1 + (uint32_t) row * grid->width];
+			if (row_end - row_start > budget) {
+				row_end = row_start + budget;
+			}
+			budget -= row_end - row_start;
+			run_starts[runs_count] = row_start;
+			run_ends[runs_count] = row_end;
+			runs_count++;
+		}
+
+		SwarmSums sums;
+		swarm_sum_agents(job, run_starts, run_ends, runs_count, x, y, &sums);
+
+		float count = 0.0f;
+		float sum[6] = {0};
+		for (uint32_t lane = 0; lane < SWARM_LANES; lane++) {
+			count += sums.count[lane];
+			sum[0] += sums.x[lane];
+			sum[1] += sums.y[lane];
+			sum[2] += sums.vx[lane];
+			sum[3] += sums.vy[lane];
+			sum[4] += sums.separation_x[lane];
+			sum[5] += sums.separation_y[lane];
+		}
+
+		float ax = params->separation_weight * sum[4];
+		float ay = params->separation_weight * sum[5];
+		if (count > 0.0f) {
+			// Towards the middle of the neighbours, and their average speed
+			float inv_count = 1.0f / count;
+			ax += params->cohesion_weight * sum[0] * inv_count + params->alignment_weight * (sum[2] * inv_count - vx);
+			ay += params->cohesion_weight * sum[1] * inv_count + params->alignment_weight * (sum[3] * inv_count - vy);
+		}
+		if (params->solidity != NULL) {
+			float avoid[2];
+			swarm_avoid_tiles(params, x, y, avoid);
+			ax += params->avoidance_weight * avoid[0];
+			ay += params->avoidance_weight * avoid[1];
+		}
+
+		vx += ax * job->dt;
+		vy += ay * job->dt;
+		float speed = sqrtf(vx * vx + vy * vy);
+		if (speed > params->max_speed) {
+			vx *= params->max_speed / speed;
+			vy *= params->max_speed / speed;
+		}
+		else if (speed < params->min_speed && speed > 0.0f) {
+			vx *= params->min_speed / speed;
+			vy *= params->min_speed / speed;
+		}
+
+		uint32_t i = grid->entries[e];
+		job->vx[i] = vx;
+		job->vy[i] = vy;
+	}
+}
+
+void swarm_steer(Swarm* swarm, const SpatialGrid* grid, const SwarmParams* params, float* vx, float* vy, float dt) {
+	/*
+	 * Change the agents' speeds for a step, split over the worker pool.  They
+	 * aren't moved
+	 *
+	 * @param grid Built from the agents' positions this step
+	 * @param vx Array of the grid's count x speeds, updated
+	 * @param vy Array of the grid's count y speeds, updated
+	 * @param dt The time step
+	 */
+	if (grid->count > swarm->capacity) {
+		fprintf(stderr, "Too many agents for the swarm (%u, it has room for %u)\n", grid->count, swarm->capacity);
+		exit(1);
+	}
+
+	SwarmJob job = {
+		.swarm = swarm,
+		.grid = grid,
+		.params = params,
+		.vx = vx,
+		.vy = vy,
+		.dt = dt,
+		.neighbour_radius2 = params->neighbour_radius * params->neighbour_radius,
+		.separation_radius2 = params->separation_radius * params->separation_radius,
+	};
+
+	// The agent's row, then out from it a row either side at a time, as far
+	// as covers the radius
+	int32_t reach = (int32_t) ceilf(params->neighbour_radius * grid->inv_cell_size);
+	job.reach = reach < SWARM_MAX_REACH ? reach : SWARM_MAX_REACH;
+	job.row_offsets[job.row_offsets_count++] = 0;
+	for (int32_t row = 1; row <= job.reach; row++) {
+		job.row_offsets[job.row_offsets_count++] = -row;
+		job.row_offsets[job.row_offsets_count++] = row;
+	}
+
+	jobs_parallel_for(grid->count, SWARM_JOB_SIZE, swarm_gather_job, &job);
+	jobs_parallel_for(grid->count, SWARM_JOB_SIZE, swarm_steer_job, &job);
+}
@@ -0,0 +1,104 @@
+/*
+ * Systems: loops over the entities of an archetype, scheduled over the worker
+ * pool.
+ *
+ * Entities with the same components are kept together in their own columns,
+ * e.g. an EntityPool, so a system is a plain loop over the columns it uses for
+ * every one of them, with nothing to check about each entity.  Different kinds
+ * of entity are different archetypes with systems of their own, rather than
+ * flags on one kind.
+ *
+ * Each system says which components it reads and writes.  When it's added it
+ * goes in the phase after the last system added before it which it conflicts
+ * with: the same archetype, and one of them writing what the other reads or
+ * writes.  So the systems run in the order they were added as far as anything
+ * can tell, while the ones which don't conflict (different archetypes, or
+ * different components) run at the same time, each split into batches.
+ *
+ * Creating and destroying entities moves the others about, so it's done
+ * between runs rather than by a system.
+ */
+
+#include "systems.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct {
+	const System* system;
+	size_t batch_size;
+} SystemJob;
+
+static bool systems_conflict(const System* a, const System* b) {
+	return a->archetype == b->archetype && ((a->writes & (b->reads | b->writes)) != 0 || (b->writes & a->reads) != 0);
+}
+
+void systems_add(SystemSchedule* schedule, const System* system) {
+	/*
+	 * Add a system to run after the ones it conflicts with
+	 */
+	if (schedule->count == SYSTEMS_MAX) {
+		fprintf(stderr, "Can't schedule more than %d systems\n", SYSTEMS_MAX);
+		exit(1);
+	}
+
+	uint32_t phase = 0;
+	for (uint32_t i = 0; i < schedule->count; i++) {
+		if (systems_conflict(&schedule->systems[i], system) && schedule->phases[i] + 1 > phase) {
+			phase = schedule->phases[i] + 1;
+		}
+	}
+
+	schedule->systems[schedule->count] = *system;
+	schedule->phases[schedule->count] = phase;
+	schedule->count++;
+	schedule->phases_count = phase + 1 > schedule->phases_count ? phase + 1 : schedule->phases_count;
+}
+
+static void systems_run_system(void* data) {
+	const SystemJob* job = data;
+	const System* system = job->system;
+
+	trace_begin(system->name);
+	if (system->count == NULL) {
+		system->kernel(0, 1, system->data);
+	}
+	else {
+		jobs_parallel_for(*system->count, job->batch_size, system->kernel, system->data);
+	}
+	trace_end();
+}
+
+void systems_run(const SystemSchedule* schedule, size_t batch_size) {
+	/*
+	 * Run every system, a phase at a time
+	 *
+	 * @param batch_size The most entities of a system each job does
+	 */
+	SystemJob jobs[SYSTEMS_MAX];
+	for (uint32_t phase = 0; phase < schedule->phases_count; phase++) {
+		// The first system of the phase runs on this thread, and the others are
+		// started on the workers first so they can get on with them
+		JobCounter counter = {0};
+		const System* first = NULL;
+		for (uint32_t i = 0; i < schedule->count; i++) {
+			if (schedule->phases[i] != phase) {
+				continue;
+			}
+			jobs[i].system = &schedule->systems[i];
+			jobs[i].batch_size = batch_size;
+			if (first == NULL) {
+				first = &schedule->systems[i];
+				continue;
+			}
+			jobs_submit(systems_run_system, &jobs[i], &counter);
+		}
+
+		if (first != NULL) {
+			SystemJob job = {first, batch_size};
+			systems_run_system(&job);
+		}
+		jobs_wait(&counter);
+	}
+}
@@ -0,0 +1,448 @@
+/*
+ * Frame metrics for unattended machines (e.g. kiosks), exported in the
+ * background.
+ *
+ * The renderer adds frame times to fixed histograms, bumps counters for late
+ * and dropped frames and swap chain trouble, and sets gauges such as the
+ * memory in use.  All of those are SDL atomics in static arrays, so recording
+ * never allocates or takes a lock and costs a few atomic adds a frame.
+ *
+ * A thread of its own wakes every interval and swaps each histogram bucket
+ * and counter back to zero, so every snapshot covers just its interval (and
+ * the 32 bit counts can't overflow).  It works out the percentiles from the
+ * buckets, which are accurate to the bucket's width (about 19%), and writes
+ * the snapshot as a JSON line and/or StatsD packets over UDP.  A sample being
+ * added while the buckets are swapped lands in this snapshot or the next, but
+ * is never lost.
+ *
+ * Gauges are added before telemetry_start(), after which nothing else changes
+ * the tables.
+ */
+
+#include "telemetry.h"
+
+#include <SDL3/SDL.h>
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET TelemetrySocket;
+#define TELEMETRY_NO_SOCKET INVALID_SOCKET
+#define telemetry_close_socket closesocket
+#else
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int TelemetrySocket;
+#define TELEMETRY_NO_SOCKET -1
+#define telemetry_close_socket close
+#endif
+
+// Longest StatsD packet, which stays under the usual MTU
+#define TELEMETRY_STATSD_PACKET 1400
+
+typedef struct {
+	SDL_AtomicInt buckets[TELEMETRY_HISTOGRAM_BUCKETS];
+	// Slowest sample, in microseconds
+	SDL_AtomicInt max_us;
+} TelemetryHistogramData;
+
+static const char* HISTOGRAM_NAMES[TELEMETRY_HISTOGRAMS_COUNT] = {
+	"frame_ms",
+	"gpu_ms",
+};
+
+static const char* COUNTER_NAMES[TELEMETRY_COUNTERS_COUNT] = {
+	"frames",
+	"late_frames",
+	"dropped_frames",
+	"swap_chain.suboptimal",
+	"swap_chain.out_of_date",
+	"swap_chain.recreations",
+};
+
+static TelemetryHistogramData histograms[TELEMETRY_HISTOGRAMS_COUNT] = {0};
+static SDL_AtomicInt counters[TELEMETRY_COUNTERS_COUNT] = {0};
+static SDL_AtomicInt gauges[TELEMETRY_MAX_GAUGES] = {0};
+static char gauge_names[TELEMETRY_MAX_GAUGES][TELEMETRY_MAX_NAME] = {0};
+static uint32_t gauges_count = 0;
+
+static SDL_AtomicInt running = {0};
+static TelemetryDesc telemetry_desc = {0};
+static SDL_Thread* thread = NULL;
+static SDL_Mutex* mutex = NULL;
+static SDL_Condition* stop_condition = NULL;
+static bool stopping = false;
+static FILE* json_file = NULL;
+static TelemetrySocket statsd_socket = TELEMETRY_NO_SOCKET;
+
+uint32_t telemetry_add_gauge(const char* name) {
+	/*
+	 * Add a gauge, a value which is set rather than added to (e.g. the memory
+	 * in use).  Has to be before telemetry_start()
+	 *
+	 * @return The gauge for telemetry_set_gauge()
+	 */
+	if (gauges_count >= TELEMETRY_MAX_GAUGES) {
+		fprintf(stderr, "Too many telemetry gauges (the most is %d)\n", TELEMETRY_MAX_GAUGES);
+		exit(1);
+	}
+
+	snprintf(gauge_names[gauges_count], TELEMETRY_MAX_NAME, "%s", name);
+	return gauges_count++;
+}
+
+void telemetry_add_sample(TelemetryHistogram histogram, double ms) {
+	/*
+	 * Add a time to a histogram.  Any thread can call it, without locking
+	 */
+	if (SDL_GetAtomicInt(&running) == 0) {
+		return;
+	}
+
+	int bucket = 0;
+	if (ms > TELEMETRY_HISTOGRAM_MIN_MS) {
+		bucket = (int) (log2(ms / TELEMETRY_HISTOGRAM_MIN_MS) * TELEMETRY_BUCKETS_PER_DOUBLING);
+		if (bucket >= TELEMETRY_HISTOGRAM_BUCKETS) {
+			bucket = TELEMETRY_HISTOGRAM_BUCKETS - 1;
+		}
+	}
+
+	TelemetryHistogramData* data = &histograms[histogram];
+	SDL_AddAtomicInt(&data->buckets[bucket], 1);
+
+	// Also a second or more, which is as slow as anything worth knowing about
+	int us = ms < 1000000.0 ? (int) (ms * 1000.0) : 1000000000;
+	int max_us = SDL_GetAtomicInt(&data->max_us);
+	while (us > max_us && !SDL_CompareAndSwapAtomicInt(&data->max_us, max_us, us)) {
+		max_us = SDL_GetAtomicInt(&data->max_us);
+	}
+}
+
+void telemetry_add_frame(uint64_t frame_ns, uint64_t refresh_period_ns) {
+	/*
+	 * Count a frame and add its time, along with whether it missed refreshes
+	 *
+	 * @param frame_ns Time since the start of the last frame
+	 * @param refresh_period_ns Of the display, 0 if there isn't one (then no
+	 *                          frames are late)
+	 */
+	if (SDL_GetAtomicInt(&running) == 0) {
+		return;
+	}
+
+	SDL_AddAtomicInt(&counters[TELEMETRY_FRAMES], 1);
+	telemetry_add_sample(TELEMETRY_FRAME_TIME, (double) frame_ns / 1000000.0);
+
+	// A frame which takes more than one refresh and a half has been on screen
+	// for (at least) two, so it missed the refreshes in between
+	if (refresh_period_ns > 0 && frame_ns * 2 > refresh_period_ns * 3) {
+		SDL_AddAtomicInt(&counters[TELEMETRY_LATE_FRAMES], 1);
+		uint64_t refreshes = (frame_ns + refresh_period_ns / 2) / refresh_period_ns;
+		SDL_AddAtomicInt(&counters[TELEMETRY_DROPPED_FRAMES], (int) (refreshes - 1));
+	}
+}
+
+void telemetry_count(TelemetryCounter counter, int count) {
+	if (SDL_GetAtomicInt(&running) == 0) {
+		return;
+	}
+	SDL_AddAtomicInt(&counters[counter], count);
+}
+
+void telemetry_set_gauge(uint32_t gauge, int value) {
+	if (SDL_GetAtomicInt(&running) == 0 || gauge >= gauges_count) {
+		return;
+	}
+	SDL_SetAtomicInt(&gauges[gauge], value);
+}
+
+typedef struct {
+	uint64_t count;
+	double p50;
+	double p90;
+	double p99;
+	double max;
+} TelemetrySummary;
+
+static double telemetry_bucket_upper_ms(uint32_t bucket) {
+	return TELEMETRY_HISTOGRAM_MIN_MS * pow(2.0, (double) (bucket + 1) / TELEMETRY_BUCKETS_PER_DOUBLING);
+}
+
+static TelemetrySummary telemetry_take_summary(TelemetryHistogramData* data) {
+	/*
+	 * Empty a histogram, returning its percentiles (the tops of their buckets)
+	 */
+	uint32_t counts[TELEMETRY_HISTOGRAM_BUCKETS];
+	TelemetrySummary summary = {0};
+	for (uint32_t i = 0; i < TELEMETRY_HISTOGRAM_BUCKETS; i++) {
+		counts[i] = (uint32_t) SDL_SetAtomicInt(&data->buckets[i], 0);
+		summary.count += counts[i];
+	}
+	summary.max = SDL_SetAtomicInt(&data->max_us, 0) / 1000.0;
+	if (summary.count == 0) {
+		return summary;
+	}
+
+	const double fractions[3] = {0.5, 0.9, 0.99};
+	double* results[3] = {&summary.p50, &summary.p90, &summary.p99};
+	uint64_t seen = 0;
+	uint32_t next = 0;
+	for (uint32_t i = 0; i < TELEMETRY_HISTOGRAM_BUCKETS && next < 3; i++) {
+		seen += counts[i];
+		while (next < 3 && (double) seen >= fractions[next] * (double) summary.count) {
+			// Never past the slowest sample, which the last bucket often is
+			*results[next] = fmin(telemetry_bucket_upper_ms(i), summary.max);
+			next++;
+		}
+	}
+
+	return summary;
+}
+
+static void telemetry_open_statsd(void) {
+	/*
+	 * Connect a UDP socket to the StatsD server, so the snapshots can just be
+	 * sent.  Failing leaves StatsD off
+	 */
+	char port[8];
+	snprintf(port, sizeof(port), "%u", telemetry_desc.statsd_port);
+
+	struct addrinfo hints = {0};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	struct addrinfo* addresses = NULL;
+	if (getaddrinfo(telemetry_desc.statsd_host, port, &hints, &addresses) != 0) {
+		fprintf(stderr, "Couldn't resolve the StatsD server %s\n", telemetry_desc.statsd_host);
+		return;
+	}
+
+	for (struct addrinfo* address = addresses; address != NULL; address = address->ai_next) {
+		statsd_socket = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+		if (statsd_socket == TELEMETRY_NO_SOCKET) {
+			continue;
+		}
+		if (connect(statsd_socket, address->ai_addr, (int) address->ai_addrlen) == 0) {
+			break;
+		}
+		telemetry_close_socket(statsd_socket);
+		statsd_socket = TELEMETRY_NO_SOCKET;
+	}
+	freeaddrinfo(addresses);
+
+	if (statsd_socket == TELEMETRY_NO_SOCKET) {
+		fprintf(stderr, "Couldn't connect to the StatsD server %s:%s\n", telemetry_desc.statsd_host, port);
+	}
+}
+
+static void telemetry_statsd_line(char* packet, size_t* length, const char* format, ...) {
+	/*
+	 * Add a metric to the packet, sending it first if the metric wouldn't fit
+	 */
+	char line[256];
+	va_list args;
+	va_start(args, format);
+	int line_length = vsnprintf(line, sizeof(line), format, args);
+	va_end(args);
+	if (line_length <= 0 || (size_t) line_length >= sizeof(line)) {
+		return;
+	}
+
+	if (*length + (size_t) line_length + 1 > TELEMETRY_STATSD_PACKET) {
+		send(statsd_socket, packet, (int) *length, 0);
+		*length = 0;
+	}
+
+	if (*length > 0) {
+		packet[(*length)++] = '\n';
+	}
+	memcpy(packet + *length, line, (size_t) line_length);
+	*length += (size_t) line_length;
+}
+
+static void telemetry_export(double interval_s) {
+	/*
+	 * Take a snapshot of everything and write it out
+	 */
+	TelemetrySummary summaries[TELEMETRY_HISTOGRAMS_COUNT];
+	for (uint32_t i = 0; i < TELEMETRY_HISTOGRAMS_COUNT; i++) {
+		summaries[i] = telemetry_take_summary(&histograms[i]);
+	}
+	int counts[TELEMETRY_COUNTERS_COUNT];
+	for (uint32_t i = 0; i < TELEMETRY_COUNTERS_COUNT; i++) {
+		counts[i] = SDL_SetAtomicInt(&counters[i], 0);
+	}
+	int values[TELEMETRY_MAX_GAUGES];
+	for (uint32_t i = 0; i < gauges_count; i++) {
+		values[i] = SDL_GetAtomicInt(&gauges[i]);
+	}
+
+	const char* prefix = telemetry_desc.prefix;
+
+	if (json_file != NULL) {
+		fprintf(json_file, "{\"time\":%lld,\"interval_s\":%.3f", (long long) time(NULL), interval_s);
+		for (uint32_t i = 0; i < TELEMETRY_HISTOGRAMS_COUNT; i++) {
+			fprintf(json_file, ",\"%s\":{\"count\":%llu,\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f}",
+					HISTOGRAM_NAMES[i], (unsigned long long) summaries[i].count,
+					summaries[i].p50, summaries[i].p90, summaries[i].p99, summaries[i].max);
+		}
+		for (uint32_t i = 0; i < TELEMETRY_COUNTERS_COUNT; i++) {
+			fprintf(json_file, ",\"%s\":%d", COUNTER_NAMES[i], counts[i]);
+		}
+		for (uint32_t i = 0; i < gauges_count; i++) {
+			fprintf(json_file, ",\"%s\":%d", gauge_names[i], values[i]);
+		}
+		fprintf(json_file, "}\n");
+		// Unattended, so it should be on disk if the power goes
+		fflush(json_file);
+	}
+
+	if (statsd_socket != TELEMETRY_NO_SOCKET) {
+		char packet[TELEMETRY_STATSD_PACKET];
+		size_t length = 0;
+		for (uint32_t i = 0; i < TELEMETRY_HISTOGRAMS_COUNT; i++) {
+			if (summaries[i].count == 0) {
+				continue;
+			}
+			telemetry_statsd_line(packet, &length, "%s.%s.p50:%.3f|g", prefix, HISTOGRAM_NAMES[i], summaries[i].p50);
+			telemetry_statsd_line(packet, &length, "%s.%s.p90:%.3f|g", prefix, HISTOGRAM_NAMES[i], summaries[i].p90);
+			telemetry_statsd_line(packet, &length, "%s.%s.p99:%.3f|g", prefix, HISTOGRAM_NAMES[i], summaries[i].p99);
+			telemetry_statsd_line(packet, &length, "%s.%s.max:%.3f|g", prefix, HISTOGRAM_NAMES[i], summaries[i].max);
+		}
+		for (uint32_t i = 0; i < TELEMETRY_COUNTERS_COUNT; i++) {
+			telemetry_statsd_line(packet, &length, "%s.%s:%d|c", prefix, COUNTER_NAMES[i], counts[i]);
+		}
+		for (uint32_t i = 0; i < gauges_count; i++) {
+			telemetry_statsd_line(packet, &length, "%s.%s:%d|g", prefix, gauge_names[i], values[i]);
+		}
+		if (length > 0) {
+			send(statsd_socket, packet, (int) length, 0);
+		}
+	}
+}
+
+static int telemetry_thread(void* data) {
+	(void) data;
+
+	uint64_t last_ns = SDL_GetTicksNS();
+	SDL_LockMutex(mutex);
+	while (!stopping) {
+		SDL_WaitConditionTimeout(stop_condition, mutex, (Sint32) telemetry_desc.interval_ms);
+		if (stopping) {
+			break;
+		}
+
+		// Exporting doesn't need the lock, which is only for stopping
+		SDL_UnlockMutex(mutex);
+		uint64_t now_ns = SDL_GetTicksNS();
+		telemetry_export(SDL_NS_TO_SECONDS((double) (now_ns - last_ns)));
+		last_ns = now_ns;
+		SDL_LockMutex(mutex);
+	}
+	SDL_UnlockMutex(mutex);
+
+	// What's left since the last snapshot
+	telemetry_export(SDL_NS_TO_SECONDS((double) (SDL_GetTicksNS() - last_ns)));
+	return 0;
+}
+
+bool telemetry_start(const TelemetryDesc* desc) {
+	/*
+	 * Start recording, and the thread which exports a snapshot every interval
+	 *
+	 * @return false if there's nowhere to export to, in which case nothing is
+	 *         recorded
+	 */
+	telemetry_desc = *desc;
+	if (telemetry_desc.interval_ms == 0) {
+		telemetry_desc.interval_ms = 1000;
+	}
+
+	if (desc->json_filename != NULL) {
+		json_file = fopen(desc->json_filename, "ab");
+		if (json_file == NULL) {
+			fprintf(stderr, "Failed to open %s for the telemetry\n", desc->json_filename);
+		}
+	}
+
+	if (desc->statsd_host != NULL) {
+#ifdef _WIN32
+		WSADATA wsa_data;
+		if (WSAStartup(MAKEWORD(2, 2), &wsa_data) == 0) {
+			telemetry_open_statsd();
+		}
+#else
+		telemetry_open_statsd();
+#endif
+	}
+
+	if (json_file == NULL && statsd_socket == TELEMETRY_NO_SOCKET) {
+		return false;
+	}
+
+	mutex = SDL_CreateMutex();
+	stop_condition = SDL_CreateCondition();
+	stopping = false;
+	if (mutex == NULL || stop_condition == NULL) {
+		fprintf(stderr, "Failed to create the telemetry thread's mutex: %s\n", SDL_GetError());
+		exit(1);
+	}
+
+	SDL_SetAtomicInt(&running, 1);
+	thread = SDL_CreateThread(telemetry_thread, "telemetry", NULL);
+	if (thread == NULL) {
+		fprintf(stderr, "Failed to create the telemetry thread: %s\n", SDL_GetError());
+		exit(1);
+	}
+
+	printf("Telemetry every %u ms to%s%s%s\n", telemetry_desc.interval_ms,
+			json_file != NULL ? " " : "", json_file != NULL ? desc->json_filename : "",
+			statsd_socket != TELEMETRY_NO_SOCKET ? " StatsD" : "");
+	return true;
+}
+
+void telemetry_stop(void) {
+	/*
+	 * Stop recording, and export the last snapshot
+	 */
+	if (SDL_GetAtomicInt(&running) == 0) {
+		return;
+	}
+	SDL_SetAtomicInt(&running, 0);
+
+	SDL_LockMutex(mutex);
+	stopping = true;
+	SDL_SignalCondition(stop_condition);
+	SDL_UnlockMutex(mutex);
+	SDL_WaitThread(thread, NULL);
+	thread = NULL;
+
+	SDL_DestroyCondition(stop_condition);
+	SDL_DestroyMutex(mutex);
+	stop_condition = NULL;
+	mutex = NULL;
+
+	if (json_file != NULL) {
+		fclose(json_file);
+		json_file = NULL;
+	}
+	if (statsd_socket != TELEMETRY_NO_SOCKET) {
+		telemetry_close_socket(statsd_socket);
+		statsd_socket = TELEMETRY_NO_SOCKET;
+#ifdef _WIN32
+		WSACleanup();
+#endif
+	}
+}
+
+bool telemetry_is_running(void) {
+	return SDL_GetAtomicInt(&running) != 0;
+}
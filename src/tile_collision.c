@@ -0,0 +1,258 @@
+/*
+ * Boxes moving through the tilemap, stopped by the solid tiles.
+ *
+ * The map's solidity is kept as a bit array, so testing a row of tiles is a
+ * few masked words rather than a byte a tile, and finding the first solid one
+ * along a row is a count of trailing (or leading) zeros.  tile_solidity_move()
+ * sweeps a box along x and then y.  Along x it looks along each row the box
+ * covers for the first solid tile past its leading edge, along y at each row
+ * the box moves into in turn, and the box stops flush against the nearest.
+ * Tiles the box already overlaps don't stop it, so something which starts
+ * inside a wall (or has one put on top of it) can still get out.  Everything
+ * outside the map is solid.
+ */
+
+#include "tile_collision.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Slack for boxes left exactly against a tile, so rounding doesn't count them
+// as overlapping it
+#define TILE_COLLISION_EPSILON 1e-4f
+
+static uint32_t count_trailing_zeros(uint64_t bits) {
+	/*
+	 * @param bits Not 0
+	 */
+#if defined(__GNUC__) || defined(__clang__)
+	return (uint32_t) __builtin_ctzll(bits);
+#else
+	uint32_t count = 0;
+	for (; (bits & 1) == 0; bits >>= 1) {
+		count++;
+	}
+	return count;
+#endif
+}
+
+static uint32_t count_leading_zeros(uint64_t bits) {
+	/*
+	 * @param bits Not 0
+	 */
+#if defined(__GNUC__) || defined(__clang__)
+	return (uint32_t) __builtin_clzll(bits);
+#else
+	uint32_t count = 0;
+	for (; (bits & (1ull << 63)) == 0; bits <<= 1) {
+		count++;
+	}
+	return count;
+#endif
+}
+
+void tile_solidity_init(TileSolidity* solidity, const uint8_t* tiles, uint32_t width, uint32_t height, uint8_t empty_tile) {
+	/*
+	 * Pack a map's tiles into solid or not
+	 *
+	 * @param tiles width * height tile values, row by row, or NULL to start
+	 *              with nothing solid
+	 * @param empty_tile The value of tiles which aren't solid
+	 */
+	solidity->width = width;
+	solidity->height = height;
+	solidity->words_per_row = (width + 63) / 64;
+	solidity->bits = calloc((size_t) solidity->words_per_row * height, sizeof(uint64_t));
+	if (solidity->bits == NULL) {
+		fprintf(stderr, "Failed to allocate the solidity of a %ux%u map\n", width, height);
+		exit(1);
+	}
+
+	for (uint32_t y = 0; y < height && tiles != NULL; y++) {
+		const uint8_t* row = &tiles[(size_t) y * width];
+		uint64_t* words = &solidity->bits[(size_t) y * solidity->words_per_row];
+		for (uint32_t x = 0; x < width; x++) {
+			words[x / 64] |= (uint64_t) (row[x] != empty_tile) << (x % 64);
+		}
+	}
+}
+
+void tile_solidity_cleanup(TileSolidity* solidity) {
+	free(solidity->bits);
+	memset(solidity, 0, sizeof(*solidity));
+}
+
+void tile_solidity_set(TileSolidity* solidity, uint32_t x, uint32_t y, bool solid) {
+	/*
+	 * Update a tile, e.g. when the map is edited.  Not while anything is moving
+	 */
+	if (x >= solidity->width || y >= solidity->height) {
+		return;
+	}
+
+	uint64_t* word = &solidity->bits[(size_t) y * solidity->words_per_row + x / 64];
+	uint64_t bit = 1ull << (x % 64);
+	*word = solid ? *word | bit : *word & ~bit;
+}
+
+bool tile_solidity_is_solid(const TileSolidity* solidity, int64_t x, int64_t y) {
+	if (x < 0 || y < 0 || x >= solidity->width || y >= solidity->height) {
+		return true;
+	}
+	return (solidity->bits[(size_t) y * solidity->words_per_row + (size_t) x / 64] >> (x % 64)) & 1;
+}
+
+static bool find_in_row(const TileSolidity* solidity, int64_t y, int64_t first, int64_t last, bool forwards, int64_t* column) {
+	/*
+	 * Find the first solid tile in columns [first, last] of a row, going from
+	 * first if forwards or else from last
+	 *
+	 * @param column Set to its column, if there is one
+	 *
+	 * @return Whether there is one
+	 */
+	if (first > last) {
+		return false;
+	}
+	if (y < 0 || y >= solidity->height) {
+		*column = forwards ? first : last;
+		return true;
+	}
+	// Outside the map, on the side the search starts from
+	if (forwards && first < 0) {
+		*column = first;
+		return true;
+	}
+	if (!forwards && last >= solidity->width) {
+		*column = last;
+		return true;
+	}
+
+	int64_t in_first = first > 0 ? first : 0;
+	int64_t in_last = last < solidity->width - 1 ? last : solidity->width - 1;
+	if (in_first <= in_last) {
+		const uint64_t* words = &solidity->bits[(size_t) y * solidity->words_per_row];
+		int64_t first_word = in_first / 64;
+		int64_t last_word = in_last / 64;
+		int64_t step = forwards ? 1 : -1;
+		for (int64_t w = forwards ? first_word : last_word; w >= first_word && w <= last_word; w += step) {
+			uint64_t bits = words[w];
+			if (w == first_word) {
+				bits &= ~0ull << (in_first % 64);
+			}
+			if (w == last_word) {
+				bits &= ~0ull >> (63 - in_last % 64);
+			}
+			if (bits != 0) {
+				*column = w * 64 + (forwards ? count_trailing_zeros(bits) : 63 - count_leading_zeros(bits));
+				return true;
+			}
+		}
+	}
+
+	// Outside the map, past it
+	if (forwards && last >= solidity->width) {
+		*column = first > solidity->width ? first : solidity->width;
+		return true;
+	}
+	if (!forwards && first < 0) {
+		*column = last < -1 ? last : -1;
+		return true;
+	}
+	return false;
+}
+
+uint32_t tile_solidity_move(const TileSolidity* solidity, float pos[2], const float half_size[2], const float delta[2]) {
+	/*
+	 * Move a box by delta, along x and then along y, stopping against solid
+	 * tiles
+	 *
+	 * @param pos The box's centre, moved
+	 * @param half_size Half of its width and height
+	 * @param delta How far to move it
+	 *
+	 * @return TILE_HIT_X and / or TILE_HIT_Y if it was stopped along them
+	 */
+	uint32_t hits = 0;
+
+	if (delta[0] != 0.0f) {
+		// The rows the box covers, not counting ones it's only touching
+		int64_t first_row = (int64_t) floorf(pos[1] - half_size[1] + TILE_COLLISION_EPSILON);
+		int64_t last_row = (int64_t) ceilf(pos[1] + half_size[1] - TILE_COLLISION_EPSILON) - 1;
+
+		// The columns the leading edge moves into
+		bool forwards = delta[0] > 0.0f;
+		int64_t first, last;
+		if (forwards) {
+			float edge = pos[0] + half_size[0];
+			first = (int64_t) ceilf(edge - TILE_COLLISION_EPSILON);
+			last = (int64_t) ceilf(edge + delta[0]) - 1;
+		}
+		else {
+			float edge = pos[0] - half_size[0];
+			first = (int64_t) floorf(edge + delta[0]);
+			last = (int64_t) floorf(edge + TILE_COLLISION_EPSILON) - 1;
+		}
+
+		bool hit = false;
+		int64_t nearest = 0;
+		for (int64_t y = first_row; y <= last_row; y++) {
+			int64_t column;
+			if (find_in_row(solidity, y, first, last, forwards, &column)) {
+				if (!hit || (forwards ? column < nearest : column > nearest)) {
+					nearest = column;
+				}
+				hit = true;
+			}
+		}
+
+		if (hit) {
+			pos[0] = forwards ? (float) nearest - half_size[0] : (float) (nearest + 1) + half_size[0];
+			hits |= TILE_HIT_X;
+		}
+		else {
+			pos[0] += delta[0];
+		}
+	}
+
+	if (delta[1] != 0.0f) {
+		int64_t first_column = (int64_t) floorf(pos[0] - half_size[0] + TILE_COLLISION_EPSILON);
+		int64_t last_column = (int64_t) ceilf(pos[0] + half_size[0] - TILE_COLLISION_EPSILON) - 1;
+
+		// The rows the leading edge moves into, nearest first
+		bool forwards = delta[1] > 0.0f;
+		int64_t first, last;
+		if (forwards) {
+			float edge = pos[1] + half_size[1];
+			first = (int64_t) ceilf(edge - TILE_COLLISION_EPSILON);
+			last = (int64_t) ceilf(edge + delta[1]) - 1;
+		}
+		else {
+			float edge = pos[1] - half_size[1];
+			first = (int64_t) floorf(edge + TILE_COLLISION_EPSILON) - 1;
+			last = (int64_t) floorf(edge + delta[1]);
+		}
+
+		int64_t step = forwards ? 1 : -1;
+		bool hit = false;
+		for (int64_t y = first; forwards ? y <= last : y >= last; y += step) {
+			int64_t column;
+			if (find_in_row(solidity, y, first_column, last_column, true, &column)) {
+				pos[1] = forwards ? (float) y - half_size[1] : (float) (y + 1) + half_size[1];
+				hit = true;
+				break;
+			}
+		}
+
+		if (hit) {
+			hits |= TILE_HIT_Y;
+		}
+		else {
+			pos[1] += delta[1];
+		}
+	}
+
+	return hits;
+}
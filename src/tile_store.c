@@ -0,0 +1,257 @@
+/*
+ * Sparse tile storage, for maps far bigger than the part of them with tiles.
+ *
+ * The map is split into TILE_STORE_CHUNK_SIZE x TILE_STORE_CHUNK_SIZE chunks
+ * of 16 bit tiles, and only the chunks with something in them exist.  They're
+ * found through an open addressed hash table of their coordinates (linear
+ * probing, kept at most half full), so the memory used and the cost of going
+ * through every chunk follow how much of the map is populated rather than its
+ * size.  Setting the last tile of a chunk to empty frees it again.
+ *
+ * A chunk is the same size as one of the tilemap's, so building a tilemap
+ * chunk reads one contiguous 2KB block, a cache line a row.
+ */
+
+#include "tile_store.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Slots the hash table starts with
+#define TILE_STORE_MIN_SLOTS 64
+
+static int32_t tile_store_chunk_coord(int32_t tile) {
+	// Rounded down, so the chunks either side of 0 are the same size
+	return tile >= 0 ? tile / TILE_STORE_CHUNK_SIZE : -((-(tile + 1)) / TILE_STORE_CHUNK_SIZE) - 1;
+}
+
+static uint32_t tile_store_hash(int32_t chunk_x, int32_t chunk_y) {
+	// Fibonacci hashing of both coordinates, whose top bits are well mixed
+	uint64_t key = (uint64_t) (uint32_t) chunk_x << 32 | (uint32_t) chunk_y;
+	return (uint32_t) ((key * 0x9e3779b97f4a7c15ull) >> 32);
+}
+
+static uint32_t tile_store_find_slot(const TileStore* store, int32_t chunk_x, int32_t chunk_y) {
+	/*
+	 * @return The slot with the chunk, or the free slot it would go in.  There
+	 *         has to be at least one slot
+	 */
+	uint32_t mask = store->slots_count - 1;
+	for (uint32_t slot = tile_store_hash(chunk_x, chunk_y) & mask; ; slot = (slot + 1) & mask) {
+		uint32_t index = store->slots[slot];
+		if (index == 0) {
+			return slot;
+		}
+		const TileStoreChunk* chunk = store->chunks[index - 1];
+		if (chunk->x == chunk_x && chunk->y == chunk_y) {
+			return slot;
+		}
+	}
+}
+
+static void tile_store_grow_slots(TileStore* store) {
+	/*
+	 * Double the hash table and put every chunk in it again
+	 */
+	uint32_t slots_count = store->slots_count > 0 ? store->slots_count * 2 : TILE_STORE_MIN_SLOTS;
+	uint32_t* slots = calloc(slots_count, sizeof(uint32_t));
+	if (slots == NULL) {
+		fprintf(stderr, "Failed to allocate %u tile chunk slots\n", slots_count);
+		exit(1);
+	}
+
+	free(store->slots);
+	store->slots = slots;
+	store->slots_count = slots_count;
+	for (uint32_t i = 0; i < store->chunks_count; i++) {
+		const TileStoreChunk* chunk = store->chunks[i];
+		store->slots[tile_store_find_slot(store, chunk->x, chunk->y)] = i + 1;
+	}
+}
+
+static TileStoreChunk* tile_store_add_chunk(TileStore* store, int32_t chunk_x, int32_t chunk_y) {
+	/*
+	 * Create an empty chunk, which isn't in the store yet
+	 */
+	if ((store->chunks_count + 1) * 2 > store->slots_count) {
+		tile_store_grow_slots(store);
+	}
+	if (store->chunks_count == store->chunks_capacity) {
+		uint32_t capacity = store->chunks_capacity > 0 ? store->chunks_capacity * 2 : TILE_STORE_MIN_SLOTS / 2;
+		TileStoreChunk** chunks = realloc(store->chunks, sizeof(TileStoreChunk*) * capacity);
+		if (chunks == NULL) {
+			fprintf(stderr, "Failed to allocate %u tile chunks\n", capacity);
+			exit(1);
+		}
+		store->chunks = chunks;
+		store->chunks_capacity = capacity;
+	}
+
+	TileStoreChunk* chunk = malloc(sizeof(TileStoreChunk));
+	if (chunk == NULL) {
+		fprintf(stderr, "Failed to allocate a tile chunk\n");
+		exit(1);
+	}
+	chunk->x = chunk_x;
+	chunk->y = chunk_y;
+	chunk->occupied = 0;
+	chunk->last_used = 0;
+	for (uint32_t i = 0; i < TILE_STORE_CHUNK_SIZE * TILE_STORE_CHUNK_SIZE; i++) {
+		chunk->tiles[i] = store->empty_tile;
+	}
+
+	store->slots[tile_store_find_slot(store, chunk_x, chunk_y)] = store->chunks_count + 1;
+	store->chunks[store->chunks_count++] = chunk;
+	return chunk;
+}
+
+static void tile_store_remove_slot(TileStore* store, uint32_t slot) {
+	/*
+	 * Free the chunk in a slot, and fill the gaps it leaves in the hash table
+	 * and in the chunks
+	 */
+	uint32_t index = store->slots[slot] - 1;
+	uint32_t mask = store->slots_count - 1;
+
+	// Move the chunks after it in the probe sequence back, unless the slot
+	// they hash to is between the hole and where they are now
+	uint32_t hole = slot;
+	store->slots[hole] = 0;
+	for (uint32_t next = (hole + 1) & mask; store->slots[next] != 0; next = (next + 1) & mask) {
+		const TileStoreChunk* chunk = store->chunks[store->slots[next] - 1];
+		uint32_t home = tile_store_hash(chunk->x, chunk->y) & mask;
+		bool stays = hole <= next ? hole < home && home <= next : hole < home || home <= next;
+		if (!stays) {
+			store->slots[hole] = store->slots[next];
+			store->slots[next] = 0;
+			hole = next;
+		}
+	}
+
+	free(store->chunks[index]);
+
+	// The last chunk takes its place in the array
+	uint32_t last = store->chunks_count - 1;
+	if (index != last) {
+		TileStoreChunk* moved = store->chunks[last];
+		store->slots[tile_store_find_slot(store, moved->x, moved->y)] = index + 1;
+		store->chunks[index] = moved;
+	}
+	store->chunks_count--;
+}
+
+void tile_store_init(TileStore* store, uint16_t empty_tile) {
+	/*
+	 * Start with an empty map
+	 *
+	 * @param empty_tile The value of tiles with nothing in them
+	 */
+	memset(store, 0, sizeof(TileStore));
+	store->empty_tile = empty_tile;
+}
+
+void tile_store_cleanup(TileStore* store) {
+	for (uint32_t i = 0; i < store->chunks_count; i++) {
+		free(store->chunks[i]);
+	}
+	free(store->chunks);
+	free(store->slots);
+	memset(store, 0, sizeof(TileStore));
+}
+
+const TileStoreChunk* tile_store_find_chunk(const TileStore* store, int32_t chunk_x, int32_t chunk_y) {
+	/*
+	 * @return The chunk, or NULL if everything in it is empty
+	 */
+	if (store->slots_count == 0) {
+		return NULL;
+	}
+	uint32_t index = store->slots[tile_store_find_slot(store, chunk_x, chunk_y)];
+	return index > 0 ? store->chunks[index - 1] : NULL;
+}
+
+uint16_t tile_store_get(const TileStore* store, int32_t x, int32_t y) {
+	int32_t chunk_x = tile_store_chunk_coord(x);
+	int32_t chunk_y = tile_store_chunk_coord(y);
+	const TileStoreChunk* chunk = tile_store_find_chunk(store, chunk_x, chunk_y);
+	if (chunk == NULL) {
+		return store->empty_tile;
+	}
+	return chunk->tiles[(x - chunk_x * TILE_STORE_CHUNK_SIZE) + (y - chunk_y * TILE_STORE_CHUNK_SIZE) * TILE_STORE_CHUNK_SIZE];
+}
+
+void tile_store_set(TileStore* store, int32_t x, int32_t y, uint16_t value) {
+	/*
+	 * Change a tile, creating its chunk if it's the first in it and freeing it
+	 * if it was the last
+	 */
+	int32_t chunk_x = tile_store_chunk_coord(x);
+	int32_t chunk_y = tile_store_chunk_coord(y);
+	TileStoreChunk* chunk = (TileStoreChunk*) tile_store_find_chunk(store, chunk_x, chunk_y);
+	if (chunk == NULL) {
+		if (value == store->empty_tile) {
+			return;
+		}
+		chunk = tile_store_add_chunk(store, chunk_x, chunk_y);
+	}
+
+	uint16_t* tile = &chunk->tiles[(x - chunk_x * TILE_STORE_CHUNK_SIZE) + (y - chunk_y * TILE_STORE_CHUNK_SIZE) * TILE_STORE_CHUNK_SIZE];
+	bool was_empty = *tile == store->empty_tile;
+	bool is_empty = value == store->empty_tile;
+	*tile = value;
+
+	if (was_empty && !is_empty) {
+		chunk->occupied++;
+	}
+	else if (!was_empty && is_empty && --chunk->occupied == 0) {
+		tile_store_remove_slot(store, tile_store_find_slot(store, chunk_x, chunk_y));
+	}
+}
+
+TileStoreChunk* tile_store_put_chunk(TileStore* store, int32_t chunk_x, int32_t chunk_y, const uint16_t* tiles) {
+	/*
+	 * Replace a whole chunk at once, e.g. one loaded from disk
+	 *
+	 * @param tiles TILE_STORE_CHUNK_SIZE * TILE_STORE_CHUNK_SIZE of them, row by
+	 *              row
+	 *
+	 * @return The chunk, or NULL if the tiles were all empty (so there isn't one)
+	 */
+	uint32_t occupied = 0;
+	for (uint32_t i = 0; i < TILE_STORE_CHUNK_SIZE * TILE_STORE_CHUNK_SIZE; i++) {
+		occupied += tiles[i] != store->empty_tile;
+	}
+
+	TileStoreChunk* chunk = (TileStoreChunk*) tile_store_find_chunk(store, chunk_x, chunk_y);
+	if (occupied == 0) {
+		if (chunk != NULL) {
+			tile_store_remove_slot(store, tile_store_find_slot(store, chunk_x, chunk_y));
+		}
+		return NULL;
+	}
+
+	if (chunk == NULL) {
+		chunk = tile_store_add_chunk(store, chunk_x, chunk_y);
+	}
+	memcpy(chunk->tiles, tiles, sizeof(chunk->tiles));
+	chunk->occupied = occupied;
+	return chunk;
+}
+
+void tile_store_remove_chunk(TileStore* store, int32_t chunk_x, int32_t chunk_y) {
+	/*
+	 * Empty a whole chunk, e.g. to evict it
+	 */
+	if (tile_store_find_chunk(store, chunk_x, chunk_y) != NULL) {
+		tile_store_remove_slot(store, tile_store_find_slot(store, chunk_x, chunk_y));
+	}
+}
+
+size_t tile_store_get_memory(const TileStore* store) {
+	/*
+	 * @return The bytes the chunks and the hash table take up
+	 */
+	return sizeof(TileStoreChunk) * store->chunks_count + sizeof(TileStoreChunk*) * store->chunks_capacity
+		+ sizeof(uint32_t) * store->slots_count;
+}
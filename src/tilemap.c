@@ -0,0 +1,494 @@
+/*
+ * Chunked tilemap.
+ *
+ * The map is split into TILEMAP_CHUNK_SIZE x TILEMAP_CHUNK_SIZE chunks, each
+ * with its own small vertex buffer, and they all share one index buffer of
+ * quads (each tile is a quad).  Chunks are only built when they
+ * come near the view and are evicted again once they are far enough away, so
+ * the GPU memory used and the work done per frame depend on the size of the
+ * view rather than the size of the map.
+ *
+ * Evicted chunks could still be in use by a frame in flight, so their buffers
+ * go on the vkx deferred destroy queue, which destroys them once the frame
+ * timeline has passed the frames which could be drawing them.  Changing a tile does the same to its chunk and builds it
+ * again.
+ *
+ * The tiles are either an array of the whole map or a TileStore, whose chunks
+ * line up with the tilemap's so that a chunk the store doesn't have is known
+ * to be empty without looking at it.
+ *
+ * Zoomed far enough out, a view has too many chunks to draw them tile by tile,
+ * so the tilemap can keep track of impostors instead: an image of each chunk,
+ * rendered once into a slot of an atlas and again only when one of its tiles
+ * changes.  The slots are reused for the chunks in view, the one drawn longest
+ * ago first.  Rendering and drawing them is up to the caller.
+ */
+
+#include "tilemap.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vkx/vkx_memory.h"
+#include "vkx/vkx_upload.h"
+
+static uint16_t tilemap_get_tile(const TilemapDesc* desc, const TileStoreChunk* stored, uint32_t chunk_x, uint32_t chunk_y,
+		uint32_t x, uint32_t y) {
+	/*
+	 * @param stored The tile store's chunk, with a store
+	 * @param chunk_x, chunk_y The tile in the chunk
+	 * @param x, y The tile in the map
+	 */
+	if (desc->store != NULL) {
+		return stored->tiles[chunk_x + chunk_y * TILE_STORE_CHUNK_SIZE];
+	}
+	return desc->tiles[x + y * desc->width];
+}
+
+uint32_t tilemap_write_chunk_vertices(const Tilemap* map, uint32_t chunk_index, TileVertex* vertices) {
+	/*
+	 * Write the vertices of a chunk's tiles, the same 4 for each tile, for its
+	 * vertex buffer or for rendering its impostor
+	 *
+	 * @param vertices Room for 4 for every tile of the chunk, or NULL to only
+	 *                 count them
+	 *
+	 * @return The number of vertices
+	 */
+	const TilemapDesc* desc = &map->desc;
+
+	uint32_t start_x = (chunk_index % map->chunks_x) * TILEMAP_CHUNK_SIZE;
+	uint32_t start_y = (chunk_index / map->chunks_x) * TILEMAP_CHUNK_SIZE;
+	uint32_t end_x = start_x + TILEMAP_CHUNK_SIZE < desc->width ? start_x + TILEMAP_CHUNK_SIZE : desc->width;
+	uint32_t end_y = start_y + TILEMAP_CHUNK_SIZE < desc->height ? start_y + TILEMAP_CHUNK_SIZE : desc->height;
+
+	// A tile store only has the chunks with something in them
+	const TileStoreChunk* stored = NULL;
+	if (desc->store != NULL) {
+		stored = tile_store_find_chunk(desc->store, (int32_t) (start_x / TILEMAP_CHUNK_SIZE), (int32_t) (start_y / TILEMAP_CHUNK_SIZE));
+	}
+
+	if (desc->store != NULL && stored == NULL) {
+		return 0;
+	}
+
+	uint32_t vertex_idx = 0;
+
+	for (uint32_t x = start_x; x < end_x; x++) {
+		for (uint32_t y = start_y; y < end_y; y++) {
+			uint16_t tile = tilemap_get_tile(desc, stored, x - start_x, y - start_y, x, y);
+			if (tile == desc->empty_tile) {
+				continue;
+			}
+
+			for (uint32_t i = 0; i < 4 && vertices != NULL; i++) {
+				TileVertex* vertex = &vertices[vertex_idx + i];
+				vertex->pos[0] = (uint16_t) x;
+				vertex->pos[1] = (uint16_t) y;
+				vertex->tile = tile;
+				vertex->_padding = 0;
+			}
+
+			vertex_idx += 4;
+		}
+	}
+
+	return vertex_idx;
+}
+
+static void tilemap_build_chunk(Tilemap* map, uint32_t chunk_index) {
+	/*
+	 * Generate the mesh for a chunk and queue the upload of its buffers
+	 */
+	const TilemapDesc* desc = &map->desc;
+	TilemapChunk* chunk = &map->chunks[chunk_index];
+
+	// 4 vertices per occupied tile
+	uint32_t vertices_count = tilemap_write_chunk_vertices(map, chunk_index, NULL);
+
+	*chunk = (TilemapChunk) {0};
+	chunk->resident = true;
+
+	// Nothing to draw, so don't bother with any buffers
+	if (vertices_count == 0) {
+		return;
+	}
+
+	// And 6 of the shared indices
+	TileVertex* vertices = malloc(sizeof(TileVertex) * vertices_count);
+	chunk->index_count = vertices_count / 4 * 6;
+
+	if (vertices == NULL) {
+		fprintf(stderr, "Failed to allocate tilemap chunk mesh\n");
+		exit(1);
+	}
+
+	tilemap_write_chunk_vertices(map, chunk_index, vertices);
+
+	VkDeviceSize vertices_size = sizeof(TileVertex) * vertices_count;
+
+	VkxMemoryTag previous_tag = vkx_memory_set_tag(VKX_MEMORY_TAG_TILES);
+	chunk->vertex_buffer = vkx_create_buffer(
+		vertices_size,
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT
+			| (desc->vertex_pulling ? VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT : VK_BUFFER_USAGE_VERTEX_BUFFER_BIT),
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+	);
+	vkx_memory_set_tag(previous_tag);
+	if (desc->vertex_pulling) {
+		chunk->vertices_address = vkx_get_buffer_address(chunk->vertex_buffer.buffer);
+	}
+
+	// The upload manager copies the data into its staging buffers straight away
+	vkx_upload_buffer(chunk->vertex_buffer.buffer, 0, vertices, vertices_size);
+
+	free(vertices);
+}
+
+static void tilemap_evict_chunk(Tilemap* map, uint32_t chunk_index) {
+	TilemapChunk* chunk = &map->chunks[chunk_index];
+
+	// A frame in flight could still be drawing the chunk
+	if (chunk->index_count > 0) {
+		vkx_defer_cleanup_buffer(&chunk->vertex_buffer);
+	}
+
+	*chunk = (TilemapChunk) {0};
+}
+
+void tilemap_init(Tilemap* map, const TilemapDesc* desc) {
+	/*
+	 * Set up a chunked tilemap.  No chunks are built until the first update
+	 *
+	 * @param map The tilemap to initialise
+	 * @param desc The map data and how to draw it.  The tiles must stay alive
+	 */
+	memset(map, 0, sizeof(Tilemap));
+	map->desc = *desc;
+
+	// The tile vertices have 16 bit positions
+	if (desc->width > UINT16_MAX || desc->height > UINT16_MAX) {
+		fprintf(stderr, "The tilemap (%ux%u) is too big for 16 bit tile positions\n", desc->width, desc->height);
+		exit(1);
+	}
+
+	map->chunks_x = (desc->width + TILEMAP_CHUNK_SIZE - 1) / TILEMAP_CHUNK_SIZE;
+	map->chunks_y = (desc->height + TILEMAP_CHUNK_SIZE - 1) / TILEMAP_CHUNK_SIZE;
+
+	uint32_t chunks_count = map->chunks_x * map->chunks_y;
+	map->chunks = calloc(chunks_count, sizeof(TilemapChunk));
+	map->visible = malloc(sizeof(uint32_t) * chunks_count);
+	map->resident = malloc(sizeof(uint32_t) * chunks_count);
+
+	if (map->chunks == NULL || map->visible == NULL || map->resident == NULL) {
+		fprintf(stderr, "Failed to allocate tilemap chunks\n");
+		exit(1);
+	}
+
+	printf("Tilemap is %dx%d tiles in %dx%d chunks\n", desc->width, desc->height, map->chunks_x, map->chunks_y);
+}
+
+void tilemap_cleanup(Tilemap* map) {
+	/*
+	 * Destroy all of the chunk buffers.  The GPU must be finished with them
+	 */
+	for (uint32_t i = 0; i < map->resident_count; i++) {
+		TilemapChunk* chunk = &map->chunks[map->resident[i]];
+		if (chunk->index_count > 0) {
+			vkx_cleanup_buffer(&chunk->vertex_buffer);
+		}
+	}
+
+	free(map->impostor_renders);
+	free(map->visible_impostors);
+	free(map->slots_used);
+	free(map->slot_chunks);
+	free(map->impostors_stale);
+	free(map->chunk_impostors);
+	free(map->resident);
+	free(map->visible);
+	free(map->chunks);
+
+	memset(map, 0, sizeof(Tilemap));
+}
+
+static void tilemap_chunk_range(float min_world, float max_world, uint32_t chunks, int32_t margin,
+		uint32_t* first, uint32_t* last) {
+	/*
+	 * Get the inclusive range of chunks on one axis which overlap [min_world, max_world]
+	 * plus the margin, clamped to the map.  last < first if there are none
+	 */
+	int32_t lo = (int32_t) floorf(min_world / TILEMAP_CHUNK_SIZE) - margin;
+	int32_t hi = (int32_t) floorf(max_world / TILEMAP_CHUNK_SIZE) + margin;
+
+	if (lo < 0) {
+		lo = 0;
+	}
+	if (hi > (int32_t) chunks - 1) {
+		hi = (int32_t) chunks - 1;
+	}
+
+	// Off the map completely
+	if (hi < lo) {
+		*first = 1;
+		*last = 0;
+		return;
+	}
+
+	*first = (uint32_t) lo;
+	*last = (uint32_t) hi;
+}
+
+bool tilemap_update(Tilemap* map, float view_min_x, float view_min_y, float view_max_x, float view_max_y) {
+	/*
+	 * Call once per frame after waiting for that frame's fence.  Builds the chunks
+	 * near the view, evicts the ones too far from it and works out which chunks
+	 * tilemap_draw() should draw
+	 *
+	 * Returns true if any chunk uploads were queued, in which case the caller must
+	 * call vkx_upload_flush() before submitting the frame
+	 *
+	 * @param view_min_x, view_min_y, view_max_x, view_max_y The view in tile coordinates
+	 */
+	bool uploaded = false;
+
+	// ----- Evict the chunks which are too far away -----
+	uint32_t keep_x0, keep_x1, keep_y0, keep_y1;
+	tilemap_chunk_range(view_min_x, view_max_x, map->chunks_x, TILEMAP_CHUNK_MARGIN, &keep_x0, &keep_x1);
+	tilemap_chunk_range(view_min_y, view_max_y, map->chunks_y, TILEMAP_CHUNK_MARGIN, &keep_y0, &keep_y1);
+
+	for (uint32_t i = 0; i < map->resident_count;) {
+		uint32_t chunk_index = map->resident[i];
+		uint32_t chunk_x = chunk_index % map->chunks_x;
+		uint32_t chunk_y = chunk_index / map->chunks_x;
+
+		if (chunk_x < keep_x0 || chunk_x > keep_x1 || chunk_y < keep_y0 || chunk_y > keep_y1) {
+			tilemap_evict_chunk(map, chunk_index);
+			map->resident[i] = map->resident[--map->resident_count];
+		}
+		else {
+			// The old buffers are retired in the same way as an eviction
+			if (map->chunks[chunk_index].dirty) {
+				tilemap_evict_chunk(map, chunk_index);
+				tilemap_build_chunk(map, chunk_index);
+				uploaded = uploaded || map->chunks[chunk_index].index_count > 0;
+			}
+			i++;
+		}
+	}
+
+	// ----- Build the chunks in and around the view -----
+
+	for (uint32_t chunk_y = keep_y0; chunk_y <= keep_y1; chunk_y++) {
+		for (uint32_t chunk_x = keep_x0; chunk_x <= keep_x1; chunk_x++) {
+			uint32_t chunk_index = chunk_x + chunk_y * map->chunks_x;
+			if (!map->chunks[chunk_index].resident) {
+				tilemap_build_chunk(map, chunk_index);
+				map->resident[map->resident_count++] = chunk_index;
+				uploaded = uploaded || map->chunks[chunk_index].index_count > 0;
+			}
+		}
+	}
+
+	// ----- Work out what to draw -----
+	uint32_t view_x0, view_x1, view_y0, view_y1;
+	tilemap_chunk_range(view_min_x, view_max_x, map->chunks_x, 0, &view_x0, &view_x1);
+	tilemap_chunk_range(view_min_y, view_max_y, map->chunks_y, 0, &view_y0, &view_y1);
+
+	map->visible_count = 0;
+	for (uint32_t chunk_y = view_y0; chunk_y <= view_y1; chunk_y++) {
+		for (uint32_t chunk_x = view_x0; chunk_x <= view_x1; chunk_x++) {
+			uint32_t chunk_index = chunk_x + chunk_y * map->chunks_x;
+			if (map->chunks[chunk_index].index_count > 0) {
+				map->visible[map->visible_count++] = chunk_index;
+			}
+		}
+	}
+
+	return uploaded;
+}
+
+void tilemap_tile_changed(Tilemap* map, uint32_t x, uint32_t y) {
+	/*
+	 * Let the tilemap know that a tile has changed in the tiles it was given.
+	 * Chunks which aren't resident pick it up when they are built anyway
+	 *
+	 * @param map The tilemap
+	 * @param x The x coordinate of the tile
+	 * @param y The y coordinate of the tile
+	 */
+	if (x >= map->desc.width || y >= map->desc.height) {
+		return;
+	}
+
+	uint32_t chunk_index = x / TILEMAP_CHUNK_SIZE + (y / TILEMAP_CHUNK_SIZE) * map->chunks_x;
+	TilemapChunk* chunk = &map->chunks[chunk_index];
+	if (chunk->resident) {
+		chunk->dirty = true;
+	}
+
+	// Its impostor is rendered again, or made now that it isn't empty
+	if (map->chunk_impostors != NULL) {
+		if (map->chunk_impostors[chunk_index] == TILEMAP_EMPTY_IMPOSTOR) {
+			map->chunk_impostors[chunk_index] = TILEMAP_NO_IMPOSTOR;
+		}
+		else {
+			map->impostors_stale[chunk_index] = true;
+		}
+	}
+}
+
+void tilemap_init_impostors(Tilemap* map, uint32_t slots_count) {
+	/*
+	 * Keep track of impostors for the chunks, for tilemap_update_impostors().
+	 * Every chunk starts without one
+	 *
+	 * @param map The tilemap, after tilemap_init()
+	 * @param slots_count How many chunks' impostors the atlas has room for,
+	 *                    which is also the most that can be drawn at once
+	 */
+	uint32_t chunks_count = map->chunks_x * map->chunks_y;
+	map->chunk_impostors = malloc(sizeof(uint32_t) * chunks_count);
+	map->impostors_stale = calloc(chunks_count, sizeof(bool));
+	map->impostor_slots_count = slots_count;
+	map->slot_chunks = malloc(sizeof(uint32_t) * slots_count);
+	map->slots_used = calloc(slots_count, sizeof(uint64_t));
+	map->visible_impostors = malloc(sizeof(TilemapImpostor) * slots_count);
+	map->impostor_renders = malloc(sizeof(TilemapImpostor) * slots_count);
+
+	if (map->chunk_impostors == NULL || map->impostors_stale == NULL || map->slot_chunks == NULL || map->slots_used == NULL
+			|| map->visible_impostors == NULL || map->impostor_renders == NULL) {
+		fprintf(stderr, "Failed to allocate tilemap impostors\n");
+		exit(1);
+	}
+
+	for (uint32_t i = 0; i < chunks_count; i++) {
+		map->chunk_impostors[i] = TILEMAP_NO_IMPOSTOR;
+	}
+	for (uint32_t i = 0; i < slots_count; i++) {
+		map->slot_chunks[i] = TILEMAP_NO_IMPOSTOR;
+	}
+}
+
+static uint32_t tilemap_take_impostor_slot(Tilemap* map) {
+	/*
+	 * Find a slot for a new impostor: a free one, or else the one drawn
+	 * longest ago which isn't in this update's view, whose chunk loses its
+	 * impostor.  TILEMAP_NO_IMPOSTOR if they're all in view
+	 */
+	uint32_t oldest = TILEMAP_NO_IMPOSTOR;
+	for (uint32_t i = 0; i < map->impostor_slots_count; i++) {
+		if (map->slot_chunks[i] == TILEMAP_NO_IMPOSTOR) {
+			return i;
+		}
+		if (map->slots_used[i] != map->impostor_updates
+				&& (oldest == TILEMAP_NO_IMPOSTOR || map->slots_used[i] < map->slots_used[oldest])) {
+			oldest = i;
+		}
+	}
+
+	if (oldest != TILEMAP_NO_IMPOSTOR) {
+		map->chunk_impostors[map->slot_chunks[oldest]] = TILEMAP_NO_IMPOSTOR;
+	}
+	return oldest;
+}
+
+void tilemap_update_impostors(Tilemap* map, float view_min_x, float view_min_y, float view_max_x, float view_max_y,
+		uint32_t max_renders) {
+	/*
+	 * Work out which chunks' impostors to draw for a view, and which of them
+	 * have to be rendered first: the new ones, and the ones a tile has changed
+	 * in.  Call instead of tilemap_update() for a view drawn with impostors.
+	 * Past max_renders, the chunks without an impostor are left out until a
+	 * later update and the changed ones are drawn as they were
+	 *
+	 * @param map The tilemap, after tilemap_init_impostors()
+	 * @param view_min_x, view_min_y, view_max_x, view_max_y The view in tile coordinates
+	 * @param max_renders The most impostors to render for this update
+	 */
+	map->impostor_updates++;
+	map->visible_impostors_count = 0;
+	map->impostor_renders_count = 0;
+
+	uint32_t view_x0, view_x1, view_y0, view_y1;
+	tilemap_chunk_range(view_min_x, view_max_x, map->chunks_x, 0, &view_x0, &view_x1);
+	tilemap_chunk_range(view_min_y, view_max_y, map->chunks_y, 0, &view_y0, &view_y1);
+
+	for (uint32_t chunk_y = view_y0; chunk_y <= view_y1; chunk_y++) {
+		for (uint32_t chunk_x = view_x0; chunk_x <= view_x1; chunk_x++) {
+			uint32_t chunk_index = chunk_x + chunk_y * map->chunks_x;
+			uint32_t slot = map->chunk_impostors[chunk_index];
+			if (slot == TILEMAP_EMPTY_IMPOSTOR) {
+				continue;
+			}
+			// Only as many as there are slots can be drawn at once
+			if (map->visible_impostors_count == map->impostor_slots_count) {
+				return;
+			}
+
+			bool render = slot == TILEMAP_NO_IMPOSTOR || map->impostors_stale[chunk_index];
+			if (render && map->impostor_renders_count == max_renders) {
+				if (slot == TILEMAP_NO_IMPOSTOR) {
+					continue;
+				}
+				render = false;
+			}
+
+			if (slot == TILEMAP_NO_IMPOSTOR) {
+				// Counting the tiles is cheaper than rendering nothing
+				if (tilemap_write_chunk_vertices(map, chunk_index, NULL) == 0) {
+					map->chunk_impostors[chunk_index] = TILEMAP_EMPTY_IMPOSTOR;
+					continue;
+				}
+
+				slot = tilemap_take_impostor_slot(map);
+				if (slot == TILEMAP_NO_IMPOSTOR) {
+					continue;
+				}
+				map->chunk_impostors[chunk_index] = slot;
+				map->slot_chunks[slot] = chunk_index;
+			}
+
+			TilemapImpostor impostor = {chunk_index, slot};
+			if (render) {
+				map->impostor_renders[map->impostor_renders_count++] = impostor;
+				map->impostors_stale[chunk_index] = false;
+			}
+			map->slots_used[slot] = map->impostor_updates;
+			map->visible_impostors[map->visible_impostors_count++] = impostor;
+		}
+	}
+}
+
+void tilemap_draw(const Tilemap* map, VkCommandBuffer command_buffer, VkPipelineLayout pipeline_layout) {
+	/*
+	 * Draw the visible chunks.  The tile pipeline, descriptor sets and push
+	 * constants must already be bound
+	 *
+	 * @param map The tilemap
+	 * @param command_buffer The command buffer to record into (inside rendering)
+	 * @param pipeline_layout The tile pipeline's layout, which the chunks'
+	 *                        vertex addresses are pushed with when pulling
+	 */
+	if (map->visible_count > 0) {
+		vkCmdBindIndexBuffer(command_buffer, map->desc.quad_index_buffer, 0, VK_INDEX_TYPE_UINT16);
+	}
+
+	for (uint32_t i = 0; i < map->visible_count; i++) {
+		const TilemapChunk* chunk = &map->chunks[map->visible[i]];
+
+		if (map->desc.vertex_pulling) {
+			vkCmdPushConstants(command_buffer, pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+					map->desc.vertices_address_offset, sizeof(VkDeviceAddress), &chunk->vertices_address);
+		}
+		else {
+			VkBuffer vertex_buffers[] = {chunk->vertex_buffer.buffer};
+			VkDeviceSize offsets[] = {0};
+			vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, offsets);
+		}
+
+		vkCmdDrawIndexed(command_buffer, chunk->index_count, 1, 0, 0, 0);
+	}
+}
@@ -0,0 +1,357 @@
+/*
+ * CPU zone profiling with a Chrome trace export.
+ *
+ * trace_begin() and trace_end() mark a zone on the calling thread, timed with
+ * SDL_GetTicksNS().  Each thread gets its own buffer the first time it records
+ * (claimed with an atomic counter), so recording never takes a lock.  The
+ * buffers keep the last TRACE_EVENTS_PER_THREAD zones of each thread.
+ *
+ * trace_write() saves them as JSON for chrome://tracing or Perfetto and then
+ * starts over.  It reads every thread's buffer, so it has to be called when
+ * only the calling thread is recording, e.g. from the main thread between
+ * frames when no jobs are running.
+ *
+ * The GPU's zones go on a track of their own with trace_add_gpu_zone(), once
+ * the profiler has put their timestamps on the same clock (see
+ * vkx_profiler.c), so the CPU recording and submitting a frame lines up with
+ * the GPU running it.  They're added from one thread, like a thread's zones.
+ *
+ * trace_add_counter() adds a value to a graph, e.g. the draws in a frame,
+ * kept in a ring of the thread's own like its zones.  trace_write_window()
+ * writes just what overlaps a stretch of time and leaves the rest, for the
+ * spike detector (see spike.c).
+ *
+ * Zone names aren't copied, so they should be string literals.  Nothing is
+ * recorded before trace_init().
+ */
+
+#include "trace.h"
+
+#include <SDL3/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+	const char* name;
+	uint64_t start_ns;
+	uint64_t end_ns;
+} TraceEvent;
+
+typedef struct {
+	const char* name;
+	uint64_t ns;
+	double value;
+} TraceCounter;
+
+typedef struct {
+	SDL_ThreadID thread_id;
+	char name[32];
+	// Ring of TRACE_EVENTS_PER_THREAD, events_count is the total written
+	TraceEvent* events;
+	uint64_t events_count;
+	// Zones which have begun but not ended
+	const char* open_names[TRACE_MAX_DEPTH];
+	uint64_t open_starts[TRACE_MAX_DEPTH];
+	uint32_t depth;
+	// Ring of TRACE_COUNTERS_PER_THREAD, allocated by the first counter
+	TraceCounter* counters;
+	uint64_t counters_count;
+} TraceThread;
+
+static TraceThread trace_threads[TRACE_MAX_THREADS] = {0};
+// The GPU's zones, written in the trace as a process of their own
+static TraceThread trace_gpu = {0};
+static SDL_AtomicInt trace_threads_count = {0};
+static SDL_AtomicInt trace_initialised = {0};
+// Timestamps are written relative to this
+static uint64_t trace_start_ns = 0;
+
+static _Thread_local TraceThread* current_thread = NULL;
+// Set when there were no buffers left for the thread
+static _Thread_local bool current_thread_full = false;
+
+static TraceThread* trace_get_thread(void) {
+	/*
+	 * The calling thread's buffer, claiming one on first use
+	 *
+	 * @return NULL if the trace isn't initialised or there are too many threads
+	 */
+	if (SDL_GetAtomicInt(&trace_initialised) == 0) {
+		return NULL;
+	}
+	if (current_thread != NULL) {
+		return current_thread;
+	}
+	if (current_thread_full) {
+		return NULL;
+	}
+
+	int index = SDL_AddAtomicInt(&trace_threads_count, 1);
+	if (index >= TRACE_MAX_THREADS) {
+		fprintf(stderr, "Too many threads to trace (max %d)\n", TRACE_MAX_THREADS);
+		current_thread_full = true;
+		return NULL;
+	}
+
+	TraceThread* thread = &trace_threads[index];
+	thread->thread_id = SDL_GetCurrentThreadID();
+	snprintf(thread->name, sizeof(thread->name), "thread %d", index);
+	thread->events = malloc(sizeof(TraceEvent) * TRACE_EVENTS_PER_THREAD);
+	if (thread->events == NULL) {
+		fprintf(stderr, "Failed to allocate the trace buffer\n");
+		exit(1);
+	}
+
+	current_thread = thread;
+	return thread;
+}
+
+void trace_init(void) {
+	trace_start_ns = SDL_GetTicksNS();
+	trace_gpu.events = malloc(sizeof(TraceEvent) * TRACE_EVENTS_PER_THREAD);
+	if (trace_gpu.events == NULL) {
+		fprintf(stderr, "Failed to allocate the trace buffer\n");
+		exit(1);
+	}
+	trace_gpu.events_count = 0;
+	SDL_SetAtomicInt(&trace_threads_count, 0);
+	SDL_SetAtomicInt(&trace_initialised, 1);
+	trace_set_thread_name("main");
+}
+
+void trace_cleanup(void) {
+	/*
+	 * Free the buffers.  Like trace_write(), no other thread can be recording
+	 */
+	SDL_SetAtomicInt(&trace_initialised, 0);
+
+	int threads_count = SDL_GetAtomicInt(&trace_threads_count);
+	for (int i = 0; i < threads_count && i < TRACE_MAX_THREADS; i++) {
+		free(trace_threads[i].events);
+		free(trace_threads[i].counters);
+	}
+	memset(trace_threads, 0, sizeof(trace_threads));
+	SDL_SetAtomicInt(&trace_threads_count, 0);
+	free(trace_gpu.events);
+	memset(&trace_gpu, 0, sizeof(trace_gpu));
+	current_thread = NULL;
+}
+
+void trace_set_thread_name(const char* name) {
+	/*
+	 * Name the calling thread in the trace
+	 *
+	 * @param name Copied, and cut short if it's long
+	 */
+	TraceThread* thread = trace_get_thread();
+	if (thread == NULL) {
+		return;
+	}
+
+	snprintf(thread->name, sizeof(thread->name), "%s", name);
+}
+
+void trace_begin(const char* name) {
+	/*
+	 * Start a zone on the calling thread, which lasts until the matching
+	 * trace_end()
+	 *
+	 * @param name Name of the zone, not copied
+	 */
+	TraceThread* thread = trace_get_thread();
+	if (thread == NULL) {
+		return;
+	}
+
+	if (thread->depth < TRACE_MAX_DEPTH) {
+		thread->open_names[thread->depth] = name;
+		thread->open_starts[thread->depth] = SDL_GetTicksNS();
+	}
+	thread->depth++;
+}
+
+void trace_end(void) {
+	uint64_t end_ns = SDL_GetTicksNS();
+
+	TraceThread* thread = trace_get_thread();
+	if (thread == NULL || thread->depth == 0) {
+		return;
+	}
+
+	thread->depth--;
+	if (thread->depth >= TRACE_MAX_DEPTH) {
+		return;
+	}
+
+	TraceEvent* event = &thread->events[thread->events_count % TRACE_EVENTS_PER_THREAD];
+	event->name = thread->open_names[thread->depth];
+	event->start_ns = thread->open_starts[thread->depth];
+	event->end_ns = end_ns;
+	thread->events_count++;
+}
+
+void trace_add_gpu_zone(const char* name, uint64_t start_ns, uint64_t end_ns) {
+	/*
+	 * Add a zone the GPU ran, which can be out of order with the others
+	 *
+	 * @param name Name of the zone, not copied
+	 * @param start_ns, end_ns On the SDL_GetTicksNS() clock
+	 */
+	if (SDL_GetAtomicInt(&trace_initialised) == 0) {
+		return;
+	}
+
+	TraceEvent* event = &trace_gpu.events[trace_gpu.events_count % TRACE_EVENTS_PER_THREAD];
+	event->name = name;
+	event->start_ns = start_ns;
+	event->end_ns = end_ns;
+	trace_gpu.events_count++;
+}
+
+void trace_add_counter(const char* name, double value) {
+	/*
+	 * Add the value of a counter at this time on the calling thread
+	 *
+	 * @param name Name of the counter, not copied
+	 */
+	TraceThread* thread = trace_get_thread();
+	if (thread == NULL) {
+		return;
+	}
+
+	if (thread->counters == NULL) {
+		thread->counters = malloc(sizeof(TraceCounter) * TRACE_COUNTERS_PER_THREAD);
+		if (thread->counters == NULL) {
+			fprintf(stderr, "Failed to allocate the trace counters\n");
+			exit(1);
+		}
+	}
+
+	TraceCounter* counter = &thread->counters[thread->counters_count % TRACE_COUNTERS_PER_THREAD];
+	counter->name = name;
+	counter->ns = SDL_GetTicksNS();
+	counter->value = value;
+	thread->counters_count++;
+}
+
+static double trace_get_us(uint64_t ns) {
+	// Trace times are in microseconds.  The GPU's can be from before the trace
+	// started
+	return (double) (int64_t) (ns - trace_start_ns) / 1000.0;
+}
+
+static void trace_write_events(FILE* file, TraceThread* thread, int pid, unsigned long long tid,
+		uint64_t start_ns, uint64_t end_ns, bool clear) {
+	/*
+	 * Write a thread's (or the GPU's) zones and counters from between two
+	 * times, and clear them if asked
+	 */
+	uint64_t events_first = 0;
+	if (thread->events_count > TRACE_EVENTS_PER_THREAD) {
+		events_first = thread->events_count - TRACE_EVENTS_PER_THREAD;
+	}
+
+	for (uint64_t j = events_first; j < thread->events_count; j++) {
+		const TraceEvent* event = &thread->events[j % TRACE_EVENTS_PER_THREAD];
+		if (event->end_ns < start_ns || event->start_ns > end_ns) {
+			continue;
+		}
+		fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%llu,\"ts\":%.3f,\"dur\":%.3f}",
+				event->name, pid, tid, trace_get_us(event->start_ns),
+				(double) (event->end_ns - event->start_ns) / 1000.0);
+	}
+
+	uint64_t counters_first = 0;
+	if (thread->counters_count > TRACE_COUNTERS_PER_THREAD) {
+		counters_first = thread->counters_count - TRACE_COUNTERS_PER_THREAD;
+	}
+
+	for (uint64_t j = counters_first; j < thread->counters_count; j++) {
+		const TraceCounter* counter = &thread->counters[j % TRACE_COUNTERS_PER_THREAD];
+		if (counter->ns < start_ns || counter->ns > end_ns) {
+			continue;
+		}
+		fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":%d,\"tid\":%llu,\"ts\":%.3f,\"args\":{\"value\":%g}}",
+				counter->name, pid, tid, trace_get_us(counter->ns), counter->value);
+	}
+
+	if (clear) {
+		thread->events_count = 0;
+		thread->counters_count = 0;
+	}
+}
+
+static bool trace_write_file(const char* filename, uint64_t start_ns, uint64_t end_ns, bool clear) {
+	/*
+	 * Write the zones and counters from between two times as a Chrome trace
+	 */
+	if (SDL_GetAtomicInt(&trace_initialised) == 0) {
+		return false;
+	}
+
+	FILE* file = fopen(filename, "w");
+	if (!file) {
+		fprintf(stderr, "Failed to open file %s for writing\n", filename);
+		return false;
+	}
+
+	fprintf(file, "{\"traceEvents\":[\n");
+	bool first = true;
+
+	int threads_count = SDL_GetAtomicInt(&trace_threads_count);
+	for (int i = 0; i < threads_count && i < TRACE_MAX_THREADS; i++) {
+		TraceThread* thread = &trace_threads[i];
+		if (thread->events == NULL) {
+			continue;
+		}
+		unsigned long long tid = (unsigned long long) thread->thread_id;
+
+		fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%llu,\"args\":{\"name\":\"%s\"}}",
+				first ? "" : ",\n", tid, thread->name);
+		first = false;
+
+		trace_write_events(file, thread, 0, tid, start_ns, end_ns, clear);
+	}
+
+	if (trace_gpu.events_count > 0) {
+		fprintf(file, "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"GPU\"}}",
+				first ? "" : ",\n");
+		fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"graphics queue\"}}");
+		trace_write_events(file, &trace_gpu, 1, 0, start_ns, end_ns, clear);
+	}
+
+	fprintf(file, "\n]}\n");
+
+	bool ok = ferror(file) == 0;
+	fclose(file);
+	if (!ok) {
+		fprintf(stderr, "Failed to write the trace to %s\n", filename);
+	}
+
+	return ok;
+}
+
+bool trace_write(const char* filename) {
+	/*
+	 * Write the recorded zones and counters as a Chrome trace, then clear
+	 * them.  The zones which are still open are left for the next one
+	 *
+	 * @param filename JSON file to write
+	 *
+	 * @return false if the file couldn't be written
+	 */
+	return trace_write_file(filename, 0, UINT64_MAX, true);
+}
+
+bool trace_write_window(const char* filename, uint64_t start_ns, uint64_t end_ns) {
+	/*
+	 * Write what was recorded between two times as a Chrome trace, leaving
+	 * all of it for trace_write().  Zones which overlap either end are written
+	 * whole
+	 *
+	 * @param start_ns, end_ns On the SDL_GetTicksNS() clock
+	 */
+	return trace_write_file(filename, start_ns, end_ns, false);
+}
@@ -0,0 +1,342 @@
+/*
+ * A hierarchy of 2D transforms, for things attached to other things (a weapon
+ * to a character, the parts of a UI), kept as flat arrays sorted by depth.
+ *
+ * Every parent comes before its children, and after an update all the nodes
+ * of a depth are together, so the world transforms are worked out a level at
+ * a time: a level's parents are all done by the time it starts, and nothing
+ * in a level depends on anything else in it, so each level is split over the
+ * worker pool with no locking.  Within a job each batch of dirty nodes is
+ * gathered, composed with affine2_mul_batch() and scattered back, so the
+ * arithmetic is in one loop the compiler can vectorise.
+ *
+ * Only the nodes whose local transforms changed, or which are under one that
+ * did, are recomputed.  The rest cost a byte's read each update, so an update
+ * is linear in the nodes and goes through each array from start to end.
+ *
+ * Nodes have stable handles like the entity pool's.  Adding one puts it on
+ * the end, which still has its parent before it, and removing one takes its
+ * subtree with it.  The arrays are sorted by depth again (a counting sort, so
+ * siblings stay in the order they were added) at the next update.
+ */
+
+#include "transform_tree.h"
+#include "jobs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A removed node's depth, until the next update drops it and its subtree
+#define TRANSFORM_TREE_REMOVED UINT8_MAX
+// Nodes of a level for each job...
+#define TRANSFORM_TREE_JOB_SIZE 4096
+// ...which gathers the dirty ones in batches of this many
+#define TRANSFORM_TREE_BATCH_SIZE 64
+
+typedef struct {
+	TransformTree* tree;
+	uint32_t level_start;
+} TransformTreeLevelJob;
+
+void transform_tree_init(TransformTree* tree, uint32_t capacity) {
+	/*
+	 * Set up an empty tree for up to capacity nodes, allocating everything up
+	 * front
+	 */
+	if (capacity > TRANSFORM_TREE_MAX_NODES) {
+		fprintf(stderr, "Transform trees can't have more than %u nodes\n", TRANSFORM_TREE_MAX_NODES);
+		exit(1);
+	}
+
+	memset(tree, 0, sizeof(*tree));
+	tree->capacity = capacity;
+	tree->parents = malloc(sizeof(uint32_t) * capacity);
+	tree->depths = malloc(sizeof(uint8_t) * capacity);
+	tree->dirty = malloc(sizeof(uint8_t) * capacity);
+	tree->locals = malloc(sizeof(Affine2) * capacity);
+	tree->worlds = malloc(sizeof(Affine2) * capacity);
+	tree->indices = malloc(sizeof(uint32_t) * capacity);
+	tree->slots = malloc(sizeof(uint32_t) * capacity);
+	tree->generations = calloc(capacity, sizeof(uint8_t));
+	tree->free_slots = malloc(sizeof(uint32_t) * capacity);
+	tree->scratch = malloc(sizeof(Affine2) * capacity);
+	tree->remap = malloc(sizeof(uint32_t) * capacity);
+	if (tree->parents == NULL || tree->depths == NULL || tree->dirty == NULL || tree->locals == NULL
+			|| tree->worlds == NULL || tree->indices == NULL || tree->slots == NULL || tree->generations == NULL
+			|| tree->free_slots == NULL || tree->scratch == NULL || tree->remap == NULL) {
+		fprintf(stderr, "Failed to allocate a transform tree of %u nodes\n", capacity);
+		exit(1);
+	}
+}
+
+void transform_tree_cleanup(TransformTree* tree) {
+	free(tree->parents);
+	free(tree->depths);
+	free(tree->dirty);
+	free(tree->locals);
+	free(tree->worlds);
+	free(tree->indices);
+	free(tree->slots);
+	free(tree->generations);
+	free(tree->free_slots);
+	free(tree->scratch);
+	free(tree->remap);
+	memset(tree, 0, sizeof(*tree));
+}
+
+bool transform_tree_is_valid(const TransformTree* tree, TransformHandle handle) {
+	uint32_t slot = handle & TRANSFORM_TREE_INDEX_MASK;
+	return handle != TRANSFORM_TREE_NO_HANDLE
+		&& slot < tree->slots_count
+		&& tree->indices[slot] != TRANSFORM_TREE_NO_INDEX
+		&& tree->generations[slot] == handle >> TRANSFORM_TREE_INDEX_BITS;
+}
+
+uint32_t transform_tree_get_index(const TransformTree* tree, TransformHandle handle) {
+	/*
+	 * @return The node's current index in the arrays, or
+	 *         TRANSFORM_TREE_NO_INDEX if it's been removed.  It changes when
+	 *         the tree is sorted
+	 */
+	if (!transform_tree_is_valid(tree, handle)) {
+		return TRANSFORM_TREE_NO_INDEX;
+	}
+	return tree->indices[handle & TRANSFORM_TREE_INDEX_MASK];
+}
+
+static void transform_tree_free_slot(TransformTree* tree, uint32_t index) {
+	uint32_t slot = tree->slots[index];
+	tree->indices[slot] = TRANSFORM_TREE_NO_INDEX;
+	tree->generations[slot]++;
+	tree->free_slots[tree->free_count++] = slot;
+	tree->slots[index] = TRANSFORM_TREE_NO_INDEX;
+}
+
+TransformHandle transform_tree_add(TransformTree* tree, TransformHandle parent, const Affine2* local) {
+	/*
+	 * Add a node, whose world transform is ready after the next update
+	 *
+	 * @param parent The node it's attached to, or TRANSFORM_TREE_NO_HANDLE for
+	 *               a root
+	 * @param local From the node to its parent (or the world for a root)
+	 *
+	 * @return Its handle, or TRANSFORM_TREE_NO_HANDLE if the tree is full, the
+	 *         parent has been removed or the node would be too deep
+	 */
+	uint32_t parent_index = TRANSFORM_TREE_NO_INDEX;
+	uint8_t depth = 0;
+	if (parent != TRANSFORM_TREE_NO_HANDLE) {
+		parent_index = transform_tree_get_index(tree, parent);
+		if (parent_index == TRANSFORM_TREE_NO_INDEX || tree->depths[parent_index] + 1 >= TRANSFORM_TREE_MAX_DEPTH) {
+			return TRANSFORM_TREE_NO_HANDLE;
+		}
+		depth = tree->depths[parent_index] + 1;
+	}
+	if (tree->count == tree->capacity) {
+		return TRANSFORM_TREE_NO_HANDLE;
+	}
+
+	uint32_t slot = tree->free_count > 0 ? tree->free_slots[--tree->free_count] : tree->slots_count++;
+	uint32_t index = tree->count++;
+	tree->indices[slot] = index;
+	tree->slots[index] = slot;
+	tree->parents[index] = parent_index;
+	tree->depths[index] = depth;
+	tree->dirty[index] = 1;
+	tree->locals[index] = *local;
+	affine2_identity(&tree->worlds[index]);
+
+	tree->unsorted = true;
+	tree->changed = true;
+	return (TransformHandle) tree->generations[slot] << TRANSFORM_TREE_INDEX_BITS | slot;
+}
+
+void transform_tree_remove(TransformTree* tree, TransformHandle handle) {
+	/*
+	 * Remove a node, if the handle is still valid.  Everything under it goes
+	 * too, though their handles stay valid until the next update
+	 */
+	uint32_t index = transform_tree_get_index(tree, handle);
+	if (index == TRANSFORM_TREE_NO_INDEX) {
+		return;
+	}
+	transform_tree_free_slot(tree, index);
+	tree->depths[index] = TRANSFORM_TREE_REMOVED;
+	tree->unsorted = true;
+}
+
+void transform_tree_set_local(TransformTree* tree, TransformHandle handle, const Affine2* local) {
+	/*
+	 * Move a node relative to its parent, which moves everything under it
+	 * too at the next update
+	 */
+	uint32_t index = transform_tree_get_index(tree, handle);
+	if (index == TRANSFORM_TREE_NO_INDEX) {
+		return;
+	}
+	tree->locals[index] = *local;
+	tree->dirty[index] = 1;
+	tree->changed = true;
+}
+
+const Affine2* transform_tree_get_world(const TransformTree* tree, TransformHandle handle) {
+	/*
+	 * @return The node's world transform as of the last update, or NULL if
+	 *         it's been removed
+	 */
+	uint32_t index = transform_tree_get_index(tree, handle);
+	return index != TRANSFORM_TREE_NO_INDEX ? &tree->worlds[index] : NULL;
+}
+
+static void transform_tree_permute(TransformTree* tree, void* column, size_t element_size, uint32_t old_count, uint32_t new_count) {
+	/*
+	 * Move each kept node's element of a column to where the sort puts it
+	 */
+	char* data = column;
+	char* scratch = tree->scratch;
+	for (uint32_t i = 0; i < old_count; i++) {
+		if (tree->remap[i] != TRANSFORM_TREE_NO_INDEX) {
+			memcpy(scratch + element_size * tree->remap[i], data + element_size * i, element_size);
+		}
+	}
+	memcpy(data, scratch, element_size * new_count);
+}
+
+static void transform_tree_sort(TransformTree* tree) {
+	/*
+	 * Drop the removed subtrees and sort what's left by depth
+	 */
+	// The arrays are in parent before child order, so a removed node is
+	// seen before anything under it
+	uint32_t depth_counts[TRANSFORM_TREE_MAX_DEPTH] = {0};
+	for (uint32_t i = 0; i < tree->count; i++) {
+		uint32_t parent = tree->parents[i];
+		if (parent != TRANSFORM_TREE_NO_INDEX && tree->depths[parent] == TRANSFORM_TREE_REMOVED
+				&& tree->depths[i] != TRANSFORM_TREE_REMOVED) {
+			transform_tree_free_slot(tree, i);
+			tree->depths[i] = TRANSFORM_TREE_REMOVED;
+		}
+		if (tree->depths[i] != TRANSFORM_TREE_REMOVED) {
+			depth_counts[tree->depths[i]]++;
+		}
+	}
+
+	tree->levels_count = 0;
+	uint32_t start = 0;
+	for (uint32_t depth = 0; depth < TRANSFORM_TREE_MAX_DEPTH; depth++) {
+		tree->level_starts[depth] = start;
+		start += depth_counts[depth];
+		if (depth_counts[depth] > 0) {
+			tree->levels_count = depth + 1;
+		}
+	}
+	tree->level_starts[TRANSFORM_TREE_MAX_DEPTH] = start;
+
+	// Where each node goes, in the order they were in within a depth
+	uint32_t next[TRANSFORM_TREE_MAX_DEPTH];
+	memcpy(next, tree->level_starts, sizeof(next));
+	for (uint32_t i = 0; i < tree->count; i++) {
+		uint8_t depth = tree->depths[i];
+		tree->remap[i] = depth != TRANSFORM_TREE_REMOVED ? next[depth]++ : TRANSFORM_TREE_NO_INDEX;
+	}
+
+	for (uint32_t i = 0; i < tree->count; i++) {
+		if (tree->remap[i] != TRANSFORM_TREE_NO_INDEX && tree->parents[i] != TRANSFORM_TREE_NO_INDEX) {
+			tree->parents[i] = tree->remap[tree->parents[i]];
+		}
+	}
+
+	uint32_t old_count = tree->count;
+	uint32_t new_count = start;
+	transform_tree_permute(tree, tree->parents, sizeof(uint32_t), old_count, new_count);
+	transform_tree_permute(tree, tree->depths, sizeof(uint8_t), old_count, new_count);
+	transform_tree_permute(tree, tree->dirty, sizeof(uint8_t), old_count, new_count);
+	transform_tree_permute(tree, tree->locals, sizeof(Affine2), old_count, new_count);
+	transform_tree_permute(tree, tree->worlds, sizeof(Affine2), old_count, new_count);
+	transform_tree_permute(tree, tree->slots, sizeof(uint32_t), old_count, new_count);
+	tree->count = new_count;
+	for (uint32_t i = 0; i < new_count; i++) {
+		tree->indices[tree->slots[i]] = i;
+	}
+
+	tree->unsorted = false;
+}
+
+static void transform_tree_update_roots(size_t start, size_t end, void* data) {
+	/*
+	 * A root's world transform is its local one
+	 */
+	TransformTree* tree = data;
+	for (size_t i = start; i < end; i++) {
+		if (tree->dirty[i]) {
+			tree->worlds[i] = tree->locals[i];
+		}
+	}
+}
+
+static void transform_tree_update_level(size_t start, size_t end, void* data) {
+	/*
+	 * Work out the world transforms of the dirty nodes in part of a level,
+	 * whose parents' are all done
+	 */
+	const TransformTreeLevelJob* job = data;
+	TransformTree* tree = job->tree;
+
+	uint32_t batch_indices[TRANSFORM_TREE_BATCH_SIZE];
+	Affine2 batch_locals[TRANSFORM_TREE_BATCH_SIZE];
+	Affine2 batch_parents[TRANSFORM_TREE_BATCH_SIZE];
+	Affine2 batch_worlds[TRANSFORM_TREE_BATCH_SIZE];
+
+	for (size_t batch_start = job->level_start + start; batch_start < job->level_start + end; batch_start += TRANSFORM_TREE_BATCH_SIZE) {
+		size_t batch_end = batch_start + TRANSFORM_TREE_BATCH_SIZE;
+		if (batch_end > job->level_start + end) {
+			batch_end = job->level_start + end;
+		}
+
+		// Anything under a dirty node is dirty too
+		uint32_t n = 0;
+		for (size_t i = batch_start; i < batch_end; i++) {
+			uint32_t parent = tree->parents[i];
+			tree->dirty[i] |= tree->dirty[parent];
+			if (tree->dirty[i]) {
+				batch_indices[n] = (uint32_t) i;
+				batch_locals[n] = tree->locals[i];
+				batch_parents[n] = tree->worlds[parent];
+				n++;
+			}
+		}
+
+		affine2_mul_batch(batch_locals, batch_parents, batch_worlds, n);
+		for (uint32_t i = 0; i < n; i++) {
+			tree->worlds[batch_indices[i]] = batch_worlds[i];
+		}
+	}
+}
+
+void transform_tree_update(TransformTree* tree) {
+	/*
+	 * Sort the nodes if any were added or removed, then work out the world
+	 * transforms of the ones that moved and everything under them, a level at
+	 * a time across the worker pool
+	 */
+	if (tree->unsorted) {
+		transform_tree_sort(tree);
+	}
+	if (!tree->changed) {
+		return;
+	}
+
+	jobs_parallel_for(tree->level_starts[1], TRANSFORM_TREE_JOB_SIZE, transform_tree_update_roots, tree);
+	for (uint32_t depth = 1; depth < tree->levels_count; depth++) {
+		TransformTreeLevelJob job = {
+			.tree = tree,
+			.level_start = tree->level_starts[depth],
+		};
+		uint32_t level_count = tree->level_starts[depth + 1] - tree->level_starts[depth];
+		jobs_parallel_for(level_count, TRANSFORM_TREE_JOB_SIZE, transform_tree_update_level, &job);
+	}
+
+	memset(tree->dirty, 0, tree->count);
+	tree->changed = false;
+}
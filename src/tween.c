@@ -0,0 +1,316 @@
+/*
+ * Tweens: floats eased from where they are to a value over a time, for UI and
+ * sprites which slide, fade and bounce without game code animating each one.
+ *
+ * The tweens are kept in arrays rather than as objects with callbacks, a
+ * group for each easing, so a group's update is the same few loops over all
+ * of its tweens: advance the time and work out how far along each one is,
+ * ease a batch of those at once, then write the values.  The first two are
+ * loops with no branches or calls, which the compiler can use SSE/AVX/NEON
+ * on like the batch functions in affine2.c, and the easing is picked once a
+ * group rather than once a tween.
+ *
+ * A tween writes straight into a float somewhere else, e.g. a field of an
+ * entity pool column or a transform tree node's local transform, so nothing
+ * has to copy the values out afterwards.  The float has to stay where it is
+ * while it's tweened: cancel the tween before the float goes, or move it
+ * with tween_move_target() when its entity is moved.
+ *
+ * Everything is allocated up front.  Finished tweens are compacted out of
+ * their group in the same update, which leaves their floats at exactly the
+ * value they were going to.
+ */
+
+#include "tween.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// For TWEEN_BACK_OUT, how far it overshoots
+#define TWEEN_BACK_OVERSHOOT 1.70158f
+
+typedef void (*TweenEaseFunc)(float* t, uint32_t count);
+
+static void tween_ease_linear(float* t, uint32_t count) {
+	(void) t;
+	(void) count;
+}
+
+static void tween_ease_quad_in(float* t, uint32_t count) {
+	for (uint32_t i = 0; i < count; i++) {
+		t[i] = t[i] * t[i];
+	}
+}
+
+static void tween_ease_quad_out(float* t, uint32_t count) {
+	for (uint32_t i = 0; i < count; i++) {
+		t[i] = t[i] * (2.0f - t[i]);
+	}
+}
+
+static void tween_ease_quad_in_out(float* t, uint32_t count) {
+	// Both halves are worked out and one picked, so there's no branch
+	for (uint32_t i = 0; i < count; i++) {
+		float u = 1.0f - t[i];
+		float in = 2.0f * t[i] * t[i];
+		float out = 1.0f - 2.0f * u * u;
+		t[i] = t[i] < 0.5f ? in : out;
+	}
+}
+
+static void tween_ease_cubic_in(float* t, uint32_t count) {
+	for (uint32_t i = 0; i < count; i++) {
+		t[i] = t[i] * t[i] * t[i];
+	}
+}
+
+static void tween_ease_cubic_out(float* t, uint32_t count) {
+	for (uint32_t i = 0; i < count; i++) {
+		float u = 1.0f - t[i];
+		t[i] = 1.0f - u * u * u;
+	}
+}
+
+static void tween_ease_cubic_in_out(float* t, uint32_t count) {
+	for (uint32_t i = 0; i < count; i++) {
+		float u = 1.0f - t[i];
+		float in = 4.0f * t[i] * t[i] * t[i];
+		float out = 1.0f - 4.0f * u * u * u;
+		t[i] = t[i] < 0.5f ? in : out;
+	}
+}
+
+static void tween_ease_sine_in_out(float* t, uint32_t count) {
+	/*
+	 * 0.5 - 0.5 cos(pi t), as 0.5 + 0.5 sin(pi (t - 0.5)) with sin's series up
+	 * to x^9 (a few millionths out at the ends), since cosf() would stop the
+	 * loop vectorising.  The end is set exactly when the tween finishes
+	 */
+	const float pi = 3.14159265f;
+	for (uint32_t i = 0; i < count; i++) {
+		float x = (t[i] - 0.5f) * pi;
+		float x2 = x * x;
+		float sine = x * (1.0f - x2 / 6.0f * (1.0f - x2 / 20.0f * (1.0f - x2 / 42.0f * (1.0f - x2 / 72.0f))));
+		t[i] = 0.5f + 0.5f * sine;
+	}
+}
+
+static void tween_ease_back_out(float* t, uint32_t count) {
+	const float c1 = TWEEN_BACK_OVERSHOOT;
+	const float c3 = TWEEN_BACK_OVERSHOOT + 1.0f;
+	for (uint32_t i = 0; i < count; i++) {
+		float u = t[i] - 1.0f;
+		t[i] = 1.0f + c3 * u * u * u + c1 * u * u;
+	}
+}
+
+static const TweenEaseFunc TWEEN_EASE_FUNCS[_TWEEN_EASING_COUNT] = {
+	[TWEEN_LINEAR] = tween_ease_linear,
+	[TWEEN_QUAD_IN] = tween_ease_quad_in,
+	[TWEEN_QUAD_OUT] = tween_ease_quad_out,
+	[TWEEN_QUAD_IN_OUT] = tween_ease_quad_in_out,
+	[TWEEN_CUBIC_IN] = tween_ease_cubic_in,
+	[TWEEN_CUBIC_OUT] = tween_ease_cubic_out,
+	[TWEEN_CUBIC_IN_OUT] = tween_ease_cubic_in_out,
+	[TWEEN_SINE_IN_OUT] = tween_ease_sine_in_out,
+	[TWEEN_BACK_OUT] = tween_ease_back_out,
+};
+
+void tweens_init(Tweens* tweens, uint32_t capacity) {
+	/*
+	 * Set up with no tweens, allocating everything up front
+	 *
+	 * @param capacity The most tweens at once with each easing
+	 */
+	memset(tweens, 0, sizeof(*tweens));
+	tweens->capacity = capacity;
+
+	for (uint32_t i = 0; i < _TWEEN_EASING_COUNT; i++) {
+		TweenGroup* group = &tweens->groups[i];
+		group->targets = malloc(sizeof(float*) * capacity);
+		group->from = malloc(sizeof(float) * capacity);
+		group->to = malloc(sizeof(float) * capacity);
+		group->elapsed = malloc(sizeof(float) * capacity);
+		group->inv_duration = malloc(sizeof(float) * capacity);
+		if (group->targets == NULL || group->from == NULL || group->to == NULL
+				|| group->elapsed == NULL || group->inv_duration == NULL) {
+			fprintf(stderr, "Failed to allocate %u tweens\n", capacity);
+			exit(1);
+		}
+	}
+}
+
+void tweens_cleanup(Tweens* tweens) {
+	for (uint32_t i = 0; i < _TWEEN_EASING_COUNT; i++) {
+		TweenGroup* group = &tweens->groups[i];
+		free(group->targets);
+		free(group->from);
+		free(group->to);
+		free(group->elapsed);
+		free(group->inv_duration);
+	}
+	memset(tweens, 0, sizeof(*tweens));
+}
+
+bool tween_start(Tweens* tweens, float* target, float to, float duration, TweenEasing easing) {
+	/*
+	 * Start easing a float from where it is now to a value.  Any other tween
+	 * of the float carries on too, so cancel it first if there could be one
+	 *
+	 * @param duration In seconds.  0 or less sets it straight away
+	 *
+	 * @return false if the easing's group is full, when the float is left as
+	 *         it is
+	 */
+	if (duration <= 0.0f) {
+		*target = to;
+		return true;
+	}
+
+	TweenGroup* group = &tweens->groups[easing];
+	if (group->count == tweens->capacity) {
+		return false;
+	}
+
+	uint32_t i = group->count++;
+	group->targets[i] = target;
+	group->from[i] = *target;
+	group->to[i] = to;
+	group->elapsed[i] = 0.0f;
+	group->inv_duration[i] = 1.0f / duration;
+	return true;
+}
+
+static void tween_group_move(TweenGroup* group, uint32_t from, uint32_t to) {
+	group->targets[to] = group->targets[from];
+	group->from[to] = group->from[from];
+	group->to[to] = group->to[from];
+	group->elapsed[to] = group->elapsed[from];
+	group->inv_duration[to] = group->inv_duration[from];
+}
+
+uint32_t tween_cancel(Tweens* tweens, const float* target) {
+	/*
+	 * Stop every tween of a float, leaving it where it's got to.  This looks
+	 * through all of the tweens
+	 *
+	 * @return How many there were
+	 */
+	uint32_t cancelled = 0;
+	for (uint32_t i = 0; i < _TWEEN_EASING_COUNT; i++) {
+		TweenGroup* group = &tweens->groups[i];
+		uint32_t kept = 0;
+		for (uint32_t j = 0; j < group->count; j++) {
+			if (group->targets[j] == target) {
+				continue;
+			}
+			if (kept != j) {
+				tween_group_move(group, j, kept);
+			}
+			kept++;
+		}
+		cancelled += group->count - kept;
+		group->count = kept;
+	}
+	return cancelled;
+}
+
+uint32_t tween_move_target(Tweens* tweens, const float* target, float* moved) {
+	/*
+	 * Point the tweens of a float at another one, e.g. when an entity pool
+	 * moves the last entity into a destroyed one's place.  This looks through
+	 * all of the tweens
+	 *
+	 * @return How many there were
+	 */
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < _TWEEN_EASING_COUNT; i++) {
+		TweenGroup* group = &tweens->groups[i];
+		for (uint32_t j = 0; j < group->count; j++) {
+			if (group->targets[j] == target) {
+				group->targets[j] = moved;
+				count++;
+			}
+		}
+	}
+	return count;
+}
+
+uint32_t tweens_count(const Tweens* tweens) {
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < _TWEEN_EASING_COUNT; i++) {
+		count += tweens->groups[i].count;
+	}
+	return count;
+}
+
+static void tween_group_update(TweenGroup* group, TweenEaseFunc ease, float dt) {
+	/*
+	 * Move every tween of a group on and write its value, a batch at a time
+	 */
+	for (uint32_t start = 0; start < group->count; start += TWEEN_BATCH) {
+		uint32_t count = group->count - start < TWEEN_BATCH ? group->count - start : TWEEN_BATCH;
+		float* elapsed = &group->elapsed[start];
+		const float* inv_duration = &group->inv_duration[start];
+		const float* from = &group->from[start];
+		const float* to = &group->to[start];
+		float* const* targets = &group->targets[start];
+
+		float t[TWEEN_BATCH];
+		for (uint32_t i = 0; i < count; i++) {
+			elapsed[i] += dt;
+			t[i] = fminf(elapsed[i] * inv_duration[i], 1.0f);
+		}
+
+		ease(t, count);
+
+		// The only part which doesn't vectorise, as the floats are anywhere
+		for (uint32_t i = 0; i < count; i++) {
+			*targets[i] = from[i] + (to[i] - from[i]) * t[i];
+		}
+	}
+}
+
+uint32_t tweens_update(Tweens* tweens, float dt, float** finished, uint32_t max_finished) {
+	/*
+	 * Move every tween on by a step and write the floats, then take out the
+	 * ones which have finished
+	 *
+	 * @param dt Seconds since the last update
+	 * @param finished Set to the floats of the tweens which finished, e.g. to
+	 *                 start the next ones, or NULL
+	 * @param max_finished Room in finished, anything more isn't given
+	 *
+	 * @return How many were put in finished
+	 */
+	uint32_t finished_count = 0;
+
+	for (uint32_t i = 0; i < _TWEEN_EASING_COUNT; i++) {
+		TweenGroup* group = &tweens->groups[i];
+		if (group->count == 0) {
+			continue;
+		}
+
+		tween_group_update(group, TWEEN_EASE_FUNCS[i], dt);
+
+		uint32_t kept = 0;
+		for (uint32_t j = 0; j < group->count; j++) {
+			if (group->elapsed[j] * group->inv_duration[j] >= 1.0f) {
+				*group->targets[j] = group->to[j];
+				if (finished != NULL && finished_count < max_finished) {
+					finished[finished_count++] = group->targets[j];
+				}
+				continue;
+			}
+			if (kept != j) {
+				tween_group_move(group, j, kept);
+			}
+			kept++;
+		}
+		group->count = kept;
+	}
+
+	return finished_count;
+}
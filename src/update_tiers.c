@@ -0,0 +1,153 @@
+/*
+ * Entities updated less often the further they are from the views, so the
+ * cost of a step goes with what's on screen rather than everything there is.
+ *
+ * Each step every entity is put in a tier by how far it is outside the
+ * rectangle the views see.  The ones in it are tier 0 and are always updated,
+ * and the rest are left for their tier's interval, building up the time they
+ * missed.  However much time an entity has built up is its time step when it
+ * is updated, so one coming into view catches up at once, the step it's seen.
+ *
+ * The ones out of view share what's left of a budget of updates a step after
+ * those in view, taken round robin from wherever the last step stopped, so
+ * when there isn't enough for all of them they all fall behind evenly rather
+ * than some never running.  The budget comes from a time through an estimate
+ * of how long each update takes, from the steps so far.
+ */
+
+#include "update_tiers.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void update_tiers_init(UpdateTiers* tiers, const UpdateTiersDesc* desc, uint32_t capacity) {
+	/*
+	 * Set up the tiers for up to capacity entities, which start with nothing
+	 * built up
+	 */
+	if (desc->tiers_count == 0 || desc->tiers_count > UPDATE_TIERS_MAX) {
+		fprintf(stderr, "Entity updates can have 1 to %d tiers\n", UPDATE_TIERS_MAX);
+		exit(1);
+	}
+	for (uint32_t i = 0; i < desc->tiers_count; i++) {
+		if (desc->intervals[i] > desc->max_dt) {
+			fprintf(stderr, "Tier %u's updates are further apart than the longest time step\n", i);
+			exit(1);
+		}
+	}
+
+	memset(tiers, 0, sizeof(*tiers));
+	tiers->desc = *desc;
+	tiers->capacity = capacity;
+	tiers->tiers = calloc(capacity, sizeof(uint8_t));
+	tiers->pending_dt = calloc(capacity, sizeof(float));
+	tiers->indices = malloc(sizeof(uint32_t) * capacity);
+	tiers->dt = malloc(sizeof(float) * capacity);
+	if (tiers->tiers == NULL || tiers->pending_dt == NULL || tiers->indices == NULL || tiers->dt == NULL) {
+		fprintf(stderr, "Failed to allocate the update tiers of %u entities\n", capacity);
+		exit(1);
+	}
+}
+
+void update_tiers_cleanup(UpdateTiers* tiers) {
+	free(tiers->tiers);
+	free(tiers->pending_dt);
+	free(tiers->indices);
+	free(tiers->dt);
+	memset(tiers, 0, sizeof(*tiers));
+}
+
+uint32_t update_tiers_get_budget(const UpdateTiers* tiers, double budget_ms) {
+	/*
+	 * Work out how many updates fit in a time, for update_tiers_schedule()
+	 *
+	 * @return UINT32_MAX until there's been a step to go by
+	 */
+	if (tiers->update_ns <= 0.0) {
+		return UINT32_MAX;
+	}
+	double updates = budget_ms * 1000000.0 / tiers->update_ns;
+	return updates < (double) UINT32_MAX ? (uint32_t) updates : UINT32_MAX;
+}
+
+void update_tiers_schedule(UpdateTiers* tiers, const float* x, const float* y, uint32_t count,
+		const float visible_rect[4], float dt, uint32_t max_updates) {
+	/*
+	 * Pick the entities to update in a step, into indices and dt
+	 *
+	 * @param x, y The entities' positions, count of them
+	 * @param visible_rect What's in view, as min x, min y, max x, max y,
+	 *                     including any margin for the entities' size
+	 * @param dt The step's time
+	 * @param max_updates Of all the entities, though the ones in view are
+	 *                    updated whatever it is
+	 */
+	if (count > tiers->capacity) {
+		fprintf(stderr, "Too many entities for the update tiers (max %u)\n", tiers->capacity);
+		exit(1);
+	}
+
+	const UpdateTiersDesc* desc = &tiers->desc;
+	uint32_t last_tier = desc->tiers_count - 1;
+	float inv_tier_distance = 1.0f / desc->tier_distance;
+	memset(tiers->tier_counts, 0, sizeof(tiers->tier_counts));
+	tiers->count = 0;
+
+	// Everything is put in its tier, and the ones in view are updated
+	for (uint32_t i = 0; i < count; i++) {
+		float dx = fmaxf(fmaxf(visible_rect[0] - x[i], x[i] - visible_rect[2]), 0.0f);
+		float dy = fmaxf(fmaxf(visible_rect[1] - y[i], y[i] - visible_rect[3]), 0.0f);
+		float distance = fmaxf(dx, dy);
+		uint32_t tier = distance > 0.0f ? 1 + (uint32_t) fminf(distance * inv_tier_distance, (float) last_tier) : 0;
+		tier = tier < last_tier ? tier : last_tier;
+		tiers->tiers[i] = (uint8_t) tier;
+		tiers->tier_counts[tier]++;
+
+		float pending = fminf(tiers->pending_dt[i] + dt, desc->max_dt);
+		if (tier == 0) {
+			tiers->indices[tiers->count] = i;
+			tiers->dt[tiers->count] = pending;
+			tiers->count++;
+			pending = 0.0f;
+		}
+		tiers->pending_dt[i] = pending;
+	}
+
+	// Then whichever of the rest are due, as far as the budget goes
+	uint32_t budget = max_updates > tiers->count ? max_updates - tiers->count : 0;
+	budget = budget > UPDATE_TIERS_MIN_UPDATES ? budget : UPDATE_TIERS_MIN_UPDATES;
+	uint32_t i = tiers->cursor < count ? tiers->cursor : 0;
+	for (uint32_t looked = 0; looked < count && budget > 0; looked++) {
+		uint32_t tier = tiers->tiers[i];
+		if (tier > 0 && tiers->pending_dt[i] >= desc->intervals[tier]) {
+			tiers->indices[tiers->count] = i;
+			tiers->dt[tiers->count] = tiers->pending_dt[i];
+			tiers->count++;
+			tiers->pending_dt[i] = 0.0f;
+			budget--;
+		}
+		i = i + 1 < count ? i + 1 : 0;
+	}
+	tiers->cursor = i;
+}
+
+void update_tiers_end_step(UpdateTiers* tiers, uint64_t elapsed_ns) {
+	/*
+	 * Give how long the updates picked by update_tiers_schedule() took, for
+	 * the estimate update_tiers_get_budget() goes by.  Anything done for all
+	 * the entities whatever their tier is counted in with the updates, so the
+	 * budget is what the whole step takes
+	 */
+	if (tiers->count == 0) {
+		return;
+	}
+	double update_ns = (double) elapsed_ns / tiers->count;
+	if (tiers->update_ns <= 0.0) {
+		tiers->update_ns = update_ns;
+	}
+	else {
+		tiers->update_ns += (update_ns - tiers->update_ns) * UPDATE_TIERS_COST_SMOOTHING;
+	}
+}
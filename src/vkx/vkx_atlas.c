@@ -0,0 +1,613 @@
+/*
+ * Texture atlas packer.
+ *
+ * A set of image files is packed into one 2D array texture at load time, so
+ * everything can be sampled through a single descriptor with the same uniform
+ * access for every draw.  Each source image becomes a region with a page (array
+ * layer) and a scale and offset for turning its texture coordinates into atlas
+ * ones.
+ *
+ * Images are packed onto shelves, tallest first.  Each image goes on the first
+ * shelf it fits, then a new shelf on the current page, then a new page.  All
+ * pages share the same size as they are layers of one image, so this is cut
+ * down to the largest used area at the end.
+ *
+ * When several images are the same size, e.g. the frames of sprite sheets
+ * exported together, the pages are made that size instead and each of them
+ * gets a whole layer, so the atlas is just a texture array of them.  Whatever
+ * else there is gets packed onto pages of the same size after them.  Sampling
+ * a whole layer needs no padding, as the sampler clamps to its edges, and the
+ * mip levels of each are only ever made from its own pixels.
+ */
+
+#include "vkx/vkx_atlas.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vkx/vkx_memory.h"
+#include "vkx/vkx_palette.h"
+#include "vkx/vkx_texture_quality.h"
+#include "vkx/vkx_upload.h"
+#include "io.h"
+#include "jobs.h"
+#include "vendor/stb_image.h"
+
+// At least this many images of the same size are given a layer each
+#define VKX_ATLAS_MIN_LAYER_IMAGES 2
+
+typedef struct {
+	uint32_t layer;
+	uint32_t y;
+	uint32_t height;
+	// Next free x position on the shelf
+	uint32_t x;
+} VkxAtlasShelf;
+
+typedef struct {
+	const char* const* filenames;
+	stbi_uc** pixels;
+	int* widths;
+	int* heights;
+} VkxAtlasDecodeJob;
+
+typedef struct {
+	const VkxAtlas* atlas;
+	stbi_uc* const* pixels;
+	uint8_t* page_pixels;
+} VkxAtlasCopyJob;
+
+static void vkx_atlas_decode_images(size_t start, size_t end, void* data) {
+	VkxAtlasDecodeJob* job = data;
+
+	for (size_t i = start; i < end; i++) {
+		job->pixels[i] = vkx_load_image_pixels(job->filenames[i], &job->widths[i], &job->heights[i]);
+		job->pixels[i] = vkx_reduce_image_quality(job->filenames[i], job->pixels[i], &job->widths[i], &job->heights[i]);
+	}
+}
+
+static void vkx_atlas_copy_images(size_t start, size_t end, void* data) {
+	/*
+	 * Copy images into their regions on the pages, repeating the edge pixels out
+	 * into the padding.  The regions don't overlap so this can run in parallel
+	 */
+	VkxAtlasCopyJob* job = data;
+	const VkxAtlas* atlas = job->atlas;
+	const int32_t padding = VKX_ATLAS_PADDING;
+	size_t page_size = (size_t) atlas->page_width * atlas->page_height * 4;
+
+	for (size_t i = start; i < end; i++) {
+		const VkxAtlasRegion* region = &atlas->regions[i];
+		const stbi_uc* src = job->pixels[i];
+		uint8_t* page = job->page_pixels + page_size * region->layer;
+		int32_t width = (int32_t) region->width;
+		int32_t height = (int32_t) region->height;
+
+		// A region with a whole page has no padding
+		int32_t left = region->x > 0 ? padding : 0;
+		int32_t top = region->y > 0 ? padding : 0;
+		int32_t right = region->x + region->width < atlas->page_width ? padding : 0;
+		int32_t bottom = region->y + region->height < atlas->page_height ? padding : 0;
+
+		for (int32_t y = -top; y < height + bottom; y++) {
+			int32_t src_y = y < 0 ? 0 : (y >= height ? height - 1 : y);
+			uint8_t* dst_row = page + ((size_t) (region->y + y) * atlas->page_width + (region->x - left)) * 4;
+
+			for (int32_t x = -left; x < width + right; x++) {
+				int32_t src_x = x < 0 ? 0 : (x >= width ? width - 1 : x);
+				memcpy(dst_row, src + ((size_t) src_y * width + src_x) * 4, 4);
+				dst_row += 4;
+			}
+		}
+	}
+}
+
+// qsort has no context argument, so the comparison looks the regions up here
+static const VkxAtlasRegion* vkx_atlas_sort_regions = NULL;
+
+static int vkx_atlas_compare_indices(const void* a, const void* b) {
+	// Tallest first, then widest first
+	const VkxAtlasRegion* region_a = &vkx_atlas_sort_regions[*(const uint32_t*) a];
+	const VkxAtlasRegion* region_b = &vkx_atlas_sort_regions[*(const uint32_t*) b];
+
+	if (region_a->height != region_b->height) {
+		return region_a->height > region_b->height ? -1 : 1;
+	}
+	if (region_a->width != region_b->width) {
+		return region_a->width > region_b->width ? -1 : 1;
+	}
+	return 0;
+}
+
+static bool vkx_atlas_find_layer_size(const VkxAtlasRegion* regions, uint32_t count, uint32_t max_page_size,
+		uint32_t* width, uint32_t* height) {
+	/*
+	 * Find the size shared by the most images, the biggest of those if there's
+	 * more than one, to make the pages so they get a layer each
+	 *
+	 * @param width Set to the size, if there is one
+	 * @param height
+	 *
+	 * Returns false if there are fewer than VKX_ATLAS_MIN_LAYER_IMAGES images
+	 * of any size which fits, or if a page that size would be too small for the
+	 * other images
+	 */
+	uint32_t best_count = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t w = regions[i].width;
+		uint32_t h = regions[i].height;
+		if (w > max_page_size || h > max_page_size) {
+			continue;
+		}
+
+		uint32_t same = 0;
+		for (uint32_t j = 0; j < count; j++) {
+			same += regions[j].width == w && regions[j].height == h;
+		}
+		if (same > best_count || (same == best_count && (uint64_t) w * h > (uint64_t) *width * *height)) {
+			best_count = same;
+			*width = w;
+			*height = h;
+		}
+	}
+	if (best_count < VKX_ATLAS_MIN_LAYER_IMAGES) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		bool whole_page = regions[i].width == *width && regions[i].height == *height;
+		if (!whole_page && (regions[i].width + VKX_ATLAS_PADDING * 2 > *width || regions[i].height + VKX_ATLAS_PADDING * 2 > *height)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static uint32_t vkx_atlas_pack(VkxAtlasRegion* regions, uint32_t count, uint32_t page_width, uint32_t page_height) {
+	/*
+	 * Work out where all of the regions go.  Fills in the layer, x and y of every
+	 * region and returns the number of pages used.  Regions as big as a page
+	 * get one each, without padding, and come first as they're the tallest
+	 */
+	uint32_t* order = malloc(sizeof(uint32_t) * count);
+	// Every shelf holds at least one image so there can't be more than that
+	VkxAtlasShelf* shelves = malloc(sizeof(VkxAtlasShelf) * count);
+	if (order == NULL || shelves == NULL) {
+		fprintf(stderr, "Failed to allocate atlas packing arrays\n");
+		exit(1);
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		order[i] = i;
+	}
+
+	vkx_atlas_sort_regions = regions;
+	qsort(order, count, sizeof(uint32_t), vkx_atlas_compare_indices);
+	vkx_atlas_sort_regions = NULL;
+
+	uint32_t shelves_count = 0;
+	uint32_t pages_count = 0;
+	// Used height of the last page
+	uint32_t page_used_height = 0;
+
+	for (uint32_t i = 0; i < count; i++) {
+		VkxAtlasRegion* region = &regions[order[i]];
+		uint32_t padded_width = region->width + VKX_ATLAS_PADDING * 2;
+		uint32_t padded_height = region->height + VKX_ATLAS_PADDING * 2;
+
+		if (region->width == page_width && region->height == page_height) {
+			region->layer = pages_count++;
+			region->x = 0;
+			region->y = 0;
+			// The next shelf goes on a page of its own
+			page_used_height = page_height;
+			continue;
+		}
+
+		if (padded_width > page_width || padded_height > page_height) {
+			fprintf(stderr, "Image of %dx%d is too big for a %dx%d atlas page\n", region->width, region->height, page_width, page_height);
+			exit(1);
+		}
+
+		// Find the first shelf the image fits on
+		VkxAtlasShelf* shelf = NULL;
+		for (uint32_t j = 0; j < shelves_count; j++) {
+			if (shelves[j].height >= padded_height && shelves[j].x + padded_width <= page_width) {
+				shelf = &shelves[j];
+				break;
+			}
+		}
+
+		// Otherwise start a new shelf, on a new page if this one is full
+		if (shelf == NULL) {
+			if (pages_count == 0 || page_used_height + padded_height > page_height) {
+				pages_count++;
+				page_used_height = 0;
+			}
+
+			shelf = &shelves[shelves_count++];
+			shelf->layer = pages_count - 1;
+			shelf->y = page_used_height;
+			shelf->height = padded_height;
+			shelf->x = 0;
+
+			page_used_height += padded_height;
+		}
+
+		region->layer = shelf->layer;
+		region->x = shelf->x + VKX_ATLAS_PADDING;
+		region->y = shelf->y + VKX_ATLAS_PADDING;
+
+		shelf->x += padded_width;
+	}
+
+	free(shelves);
+	free(order);
+
+	return pages_count;
+}
+
+static void vkx_atlas_create_image(VkxAtlas* atlas, const uint8_t* page_pixels, VkFormat format, uint32_t pixel_size,
+		bool generate_mipmaps) {
+	/*
+	 * Create the atlas's image from its pages and queue their upload
+	 *
+	 * @param pixel_size Bytes in each of the pages' pixels
+	 */
+	uint32_t mip_levels = vkx_texture_mip_levels(atlas->page_width, atlas->page_height, generate_mipmaps);
+
+	VkxMemoryTag previous_tag = vkx_memory_set_tag(VKX_MEMORY_TAG_TEXTURES);
+	atlas->image = vkx_create_image_array(
+		atlas->page_width,
+		atlas->page_height,
+		mip_levels,
+		atlas->pages_count,
+		format,
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+	);
+	vkx_memory_set_tag(previous_tag);
+
+	VkxImageUpload upload = {0};
+	upload.image = atlas->image.image;
+	upload.extent.width = atlas->page_width;
+	upload.extent.height = atlas->page_height;
+	upload.mip_levels = mip_levels;
+	upload.array_layers = atlas->pages_count;
+	upload.pixels = page_pixels;
+	upload.size = (VkDeviceSize) atlas->page_width * atlas->page_height * pixel_size * atlas->pages_count;
+
+	vkx_upload_images(1, &upload);
+
+	atlas->image.view = vkx_create_image_array_view(
+		atlas->image.image,
+		format,
+		VK_IMAGE_ASPECT_COLOR_BIT,
+		mip_levels,
+		atlas->pages_count
+	);
+}
+
+VkxAtlas vkx_pack_texture_atlas(const char* const* filenames, uint32_t count, uint32_t max_page_size, uint8_t** page_pixels) {
+	/*
+	 * Load a set of images and pack them onto atlas pages, without creating the
+	 * image.  For atlases which are uploaded some other way, e.g. the sparse one
+	 *
+	 * @param filenames The image files to load
+	 * @param count The number of files
+	 * @param max_page_size The largest width and height of a page.  This is clamped
+	 *                      to the device limit
+	 * @param page_pixels Set to the RGBA pixels of every page, one after another,
+	 *                    to free once they have been uploaded
+	 */
+	VkxAtlas atlas = {0};
+
+	if (count == 0) {
+		fprintf(stderr, "Can't create an empty texture atlas\n");
+		exit(1);
+	}
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(vkx_instance.physical_device, &properties);
+
+	if (max_page_size > properties.limits.maxImageDimension2D) {
+		max_page_size = properties.limits.maxImageDimension2D;
+	}
+
+	// ----- Decode the images -----
+	VkxAtlasDecodeJob decode_job = {0};
+	decode_job.filenames = filenames;
+	decode_job.pixels = calloc(count, sizeof(stbi_uc*));
+	decode_job.widths = calloc(count, sizeof(int));
+	decode_job.heights = calloc(count, sizeof(int));
+	atlas.regions = calloc(count, sizeof(VkxAtlasRegion));
+	atlas.regions_count = count;
+
+	if (decode_job.pixels == NULL || decode_job.widths == NULL || decode_job.heights == NULL || atlas.regions == NULL) {
+		fprintf(stderr, "Failed to allocate texture atlas arrays\n");
+		exit(1);
+	}
+
+	jobs_parallel_for(count, 1, vkx_atlas_decode_images, &decode_job);
+
+	for (uint32_t i = 0; i < count; i++) {
+		if (!decode_job.pixels[i]) {
+			fprintf(stderr, "failed to load texture image %s!\n", filenames[i]);
+			exit(1);
+		}
+
+		atlas.regions[i].width = (uint32_t) decode_job.widths[i];
+		atlas.regions[i].height = (uint32_t) decode_job.heights[i];
+	}
+
+	// ----- Pack them -----
+	uint32_t page_width = max_page_size;
+	uint32_t page_height = max_page_size;
+	bool layered = vkx_atlas_find_layer_size(atlas.regions, count, max_page_size, &page_width, &page_height);
+	atlas.pages_count = vkx_atlas_pack(atlas.regions, count, page_width, page_height);
+
+	if (atlas.pages_count > properties.limits.maxImageArrayLayers) {
+		fprintf(stderr, "Texture atlas needs %d pages but the device only supports %d\n",
+			atlas.pages_count, properties.limits.maxImageArrayLayers);
+		exit(1);
+	}
+
+	// Shrink the pages down to the area that was actually used, unless some
+	// use all of it
+	atlas.page_width = layered ? page_width : 0;
+	atlas.page_height = layered ? page_height : 0;
+	for (uint32_t i = 0; i < count && !layered; i++) {
+		uint32_t right = atlas.regions[i].x + atlas.regions[i].width + VKX_ATLAS_PADDING;
+		uint32_t bottom = atlas.regions[i].y + atlas.regions[i].height + VKX_ATLAS_PADDING;
+		if (right > atlas.page_width) {
+			atlas.page_width = right;
+		}
+		if (bottom > atlas.page_height) {
+			atlas.page_height = bottom;
+		}
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		VkxAtlasRegion* region = &atlas.regions[i];
+		region->uv_offset[0] = (float) region->x / atlas.page_width;
+		region->uv_offset[1] = (float) region->y / atlas.page_height;
+		region->uv_scale[0] = (float) region->width / atlas.page_width;
+		region->uv_scale[1] = (float) region->height / atlas.page_height;
+	}
+
+	// ----- Copy the images onto the pages -----
+	VkDeviceSize pages_size = (VkDeviceSize) atlas.page_width * atlas.page_height * 4 * atlas.pages_count;
+
+	VkxAtlasCopyJob copy_job = {0};
+	copy_job.atlas = &atlas;
+	copy_job.pixels = decode_job.pixels;
+	// Anything not covered by an image is left transparent
+	copy_job.page_pixels = calloc(1, (size_t) pages_size);
+
+	if (copy_job.page_pixels == NULL) {
+		fprintf(stderr, "Failed to allocate texture atlas pages\n");
+		exit(1);
+	}
+
+	jobs_parallel_for(count, 1, vkx_atlas_copy_images, &copy_job);
+
+	for (uint32_t i = 0; i < count; i++) {
+		stbi_image_free(decode_job.pixels[i]);
+	}
+
+	if (layered) {
+		uint32_t layers_count = 0;
+		for (uint32_t i = 0; i < count; i++) {
+			layers_count += atlas.regions[i].width == page_width && atlas.regions[i].height == page_height;
+		}
+		printf("Gave %d images a texture atlas page each and packed %d more, into %d %dx%d pages\n",
+			layers_count, count - layers_count, atlas.pages_count, atlas.page_width, atlas.page_height);
+	}
+	else {
+		printf("Packed %d images into %d %dx%d texture atlas pages\n",
+			count, atlas.pages_count, atlas.page_width, atlas.page_height);
+	}
+
+	free(decode_job.heights);
+	free(decode_job.widths);
+	free(decode_job.pixels);
+
+	*page_pixels = copy_job.page_pixels;
+	return atlas;
+}
+
+VkxAtlas vkx_create_texture_atlas(const char* const* filenames, uint32_t count, uint32_t max_page_size, bool generate_mipmaps) {
+	/*
+	 * Load a set of images and pack them into an atlas.  As with the other texture
+	 * loaders the upload is queued, so vkx_upload_flush() must be called before the
+	 * atlas is used
+	 *
+	 * @param filenames The image files to load
+	 * @param count The number of files
+	 * @param max_page_size The largest width and height of a page.  This is clamped
+	 *                      to the device limit
+	 * @param generate_mipmaps Generate a full mip chain for the pages on the GPU
+	 */
+	uint8_t* page_pixels = NULL;
+	VkxAtlas atlas = vkx_pack_texture_atlas(filenames, count, max_page_size, &page_pixels);
+
+	vkx_atlas_create_image(&atlas, page_pixels, VK_FORMAT_R8G8B8A8_SRGB, 4, generate_mipmaps);
+
+	free(page_pixels);
+	return atlas;
+}
+
+VkxAtlas vkx_create_palette_atlas(const char* const* filenames, uint32_t count, uint32_t max_page_size, uint8_t palette[VKX_PALETTE_COLOURS * 4]) {
+	/*
+	 * Load a set of images and pack them into an atlas of palette indices (see
+	 * vkx_palette.c), one R8_UNORM byte per pixel for the shaders to look up in
+	 * a palette image.  There are no mip levels, as indices can't be filtered.
+	 * The upload is queued, as with vkx_create_texture_atlas()
+	 *
+	 * @param palette Set to the colours the images were quantised to
+	 */
+	uint8_t* page_pixels = NULL;
+	VkxAtlas atlas = vkx_pack_texture_atlas(filenames, count, max_page_size, &page_pixels);
+
+	size_t pixels_count = (size_t) atlas.page_width * atlas.page_height * atlas.pages_count;
+	uint8_t* index_pixels = malloc(pixels_count);
+	if (index_pixels == NULL) {
+		fprintf(stderr, "Failed to allocate texture atlas pages\n");
+		exit(1);
+	}
+	vkx_quantise_pixels(page_pixels, pixels_count, index_pixels, palette);
+	free(page_pixels);
+
+	vkx_atlas_create_image(&atlas, index_pixels, VK_FORMAT_R8_UNORM, 1, false);
+
+	free(index_pixels);
+	return atlas;
+}
+
+VkxAtlas vkx_create_atlas_like(const VkxAtlas* layout, const char* const* filenames, const uint8_t fill[4], bool generate_mipmaps) {
+	/*
+	 * Pack another set of images into an atlas laid out the same as one which
+	 * already exists, e.g. normal maps for its textures, so that both are
+	 * sampled with the same texture coordinates.  The upload is queued, as with
+	 * vkx_create_texture_atlas().  The pixels are linear (UNORM) rather than sRGB
+	 *
+	 * @param layout The atlas to copy the layout of
+	 * @param filenames An image for each of its regions, or NULL.  Files which
+	 *                  don't exist, or aren't the same size as the region, are
+	 *                  left as fill
+	 * @param fill The colour of every pixel without an image
+	 */
+	VkxAtlas atlas = *layout;
+	atlas.image = (VkxImage) {0};
+	atlas.regions = malloc(sizeof(VkxAtlasRegion) * layout->regions_count);
+	if (atlas.regions == NULL) {
+		fprintf(stderr, "Failed to allocate texture atlas arrays\n");
+		exit(1);
+	}
+	memcpy(atlas.regions, layout->regions, sizeof(VkxAtlasRegion) * layout->regions_count);
+
+	// Only decode the images which are there
+	uint32_t count = atlas.regions_count;
+	uint32_t* present = malloc(sizeof(uint32_t) * count);
+	const char** present_filenames = malloc(sizeof(char*) * count);
+	stbi_uc** region_pixels = malloc(sizeof(stbi_uc*) * count);
+	if (present == NULL || present_filenames == NULL || region_pixels == NULL) {
+		fprintf(stderr, "Failed to allocate texture atlas arrays\n");
+		exit(1);
+	}
+
+	uint32_t present_count = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		if (filenames[i] != NULL && asset_exists(filenames[i])) {
+			present[present_count] = i;
+			present_filenames[present_count] = filenames[i];
+			present_count++;
+		}
+	}
+
+	VkxAtlasDecodeJob decode_job = {0};
+	decode_job.filenames = present_filenames;
+	decode_job.pixels = calloc(count, sizeof(stbi_uc*));
+	decode_job.widths = calloc(count, sizeof(int));
+	decode_job.heights = calloc(count, sizeof(int));
+	if (decode_job.pixels == NULL || decode_job.widths == NULL || decode_job.heights == NULL) {
+		fprintf(stderr, "Failed to allocate texture atlas arrays\n");
+		exit(1);
+	}
+
+	jobs_parallel_for(present_count, 1, vkx_atlas_decode_images, &decode_job);
+
+	// The rest are copied from an image of the fill colour as big as the
+	// largest region, and anything not covered by a region is the fill too
+	uint32_t max_pixels = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t pixels = atlas.regions[i].width * atlas.regions[i].height;
+		max_pixels = pixels > max_pixels ? pixels : max_pixels;
+	}
+
+	VkDeviceSize pages_size = (VkDeviceSize) atlas.page_width * atlas.page_height * 4 * atlas.pages_count;
+	uint8_t* fill_pixels = malloc((size_t) max_pixels * 4);
+	uint8_t* page_pixels = malloc((size_t) pages_size);
+	if (fill_pixels == NULL || page_pixels == NULL) {
+		fprintf(stderr, "Failed to allocate texture atlas pages\n");
+		exit(1);
+	}
+	for (size_t i = 0; i < (size_t) max_pixels; i++) {
+		memcpy(fill_pixels + i * 4, fill, 4);
+	}
+	for (size_t i = 0; i < (size_t) pages_size / 4; i++) {
+		memcpy(page_pixels + i * 4, fill, 4);
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		region_pixels[i] = fill_pixels;
+	}
+
+	uint32_t used_count = 0;
+	for (uint32_t i = 0; i < present_count; i++) {
+		const VkxAtlasRegion* region = &atlas.regions[present[i]];
+		if (!decode_job.pixels[i]) {
+			fprintf(stderr, "failed to load texture image %s!\n", present_filenames[i]);
+			exit(1);
+		}
+		if ((uint32_t) decode_job.widths[i] != region->width || (uint32_t) decode_job.heights[i] != region->height) {
+			printf("%s isn't the same size as its texture, so it isn't used\n", present_filenames[i]);
+			continue;
+		}
+		region_pixels[present[i]] = decode_job.pixels[i];
+		used_count++;
+	}
+
+	VkxAtlasCopyJob copy_job = {0};
+	copy_job.atlas = &atlas;
+	copy_job.pixels = region_pixels;
+	copy_job.page_pixels = page_pixels;
+
+	jobs_parallel_for(count, 1, vkx_atlas_copy_images, &copy_job);
+
+	for (uint32_t i = 0; i < present_count; i++) {
+		stbi_image_free(decode_job.pixels[i]);
+	}
+
+	vkx_atlas_create_image(&atlas, page_pixels, VK_FORMAT_R8G8B8A8_UNORM, 4, generate_mipmaps);
+
+	printf("Packed %d of %d images into a matching texture atlas\n", used_count, count);
+
+	free(page_pixels);
+	free(fill_pixels);
+	free(decode_job.heights);
+	free(decode_job.widths);
+	free(decode_job.pixels);
+	free(region_pixels);
+	free(present_filenames);
+	free(present);
+
+	return atlas;
+}
+
+void vkx_cleanup_atlas(VkxAtlas* atlas) {
+	vkx_cleanup_image(&atlas->image);
+	free(atlas->regions);
+	atlas->regions = NULL;
+	atlas->regions_count = 0;
+	atlas->pages_count = 0;
+}
+
+void vkx_atlas_map_uv(const VkxAtlas* atlas, uint32_t region_index, const float uv[2], float out_uv[2]) {
+	/*
+	 * Turn texture coordinates for one of the source images into atlas texture
+	 * coordinates.  The page to sample is atlas->regions[region_index].layer
+	 *
+	 * @param atlas The atlas
+	 * @param region_index The index of the source image
+	 * @param uv Texture coordinates in the source image
+	 * @param out_uv Set to the coordinates in the atlas (can be the same as uv)
+	 */
+	const VkxAtlasRegion* region = &atlas->regions[region_index];
+	float u = region->uv_offset[0] + uv[0] * region->uv_scale[0];
+	float v = region->uv_offset[1] + uv[1] * region->uv_scale[1];
+	out_uv[0] = u;
+	out_uv[1] = v;
+}
@@ -0,0 +1,58 @@
+/*
+ * Per frame counts of the draws, binds, barriers, push constants, uploads and
+ * submits.
+ *
+ * With VKX_COMMAND_STATS, vkx_command_stats.h wraps the Vulkan calls made
+ * directly in macros which count them before making the call, and
+ * VKX_COUNT_COMMANDS() counts the rest (the extension commands called through
+ * pointers, and the bytes written for the GPU).  The counts are atomic, as the
+ * job workers record secondary command buffers at the same time as the render
+ * thread.  vkx_command_stats_end_frame() takes them once a frame and starts
+ * again.  Without it the macros aren't there, so there's no cost.
+ */
+
+#include "vkx/vkx_command_stats.h"
+
+#include <SDL3/SDL.h>
+
+static SDL_AtomicInt counts[_VKX_STAT_COUNT] = {0};
+
+static const char* const stat_names[_VKX_STAT_COUNT] = {
+	[VKX_STAT_DRAWS] = "draws",
+	[VKX_STAT_DISPATCHES] = "dispatches",
+	[VKX_STAT_PIPELINE_BINDS] = "pipeline_binds",
+	[VKX_STAT_DESCRIPTOR_BINDS] = "descriptor_binds",
+	[VKX_STAT_BARRIERS] = "barriers",
+	[VKX_STAT_PUSH_CONSTANTS] = "push_constants",
+	[VKX_STAT_UPLOAD_BYTES] = "upload_bytes",
+	[VKX_STAT_SUBMITS] = "submits",
+};
+
+bool vkx_command_stats_enabled(void) {
+#ifdef VKX_COMMAND_STATS
+	return true;
+#else
+	return false;
+#endif
+}
+
+const char* vkx_command_stat_name(VkxCommandStat stat) {
+	// e.g. for telemetry gauges
+	return stat_names[stat];
+}
+
+void vkx_command_stats_add(VkxCommandStat stat, uint32_t count) {
+	SDL_AddAtomicInt(&counts[stat], (int) count);
+}
+
+void vkx_command_stats_end_frame(VkxCommandStats* stats) {
+	/*
+	 * Take the counts since the last call, and start again from 0.  Whatever
+	 * another thread counts at the same time goes in one frame or the other
+	 *
+	 * @param stats Set to the counts
+	 */
+	for (uint32_t i = 0; i < _VKX_STAT_COUNT; i++) {
+		stats->counts[i] = (uint32_t) SDL_SetAtomicInt(&counts[i], 0);
+	}
+}
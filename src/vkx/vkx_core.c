@@ -1,87 +1,174 @@
 #include "vkx/vkx_core.h"
 
+#include <SDL3/SDL.h>
+
+#include <math.h>
 #include <stdlib.h>
+#include <string.h>
 #include <vulkan/vulkan.h>
 #include <stdio.h>
 
+#include "vkx/vkx_memory.h"
+#include "vkx/vkx_pipeline.h"
+#include "vkx/vkx_texture_cache.h"
+#include "vkx/vkx_texture_quality.h"
+#include "vkx/vkx_upload.h"
+#include "arena.h"
+#include "io.h"
+#include "jobs.h"
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "vendor/stb_image.h"
 
 VkxInstance vkx_instance = {0};
 VkxSwapChain vkx_swap_chain = {0};
-VkxFrameSyncObjects vkx_frame_sync_objects[VKX_FRAMES_IN_FLIGHT] = {0};
+VkxFrame vkx_frames[VKX_MAX_FRAMES_IN_FLIGHT] = {0};
 
 VkxSwapChainSupportDetails vkx_query_swap_chain_support(VkPhysicalDevice device, VkSurfaceKHR surface) {
+	/*
+	 * Get what a surface supports.  The formats and present modes are in the
+	 * calling thread's frame arena, so take a mark beforehand to give them back
+	 */
 	VkxSwapChainSupportDetails details = {0};
 
 	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &details.capabilities);
 
 	vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &details.formats_count, NULL);
-	details.formats = malloc(sizeof(VkSurfaceFormatKHR) * details.formats_count);
+	details.formats = FRAME_ALLOC(VkSurfaceFormatKHR, details.formats_count);
 	vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &details.formats_count, details.formats);
 
 	vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &details.present_modes_count, NULL);
-	details.present_modes = malloc(sizeof(VkPresentModeKHR) * details.present_modes_count);
+	details.present_modes = FRAME_ALLOC(VkPresentModeKHR, details.present_modes_count);
 	vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &details.present_modes_count, details.present_modes);
 	
 	return details;
 }
 
-void vkx_free_swap_chain_support(VkxSwapChainSupportDetails* details) {
-	free(details->formats);
-	free(details->present_modes);
-}
-
 VkxQueueFamilyIndices vkx_find_queue_families(VkPhysicalDevice device, VkSurfaceKHR surface) {
 	VkxQueueFamilyIndices indices = {0};
 
 	uint32_t queue_family_count = 0;
 	vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count, NULL);
 
-	VkQueueFamilyProperties* queue_families = malloc(sizeof(VkQueueFamilyProperties) * queue_family_count);
+	Arena* arena = frame_arena();
+	size_t arena_mark = arena_get_mark(arena);
+	VkQueueFamilyProperties* queue_families = FRAME_ALLOC(VkQueueFamilyProperties, queue_family_count);
 	vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count, queue_families);
 
+	// Prefer a transfer family that can't do compute either, as that is most
+	// likely to be backed by a DMA engine
+	bool transfer_family_has_compute = false;
+	// Compute work is recorded on the graphics queue, so prefer a graphics family
+	// which can do compute as well (in practice this is always the first one)
+	bool graphics_family_has_compute = false;
+
 	for (uint32_t i = 0; i < queue_family_count; i++) {
-		if (queue_families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-			indices.graphics_family = i;
-			indices.has_graphics_family = true;
+		VkQueueFlags flags = queue_families[i].queueFlags;
+
+		if (flags & VK_QUEUE_GRAPHICS_BIT) {
+			bool has_compute = (flags & VK_QUEUE_COMPUTE_BIT) != 0;
+			if (!indices.has_graphics_family || (!graphics_family_has_compute && has_compute)) {
+				indices.graphics_family = i;
+				indices.has_graphics_family = true;
+				graphics_family_has_compute = has_compute;
+			}
 		}
 
+		// Without a surface (headless) nothing is presented, so the graphics
+		// family stands in for the present one
 		VkBool32 present_support = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &present_support);
+		if (surface != VK_NULL_HANDLE) {
+			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &present_support);
+		}
 
-		if (present_support) {
+		if (!indices.has_present_family && present_support) {
 			indices.present_family = i;
 			indices.has_present_family = true;
 		}
 
-		if (indices.has_graphics_family && indices.has_present_family) {
-			break;
+		if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT)) {
+			bool has_compute = (flags & VK_QUEUE_COMPUTE_BIT) != 0;
+			if (!indices.has_transfer_family || (transfer_family_has_compute && !has_compute)) {
+				indices.transfer_family = i;
+				indices.has_transfer_family = true;
+				transfer_family_has_compute = has_compute;
+			}
+		}
+	}
+
+	// Async compute prefers a family of its own, but can have a second queue of
+	// the transfer family
+	for (uint32_t i = 0; i < queue_family_count; i++) {
+		VkQueueFlags flags = queue_families[i].queueFlags;
+		if (!(flags & VK_QUEUE_COMPUTE_BIT) || (flags & VK_QUEUE_GRAPHICS_BIT)) {
+			continue;
+		}
+
+		bool shares_transfer = indices.has_transfer_family && indices.transfer_family == i;
+		if (shares_transfer && queue_families[i].queueCount < 2) {
+			continue;
+		}
+
+		if (!indices.has_compute_family || indices.compute_queue_index > 0) {
+			indices.compute_family = i;
+			indices.compute_queue_index = shares_transfer ? 1 : 0;
+			indices.has_compute_family = true;
 		}
 	}
 
-	free(queue_families);
+	// Presents can have a queue of their own in the graphics family, so they
+	// don't have to be synchronised with the graphics submits
+	if (indices.has_present_family && indices.has_graphics_family && indices.present_family == indices.graphics_family
+			&& queue_families[indices.graphics_family].queueCount >= 2) {
+		indices.present_queue_index = 1;
+	}
+
+	arena_release(arena, arena_mark);
+
+	if (surface == VK_NULL_HANDLE && indices.has_graphics_family) {
+		indices.present_family = indices.graphics_family;
+		indices.has_present_family = true;
+	}
 
 	return indices;
 }
 
-static uint32_t vkx_find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties) {
+uint32_t vkx_find_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties) {
 	/*
 	 * See https://vulkan-tutorial.com/Vertex_buffers/Staging_buffer#page_Memory_types
-	 * for an explanation of how this works
+	 * for an explanation of how this works.  Of the types with all of the
+	 * properties, the one with the fewest others is used, so e.g. staging buffers
+	 * don't end up in the small host visible device local heap just because its
+	 * type comes first
 	 */
 	VkPhysicalDeviceMemoryProperties mem_properties;
 	vkGetPhysicalDeviceMemoryProperties(vkx_instance.physical_device, &mem_properties);
 
+	uint32_t best_type = UINT32_MAX;
+	uint32_t best_extra_flags = UINT32_MAX;
 	for (uint32_t i = 0; i < mem_properties.memoryTypeCount; i++) {
-		if ((type_filter & (1 << i))
-				&& (mem_properties.memoryTypes[i].propertyFlags & properties) == properties) {
-			return i;
+		VkMemoryPropertyFlags flags = mem_properties.memoryTypes[i].propertyFlags;
+		if (!(type_filter & (1 << i)) || (flags & properties) != properties) {
+			continue;
+		}
+
+		uint32_t extra_flags = 0;
+		for (VkMemoryPropertyFlags extra = flags & ~properties; extra != 0; extra &= extra - 1) {
+			extra_flags++;
+		}
+
+		if (extra_flags < best_extra_flags) {
+			best_type = i;
+			best_extra_flags = extra_flags;
 		}
 	}
 
-	fprintf(stderr, "failed to find suitable memory type!");
-	exit(1);
+	if (best_type == UINT32_MAX) {
+		fprintf(stderr, "failed to find suitable memory type!");
+		exit(1);
+	}
+
+	return best_type;
 }
 
 VkxBuffer vkx_create_buffer(VkDeviceSize size, VkBufferUsageFlags usage,
@@ -95,7 +182,7 @@ VkxBuffer vkx_create_buffer(VkDeviceSize size, VkBufferUsageFlags usage,
 	buffer_info.usage = usage;
 	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-	if (vkCreateBuffer(vkx_instance.device, &buffer_info, NULL, &buffer.buffer) != VK_SUCCESS) {
+	if (vkCreateBuffer(vkx_instance.device, &buffer_info, vkx_get_allocator(VK_OBJECT_TYPE_BUFFER), &buffer.buffer) != VK_SUCCESS) {
 		fprintf(stderr, "Failed to create buffer");
 		exit(1);
 	}
@@ -103,35 +190,414 @@ VkxBuffer vkx_create_buffer(VkDeviceSize size, VkBufferUsageFlags usage,
 	VkMemoryRequirements mem_requirements = {0};
 	vkGetBufferMemoryRequirements(vkx_instance.device, buffer.buffer, &mem_requirements);
 
-	VkMemoryAllocateInfo alloc_info = {0};
-	alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	alloc_info.allocationSize = mem_requirements.size;
-	alloc_info.memoryTypeIndex = vkx_find_memory_type(mem_requirements.memoryTypeBits, properties);
+	// Host visible buffers come back already mapped (see buffer.allocation.mapped)
+	buffer.allocation = vkx_memory_alloc(mem_requirements, properties, true);
+
+	vkBindBufferMemory(vkx_instance.device, buffer.buffer, buffer.allocation.memory, buffer.allocation.offset);
+
+	return buffer;
+}
+
+void vkx_cleanup_buffer(VkxBuffer* buffer) {
+	vkDestroyBuffer(vkx_instance.device, buffer->buffer, vkx_get_allocator(VK_OBJECT_TYPE_BUFFER));
+	vkx_memory_free(&buffer->allocation);
+
+	buffer->buffer = VK_NULL_HANDLE;
+}
+
+VkDeviceAddress vkx_get_buffer_address(VkBuffer buffer) {
+	/*
+	 * Get where a buffer is for shaders to read through a pointer.  It must
+	 * have been made with VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT, which
+	 * needs vkx_instance.has_buffer_device_address
+	 */
+	VkBufferDeviceAddressInfo address_info = {0};
+	address_info.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+	address_info.buffer = buffer;
+	return vkGetBufferDeviceAddress(vkx_instance.device, &address_info);
+}
+
+VkxBuffer vkx_import_host_buffer(const void* data, VkDeviceSize size, VkBufferUsageFlags usage, VkDeviceSize* data_offset) {
+	/*
+	 * Make a buffer out of host memory that's already there, e.g. an array, an
+	 * arena or a mapped file, so the device reads it where it is rather than
+	 * from a copy.  The import has to start and end on
+	 * vkx_instance.host_pointer_alignment, so it takes in the rest of the
+	 * pages the data is in, and the data is at *data_offset in the buffer.
+	 * The memory has to stay allocated until the buffer has been destroyed,
+	 * and unchanged for as long as the device reads it
+	 *
+	 * @return A buffer of VK_NULL_HANDLE if the memory can't be imported, to
+	 *         copy it instead
+	 */
+	VkxBuffer buffer = {0};
+	if (!vkx_instance.has_external_memory_host || data == NULL || size == 0) {
+		return buffer;
+	}
+
+	uintptr_t alignment = (uintptr_t) vkx_instance.host_pointer_alignment;
+	uintptr_t start = (uintptr_t) data / alignment * alignment;
+	uintptr_t end = ((uintptr_t) data + (uintptr_t) size + alignment - 1) / alignment * alignment;
+
+	VkExternalMemoryBufferCreateInfo external_info = {0};
+	external_info.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO;
+	external_info.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+
+	VkBufferCreateInfo buffer_info = {0};
+	buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	buffer_info.pNext = &external_info;
+	buffer_info.size = end - start;
+	buffer_info.usage = usage;
+	buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-	if (vkAllocateMemory(vkx_instance.device, &alloc_info, NULL, &buffer.memory) != VK_SUCCESS) {
-		fprintf(stderr, "Failed to allocate buffer memory");
+	if (vkCreateBuffer(vkx_instance.device, &buffer_info, vkx_get_allocator(VK_OBJECT_TYPE_BUFFER), &buffer.buffer) != VK_SUCCESS) {
+		fprintf(stderr, "Failed to create buffer");
 		exit(1);
 	}
 
-	vkBindBufferMemory(vkx_instance.device, buffer.buffer, buffer.memory, 0);
+	// The memory is only what was imported, so the buffer can't need more.
+	// Vulkan takes the pointer as writable, but importing doesn't write to it
+	VkMemoryRequirements mem_requirements = {0};
+	vkGetBufferMemoryRequirements(vkx_instance.device, buffer.buffer, &mem_requirements);
+	if (mem_requirements.size > end - start
+			|| !vkx_memory_import_host((void*) start, end - start, mem_requirements.memoryTypeBits, &buffer.allocation)) {
+		vkDestroyBuffer(vkx_instance.device, buffer.buffer, vkx_get_allocator(VK_OBJECT_TYPE_BUFFER));
+		buffer.buffer = VK_NULL_HANDLE;
+		return buffer;
+	}
 
+	vkBindBufferMemory(vkx_instance.device, buffer.buffer, buffer.allocation.memory, buffer.allocation.offset);
+
+	*data_offset = (VkDeviceSize) ((uintptr_t) data - start);
 	return buffer;
 }
 
-void vkx_cleanup_buffer(VkxBuffer* buffer) {
-	vkDestroyBuffer(vkx_instance.device, buffer->buffer, NULL);
-	vkFreeMemory(vkx_instance.device, buffer->memory, NULL);
+static VkDeviceSize vkx_align_up(VkDeviceSize value, VkDeviceSize alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
 
-	buffer->buffer = VK_NULL_HANDLE;
-	buffer->memory = VK_NULL_HANDLE;
+VkxRingBuffer vkx_create_ring_buffer(VkDeviceSize frame_size, VkBufferUsageFlags usage, bool prefer_device_local) {
+	/*
+	 * Create a persistently mapped, host coherent buffer with a region for each
+	 * frame in flight.  All of the data in a frame's region must be written after
+	 * that frame's fence has been waited on
+	 *
+	 * @param frame_size The number of bytes available to each frame
+	 * @param usage How the buffer will be used (i.e. uniform and/or storage)
+	 * @param prefer_device_local Put it in device local memory if the CPU can
+	 *        write there (resizable BAR or unified memory), so the GPU doesn't
+	 *        read it over PCIe.  The CPU should then only write to it, as reads
+	 *        are uncached
+	 */
+	VkxRingBuffer ring = {0};
+
+	// Every allocation must satisfy the offset alignment for the usages we support
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(vkx_instance.physical_device, &properties);
+
+	ring.alignment = 16;
+	if ((usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT) && properties.limits.minUniformBufferOffsetAlignment > ring.alignment) {
+		ring.alignment = properties.limits.minUniformBufferOffsetAlignment;
+	}
+	if ((usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT) && properties.limits.minStorageBufferOffsetAlignment > ring.alignment) {
+		ring.alignment = properties.limits.minStorageBufferOffsetAlignment;
+	}
+
+	ring.frame_size = vkx_align_up(frame_size, ring.alignment);
+
+	VkDeviceSize total_size = ring.frame_size * vkx_instance.frames_in_flight;
+
+	VkMemoryPropertyFlags memory_properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	if (prefer_device_local && vkx_memory_has_mapped_device_local(total_size)) {
+		memory_properties |= VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		printf(" Putting the %llu KiB ring buffer in host visible device local memory\n", (unsigned long long) (total_size / 1024));
+	}
+
+	ring.buffer = vkx_create_buffer(total_size, usage, memory_properties);
+
+	// Host visible memory is always mapped by the allocator
+	ring.mapped = ring.buffer.allocation.mapped;
+
+	return ring;
 }
 
-VkImageView vkx_create_image_view(VkImage image, VkFormat format,
-		VkImageAspectFlags aspect_flags) {
+void vkx_ring_buffer_begin_frame(VkxRingBuffer* ring, uint32_t frame) {
+	/*
+	 * Start allocating from the region for the given frame, discarding everything
+	 * that was allocated the last time it was used
+	 *
+	 * @param ring The ring buffer
+	 * @param frame The index of the frame in flight
+	 */
+	ring->frame_start = ring->frame_size * (frame % vkx_instance.frames_in_flight);
+	ring->head = 0;
+}
+
+VkxRingAllocation vkx_ring_buffer_alloc(VkxRingBuffer* ring, VkDeviceSize size) {
+	/*
+	 * Allocate an aligned slice of the current frame's region.  There is no free,
+	 * everything is released by the next vkx_ring_buffer_begin_frame() for the frame
+	 *
+	 * @param ring The ring buffer
+	 * @param size The number of bytes to allocate
+	 */
+	VkDeviceSize offset = vkx_align_up(ring->head, ring->alignment);
+
+	if (offset + size > ring->frame_size) {
+		fprintf(stderr, "Ring buffer out of space (requested %llu bytes, %llu of %llu used)\n",
+			(unsigned long long) size, (unsigned long long) ring->head, (unsigned long long) ring->frame_size);
+		exit(1);
+	}
+
+	ring->head = offset + size;
+	VKX_COUNT_COMMANDS(VKX_STAT_UPLOAD_BYTES, size);
+
+	VkxRingAllocation allocation = {0};
+	allocation.offset = ring->frame_start + offset;
+	allocation.data = ring->mapped + allocation.offset;
+
+	return allocation;
+}
+
+void vkx_cleanup_ring_buffer(VkxRingBuffer* ring) {
+	vkx_cleanup_buffer(&ring->buffer);
+	ring->mapped = NULL;
+}
+
+// ----- Frame timeline -----
+
+uint64_t vkx_frame_timeline_pending(void) {
+	/*
+	 * The value the next frame submission will signal.  Anything the frames
+	 * recorded so far could be using is free once this has completed
+	 */
+	return vkx_instance.frame_timeline_value;
+}
+
+uint64_t vkx_frame_timeline_signal(void) {
+	/*
+	 * Take the value for a submission to signal on vkx_instance.frame_timeline.
+	 * The submissions must go to the graphics queue in the order they take
+	 * their values, as a timeline can only ever increase
+	 *
+	 * @return The value to signal
+	 */
+	return vkx_instance.frame_timeline_value++;
+}
+
+uint64_t vkx_frame_timeline_completed(void) {
+	// The last value the GPU has signalled
+	uint64_t completed = 0;
+	vkGetSemaphoreCounterValue(vkx_instance.device, vkx_instance.frame_timeline, &completed);
+	return completed;
+}
+
+void vkx_frame_timeline_wait(uint64_t value) {
+	/*
+	 * Block until the GPU has signalled a value on the frame timeline
+	 *
+	 * @param value From vkx_frame_timeline_signal(), or 0 to not wait
+	 */
+	if (value == 0) {
+		return;
+	}
+
+	VkSemaphoreWaitInfo wait_info = {0};
+	wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	wait_info.semaphoreCount = 1;
+	wait_info.pSemaphores = &vkx_instance.frame_timeline;
+	wait_info.pValues = &value;
+
+	if (vkWaitSemaphores(vkx_instance.device, &wait_info, UINT64_MAX) != VK_SUCCESS) {
+		fprintf(stderr, "failed to wait for the frame timeline!\n");
+		exit(1);
+	}
+}
+
+// ----- Deferred destruction -----
+
+typedef enum {
+	VKX_DEFERRED_CALLBACK,
+	VKX_DEFERRED_BUFFER,
+	VKX_DEFERRED_IMAGE,
+	VKX_DEFERRED_IMAGE_VIEW,
+	VKX_DEFERRED_PIPELINE,
+	VKX_DEFERRED_ALLOCATION,
+} VkxDeferredType;
+
+typedef struct {
+	VkxDeferredType type;
+	// The handles are copied in, so the common cases don't need an allocation
+	union {
+		struct {
+			VkxDeferredDestroyFunc func;
+			void* data;
+		} callback;
+		VkxBuffer buffer;
+		VkxImage image;
+		VkImageView image_view;
+		VkxPipeline pipeline;
+		VkxAllocation allocation;
+	};
+	// Frame timeline value after which no frame can be using it
+	uint64_t timeline_value;
+} VkxDeferredDestroy;
+
+// Oldest first, as the timeline values only increase
+static VkxDeferredDestroy* deferred_destroys = NULL;
+static uint32_t deferred_destroys_count = 0;
+static uint32_t deferred_destroys_capacity = 0;
+
+static VkxDeferredDestroy* vkx_push_deferred_destroy(VkxDeferredType type) {
+	if (deferred_destroys_count == deferred_destroys_capacity) {
+		deferred_destroys_capacity = deferred_destroys_capacity == 0 ? 16 : deferred_destroys_capacity * 2;
+		deferred_destroys = realloc(deferred_destroys, sizeof(VkxDeferredDestroy) * deferred_destroys_capacity);
+		if (deferred_destroys == NULL) {
+			fprintf(stderr, "Failed to grow the deferred destroy queue\n");
+			exit(1);
+		}
+	}
+
+	VkxDeferredDestroy* deferred = &deferred_destroys[deferred_destroys_count++];
+	deferred->type = type;
+	deferred->timeline_value = vkx_frame_timeline_pending();
+	return deferred;
+}
+
+void vkx_defer_destroy(VkxDeferredDestroyFunc func, void* data) {
+	/*
+	 * Destroy something once the frames which have been (or are being) recorded
+	 * are finished with it, rather than waiting for the device to go idle
+	 *
+	 * @param func Called with data from vkx_collect_deferred_destroys()
+	 * @param data Whatever func needs
+	 */
+	VkxDeferredDestroy* deferred = vkx_push_deferred_destroy(VKX_DEFERRED_CALLBACK);
+	deferred->callback.func = func;
+	deferred->callback.data = data;
+}
+
+void vkx_defer_cleanup_buffer(VkxBuffer* buffer) {
+	/*
+	 * vkx_cleanup_buffer() once no frame can be using the buffer.  The handle is
+	 * cleared straight away, so it can be recreated in place
+	 */
+	if (buffer->buffer == VK_NULL_HANDLE) {
+		return;
+	}
+
+	vkx_push_deferred_destroy(VKX_DEFERRED_BUFFER)->buffer = *buffer;
+	memset(buffer, 0, sizeof(VkxBuffer));
+}
+
+void vkx_defer_cleanup_image(VkxImage* image) {
+	/*
+	 * vkx_cleanup_image() (including the view) once no frame can be using it.
+	 * The handles are cleared straight away
+	 */
+	if (image->image == VK_NULL_HANDLE) {
+		return;
+	}
+
+	vkx_push_deferred_destroy(VKX_DEFERRED_IMAGE)->image = *image;
+	memset(image, 0, sizeof(VkxImage));
+}
+
+void vkx_defer_destroy_image_view(VkImageView view) {
+	if (view == VK_NULL_HANDLE) {
+		return;
+	}
+
+	vkx_push_deferred_destroy(VKX_DEFERRED_IMAGE_VIEW)->image_view = view;
+}
+
+void vkx_defer_cleanup_pipeline(VkxPipeline pipeline) {
+	/*
+	 * vkx_cleanup_pipeline() once no frame can be using it, e.g. when a shader
+	 * has been reloaded
+	 */
+	vkx_push_deferred_destroy(VKX_DEFERRED_PIPELINE)->pipeline = pipeline;
+}
+
+void vkx_defer_memory_free(VkxAllocation* allocation) {
+	/*
+	 * vkx_memory_free() once no frame can be using the memory, for resources
+	 * which were bound to it and destroyed separately
+	 */
+	if (allocation->memory == VK_NULL_HANDLE) {
+		return;
+	}
+
+	vkx_push_deferred_destroy(VKX_DEFERRED_ALLOCATION)->allocation = *allocation;
+	memset(allocation, 0, sizeof(VkxAllocation));
+}
+
+static void vkx_run_deferred_destroy(VkxDeferredDestroy* deferred) {
+	switch (deferred->type) {
+		case VKX_DEFERRED_CALLBACK:
+			deferred->callback.func(deferred->callback.data);
+			break;
+		case VKX_DEFERRED_BUFFER:
+			vkx_cleanup_buffer(&deferred->buffer);
+			break;
+		case VKX_DEFERRED_IMAGE:
+			vkx_cleanup_image(&deferred->image);
+			break;
+		case VKX_DEFERRED_IMAGE_VIEW:
+			vkDestroyImageView(vkx_instance.device, deferred->image_view, vkx_get_allocator(VK_OBJECT_TYPE_IMAGE_VIEW));
+			break;
+		case VKX_DEFERRED_PIPELINE:
+			vkx_cleanup_pipeline(deferred->pipeline);
+			break;
+		case VKX_DEFERRED_ALLOCATION:
+			vkx_memory_free(&deferred->allocation);
+			break;
+	}
+}
+
+void vkx_collect_deferred_destroys(void) {
+	/*
+	 * Destroy everything which the GPU has finished with.  Call once per frame
+	 */
+	if (deferred_destroys_count == 0) {
+		return;
+	}
+
+	uint64_t completed = vkx_frame_timeline_completed();
+	uint32_t destroyed = 0;
+	while (destroyed < deferred_destroys_count && deferred_destroys[destroyed].timeline_value <= completed) {
+		vkx_run_deferred_destroy(&deferred_destroys[destroyed]);
+		destroyed++;
+	}
+
+	if (destroyed > 0) {
+		for (uint32_t i = destroyed; i < deferred_destroys_count; i++) {
+			deferred_destroys[i - destroyed] = deferred_destroys[i];
+		}
+		deferred_destroys_count -= destroyed;
+	}
+}
+
+void vkx_flush_deferred_destroys(void) {
+	/*
+	 * Destroy everything in the queue straight away, once the device is idle
+	 */
+	for (uint32_t i = 0; i < deferred_destroys_count; i++) {
+		vkx_run_deferred_destroy(&deferred_destroys[i]);
+	}
+
+	free(deferred_destroys);
+	deferred_destroys = NULL;
+	deferred_destroys_count = 0;
+	deferred_destroys_capacity = 0;
+}
+
+static VkImageView vkx_create_image_view_of_type(VkImage image, VkImageViewType view_type, VkFormat format,
+		VkImageAspectFlags aspect_flags, uint32_t mip_levels, uint32_t array_layers) {
 	VkImageViewCreateInfo view_info = {0};
 	view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
 	view_info.image = image;
-	view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	view_info.viewType = view_type;
 	view_info.format = format;
 	view_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
 	view_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
@@ -139,12 +605,12 @@ VkImageView vkx_create_image_view(VkImage image, VkFormat format,
 	view_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
 	view_info.subresourceRange.aspectMask = aspect_flags;
 	view_info.subresourceRange.baseMipLevel = 0;
-	view_info.subresourceRange.levelCount = 1;
+	view_info.subresourceRange.levelCount = mip_levels;
 	view_info.subresourceRange.baseArrayLayer = 0;
-	view_info.subresourceRange.layerCount = 1;
+	view_info.subresourceRange.layerCount = array_layers;
 	
 	VkImageView image_view;
-	if (vkCreateImageView(vkx_instance.device, &view_info, NULL, &image_view) != VK_SUCCESS) {
+	if (vkCreateImageView(vkx_instance.device, &view_info, vkx_get_allocator(VK_OBJECT_TYPE_IMAGE_VIEW), &image_view) != VK_SUCCESS) {
 		fprintf(stderr, "failed to create image view!\n");
 		exit(1);
 	}
@@ -152,10 +618,108 @@ VkImageView vkx_create_image_view(VkImage image, VkFormat format,
 	return image_view;
 }
 
-VkxImage vkx_create_image(uint32_t width, uint32_t height, VkFormat format,
+VkImageView vkx_create_image_view(VkImage image, VkFormat format,
+		VkImageAspectFlags aspect_flags, uint32_t mip_levels) {
+	return vkx_create_image_view_of_type(image, VK_IMAGE_VIEW_TYPE_2D, format, aspect_flags, mip_levels, 1);
+}
+
+VkImageView vkx_create_image_array_view(VkImage image, VkFormat format,
+		VkImageAspectFlags aspect_flags, uint32_t mip_levels, uint32_t array_layers) {
+	/*
+	 * Create a 2D array view over all of the layers of an image, for sampling as a
+	 * sampler2DArray
+	 */
+	return vkx_create_image_view_of_type(image, VK_IMAGE_VIEW_TYPE_2D_ARRAY, format, aspect_flags, mip_levels, array_layers);
+}
+
+uint32_t vkx_mip_levels_for_extent(uint32_t width, uint32_t height) {
+	/*
+	 * Get the number of levels in a full mip chain for an image of this size, i.e.
+	 * halving the largest dimension until it reaches 1
+	 */
+	uint32_t largest = width > height ? width : height;
+	uint32_t levels = 1;
+	while (largest > 1) {
+		largest >>= 1;
+		levels++;
+	}
+	return levels;
+}
+
+// Entries of the linear to sRGB table
+#define LINEAR_TO_SRGB_SIZE 4096
+
+static SDL_InitState srgb_tables_init = {0};
+static float srgb_to_linear[256];
+static uint8_t linear_to_srgb[LINEAR_TO_SRGB_SIZE];
+
+static void vkx_init_srgb_tables(void) {
+	if (!SDL_ShouldInit(&srgb_tables_init)) {
+		return;
+	}
+
+	for (uint32_t i = 0; i < 256; i++) {
+		float c = i / 255.0f;
+		srgb_to_linear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+	}
+	for (uint32_t i = 0; i < LINEAR_TO_SRGB_SIZE; i++) {
+		float c = i / (float) (LINEAR_TO_SRGB_SIZE - 1);
+		float srgb = c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+		linear_to_srgb[i] = (uint8_t) (srgb * 255.0f + 0.5f);
+	}
+
+	SDL_SetInitialized(&srgb_tables_init, true);
+}
+
+void vkx_downsample_srgb(const uint8_t* src, uint32_t width, uint32_t height, uint8_t* dst) {
+	/*
+	 * Box filter an sRGB RGBA level into the next one in linear space, like a
+	 * linear blit on the device.  Odd edges reuse their last row or column.  Safe
+	 * to call from the job workers
+	 *
+	 * @param dst Gets the next level, half the size rounded down but at least 1
+	 */
+	vkx_init_srgb_tables();
+
+	uint32_t dst_width = width > 1 ? width / 2 : 1;
+	uint32_t dst_height = height > 1 ? height / 2 : 1;
+
+	for (uint32_t y = 0; y < dst_height; y++) {
+		const uint8_t* row0 = src + (size_t) (y * 2 < height ? y * 2 : height - 1) * width * 4;
+		const uint8_t* row1 = src + (size_t) (y * 2 + 1 < height ? y * 2 + 1 : height - 1) * width * 4;
+
+		for (uint32_t x = 0; x < dst_width; x++) {
+			uint32_t x0 = (x * 2 < width ? x * 2 : width - 1) * 4;
+			uint32_t x1 = (x * 2 + 1 < width ? x * 2 + 1 : width - 1) * 4;
+			uint8_t* out = dst + ((size_t) y * dst_width + x) * 4;
+
+			for (uint32_t c = 0; c < 3; c++) {
+				float sum = srgb_to_linear[row0[x0 + c]] + srgb_to_linear[row0[x1 + c]]
+					+ srgb_to_linear[row1[x0 + c]] + srgb_to_linear[row1[x1 + c]];
+				out[c] = linear_to_srgb[(uint32_t) (sum * 0.25f * (LINEAR_TO_SRGB_SIZE - 1) + 0.5f)];
+			}
+
+			uint32_t alpha = row0[x0 + 3] + row0[x1 + 3] + row1[x0 + 3] + row1[x1 + 3];
+			out[3] = (uint8_t) ((alpha + 2) / 4);
+		}
+	}
+}
+
+VkxImage vkx_create_image(uint32_t width, uint32_t height, uint32_t mip_levels, VkFormat format,
 		VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties) {
+	return vkx_create_image_array(width, height, mip_levels, 1, format, tiling, usage, properties);
+}
+
+VkxImage vkx_create_image_array(uint32_t width, uint32_t height, uint32_t mip_levels, uint32_t array_layers,
+		VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties) {
 
 	VkxImage image = {0};
+	image.mip_levels = mip_levels;
+	image.array_layers = array_layers;
+	image.format = format;
+	image.extent.width = width;
+	image.extent.height = height;
+	image.usage = usage;
 
 	VkImageCreateInfo image_info = {0};
 	image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -163,8 +727,8 @@ VkxImage vkx_create_image(uint32_t width, uint32_t height, VkFormat format,
 	image_info.extent.width = width;
 	image_info.extent.height = height;
 	image_info.extent.depth = 1;
-	image_info.mipLevels = 1;
-	image_info.arrayLayers = 1;
+	image_info.mipLevels = mip_levels;
+	image_info.arrayLayers = array_layers;
 	image_info.format = format;
 	image_info.tiling = tiling;
 	image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -172,7 +736,7 @@ VkxImage vkx_create_image(uint32_t width, uint32_t height, VkFormat format,
 	image_info.samples = VK_SAMPLE_COUNT_1_BIT;
 	image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-	if (vkCreateImage(vkx_instance.device, &image_info, NULL, &image.image) != VK_SUCCESS) {
+	if (vkCreateImage(vkx_instance.device, &image_info, vkx_get_allocator(VK_OBJECT_TYPE_IMAGE), &image.image) != VK_SUCCESS) {
 		fprintf(stderr, "Failed to create image!\n");
 		exit(1);
 	}
@@ -180,16 +744,9 @@ VkxImage vkx_create_image(uint32_t width, uint32_t height, VkFormat format,
 	VkMemoryRequirements mem_requirements;
 	vkGetImageMemoryRequirements(vkx_instance.device, image.image, &mem_requirements);
 
-	VkMemoryAllocateInfo alloc_info = {0};
-	alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	alloc_info.allocationSize = mem_requirements.size;
-	alloc_info.memoryTypeIndex = vkx_find_memory_type(mem_requirements.memoryTypeBits, properties);
-
-	if (vkAllocateMemory(vkx_instance.device, &alloc_info, NULL, &image.memory) != VK_SUCCESS) {
-		fprintf(stderr, "Failed to allocate image memory!\n");
-	}
+	image.allocation = vkx_memory_alloc(mem_requirements, properties, tiling == VK_IMAGE_TILING_LINEAR);
 
-	vkBindImageMemory(vkx_instance.device, image.image, image.memory, 0);
+	vkBindImageMemory(vkx_instance.device, image.image, image.allocation.memory, image.allocation.offset);
 
 	image.view = VK_NULL_HANDLE;
 
@@ -198,16 +755,114 @@ VkxImage vkx_create_image(uint32_t width, uint32_t height, VkFormat format,
 
 void vkx_cleanup_image(VkxImage* image) {
 	if (image->view != VK_NULL_HANDLE) {
-		vkDestroyImageView(vkx_instance.device, image->view, NULL);
+		vkDestroyImageView(vkx_instance.device, image->view, vkx_get_allocator(VK_OBJECT_TYPE_IMAGE_VIEW));
 	}
-	vkDestroyImage(vkx_instance.device, image->image, NULL);
-	vkFreeMemory(vkx_instance.device, image->memory, NULL);
+	vkDestroyImage(vkx_instance.device, image->image, vkx_get_allocator(VK_OBJECT_TYPE_IMAGE));
+	vkx_memory_free(&image->allocation);
 
 	image->image = VK_NULL_HANDLE;
-	image->memory = VK_NULL_HANDLE;
 	image->view = VK_NULL_HANDLE;
 }
 
+VkxImage vkx_record_image_move(VkCommandBuffer command_buffer, const VkxImage* image) {
+	/*
+	 * Create a copy of a sampled image somewhere else in device memory, e.g. to
+	 * empty a block for vkx_memory_update_defragmentation().  The copy is
+	 * recorded into a graphics command buffer before anything samples the new
+	 * image, and both images are left in SHADER_READ_ONLY_OPTIMAL.  The old one
+	 * can still be sampled by the frames in flight, so it should be destroyed
+	 * with vkx_defer_cleanup_image()
+	 *
+	 * @param image A 2D colour image with a view of all its levels, created with
+	 *        TRANSFER_SRC usage and in SHADER_READ_ONLY_OPTIMAL
+	 *
+	 * @return The new image, tagged the same as the old one
+	 */
+	VkxMemoryTag previous_tag = vkx_memory_set_tag(image->allocation.tag);
+	VkxImage moved = vkx_create_image_array(
+		image->extent.width,
+		image->extent.height,
+		image->mip_levels,
+		image->array_layers,
+		image->format,
+		VK_IMAGE_TILING_OPTIMAL,
+		image->usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+	);
+	vkx_memory_set_tag(previous_tag);
+
+	// Earlier frames sampling the old image finish before it is read
+	VkImageMemoryBarrier2 barriers[2] = {0};
+	for (uint32_t i = 0; i < 2; i++) {
+		barriers[i].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+		barriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[i].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barriers[i].subresourceRange.levelCount = image->mip_levels;
+		barriers[i].subresourceRange.layerCount = image->array_layers;
+	}
+	barriers[0].image = image->image;
+	barriers[0].srcStageMask = VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	barriers[0].dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT;
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barriers[1].image = moved.image;
+	barriers[1].srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+	barriers[1].dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	barriers[1].dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+
+	VkDependencyInfo dependency_info = {0};
+	dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dependency_info.imageMemoryBarrierCount = 2;
+	dependency_info.pImageMemoryBarriers = barriers;
+	vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+
+	VkImageCopy2 regions[VKX_KTX2_MAX_LEVELS] = {0};
+	uint32_t regions_count = image->mip_levels < VKX_KTX2_MAX_LEVELS ? image->mip_levels : VKX_KTX2_MAX_LEVELS;
+	for (uint32_t level = 0; level < regions_count; level++) {
+		VkImageCopy2* region = &regions[level];
+		region->sType = VK_STRUCTURE_TYPE_IMAGE_COPY_2;
+		region->srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region->srcSubresource.mipLevel = level;
+		region->srcSubresource.layerCount = image->array_layers;
+		region->dstSubresource = region->srcSubresource;
+		region->extent.width = image->extent.width >> level > 0 ? image->extent.width >> level : 1;
+		region->extent.height = image->extent.height >> level > 0 ? image->extent.height >> level : 1;
+		region->extent.depth = 1;
+	}
+
+	VkCopyImageInfo2 copy_info = {0};
+	copy_info.sType = VK_STRUCTURE_TYPE_COPY_IMAGE_INFO_2;
+	copy_info.srcImage = image->image;
+	copy_info.srcImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	copy_info.dstImage = moved.image;
+	copy_info.dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	copy_info.regionCount = regions_count;
+	copy_info.pRegions = regions;
+	vkCmdCopyImage2(command_buffer, &copy_info);
+
+	// Both can be sampled afterwards, the old one by nothing newer than this
+	barriers[0].srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	barriers[0].srcAccessMask = VK_ACCESS_2_NONE;
+	barriers[0].dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+	barriers[0].dstAccessMask = VK_ACCESS_2_NONE;
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barriers[1].srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	barriers[1].srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	barriers[1].dstStageMask = VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+	barriers[1].dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+	barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barriers[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+
+	moved.view = vkx_create_image_view(moved.image, moved.format, VK_IMAGE_ASPECT_COLOR_BIT, moved.mip_levels);
+	return moved;
+}
+
 
 VkCommandBuffer vkx_begin_single_time_commands() {
 	/*
@@ -293,6 +948,22 @@ VkFormat vkx_find_depth_format() {
 	return vkx_find_supported_format(candidates, sizeof(candidates) / sizeof(candidates[0]), VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
 }
 
+VkSampleCountFlagBits vkx_get_max_sample_count(VkSampleCountFlagBits wanted) {
+	/*
+	 * The most samples up to wanted which colour and depth attachments can both
+	 * have
+	 */
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(vkx_instance.physical_device, &properties);
+	VkSampleCountFlags supported = properties.limits.framebufferColorSampleCounts & properties.limits.framebufferDepthSampleCounts;
+
+	VkSampleCountFlagBits samples = wanted;
+	while (samples > VK_SAMPLE_COUNT_1_BIT && (supported & samples) == 0) {
+		samples >>= 1;
+	}
+	return samples;
+}
+
 bool vkx_has_stencil_component(VkFormat format) {
 	/*
 	 * Check if the format has a stencil component
@@ -306,106 +977,254 @@ bool vkx_has_stencil_component(VkFormat format) {
 	}
 }
 
-void vkx_transition_image_layout(
-		VkCommandBuffer command_buffer,
-		VkImage image,
-		VkFormat format,
-		VkImageLayout old_layout,
-		VkImageLayout new_layout
-) {
-	VkImageMemoryBarrier2 barrier = {0};
-	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
-	barrier.oldLayout = old_layout;
-	barrier.newLayout = new_layout;
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.image = image;
-	barrier.subresourceRange.baseMipLevel = 0;
-	barrier.subresourceRange.levelCount = 1;
-	barrier.subresourceRange.baseArrayLayer = 0;
-	barrier.subresourceRange.layerCount = 1;
-
-	if (new_layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-
-		if (vkx_has_stencil_component(format)) {
-			barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
-		}
-	}
-	else {
-		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	}
-
+static void vkx_layout_transition_masks(VkImageLayout old_layout, VkImageLayout new_layout, VkImageMemoryBarrier2* barrier) {
+	/*
+	 * Fill in the stage and access masks for a layout transition.  These are
+	 * the stages which actually use the image in each layout, so nothing else
+	 * has to wait.  Only writes go in the source access masks as there is
+	 * nothing to make available after a read
+	 */
 	if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED
 			&& new_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-		barrier.srcStageMask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		barrier.srcAccessMask = 0;
-		barrier.dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier->srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+		barrier->srcAccessMask = VK_ACCESS_2_NONE;
+		barrier->dstStageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+		barrier->dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
 	}
 	else if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED
 			&& new_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-		barrier.srcStageMask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		barrier.srcAccessMask = 0;
-		barrier.dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
-		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		// Nothing has written to it, so only the transition has to happen before reading
+		barrier->srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+		barrier->srcAccessMask = VK_ACCESS_2_NONE;
+		barrier->dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+		barrier->dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
 	}
 	else if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED
 		   	&& new_layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-		barrier.srcAccessMask = 0;
-		barrier.srcStageMask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-		barrier.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+		barrier->srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+		barrier->srcAccessMask = VK_ACCESS_2_NONE;
+		barrier->dstStageMask = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
+		barrier->dstAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	}
+	else if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED
+			&& new_layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL) {
+		barrier->srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+		barrier->srcAccessMask = VK_ACCESS_2_NONE;
+		barrier->dstStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+		barrier->dstAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
 	}
 	else if (old_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
 			&& new_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		barrier.srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
-		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-		barrier.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		barrier->srcStageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+		barrier->srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+		barrier->dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+		barrier->dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+	}
+	else if (old_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+			&& new_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
+		// Earlier reads have to finish before the image is written again
+		barrier->srcStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+		barrier->srcAccessMask = VK_ACCESS_2_NONE;
+		barrier->dstStageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+		barrier->dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
 	}
 	else if (old_layout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
 			&& new_layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL) {
-		barrier.srcStageMask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		barrier.srcAccessMask = 0;
-		barrier.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		// The acquire semaphore is waited on at the colour attachment stage, so
+		// starting from there chains onto it
+		barrier->srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+		barrier->srcAccessMask = VK_ACCESS_2_NONE;
+		barrier->dstStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+		barrier->dstAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
 	}
 	else if (old_layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
 			&& new_layout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR) {
-		barrier.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-		barrier.dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-		barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+		// Presenting waits on a semaphore, which covers everything before it
+		barrier->srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+		barrier->srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+		barrier->dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+		barrier->dstAccessMask = VK_ACCESS_2_NONE;
 	}
 	else if (old_layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
 			&& new_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-		barrier.srcStageMask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-		barrier.srcAccessMask = 0;
-		barrier.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+		barrier->srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+		barrier->srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+		barrier->dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+		barrier->dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
 	}
 	else if (old_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
 			&& new_layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL) {
-		barrier.srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-		barrier.srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-		barrier.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		barrier->srcStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+		barrier->srcAccessMask = VK_ACCESS_2_NONE;
+		barrier->dstStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+		barrier->dstAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
 	}
 	else {
 		fprintf(stderr, "Unsupported layout transition from %d to %d\n", old_layout, new_layout);
 		exit(1);
 	}
+}
+
+void vkx_transition_image_layout(
+		VkCommandBuffer command_buffer,
+		VkImage image,
+		VkFormat format,
+		VkImageLayout old_layout,
+		VkImageLayout new_layout
+) {
+	VkxBarrierBatch batch;
+	vkx_barrier_batch_begin(&batch, command_buffer);
+	vkx_barrier_batch_add_image(&batch, image, format, old_layout, new_layout);
+	vkx_barrier_batch_flush(&batch);
+}
+
+void vkx_barrier_batch_begin(VkxBarrierBatch* batch, VkCommandBuffer command_buffer) {
+	/*
+	 * Start collecting barriers to record together.  Transitions which happen
+	 * at the same point should go in one batch so the GPU only waits once
+	 */
+	batch->command_buffer = command_buffer;
+	batch->image_barriers_count = 0;
+	batch->buffer_barriers_count = 0;
+}
+
+void vkx_barrier_batch_add_image(VkxBarrierBatch* batch, VkImage image, VkFormat format, VkImageLayout old_layout, VkImageLayout new_layout) {
+	/*
+	 * Add a layout transition of the whole of a single level, single layer
+	 * image.  The stage and access masks come from the pair of layouts
+	 */
+	if (batch->image_barriers_count >= VKX_BARRIER_BATCH_MAX) {
+		vkx_barrier_batch_flush(batch);
+	}
+
+	VkImageMemoryBarrier2* barrier = &batch->image_barriers[batch->image_barriers_count++];
+	memset(barrier, 0, sizeof(VkImageMemoryBarrier2));
+	barrier->sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+	barrier->oldLayout = old_layout;
+	barrier->newLayout = new_layout;
+	barrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier->image = image;
+	barrier->subresourceRange.baseMipLevel = 0;
+	barrier->subresourceRange.levelCount = 1;
+	barrier->subresourceRange.baseArrayLayer = 0;
+	barrier->subresourceRange.layerCount = 1;
+
+	if (new_layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
+		barrier->subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+
+		if (vkx_has_stencil_component(format)) {
+			barrier->subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+		}
+	}
+	else {
+		barrier->subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	}
+
+	vkx_layout_transition_masks(old_layout, new_layout, barrier);
+}
+
+void vkx_barrier_batch_add_buffer(VkxBarrierBatch* batch, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size,
+		VkPipelineStageFlags2 src_stages, VkAccessFlags2 src_access, VkPipelineStageFlags2 dst_stages, VkAccessFlags2 dst_access) {
+	/*
+	 * Add a barrier on part of a buffer.  Buffers don't have layouts, so the
+	 * masks depend on how the buffer is used and have to be given
+	 *
+	 * @param size Size of the range, or VK_WHOLE_SIZE
+	 */
+	if (batch->buffer_barriers_count >= VKX_BARRIER_BATCH_MAX) {
+		vkx_barrier_batch_flush(batch);
+	}
+
+	VkBufferMemoryBarrier2* barrier = &batch->buffer_barriers[batch->buffer_barriers_count++];
+	memset(barrier, 0, sizeof(VkBufferMemoryBarrier2));
+	barrier->sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+	barrier->srcStageMask = src_stages;
+	barrier->srcAccessMask = src_access;
+	barrier->dstStageMask = dst_stages;
+	barrier->dstAccessMask = dst_access;
+	barrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier->buffer = buffer;
+	barrier->offset = offset;
+	barrier->size = size;
+}
+
+void vkx_barrier_batch_flush(VkxBarrierBatch* batch) {
+	/*
+	 * Record everything in the batch with one vkCmdPipelineBarrier2 and empty
+	 * it.  Does nothing if the batch is empty
+	 */
+	if (batch->image_barriers_count == 0 && batch->buffer_barriers_count == 0) {
+		return;
+	}
 
 	VkDependencyInfo dependency_info = {0};
 	dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
-	dependency_info.imageMemoryBarrierCount = 1;
-	dependency_info.pImageMemoryBarriers = &barrier;
+	dependency_info.imageMemoryBarrierCount = batch->image_barriers_count;
+	dependency_info.pImageMemoryBarriers = batch->image_barriers;
+	dependency_info.bufferMemoryBarrierCount = batch->buffer_barriers_count;
+	dependency_info.pBufferMemoryBarriers = batch->buffer_barriers;
 
-	vkCmdPipelineBarrier2(
-		command_buffer,
-		&dependency_info
-	);
+	vkCmdPipelineBarrier2(batch->command_buffer, &dependency_info);
+
+	batch->image_barriers_count = 0;
+	batch->buffer_barriers_count = 0;
+}
+
+VkImageMemoryBarrier2 vkx_image_ownership_release(VkImageMemoryBarrier2 barrier, uint32_t src_family, uint32_t dst_family) {
+	/*
+	 * Turn a barrier into the half of a queue family ownership transfer which
+	 * is recorded on the source queue.  The same barrier goes to
+	 * vkx_image_ownership_acquire() for the destination queue, which has to
+	 * wait on a semaphore signalled after this one.  Both halves do the layout
+	 * transition, but it only happens once.  Only needed for exclusive images
+	 * and when the families differ
+	 *
+	 * @param barrier With the source scope (on the source queue) and the
+	 *        destination scope (on the destination queue)
+	 */
+	// The destination scope is ignored on the source queue
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+	barrier.dstAccessMask = VK_ACCESS_2_NONE;
+	barrier.srcQueueFamilyIndex = src_family;
+	barrier.dstQueueFamilyIndex = dst_family;
+	return barrier;
+}
+
+VkImageMemoryBarrier2 vkx_image_ownership_acquire(VkImageMemoryBarrier2 barrier, uint32_t src_family, uint32_t dst_family) {
+	/*
+	 * The half of an ownership transfer recorded on the destination queue, see
+	 * vkx_image_ownership_release()
+	 */
+	// And the source scope is ignored here, the semaphore covers it
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+	barrier.srcAccessMask = VK_ACCESS_2_NONE;
+	barrier.srcQueueFamilyIndex = src_family;
+	barrier.dstQueueFamilyIndex = dst_family;
+	return barrier;
+}
+
+VkBufferMemoryBarrier2 vkx_buffer_ownership_release(VkBufferMemoryBarrier2 barrier, uint32_t src_family, uint32_t dst_family) {
+	/*
+	 * As vkx_image_ownership_release(), for part of an exclusive buffer
+	 */
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_NONE;
+	barrier.dstAccessMask = VK_ACCESS_2_NONE;
+	barrier.srcQueueFamilyIndex = src_family;
+	barrier.dstQueueFamilyIndex = dst_family;
+	return barrier;
+}
+
+VkBufferMemoryBarrier2 vkx_buffer_ownership_acquire(VkBufferMemoryBarrier2 barrier, uint32_t src_family, uint32_t dst_family) {
+	/*
+	 * As vkx_image_ownership_acquire(), for part of an exclusive buffer
+	 */
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+	barrier.srcAccessMask = VK_ACCESS_2_NONE;
+	barrier.srcQueueFamilyIndex = src_family;
+	barrier.dstQueueFamilyIndex = dst_family;
+	return barrier;
 }
 
 void vkx_transition_image_layout_tmp_buffer(
@@ -472,56 +1291,336 @@ void vkx_copy_buffer_to_image(VkBuffer buffer, VkImage image, uint32_t width, ui
     vkx_end_single_time_commands(command_buffer);
 }
 
-VkxImage vkx_create_texture_image(const char* filename) {
-	int width, height, channels;
+uint32_t vkx_texture_mip_levels(uint32_t width, uint32_t height, bool generate_mipmaps) {
+	/*
+	 * Work out how many mip levels a texture should have.  The chain is generated
+	 * with linear blits, so if the format can't do that we fall back to 1 level
+	 */
+	if (!generate_mipmaps) {
+		return 1;
+	}
 
-	printf("Loading texture image %s\n", filename);
+	VkFormatProperties format_properties;
+	vkGetPhysicalDeviceFormatProperties(vkx_instance.physical_device, VK_FORMAT_R8G8B8A8_SRGB, &format_properties);
 
-	stbi_uc* pixels = stbi_load(filename, &width, &height, &channels, STBI_rgb_alpha);
-	if (!pixels) {
-		fprintf(stderr, "failed to load texture image!\n");
-		exit(1);
+	if (!(format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
+		printf("Texture format does not support linear blitting, not generating mipmaps\n");
+		return 1;
 	}
 
-	VkDeviceSize image_size = width * height * 4;
+	return vkx_mip_levels_for_extent(width, height);
+}
 
-	// Create a buffer and load the image into it
-	VkxBuffer staging_buffer = vkx_create_buffer(
-		image_size,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-	);
+static stbi_uc* vkx_decode_or_find_image(const char* filename, int* width, int* height, MappedFile* cached, VkxKtx2Texture* cached_texture) {
+	/*
+	 * Decode an image file to RGBA pixels straight from a mapping of the file,
+	 * unless it is in the texture cache (see vkx_texture_cache.c), in which case
+	 * the entry is mapped instead.  What's decoded is added to the cache
+	 *
+	 * @param cached Set to the mapping of the cache entry, or left empty
+	 *
+	 * @return The pixels, NULL if it was cached or couldn't be decoded
+	 */
+	memset(cached, 0, sizeof(MappedFile));
 
-	void *data;
-	vkMapMemory(vkx_instance.device, staging_buffer.memory, 0, image_size, 0, &data);
-	memcpy(data, pixels, (size_t) image_size);
-	vkUnmapMemory(vkx_instance.device, staging_buffer.memory);
+	MappedFile file = map_file(filename);
+	if (file.size > INT32_MAX) {
+		fprintf(stderr, "Image %s is too big\n", filename);
+		exit(1);
+	}
 
-	stbi_image_free(pixels);
+	uint64_t key = 0;
+	if (vkx_texture_cache_is_enabled()) {
+		key = vkx_texture_cache_key(file.data, file.size);
+		if (vkx_texture_cache_load(key, cached, cached_texture)) {
+			unmap_file(&file);
+			return NULL;
+		}
+	}
 
-	// Create the image
-	VkxImage image = vkx_create_image(
-		width,
-		height,
-		VK_FORMAT_R8G8B8A8_SRGB,
-		VK_IMAGE_TILING_OPTIMAL,
-		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
-	);
+	int channels;
+	stbi_uc* pixels = stbi_load_from_memory(file.data, (int) file.size, width, height, &channels, STBI_rgb_alpha);
+	unmap_file(&file);
 
-	// Transition the image layout to transfer destination
-	vkx_transition_image_layout_tmp_buffer(image.image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-	
-	vkx_copy_buffer_to_image(staging_buffer.buffer, image.image, width, height);
+	if (pixels != NULL && vkx_texture_cache_is_enabled()) {
+		vkx_texture_cache_store(key, pixels, (uint32_t) *width, (uint32_t) *height);
+	}
 
-	// Transition the image layout to shader read
-	vkx_transition_image_layout_tmp_buffer(image.image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-	
-	// Clean up the staging buffer
-	vkx_cleanup_buffer(&staging_buffer);
+	return pixels;
+}
+
+uint8_t* vkx_load_image_pixels(const char* filename, int* width, int* height) {
+	/*
+	 * Decode an image file to RGBA pixels, rather than stb_image reading it
+	 * through stdio.  An image in the texture cache has its base level copied
+	 * out of the cache instead.  Safe to call from the job workers
+	 *
+	 * @return The pixels, to free with stbi_image_free(), or NULL if the file
+	 *         couldn't be decoded
+	 */
+	MappedFile cached;
+	VkxKtx2Texture cached_texture;
+	stbi_uc* pixels = vkx_decode_or_find_image(filename, width, height, &cached, &cached_texture);
+	if (cached.data == NULL) {
+		return pixels;
+	}
+
+	// stb_image allocates with malloc, so this can be freed the same way
+	pixels = malloc(cached_texture.level_sizes[0]);
+	if (pixels == NULL) {
+		fprintf(stderr, "Failed to allocate the pixels for %s\n", filename);
+		exit(1);
+	}
+	memcpy(pixels, (const uint8_t*) cached.data + cached_texture.level_offsets[0], cached_texture.level_sizes[0]);
+	*width = (int) cached_texture.width;
+	*height = (int) cached_texture.height;
+	unmap_file(&cached);
 
-	// Create the image view
-	image.view = vkx_create_image_view(image.image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT);
+	return pixels;
+}
 
+VkxImage vkx_create_texture_image(const char* filename, bool generate_mipmaps) {
+	/*
+	 * Load a texture from an image file, or a compressed encoding of it (see
+	 * vkx_create_texture_images()).  The upload is queued with the upload
+	 * manager, so vkx_upload_flush() must be called before the texture is used
+	 *
+	 * @param filename The image file to load
+	 * @param generate_mipmaps Generate a full mip chain from the image on the GPU
+	 */
+	VkxImage image;
+	vkx_create_texture_images(&filename, 1, &image, generate_mipmaps);
 	return image;
 }
+
+bool vkx_decode_texture(const char* filename, VkxDecodedTexture* texture) {
+	/*
+	 * Load a texture ready for vkx_create_decoded_textures().  If the image has a
+	 * KTX2 encoding in a format the device supports (see vkx_load_ktx2_texture())
+	 * or is in the texture cache that is mapped instead, and isn't decoded at
+	 * all.  Either way it loses the levels the texture quality drops (see
+	 * vkx_texture_quality.c).  Safe to call from any thread
+	 *
+	 * @param filename The image file
+	 * @param texture Filled in, to free with vkx_free_decoded_texture()
+	 *
+	 * @return false if the image couldn't be loaded
+	 */
+	memset(texture, 0, sizeof(VkxDecodedTexture));
+
+	texture->compressed = vkx_load_ktx2_texture(filename, &texture->ktx2_file, &texture->ktx2);
+	if (texture->compressed) {
+		if (texture->ktx2.array_layers != 1) {
+			fprintf(stderr, "KTX2 encoding of %s has %d layers, not 1\n", filename, texture->ktx2.array_layers);
+			exit(1);
+		}
+		vkx_reduce_texture_quality(filename, texture);
+		return true;
+	}
+
+	// The cached textures are KTX2 files as well, just not compressed ones
+	texture->pixels = vkx_decode_or_find_image(filename, &texture->width, &texture->height, &texture->ktx2_file, &texture->ktx2);
+	texture->compressed = texture->ktx2_file.data != NULL;
+	if (!texture->compressed && texture->pixels == NULL) {
+		return false;
+	}
+	vkx_reduce_texture_quality(filename, texture);
+	return true;
+}
+
+void vkx_free_decoded_texture(VkxDecodedTexture* texture) {
+	if (texture->compressed) {
+		unmap_file(&texture->ktx2_file);
+	}
+	else if (texture->pixels != NULL) {
+		stbi_image_free(texture->pixels);
+	}
+	memset(texture, 0, sizeof(VkxDecodedTexture));
+}
+
+void vkx_create_decoded_textures(uint32_t count, const VkxDecodedTexture* textures, VkxImage* images, bool generate_mipmaps) {
+	/*
+	 * Create images for decoded textures and queue their uploads in one go.  The
+	 * data is copied into the staging buffer before this returns, so the
+	 * textures can be freed straight away.  Compressed textures are copied
+	 * straight from their mappings and keep the mip levels they were encoded
+	 * with, the others have their mip chains generated and their conversions
+	 * done (see VkxDecodedTexture).  Those without a mip chain to generate or a
+	 * conversion are written from the host instead where the device can (see
+	 * vkx_upload_images_on_host()), skipping the staging copy
+	 *
+	 * @param count The number of textures
+	 * @param textures The textures from vkx_decode_texture()
+	 * @param images Array of count images to fill in
+	 * @param generate_mipmaps Generate a full mip chain for each decoded image on the GPU
+	 */
+	if (count == 0) {
+		return;
+	}
+
+	VkxImageUpload* uploads = calloc(count, sizeof(VkxImageUpload));
+	VkFormat* formats = calloc(count, sizeof(VkFormat));
+	VkDeviceSize (*level_offsets)[VKX_KTX2_MAX_LEVELS] = calloc(count, sizeof(*level_offsets));
+	// The uploads which are done from the host are moved to the end
+	VkxImageUpload* host_uploads = calloc(count, sizeof(VkxImageUpload));
+
+	if (uploads == NULL || formats == NULL || level_offsets == NULL || host_uploads == NULL) {
+		fprintf(stderr, "Failed to allocate texture upload arrays\n");
+		exit(1);
+	}
+
+	uint32_t uploads_count = 0;
+	uint32_t host_uploads_count = 0;
+	VkxMemoryTag previous_tag = vkx_memory_set_tag(VKX_MEMORY_TAG_TEXTURES);
+
+	for (uint32_t i = 0; i < count; i++) {
+		if (textures[i].compressed) {
+			const VkxKtx2Texture* texture = &textures[i].ktx2;
+			// Nothing is blitted from these, but they can be moved
+			VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+			bool on_host = vkx_upload_can_copy_on_host(texture->format, usage);
+
+			// The copy takes the span from the first level in the file (the
+			// smallest) to the end of the last, relative to its start
+			VkDeviceSize first_offset = texture->level_offsets[0];
+			VkDeviceSize data_end = 0;
+			for (uint32_t level = 0; level < texture->mip_levels; level++) {
+				VkDeviceSize level_end = texture->level_offsets[level] + texture->level_sizes[level];
+				first_offset = texture->level_offsets[level] < first_offset ? texture->level_offsets[level] : first_offset;
+				data_end = level_end > data_end ? level_end : data_end;
+			}
+			for (uint32_t level = 0; level < texture->mip_levels; level++) {
+				level_offsets[i][level] = texture->level_offsets[level] - first_offset;
+			}
+
+			formats[i] = texture->format;
+			images[i] = vkx_create_image(
+				texture->width,
+				texture->height,
+				texture->mip_levels,
+				texture->format,
+				VK_IMAGE_TILING_OPTIMAL,
+				on_host ? usage | VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT : usage,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+			);
+
+			VkxImageUpload* upload = on_host ? &host_uploads[host_uploads_count++] : &uploads[uploads_count++];
+			upload->image = images[i].image;
+			upload->extent.width = texture->width;
+			upload->extent.height = texture->height;
+			upload->mip_levels = texture->mip_levels;
+			upload->array_layers = 1;
+			upload->pixels = (const uint8_t*) textures[i].ktx2_file.data + first_offset;
+			upload->size = data_end - first_offset;
+			upload->level_offsets = level_offsets[i];
+			continue;
+		}
+
+		uint32_t mip_levels = vkx_texture_mip_levels(textures[i].width, textures[i].height, generate_mipmaps);
+		VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		// The conversions are done on the way to the staging buffer
+		bool on_host = mip_levels == 1 && textures[i].conversion == NULL && vkx_upload_can_copy_on_host(VK_FORMAT_R8G8B8A8_SRGB, usage);
+
+		formats[i] = VK_FORMAT_R8G8B8A8_SRGB;
+		images[i] = vkx_create_image(
+			textures[i].width,
+			textures[i].height,
+			mip_levels,
+			VK_FORMAT_R8G8B8A8_SRGB,
+			VK_IMAGE_TILING_OPTIMAL,
+			on_host ? usage | VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT : usage,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+		);
+
+		VkxImageUpload* upload = on_host ? &host_uploads[host_uploads_count++] : &uploads[uploads_count++];
+		upload->image = images[i].image;
+		upload->extent.width = textures[i].width;
+		upload->extent.height = textures[i].height;
+		upload->mip_levels = mip_levels;
+		upload->array_layers = 1;
+		upload->pixels = textures[i].pixels;
+		upload->size = (VkDeviceSize) textures[i].width * textures[i].height * 4;
+		upload->conversion = textures[i].conversion;
+	}
+	vkx_memory_set_tag(previous_tag);
+
+	vkx_upload_images(uploads_count, uploads);
+	vkx_upload_images_on_host(host_uploads_count, host_uploads);
+
+	for (uint32_t i = 0; i < count; i++) {
+		images[i].view = vkx_create_image_view(images[i].image, formats[i], VK_IMAGE_ASPECT_COLOR_BIT, images[i].mip_levels);
+	}
+
+	free(host_uploads);
+	free(level_offsets);
+	free(formats);
+	free(uploads);
+}
+
+typedef struct {
+	const char* const* filenames;
+	VkxDecodedTexture* textures;
+	bool* loaded;
+} VkxTextureDecodeJob;
+
+static void vkx_decode_texture_images(size_t start, size_t end, void* data) {
+	VkxTextureDecodeJob* job = data;
+
+	for (size_t i = start; i < end; i++) {
+		job->loaded[i] = vkx_decode_texture(job->filenames[i], &job->textures[i]);
+	}
+}
+
+void vkx_create_texture_images(const char* const* filenames, uint32_t count, VkxImage* images, bool generate_mipmaps) {
+	/*
+	 * Load lots of textures at once.  The files are decoded in parallel on the job
+	 * system, then all of the pixels go into one staging buffer and are uploaded
+	 * with a single set of barriers.  As with vkx_create_texture_image(),
+	 * vkx_upload_flush() must be called before the textures are used.  Images
+	 * with KTX2 encodings the device supports are used as they are (see
+	 * vkx_decode_texture())
+	 *
+	 * @param filenames The image files to load
+	 * @param count The number of files
+	 * @param images Array of count images to fill in
+	 * @param generate_mipmaps Generate a full mip chain for each image on the GPU
+	 */
+	if (count == 0) {
+		return;
+	}
+
+	printf("Loading %d texture images\n", count);
+
+	VkxTextureDecodeJob job = {0};
+	job.filenames = filenames;
+	job.textures = calloc(count, sizeof(VkxDecodedTexture));
+	job.loaded = calloc(count, sizeof(bool));
+
+	if (job.textures == NULL || job.loaded == NULL) {
+		fprintf(stderr, "Failed to allocate texture loading arrays\n");
+		exit(1);
+	}
+
+	// Decoding is by far the slowest part, so one file per job
+	jobs_parallel_for(count, 1, vkx_decode_texture_images, &job);
+
+	for (uint32_t i = 0; i < count; i++) {
+		if (!job.loaded[i]) {
+			fprintf(stderr, "failed to load texture image %s!\n", filenames[i]);
+			exit(1);
+		}
+
+		if (job.textures[i].compressed) {
+			printf("Using %d level KTX2 encoding (format %d) of %s\n", job.textures[i].ktx2.mip_levels, job.textures[i].ktx2.format, filenames[i]);
+		}
+	}
+
+	vkx_create_decoded_textures(count, job.textures, images, generate_mipmaps);
+
+	for (uint32_t i = 0; i < count; i++) {
+		vkx_free_decoded_texture(&job.textures[i]);
+	}
+
+	free(job.loaded);
+	free(job.textures);
+}
@@ -0,0 +1,103 @@
+/*
+ * Names for Vulkan objects and labels around the commands in a command buffer,
+ * which capture tools and the validation layers show instead of handles.
+ *
+ * They come from VK_EXT_debug_utils, which vkx_init() asks the instance for
+ * in builds without NDEBUG if it has it (a capture tool's layer usually adds
+ * it), and which the validation layers need anyway.  Without it, and in
+ * release builds, everything here does nothing.
+ */
+
+#include "vkx/vkx_debug.h"
+
+#ifndef NDEBUG
+
+#include <stdio.h>
+
+static PFN_vkSetDebugUtilsObjectNameEXT set_object_name_func = NULL;
+static PFN_vkCmdBeginDebugUtilsLabelEXT cmd_begin_label_func = NULL;
+static PFN_vkCmdEndDebugUtilsLabelEXT cmd_end_label_func = NULL;
+
+void vkx_debug_init(void) {
+	/*
+	 * Load the functions, after the device is created
+	 */
+	if (!vkx_instance.has_debug_utils) {
+		return;
+	}
+
+	set_object_name_func = (PFN_vkSetDebugUtilsObjectNameEXT) vkGetInstanceProcAddr(vkx_instance.instance, "vkSetDebugUtilsObjectNameEXT");
+	cmd_begin_label_func = (PFN_vkCmdBeginDebugUtilsLabelEXT) vkGetInstanceProcAddr(vkx_instance.instance, "vkCmdBeginDebugUtilsLabelEXT");
+	cmd_end_label_func = (PFN_vkCmdEndDebugUtilsLabelEXT) vkGetInstanceProcAddr(vkx_instance.instance, "vkCmdEndDebugUtilsLabelEXT");
+	if (set_object_name_func == NULL || cmd_begin_label_func == NULL || cmd_end_label_func == NULL) {
+		printf("VK_EXT_debug_utils is missing its functions - objects won't be named\n");
+		set_object_name_func = NULL;
+		cmd_begin_label_func = NULL;
+		cmd_end_label_func = NULL;
+	}
+}
+
+void vkx_set_object_name(VkObjectType type, uint64_t handle, const char* name) {
+	/*
+	 * Name an object
+	 *
+	 * @param handle The object's handle cast to uint64_t, which is skipped if
+	 *               it's VK_NULL_HANDLE (i.e. not created)
+	 * @param name Copied
+	 */
+	if (set_object_name_func == NULL || handle == 0) {
+		return;
+	}
+
+	VkDebugUtilsObjectNameInfoEXT name_info = {0};
+	name_info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT;
+	name_info.objectType = type;
+	name_info.objectHandle = handle;
+	name_info.pObjectName = name;
+	set_object_name_func(vkx_instance.device, &name_info);
+}
+
+void vkx_set_buffer_name(const VkxBuffer* buffer, const char* name) {
+	vkx_set_object_name(VK_OBJECT_TYPE_BUFFER, (uint64_t) buffer->buffer, name);
+}
+
+void vkx_set_image_name(const VkxImage* image, const char* name) {
+	// And its view
+	vkx_set_object_name(VK_OBJECT_TYPE_IMAGE, (uint64_t) image->image, name);
+	vkx_set_object_name(VK_OBJECT_TYPE_IMAGE_VIEW, (uint64_t) image->view, name);
+}
+
+void vkx_set_pipeline_name(const VkxPipeline* pipeline, const char* name) {
+	// Along with its layouts, or its shaders if it's made of shader objects
+	vkx_set_object_name(VK_OBJECT_TYPE_PIPELINE, (uint64_t) pipeline->pipeline, name);
+	vkx_set_object_name(VK_OBJECT_TYPE_PIPELINE_LAYOUT, (uint64_t) pipeline->layout, name);
+	vkx_set_object_name(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, (uint64_t) pipeline->descriptor_set_layout, name);
+	for (uint32_t i = 0; i < 2; i++) {
+		vkx_set_object_name(VK_OBJECT_TYPE_SHADER_EXT, (uint64_t) pipeline->shaders[i], name);
+	}
+}
+
+void vkx_cmd_begin_label(VkCommandBuffer command_buffer, const char* name) {
+	/*
+	 * Begin a labelled region of the command buffer, which ends with
+	 * vkx_cmd_end_label() in the same command buffer.  They can be nested
+	 */
+	if (cmd_begin_label_func == NULL) {
+		return;
+	}
+
+	VkDebugUtilsLabelEXT label = {0};
+	label.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT;
+	label.pLabelName = name;
+	cmd_begin_label_func(command_buffer, &label);
+}
+
+void vkx_cmd_end_label(VkCommandBuffer command_buffer) {
+	if (cmd_end_label_func == NULL) {
+		return;
+	}
+
+	cmd_end_label_func(command_buffer);
+}
+
+#endif // NDEBUG
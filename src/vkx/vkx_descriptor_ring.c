@@ -0,0 +1,161 @@
+/*
+ * Descriptor sets which only last a frame, e.g. the sets written for a push
+ * set without VK_KHR_push_descriptor.
+ *
+ * Each frame in flight has a chain of descriptor pools.  Sets are allocated
+ * from the newest pool which isn't full, so allocating is just the driver
+ * bumping along the pool, and when the last one fills up another twice its
+ * size is chained on.  Nothing is freed on its own: once the frame's fence
+ * has been waited on, vkx_descriptor_ring_begin_frame() resets all of its
+ * pools at once and starts from the first again.  The pools are kept, so after
+ * the busiest frame so far there's nothing more to create.
+ *
+ * Sets can be allocated by any thread, e.g. the workers recording secondary
+ * command buffers, so they're allocated with a mutex held.
+ */
+
+#include "vkx/vkx_descriptor_ring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <SDL3/SDL.h>
+
+typedef struct {
+	VkDescriptorPool pools[VKX_DESCRIPTOR_RING_MAX_POOLS];
+	uint32_t pools_count;
+	// The pool sets are being allocated from
+	uint32_t current;
+} VkxDescriptorRingFrame;
+
+static SDL_Mutex* ring_mutex = NULL;
+static VkxDescriptorRingFrame ring_frames[VKX_MAX_FRAMES_IN_FLIGHT] = {0};
+static uint32_t ring_frame = 0;
+
+// Every type a transient set could have, so any layout can come from any pool
+static const VkDescriptorType ring_types[] = {
+	VK_DESCRIPTOR_TYPE_SAMPLER,
+	VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+	VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+	VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+	VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+	VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+	VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+	VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+};
+#define VKX_DESCRIPTOR_RING_TYPES_COUNT (sizeof(ring_types) / sizeof(ring_types[0]))
+
+void vkx_descriptor_ring_init(void) {
+	/*
+	 * Get ready to allocate.  The pools are created the first time each frame
+	 * needs them
+	 */
+	ring_mutex = SDL_CreateMutex();
+	if (ring_mutex == NULL) {
+		fprintf(stderr, "Failed to create the descriptor ring mutex: %s\n", SDL_GetError());
+		exit(1);
+	}
+}
+
+void vkx_descriptor_ring_cleanup(void) {
+	for (uint32_t i = 0; i < VKX_MAX_FRAMES_IN_FLIGHT; i++) {
+		for (uint32_t j = 0; j < ring_frames[i].pools_count; j++) {
+			vkDestroyDescriptorPool(vkx_instance.device, ring_frames[i].pools[j], vkx_get_allocator(VK_OBJECT_TYPE_DESCRIPTOR_POOL));
+		}
+		ring_frames[i] = (VkxDescriptorRingFrame) {0};
+	}
+	SDL_DestroyMutex(ring_mutex);
+	ring_mutex = NULL;
+}
+
+static VkDescriptorPool vkx_descriptor_ring_create_pool(uint32_t index) {
+	/*
+	 * Create the index'th pool of a frame's chain
+	 */
+	uint32_t sets = VKX_DESCRIPTOR_RING_POOL_SETS << index;
+
+	VkDescriptorPoolSize pool_sizes[VKX_DESCRIPTOR_RING_TYPES_COUNT] = {0};
+	for (uint32_t i = 0; i < VKX_DESCRIPTOR_RING_TYPES_COUNT; i++) {
+		pool_sizes[i].type = ring_types[i];
+		pool_sizes[i].descriptorCount = sets * VKX_DESCRIPTOR_RING_DESCRIPTORS_PER_SET;
+	}
+
+	VkDescriptorPoolCreateInfo pool_info = {0};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.poolSizeCount = VKX_DESCRIPTOR_RING_TYPES_COUNT;
+	pool_info.pPoolSizes = pool_sizes;
+	pool_info.maxSets = sets;
+
+	VkDescriptorPool pool;
+	if (vkCreateDescriptorPool(vkx_instance.device, &pool_info, vkx_get_allocator(VK_OBJECT_TYPE_DESCRIPTOR_POOL), &pool) != VK_SUCCESS) {
+		fprintf(stderr, "failed to create descriptor ring pool!\n");
+		exit(1);
+	}
+	if (index > 0) {
+		printf("Chained a descriptor pool of %u sets onto frame %u's\n", sets, ring_frame);
+	}
+	return pool;
+}
+
+void vkx_descriptor_ring_begin_frame(uint32_t frame) {
+	/*
+	 * Call once per frame after waiting for that frame, before anything
+	 * allocates for it.  Every set allocated the last time it was recorded is
+	 * freed
+	 *
+	 * @param frame The index of the frame in flight which is being recorded
+	 */
+	SDL_LockMutex(ring_mutex);
+	ring_frame = frame;
+	VkxDescriptorRingFrame* ring = &ring_frames[frame];
+	for (uint32_t i = 0; i <= ring->current && i < ring->pools_count; i++) {
+		vkResetDescriptorPool(vkx_instance.device, ring->pools[i], 0);
+	}
+	ring->current = 0;
+	SDL_UnlockMutex(ring_mutex);
+}
+
+VkDescriptorSet vkx_descriptor_ring_allocate(VkDescriptorSetLayout layout) {
+	/*
+	 * Allocate a set for the frame being recorded, which is only valid until
+	 * the frame comes round again
+	 *
+	 * @param layout A layout whose bindings have no more than
+	 *               VKX_DESCRIPTOR_RING_DESCRIPTORS_PER_SET descriptors of any
+	 *               one type
+	 */
+	SDL_LockMutex(ring_mutex);
+	VkxDescriptorRingFrame* ring = &ring_frames[ring_frame];
+
+	VkDescriptorSetAllocateInfo alloc_info = {0};
+	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	alloc_info.descriptorSetCount = 1;
+	alloc_info.pSetLayouts = &layout;
+
+	VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+	for (;;) {
+		if (ring->current == ring->pools_count) {
+			if (ring->pools_count == VKX_DESCRIPTOR_RING_MAX_POOLS) {
+				fprintf(stderr, "Allocated more transient descriptor sets in a frame than %d pools hold\n", VKX_DESCRIPTOR_RING_MAX_POOLS);
+				exit(1);
+			}
+			ring->pools[ring->pools_count] = vkx_descriptor_ring_create_pool(ring->pools_count);
+			ring->pools_count++;
+		}
+
+		alloc_info.descriptorPool = ring->pools[ring->current];
+		VkResult result = vkAllocateDescriptorSets(vkx_instance.device, &alloc_info, &descriptor_set);
+		if (result == VK_SUCCESS) {
+			break;
+		}
+		if (result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL) {
+			fprintf(stderr, "failed to allocate a transient descriptor set!\n");
+			exit(1);
+		}
+		// This pool is full, so move on to the next one in the chain
+		ring->current++;
+	}
+
+	SDL_UnlockMutex(ring_mutex);
+	return descriptor_set;
+}
@@ -0,0 +1,1417 @@
+/*
+ * Frame graph for the render passes of a frame.
+ *
+ * The passes are declared once up front along with the images they render to
+ * and sample, then vkx_frame_graph_compile() works out everything the passes
+ * need between them:
+ *
+ *  - The layout transitions and synchronisation2 barriers, with the stage and
+ *    access masks of the actual uses on each side.  All of the barriers before
+ *    a pass go into a single vkCmdPipelineBarrier2, and reads of an image in a
+ *    layout it is already in don't need one at all.
+ *  - The transient images, which are created by the graph (one per frame in
+ *    flight, or one shared by all of them) with the usage flags they need.  Transients which aren't in use at
+ *    the same time share memory, and as their contents never outlive the frame
+ *    the attachments are only stored if a later pass reads them.  Transients
+ *    which are only attachments of a single pass (e.g. depth buffers) are
+ *    never stored at all, so they are created as transient attachments in
+ *    lazily allocated memory where the device has it.  On tiled GPUs these
+ *    stay in tile memory and never take up any real memory.
+ *  - The load ops.  Attachments a pass draws over every pixel of (see
+ *    vkx_frame_graph_set_covered()) aren't cleared or loaded, and neither are
+ *    transients which nothing has written yet this frame.
+ *  - Multisampled transients, which are resolved into another image at the
+ *    end of the pass rendering to them.  They're usually only in that pass,
+ *    so they stay in tile memory too and only the resolved image is stored.
+ *  - Persistent transients, which keep their contents into the next frame,
+ *    so a pass can draw only part of them (see vkx_frame_graph_set_render_area())
+ *    and leave the rest as it was.  They have memory to themselves.
+ *
+ * Imported images (e.g. the swap chain images) are owned by the caller, who
+ * gives the graph the current handle each frame with vkx_frame_graph_set_image()
+ * and says which layout they start and end the frame in.
+ *
+ * Recording goes through the passes in the order they were added:
+ *
+ *     vkx_frame_graph_begin(&graph, command_buffer, frame);
+ *     vkx_frame_graph_begin_pass(&graph, scene_pass);
+ *     ... draws ...
+ *     vkx_frame_graph_end_pass(&graph);
+ *     ...
+ *     vkx_frame_graph_end(&graph);
+ *
+ * Passes with attachments are recorded inside dynamic rendering over the extent
+ * of their attachments, with the viewport and scissor set to match.  Passes
+ * which only transfer between images (e.g. a blit to the swap chain) or run
+ * compute shaders over them are recorded outside of it, with
+ * vkx_frame_graph_get_image() for the handles.
+ *
+ * A run of compute passes can go on the compute queue instead, so that it
+ * overlaps with graphics work.  The caller splits the frame into three
+ * submissions around them (see vkx_frame_graph_set_command_buffer()) with
+ * semaphores in between, which is what orders the passes across the queues, so
+ * the barriers there only change layouts.  Images used on both queues are
+ * shared between the two families, and every frame in flight gets its own
+ * transients, as the frames aren't ordered across the queues.
+ */
+
+#include "vkx/vkx_frame_graph.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vkx/vkx_memory.h"
+
+// Accesses which have to be made available to anything later
+#define VKX_FRAME_GRAPH_WRITE_ACCESS ( \
+	VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | \
+	VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | \
+	VK_ACCESS_2_SHADER_WRITE_BIT | \
+	VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | \
+	VK_ACCESS_2_TRANSFER_WRITE_BIT | \
+	VK_ACCESS_2_HOST_WRITE_BIT | \
+	VK_ACCESS_2_MEMORY_WRITE_BIT)
+
+static bool vkx_frame_graph_is_attachment(VkxFrameGraphUsage usage) {
+	return usage == VKX_FRAME_GRAPH_COLOR_ATTACHMENT || usage == VKX_FRAME_GRAPH_DEPTH_ATTACHMENT
+		|| usage == VKX_FRAME_GRAPH_RESOLVE_ATTACHMENT || usage == VKX_FRAME_GRAPH_LOCAL_READ_ATTACHMENT;
+}
+
+void vkx_frame_graph_init(VkxFrameGraph* graph) {
+	memset(graph, 0, sizeof(VkxFrameGraph));
+}
+
+void vkx_frame_graph_cleanup(VkxFrameGraph* graph) {
+	/*
+	 * Destroy the transient images and their memory.  The GPU must be done with
+	 * them
+	 */
+	for (uint32_t i = 0; i < graph->images_count; i++) {
+		VkxFrameGraphImage* image = &graph->images[i];
+		if (!image->transient) {
+			continue;
+		}
+
+		for (uint32_t f = 0; f < vkx_instance.frames_in_flight; f++) {
+			if (image->views[f] != VK_NULL_HANDLE) {
+				vkDestroyImageView(vkx_instance.device, image->views[f], vkx_get_allocator(VK_OBJECT_TYPE_IMAGE_VIEW));
+			}
+			if (image->images[f] != VK_NULL_HANDLE) {
+				vkDestroyImage(vkx_instance.device, image->images[f], vkx_get_allocator(VK_OBJECT_TYPE_IMAGE));
+			}
+		}
+	}
+
+	for (uint32_t f = 0; f < vkx_instance.frames_in_flight; f++) {
+		for (uint32_t i = 0; i < graph->memory_slots_count; i++) {
+			vkx_memory_free(&graph->memory[f][i]);
+		}
+	}
+
+	memset(graph, 0, sizeof(VkxFrameGraph));
+}
+
+static uint32_t vkx_frame_graph_add_image(VkxFrameGraph* graph, VkFormat format) {
+	if (graph->compiled) {
+		fprintf(stderr, "Can't add images to a compiled frame graph\n");
+		exit(1);
+	}
+	if (graph->images_count >= VKX_FRAME_GRAPH_MAX_IMAGES) {
+		fprintf(stderr, "Too many frame graph images (max %d)\n", VKX_FRAME_GRAPH_MAX_IMAGES);
+		exit(1);
+	}
+
+	VkxFrameGraphImage* image = &graph->images[graph->images_count];
+	memset(image, 0, sizeof(VkxFrameGraphImage));
+	image->format = format;
+	image->array_layers = 1;
+	image->samples = VK_SAMPLE_COUNT_1_BIT;
+	image->first_pass = UINT32_MAX;
+
+	return graph->images_count++;
+}
+
+uint32_t vkx_frame_graph_import_image(VkxFrameGraph* graph, VkFormat format,
+		VkxFrameGraphState initial, VkxFrameGraphState final) {
+	/*
+	 * Add an image which is owned by the caller
+	 *
+	 * @param format Format of the image
+	 * @param initial Layout the image is in at the start of the frame, and the
+	 *                stages and accesses which the first use has to wait for
+	 * @param final Layout to leave the image in, and the stages and accesses
+	 *              which use it after the graph
+	 *
+	 * @return The graph's index for the image
+	 */
+	uint32_t index = vkx_frame_graph_add_image(graph, format);
+	graph->images[index].initial = initial;
+	graph->images[index].final = final;
+
+	return index;
+}
+
+uint32_t vkx_frame_graph_create_image(VkxFrameGraph* graph, uint32_t width, uint32_t height, VkFormat format) {
+	/*
+	 * Add a transient image, which is created when the graph is compiled
+	 *
+	 * @return The graph's index for the image
+	 */
+	return vkx_frame_graph_create_image_array(graph, width, height, format, 1);
+}
+
+uint32_t vkx_frame_graph_create_image_array(VkxFrameGraph* graph, uint32_t width, uint32_t height, VkFormat format, uint32_t array_layers) {
+	/*
+	 * Add a transient image with layers, e.g. one for each view of a multiview
+	 * pass.  With more than one its view is a 2D array
+	 *
+	 * @return The graph's index for the image
+	 */
+	uint32_t index = vkx_frame_graph_add_image(graph, format);
+	graph->images[index].transient = true;
+	graph->images[index].extent.width = width;
+	graph->images[index].extent.height = height;
+	graph->images[index].array_layers = array_layers;
+
+	return index;
+}
+
+void vkx_frame_graph_set_samples(VkxFrameGraph* graph, uint32_t image, VkSampleCountFlagBits samples) {
+	/*
+	 * Give a transient image more than one sample a pixel, for rendering with
+	 * multisampling.  It can then only be an attachment, and a colour one has
+	 * to be resolved to be used by anything after its pass
+	 */
+	if (!graph->images[image].transient) {
+		fprintf(stderr, "Only transient frame graph images can be multisampled\n");
+		exit(1);
+	}
+
+	graph->images[image].samples = samples;
+}
+
+void vkx_frame_graph_set_persistent(VkxFrameGraph* graph, uint32_t image) {
+	/*
+	 * Keep a transient image's contents from one frame to the next, e.g. to
+	 * only draw what changed into it.  It gets memory of its own and is always
+	 * stored, and its first pass gets it in the layout its last pass left it
+	 * in.  When there's a copy per frame in flight each one has what was drawn
+	 * into it frames_in_flight frames ago, and until a copy has been through a
+	 * frame its contents are undefined (see VkxFrameGraphImage.initialized).
+	 * Must be called before compiling
+	 */
+	if (graph->compiled) {
+		fprintf(stderr, "Can't make images of a compiled frame graph persistent\n");
+		exit(1);
+	}
+	if (!graph->images[image].transient || graph->images[image].samples != VK_SAMPLE_COUNT_1_BIT) {
+		fprintf(stderr, "Only single sampled transient frame graph images can be persistent\n");
+		exit(1);
+	}
+
+	graph->images[image].persistent = true;
+}
+
+void vkx_frame_graph_set_image(VkxFrameGraph* graph, uint32_t image, VkImage handle, VkImageView view, VkExtent2D extent) {
+	/*
+	 * Set the handles of an imported image for the frame about to be recorded
+	 */
+	if (graph->images[image].transient) {
+		fprintf(stderr, "Can't set the handles of a transient frame graph image\n");
+		exit(1);
+	}
+
+	graph->images[image].images[0] = handle;
+	graph->images[image].views[0] = view;
+	graph->images[image].extent = extent;
+}
+
+uint32_t vkx_frame_graph_add_pass(VkxFrameGraph* graph) {
+	/*
+	 * Add a pass, which is recorded after the ones added before it
+	 *
+	 * @return The graph's index for the pass
+	 */
+	if (graph->compiled) {
+		fprintf(stderr, "Can't add passes to a compiled frame graph\n");
+		exit(1);
+	}
+	if (graph->passes_count >= VKX_FRAME_GRAPH_MAX_PASSES) {
+		fprintf(stderr, "Too many frame graph passes (max %d)\n", VKX_FRAME_GRAPH_MAX_PASSES);
+		exit(1);
+	}
+
+	memset(&graph->passes[graph->passes_count], 0, sizeof(VkxFrameGraphPass));
+
+	return graph->passes_count++;
+}
+
+static void vkx_frame_graph_add_access(VkxFrameGraph* graph, uint32_t pass, uint32_t image,
+		VkxFrameGraphUsage usage, VkAttachmentLoadOp load_op, VkClearValue clear_value) {
+	VkxFrameGraphPass* graph_pass = &graph->passes[pass];
+	if (graph_pass->accesses_count >= VKX_FRAME_GRAPH_MAX_PASS_IMAGES) {
+		fprintf(stderr, "Too many images in a frame graph pass (max %d)\n", VKX_FRAME_GRAPH_MAX_PASS_IMAGES);
+		exit(1);
+	}
+
+	for (uint32_t i = 0; i < graph_pass->accesses_count; i++) {
+		if (graph_pass->accesses[i].image == image) {
+			fprintf(stderr, "Frame graph image %u is used twice in pass %u\n", image, pass);
+			exit(1);
+		}
+	}
+
+	VkxFrameGraphAccess* access = &graph_pass->accesses[graph_pass->accesses_count++];
+	access->image = image;
+	access->usage = usage;
+	access->load_op = load_op;
+	access->store_op = VK_ATTACHMENT_STORE_OP_STORE;
+	access->clear_value = clear_value;
+	access->resolve_image = UINT32_MAX;
+}
+
+void vkx_frame_graph_add_color_attachment(VkxFrameGraph* graph, uint32_t pass, uint32_t image,
+		VkAttachmentLoadOp load_op, VkClearValue clear_value) {
+	/*
+	 * Render to an image in a pass.  Attachments are bound in the order they
+	 * are added
+	 */
+	vkx_frame_graph_add_access(graph, pass, image, VKX_FRAME_GRAPH_COLOR_ATTACHMENT, load_op, clear_value);
+}
+
+void vkx_frame_graph_add_depth_attachment(VkxFrameGraph* graph, uint32_t pass, uint32_t image,
+		VkAttachmentLoadOp load_op, VkClearValue clear_value) {
+	vkx_frame_graph_add_access(graph, pass, image, VKX_FRAME_GRAPH_DEPTH_ATTACHMENT, load_op, clear_value);
+}
+
+void vkx_frame_graph_add_resolve_attachment(VkxFrameGraph* graph, uint32_t pass, uint32_t image, uint32_t resolve_image) {
+	/*
+	 * Average a multisampled colour attachment of a pass into resolve_image at
+	 * the end of it.  The colour attachment has to have been added first, and
+	 * resolve_image is written all over, so it needs the same extent
+	 */
+	VkxFrameGraphPass* graph_pass = &graph->passes[pass];
+	VkxFrameGraphAccess* color = NULL;
+	for (uint32_t i = 0; i < graph_pass->accesses_count; i++) {
+		if (graph_pass->accesses[i].image == image && graph_pass->accesses[i].usage == VKX_FRAME_GRAPH_COLOR_ATTACHMENT) {
+			color = &graph_pass->accesses[i];
+		}
+	}
+	if (color == NULL) {
+		fprintf(stderr, "Frame graph image %u isn't a colour attachment of pass %u to resolve\n", image, pass);
+		exit(1);
+	}
+	color->resolve_image = resolve_image;
+
+	VkClearValue unused = {0};
+	vkx_frame_graph_add_access(graph, pass, resolve_image, VKX_FRAME_GRAPH_RESOLVE_ATTACHMENT, VK_ATTACHMENT_LOAD_OP_DONT_CARE, unused);
+}
+
+void vkx_frame_graph_add_sampled_image(VkxFrameGraph* graph, uint32_t pass, uint32_t image) {
+	/*
+	 * Sample an image in the fragment shaders of a pass
+	 */
+	VkClearValue unused = {0};
+	vkx_frame_graph_add_access(graph, pass, image, VKX_FRAME_GRAPH_SAMPLED, VK_ATTACHMENT_LOAD_OP_DONT_CARE, unused);
+}
+
+void vkx_frame_graph_add_transfer_source(VkxFrameGraph* graph, uint32_t pass, uint32_t image) {
+	/*
+	 * Copy or blit from an image in a pass
+	 */
+	VkClearValue unused = {0};
+	vkx_frame_graph_add_access(graph, pass, image, VKX_FRAME_GRAPH_TRANSFER_SOURCE, VK_ATTACHMENT_LOAD_OP_DONT_CARE, unused);
+}
+
+void vkx_frame_graph_add_transfer_destination(VkxFrameGraph* graph, uint32_t pass, uint32_t image) {
+	/*
+	 * Copy or blit to an image in a pass
+	 */
+	VkClearValue unused = {0};
+	vkx_frame_graph_add_access(graph, pass, image, VKX_FRAME_GRAPH_TRANSFER_DESTINATION, VK_ATTACHMENT_LOAD_OP_DONT_CARE, unused);
+}
+
+void vkx_frame_graph_add_storage_image(VkxFrameGraph* graph, uint32_t pass, uint32_t image) {
+	/*
+	 * Write to an image as a storage image in the compute shaders of a pass.
+	 * All of it is written, the previous contents aren't kept
+	 */
+	VkClearValue unused = {0};
+	vkx_frame_graph_add_access(graph, pass, image, VKX_FRAME_GRAPH_STORAGE, VK_ATTACHMENT_LOAD_OP_DONT_CARE, unused);
+}
+
+void vkx_frame_graph_add_compute_sampled_image(VkxFrameGraph* graph, uint32_t pass, uint32_t image) {
+	/*
+	 * Sample an image in the compute shaders of a pass
+	 */
+	VkClearValue unused = {0};
+	vkx_frame_graph_add_access(graph, pass, image, VKX_FRAME_GRAPH_COMPUTE_SAMPLED, VK_ATTACHMENT_LOAD_OP_DONT_CARE, unused);
+}
+
+void vkx_frame_graph_add_shading_rate_attachment(VkxFrameGraph* graph, uint32_t pass, uint32_t image, VkExtent2D texel_size) {
+	/*
+	 * Take the fragment shading rate of a pass's draws from an image, where
+	 * the device has vkx_instance.has_shading_rate_attachment.  It doesn't
+	 * count as one of the pass's attachments for its extent, so the pass needs
+	 * a colour or depth attachment as well
+	 *
+	 * @param image An R8_UINT image with a texel for each texel_size block of
+	 *              the pass's pixels, written before the pass
+	 * @param texel_size Within vkx_instance.shading_rate_texel_min and max
+	 */
+	VkClearValue unused = {0};
+	vkx_frame_graph_add_access(graph, pass, image, VKX_FRAME_GRAPH_SHADING_RATE_ATTACHMENT, VK_ATTACHMENT_LOAD_OP_DONT_CARE, unused);
+	graph->passes[pass].shading_rate_texel_size = texel_size;
+}
+
+void vkx_frame_graph_add_local_read_attachment(VkxFrameGraph* graph, uint32_t pass, uint32_t image,
+		VkAttachmentLoadOp load_op, VkClearValue clear_value) {
+	/*
+	 * Render to an image in a pass whose shaders also read the pixel they're
+	 * drawing from it, as the input attachment with the same index as the
+	 * colour attachment, after a vkx_frame_graph_cmd_local_read_barrier().
+	 * Needs vkx_instance.has_local_read, and a single sample, as it can't be
+	 * resolved
+	 */
+	vkx_frame_graph_add_access(graph, pass, image, VKX_FRAME_GRAPH_LOCAL_READ_ATTACHMENT, load_op, clear_value);
+}
+
+void vkx_frame_graph_set_covered(VkxFrameGraph* graph, uint32_t pass, uint32_t image) {
+	/*
+	 * Say that a pass draws over every pixel of its render area in one of its
+	 * attachments, e.g. with a full screen quad, so there's no need to clear it
+	 * or load what was there before.  Its load op becomes DONT_CARE when the
+	 * graph is compiled
+	 */
+	VkxFrameGraphPass* graph_pass = &graph->passes[pass];
+	for (uint32_t i = 0; i < graph_pass->accesses_count; i++) {
+		VkxFrameGraphAccess* access = &graph_pass->accesses[i];
+		if (access->image == image && vkx_frame_graph_is_attachment(access->usage)
+				&& access->usage != VKX_FRAME_GRAPH_RESOLVE_ATTACHMENT) {
+			access->covered = true;
+			return;
+		}
+	}
+
+	fprintf(stderr, "Frame graph image %u isn't an attachment of pass %u to cover\n", image, pass);
+	exit(1);
+}
+
+static VkxFrameGraphState vkx_frame_graph_access_state(const VkxFrameGraphAccess* access) {
+	/*
+	 * The layout, stages and accesses needed for a use of an image
+	 */
+	VkxFrameGraphState state = {0};
+
+	switch (access->usage) {
+		case VKX_FRAME_GRAPH_COLOR_ATTACHMENT:
+			state.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+			state.stages = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+			state.access = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+			if (access->load_op == VK_ATTACHMENT_LOAD_OP_LOAD) {
+				state.access |= VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT;
+			}
+			break;
+		case VKX_FRAME_GRAPH_RESOLVE_ATTACHMENT:
+			// Resolves happen in the colour attachment output stage
+			state.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+			state.stages = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+			state.access = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+			break;
+		case VKX_FRAME_GRAPH_DEPTH_ATTACHMENT:
+			// Clears and loads happen in the early tests, stores in the late tests
+			state.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+			state.stages = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT;
+			state.access = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+			break;
+		case VKX_FRAME_GRAPH_SAMPLED:
+			state.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			state.stages = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+			state.access = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+			break;
+		case VKX_FRAME_GRAPH_TRANSFER_SOURCE:
+			state.layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			state.stages = VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_BLIT_BIT;
+			state.access = VK_ACCESS_2_TRANSFER_READ_BIT;
+			break;
+		case VKX_FRAME_GRAPH_TRANSFER_DESTINATION:
+			state.layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			state.stages = VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_BLIT_BIT;
+			state.access = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+			break;
+		case VKX_FRAME_GRAPH_STORAGE:
+			state.layout = VK_IMAGE_LAYOUT_GENERAL;
+			state.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+			state.access = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+			break;
+		case VKX_FRAME_GRAPH_COMPUTE_SAMPLED:
+			state.layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			state.stages = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+			state.access = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+			break;
+		case VKX_FRAME_GRAPH_SHADING_RATE_ATTACHMENT:
+			state.layout = VK_IMAGE_LAYOUT_FRAGMENT_SHADING_RATE_ATTACHMENT_OPTIMAL_KHR;
+			state.stages = VK_PIPELINE_STAGE_2_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR;
+			state.access = VK_ACCESS_2_FRAGMENT_SHADING_RATE_ATTACHMENT_READ_BIT_KHR;
+			break;
+		case VKX_FRAME_GRAPH_LOCAL_READ_ATTACHMENT:
+			state.layout = VK_IMAGE_LAYOUT_RENDERING_LOCAL_READ_KHR;
+			state.stages = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+			state.access = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_INPUT_ATTACHMENT_READ_BIT;
+			if (access->load_op == VK_ATTACHMENT_LOAD_OP_LOAD) {
+				state.access |= VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT;
+			}
+			break;
+	}
+
+	return state;
+}
+
+static VkxFrameGraphState vkx_frame_graph_last_state(const VkxFrameGraph* graph, uint32_t image) {
+	/*
+	 * The state an image is left in by its last use in the graph
+	 */
+	const VkxFrameGraphPass* pass = &graph->passes[graph->images[image].last_pass];
+	for (uint32_t i = 0; i < pass->accesses_count; i++) {
+		if (pass->accesses[i].image == image) {
+			return vkx_frame_graph_access_state(&pass->accesses[i]);
+		}
+	}
+
+	VkxFrameGraphState none = {0};
+	return none;
+}
+
+static void vkx_frame_graph_init_barrier(const VkxFrameGraph* graph, uint32_t image,
+		VkxFrameGraphState src, VkxFrameGraphState dst, VkImageMemoryBarrier2* barrier) {
+	/*
+	 * Fill in a barrier on all of an image from one state to another, apart
+	 * from the image handle
+	 */
+	memset(barrier, 0, sizeof(VkImageMemoryBarrier2));
+	barrier->sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+	barrier->srcStageMask = src.stages != 0 ? src.stages : VK_PIPELINE_STAGE_2_NONE;
+	// Only writes need to be made available
+	barrier->srcAccessMask = src.access & VKX_FRAME_GRAPH_WRITE_ACCESS;
+	barrier->dstStageMask = dst.stages != 0 ? dst.stages : VK_PIPELINE_STAGE_2_NONE;
+	barrier->dstAccessMask = dst.access;
+	barrier->oldLayout = src.layout;
+	barrier->newLayout = dst.layout;
+	barrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier->subresourceRange.aspectMask = graph->images[image].aspect;
+	barrier->subresourceRange.baseMipLevel = 0;
+	barrier->subresourceRange.levelCount = 1;
+	barrier->subresourceRange.baseArrayLayer = 0;
+	barrier->subresourceRange.layerCount = graph->images[image].array_layers;
+}
+
+static void vkx_frame_graph_add_barrier(VkxFrameGraph* graph, uint32_t image,
+		VkxFrameGraphState src, VkxFrameGraphState dst) {
+	vkx_frame_graph_init_barrier(graph, image, src, dst, &graph->barriers[graph->barriers_count]);
+
+	graph->barrier_images[graph->barriers_count] = image;
+	graph->barriers_count++;
+}
+
+void vkx_frame_graph_set_render_extent(VkxFrameGraph* graph, uint32_t pass, VkExtent2D extent) {
+	/*
+	 * Render to only part of the pass's attachments, e.g. for rendering at a
+	 * lower resolution without recreating them.  This only sets the render
+	 * area, viewport and scissor, so it can be changed every frame (but not
+	 * while the pass is being recorded)
+	 *
+	 * @param pass The pass to render with the extent
+	 * @param extent Size of the area from the top left corner, or zero for
+	 *               all of the attachments
+	 */
+	if (pass >= graph->passes_count) {
+		fprintf(stderr, "Invalid frame graph pass %u\n", pass);
+		exit(1);
+	}
+
+	graph->passes[pass].render_extent = extent;
+}
+
+void vkx_frame_graph_set_render_area(VkxFrameGraph* graph, uint32_t pass, VkRect2D area) {
+	/*
+	 * Only draw part of the pass's render extent, e.g. what changed since a
+	 * persistent image was last drawn into.  The viewport stays where it is, so
+	 * nothing moves, but the render area and scissor are limited to the area
+	 * and clearing only clears that.  Can change every frame like the extent
+	 *
+	 * @param pass The pass to limit
+	 * @param area Part of the render extent to draw, or zero for all of it
+	 */
+	if (pass >= graph->passes_count) {
+		fprintf(stderr, "Invalid frame graph pass %u\n", pass);
+		exit(1);
+	}
+
+	graph->passes[pass].render_area = area;
+}
+
+void vkx_frame_graph_set_view_mask(VkxFrameGraph* graph, uint32_t pass, uint32_t view_mask) {
+	/*
+	 * Render the views in view_mask at once with multiview, each to that layer
+	 * of the attachments (which need that many).  The pipelines used in the
+	 * pass have to be created with the same mask, see vkx_set_view_mask()
+	 */
+	if (pass >= graph->passes_count) {
+		fprintf(stderr, "Invalid frame graph pass %u\n", pass);
+		exit(1);
+	}
+
+	graph->passes[pass].view_mask = view_mask;
+}
+
+void vkx_frame_graph_set_async_compute(VkxFrameGraph* graph, uint32_t pass) {
+	/*
+	 * Record a pass on the compute queue.  It can only use transient images and
+	 * compute shaders, and the async passes have to come one after another, as
+	 * the frame is submitted in three parts around them.  Must be called before
+	 * compiling, and only if vkx_instance.has_async_compute
+	 */
+	if (graph->compiled) {
+		fprintf(stderr, "Can't move passes of a compiled frame graph to the compute queue\n");
+		exit(1);
+	}
+	if (!vkx_instance.has_async_compute) {
+		fprintf(stderr, "The device has no queue for async compute\n");
+		exit(1);
+	}
+	if (pass >= graph->passes_count) {
+		fprintf(stderr, "Invalid frame graph pass %u\n", pass);
+		exit(1);
+	}
+
+	graph->passes[pass].async_compute = true;
+	graph->async_compute = true;
+}
+
+void vkx_frame_graph_set_transient_mode(VkxFrameGraph* graph, VkxFrameGraphTransientMode mode) {
+	/*
+	 * Choose whether the transient images are created for each frame in flight
+	 * or shared between them.  Must be called before compiling
+	 */
+	if (graph->compiled) {
+		fprintf(stderr, "Can't change the transient mode of a compiled frame graph\n");
+		exit(1);
+	}
+
+	graph->transient_mode = mode;
+}
+
+static uint32_t vkx_frame_graph_transient_copies(const VkxFrameGraph* graph, const VkMemoryRequirements* slot_requirements) {
+	/*
+	 * Work out how many copies of the transient images to make.  Sharing one set
+	 * is safe as the first barrier on each image waits for its last use, which
+	 * covers the previous frame too, but the frames can't overlap on the GPU
+	 * as much
+	 */
+	// Nothing stops the next frame's graphics work from overwriting a shared
+	// image while the compute queue still reads it
+	if (graph->async_compute) {
+		return vkx_instance.frames_in_flight;
+	}
+	if (graph->transient_mode == VKX_FRAME_GRAPH_SHARED) {
+		return 1;
+	}
+	if (graph->transient_mode == VKX_FRAME_GRAPH_PER_FRAME) {
+		return vkx_instance.frames_in_flight;
+	}
+
+	// Lazily allocated memory doesn't really take anything up
+	VkDeviceSize size = 0;
+	uint32_t type_filter = UINT32_MAX;
+	for (uint32_t slot = 0; slot < graph->memory_slots_count; slot++) {
+		if (graph->memory_slot_properties[slot] & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) {
+			continue;
+		}
+		size += slot_requirements[slot].size;
+		type_filter &= slot_requirements[slot].memoryTypeBits;
+	}
+
+	if (size == 0) {
+		return vkx_instance.frames_in_flight;
+	}
+
+	uint32_t heap_index = vkx_memory_get_type_heap(type_filter, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	VkDeviceSize available = vkx_memory_get_available(heap_index);
+
+	printf("Frame graph transients need %.1f MB per frame, %.1f MB available\n",
+		size / (1024.0 * 1024.0), available / (1024.0 * 1024.0));
+
+	if (size * vkx_instance.frames_in_flight > available / VKX_FRAME_GRAPH_BUDGET_DIVISOR) {
+		return 1;
+	}
+
+	return vkx_instance.frames_in_flight;
+}
+
+static void vkx_frame_graph_create_transients(VkxFrameGraph* graph) {
+	/*
+	 * Create the transient images and place them in memory, sharing it between
+	 * images which aren't in use at the same time
+	 */
+	VkMemoryRequirements slot_requirements[VKX_FRAME_GRAPH_MAX_IMAGES] = {0};
+	uint32_t slot_last_pass[VKX_FRAME_GRAPH_MAX_IMAGES] = {0};
+	bool placed[VKX_FRAME_GRAPH_MAX_IMAGES] = {0};
+
+	for (uint32_t i = 0; i < graph->images_count; i++) {
+		VkxFrameGraphImage* image = &graph->images[i];
+		if (!image->transient || image->first_pass == UINT32_MAX) {
+			continue;
+		}
+
+		VkImageCreateInfo image_info = {0};
+		image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		image_info.imageType = VK_IMAGE_TYPE_2D;
+		image_info.extent.width = image->extent.width;
+		image_info.extent.height = image->extent.height;
+		image_info.extent.depth = 1;
+		image_info.mipLevels = 1;
+		image_info.arrayLayers = image->array_layers;
+		// Only attachments can be transient attachments
+		const VkImageUsageFlags attachment_usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT
+			| VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+		bool transient_attachment = image->first_pass == image->last_pass && (image->usage & ~attachment_usage) == 0
+			&& !image->persistent;
+
+		image_info.format = image->format;
+		image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+		image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		image_info.usage = image->usage | (transient_attachment ? VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 0);
+		image_info.samples = image->samples;
+		image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		uint32_t queue_families[2] = {vkx_instance.graphics_queue_family, vkx_instance.compute_queue_family};
+		if (image->concurrent && queue_families[0] != queue_families[1]) {
+			image_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+			image_info.queueFamilyIndexCount = 2;
+			image_info.pQueueFamilyIndices = queue_families;
+		}
+
+		for (uint32_t f = 0; f < vkx_instance.frames_in_flight; f++) {
+			if (vkCreateImage(vkx_instance.device, &image_info, vkx_get_allocator(VK_OBJECT_TYPE_IMAGE), &image->images[f]) != VK_SUCCESS) {
+				fprintf(stderr, "Failed to create frame graph image!\n");
+				exit(1);
+			}
+		}
+
+		if (transient_attachment) {
+			VkMemoryRequirements requirements;
+			vkGetImageMemoryRequirements(vkx_instance.device, image->images[0], &requirements);
+			image->lazy = vkx_memory_has_type(requirements.memoryTypeBits,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+		}
+	}
+
+	// Place the images in the order they are first used, each in the first slot
+	// which is free by then
+	for (;;) {
+		uint32_t next = UINT32_MAX;
+		for (uint32_t i = 0; i < graph->images_count; i++) {
+			const VkxFrameGraphImage* image = &graph->images[i];
+			if (!image->transient || image->first_pass == UINT32_MAX || placed[i]) {
+				continue;
+			}
+			if (next == UINT32_MAX || image->first_pass < graph->images[next].first_pass) {
+				next = i;
+			}
+		}
+		if (next == UINT32_MAX) {
+			break;
+		}
+
+		VkxFrameGraphImage* image = &graph->images[next];
+		placed[next] = true;
+
+		VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+		if (image->lazy) {
+			properties |= VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+		}
+
+		VkMemoryRequirements requirements;
+		vkGetImageMemoryRequirements(vkx_instance.device, image->images[0], &requirements);
+
+		// Persistent images can't share, as their contents last into the next
+		// frame
+		uint32_t slot = image->persistent ? graph->memory_slots_count : 0;
+		for (; slot < graph->memory_slots_count; slot++) {
+			if (slot_last_pass[slot] < image->first_pass
+					&& graph->memory_slot_properties[slot] == properties
+					&& (slot_requirements[slot].memoryTypeBits & requirements.memoryTypeBits) != 0) {
+				break;
+			}
+		}
+
+		if (slot == graph->memory_slots_count) {
+			slot_requirements[slot] = requirements;
+			graph->memory_slot_properties[slot] = properties;
+			graph->memory_slots_count++;
+		}
+		else {
+			if (requirements.size > slot_requirements[slot].size) {
+				slot_requirements[slot].size = requirements.size;
+			}
+			if (requirements.alignment > slot_requirements[slot].alignment) {
+				slot_requirements[slot].alignment = requirements.alignment;
+			}
+			slot_requirements[slot].memoryTypeBits &= requirements.memoryTypeBits;
+		}
+
+		slot_last_pass[slot] = image->persistent ? UINT32_MAX : image->last_pass;
+		image->memory_slot = slot;
+	}
+
+	graph->transient_copies = vkx_frame_graph_transient_copies(graph, slot_requirements);
+
+	VkxMemoryTag previous_tag = vkx_memory_set_tag(VKX_MEMORY_TAG_OFFSCREEN);
+	for (uint32_t f = 0; f < graph->transient_copies; f++) {
+		for (uint32_t slot = 0; slot < graph->memory_slots_count; slot++) {
+			graph->memory[f][slot] = vkx_memory_alloc(slot_requirements[slot], graph->memory_slot_properties[slot], false);
+		}
+	}
+	vkx_memory_set_tag(previous_tag);
+
+	for (uint32_t i = 0; i < graph->images_count; i++) {
+		VkxFrameGraphImage* image = &graph->images[i];
+		if (!image->transient || image->first_pass == UINT32_MAX) {
+			continue;
+		}
+
+		// Shared images don't need the other copies after all
+		for (uint32_t f = graph->transient_copies; f < vkx_instance.frames_in_flight; f++) {
+			vkDestroyImage(vkx_instance.device, image->images[f], vkx_get_allocator(VK_OBJECT_TYPE_IMAGE));
+			image->images[f] = VK_NULL_HANDLE;
+		}
+
+		for (uint32_t f = 0; f < graph->transient_copies; f++) {
+			const VkxAllocation* memory = &graph->memory[f][image->memory_slot];
+			vkBindImageMemory(vkx_instance.device, image->images[f], memory->memory, memory->offset);
+
+			// Views are only used for rendering and sampling, so not the stencil
+			VkImageAspectFlags view_aspect = image->aspect & ~VK_IMAGE_ASPECT_STENCIL_BIT;
+			image->views[f] = image->array_layers > 1
+				? vkx_create_image_array_view(image->images[f], image->format, view_aspect, 1, image->array_layers)
+				: vkx_create_image_view(image->images[f], image->format, view_aspect, 1);
+		}
+	}
+
+	uint32_t lazy_count = 0;
+	for (uint32_t i = 0; i < graph->images_count; i++) {
+		if (graph->images[i].lazy) {
+			lazy_count++;
+		}
+	}
+	printf("Frame graph has %u memory slots for its transient images (%u lazily allocated), %s\n",
+		graph->memory_slots_count, lazy_count, graph->transient_copies > 1 ? "one set per frame in flight" : "shared by the frames in flight");
+}
+
+static VkxFrameGraphState vkx_frame_graph_transient_initial_state(const VkxFrameGraph* graph, uint32_t image, bool* async_compute) {
+	/*
+	 * Work out what the first use of a transient image has to wait for.  Its
+	 * contents are thrown away, but the memory was last used by whatever was in
+	 * the slot before it, or in the previous frame on this frame in flight
+	 *
+	 * @param async_compute Set to whether that use was on the compute queue
+	 */
+	const VkxFrameGraphImage* target = &graph->images[image];
+
+	uint32_t before = UINT32_MAX;
+	uint32_t latest = UINT32_MAX;
+	for (uint32_t i = 0; i < graph->images_count; i++) {
+		const VkxFrameGraphImage* other = &graph->images[i];
+		if (!other->transient || other->first_pass == UINT32_MAX || other->memory_slot != target->memory_slot) {
+			continue;
+		}
+
+		if (other->last_pass < target->first_pass
+				&& (before == UINT32_MAX || other->last_pass > graph->images[before].last_pass)) {
+			before = i;
+		}
+		if (latest == UINT32_MAX || other->last_pass > graph->images[latest].last_pass) {
+			latest = i;
+		}
+	}
+
+	// With async compute every frame in flight has its own transients, and this
+	// one's last frame was waited for before it was recorded again
+	if (before == UINT32_MAX && graph->async_compute) {
+		*async_compute = graph->passes[target->first_pass].async_compute;
+		VkxFrameGraphState none = {0};
+		return none;
+	}
+
+	uint32_t previous = before != UINT32_MAX ? before : latest;
+	*async_compute = graph->passes[graph->images[previous].last_pass].async_compute;
+
+	VkxFrameGraphState state = vkx_frame_graph_last_state(graph, previous);
+	state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	return state;
+}
+
+void vkx_frame_graph_compile(VkxFrameGraph* graph) {
+	/*
+	 * Work out the barriers and store ops for the passes and create the
+	 * transient images.  The graph can't be changed after this
+	 */
+	if (graph->compiled) {
+		fprintf(stderr, "The frame graph is already compiled\n");
+		exit(1);
+	}
+
+	// The async compute passes are submitted between the two halves of the
+	// graphics work
+	uint32_t async_runs = 0;
+	for (uint32_t p = 0; p < graph->passes_count; p++) {
+		if (graph->passes[p].async_compute && (p == 0 || !graph->passes[p - 1].async_compute)) {
+			async_runs++;
+		}
+	}
+	if (async_runs > 1) {
+		fprintf(stderr, "The frame graph's async compute passes have to be one after another\n");
+		exit(1);
+	}
+
+	// Find out how each image is used
+	bool graphics_use[VKX_FRAME_GRAPH_MAX_IMAGES] = {0};
+	bool compute_use[VKX_FRAME_GRAPH_MAX_IMAGES] = {0};
+	for (uint32_t p = 0; p < graph->passes_count; p++) {
+		const VkxFrameGraphPass* pass = &graph->passes[p];
+		for (uint32_t i = 0; i < pass->accesses_count; i++) {
+			uint32_t index = pass->accesses[i].image;
+			VkxFrameGraphImage* image = &graph->images[index];
+
+			if (image->first_pass == UINT32_MAX) {
+				image->first_pass = p;
+			}
+			image->last_pass = p;
+
+			if (pass->async_compute) {
+				VkxFrameGraphUsage usage = pass->accesses[i].usage;
+				if (!image->transient) {
+					fprintf(stderr, "Frame graph image %u is imported, so it can't be used on the compute queue\n", index);
+					exit(1);
+				}
+				if (usage != VKX_FRAME_GRAPH_STORAGE && usage != VKX_FRAME_GRAPH_COMPUTE_SAMPLED) {
+					fprintf(stderr, "Frame graph pass %u is on the compute queue, so it can only use compute shaders\n", p);
+					exit(1);
+				}
+				compute_use[index] = true;
+			}
+			else {
+				graphics_use[index] = true;
+			}
+			image->concurrent = graphics_use[index] && compute_use[index];
+
+			switch (pass->accesses[i].usage) {
+				case VKX_FRAME_GRAPH_COLOR_ATTACHMENT:
+				case VKX_FRAME_GRAPH_RESOLVE_ATTACHMENT:
+					image->usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+					image->aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+					break;
+				case VKX_FRAME_GRAPH_DEPTH_ATTACHMENT:
+					image->usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+					image->aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+					if (vkx_has_stencil_component(image->format)) {
+						image->aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+					}
+					break;
+				case VKX_FRAME_GRAPH_SAMPLED:
+				case VKX_FRAME_GRAPH_COMPUTE_SAMPLED:
+					image->usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+					if (image->aspect == 0) {
+						image->aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+					}
+					break;
+				case VKX_FRAME_GRAPH_STORAGE:
+					image->usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+					image->aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+					break;
+				case VKX_FRAME_GRAPH_SHADING_RATE_ATTACHMENT:
+					image->usage |= VK_IMAGE_USAGE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR;
+					image->aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+					break;
+				case VKX_FRAME_GRAPH_LOCAL_READ_ATTACHMENT:
+					image->usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+					image->aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+					break;
+				case VKX_FRAME_GRAPH_TRANSFER_SOURCE:
+				case VKX_FRAME_GRAPH_TRANSFER_DESTINATION:
+					image->usage |= pass->accesses[i].usage == VKX_FRAME_GRAPH_TRANSFER_SOURCE
+						? VK_IMAGE_USAGE_TRANSFER_SRC_BIT : VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+					if (image->aspect == 0) {
+						image->aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+					}
+					break;
+			}
+		}
+	}
+
+	// Nothing can see what was in an attachment before a pass covers it, or in
+	// a transient before its first pass, unless it's kept from the last frame
+	for (uint32_t p = 0; p < graph->passes_count; p++) {
+		VkxFrameGraphPass* pass = &graph->passes[p];
+		for (uint32_t i = 0; i < pass->accesses_count; i++) {
+			VkxFrameGraphAccess* access = &pass->accesses[i];
+			const VkxFrameGraphImage* image = &graph->images[access->image];
+			bool undefined = image->transient && !image->persistent && image->first_pass == p
+				&& access->load_op == VK_ATTACHMENT_LOAD_OP_LOAD;
+			if (vkx_frame_graph_is_attachment(access->usage) && (access->covered || undefined)) {
+				access->load_op = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			}
+		}
+	}
+
+	// Nothing reads a transient after its last pass, unless it's kept for the
+	// next frame
+	for (uint32_t p = 0; p < graph->passes_count; p++) {
+		VkxFrameGraphPass* pass = &graph->passes[p];
+		for (uint32_t i = 0; i < pass->accesses_count; i++) {
+			const VkxFrameGraphImage* image = &graph->images[pass->accesses[i].image];
+			if (image->transient && !image->persistent && image->last_pass == p) {
+				pass->accesses[i].store_op = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			}
+		}
+	}
+
+	vkx_frame_graph_create_transients(graph);
+
+	// Along with whether the last use was on the compute queue
+	VkxFrameGraphState states[VKX_FRAME_GRAPH_MAX_IMAGES] = {0};
+	bool states_async[VKX_FRAME_GRAPH_MAX_IMAGES] = {0};
+	for (uint32_t i = 0; i < graph->images_count; i++) {
+		if (graph->images[i].first_pass == UINT32_MAX) {
+			continue;
+		}
+		// Persistent images are left by the last frame as its last pass left them
+		// (vkx_frame_graph_begin() sets up the first frame to match)
+		if (graph->images[i].persistent) {
+			states[i] = vkx_frame_graph_last_state(graph, i);
+			states_async[i] = graph->passes[graph->images[i].last_pass].async_compute;
+			continue;
+		}
+		states[i] = graph->images[i].transient
+			? vkx_frame_graph_transient_initial_state(graph, i, &states_async[i])
+			: graph->images[i].initial;
+	}
+
+	for (uint32_t p = 0; p < graph->passes_count; p++) {
+		VkxFrameGraphPass* pass = &graph->passes[p];
+		pass->barriers_first = graph->barriers_count;
+
+		for (uint32_t i = 0; i < pass->accesses_count; i++) {
+			uint32_t image = pass->accesses[i].image;
+			VkxFrameGraphState required = vkx_frame_graph_access_state(&pass->accesses[i]);
+			VkxFrameGraphState* current = &states[image];
+
+			// The semaphore between the submissions waits for everything on the
+			// other queue, so at most the layout needs to change (after the wait)
+			if (states_async[image] != pass->async_compute) {
+				states_async[image] = pass->async_compute;
+				if (current->layout == required.layout) {
+					*current = required;
+					continue;
+				}
+				current->stages = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+				current->access = 0;
+			}
+
+			bool write_before = (current->access & VKX_FRAME_GRAPH_WRITE_ACCESS) != 0;
+			bool write_now = (required.access & VKX_FRAME_GRAPH_WRITE_ACCESS) != 0;
+
+			// Reads after reads in the same layout can go ahead, but anything which
+			// writes later has to wait for all of them
+			if (current->layout == required.layout && !write_before && !write_now) {
+				current->stages |= required.stages;
+				current->access |= required.access;
+				continue;
+			}
+
+			vkx_frame_graph_add_barrier(graph, image, *current, required);
+			*current = required;
+		}
+
+		pass->barriers_count = graph->barriers_count - pass->barriers_first;
+	}
+
+	graph->final_barriers_first = graph->barriers_count;
+	for (uint32_t i = 0; i < graph->images_count; i++) {
+		const VkxFrameGraphImage* image = &graph->images[i];
+		if (image->transient || image->first_pass == UINT32_MAX) {
+			continue;
+		}
+
+		if (states[i].layout == image->final.layout && (states[i].access & VKX_FRAME_GRAPH_WRITE_ACCESS) == 0) {
+			continue;
+		}
+
+		vkx_frame_graph_add_barrier(graph, i, states[i], image->final);
+	}
+	graph->final_barriers_count = graph->barriers_count - graph->final_barriers_first;
+
+	graph->compiled = true;
+
+	printf("Frame graph compiled: %u passes, %u images, %u barriers\n",
+		graph->passes_count, graph->images_count, graph->barriers_count);
+}
+
+static uint32_t vkx_frame_graph_copy(const VkxFrameGraph* graph, uint32_t image, uint32_t frame) {
+	/*
+	 * Which of an image's handles a frame uses
+	 */
+	return graph->images[image].transient && graph->transient_copies > 1 ? frame : 0;
+}
+
+static VkImage vkx_frame_graph_get_handle(const VkxFrameGraph* graph, uint32_t image) {
+	return graph->images[image].images[vkx_frame_graph_copy(graph, image, graph->frame)];
+}
+
+VkImageView vkx_frame_graph_get_view(const VkxFrameGraph* graph, uint32_t image, uint32_t frame) {
+	/*
+	 * Get the view of an image, e.g. for descriptor sets which sample a
+	 * transient image.  Transient images have one for each frame in flight
+	 * unless they are shared
+	 */
+	return graph->images[image].views[vkx_frame_graph_copy(graph, image, frame)];
+}
+
+VkImage vkx_frame_graph_get_image(const VkxFrameGraph* graph, uint32_t image) {
+	/*
+	 * Get the handle of an image for the frame being recorded, e.g. for copying
+	 * to it in a transfer pass
+	 */
+	return vkx_frame_graph_get_handle(graph, image);
+}
+
+static void vkx_frame_graph_record_barriers(VkxFrameGraph* graph, uint32_t first, uint32_t count) {
+	if (count == 0) {
+		return;
+	}
+
+	VkImageMemoryBarrier2 barriers[VKX_FRAME_GRAPH_MAX_IMAGES];
+	for (uint32_t i = 0; i < count; i++) {
+		barriers[i] = graph->barriers[first + i];
+		barriers[i].image = vkx_frame_graph_get_handle(graph, graph->barrier_images[first + i]);
+	}
+
+	VkDependencyInfo dependency_info = {0};
+	dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dependency_info.imageMemoryBarrierCount = count;
+	dependency_info.pImageMemoryBarriers = barriers;
+
+	vkCmdPipelineBarrier2(graph->command_buffer, &dependency_info);
+}
+
+void vkx_frame_graph_begin(VkxFrameGraph* graph, VkCommandBuffer command_buffer, uint32_t frame) {
+	/*
+	 * Start recording the graph's passes.  The imported images must all have
+	 * been set for this frame
+	 *
+	 * @param frame The frame in flight, for picking the transient images
+	 */
+	if (!graph->compiled) {
+		fprintf(stderr, "The frame graph has to be compiled before it is recorded\n");
+		exit(1);
+	}
+
+	graph->command_buffer = command_buffer;
+	graph->frame = frame;
+	graph->next_pass = 0;
+	graph->in_pass = false;
+
+	// The passes expect the persistent images in the state the last frame left
+	// them in, which a new copy has to be moved to first
+	for (uint32_t i = 0; i < graph->images_count; i++) {
+		VkxFrameGraphImage* image = &graph->images[i];
+		uint32_t copy = vkx_frame_graph_copy(graph, i, frame);
+		if (!image->persistent || image->first_pass == UINT32_MAX || image->initialized[copy]) {
+			continue;
+		}
+
+		VkxFrameGraphState none = {0};
+		VkImageMemoryBarrier2 barrier = {0};
+		vkx_frame_graph_init_barrier(graph, i, none, vkx_frame_graph_last_state(graph, i), &barrier);
+		barrier.image = image->images[copy];
+
+		VkDependencyInfo dependency_info = {0};
+		dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+		dependency_info.imageMemoryBarrierCount = 1;
+		dependency_info.pImageMemoryBarriers = &barrier;
+		vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+
+		image->initialized[copy] = true;
+	}
+}
+
+static VkExtent2D vkx_frame_graph_pass_extent(const VkxFrameGraph* graph, const VkxFrameGraphPass* graph_pass) {
+	/*
+	 * The area a pass renders to: its first attachment, limited to the render
+	 * extent if one is set
+	 */
+	VkExtent2D extent = {0};
+	for (uint32_t i = 0; i < graph_pass->accesses_count; i++) {
+		const VkxFrameGraphAccess* access = &graph_pass->accesses[i];
+		if (vkx_frame_graph_is_attachment(access->usage)) {
+			extent = graph->images[access->image].extent;
+			break;
+		}
+	}
+
+	if (graph_pass->render_extent.width != 0) {
+		extent.width = graph_pass->render_extent.width < extent.width ? graph_pass->render_extent.width : extent.width;
+		extent.height = graph_pass->render_extent.height < extent.height ? graph_pass->render_extent.height : extent.height;
+	}
+
+	return extent;
+}
+
+static VkRect2D vkx_frame_graph_pass_area(const VkxFrameGraph* graph, const VkxFrameGraphPass* graph_pass) {
+	/*
+	 * The part of the pass's extent which is drawn: its render area, kept
+	 * inside the extent, or all of it
+	 */
+	VkExtent2D extent = vkx_frame_graph_pass_extent(graph, graph_pass);
+
+	VkRect2D area = {0};
+	area.extent = extent;
+	if (graph_pass->render_area.extent.width == 0) {
+		return area;
+	}
+
+	int32_t x0 = graph_pass->render_area.offset.x > 0 ? graph_pass->render_area.offset.x : 0;
+	int32_t y0 = graph_pass->render_area.offset.y > 0 ? graph_pass->render_area.offset.y : 0;
+	int32_t x1 = graph_pass->render_area.offset.x + (int32_t) graph_pass->render_area.extent.width;
+	int32_t y1 = graph_pass->render_area.offset.y + (int32_t) graph_pass->render_area.extent.height;
+	x1 = x1 < (int32_t) extent.width ? x1 : (int32_t) extent.width;
+	y1 = y1 < (int32_t) extent.height ? y1 : (int32_t) extent.height;
+	// At least a pixel, as the render area can't be empty
+	x0 = x0 < (int32_t) extent.width ? x0 : (int32_t) extent.width - 1;
+	y0 = y0 < (int32_t) extent.height ? y0 : (int32_t) extent.height - 1;
+
+	area.offset.x = x0;
+	area.offset.y = y0;
+	area.extent.width = x1 > x0 ? (uint32_t) (x1 - x0) : 1;
+	area.extent.height = y1 > y0 ? (uint32_t) (y1 - y0) : 1;
+	return area;
+}
+
+static void vkx_frame_graph_begin_pass_contents(VkxFrameGraph* graph, uint32_t pass, bool secondary) {
+	/*
+	 * Record the barriers for a pass and start rendering to its attachments
+	 *
+	 * @param secondary The pass is recorded in secondary command buffers, which
+	 *                  set their own viewport and scissor
+	 */
+	if (graph->in_pass || pass != graph->next_pass) {
+		fprintf(stderr, "Frame graph pass %u recorded out of order\n", pass);
+		exit(1);
+	}
+
+	const VkxFrameGraphPass* graph_pass = &graph->passes[pass];
+	vkx_frame_graph_record_barriers(graph, graph_pass->barriers_first, graph_pass->barriers_count);
+	graph->in_pass = true;
+
+	VkRenderingAttachmentInfo color_attachments[VKX_FRAME_GRAPH_MAX_PASS_IMAGES] = {0};
+	uint32_t color_attachments_count = 0;
+	VkRenderingAttachmentInfo depth_attachment = {0};
+	bool has_depth = false;
+	VkRenderingFragmentShadingRateAttachmentInfoKHR shading_rate_info = {0};
+	bool has_shading_rate = false;
+
+	for (uint32_t i = 0; i < graph_pass->accesses_count; i++) {
+		const VkxFrameGraphAccess* access = &graph_pass->accesses[i];
+		if (access->usage == VKX_FRAME_GRAPH_SHADING_RATE_ATTACHMENT) {
+			shading_rate_info.sType = VK_STRUCTURE_TYPE_RENDERING_FRAGMENT_SHADING_RATE_ATTACHMENT_INFO_KHR;
+			shading_rate_info.imageView = vkx_frame_graph_get_view(graph, access->image, graph->frame);
+			shading_rate_info.imageLayout = vkx_frame_graph_access_state(access).layout;
+			shading_rate_info.shadingRateAttachmentTexelSize = graph_pass->shading_rate_texel_size;
+			has_shading_rate = true;
+			continue;
+		}
+
+		// Resolves are part of the colour attachment they're from
+		if (!vkx_frame_graph_is_attachment(access->usage) || access->usage == VKX_FRAME_GRAPH_RESOLVE_ATTACHMENT) {
+			continue;
+		}
+
+		VkRenderingAttachmentInfo* attachment_info;
+		if (access->usage == VKX_FRAME_GRAPH_DEPTH_ATTACHMENT) {
+			attachment_info = &depth_attachment;
+			has_depth = true;
+		}
+		else {
+			attachment_info = &color_attachments[color_attachments_count++];
+		}
+
+		attachment_info->sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+		attachment_info->imageView = vkx_frame_graph_get_view(graph, access->image, graph->frame);
+		attachment_info->imageLayout = vkx_frame_graph_access_state(access).layout;
+		attachment_info->resolveMode = VK_RESOLVE_MODE_NONE;
+		attachment_info->loadOp = access->load_op;
+		attachment_info->storeOp = access->store_op;
+		attachment_info->clearValue = access->clear_value;
+		if (access->resolve_image != UINT32_MAX) {
+			attachment_info->resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+			attachment_info->resolveImageView = vkx_frame_graph_get_view(graph, access->resolve_image, graph->frame);
+			attachment_info->resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		}
+	}
+
+	// Passes without attachments record whatever they like
+	if (color_attachments_count == 0 && !has_depth) {
+		return;
+	}
+
+	VkExtent2D extent = vkx_frame_graph_pass_extent(graph, graph_pass);
+	VkRect2D area = vkx_frame_graph_pass_area(graph, graph_pass);
+
+	VkRenderingInfo rendering_info = {0};
+	rendering_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+	rendering_info.flags = secondary ? VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT : 0;
+	rendering_info.renderArea = area;
+	// Ignored with multiview
+	rendering_info.layerCount = 1;
+	rendering_info.viewMask = graph_pass->view_mask;
+	rendering_info.colorAttachmentCount = color_attachments_count;
+	rendering_info.pColorAttachments = color_attachments;
+	rendering_info.pDepthAttachment = has_depth ? &depth_attachment : NULL;
+	rendering_info.pNext = has_shading_rate ? &shading_rate_info : NULL;
+
+	vkCmdBeginRendering(graph->command_buffer, &rendering_info);
+
+	if (secondary) {
+		return;
+	}
+
+	VkViewport viewport = {0};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = (float) extent.width;
+	viewport.height = (float) extent.height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewportWithCount(graph->command_buffer, 1, &viewport);
+
+	vkCmdSetScissorWithCount(graph->command_buffer, 1, &area);
+}
+
+void vkx_frame_graph_set_command_buffer(VkxFrameGraph* graph, VkCommandBuffer command_buffer) {
+	/*
+	 * Carry on recording the graph in another command buffer, e.g. the compute
+	 * queue's for the async compute passes, then another graphics one for the
+	 * passes after them.  Only between passes
+	 */
+	if (graph->in_pass) {
+		fprintf(stderr, "Can't change the frame graph's command buffer during a pass\n");
+		exit(1);
+	}
+
+	graph->command_buffer = command_buffer;
+}
+
+void vkx_frame_graph_begin_pass(VkxFrameGraph* graph, uint32_t pass) {
+	/*
+	 * Record the barriers for a pass and start rendering to its attachments
+	 */
+	vkx_frame_graph_begin_pass_contents(graph, pass, false);
+}
+
+void vkx_frame_graph_begin_secondary_pass(VkxFrameGraph* graph, uint32_t pass) {
+	/*
+	 * Like vkx_frame_graph_begin_pass(), but the pass can then only execute
+	 * secondary command buffers, begun with vkx_frame_graph_get_pass_info()
+	 */
+	vkx_frame_graph_begin_pass_contents(graph, pass, true);
+}
+
+VkxFrameGraphPassInfo vkx_frame_graph_get_pass_info(const VkxFrameGraph* graph, uint32_t pass) {
+	/*
+	 * The attachment formats and render area of a pass, which the secondary
+	 * command buffers recorded for it have to match
+	 */
+	const VkxFrameGraphPass* graph_pass = &graph->passes[pass];
+
+	VkxFrameGraphPassInfo info = {0};
+	info.depth_format = VK_FORMAT_UNDEFINED;
+	info.samples = VK_SAMPLE_COUNT_1_BIT;
+
+	for (uint32_t i = 0; i < graph_pass->accesses_count; i++) {
+		const VkxFrameGraphAccess* access = &graph_pass->accesses[i];
+		if (access->usage == VKX_FRAME_GRAPH_DEPTH_ATTACHMENT) {
+			info.depth_format = graph->images[access->image].format;
+			info.samples = graph->images[access->image].samples;
+		}
+		else if (access->usage == VKX_FRAME_GRAPH_COLOR_ATTACHMENT || access->usage == VKX_FRAME_GRAPH_LOCAL_READ_ATTACHMENT) {
+			info.color_formats[info.color_formats_count++] = graph->images[access->image].format;
+			info.samples = graph->images[access->image].samples;
+		}
+	}
+
+	info.extent = vkx_frame_graph_pass_extent(graph, graph_pass);
+	info.render_area = vkx_frame_graph_pass_area(graph, graph_pass);
+	info.view_mask = graph_pass->view_mask;
+
+	return info;
+}
+
+void vkx_frame_graph_cmd_local_read_barrier(VkxFrameGraph* graph) {
+	/*
+	 * Make what's been drawn to the local read attachments of the current pass
+	 * so far visible to the input attachment reads of the draws after it, for
+	 * the same pixel
+	 */
+	if (!graph->in_pass) {
+		fprintf(stderr, "No frame graph pass for a local read barrier\n");
+		exit(1);
+	}
+
+	VkMemoryBarrier2 barrier = {0};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_INPUT_ATTACHMENT_READ_BIT;
+
+	VkDependencyInfo dependency_info = {0};
+	dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dependency_info.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+	dependency_info.memoryBarrierCount = 1;
+	dependency_info.pMemoryBarriers = &barrier;
+	vkCmdPipelineBarrier2(graph->command_buffer, &dependency_info);
+}
+
+void vkx_frame_graph_end_pass(VkxFrameGraph* graph) {
+	if (!graph->in_pass) {
+		fprintf(stderr, "No frame graph pass to end\n");
+		exit(1);
+	}
+
+	const VkxFrameGraphPass* graph_pass = &graph->passes[graph->next_pass];
+	for (uint32_t i = 0; i < graph_pass->accesses_count; i++) {
+		if (vkx_frame_graph_is_attachment(graph_pass->accesses[i].usage)) {
+			vkCmdEndRendering(graph->command_buffer);
+			break;
+		}
+	}
+
+	graph->in_pass = false;
+	graph->next_pass++;
+}
+
+void vkx_frame_graph_end(VkxFrameGraph* graph) {
+	/*
+	 * Finish the frame, leaving the imported images in their final layouts
+	 */
+	if (graph->in_pass || graph->next_pass != graph->passes_count) {
+		fprintf(stderr, "The frame graph ended with %u of %u passes recorded\n", graph->next_pass, graph->passes_count);
+		exit(1);
+	}
+
+	vkx_frame_graph_record_barriers(graph, graph->final_barriers_first, graph->final_barriers_count);
+	graph->command_buffer = VK_NULL_HANDLE;
+}
@@ -0,0 +1,479 @@
+/*
+ * Host memory the driver allocates, through VkAllocationCallbacks.
+ *
+ * Everything in vkx which creates or destroys a Vulkan object passes
+ * vkx_get_allocator() with the type of the object.  That's NULL (the driver's
+ * own allocator) unless track_host_allocations is set, in which case each type
+ * gets its own callbacks so the allocations can be counted by type as well as
+ * by the scope the driver gives them.  The counts since
+ * vkx_host_memory_begin_frames() are kept apart too, so the frame loop should
+ * show none once it has warmed up; anything left is a driver allocation to get
+ * rid of (e.g. an object created every frame).
+ *
+ * With pool_host_allocations the small allocations come from fixed size
+ * blocks in chunks taken from the heap, one free list for each power of 2
+ * size, so churn in the driver doesn't go through malloc.  Bigger ones go to
+ * the heap either way.  The driver can call from any thread, so it's all
+ * behind a mutex, which is fine for something only turned on to look.
+ *
+ * Every allocation has a header just before the pointer the driver gets, with
+ * its size for the counts and where it came from.  The driver asks for an
+ * alignment, which the allocation is padded up to.
+ */
+
+#include "vkx/vkx_host_memory.h"
+
+#include <SDL3/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Count the driver's host allocations, see vkx_host_memory_print_stats()
+const bool track_host_allocations = false;
+// Also serve the small ones from pools rather than the heap (only when tracking)
+const bool pool_host_allocations = false;
+
+#define VKX_HOST_SCOPES_COUNT (VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1)
+// Blocks are 64 bytes and up, the last is big enough for VKX_HOST_POOL_MAX_SIZE
+// with a header and some padding
+#define VKX_HOST_POOL_MIN_BLOCK 64
+#define VKX_HOST_POOLS_COUNT 8
+// Allocations are at least this aligned, so the header is
+#define VKX_HOST_MIN_ALIGNMENT 16
+
+typedef struct {
+	// What was allocated, from a pool or the heap
+	void* block;
+	size_t size;
+	uint16_t type_index;
+	uint8_t scope;
+	// Its pool, or -1 for the heap
+	int8_t pool;
+} VkxHostAllocationHeader;
+
+typedef struct {
+	VkObjectType type;
+	const char* name;
+	VkAllocationCallbacks callbacks;
+	VkxHostMemoryStats stats;
+} VkxHostObjectType;
+
+typedef struct VkxHostChunk {
+	struct VkxHostChunk* next;
+} VkxHostChunk;
+
+typedef struct {
+	size_t block_size;
+	// Freed blocks, linked through their first bytes
+	void* free_blocks;
+	// Blocks not handed out yet in the newest chunk
+	uint8_t* next_block;
+	uint8_t* chunk_end;
+} VkxHostPool;
+
+// The last is for anything else
+static VkxHostObjectType object_types[] = {
+	{.type = VK_OBJECT_TYPE_INSTANCE, .name = "instance"},
+	{.type = VK_OBJECT_TYPE_DEVICE, .name = "device"},
+	{.type = VK_OBJECT_TYPE_SURFACE_KHR, .name = "surface"},
+	{.type = VK_OBJECT_TYPE_SWAPCHAIN_KHR, .name = "swap chain"},
+	{.type = VK_OBJECT_TYPE_DEBUG_UTILS_MESSENGER_EXT, .name = "debug messenger"},
+	{.type = VK_OBJECT_TYPE_DEVICE_MEMORY, .name = "device memory"},
+	{.type = VK_OBJECT_TYPE_BUFFER, .name = "buffer"},
+	{.type = VK_OBJECT_TYPE_IMAGE, .name = "image"},
+	{.type = VK_OBJECT_TYPE_IMAGE_VIEW, .name = "image view"},
+	{.type = VK_OBJECT_TYPE_SAMPLER, .name = "sampler"},
+	{.type = VK_OBJECT_TYPE_SHADER_MODULE, .name = "shader module"},
+	{.type = VK_OBJECT_TYPE_SHADER_EXT, .name = "shader object"},
+	{.type = VK_OBJECT_TYPE_PIPELINE_CACHE, .name = "pipeline cache"},
+	{.type = VK_OBJECT_TYPE_PIPELINE_LAYOUT, .name = "pipeline layout"},
+	{.type = VK_OBJECT_TYPE_PIPELINE, .name = "pipeline"},
+	{.type = VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, .name = "descriptor set layout"},
+	{.type = VK_OBJECT_TYPE_DESCRIPTOR_POOL, .name = "descriptor pool"},
+	{.type = VK_OBJECT_TYPE_DESCRIPTOR_UPDATE_TEMPLATE, .name = "descriptor update template"},
+	{.type = VK_OBJECT_TYPE_COMMAND_POOL, .name = "command pool"},
+	{.type = VK_OBJECT_TYPE_SEMAPHORE, .name = "semaphore"},
+	{.type = VK_OBJECT_TYPE_FENCE, .name = "fence"},
+	{.type = VK_OBJECT_TYPE_QUERY_POOL, .name = "query pool"},
+	{.type = VK_OBJECT_TYPE_UNKNOWN, .name = "other"},
+};
+#define VKX_HOST_OBJECT_TYPES_COUNT (sizeof(object_types) / sizeof(object_types[0]))
+
+static const char* scope_names[VKX_HOST_SCOPES_COUNT] = {
+	"command", "object", "cache", "device", "instance"
+};
+
+static SDL_Mutex* host_memory_mutex = NULL;
+static VkxHostMemoryStats scope_stats[VKX_HOST_SCOPES_COUNT] = {0};
+static VkxHostMemoryStats total_stats = {0};
+static bool in_frames = false;
+
+static VkxHostPool pools[VKX_HOST_POOLS_COUNT] = {0};
+static VkxHostChunk* chunks = NULL;
+
+typedef enum {
+	VKX_HOST_ALLOCATE,
+	VKX_HOST_REALLOCATE,
+	VKX_HOST_FREE,
+	// Only moves the live bytes, for the old half of a reallocation
+	VKX_HOST_MOVE
+} VkxHostEvent;
+
+static void vkx_host_memory_count(VkxHostObjectType* type, VkSystemAllocationScope scope, int64_t bytes, VkxHostEvent event) {
+	/*
+	 * Add an allocation, reallocation or free to the counts for its type, its
+	 * scope and the total.  Called with the mutex held
+	 *
+	 * @param bytes How much the live bytes change by
+	 */
+	VkxHostMemoryStats* all_stats[3] = {&type->stats, &scope_stats[scope], &total_stats};
+	for (int i = 0; i < 3; i++) {
+		VkxHostMemoryStats* stats = all_stats[i];
+		switch (event) {
+			case VKX_HOST_ALLOCATE:
+				stats->allocations_count++;
+				stats->frame_allocations_count += in_frames ? 1 : 0;
+				break;
+			case VKX_HOST_REALLOCATE:
+				stats->reallocations_count++;
+				stats->frame_reallocations_count += in_frames ? 1 : 0;
+				break;
+			case VKX_HOST_FREE:
+				stats->frees_count++;
+				break;
+			case VKX_HOST_MOVE:
+				break;
+		}
+
+		stats->live_bytes += (uint64_t) bytes;
+		if (stats->live_bytes > stats->peak_bytes) {
+			stats->peak_bytes = stats->live_bytes;
+		}
+	}
+}
+
+static void* vkx_host_pool_alloc(int pool_index) {
+	/*
+	 * Take a block from a pool, with the mutex held
+	 */
+	VkxHostPool* pool = &pools[pool_index];
+	if (pool->free_blocks != NULL) {
+		void* block = pool->free_blocks;
+		pool->free_blocks = *(void**) block;
+		return block;
+	}
+
+	if (pool->next_block == NULL || pool->next_block + pool->block_size > pool->chunk_end) {
+		VkxHostChunk* chunk = malloc(VKX_HOST_POOL_CHUNK_SIZE);
+		if (chunk == NULL) {
+			return NULL;
+		}
+		chunk->next = chunks;
+		chunks = chunk;
+
+		// The blocks start a minimum alignment in, after the chunk's link
+		pool->next_block = (uint8_t*) chunk + VKX_HOST_MIN_ALIGNMENT;
+		pool->chunk_end = (uint8_t*) chunk + VKX_HOST_POOL_CHUNK_SIZE;
+	}
+
+	void* block = pool->next_block;
+	pool->next_block += pool->block_size;
+	return block;
+}
+
+static void* vkx_host_allocate(VkxHostObjectType* type, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+	/*
+	 * Get a block from a pool or the heap and put the header in it, without
+	 * counting it
+	 *
+	 * @return The memory for the driver, or NULL if there's none
+	 */
+	if (alignment < VKX_HOST_MIN_ALIGNMENT) {
+		alignment = VKX_HOST_MIN_ALIGNMENT;
+	}
+	size_t total = sizeof(VkxHostAllocationHeader) + alignment - 1 + size;
+
+	int pool = -1;
+	if (pool_host_allocations && size <= VKX_HOST_POOL_MAX_SIZE) {
+		for (int i = 0; i < VKX_HOST_POOLS_COUNT; i++) {
+			if (total <= pools[i].block_size) {
+				pool = i;
+				break;
+			}
+		}
+	}
+
+	void* block = NULL;
+	if (pool >= 0) {
+		SDL_LockMutex(host_memory_mutex);
+		block = vkx_host_pool_alloc(pool);
+		SDL_UnlockMutex(host_memory_mutex);
+	}
+	else {
+		block = malloc(total);
+	}
+	if (block == NULL) {
+		return NULL;
+	}
+
+	uintptr_t start = (uintptr_t) block + sizeof(VkxHostAllocationHeader);
+	uint8_t* memory = (uint8_t*) ((start + alignment - 1) & ~(uintptr_t) (alignment - 1));
+
+	VkxHostAllocationHeader* header = (VkxHostAllocationHeader*) memory - 1;
+	header->block = block;
+	header->size = size;
+	header->type_index = (uint16_t) (type - object_types);
+	header->scope = (uint8_t) scope;
+	header->pool = (int8_t) pool;
+
+	return memory;
+}
+
+static void vkx_host_release(const VkxHostAllocationHeader* header) {
+	/*
+	 * Give an allocation's block back to its pool or the heap
+	 */
+	void* block = header->block;
+	if (header->pool >= 0) {
+		SDL_LockMutex(host_memory_mutex);
+		VkxHostPool* pool = &pools[header->pool];
+		*(void**) block = pool->free_blocks;
+		pool->free_blocks = block;
+		SDL_UnlockMutex(host_memory_mutex);
+	}
+	else {
+		free(block);
+	}
+}
+
+static void* VKAPI_PTR vkx_host_alloc(void* user_data, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+	VkxHostObjectType* type = user_data;
+
+	void* memory = vkx_host_allocate(type, size, alignment, scope);
+	if (memory != NULL) {
+		SDL_LockMutex(host_memory_mutex);
+		vkx_host_memory_count(type, scope, (int64_t) size, VKX_HOST_ALLOCATE);
+		SDL_UnlockMutex(host_memory_mutex);
+	}
+
+	return memory;
+}
+
+static void VKAPI_PTR vkx_host_free(void* user_data, void* memory) {
+	(void) user_data;
+
+	if (memory == NULL) {
+		return;
+	}
+
+	// Counted against the type and scope it was allocated with
+	VkxHostAllocationHeader header = *((VkxHostAllocationHeader*) memory - 1);
+
+	SDL_LockMutex(host_memory_mutex);
+	vkx_host_memory_count(&object_types[header.type_index], header.scope, -(int64_t) header.size, VKX_HOST_FREE);
+	SDL_UnlockMutex(host_memory_mutex);
+
+	vkx_host_release(&header);
+}
+
+static void* VKAPI_PTR vkx_host_realloc(void* user_data, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+	/*
+	 * Allocate again and copy, the old allocation's bytes moving over to the
+	 * new one's type and scope
+	 */
+	if (original == NULL) {
+		return vkx_host_alloc(user_data, size, alignment, scope);
+	}
+	if (size == 0) {
+		vkx_host_free(user_data, original);
+		return NULL;
+	}
+
+	VkxHostObjectType* type = user_data;
+	VkxHostAllocationHeader old_header = *((VkxHostAllocationHeader*) original - 1);
+
+	void* memory = vkx_host_allocate(type, size, alignment, scope);
+	if (memory == NULL) {
+		return NULL;
+	}
+	memcpy(memory, original, old_header.size < size ? old_header.size : size);
+
+	SDL_LockMutex(host_memory_mutex);
+	vkx_host_memory_count(&object_types[old_header.type_index], old_header.scope, -(int64_t) old_header.size, VKX_HOST_MOVE);
+	vkx_host_memory_count(type, scope, (int64_t) size, VKX_HOST_REALLOCATE);
+	SDL_UnlockMutex(host_memory_mutex);
+
+	vkx_host_release(&old_header);
+	return memory;
+}
+
+static void VKAPI_PTR vkx_host_internal_alloc(void* user_data, size_t size, VkInternalAllocationType allocation_type, VkSystemAllocationScope scope) {
+	(void) allocation_type;
+
+	VkxHostObjectType* type = user_data;
+	SDL_LockMutex(host_memory_mutex);
+	VkxHostMemoryStats* all_stats[3] = {&type->stats, &scope_stats[scope], &total_stats};
+	for (int i = 0; i < 3; i++) {
+		all_stats[i]->internal_allocations_count++;
+		all_stats[i]->internal_live_bytes += size;
+	}
+	SDL_UnlockMutex(host_memory_mutex);
+}
+
+static void VKAPI_PTR vkx_host_internal_free(void* user_data, size_t size, VkInternalAllocationType allocation_type, VkSystemAllocationScope scope) {
+	(void) allocation_type;
+
+	VkxHostObjectType* type = user_data;
+	SDL_LockMutex(host_memory_mutex);
+	VkxHostMemoryStats* all_stats[3] = {&type->stats, &scope_stats[scope], &total_stats};
+	for (int i = 0; i < 3; i++) {
+		all_stats[i]->internal_live_bytes -= size;
+	}
+	SDL_UnlockMutex(host_memory_mutex);
+}
+
+void vkx_host_memory_init(void) {
+	/*
+	 * Set up the callbacks.  Must be called before anything is created, as the
+	 * objects have to be destroyed with the same allocator
+	 */
+	if (!track_host_allocations) {
+		return;
+	}
+
+	host_memory_mutex = SDL_CreateMutex();
+	if (host_memory_mutex == NULL) {
+		fprintf(stderr, "Failed to create host memory mutex: %s\n", SDL_GetError());
+		exit(1);
+	}
+
+	for (size_t i = 0; i < VKX_HOST_OBJECT_TYPES_COUNT; i++) {
+		VkAllocationCallbacks* callbacks = &object_types[i].callbacks;
+		callbacks->pUserData = &object_types[i];
+		callbacks->pfnAllocation = vkx_host_alloc;
+		callbacks->pfnReallocation = vkx_host_realloc;
+		callbacks->pfnFree = vkx_host_free;
+		callbacks->pfnInternalAllocation = vkx_host_internal_alloc;
+		callbacks->pfnInternalFree = vkx_host_internal_free;
+	}
+
+	for (int i = 0; i < VKX_HOST_POOLS_COUNT; i++) {
+		pools[i].block_size = (size_t) VKX_HOST_POOL_MIN_BLOCK << i;
+	}
+
+	printf("Tracking host allocations%s\n", pool_host_allocations ? ", with pools" : "");
+}
+
+void vkx_host_memory_cleanup(void) {
+	/*
+	 * Free the pools.  Everything made with the callbacks has to have been
+	 * destroyed, including the instance
+	 */
+	if (!track_host_allocations) {
+		return;
+	}
+
+	if (total_stats.live_bytes > 0) {
+		fprintf(stderr, "Warning: %llu bytes of host memory still allocated at cleanup\n", (unsigned long long) total_stats.live_bytes);
+	}
+
+	while (chunks != NULL) {
+		VkxHostChunk* next = chunks->next;
+		free(chunks);
+		chunks = next;
+	}
+	memset(pools, 0, sizeof(pools));
+
+	SDL_DestroyMutex(host_memory_mutex);
+	host_memory_mutex = NULL;
+}
+
+const VkAllocationCallbacks* vkx_get_allocator(VkObjectType object_type) {
+	/*
+	 * The callbacks to create and destroy an object of a type with
+	 *
+	 * @return NULL unless track_host_allocations is set
+	 */
+	if (!track_host_allocations) {
+		return NULL;
+	}
+
+	size_t i = 0;
+	while (i < VKX_HOST_OBJECT_TYPES_COUNT - 1 && object_types[i].type != object_type) {
+		i++;
+	}
+	return &object_types[i].callbacks;
+}
+
+void vkx_host_memory_begin_frames(void) {
+	/*
+	 * Count the allocations from here on as being in the frame loop as well
+	 */
+	if (!track_host_allocations) {
+		return;
+	}
+
+	SDL_LockMutex(host_memory_mutex);
+	in_frames = true;
+	SDL_UnlockMutex(host_memory_mutex);
+}
+
+VkxHostMemoryStats vkx_host_memory_get_stats(void) {
+	/*
+	 * Get the counts for every type and scope together
+	 */
+	VkxHostMemoryStats stats = {0};
+	if (!track_host_allocations) {
+		return stats;
+	}
+
+	SDL_LockMutex(host_memory_mutex);
+	stats = total_stats;
+	SDL_UnlockMutex(host_memory_mutex);
+
+	return stats;
+}
+
+static void vkx_host_memory_print_line(const char* name, const VkxHostMemoryStats* stats) {
+	printf(" %s: %llu allocations (%llu in frames), %llu reallocations (%llu in frames), %llu frees, %.1f KB live, %.1f KB peak",
+			name,
+			(unsigned long long) stats->allocations_count,
+			(unsigned long long) stats->frame_allocations_count,
+			(unsigned long long) stats->reallocations_count,
+			(unsigned long long) stats->frame_reallocations_count,
+			(unsigned long long) stats->frees_count,
+			stats->live_bytes / 1024.0,
+			stats->peak_bytes / 1024.0);
+	if (stats->internal_allocations_count > 0) {
+		printf(", %llu internal (%.1f KB live)", (unsigned long long) stats->internal_allocations_count, stats->internal_live_bytes / 1024.0);
+	}
+	printf("\n");
+}
+
+void vkx_host_memory_print_stats(void) {
+	if (!track_host_allocations) {
+		return;
+	}
+
+	SDL_LockMutex(host_memory_mutex);
+
+	printf("Driver host memory:\n");
+	vkx_host_memory_print_line("Total", &total_stats);
+
+	printf("By scope:\n");
+	for (int i = 0; i < VKX_HOST_SCOPES_COUNT; i++) {
+		if (scope_stats[i].allocations_count > 0 || scope_stats[i].internal_allocations_count > 0) {
+			vkx_host_memory_print_line(scope_names[i], &scope_stats[i]);
+		}
+	}
+
+	printf("By object type:\n");
+	for (size_t i = 0; i < VKX_HOST_OBJECT_TYPES_COUNT; i++) {
+		const VkxHostMemoryStats* stats = &object_types[i].stats;
+		if (stats->allocations_count > 0 || stats->internal_allocations_count > 0) {
+			vkx_host_memory_print_line(object_types[i].name, stats);
+		}
+	}
+
+	SDL_UnlockMutex(host_memory_mutex);
+}
@@ -1,5 +1,10 @@
 #include "vkx/vkx_init.h"
 #include "vkx/vkx_core.h"
+#include "vkx/vkx_memory.h"
+#include "vkx/vkx_upload.h"
+#include "vkx/vkx_descriptor_ring.h"
+#include "vkx/vkx_debug.h"
+#include "arena.h"
 
 #include <stdio.h>
 #include <stdbool.h>
@@ -12,6 +17,26 @@
 #include <SDL3/SDL_vulkan.h>
 
 const bool enable_validation_layers = true;
+// Device to use instead of the highest scoring one: its index in the list
+// printed at startup or part of its name.  The VKX_DEVICE environment
+// variable overrides this
+const char* const preferred_physical_device = NULL;
+
+// Device scores, see vkx_score_physical_device().  The type is worth more than
+// any amount of memory, which is counted in MiB up to the limit
+#define VKX_DEVICE_SCORE_DISCRETE 1000000
+#define VKX_DEVICE_SCORE_INTEGRATED 100000
+#define VKX_DEVICE_SCORE_VIRTUAL 10000
+#define VKX_DEVICE_SCORE_MAX_MEMORY_MIB 65536
+#define VKX_DEVICE_SCORE_QUEUE_FAMILY 1000
+#define VKX_DEVICE_SCORE_EXTENSION 100
+
+// Queue priorities, which the device may use to share out its time.  Async
+// compute passes are part of the frame so they are as important as graphics,
+// while uploads are mostly streaming in the background and can wait
+#define VKX_GRAPHICS_QUEUE_PRIORITY 1.0f
+#define VKX_COMPUTE_QUEUE_PRIORITY 1.0f
+#define VKX_TRANSFER_QUEUE_PRIORITY 0.5f
 
 #define VKX_NUM_VALIDATION_LAYERS 1
 static const char* validation_layers[VKX_NUM_VALIDATION_LAYERS] = {
@@ -24,6 +49,53 @@ static const char* device_extensions[VKX_NUM_DEVICE_EXTENSIONS] = {
 	VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME
 };
 
+// Enabled if the device has them, the rest of vkx checks the flags in vkx_instance
+#define VKX_NUM_OPTIONAL_DEVICE_EXTENSIONS 19
+static const char* optional_device_extensions[VKX_NUM_OPTIONAL_DEVICE_EXTENSIONS] = {
+	VK_EXT_MEMORY_BUDGET_EXTENSION_NAME,
+	// For low latency frame pacing, which needs both of them
+	VK_KHR_PRESENT_ID_EXTENSION_NAME,
+	VK_KHR_PRESENT_WAIT_EXTENSION_NAME,
+	// Blending set per draw (the rest of the dynamic render state is core 1.3)
+	VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME,
+	// Texture uploads straight from host memory, without a staging buffer
+	VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME,
+	// Handing captured frames to another process or API (e.g. a hardware
+	// video encoder) as file descriptors, dma-bufs where there are those
+	VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME,
+	VK_EXT_EXTERNAL_MEMORY_DMA_BUF_EXTENSION_NAME,
+	// Copying uploads straight out of host memory, see vkx_import_host_buffer()
+	VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME,
+	// Bindings written while recording without allocating sets, see VkxPushSet
+	VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME,
+	// Descriptors written straight into buffer memory, see vkx_set_descriptor_buffers()
+	VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME,
+	// Shaders bound on their own with all of the state dynamic, see
+	// vkx_set_shader_objects()
+	VK_EXT_SHADER_OBJECT_EXTENSION_NAME,
+	// Otherwise pipelines linked from separately compiled parts, which needs
+	// both of them
+	VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME,
+	VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME,
+	// Task and mesh shaders, see vkx_create_mesh_pipeline()
+	VK_EXT_MESH_SHADER_EXTENSION_NAME,
+	// Telling the presentation engine which part of the image changed, see
+	// vkx_add_present_region()
+	VK_KHR_INCREMENTAL_PRESENT_EXTENSION_NAME,
+	// Shading fewer times than there are pixels, per draw and from an image,
+	// see vkx_set_shading_rate()
+	VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME,
+	// Reading the colour attachment being drawn to, see
+	// vkx_frame_graph_add_local_read_attachment()
+	VK_KHR_DYNAMIC_RENDERING_LOCAL_READ_EXTENSION_NAME,
+	// Present fences and switching present modes without recreating the swap
+	// chain, see vkx_switch_present_mode()
+	VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME,
+	// Reading the GPU's clock from the CPU, for the profiler's timestamps to
+	// line up with the CPU trace
+	VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME
+};
+
 static bool vkx_check_validation_layer_support() {
 	uint32_t layer_count;
 	vkEnumerateInstanceLayerProperties(&layer_count, NULL);
@@ -51,6 +123,21 @@ static bool vkx_check_validation_layer_support() {
 	return true;
 }
 
+static bool vkx_has_instance_extension(const char* name) {
+	// Whether the loader or one of the implicit layers has an instance extension
+	uint32_t extensions_count = 0;
+	vkEnumerateInstanceExtensionProperties(NULL, &extensions_count, NULL);
+	VkExtensionProperties* extensions = malloc(sizeof(VkExtensionProperties) * extensions_count);
+	vkEnumerateInstanceExtensionProperties(NULL, &extensions_count, extensions);
+
+	bool found = false;
+	for (uint32_t i = 0; i < extensions_count && !found; i++) {
+		found = strcmp(extensions[i].extensionName, name) == 0;
+	}
+	free(extensions);
+	return found;
+}
+
 static char const * const * vkx_get_required_extensions(uint32_t* count) {
 	/*
 	 * If validation layers are enabled, we need to request the VK_EXT_DEBUG_UTILS_EXTENSION_NAME extension
@@ -61,23 +148,43 @@ static char const * const * vkx_get_required_extensions(uint32_t* count) {
 	 */
 	assert(count != NULL);
 	
-	// Get the required extensions from GLFW and set count to the number of extensions
-	char const * const * sdl_extensions = SDL_Vulkan_GetInstanceExtensions(count);
+	// Get the required extensions from GLFW and set count to the number of extensions.
+	// Headless there is no surface, so none of them are needed
+	Uint32 sdl_extensions_count = 0;
+	char const * const * sdl_extensions = vkx_instance.headless ? NULL : SDL_Vulkan_GetInstanceExtensions(&sdl_extensions_count);
+	*count = sdl_extensions_count;
 
-	if (sdl_extensions == NULL) {
+	if (sdl_extensions == NULL && !vkx_instance.headless) {
 		fprintf(stderr, "Failed to get required extensions from GLFW\n");
 		exit(1);
 	}
 	
-	if (!enable_validation_layers) {
-		const char** extensions = malloc(sizeof(const char*) * *count);
+	// Room for the surface maintenance and debug utils extensions as well
+	const char** extensions = malloc(sizeof(const char*) * (*count + 3));
+	if (*count > 0) {
 		memcpy(extensions, sdl_extensions, sizeof(const char*) * *count);
+	}
+
+	// The swap chain maintenance device extension needs these
+	vkx_instance.has_surface_maintenance1 = !vkx_instance.headless
+		&& vkx_has_instance_extension(VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME)
+		&& vkx_has_instance_extension(VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME);
+	if (vkx_instance.has_surface_maintenance1) {
+		extensions[*count] = VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME;
+		extensions[*count + 1] = VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME;
+		*count += 2;
+	}
+
+	// If validation layers are enabled, add the debug utils extension.  Debug
+	// builds also want it for the object names and labels, if it's there
+	vkx_instance.has_debug_utils = enable_validation_layers;
+#ifndef NDEBUG
+	vkx_instance.has_debug_utils = vkx_instance.has_debug_utils || vkx_has_instance_extension(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+#endif
+	if (!vkx_instance.has_debug_utils) {
 		return extensions;
 	}
 
-	// If validation layers are enabled, add the debug utils extension
-	const char** extensions = malloc(sizeof(const char*) * (*count + 1));
-	memcpy(extensions, sdl_extensions, sizeof(const char*) * *count);
 	extensions[*count] = VK_EXT_DEBUG_UTILS_EXTENSION_NAME;
 	*count += 1;
 	
@@ -105,7 +212,196 @@ static void vkx_populate_debug_messenger_create_info(VkDebugUtilsMessengerCreate
 	create_info->pfnUserCallback = vkx_debug_callback;
 }
 
+static bool vkx_is_device_suitable(VkPhysicalDevice device) {
+	/*
+	 * Check a device has everything vkx needs, printing why if it doesn't
+	 */
+	VkxQueueFamilyIndices indices = vkx_find_queue_families(device, vkx_instance.surface);
+
+	printf("  Graphics Family: %d\n", indices.graphics_family);
+	printf("  Present Family: %d\n", indices.present_family);
+
+	uint32_t extension_count;
+	vkEnumerateDeviceExtensionProperties(device, NULL, &extension_count, NULL);
+
+	VkExtensionProperties* available_extensions = malloc(sizeof(VkExtensionProperties) * extension_count);
+	vkEnumerateDeviceExtensionProperties(device, NULL, &extension_count, available_extensions);
+
+	// Check all of the required extensions are supported
+	bool required_extensions_supported = true;
+
+	for (uint32_t j = 0; j < VKX_NUM_DEVICE_EXTENSIONS; j++) {
+		if (vkx_instance.headless && strcmp(device_extensions[j], VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0) {
+			continue;
+		}
+
+		bool extension_found = false;
+		for (uint32_t k = 0; k < extension_count; k++) {
+			if (strcmp(device_extensions[j], available_extensions[k].extensionName) == 0) {
+				extension_found = true;
+				break;
+			}
+		}
+
+		if (!extension_found) {
+			required_extensions_supported = false;
+			printf("  Extension %s not supported\n", device_extensions[j]);
+			break;
+		}
+	}
+
+	free(available_extensions);
+
+	if (!required_extensions_supported) {
+		return false;
+	}
+
+	// Check the features we need are supported
+	VkPhysicalDeviceFeatures features;
+	vkGetPhysicalDeviceFeatures(device, &features);
+
+	if (!features.samplerAnisotropy) {
+		printf("  Sampler anisotropy not supported\n");
+		return false;
+	}
+
+	// The bindless texture table needs these descriptor indexing features
+	VkPhysicalDeviceVulkan12Features vulkan12_features = {0};
+	vulkan12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+	VkPhysicalDeviceFeatures2 features2 = {0};
+	features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features2.pNext = &vulkan12_features;
+	vkGetPhysicalDeviceFeatures2(device, &features2);
+
+	if (!vulkan12_features.descriptorIndexing
+			|| !vulkan12_features.runtimeDescriptorArray
+			|| !vulkan12_features.descriptorBindingPartiallyBound
+			|| !vulkan12_features.descriptorBindingSampledImageUpdateAfterBind
+			|| !vulkan12_features.descriptorBindingUpdateUnusedWhilePending) {
+		printf("  Descriptor indexing not supported\n");
+		return false;
+	}
+
+	// Check the device supports the required swap chain features
+	bool swap_chain_adequate = vkx_instance.headless;
+
+	if (indices.has_present_family && !vkx_instance.headless) {
+		size_t arena_mark = arena_get_mark(frame_arena());
+		VkxSwapChainSupportDetails swap_chain_support = vkx_query_swap_chain_support(device, vkx_instance.surface);
+		swap_chain_adequate = swap_chain_support.formats_count > 0 && swap_chain_support.present_modes_count > 0;
+		arena_release(frame_arena(), arena_mark);
+	}
+
+	if (!indices.has_graphics_family || !indices.has_present_family || !swap_chain_adequate) {
+		printf("  Can't present to the window\n");
+		return false;
+	}
+
+	return true;
+}
+
+static uint64_t vkx_score_physical_device(VkPhysicalDevice device, const VkPhysicalDeviceProperties* properties) {
+	/*
+	 * Rate a suitable device, highest first.  The device type always comes
+	 * first, so a discrete GPU beats an integrated one whatever their memory,
+	 * then the size of the device local memory and the extras which make
+	 * uploads and frames cheaper.  What it was scored on is printed
+	 */
+	uint64_t score = 0;
+	const char* type_name = "other";
+
+	switch (properties->deviceType) {
+		case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+			score += VKX_DEVICE_SCORE_DISCRETE;
+			type_name = "discrete GPU";
+			break;
+		case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+			score += VKX_DEVICE_SCORE_INTEGRATED;
+			type_name = "integrated GPU";
+			break;
+		case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+			score += VKX_DEVICE_SCORE_VIRTUAL;
+			type_name = "virtual GPU";
+			break;
+		case VK_PHYSICAL_DEVICE_TYPE_CPU:
+			type_name = "CPU";
+			break;
+		default:
+			break;
+	}
+
+	// The largest device local heap, in MiB.  Integrated GPUs report (part of)
+	// system memory here, which is why the type counts for more
+	VkPhysicalDeviceMemoryProperties memory_properties;
+	vkGetPhysicalDeviceMemoryProperties(device, &memory_properties);
+
+	VkDeviceSize device_local_size = 0;
+	for (uint32_t i = 0; i < memory_properties.memoryHeapCount; i++) {
+		if ((memory_properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) && memory_properties.memoryHeaps[i].size > device_local_size) {
+			device_local_size = memory_properties.memoryHeaps[i].size;
+		}
+	}
+
+	uint64_t device_local_mib = device_local_size / (1024 * 1024);
+	score += device_local_mib < VKX_DEVICE_SCORE_MAX_MEMORY_MIB ? device_local_mib : VKX_DEVICE_SCORE_MAX_MEMORY_MIB;
+
+	// Separate transfer and compute families let uploads and compute passes
+	// overlap the frame
+	VkxQueueFamilyIndices indices = vkx_find_queue_families(device, vkx_instance.surface);
+	if (indices.has_transfer_family) {
+		score += VKX_DEVICE_SCORE_QUEUE_FAMILY;
+	}
+	if (indices.has_compute_family) {
+		score += VKX_DEVICE_SCORE_QUEUE_FAMILY;
+	}
+
+	uint32_t extension_count;
+	vkEnumerateDeviceExtensionProperties(device, NULL, &extension_count, NULL);
+	VkExtensionProperties* available_extensions = malloc(sizeof(VkExtensionProperties) * extension_count);
+	vkEnumerateDeviceExtensionProperties(device, NULL, &extension_count, available_extensions);
+
+	uint32_t optional_extensions_count = 0;
+	for (uint32_t i = 0; i < VKX_NUM_OPTIONAL_DEVICE_EXTENSIONS; i++) {
+		for (uint32_t j = 0; j < extension_count; j++) {
+			if (strcmp(optional_device_extensions[i], available_extensions[j].extensionName) == 0) {
+				optional_extensions_count++;
+				break;
+			}
+		}
+	}
+	free(available_extensions);
+
+	score += optional_extensions_count * VKX_DEVICE_SCORE_EXTENSION;
+
+	printf("  Score %llu: %s, %llu MiB device local, %s transfer, %s compute, %u/%d optional extensions\n",
+			(unsigned long long) score, type_name, (unsigned long long) device_local_mib,
+			indices.has_transfer_family ? "dedicated" : "shared", indices.has_compute_family ? "async" : "shared",
+			optional_extensions_count, VKX_NUM_OPTIONAL_DEVICE_EXTENSIONS);
+
+	return score;
+}
+
+static bool vkx_device_matches(const char* preference, uint32_t index, const char* name) {
+	/*
+	 * Check a device against a preferred device, which is either its index in
+	 * the list or part of its name (ignoring case)
+	 */
+	char* end;
+	unsigned long preferred_index = strtoul(preference, &end, 10);
+	if (end != preference && *end == '\0') {
+		return preferred_index == index;
+	}
+
+	return SDL_strcasestr(name, preference) != NULL;
+}
+
 static VkPhysicalDevice vkx_pick_physical_device(void) {
+	/*
+	 * Pick the suitable device with the highest score (see
+	 * vkx_score_physical_device()), unless the VKX_DEVICE environment variable
+	 * or preferred_physical_device names a suitable one
+	 */
 	uint32_t device_count = 0;
 	vkEnumeratePhysicalDevices(vkx_instance.instance, &device_count, NULL);
 
@@ -117,94 +413,121 @@ static VkPhysicalDevice vkx_pick_physical_device(void) {
 	VkPhysicalDevice* devices = malloc(sizeof(VkPhysicalDevice) * device_count);
 	vkEnumeratePhysicalDevices(vkx_instance.instance, &device_count, devices);
 
-	// First let's print some info about all of the found devices
+	const char* preference = SDL_getenv("VKX_DEVICE");
+	const char* preference_source = "VKX_DEVICE";
+	if (preference == NULL || preference[0] == '\0') {
+		preference = preferred_physical_device;
+		preference_source = "preferred_physical_device";
+	}
+
 	printf(" Found %d physical devices:\n", device_count);
+
+	VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+	uint32_t chosen_index = 0;
+	uint64_t best_score = 0;
+	bool preferred_found = false;
+
 	for (uint32_t i = 0; i < device_count; i++) {
 		VkPhysicalDeviceProperties device_properties;
 		vkGetPhysicalDeviceProperties(devices[i], &device_properties);
 		printf("  Device %d: %s\n", i, device_properties.deviceName);
-	}
-	
-	VkPhysicalDevice physical_device = VK_NULL_HANDLE;
-
-	for (uint32_t i = 0; i < device_count; i++) {
-		printf(" Physical Device %d\n", i);
-        VkxQueueFamilyIndices indices = vkx_find_queue_families(devices[i], vkx_instance.surface);
-
-		printf("  Graphics Family: %d\n", indices.graphics_family);
-		printf("  Present Family: %d\n", indices.present_family);
-		
-        uint32_t extension_count;
-        vkEnumerateDeviceExtensionProperties(devices[i], NULL, &extension_count, NULL);
-		
-		VkExtensionProperties* available_extensions = malloc(sizeof(VkExtensionProperties) * extension_count);
-        vkEnumerateDeviceExtensionProperties(devices[i], NULL, &extension_count, available_extensions);
-		
-		// Check all of the required extensions are supported
-		bool required_extensions_supported = true;
-
-		for (uint32_t j = 0; j < VKX_NUM_DEVICE_EXTENSIONS; j++) {
-			bool extension_found = false;
-			for (uint32_t k = 0; k < extension_count; k++) {
-				if (strcmp(device_extensions[j], available_extensions[k].extensionName) == 0) {
-					extension_found = true;
-					break;
-				}
-			}
 
-			if (!extension_found) {
-				required_extensions_supported = false;
-				printf("Extension %s not supported\n", device_extensions[j]);
-				break;
-			}
+		if (!vkx_is_device_suitable(devices[i])) {
+			continue;
 		}
 
-		free(available_extensions);
+		uint64_t score = vkx_score_physical_device(devices[i], &device_properties);
+		bool preferred = preference != NULL && vkx_device_matches(preference, i, device_properties.deviceName);
 
-		if (!required_extensions_supported) {
-			continue;
+		// The first preferred device wins outright, otherwise the best score
+		if ((preferred && !preferred_found) || (!preferred_found && (physical_device == VK_NULL_HANDLE || score > best_score))) {
+			physical_device = devices[i];
+			chosen_index = i;
+			best_score = score;
+			preferred_found = preferred;
 		}
+	}
 
-		// Check the features we need are supported
-		VkPhysicalDeviceFeatures features;
-		vkGetPhysicalDeviceFeatures(devices[i], &features);
+	if (physical_device != VK_NULL_HANDLE) {
+		VkPhysicalDeviceProperties device_properties;
+		vkGetPhysicalDeviceProperties(physical_device, &device_properties);
 
-		if (!features.samplerAnisotropy) {
-			printf("Sampler anisotropy not supported\n");
-			continue;
+		if (preference != NULL && !preferred_found) {
+			printf(" No suitable device matches %s=%s\n", preference_source, preference);
 		}
+		printf(" Using device %d (%s): %s\n", chosen_index, device_properties.deviceName,
+				preferred_found ? "matches the preferred device" : "highest score");
+	}
 
-		// Check the device supports the required swap chain features
-		bool swap_chain_adequate = false;
+	free(devices);
+	return physical_device;
+}
 
-		if (indices.has_present_family) {
-			VkxSwapChainSupportDetails swap_chain_support = vkx_query_swap_chain_support(devices[i], vkx_instance.surface);
-			swap_chain_adequate = swap_chain_support.formats_count > 0 && swap_chain_support.present_modes_count > 0;
-			vkx_free_swap_chain_support(&swap_chain_support);
-		}
+static void vkx_create_async_compute_frame(VkxFrame* frame, VkCommandBufferAllocateInfo* buf_alloc_info) {
+	/*
+	 * Create what a frame in flight needs to submit its compute passes to the
+	 * compute queue in between two graphics submissions
+	 *
+	 * @param buf_alloc_info For one primary command buffer, the pool is changed
+	 */
+	buf_alloc_info->commandPool = frame->command_pool;
+	if (vkAllocateCommandBuffers(vkx_instance.device, buf_alloc_info, &frame->command_buffer_after_compute) != VK_SUCCESS) {
+		fprintf(stderr, "failed to allocate command buffers!\n");
+		exit(1);
+	}
 
-        if (indices.has_graphics_family
-				&& indices.has_present_family
-				&& swap_chain_adequate) {
+	VkCommandPoolCreateInfo command_pool_info = {0};
+	command_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	command_pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	command_pool_info.queueFamilyIndex = vkx_instance.compute_queue_family;
 
-			VkPhysicalDeviceProperties device_properties;
-			vkGetPhysicalDeviceProperties(devices[i], &device_properties);
-			printf(" Device %d (%s) is suitable\n", i, device_properties.deviceName);
+	if (vkCreateCommandPool(vkx_instance.device, &command_pool_info, vkx_get_allocator(VK_OBJECT_TYPE_COMMAND_POOL), &frame->compute_command_pool) != VK_SUCCESS) {
+		fprintf(stderr, "failed to create compute command pool for a frame!\n");
+		exit(1);
+	}
 
-			physical_device = devices[i];
-			break;
-		}
+	buf_alloc_info->commandPool = frame->compute_command_pool;
+	if (vkAllocateCommandBuffers(vkx_instance.device, buf_alloc_info, &frame->compute_command_buffer) != VK_SUCCESS) {
+		fprintf(stderr, "failed to allocate compute command buffers!\n");
+		exit(1);
 	}
 
-	free(devices);
-	return physical_device;
+	VkSemaphoreCreateInfo semaphore_info = {0};
+	semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	if (vkCreateSemaphore(vkx_instance.device, &semaphore_info, vkx_get_allocator(VK_OBJECT_TYPE_SEMAPHORE), &frame->compute_wait_semaphore) != VK_SUCCESS
+			|| vkCreateSemaphore(vkx_instance.device, &semaphore_info, vkx_get_allocator(VK_OBJECT_TYPE_SEMAPHORE), &frame->compute_finished_semaphore) != VK_SUCCESS) {
+		fprintf(stderr, "failed to create compute semaphores for a frame!\n");
+		exit(1);
+	}
 }
 
-void vkx_init(SDL_Window* window) {
+void vkx_init(SDL_Window* window, uint32_t frames_in_flight) {
+	/*
+	 * Create the instance, device and everything for each frame in flight
+	 *
+	 * @param window The window to render to, or NULL for headless rendering
+	 *               (no surface or swap chain, and nothing can be presented)
+	 * @param frames_in_flight From 1 (lowest latency) to VKX_MAX_FRAMES_IN_FLIGHT
+	 *                         (the most CPU and GPU overlap)
+	 */
 	printf("Initialising Vulkan (VKX)\n");
 
+	if (frames_in_flight < 1 || frames_in_flight > VKX_MAX_FRAMES_IN_FLIGHT) {
+		fprintf(stderr, "Invalid number of frames in flight: %u (1 to %d)\n", frames_in_flight, VKX_MAX_FRAMES_IN_FLIGHT);
+		exit(1);
+	}
+	vkx_instance.frames_in_flight = frames_in_flight;
+
 	// Keep a reference to the window to avoid passing it around later
 	vkx_instance.window = window;
+	vkx_instance.headless = window == NULL;
+	if (vkx_instance.headless) {
+		printf(" Headless, without a window\n");
+	}
+
+	// Before anything is created with the callbacks
+	vkx_host_memory_init();
 
 	if (enable_validation_layers && !vkx_check_validation_layer_support()) {
 		fprintf(stderr, "validation layers requested, but not available!");
@@ -248,7 +571,7 @@ void vkx_init(SDL_Window* window) {
 	}
 	
 	// ----- Create the Vulkan instance -----
-	if (vkCreateInstance(&instance_create_info, NULL, &vkx_instance.instance) != VK_SUCCESS) {
+	if (vkCreateInstance(&instance_create_info, vkx_get_allocator(VK_OBJECT_TYPE_INSTANCE), &vkx_instance.instance) != VK_SUCCESS) {
 		fprintf(stderr, "failed to create instance!");
 		exit(1);
 	}
@@ -269,7 +592,8 @@ void vkx_init(SDL_Window* window) {
 	}
 
 	// ----- Create the window surface -----
-	if (!SDL_Vulkan_CreateSurface(window, vkx_instance.instance, NULL, &vkx_instance.surface)) {
+	vkx_instance.surface = VK_NULL_HANDLE;
+	if (!vkx_instance.headless && !SDL_Vulkan_CreateSurface(window, vkx_instance.instance, vkx_get_allocator(VK_OBJECT_TYPE_SURFACE_KHR), &vkx_instance.surface)) {
 		fprintf(stderr, "failed to create window surface!");
 		exit(1);
 	}
@@ -291,18 +615,62 @@ void vkx_init(SDL_Window* window) {
 	
 	VkxQueueFamilyIndices physical_indices = vkx_find_queue_families(vkx_instance.physical_device, vkx_instance.surface);
 	
+	// Uploads go through a dedicated transfer family if there is one
+	vkx_instance.graphics_queue_family = physical_indices.graphics_family;
+	vkx_instance.transfer_queue_family = physical_indices.has_transfer_family ? physical_indices.transfer_family : physical_indices.graphics_family;
+	printf(" Transfer Family: %d (%s)\n", vkx_instance.transfer_queue_family, physical_indices.has_transfer_family ? "dedicated" : "shared with graphics");
+
+	// Async compute needs a queue which isn't the graphics one
+	vkx_instance.has_async_compute = physical_indices.has_compute_family;
+	vkx_instance.compute_queue_family = physical_indices.has_compute_family ? physical_indices.compute_family : physical_indices.graphics_family;
+	printf(" Compute Family: %d (%s)\n", vkx_instance.compute_queue_family, physical_indices.has_compute_family ? "async" : "shared with graphics");
+
 	// I don't fully understand why, but sometimes it looks like both families could be the same
-	uint32_t unique_queue_families[2] = {physical_indices.graphics_family, physical_indices.present_family};
-	uint32_t num_unique_queue_families = unique_queue_families[0] == unique_queue_families[1] ? 1 : 2;
+	uint32_t unique_queue_families[4] = {physical_indices.graphics_family, 0, 0, 0};
+	uint32_t num_unique_queue_families = 1;
+	if (physical_indices.present_family != physical_indices.graphics_family) {
+		unique_queue_families[num_unique_queue_families++] = physical_indices.present_family;
+	}
+	if (vkx_instance.transfer_queue_family != physical_indices.graphics_family
+			&& vkx_instance.transfer_queue_family != physical_indices.present_family) {
+		unique_queue_families[num_unique_queue_families++] = vkx_instance.transfer_queue_family;
+	}
+	if (vkx_instance.compute_queue_family != physical_indices.graphics_family
+			&& vkx_instance.compute_queue_family != physical_indices.present_family
+			&& vkx_instance.compute_queue_family != vkx_instance.transfer_queue_family) {
+		unique_queue_families[num_unique_queue_families++] = vkx_instance.compute_queue_family;
+	}
 	VkDeviceQueueCreateInfo* queue_create_infos = malloc(sizeof(VkDeviceQueueCreateInfo) * num_unique_queue_families);
 
-	float queue_priority = 1.0f;
+	// Each family's queues in order, with two queues of the transfer family if
+	// async compute shares it, and of the graphics family for the presents if
+	// it has them
+	float queue_priorities[4][2];
 	for (uint32_t i = 0; i < num_unique_queue_families; i++) {
 		VkDeviceQueueCreateInfo queue_create_info = {0};
 		queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
 		queue_create_info.queueFamilyIndex = unique_queue_families[i];
 		queue_create_info.queueCount = 1;
-		queue_create_info.pQueuePriorities = &queue_priority;
+		queue_create_info.pQueuePriorities = queue_priorities[i];
+
+		if (unique_queue_families[i] == physical_indices.graphics_family || unique_queue_families[i] == physical_indices.present_family) {
+			queue_priorities[i][0] = VKX_GRAPHICS_QUEUE_PRIORITY;
+		}
+		else if (physical_indices.has_transfer_family && unique_queue_families[i] == physical_indices.transfer_family) {
+			queue_priorities[i][0] = VKX_TRANSFER_QUEUE_PRIORITY;
+		}
+		else {
+			queue_priorities[i][0] = VKX_COMPUTE_QUEUE_PRIORITY;
+		}
+
+		if (physical_indices.has_compute_family && unique_queue_families[i] == physical_indices.compute_family) {
+			queue_create_info.queueCount = physical_indices.compute_queue_index + 1;
+			queue_priorities[i][physical_indices.compute_queue_index] = VKX_COMPUTE_QUEUE_PRIORITY;
+		}
+		if (unique_queue_families[i] == physical_indices.graphics_family && physical_indices.present_queue_index > 0) {
+			queue_create_info.queueCount = physical_indices.present_queue_index + 1;
+			queue_priorities[i][physical_indices.present_queue_index] = VKX_GRAPHICS_QUEUE_PRIORITY;
+		}
 
 		queue_create_infos[i] = queue_create_info;
 	}
@@ -316,12 +684,80 @@ void vkx_init(SDL_Window* window) {
 	vulkan12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
 	vulkan12_features.descriptorIndexing = VK_TRUE;
 	vulkan12_features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+	// For the bindless texture table
+	vulkan12_features.runtimeDescriptorArray = VK_TRUE;
+	vulkan12_features.descriptorBindingPartiallyBound = VK_TRUE;
+	vulkan12_features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+	vulkan12_features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+	vulkan12_features.timelineSemaphore = VK_TRUE;
 	vulkan12_features.pNext = &vulkan13_features;
+
+	// Multiview is required by Vulkan 1.1, for split screen
+	VkPhysicalDeviceVulkan11Features vulkan11_features = {0};
+	vulkan11_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES;
+	vulkan11_features.multiview = VK_TRUE;
+	vulkan11_features.pNext = &vulkan12_features;
 	
 	VkPhysicalDeviceFeatures2 features2 = {0};
 	features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
 	features2.features.samplerAnisotropy = VK_TRUE;
-	features2.pNext = &vulkan12_features;
+	features2.pNext = &vulkan11_features;
+
+	// Whichever block compressed formats there are, for KTX2 textures
+	VkPhysicalDeviceFeatures supported_device_features;
+	vkGetPhysicalDeviceFeatures(vkx_instance.physical_device, &supported_device_features);
+	features2.features.textureCompressionBC = supported_device_features.textureCompressionBC;
+	features2.features.textureCompressionETC2 = supported_device_features.textureCompressionETC2;
+	features2.features.textureCompressionASTC_LDR = supported_device_features.textureCompressionASTC_LDR;
+
+	// Counting shader invocations per pass, for the profiler
+	features2.features.pipelineStatisticsQuery = supported_device_features.pipelineStatisticsQuery;
+	vkx_instance.has_pipeline_statistics = supported_device_features.pipelineStatisticsQuery == VK_TRUE;
+
+	// Drawing the sprite batches with the same state in one indirect draw
+	features2.features.multiDrawIndirect = supported_device_features.multiDrawIndirect;
+	vkx_instance.has_multi_draw_indirect = supported_device_features.multiDrawIndirect == VK_TRUE;
+
+	// Partly resident 2D images, binding them on the graphics queue, and the
+	// shaders checking residency and writing down what they sampled, for the
+	// sparse texture atlas
+	VkPhysicalDeviceProperties sparse_device_properties;
+	vkGetPhysicalDeviceProperties(vkx_instance.physical_device, &sparse_device_properties);
+
+	size_t queue_families_mark = arena_get_mark(frame_arena());
+	uint32_t queue_families_count = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(vkx_instance.physical_device, &queue_families_count, NULL);
+	VkQueueFamilyProperties* queue_families = FRAME_ALLOC(VkQueueFamilyProperties, queue_families_count);
+	vkGetPhysicalDeviceQueueFamilyProperties(vkx_instance.physical_device, &queue_families_count, queue_families);
+
+	vkx_instance.has_sparse_residency = supported_device_features.sparseBinding
+		&& supported_device_features.sparseResidencyImage2D
+		&& supported_device_features.shaderResourceResidency
+		&& supported_device_features.fragmentStoresAndAtomics
+		&& sparse_device_properties.sparseProperties.residencyStandard2DBlockShape
+		&& (queue_families[physical_indices.graphics_family].queueFlags & VK_QUEUE_SPARSE_BINDING_BIT) != 0;
+	arena_release(frame_arena(), queue_families_mark);
+	if (vkx_instance.has_sparse_residency) {
+		features2.features.sparseBinding = VK_TRUE;
+		features2.features.sparseResidencyImage2D = VK_TRUE;
+		features2.features.shaderResourceResidency = VK_TRUE;
+		features2.features.fragmentStoresAndAtomics = VK_TRUE;
+	}
+
+	// The most commands in one indirect draw
+	vkx_instance.max_draw_indirect_count = vkx_instance.has_multi_draw_indirect
+		? sparse_device_properties.limits.maxDrawIndirectCount : 1;
+
+	// Ballots in compute shaders, for the sprite simulation appending events
+	VkPhysicalDeviceSubgroupProperties subgroup_properties = {0};
+	subgroup_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+	VkPhysicalDeviceProperties2 subgroup_device_properties = {0};
+	subgroup_device_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	subgroup_device_properties.pNext = &subgroup_properties;
+	vkGetPhysicalDeviceProperties2(vkx_instance.physical_device, &subgroup_device_properties);
+	const VkSubgroupFeatureFlags ballot_operations = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_BALLOT_BIT;
+	vkx_instance.has_subgroup_ballot = (subgroup_properties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) != 0
+		&& (subgroup_properties.supportedOperations & ballot_operations) == ballot_operations;
 
 	VkDeviceCreateInfo create_info = {0};
 	create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -329,8 +765,399 @@ void vkx_init(SDL_Window* window) {
 	create_info.queueCreateInfoCount = num_unique_queue_families;
 	create_info.pQueueCreateInfos = queue_create_infos;
 
-	create_info.enabledExtensionCount = VKX_NUM_DEVICE_EXTENSIONS;
-	create_info.ppEnabledExtensionNames = device_extensions;
+	// Add whichever optional extensions the device has
+	const char* enabled_extensions[VKX_NUM_DEVICE_EXTENSIONS + VKX_NUM_OPTIONAL_DEVICE_EXTENSIONS];
+	uint32_t enabled_extensions_count = 0;
+	for (uint32_t i = 0; i < VKX_NUM_DEVICE_EXTENSIONS; i++) {
+		if (vkx_instance.headless && strcmp(device_extensions[i], VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0) {
+			continue;
+		}
+		enabled_extensions[enabled_extensions_count++] = device_extensions[i];
+	}
+	uint32_t required_extensions_count = enabled_extensions_count;
+
+	uint32_t extension_count;
+	vkEnumerateDeviceExtensionProperties(vkx_instance.physical_device, NULL, &extension_count, NULL);
+	VkExtensionProperties* available_extensions = malloc(sizeof(VkExtensionProperties) * extension_count);
+	vkEnumerateDeviceExtensionProperties(vkx_instance.physical_device, NULL, &extension_count, available_extensions);
+
+	for (uint32_t i = 0; i < VKX_NUM_OPTIONAL_DEVICE_EXTENSIONS; i++) {
+		// The present extensions need the swap chain one
+		bool present_extension = strcmp(optional_device_extensions[i], VK_KHR_PRESENT_ID_EXTENSION_NAME) == 0
+			|| strcmp(optional_device_extensions[i], VK_KHR_PRESENT_WAIT_EXTENSION_NAME) == 0
+			|| strcmp(optional_device_extensions[i], VK_KHR_INCREMENTAL_PRESENT_EXTENSION_NAME) == 0;
+		if (vkx_instance.headless && present_extension) {
+			continue;
+		}
+		// And the swap chain maintenance one needs the surface maintenance
+		// instance extensions too
+		bool swapchain_maintenance = strcmp(optional_device_extensions[i], VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME) == 0;
+		if (swapchain_maintenance && !vkx_instance.has_surface_maintenance1) {
+			continue;
+		}
+
+		for (uint32_t j = 0; j < extension_count; j++) {
+			if (strcmp(optional_device_extensions[i], available_extensions[j].extensionName) == 0) {
+				enabled_extensions[enabled_extensions_count++] = optional_device_extensions[i];
+				break;
+			}
+		}
+	}
+	free(available_extensions);
+
+	bool has_present_id = false;
+	bool has_present_wait = false;
+	bool has_extended_dynamic_state3 = false;
+	bool has_host_image_copy = false;
+	bool has_descriptor_buffer = false;
+	bool has_shader_object = false;
+	bool has_pipeline_library = false;
+	bool has_graphics_pipeline_library = false;
+	bool has_mesh_shader = false;
+	bool has_fragment_shading_rate = false;
+	bool has_local_read = false;
+	bool has_swapchain_maintenance1 = false;
+	for (uint32_t i = required_extensions_count; i < enabled_extensions_count; i++) {
+		if (strcmp(enabled_extensions[i], VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0) {
+			vkx_instance.has_memory_budget = true;
+		}
+		else if (strcmp(enabled_extensions[i], VK_KHR_PRESENT_ID_EXTENSION_NAME) == 0) {
+			has_present_id = true;
+		}
+		else if (strcmp(enabled_extensions[i], VK_KHR_PRESENT_WAIT_EXTENSION_NAME) == 0) {
+			has_present_wait = true;
+		}
+		else if (strcmp(enabled_extensions[i], VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME) == 0) {
+			has_extended_dynamic_state3 = true;
+		}
+		else if (strcmp(enabled_extensions[i], VK_EXT_HOST_IMAGE_COPY_EXTENSION_NAME) == 0) {
+			has_host_image_copy = true;
+		}
+		else if (strcmp(enabled_extensions[i], VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME) == 0) {
+			vkx_instance.has_external_memory_fd = true;
+		}
+		else if (strcmp(enabled_extensions[i], VK_EXT_EXTERNAL_MEMORY_DMA_BUF_EXTENSION_NAME) == 0) {
+			vkx_instance.has_external_memory_dma_buf = true;
+		}
+		else if (strcmp(enabled_extensions[i], VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME) == 0) {
+			vkx_instance.has_external_memory_host = true;
+		}
+		else if (strcmp(enabled_extensions[i], VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME) == 0) {
+			vkx_instance.has_push_descriptor = true;
+		}
+		else if (strcmp(enabled_extensions[i], VK_EXT_DESCRIPTOR_BUFFER_EXTENSION_NAME) == 0) {
+			has_descriptor_buffer = true;
+		}
+		else if (strcmp(enabled_extensions[i], VK_EXT_SHADER_OBJECT_EXTENSION_NAME) == 0) {
+			has_shader_object = true;
+		}
+		else if (strcmp(enabled_extensions[i], VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) == 0) {
+			has_pipeline_library = true;
+		}
+		else if (strcmp(enabled_extensions[i], VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME) == 0) {
+			has_graphics_pipeline_library = true;
+		}
+		else if (strcmp(enabled_extensions[i], VK_EXT_MESH_SHADER_EXTENSION_NAME) == 0) {
+			has_mesh_shader = true;
+		}
+		else if (strcmp(enabled_extensions[i], VK_KHR_INCREMENTAL_PRESENT_EXTENSION_NAME) == 0) {
+			vkx_instance.has_incremental_present = true;
+		}
+		else if (strcmp(enabled_extensions[i], VK_KHR_FRAGMENT_SHADING_RATE_EXTENSION_NAME) == 0) {
+			has_fragment_shading_rate = true;
+		}
+		else if (strcmp(enabled_extensions[i], VK_KHR_DYNAMIC_RENDERING_LOCAL_READ_EXTENSION_NAME) == 0) {
+			has_local_read = true;
+		}
+		else if (strcmp(enabled_extensions[i], VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME) == 0) {
+			has_swapchain_maintenance1 = true;
+		}
+		else if (strcmp(enabled_extensions[i], VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME) == 0) {
+			vkx_instance.has_calibrated_timestamps = true;
+		}
+	}
+	// dma-bufs are exported as file descriptors
+	vkx_instance.has_external_memory_dma_buf = vkx_instance.has_external_memory_dma_buf && vkx_instance.has_external_memory_fd;
+
+	// Host pointers are imported in whole pieces of this, which has to fit the
+	// pages they're in
+	if (vkx_instance.has_external_memory_host) {
+		VkPhysicalDeviceExternalMemoryHostPropertiesEXT host_properties = {0};
+		host_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT;
+		VkPhysicalDeviceProperties2 properties = {0};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties.pNext = &host_properties;
+		vkGetPhysicalDeviceProperties2(vkx_instance.physical_device, &properties);
+
+		vkx_instance.host_pointer_alignment = host_properties.minImportedHostPointerAlignment;
+		vkx_instance.has_external_memory_host = vkx_instance.host_pointer_alignment > 0
+			&& vkx_instance.host_pointer_alignment <= VKX_HOST_IMPORT_MAX_ALIGNMENT;
+	}
+
+	// The present wait extensions also have features to turn on
+	VkPhysicalDevicePresentWaitFeaturesKHR present_wait_features = {0};
+	present_wait_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+	VkPhysicalDevicePresentIdFeaturesKHR present_id_features = {0};
+	present_id_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+	present_id_features.pNext = &present_wait_features;
+
+	if (has_present_id && has_present_wait) {
+		VkPhysicalDeviceFeatures2 supported_features = {0};
+		supported_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		supported_features.pNext = &present_id_features;
+		vkGetPhysicalDeviceFeatures2(vkx_instance.physical_device, &supported_features);
+
+		if (present_id_features.presentId && present_wait_features.presentWait) {
+			vulkan13_features.pNext = &present_id_features;
+			vkx_instance.has_present_wait = true;
+		}
+	}
+
+	// Only the blend enable and equation are used from the third extended
+	// dynamic state, so it is only turned on if both of those are there
+	VkPhysicalDeviceExtendedDynamicState3FeaturesEXT dynamic_state3_features = {0};
+	dynamic_state3_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+
+	if (has_extended_dynamic_state3) {
+		VkPhysicalDeviceFeatures2 supported_features = {0};
+		supported_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		supported_features.pNext = &dynamic_state3_features;
+		vkGetPhysicalDeviceFeatures2(vkx_instance.physical_device, &supported_features);
+
+		if (dynamic_state3_features.extendedDynamicState3ColorBlendEnable && dynamic_state3_features.extendedDynamicState3ColorBlendEquation) {
+			VkPhysicalDeviceExtendedDynamicState3FeaturesEXT enabled_features = {0};
+			enabled_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+			enabled_features.extendedDynamicState3ColorBlendEnable = VK_TRUE;
+			enabled_features.extendedDynamicState3ColorBlendEquation = VK_TRUE;
+			enabled_features.pNext = vulkan13_features.pNext;
+			dynamic_state3_features = enabled_features;
+			vulkan13_features.pNext = &dynamic_state3_features;
+			vkx_instance.has_extended_dynamic_state3 = true;
+		}
+	}
+
+	// Textures are sampled in shader read only optimal, so host image copies are
+	// only used if they can write to images in that layout
+	VkPhysicalDeviceHostImageCopyFeaturesEXT host_image_copy_features = {0};
+	host_image_copy_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_FEATURES_EXT;
+
+	if (has_host_image_copy) {
+		VkPhysicalDeviceFeatures2 supported_features = {0};
+		supported_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		supported_features.pNext = &host_image_copy_features;
+		vkGetPhysicalDeviceFeatures2(vkx_instance.physical_device, &supported_features);
+
+		VkPhysicalDeviceHostImageCopyPropertiesEXT host_image_copy_properties = {0};
+		host_image_copy_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_PROPERTIES_EXT;
+		VkPhysicalDeviceProperties2 properties = {0};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties.pNext = &host_image_copy_properties;
+		vkGetPhysicalDeviceProperties2(vkx_instance.physical_device, &properties);
+
+		VkImageLayout* copy_dst_layouts = malloc(sizeof(VkImageLayout) * (host_image_copy_properties.copyDstLayoutCount + 1));
+		host_image_copy_properties.pCopyDstLayouts = copy_dst_layouts;
+		host_image_copy_properties.copySrcLayoutCount = 0;
+		vkGetPhysicalDeviceProperties2(vkx_instance.physical_device, &properties);
+
+		bool shader_read_only_layout = false;
+		for (uint32_t i = 0; i < host_image_copy_properties.copyDstLayoutCount; i++) {
+			if (copy_dst_layouts[i] == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+				shader_read_only_layout = true;
+			}
+		}
+		free(copy_dst_layouts);
+
+		if (host_image_copy_features.hostImageCopy && shader_read_only_layout) {
+			host_image_copy_features.pNext = vulkan13_features.pNext;
+			vulkan13_features.pNext = &host_image_copy_features;
+			vkx_instance.has_host_image_copy = true;
+		}
+	}
+
+	// Buffer device address is optional in 1.2, and lets shaders read buffers
+	// through pointers (vertex pulling) as well as finding descriptor buffers
+	{
+		VkPhysicalDeviceVulkan12Features supported_vulkan12_features = {0};
+		supported_vulkan12_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		VkPhysicalDeviceFeatures2 supported_features = {0};
+		supported_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		supported_features.pNext = &supported_vulkan12_features;
+		vkGetPhysicalDeviceFeatures2(vkx_instance.physical_device, &supported_features);
+
+		if (supported_vulkan12_features.bufferDeviceAddress) {
+			vulkan12_features.bufferDeviceAddress = VK_TRUE;
+			vkx_instance.has_buffer_device_address = true;
+		}
+
+		// Half precision arithmetic in shaders, which mobile GPUs do twice as
+		// fast in half the registers
+		if (supported_vulkan12_features.shaderFloat16) {
+			vulkan12_features.shaderFloat16 = VK_TRUE;
+			vkx_instance.has_shader_float16 = true;
+		}
+	}
+
+	// Descriptor buffers are found by their device addresses, so they need
+	// buffer device address as well
+	VkPhysicalDeviceDescriptorBufferFeaturesEXT descriptor_buffer_features = {0};
+	descriptor_buffer_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT;
+
+	if (has_descriptor_buffer) {
+		VkPhysicalDeviceFeatures2 supported_features = {0};
+		supported_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		supported_features.pNext = &descriptor_buffer_features;
+		vkGetPhysicalDeviceFeatures2(vkx_instance.physical_device, &supported_features);
+
+		if (descriptor_buffer_features.descriptorBuffer && vkx_instance.has_buffer_device_address) {
+			VkPhysicalDeviceDescriptorBufferFeaturesEXT enabled_features = {0};
+			enabled_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_FEATURES_EXT;
+			enabled_features.descriptorBuffer = VK_TRUE;
+			enabled_features.pNext = vulkan13_features.pNext;
+			descriptor_buffer_features = enabled_features;
+			vulkan13_features.pNext = &descriptor_buffer_features;
+
+			vkx_instance.descriptor_buffer_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_BUFFER_PROPERTIES_EXT;
+			VkPhysicalDeviceProperties2 properties = {0};
+			properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+			properties.pNext = &vkx_instance.descriptor_buffer_properties;
+			vkGetPhysicalDeviceProperties2(vkx_instance.physical_device, &properties);
+			vkx_instance.descriptor_buffer_properties.pNext = NULL;
+			vkx_instance.has_descriptor_buffer = true;
+		}
+	}
+
+	VkPhysicalDeviceShaderObjectFeaturesEXT shader_object_features = {0};
+	shader_object_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_OBJECT_FEATURES_EXT;
+
+	if (has_shader_object) {
+		VkPhysicalDeviceFeatures2 supported_features = {0};
+		supported_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		supported_features.pNext = &shader_object_features;
+		vkGetPhysicalDeviceFeatures2(vkx_instance.physical_device, &supported_features);
+
+		if (shader_object_features.shaderObject) {
+			shader_object_features.pNext = vulkan13_features.pNext;
+			vulkan13_features.pNext = &shader_object_features;
+			vkx_instance.has_shader_object = true;
+		}
+	}
+
+	VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT swapchain_maintenance1_features = {0};
+	swapchain_maintenance1_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT;
+
+	if (has_swapchain_maintenance1) {
+		VkPhysicalDeviceFeatures2 supported_features = {0};
+		supported_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		supported_features.pNext = &swapchain_maintenance1_features;
+		vkGetPhysicalDeviceFeatures2(vkx_instance.physical_device, &supported_features);
+
+		if (swapchain_maintenance1_features.swapchainMaintenance1) {
+			swapchain_maintenance1_features.pNext = vulkan13_features.pNext;
+			vulkan13_features.pNext = &swapchain_maintenance1_features;
+			vkx_instance.has_swapchain_maintenance1 = true;
+		}
+	}
+
+	// Libraries are only worth it if linking them is quick
+	VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT pipeline_library_features = {0};
+	pipeline_library_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+
+	if (has_pipeline_library && has_graphics_pipeline_library) {
+		VkPhysicalDeviceFeatures2 supported_features = {0};
+		supported_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		supported_features.pNext = &pipeline_library_features;
+		vkGetPhysicalDeviceFeatures2(vkx_instance.physical_device, &supported_features);
+
+		VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT pipeline_library_properties = {0};
+		pipeline_library_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT;
+		VkPhysicalDeviceProperties2 properties = {0};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties.pNext = &pipeline_library_properties;
+		vkGetPhysicalDeviceProperties2(vkx_instance.physical_device, &properties);
+
+		if (pipeline_library_features.graphicsPipelineLibrary && pipeline_library_properties.graphicsPipelineLibraryFastLinking) {
+			pipeline_library_features.pNext = vulkan13_features.pNext;
+			vulkan13_features.pNext = &pipeline_library_features;
+			vkx_instance.has_graphics_pipeline_library = true;
+		}
+	}
+
+	// Only the task and mesh stages themselves (and multiview with them), none
+	// of the queries or shading rates
+	VkPhysicalDeviceMeshShaderFeaturesEXT mesh_shader_features = {0};
+	mesh_shader_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+
+	if (has_mesh_shader) {
+		VkPhysicalDeviceFeatures2 supported_features = {0};
+		supported_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		supported_features.pNext = &mesh_shader_features;
+		vkGetPhysicalDeviceFeatures2(vkx_instance.physical_device, &supported_features);
+
+		if (mesh_shader_features.taskShader && mesh_shader_features.meshShader) {
+			VkPhysicalDeviceMeshShaderFeaturesEXT enabled_features = {0};
+			enabled_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+			enabled_features.taskShader = VK_TRUE;
+			enabled_features.meshShader = VK_TRUE;
+			enabled_features.multiviewMeshShader = mesh_shader_features.multiviewMeshShader;
+			enabled_features.pNext = vulkan13_features.pNext;
+			mesh_shader_features = enabled_features;
+			vulkan13_features.pNext = &mesh_shader_features;
+			vkx_instance.has_mesh_shader = true;
+			vkx_instance.has_multiview_mesh_shader = mesh_shader_features.multiviewMeshShader == VK_TRUE;
+		}
+	}
+
+	// The rate set per draw, and from an image if there's that too, not the
+	// one written by the shaders per primitive
+	VkPhysicalDeviceFragmentShadingRateFeaturesKHR shading_rate_features = {0};
+	shading_rate_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_FEATURES_KHR;
+
+	if (has_fragment_shading_rate) {
+		VkPhysicalDeviceFeatures2 supported_features = {0};
+		supported_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		supported_features.pNext = &shading_rate_features;
+		vkGetPhysicalDeviceFeatures2(vkx_instance.physical_device, &supported_features);
+
+		VkPhysicalDeviceFragmentShadingRatePropertiesKHR shading_rate_properties = {0};
+		shading_rate_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_PROPERTIES_KHR;
+		VkPhysicalDeviceProperties2 properties = {0};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties.pNext = &shading_rate_properties;
+		vkGetPhysicalDeviceProperties2(vkx_instance.physical_device, &properties);
+
+		if (shading_rate_features.pipelineFragmentShadingRate) {
+			VkPhysicalDeviceFragmentShadingRateFeaturesKHR enabled_features = {0};
+			enabled_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FRAGMENT_SHADING_RATE_FEATURES_KHR;
+			enabled_features.pipelineFragmentShadingRate = VK_TRUE;
+			enabled_features.attachmentFragmentShadingRate = shading_rate_features.attachmentFragmentShadingRate;
+			enabled_features.pNext = vulkan13_features.pNext;
+			shading_rate_features = enabled_features;
+			vulkan13_features.pNext = &shading_rate_features;
+			vkx_instance.has_fragment_shading_rate = true;
+			vkx_instance.has_shading_rate_attachment = shading_rate_features.attachmentFragmentShadingRate == VK_TRUE;
+			vkx_instance.shading_rate_texel_min = shading_rate_properties.minFragmentShadingRateAttachmentTexelSize;
+			vkx_instance.shading_rate_texel_max = shading_rate_properties.maxFragmentShadingRateAttachmentTexelSize;
+		}
+	}
+
+	VkPhysicalDeviceDynamicRenderingLocalReadFeaturesKHR local_read_features = {0};
+	local_read_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_LOCAL_READ_FEATURES_KHR;
+
+	if (has_local_read) {
+		VkPhysicalDeviceFeatures2 supported_features = {0};
+		supported_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		supported_features.pNext = &local_read_features;
+		vkGetPhysicalDeviceFeatures2(vkx_instance.physical_device, &supported_features);
+
+		if (local_read_features.dynamicRenderingLocalRead) {
+			local_read_features.pNext = vulkan13_features.pNext;
+			vulkan13_features.pNext = &local_read_features;
+			vkx_instance.has_local_read = true;
+		}
+	}
+
+	create_info.enabledExtensionCount = enabled_extensions_count;
+	create_info.ppEnabledExtensionNames = enabled_extensions;
 
 	create_info.pNext = &features2;
 
@@ -347,7 +1174,7 @@ void vkx_init(SDL_Window* window) {
 		create_info.enabledLayerCount = 0;
 	}
 
-	if (vkCreateDevice(vkx_instance.physical_device, &create_info, NULL, &vkx_instance.device) != VK_SUCCESS) {
+	if (vkCreateDevice(vkx_instance.physical_device, &create_info, vkx_get_allocator(VK_OBJECT_TYPE_DEVICE), &vkx_instance.device) != VK_SUCCESS) {
 		fprintf(stderr, "failed to create logical device!\n");
 		exit(1);
 	}
@@ -355,48 +1182,152 @@ void vkx_init(SDL_Window* window) {
 	free(queue_create_infos);
 
 	vkGetDeviceQueue(vkx_instance.device, physical_indices.graphics_family, 0, &vkx_instance.graphics_queue);
-	vkGetDeviceQueue(vkx_instance.device, physical_indices.present_family, 0, &vkx_instance.present_queue);
+	vkGetDeviceQueue(vkx_instance.device, physical_indices.present_family, physical_indices.present_queue_index, &vkx_instance.present_queue);
+	vkGetDeviceQueue(vkx_instance.device, vkx_instance.transfer_queue_family, 0, &vkx_instance.transfer_queue);
+	if (physical_indices.has_compute_family) {
+		vkGetDeviceQueue(vkx_instance.device, physical_indices.compute_family, physical_indices.compute_queue_index, &vkx_instance.compute_queue);
+	}
+	else {
+		vkx_instance.compute_queue = vkx_instance.graphics_queue;
+	}
+	vkx_instance.has_separate_present_queue = vkx_instance.present_queue != vkx_instance.graphics_queue
+			&& vkx_instance.present_queue != vkx_instance.transfer_queue && vkx_instance.present_queue != vkx_instance.compute_queue;
+
+	// ----- Load the debug names and labels -----
+	vkx_debug_init();
+	vkx_set_object_name(VK_OBJECT_TYPE_QUEUE, (uint64_t) (uintptr_t) vkx_instance.transfer_queue, "transfer queue");
+	vkx_set_object_name(VK_OBJECT_TYPE_QUEUE, (uint64_t) (uintptr_t) vkx_instance.compute_queue, "compute queue");
+	vkx_set_object_name(VK_OBJECT_TYPE_QUEUE, (uint64_t) (uintptr_t) vkx_instance.present_queue, "present queue");
+	// (after the others, in case they're the same queue)
+	vkx_set_object_name(VK_OBJECT_TYPE_QUEUE, (uint64_t) (uintptr_t) vkx_instance.graphics_queue, "graphics queue");
+
+	// ----- Set up the memory allocator -----
+	vkx_memory_init();
 
 	// ----- Create the command pool -----
+	// Only for one-time command buffers, which are freed again straight away,
+	// so none of them are ever reset
 	VkCommandPoolCreateInfo command_pool_info = {0};
 	command_pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	command_pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	command_pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
 	command_pool_info.queueFamilyIndex = physical_indices.graphics_family;
 
-	if (vkCreateCommandPool(vkx_instance.device, &command_pool_info, NULL, &vkx_instance.command_pool) != VK_SUCCESS) {
+	if (vkCreateCommandPool(vkx_instance.device, &command_pool_info, vkx_get_allocator(VK_OBJECT_TYPE_COMMAND_POOL), &vkx_instance.command_pool) != VK_SUCCESS) {
 		fprintf(stderr, "failed to create command pool!\n");
 		exit(1);
 	}
 
-	// ----- Create the command buffers -----
-	vkx_instance.command_buffers_count = VKX_FRAMES_IN_FLIGHT;
-
+	// ----- Create the frames in flight -----
 	VkCommandBufferAllocateInfo buf_alloc_info = {0};
 	buf_alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	buf_alloc_info.commandPool = vkx_instance.command_pool;
 	buf_alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	buf_alloc_info.commandBufferCount = vkx_instance.command_buffers_count;
+	buf_alloc_info.commandBufferCount = 1;
+
+	VkSemaphoreCreateInfo semaphore_info = {0};
+	semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	// Signalled so the first wait on each frame doesn't block
+	VkFenceCreateInfo fence_info = {0};
+	fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+	for (uint32_t i = 0; i < vkx_instance.frames_in_flight; i++) {
+		// Each frame's pool is reset as a whole, and its buffers are
+		// re-recorded every frame
+		if (vkCreateCommandPool(vkx_instance.device, &command_pool_info, vkx_get_allocator(VK_OBJECT_TYPE_COMMAND_POOL), &vkx_frames[i].command_pool) != VK_SUCCESS) {
+			fprintf(stderr, "failed to create command pool for a frame!\n");
+			exit(1);
+		}
 
-	if (vkAllocateCommandBuffers(vkx_instance.device, &buf_alloc_info, vkx_instance.command_buffers) != VK_SUCCESS) {
-		fprintf(stderr, "failed to allocate command buffers!\n");
+		buf_alloc_info.commandPool = vkx_frames[i].command_pool;
+		if (vkAllocateCommandBuffers(vkx_instance.device, &buf_alloc_info, &vkx_frames[i].command_buffer) != VK_SUCCESS) {
+			fprintf(stderr, "failed to allocate command buffers!\n");
+			exit(1);
+		}
+
+		if (vkCreateSemaphore(vkx_instance.device, &semaphore_info, vkx_get_allocator(VK_OBJECT_TYPE_SEMAPHORE), &vkx_frames[i].image_available_semaphore) != VK_SUCCESS) {
+			fprintf(stderr, "failed to create semaphores for a frame!\n");
+			exit(1);
+		}
+
+		if (vkCreateFence(vkx_instance.device, &fence_info, vkx_get_allocator(VK_OBJECT_TYPE_FENCE), &vkx_frames[i].in_flight_fence) != VK_SUCCESS) {
+			fprintf(stderr, "failed to create synchronization objects for a frame!\n");
+			exit(1);
+		}
+		vkx_frames[i].timeline_value = 0;
+
+		char name[32];
+		snprintf(name, sizeof(name), "frame %u", i);
+		vkx_set_object_name(VK_OBJECT_TYPE_COMMAND_BUFFER, (uint64_t) (uintptr_t) vkx_frames[i].command_buffer, name);
+
+		if (vkx_instance.has_async_compute) {
+			vkx_create_async_compute_frame(&vkx_frames[i], &buf_alloc_info);
+		}
+	}
+
+	// Starts at 0, so the first frame signals 1
+	VkSemaphoreTypeCreateInfo timeline_type_info = {0};
+	timeline_type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	timeline_type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	timeline_type_info.initialValue = 0;
+
+	VkSemaphoreCreateInfo timeline_info = {0};
+	timeline_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	timeline_info.pNext = &timeline_type_info;
+
+	if (vkCreateSemaphore(vkx_instance.device, &timeline_info, vkx_get_allocator(VK_OBJECT_TYPE_SEMAPHORE), &vkx_instance.frame_timeline) != VK_SUCCESS) {
+		fprintf(stderr, "failed to create the frame timeline semaphore!\n");
 		exit(1);
 	}
+	vkx_instance.frame_timeline_value = 1;
+	vkx_set_object_name(VK_OBJECT_TYPE_SEMAPHORE, (uint64_t) vkx_instance.frame_timeline, "frame timeline");
+
+	// ----- Set up the upload manager -----
+	vkx_upload_init();
+	// And the frames' transient descriptor sets
+	vkx_descriptor_ring_init();
 }
 
 void vkx_cleanup_instance() {
 	printf("Cleaning up Vulkan Instance (VKX)\n");
 
-	vkDestroyCommandPool(vkx_instance.device, vkx_instance.command_pool, NULL);
+	// The device is idle by now
+	vkx_flush_deferred_destroys();
+
+	vkx_upload_cleanup();
+	vkx_descriptor_ring_cleanup();
 
-	vkDestroyDevice(vkx_instance.device, NULL);
+	for (uint32_t i = 0; i < vkx_instance.frames_in_flight; i++) {
+		vkDestroySemaphore(vkx_instance.device, vkx_frames[i].image_available_semaphore, vkx_get_allocator(VK_OBJECT_TYPE_SEMAPHORE));
+		vkDestroyFence(vkx_instance.device, vkx_frames[i].in_flight_fence, vkx_get_allocator(VK_OBJECT_TYPE_FENCE));
+		// Frees the frame's command buffer too
+		vkDestroyCommandPool(vkx_instance.device, vkx_frames[i].command_pool, vkx_get_allocator(VK_OBJECT_TYPE_COMMAND_POOL));
+
+		if (vkx_instance.has_async_compute) {
+			vkDestroySemaphore(vkx_instance.device, vkx_frames[i].compute_wait_semaphore, vkx_get_allocator(VK_OBJECT_TYPE_SEMAPHORE));
+			vkDestroySemaphore(vkx_instance.device, vkx_frames[i].compute_finished_semaphore, vkx_get_allocator(VK_OBJECT_TYPE_SEMAPHORE));
+			vkDestroyCommandPool(vkx_instance.device, vkx_frames[i].compute_command_pool, vkx_get_allocator(VK_OBJECT_TYPE_COMMAND_POOL));
+		}
+	}
+	vkDestroySemaphore(vkx_instance.device, vkx_instance.frame_timeline, vkx_get_allocator(VK_OBJECT_TYPE_SEMAPHORE));
+
+	vkDestroyCommandPool(vkx_instance.device, vkx_instance.command_pool, vkx_get_allocator(VK_OBJECT_TYPE_COMMAND_POOL));
+
+	vkx_memory_cleanup();
+
+	vkDestroyDevice(vkx_instance.device, vkx_get_allocator(VK_OBJECT_TYPE_DEVICE));
 
 	if (enable_validation_layers) {
 		PFN_vkDestroyDebugUtilsMessengerEXT func = (PFN_vkDestroyDebugUtilsMessengerEXT) vkGetInstanceProcAddr(vkx_instance.instance, "vkDestroyDebugUtilsMessengerEXT");
 		if (func != NULL) {
-			func(vkx_instance.instance, vkx_instance.debug_messenger, NULL);
+			func(vkx_instance.instance, vkx_instance.debug_messenger, vkx_get_allocator(VK_OBJECT_TYPE_DEBUG_UTILS_MESSENGER_EXT));
 		}
 	}
 
-	vkDestroySurfaceKHR(vkx_instance.instance, vkx_instance.surface, NULL);
-	vkDestroyInstance(vkx_instance.instance, NULL);
+	if (vkx_instance.surface != VK_NULL_HANDLE) {
+		vkDestroySurfaceKHR(vkx_instance.instance, vkx_instance.surface, vkx_get_allocator(VK_OBJECT_TYPE_SURFACE_KHR));
+	}
+	vkDestroyInstance(vkx_instance.instance, vkx_get_allocator(VK_OBJECT_TYPE_INSTANCE));
+
+	vkx_host_memory_cleanup();
 }
@@ -0,0 +1,264 @@
+/*
+ * KTX2 texture files, for block compressed (BCn/ASTC/ETC2) textures with their
+ * mip chains baked in.
+ *
+ * Only what the texture loader needs is read: the format, the size and where
+ * each level is.  The data format descriptor and key/value data are skipped,
+ * as the Vulkan format says everything about the blocks.  Supercompressed
+ * files (BasisLZ, Zstandard or zlib) aren't supported, since they would need
+ * transcoding or inflating before the upload, so textures should be encoded
+ * straight to a GPU format (e.g. "ktx create --format BC7_SRGB_BLOCK").
+ *
+ * Each texture can have several encodings next to its image (see
+ * vkx_load_ktx2_texture()) and the first one the device can sample is used.
+ *
+ * vkx_ktx2_write_rgba8() writes the uncompressed sRGB files the texture cache
+ * keeps (see vkx_texture_cache.c), with the basic data format descriptor so
+ * other tools can read them too.
+ */
+
+#include "vkx/vkx_ktx2.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vkx/vkx_core.h"
+
+// All of these are uint32 apart from the level index, and little endian
+#define KTX2_HEADER_SIZE 80
+#define KTX2_LEVEL_SIZE 24
+// Total size, block header, and one sample for each of R, G, B and A
+#define KTX2_RGBA8_DFD_SIZE (4 + 24 + 4 * 16)
+
+static const uint8_t KTX2_IDENTIFIER[12] = {
+	0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n'
+};
+
+// Encodings to look for, in order of preference.  BC7 is the best quality on
+// desktop GPUs and ASTC on mobile ones, with ETC2 for what's left
+static const char* const KTX2_VARIANTS[] = {
+	"bc7",
+	"astc",
+	"etc2",
+};
+
+static uint32_t ktx2_read32(const uint8_t* p) {
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static uint64_t ktx2_read64(const uint8_t* p) {
+	uint64_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static void ktx2_write32(uint8_t* p, uint32_t value) {
+	memcpy(p, &value, sizeof(value));
+}
+
+static void ktx2_write64(uint8_t* p, uint64_t value) {
+	memcpy(p, &value, sizeof(value));
+}
+
+bool vkx_ktx2_parse(const char* filename, const void* data, size_t size, VkxKtx2Texture* texture) {
+	/*
+	 * Read the header and level index of a KTX2 file
+	 *
+	 * @param filename Only used for errors
+	 * @param data The whole file
+	 * @param texture Filled in with the offsets of the levels into data
+	 *
+	 * @return false if the file isn't a 2D texture this can upload as is
+	 */
+	const uint8_t* bytes = data;
+	memset(texture, 0, sizeof(VkxKtx2Texture));
+
+	if (size < KTX2_HEADER_SIZE || memcmp(bytes, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0) {
+		fprintf(stderr, "%s isn't a KTX2 file\n", filename);
+		return false;
+	}
+
+	uint32_t format = ktx2_read32(bytes + 12);
+	uint32_t width = ktx2_read32(bytes + 20);
+	uint32_t height = ktx2_read32(bytes + 24);
+	uint32_t depth = ktx2_read32(bytes + 28);
+	uint32_t layers = ktx2_read32(bytes + 32);
+	uint32_t faces = ktx2_read32(bytes + 36);
+	uint32_t levels = ktx2_read32(bytes + 40);
+	uint32_t supercompression = ktx2_read32(bytes + 44);
+
+	if (format == VK_FORMAT_UNDEFINED || supercompression != 0) {
+		fprintf(stderr, "%s is supercompressed, which isn't supported\n", filename);
+		return false;
+	}
+
+	if (width == 0 || height == 0 || depth != 0 || faces != 1) {
+		fprintf(stderr, "%s isn't a 2D texture\n", filename);
+		return false;
+	}
+
+	// 0 means the levels should be generated, which can't be done for block
+	// compressed formats, so it just has the base level
+	if (levels == 0) {
+		levels = 1;
+	}
+
+	if (levels > VKX_KTX2_MAX_LEVELS || levels > vkx_mip_levels_for_extent(width, height)) {
+		fprintf(stderr, "%s has too many mip levels\n", filename);
+		return false;
+	}
+
+	if (size - KTX2_HEADER_SIZE < (size_t) levels * KTX2_LEVEL_SIZE) {
+		fprintf(stderr, "%s has a truncated level index\n", filename);
+		return false;
+	}
+
+	texture->format = (VkFormat) format;
+	texture->width = width;
+	texture->height = height;
+	texture->mip_levels = levels;
+	texture->array_layers = layers > 0 ? layers : 1;
+
+	for (uint32_t i = 0; i < levels; i++) {
+		const uint8_t* level = bytes + KTX2_HEADER_SIZE + i * KTX2_LEVEL_SIZE;
+		uint64_t offset = ktx2_read64(level);
+		uint64_t length = ktx2_read64(level + 8);
+
+		if (offset > size || length > size - offset || length == 0) {
+			fprintf(stderr, "%s has a bad level %d\n", filename, i);
+			return false;
+		}
+
+		texture->level_offsets[i] = offset;
+		texture->level_sizes[i] = length;
+	}
+
+	return true;
+}
+
+bool vkx_ktx2_format_supported(VkFormat format) {
+	/*
+	 * Check the device can upload to and linearly sample optimal images of a
+	 * format.  Block compressed formats are only reported if the matching
+	 * textureCompression feature is there, and vkx_init() enables those
+	 */
+	VkFormatProperties format_properties;
+	vkGetPhysicalDeviceFormatProperties(vkx_instance.physical_device, format, &format_properties);
+
+	VkFormatFeatureFlags required = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT
+		| VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT
+		| VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+
+	return (format_properties.optimalTilingFeatures & required) == required;
+}
+
+bool vkx_load_ktx2_texture(const char* filename, MappedFile* file, VkxKtx2Texture* texture) {
+	/*
+	 * Find a KTX2 encoding of an image the device supports.  For
+	 * "textures/tiles.png" these are "textures/tiles.bc7.ktx2", then
+	 * "textures/tiles.astc.ktx2" and "textures/tiles.etc2.ktx2", from the
+	 * mounted archive or the disk.  Safe to call from the job workers
+	 *
+	 * @param filename The image the texture is for
+	 * @param file Set to the mapping of the KTX2 file, to unmap once the levels
+	 *        have been copied
+	 * @param texture Set to the levels in the mapping
+	 *
+	 * @return false if there isn't a usable encoding, so the image should be
+	 *         loaded instead
+	 */
+	const char* extension = strrchr(filename, '.');
+	size_t stem_length = extension != NULL && strchr(extension, '/') == NULL ? (size_t) (extension - filename) : strlen(filename);
+
+	for (size_t i = 0; i < sizeof(KTX2_VARIANTS) / sizeof(KTX2_VARIANTS[0]); i++) {
+		char path[1024];
+		int length = snprintf(path, sizeof(path), "%.*s.%s.ktx2", (int) stem_length, filename, KTX2_VARIANTS[i]);
+		if (length < 0 || (size_t) length >= sizeof(path) || !asset_exists(path)) {
+			continue;
+		}
+
+		*file = map_file(path);
+		if (vkx_ktx2_parse(path, file->data, file->size, texture) && vkx_ktx2_format_supported(texture->format)) {
+			return true;
+		}
+
+		unmap_file(file);
+	}
+
+	return false;
+}
+
+bool vkx_ktx2_write_rgba8(const char* filename, uint32_t width, uint32_t height, uint32_t mip_levels, const uint8_t* const* levels) {
+	/*
+	 * Save a VK_FORMAT_R8G8B8A8_SRGB texture as a KTX2 file.  Doesn't exit on
+	 * failure, as it's only used for caches
+	 *
+	 * @param levels mip_levels tightly packed levels, the base level first
+	 *
+	 * @return false if the file couldn't be written
+	 */
+	if (mip_levels == 0 || mip_levels > VKX_KTX2_MAX_LEVELS) {
+		return false;
+	}
+
+	size_t level_sizes[VKX_KTX2_MAX_LEVELS];
+	size_t size = KTX2_HEADER_SIZE + (size_t) mip_levels * KTX2_LEVEL_SIZE + KTX2_RGBA8_DFD_SIZE;
+	for (uint32_t level = 0; level < mip_levels; level++) {
+		uint32_t level_width = width >> level > 0 ? width >> level : 1;
+		uint32_t level_height = height >> level > 0 ? height >> level : 1;
+		level_sizes[level] = (size_t) level_width * level_height * 4;
+		size += level_sizes[level];
+	}
+
+	uint8_t* data = calloc(1, size);
+	if (data == NULL) {
+		fprintf(stderr, "Failed to allocate %zu bytes for %s\n", size, filename);
+		return false;
+	}
+
+	uint32_t dfd_offset = KTX2_HEADER_SIZE + mip_levels * KTX2_LEVEL_SIZE;
+	memcpy(data, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+	ktx2_write32(data + 12, VK_FORMAT_R8G8B8A8_SRGB);
+	ktx2_write32(data + 16, 1);
+	ktx2_write32(data + 20, width);
+	ktx2_write32(data + 24, height);
+	ktx2_write32(data + 36, 1);
+	ktx2_write32(data + 40, mip_levels);
+	ktx2_write32(data + 48, dfd_offset);
+	ktx2_write32(data + 52, KTX2_RGBA8_DFD_SIZE);
+
+	// RGBSDA colour model, BT.709 primaries and the sRGB transfer function,
+	// with straight alpha which is always linear
+	uint8_t* dfd = data + dfd_offset;
+	ktx2_write32(dfd, KTX2_RGBA8_DFD_SIZE);
+	ktx2_write32(dfd + 8, 2 | (uint32_t) (KTX2_RGBA8_DFD_SIZE - 4) << 16);
+	dfd[12] = 1;
+	dfd[13] = 1;
+	dfd[14] = 2;
+	dfd[20] = 4;
+	static const uint8_t channels[4] = {0, 1, 2, 15 | 0x10};
+	for (uint32_t i = 0; i < 4; i++) {
+		uint8_t* sample = dfd + 28 + i * 16;
+		ktx2_write32(sample, (i * 8) | 7 << 16 | (uint32_t) channels[i] << 24);
+		ktx2_write32(sample + 12, 255);
+	}
+
+	// The levels go in smallest first
+	size_t offset = size;
+	for (uint32_t level = 0; level < mip_levels; level++) {
+		offset -= level_sizes[level];
+		memcpy(data + offset, levels[level], level_sizes[level]);
+
+		uint8_t* index = data + KTX2_HEADER_SIZE + level * KTX2_LEVEL_SIZE;
+		ktx2_write64(index, offset);
+		ktx2_write64(index + 8, level_sizes[level]);
+		ktx2_write64(index + 16, level_sizes[level]);
+	}
+
+	bool written = write_entire_binary_file(filename, data, size);
+	free(data);
+	return written;
+}
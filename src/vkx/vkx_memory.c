@@ -0,0 +1,814 @@
+/*
+ * Device memory sub-allocator.
+ *
+ * Rather than calling vkAllocateMemory for every buffer and image we allocate
+ * large blocks for each memory type and place resources at offsets inside them.
+ * Each block keeps a list of free ranges sorted by offset - allocation is first
+ * fit and freed ranges are merged with their neighbours.
+ *
+ * Linear resources (buffers) and optimal tiling images are kept in separate
+ * blocks so that we never have to worry about bufferImageGranularity.  Host
+ * visible blocks are mapped once when they are created and stay mapped, as a
+ * VkDeviceMemory can only be mapped once at a time.
+ *
+ * Empty blocks are kept, but streaming textures in and out still leaves holes
+ * which nothing fits in.  vkx_memory_update_defragmentation() deals with that
+ * by emptying one image block at a time: nothing new goes in it, and the owners
+ * of what's there move it into the other blocks over the next few frames (see
+ * vkx_memory_is_moving()), after which the block is freed.
+ *
+ * Host memory imported with VK_EXT_external_memory_host is a dedicated block
+ * too, "mapped" at the host pointer it was imported from.
+ */
+
+#include "vkx/vkx_memory.h"
+
+#include <SDL3/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+	VkDeviceSize offset;
+	VkDeviceSize size;
+} VkxMemoryRange;
+
+typedef struct {
+	VkDeviceMemory memory;
+	VkDeviceSize size;
+	uint32_t memory_type;
+	// Buffers and linear images vs optimal images
+	bool linear;
+	// Contains a single resource which was too big for a normal block
+	bool dedicated;
+	// The host's memory, see vkx_memory_import_host(), which isn't unmapped
+	bool imported;
+	// Start of the block if it is host visible, otherwise NULL
+	uint8_t* mapped;
+	// Free ranges sorted by offset
+	VkxMemoryRange* free_ranges;
+	uint32_t free_ranges_count;
+	uint32_t free_ranges_capacity;
+	// Number of live allocations in the block
+	uint32_t allocations_count;
+	VkDeviceSize used_bytes;
+	// The same by tag
+	uint32_t tag_allocations_count[VKX_MEMORY_TAGS_COUNT];
+	VkDeviceSize tag_used_bytes[VKX_MEMORY_TAGS_COUNT];
+	// Being emptied, so nothing new is allocated from it
+	bool defragmenting;
+	// Frames since something was last freed from it while being emptied
+	uint32_t stalled_frames;
+	// Has something which isn't being moved, so it isn't tried again until
+	// something in it is freed
+	bool unmovable;
+} VkxMemoryBlock;
+
+static VkPhysicalDeviceMemoryProperties memory_properties = {0};
+
+// Blocks are never moved once created so that allocations can refer to them by
+// index.  Freed dedicated blocks leave an empty slot which gets reused
+static VkxMemoryBlock* blocks = NULL;
+static uint32_t blocks_count = 0;
+static uint32_t blocks_capacity = 0;
+
+// The block being emptied, if there is one
+static uint32_t defragment_block = UINT32_MAX;
+
+// Resources can be created from the worker threads
+static SDL_Mutex* memory_mutex = NULL;
+
+static PFN_vkGetMemoryHostPointerPropertiesEXT get_memory_host_pointer_properties_func = NULL;
+
+// What the calling thread's allocations are for
+static _Thread_local VkxMemoryTag current_tag = VKX_MEMORY_TAG_OTHER;
+
+static const char* tag_names[VKX_MEMORY_TAGS_COUNT] = {
+	"other", "textures", "offscreen", "tiles", "sprites", "staging"
+};
+
+static VkDeviceSize vkx_memory_align_up(VkDeviceSize value, VkDeviceSize alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+static void vkx_memory_insert_free_range(VkxMemoryBlock* block, uint32_t index, VkxMemoryRange range) {
+	if (block->free_ranges_count == block->free_ranges_capacity) {
+		block->free_ranges_capacity = block->free_ranges_capacity == 0 ? 16 : block->free_ranges_capacity * 2;
+		block->free_ranges = realloc(block->free_ranges, sizeof(VkxMemoryRange) * block->free_ranges_capacity);
+		if (block->free_ranges == NULL) {
+			fprintf(stderr, "Failed to allocate memory block free list\n");
+			exit(1);
+		}
+	}
+
+	memmove(&block->free_ranges[index + 1], &block->free_ranges[index],
+			sizeof(VkxMemoryRange) * (block->free_ranges_count - index));
+	block->free_ranges[index] = range;
+	block->free_ranges_count++;
+}
+
+static void vkx_memory_remove_free_range(VkxMemoryBlock* block, uint32_t index) {
+	memmove(&block->free_ranges[index], &block->free_ranges[index + 1],
+			sizeof(VkxMemoryRange) * (block->free_ranges_count - index - 1));
+	block->free_ranges_count--;
+}
+
+static uint32_t vkx_memory_add_block(VkDeviceMemory memory, uint32_t memory_type, VkDeviceSize size, bool linear, bool dedicated) {
+	/*
+	 * Put a new block of memory in the array, all free, and return its index
+	 */
+	// Reuse an empty slot if there is one
+	uint32_t index = blocks_count;
+	for (uint32_t i = 0; i < blocks_count; i++) {
+		if (blocks[i].memory == VK_NULL_HANDLE) {
+			index = i;
+			break;
+		}
+	}
+
+	if (index == blocks_count) {
+		if (blocks_count == blocks_capacity) {
+			blocks_capacity = blocks_capacity == 0 ? 16 : blocks_capacity * 2;
+			blocks = realloc(blocks, sizeof(VkxMemoryBlock) * blocks_capacity);
+			if (blocks == NULL) {
+				fprintf(stderr, "Failed to allocate memory block array\n");
+				exit(1);
+			}
+		}
+		blocks_count++;
+	}
+
+	VkxMemoryBlock* block = &blocks[index];
+	memset(block, 0, sizeof(VkxMemoryBlock));
+	block->memory = memory;
+	block->size = size;
+	block->memory_type = memory_type;
+	block->linear = linear;
+	block->dedicated = dedicated;
+
+	VkxMemoryRange whole_block = {0};
+	whole_block.offset = 0;
+	whole_block.size = size;
+	vkx_memory_insert_free_range(block, 0, whole_block);
+
+	return index;
+}
+
+static uint32_t vkx_memory_create_block(uint32_t memory_type, VkDeviceSize size, bool linear, bool dedicated) {
+	/*
+	 * Allocate a new device memory block and return its index
+	 */
+	VkMemoryAllocateInfo alloc_info = {0};
+	alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	alloc_info.allocationSize = size;
+	alloc_info.memoryTypeIndex = memory_type;
+
+	// Buffers in linear blocks can then be given device addresses, which
+	// descriptor buffers are bound by and pulled vertices are read through
+	VkMemoryAllocateFlagsInfo flags_info = {0};
+	flags_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+	flags_info.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+	if (linear && vkx_instance.has_buffer_device_address) {
+		alloc_info.pNext = &flags_info;
+	}
+
+	VkDeviceMemory memory;
+	if (vkAllocateMemory(vkx_instance.device, &alloc_info, vkx_get_allocator(VK_OBJECT_TYPE_DEVICE_MEMORY), &memory) != VK_SUCCESS) {
+		fprintf(stderr, "Failed to allocate %llu byte device memory block (memory type %d)\n",
+				(unsigned long long) size, memory_type);
+		exit(1);
+	}
+
+	uint32_t index = vkx_memory_add_block(memory, memory_type, size, linear, dedicated);
+	VkxMemoryBlock* block = &blocks[index];
+
+	if (memory_properties.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		if (vkMapMemory(vkx_instance.device, memory, 0, VK_WHOLE_SIZE, 0, (void**) &block->mapped) != VK_SUCCESS) {
+			fprintf(stderr, "Failed to map device memory block\n");
+			exit(1);
+		}
+	}
+
+	return index;
+}
+
+static void vkx_memory_destroy_block(VkxMemoryBlock* block) {
+	if (block->mapped != NULL && !block->imported) {
+		vkUnmapMemory(vkx_instance.device, block->memory);
+	}
+	vkFreeMemory(vkx_instance.device, block->memory, vkx_get_allocator(VK_OBJECT_TYPE_DEVICE_MEMORY));
+	free(block->free_ranges);
+
+	memset(block, 0, sizeof(VkxMemoryBlock));
+}
+
+static bool vkx_memory_alloc_from_block(uint32_t block_index, VkDeviceSize size, VkDeviceSize alignment, VkxAllocation* allocation) {
+	/*
+	 * Try to place an allocation in the given block (first fit)
+	 */
+	VkxMemoryBlock* block = &blocks[block_index];
+
+	for (uint32_t i = 0; i < block->free_ranges_count; i++) {
+		VkxMemoryRange range = block->free_ranges[i];
+		VkDeviceSize offset = vkx_memory_align_up(range.offset, alignment);
+		VkDeviceSize end = offset + size;
+
+		if (end > range.offset + range.size) {
+			continue;
+		}
+
+		// The padding before the allocation stays free, as does anything after it
+		vkx_memory_remove_free_range(block, i);
+
+		if (end < range.offset + range.size) {
+			VkxMemoryRange after = {0};
+			after.offset = end;
+			after.size = range.offset + range.size - end;
+			vkx_memory_insert_free_range(block, i, after);
+		}
+		if (offset > range.offset) {
+			VkxMemoryRange before = {0};
+			before.offset = range.offset;
+			before.size = offset - range.offset;
+			vkx_memory_insert_free_range(block, i, before);
+		}
+
+		block->allocations_count++;
+		block->used_bytes += size;
+		block->tag_allocations_count[current_tag]++;
+		block->tag_used_bytes[current_tag] += size;
+
+		allocation->memory = block->memory;
+		allocation->offset = offset;
+		allocation->size = size;
+		allocation->mapped = block->mapped != NULL ? block->mapped + offset : NULL;
+		allocation->block_index = block_index;
+		allocation->tag = current_tag;
+
+		return true;
+	}
+
+	return false;
+}
+
+void vkx_memory_init(void) {
+	/*
+	 * Set up the allocator.  Must be called after the device has been created
+	 */
+	vkGetPhysicalDeviceMemoryProperties(vkx_instance.physical_device, &memory_properties);
+
+	memory_mutex = SDL_CreateMutex();
+	if (memory_mutex == NULL) {
+		fprintf(stderr, "Failed to create memory allocator mutex: %s\n", SDL_GetError());
+		exit(1);
+	}
+
+	// Unified memory means the device local memory the buffers go in can also be
+	// mapped.  Integrated GPUs normally say so in their memory types, but not all
+	// of them do, hence checking the device type as well
+	VkPhysicalDeviceProperties device_properties;
+	vkGetPhysicalDeviceProperties(vkx_instance.physical_device, &device_properties);
+
+	bool all_device_local_mappable = false;
+	for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+		VkMemoryPropertyFlags flags = memory_properties.memoryTypes[i].propertyFlags;
+		if (!(flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
+			continue;
+		}
+		if (!(flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) {
+			all_device_local_mappable = false;
+			break;
+		}
+		all_device_local_mappable = true;
+	}
+
+	bool integrated = device_properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU;
+	bool mappable = vkx_memory_has_type(UINT32_MAX, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+	vkx_instance.unified_memory = mappable && (all_device_local_mappable || integrated);
+	if (vkx_instance.unified_memory) {
+		printf(" Device has unified memory\n");
+	}
+
+	if (vkx_instance.has_external_memory_host) {
+		get_memory_host_pointer_properties_func = (PFN_vkGetMemoryHostPointerPropertiesEXT) vkGetDeviceProcAddr(vkx_instance.device, "vkGetMemoryHostPointerPropertiesEXT");
+		if (get_memory_host_pointer_properties_func == NULL) {
+			fprintf(stderr, "Failed to load vkGetMemoryHostPointerPropertiesEXT\n");
+			exit(1);
+		}
+	}
+}
+
+void vkx_memory_cleanup(void) {
+	/*
+	 * Free all of the device memory blocks.  Any resources still using them must
+	 * already have been destroyed
+	 */
+	for (uint32_t i = 0; i < blocks_count; i++) {
+		if (blocks[i].memory == VK_NULL_HANDLE) {
+			continue;
+		}
+
+		if (blocks[i].allocations_count > 0) {
+			fprintf(stderr, "Warning: memory block %d still has %d allocations at cleanup\n", i, blocks[i].allocations_count);
+		}
+
+		vkx_memory_destroy_block(&blocks[i]);
+	}
+
+	free(blocks);
+	blocks = NULL;
+	blocks_count = 0;
+	blocks_capacity = 0;
+	defragment_block = UINT32_MAX;
+
+	SDL_DestroyMutex(memory_mutex);
+	memory_mutex = NULL;
+}
+
+VkxMemoryTag vkx_memory_set_tag(VkxMemoryTag tag) {
+	/*
+	 * Tag what the calling thread allocates from now on, e.g. around loading
+	 * the textures
+	 *
+	 * @return The tag before, to put back afterwards
+	 */
+	VkxMemoryTag previous = current_tag;
+	current_tag = tag;
+	return previous;
+}
+
+VkxMemoryTag vkx_memory_get_tag(void) {
+	return current_tag;
+}
+
+const char* vkx_memory_get_tag_name(VkxMemoryTag tag) {
+	return tag < VKX_MEMORY_TAGS_COUNT ? tag_names[tag] : "unknown";
+}
+
+VkxAllocation vkx_memory_alloc(VkMemoryRequirements requirements, VkMemoryPropertyFlags properties, bool linear) {
+	/*
+	 * Allocate memory for a resource
+	 *
+	 * @param requirements The memory requirements of the buffer or image
+	 * @param properties The required memory properties
+	 * @param linear True for buffers and linear tiling images, false for optimal tiling images
+	 */
+	uint32_t memory_type = vkx_find_memory_type(requirements.memoryTypeBits, properties);
+
+	VkxAllocation allocation = {0};
+
+	SDL_LockMutex(memory_mutex);
+
+	// Small heaps (i.e. the 256MB host visible device local heap) get smaller blocks
+	uint32_t heap_index = memory_properties.memoryTypes[memory_type].heapIndex;
+	VkDeviceSize block_size = VKX_MEMORY_BLOCK_SIZE;
+	if (block_size > memory_properties.memoryHeaps[heap_index].size / 8) {
+		block_size = memory_properties.memoryHeaps[heap_index].size / 8;
+	}
+
+	if (requirements.size > block_size / 2) {
+		// Too big to share a block
+		uint32_t block_index = vkx_memory_create_block(memory_type, requirements.size, linear, true);
+		vkx_memory_alloc_from_block(block_index, requirements.size, requirements.alignment, &allocation);
+		SDL_UnlockMutex(memory_mutex);
+		return allocation;
+	}
+
+	for (uint32_t i = 0; i < blocks_count; i++) {
+		if (blocks[i].memory == VK_NULL_HANDLE || blocks[i].dedicated || blocks[i].defragmenting
+				|| blocks[i].memory_type != memory_type || blocks[i].linear != linear) {
+			continue;
+		}
+
+		if (vkx_memory_alloc_from_block(i, requirements.size, requirements.alignment, &allocation)) {
+			SDL_UnlockMutex(memory_mutex);
+			return allocation;
+		}
+	}
+
+	// Nothing has room so we need a new block
+	uint32_t block_index = vkx_memory_create_block(memory_type, block_size, linear, false);
+	if (!vkx_memory_alloc_from_block(block_index, requirements.size, requirements.alignment, &allocation)) {
+		fprintf(stderr, "Failed to allocate %llu bytes from a new memory block\n", (unsigned long long) requirements.size);
+		exit(1);
+	}
+
+	SDL_UnlockMutex(memory_mutex);
+
+	return allocation;
+}
+
+bool vkx_memory_import_host(void* pointer, VkDeviceSize size, uint32_t type_filter, VkxAllocation* allocation) {
+	/*
+	 * Import host memory for a buffer with VK_EXT_external_memory_host, so the
+	 * device uses it where it is.  allocation->mapped is the pointer, and the
+	 * memory is given back (but not freed) by vkx_memory_free()
+	 *
+	 * @param pointer, size Both multiples of vkx_instance.host_pointer_alignment
+	 * @param type_filter The buffer's memoryTypeBits
+	 *
+	 * @return false if the device can't import it, e.g. a read only mapping on
+	 *         some drivers
+	 */
+	if (!vkx_instance.has_external_memory_host) {
+		return false;
+	}
+
+	VkMemoryHostPointerPropertiesEXT pointer_properties = {0};
+	pointer_properties.sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT;
+	if (get_memory_host_pointer_properties_func(vkx_instance.device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+			pointer, &pointer_properties) != VK_SUCCESS) {
+		return false;
+	}
+	type_filter &= pointer_properties.memoryTypeBits;
+	if (!vkx_memory_has_type(type_filter, 0)) {
+		return false;
+	}
+	uint32_t memory_type = vkx_find_memory_type(type_filter, 0);
+
+	VkImportMemoryHostPointerInfoEXT import_info = {0};
+	import_info.sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT;
+	import_info.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+	import_info.pHostPointer = pointer;
+
+	VkMemoryAllocateInfo alloc_info = {0};
+	alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	alloc_info.pNext = &import_info;
+	alloc_info.allocationSize = size;
+	alloc_info.memoryTypeIndex = memory_type;
+
+	// Like the linear blocks, so the buffer can have a device address
+	VkMemoryAllocateFlagsInfo flags_info = {0};
+	flags_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+	flags_info.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+	if (vkx_instance.has_buffer_device_address) {
+		import_info.pNext = &flags_info;
+	}
+
+	VkDeviceMemory memory;
+	if (vkAllocateMemory(vkx_instance.device, &alloc_info, vkx_get_allocator(VK_OBJECT_TYPE_DEVICE_MEMORY), &memory) != VK_SUCCESS) {
+		return false;
+	}
+
+	SDL_LockMutex(memory_mutex);
+	uint32_t block_index = vkx_memory_add_block(memory, memory_type, size, true, true);
+	blocks[block_index].imported = true;
+	blocks[block_index].mapped = pointer;
+	vkx_memory_alloc_from_block(block_index, size, 1, allocation);
+	SDL_UnlockMutex(memory_mutex);
+
+	return true;
+}
+
+void vkx_memory_free(VkxAllocation* allocation) {
+	/*
+	 * Return an allocation to its block.  Empty blocks are kept around for reuse,
+	 * except for dedicated blocks which are freed straight away
+	 */
+	if (allocation->memory == VK_NULL_HANDLE) {
+		return;
+	}
+
+	SDL_LockMutex(memory_mutex);
+
+	VkxMemoryBlock* block = &blocks[allocation->block_index];
+
+	block->allocations_count--;
+	block->used_bytes -= allocation->size;
+	block->tag_allocations_count[allocation->tag]--;
+	block->tag_used_bytes[allocation->tag] -= allocation->size;
+	block->stalled_frames = 0;
+	block->unmovable = false;
+
+	if (block->dedicated) {
+		vkx_memory_destroy_block(block);
+	}
+	else {
+		// Find where the range goes to keep the list sorted
+		uint32_t index = 0;
+		while (index < block->free_ranges_count && block->free_ranges[index].offset < allocation->offset) {
+			index++;
+		}
+
+		VkxMemoryRange range = {0};
+		range.offset = allocation->offset;
+		range.size = allocation->size;
+		vkx_memory_insert_free_range(block, index, range);
+
+		// Merge with the next range
+		if (index + 1 < block->free_ranges_count
+				&& block->free_ranges[index].offset + block->free_ranges[index].size == block->free_ranges[index + 1].offset) {
+			block->free_ranges[index].size += block->free_ranges[index + 1].size;
+			vkx_memory_remove_free_range(block, index + 1);
+		}
+
+		// Merge with the previous range
+		if (index > 0
+				&& block->free_ranges[index - 1].offset + block->free_ranges[index - 1].size == block->free_ranges[index].offset) {
+			block->free_ranges[index - 1].size += block->free_ranges[index].size;
+			vkx_memory_remove_free_range(block, index);
+		}
+
+		if (block->defragmenting && block->allocations_count == 0) {
+			printf("Freeing memory block %d after defragmenting it\n", allocation->block_index);
+			vkx_memory_destroy_block(block);
+			defragment_block = UINT32_MAX;
+		}
+	}
+
+	SDL_UnlockMutex(memory_mutex);
+
+	memset(allocation, 0, sizeof(VkxAllocation));
+}
+
+void vkx_memory_update_defragmentation(void) {
+	/*
+	 * Call once per frame to keep the image blocks from fragmenting.  If a
+	 * heap's free space is more than VKX_MEMORY_DEFRAG_FRAGMENTATION fragmented
+	 * then its emptiest image block which is less than VKX_MEMORY_DEFRAG_MAX_USAGE
+	 * full, and whose contents fit in the free space of the other blocks of the
+	 * same memory type, starts being emptied.  One which doesn't get any
+	 * emptier for VKX_MEMORY_DEFRAG_STALL_FRAMES is given up on.  Buffer blocks
+	 * are left alone, as a moved buffer would need its device addresses
+	 * rewriting wherever they have been put
+	 */
+	SDL_LockMutex(memory_mutex);
+	if (defragment_block != UINT32_MAX) {
+		VkxMemoryBlock* block = &blocks[defragment_block];
+		if (++block->stalled_frames >= VKX_MEMORY_DEFRAG_STALL_FRAMES) {
+			block->defragmenting = false;
+			block->unmovable = true;
+			defragment_block = UINT32_MAX;
+		}
+		SDL_UnlockMutex(memory_mutex);
+		return;
+	}
+	SDL_UnlockMutex(memory_mutex);
+
+	// The stats take the lock themselves
+	bool fragmented[VK_MAX_MEMORY_HEAPS] = {0};
+	bool any_fragmented = false;
+	for (uint32_t i = 0; i < memory_properties.memoryHeapCount; i++) {
+		fragmented[i] = vkx_memory_get_heap_stats(i).fragmentation > VKX_MEMORY_DEFRAG_FRAGMENTATION;
+		any_fragmented = any_fragmented || fragmented[i];
+	}
+	if (!any_fragmented) {
+		return;
+	}
+
+	SDL_LockMutex(memory_mutex);
+	uint32_t emptiest = UINT32_MAX;
+	for (uint32_t i = 0; i < blocks_count; i++) {
+		const VkxMemoryBlock* block = &blocks[i];
+		bool candidate = block->memory != VK_NULL_HANDLE && !block->dedicated && !block->linear && !block->unmovable
+			&& block->allocations_count > 0
+			&& fragmented[memory_properties.memoryTypes[block->memory_type].heapIndex]
+			&& block->used_bytes < (VkDeviceSize) (block->size * VKX_MEMORY_DEFRAG_MAX_USAGE);
+
+		if (!candidate || (emptiest != UINT32_MAX && block->used_bytes >= blocks[emptiest].used_bytes)) {
+			continue;
+		}
+
+		// Moving it mustn't just need another block
+		VkDeviceSize room = 0;
+		for (uint32_t j = 0; j < blocks_count; j++) {
+			if (j != i && blocks[j].memory != VK_NULL_HANDLE && !blocks[j].dedicated
+					&& blocks[j].memory_type == block->memory_type && !blocks[j].linear) {
+				room += blocks[j].size - blocks[j].used_bytes;
+			}
+		}
+		if (room >= block->used_bytes) {
+			emptiest = i;
+		}
+	}
+
+	if (emptiest != UINT32_MAX) {
+		blocks[emptiest].defragmenting = true;
+		blocks[emptiest].stalled_frames = 0;
+		defragment_block = emptiest;
+	}
+	SDL_UnlockMutex(memory_mutex);
+}
+
+bool vkx_memory_is_moving(const VkxAllocation* allocation) {
+	/*
+	 * Check if an allocation is in a block being emptied, in which case its
+	 * owner should put the resource somewhere else and free it
+	 */
+	if (allocation->memory == VK_NULL_HANDLE) {
+		return false;
+	}
+
+	SDL_LockMutex(memory_mutex);
+	bool moving = blocks[allocation->block_index].defragmenting;
+	SDL_UnlockMutex(memory_mutex);
+
+	return moving;
+}
+
+bool vkx_memory_has_type(uint32_t type_filter, VkMemoryPropertyFlags properties) {
+	/*
+	 * Check if there is a memory type with the properties, e.g. to see if the
+	 * device has lazily allocated memory before asking for it
+	 *
+	 * @param type_filter The memoryTypeBits of the resource's requirements
+	 */
+	for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+		if ((type_filter & (1 << i))
+				&& (memory_properties.memoryTypes[i].propertyFlags & properties) == properties) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool vkx_memory_has_mapped_device_local(VkDeviceSize size) {
+	/*
+	 * Check if size bytes of host visible device local memory can be had, from a
+	 * resizable BAR or on a unified memory device.  Without a resizable BAR the
+	 * heap is only 256MB, so this leaves at least three quarters of it alone
+	 */
+	VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+		| VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+		| VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+	if (!vkx_memory_has_type(UINT32_MAX, properties)) {
+		return false;
+	}
+
+	uint32_t heap_index = vkx_memory_get_type_heap(UINT32_MAX, properties);
+	return size <= memory_properties.memoryHeaps[heap_index].size / 4 && size <= vkx_memory_get_available(heap_index);
+}
+
+uint32_t vkx_memory_get_type_heap(uint32_t type_filter, VkMemoryPropertyFlags properties) {
+	/*
+	 * Get the heap that an allocation with these requirements would come from
+	 */
+	uint32_t memory_type = vkx_find_memory_type(type_filter, properties);
+	return memory_properties.memoryTypes[memory_type].heapIndex;
+}
+
+VkDeviceSize vkx_memory_get_available(uint32_t heap_index) {
+	/*
+	 * Estimate how much more can be allocated from a heap.  With
+	 * VK_EXT_memory_budget this is the budget the driver gives us (which takes
+	 * other processes into account) less what we are using, otherwise it is only
+	 * the size of the heap less the blocks we have allocated
+	 */
+	if (heap_index >= memory_properties.memoryHeapCount) {
+		return 0;
+	}
+
+	VkxMemoryHeapStats stats = vkx_memory_get_heap_stats(heap_index);
+	return stats.budget_bytes > stats.usage_bytes ? stats.budget_bytes - stats.usage_bytes : 0;
+}
+
+uint32_t vkx_memory_get_heaps_count(void) {
+	return memory_properties.memoryHeapCount;
+}
+
+VkxMemoryHeapStats vkx_memory_get_heap_stats(uint32_t heap_index) {
+	/*
+	 * Get the usage statistics for a single memory heap
+	 *
+	 * @param heap_index The index of the heap (less than vkx_memory_get_heaps_count())
+	 */
+	VkxMemoryHeapStats stats = {0};
+
+	if (heap_index >= memory_properties.memoryHeapCount) {
+		return stats;
+	}
+
+	stats.heap_size = memory_properties.memoryHeaps[heap_index].size;
+	stats.device_local = (memory_properties.memoryHeaps[heap_index].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+
+	SDL_LockMutex(memory_mutex);
+	for (uint32_t i = 0; i < blocks_count; i++) {
+		if (blocks[i].memory == VK_NULL_HANDLE
+				|| memory_properties.memoryTypes[blocks[i].memory_type].heapIndex != heap_index) {
+			continue;
+		}
+
+		stats.blocks_count++;
+		stats.allocations_count += blocks[i].allocations_count;
+		stats.allocated_bytes += blocks[i].size;
+		stats.used_bytes += blocks[i].used_bytes;
+		for (uint32_t tag = 0; tag < VKX_MEMORY_TAGS_COUNT; tag++) {
+			stats.tag_allocations_count[tag] += blocks[i].tag_allocations_count[tag];
+			stats.tag_used_bytes[tag] += blocks[i].tag_used_bytes[tag];
+		}
+
+		// Dedicated blocks are only ever as big as what's in them
+		if (blocks[i].dedicated) {
+			continue;
+		}
+		for (uint32_t j = 0; j < blocks[i].free_ranges_count; j++) {
+			VkDeviceSize size = blocks[i].free_ranges[j].size;
+			stats.free_bytes += size;
+			if (size > stats.largest_free_bytes) {
+				stats.largest_free_bytes = size;
+			}
+		}
+	}
+	SDL_UnlockMutex(memory_mutex);
+
+	if (stats.free_bytes > 0) {
+		stats.fragmentation = 1.0f - (float) ((double) stats.largest_free_bytes / (double) stats.free_bytes);
+	}
+
+	stats.budget_bytes = stats.heap_size;
+	stats.usage_bytes = stats.allocated_bytes;
+	if (vkx_instance.has_memory_budget) {
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_properties = {0};
+		budget_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+		VkPhysicalDeviceMemoryProperties2 properties2 = {0};
+		properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+		properties2.pNext = &budget_properties;
+		vkGetPhysicalDeviceMemoryProperties2(vkx_instance.physical_device, &properties2);
+
+		stats.budget_bytes = budget_properties.heapBudget[heap_index];
+		stats.usage_bytes = budget_properties.heapUsage[heap_index];
+	}
+
+	return stats;
+}
+
+void vkx_memory_print_stats(void) {
+	printf("Device memory usage:\n");
+
+	for (uint32_t i = 0; i < memory_properties.memoryHeapCount; i++) {
+		VkxMemoryHeapStats stats = vkx_memory_get_heap_stats(i);
+
+		printf(" Heap %d (%s, %.1f MB): %d blocks, %d allocations, %.2f / %.2f MB used, %.0f%% fragmented, %.1f of %.1f MB budget\n",
+				i,
+				stats.device_local ? "device local" : "host",
+				stats.heap_size / (1024.0 * 1024.0),
+				stats.blocks_count,
+				stats.allocations_count,
+				stats.used_bytes / (1024.0 * 1024.0),
+				stats.allocated_bytes / (1024.0 * 1024.0),
+				stats.fragmentation * 100.0f,
+				stats.usage_bytes / (1024.0 * 1024.0),
+				stats.budget_bytes / (1024.0 * 1024.0));
+
+		for (uint32_t tag = 0; tag < VKX_MEMORY_TAGS_COUNT; tag++) {
+			if (stats.tag_allocations_count[tag] > 0) {
+				printf("  %s: %d allocations, %.2f MB\n",
+						tag_names[tag], stats.tag_allocations_count[tag], stats.tag_used_bytes[tag] / (1024.0 * 1024.0));
+			}
+		}
+	}
+}
+
+bool vkx_memory_write_stats(const char* filename) {
+	/*
+	 * Save the statistics for every heap as JSON, e.g. to compare the memory
+	 * used between builds
+	 *
+	 * @return Whether the file could be written
+	 */
+	FILE* file = fopen(filename, "wb");
+	if (file == NULL) {
+		fprintf(stderr, "Failed to open %s for the memory statistics\n", filename);
+		return false;
+	}
+
+	fprintf(file, "{\"heaps\":[");
+	for (uint32_t i = 0; i < memory_properties.memoryHeapCount; i++) {
+		VkxMemoryHeapStats stats = vkx_memory_get_heap_stats(i);
+
+		fprintf(file, "%s{\"index\":%u,\"device_local\":%s,\"size\":%llu,\"budget\":%llu,\"usage\":%llu,"
+				"\"blocks\":%u,\"allocations\":%u,\"reserved\":%llu,\"used\":%llu,\"free\":%llu,\"largest_free\":%llu,"
+				"\"fragmentation\":%.4f,\"tags\":{",
+				i > 0 ? "," : "",
+				i,
+				stats.device_local ? "true" : "false",
+				(unsigned long long) stats.heap_size,
+				(unsigned long long) stats.budget_bytes,
+				(unsigned long long) stats.usage_bytes,
+				stats.blocks_count,
+				stats.allocations_count,
+				(unsigned long long) stats.allocated_bytes,
+				(unsigned long long) stats.used_bytes,
+				(unsigned long long) stats.free_bytes,
+				(unsigned long long) stats.largest_free_bytes,
+				stats.fragmentation);
+
+		for (uint32_t tag = 0; tag < VKX_MEMORY_TAGS_COUNT; tag++) {
+			fprintf(file, "%s\"%s\":{\"allocations\":%u,\"used\":%llu}",
+					tag > 0 ? "," : "",
+					tag_names[tag],
+					stats.tag_allocations_count[tag],
+					(unsigned long long) stats.tag_used_bytes[tag]);
+		}
+		fprintf(file, "}}");
+	}
+	fprintf(file, "]}\n");
+
+	bool written = ferror(file) == 0;
+	fclose(file);
+	return written;
+}
@@ -0,0 +1,365 @@
+/*
+ * Palette-indexed textures: a byte per pixel, looked up in a row of
+ * VKX_PALETTE_COLOURS colours by the shader.
+ *
+ * vkx_quantise_pixels() picks the colours by median cut.  The pixels are
+ * counted into buckets of VKX_PALETTE_BITS per channel (alpha too, as the
+ * edges of sprites are soft), then the box of buckets with the most pixels
+ * times its widest channel is split at the median of that channel until
+ * there are enough boxes.  Each box's colour is the average of its pixels, and
+ * then each bucket is moved to the nearest of those a few times over (k-means),
+ * which makes up for the boxes' straight edges.  The pixels are given their
+ * bucket's index, so the nearest colour is only searched for once a bucket
+ * rather than once a pixel.  Art which already has few enough colours comes
+ * through unchanged as long as no two of them share a bucket.
+ *
+ * The palette image has a row of colours for each palette, so swapping a
+ * sprite's colours is just picking another row.
+ */
+
+#include "vkx/vkx_palette.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vkx/vkx_memory.h"
+#include "vkx/vkx_upload.h"
+#include "jobs.h"
+
+// Bits of each channel the pixels are bucketed by
+#define VKX_PALETTE_BITS 5
+#define VKX_PALETTE_CHANNEL_MASK ((1u << VKX_PALETTE_BITS) - 1)
+#define VKX_PALETTE_BUCKETS (1u << (VKX_PALETTE_BITS * 4))
+// Pixels given their indices by each job
+#define VKX_PALETTE_JOB_PIXELS (64 * 1024)
+// Times the colours are moved to the nearest average after the cut, and how
+// many colours each job does
+#define VKX_PALETTE_REFINE_PASSES 3
+#define VKX_PALETTE_REFINE_BATCH 256
+
+typedef struct {
+	uint32_t bucket;
+	uint32_t count;
+	// Of the pixels' channels, for the average
+	uint64_t sums[4];
+} VkxPaletteColour;
+
+typedef struct {
+	// Colours [start, end)
+	uint32_t start;
+	uint32_t end;
+	uint64_t count;
+	// The channel with the most distance between its colours, and the distance
+	uint32_t channel;
+	uint32_t range;
+} VkxPaletteBox;
+
+typedef struct {
+	const uint8_t* pixels;
+	uint8_t* indices;
+	size_t count;
+	// Each bucket's index
+	const uint8_t* bucket_indices;
+} VkxPaletteIndexJob;
+
+typedef struct {
+	const VkxPaletteColour* colours;
+	const uint8_t* palette;
+	uint32_t palette_count;
+	uint8_t* colour_indices;
+} VkxPaletteRefineJob;
+
+static uint32_t vkx_palette_bucket(const uint8_t* pixel) {
+	const uint32_t shift = 8 - VKX_PALETTE_BITS;
+	return (uint32_t) (pixel[0] >> shift)
+		| (uint32_t) (pixel[1] >> shift) << VKX_PALETTE_BITS
+		| (uint32_t) (pixel[2] >> shift) << (VKX_PALETTE_BITS * 2)
+		| (uint32_t) (pixel[3] >> shift) << (VKX_PALETTE_BITS * 3);
+}
+
+static uint32_t vkx_palette_channel(uint32_t bucket, uint32_t channel) {
+	return bucket >> (channel * VKX_PALETTE_BITS) & VKX_PALETTE_CHANNEL_MASK;
+}
+
+static void vkx_palette_measure_box(const VkxPaletteColour* colours, VkxPaletteBox* box) {
+	/*
+	 * Count the pixels in a box and find its widest channel
+	 */
+	uint32_t min[4] = {VKX_PALETTE_CHANNEL_MASK, VKX_PALETTE_CHANNEL_MASK, VKX_PALETTE_CHANNEL_MASK, VKX_PALETTE_CHANNEL_MASK};
+	uint32_t max[4] = {0};
+	box->count = 0;
+	for (uint32_t i = box->start; i < box->end; i++) {
+		for (uint32_t c = 0; c < 4; c++) {
+			uint32_t value = vkx_palette_channel(colours[i].bucket, c);
+			min[c] = value < min[c] ? value : min[c];
+			max[c] = value > max[c] ? value : max[c];
+		}
+		box->count += colours[i].count;
+	}
+
+	box->channel = 0;
+	box->range = 0;
+	for (uint32_t c = 0; c < 4; c++) {
+		if (max[c] > min[c] && max[c] - min[c] > box->range) {
+			box->channel = c;
+			box->range = max[c] - min[c];
+		}
+	}
+}
+
+static uint32_t vkx_palette_split_box(VkxPaletteColour* colours, VkxPaletteColour* scratch, const VkxPaletteBox* box) {
+	/*
+	 * Sort a box's colours along its widest channel, which only has
+	 * 2^VKX_PALETTE_BITS values so a counting sort does it in two passes, and
+	 * find where half of its pixels are on either side
+	 *
+	 * @return The first colour of the second half
+	 */
+	uint32_t offsets[VKX_PALETTE_CHANNEL_MASK + 2] = {0};
+	for (uint32_t i = box->start; i < box->end; i++) {
+		offsets[vkx_palette_channel(colours[i].bucket, box->channel) + 1]++;
+	}
+	for (uint32_t v = 1; v < VKX_PALETTE_CHANNEL_MASK + 2; v++) {
+		offsets[v] += offsets[v - 1];
+	}
+	for (uint32_t i = box->start; i < box->end; i++) {
+		uint32_t value = vkx_palette_channel(colours[i].bucket, box->channel);
+		scratch[offsets[value]++] = colours[i];
+	}
+	memcpy(&colours[box->start], scratch, sizeof(VkxPaletteColour) * (box->end - box->start));
+
+	// Both halves need a colour
+	uint64_t half = box->count / 2;
+	uint64_t below = 0;
+	uint32_t split = box->start + 1;
+	for (uint32_t i = box->start; i < box->end - 1; i++) {
+		below += colours[i].count;
+		split = i + 1;
+		if (below >= half) {
+			break;
+		}
+	}
+	return split;
+}
+
+static void vkx_palette_refine_colours(size_t start, size_t end, void* data) {
+	/*
+	 * Give the colours [start, end) the index of the palette's nearest colour
+	 * to their average.  Index 0 is left for the transparent pixels
+	 */
+	VkxPaletteRefineJob* job = data;
+
+	for (size_t i = start; i < end; i++) {
+		const VkxPaletteColour* colour = &job->colours[i];
+		int32_t average[4];
+		for (uint32_t c = 0; c < 4; c++) {
+			average[c] = (int32_t) ((colour->sums[c] + colour->count / 2) / colour->count);
+		}
+
+		uint32_t nearest = job->colour_indices[i];
+		int32_t nearest_distance = INT32_MAX;
+		for (uint32_t j = 1; j < job->palette_count; j++) {
+			const uint8_t* other = &job->palette[j * 4];
+			int32_t distance = 0;
+			for (uint32_t c = 0; c < 4; c++) {
+				int32_t d = average[c] - other[c];
+				distance += d * d;
+			}
+			if (distance < nearest_distance) {
+				nearest = j;
+				nearest_distance = distance;
+			}
+		}
+		job->colour_indices[i] = (uint8_t) nearest;
+	}
+}
+
+static void vkx_palette_index_pixels(size_t start, size_t end, void* data) {
+	/*
+	 * Look up the indices of the pixels in jobs [start, end)
+	 */
+	const VkxPaletteIndexJob* job = data;
+
+	size_t first = start * VKX_PALETTE_JOB_PIXELS;
+	size_t last = end * VKX_PALETTE_JOB_PIXELS < job->count ? end * VKX_PALETTE_JOB_PIXELS : job->count;
+	for (size_t i = first; i < last; i++) {
+		const uint8_t* pixel = &job->pixels[i * 4];
+		job->indices[i] = pixel[3] != 0 ? job->bucket_indices[vkx_palette_bucket(pixel)] : 0;
+	}
+}
+
+void vkx_quantise_pixels(const uint8_t* pixels, size_t count, uint8_t* indices, uint8_t palette[VKX_PALETTE_COLOURS * 4]) {
+	/*
+	 * Pick a palette for some RGBA8 pixels, and give each of them the index of
+	 * its colour
+	 *
+	 * @param pixels The pixels, e.g. every page of an atlas
+	 * @param count How many there are
+	 * @param indices Set to the index of each pixel.  The fully transparent ones
+	 *                are 0
+	 * @param palette Set to the colours, with 0 being transparent black and any
+	 *                that aren't used the same
+	 */
+	uint32_t* buckets = calloc(VKX_PALETTE_BUCKETS, sizeof(uint32_t));
+	uint8_t* bucket_indices = calloc(VKX_PALETTE_BUCKETS, sizeof(uint8_t));
+	if (buckets == NULL || bucket_indices == NULL) {
+		fprintf(stderr, "Failed to allocate the palette buckets\n");
+		exit(1);
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		const uint8_t* pixel = &pixels[i * 4];
+		if (pixel[3] != 0) {
+			buckets[vkx_palette_bucket(pixel)]++;
+		}
+	}
+
+	uint32_t colours_count = 0;
+	for (uint32_t i = 0; i < VKX_PALETTE_BUCKETS; i++) {
+		colours_count += buckets[i] != 0;
+	}
+	VkxPaletteColour* colours = calloc(colours_count > 0 ? colours_count : 1, sizeof(VkxPaletteColour));
+	VkxPaletteColour* scratch = malloc(sizeof(VkxPaletteColour) * (colours_count > 0 ? colours_count : 1));
+	if (colours == NULL || scratch == NULL) {
+		fprintf(stderr, "Failed to allocate the palette colours\n");
+		exit(1);
+	}
+
+	// Each bucket's count becomes its colour's index while the sums are added up
+	uint32_t next = 0;
+	for (uint32_t i = 0; i < VKX_PALETTE_BUCKETS; i++) {
+		if (buckets[i] != 0) {
+			colours[next].bucket = i;
+			colours[next].count = buckets[i];
+			buckets[i] = next++;
+		}
+	}
+	for (size_t i = 0; i < count; i++) {
+		const uint8_t* pixel = &pixels[i * 4];
+		if (pixel[3] != 0) {
+			VkxPaletteColour* colour = &colours[buckets[vkx_palette_bucket(pixel)]];
+			for (uint32_t c = 0; c < 4; c++) {
+				colour->sums[c] += pixel[c];
+			}
+		}
+	}
+
+	// Index 0 is kept for the transparent pixels
+	VkxPaletteBox boxes[VKX_PALETTE_COLOURS - 1] = {0};
+	uint32_t boxes_count = 0;
+	if (colours_count > 0) {
+		boxes[0].start = 0;
+		boxes[0].end = colours_count;
+		vkx_palette_measure_box(colours, &boxes[0]);
+		boxes_count = 1;
+	}
+	while (boxes_count < VKX_PALETTE_COLOURS - 1) {
+		uint32_t widest = 0;
+		uint64_t widest_score = 0;
+		for (uint32_t i = 0; i < boxes_count; i++) {
+			uint64_t score = boxes[i].count * boxes[i].range;
+			if (score > widest_score) {
+				widest = i;
+				widest_score = score;
+			}
+		}
+		// Every box is a single bucket
+		if (widest_score == 0) {
+			break;
+		}
+
+		VkxPaletteBox* box = &boxes[widest];
+		uint32_t split = vkx_palette_split_box(colours, scratch, box);
+		VkxPaletteBox* other = &boxes[boxes_count++];
+		other->start = split;
+		other->end = box->end;
+		box->end = split;
+		vkx_palette_measure_box(colours, box);
+		vkx_palette_measure_box(colours, other);
+	}
+
+	// Each colour starts in its box, then moves to the nearest of the averages
+	// a few times, which evens out the boxes' edges
+	uint8_t* colour_indices = malloc(colours_count > 0 ? colours_count : 1);
+	if (colour_indices == NULL) {
+		fprintf(stderr, "Failed to allocate the palette colours\n");
+		exit(1);
+	}
+	for (uint32_t i = 0; i < boxes_count; i++) {
+		for (uint32_t j = boxes[i].start; j < boxes[i].end; j++) {
+			colour_indices[j] = (uint8_t) (i + 1);
+		}
+	}
+	for (uint32_t pass = 0; pass <= VKX_PALETTE_REFINE_PASSES; pass++) {
+		uint64_t sums[VKX_PALETTE_COLOURS][4] = {0};
+		uint64_t counts[VKX_PALETTE_COLOURS] = {0};
+		for (uint32_t i = 0; i < colours_count; i++) {
+			for (uint32_t c = 0; c < 4; c++) {
+				sums[colour_indices[i]][c] += colours[i].sums[c];
+			}
+			counts[colour_indices[i]] += colours[i].count;
+		}
+		memset(palette, 0, VKX_PALETTE_COLOURS * 4);
+		for (uint32_t i = 1; i <= boxes_count; i++) {
+			for (uint32_t c = 0; c < 4 && counts[i] > 0; c++) {
+				palette[i * 4 + c] = (uint8_t) ((sums[i][c] + counts[i] / 2) / counts[i]);
+			}
+		}
+		if (pass == VKX_PALETTE_REFINE_PASSES) {
+			break;
+		}
+
+		VkxPaletteRefineJob refine_job = {0};
+		refine_job.colours = colours;
+		refine_job.palette = palette;
+		refine_job.palette_count = boxes_count + 1;
+		refine_job.colour_indices = colour_indices;
+		jobs_parallel_for(colours_count, VKX_PALETTE_REFINE_BATCH, vkx_palette_refine_colours, &refine_job);
+	}
+	for (uint32_t i = 0; i < colours_count; i++) {
+		bucket_indices[colours[i].bucket] = colour_indices[i];
+	}
+	free(colour_indices);
+
+	VkxPaletteIndexJob job = {0};
+	job.pixels = pixels;
+	job.indices = indices;
+	job.count = count;
+	job.bucket_indices = bucket_indices;
+	jobs_parallel_for((count + VKX_PALETTE_JOB_PIXELS - 1) / VKX_PALETTE_JOB_PIXELS, 1, vkx_palette_index_pixels, &job);
+
+	printf("Quantised %u colours to a palette of %u\n", colours_count, boxes_count + 1);
+
+	free(scratch);
+	free(colours);
+	free(bucket_indices);
+	free(buckets);
+}
+
+VkxImage vkx_create_palette_image(const uint8_t* colours, uint32_t rows) {
+	/*
+	 * Create an image of palettes and queue its upload, see
+	 * vkx_upload_images().  It's sampled with texelFetch, so has no mip levels
+	 *
+	 * @param colours rows palettes of VKX_PALETTE_COLOURS RGBA8 sRGB colours,
+	 *                one after another
+	 * @param rows How many palettes there are
+	 */
+	VkxMemoryTag previous_tag = vkx_memory_set_tag(VKX_MEMORY_TAG_TEXTURES);
+	VkxImage image = vkx_create_image(
+		VKX_PALETTE_COLOURS,
+		rows,
+		1,
+		VK_FORMAT_R8G8B8A8_SRGB,
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+	);
+	vkx_memory_set_tag(previous_tag);
+
+	vkx_upload_image(image.image, VKX_PALETTE_COLOURS, rows, 1, colours, (VkDeviceSize) VKX_PALETTE_COLOURS * 4 * rows);
+
+	image.view = vkx_create_image_view(image.image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+	return image;
+}
@@ -3,10 +3,137 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <vulkan/vulkan.h>
+#include <SDL3/SDL.h>
 
 #include "io.h"
 #include "vkx/vkx_core.h"
+#include "vkx/vkx_descriptor_ring.h"
+#include "vkx/vkx_texture_table.h"
+
+// Written at the start of the pipeline cache file.  The Vulkan cache data has
+// its own header with the device and UUID, but not the driver version, and a
+// driver update can make the old data useless (or worse with buggy drivers)
+typedef struct {
+	uint32_t magic;
+	uint32_t vendor_id;
+	uint32_t device_id;
+	uint32_t driver_version;
+	uint8_t pipeline_cache_uuid[VK_UUID_SIZE];
+	uint64_t data_size;
+} VkxPipelineCacheFileHeader;
+
+#define VKX_PIPELINE_CACHE_MAGIC 0x43505856 // "VXPC"
+
+// FNV-1a offset basis
+#define VKX_HASH_START 0xcbf29ce484222325ull
+
+// Shared by all of the pipelines
+static VkPipelineCache pipeline_cache = VK_NULL_HANDLE;
+static const char* pipeline_cache_path = NULL;
+
+// Vertex buffer pipelines leave their cull mode, depth settings and (with
+// VK_EXT_extended_dynamic_state3) blending to the command buffer
+static bool dynamic_render_state = false;
+static PFN_vkCmdSetColorBlendEnableEXT set_color_blend_enable_func = NULL;
+static PFN_vkCmdSetColorBlendEquationEXT set_color_blend_equation_func = NULL;
+// VK_KHR_push_descriptor's command, loaded by the first VkxPushSet
+static PFN_vkCmdPushDescriptorSetWithTemplateKHR push_descriptor_set_with_template_func = NULL;
+// Push sets created keep their descriptors in buffers (where the device has
+// VK_EXT_descriptor_buffer and they only have image and sampler bindings), with
+// the extension's commands
+static bool descriptor_buffers = false;
+static PFN_vkGetDescriptorSetLayoutSizeEXT get_descriptor_set_layout_size_func = NULL;
+static PFN_vkGetDescriptorSetLayoutBindingOffsetEXT get_descriptor_set_layout_binding_offset_func = NULL;
+static PFN_vkGetDescriptorEXT get_descriptor_func = NULL;
+static PFN_vkCmdBindDescriptorBuffersEXT bind_descriptor_buffers_func = NULL;
+static PFN_vkCmdSetDescriptorBufferOffsetsEXT set_descriptor_buffer_offsets_func = NULL;
+// Vertex buffer pipelines are made of shader objects (where the device has
+// VK_EXT_shader_object), with the commands for the state they leave dynamic
+static bool shader_objects = false;
+static PFN_vkCreateShadersEXT create_shaders_func = NULL;
+static PFN_vkDestroyShaderEXT destroy_shader_func = NULL;
+static PFN_vkCmdBindShadersEXT bind_shaders_func = NULL;
+static PFN_vkCmdSetVertexInputEXT set_vertex_input_func = NULL;
+static PFN_vkCmdSetPolygonModeEXT set_polygon_mode_func = NULL;
+static PFN_vkCmdSetRasterizationSamplesEXT set_rasterization_samples_func = NULL;
+static PFN_vkCmdSetSampleMaskEXT set_sample_mask_func = NULL;
+static PFN_vkCmdSetAlphaToCoverageEnableEXT set_alpha_to_coverage_enable_func = NULL;
+static PFN_vkCmdSetColorWriteMaskEXT set_color_write_mask_func = NULL;
+// Otherwise they're linked from VK_EXT_graphics_pipeline_library parts
+static bool pipeline_libraries = false;
+// VK_EXT_mesh_shader's draw, loaded by the first mesh pipeline
+static PFN_vkCmdDrawMeshTasksEXT draw_mesh_tasks_func = NULL;
+// Views they render with multiview, 0 without
+static uint32_t view_mask = 0;
+// Whether the passes they're used in have a depth attachment to test against
+static bool depth_buffer = true;
+// The format of their colour attachment, VK_FORMAT_UNDEFINED for the swap
+// chain's
+static VkFormat color_format = VK_FORMAT_UNDEFINED;
+// And the types of the bindings from 3 on, which only the fragment shaders use
+static VkDescriptorType fragment_binding_types[VKX_MAX_FRAGMENT_BINDINGS];
+static uint32_t fragment_bindings_count = 0;
+// The samples of the attachments they render to, and whether the ones which
+// don't blend turn their alpha into coverage
+static VkSampleCountFlagBits sample_count = VK_SAMPLE_COUNT_1_BIT;
+static bool alpha_to_coverage = false;
+// The ones which blend add their colour instead
+static bool additive_blend = false;
+// Their fragment shading rate is set per draw by vkx_cmd_set_shading_rate()
+// (where the device has VK_KHR_fragment_shading_rate), and whether it can come
+// from the pass's shading rate attachment as well
+static bool shading_rate = false;
+static bool shading_rate_attachment = false;
+static PFN_vkCmdSetFragmentShadingRateKHR set_fragment_shading_rate_func = NULL;
+
+// Shader modules are created once and shared by every pipeline using them.  An
+// entry is found by its path, and files with the same contents share the
+// module of the first one (the other entries don't own it)
+typedef struct {
+	char* path;
+	uint64_t hash;
+	VkShaderModule module;
+	bool owner;
+} VkxShaderModuleEntry;
+
+static VkxShaderModuleEntry shader_modules[VKX_MAX_SHADER_MODULES];
+static uint32_t shader_modules_count = 0;
+
+// The modules of shaders which were reloaded, which pipelines being created
+// on other threads could still be using
+static VkShaderModule* retired_shader_modules = NULL;
+static uint32_t retired_shader_modules_count = 0;
+
+// The parts of the vertex buffer pipelines, which are shared by every
+// pipeline with the same state for that part.  An entry is found by its part
+// and a hash of everything it was created from
+typedef struct {
+	VkGraphicsPipelineLibraryFlagsEXT part;
+	uint64_t hash;
+	VkPipeline library;
+} VkxPipelineLibraryEntry;
+
+static VkxPipelineLibraryEntry pipeline_library_entries[VKX_MAX_PIPELINE_LIBRARIES];
+static uint32_t pipeline_library_entries_count = 0;
+static SDL_Mutex* pipeline_libraries_mutex = NULL;
+
+// Samplers, descriptor set layouts and pipeline layouts, which are created once
+// for each distinct create info and shared by everything asking for one like
+// it.  An entry is found by its type and a hash of the create info's contents,
+// so pipelines with the same sets get the same layout handles
+typedef struct {
+	VkObjectType type;
+	uint64_t hash;
+	uint64_t handle;
+} VkxCachedObject;
+
+static VkxCachedObject cached_objects[VKX_MAX_CACHED_OBJECTS];
+static uint32_t cached_objects_count = 0;
+static SDL_Mutex* cached_objects_mutex = NULL;
+// The pipeline manager loads shaders on its threads as well
+static SDL_Mutex* shader_modules_mutex = NULL;
 
 static VkShaderModule vkx_create_shader_module(const char* code, size_t code_size) {
 	VkShaderModuleCreateInfo create_info = {0};
@@ -15,7 +142,7 @@ static VkShaderModule vkx_create_shader_module(const char* code, size_t code_siz
 	create_info.pCode = (const uint32_t*)code;
 
 	VkShaderModule shader_module;
-	if (vkCreateShaderModule(vkx_instance.device, &create_info, NULL, &shader_module) != VK_SUCCESS) {
+	if (vkCreateShaderModule(vkx_instance.device, &create_info, vkx_get_allocator(VK_OBJECT_TYPE_SHADER_MODULE), &shader_module) != VK_SUCCESS) {
 		fprintf(stderr, "failed to create shader module!");
 		exit(1);
 	}
@@ -23,90 +150,1947 @@ static VkShaderModule vkx_create_shader_module(const char* code, size_t code_siz
 	return shader_module;
 }
 
-VkShaderModule vkx_load_shader_module(const char* path) {
+static uint64_t vkx_hash_bytes(uint64_t hash, const void* data, size_t size) {
+	/*
+	 * Add some bytes to a 64 bit FNV-1a hash, which starts at VKX_HASH_START
+	 */
+	const uint8_t* bytes = data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+static uint64_t vkx_hash_shader_code(const char* code, size_t code_size) {
+	return vkx_hash_bytes(VKX_HASH_START, code, code_size);
+}
+
+static uint64_t vkx_hash_u32(uint64_t hash, uint32_t value) {
+	return vkx_hash_bytes(hash, &value, sizeof(value));
+}
+
+static uint64_t vkx_hash_float(uint64_t hash, float value) {
+	return vkx_hash_bytes(hash, &value, sizeof(value));
+}
+
+static uint64_t vkx_hash_handle(uint64_t hash, const void* handle) {
+	/*
+	 * Add a Vulkan handle, which is a pointer or a 64 bit integer
+	 */
+	uint64_t value = 0;
+	memcpy(&value, handle, sizeof(VkSampler));
+	return vkx_hash_bytes(hash, &value, sizeof(value));
+}
+
+static bool vkx_find_cached_object(VkObjectType type, uint64_t hash, uint64_t* handle) {
+	/*
+	 * Look for an object like one being asked for, with cached_objects_mutex
+	 * held.  Nothing is compared but the hashes
+	 */
+	for (uint32_t i = 0; i < cached_objects_count; i++) {
+		if (cached_objects[i].type == type && cached_objects[i].hash == hash) {
+			*handle = cached_objects[i].handle;
+			return true;
+		}
+	}
+
+	if (cached_objects_count >= VKX_MAX_CACHED_OBJECTS) {
+		fprintf(stderr, "Too many cached samplers and layouts (max %d)\n", VKX_MAX_CACHED_OBJECTS);
+		exit(1);
+	}
+	return false;
+}
+
+static void vkx_add_cached_object(VkObjectType type, uint64_t hash, uint64_t handle) {
+	VkxCachedObject* entry = &cached_objects[cached_objects_count++];
+	entry->type = type;
+	entry->hash = hash;
+	entry->handle = handle;
+}
+
+VkSampler vkx_get_sampler(const VkSamplerCreateInfo* create_info) {
+	/*
+	 * Get a sampler made from a create info, which is created the first time
+	 * and then shared.  The sampler belongs to the cache, so don't destroy it
+	 *
+	 * @param create_info With no pNext chain
+	 */
+	if (create_info->pNext != NULL) {
+		fprintf(stderr, "Samplers with a pNext chain can't be cached\n");
+		exit(1);
+	}
+
+	uint64_t hash = vkx_hash_u32(VKX_HASH_START, create_info->flags);
+	hash = vkx_hash_u32(hash, create_info->magFilter);
+	hash = vkx_hash_u32(hash, create_info->minFilter);
+	hash = vkx_hash_u32(hash, create_info->mipmapMode);
+	hash = vkx_hash_u32(hash, create_info->addressModeU);
+	hash = vkx_hash_u32(hash, create_info->addressModeV);
+	hash = vkx_hash_u32(hash, create_info->addressModeW);
+	hash = vkx_hash_float(hash, create_info->mipLodBias);
+	hash = vkx_hash_u32(hash, create_info->anisotropyEnable);
+	hash = vkx_hash_float(hash, create_info->anisotropyEnable ? create_info->maxAnisotropy : 0.0f);
+	hash = vkx_hash_u32(hash, create_info->compareEnable);
+	hash = vkx_hash_u32(hash, create_info->compareEnable ? create_info->compareOp : 0);
+	hash = vkx_hash_float(hash, create_info->minLod);
+	hash = vkx_hash_float(hash, create_info->maxLod);
+	hash = vkx_hash_u32(hash, create_info->borderColor);
+	hash = vkx_hash_u32(hash, create_info->unnormalizedCoordinates);
+
+	SDL_LockMutex(cached_objects_mutex);
+	uint64_t handle;
+	VkSampler sampler;
+	if (vkx_find_cached_object(VK_OBJECT_TYPE_SAMPLER, hash, &handle)) {
+		memcpy(&sampler, &handle, sizeof(sampler));
+	}
+	else {
+		if (vkCreateSampler(vkx_instance.device, create_info, vkx_get_allocator(VK_OBJECT_TYPE_SAMPLER), &sampler) != VK_SUCCESS) {
+			fprintf(stderr, "failed to create sampler!\n");
+			exit(1);
+		}
+		handle = (uint64_t) sampler;
+		vkx_add_cached_object(VK_OBJECT_TYPE_SAMPLER, hash, handle);
+	}
+	SDL_UnlockMutex(cached_objects_mutex);
+
+	return sampler;
+}
+
+VkDescriptorSetLayout vkx_get_descriptor_set_layout(const VkDescriptorSetLayoutCreateInfo* create_info) {
+	/*
+	 * Get a descriptor set layout made from a create info, which is created the
+	 * first time and then shared.  The layout belongs to the cache, so don't
+	 * destroy it
+	 *
+	 * @param create_info With nothing in its pNext chain but binding flags
+	 */
+	uint64_t hash = vkx_hash_u32(VKX_HASH_START, create_info->flags);
+	for (uint32_t i = 0; i < create_info->bindingCount; i++) {
+		const VkDescriptorSetLayoutBinding* binding = &create_info->pBindings[i];
+		hash = vkx_hash_u32(hash, binding->binding);
+		hash = vkx_hash_u32(hash, binding->descriptorType);
+		hash = vkx_hash_u32(hash, binding->descriptorCount);
+		hash = vkx_hash_u32(hash, binding->stageFlags);
+		bool immutable_samplers = binding->pImmutableSamplers != NULL
+			&& (binding->descriptorType == VK_DESCRIPTOR_TYPE_SAMPLER || binding->descriptorType == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+		for (uint32_t j = 0; immutable_samplers && j < binding->descriptorCount; j++) {
+			hash = vkx_hash_handle(hash, &binding->pImmutableSamplers[j]);
+		}
+	}
+
+	for (const VkBaseInStructure* next = create_info->pNext; next != NULL; next = next->pNext) {
+		if (next->sType != VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO) {
+			fprintf(stderr, "Descriptor set layouts with a pNext chain other than binding flags can't be cached\n");
+			exit(1);
+		}
+		const VkDescriptorSetLayoutBindingFlagsCreateInfo* flags_info = (const VkDescriptorSetLayoutBindingFlagsCreateInfo*) next;
+		hash = vkx_hash_u32(hash, next->sType);
+		for (uint32_t i = 0; i < flags_info->bindingCount; i++) {
+			hash = vkx_hash_u32(hash, flags_info->pBindingFlags[i]);
+		}
+	}
+
+	SDL_LockMutex(cached_objects_mutex);
+	uint64_t handle;
+	VkDescriptorSetLayout layout;
+	if (vkx_find_cached_object(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, hash, &handle)) {
+		memcpy(&layout, &handle, sizeof(layout));
+	}
+	else {
+		if (vkCreateDescriptorSetLayout(vkx_instance.device, create_info, vkx_get_allocator(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT), &layout) != VK_SUCCESS) {
+			fprintf(stderr, "failed to create descriptor set layout!\n");
+			exit(1);
+		}
+		handle = (uint64_t) layout;
+		vkx_add_cached_object(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT, hash, handle);
+	}
+	SDL_UnlockMutex(cached_objects_mutex);
+
+	return layout;
+}
+
+VkPipelineLayout vkx_get_pipeline_layout(const VkPipelineLayoutCreateInfo* create_info) {
 	/*
-	 * Load a shader module from a file
+	 * Get a pipeline layout made from a create info, which is created the first
+	 * time and then shared.  Its set layouts are compared by handle, which the
+	 * ones from vkx_get_descriptor_set_layout() share.  The layout belongs to
+	 * the cache, so don't destroy it
 	 *
-	 * @param path The path to the shader file
+	 * @param create_info With no pNext chain
 	 */
-	size_t code_size;
-	char* code = read_entire_binary_file(path, &code_size);
-	printf(" Read %ld bytes\n", code_size);
+	if (create_info->pNext != NULL) {
+		fprintf(stderr, "Pipeline layouts with a pNext chain can't be cached\n");
+		exit(1);
+	}
+
+	uint64_t hash = vkx_hash_u32(VKX_HASH_START, create_info->flags);
+	hash = vkx_hash_u32(hash, create_info->setLayoutCount);
+	for (uint32_t i = 0; i < create_info->setLayoutCount; i++) {
+		hash = vkx_hash_handle(hash, &create_info->pSetLayouts[i]);
+	}
+	for (uint32_t i = 0; i < create_info->pushConstantRangeCount; i++) {
+		const VkPushConstantRange* range = &create_info->pPushConstantRanges[i];
+		hash = vkx_hash_u32(hash, range->stageFlags);
+		hash = vkx_hash_u32(hash, range->offset);
+		hash = vkx_hash_u32(hash, range->size);
+	}
+
+	SDL_LockMutex(cached_objects_mutex);
+	uint64_t handle;
+	VkPipelineLayout layout;
+	if (vkx_find_cached_object(VK_OBJECT_TYPE_PIPELINE_LAYOUT, hash, &handle)) {
+		memcpy(&layout, &handle, sizeof(layout));
+	}
+	else {
+		if (vkCreatePipelineLayout(vkx_instance.device, create_info, vkx_get_allocator(VK_OBJECT_TYPE_PIPELINE_LAYOUT), &layout) != VK_SUCCESS) {
+			fprintf(stderr, "failed to create pipeline layout!\n");
+			exit(1);
+		}
+		handle = (uint64_t) layout;
+		vkx_add_cached_object(VK_OBJECT_TYPE_PIPELINE_LAYOUT, hash, handle);
+	}
+	SDL_UnlockMutex(cached_objects_mutex);
+
+	return layout;
+}
+
+static VkShaderModule vkx_find_shader_module(uint64_t hash, const char* code, size_t code_size) {
+	/*
+	 * The module of an entry with the same contents, or VK_NULL_HANDLE if
+	 * there isn't one.  The hash only picks the candidates, so the code has to
+	 * be compared with the entry's, which is still embedded or is read again
+	 */
+	for (uint32_t i = 0; i < shader_modules_count; i++) {
+		if (shader_modules[i].hash != hash || !shader_modules[i].owner) {
+			continue;
+		}
+
+		size_t other_size = 0;
+		const char* other = vkx_get_embedded_shader(shader_modules[i].path, &other_size);
+		MappedFile other_file = {0};
+		if (other == NULL) {
+			other_file = map_file(shader_modules[i].path);
+			other = other_file.data;
+			other_size = other_file.size;
+		}
+
+		bool same = other_size == code_size && memcmp(other, code, code_size) == 0;
+		unmap_file(&other_file);
+		if (same) {
+			return shader_modules[i].module;
+		}
+	}
+
+	return VK_NULL_HANDLE;
+}
+
+static const char* vkx_map_shader_code(const char* path, MappedFile* file, size_t* code_size) {
+	/*
+	 * Get a shader's SPIR-V, from the binary if it's embedded, otherwise by
+	 * mapping the file.  The mapping is page aligned, so the code can be used
+	 * straight from it
+	 *
+	 * @param file Set to the mapping, which the caller unmaps when it's done
+	 *             with the code (it's left empty for embedded shaders)
+	 */
+	const char* code = vkx_get_embedded_shader(path, code_size);
+	if (code == NULL) {
+		*file = map_file(path);
+		printf(" Mapped %zu bytes\n", file->size);
+		code = file->data;
+		*code_size = file->size;
+	}
+	return code;
+}
+
+static VkShaderModule vkx_load_hashed_shader_module(const char* path, uint64_t* code_hash) {
+	/*
+	 * vkx_load_shader_module(), which also gives the hash of the code, for
+	 * keys which have to change when the file does
+	 */
+	SDL_LockMutex(shader_modules_mutex);
+
+	for (uint32_t i = 0; i < shader_modules_count; i++) {
+		if (strcmp(shader_modules[i].path, path) == 0) {
+			VkShaderModule shader_module = shader_modules[i].module;
+			*code_hash = shader_modules[i].hash;
+			SDL_UnlockMutex(shader_modules_mutex);
+			return shader_module;
+		}
+	}
+
+	if (shader_modules_count >= VKX_MAX_SHADER_MODULES) {
+		fprintf(stderr, "Too many shader modules (max %d)\n", VKX_MAX_SHADER_MODULES);
+		exit(1);
+	}
+
+	size_t code_size = 0;
+	MappedFile file = {0};
+	const char* code = vkx_map_shader_code(path, &file, &code_size);
+
+	uint64_t hash = vkx_hash_shader_code(code, code_size);
+	VkShaderModule shader_module = vkx_find_shader_module(hash, code, code_size);
+	bool owner = shader_module == VK_NULL_HANDLE;
+	if (owner) {
+		shader_module = vkx_create_shader_module(code, code_size);
+	}
+	unmap_file(&file);
 
-	VkShaderModule shader_module = vkx_create_shader_module(code, code_size);
-	free(code);
+	size_t path_length = strlen(path);
+	VkxShaderModuleEntry* entry = &shader_modules[shader_modules_count++];
+	entry->path = malloc(path_length + 1);
+	memcpy(entry->path, path, path_length + 1);
+	entry->hash = hash;
+	entry->module = shader_module;
+	entry->owner = owner;
+	*code_hash = hash;
+
+	SDL_UnlockMutex(shader_modules_mutex);
 
 	return shader_module;
 }
 
-VkDescriptorSetLayout vkx_create_descriptor_set_layout(uint32_t num_textures) {
+VkShaderModule vkx_load_shader_module(const char* path) {
 	/*
-	 * Create a descriptor set layout for the uniform buffer and texture sampler.
+	 * Get the shader module for a SPIR-V file, which is loaded the first time
+	 * and then shared.  The module belongs to the cache, so don't destroy it
 	 *
-	 * This is made based on the assumption that most pipelines in the app will
-	 * use a similar layout format.
+	 * @param path The path to the shader file.  Shaders embedded in the binary
+	 *             (VKX_EMBEDDED_SHADERS) are used rather than reading the file
+	 */
+	uint64_t code_hash;
+	return vkx_load_hashed_shader_module(path, &code_hash);
+}
+
+void vkx_reload_shader_module(const char* path) {
+	/*
+	 * Forget the module of a SPIR-V file which has changed, so the next
+	 * pipeline made with it loads the file again.  Nothing has to be done if it
+	 * was never loaded.  A pipeline being created with the old module on
+	 * another thread could still be using it, so it's kept until
+	 * vkx_destroy_retired_shader_modules()
+	 */
+	SDL_LockMutex(shader_modules_mutex);
+
+	for (uint32_t i = 0; i < shader_modules_count; i++) {
+		if (strcmp(shader_modules[i].path, path) != 0) {
+			continue;
+		}
+
+		VkxShaderModuleEntry entry = shader_modules[i];
+		shader_modules[i] = shader_modules[--shader_modules_count];
+		free(entry.path);
+		if (!entry.owner) {
+			break;
+		}
+
+		// Another file with the old contents takes the module over
+		uint32_t sharer = 0;
+		while (sharer < shader_modules_count && shader_modules[sharer].module != entry.module) {
+			sharer++;
+		}
+		if (sharer < shader_modules_count) {
+			shader_modules[sharer].owner = true;
+			break;
+		}
+
+		VkShaderModule* retired = realloc(retired_shader_modules, sizeof(VkShaderModule) * (retired_shader_modules_count + 1));
+		if (retired == NULL) {
+			fprintf(stderr, "Failed to allocate retired shader modules\n");
+			exit(1);
+		}
+		retired_shader_modules = retired;
+		retired_shader_modules[retired_shader_modules_count++] = entry.module;
+		break;
+	}
+
+	SDL_UnlockMutex(shader_modules_mutex);
+}
+
+void vkx_destroy_retired_shader_modules(void) {
+	/*
+	 * Destroy the modules which vkx_reload_shader_module() replaced, once no
+	 * pipeline is being created
+	 */
+	SDL_LockMutex(shader_modules_mutex);
+	for (uint32_t i = 0; i < retired_shader_modules_count; i++) {
+		vkDestroyShaderModule(vkx_instance.device, retired_shader_modules[i], vkx_get_allocator(VK_OBJECT_TYPE_SHADER_MODULE));
+	}
+	free(retired_shader_modules);
+	retired_shader_modules = NULL;
+	retired_shader_modules_count = 0;
+	SDL_UnlockMutex(shader_modules_mutex);
+}
+
+const char* vkx_get_embedded_shader(const char* path, size_t* code_size) {
+	/*
+	 * The SPIR-V which compile_shaders.sh wrote to a path, if the build
+	 * embedded it
 	 *
-	 * @param num_textures The number of textures to make room for in the descriptor set layout
+	 * @param path The path of the .spv file
+	 * @param code_size Set to the size of the code in bytes
+	 *
+	 * @return The code, or NULL if it isn't embedded
 	 */
-	// ----- Set up uniform buffer layout -----
-	// We need 2 bindings for the uniform buffer and the texture sampler
-	VkDescriptorSetLayoutBinding layout_bindings[2] = {0};
-	
-	// First binding is for the uniform buffer
-	layout_bindings[0].binding = 0;
-	layout_bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	layout_bindings[0].descriptorCount = 1;
-	layout_bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
-	layout_bindings[0].pImmutableSamplers = NULL;
-
-	// Second binding is for the texture sampler
-	layout_bindings[1].binding = 1;
-	layout_bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	layout_bindings[1].descriptorCount = num_textures;
-	layout_bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-	layout_bindings[1].pImmutableSamplers = NULL;
+#ifdef VKX_EMBEDDED_SHADERS
+	for (uint32_t i = 0; i < vkx_embedded_shaders_count; i++) {
+		if (strcmp(vkx_embedded_shaders[i].path, path) == 0) {
+			*code_size = vkx_embedded_shaders[i].size;
+			return (const char*) vkx_embedded_shaders[i].code;
+		}
+	}
+#else
+	(void) path;
+#endif
+
+	*code_size = 0;
+	return NULL;
+}
+
+static bool vkx_pipeline_cache_data_valid(const char* data, size_t size, const VkPhysicalDeviceProperties* properties) {
+	/*
+	 * Check that the data from a cache file was written by this device and driver
+	 */
+	if (size < sizeof(VkxPipelineCacheFileHeader)) {
+		return false;
+	}
+
+	VkxPipelineCacheFileHeader header;
+	memcpy(&header, data, sizeof(header));
+
+	if (header.magic != VKX_PIPELINE_CACHE_MAGIC
+			|| header.vendor_id != properties->vendorID
+			|| header.device_id != properties->deviceID
+			|| header.driver_version != properties->driverVersion
+			|| memcmp(header.pipeline_cache_uuid, properties->pipelineCacheUUID, VK_UUID_SIZE) != 0
+			|| header.data_size != size - sizeof(header)) {
+		return false;
+	}
+
+	// Check the Vulkan header too (VkPipelineCacheHeaderVersionOne)
+	const size_t vk_header_size = 16 + VK_UUID_SIZE;
+	if (header.data_size < vk_header_size) {
+		return false;
+	}
+
+	uint32_t vk_header[4];
+	memcpy(vk_header, data + sizeof(header), sizeof(vk_header));
+
+	return vk_header[0] >= vk_header_size
+		&& vk_header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+		&& vk_header[2] == properties->vendorID
+		&& vk_header[3] == properties->deviceID
+		&& memcmp(data + sizeof(header) + 16, properties->pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+void vkx_init_pipeline_cache(const char* path) {
+	/*
+	 * Create the pipeline cache which is used for all pipelines, loading the data
+	 * from the file if it exists and matches the current device and driver, and
+	 * the shader module, sampler and layout caches
+	 *
+	 * @param path The file to load the cache from (and save it to at cleanup)
+	 */
+	pipeline_cache_path = path;
+
+	shader_modules_mutex = SDL_CreateMutex();
+	if (shader_modules_mutex == NULL) {
+		fprintf(stderr, "Failed to create shader module cache mutex: %s\n", SDL_GetError());
+		exit(1);
+	}
+	shader_modules_count = 0;
+
+	pipeline_libraries_mutex = SDL_CreateMutex();
+	if (pipeline_libraries_mutex == NULL) {
+		fprintf(stderr, "Failed to create pipeline library cache mutex: %s\n", SDL_GetError());
+		exit(1);
+	}
+	pipeline_library_entries_count = 0;
+
+	cached_objects_mutex = SDL_CreateMutex();
+	if (cached_objects_mutex == NULL) {
+		fprintf(stderr, "Failed to create sampler and layout cache mutex: %s\n", SDL_GetError());
+		exit(1);
+	}
+	cached_objects_count = 0;
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(vkx_instance.physical_device, &properties);
+
+	MappedFile file = {0};
+	const char* data = NULL;
+
+	if (file_exists(path)) {
+		// Never from an archive, as it is written back at cleanup
+		file = map_disk_file(path);
+		data = file.data;
+
+		if (!vkx_pipeline_cache_data_valid(data, file.size, &properties)) {
+			printf(" Pipeline cache %s is out of date - ignoring it\n", path);
+			data = NULL;
+		}
+	}
+
+	VkPipelineCacheCreateInfo cache_info = {0};
+	cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+	if (data != NULL) {
+		cache_info.initialDataSize = file.size - sizeof(VkxPipelineCacheFileHeader);
+		cache_info.pInitialData = data + sizeof(VkxPipelineCacheFileHeader);
+	}
+
+	if (vkCreatePipelineCache(vkx_instance.device, &cache_info, vkx_get_allocator(VK_OBJECT_TYPE_PIPELINE_CACHE), &pipeline_cache) != VK_SUCCESS) {
+		fprintf(stderr, "failed to create pipeline cache!\n");
+		exit(1);
+	}
+
+	printf(" Pipeline cache created (%zu bytes loaded)\n", (size_t) cache_info.initialDataSize);
+
+	unmap_file(&file);
+}
+
+void vkx_cleanup_pipeline_cache(void) {
+	/*
+	 * Write the pipeline cache back to disk and destroy it, along with the
+	 * shader modules, pipeline libraries, samplers and layouts.  Failing to save the cache isn't fatal, it'll just be
+	 * rebuilt next time
+	 */
+	for (uint32_t i = 0; i < shader_modules_count; i++) {
+		if (shader_modules[i].owner) {
+			vkDestroyShaderModule(vkx_instance.device, shader_modules[i].module, vkx_get_allocator(VK_OBJECT_TYPE_SHADER_MODULE));
+		}
+		free(shader_modules[i].path);
+	}
+	shader_modules_count = 0;
+	vkx_destroy_retired_shader_modules();
+	SDL_DestroyMutex(shader_modules_mutex);
+	shader_modules_mutex = NULL;
+
+	for (uint32_t i = 0; i < pipeline_library_entries_count; i++) {
+		vkDestroyPipeline(vkx_instance.device, pipeline_library_entries[i].library, vkx_get_allocator(VK_OBJECT_TYPE_PIPELINE));
+	}
+	pipeline_library_entries_count = 0;
+	SDL_DestroyMutex(pipeline_libraries_mutex);
+	pipeline_libraries_mutex = NULL;
+
+	// Pipeline layouts before the set layouts in them
+	for (uint32_t i = 0; i < cached_objects_count; i++) {
+		if (cached_objects[i].type == VK_OBJECT_TYPE_PIPELINE_LAYOUT) {
+			VkPipelineLayout layout;
+			memcpy(&layout, &cached_objects[i].handle, sizeof(layout));
+			vkDestroyPipelineLayout(vkx_instance.device, layout, vkx_get_allocator(VK_OBJECT_TYPE_PIPELINE_LAYOUT));
+		}
+	}
+	for (uint32_t i = 0; i < cached_objects_count; i++) {
+		if (cached_objects[i].type == VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT) {
+			VkDescriptorSetLayout layout;
+			memcpy(&layout, &cached_objects[i].handle, sizeof(layout));
+			vkDestroyDescriptorSetLayout(vkx_instance.device, layout, vkx_get_allocator(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT));
+		}
+	}
+	for (uint32_t i = 0; i < cached_objects_count; i++) {
+		if (cached_objects[i].type == VK_OBJECT_TYPE_SAMPLER) {
+			VkSampler sampler;
+			memcpy(&sampler, &cached_objects[i].handle, sizeof(sampler));
+			vkDestroySampler(vkx_instance.device, sampler, vkx_get_allocator(VK_OBJECT_TYPE_SAMPLER));
+		}
+	}
+	cached_objects_count = 0;
+	SDL_DestroyMutex(cached_objects_mutex);
+	cached_objects_mutex = NULL;
+
+	if (pipeline_cache == VK_NULL_HANDLE) {
+		return;
+	}
+
+	size_t size = 0;
+	if (vkGetPipelineCacheData(vkx_instance.device, pipeline_cache, &size, NULL) == VK_SUCCESS && size > 0) {
+		char* data = malloc(sizeof(VkxPipelineCacheFileHeader) + size);
+
+		if (data != NULL && vkGetPipelineCacheData(vkx_instance.device, pipeline_cache, &size, data + sizeof(VkxPipelineCacheFileHeader)) == VK_SUCCESS) {
+			VkPhysicalDeviceProperties properties;
+			vkGetPhysicalDeviceProperties(vkx_instance.physical_device, &properties);
+
+			VkxPipelineCacheFileHeader header = {0};
+			header.magic = VKX_PIPELINE_CACHE_MAGIC;
+			header.vendor_id = properties.vendorID;
+			header.device_id = properties.deviceID;
+			header.driver_version = properties.driverVersion;
+			memcpy(header.pipeline_cache_uuid, properties.pipelineCacheUUID, VK_UUID_SIZE);
+			header.data_size = size;
+			memcpy(data, &header, sizeof(header));
+
+			// Through a file of its own renamed into place, so other copies of
+			// the renderer sharing the cache (e.g. one per headless session)
+			// never load half of one, and the last to exit wins
+			char temp_path[1088];
+			snprintf(temp_path, sizeof(temp_path), "%s.%llu.tmp", pipeline_cache_path, (unsigned long long) SDL_GetCurrentThreadID());
+
+			if (write_entire_binary_file(temp_path, data, sizeof(header) + size) && !SDL_RenamePath(temp_path, pipeline_cache_path)) {
+				fprintf(stderr, "Failed to save the pipeline cache %s: %s\n", pipeline_cache_path, SDL_GetError());
+				SDL_RemovePath(temp_path);
+			}
+		}
+
+		free(data);
+	}
+
+	vkDestroyPipelineCache(vkx_instance.device, pipeline_cache, vkx_get_allocator(VK_OBJECT_TYPE_PIPELINE_CACHE));
+	pipeline_cache = VK_NULL_HANDLE;
+}
+
+void vkx_set_dynamic_render_state(bool enabled) {
+	/*
+	 * Make the vertex buffer pipelines created after this leave their render
+	 * state (VkxRenderState) to vkx_cmd_set_render_state(), so pipelines which
+	 * only differ in it can be shared.  Must be after vkx_init()
+	 */
+	dynamic_render_state = enabled;
+
+	if (enabled && vkx_instance.has_extended_dynamic_state3 && set_color_blend_enable_func == NULL) {
+		set_color_blend_enable_func = (PFN_vkCmdSetColorBlendEnableEXT) vkGetDeviceProcAddr(vkx_instance.device, "vkCmdSetColorBlendEnableEXT");
+		set_color_blend_equation_func = (PFN_vkCmdSetColorBlendEquationEXT) vkGetDeviceProcAddr(vkx_instance.device, "vkCmdSetColorBlendEquationEXT");
+		if (set_color_blend_enable_func == NULL || set_color_blend_equation_func == NULL) {
+			fprintf(stderr, "failed to load the extended dynamic state 3 commands!\n");
+			exit(1);
+		}
+	}
+}
+
+void vkx_set_descriptor_buffers(bool enabled) {
+	/*
+	 * Make the push sets created after this write their descriptors straight
+	 * into a buffer, which the GPU reads them from, rather than going through
+	 * the driver's sets.  Only for the ones whose bindings are all images and
+	 * samplers, and only where the device has VK_EXT_descriptor_buffer, the
+	 * rest carry on as before.  Must be after vkx_init()
+	 */
+	descriptor_buffers = enabled && vkx_instance.has_descriptor_buffer;
+
+	if (descriptor_buffers && get_descriptor_func == NULL) {
+		get_descriptor_set_layout_size_func = (PFN_vkGetDescriptorSetLayoutSizeEXT) vkGetDeviceProcAddr(vkx_instance.device, "vkGetDescriptorSetLayoutSizeEXT");
+		get_descriptor_set_layout_binding_offset_func = (PFN_vkGetDescriptorSetLayoutBindingOffsetEXT) vkGetDeviceProcAddr(vkx_instance.device, "vkGetDescriptorSetLayoutBindingOffsetEXT");
+		get_descriptor_func = (PFN_vkGetDescriptorEXT) vkGetDeviceProcAddr(vkx_instance.device, "vkGetDescriptorEXT");
+		bind_descriptor_buffers_func = (PFN_vkCmdBindDescriptorBuffersEXT) vkGetDeviceProcAddr(vkx_instance.device, "vkCmdBindDescriptorBuffersEXT");
+		set_descriptor_buffer_offsets_func = (PFN_vkCmdSetDescriptorBufferOffsetsEXT) vkGetDeviceProcAddr(vkx_instance.device, "vkCmdSetDescriptorBufferOffsetsEXT");
+		if (get_descriptor_set_layout_size_func == NULL || get_descriptor_set_layout_binding_offset_func == NULL
+				|| get_descriptor_func == NULL || bind_descriptor_buffers_func == NULL
+				|| set_descriptor_buffer_offsets_func == NULL) {
+			fprintf(stderr, "failed to load the descriptor buffer commands!\n");
+			exit(1);
+		}
+	}
+}
+
+static void vkx_load_shading_rate_command(void) {
+	if (set_fragment_shading_rate_func == NULL) {
+		set_fragment_shading_rate_func = (PFN_vkCmdSetFragmentShadingRateKHR) vkGetDeviceProcAddr(vkx_instance.device, "vkCmdSetFragmentShadingRateKHR");
+		if (set_fragment_shading_rate_func == NULL) {
+			fprintf(stderr, "failed to load vkCmdSetFragmentShadingRateKHR!\n");
+			exit(1);
+		}
+	}
+}
+
+void vkx_set_shader_objects(bool enabled) {
+	/*
+	 * Make the vertex buffer pipelines created after this out of shader
+	 * objects, where the device has VK_EXT_shader_object.  The shaders are
+	 * compiled on their own without any of the render state, which is all set
+	 * by vkx_cmd_bind_pipeline(), so there are no pipelines to build for each
+	 * combination of it.  Must be after vkx_init()
+	 */
+	shader_objects = enabled && vkx_instance.has_shader_object;
+
+	if (shader_objects && create_shaders_func == NULL) {
+		create_shaders_func = (PFN_vkCreateShadersEXT) vkGetDeviceProcAddr(vkx_instance.device, "vkCreateShadersEXT");
+		destroy_shader_func = (PFN_vkDestroyShaderEXT) vkGetDeviceProcAddr(vkx_instance.device, "vkDestroyShaderEXT");
+		bind_shaders_func = (PFN_vkCmdBindShadersEXT) vkGetDeviceProcAddr(vkx_instance.device, "vkCmdBindShadersEXT");
+		set_vertex_input_func = (PFN_vkCmdSetVertexInputEXT) vkGetDeviceProcAddr(vkx_instance.device, "vkCmdSetVertexInputEXT");
+		set_polygon_mode_func = (PFN_vkCmdSetPolygonModeEXT) vkGetDeviceProcAddr(vkx_instance.device, "vkCmdSetPolygonModeEXT");
+		set_rasterization_samples_func = (PFN_vkCmdSetRasterizationSamplesEXT) vkGetDeviceProcAddr(vkx_instance.device, "vkCmdSetRasterizationSamplesEXT");
+		set_sample_mask_func = (PFN_vkCmdSetSampleMaskEXT) vkGetDeviceProcAddr(vkx_instance.device, "vkCmdSetSampleMaskEXT");
+		set_alpha_to_coverage_enable_func = (PFN_vkCmdSetAlphaToCoverageEnableEXT) vkGetDeviceProcAddr(vkx_instance.device, "vkCmdSetAlphaToCoverageEnableEXT");
+		set_color_write_mask_func = (PFN_vkCmdSetColorWriteMaskEXT) vkGetDeviceProcAddr(vkx_instance.device, "vkCmdSetColorWriteMaskEXT");
+		// The extension has the blending commands too, whether or not there is
+		// VK_EXT_extended_dynamic_state3
+		set_color_blend_enable_func = (PFN_vkCmdSetColorBlendEnableEXT) vkGetDeviceProcAddr(vkx_instance.device, "vkCmdSetColorBlendEnableEXT");
+		set_color_blend_equation_func = (PFN_vkCmdSetColorBlendEquationEXT) vkGetDeviceProcAddr(vkx_instance.device, "vkCmdSetColorBlendEquationEXT");
+		if (create_shaders_func == NULL || destroy_shader_func == NULL || bind_shaders_func == NULL
+				|| set_vertex_input_func == NULL || set_polygon_mode_func == NULL
+				|| set_rasterization_samples_func == NULL || set_sample_mask_func == NULL
+				|| set_alpha_to_coverage_enable_func == NULL || set_color_write_mask_func == NULL
+				|| set_color_blend_enable_func == NULL || set_color_blend_equation_func == NULL) {
+			fprintf(stderr, "failed to load the shader object commands!\n");
+			exit(1);
+		}
+	}
+
+	// With the device's shading rate feature on, every draw with shader
+	// objects has to have one set
+	if (shader_objects && vkx_instance.has_fragment_shading_rate) {
+		vkx_load_shading_rate_command();
+	}
+}
+
+void vkx_set_pipeline_libraries(bool enabled) {
+	/*
+	 * Make the vertex buffer pipelines created after this (apart from shader
+	 * objects) by linking parts made with VK_EXT_graphics_pipeline_library,
+	 * where the device can link them quickly.  The vertex input, vertex shader,
+	 * fragment shader and output parts are each compiled once and shared by
+	 * the pipelines which have the same of them, so a new combination is only
+	 * a link.  Must be after vkx_init()
+	 */
+	pipeline_libraries = enabled && vkx_instance.has_graphics_pipeline_library;
+}
+
+void vkx_set_view_mask(uint32_t mask) {
+	/*
+	 * Make the vertex buffer pipelines created after this render the views in
+	 * mask at once with multiview, e.g. for split screen.  They can then only
+	 * be used in passes with the same view mask (0 for no multiview)
+	 */
+	view_mask = mask;
+}
+
+uint32_t vkx_get_view_mask(void) {
+	return view_mask;
+}
+
+void vkx_set_depth_buffer(bool enabled) {
+	/*
+	 * Make the vertex buffer and mesh pipelines created after this render to
+	 * passes without a depth attachment, so the draws are ordered by whatever
+	 * order they're recorded in.  The depth settings of
+	 * vkx_cmd_set_render_state() are ignored then
+	 */
+	depth_buffer = enabled;
+}
+
+VkFormat vkx_get_depth_format(void) {
+	// The pipelines' depth attachment format, VK_FORMAT_UNDEFINED without one
+	return depth_buffer ? vkx_find_depth_format() : VK_FORMAT_UNDEFINED;
+}
+
+void vkx_set_color_format(VkFormat format) {
+	/*
+	 * Make the vertex buffer and mesh pipelines created after this render to
+	 * a colour attachment of format, e.g. offscreen images which don't follow
+	 * the swap chain.  VK_FORMAT_UNDEFINED for the swap chain's format
+	 */
+	color_format = format;
+}
+
+VkFormat vkx_get_color_format(void) {
+	return color_format != VK_FORMAT_UNDEFINED ? color_format : vkx_swap_chain.image_format;
+}
+
+void vkx_set_fragment_bindings(const VkDescriptorType* types, uint32_t count) {
+	/*
+	 * Give the vertex buffer pipelines created after this more bindings for
+	 * their fragment shaders, one descriptor each in bindings 3 onwards (e.g.
+	 * for lighting).  Their sets all share the one layout, so this should be
+	 * set before any of them are created
+	 *
+	 * @param types The descriptor type of each binding
+	 * @param count Up to VKX_MAX_FRAGMENT_BINDINGS, 0 for none
+	 */
+	if (count > VKX_MAX_FRAGMENT_BINDINGS) {
+		fprintf(stderr, "Vertex buffer pipelines can't have more than %d fragment bindings\n", VKX_MAX_FRAGMENT_BINDINGS);
+		exit(1);
+	}
+	memcpy(fragment_binding_types, types, sizeof(VkDescriptorType) * count);
+	fragment_bindings_count = count;
+}
+
+void vkx_set_multisampling(VkSampleCountFlagBits samples, bool coverage) {
+	/*
+	 * Make the vertex buffer pipelines created after this render with samples
+	 * per pixel, so they can only be used in passes whose attachments have as
+	 * many.  With coverage, pipelines which don't blend write their alpha as
+	 * the share of the samples covered, which smooths alpha tested edges
+	 */
+	sample_count = samples;
+	alpha_to_coverage = coverage && samples > VK_SAMPLE_COUNT_1_BIT;
+}
+
+void vkx_set_additive_blend(bool enabled) {
+	/*
+	 * Make the vertex buffer pipelines created with alpha_blend after this add
+	 * their colour to the attachment, e.g. to count how often each pixel is
+	 * drawn.  Unlike alpha blending they keep writing depth, so what they hide
+	 * isn't drawn.  Where the blending is dynamic, VkxRenderState.additive_blend
+	 * picks it instead
+	 */
+	additive_blend = enabled;
+}
+
+void vkx_set_shading_rate(bool enabled, bool attachment) {
+	/*
+	 * Make the vertex buffer and mesh pipelines created after this leave
+	 * their fragment shading rate to vkx_cmd_set_shading_rate(), where the
+	 * device has VK_KHR_fragment_shading_rate.  With attachment (where the
+	 * device can do that too), they can be used in passes with a shading rate
+	 * attachment, see vkx_frame_graph_add_shading_rate_attachment().  Must be
+	 * after vkx_init()
+	 */
+	shading_rate = enabled && vkx_instance.has_fragment_shading_rate;
+	shading_rate_attachment = shading_rate && attachment && vkx_instance.has_shading_rate_attachment;
+
+	if (shading_rate) {
+		vkx_load_shading_rate_command();
+	}
+}
+
+bool vkx_has_shading_rate(void) {
+	return shading_rate;
+}
+
+bool vkx_has_shading_rate_attachment(void) {
+	return shading_rate_attachment;
+}
+
+VkSampleCountFlagBits vkx_get_sample_count(void) {
+	return sample_count;
+}
+
+bool vkx_has_dynamic_render_state(void) {
+	return dynamic_render_state;
+}
+
+bool vkx_has_dynamic_blend(void) {
+	/*
+	 * Whether VkxRenderState.alpha_blend is dynamic, so one pipeline can draw
+	 * both blended and opaque.  Not with alpha to coverage, which is baked
+	 * into the pipelines which don't blend
+	 */
+	return dynamic_render_state && (vkx_instance.has_extended_dynamic_state3 || shader_objects) && !alpha_to_coverage;
+}
+
+static void vkx_cmd_set_render_state_commands(VkCommandBuffer command_buffer, const VkxRenderState* state) {
+	vkCmdSetCullMode(command_buffer, state->cull_mode);
+	vkCmdSetDepthTestEnable(command_buffer, state->depth_test && depth_buffer ? VK_TRUE : VK_FALSE);
+	vkCmdSetDepthWriteEnable(command_buffer, state->depth_write && depth_buffer ? VK_TRUE : VK_FALSE);
+	vkCmdSetDepthCompareOp(command_buffer, state->depth_compare_op);
+
+	if (vkx_instance.has_extended_dynamic_state3 || shader_objects) {
+		VkBool32 blend_enable = state->alpha_blend ? VK_TRUE : VK_FALSE;
+		set_color_blend_enable_func(command_buffer, 0, 1, &blend_enable);
+
+		// The same equation as the pipelines created with alpha_blend
+		VkColorBlendEquationEXT equation = {0};
+		equation.srcColorBlendFactor = state->additive_blend ? VK_BLEND_FACTOR_ONE : VK_BLEND_FACTOR_SRC_ALPHA;
+		equation.dstColorBlendFactor = state->additive_blend ? VK_BLEND_FACTOR_ONE : VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+		equation.colorBlendOp = VK_BLEND_OP_ADD;
+		equation.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		equation.dstAlphaBlendFactor = state->additive_blend ? VK_BLEND_FACTOR_ONE : VK_BLEND_FACTOR_ZERO;
+		equation.alphaBlendOp = VK_BLEND_OP_ADD;
+		set_color_blend_equation_func(command_buffer, 0, 1, &equation);
+	}
+}
+
+void vkx_cmd_set_render_state(VkCommandBuffer command_buffer, const VkxRenderState* state) {
+	/*
+	 * Set the dynamic render state for the following draws, after binding a
+	 * vertex buffer pipeline (binding a pipeline with the state baked in, like
+	 * the screen pipeline, leaves it undefined).  Does nothing without
+	 * vkx_set_dynamic_render_state(true)
+	 *
+	 * @param command_buffer The command buffer to record into
+	 * @param state The state to set
+	 */
+	if (dynamic_render_state) {
+		vkx_cmd_set_render_state_commands(command_buffer, state);
+	}
+}
+
+void vkx_cmd_set_shading_rate(VkCommandBuffer command_buffer, VkExtent2D fragment_size, bool use_attachment) {
+	/*
+	 * Set the fragment shading rate for the following draws, after binding a
+	 * pipeline with VkxPipeline.shading_rate.  Does nothing if the device
+	 * can't vary it
+	 *
+	 * @param fragment_size The pixels each fragment shader invocation covers,
+	 *                      1x1 for every pixel, up to 2x2 (which every device
+	 *                      with the extension has)
+	 * @param use_attachment Take the rate from the pass's shading rate
+	 *                       attachment instead where it has one, with
+	 *                       vkx_set_shading_rate(true, true)
+	 */
+	if (set_fragment_shading_rate_func == NULL) {
+		return;
+	}
+
+	// The attachment's rate replaces the draw's rather than being combined
+	// with it, which doesn't need the nontrivial combiner ops
+	VkFragmentShadingRateCombinerOpKHR combiner_ops[2] = {
+		VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR,
+		use_attachment && shading_rate_attachment ? VK_FRAGMENT_SHADING_RATE_COMBINER_OP_REPLACE_KHR : VK_FRAGMENT_SHADING_RATE_COMBINER_OP_KEEP_KHR
+	};
+	set_fragment_shading_rate_func(command_buffer, &fragment_size, combiner_ops);
+}
+
+void vkx_cmd_bind_pipeline(VkCommandBuffer command_buffer, const VkxPipeline* pipeline) {
+	/*
+	 * Bind a graphics pipeline.  One made of shader objects has the state it
+	 * would have been created with set here instead, so the draws after this
+	 * are the same either way, and vkx_cmd_set_render_state() can follow it
+	 * the same.  One with a dynamic shading rate starts at every pixel, which
+	 * vkx_cmd_set_shading_rate() can change after this
+	 */
+	const VkExtent2D full_rate = {1, 1};
+	if (pipeline->shaders[0] == VK_NULL_HANDLE) {
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline->pipeline);
+		if (pipeline->shading_rate) {
+			vkx_cmd_set_shading_rate(command_buffer, full_rate, false);
+		}
+		return;
+	}
+
+	// With the mesh shader features on, the task and mesh stages have to be
+	// unbound explicitly
+	VkShaderStageFlagBits stages[4] = {VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT, VK_SHADER_STAGE_TASK_BIT_EXT, VK_SHADER_STAGE_MESH_BIT_EXT};
+	VkShaderEXT shaders[4] = {pipeline->shaders[0], pipeline->shaders[1], VK_NULL_HANDLE, VK_NULL_HANDLE};
+	bind_shaders_func(command_buffer, vkx_instance.has_mesh_shader ? 4 : 2, stages, shaders);
+	VKX_COUNT_COMMANDS(VKX_STAT_PIPELINE_BINDS, 1);
+
+	set_vertex_input_func(command_buffer, 1, &pipeline->vertex_binding,
+			pipeline->vertex_attributes_count, pipeline->vertex_attributes);
+	vkCmdSetPrimitiveTopology(command_buffer, VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+	vkCmdSetPrimitiveRestartEnable(command_buffer, VK_FALSE);
+	vkCmdSetRasterizerDiscardEnable(command_buffer, VK_FALSE);
+	set_polygon_mode_func(command_buffer, VK_POLYGON_MODE_FILL);
+	vkCmdSetFrontFace(command_buffer, VK_FRONT_FACE_COUNTER_CLOCKWISE);
+	vkCmdSetDepthBiasEnable(command_buffer, VK_FALSE);
+	vkCmdSetDepthBoundsTestEnable(command_buffer, VK_FALSE);
+	vkCmdSetStencilTestEnable(command_buffer, VK_FALSE);
+
+	VkSampleMask sample_mask = ~0u;
+	set_rasterization_samples_func(command_buffer, pipeline->samples);
+	set_sample_mask_func(command_buffer, pipeline->samples, &sample_mask);
+	set_alpha_to_coverage_enable_func(command_buffer, pipeline->alpha_to_coverage ? VK_TRUE : VK_FALSE);
+
+	VkColorComponentFlags write_mask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	set_color_write_mask_func(command_buffer, 0, 1, &write_mask);
+
+	// What vkx_create_vertex_buffer_pipeline() bakes in
+	VkxRenderState state = {0};
+	state.cull_mode = VK_CULL_MODE_BACK_BIT;
+	state.depth_test = true;
+	state.depth_write = !pipeline->alpha_blend || pipeline->additive_blend;
+	state.depth_compare_op = VK_COMPARE_OP_LESS;
+	state.alpha_blend = pipeline->alpha_blend;
+	state.additive_blend = pipeline->additive_blend;
+	vkx_cmd_set_render_state_commands(command_buffer, &state);
+
+	if (pipeline->shading_rate) {
+		vkx_cmd_set_shading_rate(command_buffer, full_rate, false);
+	}
+}
+
+VkDescriptorSetLayout vkx_create_descriptor_set_layout(VkxSetBindings bindings, uint32_t num_textures,
+		const VkDescriptorType* fragment_types, uint32_t fragment_count) {
+	/*
+	 * Create a descriptor set layout for the uniform buffer, texture sampler and
+	 * sprite storage buffer, or the ones of them a pipeline uses.
+	 *
+	 * This is made based on the assumption that most pipelines in the app will
+	 * use a similar layout format.
+	 *
+	 * @param bindings Which of the three to include, see VkxSetBindings.  The
+	 *                 dynamic ones left out don't take a dynamic offset when
+	 *                 the set is bound
+	 * @param num_textures The number of textures to make room for in the descriptor set layout
+	 * @param fragment_types Types of the bindings after those, for the fragment
+	 *                       shader only
+	 * @param fragment_count The number of them
+	 */
+	VkDescriptorSetLayoutBinding layout_bindings[3 + VKX_MAX_FRAGMENT_BINDINGS] = {0};
+	uint32_t bindings_count = 0;
+
+	// Mesh pipelines read the same buffers from their task and mesh shaders.
+	// The stages are part of the layout, so the sets are only interchangeable
+	// between the two kinds of pipeline if every layout has them
+	VkShaderStageFlags geometry_stages = VK_SHADER_STAGE_VERTEX_BIT;
+	if (vkx_instance.has_mesh_shader) {
+		geometry_stages |= VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+	}
+
+	// The uniform buffer and the storage buffer are dynamic so that they can
+	// point into a per-frame ring buffer
+	if (bindings & VKX_SET_UNIFORMS) {
+		VkDescriptorSetLayoutBinding* binding = &layout_bindings[bindings_count++];
+		binding->binding = 0;
+		binding->descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		binding->descriptorCount = 1;
+		binding->stageFlags = geometry_stages | VK_SHADER_STAGE_FRAGMENT_BIT;
+	}
+
+	if (bindings & VKX_SET_TEXTURES) {
+		VkDescriptorSetLayoutBinding* binding = &layout_bindings[bindings_count++];
+		binding->binding = 1;
+		binding->descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		binding->descriptorCount = num_textures;
+		binding->stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	}
+
+	// i.e. the per-sprite transforms
+	if (bindings & VKX_SET_DRAW_DATA) {
+		VkDescriptorSetLayoutBinding* binding = &layout_bindings[bindings_count++];
+		binding->binding = 2;
+		binding->descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+		binding->descriptorCount = 1;
+		binding->stageFlags = geometry_stages;
+	}
+
+	for (uint32_t i = 0; i < fragment_count; i++) {
+		VkDescriptorSetLayoutBinding* binding = &layout_bindings[bindings_count++];
+		binding->binding = 3 + i;
+		binding->descriptorType = fragment_types[i];
+		binding->descriptorCount = 1;
+		binding->stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layout_info = {0};
+	layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layout_info.bindingCount = bindings_count;
+	layout_info.pBindings = layout_bindings;
+	
+	// Which pipelines with the same bindings share
+	return vkx_get_descriptor_set_layout(&layout_info);
+}
+
+void vkx_push_set_init(VkxPushSet* push_set, const VkDescriptorType* types, VkShaderStageFlags stages,
+		uint32_t count, uint32_t max_pushes_per_frame) {
+	/*
+	 * Create the layout of a set which is pushed while recording.  It goes in
+	 * the pipeline's layout like any other set, then once the pipeline is
+	 * created vkx_push_set_create_template() gets it ready to push
+	 *
+	 * @param types The bindings' types, from binding 0 up, one descriptor each.
+	 *              Push descriptors can't be dynamic, so any uniform or storage
+	 *              buffer is the plain kind with its offset in the data
+	 * @param stages The shader stages which read them
+	 * @param count Up to VKX_MAX_PUSH_SET_BINDINGS
+	 * @param max_pushes_per_frame Times a frame can push it, which is only
+	 *                             allocated for in a descriptor buffer
+	 */
+	if (count > VKX_MAX_PUSH_SET_BINDINGS) {
+		fprintf(stderr, "Push sets can't have more than %d bindings\n", VKX_MAX_PUSH_SET_BINDINGS);
+		exit(1);
+	}
+
+	memset(push_set, 0, sizeof(*push_set));
+	memcpy(push_set->types, types, sizeof(VkDescriptorType) * count);
+	push_set->bindings_count = count;
+
+	// Buffer descriptors would need the buffers' device addresses, which most
+	// of them weren't created with, so only image sets go in descriptor buffers
+	VkBufferUsageFlags descriptor_buffer_usage = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		if (types[i] == VK_DESCRIPTOR_TYPE_SAMPLER || types[i] == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER) {
+			descriptor_buffer_usage |= VK_BUFFER_USAGE_SAMPLER_DESCRIPTOR_BUFFER_BIT_EXT;
+		}
+		else if (types[i] == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE || types[i] == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE) {
+			descriptor_buffer_usage |= VK_BUFFER_USAGE_RESOURCE_DESCRIPTOR_BUFFER_BIT_EXT;
+		}
+		else {
+			descriptor_buffer_usage = 0;
+			break;
+		}
+	}
+	push_set->uses_descriptor_buffer = descriptor_buffers && descriptor_buffer_usage != 0;
+
+	VkDescriptorSetLayoutBinding layout_bindings[VKX_MAX_PUSH_SET_BINDINGS] = {0};
+	for (uint32_t i = 0; i < count; i++) {
+		layout_bindings[i].binding = i;
+		layout_bindings[i].descriptorType = types[i];
+		layout_bindings[i].descriptorCount = 1;
+		layout_bindings[i].stageFlags = stages;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layout_info = {0};
+	layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	if (push_set->uses_descriptor_buffer) {
+		layout_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_DESCRIPTOR_BUFFER_BIT_EXT;
+	}
+	else if (vkx_instance.has_push_descriptor) {
+		layout_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+	}
+	layout_info.bindingCount = count;
+	layout_info.pBindings = layout_bindings;
+
+	push_set->layout = vkx_get_descriptor_set_layout(&layout_info);
+
+	if (push_set->uses_descriptor_buffer) {
+		// Every push of every frame in flight gets its own copy of the set, each
+		// one starting at an offset the device can bind
+		VkDeviceSize alignment = vkx_instance.descriptor_buffer_properties.descriptorBufferOffsetAlignment;
+		VkDeviceSize set_size;
+		get_descriptor_set_layout_size_func(vkx_instance.device, push_set->layout, &set_size);
+		push_set->set_size = (set_size + alignment - 1) / alignment * alignment;
+		for (uint32_t i = 0; i < count; i++) {
+			get_descriptor_set_layout_binding_offset_func(vkx_instance.device, push_set->layout, i, &push_set->binding_offsets[i]);
+		}
+
+		push_set->max_pushes = max_pushes_per_frame;
+		push_set->descriptor_buffer_usage = descriptor_buffer_usage;
+		push_set->descriptor_buffer = vkx_create_buffer(
+			push_set->set_size * max_pushes_per_frame * vkx_instance.frames_in_flight,
+			descriptor_buffer_usage | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+		);
+
+		push_set->descriptor_buffer_address = vkx_get_buffer_address(push_set->descriptor_buffer.buffer);
+		return;
+	}
+
+	if (vkx_instance.has_push_descriptor) {
+		if (push_descriptor_set_with_template_func == NULL) {
+			push_descriptor_set_with_template_func = (PFN_vkCmdPushDescriptorSetWithTemplateKHR) vkGetDeviceProcAddr(vkx_instance.device, "vkCmdPushDescriptorSetWithTemplateKHR");
+			if (push_descriptor_set_with_template_func == NULL) {
+				fprintf(stderr, "failed to load the push descriptor commands!\n");
+				exit(1);
+			}
+		}
+		return;
+	}
+
+	// Otherwise the sets come from the descriptor ring, whose pools only have
+	// so many of each type for each set
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t same_type = 0;
+		for (uint32_t j = 0; j < count; j++) {
+			same_type += types[j] == types[i];
+		}
+		if (same_type > VKX_DESCRIPTOR_RING_DESCRIPTORS_PER_SET) {
+			fprintf(stderr, "Push sets can't have more than %d bindings of a type without push descriptors\n", VKX_DESCRIPTOR_RING_DESCRIPTORS_PER_SET);
+			exit(1);
+		}
+	}
+}
+
+void vkx_push_set_create_template(VkxPushSet* push_set, VkPipelineLayout pipeline_layout,
+		VkPipelineBindPoint bind_point, uint32_t set) {
+	/*
+	 * Make the update template the data is written with
+	 *
+	 * @param pipeline_layout The layout of a pipeline with the push set in it.
+	 *                        Pipelines whose layouts are compatible with it up
+	 *                        to the set can use it too
+	 * @param set Which set of that layout it is
+	 */
+	push_set->pipeline_layout = pipeline_layout;
+	push_set->bind_point = bind_point;
+	push_set->set = set;
+
+	// Descriptor buffers are written by vkx_cmd_push_set() itself
+	if (push_set->uses_descriptor_buffer) {
+		return;
+	}
+
+	VkDescriptorUpdateTemplateEntry entries[VKX_MAX_PUSH_SET_BINDINGS] = {0};
+	for (uint32_t i = 0; i < push_set->bindings_count; i++) {
+		entries[i].dstBinding = i;
+		entries[i].dstArrayElement = 0;
+		entries[i].descriptorCount = 1;
+		entries[i].descriptorType = push_set->types[i];
+		entries[i].offset = sizeof(VkxPushSetData) * i;
+		entries[i].stride = sizeof(VkxPushSetData);
+	}
+
+	VkDescriptorUpdateTemplateCreateInfo template_info = {0};
+	template_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+	template_info.descriptorUpdateEntryCount = push_set->bindings_count;
+	template_info.pDescriptorUpdateEntries = entries;
+	if (vkx_instance.has_push_descriptor) {
+		template_info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_PUSH_DESCRIPTORS_KHR;
+		template_info.pipelineBindPoint = bind_point;
+		template_info.pipelineLayout = pipeline_layout;
+		template_info.set = set;
+	}
+	else {
+		template_info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+		template_info.descriptorSetLayout = push_set->layout;
+	}
+
+	if (vkCreateDescriptorUpdateTemplate(vkx_instance.device, &template_info, vkx_get_allocator(VK_OBJECT_TYPE_DESCRIPTOR_UPDATE_TEMPLATE), &push_set->update_template) != VK_SUCCESS) {
+		fprintf(stderr, "failed to create push set update template!\n");
+		exit(1);
+	}
+}
+
+void vkx_push_set_begin_frame(VkxPushSet* push_set, uint32_t frame) {
+	/*
+	 * Start pushing for a frame in flight, whose last use the GPU has finished
+	 * with.  Without push descriptors the sets it was given then are freed by
+	 * vkx_descriptor_ring_begin_frame() instead
+	 */
+	push_set->frame = frame;
+	push_set->pushes = 0;
+}
+
+static void vkx_cmd_push_set_descriptor_buffer(VkxPushSet* push_set, VkCommandBuffer command_buffer,
+		const VkxPushSetData* data) {
+	/*
+	 * Write the descriptors into the next copy of the set in the frame's part
+	 * of the buffer, and point the set at it
+	 */
+	if (push_set->pushes == push_set->max_pushes) {
+		fprintf(stderr, "Pushed a set more times in a frame than it was created for\n");
+		exit(1);
+	}
+
+	const VkPhysicalDeviceDescriptorBufferPropertiesEXT* properties = &vkx_instance.descriptor_buffer_properties;
+	VkDeviceSize offset = push_set->set_size * (push_set->frame * push_set->max_pushes + push_set->pushes);
+	uint8_t* set_data = (uint8_t*) push_set->descriptor_buffer.allocation.mapped + offset;
+	push_set->pushes++;
+
+	for (uint32_t i = 0; i < push_set->bindings_count; i++) {
+		VkDescriptorGetInfoEXT get_info = {0};
+		get_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_GET_INFO_EXT;
+		get_info.type = push_set->types[i];
+		size_t size;
+		switch (push_set->types[i]) {
+			case VK_DESCRIPTOR_TYPE_SAMPLER:
+				get_info.data.pSampler = &data[i].image.sampler;
+				size = properties->samplerDescriptorSize;
+				break;
+			case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+				get_info.data.pCombinedImageSampler = &data[i].image;
+				size = properties->combinedImageSamplerDescriptorSize;
+				break;
+			case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+				get_info.data.pSampledImage = &data[i].image;
+				size = properties->sampledImageDescriptorSize;
+				break;
+			default:
+				get_info.data.pStorageImage = &data[i].image;
+				size = properties->storageImageDescriptorSize;
+				break;
+		}
+		get_descriptor_func(vkx_instance.device, &get_info, size, set_data + push_set->binding_offsets[i]);
+	}
+
+	// Binding descriptor buffers forgets the offsets of the sets from the
+	// buffers bound before, so a pipeline can only have one set done this way
+	VkDescriptorBufferBindingInfoEXT binding_info = {0};
+	binding_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_BUFFER_BINDING_INFO_EXT;
+	binding_info.address = push_set->descriptor_buffer_address;
+	binding_info.usage = push_set->descriptor_buffer_usage;
+	bind_descriptor_buffers_func(command_buffer, 1, &binding_info);
+
+	uint32_t buffer_index = 0;
+	set_descriptor_buffer_offsets_func(command_buffer, push_set->bind_point, push_set->pipeline_layout,
+			push_set->set, 1, &buffer_index, &offset);
+	VKX_COUNT_COMMANDS(VKX_STAT_DESCRIPTOR_BINDS, 1);
+}
+
+void vkx_cmd_push_set(VkxPushSet* push_set, VkCommandBuffer command_buffer, const VkxPushSetData* data) {
+	/*
+	 * Set the bindings for the draws or dispatches after this
+	 *
+	 * @param data One for each binding
+	 */
+	if (push_set->uses_descriptor_buffer) {
+		vkx_cmd_push_set_descriptor_buffer(push_set, command_buffer, data);
+		return;
+	}
+
+	if (vkx_instance.has_push_descriptor) {
+		push_descriptor_set_with_template_func(command_buffer, push_set->update_template, push_set->pipeline_layout, push_set->set, data);
+		VKX_COUNT_COMMANDS(VKX_STAT_DESCRIPTOR_BINDS, 1);
+		return;
+	}
+
+	VkDescriptorSet descriptor_set = vkx_descriptor_ring_allocate(push_set->layout);
+	vkUpdateDescriptorSetWithTemplate(vkx_instance.device, descriptor_set, push_set->update_template, data);
+	vkCmdBindDescriptorSets(command_buffer, push_set->bind_point, push_set->pipeline_layout, push_set->set, 1, &descriptor_set, 0, NULL);
+}
+
+void vkx_push_set_cleanup(VkxPushSet* push_set) {
+	if (push_set->descriptor_buffer.buffer != VK_NULL_HANDLE) {
+		vkx_cleanup_buffer(&push_set->descriptor_buffer);
+	}
+	vkDestroyDescriptorUpdateTemplate(vkx_instance.device, push_set->update_template, vkx_get_allocator(VK_OBJECT_TYPE_DESCRIPTOR_UPDATE_TEMPLATE));
+	memset(push_set, 0, sizeof(*push_set));
+}
+
+static VkPipeline vkx_get_pipeline_library(VkGraphicsPipelineLibraryFlagsEXT part, uint64_t hash,
+		VkGraphicsPipelineCreateInfo* pipeline_info) {
+	/*
+	 * Get the library for a part of a pipeline, which is created the first
+	 * time from pipeline_info (with only that part's state in it).  It isn't
+	 * locked while compiling so other threads can get theirs, and if two
+	 * make the same library the first one in is kept
+	 *
+	 * @param hash Of everything in pipeline_info
+	 */
+	SDL_LockMutex(pipeline_libraries_mutex);
+	for (uint32_t i = 0; i < pipeline_library_entries_count; i++) {
+		if (pipeline_library_entries[i].part == part && pipeline_library_entries[i].hash == hash) {
+			VkPipeline library = pipeline_library_entries[i].library;
+			SDL_UnlockMutex(pipeline_libraries_mutex);
+			return library;
+		}
+	}
+	SDL_UnlockMutex(pipeline_libraries_mutex);
+
+	VkGraphicsPipelineLibraryCreateInfoEXT library_info = {0};
+	library_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+	library_info.pNext = pipeline_info->pNext;
+	library_info.flags = part;
+	pipeline_info->pNext = &library_info;
+	pipeline_info->flags |= VK_PIPELINE_CREATE_LIBRARY_BIT_KHR;
+
+	VkPipeline library;
+	if (vkCreateGraphicsPipelines(vkx_instance.device, pipeline_cache, 1, pipeline_info, vkx_get_allocator(VK_OBJECT_TYPE_PIPELINE), &library) != VK_SUCCESS) {
+		fprintf(stderr, "failed to create pipeline library!\n");
+		exit(1);
+	}
+
+	SDL_LockMutex(pipeline_libraries_mutex);
+	for (uint32_t i = 0; i < pipeline_library_entries_count; i++) {
+		if (pipeline_library_entries[i].part == part && pipeline_library_entries[i].hash == hash) {
+			vkDestroyPipeline(vkx_instance.device, library, vkx_get_allocator(VK_OBJECT_TYPE_PIPELINE));
+			library = pipeline_library_entries[i].library;
+			SDL_UnlockMutex(pipeline_libraries_mutex);
+			return library;
+		}
+	}
+	if (pipeline_library_entries_count >= VKX_MAX_PIPELINE_LIBRARIES) {
+		fprintf(stderr, "Too many pipeline libraries (max %d)\n", VKX_MAX_PIPELINE_LIBRARIES);
+		exit(1);
+	}
+	VkxPipelineLibraryEntry* entry = &pipeline_library_entries[pipeline_library_entries_count++];
+	entry->part = part;
+	entry->hash = hash;
+	entry->library = library;
+	SDL_UnlockMutex(pipeline_libraries_mutex);
+
+	return library;
+}
+
+static VkPipeline vkx_link_pipeline_libraries(const VkGraphicsPipelineCreateInfo* pipeline_info, const uint64_t hashes[4]) {
+	/*
+	 * Make a pipeline by linking the libraries of its four parts, taking the
+	 * state of each from the full pipeline_info
+	 *
+	 * @param hashes Of the state of the vertex input, vertex shader, fragment
+	 *               shader and output parts, in that order
+	 */
+	// Each part has the flags (e.g. for a shading rate attachment) as well as
+	// the linked pipeline
+	VkGraphicsPipelineCreateInfo part_infos[4] = {0};
+	for (uint32_t i = 0; i < 4; i++) {
+		part_infos[i].sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		part_infos[i].flags = pipeline_info->flags;
+		part_infos[i].pDynamicState = pipeline_info->pDynamicState;
+	}
+
+	part_infos[0].pVertexInputState = pipeline_info->pVertexInputState;
+	part_infos[0].pInputAssemblyState = pipeline_info->pInputAssemblyState;
+
+	// The rendering info has the view mask which the shaders need, and the
+	// formats which the output does
+	part_infos[1].pNext = pipeline_info->pNext;
+	part_infos[1].stageCount = 1;
+	part_infos[1].pStages = &pipeline_info->pStages[0];
+	part_infos[1].pViewportState = pipeline_info->pViewportState;
+	part_infos[1].pRasterizationState = pipeline_info->pRasterizationState;
+	part_infos[1].layout = pipeline_info->layout;
+
+	part_infos[2].pNext = pipeline_info->pNext;
+	part_infos[2].stageCount = 1;
+	part_infos[2].pStages = &pipeline_info->pStages[1];
+	part_infos[2].pDepthStencilState = pipeline_info->pDepthStencilState;
+	part_infos[2].pMultisampleState = pipeline_info->pMultisampleState;
+	part_infos[2].layout = pipeline_info->layout;
+
+	part_infos[3].pNext = pipeline_info->pNext;
+	part_infos[3].pColorBlendState = pipeline_info->pColorBlendState;
+	part_infos[3].pMultisampleState = pipeline_info->pMultisampleState;
+
+	const VkGraphicsPipelineLibraryFlagsEXT parts[4] = {
+		VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT,
+		VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT,
+		VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT,
+		VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT
+	};
+	VkPipeline libraries[4];
+	for (uint32_t i = 0; i < 4; i++) {
+		libraries[i] = vkx_get_pipeline_library(parts[i], hashes[i], &part_infos[i]);
+	}
+
+	VkPipelineLibraryCreateInfoKHR library_info = {0};
+	library_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+	library_info.libraryCount = 4;
+	library_info.pLibraries = libraries;
+
+	VkGraphicsPipelineCreateInfo link_info = {0};
+	link_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	link_info.pNext = &library_info;
+	link_info.flags = pipeline_info->flags;
+	link_info.layout = pipeline_info->layout;
+
+	VkPipeline pipeline;
+	if (vkCreateGraphicsPipelines(vkx_instance.device, pipeline_cache, 1, &link_info, vkx_get_allocator(VK_OBJECT_TYPE_PIPELINE), &pipeline) != VK_SUCCESS) {
+		fprintf(stderr, "failed to link graphics pipeline!\n");
+		exit(1);
+	}
+	return pipeline;
+}
+
+static void vkx_create_shader_objects(VkxPipeline* pipeline, const char* vert_shader_path, const char* frag_shader_path,
+		const VkPipelineLayoutCreateInfo* layout_info, const VkSpecializationInfo* specialization) {
+	/*
+	 * Create a vertex and fragment shader linked together, which the driver
+	 * can optimise as a pair like a pipeline's
+	 *
+	 * @param layout_info What the pipeline layout was created with, which the
+	 *                    shaders have to match
+	 */
+	const char* paths[2] = {vert_shader_path, frag_shader_path};
+	MappedFile files[2] = {0};
+	VkShaderCreateInfoEXT create_infos[2] = {0};
+
+	for (uint32_t i = 0; i < 2; i++) {
+		size_t code_size = 0;
+		const char* code = vkx_map_shader_code(paths[i], &files[i], &code_size);
+
+		create_infos[i].sType = VK_STRUCTURE_TYPE_SHADER_CREATE_INFO_EXT;
+		create_infos[i].flags = VK_SHADER_CREATE_LINK_STAGE_BIT_EXT;
+		if (i == 1 && shading_rate_attachment) {
+			create_infos[i].flags |= VK_SHADER_CREATE_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_EXT;
+		}
+		create_infos[i].stage = i == 0 ? VK_SHADER_STAGE_VERTEX_BIT : VK_SHADER_STAGE_FRAGMENT_BIT;
+		create_infos[i].nextStage = i == 0 ? VK_SHADER_STAGE_FRAGMENT_BIT : 0;
+		create_infos[i].codeType = VK_SHADER_CODE_TYPE_SPIRV_EXT;
+		create_infos[i].codeSize = code_size;
+		create_infos[i].pCode = code;
+		create_infos[i].pName = "main";
+		create_infos[i].setLayoutCount = layout_info->setLayoutCount;
+		create_infos[i].pSetLayouts = layout_info->pSetLayouts;
+		create_infos[i].pushConstantRangeCount = layout_info->pushConstantRangeCount;
+		create_infos[i].pPushConstantRanges = layout_info->pPushConstantRanges;
+		create_infos[i].pSpecializationInfo = specialization;
+	}
+
+	if (create_shaders_func(vkx_instance.device, 2, create_infos, vkx_get_allocator(VK_OBJECT_TYPE_SHADER_EXT), pipeline->shaders) != VK_SUCCESS) {
+		fprintf(stderr, "failed to create shader objects for %s and %s!\n", vert_shader_path, frag_shader_path);
+		exit(1);
+	}
+
+	unmap_file(&files[0]);
+	unmap_file(&files[1]);
+}
+
+VkxPipeline vkx_create_vertex_buffer_pipeline(
+		const char* vert_shader_path,
+		const char* frag_shader_path,
+		VkVertexInputBindingDescription binding_description,
+		VkVertexInputAttributeDescription* attribute_descriptions,
+		size_t attribute_descriptions_count,
+		VkPushConstantRange push_constant_range,
+		uint32_t num_textures,
+		bool use_texture_table,
+		bool alpha_blend,
+		VkDescriptorSetLayout extra_set_layout,
+		const VkSpecializationInfo* specialization
+) {
+	/*
+	 * Create a graphics pipeline for rendering from a vertex buffer.
+	 *
+	 * Normally vertex data would be in the vertex buffer, but for primitives it is still
+	 * useful as it can store offsets for other data fed in from the uniform buffer.
+	 *
+	 * After vkx_set_shader_objects(true) it's made of shader objects instead,
+	 * so bind it with vkx_cmd_bind_pipeline() rather than vkCmdBindPipeline().
+	 *
+	 * @param binding_description The vertex input binding description
+	 * @param attribute_descriptions The vertex input attribute descriptions
+	 * @param attribute_descriptions_count The number of vertex input attribute descriptions
+	 * @param push_constant_range The push constant range
+	 * @param num_textures The number of textures to make room for in the descriptor set layout
+	 * @param use_texture_table Add the bindless texture table as set VKX_TEXTURE_TABLE_SET.
+	 *                          vkx_texture_table_init() must have been called
+	 * @param alpha_blend Blend with the source alpha instead of overwriting.  Depth
+	 *                    writes are turned off so the caller must draw back to front.
+	 *                    With vkx_set_dynamic_render_state(true) this is only the
+	 *                    blending (if vkx_has_dynamic_blend() is false), and the
+	 *                    rest comes from vkx_cmd_set_render_state().  After
+	 *                    vkx_set_additive_blend(true) it adds instead, and writes depth
+	 * @param extra_set_layout Layout of one more set used by the shaders (e.g. for
+	 *                         resources only this pipeline needs), or VK_NULL_HANDLE.
+	 *                         It comes after the texture table set if there is one
+	 * @param specialization Constants for both of the shaders, or NULL
+	 */
+
+	VkxPipeline pipeline = {0};
+	pipeline.descriptor_set_layout = vkx_create_descriptor_set_layout(VKX_SET_ALL, num_textures, fragment_binding_types, fragment_bindings_count);
+	
+	// ----- Load the shaders -----
+	
+	// Shader objects are made from the code rather than modules.  The code's
+	// hashes are in the libraries' keys, so a reloaded shader gets new ones
+	uint64_t vert_code_hash = 0;
+	uint64_t frag_code_hash = 0;
+	VkShaderModule vert_shader_module = shader_objects ? VK_NULL_HANDLE : vkx_load_hashed_shader_module(vert_shader_path, &vert_code_hash);
+	VkShaderModule frag_shader_module = shader_objects ? VK_NULL_HANDLE : vkx_load_hashed_shader_module(frag_shader_path, &frag_code_hash);
+	
+	// ----- Create the graphics pipeline -----
+	VkPipelineShaderStageCreateInfo vert_shader_stage_info = {0};
+	vert_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	vert_shader_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
+	vert_shader_stage_info.module = vert_shader_module;
+	vert_shader_stage_info.pName = "main";
+	vert_shader_stage_info.pSpecializationInfo = specialization;
+
+	VkPipelineShaderStageCreateInfo frag_shader_stage_info = {0};
+	frag_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	frag_shader_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	frag_shader_stage_info.module = frag_shader_module;
+	frag_shader_stage_info.pName = "main";
+	frag_shader_stage_info.pSpecializationInfo = specialization;
+
+	VkPipelineShaderStageCreateInfo shader_stages[] = {vert_shader_stage_info, frag_shader_stage_info};
+	
+	VkPipelineVertexInputStateCreateInfo vertex_input_info = {0};
+	vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertex_input_info.vertexBindingDescriptionCount = 1;
+	vertex_input_info.vertexAttributeDescriptionCount = attribute_descriptions_count;
+	vertex_input_info.pVertexBindingDescriptions = &binding_description;
+	vertex_input_info.pVertexAttributeDescriptions = attribute_descriptions;
+
+	VkPipelineInputAssemblyStateCreateInfo input_assembly = {0};
+	input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	input_assembly.primitiveRestartEnable = VK_FALSE;
+
+	VkPipelineViewportStateCreateInfo viewport_state = {0};
+	viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+
+	VkPipelineRasterizationStateCreateInfo rasterizer = {0};
+	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.depthClampEnable = VK_FALSE;
+	rasterizer.rasterizerDiscardEnable = VK_FALSE;
+	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterizer.lineWidth = 1.0f;
+	rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	rasterizer.depthBiasEnable = VK_FALSE;
+
+	VkPipelineMultisampleStateCreateInfo multisampling = {0};
+	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling.sampleShadingEnable = VK_FALSE;
+	multisampling.rasterizationSamples = sample_count;
+	multisampling.alphaToCoverageEnable = alpha_to_coverage && !alpha_blend ? VK_TRUE : VK_FALSE;
+
+	VkPipelineColorBlendAttachmentState color_blend_attachment = {0};
+
+	if (alpha_blend) {
+		color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+		color_blend_attachment.blendEnable = VK_TRUE;
+		color_blend_attachment.srcColorBlendFactor = additive_blend ? VK_BLEND_FACTOR_ONE : VK_BLEND_FACTOR_SRC_ALPHA;
+		color_blend_attachment.dstColorBlendFactor = additive_blend ? VK_BLEND_FACTOR_ONE : VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+		color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+		color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		color_blend_attachment.dstAlphaBlendFactor = additive_blend ? VK_BLEND_FACTOR_ONE : VK_BLEND_FACTOR_ZERO;
+		color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+	}
+	else {
+		color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+		color_blend_attachment.blendEnable = VK_FALSE;
+	}
+
+	VkPipelineColorBlendStateCreateInfo color_blending = {0};
+	color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	color_blending.logicOpEnable = VK_FALSE;
+	color_blending.logicOp = VK_LOGIC_OP_COPY;
+	color_blending.attachmentCount = 1;
+	color_blending.pAttachments = &color_blend_attachment;
+	color_blending.blendConstants[0] = 0.0f;
+	color_blending.blendConstants[1] = 0.0f;
+	color_blending.blendConstants[2] = 0.0f;
+	color_blending.blendConstants[3] = 0.0f;
+
+	// The viewport and scissor counts are dynamic as well, like shader objects
+	// need, so the same vkCmdSetViewportWithCount() works for either
+	VkDynamicState dynamic_states[9] = {VK_DYNAMIC_STATE_VIEWPORT_WITH_COUNT, VK_DYNAMIC_STATE_SCISSOR_WITH_COUNT};
+	uint32_t dynamic_states_count = 2;
+	if (dynamic_render_state) {
+		// Core in 1.3
+		dynamic_states[dynamic_states_count++] = VK_DYNAMIC_STATE_CULL_MODE;
+		dynamic_states[dynamic_states_count++] = VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE;
+		dynamic_states[dynamic_states_count++] = VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE;
+		dynamic_states[dynamic_states_count++] = VK_DYNAMIC_STATE_DEPTH_COMPARE_OP;
+		if (vkx_instance.has_extended_dynamic_state3) {
+			dynamic_states[dynamic_states_count++] = VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT;
+			dynamic_states[dynamic_states_count++] = VK_DYNAMIC_STATE_COLOR_BLEND_EQUATION_EXT;
+		}
+	}
+	if (shading_rate) {
+		dynamic_states[dynamic_states_count++] = VK_DYNAMIC_STATE_FRAGMENT_SHADING_RATE_KHR;
+	}
+
+	VkPipelineDynamicStateCreateInfo dynamic_state = {0};
+	dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamic_state.dynamicStateCount = dynamic_states_count;
+	dynamic_state.pDynamicStates = dynamic_states;
+	
+
+	VkDescriptorSetLayout set_layouts[3] = {pipeline.descriptor_set_layout, VK_NULL_HANDLE, VK_NULL_HANDLE};
+	uint32_t set_layouts_count = 1;
+	if (use_texture_table) {
+		set_layouts[VKX_TEXTURE_TABLE_SET] = vkx_texture_table_get_layout();
+		set_layouts_count++;
+	}
+	// The caller owns this one, the pipeline cleanup doesn't destroy it
+	if (extra_set_layout != VK_NULL_HANDLE) {
+		set_layouts[set_layouts_count++] = extra_set_layout;
+	}
+
+	VkPipelineLayoutCreateInfo pipeline_layout_info = {0};
+	pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipeline_layout_info.setLayoutCount = set_layouts_count;
+	pipeline_layout_info.pSetLayouts = set_layouts;
+	pipeline_layout_info.pushConstantRangeCount = 1;
+	pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+	pipeline.layout = vkx_get_pipeline_layout(&pipeline_layout_info);
+
+	if (shader_objects) {
+		if (attribute_descriptions_count > VKX_MAX_VERTEX_ATTRIBUTES) {
+			fprintf(stderr, "Shader object pipelines can't have more than %d vertex attributes\n", VKX_MAX_VERTEX_ATTRIBUTES);
+			exit(1);
+		}
+		vkx_create_shader_objects(&pipeline, vert_shader_path, frag_shader_path, &pipeline_layout_info, specialization);
+		pipeline.vertex_binding.sType = VK_STRUCTURE_TYPE_VERTEX_INPUT_BINDING_DESCRIPTION_2_EXT;
+		pipeline.vertex_binding.binding = binding_description.binding;
+		pipeline.vertex_binding.stride = binding_description.stride;
+		pipeline.vertex_binding.inputRate = binding_description.inputRate;
+		pipeline.vertex_binding.divisor = 1;
+		for (size_t i = 0; i < attribute_descriptions_count; i++) {
+			VkVertexInputAttributeDescription2EXT* attribute = &pipeline.vertex_attributes[i];
+			attribute->sType = VK_STRUCTURE_TYPE_VERTEX_INPUT_ATTRIBUTE_DESCRIPTION_2_EXT;
+			attribute->location = attribute_descriptions[i].location;
+			attribute->binding = attribute_descriptions[i].binding;
+			attribute->format = attribute_descriptions[i].format;
+			attribute->offset = attribute_descriptions[i].offset;
+		}
+		pipeline.vertex_attributes_count = (uint32_t) attribute_descriptions_count;
+		pipeline.samples = sample_count;
+		pipeline.alpha_blend = alpha_blend;
+		pipeline.additive_blend = alpha_blend && additive_blend;
+		pipeline.alpha_to_coverage = multisampling.alphaToCoverageEnable == VK_TRUE;
+		pipeline.shading_rate = vkx_instance.has_fragment_shading_rate;
+
+		printf(" Shader objects created\n");
+		return pipeline;
+	}
+
+	VkFormat attachment_format = vkx_get_color_format();
+	VkPipelineRenderingCreateInfo rendering_info = {0};
+	rendering_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+	rendering_info.colorAttachmentCount = 1;
+	rendering_info.pColorAttachmentFormats = &attachment_format;
+	rendering_info.depthAttachmentFormat = vkx_get_depth_format();
+	rendering_info.viewMask = view_mask;
+
+	VkPipelineDepthStencilStateCreateInfo depth_stencil = {0};
+	depth_stencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depth_stencil.depthTestEnable = depth_buffer ? VK_TRUE : VK_FALSE;
+	depth_stencil.depthWriteEnable = depth_buffer && (!alpha_blend || additive_blend) ? VK_TRUE : VK_FALSE;
+	depth_stencil.depthCompareOp = VK_COMPARE_OP_LESS;
+	depth_stencil.depthBoundsTestEnable = VK_FALSE;
+	depth_stencil.minDepthBounds = 0.0f;
+	depth_stencil.maxDepthBounds = 1.0f;
+	depth_stencil.stencilTestEnable = VK_FALSE;
+	depth_stencil.front = (VkStencilOpState) {0};
+	depth_stencil.back = (VkStencilOpState) {0};
+
+	VkGraphicsPipelineCreateInfo pipeline_info = {0};
+	pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipeline_info.stageCount = 2;
+	pipeline_info.pStages = shader_stages;
+	pipeline_info.pVertexInputState = &vertex_input_info;
+	pipeline_info.pInputAssemblyState = &input_assembly;
+	pipeline_info.pViewportState = &viewport_state;
+	pipeline_info.pRasterizationState = &rasterizer;
+	pipeline_info.pMultisampleState = &multisampling;
+	pipeline_info.pColorBlendState = &color_blending;
+	pipeline_info.pDynamicState = &dynamic_state;
+	pipeline_info.layout = pipeline.layout;
+	pipeline_info.renderPass = VK_NULL_HANDLE;
+	pipeline_info.subpass = 0;
+	pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+	pipeline_info.pDepthStencilState = &depth_stencil;
+	pipeline_info.pNext = &rendering_info;
+	if (shading_rate_attachment) {
+		pipeline_info.flags = VK_PIPELINE_CREATE_RENDERING_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR;
+	}
+	pipeline.shading_rate = shading_rate;
+
+	if (pipeline_libraries) {
+		// Everything each part is made from, so the sprite variants (which
+		// mostly differ in their fragment state) share the rest.  The shaders
+		// are told apart by their paths, like the shader modules are
+		VkFormat depth_format = rendering_info.depthAttachmentFormat;
+		uint64_t shared_hash = vkx_hash_bytes(VKX_HASH_START, dynamic_states, sizeof(VkDynamicState) * dynamic_states_count);
+		shared_hash = vkx_hash_bytes(shared_hash, &view_mask, sizeof(view_mask));
+		shared_hash = vkx_hash_bytes(shared_hash, &depth_buffer, sizeof(depth_buffer));
+		shared_hash = vkx_hash_bytes(shared_hash, &pipeline_info.flags, sizeof(pipeline_info.flags));
+
+		uint64_t shader_hash = vkx_hash_bytes(shared_hash, &push_constant_range, sizeof(push_constant_range));
+		shader_hash = vkx_hash_bytes(shader_hash, &num_textures, sizeof(num_textures));
+		shader_hash = vkx_hash_bytes(shader_hash, &use_texture_table, sizeof(use_texture_table));
+		shader_hash = vkx_hash_bytes(shader_hash, &extra_set_layout, sizeof(extra_set_layout));
+		shader_hash = vkx_hash_bytes(shader_hash, fragment_binding_types, sizeof(VkDescriptorType) * fragment_bindings_count);
+		if (specialization != NULL) {
+			shader_hash = vkx_hash_bytes(shader_hash, specialization->pMapEntries, sizeof(VkSpecializationMapEntry) * specialization->mapEntryCount);
+			shader_hash = vkx_hash_bytes(shader_hash, specialization->pData, specialization->dataSize);
+		}
+
+		uint64_t output_hash = vkx_hash_bytes(shared_hash, &alpha_blend, sizeof(alpha_blend));
+		output_hash = vkx_hash_bytes(output_hash, &additive_blend, sizeof(additive_blend));
+		output_hash = vkx_hash_bytes(output_hash, &multisampling.rasterizationSamples, sizeof(multisampling.rasterizationSamples));
+		output_hash = vkx_hash_bytes(output_hash, &multisampling.alphaToCoverageEnable, sizeof(multisampling.alphaToCoverageEnable));
+
+		uint64_t hashes[4];
+		hashes[0] = vkx_hash_bytes(shared_hash, &binding_description, sizeof(binding_description));
+		hashes[0] = vkx_hash_bytes(hashes[0], attribute_descriptions, sizeof(VkVertexInputAttributeDescription) * attribute_descriptions_count);
+		hashes[1] = vkx_hash_bytes(shader_hash, vert_shader_path, strlen(vert_shader_path));
+		hashes[1] = vkx_hash_bytes(hashes[1], &vert_code_hash, sizeof(vert_code_hash));
+		hashes[2] = vkx_hash_bytes(shader_hash, frag_shader_path, strlen(frag_shader_path));
+		hashes[2] = vkx_hash_bytes(hashes[2], &frag_code_hash, sizeof(frag_code_hash));
+		hashes[2] = vkx_hash_bytes(hashes[2], &output_hash, sizeof(output_hash));
+		hashes[3] = vkx_hash_bytes(output_hash, &attachment_format, sizeof(VkFormat));
+		hashes[3] = vkx_hash_bytes(hashes[3], &depth_format, sizeof(depth_format));
+
+		pipeline.pipeline = vkx_link_pipeline_libraries(&pipeline_info, hashes);
+		printf(" Pipeline linked\n");
+		return pipeline;
+	}
+
+	if (vkCreateGraphicsPipelines(vkx_instance.device, pipeline_cache, 1, &pipeline_info, vkx_get_allocator(VK_OBJECT_TYPE_PIPELINE), &pipeline.pipeline) != VK_SUCCESS) {
+		fprintf(stderr, "failed to create graphics pipeline!");
+		exit(1);
+	}
+
+
+	printf(" Pipeline created\n");
+
+	return pipeline;
+}
+
+VkxPipeline vkx_create_mesh_pipeline(
+		const char* task_shader_path,
+		const char* mesh_shader_path,
+		const char* frag_shader_path,
+		VkPushConstantRange push_constant_range,
+		uint32_t num_textures,
+		bool use_texture_table,
+		const VkSpecializationInfo* specialization
+) {
+	/*
+	 * Create a graphics pipeline whose geometry comes from a task and a mesh
+	 * shader (VK_EXT_mesh_shader, see vkx_instance.has_mesh_shader) rather
+	 * than the vertex input, drawn with vkx_cmd_draw_mesh_tasks().
+	 *
+	 * It has the same set layout, rendering formats, multiview, multisampling
+	 * and dynamic state as the vertex buffer pipelines, so it draws into the
+	 * same passes with the same sets.  It doesn't blend, and is always a
+	 * pipeline rather than shader objects or libraries.
+	 *
+	 * @param task_shader_path The path to the task shader
+	 * @param mesh_shader_path The path to the mesh shader
+	 * @param frag_shader_path The path to the fragment shader
+	 * @param push_constant_range The push constant range
+	 * @param num_textures The number of textures to make room for in the descriptor set layout
+	 * @param use_texture_table Add the bindless texture table as set VKX_TEXTURE_TABLE_SET
+	 * @param specialization Constants for all of the shaders, or NULL
+	 */
+	if (!vkx_instance.has_mesh_shader) {
+		fprintf(stderr, "Mesh pipelines need VK_EXT_mesh_shader\n");
+		exit(1);
+	}
+	if (view_mask != 0 && !vkx_instance.has_multiview_mesh_shader) {
+		fprintf(stderr, "The device can't use mesh shaders with multiview\n");
+		exit(1);
+	}
+
+	if (draw_mesh_tasks_func == NULL) {
+		draw_mesh_tasks_func = (PFN_vkCmdDrawMeshTasksEXT) vkGetDeviceProcAddr(vkx_instance.device, "vkCmdDrawMeshTasksEXT");
+		if (draw_mesh_tasks_func == NULL) {
+			fprintf(stderr, "failed to load vkCmdDrawMeshTasksEXT!\n");
+			exit(1);
+		}
+	}
+
+	VkxPipeline pipeline = {0};
+	pipeline.descriptor_set_layout = vkx_create_descriptor_set_layout(VKX_SET_ALL, num_textures, fragment_binding_types, fragment_bindings_count);
+
+	// ----- Load the shaders -----
+	const char* shader_paths[3] = {task_shader_path, mesh_shader_path, frag_shader_path};
+	const VkShaderStageFlagBits shader_stage_bits[3] = {VK_SHADER_STAGE_TASK_BIT_EXT, VK_SHADER_STAGE_MESH_BIT_EXT, VK_SHADER_STAGE_FRAGMENT_BIT};
+
+	VkPipelineShaderStageCreateInfo shader_stages[3] = {0};
+	for (uint32_t i = 0; i < 3; i++) {
+		shader_stages[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shader_stages[i].stage = shader_stage_bits[i];
+		shader_stages[i].module = vkx_load_shader_module(shader_paths[i]);
+		shader_stages[i].pName = "main";
+		shader_stages[i].pSpecializationInfo = specialization;
+	}
+
+	// ----- Create the graphics pipeline -----
+	// No vertex input or input assembly, the mesh shader makes the triangles
+	VkPipelineViewportStateCreateInfo viewport_state = {0};
+	viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+
+	VkPipelineRasterizationStateCreateInfo rasterizer = {0};
+	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.depthClampEnable = VK_FALSE;
+	rasterizer.rasterizerDiscardEnable = VK_FALSE;
+	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterizer.lineWidth = 1.0f;
+	rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	rasterizer.depthBiasEnable = VK_FALSE;
+
+	VkPipelineMultisampleStateCreateInfo multisampling = {0};
+	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling.sampleShadingEnable = VK_FALSE;
+	multisampling.rasterizationSamples = sample_count;
+	multisampling.alphaToCoverageEnable = alpha_to_coverage ? VK_TRUE : VK_FALSE;
+
+	VkPipelineColorBlendAttachmentState color_blend_attachment = {0};
+	color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	color_blend_attachment.blendEnable = VK_FALSE;
+
+	VkPipelineColorBlendStateCreateInfo color_blending = {0};
+	color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	color_blending.logicOpEnable = VK_FALSE;
+	color_blending.logicOp = VK_LOGIC_OP_COPY;
+	color_blending.attachmentCount = 1;
+	color_blending.pAttachments = &color_blend_attachment;
+
+	// The same dynamic state as the vertex buffer pipelines, so
+	// vkx_cmd_set_render_state() works on it too
+	VkDynamicState dynamic_states[9] = {VK_DYNAMIC_STATE_VIEWPORT_WITH_COUNT, VK_DYNAMIC_STATE_SCISSOR_WITH_COUNT};
+	uint32_t dynamic_states_count = 2;
+	if (dynamic_render_state) {
+		dynamic_states[dynamic_states_count++] = VK_DYNAMIC_STATE_CULL_MODE;
+		dynamic_states[dynamic_states_count++] = VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE;
+		dynamic_states[dynamic_states_count++] = VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE;
+		dynamic_states[dynamic_states_count++] = VK_DYNAMIC_STATE_DEPTH_COMPARE_OP;
+		if (vkx_instance.has_extended_dynamic_state3) {
+			dynamic_states[dynamic_states_count++] = VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT;
+			dynamic_states[dynamic_states_count++] = VK_DYNAMIC_STATE_COLOR_BLEND_EQUATION_EXT;
+		}
+	}
+	if (shading_rate) {
+		dynamic_states[dynamic_states_count++] = VK_DYNAMIC_STATE_FRAGMENT_SHADING_RATE_KHR;
+	}
+
+	VkPipelineDynamicStateCreateInfo dynamic_state = {0};
+	dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamic_state.dynamicStateCount = dynamic_states_count;
+	dynamic_state.pDynamicStates = dynamic_states;
+
+	VkDescriptorSetLayout set_layouts[2] = {pipeline.descriptor_set_layout, VK_NULL_HANDLE};
+	uint32_t set_layouts_count = 1;
+	if (use_texture_table) {
+		set_layouts[VKX_TEXTURE_TABLE_SET] = vkx_texture_table_get_layout();
+		set_layouts_count++;
+	}
+
+	VkPipelineLayoutCreateInfo pipeline_layout_info = {0};
+	pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipeline_layout_info.setLayoutCount = set_layouts_count;
+	pipeline_layout_info.pSetLayouts = set_layouts;
+	pipeline_layout_info.pushConstantRangeCount = 1;
+	pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+	pipeline.layout = vkx_get_pipeline_layout(&pipeline_layout_info);
+
+	VkFormat attachment_format = vkx_get_color_format();
+	VkPipelineRenderingCreateInfo rendering_info = {0};
+	rendering_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+	rendering_info.colorAttachmentCount = 1;
+	rendering_info.pColorAttachmentFormats = &attachment_format;
+	rendering_info.depthAttachmentFormat = vkx_get_depth_format();
+	rendering_info.viewMask = view_mask;
+
+	VkPipelineDepthStencilStateCreateInfo depth_stencil = {0};
+	depth_stencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depth_stencil.depthTestEnable = depth_buffer ? VK_TRUE : VK_FALSE;
+	depth_stencil.depthWriteEnable = depth_buffer ? VK_TRUE : VK_FALSE;
+	depth_stencil.depthCompareOp = VK_COMPARE_OP_LESS;
+	depth_stencil.minDepthBounds = 0.0f;
+	depth_stencil.maxDepthBounds = 1.0f;
+
+	VkGraphicsPipelineCreateInfo pipeline_info = {0};
+	pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipeline_info.stageCount = 3;
+	pipeline_info.pStages = shader_stages;
+	pipeline_info.pViewportState = &viewport_state;
+	pipeline_info.pRasterizationState = &rasterizer;
+	pipeline_info.pMultisampleState = &multisampling;
+	pipeline_info.pColorBlendState = &color_blending;
+	pipeline_info.pDynamicState = &dynamic_state;
+	pipeline_info.pDepthStencilState = &depth_stencil;
+	pipeline_info.layout = pipeline.layout;
+	pipeline_info.pNext = &rendering_info;
+	if (shading_rate_attachment) {
+		pipeline_info.flags = VK_PIPELINE_CREATE_RENDERING_FRAGMENT_SHADING_RATE_ATTACHMENT_BIT_KHR;
+	}
+	pipeline.shading_rate = shading_rate;
 
-	VkDescriptorSetLayoutCreateInfo layout_info = {0};
-	layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	layout_info.bindingCount = 2;
-	layout_info.pBindings = layout_bindings;
-	
-	// Create the descriptor set layout
-	VkDescriptorSetLayout descriptor_set_layout;
-	if (vkCreateDescriptorSetLayout(vkx_instance.device, &layout_info, NULL, &descriptor_set_layout) != VK_SUCCESS) {
-		fprintf(stderr, "failed to create descriptor set layout!\n");
+	if (vkCreateGraphicsPipelines(vkx_instance.device, pipeline_cache, 1, &pipeline_info, vkx_get_allocator(VK_OBJECT_TYPE_PIPELINE), &pipeline.pipeline) != VK_SUCCESS) {
+		fprintf(stderr, "failed to create mesh pipeline!");
 		exit(1);
 	}
 
-	return descriptor_set_layout;
+	printf(" Mesh pipeline created\n");
+
+	return pipeline;
 }
 
-VkxPipeline vkx_create_vertex_buffer_pipeline(
+void vkx_cmd_draw_mesh_tasks(VkCommandBuffer command_buffer, uint32_t group_count_x, uint32_t group_count_y, uint32_t group_count_z) {
+	/*
+	 * Draw with a pipeline from vkx_create_mesh_pipeline(), launching this
+	 * many task shader workgroups
+	 */
+	draw_mesh_tasks_func(command_buffer, group_count_x, group_count_y, group_count_z);
+	VKX_COUNT_COMMANDS(VKX_STAT_DRAWS, 1);
+}
+
+VkxPipeline vkx_create_screen_pipeline(
 		const char* vert_shader_path,
 		const char* frag_shader_path,
-		VkVertexInputBindingDescription binding_description,
-		VkVertexInputAttributeDescription* attribute_descriptions,
-		size_t attribute_descriptions_count,
-		VkPushConstantRange push_constant_range,
-		uint32_t num_textures
+		uint32_t num_textures,
+		VkFormat color_format,
+		const VkSpecializationInfo* specialization
 ) {
 	/*
-	 * Create a graphics pipeline for rendering from a vertex buffer.
+	 * Create a graphics pipeline for a full screen pass, e.g. rendering the
+	 * offscreen image to the screen or a post-processing effect.
 	 *
-	 * Normally vertex data would be in the vertex buffer, but for primitives it is still
-	 * useful as it can store offsets for other data fed in from the uniform buffer.
+	 * The vertices for this pipeline must be hardcoded in the vertex shader.
+	 * Its set only has the uniform buffer and the textures, so it's bound with
+	 * the one dynamic offset.
 	 *
-	 * @param binding_description The vertex input binding description
-	 * @param attribute_descriptions The vertex input attribute descriptions
-	 * @param attribute_descriptions_count The number of vertex input attribute descriptions
-	 * @param push_constant_range The push constant range
-	 * @param num_textures The number of textures to make room for in the descriptor set layout
+	 * @param vert_shader_path The path to the vertex shader
+	 * @param frag_shader_path The path to the fragment shader
+	 * @param num_textures The number of textures the shaders sample
+	 * @param color_format Format of the attachment it renders to
+	 * @param specialization Constants for both of the shaders, or NULL
 	 */
-	// TODO: make this a parameter?
-	const bool BLEND_ENABLED = false;
-
 	VkxPipeline pipeline = {0};
-	pipeline.descriptor_set_layout = vkx_create_descriptor_set_layout(num_textures);
+	pipeline.descriptor_set_layout = vkx_create_descriptor_set_layout(VKX_SET_UNIFORMS | VKX_SET_TEXTURES, num_textures, NULL, 0);
 	
 	// ----- Load the shaders -----
 	
@@ -119,21 +2103,21 @@ VkxPipeline vkx_create_vertex_buffer_pipeline(
 	vert_shader_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
 	vert_shader_stage_info.module = vert_shader_module;
 	vert_shader_stage_info.pName = "main";
+	vert_shader_stage_info.pSpecializationInfo = specialization;
 
 	VkPipelineShaderStageCreateInfo frag_shader_stage_info = {0};
 	frag_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	frag_shader_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
 	frag_shader_stage_info.module = frag_shader_module;
 	frag_shader_stage_info.pName = "main";
+	frag_shader_stage_info.pSpecializationInfo = specialization;
 
 	VkPipelineShaderStageCreateInfo shader_stages[] = {vert_shader_stage_info, frag_shader_stage_info};
 	
 	VkPipelineVertexInputStateCreateInfo vertex_input_info = {0};
 	vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertex_input_info.vertexBindingDescriptionCount = 1;
-	vertex_input_info.vertexAttributeDescriptionCount = attribute_descriptions_count;
-	vertex_input_info.pVertexBindingDescriptions = &binding_description;
-	vertex_input_info.pVertexAttributeDescriptions = attribute_descriptions;
+	vertex_input_info.vertexBindingDescriptionCount = 0;
+	vertex_input_info.vertexAttributeDescriptionCount = 0;
 
 	VkPipelineInputAssemblyStateCreateInfo input_assembly = {0};
 	input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -142,8 +2126,6 @@ VkxPipeline vkx_create_vertex_buffer_pipeline(
 
 	VkPipelineViewportStateCreateInfo viewport_state = {0};
 	viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewport_state.viewportCount = 1;
-	viewport_state.scissorCount = 1;
 
 	VkPipelineRasterizationStateCreateInfo rasterizer = {0};
 	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -151,7 +2133,7 @@ VkxPipeline vkx_create_vertex_buffer_pipeline(
 	rasterizer.rasterizerDiscardEnable = VK_FALSE;
 	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
 	rasterizer.lineWidth = 1.0f;
-	rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+	rasterizer.cullMode = VK_CULL_MODE_NONE;
 	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
 	rasterizer.depthBiasEnable = VK_FALSE;
 
@@ -162,20 +2144,8 @@ VkxPipeline vkx_create_vertex_buffer_pipeline(
 
 	VkPipelineColorBlendAttachmentState color_blend_attachment = {0};
 
-	if (BLEND_ENABLED) {
-		color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-		color_blend_attachment.blendEnable = VK_TRUE;
-		color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-		color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-		color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
-		color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-		color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-		color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
-	}
-	else {
-		color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-		color_blend_attachment.blendEnable = VK_FALSE;
-	}
+	color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	color_blend_attachment.blendEnable = VK_FALSE;
 
 	VkPipelineColorBlendStateCreateInfo color_blending = {0};
 	color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
@@ -188,43 +2158,25 @@ VkxPipeline vkx_create_vertex_buffer_pipeline(
 	color_blending.blendConstants[2] = 0.0f;
 	color_blending.blendConstants[3] = 0.0f;
 
-	VkDynamicState dynamic_states[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+	VkDynamicState dynamic_states[] = {VK_DYNAMIC_STATE_VIEWPORT_WITH_COUNT, VK_DYNAMIC_STATE_SCISSOR_WITH_COUNT};
 
 	VkPipelineDynamicStateCreateInfo dynamic_state = {0};
 	dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
 	dynamic_state.dynamicStateCount = 2;
 	dynamic_state.pDynamicStates = dynamic_states;
-	
 
 	VkPipelineLayoutCreateInfo pipeline_layout_info = {0};
 	pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 	pipeline_layout_info.setLayoutCount = 1;
 	pipeline_layout_info.pSetLayouts = &pipeline.descriptor_set_layout;
-	pipeline_layout_info.pushConstantRangeCount = 1;
-	pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+	pipeline_layout_info.pushConstantRangeCount = 0;
 
-	if (vkCreatePipelineLayout(vkx_instance.device, &pipeline_layout_info, NULL, &pipeline.layout) != VK_SUCCESS) {
-		fprintf(stderr, "failed to create pipeline layout!");
-		exit(1);
-	}
+	pipeline.layout = vkx_get_pipeline_layout(&pipeline_layout_info);
 
 	VkPipelineRenderingCreateInfo rendering_info = {0};
 	rendering_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
 	rendering_info.colorAttachmentCount = 1;
-	rendering_info.pColorAttachmentFormats = &vkx_swap_chain.image_format;
-	rendering_info.depthAttachmentFormat = vkx_find_depth_format();
-
-	VkPipelineDepthStencilStateCreateInfo depth_stencil = {0};
-	depth_stencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-	depth_stencil.depthTestEnable = VK_TRUE;
-	depth_stencil.depthWriteEnable = VK_TRUE;
-	depth_stencil.depthCompareOp = VK_COMPARE_OP_LESS;
-	depth_stencil.depthBoundsTestEnable = VK_FALSE;
-	depth_stencil.minDepthBounds = 0.0f;
-	depth_stencil.maxDepthBounds = 1.0f;
-	depth_stencil.stencilTestEnable = VK_FALSE;
-	depth_stencil.front = (VkStencilOpState) {0};
-	depth_stencil.back = (VkStencilOpState) {0};
+	rendering_info.pColorAttachmentFormats = &color_format;
 
 	VkGraphicsPipelineCreateInfo pipeline_info = {0};
 	pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
@@ -241,62 +2193,68 @@ VkxPipeline vkx_create_vertex_buffer_pipeline(
 	pipeline_info.renderPass = VK_NULL_HANDLE;
 	pipeline_info.subpass = 0;
 	pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
-	pipeline_info.pDepthStencilState = &depth_stencil;
+	pipeline_info.pDepthStencilState = VK_NULL_HANDLE;
 	pipeline_info.pNext = &rendering_info;
 
-	if (vkCreateGraphicsPipelines(vkx_instance.device, VK_NULL_HANDLE, 1, &pipeline_info, NULL, &pipeline.pipeline) != VK_SUCCESS) {
+	if (vkCreateGraphicsPipelines(vkx_instance.device, pipeline_cache, 1, &pipeline_info, vkx_get_allocator(VK_OBJECT_TYPE_PIPELINE), &pipeline.pipeline) != VK_SUCCESS) {
 		fprintf(stderr, "failed to create graphics pipeline!");
 		exit(1);
 	}
 
-	vkDestroyShaderModule(vkx_instance.device, frag_shader_module, NULL);
-	vkDestroyShaderModule(vkx_instance.device, vert_shader_module, NULL);
 
 	printf(" Pipeline created\n");
 
 	return pipeline;
 }
 
-VkxPipeline vkx_create_screen_pipeline(
+VkxPipeline vkx_create_local_read_pipeline(
 		const char* vert_shader_path,
-		const char* frag_shader_path
+		const char* frag_shader_path,
+		const VkxPushSet* push_set,
+		const VkSpecializationInfo* specialization
 ) {
 	/*
-	 * Create a graphics pipeline for rendering the offscreen image to the screen.
+	 * Create a graphics pipeline for a full screen draw at the end of a pass
+	 * which reads each pixel of its colour attachment and writes it back, e.g.
+	 * a post-processing effect without the image going out to memory and back
+	 * (see vkx_frame_graph_add_local_read_attachment()).  It renders to the
+	 * same attachments as the vertex buffer pipelines, with the depth test off.
 	 *
-	 * The vertices for this pipeline must be hardcoded in the vertex shader.
+	 * The vertices must be hardcoded in the vertex shader.  Set 0 only has the
+	 * uniform buffer, bound with the one dynamic offset, and set 1 is push_set,
+	 * with the colour attachment as an input attachment.
 	 *
-	 * @param vert_shader_path The path to the vertex shader
-	 * @param frag_shader_path The path to the fragment shader
+	 * @param push_set Set 1, which its template is made for after this.  The
+	 *                 caller owns it
+	 * @param specialization Constants for both of the shaders, or NULL
 	 */
 	VkxPipeline pipeline = {0};
-	// Only 1 texture is needed for this
-	pipeline.descriptor_set_layout = vkx_create_descriptor_set_layout(1);
-	
+	pipeline.descriptor_set_layout = vkx_create_descriptor_set_layout(VKX_SET_UNIFORMS, 0, NULL, 0);
+
 	// ----- Load the shaders -----
-	
+
 	VkShaderModule vert_shader_module = vkx_load_shader_module(vert_shader_path);
 	VkShaderModule frag_shader_module = vkx_load_shader_module(frag_shader_path);
-	
+
 	// ----- Create the graphics pipeline -----
 	VkPipelineShaderStageCreateInfo vert_shader_stage_info = {0};
 	vert_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	vert_shader_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
 	vert_shader_stage_info.module = vert_shader_module;
 	vert_shader_stage_info.pName = "main";
+	vert_shader_stage_info.pSpecializationInfo = specialization;
 
 	VkPipelineShaderStageCreateInfo frag_shader_stage_info = {0};
 	frag_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	frag_shader_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
 	frag_shader_stage_info.module = frag_shader_module;
 	frag_shader_stage_info.pName = "main";
+	frag_shader_stage_info.pSpecializationInfo = specialization;
 
 	VkPipelineShaderStageCreateInfo shader_stages[] = {vert_shader_stage_info, frag_shader_stage_info};
-	
+
 	VkPipelineVertexInputStateCreateInfo vertex_input_info = {0};
 	vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertex_input_info.vertexBindingDescriptionCount = 0;
-	vertex_input_info.vertexAttributeDescriptionCount = 0;
 
 	VkPipelineInputAssemblyStateCreateInfo input_assembly = {0};
 	input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -305,8 +2263,6 @@ VkxPipeline vkx_create_screen_pipeline(
 
 	VkPipelineViewportStateCreateInfo viewport_state = {0};
 	viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-	viewport_state.viewportCount = 1;
-	viewport_state.scissorCount = 1;
 
 	VkPipelineRasterizationStateCreateInfo rasterizer = {0};
 	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -318,13 +2274,14 @@ VkxPipeline vkx_create_screen_pipeline(
 	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
 	rasterizer.depthBiasEnable = VK_FALSE;
 
+	// Input attachments can't be read per sample without sample shading, so
+	// the pass has a single one
 	VkPipelineMultisampleStateCreateInfo multisampling = {0};
 	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
 	multisampling.sampleShadingEnable = VK_FALSE;
 	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 
 	VkPipelineColorBlendAttachmentState color_blend_attachment = {0};
-
 	color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
 	color_blend_attachment.blendEnable = VK_FALSE;
 
@@ -334,33 +2291,184 @@ VkxPipeline vkx_create_screen_pipeline(
 	color_blending.logicOp = VK_LOGIC_OP_COPY;
 	color_blending.attachmentCount = 1;
 	color_blending.pAttachments = &color_blend_attachment;
-	color_blending.blendConstants[0] = 0.0f;
-	color_blending.blendConstants[1] = 0.0f;
-	color_blending.blendConstants[2] = 0.0f;
-	color_blending.blendConstants[3] = 0.0f;
 
-	VkDynamicState dynamic_states[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+	// Whatever the pass's depth attachment has in it is left alone
+	VkPipelineDepthStencilStateCreateInfo depth_stencil = {0};
+	depth_stencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depth_stencil.depthTestEnable = VK_FALSE;
+	depth_stencil.depthWriteEnable = VK_FALSE;
+	depth_stencil.depthCompareOp = VK_COMPARE_OP_ALWAYS;
+	depth_stencil.minDepthBounds = 0.0f;
+	depth_stencil.maxDepthBounds = 1.0f;
+
+	VkDynamicState dynamic_states[] = {VK_DYNAMIC_STATE_VIEWPORT_WITH_COUNT, VK_DYNAMIC_STATE_SCISSOR_WITH_COUNT};
 
 	VkPipelineDynamicStateCreateInfo dynamic_state = {0};
 	dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
 	dynamic_state.dynamicStateCount = 2;
 	dynamic_state.pDynamicStates = dynamic_states;
 
+	VkDescriptorSetLayout set_layouts[2] = {pipeline.descriptor_set_layout, push_set->layout};
+
 	VkPipelineLayoutCreateInfo pipeline_layout_info = {0};
 	pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipeline_layout_info.setLayoutCount = 1;
-	pipeline_layout_info.pSetLayouts = &pipeline.descriptor_set_layout;
+	pipeline_layout_info.setLayoutCount = 2;
+	pipeline_layout_info.pSetLayouts = set_layouts;
 	pipeline_layout_info.pushConstantRangeCount = 0;
 
-	if (vkCreatePipelineLayout(vkx_instance.device, &pipeline_layout_info, NULL, &pipeline.layout) != VK_SUCCESS) {
-		fprintf(stderr, "failed to create pipeline layout!");
+	pipeline.layout = vkx_get_pipeline_layout(&pipeline_layout_info);
+
+	// Without a VkRenderingInputAttachmentIndexInfoKHR the colour attachments
+	// are the input attachments with the same index
+	VkFormat pipeline_color_format = vkx_get_color_format();
+	VkPipelineRenderingCreateInfo rendering_info = {0};
+	rendering_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+	rendering_info.colorAttachmentCount = 1;
+	rendering_info.pColorAttachmentFormats = &pipeline_color_format;
+	rendering_info.depthAttachmentFormat = vkx_get_depth_format();
+
+	VkGraphicsPipelineCreateInfo pipeline_info = {0};
+	pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipeline_info.stageCount = 2;
+	pipeline_info.pStages = shader_stages;
+	pipeline_info.pVertexInputState = &vertex_input_info;
+	pipeline_info.pInputAssemblyState = &input_assembly;
+	pipeline_info.pViewportState = &viewport_state;
+	pipeline_info.pRasterizationState = &rasterizer;
+	pipeline_info.pMultisampleState = &multisampling;
+	pipeline_info.pColorBlendState = &color_blending;
+	pipeline_info.pDepthStencilState = &depth_stencil;
+	pipeline_info.pDynamicState = &dynamic_state;
+	pipeline_info.layout = pipeline.layout;
+	pipeline_info.renderPass = VK_NULL_HANDLE;
+	pipeline_info.subpass = 0;
+	pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+	pipeline_info.pNext = &rendering_info;
+
+	if (vkCreateGraphicsPipelines(vkx_instance.device, pipeline_cache, 1, &pipeline_info, vkx_get_allocator(VK_OBJECT_TYPE_PIPELINE), &pipeline.pipeline) != VK_SUCCESS) {
+		fprintf(stderr, "failed to create graphics pipeline!");
 		exit(1);
 	}
 
+	printf(" Pipeline created\n");
+
+	return pipeline;
+}
+
+VkxPipeline vkx_create_overlay_pipeline(
+		const char* vert_shader_path,
+		const char* frag_shader_path,
+		VkVertexInputBindingDescription binding_description,
+		VkVertexInputAttributeDescription* attribute_descriptions,
+		size_t attribute_descriptions_count,
+		VkPushConstantRange push_constant_range,
+		const VkxPushSet* push_set,
+		VkFormat color_format
+) {
+	/*
+	 * Create a graphics pipeline for drawing on top of a finished image, e.g.
+	 * a debug overlay in the screen pass.  It draws from a vertex buffer with
+	 * alpha blending and has no depth attachment.  The only descriptors are
+	 * the fragment shader's textures in push_set, so everything else the
+	 * shaders need comes from the vertices and push constants.
+	 *
+	 * @param binding_description The vertex input binding description
+	 * @param attribute_descriptions The vertex input attribute descriptions
+	 * @param attribute_descriptions_count The number of vertex input attribute descriptions
+	 * @param push_constant_range The push constant range
+	 * @param push_set Set 0, which its template is made for after this, or
+	 *                 NULL for no descriptor sets at all.  The caller owns it
+	 * @param color_format Format of the attachment it renders to
+	 */
+	VkxPipeline pipeline = {0};
+
+	// ----- Load the shaders -----
+
+	VkShaderModule vert_shader_module = vkx_load_shader_module(vert_shader_path);
+	VkShaderModule frag_shader_module = vkx_load_shader_module(frag_shader_path);
+
+	// ----- Create the graphics pipeline -----
+	VkPipelineShaderStageCreateInfo vert_shader_stage_info = {0};
+	vert_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	vert_shader_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
+	vert_shader_stage_info.module = vert_shader_module;
+	vert_shader_stage_info.pName = "main";
+
+	VkPipelineShaderStageCreateInfo frag_shader_stage_info = {0};
+	frag_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	frag_shader_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	frag_shader_stage_info.module = frag_shader_module;
+	frag_shader_stage_info.pName = "main";
+
+	VkPipelineShaderStageCreateInfo shader_stages[] = {vert_shader_stage_info, frag_shader_stage_info};
+
+	VkPipelineVertexInputStateCreateInfo vertex_input_info = {0};
+	vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	vertex_input_info.vertexBindingDescriptionCount = 1;
+	vertex_input_info.vertexAttributeDescriptionCount = attribute_descriptions_count;
+	vertex_input_info.pVertexBindingDescriptions = &binding_description;
+	vertex_input_info.pVertexAttributeDescriptions = attribute_descriptions;
+
+	VkPipelineInputAssemblyStateCreateInfo input_assembly = {0};
+	input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	input_assembly.primitiveRestartEnable = VK_FALSE;
+
+	VkPipelineViewportStateCreateInfo viewport_state = {0};
+	viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+
+	VkPipelineRasterizationStateCreateInfo rasterizer = {0};
+	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.depthClampEnable = VK_FALSE;
+	rasterizer.rasterizerDiscardEnable = VK_FALSE;
+	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterizer.lineWidth = 1.0f;
+	rasterizer.cullMode = VK_CULL_MODE_NONE;
+	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	rasterizer.depthBiasEnable = VK_FALSE;
+
+	VkPipelineMultisampleStateCreateInfo multisampling = {0};
+	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling.sampleShadingEnable = VK_FALSE;
+	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	VkPipelineColorBlendAttachmentState color_blend_attachment = {0};
+	color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	color_blend_attachment.blendEnable = VK_TRUE;
+	color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+	color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+	color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+	color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+	VkPipelineColorBlendStateCreateInfo color_blending = {0};
+	color_blending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	color_blending.logicOpEnable = VK_FALSE;
+	color_blending.logicOp = VK_LOGIC_OP_COPY;
+	color_blending.attachmentCount = 1;
+	color_blending.pAttachments = &color_blend_attachment;
+
+	VkDynamicState dynamic_states[] = {VK_DYNAMIC_STATE_VIEWPORT_WITH_COUNT, VK_DYNAMIC_STATE_SCISSOR_WITH_COUNT};
+
+	VkPipelineDynamicStateCreateInfo dynamic_state = {0};
+	dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamic_state.dynamicStateCount = 2;
+	dynamic_state.pDynamicStates = dynamic_states;
+
+	VkPipelineLayoutCreateInfo pipeline_layout_info = {0};
+	pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipeline_layout_info.setLayoutCount = push_set != NULL ? 1 : 0;
+	pipeline_layout_info.pSetLayouts = push_set != NULL ? &push_set->layout : NULL;
+	pipeline_layout_info.pushConstantRangeCount = 1;
+	pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+	pipeline.layout = vkx_get_pipeline_layout(&pipeline_layout_info);
+
 	VkPipelineRenderingCreateInfo rendering_info = {0};
 	rendering_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
 	rendering_info.colorAttachmentCount = 1;
-	rendering_info.pColorAttachmentFormats = &vkx_swap_chain.image_format;
+	rendering_info.pColorAttachmentFormats = &color_format;
 
 	VkGraphicsPipelineCreateInfo pipeline_info = {0};
 	pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
@@ -379,28 +2487,115 @@ VkxPipeline vkx_create_screen_pipeline(
 	pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
 	pipeline_info.pDepthStencilState = VK_NULL_HANDLE;
 	pipeline_info.pNext = &rendering_info;
+	if (push_set != NULL && push_set->uses_descriptor_buffer) {
+		pipeline_info.flags = VK_PIPELINE_CREATE_DESCRIPTOR_BUFFER_BIT_EXT;
+	}
 
-	if (vkCreateGraphicsPipelines(vkx_instance.device, VK_NULL_HANDLE, 1, &pipeline_info, NULL, &pipeline.pipeline) != VK_SUCCESS) {
+	if (vkCreateGraphicsPipelines(vkx_instance.device, pipeline_cache, 1, &pipeline_info, vkx_get_allocator(VK_OBJECT_TYPE_PIPELINE), &pipeline.pipeline) != VK_SUCCESS) {
 		fprintf(stderr, "failed to create graphics pipeline!");
 		exit(1);
 	}
 
-	vkDestroyShaderModule(vkx_instance.device, frag_shader_module, NULL);
-	vkDestroyShaderModule(vkx_instance.device, vert_shader_module, NULL);
-
 	printf(" Pipeline created\n");
 
 	return pipeline;
 }
 
+VkxPipeline vkx_create_compute_pipeline(
+		const char* comp_shader_path,
+		const VkDescriptorType* binding_types,
+		uint32_t bindings_count,
+		VkPushConstantRange push_constant_range,
+		const VkSpecializationInfo* specialization
+) {
+	/*
+	 * Create a compute pipeline.  The descriptor set layout has one descriptor per
+	 * binding, in bindings 0 to bindings_count - 1.
+	 *
+	 * @param comp_shader_path The path to the compute shader
+	 * @param binding_types The descriptor type of each binding (e.g. STORAGE_BUFFER,
+	 *                      or STORAGE_BUFFER_DYNAMIC for data in a ring buffer)
+	 * @param bindings_count The number of bindings
+	 * @param push_constant_range The push constant range (size 0 for none)
+	 * @param specialization Specialization constants of the shader, or NULL
+	 */
+	VkxPipeline pipeline = {0};
+
+	// ----- Descriptor set layout -----
+	VkDescriptorSetLayoutBinding* layout_bindings = malloc(sizeof(VkDescriptorSetLayoutBinding) * bindings_count);
+	if (layout_bindings == NULL) {
+		fprintf(stderr, "Failed to allocate compute layout bindings\n");
+		exit(1);
+	}
+
+	for (uint32_t i = 0; i < bindings_count; i++) {
+		layout_bindings[i] = (VkDescriptorSetLayoutBinding) {0};
+		layout_bindings[i].binding = i;
+		layout_bindings[i].descriptorType = binding_types[i];
+		layout_bindings[i].descriptorCount = 1;
+		layout_bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		layout_bindings[i].pImmutableSamplers = NULL;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layout_info = {0};
+	layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layout_info.bindingCount = bindings_count;
+	layout_info.pBindings = layout_bindings;
+
+	pipeline.descriptor_set_layout = vkx_get_descriptor_set_layout(&layout_info);
+
+	free(layout_bindings);
+
+	// ----- Pipeline layout -----
+	VkPipelineLayoutCreateInfo pipeline_layout_info = {0};
+	pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipeline_layout_info.setLayoutCount = 1;
+	pipeline_layout_info.pSetLayouts = &pipeline.descriptor_set_layout;
+	if (push_constant_range.size > 0) {
+		pipeline_layout_info.pushConstantRangeCount = 1;
+		pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+	}
+
+	pipeline.layout = vkx_get_pipeline_layout(&pipeline_layout_info);
+
+	// ----- Create the compute pipeline -----
+	VkShaderModule comp_shader_module = vkx_load_shader_module(comp_shader_path);
+
+	VkPipelineShaderStageCreateInfo comp_shader_stage_info = {0};
+	comp_shader_stage_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	comp_shader_stage_info.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	comp_shader_stage_info.module = comp_shader_module;
+	comp_shader_stage_info.pName = "main";
+	comp_shader_stage_info.pSpecializationInfo = specialization;
+
+	VkComputePipelineCreateInfo pipeline_info = {0};
+	pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipeline_info.stage = comp_shader_stage_info;
+	pipeline_info.layout = pipeline.layout;
+	pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+
+	if (vkCreateComputePipelines(vkx_instance.device, pipeline_cache, 1, &pipeline_info, vkx_get_allocator(VK_OBJECT_TYPE_PIPELINE), &pipeline.pipeline) != VK_SUCCESS) {
+		fprintf(stderr, "failed to create compute pipeline!");
+		exit(1);
+	}
+
+
+	printf(" Compute pipeline created\n");
+
+	return pipeline;
+}
+
 void vkx_cleanup_pipeline(VkxPipeline pipeline) {
 	/*
-	 * Clean up the graphics pipeline
+	 * Clean up the graphics pipeline.  Its layouts belong to the layout cache
 	 *
 	 * @param pipeline The pipeline to clean up
 	 */
-	vkDestroyDescriptorSetLayout(vkx_instance.device, pipeline.descriptor_set_layout, NULL);
-	vkDestroyPipeline(vkx_instance.device, pipeline.pipeline, NULL);
-	vkDestroyPipelineLayout(vkx_instance.device, pipeline.layout, NULL);
+	vkDestroyPipeline(vkx_instance.device, pipeline.pipeline, vkx_get_allocator(VK_OBJECT_TYPE_PIPELINE));
+	for (uint32_t i = 0; i < 2; i++) {
+		if (pipeline.shaders[i] != VK_NULL_HANDLE) {
+			destroy_shader_func(vkx_instance.device, pipeline.shaders[i], vkx_get_allocator(VK_OBJECT_TYPE_SHADER_EXT));
+		}
+	}
 }
 
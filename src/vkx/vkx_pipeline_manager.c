@@ -0,0 +1,439 @@
+/*
+ * Compiles vertex buffer pipelines on background threads.
+ *
+ * vkx_pipeline_manager_request() copies the description and returns a handle
+ * straight away, and one of the manager's threads creates the pipeline (through
+ * the shared pipeline cache, which is internally synchronised).  Until it is
+ * ready vkx_pipeline_manager_get() returns the fallback given with the request,
+ * e.g. a generic pipeline which can draw the same things less efficiently, so
+ * new materials can be requested mid-level without stalling the frame.
+ *
+ * Requests are compiled in the order they were made.  With no threads they are
+ * compiled inside the request.  The manager owns the pipelines and destroys
+ * them at cleanup, after waiting for any which are still being compiled.
+ *
+ * When a shader changes (hot_reload.c) vkx_pipeline_manager_reload() has the
+ * pipelines using it compiled again in the same way, after any new requests.
+ * The old pipeline is drawn with until vkx_pipeline_manager_swap_reloaded()
+ * puts the new one in its place between frames.
+ */
+
+#include "vkx/vkx_pipeline_manager.h"
+
+#include <SDL3/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace.h"
+#include "vkx/vkx_pipeline.h"
+
+typedef enum {
+	VKX_PIPELINE_PENDING,
+	VKX_PIPELINE_COMPILING,
+	VKX_PIPELINE_READY,
+} VkxPipelineState;
+
+typedef enum {
+	VKX_RELOAD_NONE,
+	VKX_RELOAD_QUEUED,
+	VKX_RELOAD_COMPILING,
+	VKX_RELOAD_READY,
+} VkxReloadState;
+
+typedef struct {
+	VkxPipelineDesc desc;
+	const VkxPipeline* fallback;
+	VkxPipeline pipeline;
+	// VkxPipelineState, only READY once the pipeline is written
+	SDL_AtomicInt state;
+	// The pipeline compiled again, until it's swapped in.  These are protected
+	// by manager_mutex
+	VkxPipeline reloaded;
+	VkxReloadState reload_state;
+	// The shaders changed again while it was compiling, so it's out of date
+	bool reload_again;
+} VkxPipelineSlot;
+
+static VkxPipelineSlot slots[VKX_PIPELINE_MANAGER_MAX_PIPELINES];
+
+static SDL_Thread* threads[VKX_PIPELINE_MANAGER_MAX_THREADS] = {0};
+static uint32_t threads_count = 0;
+
+// Protects everything below
+static SDL_Mutex* manager_mutex = NULL;
+// Signalled when a request is made (or we are quitting)
+static SDL_Condition* request_condition = NULL;
+// Signalled when a pipeline is ready
+static SDL_Condition* ready_condition = NULL;
+
+static uint32_t slots_count = 0;
+// The next slot for a thread to pick up
+static uint32_t next_pending = 0;
+static uint32_t compiled_count = 0;
+static bool quitting = false;
+// Slots to compile again, in the order they were asked for
+static uint32_t reload_queue[VKX_PIPELINE_MANAGER_MAX_PIPELINES];
+static uint32_t reload_queue_count = 0;
+static uint32_t reloads_compiling = 0;
+
+static VkxPipeline vkx_pipeline_manager_create(const VkxPipelineDesc* desc) {
+
+	VkSpecializationInfo specialization = {0};
+	specialization.mapEntryCount = desc->specialization_entries_count;
+	specialization.pMapEntries = desc->specialization_entries;
+	specialization.dataSize = desc->specialization_data_size;
+	specialization.pData = desc->specialization_data;
+
+	trace_begin("compile pipeline");
+	VkxPipeline pipeline = vkx_create_vertex_buffer_pipeline(
+		desc->vert_shader_path,
+		desc->frag_shader_path,
+		desc->binding_description,
+		(VkVertexInputAttributeDescription*) desc->attribute_descriptions,
+		desc->attribute_descriptions_count,
+		desc->push_constant_range,
+		desc->num_textures,
+		desc->use_texture_table,
+		desc->alpha_blend,
+		desc->extra_set_layout,
+		desc->specialization_entries_count > 0 ? &specialization : NULL
+	);
+	trace_end();
+
+	return pipeline;
+}
+
+static void vkx_pipeline_manager_compile(VkxPipelineSlot* slot) {
+	slot->pipeline = vkx_pipeline_manager_create(&slot->desc);
+	SDL_SetAtomicInt(&slot->state, VKX_PIPELINE_READY);
+}
+
+static void vkx_pipeline_manager_queue_reload(uint32_t handle) {
+	/*
+	 * Put a slot at the back of the reload queue, with the mutex locked
+	 */
+	slots[handle].reload_state = VKX_RELOAD_QUEUED;
+	reload_queue[reload_queue_count++] = handle;
+	SDL_SignalCondition(request_condition);
+}
+
+static void vkx_pipeline_manager_compile_reload(void) {
+	/*
+	 * Compile the slot at the front of the reload queue, with the mutex locked
+	 * (which is unlocked while compiling)
+	 */
+	uint32_t handle = reload_queue[0];
+	reload_queue_count--;
+	memmove(reload_queue, reload_queue + 1, sizeof(uint32_t) * reload_queue_count);
+
+	VkxPipelineSlot* slot = &slots[handle];
+	slot->reload_state = VKX_RELOAD_COMPILING;
+	reloads_compiling++;
+	SDL_UnlockMutex(manager_mutex);
+
+	VkxPipeline pipeline = vkx_pipeline_manager_create(&slot->desc);
+
+	SDL_LockMutex(manager_mutex);
+	reloads_compiling--;
+	// Nothing has used it yet, so it can go straight away
+	if (slot->reload_again) {
+		slot->reload_again = false;
+		vkx_cleanup_pipeline(pipeline);
+		vkx_pipeline_manager_queue_reload(handle);
+		return;
+	}
+	slot->reloaded = pipeline;
+	slot->reload_state = VKX_RELOAD_READY;
+}
+
+static int vkx_pipeline_manager_thread_main(void* data) {
+	(void) data;
+
+	trace_set_thread_name("pipeline compiler");
+
+	SDL_LockMutex(manager_mutex);
+	for (;;) {
+		while (!quitting && next_pending == slots_count && reload_queue_count == 0) {
+			SDL_WaitCondition(request_condition, manager_mutex);
+		}
+
+		// Anything left over isn't needed any more
+		if (quitting) {
+			break;
+		}
+
+		// New requests go before the reloads, which have a pipeline already
+		if (next_pending == slots_count) {
+			vkx_pipeline_manager_compile_reload();
+			continue;
+		}
+
+		VkxPipelineSlot* slot = &slots[next_pending++];
+		SDL_SetAtomicInt(&slot->state, VKX_PIPELINE_COMPILING);
+		SDL_UnlockMutex(manager_mutex);
+
+		vkx_pipeline_manager_compile(slot);
+
+		SDL_LockMutex(manager_mutex);
+		compiled_count++;
+		SDL_BroadcastCondition(ready_condition);
+	}
+	SDL_UnlockMutex(manager_mutex);
+
+	return 0;
+}
+
+void vkx_pipeline_manager_init(uint32_t num_threads) {
+	/*
+	 * Start the compiler threads, after vkx_init_pipeline_cache()
+	 *
+	 * @param num_threads The number of threads to compile on, or 0 to compile
+	 *                    each pipeline inside its request
+	 */
+	if (num_threads > VKX_PIPELINE_MANAGER_MAX_THREADS) {
+		num_threads = VKX_PIPELINE_MANAGER_MAX_THREADS;
+	}
+
+	manager_mutex = SDL_CreateMutex();
+	request_condition = SDL_CreateCondition();
+	ready_condition = SDL_CreateCondition();
+
+	if (manager_mutex == NULL || request_condition == NULL || ready_condition == NULL) {
+		fprintf(stderr, "Failed to create pipeline manager sync objects: %s\n", SDL_GetError());
+		exit(1);
+	}
+
+	memset(slots, 0, sizeof(slots));
+	slots_count = 0;
+	next_pending = 0;
+	compiled_count = 0;
+	quitting = false;
+	reload_queue_count = 0;
+	reloads_compiling = 0;
+
+	for (threads_count = 0; threads_count < num_threads; threads_count++) {
+		threads[threads_count] = SDL_CreateThread(vkx_pipeline_manager_thread_main, "pipeline_compiler", NULL);
+		if (threads[threads_count] == NULL) {
+			fprintf(stderr, "Failed to create pipeline compiler thread: %s\n", SDL_GetError());
+			exit(1);
+		}
+	}
+}
+
+void vkx_pipeline_manager_cleanup(void) {
+	/*
+	 * Stop the threads (once they have finished the pipelines they are on) and
+	 * destroy all of the pipelines which were compiled
+	 */
+	SDL_LockMutex(manager_mutex);
+	quitting = true;
+	SDL_BroadcastCondition(request_condition);
+	SDL_UnlockMutex(manager_mutex);
+
+	for (uint32_t i = 0; i < threads_count; i++) {
+		SDL_WaitThread(threads[i], NULL);
+		threads[i] = NULL;
+	}
+	threads_count = 0;
+
+	for (uint32_t i = 0; i < slots_count; i++) {
+		if (SDL_GetAtomicInt(&slots[i].state) == VKX_PIPELINE_READY) {
+			vkx_cleanup_pipeline(slots[i].pipeline);
+		}
+		if (slots[i].reload_state == VKX_RELOAD_READY) {
+			vkx_cleanup_pipeline(slots[i].reloaded);
+		}
+	}
+	slots_count = 0;
+	reload_queue_count = 0;
+
+	SDL_DestroyCondition(ready_condition);
+	SDL_DestroyCondition(request_condition);
+	SDL_DestroyMutex(manager_mutex);
+	ready_condition = NULL;
+	request_condition = NULL;
+	manager_mutex = NULL;
+}
+
+void vkx_pipeline_desc_set_specialization(VkxPipelineDesc* desc, const VkSpecializationInfo* specialization) {
+	/*
+	 * Copy the specialization constants into the description
+	 *
+	 * @param specialization The constants, or NULL for none
+	 */
+	if (specialization == NULL) {
+		desc->specialization_entries_count = 0;
+		desc->specialization_data_size = 0;
+		return;
+	}
+
+	if (specialization->mapEntryCount > VKX_PIPELINE_MANAGER_MAX_SPECIALIZATION_ENTRIES
+			|| specialization->dataSize > VKX_PIPELINE_MANAGER_MAX_SPECIALIZATION_SIZE) {
+		fprintf(stderr, "Too many specialization constants for the pipeline manager\n");
+		exit(1);
+	}
+
+	memcpy(desc->specialization_entries, specialization->pMapEntries, sizeof(VkSpecializationMapEntry) * specialization->mapEntryCount);
+	desc->specialization_entries_count = specialization->mapEntryCount;
+	memcpy(desc->specialization_data, specialization->pData, specialization->dataSize);
+	desc->specialization_data_size = specialization->dataSize;
+}
+
+uint32_t vkx_pipeline_manager_request(const VkxPipelineDesc* desc, const VkxPipeline* fallback) {
+	/*
+	 * Ask for a pipeline to be compiled in the background
+	 *
+	 * @param desc The pipeline, which is copied
+	 * @param fallback Returned by vkx_pipeline_manager_get() until the pipeline
+	 *                 is ready (it has to stay valid until then), or NULL
+	 *
+	 * @return The handle of the pipeline
+	 */
+	if (desc->attribute_descriptions_count > VKX_PIPELINE_MANAGER_MAX_ATTRIBUTES) {
+		fprintf(stderr, "Too many vertex attributes for the pipeline manager (max %d)\n", VKX_PIPELINE_MANAGER_MAX_ATTRIBUTES);
+		exit(1);
+	}
+
+	SDL_LockMutex(manager_mutex);
+	if (slots_count >= VKX_PIPELINE_MANAGER_MAX_PIPELINES) {
+		fprintf(stderr, "Too many pipelines in the pipeline manager (max %d)\n", VKX_PIPELINE_MANAGER_MAX_PIPELINES);
+		exit(1);
+	}
+
+	uint32_t handle = slots_count;
+	VkxPipelineSlot* slot = &slots[handle];
+	slot->desc = *desc;
+	slot->fallback = fallback;
+	SDL_SetAtomicInt(&slot->state, VKX_PIPELINE_PENDING);
+	slots_count++;
+
+	if (threads_count == 0) {
+		next_pending = slots_count;
+		SDL_UnlockMutex(manager_mutex);
+
+		vkx_pipeline_manager_compile(slot);
+
+		SDL_LockMutex(manager_mutex);
+		compiled_count++;
+	}
+	else {
+		SDL_SignalCondition(request_condition);
+	}
+	SDL_UnlockMutex(manager_mutex);
+
+	return handle;
+}
+
+bool vkx_pipeline_manager_is_ready(uint32_t handle) {
+	return SDL_GetAtomicInt(&slots[handle].state) == VKX_PIPELINE_READY;
+}
+
+const VkxPipeline* vkx_pipeline_manager_get(uint32_t handle) {
+	/*
+	 * The pipeline to draw with, which can be called from any thread
+	 *
+	 * @param handle From vkx_pipeline_manager_request()
+	 *
+	 * @return The pipeline if it is ready, otherwise the request's fallback
+	 */
+	VkxPipelineSlot* slot = &slots[handle];
+	if (SDL_GetAtomicInt(&slot->state) == VKX_PIPELINE_READY) {
+		return &slot->pipeline;
+	}
+	return slot->fallback;
+}
+
+void vkx_pipeline_manager_wait_all(void) {
+	/*
+	 * Block until every pipeline requested so far is ready (e.g. for loading
+	 * screens, or to measure how long the compiles take)
+	 */
+	SDL_LockMutex(manager_mutex);
+	while (compiled_count < slots_count) {
+		SDL_WaitCondition(ready_condition, manager_mutex);
+	}
+	SDL_UnlockMutex(manager_mutex);
+}
+
+uint32_t vkx_pipeline_manager_reload(const char* shader_path) {
+	/*
+	 * Compile every pipeline using a shader again in the background, after
+	 * vkx_reload_shader_module() has forgotten the old code.  With no threads
+	 * they are compiled here instead
+	 *
+	 * @param shader_path The .spv file of either of the pipelines' shaders
+	 *
+	 * @return How many pipelines use it
+	 */
+	uint32_t count = 0;
+
+	SDL_LockMutex(manager_mutex);
+	for (uint32_t i = 0; i < slots_count; i++) {
+		VkxPipelineSlot* slot = &slots[i];
+		if (strcmp(slot->desc.vert_shader_path, shader_path) != 0 && strcmp(slot->desc.frag_shader_path, shader_path) != 0) {
+			continue;
+		}
+		count++;
+
+		switch (slot->reload_state) {
+		case VKX_RELOAD_NONE:
+			vkx_pipeline_manager_queue_reload(i);
+			break;
+		case VKX_RELOAD_QUEUED:
+			// It'll load the new code when it gets there
+			break;
+		case VKX_RELOAD_COMPILING:
+			slot->reload_again = true;
+			break;
+		case VKX_RELOAD_READY:
+			// Hasn't been swapped in yet, so it was never drawn with
+			vkx_cleanup_pipeline(slot->reloaded);
+			vkx_pipeline_manager_queue_reload(i);
+			break;
+		}
+	}
+
+	while (threads_count == 0 && reload_queue_count > 0) {
+		vkx_pipeline_manager_compile_reload();
+	}
+	SDL_UnlockMutex(manager_mutex);
+
+	return count;
+}
+
+uint32_t vkx_pipeline_manager_swap_reloaded(void) {
+	/*
+	 * Put the pipelines which have finished compiling again in place of the old
+	 * ones, between frames, on the thread which records them.  The old ones are
+	 * destroyed once the frames in flight are done with them
+	 *
+	 * @return How many were swapped, e.g. for recording static commands again
+	 */
+	uint32_t swapped = 0;
+
+	SDL_LockMutex(manager_mutex);
+	for (uint32_t i = 0; i < slots_count; i++) {
+		VkxPipelineSlot* slot = &slots[i];
+		if (slot->reload_state != VKX_RELOAD_READY || SDL_GetAtomicInt(&slot->state) != VKX_PIPELINE_READY) {
+			continue;
+		}
+
+		vkx_defer_cleanup_pipeline(slot->pipeline);
+		slot->pipeline = slot->reloaded;
+		memset(&slot->reloaded, 0, sizeof(slot->reloaded));
+		slot->reload_state = VKX_RELOAD_NONE;
+		swapped++;
+	}
+
+	// With nothing compiling, no pipeline can be using the old shader modules
+	bool idle = compiled_count == slots_count && reload_queue_count == 0 && reloads_compiling == 0;
+	SDL_UnlockMutex(manager_mutex);
+
+	if (idle) {
+		vkx_destroy_retired_shader_modules();
+	}
+
+	return swapped;
+}
@@ -0,0 +1,252 @@
+/*
+ * Conversions of RGBA8 pixels on their way into a texture, e.g. straight
+ * into the staging buffer by vkx_upload_images().
+ *
+ * Everything asked for is done to a row before moving onto the next, so each
+ * pixel is read from memory once however many conversions there are, and the
+ * image is split into bands of rows over the worker pool.  The swizzle, the
+ * premultiply and the check for visible pixels each do the same thing to
+ * every pixel of a row with no branches, so the compiler vectorises them
+ * (SSE2, AVX2 or NEON, whichever it's building for) without anything written
+ * for a particular instruction set.  Only the bleeding branches, on the
+ * transparent pixels, as it's their neighbours which matter there.
+ *
+ * With VKX_PIXELS_BOUNDS each band is a row of regions, so each region's
+ * bounds are only written by one job.
+ */
+
+#include "vkx/vkx_pixels.h"
+#include "jobs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Rows in each job, when there are no regions to split the jobs by
+#define VKX_PIXELS_JOB_ROWS 64
+
+typedef struct {
+	const VkxPixelConversion* conversion;
+	const uint8_t* src;
+	uint8_t* dst;
+	uint32_t width;
+	uint32_t height;
+	uint32_t band_rows;
+	uint32_t region_width;
+	uint32_t region_height;
+	// Of the alpha in the source
+	uint32_t src_alpha;
+} VkxPixelsJob;
+
+static void vkx_pixels_swizzle_row(const uint8_t* swizzle, const uint8_t* src, uint8_t* dst, uint32_t width) {
+	/*
+	 * Move the channels by shifting each pixel as a little endian word, which
+	 * works the same for every pixel of a row whatever the swizzle, unlike
+	 * indexing its bytes
+	 */
+	uint32_t r = swizzle[0] * 8u;
+	uint32_t g = swizzle[1] * 8u;
+	uint32_t b = swizzle[2] * 8u;
+	uint32_t a = swizzle[3] * 8u;
+	for (size_t x = 0; x < width; x++) {
+		const uint8_t* in = &src[x * 4];
+		uint32_t pixel = (uint32_t) in[0] | (uint32_t) in[1] << 8 | (uint32_t) in[2] << 16 | (uint32_t) in[3] << 24;
+		uint32_t out = (pixel >> r & 0xff) | (pixel >> g & 0xff) << 8 | (pixel >> b & 0xff) << 16 | (pixel >> a & 0xff) << 24;
+		dst[x * 4 + 0] = (uint8_t) out;
+		dst[x * 4 + 1] = (uint8_t) (out >> 8);
+		dst[x * 4 + 2] = (uint8_t) (out >> 16);
+		dst[x * 4 + 3] = (uint8_t) (out >> 24);
+	}
+}
+
+static void vkx_pixels_bleed_row(const VkxPixelsJob* job, uint32_t y, uint8_t* dst) {
+	/*
+	 * Give the transparent pixels of a row the average colour of the visible
+	 * ones of the 8 around them, from the source so it's the same whichever
+	 * order the rows are done in
+	 */
+	const uint8_t* swizzle = job->conversion->swizzle;
+	bool swizzled = (job->conversion->flags & VKX_PIXELS_SWIZZLE) != 0;
+	size_t stride = (size_t) job->width * 4;
+	const uint8_t* row = job->src + y * stride;
+
+	for (uint32_t x = 0; x < job->width; x++) {
+		if (row[x * 4 + job->src_alpha] != 0) {
+			continue;
+		}
+
+		uint32_t sums[3] = {0};
+		uint32_t count = 0;
+		for (int32_t dy = -1; dy <= 1; dy++) {
+			int64_t ny = (int64_t) y + dy;
+			if (ny < 0 || ny >= job->height) {
+				continue;
+			}
+			for (int32_t dx = -1; dx <= 1; dx++) {
+				int64_t nx = (int64_t) x + dx;
+				if (nx < 0 || nx >= job->width) {
+					continue;
+				}
+				const uint8_t* other = job->src + (size_t) ny * stride + (size_t) nx * 4;
+				if (other[job->src_alpha] == 0) {
+					continue;
+				}
+				for (uint32_t c = 0; c < 3; c++) {
+					sums[c] += other[swizzled ? swizzle[c] : c];
+				}
+				count++;
+			}
+		}
+
+		if (count > 0) {
+			for (uint32_t c = 0; c < 3; c++) {
+				dst[x * 4 + c] = (uint8_t) ((sums[c] + count / 2) / count);
+			}
+		}
+	}
+}
+
+static uint8_t vkx_pixels_premultiply(uint32_t colour, uint32_t alpha) {
+	// colour * alpha / 255, rounded, without a divide
+	uint32_t t = colour * alpha + 128;
+	return (uint8_t) ((t + (t >> 8)) >> 8);
+}
+
+static void vkx_pixels_premultiply_row(uint8_t* dst, uint32_t width) {
+	for (size_t x = 0; x < width; x++) {
+		uint8_t* pixel = &dst[x * 4];
+		uint32_t alpha = pixel[3];
+		pixel[0] = vkx_pixels_premultiply(pixel[0], alpha);
+		pixel[1] = vkx_pixels_premultiply(pixel[1], alpha);
+		pixel[2] = vkx_pixels_premultiply(pixel[2], alpha);
+	}
+}
+
+static void vkx_pixels_bound_row(const VkxPixelsJob* job, const uint8_t* alpha, int32_t region_y, VkxPixelBounds* bounds) {
+	/*
+	 * Grow the bounds of a row of regions by the visible pixels in one of its
+	 * rows
+	 *
+	 * @param alpha The row's alpha, every 4th byte
+	 * @param region_y The row's y in its regions
+	 */
+	for (uint32_t region = 0; region < job->conversion->regions_x; region++) {
+		const uint8_t* start = &alpha[(size_t) region * job->region_width * 4];
+
+		// Most rows of most regions are all or none visible, which is found
+		// out without branching
+		uint32_t any = 0;
+		for (uint32_t x = 0; x < job->region_width; x++) {
+			any |= start[x * 4];
+		}
+		if (any == 0) {
+			continue;
+		}
+
+		int32_t first = 0;
+		while (start[first * 4] == 0) {
+			first++;
+		}
+		int32_t last = (int32_t) job->region_width - 1;
+		while (start[last * 4] == 0) {
+			last--;
+		}
+
+		VkxPixelBounds* bound = &bounds[region];
+		bound->min_x = first < bound->min_x ? first : bound->min_x;
+		bound->max_x = last > bound->max_x ? last : bound->max_x;
+		bound->min_y = region_y < bound->min_y ? region_y : bound->min_y;
+		bound->max_y = region_y > bound->max_y ? region_y : bound->max_y;
+	}
+}
+
+static void vkx_pixels_convert_job(size_t start, size_t end, void* data) {
+	/*
+	 * Convert the bands [start, end) of rows
+	 */
+	const VkxPixelsJob* job = data;
+	const VkxPixelConversion* conversion = job->conversion;
+	size_t stride = (size_t) job->width * 4;
+
+	for (size_t band = start; band < end; band++) {
+		uint32_t first_row = (uint32_t) band * job->band_rows;
+		uint32_t last_row = first_row + job->band_rows < job->height ? first_row + job->band_rows : job->height;
+
+		// Only the whole regions have bounds
+		VkxPixelBounds* bounds = NULL;
+		if ((conversion->flags & VKX_PIXELS_BOUNDS) && band < conversion->regions_y) {
+			bounds = &conversion->bounds[band * conversion->regions_x];
+			for (uint32_t region = 0; region < conversion->regions_x; region++) {
+				bounds[region].min_x = (int32_t) job->region_width;
+				bounds[region].min_y = (int32_t) job->region_height;
+				bounds[region].max_x = -1;
+				bounds[region].max_y = -1;
+			}
+		}
+
+		for (uint32_t y = first_row; y < last_row; y++) {
+			const uint8_t* src = job->src + y * stride;
+			uint8_t* dst = job->dst != NULL ? job->dst + y * stride : NULL;
+
+			if (dst != NULL) {
+				if (conversion->flags & VKX_PIXELS_SWIZZLE) {
+					vkx_pixels_swizzle_row(conversion->swizzle, src, dst, job->width);
+				}
+				else {
+					memcpy(dst, src, stride);
+				}
+				if (conversion->flags & VKX_PIXELS_BLEED) {
+					vkx_pixels_bleed_row(job, y, dst);
+				}
+				if (conversion->flags & VKX_PIXELS_PREMULTIPLY) {
+					vkx_pixels_premultiply_row(dst, job->width);
+				}
+			}
+
+			if (bounds != NULL) {
+				const uint8_t* alpha = dst != NULL ? dst + 3 : src + job->src_alpha;
+				vkx_pixels_bound_row(job, alpha, (int32_t) (y - first_row), bounds);
+			}
+		}
+	}
+}
+
+void vkx_convert_pixels(const VkxPixelConversion* conversion, const uint8_t* src, uint8_t* dst, uint32_t width, uint32_t height) {
+	/*
+	 * Copy RGBA8 pixels, converting them on the way, split over the worker
+	 * pool
+	 *
+	 * @param conversion What to do to them
+	 * @param src Tightly packed pixels
+	 * @param dst Where to write the same number of them, which can't be src.
+	 *            NULL to only find the bounds
+	 */
+	if (dst == NULL && (conversion->flags & ~VKX_PIXELS_BOUNDS) != 0) {
+		fprintf(stderr, "Only the bounds can be found without writing the pixels\n");
+		exit(1);
+	}
+
+	VkxPixelsJob job = {0};
+	job.conversion = conversion;
+	job.src = src;
+	job.dst = dst;
+	job.width = width;
+	job.height = height;
+	job.band_rows = VKX_PIXELS_JOB_ROWS;
+	job.src_alpha = (conversion->flags & VKX_PIXELS_SWIZZLE) ? conversion->swizzle[3] : 3;
+
+	if (conversion->flags & VKX_PIXELS_BOUNDS) {
+		if (conversion->regions_x == 0 || conversion->regions_y == 0 || conversion->regions_x > width || conversion->regions_y > height) {
+			fprintf(stderr, "Can't split a %ux%u image into %ux%u regions\n", width, height, conversion->regions_x, conversion->regions_y);
+			exit(1);
+		}
+		job.region_width = width / conversion->regions_x;
+		job.region_height = height / conversion->regions_y;
+		job.band_rows = job.region_height;
+	}
+
+	if (width == 0 || height == 0) {
+		return;
+	}
+	jobs_parallel_for((height + job.band_rows - 1) / job.band_rows, 1, vkx_pixels_convert_job, &job);
+}
@@ -0,0 +1,420 @@
+/*
+ * GPU profiler using timestamp queries.
+ *
+ * Scopes (e.g. the passes of a frame) are added once, then each frame writes a
+ * timestamp at the start and end of them in its command buffer.  Every frame
+ * in flight has its own queries, which are read back without waiting once that
+ * frame's fence has been waited on (i.e. a frame or so later), and each scope
+ * keeps the last VKX_PROFILER_HISTORY times for its min/avg/max/p99.
+ *
+ * The timestamps wait for all of the commands before them, so the scopes
+ * shouldn't overlap.  On tiled GPUs timestamps inside a render pass only give a
+ * rough split of the pass.
+ *
+ * Statistics scopes also count the vertex and fragment shader invocations and
+ * the primitives clipped with a pipeline statistics query, where the device
+ * has pipelineStatisticsQuery.  Only one such query can be active at a time,
+ * and one begun inside rendering has to end in it.
+ *
+ * With VK_EXT_calibrated_timestamps the GPU's clock is read from the CPU
+ * every so often, between two SDL_GetTicksNS() calls, which puts the scopes'
+ * timestamps on the same clock as the CPU trace (last_start_ns and
+ * last_end_ns) to within a few microseconds.
+ */
+
+#include "vkx/vkx_profiler.h"
+
+#include <SDL3/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// What the statistics queries count, whose results come in the order of the bits
+#define VKX_PROFILER_STATISTICS (VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT \
+		| VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT \
+		| VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT)
+
+static uint32_t vkx_profiler_query(uint32_t frame, uint32_t scope) {
+	// The first of the scope's two queries for the frame
+	return (frame * VKX_PROFILER_MAX_SCOPES + scope) * 2;
+}
+
+static uint32_t vkx_profiler_statistics_query(uint32_t frame, uint32_t scope) {
+	// The scope's statistics query for the frame
+	return frame * VKX_PROFILER_MAX_SCOPES + scope;
+}
+
+static bool vkx_profiler_has_device_time_domain(void) {
+	/*
+	 * Whether the GPU's own clock can be read with vkGetCalibratedTimestampsEXT
+	 */
+	PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT get_time_domains = (PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT)
+		vkGetInstanceProcAddr(vkx_instance.instance, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT");
+	if (get_time_domains == NULL) {
+		return false;
+	}
+
+	VkTimeDomainEXT domains[8];
+	uint32_t domains_count = sizeof(domains) / sizeof(domains[0]);
+	VkResult result = get_time_domains(vkx_instance.physical_device, &domains_count, domains);
+	if (result != VK_SUCCESS && result != VK_INCOMPLETE) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < domains_count; i++) {
+		if (domains[i] == VK_TIME_DOMAIN_DEVICE_EXT) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void vkx_profiler_calibrate(VkxProfiler* profiler) {
+	/*
+	 * Read the GPU's clock along with SDL_GetTicksNS().  It's read somewhere
+	 * between the CPU times either side, so the middle of them is at most half
+	 * the gap out, and the try with the smallest gap is kept
+	 */
+	VkCalibratedTimestampInfoEXT timestamp_info = {0};
+	timestamp_info.sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+	timestamp_info.timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+
+	uint64_t best_gap_ns = UINT64_MAX;
+	for (uint32_t i = 0; i < VKX_PROFILER_CALIBRATION_TRIES; i++) {
+		uint64_t timestamp = 0;
+		uint64_t max_deviation = 0;
+		uint64_t before_ns = SDL_GetTicksNS();
+		VkResult result = profiler->get_calibrated_timestamps(vkx_instance.device, 1, &timestamp_info, &timestamp, &max_deviation);
+		uint64_t after_ns = SDL_GetTicksNS();
+
+		if (result == VK_SUCCESS && after_ns - before_ns < best_gap_ns) {
+			best_gap_ns = after_ns - before_ns;
+			profiler->calibration_timestamp = timestamp;
+			profiler->calibration_ns = before_ns + best_gap_ns / 2;
+			profiler->calibrated = true;
+		}
+	}
+}
+
+static uint64_t vkx_profiler_timestamp_ns(const VkxProfiler* profiler, uint64_t timestamp) {
+	/*
+	 * A timestamp on the SDL_GetTicksNS() clock, from the last calibration.
+	 * The difference wraps around in the valid bits, and can be either way
+	 */
+	uint64_t ticks = (timestamp - profiler->calibration_timestamp) & profiler->timestamp_mask;
+	if (ticks <= profiler->timestamp_mask / 2) {
+		return profiler->calibration_ns + (uint64_t) ((double) ticks * profiler->timestamp_period);
+	}
+
+	ticks = (profiler->calibration_timestamp - timestamp) & profiler->timestamp_mask;
+	return profiler->calibration_ns - (uint64_t) ((double) ticks * profiler->timestamp_period);
+}
+
+void vkx_profiler_init(VkxProfiler* profiler) {
+	/*
+	 * Set up the profiler, which is disabled if the graphics queue doesn't
+	 * support timestamps
+	 */
+	memset(profiler, 0, sizeof(VkxProfiler));
+
+	uint32_t families_count = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(vkx_instance.physical_device, &families_count, NULL);
+	VkQueueFamilyProperties* families = malloc(sizeof(VkQueueFamilyProperties) * families_count);
+	vkGetPhysicalDeviceQueueFamilyProperties(vkx_instance.physical_device, &families_count, families);
+	uint32_t valid_bits = families[vkx_instance.graphics_queue_family].timestampValidBits;
+	free(families);
+
+	if (valid_bits == 0) {
+		printf("The graphics queue doesn't support timestamps - GPU profiling is disabled\n");
+		return;
+	}
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(vkx_instance.physical_device, &properties);
+	profiler->timestamp_period = (double) properties.limits.timestampPeriod;
+	profiler->timestamp_mask = valid_bits >= 64 ? UINT64_MAX : (((uint64_t) 1 << valid_bits) - 1);
+
+	VkQueryPoolCreateInfo query_pool_info = {0};
+	query_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	query_pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	query_pool_info.queryCount = 2 * VKX_PROFILER_MAX_SCOPES * vkx_instance.frames_in_flight;
+
+	if (vkCreateQueryPool(vkx_instance.device, &query_pool_info, vkx_get_allocator(VK_OBJECT_TYPE_QUERY_POOL), &profiler->query_pool) != VK_SUCCESS) {
+		fprintf(stderr, "failed to create profiler query pool!\n");
+		exit(1);
+	}
+
+	if (vkx_instance.has_calibrated_timestamps && vkx_profiler_has_device_time_domain()) {
+		profiler->get_calibrated_timestamps = (PFN_vkGetCalibratedTimestampsEXT) vkGetDeviceProcAddr(vkx_instance.device, "vkGetCalibratedTimestampsEXT");
+		if (profiler->get_calibrated_timestamps != NULL) {
+			vkx_profiler_calibrate(profiler);
+		}
+	}
+
+	if (!vkx_instance.has_pipeline_statistics) {
+		printf("The device can't count pipeline statistics - the profiler only has times\n");
+		return;
+	}
+
+	VkQueryPoolCreateInfo statistics_pool_info = {0};
+	statistics_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	statistics_pool_info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+	statistics_pool_info.queryCount = VKX_PROFILER_MAX_SCOPES * vkx_instance.frames_in_flight;
+	statistics_pool_info.pipelineStatistics = VKX_PROFILER_STATISTICS;
+
+	if (vkCreateQueryPool(vkx_instance.device, &statistics_pool_info, vkx_get_allocator(VK_OBJECT_TYPE_QUERY_POOL), &profiler->statistics_pool) != VK_SUCCESS) {
+		fprintf(stderr, "failed to create profiler statistics query pool!\n");
+		exit(1);
+	}
+}
+
+void vkx_profiler_cleanup(VkxProfiler* profiler) {
+	if (profiler->statistics_pool != VK_NULL_HANDLE) {
+		vkDestroyQueryPool(vkx_instance.device, profiler->statistics_pool, vkx_get_allocator(VK_OBJECT_TYPE_QUERY_POOL));
+	}
+	if (profiler->query_pool != VK_NULL_HANDLE) {
+		vkDestroyQueryPool(vkx_instance.device, profiler->query_pool, vkx_get_allocator(VK_OBJECT_TYPE_QUERY_POOL));
+	}
+	memset(profiler, 0, sizeof(VkxProfiler));
+}
+
+bool vkx_profiler_is_enabled(const VkxProfiler* profiler) {
+	return profiler->query_pool != VK_NULL_HANDLE;
+}
+
+uint32_t vkx_profiler_add_scope(VkxProfiler* profiler, const char* name) {
+	/*
+	 * Add something to time
+	 *
+	 * @param name Shown by vkx_profiler_print(), not copied
+	 *
+	 * @return The profiler's index for the scope
+	 */
+	if (profiler->scopes_count >= VKX_PROFILER_MAX_SCOPES) {
+		fprintf(stderr, "Too many profiler scopes (max %d)\n", VKX_PROFILER_MAX_SCOPES);
+		exit(1);
+	}
+
+	VkxProfilerScope* profiler_scope = &profiler->scopes[profiler->scopes_count];
+	memset(profiler_scope, 0, sizeof(VkxProfilerScope));
+	profiler_scope->name = name;
+
+	return profiler->scopes_count++;
+}
+
+uint32_t vkx_profiler_add_statistics_scope(VkxProfiler* profiler, const char* name) {
+	/*
+	 * Add something to time which also counts its shader invocations (if the
+	 * device can).  It can't overlap another statistics scope, and it has to
+	 * begin and end on the same side of rendering, in the same command buffer.
+	 * Inside rendering with multiview the counts aren't per view, so don't use
+	 * one there
+	 *
+	 * @param name Shown by vkx_profiler_print(), not copied
+	 *
+	 * @return The profiler's index for the scope
+	 */
+	uint32_t scope = vkx_profiler_add_scope(profiler, name);
+	profiler->scopes[scope].statistics = profiler->statistics_pool != VK_NULL_HANDLE;
+	return scope;
+}
+
+bool vkx_profiler_collect(VkxProfiler* profiler, uint32_t frame) {
+	/*
+	 * Read the times for a frame in flight, which has to be after its fence
+	 * has been waited on and before it is recorded again
+	 *
+	 * @param frame The frame in flight
+	 *
+	 * @return Whether any new times were read
+	 */
+	bool collected = false;
+
+	if (profiler->get_calibrated_timestamps != NULL && SDL_GetTicksNS() - profiler->calibration_ns >= VKX_PROFILER_CALIBRATION_INTERVAL_NS) {
+		vkx_profiler_calibrate(profiler);
+	}
+
+	for (uint32_t i = 0; i < profiler->scopes_count; i++) {
+		VkxProfilerScope* scope = &profiler->scopes[i];
+		scope->collected = false;
+		if (!scope->written[frame]) {
+			continue;
+		}
+		scope->written[frame] = false;
+
+		// The fence has been signalled so they should be ready, but never stall
+		uint64_t timestamps[2] = {0};
+		VkResult result = vkGetQueryPoolResults(vkx_instance.device, profiler->query_pool, vkx_profiler_query(frame, i), 2,
+				sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+		if (result != VK_SUCCESS) {
+			continue;
+		}
+
+		uint64_t ticks = (timestamps[1] - timestamps[0]) & profiler->timestamp_mask;
+		scope->last = (float) ((double) ticks * profiler->timestamp_period * 1e-6);
+		scope->samples[scope->next_sample] = scope->last;
+		scope->next_sample = (scope->next_sample + 1) % VKX_PROFILER_HISTORY;
+		if (scope->samples_count < VKX_PROFILER_HISTORY) {
+			scope->samples_count++;
+		}
+		if (profiler->calibrated) {
+			scope->last_start_ns = vkx_profiler_timestamp_ns(profiler, timestamps[0]);
+			scope->last_end_ns = vkx_profiler_timestamp_ns(profiler, timestamps[1]);
+		}
+		scope->collected = true;
+		collected = true;
+
+		if (scope->statistics) {
+			uint64_t counts[3] = {0};
+			result = vkGetQueryPoolResults(vkx_instance.device, profiler->statistics_pool, vkx_profiler_statistics_query(frame, i), 1,
+					sizeof(counts), counts, sizeof(counts), VK_QUERY_RESULT_64_BIT);
+			if (result == VK_SUCCESS) {
+				scope->last_statistics.vertex_invocations = counts[0];
+				scope->last_statistics.clipping_invocations = counts[1];
+				scope->last_statistics.fragment_invocations = counts[2];
+			}
+		}
+	}
+
+	return collected;
+}
+
+void vkx_profiler_begin_frame(VkxProfiler* profiler, VkCommandBuffer command_buffer, uint32_t frame) {
+	/*
+	 * Reset the frame's queries, recorded in its command buffer before any of
+	 * the scopes (and outside of rendering)
+	 *
+	 * @param command_buffer The frame's command buffer
+	 * @param frame The frame in flight
+	 */
+	profiler->command_buffer = command_buffer;
+	profiler->frame = frame;
+
+	if (profiler->query_pool == VK_NULL_HANDLE) {
+		return;
+	}
+
+	vkCmdResetQueryPool(command_buffer, profiler->query_pool, vkx_profiler_query(frame, 0), 2 * VKX_PROFILER_MAX_SCOPES);
+	if (profiler->statistics_pool != VK_NULL_HANDLE) {
+		vkCmdResetQueryPool(command_buffer, profiler->statistics_pool, vkx_profiler_statistics_query(frame, 0), VKX_PROFILER_MAX_SCOPES);
+	}
+}
+
+void vkx_profiler_set_command_buffer(VkxProfiler* profiler, VkCommandBuffer command_buffer) {
+	/*
+	 * Carry on writing the frame's timestamps in another command buffer on the
+	 * graphics queue, submitted after the first
+	 */
+	profiler->command_buffer = command_buffer;
+}
+
+void vkx_profiler_begin_scope(VkxProfiler* profiler, uint32_t scope) {
+	if (profiler->query_pool == VK_NULL_HANDLE) {
+		return;
+	}
+
+	vkCmdWriteTimestamp2(profiler->command_buffer, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+			profiler->query_pool, vkx_profiler_query(profiler->frame, scope));
+
+	if (profiler->scopes[scope].statistics) {
+		if (profiler->statistics_active) {
+			fprintf(stderr, "Profiler statistics scopes can't overlap (%s)\n", profiler->scopes[scope].name);
+			exit(1);
+		}
+		vkCmdBeginQuery(profiler->command_buffer, profiler->statistics_pool, vkx_profiler_statistics_query(profiler->frame, scope), 0);
+		profiler->statistics_active = true;
+	}
+}
+
+void vkx_profiler_end_scope(VkxProfiler* profiler, uint32_t scope) {
+	if (profiler->query_pool == VK_NULL_HANDLE) {
+		return;
+	}
+
+	if (profiler->scopes[scope].statistics) {
+		vkCmdEndQuery(profiler->command_buffer, profiler->statistics_pool, vkx_profiler_statistics_query(profiler->frame, scope));
+		profiler->statistics_active = false;
+	}
+
+	vkCmdWriteTimestamp2(profiler->command_buffer, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+			profiler->query_pool, vkx_profiler_query(profiler->frame, scope) + 1);
+	profiler->scopes[scope].written[profiler->frame] = true;
+}
+
+static int vkx_profiler_compare_samples(const void* a, const void* b) {
+	float sample_a = *(const float*) a;
+	float sample_b = *(const float*) b;
+	return (sample_a > sample_b) - (sample_a < sample_b);
+}
+
+VkxProfilerStats vkx_profiler_get_stats(const VkxProfiler* profiler, uint32_t scope) {
+	/*
+	 * Statistics over the recent times of a scope (all zero before the first),
+	 * in milliseconds
+	 */
+	VkxProfilerStats stats = {0};
+	const VkxProfilerScope* profiler_scope = &profiler->scopes[scope];
+	uint32_t count = profiler_scope->samples_count;
+	if (count == 0) {
+		return stats;
+	}
+
+	float sorted[VKX_PROFILER_HISTORY];
+	memcpy(sorted, profiler_scope->samples, sizeof(float) * count);
+	qsort(sorted, count, sizeof(float), vkx_profiler_compare_samples);
+
+	double total = 0.0;
+	for (uint32_t i = 0; i < count; i++) {
+		total += sorted[i];
+	}
+
+	stats.min = sorted[0];
+	stats.max = sorted[count - 1];
+	stats.avg = (float) (total / count);
+	stats.p99 = sorted[(count * 99) / 100];
+
+	return stats;
+}
+
+VkxProfilerStatistics vkx_profiler_get_statistics(const VkxProfiler* profiler, uint32_t scope) {
+	/*
+	 * The counts from the last frame read back of a statistics scope, all
+	 * zero if it isn't one or the device can't count them
+	 */
+	return profiler->scopes[scope].last_statistics;
+}
+
+void vkx_profiler_print(const VkxProfiler* profiler) {
+	if (profiler->query_pool == VK_NULL_HANDLE) {
+		return;
+	}
+
+	printf("GPU times (ms):      min      avg      max      p99\n");
+	for (uint32_t i = 0; i < profiler->scopes_count; i++) {
+		// Scopes which aren't being recorded at the moment
+		if (profiler->scopes[i].samples_count == 0) {
+			continue;
+		}
+
+		VkxProfilerStats stats = vkx_profiler_get_stats(profiler, i);
+		printf("  %-16s %8.3f %8.3f %8.3f %8.3f\n", profiler->scopes[i].name, stats.min, stats.avg, stats.max, stats.p99);
+	}
+
+	if (profiler->statistics_pool == VK_NULL_HANDLE) {
+		return;
+	}
+
+	printf("Last frame:         vertices    clipped  fragments\n");
+	for (uint32_t i = 0; i < profiler->scopes_count; i++) {
+		const VkxProfilerScope* scope = &profiler->scopes[i];
+		if (!scope->statistics || scope->samples_count == 0) {
+			continue;
+		}
+
+		printf("  %-16s %10llu %10llu %10llu\n", scope->name,
+				(unsigned long long) scope->last_statistics.vertex_invocations,
+				(unsigned long long) scope->last_statistics.clipping_invocations,
+				(unsigned long long) scope->last_statistics.fragment_invocations);
+	}
+}
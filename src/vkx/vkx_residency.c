@@ -0,0 +1,629 @@
+/*
+ * Texture residency manager, which keeps the textures within a memory budget.
+ *
+ * Every texture has a fixed index in the bindless texture table and a small
+ * placeholder (its lowest mip levels) which is always resident.  The full
+ * texture is evicted when the textures go over the budget and hasn't been used
+ * for a while, least recently used first, and its table index is pointed at
+ * the placeholder.  When it is used again it is decoded on the manager's
+ * thread, uploaded through the upload manager, and swapped back in once the
+ * upload has finished, so nothing stalls the frame.
+ *
+ * The budget is either a fixed number of bytes for the full textures, or (if
+ * that's 0) whatever the device local heap has spare, from VK_EXT_memory_budget
+ * when the device has it, less VKX_RESIDENCY_HEAP_RESERVE.
+ *
+ * Textures which are too big to shrink, like KTX2 files without a small enough
+ * mip level, don't get a placeholder and are never evicted.
+ *
+ * Resident textures and placeholders in a block the allocator is emptying are
+ * copied somewhere else with the frame's commands, a few at a time, and their
+ * table indices pointed at the copies (see vkx_residency_move_textures()).
+ */
+
+#include "vkx/vkx_residency.h"
+
+#include <SDL3/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "jobs.h"
+#include "trace.h"
+#include "vkx/vkx_memory.h"
+#include "vkx/vkx_texture_table.h"
+#include "vkx/vkx_upload.h"
+
+typedef enum {
+	VKX_TEXTURE_RESIDENT,
+	VKX_TEXTURE_EVICTED,
+	// Queued for or being decoded on the streaming thread
+	VKX_TEXTURE_DECODING,
+	// Decoded and waiting for vkx_residency_update() to upload it
+	VKX_TEXTURE_DECODED,
+	VKX_TEXTURE_UPLOADING,
+} VkxTextureResidency;
+
+typedef struct {
+	char* filename;
+	uint32_t table_index;
+	// The full texture, while it is resident or uploading
+	VkxImage image;
+	// No image if the texture can't be evicted
+	VkxImage placeholder;
+	// Size of the full texture, estimated until it has been created
+	VkDeviceSize size;
+	uint64_t last_used_frame;
+	uint64_t upload_value;
+	// Written by the streaming thread while the texture is decoding
+	VkxDecodedTexture decoded;
+	// VkxTextureResidency, only DECODED once the decoded texture is written
+	SDL_AtomicInt state;
+} VkxResidentTexture;
+
+static VkxResidentTexture textures[VKX_RESIDENCY_MAX_TEXTURES];
+static uint32_t textures_count = 0;
+
+static VkSampler texture_sampler = VK_NULL_HANDLE;
+static VkDeviceSize fixed_budget = 0;
+static bool mipmaps = false;
+static uint32_t heap_index = 0;
+
+static uint64_t frame_number = 0;
+// Full textures which are resident, uploading or being decoded
+static VkDeviceSize resident_bytes = 0;
+// The part of that which hasn't been allocated yet
+static VkDeviceSize decoding_bytes = 0;
+
+static SDL_Thread* stream_thread = NULL;
+// Protects everything below
+static SDL_Mutex* stream_mutex = NULL;
+// Signalled when a texture is queued (or we are quitting)
+static SDL_Condition* stream_condition = NULL;
+
+// Textures to decode, oldest first.  Each texture is in here at most once
+static uint32_t stream_queue[VKX_RESIDENCY_MAX_TEXTURES];
+static uint32_t stream_queue_head = 0;
+static uint32_t stream_queue_count = 0;
+static bool quitting = false;
+
+static int vkx_residency_thread_main(void* data) {
+	(void) data;
+
+	trace_set_thread_name("texture streaming");
+
+	SDL_LockMutex(stream_mutex);
+	for (;;) {
+		while (!quitting && stream_queue_count == 0) {
+			SDL_WaitCondition(stream_condition, stream_mutex);
+		}
+
+		if (quitting) {
+			break;
+		}
+
+		VkxResidentTexture* texture = &textures[stream_queue[stream_queue_head]];
+		stream_queue_head = (stream_queue_head + 1) % VKX_RESIDENCY_MAX_TEXTURES;
+		stream_queue_count--;
+		SDL_UnlockMutex(stream_mutex);
+
+		trace_begin("stream texture");
+		if (!vkx_decode_texture(texture->filename, &texture->decoded)) {
+			fprintf(stderr, "Failed to stream in texture %s\n", texture->filename);
+			exit(1);
+		}
+		trace_end();
+
+		SDL_SetAtomicInt(&texture->state, VKX_TEXTURE_DECODED);
+
+		SDL_LockMutex(stream_mutex);
+	}
+	SDL_UnlockMutex(stream_mutex);
+
+	return 0;
+}
+
+void vkx_residency_init(VkSampler sampler, VkDeviceSize budget, bool generate_mipmaps) {
+	/*
+	 * Start the streaming thread, after the texture table has been created
+	 *
+	 * @param sampler The sampler all of the textures are sampled with
+	 * @param budget Bytes the full textures can use, or 0 to keep within the
+	 *        device local heap's budget
+	 * @param generate_mipmaps Generate mip chains for the decoded images (KTX2
+	 *        files have theirs already)
+	 */
+	texture_sampler = sampler;
+	fixed_budget = budget;
+	mipmaps = generate_mipmaps;
+	heap_index = vkx_memory_get_type_heap(UINT32_MAX, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	memset(textures, 0, sizeof(textures));
+	textures_count = 0;
+	frame_number = 0;
+	resident_bytes = 0;
+	decoding_bytes = 0;
+	stream_queue_head = 0;
+	stream_queue_count = 0;
+	quitting = false;
+
+	stream_mutex = SDL_CreateMutex();
+	stream_condition = SDL_CreateCondition();
+	if (stream_mutex == NULL || stream_condition == NULL) {
+		fprintf(stderr, "Failed to create texture streaming sync objects: %s\n", SDL_GetError());
+		exit(1);
+	}
+
+	stream_thread = SDL_CreateThread(vkx_residency_thread_main, "texture_streaming", NULL);
+	if (stream_thread == NULL) {
+		fprintf(stderr, "Failed to create texture streaming thread: %s\n", SDL_GetError());
+		exit(1);
+	}
+}
+
+void vkx_residency_cleanup(void) {
+	/*
+	 * Stop the streaming thread and destroy all of the textures, after the
+	 * device is idle
+	 */
+	SDL_LockMutex(stream_mutex);
+	quitting = true;
+	SDL_BroadcastCondition(stream_condition);
+	SDL_UnlockMutex(stream_mutex);
+
+	SDL_WaitThread(stream_thread, NULL);
+	stream_thread = NULL;
+
+	for (uint32_t i = 0; i < textures_count; i++) {
+		VkxResidentTexture* texture = &textures[i];
+		int state = SDL_GetAtomicInt(&texture->state);
+
+		if (state == VKX_TEXTURE_UPLOADING) {
+			vkx_upload_wait(texture->upload_value);
+		}
+		else if (state == VKX_TEXTURE_DECODED) {
+			vkx_free_decoded_texture(&texture->decoded);
+		}
+
+		vkx_texture_table_remove(texture->table_index);
+		vkx_cleanup_image(&texture->image);
+		vkx_cleanup_image(&texture->placeholder);
+		free(texture->filename);
+	}
+	textures_count = 0;
+
+	SDL_DestroyCondition(stream_condition);
+	SDL_DestroyMutex(stream_mutex);
+	stream_condition = NULL;
+	stream_mutex = NULL;
+}
+
+static VkDeviceSize vkx_residency_estimate_size(const VkxDecodedTexture* decoded) {
+	/*
+	 * How much memory the full texture will take, near enough for the budget
+	 */
+	if (decoded->compressed) {
+		VkDeviceSize size = 0;
+		for (uint32_t level = 0; level < decoded->ktx2.mip_levels; level++) {
+			size += decoded->ktx2.level_sizes[level];
+		}
+		return size;
+	}
+
+	// A full mip chain adds a third
+	VkDeviceSize size = (VkDeviceSize) decoded->width * decoded->height * 4;
+	return mipmaps ? size + size / 3 : size;
+}
+
+static bool vkx_residency_make_placeholder(const VkxDecodedTexture* decoded, VkxDecodedTexture* placeholder) {
+	/*
+	 * Shrink a texture to VKX_RESIDENCY_PLACEHOLDER_SIZE.  Compressed textures
+	 * use their first level which is small enough (and the ones after it), and
+	 * share the mapping.  Decoded images are box filtered into a new buffer
+	 *
+	 * @return false if the texture can't be shrunk
+	 */
+	memset(placeholder, 0, sizeof(VkxDecodedTexture));
+
+	if (decoded->compressed) {
+		const VkxKtx2Texture* ktx2 = &decoded->ktx2;
+		for (uint32_t level = 0; level < ktx2->mip_levels; level++) {
+			uint32_t width = ktx2->width >> level > 0 ? ktx2->width >> level : 1;
+			uint32_t height = ktx2->height >> level > 0 ? ktx2->height >> level : 1;
+			if (width > VKX_RESIDENCY_PLACEHOLDER_SIZE || height > VKX_RESIDENCY_PLACEHOLDER_SIZE) {
+				continue;
+			}
+
+			placeholder->compressed = true;
+			placeholder->ktx2_file = decoded->ktx2_file;
+			placeholder->ktx2.format = ktx2->format;
+			placeholder->ktx2.width = width;
+			placeholder->ktx2.height = height;
+			placeholder->ktx2.mip_levels = ktx2->mip_levels - level;
+			placeholder->ktx2.array_layers = 1;
+			for (uint32_t i = 0; i < placeholder->ktx2.mip_levels; i++) {
+				placeholder->ktx2.level_offsets[i] = ktx2->level_offsets[level + i];
+				placeholder->ktx2.level_sizes[i] = ktx2->level_sizes[level + i];
+			}
+			return true;
+		}
+
+		return false;
+	}
+
+	int width = decoded->width;
+	int height = decoded->height;
+	uint8_t* pixels = malloc((size_t) width * height * 4);
+	if (pixels == NULL) {
+		fprintf(stderr, "Failed to allocate a texture placeholder\n");
+		exit(1);
+	}
+	memcpy(pixels, decoded->pixels, (size_t) width * height * 4);
+
+	// Halve it in place (each row is read before it is overwritten) until it
+	// fits.  Odd edges are dropped, which doesn't matter for a placeholder
+	while ((width > VKX_RESIDENCY_PLACEHOLDER_SIZE || height > VKX_RESIDENCY_PLACEHOLDER_SIZE) && width > 1 && height > 1) {
+		int half_width = width / 2;
+		int half_height = height / 2;
+
+		for (int y = 0; y < half_height; y++) {
+			const uint8_t* row0 = pixels + (size_t) (y * 2) * width * 4;
+			const uint8_t* row1 = row0 + (size_t) width * 4;
+			uint8_t* out = pixels + (size_t) y * half_width * 4;
+
+			for (int x = 0; x < half_width; x++) {
+				for (int c = 0; c < 4; c++) {
+					int sum = row0[x * 8 + c] + row0[x * 8 + 4 + c] + row1[x * 8 + c] + row1[x * 8 + 4 + c];
+					out[x * 4 + c] = (uint8_t) ((sum + 2) / 4);
+				}
+			}
+		}
+
+		width = half_width;
+		height = half_height;
+	}
+
+	placeholder->pixels = pixels;
+	placeholder->width = width;
+	placeholder->height = height;
+	return true;
+}
+
+typedef struct {
+	const char* const* filenames;
+	VkxDecodedTexture* decoded;
+	bool* loaded;
+} VkxResidencyDecodeJob;
+
+static void vkx_residency_decode(size_t start, size_t end, void* data) {
+	VkxResidencyDecodeJob* job = data;
+
+	for (size_t i = start; i < end; i++) {
+		job->loaded[i] = vkx_decode_texture(job->filenames[i], &job->decoded[i]);
+	}
+}
+
+static int64_t vkx_residency_spare_bytes(void) {
+	/*
+	 * How much more the full textures can use, negative if they are over
+	 */
+	int64_t spare = INT64_MAX;
+
+	if (fixed_budget > 0) {
+		spare = (int64_t) fixed_budget - (int64_t) resident_bytes;
+	}
+
+	// The heap's budget, plus the free space in our own blocks (as freed
+	// textures don't give their blocks back)
+	VkxMemoryHeapStats stats = vkx_memory_get_heap_stats(heap_index);
+	int64_t heap_spare = (int64_t) vkx_memory_get_available(heap_index)
+		+ (int64_t) (stats.allocated_bytes - stats.used_bytes)
+		- (int64_t) (stats.heap_size * VKX_RESIDENCY_HEAP_RESERVE)
+		- (int64_t) decoding_bytes;
+
+	return heap_spare < spare ? heap_spare : spare;
+}
+
+void vkx_residency_add_textures(const char* const* filenames, uint32_t count, uint32_t* handles) {
+	/*
+	 * Load textures and put them in the texture table.  They are decoded in
+	 * parallel on the job system, and as many as fit in the budget are made
+	 * resident, the rest start off evicted.  As with vkx_create_texture_images()
+	 * vkx_upload_flush() must be called before they are used
+	 *
+	 * @param filenames The image files to load, which are kept to stream them
+	 *        in again
+	 * @param count The number of files
+	 * @param handles Array of count handles to fill in
+	 */
+	if (textures_count + count > VKX_RESIDENCY_MAX_TEXTURES) {
+		fprintf(stderr, "Too many textures for the residency manager\n");
+		exit(1);
+	}
+
+	printf("Loading %d streamed texture images\n", count);
+
+	VkxResidencyDecodeJob job = {0};
+	job.filenames = filenames;
+	job.decoded = calloc(count, sizeof(VkxDecodedTexture));
+	job.loaded = calloc(count, sizeof(bool));
+
+	VkxDecodedTexture* uploads = calloc(count * 2, sizeof(VkxDecodedTexture));
+	VkxImage* images = calloc(count * 2, sizeof(VkxImage));
+	VkxImage** image_targets = calloc(count * 2, sizeof(VkxImage*));
+	// Set for the placeholders with pixels of their own
+	bool* owns_pixels = calloc(count * 2, sizeof(bool));
+
+	if (job.decoded == NULL || job.loaded == NULL || uploads == NULL || images == NULL || image_targets == NULL || owns_pixels == NULL) {
+		fprintf(stderr, "Failed to allocate texture loading arrays\n");
+		exit(1);
+	}
+
+	jobs_parallel_for(count, 1, vkx_residency_decode, &job);
+
+	// The placeholders and the full textures which fit are all uploaded together
+	uint32_t uploads_count = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		if (!job.loaded[i]) {
+			fprintf(stderr, "failed to load texture image %s!\n", filenames[i]);
+			exit(1);
+		}
+
+		handles[i] = textures_count;
+		VkxResidentTexture* texture = &textures[textures_count++];
+
+		size_t filename_size = strlen(filenames[i]) + 1;
+		texture->filename = malloc(filename_size);
+		if (texture->filename == NULL) {
+			fprintf(stderr, "Failed to allocate a texture filename\n");
+			exit(1);
+		}
+		memcpy(texture->filename, filenames[i], filename_size);
+
+		texture->size = vkx_residency_estimate_size(&job.decoded[i]);
+
+		bool has_placeholder = vkx_residency_make_placeholder(&job.decoded[i], &uploads[uploads_count]);
+		if (has_placeholder) {
+			owns_pixels[uploads_count] = !uploads[uploads_count].compressed;
+			image_targets[uploads_count++] = &texture->placeholder;
+		}
+
+		// Textures without a placeholder have to be resident.  Until they are
+		// created the others count as being decoded for the budget
+		if (!has_placeholder || (int64_t) texture->size <= vkx_residency_spare_bytes()) {
+			uploads[uploads_count] = job.decoded[i];
+			image_targets[uploads_count++] = &texture->image;
+			resident_bytes += texture->size;
+			decoding_bytes += texture->size;
+			SDL_SetAtomicInt(&texture->state, VKX_TEXTURE_RESIDENT);
+		}
+		else {
+			SDL_SetAtomicInt(&texture->state, VKX_TEXTURE_EVICTED);
+		}
+	}
+
+	// Placeholders only need their mip chains if they have them already
+	vkx_create_decoded_textures(uploads_count, uploads, images, mipmaps);
+
+	for (uint32_t i = 0; i < uploads_count; i++) {
+		*image_targets[i] = images[i];
+		if (owns_pixels[i]) {
+			free(uploads[i].pixels);
+		}
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		VkxResidentTexture* texture = &textures[handles[i]];
+
+		// The estimates are replaced by the real sizes
+		if (texture->image.image != VK_NULL_HANDLE) {
+			decoding_bytes -= texture->size;
+			resident_bytes -= texture->size;
+			texture->size = texture->image.allocation.size;
+			resident_bytes += texture->size;
+		}
+
+		VkImageView view = texture->image.image != VK_NULL_HANDLE ? texture->image.view : texture->placeholder.view;
+		texture->table_index = vkx_texture_table_add(view, texture_sampler);
+		if (texture->table_index == VKX_TEXTURE_TABLE_INVALID_INDEX) {
+			fprintf(stderr, "The texture table is full\n");
+			exit(1);
+		}
+
+		vkx_free_decoded_texture(&job.decoded[i]);
+	}
+
+	free(owns_pixels);
+	free(image_targets);
+	free(images);
+	free(uploads);
+	free(job.loaded);
+	free(job.decoded);
+}
+
+uint32_t vkx_residency_get_table_index(uint32_t handle) {
+	/*
+	 * The texture's index in the texture table, which it keeps whether or not
+	 * it is resident
+	 */
+	return textures[handle].table_index;
+}
+
+bool vkx_residency_is_resident(uint32_t handle) {
+	return SDL_GetAtomicInt(&textures[handle].state) == VKX_TEXTURE_RESIDENT;
+}
+
+void vkx_residency_use(uint32_t handle) {
+	/*
+	 * Note that the texture is drawn with this frame, so it is streamed in if it
+	 * isn't resident and isn't evicted for a while
+	 */
+	textures[handle].last_used_frame = frame_number;
+}
+
+static void vkx_residency_evict(int64_t bytes) {
+	/*
+	 * Evict least recently used textures until at least bytes have been freed,
+	 * or there's nothing left which can be.  The frames in flight can still be
+	 * using them, so they are destroyed once those are done
+	 */
+	while (bytes > 0) {
+		VkxResidentTexture* oldest = NULL;
+		for (uint32_t i = 0; i < textures_count; i++) {
+			VkxResidentTexture* texture = &textures[i];
+			bool evictable = SDL_GetAtomicInt(&texture->state) == VKX_TEXTURE_RESIDENT
+				&& texture->placeholder.image != VK_NULL_HANDLE
+				&& texture->last_used_frame + VKX_RESIDENCY_KEEP_FRAMES < frame_number;
+
+			if (evictable && (oldest == NULL || texture->last_used_frame < oldest->last_used_frame)) {
+				oldest = texture;
+			}
+		}
+
+		if (oldest == NULL) {
+			return;
+		}
+
+		printf("Evicting texture %s (%llu KiB)\n", oldest->filename, (unsigned long long) (oldest->size / 1024));
+
+		vkx_texture_table_replace(oldest->table_index, oldest->placeholder.view, texture_sampler);
+		vkx_defer_cleanup_image(&oldest->image);
+		SDL_SetAtomicInt(&oldest->state, VKX_TEXTURE_EVICTED);
+
+		resident_bytes -= oldest->size;
+		bytes -= (int64_t) oldest->size;
+	}
+}
+
+void vkx_residency_update(void) {
+	/*
+	 * Call once per frame, after vkx_texture_table_begin_frame().  Swaps in the
+	 * textures which have finished streaming, evicts textures if they are over
+	 * the budget, and starts streaming in evicted ones which have been used
+	 */
+	frame_number++;
+
+	// ----- Upload what has been decoded, and swap in what has been uploaded -----
+	bool uploaded = false;
+	for (uint32_t i = 0; i < textures_count; i++) {
+		VkxResidentTexture* texture = &textures[i];
+		int state = SDL_GetAtomicInt(&texture->state);
+
+		if (state == VKX_TEXTURE_DECODED) {
+			vkx_create_decoded_textures(1, &texture->decoded, &texture->image, mipmaps);
+			vkx_free_decoded_texture(&texture->decoded);
+
+			// The estimate is replaced by the real size
+			decoding_bytes -= texture->size;
+			resident_bytes -= texture->size;
+			texture->size = texture->image.allocation.size;
+			resident_bytes += texture->size;
+
+			SDL_SetAtomicInt(&texture->state, VKX_TEXTURE_UPLOADING);
+			uploaded = true;
+		}
+		else if (state == VKX_TEXTURE_UPLOADING && vkx_upload_is_complete(texture->upload_value)) {
+			vkx_texture_table_replace(texture->table_index, texture->image.view, texture_sampler);
+			SDL_SetAtomicInt(&texture->state, VKX_TEXTURE_RESIDENT);
+		}
+	}
+
+	if (uploaded) {
+		uint64_t upload_value = vkx_upload_flush();
+		for (uint32_t i = 0; i < textures_count; i++) {
+			if (SDL_GetAtomicInt(&textures[i].state) == VKX_TEXTURE_UPLOADING && textures[i].upload_value == 0) {
+				textures[i].upload_value = upload_value;
+			}
+		}
+	}
+
+	// ----- Evict if we are over the budget -----
+	int64_t spare = vkx_residency_spare_bytes();
+	if (spare < 0) {
+		vkx_residency_evict(-spare);
+		spare = vkx_residency_spare_bytes();
+	}
+
+	// ----- Stream in the evicted textures which are being used -----
+	SDL_LockMutex(stream_mutex);
+	for (uint32_t i = 0; i < textures_count; i++) {
+		VkxResidentTexture* texture = &textures[i];
+		bool wanted = SDL_GetAtomicInt(&texture->state) == VKX_TEXTURE_EVICTED
+			&& frame_number - texture->last_used_frame <= VKX_RESIDENCY_KEEP_FRAMES
+			&& texture->last_used_frame > 0;
+
+		if (!wanted || (int64_t) texture->size > spare) {
+			continue;
+		}
+
+		texture->upload_value = 0;
+		SDL_SetAtomicInt(&texture->state, VKX_TEXTURE_DECODING);
+		stream_queue[(stream_queue_head + stream_queue_count) % VKX_RESIDENCY_MAX_TEXTURES] = i;
+		stream_queue_count++;
+
+		resident_bytes += texture->size;
+		decoding_bytes += texture->size;
+		spare -= (int64_t) texture->size;
+	}
+	SDL_BroadcastCondition(stream_condition);
+	SDL_UnlockMutex(stream_mutex);
+}
+
+static VkDeviceSize vkx_residency_move(VkCommandBuffer command_buffer, VkxResidentTexture* texture, VkxImage* image, bool in_table) {
+	VkxImage moved = vkx_record_image_move(command_buffer, image);
+	if (in_table) {
+		vkx_texture_table_replace(texture->table_index, moved.view, texture_sampler);
+	}
+
+	vkx_defer_cleanup_image(image);
+	*image = moved;
+	return moved.allocation.size;
+}
+
+void vkx_residency_move_textures(VkCommandBuffer command_buffer, VkDeviceSize max_bytes) {
+	/*
+	 * Move the textures out of any memory block being defragmented (see
+	 * vkx_memory_update_defragmentation()).  Call while recording the frame,
+	 * before anything samples the textures, after vkx_residency_update()
+	 *
+	 * @param command_buffer The frame's graphics command buffer, outside of
+	 *        rendering
+	 * @param max_bytes How much to copy this frame.  At least one texture is
+	 *        moved however big it is
+	 */
+	VkDeviceSize moved_bytes = 0;
+
+	for (uint32_t i = 0; i < textures_count && moved_bytes < max_bytes; i++) {
+		VkxResidentTexture* texture = &textures[i];
+
+		// Textures still uploading are moved once they're resident
+		bool resident = SDL_GetAtomicInt(&texture->state) == VKX_TEXTURE_RESIDENT;
+		if (resident && vkx_memory_is_moving(&texture->image.allocation)) {
+			moved_bytes += vkx_residency_move(command_buffer, texture, &texture->image, true);
+		}
+
+		// The table has the placeholder whenever the texture isn't resident
+		if (vkx_memory_is_moving(&texture->placeholder.allocation)) {
+			moved_bytes += vkx_residency_move(command_buffer, texture, &texture->placeholder, !resident);
+		}
+	}
+}
+
+VkxResidencyStats vkx_residency_get_stats(void) {
+	VkxResidencyStats stats = {0};
+	stats.textures_count = textures_count;
+	stats.resident_bytes = resident_bytes;
+
+	for (uint32_t i = 0; i < textures_count; i++) {
+		int state = SDL_GetAtomicInt(&textures[i].state);
+		if (state == VKX_TEXTURE_RESIDENT) {
+			stats.resident_count++;
+		}
+		else if (state != VKX_TEXTURE_EVICTED) {
+			stats.streaming_count++;
+		}
+	}
+
+	return stats;
+}
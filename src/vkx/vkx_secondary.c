@@ -0,0 +1,144 @@
+/*
+ * Secondary command buffers for recording a rendering pass on several threads.
+ *
+ * Command pools can only be used by one thread at a time, so every secondary
+ * command buffer of every frame in flight gets a pool of its own.  A job
+ * records into buffer i by beginning it with vkx_secondary_commands_begin(),
+ * which resets its pool: the frame's fence has been waited on by then, so
+ * nothing is still executing it.  The frame's command buffer then runs them in
+ * order with vkCmdExecuteCommands() inside a pass begun with
+ * vkx_frame_graph_begin_secondary_pass().
+ *
+ * Reusable ones are only recorded again when what they draw changes, and
+ * executed by the same frame in flight every time in between.
+ *
+ * Nothing is inherited from the primary command buffer apart from the pass's
+ * attachments, so each secondary binds its own pipelines and descriptor sets.
+ * The viewport is set to the pass's extent and the scissor to its render area
+ * here.
+ */
+
+#include "vkx/vkx_secondary.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void vkx_secondary_commands_init(VkxSecondaryCommands* commands, uint32_t count, bool reusable) {
+	/*
+	 * Create the pools and command buffers for each frame in flight
+	 *
+	 * @param count The secondary command buffers in a frame
+	 * @param reusable Whether the command buffers are kept for later frames
+	 */
+	memset(commands, 0, sizeof(VkxSecondaryCommands));
+
+	if (count > VKX_MAX_SECONDARY_COMMAND_BUFFERS) {
+		fprintf(stderr, "Too many secondary command buffers (max %d)\n", VKX_MAX_SECONDARY_COMMAND_BUFFERS);
+		exit(1);
+	}
+	commands->count = count;
+	commands->reusable = reusable;
+
+	VkCommandPoolCreateInfo pool_info = {0};
+	pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_info.flags = reusable ? 0 : VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	pool_info.queueFamilyIndex = vkx_instance.graphics_queue_family;
+
+	for (uint32_t frame = 0; frame < vkx_instance.frames_in_flight; frame++) {
+		for (uint32_t i = 0; i < count; i++) {
+			if (vkCreateCommandPool(vkx_instance.device, &pool_info, vkx_get_allocator(VK_OBJECT_TYPE_COMMAND_POOL), &commands->pools[frame][i]) != VK_SUCCESS) {
+				fprintf(stderr, "failed to create secondary command pool!\n");
+				exit(1);
+			}
+
+			VkCommandBufferAllocateInfo alloc_info = {0};
+			alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			alloc_info.commandPool = commands->pools[frame][i];
+			alloc_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+			alloc_info.commandBufferCount = 1;
+
+			if (vkAllocateCommandBuffers(vkx_instance.device, &alloc_info, &commands->command_buffers[frame][i]) != VK_SUCCESS) {
+				fprintf(stderr, "failed to allocate secondary command buffers!\n");
+				exit(1);
+			}
+		}
+	}
+}
+
+void vkx_secondary_commands_cleanup(VkxSecondaryCommands* commands) {
+	// Destroying the pools frees their command buffers
+	for (uint32_t frame = 0; frame < VKX_MAX_FRAMES_IN_FLIGHT; frame++) {
+		for (uint32_t i = 0; i < commands->count; i++) {
+			if (commands->pools[frame][i] != VK_NULL_HANDLE) {
+				vkDestroyCommandPool(vkx_instance.device, commands->pools[frame][i], vkx_get_allocator(VK_OBJECT_TYPE_COMMAND_POOL));
+			}
+		}
+	}
+	memset(commands, 0, sizeof(VkxSecondaryCommands));
+}
+
+VkCommandBuffer vkx_secondary_commands_begin(VkxSecondaryCommands* commands, uint32_t frame, uint32_t index,
+		const VkxFrameGraphPassInfo* pass_info) {
+	/*
+	 * Start recording one of a frame's secondary command buffers for a pass.
+	 * Different indices can be recorded on different threads at the same time
+	 *
+	 * @param frame The frame in flight, after its fence has been waited on
+	 * @param index Which of the frame's secondary command buffers
+	 * @param pass_info From vkx_frame_graph_get_pass_info() for the pass it's executed in
+	 *
+	 * @return The command buffer, with the viewport and scissor set
+	 */
+	if (index >= commands->count) {
+		fprintf(stderr, "Invalid secondary command buffer %u\n", index);
+		exit(1);
+	}
+
+	vkResetCommandPool(vkx_instance.device, commands->pools[frame][index], 0);
+	VkCommandBuffer command_buffer = commands->command_buffers[frame][index];
+
+	VkCommandBufferInheritanceRenderingInfo rendering_info = {0};
+	rendering_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+	rendering_info.colorAttachmentCount = pass_info->color_formats_count;
+	rendering_info.pColorAttachmentFormats = pass_info->color_formats;
+	rendering_info.depthAttachmentFormat = pass_info->depth_format;
+	rendering_info.stencilAttachmentFormat = VK_FORMAT_UNDEFINED;
+	rendering_info.rasterizationSamples = pass_info->samples;
+	rendering_info.viewMask = pass_info->view_mask;
+
+	VkCommandBufferInheritanceInfo inheritance_info = {0};
+	inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritance_info.pNext = &rendering_info;
+
+	VkCommandBufferBeginInfo begin_info = {0};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+	if (!commands->reusable) {
+		begin_info.flags |= VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+	}
+	begin_info.pInheritanceInfo = &inheritance_info;
+
+	if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+		fprintf(stderr, "failed to begin recording secondary command buffer!\n");
+		exit(1);
+	}
+
+	VkViewport viewport = {0};
+	viewport.width = (float) pass_info->extent.width;
+	viewport.height = (float) pass_info->extent.height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewportWithCount(command_buffer, 1, &viewport);
+
+	vkCmdSetScissorWithCount(command_buffer, 1, &pass_info->render_area);
+
+	return command_buffer;
+}
+
+void vkx_secondary_commands_end(VkCommandBuffer command_buffer) {
+	if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+		fprintf(stderr, "failed to record secondary command buffer!\n");
+		exit(1);
+	}
+}
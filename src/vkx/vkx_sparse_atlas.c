@@ -0,0 +1,829 @@
+/*
+ * Sparse texture atlas, which only keeps the parts of the atlas that are being
+ * drawn in device memory.
+ *
+ * The atlas is packed as usual, but its image is sparse resident and split
+ * into pages of the device's sparse block size.  The mip tail (the levels
+ * smaller than a page) is always resident, and the rest of the pages are
+ * bound to slots in a fixed pool of device memory as they are needed.
+ *
+ * The sparse shaders mark the pages they sample in each frame's feedback
+ * buffer (one pixel in 16, a different one each frame), and fall back to a
+ * coarser level until the page they wanted is resident.  Once a frame has
+ * finished, vkx_sparse_atlas_update() reads its feedback, binds the pages
+ * which aren't resident (evicting those which haven't been sampled for a
+ * while, least recently used first) and copies them in with that frame's
+ * commands.  The feedback is lossy, which only delays a page by a frame.
+ *
+ * The pixels of every page are kept in host memory, so pages are streamed
+ * from there rather than decoded again.
+ *
+ * The binds go through the graphics queue after the last frame submitted,
+ * signalling a timeline which the next frame waits on, so no frame in flight
+ * sees a page change under it.
+ */
+
+#include "vkx/vkx_sparse_atlas.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vkx/vkx_memory.h"
+#include "arena.h"
+#include "jobs.h"
+
+// No slot in the pool or no page in a slot
+#define VKX_SPARSE_NONE UINT32_MAX
+
+// The header of SparseFeedback in the sparse shaders, followed by a bit per
+// page.  Written by the host before the frame and read back after it
+typedef struct {
+	// Which pixel of each 4x4 writes feedback this frame
+	uint32_t sample_offset;
+	// First level in the mip tail
+	uint32_t tail_lod;
+	uint32_t page_size[2];
+	uint32_t pages_per_layer;
+	// First page of each level in a layer
+	uint32_t level_offsets[VKX_SPARSE_MAX_LEVELS];
+	uint32_t page_bits[];
+} VkxSparseFeedback;
+
+typedef struct {
+	// Slot in the pool while it's resident
+	uint32_t slot;
+	uint64_t last_used_frame;
+} VkxSparsePage;
+
+typedef struct {
+	uint32_t level;
+	uint32_t layer;
+	VkOffset3D offset;
+	VkExtent3D extent;
+} VkxSparsePageRegion;
+
+typedef struct {
+	uint8_t* const* level_pixels;
+	uint32_t width;
+	uint32_t height;
+	uint32_t level;
+} VkxSparseDownsampleJob;
+
+static VkxImage image = {0};
+static uint32_t array_layers = 0;
+static uint32_t mip_levels = 0;
+static uint32_t tail_lod = 0;
+static VkExtent2D page_extent = {0};
+static VkDeviceSize slot_size = 0;
+
+// RGBA pixels of every level, layer after layer
+static uint8_t* level_pixels[VKX_SPARSE_MAX_LEVELS] = {0};
+static uint32_t level_columns[VKX_SPARSE_MAX_LEVELS] = {0};
+static uint32_t level_offsets[VKX_SPARSE_MAX_LEVELS + 1] = {0};
+static uint32_t pages_per_layer = 0;
+
+static VkxSparsePage* pages = NULL;
+static uint32_t pages_count = 0;
+static uint32_t resident_count = 0;
+static uint32_t requested_count = 0;
+
+static VkxAllocation pool = {0};
+static VkxAllocation tail = {0};
+// The page in each slot, and the slots without one
+static uint32_t* slot_pages = NULL;
+static uint32_t* free_slots = NULL;
+static uint32_t slots_count = 0;
+static uint32_t free_slots_count = 0;
+
+static VkxBuffer feedback_buffers[VKX_MAX_FRAMES_IN_FLIGHT] = {0};
+static VkDeviceSize feedback_size = 0;
+
+// Each frame's page uploads, which it copies from its staging buffer
+static VkxBuffer staging_buffers[VKX_MAX_FRAMES_IN_FLIGHT] = {0};
+static VkBufferImageCopy* uploads[VKX_MAX_FRAMES_IN_FLIGHT] = {0};
+static uint32_t uploads_count[VKX_MAX_FRAMES_IN_FLIGHT] = {0};
+static uint32_t max_uploads = 0;
+
+// Unbinds for the evicted pages then binds for the new ones
+static VkSparseImageMemoryBind* binds = NULL;
+static VkSemaphore bind_timeline = VK_NULL_HANDLE;
+static uint64_t bind_value = 0;
+static bool binds_submitted = false;
+
+static uint64_t frame_number = 0;
+
+static uint32_t vkx_sparse_level_size(uint32_t size, uint32_t level) {
+	return size >> level > 0 ? size >> level : 1;
+}
+
+static void vkx_sparse_downsample_layers(size_t start, size_t end, void* data) {
+	VkxSparseDownsampleJob* job = data;
+	const uint8_t* src = job->level_pixels[job->level - 1];
+	uint8_t* dst = job->level_pixels[job->level];
+	size_t src_layer_size = (size_t) job->width * job->height * 4;
+	size_t dst_layer_size = (size_t) vkx_sparse_level_size(job->width, 1) * vkx_sparse_level_size(job->height, 1) * 4;
+
+	for (size_t layer = start; layer < end; layer++) {
+		vkx_downsample_srgb(src + src_layer_size * layer, job->width, job->height, dst + dst_layer_size * layer);
+	}
+}
+
+static VkxSparsePageRegion vkx_sparse_page_region(uint32_t index) {
+	/*
+	 * Get where a page is in the image.  Pages at the right and bottom edges of
+	 * a level are cut down to what's left of it
+	 */
+	VkxSparsePageRegion region = {0};
+	region.layer = index / pages_per_layer;
+
+	uint32_t layer_index = index % pages_per_layer;
+	while (layer_index >= level_offsets[region.level + 1]) {
+		region.level++;
+	}
+	layer_index -= level_offsets[region.level];
+
+	uint32_t level_width = vkx_sparse_level_size(image.extent.width, region.level);
+	uint32_t level_height = vkx_sparse_level_size(image.extent.height, region.level);
+	uint32_t x = layer_index % level_columns[region.level] * page_extent.width;
+	uint32_t y = layer_index / level_columns[region.level] * page_extent.height;
+
+	region.offset = (VkOffset3D) {(int32_t) x, (int32_t) y, 0};
+	region.extent.width = level_width - x < page_extent.width ? level_width - x : page_extent.width;
+	region.extent.height = level_height - y < page_extent.height ? level_height - y : page_extent.height;
+	region.extent.depth = 1;
+	return region;
+}
+
+bool vkx_sparse_atlas_is_supported(void) {
+	/*
+	 * Whether the device can sample a sparse atlas with the standard page shape.
+	 * Only asks the device the first time
+	 */
+	static bool checked = false;
+	static bool supported = false;
+	if (checked) {
+		return supported;
+	}
+	checked = true;
+
+	if (!vkx_instance.has_sparse_residency) {
+		return false;
+	}
+
+	uint32_t properties_count = 0;
+	vkGetPhysicalDeviceSparseImageFormatProperties(vkx_instance.physical_device, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TYPE_2D,
+		VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_TILING_OPTIMAL,
+		&properties_count, NULL);
+	supported = properties_count > 0;
+	return supported;
+}
+
+static void vkx_sparse_create_image(uint32_t width, uint32_t height) {
+	image.mip_levels = mip_levels;
+	image.array_layers = array_layers;
+	image.format = VK_FORMAT_R8G8B8A8_SRGB;
+	image.extent.width = width;
+	image.extent.height = height;
+	image.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+
+	VkImageCreateInfo image_info = {0};
+	image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	image_info.flags = VK_IMAGE_CREATE_SPARSE_BINDING_BIT | VK_IMAGE_CREATE_SPARSE_RESIDENCY_BIT;
+	image_info.imageType = VK_IMAGE_TYPE_2D;
+	image_info.extent.width = width;
+	image_info.extent.height = height;
+	image_info.extent.depth = 1;
+	image_info.mipLevels = mip_levels;
+	image_info.arrayLayers = array_layers;
+	image_info.format = image.format;
+	image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+	image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	image_info.usage = image.usage;
+	image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+	image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateImage(vkx_instance.device, &image_info, vkx_get_allocator(VK_OBJECT_TYPE_IMAGE), &image.image) != VK_SUCCESS) {
+		fprintf(stderr, "Failed to create the sparse atlas image!\n");
+		exit(1);
+	}
+}
+
+static VkxSparseFeedback* vkx_sparse_get_feedback(uint32_t frame) {
+	return feedback_buffers[frame].allocation.mapped;
+}
+
+static void vkx_sparse_bind_tail(VkMemoryRequirements memory_requirements) {
+	/*
+	 * Give the mip tail memory of its own and wait for it to be bound, as it
+	 * has to be there to fall back to before anything is drawn
+	 */
+	uint32_t requirements_count = 0;
+	vkGetImageSparseMemoryRequirements(vkx_instance.device, image.image, &requirements_count, NULL);
+	VkSparseImageMemoryRequirements* requirements = malloc(sizeof(VkSparseImageMemoryRequirements) * requirements_count);
+	if (requirements == NULL) {
+		fprintf(stderr, "Failed to allocate the sparse memory requirements\n");
+		exit(1);
+	}
+	vkGetImageSparseMemoryRequirements(vkx_instance.device, image.image, &requirements_count, requirements);
+
+	// The colour aspect sets the page shape.  Any metadata has a tail to bind too
+	bool has_color = false;
+	VkDeviceSize tail_size = 0;
+	for (uint32_t i = 0; i < requirements_count; i++) {
+		const VkSparseImageMemoryRequirements* r = &requirements[i];
+		uint32_t tails = (r->formatProperties.flags & VK_SPARSE_IMAGE_FORMAT_SINGLE_MIPTAIL_BIT) ? 1 : array_layers;
+		tail_size += r->imageMipTailSize * tails;
+
+		if (r->formatProperties.aspectMask & VK_IMAGE_ASPECT_COLOR_BIT) {
+			has_color = true;
+			tail_lod = r->imageMipTailFirstLod;
+			page_extent.width = r->formatProperties.imageGranularity.width;
+			page_extent.height = r->formatProperties.imageGranularity.height;
+		}
+	}
+
+	if (!has_color || tail_lod == 0 || tail_lod >= mip_levels) {
+		fprintf(stderr, "The sparse atlas needs a mip tail below its pages\n");
+		exit(1);
+	}
+
+	VkMemoryRequirements tail_requirements = memory_requirements;
+	tail_requirements.size = tail_size;
+	tail = vkx_memory_alloc(tail_requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false);
+
+	VkSparseMemoryBind* tail_binds = malloc(sizeof(VkSparseMemoryBind) * requirements_count * array_layers);
+	if (tail_binds == NULL) {
+		fprintf(stderr, "Failed to allocate the sparse mip tail binds\n");
+		exit(1);
+	}
+
+	uint32_t tail_binds_count = 0;
+	VkDeviceSize memory_offset = tail.offset;
+	for (uint32_t i = 0; i < requirements_count; i++) {
+		const VkSparseImageMemoryRequirements* r = &requirements[i];
+		uint32_t tails = (r->formatProperties.flags & VK_SPARSE_IMAGE_FORMAT_SINGLE_MIPTAIL_BIT) ? 1 : array_layers;
+
+		for (uint32_t layer = 0; layer < tails; layer++) {
+			VkSparseMemoryBind* bind = &tail_binds[tail_binds_count++];
+			bind->resourceOffset = r->imageMipTailOffset + r->imageMipTailStride * layer;
+			bind->size = r->imageMipTailSize;
+			bind->memory = tail.memory;
+			bind->memoryOffset = memory_offset;
+			bind->flags = (r->formatProperties.aspectMask & VK_IMAGE_ASPECT_METADATA_BIT) ? VK_SPARSE_MEMORY_BIND_METADATA_BIT : 0;
+			memory_offset += r->imageMipTailSize;
+		}
+	}
+
+	VkSparseImageOpaqueMemoryBindInfo opaque_bind = {0};
+	opaque_bind.image = image.image;
+	opaque_bind.bindCount = tail_binds_count;
+	opaque_bind.pBinds = tail_binds;
+
+	VkBindSparseInfo bind_info = {0};
+	bind_info.sType = VK_STRUCTURE_TYPE_BIND_SPARSE_INFO;
+	bind_info.imageOpaqueBindCount = 1;
+	bind_info.pImageOpaqueBinds = &opaque_bind;
+
+	if (vkQueueBindSparse(vkx_instance.graphics_queue, 1, &bind_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+		fprintf(stderr, "Failed to bind the sparse atlas mip tail!\n");
+		exit(1);
+	}
+	vkQueueWaitIdle(vkx_instance.graphics_queue);
+
+	free(tail_binds);
+	free(requirements);
+}
+
+static void vkx_sparse_upload_tail(void) {
+	/*
+	 * Copy the mip tail in and leave the whole image in GENERAL, where it stays
+	 * as pages are copied in while it's being sampled
+	 */
+	VkDeviceSize tail_pixels_size = 0;
+	for (uint32_t level = tail_lod; level < mip_levels; level++) {
+		tail_pixels_size += (VkDeviceSize) vkx_sparse_level_size(image.extent.width, level)
+			* vkx_sparse_level_size(image.extent.height, level) * 4 * array_layers;
+	}
+
+	VkxMemoryTag previous_tag = vkx_memory_set_tag(VKX_MEMORY_TAG_STAGING);
+	VkxBuffer staging = vkx_create_buffer(tail_pixels_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	vkx_memory_set_tag(previous_tag);
+
+	VkBufferImageCopy regions[VKX_SPARSE_MAX_LEVELS] = {0};
+	uint32_t regions_count = 0;
+	VkDeviceSize offset = 0;
+	for (uint32_t level = tail_lod; level < mip_levels; level++) {
+		uint32_t width = vkx_sparse_level_size(image.extent.width, level);
+		uint32_t height = vkx_sparse_level_size(image.extent.height, level);
+		VkDeviceSize size = (VkDeviceSize) width * height * 4 * array_layers;
+		memcpy((uint8_t*) staging.allocation.mapped + offset, level_pixels[level], (size_t) size);
+
+		VkBufferImageCopy* region = &regions[regions_count++];
+		region->bufferOffset = offset;
+		region->imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		region->imageSubresource.mipLevel = level;
+		region->imageSubresource.baseArrayLayer = 0;
+		region->imageSubresource.layerCount = array_layers;
+		region->imageExtent = (VkExtent3D) {width, height, 1};
+		offset += size;
+	}
+
+	VkCommandBuffer command_buffer = vkx_begin_single_time_commands();
+
+	VkImageMemoryBarrier2 barrier = {0};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+	barrier.srcAccessMask = VK_ACCESS_2_NONE;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image.image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.levelCount = mip_levels;
+	barrier.subresourceRange.layerCount = array_layers;
+
+	VkDependencyInfo dependency_info = {0};
+	dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dependency_info.imageMemoryBarrierCount = 1;
+	dependency_info.pImageMemoryBarriers = &barrier;
+	vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+
+	vkCmdCopyBufferToImage(command_buffer, staging.buffer, image.image, VK_IMAGE_LAYOUT_GENERAL, regions_count, regions);
+
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+	vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+
+	vkx_end_single_time_commands(command_buffer);
+	vkx_cleanup_buffer(&staging);
+}
+
+VkxAtlas vkx_create_sparse_texture_atlas(const char* const* filenames, uint32_t count, uint32_t max_page_size,
+		VkDeviceSize budget, uint32_t max_pages_per_frame) {
+	/*
+	 * Load a set of images and pack them into a sparse atlas, which always has a
+	 * full mip chain.  There is only one, and its image belongs to this module
+	 * until vkx_sparse_atlas_cleanup(), though vkx_cleanup_atlas() is what
+	 * destroys it.  The image is in VK_IMAGE_LAYOUT_GENERAL and should be
+	 * sampled with the sparse shaders, which need the feedback buffers from
+	 * vkx_sparse_atlas_get_feedback()
+	 *
+	 * @param budget Bytes of device memory for the pages outside the mip tail
+	 * @param max_pages_per_frame The most pages to copy in each frame
+	 */
+	uint8_t* page_pixels = NULL;
+	VkxAtlas atlas = vkx_pack_texture_atlas(filenames, count, max_page_size, &page_pixels);
+	array_layers = atlas.pages_count;
+	mip_levels = vkx_texture_mip_levels(atlas.page_width, atlas.page_height, true);
+	if (mip_levels > VKX_SPARSE_MAX_LEVELS) {
+		fprintf(stderr, "The sparse atlas can't have more than %d mip levels\n", VKX_SPARSE_MAX_LEVELS);
+		exit(1);
+	}
+
+	// ----- Filter the levels -----
+	level_pixels[0] = page_pixels;
+	for (uint32_t level = 1; level < mip_levels; level++) {
+		size_t size = (size_t) vkx_sparse_level_size(atlas.page_width, level) * vkx_sparse_level_size(atlas.page_height, level) * 4 * array_layers;
+		level_pixels[level] = malloc(size);
+		if (level_pixels[level] == NULL) {
+			fprintf(stderr, "Failed to allocate the sparse atlas levels\n");
+			exit(1);
+		}
+
+		VkxSparseDownsampleJob job = {0};
+		job.level_pixels = level_pixels;
+		job.width = vkx_sparse_level_size(atlas.page_width, level - 1);
+		job.height = vkx_sparse_level_size(atlas.page_height, level - 1);
+		job.level = level;
+		jobs_parallel_for(array_layers, 1, vkx_sparse_downsample_layers, &job);
+	}
+
+	// ----- Create the image and bind its mip tail -----
+	vkx_sparse_create_image(atlas.page_width, atlas.page_height);
+
+	VkMemoryRequirements memory_requirements;
+	vkGetImageMemoryRequirements(vkx_instance.device, image.image, &memory_requirements);
+
+	VkxMemoryTag previous_tag = vkx_memory_set_tag(VKX_MEMORY_TAG_TEXTURES);
+	vkx_sparse_bind_tail(memory_requirements);
+
+	for (uint32_t level = 0; level < tail_lod; level++) {
+		uint32_t width = vkx_sparse_level_size(atlas.page_width, level);
+		uint32_t height = vkx_sparse_level_size(atlas.page_height, level);
+		level_columns[level] = (width + page_extent.width - 1) / page_extent.width;
+		level_offsets[level + 1] = level_offsets[level] + level_columns[level] * ((height + page_extent.height - 1) / page_extent.height);
+	}
+	pages_per_layer = level_offsets[tail_lod];
+	pages_count = pages_per_layer * array_layers;
+
+	pages = malloc(sizeof(VkxSparsePage) * pages_count);
+	if (pages == NULL) {
+		fprintf(stderr, "Failed to allocate the sparse atlas pages\n");
+		exit(1);
+	}
+	for (uint32_t i = 0; i < pages_count; i++) {
+		pages[i].slot = VKX_SPARSE_NONE;
+		pages[i].last_used_frame = 0;
+	}
+
+	// ----- Make the page pool -----
+	// Every page takes a whole block, even the cut down ones at the edges
+	slot_size = (VkDeviceSize) page_extent.width * page_extent.height * 4;
+	slot_size = (slot_size + memory_requirements.alignment - 1) / memory_requirements.alignment * memory_requirements.alignment;
+
+	slots_count = (uint32_t) (budget / slot_size);
+	slots_count = slots_count < max_pages_per_frame ? max_pages_per_frame : slots_count;
+	slots_count = slots_count > pages_count ? pages_count : slots_count;
+
+	VkMemoryRequirements pool_requirements = memory_requirements;
+	pool_requirements.size = slot_size * slots_count;
+	pool = vkx_memory_alloc(pool_requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false);
+	vkx_memory_set_tag(previous_tag);
+
+	slot_pages = malloc(sizeof(uint32_t) * slots_count);
+	free_slots = malloc(sizeof(uint32_t) * slots_count);
+	if (slot_pages == NULL || free_slots == NULL) {
+		fprintf(stderr, "Failed to allocate the sparse atlas slots\n");
+		exit(1);
+	}
+	for (uint32_t i = 0; i < slots_count; i++) {
+		slot_pages[i] = VKX_SPARSE_NONE;
+		// Handed out from the end, so the first slots go first
+		free_slots[i] = slots_count - 1 - i;
+	}
+	free_slots_count = slots_count;
+
+	// ----- Feedback and staging for each frame -----
+	feedback_size = sizeof(VkxSparseFeedback) + sizeof(uint32_t) * ((pages_count + 31) / 32);
+	max_uploads = max_pages_per_frame;
+
+	// Cached memory if there is any, as the feedback is read every frame
+	VkMemoryPropertyFlags feedback_properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+	if (vkx_memory_has_type(UINT32_MAX, feedback_properties | VK_MEMORY_PROPERTY_HOST_CACHED_BIT)) {
+		feedback_properties |= VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+	}
+
+	previous_tag = vkx_memory_set_tag(VKX_MEMORY_TAG_STAGING);
+	for (uint32_t i = 0; i < vkx_instance.frames_in_flight; i++) {
+		feedback_buffers[i] = vkx_create_buffer(feedback_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, feedback_properties);
+		staging_buffers[i] = vkx_create_buffer(slot_size * max_uploads, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		uploads[i] = malloc(sizeof(VkBufferImageCopy) * max_uploads);
+		if (uploads[i] == NULL) {
+			fprintf(stderr, "Failed to allocate the sparse atlas uploads\n");
+			exit(1);
+		}
+
+		VkxSparseFeedback* feedback = vkx_sparse_get_feedback(i);
+		memset(feedback, 0, (size_t) feedback_size);
+		feedback->tail_lod = tail_lod;
+		feedback->page_size[0] = page_extent.width;
+		feedback->page_size[1] = page_extent.height;
+		feedback->pages_per_layer = pages_per_layer;
+		memcpy(feedback->level_offsets, level_offsets, sizeof(feedback->level_offsets));
+	}
+	vkx_memory_set_tag(previous_tag);
+
+	binds = malloc(sizeof(VkSparseImageMemoryBind) * max_uploads * 2);
+	if (binds == NULL) {
+		fprintf(stderr, "Failed to allocate the sparse atlas binds\n");
+		exit(1);
+	}
+
+	VkSemaphoreTypeCreateInfo timeline_type_info = {0};
+	timeline_type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	timeline_type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	timeline_type_info.initialValue = 0;
+
+	VkSemaphoreCreateInfo timeline_info = {0};
+	timeline_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	timeline_info.pNext = &timeline_type_info;
+
+	if (vkCreateSemaphore(vkx_instance.device, &timeline_info, vkx_get_allocator(VK_OBJECT_TYPE_SEMAPHORE), &bind_timeline) != VK_SUCCESS) {
+		fprintf(stderr, "failed to create the sparse bind timeline semaphore!\n");
+		exit(1);
+	}
+
+	// ----- Upload the mip tail -----
+	vkx_sparse_upload_tail();
+	image.view = vkx_create_image_array_view(image.image, image.format, VK_IMAGE_ASPECT_COLOR_BIT, mip_levels, array_layers);
+	atlas.image = image;
+
+	printf("Sparse texture atlas has %d pages of %dx%d, with room for %d of them\n",
+		pages_count, page_extent.width, page_extent.height, slots_count);
+
+	return atlas;
+}
+
+void vkx_sparse_atlas_cleanup(void) {
+	/*
+	 * Free everything but the image, once the device is idle
+	 */
+	for (uint32_t i = 0; i < vkx_instance.frames_in_flight; i++) {
+		vkx_cleanup_buffer(&feedback_buffers[i]);
+		vkx_cleanup_buffer(&staging_buffers[i]);
+		free(uploads[i]);
+		uploads[i] = NULL;
+	}
+	vkDestroySemaphore(vkx_instance.device, bind_timeline, vkx_get_allocator(VK_OBJECT_TYPE_SEMAPHORE));
+	bind_timeline = VK_NULL_HANDLE;
+
+	vkx_memory_free(&pool);
+	vkx_memory_free(&tail);
+
+	for (uint32_t level = 0; level < VKX_SPARSE_MAX_LEVELS; level++) {
+		free(level_pixels[level]);
+		level_pixels[level] = NULL;
+	}
+	free(binds);
+	free(free_slots);
+	free(slot_pages);
+	free(pages);
+	binds = NULL;
+	free_slots = NULL;
+	slot_pages = NULL;
+	pages = NULL;
+	pages_count = 0;
+	resident_count = 0;
+	image = (VkxImage) {0};
+}
+
+VkDescriptorBufferInfo vkx_sparse_atlas_get_feedback(uint32_t frame) {
+	// The sparse shaders' SparseFeedback binding for a frame in flight
+	VkDescriptorBufferInfo buffer_info = {0};
+	buffer_info.buffer = feedback_buffers[frame].buffer;
+	buffer_info.offset = 0;
+	buffer_info.range = feedback_size;
+	return buffer_info;
+}
+
+static uint32_t vkx_sparse_take_slot(void) {
+	/*
+	 * Get a slot for a page, evicting the least recently used page if they're
+	 * all taken.  Pages sampled in the last VKX_SPARSE_KEEP_FRAMES frames stay
+	 *
+	 * @return The slot, or VKX_SPARSE_NONE if every page is still being used
+	 */
+	if (free_slots_count > 0) {
+		return free_slots[--free_slots_count];
+	}
+
+	uint32_t oldest_slot = VKX_SPARSE_NONE;
+	uint64_t oldest_frame = UINT64_MAX;
+	for (uint32_t i = 0; i < slots_count; i++) {
+		uint64_t last_used_frame = pages[slot_pages[i]].last_used_frame;
+		if (last_used_frame + VKX_SPARSE_KEEP_FRAMES < frame_number && last_used_frame < oldest_frame) {
+			oldest_slot = i;
+			oldest_frame = last_used_frame;
+		}
+	}
+	return oldest_slot;
+}
+
+void vkx_sparse_atlas_update(uint32_t frame) {
+	/*
+	 * Stream in the pages a frame asked for.  Call once the frame has been
+	 * waited on and before its commands are recorded.  The binds are submitted
+	 * straight away, so the frame has to wait on them (see
+	 * vkx_sparse_atlas_get_bind_wait())
+	 *
+	 * @param frame The frame in flight, whose feedback and staging are free
+	 */
+	frame_number++;
+	uploads_count[frame] = 0;
+	binds_submitted = false;
+
+	// ----- Read what the frame sampled -----
+	VkxSparseFeedback* feedback = vkx_sparse_get_feedback(frame);
+	size_t requests_mark = arena_get_mark(frame_arena());
+	uint32_t* requests = FRAME_ALLOC(uint32_t, max_uploads);
+	uint32_t requests_count = 0;
+	requested_count = 0;
+
+	for (uint32_t word_index = 0; word_index < (pages_count + 31) / 32; word_index++) {
+		uint32_t word = feedback->page_bits[word_index];
+		if (word == 0) {
+			continue;
+		}
+		feedback->page_bits[word_index] = 0;
+
+		for (uint32_t bit = 0; bit < 32; bit++) {
+			uint32_t index = word_index * 32 + bit;
+			if ((word & (1u << bit)) == 0 || index >= pages_count) {
+				continue;
+			}
+
+			pages[index].last_used_frame = frame_number;
+			if (pages[index].slot == VKX_SPARSE_NONE) {
+				requested_count++;
+				if (requests_count < max_uploads) {
+					requests[requests_count++] = index;
+				}
+			}
+		}
+	}
+
+	// A different pixel of each 4x4 next time round
+	feedback->sample_offset = (uint32_t) (frame_number % 16);
+
+	// ----- Bind them and copy them to the staging buffer -----
+	uint32_t unbinds_count = 0;
+	uint32_t page_binds_count = 0;
+	VkSparseImageMemoryBind* page_binds = binds + max_uploads;
+	uint8_t* staging = staging_buffers[frame].allocation.mapped;
+
+	for (uint32_t i = 0; i < requests_count; i++) {
+		uint32_t slot = vkx_sparse_take_slot();
+		if (slot == VKX_SPARSE_NONE) {
+			break;
+		}
+
+		// Evict whatever was there
+		if (slot_pages[slot] != VKX_SPARSE_NONE) {
+			uint32_t evicted = slot_pages[slot];
+			VkxSparsePageRegion region = vkx_sparse_page_region(evicted);
+
+			VkSparseImageMemoryBind* unbind = &binds[unbinds_count++];
+			*unbind = (VkSparseImageMemoryBind) {0};
+			unbind->subresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			unbind->subresource.mipLevel = region.level;
+			unbind->subresource.arrayLayer = region.layer;
+			unbind->offset = region.offset;
+			unbind->extent = region.extent;
+			unbind->memory = VK_NULL_HANDLE;
+
+			pages[evicted].slot = VKX_SPARSE_NONE;
+			resident_count--;
+		}
+
+		uint32_t index = requests[i];
+		VkxSparsePageRegion region = vkx_sparse_page_region(index);
+
+		VkSparseImageMemoryBind* bind = &page_binds[page_binds_count++];
+		*bind = (VkSparseImageMemoryBind) {0};
+		bind->subresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		bind->subresource.mipLevel = region.level;
+		bind->subresource.arrayLayer = region.layer;
+		bind->offset = region.offset;
+		bind->extent = region.extent;
+		bind->memory = pool.memory;
+		bind->memoryOffset = pool.offset + slot_size * slot;
+
+		slot_pages[slot] = index;
+		pages[index].slot = slot;
+		resident_count++;
+
+		// The pixels go in tightly packed, a page to a slot of the staging buffer
+		uint32_t level_width = vkx_sparse_level_size(image.extent.width, region.level);
+		uint32_t level_height = vkx_sparse_level_size(image.extent.height, region.level);
+		const uint8_t* src = level_pixels[region.level] + (size_t) region.layer * level_width * level_height * 4;
+		VkDeviceSize staging_offset = slot_size * uploads_count[frame];
+
+		for (uint32_t y = 0; y < region.extent.height; y++) {
+			memcpy(
+				staging + staging_offset + (size_t) y * region.extent.width * 4,
+				src + ((size_t) (region.offset.y + y) * level_width + (uint32_t) region.offset.x) * 4,
+				(size_t) region.extent.width * 4
+			);
+		}
+
+		VkBufferImageCopy* upload = &uploads[frame][uploads_count[frame]++];
+		*upload = (VkBufferImageCopy) {0};
+		upload->bufferOffset = staging_offset;
+		upload->imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		upload->imageSubresource.mipLevel = region.level;
+		upload->imageSubresource.baseArrayLayer = region.layer;
+		upload->imageSubresource.layerCount = 1;
+		upload->imageOffset = region.offset;
+		upload->imageExtent = region.extent;
+	}
+	arena_release(frame_arena(), requests_mark);
+
+	if (page_binds_count == 0) {
+		return;
+	}
+
+	// The unbinds go first, as their memory goes to the new pages
+	memmove(binds + unbinds_count, page_binds, sizeof(VkSparseImageMemoryBind) * page_binds_count);
+
+	VkSparseImageMemoryBindInfo image_bind = {0};
+	image_bind.image = image.image;
+	image_bind.bindCount = unbinds_count + page_binds_count;
+	image_bind.pBinds = binds;
+
+	// After the last frame submitted, which could still be sampling the
+	// evicted pages
+	uint64_t wait_value = vkx_frame_timeline_pending() - 1;
+	uint64_t signal_value = ++bind_value;
+
+	VkTimelineSemaphoreSubmitInfo timeline_info = {0};
+	timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+	timeline_info.waitSemaphoreValueCount = wait_value > 0 ? 1 : 0;
+	timeline_info.pWaitSemaphoreValues = &wait_value;
+	timeline_info.signalSemaphoreValueCount = 1;
+	timeline_info.pSignalSemaphoreValues = &signal_value;
+
+	VkBindSparseInfo bind_info = {0};
+	bind_info.sType = VK_STRUCTURE_TYPE_BIND_SPARSE_INFO;
+	bind_info.pNext = &timeline_info;
+	bind_info.waitSemaphoreCount = wait_value > 0 ? 1 : 0;
+	bind_info.pWaitSemaphores = &vkx_instance.frame_timeline;
+	bind_info.imageBindCount = 1;
+	bind_info.pImageBinds = &image_bind;
+	bind_info.signalSemaphoreCount = 1;
+	bind_info.pSignalSemaphores = &bind_timeline;
+
+	if (vkQueueBindSparse(vkx_instance.graphics_queue, 1, &bind_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+		fprintf(stderr, "Failed to bind the sparse atlas pages!\n");
+		exit(1);
+	}
+	binds_submitted = true;
+}
+
+bool vkx_sparse_atlas_get_bind_wait(VkSemaphoreSubmitInfo* wait_info) {
+	/*
+	 * Get what the frame's submission has to wait on for the pages bound by
+	 * vkx_sparse_atlas_update()
+	 *
+	 * @return false if nothing was bound, so there's nothing to wait on
+	 */
+	if (!binds_submitted) {
+		return false;
+	}
+
+	*wait_info = (VkSemaphoreSubmitInfo) {0};
+	wait_info->sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+	wait_info->semaphore = bind_timeline;
+	wait_info->value = bind_value;
+	wait_info->stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+	return true;
+}
+
+void vkx_sparse_atlas_record_uploads(VkCommandBuffer command_buffer, uint32_t frame) {
+	/*
+	 * Copy the pages bound this frame in, before anything is drawn
+	 */
+	if (uploads_count[frame] == 0) {
+		return;
+	}
+
+	vkCmdCopyBufferToImage(command_buffer, staging_buffers[frame].buffer, image.image, VK_IMAGE_LAYOUT_GENERAL,
+		uploads_count[frame], uploads[frame]);
+
+	VkMemoryBarrier2 barrier = {0};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+
+	VkDependencyInfo dependency_info = {0};
+	dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dependency_info.memoryBarrierCount = 1;
+	dependency_info.pMemoryBarriers = &barrier;
+	vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+}
+
+void vkx_sparse_atlas_record_feedback_barrier(VkCommandBuffer command_buffer) {
+	/*
+	 * Make the frame's feedback visible to the host, at the end of the frame
+	 */
+	VkMemoryBarrier2 barrier = {0};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT;
+
+	VkDependencyInfo dependency_info = {0};
+	dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dependency_info.memoryBarrierCount = 1;
+	dependency_info.pMemoryBarriers = &barrier;
+	vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+}
+
+VkxSparseAtlasStats vkx_sparse_atlas_get_stats(void) {
+	VkxSparseAtlasStats stats = {0};
+	stats.pages_count = pages_count;
+	stats.resident_count = resident_count;
+	stats.slots_count = slots_count;
+	stats.requested_count = requested_count;
+	stats.pool_bytes = pool.size;
+	stats.tail_bytes = tail.size;
+	return stats;
+}
+
+void vkx_sparse_atlas_print_stats(void) {
+	VkxSparseAtlasStats stats = vkx_sparse_atlas_get_stats();
+	printf("Sparse atlas: %d of %d pages resident (%d slots), %d wanted, %.1f MiB pool + %.1f MiB mip tail\n",
+		stats.resident_count, stats.pages_count, stats.slots_count, stats.requested_count,
+		stats.pool_bytes / (1024.0 * 1024.0), stats.tail_bytes / (1024.0 * 1024.0));
+}
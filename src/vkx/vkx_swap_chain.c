@@ -1,11 +1,31 @@
 #include "vkx/vkx_swap_chain.h"
 #include "vkx/vkx_core.h"
+#include "vkx/vkx_memory.h"
+#include "arena.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 #include <SDL3/SDL.h>
+#include <SDL3/SDL_vulkan.h>
+
+// Used if the surface supports it, otherwise FIFO (which is always there)
+static VkPresentModeKHR preferred_present_mode = VK_PRESENT_MODE_MAILBOX_KHR;
+// 0 for one more than the surface's minimum
+static uint32_t preferred_image_count = 0;
+// Rotate in the screen shader rather than leaving it to the compositor
+static bool pre_rotation_enabled = true;
+// Read back in the pass drawing to them, if the surface supports it
+static bool input_attachment_enabled = false;
+
+static PFN_vkWaitForPresentKHR wait_for_present_func = NULL;
+static PFN_vkGetPhysicalDeviceSurfaceCapabilities2KHR get_surface_capabilities2_func = NULL;
+
+// Longest a present fence is waited for, in case the present never finished
+// (e.g. it failed)
+#define VKX_PRESENT_FENCE_TIMEOUT_NS 1000000000ull
 
 static VkExtent2D vkx_choose_swap_extent(SDL_Window* window, VkSurfaceCapabilitiesKHR *capabilities) {
 	if (capabilities->currentExtent.width != 0xFFFFFFFF) {
@@ -38,21 +58,143 @@ static VkExtent2D vkx_choose_swap_extent(SDL_Window* window, VkSurfaceCapabiliti
 	}
 }
 
-void vkx_create_swap_chain(bool create_depth_image) {
+static uint32_t vkx_transform_quarter_turns(VkSurfaceTransformFlagBitsKHR transform) {
+	switch (transform) {
+		case VK_SURFACE_TRANSFORM_ROTATE_90_BIT_KHR:
+			return 1;
+		case VK_SURFACE_TRANSFORM_ROTATE_180_BIT_KHR:
+			return 2;
+		case VK_SURFACE_TRANSFORM_ROTATE_270_BIT_KHR:
+			return 3;
+		default:
+			return 0;
+	}
+}
+
+static VkSurfaceTransformFlagBitsKHR vkx_choose_pre_transform(const VkSurfaceCapabilitiesKHR* capabilities) {
+	/*
+	 * Pick the transform to create the swap chain with.  Matching the display's
+	 * current transform (and rotating in the screen shader) saves the compositor
+	 * a full screen rotation every frame.  Mirrored transforms aren't handled by
+	 * the shader, so those are left to the compositor if it can
+	 */
+	VkSurfaceTransformFlagBitsKHR current = capabilities->currentTransform;
+	bool identity_supported = (capabilities->supportedTransforms & VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR) != 0;
+
+	bool rotation = current == VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR || vkx_transform_quarter_turns(current) > 0;
+	if ((pre_rotation_enabled && rotation) || !identity_supported) {
+		return current;
+	}
+	return VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
+}
+
+static void vkx_query_compatible_present_modes(VkxSwapChain* swap_chain, VkSurfaceKHR surface, VkPresentModeKHR present_mode) {
+	/*
+	 * Find the present modes a swap chain created with present_mode can switch
+	 * to from one present to the next (VK_EXT_surface_maintenance1), into
+	 * swap_chain->present_modes.  Just present_mode itself if the surface
+	 * doesn't say
+	 */
+	if (get_surface_capabilities2_func == NULL) {
+		get_surface_capabilities2_func = (PFN_vkGetPhysicalDeviceSurfaceCapabilities2KHR) vkGetInstanceProcAddr(
+				vkx_instance.instance, "vkGetPhysicalDeviceSurfaceCapabilities2KHR");
+		if (get_surface_capabilities2_func == NULL) {
+			fprintf(stderr, "failed to load vkGetPhysicalDeviceSurfaceCapabilities2KHR!\n");
+			exit(1);
+		}
+	}
+
+	VkSurfacePresentModeEXT surface_present_mode = {0};
+	surface_present_mode.sType = VK_STRUCTURE_TYPE_SURFACE_PRESENT_MODE_EXT;
+	surface_present_mode.presentMode = present_mode;
+
+	VkPhysicalDeviceSurfaceInfo2KHR surface_info = {0};
+	surface_info.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SURFACE_INFO_2_KHR;
+	surface_info.pNext = &surface_present_mode;
+	surface_info.surface = surface;
+
+	VkSurfacePresentModeCompatibilityEXT compatibility = {0};
+	compatibility.sType = VK_STRUCTURE_TYPE_SURFACE_PRESENT_MODE_COMPATIBILITY_EXT;
+	compatibility.presentModeCount = VKX_MAX_PRESENT_MODES;
+	compatibility.pPresentModes = swap_chain->present_modes;
+
+	VkSurfaceCapabilities2KHR capabilities = {0};
+	capabilities.sType = VK_STRUCTURE_TYPE_SURFACE_CAPABILITIES_2_KHR;
+	capabilities.pNext = &compatibility;
+
+	swap_chain->present_modes_count = 0;
+	if (get_surface_capabilities2_func(vkx_instance.physical_device, &surface_info, &capabilities) == VK_SUCCESS) {
+		swap_chain->present_modes_count = compatibility.presentModeCount;
+	}
+
+	// It has to be one of its own modes
+	for (uint32_t i = 0; i < swap_chain->present_modes_count; i++) {
+		if (swap_chain->present_modes[i] == present_mode) {
+			return;
+		}
+	}
+	if (swap_chain->present_modes_count == VKX_MAX_PRESENT_MODES) {
+		swap_chain->present_modes_count--;
+	}
+	swap_chain->present_modes[swap_chain->present_modes_count++] = present_mode;
+}
+
+static void vkx_create_swap_chain_depth_image(VkxSwapChain* swap_chain, bool create_depth_image) {
 	/*
-	 * Create the swap chain
+	 * Create the depth image to go with the swap chain images, if asked for
+	 */
+	// TODO: there should be 1 per frame
+	swap_chain->has_depth_image = create_depth_image;
+	if (create_depth_image) {
+		VkFormat depth_format = vkx_find_depth_format();
+
+		VkxMemoryTag previous_tag = vkx_memory_set_tag(VKX_MEMORY_TAG_OFFSCREEN);
+		swap_chain->depth_image = vkx_create_image(
+			swap_chain->extent.width,
+			swap_chain->extent.height,
+			1,
+			depth_format,
+			VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+		);
+		vkx_memory_set_tag(previous_tag);
+
+		swap_chain->depth_image.view = vkx_create_image_view(swap_chain->depth_image.image, depth_format, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
+
+		// Transition the image layout to depth stencil attachment
+		vkx_transition_image_layout_tmp_buffer(
+			swap_chain->depth_image.image, depth_format,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+		);
+		printf(" Depth image created\n");
+	}
+}
+
+static bool vkx_create_window_swap_chain(VkxSwapChain* swap_chain, SDL_Window* window, VkSurfaceKHR surface, bool create_depth_image) {
+	/*
+	 * Create a swap chain for a window's surface, handing over the one
+	 * swap_chain has (if any) as the old one
 	 *
 	 * @param create_depth_image Whether to create a depth image (for depth test)
+	 *
+	 * @return false if the surface can't have one (no formats or present
+	 *         modes)
 	 */
-	VkxSwapChainSupportDetails swap_chain_support = vkx_query_swap_chain_support(vkx_instance.physical_device, vkx_instance.surface);
+	// Recreating after a resize is part of a frame, so this is in the frame
+	// arena rather than the heap
+	size_t arena_mark = arena_get_mark(frame_arena());
+	VkxSwapChainSupportDetails swap_chain_support = vkx_query_swap_chain_support(vkx_instance.physical_device, surface);
 
 	if (swap_chain_support.formats_count == 0) {
 		fprintf(stderr, "Swap chain support not available (no formats)\n");
-		exit(1);
+		arena_release(frame_arena(), arena_mark);
+		return false;
 	}
 	else if (swap_chain_support.present_modes_count == 0) {
 		fprintf(stderr, "Swap chain support not available (no present modes)\n");
-		exit(1);
+		arena_release(frame_arena(), arena_mark);
+		return false;
 	}
 
 	printf(" Swap chain support: %d formats, %d present modes\n", swap_chain_support.formats_count, swap_chain_support.present_modes_count);
@@ -66,36 +208,65 @@ void vkx_create_swap_chain(bool create_depth_image) {
 		}
 	}
 	
-	// Choose the best present mode from the available present modes
-	// VkPresentModeKHR presentMode = chooseSwapPresentMode(swap_chain_support.presentModes);
+	// Use the preferred present mode if there is one
 	VkPresentModeKHR present_mode = VK_PRESENT_MODE_FIFO_KHR;
 	for (uint32_t i = 0; i < swap_chain_support.present_modes_count; i++) {
-		if (swap_chain_support.present_modes[i] == VK_PRESENT_MODE_MAILBOX_KHR) {
+		if (swap_chain_support.present_modes[i] == preferred_present_mode) {
 			present_mode = swap_chain_support.present_modes[i];
 			break;
 		}
 	}
-
-	vkx_swap_chain.extent = vkx_choose_swap_extent(vkx_instance.window, &swap_chain_support.capabilities);
-	printf(" Swap chain extent: %d x %d\n", vkx_swap_chain.extent.width, vkx_swap_chain.extent.height);
+	if (present_mode != preferred_present_mode) {
+		printf(" %s isn't supported, using %s\n", vkx_present_mode_name(preferred_present_mode), vkx_present_mode_name(present_mode));
+	}
+	swap_chain->present_mode = present_mode;
+	// Present IDs only have to increase within a swap chain
+	swap_chain->present_id = 0;
+
+	swap_chain->extent = vkx_choose_swap_extent(window, &swap_chain_support.capabilities);
+
+	// The surface's extent is in the rotated orientation, but pre-rotated
+	// images are in the display's native one
+	swap_chain->pre_transform = vkx_choose_pre_transform(&swap_chain_support.capabilities);
+	swap_chain->pre_rotation = vkx_transform_quarter_turns(swap_chain->pre_transform);
+	if (swap_chain->pre_rotation % 2 == 1) {
+		uint32_t width = swap_chain->extent.width;
+		swap_chain->extent.width = swap_chain->extent.height;
+		swap_chain->extent.height = width;
+	}
+	printf(" Swap chain extent: %d x %d, pre-rotated %d degrees\n",
+			swap_chain->extent.width, swap_chain->extent.height, swap_chain->pre_rotation * 90);
 
 	uint32_t image_count = swap_chain_support.capabilities.minImageCount + 1;
+	if (preferred_image_count > 0) {
+		image_count = preferred_image_count;
+	}
+	if (image_count < swap_chain_support.capabilities.minImageCount) {
+		image_count = swap_chain_support.capabilities.minImageCount;
+	}
 	if (swap_chain_support.capabilities.maxImageCount > 0 && image_count > swap_chain_support.capabilities.maxImageCount) {
 		image_count = swap_chain_support.capabilities.maxImageCount;
 	}
 
 	VkSwapchainCreateInfoKHR create_info = {0};
 	create_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-	create_info.surface = vkx_instance.surface;
+	create_info.surface = surface;
 
 	create_info.minImageCount = image_count;
 	create_info.imageFormat = surface_format.format;
 	create_info.imageColorSpace = surface_format.colorSpace;
-	create_info.imageExtent = vkx_swap_chain.extent;
+	create_info.imageExtent = swap_chain->extent;
 	create_info.imageArrayLayers = 1;
-	create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+	// Copying to the images lets the screen pass skip its shader, and copying
+	// from them is how frames are captured
+	swap_chain->image_usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT
+		| (swap_chain_support.capabilities.supportedUsageFlags & (VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT));
+	if (input_attachment_enabled) {
+		swap_chain->image_usage |= swap_chain_support.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+	}
+	create_info.imageUsage = swap_chain->image_usage;
 
-	VkxQueueFamilyIndices indices = vkx_find_queue_families(vkx_instance.physical_device, vkx_instance.surface);
+	VkxQueueFamilyIndices indices = vkx_find_queue_families(vkx_instance.physical_device, surface);
 	uint32_t queueFamilyIndices[] = {indices.graphics_family, indices.present_family};
 
 	if (indices.graphics_family != indices.present_family) {
@@ -106,177 +277,630 @@ void vkx_create_swap_chain(bool create_depth_image) {
 		create_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
 	}
 
-	create_info.preTransform = swap_chain_support.capabilities.currentTransform;
+	create_info.preTransform = swap_chain->pre_transform;
 	create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	create_info.presentMode = present_mode;
 	create_info.clipped = VK_TRUE;
+	// Handing over the old one (when recreating) lets its images be reused,
+	// and its presents finish while it waits to be destroyed
+	create_info.oldSwapchain = swap_chain->swap_chain;
+
+	// With swap chain maintenance it can switch between the modes which are
+	// compatible with this one without being recreated
+	VkSwapchainPresentModesCreateInfoEXT present_modes_info = {0};
+	swap_chain->present_modes_count = 0;
+	if (vkx_instance.has_swapchain_maintenance1) {
+		vkx_query_compatible_present_modes(swap_chain, surface, present_mode);
+
+		present_modes_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_MODES_CREATE_INFO_EXT;
+		present_modes_info.presentModeCount = swap_chain->present_modes_count;
+		present_modes_info.pPresentModes = swap_chain->present_modes;
+		create_info.pNext = &present_modes_info;
+	}
 
-	if (vkCreateSwapchainKHR(vkx_instance.device, &create_info, NULL, &vkx_swap_chain.swap_chain) != VK_SUCCESS) {
+	if (vkCreateSwapchainKHR(vkx_instance.device, &create_info, vkx_get_allocator(VK_OBJECT_TYPE_SWAPCHAIN_KHR), &swap_chain->swap_chain) != VK_SUCCESS) {
 		fprintf(stderr, "failed to create swap chain!");
 		exit(1);
 	}
 	
-	vkGetSwapchainImagesKHR(vkx_instance.device, vkx_swap_chain.swap_chain, &vkx_swap_chain.images_count, NULL);
-	vkx_swap_chain.images = malloc(sizeof(VkImage) * vkx_swap_chain.images_count);
-	vkGetSwapchainImagesKHR(vkx_instance.device, vkx_swap_chain.swap_chain, &vkx_swap_chain.images_count, vkx_swap_chain.images);
+	vkGetSwapchainImagesKHR(vkx_instance.device, swap_chain->swap_chain, &swap_chain->images_count, NULL);
+	swap_chain->images = malloc(sizeof(VkImage) * swap_chain->images_count);
+	vkGetSwapchainImagesKHR(vkx_instance.device, swap_chain->swap_chain, &swap_chain->images_count, swap_chain->images);
 
 	VkSemaphoreCreateInfo semaphore_info = {0};
 	semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-	vkx_swap_chain.render_finished_semaphores = malloc(sizeof(VkSemaphore) * vkx_swap_chain.images_count);
-	for (size_t i = 0; i < vkx_swap_chain.images_count; i++) {
-		if (vkCreateSemaphore(vkx_instance.device, &semaphore_info, NULL, &vkx_swap_chain.render_finished_semaphores[i]) != VK_SUCCESS) {
+	swap_chain->render_finished_semaphores = malloc(sizeof(VkSemaphore) * swap_chain->images_count);
+	for (size_t i = 0; i < swap_chain->images_count; i++) {
+		if (vkCreateSemaphore(vkx_instance.device, &semaphore_info, vkx_get_allocator(VK_OBJECT_TYPE_SEMAPHORE), &swap_chain->render_finished_semaphores[i]) != VK_SUCCESS) {
 			fprintf(stderr, "failed to create render finished semaphore for a swap chain image!\n");
 			exit(1);
 		}
 	}
-	
-	// Transition the images to a valid layout
-    // Begin the command buffer
-    VkCommandBufferBeginInfo begin_info = {0};
-    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    begin_info.flags = 0;
-
-	// TODO: convert to single use command buffer?
-	VkCommandBuffer command_buffer = vkx_instance.command_buffers[0];
-
-    if (vkResetCommandBuffer(command_buffer, 0) != VK_SUCCESS) {
-        fprintf(stderr, "failed to reset command buffer!");
-        exit(1);
-    }
-
-    if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
-        fprintf(stderr, "failed to begin recording command buffer!");
-        exit(1);
-    }
-	
-	// All of the swap chain images are now in the VK_IMAGE_LAYOUT_UNDEFINED layout, which is not a valid
-	// layout for rendering - we need to transition them to VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
-
-    // Transition the images to a valid layout
-    for (uint32_t i = 0; i < vkx_swap_chain.images_count; i++) {
-        VkImageMemoryBarrier barrier = {0};
-        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-        barrier.srcAccessMask = 0;
-        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.image = vkx_swap_chain.images[i];
-        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        barrier.subresourceRange.baseMipLevel = 0;
-        barrier.subresourceRange.levelCount = 1;
-        barrier.subresourceRange.baseArrayLayer = 0;
-        barrier.subresourceRange.layerCount = 1;
-
-        VkPipelineStageFlags src_stage_mask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-        VkPipelineStageFlags dst_stage_mask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-
-        vkCmdPipelineBarrier(
-            command_buffer,
-            src_stage_mask, // Pipeline stage that source access mask applies to
-            dst_stage_mask, // Pipeline stage that destination access mask applies to
-            0,              // Dependency flags (not used in this case)
-            0, NULL,        // Memory barriers
-            0, NULL,        // Buffer memory barriers
-            1, &barrier     // Image memory barriers
-        );
-    }
-
-    if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
-        fprintf(stderr, "failed to record command buffer!");
-        exit(1);
-    }
-	
-	// Submit the command buffer
-	VkSubmitInfo submit_info = {0};
-	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submit_info.commandBufferCount = 1;
-	submit_info.pCommandBuffers = &command_buffer;
-
-	if (vkQueueSubmit(vkx_instance.graphics_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
-		fprintf(stderr, "failed to submit command buffer!");
-		exit(1);
+
+	// Signalled to start with, as if each image had been presented
+	swap_chain->present_fences = NULL;
+	if (vkx_instance.has_swapchain_maintenance1) {
+		VkFenceCreateInfo fence_info = {0};
+		fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+		swap_chain->present_fences = malloc(sizeof(VkFence) * swap_chain->images_count);
+		for (size_t i = 0; i < swap_chain->images_count; i++) {
+			if (vkCreateFence(vkx_instance.device, &fence_info, vkx_get_allocator(VK_OBJECT_TYPE_FENCE), &swap_chain->present_fences[i]) != VK_SUCCESS) {
+				fprintf(stderr, "failed to create present fence for a swap chain image!\n");
+				exit(1);
+			}
+		}
 	}
 	
+	// The images start off undefined, which is how the frame graph treats them
+	// at the start of every frame anyway, so they don't need a transition
+
 	// ----- Now create the image views -----
-	vkx_swap_chain.image_views = malloc(sizeof(VkImageView) * vkx_swap_chain.images_count);
+	swap_chain->image_views = malloc(sizeof(VkImageView) * swap_chain->images_count);
 
-	for (size_t i = 0; i < vkx_swap_chain.images_count; i++) {
-		vkx_swap_chain.image_views[i] = vkx_create_image_view(
-			vkx_swap_chain.images[i], surface_format.format, VK_IMAGE_ASPECT_COLOR_BIT
+	for (size_t i = 0; i < swap_chain->images_count; i++) {
+		swap_chain->image_views[i] = vkx_create_image_view(
+			swap_chain->images[i], surface_format.format, VK_IMAGE_ASPECT_COLOR_BIT, 1
 		);
 	}
 
 	printf(" Image views created\n");
 
-	// Wait for the queue to finish processing the command buffer
-	vkQueueWaitIdle(vkx_instance.graphics_queue);
+	swap_chain->image_format = surface_format.format;
 
-	vkx_swap_chain.image_format = surface_format.format;
-
-	vkx_free_swap_chain_support(&swap_chain_support);
+	arena_release(frame_arena(), arena_mark);
 
 	// Create the depth resources
-	// TODO: there should be 1 per frame
-	vkx_swap_chain.has_depth_image = create_depth_image;
-	if (create_depth_image) {
-		VkFormat depth_format = vkx_find_depth_format();
+	vkx_create_swap_chain_depth_image(swap_chain, create_depth_image);
 
-		vkx_swap_chain.depth_image = vkx_create_image(
-			vkx_swap_chain.extent.width,
-			vkx_swap_chain.extent.height,
-			depth_format,
+	printf(" Swap chain created with format: %d, present mode: %s, images: %d\n",
+			swap_chain->image_format, vkx_present_mode_name(swap_chain->present_mode), swap_chain->images_count);
+	return true;
+}
+
+void vkx_create_swap_chain(bool create_depth_image) {
+	/*
+	 * Create the swap chain for vkx_instance's window
+	 *
+	 * @param create_depth_image Whether to create a depth image (for depth test)
+	 */
+	if (!vkx_create_window_swap_chain(&vkx_swap_chain, vkx_instance.window, vkx_instance.surface, create_depth_image)) {
+		exit(1);
+	}
+}
+
+static void vkx_destroy_swap_chain_resources(VkxSwapChain* swap_chain) {
+	// The presents are done with the semaphores once their fences are
+	// signalled, which by now (a frame after the last present) they should be
+	if (swap_chain->present_fences != NULL) {
+		vkWaitForFences(vkx_instance.device, swap_chain->images_count, swap_chain->present_fences, VK_TRUE, VKX_PRESENT_FENCE_TIMEOUT_NS);
+		for (size_t i = 0; i < swap_chain->images_count; i++) {
+			vkDestroyFence(vkx_instance.device, swap_chain->present_fences[i], vkx_get_allocator(VK_OBJECT_TYPE_FENCE));
+		}
+		free(swap_chain->present_fences);
+		swap_chain->present_fences = NULL;
+	}
+
+	if (swap_chain->has_depth_image) {
+		vkx_cleanup_image(&swap_chain->depth_image);
+	}
+
+	for (size_t i = 0; i < swap_chain->images_count; i++) {
+		vkDestroyImageView(vkx_instance.device, swap_chain->image_views[i], vkx_get_allocator(VK_OBJECT_TYPE_IMAGE_VIEW));
+		if (swap_chain->render_finished_semaphores != NULL) {
+			vkDestroySemaphore(vkx_instance.device, swap_chain->render_finished_semaphores[i], vkx_get_allocator(VK_OBJECT_TYPE_SEMAPHORE));
+		}
+		if (swap_chain->headless_images != NULL) {
+			vkx_cleanup_image(&swap_chain->headless_images[i]);
+		}
+	}
+
+	free(swap_chain->headless_images);
+	swap_chain->headless_images = NULL;
+
+	free(swap_chain->render_finished_semaphores);
+	swap_chain->render_finished_semaphores = NULL;
+	free(swap_chain->image_views);
+	swap_chain->image_views = NULL;
+	free(swap_chain->images);
+	swap_chain->images = NULL;
+	swap_chain->images_count = 0;
+
+	if (swap_chain->swap_chain != VK_NULL_HANDLE) {
+		vkDestroySwapchainKHR(vkx_instance.device, swap_chain->swap_chain, vkx_get_allocator(VK_OBJECT_TYPE_SWAPCHAIN_KHR));
+	}
+	swap_chain->swap_chain = VK_NULL_HANDLE;
+}
+
+void vkx_create_headless_swap_chain(VkExtent2D extent, uint32_t images_count, bool create_depth_image) {
+	/*
+	 * Stand in for the swap chain when there is no window (see vkx_init()).
+	 * vkx_swap_chain is filled in the same way, but with ordinary images which
+	 * can be copied from, so the frames can be read back.  Nothing is acquired
+	 * or presented: the caller picks the image for each frame and there are no
+	 * render finished semaphores
+	 *
+	 * @param extent The size of the images
+	 * @param images_count How many images, normally one per frame in flight
+	 * @param create_depth_image Whether to create a depth image (for depth test)
+	 */
+	memset(&vkx_swap_chain, 0, sizeof(VkxSwapChain));
+
+	vkx_swap_chain.extent = extent;
+	vkx_swap_chain.image_format = VK_FORMAT_B8G8R8A8_SRGB;
+	vkx_swap_chain.image_usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+	if (input_attachment_enabled) {
+		vkx_swap_chain.image_usage |= VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+	}
+	vkx_swap_chain.pre_transform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
+	vkx_swap_chain.pre_rotation = 0;
+	vkx_swap_chain.present_mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+
+	vkx_swap_chain.images_count = images_count;
+	vkx_swap_chain.headless_images = malloc(sizeof(VkxImage) * images_count);
+	vkx_swap_chain.images = malloc(sizeof(VkImage) * images_count);
+	vkx_swap_chain.image_views = malloc(sizeof(VkImageView) * images_count);
+	if (vkx_swap_chain.headless_images == NULL || vkx_swap_chain.images == NULL || vkx_swap_chain.image_views == NULL) {
+		fprintf(stderr, "Failed to allocate the headless swap chain\n");
+		exit(1);
+	}
+
+	for (uint32_t i = 0; i < images_count; i++) {
+		VkxMemoryTag previous_tag = vkx_memory_set_tag(VKX_MEMORY_TAG_OFFSCREEN);
+		vkx_swap_chain.headless_images[i] = vkx_create_image(
+			extent.width,
+			extent.height,
+			1,
+			vkx_swap_chain.image_format,
 			VK_IMAGE_TILING_OPTIMAL,
-			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+			vkx_swap_chain.image_usage,
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
 		);
-
-		vkx_swap_chain.depth_image.view = vkx_create_image_view(vkx_swap_chain.depth_image.image, depth_format, VK_IMAGE_ASPECT_DEPTH_BIT);
-
-		// Transition the image layout to depth stencil attachment
-		vkx_transition_image_layout_tmp_buffer(
-			vkx_swap_chain.depth_image.image, depth_format,
-			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+		vkx_memory_set_tag(previous_tag);
+		vkx_swap_chain.images[i] = vkx_swap_chain.headless_images[i].image;
+		vkx_swap_chain.image_views[i] = vkx_create_image_view(
+			vkx_swap_chain.images[i], vkx_swap_chain.image_format, VK_IMAGE_ASPECT_COLOR_BIT, 1
 		);
-		printf(" Depth image created\n");
 	}
 
-	printf(" Swap chain created with format: %d\n", vkx_swap_chain.image_format);
+	vkx_create_swap_chain_depth_image(&vkx_swap_chain, create_depth_image);
+
+	printf(" Headless swap chain created: %d x %d, format: %d, images: %d\n",
+			extent.width, extent.height, vkx_swap_chain.image_format, images_count);
+}
+
+static void vkx_destroy_retired_swap_chain(void* data) {
+	vkx_destroy_swap_chain_resources(data);
+	free(data);
 }
 
 void vkx_cleanup_swap_chain() {
 	printf("Cleaning up swap chain\n");
-	
-	if (vkx_swap_chain.has_depth_image) {
-		vkx_cleanup_image(&vkx_swap_chain.depth_image);
-	}
 
-	for (size_t i = 0; i < vkx_swap_chain.images_count; i++) {
-		vkDestroyImageView(vkx_instance.device, vkx_swap_chain.image_views[i], NULL);
-		vkDestroySemaphore(vkx_instance.device, vkx_swap_chain.render_finished_semaphores[i], NULL);
+	vkx_destroy_swap_chain_resources(&vkx_swap_chain);
+}
+
+static void vkx_recreate_window_swap_chain(VkxSwapChain* swap_chain, SDL_Window* window, VkSurfaceKHR surface) {
+	VkxSwapChain* retired = malloc(sizeof(VkxSwapChain));
+	if (retired == NULL) {
+		fprintf(stderr, "Failed to allocate the retired swap chain\n");
+		exit(1);
 	}
+	*retired = *swap_chain;
 
-	free(vkx_swap_chain.render_finished_semaphores);
-	vkx_swap_chain.render_finished_semaphores = NULL;
-	free(vkx_swap_chain.image_views);
-	vkx_swap_chain.image_views = NULL;
-	free(vkx_swap_chain.images);
-	vkx_swap_chain.images = NULL;
-	vkx_swap_chain.images_count = 0;
+	if (!vkx_create_window_swap_chain(swap_chain, window, surface, retired->has_depth_image)) {
+		exit(1);
+	}
 
-	vkDestroySwapchainKHR(vkx_instance.device, vkx_swap_chain.swap_chain, NULL);
+	// The frame timeline goes past the next frame after the presents from the
+	// old one have been queued.  Without VK_EXT_swapchain_maintenance1 that's
+	// as close as it gets to knowing that they are done, with it the present
+	// fences say so
+	vkx_defer_destroy(vkx_destroy_retired_swap_chain, retired);
 }
 
 void vkx_recreate_swap_chain() {
-	int width = 0, height = 0;
-	SDL_GetWindowSize(vkx_instance.window, &width, &height);
+	/*
+	 * Replace the swap chain (e.g. after a resize) without waiting for the
+	 * device to go idle.  The old one is retired into the new one, and it and
+	 * its views and semaphores are destroyed once the frames which could be
+	 * using them have finished.  Call between frames
+	 */
+	vkx_recreate_window_swap_chain(&vkx_swap_chain, vkx_instance.window, vkx_instance.surface);
+}
+
+
+void vkx_set_present_mode(VkPresentModeKHR present_mode, uint32_t image_count) {
+	/*
+	 * Choose the present mode and number of images for the swap chain, which
+	 * are used the next time it is created (or recreated)
+	 *
+	 * @param present_mode Falls back to FIFO if the surface doesn't support it
+	 * @param image_count 0 for one more than the minimum, otherwise it is
+	 *                    clamped to what the surface supports
+	 */
+	preferred_present_mode = present_mode;
+	preferred_image_count = image_count;
+}
+
+bool vkx_switch_present_mode(VkPresentModeKHR present_mode) {
+	/*
+	 * Switch the swap chain to another present mode from the next present,
+	 * without recreating it.  It can with VK_EXT_swapchain_maintenance1 if
+	 * the mode is compatible with the one it was created with.  Call between
+	 * frames, after vkx_set_present_mode() for the next time it's created
+	 *
+	 * @return false if it has to be recreated for the mode to be used
+	 */
+	for (uint32_t i = 0; i < vkx_swap_chain.present_modes_count; i++) {
+		if (vkx_swap_chain.present_modes[i] == present_mode) {
+			vkx_swap_chain.present_mode = present_mode;
+			return true;
+		}
+	}
+	return false;
+}
+
+void vkx_set_pre_rotation(bool pre_rotate) {
+	/*
+	 * Choose whether the swap chain matches the display's rotation, so the
+	 * screen pass has to rotate the image (see vkx_swap_chain.pre_rotation),
+	 * or is left to the compositor to rotate.  Used the next time it is created
+	 */
+	pre_rotation_enabled = pre_rotate;
+}
+
+void vkx_set_swap_chain_input_attachment(bool input_attachment) {
+	/*
+	 * Choose whether the images can also be input attachments, for reading
+	 * back what's been drawn to them in the same pass (see
+	 * vkx_frame_graph_add_local_read_attachment()).  Only if the surface
+	 * supports it, see vkx_swap_chain.image_usage.  Used the next time the
+	 * swap chain is created
+	 */
+	input_attachment_enabled = input_attachment;
+}
+
+const char* vkx_present_mode_name(VkPresentModeKHR present_mode) {
+	switch (present_mode) {
+		case VK_PRESENT_MODE_IMMEDIATE_KHR:
+			return "IMMEDIATE";
+		case VK_PRESENT_MODE_MAILBOX_KHR:
+			return "MAILBOX";
+		case VK_PRESENT_MODE_FIFO_KHR:
+			return "FIFO";
+		case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+			return "FIFO_RELAXED";
+		default:
+			return "unknown";
+	}
+}
+
+void vkx_add_present_id(VkPresentInfoKHR* present_info, VkPresentIdKHR* present_id) {
+	/*
+	 * Give the next present an ID (vkx_swap_chain.present_id afterwards) so it
+	 * can be waited on, or do nothing without present wait
+	 *
+	 * @param present_info Present with just the swap chain, present_id is
+	 *                     added to its pNext chain
+	 * @param present_id Has to last until the present
+	 */
+	if (!vkx_instance.has_present_wait) {
+		return;
+	}
+
+	vkx_swap_chain.present_id++;
+
+	present_id->sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+	present_id->pNext = present_info->pNext;
+	present_id->swapchainCount = 1;
+	present_id->pPresentIds = &vkx_swap_chain.present_id;
+	present_info->pNext = present_id;
+}
+
+void vkx_add_present_fence(VkPresentInfoKHR* present_info, VkSwapchainPresentFenceInfoEXT* fence_info,
+		VkSwapchainPresentModeInfoEXT* mode_info, uint32_t image_index) {
+	/*
+	 * Give the next present a fence, which is signalled once it has finished
+	 * with the image and its render finished semaphore, and the present mode
+	 * (see vkx_switch_present_mode()).  Does nothing without
+	 * VK_EXT_swapchain_maintenance1
+	 *
+	 * @param present_info Present with just the swap chain, fence_info and
+	 *                     mode_info are added to its pNext chain
+	 * @param fence_info, mode_info Have to last until the present
+	 * @param image_index The image being presented
+	 */
+	if (vkx_swap_chain.present_fences == NULL) {
+		return;
+	}
+
+	// The image's last present has finished long since, as it's been acquired
+	// again, so this doesn't wait
+	VkFence* fence = &vkx_swap_chain.present_fences[image_index];
+	vkWaitForFences(vkx_instance.device, 1, fence, VK_TRUE, VKX_PRESENT_FENCE_TIMEOUT_NS);
+	vkResetFences(vkx_instance.device, 1, fence);
+
+	fence_info->sType = VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_FENCE_INFO_EXT;
+	fence_info->pNext = present_info->pNext;
+	fence_info->swapchainCount = 1;
+	fence_info->pFences = fence;
+
+	mode_info->sType = VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_MODE_INFO_EXT;
+	mode_info->pNext = fence_info;
+	mode_info->swapchainCount = 1;
+	mode_info->pPresentModes = &vkx_swap_chain.present_mode;
+	present_info->pNext = mode_info;
+}
+
+void vkx_add_present_region(VkPresentInfoKHR* present_info, VkPresentRegionsKHR* regions, VkPresentRegionKHR* region,
+		const VkRectLayerKHR* rect) {
+	/*
+	 * Tell the presentation engine that only part of the next present's image
+	 * changed since the last one, so it can skip copying or composing the rest.
+	 * The rest of the image still has to be the same as last time.  Does
+	 * nothing without incremental present, or when the image is rotated to
+	 * match the display (the rectangle would have to be too)
+	 *
+	 * @param present_info Present with just the swap chain, regions is added
+	 *                     to its pNext chain
+	 * @param regions Has to last until the present, along with region and rect
+	 * @param rect The part of the image which changed
+	 */
+	if (!vkx_instance.has_incremental_present || vkx_swap_chain.pre_rotation != 0) {
+		return;
+	}
+
+	region->rectangleCount = 1;
+	region->pRectangles = rect;
+
+	regions->sType = VK_STRUCTURE_TYPE_PRESENT_REGIONS_KHR;
+	regions->pNext = present_info->pNext;
+	regions->swapchainCount = 1;
+	regions->pRegions = region;
+	present_info->pNext = regions;
+}
+
+bool vkx_wait_for_present(uint64_t present_id, uint64_t timeout_ns) {
+	/*
+	 * Wait for a present from vkx_add_present_id() to be on screen
+	 *
+	 * @param present_id The present to wait for
+	 * @param timeout_ns Give up after this long (e.g. the window is hidden)
+	 *
+	 * @return false if there is no present wait, or it didn't happen in time
+	 */
+	if (!vkx_instance.has_present_wait || present_id == 0) {
+		return false;
+	}
+
+	if (wait_for_present_func == NULL) {
+		wait_for_present_func = (PFN_vkWaitForPresentKHR) vkGetDeviceProcAddr(vkx_instance.device, "vkWaitForPresentKHR");
+		if (wait_for_present_func == NULL) {
+			fprintf(stderr, "failed to load vkWaitForPresentKHR!\n");
+			exit(1);
+		}
+	}
+
+	VkResult result = wait_for_present_func(vkx_instance.device, vkx_swap_chain.swap_chain, present_id, timeout_ns);
+	return result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR;
+}
+
+bool vkx_create_window(VkxWindow* window, SDL_Window* sdl_window) {
+	/*
+	 * Set up another window to present to from vkx_instance's device, with its
+	 * own surface and swap chain (made like vkx_swap_chain, without a depth
+	 * image) but the same device, queues and everything on them.  Its images
+	 * are filled with copies, so they have to be transfer destinations, and
+	 * the present queue has to be able to present to it
+	 *
+	 * @return false if it can't be used, when nothing is left to clean up
+	 */
+	memset(window, 0, sizeof(*window));
+	window->window = sdl_window;
+	window->image_index = UINT32_MAX;
+
+	if (!SDL_Vulkan_CreateSurface(sdl_window, vkx_instance.instance, vkx_get_allocator(VK_OBJECT_TYPE_SURFACE_KHR), &window->surface)) {
+		fprintf(stderr, "Failed to create a surface for another window: %s\n", SDL_GetError());
+		return false;
+	}
+
+	// The present queue is from the main window's family
+	uint32_t present_family = vkx_find_queue_families(vkx_instance.physical_device, vkx_instance.surface).present_family;
+	VkBool32 supported = VK_FALSE;
+	vkGetPhysicalDeviceSurfaceSupportKHR(vkx_instance.physical_device, present_family, window->surface, &supported);
+	if (!supported || !vkx_create_window_swap_chain(&window->swap_chain, sdl_window, window->surface, false)) {
+		fprintf(stderr, "Can't present to another window from the main window's queue\n");
+		vkDestroySurfaceKHR(vkx_instance.instance, window->surface, vkx_get_allocator(VK_OBJECT_TYPE_SURFACE_KHR));
+		memset(window, 0, sizeof(*window));
+		return false;
+	}
+	VkFormatProperties properties;
+	vkGetPhysicalDeviceFormatProperties(vkx_instance.physical_device, window->swap_chain.image_format, &properties);
+	if ((window->swap_chain.image_usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT) == 0
+			|| (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT) == 0) {
+		fprintf(stderr, "Another window's swap chain images can't be copied to\n");
+		vkx_cleanup_window(window);
+		return false;
+	}
+
+	VkSemaphoreCreateInfo semaphore_info = {0};
+	semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	for (uint32_t i = 0; i < VKX_MAX_FRAMES_IN_FLIGHT; i++) {
+		if (vkCreateSemaphore(vkx_instance.device, &semaphore_info, vkx_get_allocator(VK_OBJECT_TYPE_SEMAPHORE), &window->image_available_semaphores[i]) != VK_SUCCESS) {
+			fprintf(stderr, "failed to create an image available semaphore for another window!\n");
+			exit(1);
+		}
+	}
+
+	return true;
+}
+
+void vkx_cleanup_window(VkxWindow* window) {
+	/*
+	 * Destroy a window's surface, swap chain and semaphores, once the device
+	 * is done with them.  The SDL window is left
+	 */
+	vkx_destroy_swap_chain_resources(&window->swap_chain);
+	for (uint32_t i = 0; i < VKX_MAX_FRAMES_IN_FLIGHT; i++) {
+		if (window->image_available_semaphores[i] != VK_NULL_HANDLE) {
+			vkDestroySemaphore(vkx_instance.device, window->image_available_semaphores[i], vkx_get_allocator(VK_OBJECT_TYPE_SEMAPHORE));
+		}
+	}
+	if (window->surface != VK_NULL_HANDLE) {
+		vkDestroySurfaceKHR(vkx_instance.instance, window->surface, vkx_get_allocator(VK_OBJECT_TYPE_SURFACE_KHR));
+	}
+	memset(window, 0, sizeof(*window));
+}
+
+bool vkx_acquire_window_image(VkxWindow* window, uint32_t frame) {
+	/*
+	 * Acquire a window's next image for a frame, signalling its
+	 * image_available_semaphores[frame], recreating its swap chain first if it
+	 * went out of date.  Nothing is acquired while it's minimised or hidden
+	 *
+	 * @return false if it hasn't got an image for this frame
+	 */
+	window->image_index = UINT32_MAX;
+	if ((SDL_GetWindowFlags(window->window) & (SDL_WINDOW_MINIMIZED | SDL_WINDOW_HIDDEN)) != 0) {
+		return false;
+	}
+
+	if (window->out_of_date) {
+		window->out_of_date = false;
+		vkx_recreate_window_swap_chain(&window->swap_chain, window->window, window->surface);
+	}
+
+	uint32_t image_index = 0;
+	VkResult result = vkAcquireNextImageKHR(vkx_instance.device, window->swap_chain.swap_chain, UINT64_MAX,
+			window->image_available_semaphores[frame], VK_NULL_HANDLE, &image_index);
+	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+		window->out_of_date = true;
+		return false;
+	}
+	if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+		fprintf(stderr, "Failed to acquire another window's swap chain image (result: %d)\n", result);
+		exit(1);
+	}
+
+	// Suboptimal still has the image to present, and is recreated after
+	window->out_of_date = result == VK_SUBOPTIMAL_KHR;
+	window->image_index = image_index;
+	return true;
+}
 
-	vkDeviceWaitIdle(vkx_instance.device);
+void vkx_add_present_windows(VkPresentInfoKHR* present_info, VkxPresentBatch* batch, VkxWindow* windows, uint32_t windows_count) {
+	/*
+	 * Present the windows which acquired an image this frame along with
+	 * vkx_swap_chain, in the same vkQueuePresentKHR.  Each waits for its own
+	 * render finished semaphore, so the submit has to signal those.  Goes
+	 * after vkx_add_present_id() and the others, whose structures are made to
+	 * cover every swap chain: the other windows get their own IDs, fences and
+	 * present modes, and all of their image is changed
+	 *
+	 * @param present_info Present with just vkx_swap_chain
+	 * @param windows Has windows_count, only the acquired ones are presented
+	 */
+	batch->windows_count = 0;
+	for (uint32_t i = 0; i < windows_count && batch->windows_count < VKX_MAX_WINDOWS; i++) {
+		if (windows[i].image_index != UINT32_MAX) {
+			batch->windows[batch->windows_count++] = &windows[i];
+		}
+	}
+	if (batch->windows_count == 0) {
+		return;
+	}
 
-	vkx_cleanup_swap_chain();
+	uint32_t count = batch->windows_count + 1;
+	batch->swap_chains[0] = present_info->pSwapchains[0];
+	batch->image_indices[0] = present_info->pImageIndices[0];
+	batch->wait_semaphores[0] = present_info->pWaitSemaphores[0];
+	for (uint32_t i = 1; i < count; i++) {
+		VkxWindow* window = batch->windows[i - 1];
+		batch->swap_chains[i] = window->swap_chain.swap_chain;
+		batch->image_indices[i] = window->image_index;
+		batch->wait_semaphores[i] = window->swap_chain.render_finished_semaphores[window->image_index];
+	}
 
-	vkx_create_swap_chain(vkx_swap_chain.has_depth_image);
+	// The structures vkx_swap_chain's present added, which all have an entry
+	// for each swap chain
+	for (VkBaseOutStructure* next = (VkBaseOutStructure*) present_info->pNext; next != NULL; next = next->pNext) {
+		if (next->sType == VK_STRUCTURE_TYPE_PRESENT_ID_KHR) {
+			VkPresentIdKHR* present_id = (VkPresentIdKHR*) next;
+			batch->present_ids[0] = present_id->pPresentIds[0];
+			for (uint32_t i = 1; i < count; i++) {
+				batch->present_ids[i] = ++batch->windows[i - 1]->swap_chain.present_id;
+			}
+			present_id->swapchainCount = count;
+			present_id->pPresentIds = batch->present_ids;
+		}
+		else if (next->sType == VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_FENCE_INFO_EXT) {
+			VkSwapchainPresentFenceInfoEXT* fence_info = (VkSwapchainPresentFenceInfoEXT*) next;
+			batch->present_fences[0] = fence_info->pFences[0];
+			for (uint32_t i = 1; i < count; i++) {
+				// Long since finished, as in vkx_add_present_fence()
+				VkxWindow* window = batch->windows[i - 1];
+				VkFence* fence = &window->swap_chain.present_fences[window->image_index];
+				vkWaitForFences(vkx_instance.device, 1, fence, VK_TRUE, VKX_PRESENT_FENCE_TIMEOUT_NS);
+				vkResetFences(vkx_instance.device, 1, fence);
+				batch->present_fences[i] = *fence;
+			}
+			fence_info->swapchainCount = count;
+			fence_info->pFences = batch->present_fences;
+		}
+		else if (next->sType == VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_MODE_INFO_EXT) {
+			VkSwapchainPresentModeInfoEXT* mode_info = (VkSwapchainPresentModeInfoEXT*) next;
+			batch->present_modes[0] = mode_info->pPresentModes[0];
+			for (uint32_t i = 1; i < count; i++) {
+				batch->present_modes[i] = batch->windows[i - 1]->swap_chain.present_mode;
+			}
+			mode_info->swapchainCount = count;
+			mode_info->pPresentModes = batch->present_modes;
+		}
+		else if (next->sType == VK_STRUCTURE_TYPE_PRESENT_REGIONS_KHR) {
+			VkPresentRegionsKHR* regions = (VkPresentRegionsKHR*) next;
+			batch->present_regions[0] = regions->pRegions[0];
+			for (uint32_t i = 1; i < count; i++) {
+				batch->present_regions[i].rectangleCount = 0;
+				batch->present_regions[i].pRectangles = NULL;
+			}
+			regions->swapchainCount = count;
+			regions->pRegions = batch->present_regions;
+		}
+	}
+
+	present_info->swapchainCount = count;
+	present_info->pSwapchains = batch->swap_chains;
+	present_info->pImageIndices = batch->image_indices;
+	present_info->waitSemaphoreCount = count;
+	present_info->pWaitSemaphores = batch->wait_semaphores;
+	present_info->pResults = batch->results;
 }
 
+VkResult vkx_finish_present_windows(const VkxPresentBatch* batch, VkResult result) {
+	/*
+	 * Mark the other windows whose presents were out of date or suboptimal to
+	 * be recreated
+	 *
+	 * @param result What vkQueuePresentKHR returned
+	 *
+	 * @return vkx_swap_chain's own result
+	 */
+	if (batch->windows_count == 0) {
+		return result;
+	}
+
+	for (uint32_t i = 0; i < batch->windows_count; i++) {
+		VkResult window_result = batch->results[i + 1];
+		if (window_result == VK_ERROR_OUT_OF_DATE_KHR || window_result == VK_SUBOPTIMAL_KHR) {
+			batch->windows[i]->out_of_date = true;
+		}
+		else if (window_result != VK_SUCCESS) {
+			fprintf(stderr, "failed to present another window's swap chain image! (result: %d)\n", window_result);
+			exit(1);
+		}
+	}
+	return batch->results[0];
+}
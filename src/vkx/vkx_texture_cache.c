@@ -0,0 +1,169 @@
+/*
+ * Cache of decoded textures, so each image is only decoded once.
+ *
+ * The first time an image is decoded its pixels are saved in the cache
+ * directory as an uncompressed KTX2 file named after a hash of the image file,
+ * with its mip chain already filtered if the textures have them.  After that
+ * vkx_decode_texture() maps the cached file instead and the levels go straight
+ * from the mapping into the staging buffer, the same as a KTX2 encoding next to
+ * the image, so the only work left on a warm start is hashing the image files.
+ * An image which changes gets a new entry, and the old one stays until the
+ * directory is deleted.
+ *
+ * Entries are written to a file of their own and renamed into place, so a
+ * worker never maps half of one, even if two images have the same contents.
+ */
+
+#include "vkx/vkx_texture_cache.h"
+
+#include <SDL3/SDL.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vkx/vkx_core.h"
+
+static const char* cache_directory = NULL;
+static bool cache_mip_chains = false;
+
+void vkx_texture_cache_init(const char* directory, bool mip_chains) {
+	/*
+	 * Start using the cache, before any textures are loaded
+	 *
+	 * @param directory Where to keep the entries, which is created if it doesn't
+	 *        exist.  NULL for no cache
+	 * @param mip_chains Whether the entries have full mip chains, for textures
+	 *        which are mipmapped
+	 */
+	cache_directory = directory;
+	cache_mip_chains = mip_chains;
+
+	if (directory == NULL) {
+		return;
+	}
+
+	if (!SDL_CreateDirectory(directory)) {
+		fprintf(stderr, "Failed to create the texture cache %s, so it isn't used: %s\n", directory, SDL_GetError());
+		cache_directory = NULL;
+	}
+}
+
+bool vkx_texture_cache_is_enabled(void) {
+	return cache_directory != NULL;
+}
+
+uint64_t vkx_texture_cache_key(const void* data, size_t size) {
+	/*
+	 * Hash the contents of an image file.  This is done for every image on every
+	 * launch, so it takes 8 bytes at a time.  Whether the entries have mip
+	 * chains is part of the key
+	 */
+	const uint8_t* bytes = data;
+	uint64_t hash = 0xcbf29ce484222325ull ^ size ^ (cache_mip_chains ? 0x9e3779b97f4a7c15ull : 0);
+
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		uint64_t word;
+		memcpy(&word, bytes + i, sizeof(word));
+		hash = (hash ^ word) * 0x9e3779b97f4a7c15ull;
+		hash ^= hash >> 32;
+	}
+	for (; i < size; i++) {
+		hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+	}
+
+	// The last few bytes only reach the low bits otherwise
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdull;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+static uint32_t vkx_texture_cache_mip_levels(uint32_t width, uint32_t height) {
+	if (!cache_mip_chains) {
+		return 1;
+	}
+
+	uint32_t mip_levels = vkx_mip_levels_for_extent(width, height);
+	return mip_levels < VKX_KTX2_MAX_LEVELS ? mip_levels : VKX_KTX2_MAX_LEVELS;
+}
+
+static bool vkx_texture_cache_path(uint64_t key, char* path, size_t path_size) {
+	int length = snprintf(path, path_size, "%s/%016llx.ktx2", cache_directory, (unsigned long long) key);
+	return length > 0 && (size_t) length < path_size;
+}
+
+bool vkx_texture_cache_load(uint64_t key, MappedFile* file, VkxKtx2Texture* texture) {
+	/*
+	 * Map the entry for an image.  Safe to call from the job workers
+	 *
+	 * @param key The hash of the image file from vkx_texture_cache_key()
+	 * @param file Set to the mapping of the entry, to unmap once the levels have
+	 *        been copied
+	 * @param texture Set to the levels in the mapping
+	 *
+	 * @return false if there isn't a usable entry, so the image should be decoded
+	 *         and stored
+	 */
+	char path[1024];
+	if (cache_directory == NULL || !vkx_texture_cache_path(key, path, sizeof(path)) || !file_exists(path)) {
+		return false;
+	}
+
+	*file = map_disk_file(path);
+	bool usable = vkx_ktx2_parse(path, file->data, file->size, texture)
+		&& texture->format == VK_FORMAT_R8G8B8A8_SRGB
+		&& texture->array_layers == 1
+		&& texture->mip_levels == vkx_texture_cache_mip_levels(texture->width, texture->height)
+		&& texture->level_sizes[0] == (VkDeviceSize) texture->width * texture->height * 4;
+
+	if (!usable) {
+		unmap_file(file);
+	}
+	return usable;
+}
+
+void vkx_texture_cache_store(uint64_t key, const uint8_t* pixels, uint32_t width, uint32_t height) {
+	/*
+	 * Save a decoded image in the cache.  Failing to is only a warning.  Safe to
+	 * call from the job workers
+	 *
+	 * @param key The hash of the image file from vkx_texture_cache_key()
+	 * @param pixels The decoded RGBA pixels
+	 */
+	char path[1024];
+	char temp_path[1088];
+	if (cache_directory == NULL || !vkx_texture_cache_path(key, path, sizeof(path))) {
+		return;
+	}
+	snprintf(temp_path, sizeof(temp_path), "%s.%llu.tmp", path, (unsigned long long) SDL_GetCurrentThreadID());
+
+	uint32_t mip_levels = vkx_texture_cache_mip_levels(width, height);
+	const uint8_t* levels[VKX_KTX2_MAX_LEVELS] = {pixels};
+	uint8_t* filtered[VKX_KTX2_MAX_LEVELS] = {0};
+
+	for (uint32_t level = 1; level < mip_levels; level++) {
+		uint32_t level_width = width >> (level - 1) > 0 ? width >> (level - 1) : 1;
+		uint32_t level_height = height >> (level - 1) > 0 ? height >> (level - 1) : 1;
+		uint32_t next_width = level_width > 1 ? level_width / 2 : 1;
+		uint32_t next_height = level_height > 1 ? level_height / 2 : 1;
+
+		filtered[level] = malloc((size_t) next_width * next_height * 4);
+		if (filtered[level] == NULL) {
+			fprintf(stderr, "Failed to allocate a mip level for the texture cache\n");
+			exit(1);
+		}
+		vkx_downsample_srgb(levels[level - 1], level_width, level_height, filtered[level]);
+		levels[level] = filtered[level];
+	}
+
+	if (vkx_ktx2_write_rgba8(temp_path, width, height, mip_levels, levels) && !SDL_RenamePath(temp_path, path)) {
+		fprintf(stderr, "Failed to add %s to the texture cache: %s\n", path, SDL_GetError());
+		SDL_RemovePath(temp_path);
+	}
+
+	for (uint32_t level = 1; level < mip_levels; level++) {
+		free(filtered[level]);
+	}
+}
@@ -0,0 +1,238 @@
+/*
+ * Texture quality scaled to the device's memory, so one set of textures fits
+ * a device with little of it without the driver paging them out.
+ *
+ * The memory tier comes from the budget of the device local heap (from
+ * VK_EXT_memory_budget where the device has it, otherwise the heap's size),
+ * and each tier has a number of mip levels dropped off the top of every
+ * texture as it's loaded.  KTX2 textures with the levels already in them
+ * start from a lower level, and decoded images are halved on the thread
+ * decoding them, averaging each 2x2 weighted by alpha so the colour of the
+ * transparent pixels doesn't bleed in.
+ *
+ * No texture goes below VKX_TEXTURE_QUALITY_MIN_SIZE on its longer side, or
+ * the minimum given for it, e.g. pixel art which has to stay sharp.  A side is
+ * only halved while it's even, so sheets of equal frames stay lined up with
+ * their frames.
+ */
+
+#include "vkx/vkx_texture_quality.h"
+#include "vkx/vkx_memory.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The levels each VkxMemoryTier drops
+static const uint32_t VKX_MEMORY_TIER_DROPPED_LEVELS[] = {
+	[VKX_MEMORY_TIER_LOW] = 2,
+	[VKX_MEMORY_TIER_MEDIUM] = 1,
+	[VKX_MEMORY_TIER_HIGH] = 0,
+};
+
+static const char* const VKX_MEMORY_TIER_NAMES[] = {
+	[VKX_MEMORY_TIER_LOW] = "low",
+	[VKX_MEMORY_TIER_MEDIUM] = "medium",
+	[VKX_MEMORY_TIER_HIGH] = "high",
+};
+
+typedef struct {
+	const char* filename;
+	uint32_t min_size;
+} VkxTextureQualityRule;
+
+// Set on the main thread before anything is loaded, and only read by the
+// decoding threads
+static uint32_t dropped_levels = 0;
+static VkxTextureQualityRule rules[VKX_TEXTURE_QUALITY_MAX_RULES];
+static uint32_t rules_count = 0;
+
+VkxMemoryTier vkx_get_memory_tier(void) {
+	/*
+	 * Find how much device local memory the device has for us, after
+	 * vkx_memory_init()
+	 */
+	uint32_t heap_index = vkx_memory_get_type_heap(UINT32_MAX, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	VkDeviceSize budget = vkx_memory_get_heap_stats(heap_index).budget_bytes;
+
+	if (budget < VKX_MEMORY_TIER_LOW_BYTES) {
+		return VKX_MEMORY_TIER_LOW;
+	}
+	if (budget < VKX_MEMORY_TIER_MEDIUM_BYTES) {
+		return VKX_MEMORY_TIER_MEDIUM;
+	}
+	return VKX_MEMORY_TIER_HIGH;
+}
+
+void vkx_set_texture_quality(int32_t levels) {
+	/*
+	 * Set how many mip levels are dropped off the top of the textures loaded
+	 * from now on, on the main thread
+	 *
+	 * @param levels Or -1 for what the device's memory tier drops
+	 */
+	if (levels >= 0) {
+		dropped_levels = (uint32_t) levels;
+		return;
+	}
+
+	VkxMemoryTier tier = vkx_get_memory_tier();
+	dropped_levels = VKX_MEMORY_TIER_DROPPED_LEVELS[tier];
+	if (dropped_levels > 0) {
+		printf("The device's memory is %s tier, so the textures are halved up to %u times as they're loaded\n",
+			VKX_MEMORY_TIER_NAMES[tier], dropped_levels);
+	}
+}
+
+void vkx_set_texture_min_size(const char* filename, uint32_t min_size) {
+	/*
+	 * Keep a texture from being shrunk below a size, before it's loaded
+	 *
+	 * @param filename Kept rather than copied
+	 * @param min_size Of the longer side, UINT32_MAX to always load it whole
+	 */
+	for (uint32_t i = 0; i < rules_count; i++) {
+		if (strcmp(rules[i].filename, filename) == 0) {
+			rules[i].min_size = min_size;
+			return;
+		}
+	}
+
+	if (rules_count == VKX_TEXTURE_QUALITY_MAX_RULES) {
+		fprintf(stderr, "Too many texture minimum sizes (max %d)\n", VKX_TEXTURE_QUALITY_MAX_RULES);
+		exit(1);
+	}
+	rules[rules_count].filename = filename;
+	rules[rules_count].min_size = min_size;
+	rules_count++;
+}
+
+uint32_t vkx_get_texture_dropped_levels(const char* filename, uint32_t width, uint32_t height) {
+	/*
+	 * Work out how many times a texture is halved as it's loaded
+	 */
+	uint32_t min_size = VKX_TEXTURE_QUALITY_MIN_SIZE;
+	for (uint32_t i = 0; i < rules_count; i++) {
+		if (strcmp(rules[i].filename, filename) == 0) {
+			min_size = rules[i].min_size;
+			break;
+		}
+	}
+
+	uint32_t levels = 0;
+	while (levels < dropped_levels) {
+		uint32_t level_width = width >> levels;
+		uint32_t level_height = height >> levels;
+		uint32_t longer = level_width > level_height ? level_width : level_height;
+		if (longer / 2 < min_size || level_width % 2 != 0 || level_height % 2 != 0) {
+			break;
+		}
+		levels++;
+	}
+	return levels;
+}
+
+static void vkx_texture_quality_halve(const uint8_t* src, uint32_t width, uint32_t height, uint8_t* dst) {
+	/*
+	 * Shrink RGBA8 pixels of even width and height to half of each, averaging
+	 * the colour of each 2x2 weighted by alpha
+	 */
+	uint32_t half_width = width / 2;
+	uint32_t half_height = height / 2;
+	for (uint32_t y = 0; y < half_height; y++) {
+		const uint8_t* rows[2] = {&src[(size_t) y * 2 * width * 4], &src[((size_t) y * 2 + 1) * width * 4]};
+		uint8_t* out = &dst[(size_t) y * half_width * 4];
+
+		for (uint32_t x = 0; x < half_width; x++) {
+			uint32_t sums[3] = {0};
+			uint32_t plain_sums[3] = {0};
+			uint32_t alpha = 0;
+			for (uint32_t k = 0; k < 4; k++) {
+				const uint8_t* pixel = &rows[k / 2][((size_t) x * 2 + k % 2) * 4];
+				for (uint32_t c = 0; c < 3; c++) {
+					sums[c] += pixel[c] * pixel[3];
+					plain_sums[c] += pixel[c];
+				}
+				alpha += pixel[3];
+			}
+
+			// Where they're all transparent, the plain average keeps whatever
+			// colour the filtering further down will bring in
+			for (uint32_t c = 0; c < 3; c++) {
+				out[x * 4 + c] = (uint8_t) (alpha > 0 ? (sums[c] + alpha / 2) / alpha : (plain_sums[c] + 2) / 4);
+			}
+			out[x * 4 + 3] = (uint8_t) ((alpha + 2) / 4);
+		}
+	}
+}
+
+uint8_t* vkx_reduce_image_quality(const char* filename, uint8_t* pixels, int* width, int* height) {
+	/*
+	 * Shrink decoded RGBA8 pixels by the levels the texture drops
+	 *
+	 * @param pixels From malloc() (or stb_image), freed if they're shrunk
+	 * @param width, height Set to the new size
+	 *
+	 * @return The pixels to use, to free the same way
+	 */
+	if (pixels == NULL) {
+		return NULL;
+	}
+
+	uint32_t levels = vkx_get_texture_dropped_levels(filename, (uint32_t) *width, (uint32_t) *height);
+	for (uint32_t level = 0; level < levels; level++) {
+		uint8_t* half = malloc((size_t) (*width / 2) * (*height / 2) * 4);
+		if (half == NULL) {
+			fprintf(stderr, "Failed to allocate the shrunk pixels of %s\n", filename);
+			exit(1);
+		}
+		vkx_texture_quality_halve(pixels, (uint32_t) *width, (uint32_t) *height, half);
+		free(pixels);
+		pixels = half;
+		*width /= 2;
+		*height /= 2;
+	}
+	return pixels;
+}
+
+void vkx_reduce_texture_quality(const char* filename, VkxDecodedTexture* texture) {
+	/*
+	 * Drop the levels a texture from vkx_decode_texture() loses: from its
+	 * level offsets when it has the levels, otherwise by shrinking its pixels
+	 */
+	if (!texture->compressed) {
+		texture->pixels = vkx_reduce_image_quality(filename, texture->pixels, &texture->width, &texture->height);
+		return;
+	}
+
+	VkxKtx2Texture* ktx2 = &texture->ktx2;
+	uint32_t levels = vkx_get_texture_dropped_levels(filename, ktx2->width, ktx2->height);
+	if (levels == 0) {
+		return;
+	}
+
+	// A texture cache entry without a mip chain comes out of the cache to be
+	// shrunk like a decoded image.  Other single level encodings have to be
+	// used as they are
+	if (ktx2->mip_levels == 1 && ktx2->format == VK_FORMAT_R8G8B8A8_SRGB) {
+		uint8_t* pixels = malloc(ktx2->level_sizes[0]);
+		if (pixels == NULL) {
+			fprintf(stderr, "Failed to allocate the pixels of %s\n", filename);
+			exit(1);
+		}
+		memcpy(pixels, (const uint8_t*) texture->ktx2_file.data + ktx2->level_offsets[0], ktx2->level_sizes[0]);
+		texture->width = (int) ktx2->width;
+		texture->height = (int) ktx2->height;
+		unmap_file(&texture->ktx2_file);
+		texture->compressed = false;
+		texture->pixels = vkx_reduce_image_quality(filename, pixels, &texture->width, &texture->height);
+		return;
+	}
+
+	levels = levels < ktx2->mip_levels ? levels : ktx2->mip_levels - 1;
+	memmove(ktx2->level_offsets, &ktx2->level_offsets[levels], sizeof(VkDeviceSize) * (ktx2->mip_levels - levels));
+	memmove(ktx2->level_sizes, &ktx2->level_sizes[levels], sizeof(VkDeviceSize) * (ktx2->mip_levels - levels));
+	ktx2->mip_levels -= levels;
+	ktx2->width = ktx2->width >> levels > 0 ? ktx2->width >> levels : 1;
+	ktx2->height = ktx2->height >> levels > 0 ? ktx2->height >> levels : 1;
+}
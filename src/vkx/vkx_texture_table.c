@@ -0,0 +1,366 @@
+/*
+ * Bindless texture table.
+ *
+ * One big descriptor set holds an unbounded (up to the device limits) array of
+ * combined image samplers, and textures are registered into it to get an index
+ * which the shaders use directly.  The binding is partially bound and update
+ * after bind, so textures can be added and removed while the set is bound and
+ * command buffers using it are in flight, without rebuilding any descriptor
+ * sets or pipelines.
+ *
+ * Shaders see the table as set VKX_TEXTURE_TABLE_SET, binding 0:
+ *
+ *     layout(set = 1, binding = 0) uniform sampler2D textures[];
+ *
+ * A removed index could still be used by a frame in flight, so it isn't handed
+ * out again until the frame timeline shows that every frame recorded before
+ * the removal has finished.
+ *
+ * There's a copy of the set for each frame in flight, so a texture can also be
+ * swapped for another at the same index (vkx_texture_table_replace()) while
+ * frames are drawing with it.  The frame being recorded gets the new descriptor
+ * straight away and each of the others once it has been waited for, as a
+ * descriptor can't be written while a submitted frame might read it.
+ */
+
+#include "vkx/vkx_texture_table.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+	uint32_t index;
+	// Frame timeline value after which no frame can be using the index
+	uint64_t timeline_value;
+} VkxTextureTableRetired;
+
+static VkDescriptorSetLayout table_layout = VK_NULL_HANDLE;
+static VkDescriptorPool table_pool = VK_NULL_HANDLE;
+static VkDescriptorSet table_sets[VKX_MAX_FRAMES_IN_FLIGHT] = {0};
+static uint32_t table_sets_count = 0;
+// The set for the frame being recorded
+static uint32_t current_set = 0;
+static uint32_t table_capacity = 0;
+
+// Indices which have never been used start from here
+static uint32_t next_index = 0;
+static uint32_t used_count = 0;
+
+// Indices which are safe to reuse
+static uint32_t* free_indices = NULL;
+static uint32_t free_indices_count = 0;
+
+// Indices waiting for the frames in flight to finish with them, oldest first.
+// This can't hold more than the capacity so it never needs to grow
+static VkxTextureTableRetired* retired = NULL;
+static uint32_t retired_count = 0;
+
+// Replacements which some of the sets haven't had yet, by index.  The mask has
+// a bit for each set still to be written
+static VkDescriptorImageInfo* replacements = NULL;
+static uint32_t* replacement_masks = NULL;
+static uint32_t* replaced_indices = NULL;
+static uint32_t replaced_indices_count = 0;
+
+static void vkx_texture_table_write(uint32_t set, uint32_t index, const VkDescriptorImageInfo* image_info) {
+	VkWriteDescriptorSet descriptor_write = {0};
+	descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptor_write.dstSet = table_sets[set];
+	descriptor_write.dstBinding = 0;
+	descriptor_write.dstArrayElement = index;
+	descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	descriptor_write.descriptorCount = 1;
+	descriptor_write.pImageInfo = image_info;
+
+	vkUpdateDescriptorSets(vkx_instance.device, 1, &descriptor_write, 0, NULL);
+}
+
+void vkx_texture_table_init(uint32_t max_textures) {
+	/*
+	 * Create the descriptor set for the texture table.  Needs the descriptor
+	 * indexing features which are enabled by vkx_init()
+	 *
+	 * @param max_textures The size of the table.  This is clamped to the device limits
+	 */
+	VkPhysicalDeviceVulkan12Properties vulkan12_properties = {0};
+	vulkan12_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+
+	VkPhysicalDeviceProperties2 properties = {0};
+	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties.pNext = &vulkan12_properties;
+	vkGetPhysicalDeviceProperties2(vkx_instance.physical_device, &properties);
+
+	if (max_textures > vulkan12_properties.maxDescriptorSetUpdateAfterBindSampledImages) {
+		max_textures = vulkan12_properties.maxDescriptorSetUpdateAfterBindSampledImages;
+	}
+	if (max_textures > vulkan12_properties.maxPerStageDescriptorUpdateAfterBindSampledImages) {
+		max_textures = vulkan12_properties.maxPerStageDescriptorUpdateAfterBindSampledImages;
+	}
+	if (max_textures > vulkan12_properties.maxDescriptorSetUpdateAfterBindSamplers) {
+		max_textures = vulkan12_properties.maxDescriptorSetUpdateAfterBindSamplers;
+	}
+
+	table_capacity = max_textures;
+
+	// ----- Layout -----
+	VkDescriptorSetLayoutBinding binding = {0};
+	binding.binding = 0;
+	binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	binding.descriptorCount = table_capacity;
+	binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	binding.pImmutableSamplers = NULL;
+
+	VkDescriptorBindingFlags binding_flags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT
+		| VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT
+		| VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_info = {0};
+	binding_flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	binding_flags_info.bindingCount = 1;
+	binding_flags_info.pBindingFlags = &binding_flags;
+
+	VkDescriptorSetLayoutCreateInfo layout_info = {0};
+	layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layout_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+	layout_info.bindingCount = 1;
+	layout_info.pBindings = &binding;
+	layout_info.pNext = &binding_flags_info;
+
+	if (vkCreateDescriptorSetLayout(vkx_instance.device, &layout_info, vkx_get_allocator(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT), &table_layout) != VK_SUCCESS) {
+		fprintf(stderr, "failed to create texture table descriptor set layout!\n");
+		exit(1);
+	}
+
+	// ----- Pool and sets -----
+	table_sets_count = vkx_instance.frames_in_flight;
+	current_set = 0;
+
+	VkDescriptorPoolSize pool_size = {0};
+	pool_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	pool_size.descriptorCount = table_capacity * table_sets_count;
+
+	VkDescriptorPoolCreateInfo pool_info = {0};
+	pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+	pool_info.poolSizeCount = 1;
+	pool_info.pPoolSizes = &pool_size;
+	pool_info.maxSets = table_sets_count;
+
+	if (vkCreateDescriptorPool(vkx_instance.device, &pool_info, vkx_get_allocator(VK_OBJECT_TYPE_DESCRIPTOR_POOL), &table_pool) != VK_SUCCESS) {
+		fprintf(stderr, "failed to create texture table descriptor pool!\n");
+		exit(1);
+	}
+
+	VkDescriptorSetLayout set_layouts[VKX_MAX_FRAMES_IN_FLIGHT];
+	for (uint32_t i = 0; i < table_sets_count; i++) {
+		set_layouts[i] = table_layout;
+	}
+
+	VkDescriptorSetAllocateInfo alloc_info = {0};
+	alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	alloc_info.descriptorPool = table_pool;
+	alloc_info.descriptorSetCount = table_sets_count;
+	alloc_info.pSetLayouts = set_layouts;
+
+	if (vkAllocateDescriptorSets(vkx_instance.device, &alloc_info, table_sets) != VK_SUCCESS) {
+		fprintf(stderr, "failed to allocate texture table descriptor set!\n");
+		exit(1);
+	}
+
+	// ----- Index bookkeeping -----
+	free_indices = malloc(sizeof(uint32_t) * table_capacity);
+	retired = malloc(sizeof(VkxTextureTableRetired) * table_capacity);
+	replacements = malloc(sizeof(VkDescriptorImageInfo) * table_capacity);
+	replacement_masks = calloc(table_capacity, sizeof(uint32_t));
+	replaced_indices = malloc(sizeof(uint32_t) * table_capacity);
+	if (free_indices == NULL || retired == NULL || replacements == NULL || replacement_masks == NULL || replaced_indices == NULL) {
+		fprintf(stderr, "Failed to allocate texture table arrays\n");
+		exit(1);
+	}
+
+	next_index = 0;
+	used_count = 0;
+	free_indices_count = 0;
+	retired_count = 0;
+	replaced_indices_count = 0;
+
+	printf(" Texture table created with room for %d textures\n", table_capacity);
+}
+
+void vkx_texture_table_cleanup(void) {
+	/*
+	 * Destroy the texture table.  The textures themselves belong to the caller
+	 */
+	vkDestroyDescriptorPool(vkx_instance.device, table_pool, vkx_get_allocator(VK_OBJECT_TYPE_DESCRIPTOR_POOL));
+	vkDestroyDescriptorSetLayout(vkx_instance.device, table_layout, vkx_get_allocator(VK_OBJECT_TYPE_DESCRIPTOR_SET_LAYOUT));
+
+	free(replaced_indices);
+	free(replacement_masks);
+	free(replacements);
+	free(retired);
+	free(free_indices);
+
+	table_pool = VK_NULL_HANDLE;
+	table_layout = VK_NULL_HANDLE;
+	memset(table_sets, 0, sizeof(table_sets));
+	table_sets_count = 0;
+	table_capacity = 0;
+	replaced_indices = NULL;
+	replacement_masks = NULL;
+	replacements = NULL;
+	retired = NULL;
+	free_indices = NULL;
+}
+
+bool vkx_texture_table_is_initialised(void) {
+	return table_sets_count > 0;
+}
+
+uint32_t vkx_texture_table_add(VkImageView view, VkSampler sampler) {
+	/*
+	 * Put a texture into the table and return the index for the shaders to use.
+	 * The view must be in SHADER_READ_ONLY_OPTIMAL whenever it's sampled, and must
+	 * stay alive until it has been removed and the frames in flight are done with it
+	 *
+	 * @param view The image view to sample
+	 * @param sampler The sampler to use with it
+	 */
+	uint32_t index;
+	if (free_indices_count > 0) {
+		index = free_indices[--free_indices_count];
+	}
+	else if (next_index < table_capacity) {
+		index = next_index++;
+	}
+	else {
+		return VKX_TEXTURE_TABLE_INVALID_INDEX;
+	}
+
+	VkDescriptorImageInfo image_info = {0};
+	image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	image_info.imageView = view;
+	image_info.sampler = sampler;
+
+	// Nothing in flight uses a new index, so every set can have it now
+	for (uint32_t i = 0; i < table_sets_count; i++) {
+		vkx_texture_table_write(i, index, &image_info);
+	}
+
+	used_count++;
+
+	return index;
+}
+
+void vkx_texture_table_remove(uint32_t index) {
+	/*
+	 * Take a texture out of the table.  The descriptor is left as it is (nothing
+	 * new should be using it) and the index is reused once the frames in flight
+	 * have finished
+	 *
+	 * @param index The index returned by vkx_texture_table_add()
+	 */
+	if (index >= next_index) {
+		fprintf(stderr, "Invalid texture table index %d\n", index);
+		exit(1);
+	}
+
+	retired[retired_count].index = index;
+	retired[retired_count].timeline_value = vkx_frame_timeline_pending();
+	retired_count++;
+
+	// A replacement still waiting for some of the sets would overwrite whatever
+	// gets the index next
+	replacement_masks[index] = 0;
+
+	used_count--;
+}
+
+void vkx_texture_table_replace(uint32_t index, VkImageView view, VkSampler sampler) {
+	/*
+	 * Point an index at a different texture, e.g. a placeholder while the real one
+	 * isn't loaded.  The frames in flight carry on with the old one, so it must
+	 * stay alive until they have finished (vkx_defer_cleanup_image() does that)
+	 *
+	 * @param index The index returned by vkx_texture_table_add()
+	 * @param view The image view to sample from now on
+	 * @param sampler The sampler to use with it
+	 */
+	if (index >= next_index) {
+		fprintf(stderr, "Invalid texture table index %d\n", index);
+		exit(1);
+	}
+
+	VkDescriptorImageInfo* image_info = &replacements[index];
+	image_info->imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	image_info->imageView = view;
+	image_info->sampler = sampler;
+
+	// The set being recorded isn't in use by the GPU
+	vkx_texture_table_write(current_set, index, image_info);
+
+	uint32_t mask = ((1u << table_sets_count) - 1) & ~(1u << current_set);
+	if (mask != 0 && replacement_masks[index] == 0) {
+		replaced_indices[replaced_indices_count++] = index;
+	}
+	replacement_masks[index] = mask;
+}
+
+void vkx_texture_table_begin_frame(uint32_t frame) {
+	/*
+	 * Call once per frame after waiting for that frame.  Indices which were
+	 * removed before the frames the GPU has finished become free, and the
+	 * frame's set catches up with the replacements
+	 *
+	 * @param frame The index of the frame in flight which is being recorded
+	 */
+	current_set = frame;
+
+	uint32_t kept = 0;
+	for (uint32_t i = 0; i < replaced_indices_count; i++) {
+		uint32_t index = replaced_indices[i];
+		if (replacement_masks[index] & (1u << frame)) {
+			vkx_texture_table_write(frame, index, &replacements[index]);
+			replacement_masks[index] &= ~(1u << frame);
+		}
+
+		if (replacement_masks[index] != 0) {
+			replaced_indices[kept++] = index;
+		}
+	}
+	replaced_indices_count = kept;
+
+	uint64_t completed = vkx_frame_timeline_completed();
+	uint32_t recycled = 0;
+	while (recycled < retired_count && retired[recycled].timeline_value <= completed) {
+		free_indices[free_indices_count++] = retired[recycled].index;
+		recycled++;
+	}
+
+	if (recycled > 0) {
+		for (uint32_t i = recycled; i < retired_count; i++) {
+			retired[i - recycled] = retired[i];
+		}
+		retired_count -= recycled;
+	}
+}
+
+uint32_t vkx_texture_table_get_capacity(void) {
+	return table_capacity;
+}
+
+uint32_t vkx_texture_table_get_count(void) {
+	return used_count;
+}
+
+VkDescriptorSetLayout vkx_texture_table_get_layout(void) {
+	return table_layout;
+}
+
+VkDescriptorSet vkx_texture_table_get_set(void) {
+	/*
+	 * The set for the frame being recorded, which is only valid to use with that
+	 * frame (or with commands which are waited for before the next frame begins)
+	 */
+	return table_sets[current_set];
+}
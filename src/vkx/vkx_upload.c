@@ -0,0 +1,1050 @@
+/*
+ * Upload manager for getting data into device local buffers and images without
+ * stalling the GPU.
+ *
+ * Uploads are recorded into a single command buffer on the transfer queue (a
+ * dedicated transfer family if the device has one) until vkx_upload_flush() is
+ * called.  The flush submits everything at once and signals a timeline
+ * semaphore, returning the value which means the uploads are ready.
+ *
+ * With a dedicated transfer family the resources have to change queue family
+ * ownership, so the flush also submits a small command buffer to the graphics
+ * queue which waits on the transfer and performs the acquire barriers.  As
+ * semaphore waits cover everything later in submission order, anything submitted
+ * to the graphics queue after a flush can safely use the uploaded resources -
+ * only the CPU ever needs to wait on the returned value.
+ *
+ * Images can have their mip chain generated from the base level.  Blits need a
+ * graphics capable queue, so with a dedicated transfer family the blits are
+ * recorded into the acquire command buffer after the ownership transfer, and
+ * otherwise at the end of the transfer command buffer.  Either way the chains
+ * for every image in the batch are built level by level with one barrier per
+ * level.
+ *
+ * The staging data goes into one big persistently mapped buffer, which is used
+ * as a ring.  Each batch's part of it is given back once the batch has
+ * completed on the GPU, and if it is full the oldest batches are waited for.
+ * Only uploads which can't fit in it (even once everything else has been
+ * given back) get their own staging buffer, which is freed with the batch.
+ *
+ * With VK_EXT_host_image_copy, images which don't need a mip chain generating
+ * can skip all of this and be written straight from host memory with
+ * vkx_upload_images_on_host() (see vkx_upload_can_copy_on_host()).
+ *
+ * With VK_EXT_external_memory_host, big buffer uploads whose data stays put
+ * until they're done can be copied straight out of it with
+ * vkx_upload_buffer_in_place(), without a staging copy.  The imported memory
+ * is given back with the batch, like a staging buffer of its own.
+ */
+
+#include "vkx/vkx_upload.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vkx/vkx_memory.h"
+#include "arena.h"
+
+typedef struct {
+	VkImage image;
+	// Size of the base level
+	VkExtent2D extent;
+	uint32_t mip_levels;
+	uint32_t array_layers;
+} VkxUploadMipChain;
+
+typedef struct {
+	VkCommandBuffer transfer_command_buffer;
+	// Only used with a dedicated transfer queue family
+	VkCommandBuffer acquire_command_buffer;
+	// Where the batch's part of the staging arena ends
+	uint64_t staging_end;
+	// Staging buffers to free once the batch is complete
+	VkxBuffer* staging_buffers;
+	uint32_t staging_buffers_count;
+	uint32_t staging_buffers_capacity;
+	// Queue family ownership acquire barriers to record on the graphics queue
+	VkImageMemoryBarrier2* image_barriers;
+	uint32_t image_barriers_count;
+	uint32_t image_barriers_capacity;
+	VkBufferMemoryBarrier2* buffer_barriers;
+	uint32_t buffer_barriers_count;
+	uint32_t buffer_barriers_capacity;
+	// Images which need their mip chains generating before they are used
+	VkxUploadMipChain* mip_chains;
+	uint32_t mip_chains_count;
+	uint32_t mip_chains_capacity;
+	// Timeline value which is signalled when the batch is complete
+	uint64_t value;
+} VkxUploadBatch;
+
+static VkCommandPool transfer_command_pool = VK_NULL_HANDLE;
+static VkCommandPool acquire_command_pool = VK_NULL_HANDLE;
+static VkSemaphore timeline_semaphore = VK_NULL_HANDLE;
+// Last value that was (or will be) signalled on the timeline
+static uint64_t timeline_value = 0;
+
+// Does the transfer queue belong to a different family to the graphics queue?
+static bool ownership_transfer = false;
+
+// The batch that is currently being recorded
+static VkxUploadBatch recording_batch = {0};
+static bool recording = false;
+
+// Batches which have been submitted but may not be finished yet, oldest first
+static VkxUploadBatch* pending_batches = NULL;
+static uint32_t pending_batches_count = 0;
+static uint32_t pending_batches_capacity = 0;
+
+static VkxBuffer staging_arena = {0};
+// Bytes ever handed out from the arena and given back to it.  The part in use
+// is from the tail to the head, wrapping around the end of the buffer
+static uint64_t staging_head = 0;
+static uint64_t staging_tail = 0;
+
+typedef struct {
+	VkBuffer buffer;
+	VkDeviceSize offset;
+	void* mapped;
+} VkxStagingRegion;
+
+static PFN_vkTransitionImageLayoutEXT transition_image_layout_func = NULL;
+static PFN_vkCopyMemoryToImageEXT copy_memory_to_image_func = NULL;
+
+static void* vkx_upload_grow(void* array, uint32_t* capacity, size_t element_size) {
+	*capacity = *capacity == 0 ? 16 : *capacity * 2;
+	array = realloc(array, element_size * *capacity);
+	if (array == NULL) {
+		fprintf(stderr, "Failed to grow upload batch array\n");
+		exit(1);
+	}
+	return array;
+}
+
+static VkCommandBuffer vkx_upload_begin_command_buffer(VkCommandPool command_pool) {
+	VkCommandBufferAllocateInfo alloc_info = {0};
+	alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	alloc_info.commandPool = command_pool;
+	alloc_info.commandBufferCount = 1;
+
+	VkCommandBuffer command_buffer;
+	if (vkAllocateCommandBuffers(vkx_instance.device, &alloc_info, &command_buffer) != VK_SUCCESS) {
+		fprintf(stderr, "failed to allocate upload command buffer!\n");
+		exit(1);
+	}
+
+	VkCommandBufferBeginInfo begin_info = {0};
+	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkBeginCommandBuffer(command_buffer, &begin_info);
+
+	return command_buffer;
+}
+
+static VkxUploadBatch* vkx_upload_get_batch(void) {
+	/*
+	 * Get the batch to record into, starting a new one if needed
+	 */
+	if (!recording) {
+		memset(&recording_batch, 0, sizeof(VkxUploadBatch));
+		recording_batch.transfer_command_buffer = vkx_upload_begin_command_buffer(transfer_command_pool);
+		recording = true;
+	}
+
+	return &recording_batch;
+}
+
+static void vkx_upload_free_batch(VkxUploadBatch* batch) {
+	// Batches complete in order, so everything up to here is free
+	if (batch->staging_end > staging_tail) {
+		staging_tail = batch->staging_end;
+	}
+
+	for (uint32_t i = 0; i < batch->staging_buffers_count; i++) {
+		vkx_cleanup_buffer(&batch->staging_buffers[i]);
+	}
+
+	vkFreeCommandBuffers(vkx_instance.device, transfer_command_pool, 1, &batch->transfer_command_buffer);
+	if (batch->acquire_command_buffer != VK_NULL_HANDLE) {
+		vkFreeCommandBuffers(vkx_instance.device, acquire_command_pool, 1, &batch->acquire_command_buffer);
+	}
+
+	free(batch->staging_buffers);
+	free(batch->image_barriers);
+	free(batch->buffer_barriers);
+	free(batch->mip_chains);
+	memset(batch, 0, sizeof(VkxUploadBatch));
+}
+
+static VkImageMemoryBarrier2 vkx_upload_mip_barrier(const VkxUploadMipChain* chain, uint32_t mip_level,
+		VkImageLayout old_layout, VkImageLayout new_layout) {
+	VkImageMemoryBarrier2 barrier = {0};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+	barrier.image = chain->image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.baseMipLevel = mip_level;
+	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = chain->array_layers;
+	barrier.oldLayout = old_layout;
+	barrier.newLayout = new_layout;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+
+	if (old_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
+		// Written by the copy (level 0) or the previous blit
+		barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_BLIT_BIT;
+		barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	}
+	else {
+		// Only read by the blit to the next level
+		barrier.srcStageMask = VK_PIPELINE_STAGE_2_BLIT_BIT;
+		barrier.srcAccessMask = VK_ACCESS_2_NONE;
+	}
+
+	if (new_layout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL) {
+		barrier.dstStageMask = VK_PIPELINE_STAGE_2_BLIT_BIT;
+		barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT;
+	}
+	else {
+		barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+		barrier.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+	}
+
+	return barrier;
+}
+
+static void vkx_upload_record_mip_chains(VkCommandBuffer command_buffer, const VkxUploadBatch* batch) {
+	/*
+	 * Generate the mip chains for all of the images in the batch.  Every level of
+	 * every image must be in TRANSFER_DST_OPTIMAL with level 0 filled in, and they
+	 * all end up in SHADER_READ_ONLY_OPTIMAL.
+	 *
+	 * The images are processed together one level at a time, so each step is a
+	 * single barrier (the previous source level is finished with and the next one
+	 * is ready to read) followed by a blit per image
+	 */
+	if (batch->mip_chains_count == 0) {
+		return;
+	}
+
+	uint32_t max_levels = 0;
+	for (uint32_t i = 0; i < batch->mip_chains_count; i++) {
+		if (batch->mip_chains[i].mip_levels > max_levels) {
+			max_levels = batch->mip_chains[i].mip_levels;
+		}
+	}
+
+	Arena* arena = frame_arena();
+	size_t arena_mark = arena_get_mark(arena);
+	VkImageMemoryBarrier2* barriers = FRAME_ALLOC(VkImageMemoryBarrier2, batch->mip_chains_count * 2);
+
+	// Step n blits level n - 1 into level n, the extra step finishes the longest chain
+	for (uint32_t level = 1; level <= max_levels; level++) {
+		uint32_t barriers_count = 0;
+
+		for (uint32_t i = 0; i < batch->mip_chains_count; i++) {
+			const VkxUploadMipChain* chain = &batch->mip_chains[i];
+
+			if (level < chain->mip_levels) {
+				barriers[barriers_count++] = vkx_upload_mip_barrier(chain, level - 1,
+					VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+				if (level >= 2) {
+					barriers[barriers_count++] = vkx_upload_mip_barrier(chain, level - 2,
+						VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+				}
+			}
+			else if (level == chain->mip_levels) {
+				// The last level was only ever written to
+				barriers[barriers_count++] = vkx_upload_mip_barrier(chain, level - 1,
+					VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+				barriers[barriers_count++] = vkx_upload_mip_barrier(chain, level - 2,
+					VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+			}
+		}
+
+		VkDependencyInfo dependency_info = {0};
+		dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+		dependency_info.imageMemoryBarrierCount = barriers_count;
+		dependency_info.pImageMemoryBarriers = barriers;
+		vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+
+		for (uint32_t i = 0; i < batch->mip_chains_count; i++) {
+			const VkxUploadMipChain* chain = &batch->mip_chains[i];
+			if (level >= chain->mip_levels) {
+				continue;
+			}
+
+			int32_t src_width = (int32_t) (chain->extent.width >> (level - 1));
+			int32_t src_height = (int32_t) (chain->extent.height >> (level - 1));
+			int32_t dst_width = (int32_t) (chain->extent.width >> level);
+			int32_t dst_height = (int32_t) (chain->extent.height >> level);
+
+			VkImageBlit blit = {0};
+			blit.srcOffsets[1].x = src_width > 1 ? src_width : 1;
+			blit.srcOffsets[1].y = src_height > 1 ? src_height : 1;
+			blit.srcOffsets[1].z = 1;
+			blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			blit.srcSubresource.mipLevel = level - 1;
+			blit.srcSubresource.baseArrayLayer = 0;
+			blit.srcSubresource.layerCount = chain->array_layers;
+			blit.dstOffsets[1].x = dst_width > 1 ? dst_width : 1;
+			blit.dstOffsets[1].y = dst_height > 1 ? dst_height : 1;
+			blit.dstOffsets[1].z = 1;
+			blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			blit.dstSubresource.mipLevel = level;
+			blit.dstSubresource.baseArrayLayer = 0;
+			blit.dstSubresource.layerCount = chain->array_layers;
+
+			vkCmdBlitImage(
+				command_buffer,
+				chain->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				chain->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				1, &blit,
+				VK_FILTER_LINEAR
+			);
+		}
+	}
+
+	arena_release(arena, arena_mark);
+}
+
+static void vkx_upload_collect(void) {
+	/*
+	 * Free all of the batches that the GPU has finished with
+	 */
+	uint64_t completed = 0;
+	vkGetSemaphoreCounterValue(vkx_instance.device, timeline_semaphore, &completed);
+
+	uint32_t kept = 0;
+	for (uint32_t i = 0; i < pending_batches_count; i++) {
+		if (pending_batches[i].value <= completed) {
+			vkx_upload_free_batch(&pending_batches[i]);
+		}
+		else {
+			pending_batches[kept++] = pending_batches[i];
+		}
+	}
+	pending_batches_count = kept;
+}
+
+static bool vkx_upload_arena_alloc(VkDeviceSize size, VkDeviceSize* offset) {
+	/*
+	 * Take size bytes from the staging arena, waiting for the oldest batches to
+	 * give theirs back if it is full.  The offsets are 16 byte aligned for image
+	 * copies
+	 *
+	 * @return false if it won't fit even without the pending batches
+	 */
+	const uint64_t arena_size = VKX_UPLOAD_STAGING_ARENA_SIZE;
+	if (size > arena_size) {
+		return false;
+	}
+
+	for (;;) {
+		uint64_t head = (staging_head + 15) & ~((uint64_t) 15);
+		uint64_t position = head % arena_size;
+
+		// Regions don't wrap, the rest of the buffer is skipped instead
+		if (position + size > arena_size) {
+			head += arena_size - position;
+			position = 0;
+		}
+
+		if (head + size - staging_tail <= arena_size) {
+			staging_head = head + size;
+			*offset = position;
+			return true;
+		}
+
+		if (pending_batches_count == 0) {
+			return false;
+		}
+
+		vkx_upload_wait(pending_batches[0].value);
+		vkx_upload_collect();
+	}
+}
+
+static VkxStagingRegion vkx_upload_create_staging_buffer(VkxUploadBatch* batch, const void* data, VkDeviceSize size) {
+	VkxStagingRegion region = {0};
+
+	VkDeviceSize offset;
+	if (vkx_upload_arena_alloc(size, &offset)) {
+		region.buffer = staging_arena.buffer;
+		region.offset = offset;
+		region.mapped = (uint8_t*) staging_arena.allocation.mapped + offset;
+		batch->staging_end = staging_head;
+	}
+	else {
+		VkxMemoryTag previous_tag = vkx_memory_set_tag(VKX_MEMORY_TAG_STAGING);
+		VkxBuffer staging_buffer = vkx_create_buffer(
+			size,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+		);
+		vkx_memory_set_tag(previous_tag);
+
+		if (batch->staging_buffers_count == batch->staging_buffers_capacity) {
+			batch->staging_buffers = vkx_upload_grow(batch->staging_buffers, &batch->staging_buffers_capacity, sizeof(VkxBuffer));
+		}
+		batch->staging_buffers[batch->staging_buffers_count++] = staging_buffer;
+
+		region.buffer = staging_buffer.buffer;
+		region.offset = 0;
+		region.mapped = staging_buffer.allocation.mapped;
+	}
+
+	// The data can be NULL if the caller wants to fill the buffer itself
+	if (data != NULL) {
+		memcpy(region.mapped, data, (size_t) size);
+	}
+	VKX_COUNT_COMMANDS(VKX_STAT_UPLOAD_BYTES, size);
+
+	return region;
+}
+
+void vkx_upload_init(void) {
+	/*
+	 * Create the command pools and timeline semaphore.  Called from vkx_init()
+	 */
+	ownership_transfer = vkx_instance.transfer_queue_family != vkx_instance.graphics_queue_family;
+
+	VkCommandPoolCreateInfo pool_info = {0};
+	pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	pool_info.queueFamilyIndex = vkx_instance.transfer_queue_family;
+
+	if (vkCreateCommandPool(vkx_instance.device, &pool_info, vkx_get_allocator(VK_OBJECT_TYPE_COMMAND_POOL), &transfer_command_pool) != VK_SUCCESS) {
+		fprintf(stderr, "failed to create upload command pool!\n");
+		exit(1);
+	}
+
+	if (ownership_transfer) {
+		pool_info.queueFamilyIndex = vkx_instance.graphics_queue_family;
+
+		if (vkCreateCommandPool(vkx_instance.device, &pool_info, vkx_get_allocator(VK_OBJECT_TYPE_COMMAND_POOL), &acquire_command_pool) != VK_SUCCESS) {
+			fprintf(stderr, "failed to create upload acquire command pool!\n");
+			exit(1);
+		}
+	}
+
+	VkSemaphoreTypeCreateInfo type_info = {0};
+	type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	type_info.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphore_info = {0};
+	semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphore_info.pNext = &type_info;
+
+	if (vkCreateSemaphore(vkx_instance.device, &semaphore_info, vkx_get_allocator(VK_OBJECT_TYPE_SEMAPHORE), &timeline_semaphore) != VK_SUCCESS) {
+		fprintf(stderr, "failed to create upload timeline semaphore!\n");
+		exit(1);
+	}
+
+	timeline_value = 0;
+
+	VkxMemoryTag previous_tag = vkx_memory_set_tag(VKX_MEMORY_TAG_STAGING);
+	staging_arena = vkx_create_buffer(
+		VKX_UPLOAD_STAGING_ARENA_SIZE,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+	);
+	vkx_memory_set_tag(previous_tag);
+	staging_head = 0;
+	staging_tail = 0;
+
+	if (vkx_instance.has_host_image_copy) {
+		transition_image_layout_func = (PFN_vkTransitionImageLayoutEXT) vkGetDeviceProcAddr(vkx_instance.device, "vkTransitionImageLayoutEXT");
+		copy_memory_to_image_func = (PFN_vkCopyMemoryToImageEXT) vkGetDeviceProcAddr(vkx_instance.device, "vkCopyMemoryToImageEXT");
+		if (transition_image_layout_func == NULL || copy_memory_to_image_func == NULL) {
+			fprintf(stderr, "failed to load the host image copy commands!\n");
+			exit(1);
+		}
+	}
+}
+
+void vkx_upload_cleanup(void) {
+	/*
+	 * Wait for any outstanding uploads and free everything
+	 */
+	if (recording) {
+		vkx_upload_flush();
+	}
+
+	vkx_upload_wait(timeline_value);
+	vkx_upload_collect();
+
+	free(pending_batches);
+	pending_batches = NULL;
+	pending_batches_capacity = 0;
+
+	vkx_cleanup_buffer(&staging_arena);
+
+	vkDestroySemaphore(vkx_instance.device, timeline_semaphore, vkx_get_allocator(VK_OBJECT_TYPE_SEMAPHORE));
+	vkDestroyCommandPool(vkx_instance.device, transfer_command_pool, vkx_get_allocator(VK_OBJECT_TYPE_COMMAND_POOL));
+	if (acquire_command_pool != VK_NULL_HANDLE) {
+		vkDestroyCommandPool(vkx_instance.device, acquire_command_pool, vkx_get_allocator(VK_OBJECT_TYPE_COMMAND_POOL));
+	}
+
+	timeline_semaphore = VK_NULL_HANDLE;
+	transfer_command_pool = VK_NULL_HANDLE;
+	acquire_command_pool = VK_NULL_HANDLE;
+}
+
+static void vkx_upload_record_buffer_copy(VkxUploadBatch* batch, VkxStagingRegion staging, VkBuffer dst_buffer,
+		VkDeviceSize dst_offset, VkDeviceSize size) {
+	/*
+	 * Record the copy of an upload out of its staging region, and hand the
+	 * buffer over to the graphics queue
+	 */
+	VkBufferCopy copy_region = {0};
+	copy_region.srcOffset = staging.offset;
+	copy_region.dstOffset = dst_offset;
+	copy_region.size = size;
+	vkCmdCopyBuffer(batch->transfer_command_buffer, staging.buffer, dst_buffer, 1, &copy_region);
+
+	VkBufferMemoryBarrier2 barrier = {0};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+	barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+	barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+	// Some buffers (e.g. simulation state) are written by shaders afterwards
+	barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+	barrier.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = dst_buffer;
+	barrier.offset = dst_offset;
+	barrier.size = size;
+
+	// Released from the transfer queue here, and acquired on the graphics queue
+	// when the batch is flushed
+	VkBufferMemoryBarrier2 recorded_barrier = barrier;
+	if (ownership_transfer) {
+		recorded_barrier = vkx_buffer_ownership_release(barrier, vkx_instance.transfer_queue_family, vkx_instance.graphics_queue_family);
+	}
+
+	VkDependencyInfo dependency_info = {0};
+	dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dependency_info.bufferMemoryBarrierCount = 1;
+	dependency_info.pBufferMemoryBarriers = &recorded_barrier;
+	vkCmdPipelineBarrier2(batch->transfer_command_buffer, &dependency_info);
+
+	if (ownership_transfer) {
+		if (batch->buffer_barriers_count == batch->buffer_barriers_capacity) {
+			batch->buffer_barriers = vkx_upload_grow(batch->buffer_barriers, &batch->buffer_barriers_capacity, sizeof(VkBufferMemoryBarrier2));
+		}
+		batch->buffer_barriers[batch->buffer_barriers_count++] = vkx_buffer_ownership_acquire(barrier, vkx_instance.transfer_queue_family, vkx_instance.graphics_queue_family);
+	}
+}
+
+void vkx_upload_buffer(VkBuffer dst_buffer, VkDeviceSize dst_offset, const void* data, VkDeviceSize size) {
+	/*
+	 * Queue a copy of data into a buffer.  The data is copied into a staging buffer
+	 * straight away so it can be freed as soon as this returns, but the buffer
+	 * must not be used until the batch has been flushed
+	 *
+	 * @param dst_buffer The buffer to copy to (must have TRANSFER_DST usage)
+	 * @param dst_offset Offset into the buffer to copy to
+	 * @param data The data to copy
+	 * @param size The number of bytes to copy
+	 */
+	VkxUploadBatch* batch = vkx_upload_get_batch();
+	VkxStagingRegion staging = vkx_upload_create_staging_buffer(batch, data, size);
+	vkx_upload_record_buffer_copy(batch, staging, dst_buffer, dst_offset, size);
+}
+
+void vkx_upload_buffer_in_place(VkBuffer dst_buffer, VkDeviceSize dst_offset, const void* data, VkDeviceSize size) {
+	/*
+	 * Queue a copy of data into a buffer straight out of the data, where it's
+	 * big enough and the device can import it, otherwise the same as
+	 * vkx_upload_buffer().  Either way the data mustn't be freed or changed
+	 * until vkx_upload_is_complete() for the flush it goes in
+	 */
+	if (size < VKX_UPLOAD_IMPORT_MIN_SIZE) {
+		vkx_upload_buffer(dst_buffer, dst_offset, data, size);
+		return;
+	}
+
+	VkDeviceSize data_offset = 0;
+	VkxMemoryTag previous_tag = vkx_memory_set_tag(VKX_MEMORY_TAG_STAGING);
+	VkxBuffer source = vkx_import_host_buffer(data, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, &data_offset);
+	vkx_memory_set_tag(previous_tag);
+	if (source.buffer == VK_NULL_HANDLE) {
+		vkx_upload_buffer(dst_buffer, dst_offset, data, size);
+		return;
+	}
+
+	VkxUploadBatch* batch = vkx_upload_get_batch();
+	if (batch->staging_buffers_count == batch->staging_buffers_capacity) {
+		batch->staging_buffers = vkx_upload_grow(batch->staging_buffers, &batch->staging_buffers_capacity, sizeof(VkxBuffer));
+	}
+	batch->staging_buffers[batch->staging_buffers_count++] = source;
+	VKX_COUNT_COMMANDS(VKX_STAT_UPLOAD_BYTES, size);
+
+	VkxStagingRegion staging = {0};
+	staging.buffer = source.buffer;
+	staging.offset = data_offset;
+	vkx_upload_record_buffer_copy(batch, staging, dst_buffer, dst_offset, size);
+}
+
+void vkx_upload_image(VkImage image, uint32_t width, uint32_t height, uint32_t mip_levels, const void* pixels, VkDeviceSize size) {
+	/*
+	 * Queue an upload of the pixels to a colour image.  The image is transitioned
+	 * from undefined to shader read only optimal.  As with vkx_upload_buffer() the
+	 * pixels may be freed straight away, but the image must not be used until the
+	 * batch has been flushed
+	 *
+	 * @param image The image (must have TRANSFER_DST usage)
+	 * @param width The width of the image
+	 * @param height The height of the image
+	 * @param mip_levels The number of mip levels in the image, see VkxImageUpload
+	 * @param pixels Tightly packed pixel data
+	 * @param size The size of the pixel data in bytes
+	 */
+	VkxImageUpload upload = {0};
+	upload.image = image;
+	upload.extent.width = width;
+	upload.extent.height = height;
+	upload.mip_levels = mip_levels;
+	upload.array_layers = 1;
+	upload.pixels = pixels;
+	upload.size = size;
+
+	vkx_upload_images(1, &upload);
+}
+
+void vkx_upload_images(uint32_t count, const VkxImageUpload* uploads) {
+	/*
+	 * Queue uploads to several colour images at once.  All of the pixel data is
+	 * packed into a single staging buffer and the layout transitions for all of the
+	 * images are done with one barrier before and one after the copies
+	 *
+	 * @param count The number of images
+	 * @param uploads The images and their pixels
+	 */
+	if (count == 0) {
+		return;
+	}
+
+	VkxUploadBatch* batch = vkx_upload_get_batch();
+
+	// ----- Pack the pixels into one staging buffer -----
+	Arena* arena = frame_arena();
+	size_t arena_mark = arena_get_mark(arena);
+	VkDeviceSize* offsets = FRAME_ALLOC(VkDeviceSize, count);
+	VkImageMemoryBarrier2* barriers = FRAME_ALLOC(VkImageMemoryBarrier2, count);
+
+	// Buffer offsets for image copies must be a multiple of the texel size (or
+	// the block size for compressed formats), neither of which is over 16 bytes
+	VkDeviceSize total_size = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		offsets[i] = total_size;
+		total_size = (total_size + uploads[i].size + 15) & ~((VkDeviceSize) 15);
+	}
+
+	VkxStagingRegion staging = vkx_upload_create_staging_buffer(batch, NULL, total_size);
+	for (uint32_t i = 0; i < count; i++) {
+		uint8_t* dst = (uint8_t*) staging.mapped + offsets[i];
+		if (uploads[i].conversion == NULL) {
+			memcpy(dst, uploads[i].pixels, (size_t) uploads[i].size);
+			continue;
+		}
+
+		if (uploads[i].array_layers != 1 || uploads[i].level_offsets != NULL
+				|| uploads[i].size != (VkDeviceSize) uploads[i].extent.width * uploads[i].extent.height * 4) {
+			fprintf(stderr, "Pixels can only be converted in uploads of one layer of RGBA8\n");
+			exit(1);
+		}
+		vkx_convert_pixels(uploads[i].conversion, uploads[i].pixels, dst, uploads[i].extent.width, uploads[i].extent.height);
+	}
+
+	// ----- Undefined -> transfer destination -----
+	for (uint32_t i = 0; i < count; i++) {
+		VkImageMemoryBarrier2 barrier = {0};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+		barrier.image = uploads[i].image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = uploads[i].mip_levels;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = uploads[i].array_layers;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+		barrier.srcAccessMask = VK_ACCESS_2_NONE;
+		// The lower mip levels are written by blits
+		barrier.dstStageMask = VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_BLIT_BIT;
+		barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barriers[i] = barrier;
+	}
+
+	VkDependencyInfo dependency_info = {0};
+	dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+	dependency_info.imageMemoryBarrierCount = count;
+	dependency_info.pImageMemoryBarriers = barriers;
+	vkCmdPipelineBarrier2(batch->transfer_command_buffer, &dependency_info);
+
+	// ----- Copy the pixels -----
+	for (uint32_t i = 0; i < count; i++) {
+		// Either just the base level, or every level when they are given
+		uint32_t copied_levels = uploads[i].level_offsets != NULL ? uploads[i].mip_levels : 1;
+
+		for (uint32_t level = 0; level < copied_levels; level++) {
+			// All of the layers are copied in one go as they are tightly packed.
+			// Block compressed levels are also padded out to whole blocks, which
+			// the copy (with the real size of the level) expects
+			VkBufferImageCopy region = {0};
+			region.bufferOffset = staging.offset + offsets[i] + (uploads[i].level_offsets != NULL ? uploads[i].level_offsets[level] : 0);
+			region.bufferRowLength = 0;
+			region.bufferImageHeight = 0;
+			region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region.imageSubresource.mipLevel = level;
+			region.imageSubresource.baseArrayLayer = 0;
+			region.imageSubresource.layerCount = uploads[i].array_layers;
+			region.imageExtent.width = uploads[i].extent.width >> level > 0 ? uploads[i].extent.width >> level : 1;
+			region.imageExtent.height = uploads[i].extent.height >> level > 0 ? uploads[i].extent.height >> level : 1;
+			region.imageExtent.depth = 1;
+
+			vkCmdCopyBufferToImage(
+				batch->transfer_command_buffer,
+				staging.buffer,
+				uploads[i].image,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				1,
+				&region
+			);
+		}
+	}
+
+	// ----- Queue up the mip chains -----
+	for (uint32_t i = 0; i < count; i++) {
+		if (uploads[i].mip_levels <= 1 || uploads[i].level_offsets != NULL) {
+			continue;
+		}
+
+		if (batch->mip_chains_count == batch->mip_chains_capacity) {
+			batch->mip_chains = vkx_upload_grow(batch->mip_chains, &batch->mip_chains_capacity, sizeof(VkxUploadMipChain));
+		}
+
+		VkxUploadMipChain* chain = &batch->mip_chains[batch->mip_chains_count++];
+		chain->image = uploads[i].image;
+		chain->extent = uploads[i].extent;
+		chain->mip_levels = uploads[i].mip_levels;
+		chain->array_layers = uploads[i].array_layers;
+	}
+
+	// ----- Transfer destination -> shader read only -----
+	uint32_t barriers_count = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		bool has_mip_chain = uploads[i].mip_levels > 1 && uploads[i].level_offsets == NULL;
+
+		// Without an ownership transfer the mip chain does its own transitions
+		if (has_mip_chain && !ownership_transfer) {
+			continue;
+		}
+
+		VkImageMemoryBarrier2 barrier = barriers[i];
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		// Images with mip chains stay as transfer destinations for the blits
+		barrier.newLayout = has_mip_chain ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+		barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+		if (has_mip_chain) {
+			barrier.dstStageMask = VK_PIPELINE_STAGE_2_BLIT_BIT;
+			barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT;
+		}
+		else {
+			barrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+			barrier.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+		}
+
+		if (ownership_transfer) {
+			// Released from the transfer queue here, with the matching acquire
+			// (and the same layout transition) on the graphics queue
+			barriers[barriers_count++] = vkx_image_ownership_release(barrier, vkx_instance.transfer_queue_family, vkx_instance.graphics_queue_family);
+
+			if (batch->image_barriers_count == batch->image_barriers_capacity) {
+				batch->image_barriers = vkx_upload_grow(batch->image_barriers, &batch->image_barriers_capacity, sizeof(VkImageMemoryBarrier2));
+			}
+			batch->image_barriers[batch->image_barriers_count++] = vkx_image_ownership_acquire(barrier, vkx_instance.transfer_queue_family, vkx_instance.graphics_queue_family);
+		}
+		else {
+			barriers[barriers_count++] = barrier;
+		}
+	}
+
+	if (barriers_count > 0) {
+		dependency_info.imageMemoryBarrierCount = barriers_count;
+		vkCmdPipelineBarrier2(batch->transfer_command_buffer, &dependency_info);
+	}
+
+	arena_release(arena, arena_mark);
+}
+
+bool vkx_upload_can_copy_on_host(VkFormat format, VkImageUsageFlags usage) {
+	/*
+	 * Check whether optimally tiled colour images of a format can be written with
+	 * vkx_upload_images_on_host().  Some devices lay images out less efficiently
+	 * for the GPU when they can be copied to from the host, so this is false for
+	 * those as well, and they keep going through the staging buffer
+	 *
+	 * @param format The image format
+	 * @param usage The usage the image will have, apart from HOST_TRANSFER
+	 */
+	if (!vkx_instance.has_host_image_copy) {
+		return false;
+	}
+
+	VkFormatProperties3 format_properties3 = {0};
+	format_properties3.sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_3;
+	VkFormatProperties2 format_properties = {0};
+	format_properties.sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_2;
+	format_properties.pNext = &format_properties3;
+	vkGetPhysicalDeviceFormatProperties2(vkx_instance.physical_device, format, &format_properties);
+
+	if ((format_properties3.optimalTilingFeatures & VK_FORMAT_FEATURE_2_HOST_IMAGE_TRANSFER_BIT_EXT) == 0) {
+		return false;
+	}
+
+	VkHostImageCopyDevicePerformanceQueryEXT performance_query = {0};
+	performance_query.sType = VK_STRUCTURE_TYPE_HOST_IMAGE_COPY_DEVICE_PERFORMANCE_QUERY_EXT;
+	VkImageFormatProperties2 image_format_properties = {0};
+	image_format_properties.sType = VK_STRUCTURE_TYPE_IMAGE_FORMAT_PROPERTIES_2;
+	image_format_properties.pNext = &performance_query;
+
+	VkPhysicalDeviceImageFormatInfo2 image_format_info = {0};
+	image_format_info.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_FORMAT_INFO_2;
+	image_format_info.format = format;
+	image_format_info.type = VK_IMAGE_TYPE_2D;
+	image_format_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+	image_format_info.usage = usage | VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT;
+
+	if (vkGetPhysicalDeviceImageFormatProperties2(vkx_instance.physical_device, &image_format_info, &image_format_properties) != VK_SUCCESS) {
+		return false;
+	}
+
+	return performance_query.optimalDeviceAccess;
+}
+
+void vkx_upload_images_on_host(uint32_t count, const VkxImageUpload* uploads) {
+	/*
+	 * Write the pixels straight into colour images from host memory (which can be
+	 * a mapped file), transitioning them from undefined to shader read only
+	 * optimal.  Nothing is recorded or submitted, so unlike vkx_upload_images()
+	 * the images can be used as soon as this returns, and the pixels freed.
+	 * Only for images which don't need their mip chains generating, as that
+	 * needs blits
+	 *
+	 * @param count The number of images
+	 * @param uploads The images, which need HOST_TRANSFER usage and a format
+	 *        vkx_upload_can_copy_on_host() is true for, and their pixels.  Either
+	 *        mip_levels is 1 or level_offsets is set
+	 */
+	if (count == 0) {
+		return;
+	}
+
+	Arena* arena = frame_arena();
+	size_t arena_mark = arena_get_mark(arena);
+	VkHostImageLayoutTransitionInfoEXT* transitions = FRAME_ALLOC(VkHostImageLayoutTransitionInfoEXT, count);
+
+	for (uint32_t i = 0; i < count; i++) {
+		if (uploads[i].mip_levels > 1 && uploads[i].level_offsets == NULL) {
+			fprintf(stderr, "Host image copies can't generate mip chains\n");
+			exit(1);
+		}
+
+		VkHostImageLayoutTransitionInfoEXT transition = {0};
+		transition.sType = VK_STRUCTURE_TYPE_HOST_IMAGE_LAYOUT_TRANSITION_INFO_EXT;
+		transition.image = uploads[i].image;
+		transition.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		transition.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		transition.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		transition.subresourceRange.baseMipLevel = 0;
+		transition.subresourceRange.levelCount = uploads[i].mip_levels;
+		transition.subresourceRange.baseArrayLayer = 0;
+		transition.subresourceRange.layerCount = uploads[i].array_layers;
+		transitions[i] = transition;
+	}
+
+	if (transition_image_layout_func(vkx_instance.device, count, transitions) != VK_SUCCESS) {
+		fprintf(stderr, "failed to transition images on the host!\n");
+		exit(1);
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		if (uploads[i].conversion != NULL) {
+			fprintf(stderr, "Pixels can't be converted when they're copied on the host\n");
+			exit(1);
+		}
+
+		VkMemoryToImageCopyEXT regions[VKX_KTX2_MAX_LEVELS] = {0};
+		uint32_t levels = uploads[i].mip_levels < VKX_KTX2_MAX_LEVELS ? uploads[i].mip_levels : VKX_KTX2_MAX_LEVELS;
+
+		// Laid out the same as the buffer copies in vkx_upload_images()
+		for (uint32_t level = 0; level < levels; level++) {
+			VkMemoryToImageCopyEXT* region = &regions[level];
+			region->sType = VK_STRUCTURE_TYPE_MEMORY_TO_IMAGE_COPY_EXT;
+			region->pHostPointer = (const uint8_t*) uploads[i].pixels + (uploads[i].level_offsets != NULL ? uploads[i].level_offsets[level] : 0);
+			region->memoryRowLength = 0;
+			region->memoryImageHeight = 0;
+			region->imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			region->imageSubresource.mipLevel = level;
+			region->imageSubresource.baseArrayLayer = 0;
+			region->imageSubresource.layerCount = uploads[i].array_layers;
+			region->imageExtent.width = uploads[i].extent.width >> level > 0 ? uploads[i].extent.width >> level : 1;
+			region->imageExtent.height = uploads[i].extent.height >> level > 0 ? uploads[i].extent.height >> level : 1;
+			region->imageExtent.depth = 1;
+		}
+
+		VkCopyMemoryToImageInfoEXT copy_info = {0};
+		copy_info.sType = VK_STRUCTURE_TYPE_COPY_MEMORY_TO_IMAGE_INFO_EXT;
+		copy_info.dstImage = uploads[i].image;
+		copy_info.dstImageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		copy_info.regionCount = levels;
+		copy_info.pRegions = regions;
+
+		if (copy_memory_to_image_func(vkx_instance.device, &copy_info) != VK_SUCCESS) {
+			fprintf(stderr, "failed to copy pixels to an image on the host!\n");
+			exit(1);
+		}
+		VKX_COUNT_COMMANDS(VKX_STAT_UPLOAD_BYTES, uploads[i].size);
+	}
+
+	arena_release(arena, arena_mark);
+}
+
+uint64_t vkx_upload_flush(void) {
+	/*
+	 * Submit all of the queued uploads.  Returns the timeline value which is
+	 * signalled when they are complete (and the resources have been handed over to
+	 * the graphics queue).  If there was nothing to submit this returns the value
+	 * of the last flush
+	 */
+	vkx_upload_collect();
+
+	if (!recording) {
+		return timeline_value;
+	}
+
+	VkxUploadBatch* batch = &recording_batch;
+
+	// The transfer queue is graphics capable if there's no ownership transfer
+	if (!ownership_transfer) {
+		vkx_upload_record_mip_chains(batch->transfer_command_buffer, batch);
+	}
+
+	vkEndCommandBuffer(batch->transfer_command_buffer);
+
+	// ----- Submit the copies to the transfer queue -----
+	VkCommandBufferSubmitInfo command_buffer_info = {0};
+	command_buffer_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+	command_buffer_info.commandBuffer = batch->transfer_command_buffer;
+
+	VkSemaphoreSubmitInfo signal_info = {0};
+	signal_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+	signal_info.semaphore = timeline_semaphore;
+	signal_info.value = ++timeline_value;
+	signal_info.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+	VkSubmitInfo2 submit_info = {0};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+	submit_info.commandBufferInfoCount = 1;
+	submit_info.pCommandBufferInfos = &command_buffer_info;
+	submit_info.signalSemaphoreInfoCount = 1;
+	submit_info.pSignalSemaphoreInfos = &signal_info;
+
+	if (vkQueueSubmit2(vkx_instance.transfer_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+		fprintf(stderr, "failed to submit upload command buffer!\n");
+		exit(1);
+	}
+
+	// ----- Acquire ownership on the graphics queue -----
+	if (ownership_transfer) {
+		batch->acquire_command_buffer = vkx_upload_begin_command_buffer(acquire_command_pool);
+
+		VkDependencyInfo dependency_info = {0};
+		dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+		dependency_info.imageMemoryBarrierCount = batch->image_barriers_count;
+		dependency_info.pImageMemoryBarriers = batch->image_barriers;
+		dependency_info.bufferMemoryBarrierCount = batch->buffer_barriers_count;
+		dependency_info.pBufferMemoryBarriers = batch->buffer_barriers;
+		vkCmdPipelineBarrier2(batch->acquire_command_buffer, &dependency_info);
+
+		vkx_upload_record_mip_chains(batch->acquire_command_buffer, batch);
+
+		vkEndCommandBuffer(batch->acquire_command_buffer);
+
+		VkSemaphoreSubmitInfo wait_info = signal_info;
+		wait_info.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+		signal_info.value = ++timeline_value;
+		command_buffer_info.commandBuffer = batch->acquire_command_buffer;
+
+		submit_info.waitSemaphoreInfoCount = 1;
+		submit_info.pWaitSemaphoreInfos = &wait_info;
+
+		if (vkQueueSubmit2(vkx_instance.graphics_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+			fprintf(stderr, "failed to submit upload acquire command buffer!\n");
+			exit(1);
+		}
+	}
+
+	batch->value = timeline_value;
+
+	if (pending_batches_count == pending_batches_capacity) {
+		pending_batches = vkx_upload_grow(pending_batches, &pending_batches_capacity, sizeof(VkxUploadBatch));
+	}
+	pending_batches[pending_batches_count++] = *batch;
+
+	memset(&recording_batch, 0, sizeof(VkxUploadBatch));
+	recording = false;
+
+	return timeline_value;
+}
+
+bool vkx_upload_is_complete(uint64_t value) {
+	/*
+	 * Check (without blocking) if the uploads for a flush have finished
+	 *
+	 * @param value The value returned by vkx_upload_flush()
+	 */
+	uint64_t completed = 0;
+	vkGetSemaphoreCounterValue(vkx_instance.device, timeline_semaphore, &completed);
+	return completed >= value;
+}
+
+void vkx_upload_wait(uint64_t value) {
+	/*
+	 * Block until the uploads for a flush have finished.  This is only needed if
+	 * the CPU needs to know - GPU work submitted to the graphics queue after the
+	 * flush is already ordered after the uploads
+	 *
+	 * @param value The value returned by vkx_upload_flush()
+	 */
+	VkSemaphoreWaitInfo wait_info = {0};
+	wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+	wait_info.semaphoreCount = 1;
+	wait_info.pSemaphores = &timeline_semaphore;
+	wait_info.pValues = &value;
+
+	if (vkWaitSemaphores(vkx_instance.device, &wait_info, UINT64_MAX) != VK_SUCCESS) {
+		fprintf(stderr, "failed to wait for uploads!\n");
+		exit(1);
+	}
+}
+
+VkSemaphore vkx_upload_get_semaphore(void) {
+	/*
+	 * Get the timeline semaphore, for submissions to other queues that want to wait
+	 * on uploads on the GPU
+	 */
+	return timeline_semaphore;
+}
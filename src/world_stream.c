@@ -0,0 +1,518 @@
+/*
+ * Streaming a world's chunks from region files (see world_stream.h for the
+ * layout) into a TileStore as the camera nears them.
+ *
+ * Each frame world_stream_update() looks at the chunks in a window around the
+ * view: WORLD_STREAM_MARGIN chunks all the way round, stretched out ahead of
+ * the camera as far as it goes in WORLD_STREAM_LOOKAHEAD seconds.  Those the
+ * store doesn't have are sorted by how soon they'll be visible (their distance
+ * from the view over how fast the camera is heading their way), and read in
+ * that order.  Each one's looked up in its region's index, which is mapped with
+ * map_disk_file(), and a job decompresses it straight out of the mapping (so
+ * the disk is read by the worker as it touches the pages).  Finished reads go
+ * in the store on the next update, and chunk_changed is called so the tilemap
+ * and the collisions pick them up.  The main thread never waits on the disk.
+ * Reads of chunks which leave the window first are cancelled, so turning
+ * around doesn't leave chunks nobody needs in memory.
+ *
+ * Once the chunks take more than the memory budget the least recently needed
+ * ones are evicted, the furthest from the view first, until they fit again.
+ * Chunks near the view are never evicted.  Evicting a chunk drops any edits to
+ * it, and it's read from its region again when it's next needed.
+ */
+
+#include "world_stream.h"
+#include "lz4_block.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Longest region filename
+#define WORLD_MAX_FILENAME 256
+
+typedef struct {
+	uint32_t last_used;
+	float distance;
+	int32_t x;
+	int32_t y;
+} WorldEvictionCandidate;
+
+static int32_t world_floor_div(int32_t value, int32_t divisor) {
+	return value >= 0 ? value / divisor : -((-(value + 1)) / divisor) - 1;
+}
+
+void world_get_region_filename(const char* prefix, int32_t region_x, int32_t region_y, char* filename, size_t size) {
+	snprintf(filename, size, "%s_%d_%d.vxr", prefix, region_x, region_y);
+}
+
+static bool world_write_region(const char* prefix, const TileStore* store, int32_t region_x, int32_t region_y,
+		bool* written) {
+	/*
+	 * Write one region's file from the chunks in the store
+	 *
+	 * @param written Set for each of the store's chunks written
+	 */
+	const size_t entries_count = WORLD_REGION_CHUNKS * WORLD_REGION_CHUNKS;
+	const size_t index_size = sizeof(WorldRegionHeader) + sizeof(WorldRegionEntry) * entries_count;
+	const size_t chunk_size = sizeof(((TileStoreChunk*) NULL)->tiles);
+
+	uint32_t chunks_count = 0;
+	for (uint32_t i = 0; i < store->chunks_count; i++) {
+		const TileStoreChunk* chunk = store->chunks[i];
+		chunks_count += world_floor_div(chunk->x, WORLD_REGION_CHUNKS) == region_x
+			&& world_floor_div(chunk->y, WORLD_REGION_CHUNKS) == region_y;
+	}
+
+	size_t capacity = index_size + LZ4_BLOCK_BOUND(chunk_size) * chunks_count;
+	uint8_t* data = calloc(1, capacity);
+	if (data == NULL) {
+		fprintf(stderr, "Failed to allocate %zu bytes for region %d, %d\n", capacity, region_x, region_y);
+		return false;
+	}
+
+	WorldRegionHeader header = {
+		.magic = WORLD_REGION_MAGIC,
+		.version = WORLD_REGION_VERSION,
+		.region_x = region_x,
+		.region_y = region_y,
+		.chunk_size = TILE_STORE_CHUNK_SIZE,
+	};
+	memcpy(data, &header, sizeof(header));
+	WorldRegionEntry* entries = (WorldRegionEntry*) (data + sizeof(header));
+
+	size_t size = index_size;
+	for (uint32_t i = 0; i < store->chunks_count; i++) {
+		const TileStoreChunk* chunk = store->chunks[i];
+		if (world_floor_div(chunk->x, WORLD_REGION_CHUNKS) != region_x
+				|| world_floor_div(chunk->y, WORLD_REGION_CHUNKS) != region_y) {
+			continue;
+		}
+
+		size_t compressed_size = lz4_block_compress((const uint8_t*) chunk->tiles, chunk_size, data + size, capacity - size);
+		if (compressed_size == 0) {
+			fprintf(stderr, "Failed to compress chunk %d, %d\n", chunk->x, chunk->y);
+			free(data);
+			return false;
+		}
+
+		uint32_t local_x = (uint32_t) (chunk->x - region_x * WORLD_REGION_CHUNKS);
+		uint32_t local_y = (uint32_t) (chunk->y - region_y * WORLD_REGION_CHUNKS);
+		WorldRegionEntry* entry = &entries[local_x + local_y * WORLD_REGION_CHUNKS];
+		entry->offset = size;
+		entry->size = (uint32_t) compressed_size;
+		size += compressed_size;
+		written[i] = true;
+	}
+
+	char filename[WORLD_MAX_FILENAME];
+	world_get_region_filename(prefix, region_x, region_y, filename, sizeof(filename));
+	bool result = write_entire_binary_file(filename, data, size);
+	free(data);
+	return result;
+}
+
+bool world_write_regions(const char* prefix, const TileStore* store) {
+	/*
+	 * Write every region with something in it from a store, e.g. a generated
+	 * world, for streaming it back in later
+	 *
+	 * @param prefix The start of the region filenames, which can have a
+	 *               directory in it
+	 *
+	 * @return false if a region couldn't be written
+	 */
+	bool* written = calloc(store->chunks_count > 0 ? store->chunks_count : 1, sizeof(bool));
+	if (written == NULL) {
+		fprintf(stderr, "Failed to allocate the regions to write\n");
+		return false;
+	}
+
+	bool result = true;
+	for (uint32_t i = 0; i < store->chunks_count && result; i++) {
+		if (!written[i]) {
+			const TileStoreChunk* chunk = store->chunks[i];
+			result = world_write_region(prefix, store, world_floor_div(chunk->x, WORLD_REGION_CHUNKS),
+				world_floor_div(chunk->y, WORLD_REGION_CHUNKS), written);
+		}
+	}
+
+	free(written);
+	return result;
+}
+
+static void world_stream_close_region(WorldRegion* region) {
+	if (region->entries != NULL) {
+		unmap_file(&region->file);
+	}
+	memset(region, 0, sizeof(WorldRegion));
+}
+
+static void world_stream_open_region(WorldStream* stream, WorldRegion* region, int32_t region_x, int32_t region_y) {
+	/*
+	 * Map a region's file and check its index.  A region without a file, or
+	 * with a bad one, is left empty
+	 */
+	memset(region, 0, sizeof(WorldRegion));
+	region->used = true;
+	region->x = region_x;
+	region->y = region_y;
+	region->last_used = stream->frame;
+
+	char filename[WORLD_MAX_FILENAME];
+	world_get_region_filename(stream->prefix, region_x, region_y, filename, sizeof(filename));
+	if (!file_exists(filename)) {
+		return;
+	}
+
+	region->file = map_disk_file(filename);
+	const uint8_t* data = region->file.data;
+	size_t size = region->file.size;
+	const size_t entries_count = WORLD_REGION_CHUNKS * WORLD_REGION_CHUNKS;
+
+	WorldRegionHeader header = {0};
+	bool valid = size >= sizeof(header) + sizeof(WorldRegionEntry) * entries_count;
+	if (valid) {
+		memcpy(&header, data, sizeof(header));
+		valid = header.magic == WORLD_REGION_MAGIC && header.version == WORLD_REGION_VERSION
+			&& header.region_x == region_x && header.region_y == region_y && header.chunk_size == TILE_STORE_CHUNK_SIZE;
+	}
+
+	// The mapping is page aligned and the header is 32 bytes, so the entries
+	// can be used in place
+	const WorldRegionEntry* entries = (const WorldRegionEntry*) (data + sizeof(header));
+	for (size_t i = 0; i < entries_count && valid; i++) {
+		valid = entries[i].offset <= size && entries[i].size <= size - entries[i].offset;
+	}
+
+	if (!valid) {
+		fprintf(stderr, "Region %s isn't a valid version %d region, so it's left empty\n", filename, WORLD_REGION_VERSION);
+		unmap_file(&region->file);
+		return;
+	}
+	region->entries = entries;
+}
+
+static WorldRegion* world_stream_get_region(WorldStream* stream, int32_t region_x, int32_t region_y) {
+	/*
+	 * Find a region, opening it in place of the least recently used one
+	 * without reads in flight if it isn't open
+	 *
+	 * @return NULL if every region has reads in flight
+	 */
+	WorldRegion* unused = NULL;
+	WorldRegion* oldest = NULL;
+	for (uint32_t i = 0; i < WORLD_STREAM_MAX_REGIONS; i++) {
+		WorldRegion* region = &stream->regions[i];
+		if (region->used && region->x == region_x && region->y == region_y) {
+			region->last_used = stream->frame;
+			return region;
+		}
+		if (!region->used) {
+			unused = unused != NULL ? unused : region;
+		}
+		else if (region->pending == 0 && (oldest == NULL || region->last_used < oldest->last_used)) {
+			oldest = region;
+		}
+	}
+
+	WorldRegion* region = unused != NULL ? unused : oldest;
+	if (region == NULL) {
+		return NULL;
+	}
+	world_stream_close_region(region);
+	world_stream_open_region(stream, region, region_x, region_y);
+	return region;
+}
+
+static void world_stream_read_chunk(void* data) {
+	/*
+	 * Decompress a chunk out of its region's mapping, on a worker
+	 */
+	WorldStreamRequest* request = data;
+	if (SDL_GetAtomicInt(&request->cancelled)) {
+		request->valid = false;
+		return;
+	}
+	request->valid = lz4_block_decompress(request->compressed, request->compressed_size,
+		(uint8_t*) request->tiles, sizeof(request->tiles));
+}
+
+static bool world_stream_is_requested(const WorldStream* stream, int32_t chunk_x, int32_t chunk_y) {
+	for (uint32_t i = 0; i < WORLD_STREAM_MAX_REQUESTS; i++) {
+		const WorldStreamRequest* request = &stream->requests[i];
+		if (request->active && request->chunk_x == chunk_x && request->chunk_y == chunk_y) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void world_stream_finish_reads(WorldStream* stream) {
+	/*
+	 * Put the chunks which have been read in the store
+	 */
+	for (uint32_t i = 0; i < WORLD_STREAM_MAX_REQUESTS; i++) {
+		WorldStreamRequest* request = &stream->requests[i];
+		if (!request->active || !jobs_is_done(&request->counter)) {
+			continue;
+		}
+		request->active = false;
+		stream->regions[request->region].pending--;
+
+		if (SDL_GetAtomicInt(&request->cancelled)) {
+			stream->cancelled_count++;
+			continue;
+		}
+		if (!request->valid) {
+			fprintf(stderr, "Chunk %d, %d is corrupt, so it's left empty\n", request->chunk_x, request->chunk_y);
+			continue;
+		}
+		// An edit could have made the chunk while it was being read, which
+		// wins
+		if (tile_store_find_chunk(stream->store, request->chunk_x, request->chunk_y) != NULL) {
+			continue;
+		}
+
+		TileStoreChunk* chunk = tile_store_put_chunk(stream->store, request->chunk_x, request->chunk_y, request->tiles);
+		if (chunk != NULL) {
+			chunk->last_used = stream->frame;
+			stream->loaded_count++;
+			stream->chunk_changed(request->chunk_x, request->chunk_y, stream->chunk_changed_data);
+		}
+	}
+}
+
+static void world_stream_request_chunk(WorldStream* stream, WorldStreamRequest* request, int32_t chunk_x, int32_t chunk_y) {
+	/*
+	 * Start reading a chunk the store doesn't have, unless it's empty
+	 *
+	 * @param request One which isn't active, which is left alone if there's
+	 *                nothing to read
+	 */
+
+	int32_t region_x = world_floor_div(chunk_x, WORLD_REGION_CHUNKS);
+	int32_t region_y = world_floor_div(chunk_y, WORLD_REGION_CHUNKS);
+	WorldRegion* region = world_stream_get_region(stream, region_x, region_y);
+	if (region == NULL || region->entries == NULL) {
+		return;
+	}
+
+	uint32_t local_x = (uint32_t) (chunk_x - region_x * WORLD_REGION_CHUNKS);
+	uint32_t local_y = (uint32_t) (chunk_y - region_y * WORLD_REGION_CHUNKS);
+	const WorldRegionEntry* entry = &region->entries[local_x + local_y * WORLD_REGION_CHUNKS];
+	if (entry->size == 0) {
+		return;
+	}
+
+	request->active = true;
+	request->chunk_x = chunk_x;
+	request->chunk_y = chunk_y;
+	request->region = (uint32_t) (region - stream->regions);
+	request->compressed = (const uint8_t*) region->file.data + entry->offset;
+	request->compressed_size = entry->size;
+	request->valid = false;
+	SDL_SetAtomicInt(&request->cancelled, 0);
+	region->pending++;
+	jobs_submit(world_stream_read_chunk, request, &request->counter);
+}
+
+static float world_time_to_visible(int32_t chunk_x, int32_t chunk_y, const float view[4], const float velocity[2]) {
+	/*
+	 * Estimate the seconds until a chunk comes into view, from the gap
+	 * between them and how fast the camera is closing it
+	 */
+	float min_x = (float) chunk_x * TILE_STORE_CHUNK_SIZE;
+	float min_y = (float) chunk_y * TILE_STORE_CHUNK_SIZE;
+	float max_x = min_x + TILE_STORE_CHUNK_SIZE;
+	float max_y = min_y + TILE_STORE_CHUNK_SIZE;
+
+	// Signed, towards the chunk
+	float gap_x = min_x > view[2] ? min_x - view[2] : (max_x < view[0] ? max_x - view[0] : 0.0f);
+	float gap_y = min_y > view[3] ? min_y - view[3] : (max_y < view[1] ? max_y - view[1] : 0.0f);
+	float distance = sqrtf(gap_x * gap_x + gap_y * gap_y);
+	if (distance == 0.0f) {
+		return 0.0f;
+	}
+
+	float closing = (velocity[0] * gap_x + velocity[1] * gap_y) / distance;
+	return distance / (closing > WORLD_STREAM_MIN_SPEED ? closing : WORLD_STREAM_MIN_SPEED);
+}
+
+static int world_compare_times(const void* a, const void* b) {
+	const WorldStreamCandidate* first = a;
+	const WorldStreamCandidate* second = b;
+	return (first->time > second->time) - (first->time < second->time);
+}
+
+static void world_stream_add_candidate(WorldStream* stream, uint32_t* count, WorldStreamCandidate candidate) {
+	if (*count == stream->candidates_capacity) {
+		uint32_t capacity = stream->candidates_capacity > 0 ? stream->candidates_capacity * 2 : 256;
+		WorldStreamCandidate* candidates = realloc(stream->candidates, sizeof(WorldStreamCandidate) * capacity);
+		if (candidates == NULL) {
+			fprintf(stderr, "Failed to allocate %u chunks to stream\n", capacity);
+			exit(1);
+		}
+		stream->candidates = candidates;
+		stream->candidates_capacity = capacity;
+	}
+	stream->candidates[(*count)++] = candidate;
+}
+
+static int world_compare_candidates(const void* a, const void* b) {
+	// Least recently used first, then the furthest away
+	const WorldEvictionCandidate* first = a;
+	const WorldEvictionCandidate* second = b;
+	if (first->last_used != second->last_used) {
+		return first->last_used < second->last_used ? -1 : 1;
+	}
+	return (first->distance < second->distance) - (first->distance > second->distance);
+}
+
+static void world_stream_evict(WorldStream* stream, const float view[4]) {
+	/*
+	 * Evict chunks which weren't needed this frame until the rest fit in the
+	 * memory budget
+	 */
+	TileStore* store = stream->store;
+	size_t chunks_budget = stream->memory_budget / sizeof(TileStoreChunk);
+	if (store->chunks_count <= chunks_budget) {
+		return;
+	}
+
+	WorldEvictionCandidate* candidates = malloc(sizeof(WorldEvictionCandidate) * store->chunks_count);
+	if (candidates == NULL) {
+		fprintf(stderr, "Failed to allocate the chunks to evict\n");
+		exit(1);
+	}
+
+	float centre_x = (view[0] + view[2]) * 0.5f;
+	float centre_y = (view[1] + view[3]) * 0.5f;
+	uint32_t candidates_count = 0;
+	for (uint32_t i = 0; i < store->chunks_count; i++) {
+		const TileStoreChunk* chunk = store->chunks[i];
+		if (chunk->last_used == stream->frame) {
+			continue;
+		}
+		float dx = ((float) chunk->x + 0.5f) * TILE_STORE_CHUNK_SIZE - centre_x;
+		float dy = ((float) chunk->y + 0.5f) * TILE_STORE_CHUNK_SIZE - centre_y;
+		candidates[candidates_count++] = (WorldEvictionCandidate) {
+			.last_used = chunk->last_used,
+			.distance = dx * dx + dy * dy,
+			.x = chunk->x,
+			.y = chunk->y,
+		};
+	}
+	qsort(candidates, candidates_count, sizeof(WorldEvictionCandidate), world_compare_candidates);
+
+	for (uint32_t i = 0; i < candidates_count && store->chunks_count > chunks_budget; i++) {
+		tile_store_remove_chunk(store, candidates[i].x, candidates[i].y);
+		stream->evicted_count++;
+		stream->chunk_changed(candidates[i].x, candidates[i].y, stream->chunk_changed_data);
+	}
+
+	free(candidates);
+}
+
+void world_stream_init(WorldStream* stream, const char* prefix, TileStore* store, size_t memory_budget,
+		WorldChunkFunc chunk_changed, void* chunk_changed_data) {
+	/*
+	 * Start streaming a world into a store
+	 *
+	 * @param prefix The start of the region filenames, as given to
+	 *               world_write_regions()
+	 * @param store Where the chunks go, which should start out empty
+	 * @param memory_budget Bytes of chunks to keep before evicting any
+	 * @param chunk_changed Called on the thread calling world_stream_update()
+	 *                      for each chunk which comes or goes
+	 */
+	memset(stream, 0, sizeof(WorldStream));
+	stream->prefix = prefix;
+	stream->store = store;
+	stream->memory_budget = memory_budget;
+	stream->chunk_changed = chunk_changed;
+	stream->chunk_changed_data = chunk_changed_data;
+}
+
+void world_stream_cleanup(WorldStream* stream) {
+	/*
+	 * Wait for the reads in flight, and close the regions.  The store keeps
+	 * the chunks
+	 */
+	for (uint32_t i = 0; i < WORLD_STREAM_MAX_REQUESTS; i++) {
+		if (stream->requests[i].active) {
+			jobs_wait(&stream->requests[i].counter);
+		}
+	}
+	for (uint32_t i = 0; i < WORLD_STREAM_MAX_REGIONS; i++) {
+		world_stream_close_region(&stream->regions[i]);
+	}
+	free(stream->candidates);
+	memset(stream, 0, sizeof(WorldStream));
+}
+
+void world_stream_update(WorldStream* stream, const float view[4], const float velocity[2]) {
+	/*
+	 * Take in the chunks which have been read, start reading the ones about
+	 * to be visible, and evict what's over the budget.  Once a frame
+	 *
+	 * @param view The world rectangle (in tiles) the camera sees, as min x,
+	 *             min y, max x, max y
+	 * @param velocity How fast the camera is moving, in tiles a second
+	 */
+	stream->frame++;
+	world_stream_finish_reads(stream);
+
+	// The window, in chunks
+	float window[4];
+	memcpy(window, view, sizeof(window));
+	const float max_ahead = (float) (WORLD_STREAM_MAX_LOOKAHEAD * TILE_STORE_CHUNK_SIZE);
+	for (int i = 0; i < 2; i++) {
+		float ahead = velocity[i] * WORLD_STREAM_LOOKAHEAD;
+		ahead = ahead < -max_ahead ? -max_ahead : (ahead > max_ahead ? max_ahead : ahead);
+		window[i] += ahead < 0.0f ? ahead : 0.0f;
+		window[i + 2] += ahead > 0.0f ? ahead : 0.0f;
+	}
+	int32_t min_x = (int32_t) floorf(window[0] / TILE_STORE_CHUNK_SIZE) - WORLD_STREAM_MARGIN;
+	int32_t min_y = (int32_t) floorf(window[1] / TILE_STORE_CHUNK_SIZE) - WORLD_STREAM_MARGIN;
+	int32_t max_x = (int32_t) floorf(window[2] / TILE_STORE_CHUNK_SIZE) + WORLD_STREAM_MARGIN;
+	int32_t max_y = (int32_t) floorf(window[3] / TILE_STORE_CHUNK_SIZE) + WORLD_STREAM_MARGIN;
+
+	// Reads which are no longer needed
+	for (uint32_t i = 0; i < WORLD_STREAM_MAX_REQUESTS; i++) {
+		WorldStreamRequest* request = &stream->requests[i];
+		bool in_window = request->chunk_x >= min_x && request->chunk_x <= max_x
+			&& request->chunk_y >= min_y && request->chunk_y <= max_y;
+		if (request->active && !in_window) {
+			SDL_SetAtomicInt(&request->cancelled, 1);
+		}
+	}
+
+	uint32_t candidates_count = 0;
+	for (int32_t y = min_y; y <= max_y; y++) {
+		for (int32_t x = min_x; x <= max_x; x++) {
+			TileStoreChunk* chunk = (TileStoreChunk*) tile_store_find_chunk(stream->store, x, y);
+			if (chunk != NULL) {
+				chunk->last_used = stream->frame;
+			}
+			else if (!world_stream_is_requested(stream, x, y)) {
+				WorldStreamCandidate candidate = {world_time_to_visible(x, y, view, velocity), x, y};
+				world_stream_add_candidate(stream, &candidates_count, candidate);
+			}
+		}
+	}
+
+	// Soonest first, for as many as there are requests free
+	qsort(stream->candidates, candidates_count, sizeof(WorldStreamCandidate), world_compare_times);
+	uint32_t next = 0;
+	for (uint32_t i = 0; i < WORLD_STREAM_MAX_REQUESTS && next < candidates_count; i++) {
+		WorldStreamRequest* request = &stream->requests[i];
+		while (!request->active && next < candidates_count) {
+			world_stream_request_chunk(stream, request, stream->candidates[next].x, stream->candidates[next].y);
+			next++;
+		}
+	}
+
+	world_stream_evict(stream, view);
+}
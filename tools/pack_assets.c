@@ -0,0 +1,166 @@
+/*
+ * Packs asset files into an archive for the renderer (see archive.h).
+ *
+ *   pack_assets [-z] <archive> <files...>
+ *
+ * Each file is stored under the path it is given as, so run it from the
+ * directory the renderer runs in, with the shaders' .spv files and the
+ * textures' .png files (pack_assets.sh does this for dist/).
+ *
+ * With -z the entries are LZ4 compressed, apart from the ones which don't get
+ * any smaller (like the PNGs).
+ */
+
+#include "archive.h"
+#include "io.h"
+#include "lz4_block.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+	const char* path;
+	ArchiveEntry entry;
+	// What is written for the entry, either the mapped file or the
+	// compressed copy
+	MappedFile file;
+	uint8_t* compressed;
+	const void* payload;
+} PackedFile;
+
+static int compare_packed_files(const void* a, const void* b) {
+	uint64_t hash_a = ((const PackedFile*) a)->entry.name_hash;
+	uint64_t hash_b = ((const PackedFile*) b)->entry.name_hash;
+	return (hash_a > hash_b) - (hash_a < hash_b);
+}
+
+static uint64_t align_offset(uint64_t offset) {
+	return (offset + ARCHIVE_ALIGNMENT - 1) / ARCHIVE_ALIGNMENT * ARCHIVE_ALIGNMENT;
+}
+
+static void write_padding(FILE* output, uint64_t* offset, uint64_t target) {
+	static const uint8_t zeros[ARCHIVE_ALIGNMENT] = {0};
+	while (*offset < target) {
+		uint64_t count = target - *offset;
+		if (count > sizeof(zeros)) {
+			count = sizeof(zeros);
+		}
+		fwrite(zeros, 1, (size_t) count, output);
+		*offset += count;
+	}
+}
+
+int main(int argc, char** argv) {
+	bool compress = false;
+	int first_arg = 1;
+	if (argc > 1 && strcmp(argv[1], "-z") == 0) {
+		compress = true;
+		first_arg = 2;
+	}
+
+	if (argc - first_arg < 2) {
+		fprintf(stderr, "Usage: %s [-z] <archive> <files...>\n", argv[0]);
+		return 1;
+	}
+
+	const char* archive_path = argv[first_arg];
+	uint32_t files_count = (uint32_t) (argc - first_arg - 1);
+
+	PackedFile* files = calloc(files_count, sizeof(PackedFile));
+	if (files == NULL) {
+		fprintf(stderr, "Failed to allocate the file list\n");
+		return 1;
+	}
+
+	uint64_t stored_total = 0;
+	uint64_t uncompressed_total = 0;
+
+	for (uint32_t i = 0; i < files_count; i++) {
+		PackedFile* file = &files[i];
+		file->path = argv[first_arg + 1 + i];
+		file->file = map_disk_file(file->path);
+		file->payload = file->file.data;
+
+		file->entry.name_hash = archive_hash_name(file->path);
+		file->entry.compression = ARCHIVE_COMPRESSION_NONE;
+		file->entry.size = file->file.size;
+		file->entry.uncompressed_size = file->file.size;
+
+		if (compress && file->file.size > 0) {
+			size_t capacity = LZ4_BLOCK_BOUND(file->file.size);
+			file->compressed = malloc(capacity);
+			if (file->compressed == NULL) {
+				fprintf(stderr, "Failed to allocate %zu bytes to compress %s\n", capacity, file->path);
+				return 1;
+			}
+
+			size_t compressed_size = lz4_block_compress(file->file.data, file->file.size, file->compressed, capacity);
+			if (compressed_size > 0 && compressed_size < file->file.size) {
+				file->entry.compression = ARCHIVE_COMPRESSION_LZ4;
+				file->entry.size = compressed_size;
+				file->payload = file->compressed;
+			}
+		}
+
+		stored_total += file->entry.size;
+		uncompressed_total += file->entry.uncompressed_size;
+	}
+
+	// Sorted for the reader's binary search, which also shows up any clashes
+	qsort(files, files_count, sizeof(PackedFile), compare_packed_files);
+	for (uint32_t i = 1; i < files_count; i++) {
+		if (files[i].entry.name_hash == files[i - 1].entry.name_hash) {
+			fprintf(stderr, "%s and %s have the same name hash (or are the same file)\n", files[i - 1].path, files[i].path);
+			return 1;
+		}
+	}
+
+	uint64_t offset = align_offset(sizeof(ArchiveHeader) + sizeof(ArchiveEntry) * (uint64_t) files_count);
+	for (uint32_t i = 0; i < files_count; i++) {
+		files[i].entry.offset = offset;
+		offset = align_offset(offset + files[i].entry.size);
+	}
+
+	FILE* output = fopen(archive_path, "wb");
+	if (output == NULL) {
+		fprintf(stderr, "Failed to open %s for writing\n", archive_path);
+		return 1;
+	}
+
+	ArchiveHeader header = {0};
+	header.magic = ARCHIVE_MAGIC;
+	header.version = ARCHIVE_VERSION;
+	header.entries_count = files_count;
+	fwrite(&header, sizeof(header), 1, output);
+
+	for (uint32_t i = 0; i < files_count; i++) {
+		fwrite(&files[i].entry, sizeof(ArchiveEntry), 1, output);
+	}
+
+	uint64_t written = sizeof(ArchiveHeader) + sizeof(ArchiveEntry) * (uint64_t) files_count;
+	for (uint32_t i = 0; i < files_count; i++) {
+		write_padding(output, &written, files[i].entry.offset);
+		if (files[i].entry.size > 0) {
+			fwrite(files[i].payload, 1, (size_t) files[i].entry.size, output);
+			written += files[i].entry.size;
+		}
+	}
+	write_padding(output, &written, align_offset(written));
+
+	if (ferror(output) || fclose(output) != 0) {
+		fprintf(stderr, "Failed to write %s\n", archive_path);
+		return 1;
+	}
+
+	for (uint32_t i = 0; i < files_count; i++) {
+		free(files[i].compressed);
+		unmap_file(&files[i].file);
+	}
+	free(files);
+
+	printf("Packed %d files into %s (%llu bytes stored, %llu uncompressed)\n", files_count, archive_path,
+			(unsigned long long) stored_total, (unsigned long long) uncompressed_total);
+
+	return 0;
+}
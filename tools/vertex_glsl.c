@@ -0,0 +1,290 @@
+/*
+ * Writes the GLSL side of the vertex formats in vertex_formats.h, so the
+ * shaders can't drift from the C structs and the attribute descriptions.
+ *
+ *   vertex_glsl <output>
+ *
+ * which the vertex_formats target runs for shaders/vertex_formats.glsl.
+ *
+ * A format's vertex inputs are behind a #ifdef of its name, e.g. a shader
+ * defines SPRITE_VERTEX_INPUTS before including the file to get the sprites'.
+ * The sprites also come as a struct of words (SPRITE_VERTEX_RECORD) for the
+ * shaders which read them from buffers themselves, as they don't make up a
+ * valid std430 struct, with a function to unpack each field as the vertex
+ * input would.
+ */
+
+#include "vertex_formats.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef enum {
+	FIELD_KIND_VERTEX_FLOAT,
+	FIELD_KIND_VERTEX_HALF,
+	FIELD_KIND_VERTEX_UNORM8,
+	FIELD_KIND_VERTEX_UNORM16,
+	FIELD_KIND_VERTEX_UINT8,
+	FIELD_KIND_VERTEX_UINT16,
+	FIELD_KIND_VERTEX_UINT32,
+} FieldKind;
+
+#define FIELD_KIND(kind) VERTEX_PASTE(FIELD_KIND_, kind)
+
+typedef struct {
+	// Bytes a component
+	uint32_t size;
+	// uint/uvecN in GLSL rather than float/vecN
+	bool integer;
+} FieldKindInfo;
+
+static const FieldKindInfo FIELD_KINDS[] = {
+	[FIELD_KIND_VERTEX_FLOAT] = {4, false},
+	[FIELD_KIND_VERTEX_HALF] = {2, false},
+	[FIELD_KIND_VERTEX_UNORM8] = {1, false},
+	[FIELD_KIND_VERTEX_UNORM16] = {2, false},
+	[FIELD_KIND_VERTEX_UINT8] = {1, true},
+	[FIELD_KIND_VERTEX_UINT16] = {2, true},
+	[FIELD_KIND_VERTEX_UINT32] = {4, true},
+};
+
+typedef struct {
+	const char* name;
+	FieldKind kind;
+	uint32_t count;
+	// -1 for padding
+	int32_t location;
+	size_t offset;
+} Field;
+
+#define TOOL_FIELD(T, name, kind, count, location) {#name, FIELD_KIND(kind), count, location, offsetof(T, name)},
+#define TOOL_PAD(T, name, kind, count) {#name, FIELD_KIND(kind), count, -1, offsetof(T, name)},
+
+typedef struct {
+	SPRITE_VERTEX_FIELDS(VERTEX_STRUCT_FIELD, VERTEX_STRUCT_PAD, SpriteVertex)
+} SpriteVertex;
+
+typedef struct {
+	FRAMED_SPRITE_VERTEX_FIELDS(VERTEX_STRUCT_FIELD, VERTEX_STRUCT_PAD, FramedSpriteVertex)
+} FramedSpriteVertex;
+
+typedef struct {
+	SKINNED_VERTEX_FIELDS(VERTEX_STRUCT_FIELD, VERTEX_STRUCT_PAD, SkinnedVertex)
+} SkinnedVertex;
+
+typedef struct {
+	TILE_VERTEX_FIELDS(VERTEX_STRUCT_FIELD, VERTEX_STRUCT_PAD, TileVertex)
+} TileVertex;
+
+typedef struct {
+	QUAD_VERTEX_FIELDS(VERTEX_STRUCT_FIELD, VERTEX_STRUCT_PAD, QuadVertex)
+} QuadVertex;
+
+static const Field SPRITE_FIELDS[] = {SPRITE_VERTEX_FIELDS(TOOL_FIELD, TOOL_PAD, SpriteVertex)};
+static const Field FRAMED_SPRITE_FIELDS[] = {FRAMED_SPRITE_VERTEX_FIELDS(TOOL_FIELD, TOOL_PAD, FramedSpriteVertex)};
+static const Field SKINNED_FIELDS[] = {SKINNED_VERTEX_FIELDS(TOOL_FIELD, TOOL_PAD, SkinnedVertex)};
+static const Field TILE_FIELDS[] = {TILE_VERTEX_FIELDS(TOOL_FIELD, TOOL_PAD, TileVertex)};
+static const Field QUAD_FIELDS[] = {QUAD_VERTEX_FIELDS(TOOL_FIELD, TOOL_PAD, QuadVertex)};
+
+typedef struct {
+	// The struct in the renderer, and the #ifdef the format is behind
+	const char* c_name;
+	const char* guard;
+	// The struct of words and its functions' prefix, or NULL for just the
+	// vertex inputs
+	const char* record_name;
+	const char* record_prefix;
+	const Field* fields;
+	uint32_t fields_count;
+	size_t size;
+} Format;
+
+#define FORMAT(c_name, guard, record_name, record_prefix, fields, T) \
+	{c_name, guard, record_name, record_prefix, fields, sizeof(fields) / sizeof(fields[0]), sizeof(T)}
+
+static const Format FORMATS[] = {
+	FORMAT("VertexBufferSprite", "SPRITE_VERTEX", "SpriteRecord", "sprite_record", SPRITE_FIELDS, SpriteVertex),
+	FORMAT("VertexBufferFramedSprite", "FRAMED_SPRITE_VERTEX", NULL, NULL, FRAMED_SPRITE_FIELDS, FramedSpriteVertex),
+	FORMAT("SkinnedVertex", "SKINNED_VERTEX", NULL, NULL, SKINNED_FIELDS, SkinnedVertex),
+	FORMAT("TileVertex", "TILE_VERTEX", NULL, NULL, TILE_FIELDS, TileVertex),
+	FORMAT("Vertex", "QUAD_VERTEX", NULL, NULL, QUAD_FIELDS, QuadVertex),
+};
+
+static void write_glsl_type(FILE* output, const Field* field) {
+	bool integer = FIELD_KINDS[field->kind].integer;
+	if (field->count == 1) {
+		fputs(integer ? "uint" : "float", output);
+	}
+	else {
+		fprintf(output, "%s%u", integer ? "uvec" : "vec", field->count);
+	}
+}
+
+static void write_upper(FILE* output, const char* name) {
+	for (const char* c = name; *c != '\0'; c++) {
+		fputc(*c >= 'a' && *c <= 'z' ? *c - 'a' + 'A' : *c, output);
+	}
+}
+
+static void write_inputs(FILE* output, const Format* format) {
+	fprintf(output, "\n#ifdef %s_INPUTS\n", format->guard);
+	fprintf(output, "// %s, %zu bytes\n", format->c_name, format->size);
+
+	// In the order of their locations, which isn't always the struct's
+	for (int32_t location = 0; location < (int32_t) format->fields_count; location++) {
+		for (uint32_t i = 0; i < format->fields_count; i++) {
+			const Field* field = &format->fields[i];
+			if (field->location != location) {
+				continue;
+			}
+			fprintf(output, "layout(location = %d) in ", location);
+			write_glsl_type(output, field);
+			fprintf(output, " %s_in;\n", field->name);
+		}
+	}
+
+	fputs("#endif\n", output);
+}
+
+static void write_component(FILE* output, const Field* field, uint32_t component) {
+	/*
+	 * The GLSL for a component of a field, from the words of a record
+	 */
+	uint32_t size = FIELD_KINDS[field->kind].size;
+	size_t offset = field->offset + (size_t) size * component;
+	size_t word = offset / 4;
+	uint32_t shift = (uint32_t) (offset % 4) * 8;
+
+	if (size == 4) {
+		const char* format = field->kind == FIELD_KIND_VERTEX_FLOAT ? "uintBitsToFloat(record.words[%zu])" : "record.words[%zu]";
+		fprintf(output, format, word);
+		return;
+	}
+
+	// The component's bits at the bottom of a uint
+	char bits[64];
+	uint32_t mask = (1u << (size * 8)) - 1;
+	if (shift + size * 8 == 32) {
+		snprintf(bits, sizeof(bits), "(record.words[%zu] >> %u)", word, shift);
+	}
+	else if (shift == 0) {
+		snprintf(bits, sizeof(bits), "(record.words[%zu] & 0x%xu)", word, mask);
+	}
+	else {
+		snprintf(bits, sizeof(bits), "((record.words[%zu] >> %u) & 0x%xu)", word, shift, mask);
+	}
+
+	switch (field->kind) {
+	case FIELD_KIND_VERTEX_HALF:
+		fprintf(output, "unpackHalf2x16%s.x", bits);
+		break;
+	case FIELD_KIND_VERTEX_UNORM8:
+		fprintf(output, "float%s / 255.0", bits);
+		break;
+	case FIELD_KIND_VERTEX_UNORM16:
+		fprintf(output, "float%s / 65535.0", bits);
+		break;
+	default:
+		fputs(bits, output);
+		break;
+	}
+}
+
+static void write_unpack(FILE* output, const Format* format, const Field* field) {
+	write_glsl_type(output, field);
+	fprintf(output, " %s_%s(%s record) {\n\treturn ", format->record_prefix, field->name, format->record_name);
+
+	// A whole word of a packed pair or four, which the GPU unpacks at once
+	uint32_t size = FIELD_KINDS[field->kind].size;
+	if (field->offset % 4 == 0 && size * field->count == 4 && field->count > 1 && !FIELD_KINDS[field->kind].integer) {
+		const char* function = field->kind == FIELD_KIND_VERTEX_UNORM8 ? "unpackUnorm4x8"
+			: field->kind == FIELD_KIND_VERTEX_UNORM16 ? "unpackUnorm2x16" : "unpackHalf2x16";
+		fprintf(output, "%s(record.words[%zu]);\n}\n\n", function, field->offset / 4);
+		return;
+	}
+
+	if (field->count > 1) {
+		write_glsl_type(output, field);
+		fputc('(', output);
+	}
+	for (uint32_t i = 0; i < field->count; i++) {
+		if (i > 0) {
+			fputs(", ", output);
+		}
+		write_component(output, field, i);
+	}
+	if (field->count > 1) {
+		fputc(')', output);
+	}
+	fputs(";\n}\n\n", output);
+}
+
+static void write_record(FILE* output, const Format* format) {
+	if (format->size % 4 != 0) {
+		fprintf(stderr, "%s isn't a whole number of words\n", format->c_name);
+		exit(1);
+	}
+
+	fprintf(output, "\n#ifdef %s_RECORD\n", format->guard);
+	fprintf(output, "// %s as words\n", format->c_name);
+	fputs("const uint ", output);
+	write_upper(output, format->record_prefix);
+	fprintf(output, "_WORDS = %zu;\n", format->size / 4);
+
+	// Where each field starts, for the shaders which copy or write the words
+	for (uint32_t i = 0; i < format->fields_count; i++) {
+		const Field* field = &format->fields[i];
+		if (field->location < 0) {
+			continue;
+		}
+		fputs("const uint ", output);
+		write_upper(output, format->record_prefix);
+		fputc('_', output);
+		write_upper(output, field->name);
+		fprintf(output, "_WORD = %zu;\n", field->offset / 4);
+	}
+
+	fprintf(output, "\nstruct %s {\n\tuint words[", format->record_name);
+	write_upper(output, format->record_prefix);
+	fputs("_WORDS];\n};\n\n", output);
+
+	for (uint32_t i = 0; i < format->fields_count; i++) {
+		if (format->fields[i].location >= 0) {
+			write_unpack(output, format, &format->fields[i]);
+		}
+	}
+
+	fputs("#endif\n", output);
+}
+
+int main(int argc, char** argv) {
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s <output>\n", argv[0]);
+		return 1;
+	}
+
+	FILE* output = fopen(argv[1], "wb");
+	if (output == NULL) {
+		fprintf(stderr, "Failed to open %s\n", argv[1]);
+		return 1;
+	}
+
+	fputs("// Generated by tools/vertex_glsl.c from include/vertex_formats.h - don't edit\n", output);
+	fputs("//\n", output);
+	fputs("// Define a format's name before including this for its vertex inputs, e.g.\n", output);
+	fputs("// SPRITE_VERTEX_INPUTS, or its struct of words, e.g. SPRITE_VERTEX_RECORD\n", output);
+
+	for (size_t i = 0; i < sizeof(FORMATS) / sizeof(FORMATS[0]); i++) {
+		write_inputs(output, &FORMATS[i]);
+		if (FORMATS[i].record_name != NULL) {
+			write_record(output, &FORMATS[i]);
+		}
+	}
+
+	if (fclose(output) != 0) {
+		fprintf(stderr, "Failed to write %s\n", argv[1]);
+		return 1;
+	}
+	return 0;
+}
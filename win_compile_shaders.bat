@@ -35,6 +35,28 @@ for %%f in (*.frag) do (
     )
 )
 
+REM Loop through all .comp files and compile them, their subgroup operations need SPIR-V 1.3
+for %%f in (*.comp) do (
+    echo Compiling %%f...
+    glslc --target-env=vulkan1.1 "%%f" -o "%%~nf.comp.spv"
+    if errorlevel 1 (
+        echo Error compiling %%f
+    ) else (
+        echo Successfully compiled %%f to %%~nf.comp.spv
+    )
+)
+
+REM Loop through all .task and .mesh files and compile them, they need SPIR-V 1.4
+for %%f in (*.task *.mesh) do (
+    echo Compiling %%f...
+    glslc --target-env=vulkan1.3 "%%f" -o "%%f.spv"
+    if errorlevel 1 (
+        echo Error compiling %%f
+    ) else (
+        echo Successfully compiled %%f to %%f.spv
+    )
+)
+
 echo Compilation process completed.
 
 REM Change back to the original directory